@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Stands in for xz-embedded's xz_crc32.c and xz_crc64.c. Whole 16-byte blocks are folded together with carry-less
+ * multiplication (PCLMULQDQ on x86-64, PMULL on ARMv8) when the CPU has it, which leaves a single block with the
+ * same CRC as all of them. That block and any tail go through the same tables as xz-embedded's.
+ */
+
+#include <xz.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(XZ_CRC_CLMUL) && defined(__x86_64__)
+#include <immintrin.h>
+
+#define XZ_CRC_TARGET __attribute__((target("pclmul,sse2")))
+
+typedef __m128i lane_t;
+
+static XZ_CRC_TARGET lane_t load_lane(const uint8_t *buf)
+{
+	return _mm_loadu_si128((const __m128i *)buf);
+}
+
+static XZ_CRC_TARGET void store_lane(uint8_t *buf, lane_t x)
+{
+	_mm_storeu_si128((__m128i *)buf, x);
+}
+
+static XZ_CRC_TARGET lane_t make_lane(uint64_t low, uint64_t high)
+{
+	return _mm_set_epi64x((int64_t)high, (int64_t)low);
+}
+
+static XZ_CRC_TARGET lane_t fold_lane(lane_t x, lane_t next, lane_t k)
+{
+	return _mm_xor_si128(next, _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)));
+}
+
+static int has_clmul(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("pclmul");
+}
+#elif defined(XZ_CRC_CLMUL) && defined(__aarch64__)
+#include <arm_neon.h>
+
+#if defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+#if defined(__ARM_FEATURE_CRYPTO)
+#define XZ_CRC_TARGET
+#else
+#define XZ_CRC_TARGET __attribute__((target("+crypto")))
+#endif
+
+typedef uint64x2_t lane_t;
+
+static XZ_CRC_TARGET lane_t load_lane(const uint8_t *buf)
+{
+	return vreinterpretq_u64_u8(vld1q_u8(buf));
+}
+
+static XZ_CRC_TARGET void store_lane(uint8_t *buf, lane_t x)
+{
+	vst1q_u8(buf, vreinterpretq_u8_u64(x));
+}
+
+static XZ_CRC_TARGET lane_t make_lane(uint64_t low, uint64_t high)
+{
+	return vcombine_u64(vcreate_u64(low), vcreate_u64(high));
+}
+
+static XZ_CRC_TARGET lane_t fold_lane(lane_t x, lane_t next, lane_t k)
+{
+	const poly128_t low = vmull_p64((poly64_t)vgetq_lane_u64(x, 0), (poly64_t)vgetq_lane_u64(k, 0));
+	const poly128_t high = vmull_p64((poly64_t)vgetq_lane_u64(x, 1), (poly64_t)vgetq_lane_u64(k, 1));
+
+	return veorq_u64(next, veorq_u64(vreinterpretq_u64_p128(low), vreinterpretq_u64_p128(high)));
+}
+
+static int has_clmul(void)
+{
+#if defined(__APPLE__) || defined(__ARM_FEATURE_CRYPTO)
+	return 1;
+#elif defined(__linux__)
+	return (getauxval(AT_HWCAP) & HWCAP_PMULL) != 0;
+#else
+	return 0;
+#endif
+}
+#else
+#undef XZ_CRC_CLMUL
+#endif
+
+#ifdef XZ_CRC_CLMUL
+/*
+ * Folding constants, for the reflected polynomial, as {x^(d+63), x^(d-1)} mod P at a distance d of 512 bits, when
+ * four blocks are folded at a time, and then of 128 bits. The one bit off in each makes up for the product of two
+ * 64-bit halves landing one bit short of the 128-bit block it is added to.
+ */
+static const uint64_t crc32_constants[4] = {
+	0x653d982200000000, 0xcad38e8f00000000, 0x65673b4600000000, 0x9ba54c6f00000000
+};
+
+static const uint64_t crc64_constants[4] = {
+	0x6ae3efbb9dd441f3, 0x081f6054a7842df4, 0xe05dd497ca393ae4, 0xdabe95afc7875f40
+};
+
+/* Only ever set to the same value, but read and written atomically all the same, whichever thread gets there first */
+static int use_clmul = -1;
+
+static void detect_clmul(void)
+{
+	if (__atomic_load_n(&use_clmul, __ATOMIC_RELAXED) < 0)
+		__atomic_store_n(&use_clmul, has_clmul(), __ATOMIC_RELAXED);
+}
+
+static int clmul_usable(void)
+{
+	return __atomic_load_n(&use_clmul, __ATOMIC_RELAXED) > 0;
+}
+
+/*
+ * Folds size bytes of buf, at least 64 and a multiple of 16, into the single block in out, crc having been added
+ * into its first bytes
+ */
+static XZ_CRC_TARGET void fold_blocks(const uint8_t *buf, size_t size, uint64_t crc, const uint64_t *k, uint8_t *out)
+{
+	lane_t x0;
+	lane_t x1 = load_lane(buf + 16);
+	lane_t x2 = load_lane(buf + 32);
+	lane_t x3 = load_lane(buf + 48);
+	lane_t k4 = make_lane(k[0], k[1]);
+	lane_t k1 = make_lane(k[2], k[3]);
+	uint8_t first[16];
+	size_t i;
+
+	for (i = 0; i < 16; ++i)
+		first[i] = buf[i] ^ (i < 8 ? (uint8_t)(crc >> (8 * i)) : 0);
+	x0 = load_lane(first);
+
+	buf += 64;
+	size -= 64;
+
+	while (size >= 64) {
+		x0 = fold_lane(x0, load_lane(buf), k4);
+		x1 = fold_lane(x1, load_lane(buf + 16), k4);
+		x2 = fold_lane(x2, load_lane(buf + 32), k4);
+		x3 = fold_lane(x3, load_lane(buf + 48), k4);
+		buf += 64;
+		size -= 64;
+	}
+
+	x0 = fold_lane(x0, x1, k1);
+	x0 = fold_lane(x0, x2, k1);
+	x0 = fold_lane(x0, x3, k1);
+
+	while (size >= 16) {
+		x0 = fold_lane(x0, load_lane(buf), k1);
+		buf += 16;
+		size -= 16;
+	}
+
+	store_lane(out, x0);
+}
+#endif
+
+static uint32_t xz_crc32_table[256];
+
+static uint32_t crc32_update(const uint8_t *buf, size_t size, uint32_t crc)
+{
+	while (size != 0) {
+		crc = xz_crc32_table[*buf++ ^ (crc & 0xFF)] ^ (crc >> 8);
+		--size;
+	}
+
+	return crc;
+}
+
+XZ_EXTERN void xz_crc32_init(void)
+{
+	const uint32_t poly = 0xEDB88320;
+
+	uint32_t i;
+	uint32_t j;
+	uint32_t r;
+
+	for (i = 0; i < 256; ++i) {
+		r = i;
+		for (j = 0; j < 8; ++j)
+			r = (r >> 1) ^ (poly & ~((r & 1) - 1));
+
+		xz_crc32_table[i] = r;
+	}
+
+#ifdef XZ_CRC_CLMUL
+	detect_clmul();
+#endif
+}
+
+XZ_EXTERN uint32_t xz_crc32(const uint8_t *buf, size_t size, uint32_t crc)
+{
+	crc = ~crc;
+
+#ifdef XZ_CRC_CLMUL
+	if (clmul_usable() && size >= 64) {
+		const size_t folded = size & ~(size_t)15;
+		uint8_t block[16];
+
+		fold_blocks(buf, folded, crc, crc32_constants, block);
+		crc = crc32_update(block, sizeof(block), 0);
+		buf += folded;
+		size -= folded;
+	}
+#endif
+
+	return ~crc32_update(buf, size, crc);
+}
+
+#ifdef XZ_USE_CRC64
+static uint64_t xz_crc64_table[256];
+
+static uint64_t crc64_update(const uint8_t *buf, size_t size, uint64_t crc)
+{
+	while (size != 0) {
+		crc = xz_crc64_table[*buf++ ^ (crc & 0xFF)] ^ (crc >> 8);
+		--size;
+	}
+
+	return crc;
+}
+
+XZ_EXTERN void xz_crc64_init(void)
+{
+	const uint64_t poly = 0xC96C5795D7870F42;
+
+	uint32_t i;
+	uint32_t j;
+	uint64_t r;
+
+	for (i = 0; i < 256; ++i) {
+		r = i;
+		for (j = 0; j < 8; ++j)
+			r = (r >> 1) ^ (poly & ~((r & 1) - 1));
+
+		xz_crc64_table[i] = r;
+	}
+
+#ifdef XZ_CRC_CLMUL
+	detect_clmul();
+#endif
+}
+
+XZ_EXTERN uint64_t xz_crc64(const uint8_t *buf, size_t size, uint64_t crc)
+{
+	crc = ~crc;
+
+#ifdef XZ_CRC_CLMUL
+	if (clmul_usable() && size >= 64) {
+		const size_t folded = size & ~(size_t)15;
+		uint8_t block[16];
+
+		fold_blocks(buf, folded, crc, crc64_constants, block);
+		crc = crc64_update(block, sizeof(block), 0);
+		buf += folded;
+		size -= folded;
+	}
+#endif
+
+	return ~crc64_update(buf, size, crc);
+}
+#endif
@@ -25,7 +25,10 @@
 #include <fmt/format.h>
 
 #include <algorithm>
+#include <functional>
+#include <iterator>
 #include <string>
+#include <vector>
 
 namespace multipass
 {
@@ -37,22 +40,27 @@ std::string status_string_for(const InstanceStatus& status);
 std::string image_string_for(const multipass::FindReply_AliasInfo& alias);
 Formatter* formatter_for(const std::string& format);
 
+// Orders references to the elements rather than copies of them, with the primary instance first
 template <typename Instances>
-Instances sorted(const Instances& instances);
+std::vector<std::reference_wrapper<const typename Instances::value_type>> sorted(const Instances& instances);
 
 void filter_aliases(google::protobuf::RepeatedPtrField<multipass::FindReply_AliasInfo>& aliases);
 } // namespace format
 }
 
 template <typename Instances>
-Instances multipass::format::sorted(const Instances& instances)
+std::vector<std::reference_wrapper<const typename Instances::value_type>>
+multipass::format::sorted(const Instances& instances)
 {
-    if (instances.empty())
-        return instances;
+    std::vector<std::reference_wrapper<const typename Instances::value_type>> ret(std::cbegin(instances),
+                                                                                 std::cend(instances));
+    if (ret.empty())
+        return ret;
 
-    auto ret = instances;
     const auto petenv_name = MP_SETTINGS.get(petenv_key).toStdString();
-    std::sort(std::begin(ret), std::end(ret), [&petenv_name](const auto& a, const auto& b) {
+    std::sort(std::begin(ret), std::end(ret), [&petenv_name](const auto& a_ref, const auto& b_ref) {
+        const auto& a = a_ref.get();
+        const auto& b = b_ref.get();
         if (a.name() == petenv_name)
             return true;
         else if (b.name() == petenv_name)
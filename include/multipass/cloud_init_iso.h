@@ -34,6 +34,8 @@ public:
     void write_to(const Path& path);
 
 private:
+    std::string make_image() const;
+
     struct FileEntry
     {
         std::string name;
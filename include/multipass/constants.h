@@ -33,9 +33,15 @@ constexpr auto default_memory_size = "1G";
 constexpr auto default_disk_size = "5G";
 constexpr auto default_cpu_cores = min_cpu_cores;
 constexpr auto default_timeout = std::chrono::seconds(300);
+constexpr auto max_launch_count = 64; // instances one launch can ask for, each prepared in a thread of its own
+
+constexpr auto default_storage_profile = "default";
+constexpr auto performance_storage_profile = "performance"; // disk tuned for throughput, where the backend can
 
 constexpr auto home_automount_dir = "Home";
 
+constexpr auto package_cache_port = 3142; // where instances find the host's package cache, apt-cacher's usual port
+
 constexpr auto driver_env_var = "MULTIPASS_VM_DRIVER";
 
 constexpr auto winterm_profile_guid =
@@ -45,6 +51,49 @@ constexpr auto petenv_key = "client.primary-name";     // This will eventually b
 constexpr auto driver_key = "local.driver";            // idem
 constexpr auto bridged_interface_key = "local.bridged-network"; // idem
 constexpr auto bridged_network_name = "bridged";
+constexpr auto baked_remote_name = "baked"; // the remote that images baked from instances are launched from
+constexpr auto image_cache_size_key = "local.image-cache-size"; // idem
+constexpr auto image_cache_peers_key = "local.image-cache-peers"; // idem
+constexpr auto image_bulk_storage_key = "local.image-bulk-storage"; // idem
+constexpr auto image_mirrors_key = "local.image-mirrors"; // idem
+constexpr auto download_concurrency_key = "local.download-concurrency"; // idem
+constexpr auto download_rate_key = "local.download-rate";               // idem
+constexpr auto start_concurrency_key = "local.start-concurrency";       // idem
+constexpr auto ssh_ciphers_key = "local.ssh-ciphers";                   // idem
+constexpr auto ssh_compression_key = "local.ssh-compression";           // idem
+constexpr auto ssh_compression_level_key = "local.ssh-compression-level"; // idem
+constexpr auto ssh_broker_key = "client.ssh-broker";                    // idem
+constexpr auto hosts_key = "client.hosts";                              // idem
+constexpr auto client_rpc_compression_key = "client.rpc.compression";   // idem
+constexpr auto client_rpc_keepalive_key = "client.rpc.keepalive";       // idem
+constexpr auto client_rpc_window_key = "client.rpc.window";             // idem
+constexpr auto memory_reclaim_key = "local.memory-reclaim";             // idem
+constexpr auto cpu_pinning_key = "local.cpu-pinning";                   // idem
+constexpr auto hugepages_key = "local.hugepages";                       // idem
+constexpr auto memory_merge_key = "local.memory-merge";                 // idem
+constexpr auto warm_pool_size_key = "local.warm-pool.size";             // idem
+constexpr auto warm_pool_image_key = "local.warm-pool.image";           // idem
+constexpr auto warm_pool_cpus_key = "local.warm-pool.cpus";             // idem
+constexpr auto warm_pool_memory_key = "local.warm-pool.memory";         // idem
+constexpr auto warm_pool_disk_key = "local.warm-pool.disk";             // idem
+constexpr auto max_warm_pool_size = 8;
+constexpr auto disk_overlays_key = "local.disk-overlays";               // idem
+constexpr auto lazy_boot_key = "local.lazy-boot";                       // idem
+constexpr auto compress_images_key = "local.compress-images";           // idem
+constexpr auto package_cache_key = "local.package-cache";               // idem
+constexpr auto keep_running_key = "local.keep-running";                 // idem
+constexpr auto shutdown_action_key = "local.shutdown-action";           // idem
+constexpr auto idle_suspend_key = "local.idle-suspend";                 // idem
+constexpr auto usage_history_interval_key = "local.usage-history-interval"; // idem
+constexpr auto rpc_compression_key = "local.rpc.compression";           // idem
+constexpr auto rpc_keepalive_key = "local.rpc.keepalive";               // idem
+constexpr auto rpc_window_key = "local.rpc.window";                     // idem
+constexpr auto rpc_max_streams_key = "local.rpc.max-streams";           // idem
+constexpr auto fast_boot_key = "local.fast-boot";                       // idem
+constexpr auto boot_readahead_key = "local.boot-readahead";             // idem
+constexpr auto admission_mode_key = "local.admission.mode";             // idem
+constexpr auto admission_cpus_key = "local.admission.cpus";             // idem
+constexpr auto admission_memory_key = "local.admission.memory";         // idem
 constexpr auto autostart_key = "client.gui.autostart"; // idem
 constexpr auto winterm_key = "client.apps.windows-terminal.profiles"; // idem
 constexpr auto hotkey_key = "client.gui.hotkey";                      // idem
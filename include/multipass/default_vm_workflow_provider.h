@@ -18,17 +18,24 @@
 #ifndef MULTIPASS_DEFAULT_VM_WORKFLOW_PROVIDER_H
 #define MULTIPASS_DEFAULT_VM_WORKFLOW_PROVIDER_H
 
+#include <multipass/memory_size.h>
+#include <multipass/optional.h>
 #include <multipass/path.h>
 #include <multipass/vm_workflow_provider.h>
 
 #include <yaml-cpp/yaml.h>
 
+#include <QByteArray>
 #include <QDir>
 #include <QString>
 #include <QUrl>
 
 #include <chrono>
 #include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace multipass
 {
@@ -51,6 +58,33 @@ public:
     int workflow_timeout(const std::string& workflow_name) override;
 
 private:
+    // What a workflow file says, read once per archive. Fields that do not check out keep the error to raise when
+    // they are asked for, so that one broken workflow does not take the others down with it
+    struct Workflow
+    {
+        std::string info_error;
+        QString description;
+        QString version;
+
+        std::string image_error;
+        std::string remote_name;
+        std::string release{"default"};
+
+        std::string min_cpus_error;
+        optional<int> min_cpus;
+        std::string min_mem_error;
+        optional<std::pair<std::string, MemorySize>> min_mem;
+        std::string min_disk_error;
+        optional<std::pair<std::string, MemorySize>> min_disk;
+
+        std::string vendor_data_error;
+        std::vector<std::pair<std::string, YAML::Node>> vendor_data;
+
+        std::string timeout_error;
+        int timeout_seconds{0};
+    };
+
+    static Workflow workflow_from(const std::string& workflow_name, const YAML::Node& workflow_config);
     void fetch_workflows();
     void update_workflows();
 
@@ -59,8 +93,10 @@ private:
     const QString archive_file_path;
     const std::chrono::milliseconds workflows_ttl;
     std::chrono::steady_clock::time_point last_update;
-    std::map<std::string, YAML::Node> workflow_map;
+    std::map<std::string, Workflow> workflow_map;
+    QByteArray archive_hash; // of the archive workflow_map was read from
     bool needs_update{true};
+    std::recursive_mutex workflows_mutex; // all_workflows() goes through info_for()
 };
 } // namespace multipass
 #endif // MULTIPASS_DEFAULT_VM_WORKFLOW_PROVIDER_H
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_DISK_IMAGE_H
+#define MULTIPASS_DISK_IMAGE_H
+
+#include <multipass/optional.h>
+#include <multipass/path.h>
+
+#include <QString>
+
+namespace multipass
+{
+namespace disk_image
+{
+struct Qcow2Info
+{
+    quint64 virtual_size;
+    quint32 version;
+    QString backing_file;
+    quint32 snapshot_count;
+};
+
+// Reads the header of a qcow2 image (versions 2 and 3) without spawning qemu-img. Returns nothing for files that
+// cannot be read or are not qcow2, which callers leave to qemu-img.
+optional<Qcow2Info> inspect_qcow2(const Path& image_path);
+
+// Grows a qcow2 image in place when its L1 table already has room for the new size, which is the common case for
+// freshly downloaded cloud images. Returns false, leaving the image untouched, whenever it would take more than
+// rewriting the header, e.g. with snapshots, encryption, unknown features or an L1 table that has to move.
+bool grow_qcow2(const Path& image_path, quint64 new_size);
+} // namespace disk_image
+} // namespace multipass
+#endif // MULTIPASS_DISK_IMAGE_H
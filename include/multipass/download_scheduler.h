@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_DOWNLOAD_SCHEDULER_H
+#define MULTIPASS_DOWNLOAD_SCHEDULER_H
+
+#include <QtGlobal>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+namespace multipass
+{
+// Shares the link between concurrent downloads. Downloads are admitted in priority order, within a global cap, and
+// the less urgent ones back off while more urgent ones run. All downloads together stay within a byte rate.
+class DownloadScheduler
+{
+public:
+    enum class Priority
+    {
+        interactive, // The default, e.g. launches
+        prefetch,
+        update
+    };
+
+    struct Limits
+    {
+        int max_concurrent_downloads{0}; // 0 for no limit
+        qint64 max_bytes_per_second{0};  // idem
+    };
+
+    // Sets the priority of the downloads that the current thread starts while the scope is alive
+    class PriorityScope
+    {
+    public:
+        explicit PriorityScope(Priority priority);
+        ~PriorityScope();
+
+    private:
+        PriorityScope(const PriorityScope&) = delete;
+        PriorityScope& operator=(const PriorityScope&) = delete;
+
+        const Priority previous;
+    };
+
+    // Holds a download's place in the scheduler until destroyed
+    class Slot
+    {
+    public:
+        ~Slot();
+
+        Priority priority() const;
+
+    private:
+        friend class DownloadScheduler;
+        Slot(DownloadScheduler& scheduler, Priority priority);
+        Slot(const Slot&) = delete;
+        Slot& operator=(const Slot&) = delete;
+
+        DownloadScheduler& scheduler;
+        const Priority download_priority;
+    };
+
+    explicit DownloadScheduler(const Limits& limits);
+
+    static Priority current_priority();
+
+    // Blocks until a download with the current thread's priority may start; throws AbortedDownloadException if
+    // abort is set in the meantime
+    std::unique_ptr<Slot> acquire(const std::atomic_bool& abort);
+
+    // Call with the size of each piece of data received, before handling it. Blocks as long as needed to stay within
+    // the byte rate, and for a while if more urgent downloads are running.
+    void throttle(const Slot& slot, qint64 bytes, const std::atomic_bool& abort);
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr auto priority_count = 3;
+
+    bool can_start(Priority priority) const;
+    bool has_more_urgent(Priority priority) const;
+    void release(Priority priority);
+
+    const Limits limits;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::array<int, priority_count> running{};
+    std::array<int, priority_count> waiting{};
+    Clock::time_point rate_budget_time{};
+};
+} // namespace multipass
+#endif // MULTIPASS_DOWNLOAD_SCHEDULER_H
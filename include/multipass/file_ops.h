@@ -25,6 +25,8 @@
 #include <QFile>
 #include <QString>
 
+#include <vector>
+
 #define MP_FILEOPS multipass::FileOps::instance()
 
 namespace multipass
@@ -32,22 +34,42 @@ namespace multipass
 class FileOps : public Singleton<FileOps>
 {
 public:
+    // A positioned read or write, like read_at() and write_at(), for submit() to carry out alongside others
+    struct IoRequest
+    {
+        QFile* file;
+        char* data; // read into, or written from
+        qint64 size;
+        qint64 pos;
+        bool write{false};
+        qint64 result{-1}; // bytes transferred, short only for reads reaching the end of the file; -1 on failure
+        int error{0};      // the errno of a failed request
+    };
+
     FileOps(const Singleton<FileOps>::PrivatePass&) noexcept;
 
     // QDir operations
-    virtual bool isReadable(QDir& dir);
-    virtual bool rmdir(QDir& dir, const QString& dirName);
+    MP_MOCKABLE bool isReadable(QDir& dir);
+    MP_MOCKABLE bool rmdir(QDir& dir, const QString& dirName);
 
     // QFile operations
-    virtual bool open(QFile& file, QIODevice::OpenMode mode);
-    virtual qint64 read(QFile& file, char* data, qint64 maxSize);
-    virtual bool remove(QFile& file);
-    virtual bool rename(QFile& file, const QString& newName);
-    virtual bool resize(QFile& file, qint64 sz);
-    virtual bool seek(QFile& file, qint64 pos);
-    virtual bool setPermissions(QFile& file, QFileDevice::Permissions permissions);
-    virtual qint64 write(QFile& file, const char* data, qint64 maxSize);
-    virtual qint64 write(QFile& file, const QByteArray& data);
+    MP_MOCKABLE bool open(QFile& file, QIODevice::OpenMode mode);
+    MP_MOCKABLE qint64 read(QFile& file, char* data, qint64 maxSize);
+    MP_MOCKABLE qint64 read_at(QFile& file, char* data, qint64 maxSize, qint64 pos); // leaves the file position alone
+    MP_MOCKABLE bool remove(QFile& file);
+    MP_MOCKABLE bool rename(QFile& file, const QString& newName);
+    MP_MOCKABLE bool resize(QFile& file, qint64 sz);
+    MP_MOCKABLE bool seek(QFile& file, qint64 pos);
+    MP_MOCKABLE bool setPermissions(QFile& file, QFileDevice::Permissions permissions);
+    MP_MOCKABLE qint64 write(QFile& file, const char* data, qint64 maxSize);
+    MP_MOCKABLE qint64 write(QFile& file, const QByteArray& data);
+    MP_MOCKABLE qint64 write_at(QFile& file, const char* data, qint64 size, qint64 pos); // all of it, or -1
+    MP_MOCKABLE qint64 copy_range(QFile& from, qint64 from_pos, QFile& to, qint64 to_pos, qint64 size); // up to EOF
+    MP_MOCKABLE bool sync(QFile& file);
+    MP_MOCKABLE bool advise_will_need(QFile& file, qint64 pos, qint64 size); // starts reading it into the page cache
+    // Has the kernel work on all the requests at once through io_uring, falling back to one at a time where the
+    // kernel does not have it. Returns whether every request succeeded
+    MP_MOCKABLE bool submit(std::vector<IoRequest>& requests);
 };
 } // namespace multipass
 
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_INSTRUMENTATION_H
+#define MULTIPASS_INSTRUMENTATION_H
+
+#include "singleton.h"
+
+#include <QtGlobal>
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define MP_INSTRUMENTATION multipass::Instrumentation::instance()
+
+namespace multipass
+{
+// Collects where the daemon spends its time, for rendering in the OpenMetrics text format. Metrics are identified by
+// a name and a (possibly empty) label set written the OpenMetrics way, e.g. `rpc="launch"`
+class Instrumentation : public Singleton<Instrumentation>
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Upper bounds of the latency histogram buckets, in seconds
+    static constexpr std::array<double, 12> buckets{0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 30, 60, 300};
+    // The index of the bucket a duration falls in, or the number of buckets when it is beyond them all
+    static std::size_t bucket_of(Clock::duration duration);
+
+    Instrumentation(const Singleton<Instrumentation>::PrivatePass&) noexcept;
+
+    virtual void observe(const std::string& name, const std::string& labels, Clock::duration duration);
+    // Folds in a histogram kept elsewhere, e.g. by another process, over the same buckets
+    virtual void observe_histogram(const std::string& name, const std::string& labels,
+                                   const std::array<quint64, buckets.size()>& bucket_counts, quint64 count, double sum);
+    virtual void add(const std::string& name, const std::string& labels, quint64 amount);
+    // Replaces the value of a gauge, for quantities that go down as well as up
+    virtual void set(const std::string& name, const std::string& labels, quint64 value);
+
+    virtual std::string openmetrics() const;
+
+    // Keeps the latest spans of each thread, like a flight recorder. Names must be string literals, since only
+    // pointers to them are kept
+    static constexpr std::size_t spans_per_thread = 1024;
+    virtual void trace(const char* category, const char* name, Clock::time_point start, Clock::duration duration);
+    // Renders the recorded spans in the Chrome trace event format, which Perfetto also reads
+    virtual std::string chrome_trace() const;
+
+private:
+    struct Span
+    {
+        const char* category;
+        const char* name;
+        Clock::time_point start;
+        Clock::duration duration;
+    };
+
+    struct SpanRing
+    {
+        std::mutex mutex; // only ever contended while a trace is being rendered
+        std::array<Span, spans_per_thread> spans{};
+        std::size_t recorded{0};
+    };
+
+    SpanRing& ring_for_this_thread();
+
+    struct Histogram
+    {
+        std::array<quint64, buckets.size()> bucket_counts{}; // not cumulative, unlike the rendering
+        quint64 count{0};
+        double sum{0};
+    };
+
+    using Key = std::pair<std::string, std::string>; // name, labels
+
+    mutable std::mutex mutex;
+    std::map<Key, Histogram> histograms;
+    std::map<Key, quint64> counters;
+    std::map<Key, quint64> gauges;
+
+    const quint64 generation;
+    // One per thread that traced, guarded by mutex. Each is owned by its thread alone, so it goes with the thread
+    std::vector<std::weak_ptr<SpanRing>> rings;
+};
+
+// Traces its own lifetime as one span
+class TraceSpan
+{
+public:
+    TraceSpan(const char* category, const char* name);
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* const category;
+    const char* const name;
+    const Instrumentation::Clock::time_point start;
+};
+
+// Observes its own lifetime as one duration
+class ScopedTiming
+{
+public:
+    explicit ScopedTiming(std::string name, std::string labels = {});
+    ~ScopedTiming();
+
+    ScopedTiming(const ScopedTiming&) = delete;
+    ScopedTiming& operator=(const ScopedTiming&) = delete;
+
+private:
+    const std::string name;
+    const std::string labels;
+    const Instrumentation::Clock::time_point start;
+};
+} // namespace multipass
+
+#endif // MULTIPASS_INSTRUMENTATION_H
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_IO_LIMITS_H
+#define MULTIPASS_IO_LIMITS_H
+
+namespace multipass
+{
+// Ceilings on an instance's I/O, each zero for no limit. A burst is the rate the instance may reach for a short while
+// above the sustained one, so it only makes sense on top of one and never below it
+struct IoLimits
+{
+    long long disk_iops{0};
+    long long disk_iops_burst{0};
+    long long disk_bytes_per_second{0};
+    long long disk_bytes_burst{0};
+    long long network_bytes_per_second{0};
+
+    bool disk_limited() const
+    {
+        return disk_iops || disk_bytes_per_second;
+    }
+
+    bool empty() const
+    {
+        return !disk_limited() && !network_bytes_per_second;
+    }
+
+    bool valid() const
+    {
+        auto valid_pair = [](long long sustained, long long burst) {
+            return sustained >= 0 && burst >= 0 && (!burst || (sustained && burst >= sustained));
+        };
+
+        return valid_pair(disk_iops, disk_iops_burst) && valid_pair(disk_bytes_per_second, disk_bytes_burst) &&
+               network_bytes_per_second >= 0;
+    }
+};
+
+inline bool operator==(const IoLimits& a, const IoLimits& b)
+{
+    return a.disk_iops == b.disk_iops && a.disk_iops_burst == b.disk_iops_burst &&
+           a.disk_bytes_per_second == b.disk_bytes_per_second && a.disk_bytes_burst == b.disk_bytes_burst &&
+           a.network_bytes_per_second == b.network_bytes_per_second;
+}
+
+inline bool operator!=(const IoLimits& a, const IoLimits& b)
+{
+    return !(a == b);
+}
+} // namespace multipass
+
+#endif // MULTIPASS_IO_LIMITS_H
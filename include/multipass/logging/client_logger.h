@@ -25,16 +25,128 @@
 
 #include <fmt/format.h>
 
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
 namespace multipass
 {
 namespace logging
 {
+namespace detail
+{
+struct ClientStream
+{
+    std::mutex write_mutex;
+    int writers{0};
+};
+
+// The streams that have loggers, or others that write to them from threads of their own
+struct ClientStreams
+{
+    std::mutex mutex;
+    std::condition_variable loggers_gone;
+    std::unordered_map<const void*, std::shared_ptr<ClientStream>> streams;
+};
+
+inline ClientStreams& client_streams()
+{
+    static ClientStreams streams;
+    return streams;
+}
+
+inline std::shared_ptr<ClientStream> client_stream(const void* server)
+{
+    auto& streams = client_streams();
+    std::lock_guard<decltype(streams.mutex)> lock{streams.mutex};
+    auto it = streams.streams.find(server);
+    return it == streams.streams.end() ? nullptr : it->second;
+}
+} // namespace detail
+
+// While it lives, writes to the client through write_to_client() go one at a time, for requests that write to it from
+// several threads. The stream is only finished once every such writer is gone.
+class SharedClientStream
+{
+public:
+    explicit SharedClientStream(const void* server) : server{server}
+    {
+        if (server)
+        {
+            auto& streams = detail::client_streams();
+            std::lock_guard<decltype(streams.mutex)> lock{streams.mutex};
+            auto& stream = streams.streams[server];
+            if (!stream)
+                stream = std::make_shared<detail::ClientStream>();
+            ++stream->writers;
+        }
+    }
+
+    ~SharedClientStream()
+    {
+        if (server)
+        {
+            auto& streams = detail::client_streams();
+            {
+                std::lock_guard<decltype(streams.mutex)> lock{streams.mutex};
+                auto it = streams.streams.find(server);
+                if (--it->second->writers == 0)
+                    streams.streams.erase(it);
+            }
+            streams.loggers_gone.notify_all();
+        }
+    }
+
+    SharedClientStream(const SharedClientStream&) = delete;
+    SharedClientStream& operator=(const SharedClientStream&) = delete;
+
+private:
+    const void* server;
+};
+
+// Every write to a client goes through here, so that it does not overlap with one by the client's logger
+template <typename T>
+bool write_to_client(grpc::ServerWriterInterface<T>* server, const T& reply)
+{
+    if (auto stream = detail::client_stream(server))
+    {
+        std::lock_guard<decltype(stream->write_mutex)> lock{stream->write_mutex};
+        return server->Write(reply);
+    }
+
+    return server->Write(reply);
+}
+
+// The gRPC thread finishes a stream as soon as its status is set, which can be before the request's logger is done
+// writing to it, or before a SharedClientStream lets it go, so it waits on this first
+inline void wait_for_client_loggers(const void* server)
+{
+    auto& streams = client_streams();
+    std::unique_lock<decltype(streams.mutex)> lock{streams.mutex};
+    streams.loggers_gone.wait(lock, [&streams, server] { return streams.streams.count(server) == 0; });
+}
+
+// The same, for streams finished off a completion queue, which checks on them rather than waits
+inline bool client_loggers_gone(const void* server)
+{
+    return detail::client_stream(server) == nullptr;
+}
+
+// Lines are queued and written to the client from a thread of the logger's own, so that a slow client does not hold
+// up whoever logs. Past max_queued_lines, they are dropped and the client is told how many.
 template <typename T>
 class ClientLogger : public Logger
 {
 public:
-    ClientLogger(Level level, MultiplexingLogger& mpx, grpc::ServerWriter<T>* server)
-        : logging_level{level}, server{server}, mpx_logger{mpx}
+    ClientLogger(Level level, MultiplexingLogger& mpx, grpc::ServerWriterInterface<T>* server,
+                 std::size_t max_queued_lines = 1024)
+        : Logger{level}, server{server}, shared_stream{server}, mpx_logger{mpx}, max_queued_lines{max_queued_lines}
     {
         mpx_logger.add_logger(this);
     }
@@ -42,23 +154,81 @@ public:
     ~ClientLogger()
     {
         mpx_logger.remove_logger(this);
+
+        {
+            std::lock_guard<decltype(queue_mutex)> lock{queue_mutex};
+            stopping = true;
+        }
+        queue_cv.notify_one();
+
+        if (writer.joinable())
+            writer.join(); // once what was queued is written, before shared_stream lets the stream go
     }
 
     void log(Level level, CString category, CString message) const override
     {
         if (level <= logging_level && server != nullptr)
         {
-            T reply;
-            reply.set_log_line(fmt::format("[{}] [{}] [{}] {}\n", timestamp(), as_string(level).c_str(),
-                                           category.c_str(), message.c_str()));
-            server->Write(reply);
+            auto line = fmt::format("[{}] [{}] [{}] {}\n", timestamp(), as_string(level).c_str(), category.c_str(),
+                                    message.c_str());
+            {
+                std::lock_guard<decltype(queue_mutex)> lock{queue_mutex};
+                if (queue.size() >= max_queued_lines)
+                {
+                    ++dropped_lines;
+                    return;
+                }
+
+                queue.push_back(std::move(line));
+                if (!writer.joinable()) // most requests never log to the client, so only start writing when one does
+                    writer = std::thread{&ClientLogger::write_queued_lines, this};
+            }
+            queue_cv.notify_one();
         }
     }
 
 private:
-    Level logging_level;
-    grpc::ServerWriter<T>* server;
+    void write_queued_lines() const
+    {
+        std::unique_lock<decltype(queue_mutex)> lock{queue_mutex};
+        while (true)
+        {
+            queue_cv.wait(lock, [this] { return !queue.empty() || stopping; });
+            if (queue.empty())
+                return;
+
+            auto lines = std::move(queue);
+            queue.clear();
+            auto dropped = std::exchange(dropped_lines, 0);
+
+            lock.unlock();
+            for (const auto& line : lines)
+                write(line);
+
+            if (dropped)
+                write(fmt::format("[{}] [{}] [client] {} lines dropped, as they came faster than they could be sent\n",
+                                  timestamp(), as_string(Level::warning).c_str(), dropped));
+            lock.lock();
+        }
+    }
+
+    void write(const std::string& line) const
+    {
+        T reply;
+        reply.set_log_line(line);
+        write_to_client(server, reply);
+    }
+
+    grpc::ServerWriterInterface<T>* server;
+    SharedClientStream shared_stream;
     MultiplexingLogger& mpx_logger;
+    const std::size_t max_queued_lines;
+    mutable std::mutex queue_mutex;
+    mutable std::condition_variable queue_cv;
+    mutable std::deque<std::string> queue;
+    mutable std::size_t dropped_lines{0};
+    bool stopping{false};
+    mutable std::thread writer;
 };
 } // namespace logging
 } // namespace multipass
@@ -18,18 +18,36 @@
 #ifndef MULTIPASS_LOG_H
 #define MULTIPASS_LOG_H
 
+#include <multipass/format.h>
 #include <multipass/logging/cstring.h>
 #include <multipass/logging/level.h>
 #include <multipass/logging/logger.h>
 
+#include <cstddef>
+#include <utility>
+
 namespace multipass
 {
 namespace logging
 {
 void log(Level level, CString category, CString message);
+bool enabled(Level level); // check before building costly messages, on paths that log a lot
 void set_logger(std::shared_ptr<Logger> logger);
 Level get_logging_level();
 Logger* get_logger(); // for tests, don't rely on it lasting
+
+// Whether a message with this category and format may be logged now. Each pair gets a burst of messages per
+// interval; the rest are only counted, and how many there were is logged once the next interval begins
+bool admit_limited(Level level, CString category, CString format);
+std::size_t limited_kinds(); // for tests, how many category and format pairs are being tracked
+
+// For paths that a misbehaving peer can make log over and over. Messages are only formatted when admitted
+template <typename... Args>
+void log_limited(Level level, CString category, const char* format, Args&&... args)
+{
+    if (enabled(level) && admit_limited(level, category, format))
+        log(level, category, fmt::vformat(format, fmt::make_format_args(args...)));
+}
 } // namespace logging
 } // namespace multipass
 #endif // MULTIPASS_LOG_H
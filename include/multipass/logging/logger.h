@@ -37,7 +37,14 @@ public:
     using UPtr = std::unique_ptr<Logger>;
     virtual ~Logger() = default;
     virtual void log(Level level, CString category, CString message) const = 0;
-    Level get_logging_level()
+
+    // Whether log() would do anything with a message at this level, so that it need not be built otherwise
+    virtual bool enabled_for(Level level) const
+    {
+        return level <= logging_level;
+    }
+
+    Level get_logging_level() const
     {
         return logging_level;
     };
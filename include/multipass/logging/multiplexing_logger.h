@@ -20,6 +20,7 @@
 
 #include "logger.h"
 
+#include <atomic>
 #include <memory>
 #include <shared_mutex>
 #include <vector>
@@ -33,13 +34,17 @@ class MultiplexingLogger : public Logger
 public:
     explicit MultiplexingLogger(UPtr system_logger);
     void log(Level level, CString category, CString message) const override;
+    bool enabled_for(Level level) const override;
     void add_logger(const Logger* logger);
     void remove_logger(const Logger* logger);
 
 private:
+    void update_enabled_level(); // must be called with the mutex held exclusively
+
     UPtr system_logger;
-    mutable std::shared_timed_mutex mutex;
+    mutable std::shared_mutex mutex;
     std::vector<const Logger*> loggers;
+    std::atomic<Level> enabled_level; // the most verbose that any of the loggers takes, read without the mutex
 };
 } // namespace logging
 } // namespace multipass
@@ -20,6 +20,7 @@
 #ifndef MULTIPASS_NAME_GENERATOR_H
 #define MULTIPASS_NAME_GENERATOR_H
 
+#include <functional>
 #include <memory>
 #include <string>
 
@@ -29,8 +30,11 @@ class NameGenerator
 {
 public:
     using UPtr = std::unique_ptr<NameGenerator>;
+    using NameFilter = std::function<bool(const std::string&)>;
     virtual ~NameGenerator() = default;
     virtual std::string make_name() = 0;
+    // Makes a name for which is_taken returns false, throwing when none can be found
+    virtual std::string make_unique_name(const NameFilter& is_taken);
 
 protected:
     NameGenerator() = default;
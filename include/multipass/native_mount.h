@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef MULTIPASS_NATIVE_MOUNT_H
+#define MULTIPASS_NATIVE_MOUNT_H
+
+#include <string>
+#include <unordered_map>
+
+namespace multipass
+{
+// A host directory the hypervisor shares with the instance itself (virtiofs, or 9p where virtiofs is unavailable),
+// instead of serving it over SSHFS
+struct NativeMount
+{
+    std::string source_path;
+    std::string tag; // what the instance mounts, e.g. "mount -t virtiofs <tag> <target>"
+    std::unordered_map<int, int> uid_map; // host id -> instance id, resolved to concrete ids
+    std::unordered_map<int, int> gid_map;
+};
+
+inline bool operator==(const NativeMount& a, const NativeMount& b)
+{
+    return a.source_path == b.source_path && a.tag == b.tag && a.uid_map == b.uid_map && a.gid_map == b.gid_map;
+}
+
+inline bool operator!=(const NativeMount& a, const NativeMount& b)
+{
+    return !(a == b);
+}
+} // namespace multipass
+
+#endif // MULTIPASS_NATIVE_MOUNT_H
@@ -25,6 +25,7 @@
 
 namespace multipass
 {
+class LocalSocketPool;
 
 class NetworkAccessManager : public QNetworkAccessManager
 {
@@ -33,10 +34,14 @@ public:
     using UPtr = std::unique_ptr<NetworkAccessManager>;
 
     NetworkAccessManager(QObject* parent = nullptr);
+    ~NetworkAccessManager();
 
 protected:
     QNetworkReply* createRequest(Operation op, const QNetworkRequest& orig_request,
                                  QIODevice* outgoingData = nullptr) override;
+
+private:
+    const std::shared_ptr<LocalSocketPool> local_socket_pool;
 };
 } // namespace multipass
 
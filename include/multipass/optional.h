@@ -23,6 +23,7 @@
 #include <optional>
 namespace multipass
 {
+using std::in_place;
 using std::make_optional;
 using std::nullopt;
 using std::optional;
@@ -33,6 +34,7 @@ using std::optional;
 #include <experimental/optional>
 namespace multipass
 {
+using std::experimental::in_place;
 using std::experimental::make_optional;
 using std::experimental::nullopt;
 using std::experimental::optional;
@@ -49,14 +49,18 @@ class Platform : public Singleton<Platform>
 public:
     Platform(const Singleton::PrivatePass&) noexcept;
     // Get information on the network interfaces that are seen by the platform, indexed by name
-    virtual std::map<std::string, NetworkInterfaceInfo> get_network_interfaces_info() const;
-    virtual QString get_workflows_url_override();
-    virtual bool is_alias_supported(const std::string& alias, const std::string& remote);
-    virtual bool is_remote_supported(const std::string& remote);
-    virtual int chown(const char* path, unsigned int uid, unsigned int gid);
-    virtual bool link(const char* target, const char* link);
-    virtual bool symlink(const char* target, const char* link, bool is_dir);
-    virtual int utime(const char* path, int atime, int mtime);
+    MP_MOCKABLE std::map<std::string, NetworkInterfaceInfo> get_network_interfaces_info() const;
+    MP_MOCKABLE QString get_workflows_url_override();
+    MP_MOCKABLE bool is_alias_supported(const std::string& alias, const std::string& remote);
+    MP_MOCKABLE bool is_remote_supported(const std::string& remote);
+    MP_MOCKABLE int chown(const char* path, unsigned int uid, unsigned int gid);
+    MP_MOCKABLE bool link(const char* target, const char* link);
+    MP_MOCKABLE bool symlink(const char* target, const char* link, bool is_dir);
+    MP_MOCKABLE int utime(const char* path, int atime, int mtime);
+    // Copy source to target without duplicating its data on disk, where the filesystem supports it
+    MP_MOCKABLE bool clone_file(const char* source, const char* target);
+    // Identify a file by its device, inode, size and modification time; empty if it cannot be determined
+    MP_MOCKABLE std::string file_identity(const char* path);
 };
 
 std::map<QString, QString> extra_settings_defaults();
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_ASYNC_PROCESS_H
+#define MULTIPASS_ASYNC_PROCESS_H
+
+#include <multipass/process/process.h>
+
+#include <QByteArray>
+#include <QFuture>
+
+#include <functional>
+
+namespace multipass
+{
+struct ProcessOutput
+{
+    ProcessState state;
+    QByteArray standard_output; // only read from processes that exited normally
+    QByteArray standard_error;
+};
+
+// Creates a process on one of a few threads kept for short-lived tools, runs it to completion there and hands back
+// what it printed, so that the thread asking, typically the daemon's event loop, does not wait on it. Failing to
+// create the process is reported like a failure to start it.
+QFuture<ProcessOutput> execute_async(std::function<Process::UPtr()> make_process, int timeout = 30000);
+} // namespace multipass
+
+#endif // MULTIPASS_ASYNC_PROCESS_H
@@ -26,6 +26,18 @@
 namespace multipass
 {
 
+// Which group of processes a process's use of the host is accounted to, and that group's share of it. The group is
+// named after the instance the process serves, the leaf after what the process does for it. Zeros leave a limit unset
+struct ResourceControls
+{
+    QString group; // none leaves the process alongside the daemon
+    QString leaf;
+    int cpu_weight{0};        // relative to the default of 100
+    int cpu_max_cores{0};     // all the group's processes together
+    long long memory_high{0}; // bytes, over which the group is throttled and reclaimed from
+    int io_weight{0};         // relative to the default of 100
+};
+
 class ProcessSpec
 {
 public:
@@ -42,6 +54,9 @@ public:
     virtual QString apparmor_profile() const = 0;
     const QString apparmor_profile_name() const;
     virtual QString identifier() const;
+
+    virtual ResourceControls resource_controls() const;
+    virtual bool outlives_daemon() const;
 };
 
 } // namespace multipass
@@ -38,6 +38,7 @@ public:
     std::string remote_name;
     Type query_type;
     bool allow_unsupported{false};
+    bool ephemeral{false}; // for an instance that is never recorded for good
 };
 }
 #endif // MULTIPASS_QUERY_H
@@ -21,12 +21,13 @@
 #include "exceptions/settings_exceptions.h"
 #include "singleton.h"
 
+#include <QDateTime>
 #include <QString>
 #include <QVariant>
 
 #include <map>
-#include <mutex>
 #include <set>
+#include <shared_mutex>
 
 #define MP_SETTINGS multipass::Settings::instance()
 
@@ -53,8 +54,17 @@ protected:
 private:
     void set_aux(const QString& key, QString val);
 
+    // What a settings file held when it was last read, and how the file looked then
+    struct CachedFile
+    {
+        QDateTime modified;
+        qint64 size;
+        std::map<QString, QString> values;
+    };
+
     std::map<QString, QString> defaults;
-    mutable std::mutex mutex;
+    mutable std::map<QString, CachedFile> cache; // by file name
+    mutable std::shared_mutex mutex;
 };
 } // namespace multipass
 
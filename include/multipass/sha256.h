@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_SHA256_H
+#define MULTIPASS_SHA256_H
+
+#include <QByteArray>
+
+#include <memory>
+
+struct evp_md_ctx_st;
+
+namespace multipass
+{
+// SHA-256 through OpenSSL, which uses the CPU's own SHA instructions (SHA-NI, ARMv8 crypto extensions) where it has
+// them. Images are hashed on every verification, and this is several times faster than QCryptographicHash there.
+class Sha256
+{
+public:
+    Sha256();
+    ~Sha256();
+
+    void add_data(const char* data, qint64 size);
+    void add_data(const QByteArray& data);
+    void reset();
+    // The digest of what was added since construction or the last reset, which this does not reset
+    QByteArray result() const;
+
+private:
+    std::unique_ptr<evp_md_ctx_st, void (*)(evp_md_ctx_st*)> context;
+};
+} // namespace multipass
+#endif // MULTIPASS_SHA256_H
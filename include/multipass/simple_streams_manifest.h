@@ -23,7 +23,7 @@
 #include <multipass/vm_image_info.h>
 
 #include <QByteArray>
-#include <QMap>
+#include <QHash>
 #include <QString>
 
 #include <memory>
@@ -37,10 +37,19 @@ struct SimpleStreamsManifest
     SimpleStreamsManifest(const SimpleStreamsManifest&) = delete;
     SimpleStreamsManifest& operator=(const SimpleStreamsManifest&) = delete;
     static std::unique_ptr<SimpleStreamsManifest> fromJson(const QByteArray& json, const QString& host_url);
+    // Indexes products that were already parsed, e.g. restored from a cache
+    static std::unique_ptr<SimpleStreamsManifest> fromProducts(const QString& updated_at,
+                                                               std::vector<VMImageInfo> products);
+
+    // The first product with the given id, if any
+    const VMImageInfo* product_with_id(const QString& id) const;
+    // The products whose id starts with prefix, in the order of products
+    std::vector<const VMImageInfo*> products_with_id_prefix(const QString& prefix) const;
 
     const QString updated_at;
     const std::vector<VMImageInfo> products;
-    const QMap<QString, const VMImageInfo*> image_records;
+    const QHash<QString, const VMImageInfo*> image_records; // by alias and by id
+    const std::vector<const VMImageInfo*> products_by_id;  // sorted by id; the indexes for the lookups above
 };
 }
 #endif // MULTIPASS_SIMPLE_STREAMS_MANIFEST_H
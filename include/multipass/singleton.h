@@ -24,6 +24,14 @@
 #include <mutex>
 #include <type_traits>
 
+// Members of singletons that tests swap for mocks are only virtual in builds with the tests, so that the others bind
+// calls to them statically
+#ifdef MULTIPASS_MOCKABLE_SINGLETONS
+#define MP_MOCKABLE virtual
+#else
+#define MP_MOCKABLE
+#endif
+
 namespace multipass
 {
 
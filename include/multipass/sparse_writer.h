@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_SPARSE_WRITER_H
+#define MULTIPASS_SPARSE_WRITER_H
+
+#include <multipass/file_ops.h>
+
+#include <QFile>
+
+#include <functional>
+#include <vector>
+
+namespace multipass
+{
+// Writes to a file that starts out empty, seeking over blocks of zeros instead of writing them so that they are
+// left as holes. Raw disk images are mostly zeros, so this saves both disk writes and space.
+class SparseWriter
+{
+public:
+    explicit SparseWriter(QFile& file);
+
+    bool write(const char* data, qint64 size);
+    // Leaves the writing to FileOps::submit() instead, adding a positioned write for each run of data there is
+    // in what belongs at pos. The file is then to be extended over any trailing hole by whoever submits them
+    void queue(char* data, qint64 size, qint64 pos, std::vector<FileOps::IoRequest>& requests);
+    // Extends the file over any trailing hole; call once everything was written
+    bool finish();
+
+    static bool is_zero(const char* data, qint64 size);
+
+private:
+    // Calls back with each run of blocks of the same kind, by offset, length and whether they are all zeros
+    static bool for_each_run(const char* data, qint64 size, const std::function<bool(qint64, qint64, bool)>& on_run);
+
+    QFile& file;
+};
+} // namespace multipass
+#endif // MULTIPASS_SPARSE_WRITER_H
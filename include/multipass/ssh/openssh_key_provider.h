@@ -35,13 +35,21 @@ public:
     };
     using KeyUPtr = std::unique_ptr<ssh_key_struct, KeyDeleter>;
 
-    OpenSSHKeyProvider(const Path& cache_dir);
+    // ed25519 keys are quicker to sign with, and so to authenticate with, than RSA ones
+    enum class KeyType
+    {
+        rsa,
+        ed25519
+    };
+
+    OpenSSHKeyProvider(const Path& cache_dir, KeyType preferred_type = KeyType::ed25519);
     std::string private_key_as_base64() const override;
     std::string public_key_as_base64() const override;
     ssh_key private_key() const override;
 
 private:
     QDir ssh_key_dir;
+    QString priv_key_path;
     KeyUPtr priv_key;
 };
 }
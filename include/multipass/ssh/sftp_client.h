@@ -22,9 +22,14 @@
 
 #include <libssh/sftp.h>
 
+#include <cstddef>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <vector>
+
+class QFileInfo;
 
 namespace multipass
 {
@@ -34,17 +39,47 @@ using SFTPSessionUPtr = std::unique_ptr<sftp_session_struct, void (*)(sftp_sessi
 class SFTPClient
 {
 public:
-    SFTPClient(const std::string& host, int port, const std::string& username, const std::string& priv_key_blob);
-    SFTPClient(SSHSessionUPtr ssh_session);
+    // Pushes and pulls keep up to transfer_window chunk requests in flight at once, rather than waiting a round-trip
+    // for each chunk before asking for the next
+    static constexpr std::size_t default_transfer_window = 64;
+
+    SFTPClient(const std::string& host, int port, const std::string& username, const std::string& priv_key_blob,
+               std::size_t transfer_window = default_transfer_window);
+    SFTPClient(SSHSessionUPtr ssh_session, std::size_t transfer_window = default_transfer_window);
 
     void push_file(const std::string& source_path, const std::string& destination_path);
     void pull_file(const std::string& source_path, const std::string& destination_path);
+    // Push only those blocks of a file that differ from what is already at the destination
+    void sync_file(const std::string& source_path, const std::string& destination_path);
+    // Copy a whole directory tree, keeping the permissions and modification times of what is in it
+    void push_dir(const std::string& source_path, const std::string& destination_path, bool sync = false);
+    void pull_dir(const std::string& source_path, const std::string& destination_path);
+    bool is_remote_dir(const std::string& path);
     void stream_file(const std::string& destination_path, std::istream& cin);
     void stream_file(const std::string& source_path, std::ostream& cout);
+    // Copy a file, or a whole directory tree, from this client's instance straight into the instance of another,
+    // passing the data along as it comes rather than landing it anywhere in between
+    void copy_to(SFTPClient& destination, const std::string& source_path, const std::string& destination_path,
+                 bool recursive = false);
 
 private:
+    void push_file_to(const std::string& source_path, const std::string& full_destination_path);
+    void pull_file_to(const std::string& source_path, const std::string& full_destination_path);
+    void read_pipelined(sftp_file file, const std::function<void(const char*, int)>& consume);
+    void sync_file_to(const std::string& source_path, const std::string& full_destination_path);
+    std::vector<std::string> remote_block_signatures(const std::string& path);
+    void pull_tree(const std::string& source_path, const std::string& full_destination_path);
+    void make_remote_dir(const std::string& path);
+    void set_remote_metadata(const std::string& path, const QFileInfo& info);
+    void set_remote_metadata(const std::string& path, const sftp_attributes_struct& attributes);
+    void copy_file_to(SFTPClient& destination, const std::string& source_path,
+                      const std::string& full_destination_path);
+    void copy_tree_to(SFTPClient& destination, const std::string& source_path,
+                      const std::string& full_destination_path);
+
     SSHSessionUPtr ssh_session;
     SFTPSessionUPtr sftp;
+    const std::size_t transfer_window;
 };
 } // namespace multipass
 #endif // MULTIPASS_SFTP_CLIENT_H
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef MULTIPASS_SHARED_SSH_SESSION_H
+#define MULTIPASS_SHARED_SSH_SESSION_H
+
+#include <multipass/ssh/ssh_session.h>
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace multipass
+{
+// An ssh session that several users take turns on, each over channels of its own
+struct SharedSSHSession
+{
+    explicit SharedSSHSession(SSHSession&& session);
+    ~SharedSSHSession();
+
+    // Holds the session for one of its users. Whatever comes in from the socket meanwhile is taken into the buffers
+    // of whichever channels it is for, so the users waiting for data are woken afterwards to look at theirs
+    class Turn
+    {
+    public:
+        explicit Turn(SharedSSHSession& shared);
+        ~Turn();
+
+    private:
+        SharedSSHSession& shared;
+        std::lock_guard<std::mutex> lock;
+        bool incoming;
+    };
+
+    // How many turns took in data so far, to be read during a turn and then given to wait_for_data
+    std::uint64_t arrivals();
+    // Sleeps, without holding the session, until data comes in on its socket, a turn takes some in after the given
+    // arrivals, or the timeout passes
+    void wait_for_data(std::uint64_t seen, std::chrono::milliseconds timeout);
+
+    SSHSession session;
+    std::mutex mutex; // serializes use of the session between all the threads of its users
+
+private:
+    void announce_arrival();
+
+    std::mutex arrivals_mutex;
+    std::uint64_t arrival_count{0};
+    int waiting{0};
+    bool woken{false};
+    int wakeup_pipe[2]{-1, -1}; // readable while there are waiters to wake
+};
+} // namespace multipass
+#endif // MULTIPASS_SHARED_SSH_SESSION_H
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_SSH_BROKER_H
+#define MULTIPASS_SSH_BROKER_H
+
+#include <multipass/ssh/ssh_session_pool.h>
+
+#include <QString>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class QThread;
+
+namespace multipass
+{
+class Terminal;
+
+// Keeps authenticated sessions to instances on behalf of one user's short-lived client processes, so that scripts
+// calling `multipass exec` over and over skip the connection handshake. Clients relay a command's input, output and
+// exit status over a local socket. The broker quits once it has been idle for a while.
+class SSHBroker
+{
+public:
+    static constexpr auto run_flag = "--run-ssh-broker";
+
+    explicit SSHBroker(const QString& server_name,
+                       std::chrono::milliseconds idle_timeout = std::chrono::minutes{10});
+    ~SSHBroker();
+
+    // Serves until idle, returning straight away when another broker already listens on the name
+    int run();
+
+    // Runs a command through the broker listening on server_name and returns its exit status. Returns nothing when no
+    // broker took the command, in which case nothing was relayed and the caller should connect by itself
+    static std::optional<int> exec(const QString& server_name, const std::string& host, int port,
+                                   const std::string& username, const std::string& priv_key_blob,
+                                   const std::vector<std::string>& args, Terminal* term);
+
+    // The name this user's broker listens on, in the client's config dir
+    static QString default_server_name();
+    // Starts a broker in the background for the commands that follow
+    static void spawn();
+
+private:
+    class Server;
+    struct KeyedPool;
+
+    void start_serving(quintptr socket_descriptor);
+    void serve(quintptr socket_descriptor);
+    SSHSessionPool& pool_for(const std::string& priv_key_blob);
+    bool idle() const;
+
+    const QString server_name;
+    const std::chrono::milliseconds idle_timeout;
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::unique_ptr<KeyedPool>> pools;
+    std::vector<std::unique_ptr<QThread>> workers;
+    int active_clients{0};
+    std::chrono::steady_clock::time_point last_active;
+};
+} // namespace multipass
+#endif // MULTIPASS_SSH_BROKER_H
@@ -23,7 +23,11 @@
 #include <libssh/libssh.h>
 
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 
 namespace multipass
@@ -32,12 +36,26 @@ class SSHProcess
 {
 public:
     using ChannelUPtr = std::unique_ptr<ssh_channel_struct, void (*)(ssh_channel)>;
+    using OutputHandler = std::function<void(const char* data, std::size_t size)>;
 
-    SSHProcess(ssh_session ssh_session, const std::string& cmd);
+    // Where the processes of one session find the event they wait on between them. It belongs to the session, for
+    // as long as that lives, rather than to wherever the session happens to be in memory
+    struct SharedEvent
+    {
+        std::mutex mutex;
+        std::weak_ptr<ssh_event_struct> event;
+    };
+
+    SSHProcess(ssh_session ssh_session, const std::string& cmd, std::shared_ptr<SharedEvent> shared_event);
+    SSHProcess(SSHProcess&&);
+    ~SSHProcess();
 
     int exit_code(std::chrono::milliseconds timeout = std::chrono::seconds(5));
     std::string read_std_output();
     std::string read_std_error();
+    // Hand output over piece by piece as it arrives, instead of collecting all of it first
+    void read_std_output(const OutputHandler& handler);
+    void read_std_error(const OutputHandler& handler);
 
 private:
     enum class StreamType
@@ -47,12 +65,19 @@ private:
     };
 
     std::string read_stream(StreamType type, int timeout = -1);
+    void read_stream(StreamType type, const OutputHandler& handler, int timeout = -1);
+    bool has_output_to_read();
+    int read_chunk(StreamType type, char* data, std::uint32_t size, int timeout);
     ssh_channel release_channel();
 
     ssh_session session;
     const std::string cmd;
+    struct ExitStatusWatch;
+
     ChannelUPtr channel;
-    optional<int> exit_status;
+    std::unique_ptr<ExitStatusWatch> exit_status_watch; // declared after the channel, to be gone before it is
+    std::shared_ptr<SharedEvent> shared_event;
+    std::shared_ptr<ssh_event_struct> event;
 
     friend class SftpServer;
 };
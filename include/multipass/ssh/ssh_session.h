@@ -32,12 +32,34 @@ class SSHKeyProvider;
 class SSHSession
 {
 public:
+    enum class Compression
+    {
+        automatic, // only over links found slow to connect; never on Windows, where libssh connects by itself
+        always,
+        never
+    };
+    static constexpr int default_compression_level = 6;
+
     SSHSession(const std::string& host, int port, const std::chrono::milliseconds timeout = std::chrono::seconds(1));
     SSHSession(const std::string& host, int port, const std::string& ssh_username, const SSHKeyProvider& key_provider,
                const std::chrono::milliseconds timeout = std::chrono::seconds(20));
 
     SSHProcess exec(const std::string& cmd);
 
+    // The host that has sessions reach a local instance over AF_VSOCK, bypassing its network; Linux only
+    static std::string vsock_host(unsigned cid);
+    static bool is_vsock_host(const std::string& host);
+
+    // Ciphers for the sessions created from now on, as a comma-separated list in order of preference; empty picks
+    // AES-GCM first where the CPU accelerates AES, and ChaCha20-Poly1305 first elsewhere
+    static void set_ciphers(const std::string& ciphers);
+    // Compression for the sessions created from now on, at a zlib level from 1 (fastest) to 9 (smallest)
+    static void set_compression(Compression compression, int level = default_compression_level);
+    static Compression compression();
+    // The compression a value of local.ssh-compression stands for: "auto", "on" or "off", and empty for the current one
+    static Compression compression_for(const std::string& setting);
+    static int compression_level();
+
     void force_shutdown();
     operator ssh_session() const;
 
@@ -47,6 +69,7 @@ private:
                const std::chrono::milliseconds timeout = std::chrono::seconds(20));
     void set_option(ssh_options_e type, const void* value);
     std::unique_ptr<ssh_session_struct, void (*)(ssh_session)> session;
+    std::shared_ptr<SSHProcess::SharedEvent> shared_event{std::make_shared<SSHProcess::SharedEvent>()};
 };
 } // namespace multipass
 #endif // MULTIPASS_SSH_H
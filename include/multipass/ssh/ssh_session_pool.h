@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_SSH_SESSION_POOL_H
+#define MULTIPASS_SSH_SESSION_POOL_H
+
+#include <multipass/ssh/ssh_session.h>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace multipass
+{
+class SSHKeyProvider;
+
+// Keeps authenticated sessions to instances around, so that repeated commands skip the connection handshake. Each
+// session is only used by one holder at a time.
+class SSHSessionPool
+{
+public:
+    // A session borrowed from the pool, given back on destruction unless an exception is propagating
+    class Lease
+    {
+    public:
+        Lease(Lease&&) = default;
+        ~Lease();
+
+        SSHSession& operator*() const;
+        SSHSession* operator->() const;
+
+    private:
+        friend class SSHSessionPool;
+        Lease(SSHSessionPool& pool, const std::string& instance, unsigned generation, const std::string& host,
+              int port, const std::string& username, std::unique_ptr<SSHSession> session);
+
+        SSHSessionPool* pool;
+        std::string instance;
+        unsigned generation;
+        std::string host;
+        int port;
+        std::string username;
+        std::unique_ptr<SSHSession> session;
+        int initial_exc_count;
+    };
+
+    explicit SSHSessionPool(const SSHKeyProvider& key_provider,
+                            std::chrono::seconds max_idle_time = std::chrono::seconds{60});
+
+    // The timeout only bounds connecting, when there is no idle session to reuse
+    Lease acquire(const std::string& instance, const std::string& host, int port, const std::string& username,
+                  std::chrono::milliseconds timeout = std::chrono::seconds{20});
+    // Forgets the sessions of an instance, including those currently lent out; call when it stops or restarts
+    void drop(const std::string& instance);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct IdleSession
+    {
+        std::string host;
+        int port;
+        std::string username;
+        std::unique_ptr<SSHSession> session;
+        Clock::time_point idle_since;
+    };
+
+    void give_back(Lease& lease);
+
+    const SSHKeyProvider& key_provider;
+    const std::chrono::seconds max_idle_time;
+    std::mutex mutex;
+    std::unordered_map<std::string, std::vector<IdleSession>> idle_sessions;
+    std::unordered_map<std::string, unsigned> generations;
+};
+} // namespace multipass
+#endif // MULTIPASS_SSH_SESSION_POOL_H
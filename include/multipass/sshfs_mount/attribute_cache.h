@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_ATTRIBUTE_CACHE_H
+#define MULTIPASS_ATTRIBUTE_CACHE_H
+
+#include <multipass/optional.h>
+
+#include <libssh/sftp.h>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace multipass
+{
+// Remembers file attributes under a root, forgetting them as inotify reports changes there.
+// Changes made through the cache's owner should be reported with invalidate(), so they show straight away.
+class AttributeCache
+{
+public:
+    struct Attributes
+    {
+        sftp_attributes_struct attr;
+        bool exists;
+        bool through_link; // resolved through a symlink, which may lead out of the watched directories
+    };
+    using StatFunction = std::function<Attributes()>;
+
+    AttributeCache(const std::string& root, std::size_t max_entries = 16384, std::size_t max_watches = 2048);
+    ~AttributeCache();
+
+    // Calls stat on a miss, or whenever it can't tell when the result would go stale
+    Attributes attributes_of(const std::string& path, bool follow, const StatFunction& stat);
+
+    void invalidate(const std::string& path);
+    void invalidate_tree(const std::string& path);
+
+private:
+    struct Entry
+    {
+        optional<Attributes> followed;
+        optional<Attributes> unfollowed;
+    };
+
+    bool watch_up_to(const std::string& dir);
+    void forget(const std::string& path);
+    void forget_tree(const std::string& path);
+    void watch_events();
+    void handle_event(int wd, uint32_t mask, const std::string& name);
+
+    const std::string root;
+    const std::size_t max_entries;
+    const std::size_t max_watches;
+
+    std::mutex mutex;
+    uint64_t generation{0}; // bumped on every invalidation, so results that raced with one are not kept
+    std::map<std::string, Entry> entries;
+    std::unordered_map<std::string, int> watches;
+    std::unordered_map<int, std::string> watched_dirs;
+
+    int inotify_fd{-1};
+    int stop_fds[2]{-1, -1};
+    std::thread watcher;
+};
+} // namespace multipass
+#endif // MULTIPASS_ATTRIBUTE_CACHE_H
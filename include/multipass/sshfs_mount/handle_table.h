@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef MULTIPASS_HANDLE_TABLE_H
+#define MULTIPASS_HANDLE_TABLE_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace multipass
+{
+// Owns what SFTP handles refer to, in slots that the handles name directly: a kind byte, the slot and the slot's
+// generation, so that finding one takes no lookup structure and a reused slot does not answer to stale handles
+template <typename T>
+class HandleTable
+{
+public:
+    static constexpr std::size_t handle_size = 1 + 2 * sizeof(uint32_t);
+
+    explicit HandleTable(char kind) : kind{kind}
+    {
+    }
+
+    std::string add(std::unique_ptr<T> item)
+    {
+        uint32_t index;
+        if (free_slots.empty())
+        {
+            index = static_cast<uint32_t>(slots.size());
+            slots.emplace_back();
+        }
+        else
+        {
+            index = free_slots.back();
+            free_slots.pop_back();
+        }
+
+        auto& slot = slots[index];
+        slot.item = std::move(item);
+        ++count;
+
+        std::string handle(handle_size, kind);
+        std::memcpy(&handle[1], &index, sizeof(index));
+        std::memcpy(&handle[1 + sizeof(index)], &slot.generation, sizeof(slot.generation));
+        return handle;
+    }
+
+    T* find(const void* handle, std::size_t size) const
+    {
+        auto slot = slot_for(handle, size);
+        return slot ? slot->item.get() : nullptr;
+    }
+
+    bool remove(const void* handle, std::size_t size)
+    {
+        auto slot = const_cast<Slot*>(slot_for(handle, size));
+        if (slot == nullptr)
+            return false;
+
+        slot->item.reset();
+        ++slot->generation;
+        free_slots.push_back(static_cast<uint32_t>(slot - slots.data()));
+        --count;
+        return true;
+    }
+
+    void clear()
+    {
+        free_slots.clear();
+        for (auto i = slots.size(); i-- > 0;)
+        {
+            if (slots[i].item)
+            {
+                slots[i].item.reset();
+                ++slots[i].generation;
+            }
+            free_slots.push_back(static_cast<uint32_t>(i));
+        }
+        count = 0;
+    }
+
+    std::size_t size() const
+    {
+        return count;
+    }
+
+private:
+    struct Slot
+    {
+        std::unique_ptr<T> item;
+        uint32_t generation{0};
+    };
+
+    const Slot* slot_for(const void* handle, std::size_t size) const
+    {
+        if (handle == nullptr || size != handle_size || *static_cast<const char*>(handle) != kind)
+            return nullptr;
+
+        uint32_t index, generation;
+        std::memcpy(&index, static_cast<const char*>(handle) + 1, sizeof(index));
+        std::memcpy(&generation, static_cast<const char*>(handle) + 1 + sizeof(index), sizeof(generation));
+
+        if (index >= slots.size() || !slots[index].item || slots[index].generation != generation)
+            return nullptr;
+
+        return &slots[index];
+    }
+
+    const char kind;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> free_slots; // most recently freed last, to be reused while still warm
+    std::size_t count{0};
+};
+} // namespace multipass
+
+#endif // MULTIPASS_HANDLE_TABLE_H
@@ -18,15 +18,30 @@
 #ifndef MULTIPASS_SFTP_SERVER_H
 #define MULTIPASS_SFTP_SERVER_H
 
+#include <multipass/ssh/shared_ssh_session.h>
 #include <multipass/ssh/ssh_session.h>
+#include <multipass/sshfs_mount/attribute_cache.h>
+#include <multipass/sshfs_mount/handle_table.h>
+#include <multipass/sshfs_mount/sftp_stats.h>
 
+#include <multipass/optional.h>
+
+#include <libssh/callbacks.h>
 #include <libssh/sftp.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
+#include <QDirIterator>
 #include <QFile>
 #include <QFileInfo>
+#include <QThreadPool>
 
 namespace multipass
 {
@@ -39,19 +54,40 @@ public:
     SftpServer(SSHSession&& ssh_session, const std::string& source, const std::string& target,
                const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map,
                int default_uid, int default_gid, const std::string& sshfs_exec_line);
+    SftpServer(std::shared_ptr<SharedSSHSession> ssh_session, const std::string& source, const std::string& target,
+               const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map,
+               int default_uid, int default_gid, const std::string& sshfs_exec_line);
     SftpServer(SftpServer&& other);
     ~SftpServer();
 
     void run();
     void stop();
 
+    SftpStats stats() const;
+
     using SSHSessionUptr = std::unique_ptr<ssh_session_struct, decltype(ssh_free)*>;
     using SftpSessionUptr = std::unique_ptr<sftp_session_struct, decltype(sftp_free)*>;
     using SSHFSProcUptr = std::unique_ptr<SSHProcess>;
 
 private:
+    SftpServer(std::shared_ptr<SharedSSHSession> ssh_session, bool session_is_shared, const std::string& source,
+               const std::string& target, const std::unordered_map<int, int>& gid_map,
+               const std::unordered_map<int, int>& uid_map, int default_uid, int default_gid,
+               const std::string& sshfs_exec_line);
+    sftp_client_message next_message();
+    void watch_sshfs_channel();
+    int sshfs_exit_status();
+    void remount();
+    void dispatch(sftp_client_message msg);
+    void wait_for_pending_requests();
+    bool flush_pending_write();
+    void read_ahead(QFile* file, qint64 offset, qint64 length);
+    void record(const char* operation, std::chrono::steady_clock::duration duration, const char* path = nullptr);
+    template <typename Reply>
+    int reply(Reply&& send);
     void process_message(sftp_client_message msg);
     sftp_attributes_struct attr_from(const QFileInfo& file_info);
+    AttributeCache::Attributes attributes_for(const std::string& filename, bool follow);
     int mapped_uid_for(const int uid);
     int mapped_gid_for(const int gid);
 
@@ -72,20 +108,56 @@ private:
     int handle_symlink(sftp_client_message msg);
     int handle_write(sftp_client_message msg);
     int handle_extended(sftp_client_message msg);
+    int handle_fsync(sftp_client_message msg);
+    int handle_statvfs(sftp_client_message msg);
+    int handle_limits(sftp_client_message msg);
+    int handle_copy_data(sftp_client_message msg);
 
-    SSHSession ssh_session;
+    std::shared_ptr<SharedSSHSession> ssh_session;
+    const bool session_is_shared;
     SSHFSProcUptr sshfs_process;
+    ssh_channel_callbacks_struct sshfs_channel_callbacks{}; // before the session, which frees the channel they are on
+    optional<int> sshfs_exit_code;                         // as the callbacks tell, under the session's mutex
+    bool sshfs_channel_closed{false};
     SftpSessionUptr sftp_server_session;
     const std::string source_path;
     const std::string target_path;
-    std::unordered_map<void*, std::unique_ptr<QFileInfoList>> open_dir_handles;
-    std::unordered_map<void*, std::unique_ptr<QFile>> open_file_handles;
+    HandleTable<QDirIterator> open_dir_handles{'d'};
+    HandleTable<QFile> open_file_handles{'f'};
     const std::unordered_map<int, int> gid_map;
     const std::unordered_map<int, int> uid_map;
     const int default_uid;
     const int default_gid;
     const std::string sshfs_exec_line;
-    bool stop_invoked{false};
+    std::atomic_bool stop_invoked{false};
+    AttributeCache attribute_cache;
+
+    struct PendingWrite // consecutive writes to adjacent ranges of one file, sent off together
+    {
+        QFile* file{nullptr};
+        qint64 offset{0};
+        std::vector<char> data;
+    } pending_write;
+    std::unordered_set<QFile*> failed_writes; // which had a pending write fail, to report when they are closed
+
+    struct ReadAhead // how far a handle is being read through in order, and how far the kernel was asked to read ahead
+    {
+        qint64 next_offset{0};
+        qint64 advised_to{0};
+        int sequential_reads{0};
+    };
+    std::unordered_map<QFile*, ReadAhead> read_aheads;
+    std::mutex read_ahead_mutex; // reads come in on the request pool
+
+    mutable std::mutex stats_mutex;
+    SftpStats sftp_stats; // but for the bytes, counted as they go
+    std::atomic<quint64> bytes_read{0};
+    std::atomic<quint64> bytes_written{0};
+
+    std::mutex pending_mutex;
+    std::condition_variable pending_cv;
+    int pending_requests{0};
+    QThreadPool request_pool; // last, so that it waits for its workers before anything they use goes away
 };
 } // namespace multipass
 #endif // MULTIPASS_SFTP_SERVER_H
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_SFTP_STATS_H
+#define MULTIPASS_SFTP_STATS_H
+
+#include <multipass/instrumentation.h>
+
+#include <QJsonObject>
+
+#include <array>
+#include <map>
+#include <string>
+
+namespace multipass
+{
+// What the SFTP server of a mount was asked to do, and how long that took, since it started. It travels from the
+// sshfs_server process to the daemon as JSON
+struct SftpStats
+{
+    struct Operation
+    {
+        std::array<quint64, Instrumentation::buckets.size()> bucket_counts{}; // of the latencies, not cumulative
+        quint64 count{0};
+        double seconds{0};
+        double max_seconds{0};
+    };
+
+    std::map<std::string, Operation> operations; // by message type, e.g. "read"
+    quint64 bytes_read{0};
+    quint64 bytes_written{0};
+    quint64 slow_operations{0};
+
+    QJsonObject to_json() const;
+    static SftpStats from_json(const QJsonObject& json);
+};
+} // namespace multipass
+
+#endif // MULTIPASS_SFTP_STATS_H
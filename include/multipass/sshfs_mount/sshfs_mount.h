@@ -18,6 +18,8 @@
 #ifndef MULTIPASS_SSHFS_MOUNT
 #define MULTIPASS_SSHFS_MOUNT
 
+#include <multipass/sshfs_mount/sftp_stats.h>
+
 #include <memory>
 #include <thread>
 #include <unordered_map>
@@ -26,17 +28,25 @@ namespace multipass
 {
 class SSHSession;
 class SftpServer;
+struct SharedSSHSession;
 class SshfsMount
 {
 public:
     SshfsMount(SSHSession&& session, const std::string& source, const std::string& target,
                const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map);
+    // Serves the mount over a channel of a session that other mounts use too
+    SshfsMount(std::shared_ptr<SharedSSHSession> session, const std::string& source, const std::string& target,
+               const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map);
     SshfsMount(SshfsMount&& other);
     ~SshfsMount();
 
     void stop();
 
+    SftpStats stats() const;
+
 private:
+    explicit SshfsMount(std::unique_ptr<SftpServer> sftp_server);
+
     // sftp_server Doesn't need to be a pointer, but done for now to avoid bringing sftp.h
     // which has an error with -pedantic.
     std::unique_ptr<SftpServer> sftp_server;
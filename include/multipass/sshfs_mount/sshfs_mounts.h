@@ -19,12 +19,19 @@
 #define MULTIPASS_SSHFSMOUNTS_H
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
+#include <multipass/optional.h>
 #include <multipass/process/process.h>
 #include <multipass/qt_delete_later_unique_ptr.h>
 #include <multipass/ssh/ssh_key_provider.h>
+#include <multipass/sshfs_mount/sftp_stats.h>
+#include <multipass/sshfs_server_config.h>
+
+#include <QFutureSynchronizer>
 
 namespace multipass
 {
@@ -36,18 +43,49 @@ class SSHFSMounts : public QObject
 public:
     explicit SSHFSMounts(const SSHKeyProvider& ssh_key_provider);
 
+    // Compression is a value of local.ssh-compression for the mount's session, empty to follow the setting
     void start_mount(VirtualMachine* vm, const std::string& source_path, const std::string& target_path,
-                     const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map);
+                     const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map,
+                     const std::string& compression = {});
+    // Serves all the mounts from one sshfs_server process, over a single ssh session
+    void start_mounts(VirtualMachine* vm, const std::vector<SSHFSServerConfig::Mount>& mounts,
+                      const std::string& compression = {});
 
     bool stop_mount(const std::string& instance, const std::string& path);
     void stop_all_mounts_for_instance(const std::string& instance);
 
     bool has_instance_already_mounted(const std::string& instance, const std::string& path) const;
 
+    // As last reported by the process serving the mount, which does so every few seconds
+    optional<SftpStats> mount_stats(const std::string& instance, const std::string& path) const;
+
+    // The SSH sessions that the mounts of an instance hold, and how many operations they were asked for in all,
+    // which only moves while the instance uses them
+    struct Activity
+    {
+        std::size_t sessions{0};
+        quint64 operations{0};
+    };
+    Activity activity_of(const std::string& instance) const;
+
 private:
+    struct ServerProcess
+    {
+        qt_delete_later_unique_ptr<Process> process;
+        SSHFSServerConfig config;                         // all the mounts it serves
+        QByteArray output;                                // the start of a line yet to be finished
+        std::unordered_map<std::string, SftpStats> stats; // by target path
+    };
+
+    void start_server(const SSHFSServerConfig& config);
+    void restart_server(const SSHFSServerConfig& config);
+    void read_stats(const std::string& instance, ServerProcess& server);
+
     const std::string key;
-    std::unordered_map<std::string, std::unordered_map<std::string, qt_delete_later_unique_ptr<Process>>>
+    mutable std::mutex mutex; // mounts start from worker threads, several at a time
+    std::unordered_map<std::string, std::unordered_map<std::string, std::shared_ptr<ServerProcess>>>
         mount_processes;
+    QFutureSynchronizer<void> restarts; // last, to wait for them before the rest goes
 };
 
 } // namespace multipass
@@ -20,6 +20,7 @@
 
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace multipass
 {
@@ -35,6 +36,17 @@ struct SSHFSServerConfig
     std::string target_path;
     std::unordered_map<int, int> gid_map;
     std::unordered_map<int, int> uid_map;
+    int compression{0}; // the SSHSession::Compression of the process's session, passed on like the log level
+    int compression_level{0};
+
+    struct Mount
+    {
+        std::string source_path;
+        std::string target_path;
+        std::unordered_map<int, int> gid_map;
+        std::unordered_map<int, int> uid_map;
+    };
+    std::vector<Mount> additional_mounts; // served by the same process, over the same ssh session
 };
 
 } // namespace multipass
@@ -18,6 +18,7 @@
 #ifndef MULTIPASS_URL_DOWNLOADER_H
 #define MULTIPASS_URL_DOWNLOADER_H
 
+#include <multipass/download_scheduler.h>
 #include <multipass/path.h>
 #include <multipass/progress_monitor.h>
 #include <multipass/singleton.h>
@@ -28,13 +29,22 @@
 
 #include <atomic>
 #include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #define MP_NETMGRFACTORY multipass::NetworkManagerFactory::instance()
 
+class QFile;
+class QNetworkReply;
+class QThread;
 class QUrl;
 class QString;
 namespace multipass
 {
+class Sha256;
+
 class NetworkManagerFactory : public Singleton<NetworkManagerFactory>
 {
 public:
@@ -47,12 +57,32 @@ class URLDownloader
 {
 public:
     URLDownloader(std::chrono::milliseconds timeout);
-    URLDownloader(const Path& cache_dir, std::chrono::milliseconds timeout);
-    virtual ~URLDownloader() = default;
+    // With max_connections above 1, large files from servers that accept byte ranges are fetched in that many
+    // ranges at once. With resume_downloads, files that fail to download are kept as "<file_name>.partial" and
+    // resumed by the next download to the same file, if the remote file did not change in the meantime. All file
+    // downloads share download_limits, with the priority that the calling thread set in a PriorityScope.
+    URLDownloader(const Path& cache_dir, std::chrono::milliseconds timeout, int max_connections = 1,
+                  bool resume_downloads = false, const DownloadScheduler::Limits& download_limits = {});
+    virtual ~URLDownloader();
     virtual void download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
                              const ProgressMonitor& monitor);
+    // Same as download_to(), but the SHA-256 digest of the data is computed as it is written, avoiding
+    // a second read of the file. Returns the hex-encoded digest.
+    virtual QString download_and_hash_to(const QUrl& url, const QString& file_name, int64_t size,
+                                         const int download_type, const ProgressMonitor& monitor);
+    // Hands the downloaded data over to consume as it arrives, instead of writing it to a file. A false return
+    // from consume aborts the download. Returns the hex-encoded SHA-256 digest of the data.
+    using DataConsumer = std::function<bool(const QByteArray&)>;
+    virtual QString stream_and_hash(const QUrl& url, const DataConsumer& consume, int64_t size,
+                                    const int download_type, const ProgressMonitor& monitor);
     virtual QByteArray download(const QUrl& url);
+    // The bytes of the remote file from start up to end, exclusive, which the server must serve as a byte range
+    virtual QByteArray download_range(const QUrl& url, qint64 start, qint64 end);
     virtual QDateTime last_modified(const QUrl& url);
+    // Lets a file download that failed part way be resumed from another server with the same file, such as a mirror.
+    // Only the Last-Modified validator carries over, since mirrors keep modification times while ETags are each
+    // server's own; without it, the next download starts over.
+    virtual void hand_over_partial_download(const QUrl& from, const QUrl& to, const QString& file_name);
     virtual void abort_all_downloads();
 
 protected:
@@ -61,9 +91,33 @@ protected:
 private:
     URLDownloader(const URLDownloader&) = delete;
     URLDownloader& operator=(const URLDownloader&) = delete;
+    QNetworkAccessManager* network_manager();
+    void download_to_file(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                          const ProgressMonitor& monitor, Sha256* hash);
+    bool download_ranges_to(QNetworkAccessManager* manager, const QUrl& url, QFile& file, const int download_type,
+                            const ProgressMonitor& monitor, Sha256* hash,
+                            const DownloadScheduler::Slot& slot);
+    void finish_download_to(QFile& file, const QString& file_name, const QString& state_path);
+    void download_with(QNetworkAccessManager* manager, const QUrl& url, int64_t size, const int download_type,
+                       const ProgressMonitor& monitor, Sha256* hash, const DataConsumer& consume,
+                       const std::function<bool(QNetworkReply*)>& start_reply, const std::function<void()>& on_error,
+                       const DownloadScheduler::Slot& slot, qint64 resume_offset = 0, const QByteArray& if_range = {});
 
     const Path cache_dir_path;
     std::chrono::milliseconds timeout;
+    const int max_connections;
+    const bool resume_downloads;
+    DownloadScheduler scheduler;
+
+    // A QNetworkAccessManager can only be used from the thread that created it, so each thread gets its own. Keeping
+    // them around lets consecutive requests reuse open connections instead of paying for new ones every time.
+    struct ThreadNetworkManager
+    {
+        std::unique_ptr<QNetworkAccessManager> manager;
+        QMetaObject::Connection thread_finished;
+    };
+    std::mutex network_managers_mutex;
+    std::unordered_map<QThread*, ThreadNetworkManager> network_managers;
 };
 }
 #endif // MULTIPASS_URL_DOWNLOADER_H
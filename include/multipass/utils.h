@@ -26,6 +26,7 @@
 
 #include <yaml-cpp/yaml.h>
 
+#include <algorithm>
 #include <chrono>
 #include <functional>
 #include <sstream>
@@ -107,7 +108,8 @@ void wait_until_ssh_up(VirtualMachine* virtual_machine, std::chrono::millisecond
                        std::function<void()> const& ensure_vm_is_running = []() {});
 void install_sshfs_for(const std::string& name, SSHSession& session,
                        const std::chrono::milliseconds timeout = std::chrono::minutes(5));
-std::string run_in_ssh_session(SSHSession& session, const std::string& cmd);
+std::string run_in_ssh_session(SSHSession& session, const std::string& cmd,
+                               std::chrono::milliseconds timeout = std::chrono::seconds(5));
 
 // yaml helpers
 std::string emit_yaml(const YAML::Node& node);
@@ -150,14 +152,17 @@ void multipass::utils::try_action_for(OnTimeoutCallable&& on_timeout, std::chron
     static_assert(std::is_same<decltype(try_action(std::forward<Args>(args)...)), TimeoutAction>::value, "");
     using namespace std::literals::chrono_literals;
 
+    // Retry soon at first, when things are most likely to be about ready, then back off up to a second at a time
+    auto delay = std::chrono::milliseconds{100ms};
     auto deadline = std::chrono::steady_clock::now() + timeout;
     while (std::chrono::steady_clock::now() < deadline)
     {
         if (try_action(std::forward<Args>(args)...) == TimeoutAction::done)
             return;
 
-        // The < 1s is used for testing so unit tests don't have to sleep to 1 second
-        std::this_thread::sleep_for(timeout < 1s ? timeout : 1s);
+        auto time_left = deadline - std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(delay, time_left));
+        delay = std::min(delay * 2, std::chrono::milliseconds{1s});
     }
     on_timeout();
 }
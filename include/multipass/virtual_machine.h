@@ -18,7 +18,11 @@
 #ifndef MULTIPASS_VIRTUAL_MACHINE_H
 #define MULTIPASS_VIRTUAL_MACHINE_H
 
+#include <multipass/exceptions/not_implemented_on_this_backend_exception.h>
+#include <multipass/io_limits.h>
 #include <multipass/ip_address.h>
+#include <multipass/memory_size.h>
+#include <multipass/native_mount.h>
 #include <multipass/optional.h>
 
 #include <chrono>
@@ -48,6 +52,25 @@ public:
         unknown
     };
 
+    // Resource usage in bytes, as far as the hypervisor can tell without asking the instance
+    struct Metrics
+    {
+        optional<long long> memory_used;
+        optional<long long> memory_total;
+        optional<long long> disk_used;
+        optional<long long> disk_total;
+        optional<long long> cpu_time_ms;    // the host spent running the instance, all told
+        optional<long long> disk_allocated; // on the host, by the instance's disk image
+        optional<long long> net_rx_bytes;   // received by the instance since it started
+        optional<long long> net_tx_bytes;   // sent by the instance since it started
+    };
+
+    struct GuestCommandResult
+    {
+        int exit_code;
+        std::string output;
+    };
+
     using UPtr = std::unique_ptr<VirtualMachine>;
     using ShPtr = std::shared_ptr<VirtualMachine>;
 
@@ -71,6 +94,63 @@ public:
     virtual void ensure_vm_is_running() = 0;
     virtual void update_state() = 0;
 
+    // Expected to be cheap, returning what is already at hand rather than waiting on the instance
+    virtual Metrics metrics()
+    {
+        return {};
+    }
+
+    // Runs a shell command through the hypervisor's channel to a guest agent, sparing management calls the network
+    // and the SSH handshake. Returns nothing when the instance has no agent to answer, so callers fall back to SSH
+    virtual optional<GuestCommandResult> run_in_guest(const std::string& /*command*/,
+                                                      std::chrono::milliseconds /*timeout*/)
+    {
+        return nullopt;
+    }
+
+    // Runs a shell command as root in an instance that was just resumed, as soon as it can be reached, be it before
+    // its network is right. Tells whether it succeeded before the timeout. Blocks, so not for the main thread
+    virtual bool run_after_resume(const std::string& /*command*/, const SSHKeyProvider& /*key_provider*/,
+                                  std::chrono::milliseconds /*timeout*/)
+    {
+        throw NotImplementedOnThisBackendException("cloning suspended instances");
+    }
+
+    // Directories for the hypervisor to share with the instance, taking effect from its next boot
+    virtual void set_native_mounts(const std::vector<NativeMount>& mounts)
+    {
+        if (!mounts.empty())
+            throw NotImplementedOnThisBackendException("native mounts");
+    }
+
+    // Replaces the limits the instance was described with, taking effect straight away when it runs
+    virtual void set_io_limits(const IoLimits& limits)
+    {
+        if (!limits.empty())
+            throw NotImplementedOnThisBackendException("I/O limits");
+    }
+
+    // Rewrites the disk of a stopped instance without the space its guest freed, returning how many bytes the host
+    // got back. May take minutes, so it is not to be called from the main thread
+    virtual long long compact_disk()
+    {
+        return 0;
+    }
+
+    // Gives the instance as many vCPUs and as much memory, straight away when it runs as far as it can be done
+    // without a reboot, and in full from its next boot
+    virtual void resize(int num_cores, const MemorySize& mem_size)
+    {
+        throw NotImplementedOnThisBackendException("resizing");
+    }
+
+    // Sets the instance going down without waiting for it, so that the daemon can take all of its instances down at once
+    // when it goes. The destructor then waits for it, until the deadline. A running instance is suspended rather than
+    // powered down when asked to. Instances of backends that do not do this go down in their destructors as before.
+    virtual void begin_shutdown(bool suspend, std::chrono::steady_clock::time_point deadline)
+    {
+    }
+
     VirtualMachine::State state;
     const std::string vm_name;
     std::condition_variable state_wait;
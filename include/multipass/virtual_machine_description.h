@@ -18,6 +18,7 @@
 #ifndef MULTIPASS_VIRTUAL_MACHINE_DESCRIPTION_H
 #define MULTIPASS_VIRTUAL_MACHINE_DESCRIPTION_H
 
+#include <multipass/io_limits.h>
 #include <multipass/memory_size.h>
 #include <multipass/network_interface.h>
 #include <multipass/vm_image.h>
@@ -50,6 +51,9 @@ public:
     YAML::Node user_data_config;
     YAML::Node vendor_data_config;
     YAML::Node network_data_config;
+    std::string storage_profile; // how backends tune the instance disk, empty for their defaults
+    IoLimits io_limits;
+    bool ephemeral{false}; // what the instance writes to its disk is thrown away with it
 };
 } // namespace multipass
 
@@ -20,7 +20,9 @@
 
 #include <multipass/days.h>
 #include <multipass/fetch_type.h>
+#include <multipass/io_limits.h>
 #include <multipass/path.h>
+#include <multipass/progress_monitor.h>
 #include <multipass/virtual_machine.h>
 #include <multipass/vm_image.h>
 #include <multipass/vm_image_vault.h>
@@ -53,9 +55,30 @@ public:
      */
     virtual void remove_resources_for(const std::string& name) = 0;
 
+    /** Carries the resources associated with a VM over to a new name, for a stopped or suspended VM whose object has
+     * been dropped and is about to be created again under that name.
+     *
+     * @param from The name the resources are currently held under
+     * @param to The name they are to be held under instead
+     */
+    virtual void rename_resources_for(const std::string& from, const std::string& to) = 0;
+    // Whether rename_resources_for can be called at all on this backend
+    virtual bool can_rename_resources() const = 0;
+    // Whether instances of this backend can be held to the limits, both at launch and when throttled
+    virtual bool can_limit_io(const IoLimits& limits) const = 0;
+
+    /** Carries the memory of a suspended VM over to a clone whose image was layered on top of the VM's, so that the
+     * clone resumes where the VM was suspended rather than booting.
+     *
+     * @param source_image The image of the suspended VM
+     * @param clone_image The image of the clone, layered on top of the VM's as it was suspended
+     */
+    virtual void clone_suspended_state(const VMImage& source_image, const VMImage& clone_image) = 0;
+
     virtual FetchType fetch_type() = 0;
     virtual void prepare_networking(std::vector<NetworkInterface>& extra_interfaces) = 0; // note the arg may be updated
-    virtual VMImage prepare_source_image(const VMImage& source_image) = 0;
+    // How far along the preparation is goes to monitor as a percentage, under a progress type the monitor picks
+    virtual VMImage prepare_source_image(const VMImage& source_image, const ProgressMonitor& monitor) = 0;
     virtual void prepare_instance_image(const VMImage& instance_image, const VirtualMachineDescription& desc) = 0;
     virtual void hypervisor_health_check() = 0;
     virtual QString get_backend_directory_name() = 0;
@@ -68,6 +91,9 @@ public:
     // List all the network interfaces seen by the backend.
     virtual std::vector<NetworkInterfaceInfo> networks() const = 0;
 
+    // The host's own address on the network instances are put on, or empty when the backend does not manage one.
+    virtual std::string host_address() const = 0;
+
 protected:
     VirtualMachineFactory() = default;
     VirtualMachineFactory(const VirtualMachineFactory&) = delete;
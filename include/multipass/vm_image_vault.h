@@ -46,6 +46,10 @@ QString copy(const QString& file_name, const QDir& output_dir);
 void delete_file(const Path& path);
 QString compute_image_hash(const Path& image_path);
 void verify_image_download(const Path& image_path, const QString& image_hash);
+void verify_image_hash(const QString& computed_hash, const QString& image_hash);
+// Images compressed with xz or zstd, by their .xz or .zst suffix, which extract_image() takes off
+bool is_compressed_image(const Path& image_path);
+QString decompressed_path(const Path& image_path);
 QString extract_image(const Path& image_path, const ProgressMonitor& monitor, const bool delete_file = false);
 std::unordered_map<std::string, VMImageHost*> configure_image_host_map(const std::vector<VMImageHost*>& image_hosts);
 
@@ -82,12 +86,23 @@ public:
                                 const ProgressMonitor& monitor) = 0;
     virtual void remove(const std::string& name) = 0;
     virtual bool has_record_for(const std::string& name) = 0;
+    // Hands the instance image kept for one name over to another, returning it at its new location
+    virtual VMImage rename(const std::string& from, const std::string& to) = 0;
+    // Keeps a copy of an instance's image as a source image of its own, launched as "baked:<image_name>"
+    virtual VMImage bake(const std::string& instance_name, const std::string& image_name) = 0;
+    // Gives a new instance a copy of another's image, sharing its extents where the filesystem allows
+    virtual VMImage clone(const std::string& source_name, const std::string& destination_name) = 0;
+    // Gives a new instance an overlay on top of what another's image holds so far, which is frozen into a base they
+    // both share from then on; the source must not be running
+    virtual VMImage clone_layered(const std::string& source_name, const std::string& destination_name) = 0;
     virtual void prune_expired_images() = 0;
     virtual void update_images(const FetchType& fetch_type, const PrepareAction& prepare,
                                const ProgressMonitor& monitor) = 0;
     virtual MemorySize minimum_image_size_for(const std::string& id) = 0;
     virtual VMImageHost* image_host_for(const std::string& remote_name) const = 0;
     virtual std::vector<std::pair<std::string, VMImageInfo>> all_info_for(const Query& query) const = 0;
+    // The images that launch can have without downloading, named as launch takes them, e.g. "daily:20.04"
+    virtual std::vector<std::string> cached_images() = 0;
 
 protected:
     VMImageVault() = default;
@@ -21,8 +21,14 @@
 #include <multipass/path.h>
 #include <multipass/progress_monitor.h>
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <memory>
+#include <mutex>
+#include <thread>
 
+#include <QByteArray>
 #include <QFile>
 
 #include <xz.h>
@@ -42,5 +48,34 @@ private:
     QFile xz_file;
     XzDecoderUPtr xz_decoder;
 };
+
+// Decodes xz data that is handed over in chunks, e.g. as it arrives from the network. Decoding happens on a worker
+// thread, with a bounded queue between the producer and the decoder, so only the decoded image touches the disk.
+class XzStreamDecoder
+{
+public:
+    XzStreamDecoder(const Path& decoded_file_path, std::size_t max_queued_chunks = 64);
+    ~XzStreamDecoder();
+
+    // Blocks while the queue is full. Returns false if decoding failed and no more data is wanted.
+    bool write(const QByteArray& chunk);
+    // Waits for all the queued data to be decoded, rethrowing any decoding error
+    void finish();
+
+private:
+    void decode();
+    bool next_chunk(QByteArray& chunk);
+
+    QFile decoded_file;
+    XzImageDecoder::XzDecoderUPtr xz_decoder;
+    const std::size_t max_queued_chunks;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::deque<QByteArray> queued_chunks;
+    bool input_done{false};
+    bool decoding_done{false};
+    std::exception_ptr decode_error;
+    std::thread worker;
+};
 } // namespace multipass
 #endif // MULTIPASS_XZ_IMAGE_DECODER_H
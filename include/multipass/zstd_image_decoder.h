@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_ZSTD_IMAGE_DECODER_H
+#define MULTIPASS_ZSTD_IMAGE_DECODER_H
+
+#include <multipass/path.h>
+#include <multipass/progress_monitor.h>
+#include <multipass/sparse_writer.h>
+
+#include <exception>
+#include <memory>
+#include <vector>
+
+#include <QByteArray>
+#include <QFile>
+
+#include <zstd.h>
+
+namespace multipass
+{
+// Decodes zstd data that is handed over in chunks, e.g. as it arrives from the network. zstd decodes several times
+// faster than images download, so unlike XzStreamDecoder it needs no worker thread and decodes as it is written to.
+class ZstdStreamDecoder
+{
+public:
+    explicit ZstdStreamDecoder(const Path& decoded_file_path);
+
+    // Returns false if decoding failed and no more data is wanted
+    bool write(const QByteArray& chunk);
+    // Flushes what is left of the decoded data, throwing any decoding error or if the data ended part way through
+    void finish();
+
+    using ZstdDecoderUPtr = std::unique_ptr<ZSTD_DStream, decltype(ZSTD_freeDStream)*>;
+
+private:
+    void decode(const QByteArray& chunk);
+    void write_out(const ZSTD_outBuffer& output);
+
+    QFile decoded_file;
+    SparseWriter writer;
+    ZstdDecoderUPtr zstd_decoder;
+    std::vector<char> write_data;
+    std::size_t frame_remaining{0}; // a hint from the decoder, zero once a frame is complete
+    bool had_data{false};
+    std::exception_ptr decode_error;
+};
+
+class ZstdImageDecoder
+{
+public:
+    explicit ZstdImageDecoder(const Path& zstd_file_path);
+
+    void decode_to(const Path& decoded_file_path, const ProgressMonitor& monitor);
+
+private:
+    QFile zstd_file;
+};
+} // namespace multipass
+#endif // MULTIPASS_ZSTD_IMAGE_DECODER_H
@@ -16,9 +16,13 @@
  */
 
 #include "client.h"
+#include "cmd/bake.h"
+#include "cmd/bench_mount.h"
+#include "cmd/clone.h"
 #include "cmd/delete.h"
 #include "cmd/exec.h"
 #include "cmd/find.h"
+#include "cmd/forward.h"
 #include "cmd/get.h"
 #include "cmd/help.h"
 #include "cmd/info.h"
@@ -28,17 +32,23 @@
 #include "cmd/networks.h"
 #include "cmd/purge.h"
 #include "cmd/recover.h"
+#include "cmd/resize.h"
 #include "cmd/restart.h"
 #include "cmd/set.h"
 #include "cmd/shell.h"
 #include "cmd/start.h"
+#include "cmd/stats.h"
 #include "cmd/stop.h"
 #include "cmd/suspend.h"
+#include "cmd/throttle.h"
 #include "cmd/transfer.h"
 #include "cmd/umount.h"
 #include "cmd/version.h"
 
 #include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <string>
 
 #include <multipass/cli/argparser.h>
 #include <multipass/cli/client_common.h>
@@ -48,12 +58,74 @@
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 
+namespace
+{
+// Splits a line into words the way a shell would at its simplest: on blanks, except within quotes
+QStringList split_command_line(const std::string& line)
+{
+    QStringList words;
+    QString word;
+    bool in_word{false};
+    char quote{'\0'};
+
+    for (auto it = line.cbegin(); it != line.cend(); ++it)
+    {
+        const auto c = *it;
+        if (quote != '\0')
+        {
+            if (c == quote)
+                quote = '\0';
+            else if (c == '\\' && quote == '"' && std::next(it) != line.cend())
+                word += *++it;
+            else
+                word += c;
+        }
+        else if (c == '\'' || c == '"')
+        {
+            quote = c;
+            in_word = true;
+        }
+        else if (c == '\\' && std::next(it) != line.cend())
+        {
+            word += *++it;
+            in_word = true;
+        }
+        else if (std::isspace(static_cast<unsigned char>(c)))
+        {
+            if (in_word)
+                words << word;
+            word.clear();
+            in_word = false;
+        }
+        else
+        {
+            word += c;
+            in_word = true;
+        }
+    }
+
+    if (in_word)
+        words << word;
+
+    return words;
+}
+} // namespace
+
 mp::Client::Client(ClientConfig& config)
     : cert_provider{std::move(config.cert_provider)},
       rpc_channel{mp::client::make_channel(config.server_address, config.conn_type, *cert_provider)},
       stub{mp::Rpc::NewStub(rpc_channel)},
       term{config.term}
 {
+    add_commands();
+}
+
+void mp::Client::add_commands()
+{
+    add_command<cmd::Bake>();
+    add_command<cmd::BenchMount>();
+    add_command<cmd::Clone>();
+    add_command<cmd::Forward>();
     add_command<cmd::Launch>();
     add_command<cmd::Purge>();
     add_command<cmd::Exec>();
@@ -65,11 +137,14 @@ mp::Client::Client(ClientConfig& config)
     add_command<cmd::Networks>();
     add_command<cmd::Mount>();
     add_command<cmd::Recover>();
+    add_command<cmd::Resize>();
     add_command<cmd::Set>();
     add_command<cmd::Shell>();
     add_command<cmd::Start>();
+    add_command<cmd::Stats>();
     add_command<cmd::Stop>();
     add_command<cmd::Suspend>();
+    add_command<cmd::Throttle>();
     add_command<cmd::Transfer>();
     add_command<cmd::Restart>();
     add_command<cmd::Delete>();
@@ -87,6 +162,9 @@ void mp::Client::sort_commands()
 
 int mp::Client::run(const QStringList& arguments)
 {
+    if (arguments.size() == 2 && arguments.at(1) == batch_flag)
+        return run_batch(arguments.at(0));
+
     QString description("Create, control and connect to Ubuntu instances.\n\n"
                         "This is a command line utility for multipass, a\n"
                         "service that manages Ubuntu instances.");
@@ -107,3 +185,26 @@ int mp::Client::run(const QStringList& arguments)
 
     return ret;
 }
+
+// Runs one command per line of input over the same channel, so that scripts pay for connecting to the daemon once
+int mp::Client::run_batch(const QString& program)
+{
+    auto ret = ReturnCode::Ok;
+    std::string line;
+    while (std::getline(term->cin(), line))
+    {
+        auto words = split_command_line(line);
+        if (words.isEmpty() || words.first().startsWith('#'))
+            continue;
+
+        // Commands keep the request they build, so each line gets fresh ones
+        commands.clear();
+        add_commands();
+
+        words.prepend(program);
+        if (auto line_ret = static_cast<ReturnCode>(run(words)); line_ret != ReturnCode::Ok)
+            ret = line_ret;
+    }
+
+    return ret;
+}
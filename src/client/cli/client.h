@@ -41,6 +41,9 @@ struct ClientConfig
 class Client
 {
 public:
+    // Makes the client run the commands read from its input, one per line
+    static constexpr auto batch_flag = "--batch";
+
     explicit Client(ClientConfig& context);
     virtual ~Client() = default;
     int run(const QStringList& arguments);
@@ -48,9 +51,12 @@ public:
 protected:
     template <typename T>
     void add_command();
+    void add_commands();
     void sort_commands();
 
 private:
+    int run_batch(const QString& program);
+
     const std::unique_ptr<CertProvider> cert_provider;
     std::shared_ptr<grpc::Channel> rpc_channel;
     std::unique_ptr<multipass::Rpc::Stub> stub;
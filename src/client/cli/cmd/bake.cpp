@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "bake.h"
+#include "common_cli.h"
+
+#include "animated_spinner.h"
+
+#include <multipass/cli/argparser.h>
+#include <multipass/format.h>
+
+namespace mp = multipass;
+namespace cmd = multipass::cmd;
+using RpcMethod = mp::Rpc::Stub;
+
+mp::ReturnCode cmd::Bake::run(mp::ArgParser* parser)
+{
+    auto ret = parse_args(parser);
+    if (ret != ParseCode::Ok)
+    {
+        return parser->returnCodeFrom(ret);
+    }
+
+    AnimatedSpinner spinner{cout};
+    std::string baked_name;
+    auto on_success = [this, &spinner, &baked_name](mp::BakeReply& reply) {
+        spinner.stop();
+        cout << "Baked " << baked_name << ", launch it with `multipass launch " << baked_name << "`\n";
+        return ReturnCode::Ok;
+    };
+
+    auto on_failure = [this, &spinner](grpc::Status& status) {
+        spinner.stop();
+        return standard_failure_handler_for(name(), cerr, status);
+    };
+
+    auto streaming_callback = [this, &spinner, &baked_name](mp::BakeReply& reply) {
+        if (!reply.log_line().empty())
+            spinner.print(cerr, reply.log_line());
+
+        if (!reply.image_name().empty())
+            baked_name = reply.image_name();
+    };
+
+    spinner.start(fmt::format("Baking {}", request.instance_name()));
+    request.set_verbosity_level(parser->verbosityLevel());
+    return dispatch(&RpcMethod::bake, request, on_success, on_failure, streaming_callback);
+}
+
+std::string cmd::Bake::name() const
+{
+    return "bake";
+}
+
+QString cmd::Bake::short_help() const
+{
+    return QStringLiteral("Keep an instance's disk as an image to launch from");
+}
+
+QString cmd::Bake::description() const
+{
+    return QStringLiteral("Wait for cloud-init to finish in a running instance, clean its\n"
+                          "state and stop the instance, then keep a copy of its disk as an\n"
+                          "image. Instances launched from \"baked:<image>\" start out with\n"
+                          "what was installed, so cloud-init has little left to do.");
+}
+
+mp::ParseCode cmd::Bake::parse_args(mp::ArgParser* parser)
+{
+    parser->addPositionalArgument("instance", "Name of the running instance to bake", "<instance>");
+    parser->addPositionalArgument("image", "Name to give the image. If omitted, the instance's name is used",
+                                  "[<image>]");
+
+    auto status = parser->commandParse(this);
+    if (status != ParseCode::Ok)
+        return status;
+
+    const auto args = parser->positionalArguments();
+    if (args.isEmpty() || args.count() > 2)
+    {
+        cerr << "Wrong number of arguments\n";
+        return ParseCode::CommandLineError;
+    }
+
+    request.set_instance_name(args.at(0).toStdString());
+    if (args.count() == 2)
+        request.set_image_name(args.at(1).toStdString());
+
+    return status;
+}
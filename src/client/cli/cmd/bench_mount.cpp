@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "bench_mount.h"
+#include "common_cli.h"
+
+#include "animated_spinner.h"
+
+#include <multipass/cli/argparser.h>
+#include <multipass/format.h>
+
+#include <algorithm>
+
+namespace mp = multipass;
+namespace cmd = multipass::cmd;
+using RpcMethod = mp::Rpc::Stub;
+
+namespace
+{
+constexpr auto row_format = "{:<16}{:>8}{:>14}{:>11}{:>10}{:>10}\n";
+
+std::string latency(double seconds)
+{
+    if (seconds < 1e-3)
+        return fmt::format("{:.0f}us", seconds * 1e6);
+    if (seconds < 1)
+        return fmt::format("{:.1f}ms", seconds * 1e3);
+    return fmt::format("{:.2f}s", seconds);
+}
+
+std::string row_for(const mp::BenchMountResult& result)
+{
+    const auto seconds = std::max(result.seconds(), 1e-9);
+    const auto throughput = result.bytes() ? fmt::format("{:.1f} MB/s", result.bytes() / seconds / 1e6) : "-";
+
+    return fmt::format(row_format, result.operation(), result.count(), throughput,
+                       fmt::format("{:.0f}", result.count() / seconds), latency(result.p50_seconds()),
+                       latency(result.p99_seconds()));
+}
+} // namespace
+
+mp::ReturnCode cmd::BenchMount::run(mp::ArgParser* parser)
+{
+    auto ret = parse_args(parser);
+    if (ret != ParseCode::Ok)
+    {
+        return parser->returnCodeFrom(ret);
+    }
+
+    AnimatedSpinner spinner{cout};
+    auto on_success = [&spinner](mp::BenchMountReply& reply) {
+        spinner.stop();
+        return ReturnCode::Ok;
+    };
+
+    auto on_failure = [this, &spinner](grpc::Status& status) {
+        spinner.stop();
+        return standard_failure_handler_for(name(), cerr, status);
+    };
+
+    auto printed_header = false;
+    auto streaming_callback = [this, &spinner, &printed_header](mp::BenchMountReply& reply) {
+        if (!reply.log_line().empty())
+            spinner.print(cerr, reply.log_line());
+
+        if (!reply.reply_message().empty())
+        {
+            spinner.stop();
+            spinner.start(reply.reply_message());
+        }
+
+        if (reply.has_result())
+        {
+            std::string rows;
+            if (!printed_header)
+                rows = fmt::format(row_format, "Operation", "Ops", "Throughput", "IOPS", "p50", "p99");
+            printed_header = true;
+
+            spinner.print(cout, rows + row_for(reply.result()));
+        }
+    };
+
+    request.set_verbosity_level(parser->verbosityLevel());
+    return dispatch(&RpcMethod::bench_mount, request, on_success, on_failure, streaming_callback);
+}
+
+std::string cmd::BenchMount::name() const
+{
+    return "bench-mount";
+}
+
+QString cmd::BenchMount::short_help() const
+{
+    return QStringLiteral("Measure the I/O performance of a mount");
+}
+
+QString cmd::BenchMount::description() const
+{
+    return QStringLiteral("Run a standard workload over a mount, from inside the running\n"
+                          "instance: sequential reads and writes, random 4K reads and\n"
+                          "writes, creating, stat'ing and unlinking many files, and listing\n"
+                          "a large directory. Report the throughput, operations per second\n"
+                          "and latencies of each. The workload needs python3 in the instance\n"
+                          "and cleans up after itself.");
+}
+
+mp::ParseCode cmd::BenchMount::parse_args(mp::ArgParser* parser)
+{
+    parser->addPositionalArgument("mount", "Mount to measure, in <name>:<path> format, where <path> is the mount "
+                                           "point in the instance",
+                                  "<name>:<path>");
+    QCommandLineOption size_option("size", "Size in MiB of the file that the sequential and random workloads use",
+                                   "size", "128");
+    parser->addOption(size_option);
+
+    auto status = parser->commandParse(this);
+    if (status != ParseCode::Ok)
+        return status;
+
+    const auto args = parser->positionalArguments();
+    if (args.count() != 1)
+    {
+        cerr << "Wrong number of arguments\n";
+        return ParseCode::CommandLineError;
+    }
+
+    const auto colon = args.at(0).indexOf(':');
+    if (colon < 1 || colon == args.at(0).size() - 1)
+    {
+        cerr << "The mount must be given as <name>:<path>\n";
+        return ParseCode::CommandLineError;
+    }
+
+    auto ok = false;
+    const auto size = parser->value(size_option).toInt(&ok);
+    if (!ok || size < 1)
+    {
+        cerr << "error: The size must be a positive integer\n";
+        return ParseCode::CommandLineError;
+    }
+
+    request.set_instance_name(args.at(0).left(colon).toStdString());
+    request.set_target_path(args.at(0).mid(colon + 1).toStdString());
+    request.set_size_mib(size);
+
+    return status;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "clone.h"
+#include "common_cli.h"
+
+#include "animated_spinner.h"
+
+#include <multipass/cli/argparser.h>
+#include <multipass/format.h>
+
+namespace mp = multipass;
+namespace cmd = multipass::cmd;
+using RpcMethod = mp::Rpc::Stub;
+
+mp::ReturnCode cmd::Clone::run(mp::ArgParser* parser)
+{
+    auto ret = parse_args(parser);
+    if (ret != ParseCode::Ok)
+    {
+        return parser->returnCodeFrom(ret);
+    }
+
+    AnimatedSpinner spinner{cout};
+    auto on_success = [this, &spinner](mp::CloneReply& reply) {
+        spinner.stop();
+        cout << "Cloned " << request.source_name() << " as " << request.destination_name() << "\n";
+        return ReturnCode::Ok;
+    };
+
+    auto on_failure = [this, &spinner](grpc::Status& status) {
+        spinner.stop();
+        return standard_failure_handler_for(name(), cerr, status);
+    };
+
+    auto streaming_callback = [this, &spinner](mp::CloneReply& reply) {
+        if (!reply.log_line().empty())
+            spinner.print(cerr, reply.log_line());
+
+        if (!reply.reply_message().empty())
+        {
+            spinner.stop();
+            spinner.start(reply.reply_message());
+        }
+    };
+
+    spinner.start(fmt::format("Cloning {}", request.source_name()));
+    request.set_verbosity_level(parser->verbosityLevel());
+    return dispatch(&RpcMethod::clone, request, on_success, on_failure, streaming_callback);
+}
+
+std::string cmd::Clone::name() const
+{
+    return "clone";
+}
+
+QString cmd::Clone::short_help() const
+{
+    return QStringLiteral("Make a new instance as a copy of another");
+}
+
+QString cmd::Clone::description() const
+{
+    return QStringLiteral("Make a new instance with a copy of another instance's disk and\n"
+                          "the same resources, but addresses, a hostname and host keys of\n"
+                          "its own. A running instance is stopped for the copy and started\n"
+                          "again after. The new instance is left stopped.\n\n"
+                          "A suspended instance serves as a template instead: the new one\n"
+                          "resumes where it was suspended, on a disk layered over its own,\n"
+                          "and is left running.");
+}
+
+mp::ParseCode cmd::Clone::parse_args(mp::ArgParser* parser)
+{
+    parser->addPositionalArgument("source", "Name of the instance to clone", "<source>");
+    parser->addPositionalArgument("name", "Name to give the new instance", "<name>");
+
+    auto status = parser->commandParse(this);
+    if (status != ParseCode::Ok)
+        return status;
+
+    const auto args = parser->positionalArguments();
+    if (args.count() != 2)
+    {
+        cerr << "Wrong number of arguments\n";
+        return ParseCode::CommandLineError;
+    }
+
+    request.set_source_name(args.at(0).toStdString());
+    request.set_destination_name(args.at(1).toStdString());
+
+    return status;
+}
@@ -23,7 +23,9 @@
 #include <multipass/cli/format_utils.h>
 #include <multipass/constants.h>
 #include <multipass/exceptions/cmd_exceptions.h>
+#include <multipass/exceptions/invalid_memory_size_exception.h>
 #include <multipass/exceptions/settings_exceptions.h>
+#include <multipass/memory_size.h>
 #include <multipass/settings.h>
 
 #include <QCommandLineOption>
@@ -207,3 +209,61 @@ std::unique_ptr<multipass::utils::Timer> multipass::cmd::make_timer(int timeout,
 
     return timer;
 }
+
+void multipass::cmd::add_io_limit_options(multipass::ArgParser* parser)
+{
+    QCommandLineOption disk_iops_option("disk-iops", "Limit the instance disk to this many operations per second.",
+                                        "iops");
+    QCommandLineOption disk_iops_burst_option(
+        "disk-iops-burst", "Let the instance disk reach this many operations per second in short bursts.", "iops");
+    QCommandLineOption disk_bandwidth_option(
+        "disk-bandwidth",
+        "Limit the instance disk to this many bytes per second. Positive integers, in bytes, or with K, M, G suffix.",
+        "rate");
+    QCommandLineOption disk_bandwidth_burst_option(
+        "disk-bandwidth-burst", "Let the instance disk reach this many bytes per second in short bursts.", "rate");
+    QCommandLineOption network_bandwidth_option(
+        "network-bandwidth", "Limit the instance network traffic to this many bytes per second each way.", "rate");
+
+    parser->addOptions({disk_iops_option, disk_iops_burst_option, disk_bandwidth_option, disk_bandwidth_burst_option,
+                        network_bandwidth_option});
+}
+
+mp::IoLimitOptions multipass::cmd::parse_io_limit_options(const multipass::ArgParser* parser)
+{
+    auto count = [parser](const QString& option) -> long long {
+        if (!parser->isSet(option))
+            return 0;
+
+        bool ok;
+        const auto value = parser->value(option).toLongLong(&ok);
+        if (!ok || value < 0)
+            throw mp::ValidationException(
+                fmt::format("--{} value has to be a non-negative integer", option.toStdString()));
+        return value;
+    };
+
+    auto rate = [parser](const QString& option) -> long long {
+        if (!parser->isSet(option))
+            return 0;
+
+        try
+        {
+            return mp::MemorySize{parser->value(option).toStdString()}.in_bytes();
+        }
+        catch (const mp::InvalidMemorySizeException&)
+        {
+            throw mp::ValidationException(
+                fmt::format("--{} value has to be a number of bytes, such as 100M", option.toStdString()));
+        }
+    };
+
+    mp::IoLimitOptions limits;
+    limits.set_disk_iops(count("disk-iops"));
+    limits.set_disk_iops_burst(count("disk-iops-burst"));
+    limits.set_disk_bytes_per_second(rate("disk-bandwidth"));
+    limits.set_disk_bytes_burst(rate("disk-bandwidth-burst"));
+    limits.set_network_bytes_per_second(rate("network-bandwidth"));
+
+    return limits;
+}
@@ -59,6 +59,8 @@ void add_timeout(multipass::ArgParser*);
 int parse_timeout(const multipass::ArgParser* parser);
 std::unique_ptr<multipass::utils::Timer> make_timer(int timeout, AnimatedSpinner* spinner, std::ostream& cerr,
                                                     const std::string& msg);
+void add_io_limit_options(multipass::ArgParser*);
+multipass::IoLimitOptions parse_io_limit_options(const multipass::ArgParser* parser); // zero for each option not set
 
 } // namespace cmd
 } // namespace multipass
@@ -17,8 +17,10 @@
 
 #include "delete.h"
 #include "common_cli.h"
+#include "host_pool.h"
 
 #include <multipass/cli/argparser.h>
+#include <multipass/exceptions/cmd_exceptions.h>
 
 namespace mp = multipass;
 namespace cmd = multipass::cmd;
@@ -76,6 +78,16 @@ mp::ParseCode cmd::Delete::parse_args(mp::ArgParser* parser)
 
     request.mutable_instance_names()->CopyFrom(add_instance_names(parser));
 
+    try
+    {
+        direct_to_host(*request.mutable_instance_names()->mutable_instance_name(), host_pool, rpc_channel, stub);
+    }
+    catch (const mp::ValidationException& e)
+    {
+        cerr << "error: " << e.what() << std::endl;
+        return ParseCode::CommandLineError;
+    }
+
     if (parser->isSet(purge_option))
     {
         request.set_purge(true);
@@ -18,8 +18,12 @@
 #ifndef MULTIPASS_DELETE_H
 #define MULTIPASS_DELETE_H
 
+#include "host_pool.h"
+
 #include <multipass/cli/command.h>
 
+#include <memory>
+
 namespace multipass
 {
 namespace cmd
@@ -36,6 +40,7 @@ public:
 
 private:
     DeleteRequest request;
+    std::unique_ptr<HostPool> host_pool; // of the host the instances are on, when not the default one
 
     ParseCode parse_args(ArgParser* parser) override;
 };
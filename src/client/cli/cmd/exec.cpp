@@ -19,12 +19,164 @@
 #include "common_cli.h"
 
 #include <multipass/cli/argparser.h>
+#include <multipass/constants.h>
+#include <multipass/format.h>
+#include <multipass/settings.h>
+#include <multipass/ssh/ssh_broker.h>
 #include <multipass/ssh/ssh_client.h>
+#include <multipass/ssh/ssh_client_key_provider.h>
+#include <multipass/ssh/ssh_session.h>
+#include <multipass/utils.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <sstream>
+#include <streambuf>
+#include <thread>
+#include <utility>
 
 namespace mp = multipass;
 namespace cmd = multipass::cmd;
 using RpcMethod = mp::Rpc::Stub;
 
+namespace
+{
+// Interactive commands get a terminal of their own, which the broker does not relay
+bool use_ssh_broker(mp::Terminal* term)
+{
+    return !term->is_live() && MP_SETTINGS.get(mp::ssh_broker_key) == "true";
+}
+
+// Passes output on to another stream a whole line at a time, each line tagged with a prefix, so that the output of
+// commands running side by side does not interleave mid-line
+class LinePrefixer : public std::streambuf
+{
+public:
+    LinePrefixer(std::ostream& out, std::mutex& out_mutex, const std::string& prefix)
+        : out{out}, out_mutex{out_mutex}, prefix{prefix}
+    {
+    }
+
+    // Hands on what is left of an unfinished last line
+    void finish()
+    {
+        if (!line.empty())
+        {
+            line.push_back('\n');
+            emit_line();
+        }
+    }
+
+protected:
+    int_type overflow(int_type c) override
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof()))
+            return traits_type::not_eof(c);
+
+        line.push_back(traits_type::to_char_type(c));
+        if (line.back() == '\n')
+            emit_line();
+
+        return c;
+    }
+
+    std::streamsize xsputn(const char* data, std::streamsize size) override
+    {
+        for (std::streamsize i = 0; i < size; ++i)
+            overflow(traits_type::to_int_type(data[i]));
+
+        return size;
+    }
+
+private:
+    void emit_line()
+    {
+        std::lock_guard<std::mutex> lock{out_mutex};
+        out << prefix << line << std::flush;
+        line.clear();
+    }
+
+    std::ostream& out;
+    std::mutex& out_mutex;
+    const std::string prefix;
+    std::string line;
+};
+
+// What one instance's command gets to see: no input, and output that ends up prefixed on the real terminal
+class InstanceTerminal : public mp::Terminal
+{
+public:
+    InstanceTerminal(mp::Terminal* term, std::mutex& out_mutex, const std::string& instance)
+        : out_buf{term->cout(), out_mutex, instance + ": "},
+          err_buf{term->cerr(), out_mutex, instance + ": "},
+          out{&out_buf},
+          err{&err_buf}
+    {
+    }
+
+    std::istream& cin() override
+    {
+        return in;
+    }
+
+    std::ostream& cout() override
+    {
+        return out;
+    }
+
+    std::ostream& cerr() override
+    {
+        return err;
+    }
+
+    bool cin_is_live() const override
+    {
+        return false;
+    }
+
+    bool cout_is_live() const override
+    {
+        return false;
+    }
+
+    void finish()
+    {
+        out_buf.finish();
+        err_buf.finish();
+    }
+
+private:
+    LinePrefixer out_buf;
+    LinePrefixer err_buf;
+    std::istringstream in;
+    std::ostream out;
+    std::ostream err;
+};
+
+// Goes through the broker's pooled sessions when there is a broker, and connects directly otherwise
+int exec_on(const mp::SSHInfo& ssh_info, const std::vector<std::string>& args, mp::Terminal* term,
+            const QString& broker, std::atomic_bool& broker_missing)
+{
+    if (!broker.isEmpty() && !broker_missing)
+    {
+        if (auto ret = mp::SSHBroker::exec(broker, ssh_info.host(), ssh_info.port(), ssh_info.username(),
+                                           ssh_info.priv_key_base64(), args, term))
+            return *ret;
+
+        broker_missing = true;
+    }
+
+    mp::SSHSession session{ssh_info.host(), ssh_info.port(), ssh_info.username(),
+                           mp::SSHClientKeyProvider{ssh_info.priv_key_base64()}};
+    auto process = session.exec(mp::utils::to_cmd(args, mp::utils::QuoteType::quote_every_arg));
+    process.read_std_output([term](const char* data, std::size_t size) { term->cout().write(data, size); });
+    process.read_std_error([term](const char* data, std::size_t size) { term->cerr().write(data, size); });
+
+    return process.exit_code();
+}
+} // namespace
+
 mp::ReturnCode cmd::Exec::run(mp::ArgParser* parser)
 {
     auto ret = parse_args(parser);
@@ -33,15 +185,31 @@ mp::ReturnCode cmd::Exec::run(mp::ArgParser* parser)
         return parser->returnCodeFrom(ret);
     }
 
+    // When the instances come from the options, every positional argument is part of the command
     std::vector<std::string> args;
-    for (int i = 1; i < parser->positionalArguments().size(); ++i)
+    for (int i = many_instances ? 0 : 1; i < parser->positionalArguments().size(); ++i)
         args.push_back(parser->positionalArguments().at(i).toStdString());
 
-    auto on_success = [this, &args](mp::SSHInfoReply& reply) { return exec_success(reply, args, term); };
+    request.set_verbosity_level(parser->verbosityLevel());
+
+    if (all_instances)
+    {
+        if (auto ret = select_running_instances(); ret != ReturnCode::Ok)
+            return ret;
+
+        if (request.instance_name().empty())
+        {
+            cerr << "There are no running instances\n";
+            return ReturnCode::Ok;
+        }
+    }
+
+    auto on_success = [this, &args](mp::SSHInfoReply& reply) {
+        return many_instances ? exec_on_all(reply, args, term, max_parallel) : exec_success(reply, args, term);
+    };
 
     auto on_failure = [this](grpc::Status& status) { return standard_failure_handler_for(name(), cerr, status); };
 
-    request.set_verbosity_level(parser->verbosityLevel());
     return dispatch(&RpcMethod::ssh_info, request, on_success, on_failure);
 }
 
@@ -57,7 +225,9 @@ QString cmd::Exec::short_help() const
 
 QString cmd::Exec::description() const
 {
-    return QStringLiteral("Run a command on an instance");
+    return QStringLiteral("Run a command on an instance. With --all or --instances, run it on several instances at\n"
+                          "once instead, each line of output prefixed with the name of the instance it came from.\n"
+                          "The command then gets no input, and fails if it failed on any of the instances.");
 }
 
 mp::ReturnCode cmd::Exec::exec_success(const mp::SSHInfoReply& reply, const std::vector<std::string>& args,
@@ -75,6 +245,15 @@ mp::ReturnCode cmd::Exec::exec_success(const mp::SSHInfoReply& reply, const std:
 
     try
     {
+        if (use_ssh_broker(term))
+        {
+            const auto broker = mp::SSHBroker::default_server_name();
+            if (auto ret = mp::SSHBroker::exec(broker, host, port, username, priv_key_blob, args, term))
+                return static_cast<mp::ReturnCode>(*ret);
+
+            mp::SSHBroker::spawn(); // for the commands that follow
+        }
+
         auto console_creator = [&term](auto channel) { return Console::make_console(channel, term); };
         mp::SSHClient ssh_client{host, port, username, priv_key_blob, console_creator};
         return static_cast<mp::ReturnCode>(ssh_client.exec(args));
@@ -86,11 +265,99 @@ mp::ReturnCode cmd::Exec::exec_success(const mp::SSHInfoReply& reply, const std:
     }
 }
 
+mp::ReturnCode cmd::Exec::exec_on_all(const mp::SSHInfoReply& reply, const std::vector<std::string>& args,
+                                      mp::Terminal* term, int max_parallel)
+{
+    std::vector<std::pair<std::string, mp::SSHInfo>> targets{reply.ssh_info().begin(), reply.ssh_info().end()};
+    std::sort(targets.begin(), targets.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    const auto broker = MP_SETTINGS.get(mp::ssh_broker_key) == "true" ? mp::SSHBroker::default_server_name() : "";
+    std::atomic_bool broker_missing{false};
+
+    std::vector<int> exit_codes(targets.size(), 0);
+    std::vector<std::string> errors(targets.size());
+    std::mutex out_mutex;
+    std::atomic_size_t next{0};
+
+    auto work = [&] {
+        for (auto i = next++; i < targets.size(); i = next++)
+        {
+            const auto& [instance, ssh_info] = targets[i];
+            InstanceTerminal instance_term{term, out_mutex, instance};
+            try
+            {
+                exit_codes[i] = exec_on(ssh_info, args, &instance_term, broker, broker_missing);
+            }
+            catch (const std::exception& e)
+            {
+                errors[i] = e.what();
+            }
+            instance_term.finish();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (auto n = std::min<std::size_t>(max_parallel, targets.size()); n > 0; --n)
+        workers.emplace_back(work);
+    for (auto& worker : workers)
+        worker.join();
+
+    if (broker_missing)
+        mp::SSHBroker::spawn(); // for the commands that follow
+
+    // Succeeds only when the command did everywhere, taking the status of the first instance it failed on otherwise
+    auto ret = ReturnCode::Ok;
+    for (std::size_t i = 0; i < targets.size(); ++i)
+    {
+        if (!errors[i].empty())
+            term->cerr() << fmt::format("{}: exec failed: {}\n", targets[i].first, errors[i]);
+        else if (exit_codes[i] != 0)
+            term->cerr() << fmt::format("{}: exited with status {}\n", targets[i].first, exit_codes[i]);
+        else
+            continue;
+
+        if (ret == ReturnCode::Ok)
+            ret = errors[i].empty() ? static_cast<ReturnCode>(exit_codes[i]) : ReturnCode::CommandFail;
+    }
+
+    return ret;
+}
+
+mp::ReturnCode cmd::Exec::select_running_instances()
+{
+    ListRequest list_request;
+    list_request.set_verbosity_level(request.verbosity_level());
+    list_request.add_fields("name");
+    list_request.add_fields("instance_status");
+
+    auto on_success = [this](ListReply& reply) {
+        for (const auto& instance : reply.instances())
+            if (instance.instance_status().status() == InstanceStatus::RUNNING)
+                request.add_instance_name(instance.name());
+
+        return ReturnCode::Ok;
+    };
+
+    auto on_failure = [this](grpc::Status& status) { return standard_failure_handler_for(name(), cerr, status); };
+
+    return dispatch(&RpcMethod::list, list_request, on_success, on_failure);
+}
+
 mp::ParseCode cmd::Exec::parse_args(mp::ArgParser* parser)
 {
     parser->addPositionalArgument("name", "Name of instance to execute the command on", "<name>");
     parser->addPositionalArgument("command", "Command to execute on the instance", "[--] <command>");
 
+    QCommandLineOption all_option(all_option_name, "Run the command on all running instances");
+    QCommandLineOption instances_option("instances", "Run the command on each of the given instances, instead of on "
+                                                     "<name>",
+                                        "names");
+    QCommandLineOption parallel_option("parallel",
+                                       "With --all or --instances, how many instances to run the command on at a "
+                                       "time. Defaults to 8",
+                                       "count", "8");
+    parser->addOptions({all_option, instances_option, parallel_option});
+
     auto status = parser->commandParse(this);
 
     if (status != ParseCode::Ok)
@@ -103,7 +370,44 @@ mp::ParseCode cmd::Exec::parse_args(mp::ArgParser* parser)
         return status;
     }
 
-    if (parser->positionalArguments().count() < 2)
+    all_instances = parser->isSet(all_option);
+    many_instances = all_instances || parser->isSet(instances_option);
+
+    if (all_instances && parser->isSet(instances_option))
+    {
+        cerr << "Cannot specify both --all and --instances\n";
+        return ParseCode::CommandLineError;
+    }
+
+    if (parser->isSet(parallel_option))
+    {
+        auto ok = false;
+        max_parallel = parser->value(parallel_option).toInt(&ok);
+        if (!ok || max_parallel < 1)
+        {
+            cerr << "error: The number of instances to run on at a time must be a positive integer\n";
+            return ParseCode::CommandLineError;
+        }
+    }
+
+    if (many_instances)
+    {
+        if (parser->positionalArguments().isEmpty())
+        {
+            cerr << "Wrong number of arguments\n";
+            return ParseCode::CommandLineError;
+        }
+
+        for (const auto& instance : parser->value(instances_option).split(',', QString::SkipEmptyParts))
+            request.add_instance_name(instance.trimmed().toStdString());
+
+        if (!all_instances && request.instance_name().empty())
+        {
+            cerr << "No instances given to --instances\n";
+            status = ParseCode::CommandLineError;
+        }
+    }
+    else if (parser->positionalArguments().count() < 2)
     {
         cerr << "Wrong number of arguments\n";
         status = ParseCode::CommandLineError;
@@ -37,11 +37,19 @@ public:
     QString description() const override;
 
     static ReturnCode exec_success(const SSHInfoReply& reply, const std::vector<std::string>& args, Terminal* term);
+    // Runs the command on every instance in the reply, at most max_parallel at a time, prefixing output lines with
+    // the instance name; fails when the command failed anywhere
+    static ReturnCode exec_on_all(const SSHInfoReply& reply, const std::vector<std::string>& args, Terminal* term,
+                                  int max_parallel);
 
 private:
     SSHInfoRequest request;
+    bool all_instances{false};
+    bool many_instances{false};
+    int max_parallel{8};
 
     ParseCode parse_args(ArgParser* parser) override;
+    ReturnCode select_running_instances();
 };
 } // namespace cmd
 } // namespace multipass
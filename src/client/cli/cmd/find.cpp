@@ -17,10 +17,13 @@
 
 #include "find.h"
 #include "common_cli.h"
+#include "response_cache.h"
 
 #include <multipass/cli/argparser.h>
 #include <multipass/cli/formatter.h>
 
+#include <algorithm>
+
 namespace mp = multipass;
 namespace cmd = multipass::cmd;
 using RpcMethod = mp::Rpc::Stub;
@@ -33,16 +36,35 @@ mp::ReturnCode cmd::Find::run(mp::ArgParser* parser)
         return parser->returnCodeFrom(ret);
     }
 
-    auto on_success = [this](FindReply& reply) {
-        cout << chosen_formatter->format(reply);
+    ResponseCache cache;
+    FindReply found;
+    if (cache.load(request, found))
+    {
+        cout << chosen_formatter->format(found);
+        return ReturnCode::Ok;
+    }
+
+    // The daemon sends the images of each remote as they are listed; formatting needs all of them at once
+    auto on_success = [this, &found, &cache](FindReply&) {
+        cache.store(request, found, found.cache_ttl());
+        cout << chosen_formatter->format(found);
 
         return ReturnCode::Ok;
     };
 
     auto on_failure = [this](grpc::Status& status) { return standard_failure_handler_for(name(), cerr, status); };
 
+    auto streaming_callback = [this, &found](FindReply& reply) {
+        if (!reply.log_line().empty())
+            cerr << reply.log_line();
+
+        found.mutable_images_info()->MergeFrom(reply.images_info());
+        found.set_cache_ttl(std::max(found.cache_ttl(), reply.cache_ttl()));
+    };
+
     request.set_verbosity_level(parser->verbosityLevel());
-    return dispatch(&RpcMethod::find, request, on_success, on_failure);
+    request.set_partial_replies(true);
+    return dispatch(&RpcMethod::find, request, on_success, on_failure, streaming_callback);
 }
 
 std::string cmd::Find::name() const
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "forward.h"
+#include "common_cli.h"
+
+#include <multipass/cli/argparser.h>
+#include <multipass/format.h>
+
+namespace mp = multipass;
+namespace cmd = multipass::cmd;
+using RpcMethod = mp::Rpc::Stub;
+
+namespace
+{
+int parse_port(const QString& text)
+{
+    bool ok;
+    const auto port = text.toInt(&ok);
+    return ok && port > 0 && port < 65536 ? port : 0;
+}
+} // namespace
+
+mp::ReturnCode cmd::Forward::run(mp::ArgParser* parser)
+{
+    auto ret = parse_args(parser);
+    if (ret != ParseCode::Ok)
+    {
+        return parser->returnCodeFrom(ret);
+    }
+
+    auto on_success = [this](mp::ForwardReply& reply) {
+        if (reply.forwards().empty())
+            cout << fmt::format("No ports are forwarded to {}\n", request.instance_name());
+
+        for (const auto& forward : reply.forwards())
+            cout << fmt::format("{}:{} -> {}:{}\n", forward.host_address().empty() ? "*" : forward.host_address(),
+                                forward.host_port(), request.instance_name(), forward.instance_port());
+
+        return ReturnCode::Ok;
+    };
+
+    auto on_failure = [this](grpc::Status& status) { return standard_failure_handler_for(name(), cerr, status); };
+
+    request.set_verbosity_level(parser->verbosityLevel());
+    return dispatch(&RpcMethod::forward, request, on_success, on_failure);
+}
+
+std::string cmd::Forward::name() const
+{
+    return "forward";
+}
+
+QString cmd::Forward::short_help() const
+{
+    return QStringLiteral("Forward host ports to an instance");
+}
+
+QString cmd::Forward::description() const
+{
+    return QStringLiteral("Have the daemon listen on a host port and relay connections to\n"
+                          "a port of the instance, for as long as the instance runs. Forwards\n"
+                          "last until cancelled, across restarts. With no ports given, the\n"
+                          "instance's forwards are listed.");
+}
+
+mp::ParseCode cmd::Forward::parse_args(mp::ArgParser* parser)
+{
+    parser->addPositionalArgument("instance", "Name of the instance to forward to", "<instance>");
+    parser->addPositionalArgument("ports",
+                                  "Host port and instance port to forward it to, as <host-port>:<instance-port>, "
+                                  "or a single port for both. Only the host port is given with --cancel",
+                                  "[<ports>]");
+    QCommandLineOption address_option("address",
+                                      "Host address to listen on, rather than 127.0.0.1. 0.0.0.0 listens on all of "
+                                      "them, which lets other machines connect",
+                                      "address");
+    QCommandLineOption cancel_option({"c", "cancel"},
+                                     "Stop forwarding the given host port, on the given address or on any of them");
+    parser->addOptions({address_option, cancel_option});
+
+    auto status = parser->commandParse(this);
+    if (status != ParseCode::Ok)
+        return status;
+
+    const auto args = parser->positionalArguments();
+    if (args.count() < 1 || args.count() > 2 || (parser->isSet(cancel_option) && args.count() != 2))
+    {
+        cerr << "Wrong number of arguments\n";
+        return ParseCode::CommandLineError;
+    }
+
+    request.set_instance_name(args.at(0).toStdString());
+    request.set_cancel(parser->isSet(cancel_option));
+    request.set_host_address(parser->value(address_option).toStdString());
+
+    if (args.count() == 2)
+    {
+        const auto ports = args.at(1).split(':');
+        const auto host_port = parse_port(ports.first());
+        const auto instance_port = parse_port(ports.last());
+        if (ports.size() > 2 || !host_port || !instance_port || (request.cancel() && ports.size() != 1))
+        {
+            cerr << "Invalid ports\n";
+            return ParseCode::CommandLineError;
+        }
+
+        request.set_host_port(host_port);
+        request.set_instance_port(instance_port);
+    }
+
+    return status;
+}
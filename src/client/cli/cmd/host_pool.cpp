@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "host_pool.h"
+
+#include <multipass/cli/client_common.h>
+#include <multipass/constants.h>
+#include <multipass/exceptions/cmd_exceptions.h>
+#include <multipass/format.h>
+#include <multipass/memory_size.h>
+#include <multipass/settings.h>
+#include <multipass/ssl_cert_provider.h>
+
+#include <algorithm>
+#include <future>
+
+namespace mp = multipass;
+namespace cmd = multipass::cmd;
+
+namespace
+{
+long long requested_bytes(const std::string& size, const char* default_size)
+{
+    return mp::MemorySize{size.empty() ? default_size : size}.in_bytes();
+}
+
+std::string requested_image(const mp::LaunchRequest& request)
+{
+    const auto image = request.image().empty() ? std::string{"default"} : request.image();
+    return request.remote_name().empty() ? image : request.remote_name() + ':' + image;
+}
+} // namespace
+
+mp::optional<std::string> cmd::take_host_from(std::string& instance_name)
+{
+    const auto at = instance_name.rfind('@');
+    if (at == std::string::npos)
+        return nullopt;
+
+    auto host = instance_name.substr(at + 1);
+    instance_name.erase(at);
+    return host;
+}
+
+mp::optional<std::size_t> cmd::best_host_for(const LaunchRequest& request,
+                                              const std::vector<optional<HostCapacity>>& hosts)
+{
+    const auto count = std::max(request.count(), 1);
+    const auto cores = count * (request.num_cores() ? request.num_cores() : std::stoi(mp::default_cpu_cores));
+    const auto memory = count * requested_bytes(request.mem_size(), mp::default_memory_size);
+    const auto disk = count * requested_bytes(request.disk_space(), mp::default_disk_size);
+    const auto image = requested_image(request);
+
+    optional<std::size_t> best;
+    auto has_image = [&hosts, &image](std::size_t i) {
+        const auto& cached = hosts[i]->cached_images;
+        return std::find(cached.cbegin(), cached.cend(), image) != cached.cend();
+    };
+
+    for (std::size_t i = 0; i < hosts.size(); ++i)
+    {
+        const auto& host = hosts[i];
+        if (!host || host->cores - host->committed_cores < cores || host->disk_available < disk ||
+            (host->memory_available && host->memory_available < memory))
+            continue;
+
+        if (!best || std::make_pair(has_image(i), host->memory_available) >
+                         std::make_pair(has_image(*best), hosts[*best]->memory_available))
+            best = i;
+    }
+
+    return best;
+}
+
+cmd::HostPool::HostPool() : cert_provider{mp::client::get_cert_provider()}
+{
+    for (const auto& address : MP_SETTINGS.get(mp::hosts_key).split(',', QString::SkipEmptyParts))
+    {
+        Host host{address.trimmed().toStdString(), nullptr, nullptr};
+        host.channel = mp::client::make_channel(host.address, mp::RpcConnectionType::ssl, *cert_provider);
+        host.stub = mp::Rpc::NewStub(host.channel);
+        hosts.push_back(std::move(host));
+    }
+}
+
+cmd::HostPool::~HostPool() = default;
+
+std::size_t cmd::HostPool::size() const
+{
+    return hosts.size();
+}
+
+const std::string& cmd::HostPool::address(std::size_t i) const
+{
+    return hosts.at(i).address;
+}
+
+grpc::Channel& cmd::HostPool::channel(std::size_t i)
+{
+    return *hosts.at(i).channel;
+}
+
+mp::Rpc::Stub& cmd::HostPool::stub(std::size_t i)
+{
+    return *hosts.at(i).stub;
+}
+
+std::size_t cmd::HostPool::index_of(const std::string& address) const
+{
+    const auto it = std::find_if(hosts.cbegin(), hosts.cend(), [&address](const Host& host) {
+        return host.address == address;
+    });
+    if (it == hosts.cend())
+        throw ValidationException{fmt::format("\"{}\" is not one of the hosts in {}", address, hosts_key)};
+
+    return static_cast<std::size_t>(it - hosts.cbegin());
+}
+
+std::vector<mp::optional<cmd::HostCapacity>> cmd::HostPool::capacities(Rpc::Stub& default_stub, int verbosity_level)
+{
+    std::vector<std::future<optional<HostCapacity>>> answers;
+    answers.push_back(std::async(std::launch::async, capacity_of, std::ref(default_stub), verbosity_level));
+    for (auto& host : hosts)
+        answers.push_back(std::async(std::launch::async, capacity_of, std::ref(*host.stub), verbosity_level));
+
+    std::vector<optional<HostCapacity>> capacities;
+    for (auto& answer : answers)
+        capacities.push_back(answer.get());
+
+    return capacities;
+}
+
+mp::optional<cmd::HostCapacity> cmd::HostPool::capacity_of(Rpc::Stub& stub, int verbosity_level)
+{
+    CapacityRequest request;
+    request.set_verbosity_level(verbosity_level);
+
+    const auto reply = ask<CapacityReply>(stub, &Rpc::Stub::capacity, request);
+    if (!reply)
+        return nullopt;
+
+    return HostCapacity{reply->cores(), reply->committed_cores(), reply->memory_available(), reply->disk_available(),
+                        {reply->cached_images().cbegin(), reply->cached_images().cend()}};
+}
+
+mp::optional<std::size_t> cmd::direct_to_host(google::protobuf::RepeatedPtrField<std::string>& instance_names,
+                                              std::unique_ptr<HostPool>& pool, grpc::Channel*& channel,
+                                              Rpc::Stub*& stub)
+{
+    optional<std::string> host;
+    for (auto i = 0; i < instance_names.size(); ++i)
+    {
+        auto instance_host = take_host_from(*instance_names.Mutable(i));
+        if (i > 0 && instance_host != host)
+            throw ValidationException{"Instances on different hosts cannot be worked on together"};
+        host = std::move(instance_host);
+    }
+
+    if (!host)
+        return nullopt;
+
+    pool = std::make_unique<HostPool>();
+    const auto i = pool->index_of(*host);
+    channel = &pool->channel(i);
+    stub = &pool->stub(i);
+
+    return i;
+}
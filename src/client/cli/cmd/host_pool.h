@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_HOST_POOL_H
+#define MULTIPASS_HOST_POOL_H
+
+#include <multipass/optional.h>
+#include <multipass/rpc/multipass.grpc.pb.h>
+
+#include <grpcpp/grpcpp.h>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace multipass
+{
+class SSLCertProvider;
+
+namespace cmd
+{
+struct HostCapacity
+{
+    int cores;
+    int committed_cores;
+    long long memory_available; // zero when unknown
+    long long disk_available;
+    std::vector<std::string> cached_images;
+};
+
+// Which of the hosts to launch on: of those with room for the request, the ones that have its image cached come
+// first, and then the one with the most memory to spare. Hosts that could not tell their capacity are passed over.
+optional<std::size_t> best_host_for(const LaunchRequest& request, const std::vector<optional<HostCapacity>>& hosts);
+
+// Instances on the pool's hosts go by "<name>@<host>"; takes the host off the name, if it has one
+optional<std::string> take_host_from(std::string& instance_name);
+
+// The further multipassd's that client.hosts names, reached with this client's certificate like the default one
+class HostPool
+{
+public:
+    HostPool();
+    ~HostPool();
+
+    std::size_t size() const;
+    const std::string& address(std::size_t i) const;
+    grpc::Channel& channel(std::size_t i);
+    Rpc::Stub& stub(std::size_t i);
+
+    // Which of the pool's hosts is at the address; throws ValidationException for those client.hosts does not name
+    std::size_t index_of(const std::string& address) const;
+
+    // What the default host and then each of the pool's have room for, asked all at once
+    std::vector<optional<HostCapacity>> capacities(Rpc::Stub& default_stub, int verbosity_level);
+
+    // What a host has room for, if it answers in time
+    static optional<HostCapacity> capacity_of(Rpc::Stub& stub, int verbosity_level);
+
+    // The reply of a streaming call, if it went through in time; hosts that are down should not hold everything up
+    template <typename Reply, typename RpcFunc, typename Request>
+    static optional<Reply> ask(Rpc::Stub& stub, RpcFunc&& rpc_func, const Request& request,
+                               grpc::Status* status = nullptr)
+    {
+        grpc::ClientContext context;
+        context.set_deadline(std::chrono::system_clock::now() + timeout);
+
+        Reply reply, last;
+        auto reader = (stub.*rpc_func)(&context, request);
+        while (reader->Read(&reply))
+            if (reply.log_line().empty())
+                last = reply;
+
+        const auto finished = reader->Finish();
+        if (status)
+            *status = finished;
+        if (!finished.ok())
+            return nullopt;
+
+        return last;
+    }
+
+    // The replies of each of the pool's hosts to the one request, asked all at once
+    template <typename Reply, typename RpcFunc, typename Request>
+    std::vector<optional<Reply>> ask_all(RpcFunc rpc_func, const Request& request)
+    {
+        std::vector<std::future<optional<Reply>>> answers;
+        for (auto& host : hosts)
+            answers.push_back(std::async(std::launch::async, [&host, rpc_func, &request] {
+                return ask<Reply>(*host.stub, rpc_func, request);
+            }));
+
+        std::vector<optional<Reply>> replies;
+        for (auto& answer : answers)
+            replies.push_back(answer.get());
+
+        return replies;
+    }
+
+private:
+    struct Host
+    {
+        std::string address;
+        std::shared_ptr<grpc::Channel> channel;
+        std::unique_ptr<Rpc::Stub> stub;
+    };
+
+    static constexpr auto timeout = std::chrono::seconds{5};
+
+    std::unique_ptr<SSLCertProvider> cert_provider;
+    std::vector<Host> hosts;
+};
+
+// Points a command at the host its instances are on, taking "@<host>" off their names, and leaves it with the default
+// host when none names another. They all have to be on the one host; throws ValidationException otherwise. Returns
+// which of the pool's hosts that is, if not the default one.
+optional<std::size_t> direct_to_host(google::protobuf::RepeatedPtrField<std::string>& instance_names,
+                                     std::unique_ptr<HostPool>& pool, grpc::Channel*& channel, Rpc::Stub*& stub);
+} // namespace cmd
+} // namespace multipass
+#endif // MULTIPASS_HOST_POOL_H
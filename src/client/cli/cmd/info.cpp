@@ -20,11 +20,19 @@
 
 #include <multipass/cli/argparser.h>
 #include <multipass/cli/formatter.h>
+#include <multipass/constants.h>
+#include <multipass/exceptions/cmd_exceptions.h>
+#include <multipass/settings.h>
 
 namespace mp = multipass;
 namespace cmd = multipass::cmd;
 using RpcMethod = mp::Rpc::Stub;
 
+namespace
+{
+constexpr auto history_points = 48;
+} // namespace
+
 mp::ReturnCode cmd::Info::run(mp::ArgParser* parser)
 {
     auto ret = parse_args(parser);
@@ -33,7 +41,27 @@ mp::ReturnCode cmd::Info::run(mp::ArgParser* parser)
         return parser->returnCodeFrom(ret);
     }
 
-    auto on_success = [this](mp::InfoReply& reply) {
+    request.set_verbosity_level(parser->verbosityLevel());
+
+    // Info on all instances takes in those of every host in client.hosts, asked along with the default host
+    std::future<std::vector<optional<InfoReply>>> pool_replies;
+    const auto all_hosts = !host_pool && request.instance_names().instance_name().empty() &&
+                           !MP_SETTINGS.get(hosts_key).isEmpty();
+    if (all_hosts)
+    {
+        host_pool = std::make_unique<HostPool>();
+        pool_replies = std::async(std::launch::async,
+                                  [this] { return host_pool->ask_all<InfoReply>(&RpcMethod::info, request); });
+    }
+
+    auto on_success = [this, &pool_replies, all_hosts](mp::InfoReply& reply) {
+        if (pool_host)
+            for (auto& info : *reply.mutable_info())
+                info.set_name(fmt::format("{}@{}", info.name(), host_pool->address(*pool_host)));
+
+        if (all_hosts)
+            add_pool_info(pool_replies.get(), reply);
+
         cout << chosen_formatter->format(reply);
 
         return ReturnCode::Ok;
@@ -41,10 +69,29 @@ mp::ReturnCode cmd::Info::run(mp::ArgParser* parser)
 
     auto on_failure = [this](grpc::Status& status) { return standard_failure_handler_for(name(), cerr, status); };
 
-    request.set_verbosity_level(parser->verbosityLevel());
     return dispatch(&RpcMethod::info, request, on_success, on_failure);
 }
 
+// Instances on the hosts of client.hosts are named after where they are, as "<name>@<host>"
+void cmd::Info::add_pool_info(const std::vector<optional<InfoReply>>& host_replies, InfoReply& reply)
+{
+    for (std::size_t i = 0; i < host_replies.size(); ++i)
+    {
+        if (!host_replies[i])
+        {
+            cerr << fmt::format("Could not get the information of the instances on {}\n", host_pool->address(i));
+            continue;
+        }
+
+        for (const auto& info : host_replies[i]->info())
+        {
+            auto entry = reply.add_info();
+            *entry = info;
+            entry->set_name(fmt::format("{}@{}", info.name(), host_pool->address(i)));
+        }
+    }
+}
+
 std::string cmd::Info::name() const { return "info"; }
 
 QString cmd::Info::short_help() const
@@ -69,6 +116,16 @@ mp::ParseCode cmd::Info::parse_args(mp::ArgParser* parser)
         "format", "table");
     parser->addOption(formatOption);
 
+    QCommandLineOption history_option(
+        "history", QString{"Include the resource usage recorded over time, in up to %1 points"}.arg(history_points));
+    parser->addOption(history_option);
+
+    QCommandLineOption timeout_option("timeout",
+                                      "Maximum time, in seconds, to wait for instances to answer. Those that do not "
+                                      "answer in time are shown as they last answered, marked stale",
+                                      "timeout");
+    parser->addOption(timeout_option);
+
     auto status = parser->commandParse(this);
 
     if (status != ParseCode::Ok)
@@ -82,6 +139,29 @@ mp::ParseCode cmd::Info::parse_args(mp::ArgParser* parser)
 
     request.mutable_instance_names()->CopyFrom(add_instance_names(parser));
 
+    try
+    {
+        pool_host = direct_to_host(*request.mutable_instance_names()->mutable_instance_name(), host_pool, rpc_channel,
+                                   stub);
+    }
+    catch (const mp::ValidationException& e)
+    {
+        cerr << "error: " << e.what() << std::endl;
+        return ParseCode::CommandLineError;
+    }
+    request.set_history_points(parser->isSet(history_option) ? history_points : 0);
+
+    try
+    {
+        if (parser->isSet(timeout_option))
+            request.set_timeout(mp::cmd::parse_timeout(parser));
+    }
+    catch (const mp::ValidationException& e)
+    {
+        cerr << "error: " << e.what() << std::endl;
+        return ParseCode::CommandLineError;
+    }
+
     status = handle_format_option(parser, &chosen_formatter, cerr);
 
     return status;
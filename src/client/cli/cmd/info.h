@@ -20,8 +20,13 @@
 #ifndef MULTIPASS_INFO_H
 #define MULTIPASS_INFO_H
 
+#include "host_pool.h"
+
 #include <multipass/cli/command.h>
 
+#include <memory>
+#include <vector>
+
 namespace multipass
 {
 class Formatter;
@@ -40,9 +45,12 @@ public:
 
 private:
     InfoRequest request;
+    std::unique_ptr<HostPool> host_pool; // of the hosts the instances are on, when not only the default one
+    optional<std::size_t> pool_host;     // the one host of the pool that all the instances are on, if any
     Formatter* chosen_formatter;
 
     ParseCode parse_args(ArgParser *parser) override;
+    void add_pool_info(const std::vector<optional<InfoReply>>& host_replies, InfoReply& reply);
 };
 }
 }
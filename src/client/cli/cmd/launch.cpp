@@ -126,9 +126,10 @@ mp::ReturnCode cmd::Launch::run(mp::ArgParser* parser)
     }
 
     request.set_time_zone(QTimeZone::systemTimeZoneId().toStdString());
+    choose_host(parser);
 
     auto ret = request_launch(parser);
-    if (ret == ReturnCode::Ok && request.instance_name() == petenv_name.toStdString())
+    if (ret == ReturnCode::Ok && request.count() <= 1 && request.instance_name() == petenv_name.toStdString())
     {
         QString mount_source{};
         try
@@ -213,9 +214,27 @@ mp::ParseCode cmd::Launch::parse_args(mp::ArgParser* parser)
                                      "You can also use a shortcut of \"<name>\" to mean \"name=<name>\".",
                                      "spec");
     QCommandLineOption bridgedOption("bridged", "Adds one `--network bridged` network.");
-
-    parser->addOptions({cpusOption, diskOption, memOption, nameOption, cloudInitOption, networkOption, bridgedOption});
-
+    QCommandLineOption storageProfileOption(
+        "storage-profile",
+        QString::fromStdString(fmt::format("How to tune the instance disk: {}|{} (default: {}). The {} profile "
+                                           "gives the disk its own I/O thread and queues, bypassing the host page "
+                                           "cache where the driver supports it.",
+                                           default_storage_profile, performance_storage_profile,
+                                           default_storage_profile, performance_storage_profile)),
+        "profile");
+    QCommandLineOption countOption("count",
+                                   "Number of identical instances to launch, sharing the image preparation. Given a "
+                                   "name, they are called <name>-1 to <name>-<count>.",
+                                   "count", "1");
+    QCommandLineOption timingsOption("timings", "Report how long each phase of the launch took.");
+    QCommandLineOption ephemeralOption("ephemeral",
+                                       "Throw the instance away once it stops. What it writes to its disk is kept in "
+                                       "memory, and it cannot be suspended.");
+
+    parser->addOptions({cpusOption, diskOption, memOption, nameOption, cloudInitOption, networkOption, bridgedOption,
+                        storageProfileOption, countOption, timingsOption, ephemeralOption});
+
+    mp::cmd::add_io_limit_options(parser);
     mp::cmd::add_timeout(parser);
 
     auto status = parser->commandParse(this);
@@ -266,6 +285,25 @@ mp::ParseCode cmd::Launch::parse_args(mp::ArgParser* parser)
         request.set_instance_name(parser->value(nameOption).toStdString());
     }
 
+    if (parser->isSet(countOption))
+    {
+        bool ok;
+        const auto count = parser->value(countOption).toInt(&ok);
+        if (!ok || count < 1)
+        {
+            cerr << "error: The count of instances must be a positive integer\n";
+            return ParseCode::CommandLineError;
+        }
+
+        if (count > mp::max_launch_count)
+        {
+            cerr << fmt::format("error: At most {} instances can be launched at once\n", mp::max_launch_count);
+            return ParseCode::CommandLineError;
+        }
+
+        request.set_count(count);
+    }
+
     if (parser->isSet(cpusOption))
     {
         request.set_num_cores(parser->value(cpusOption).toInt());
@@ -281,6 +319,13 @@ mp::ParseCode cmd::Launch::parse_args(mp::ArgParser* parser)
         request.set_disk_space(parser->value(diskOption).toStdString());
     }
 
+    if (parser->isSet(storageProfileOption))
+    {
+        request.set_storage_profile(parser->value(storageProfileOption).toStdString());
+    }
+
+    request.set_ephemeral(parser->isSet(ephemeralOption));
+
     if (parser->isSet(cloudInitOption))
     {
         try
@@ -323,6 +368,7 @@ mp::ParseCode cmd::Launch::parse_args(mp::ArgParser* parser)
             for (const auto& net : parser->values(networkOption))
                 request.mutable_network_options()->Add(net_digest(net));
 
+        *request.mutable_io_limits() = mp::cmd::parse_io_limit_options(parser);
         request.set_timeout(mp::cmd::parse_timeout(parser));
     }
     catch (mp::ValidationException& e)
@@ -336,6 +382,25 @@ mp::ParseCode cmd::Launch::parse_args(mp::ArgParser* parser)
     return status;
 }
 
+void cmd::Launch::choose_host(const ArgParser* parser)
+{
+    // The primary instance gets the home directory mounted, so it stays by the default host
+    if (MP_SETTINGS.get(hosts_key).isEmpty() || request.instance_name() == petenv_name.toStdString())
+        return;
+
+    host_pool = std::make_unique<HostPool>();
+    const auto best = best_host_for(request, host_pool->capacities(*stub, parser->verbosityLevel()));
+
+    // With no host looking to have room, the default one is left to tell what is missing
+    if (!best || *best == 0)
+        return;
+
+    const auto i = *best - 1;
+    rpc_channel = &host_pool->channel(i);
+    stub = &host_pool->stub(i);
+    cout << fmt::format("Launching on {}\n", host_pool->address(i));
+}
+
 mp::ReturnCode cmd::Launch::request_launch(const ArgParser* parser)
 {
     if (!spinner)
@@ -362,7 +427,30 @@ mp::ReturnCode cmd::Launch::request_launch(const ArgParser* parser)
             return request_launch(parser);
         }
 
-        cout << "Launched: " << reply.vm_instance_name() << "\n";
+        if (reply.launched_instances_size())
+        {
+            for (const auto& instance : reply.launched_instances())
+                cout << "Launched: " << instance << "\n";
+        }
+        else
+        {
+            cout << "Launched: " << reply.vm_instance_name() << "\n";
+        }
+
+        if (parser->isSet("timings"))
+        {
+            std::string instance_name;
+            for (const auto& timing : reply.timings())
+            {
+                if (timing.instance_name() != instance_name)
+                {
+                    instance_name = timing.instance_name();
+                    cout << fmt::format("Timings for {}:\n", instance_name);
+                }
+
+                cout << fmt::format("  {:<22}{:>10.3f}s\n", timing.phase(), timing.microseconds() / 1e6);
+            }
+        }
 
         if (term->is_live() && update_available(reply.update_info()))
         {
@@ -397,6 +485,19 @@ mp::ReturnCode cmd::Launch::request_launch(const ArgParser* parser)
             {
                 error_details = fmt::format("Invalid instance name supplied: {}", request.instance_name());
             }
+            else if (error == LaunchError::INVALID_STORAGE_PROFILE)
+            {
+                error_details = fmt::format("Invalid storage profile supplied: {}.", request.storage_profile());
+            }
+            else if (error == LaunchError::INVALID_IO_LIMITS)
+            {
+                error_details = "Invalid I/O limits supplied: each burst needs a sustained limit, and can be no "
+                                "lower than it.";
+            }
+            else if (error == LaunchError::UNSUPPORTED_IO_LIMITS)
+            {
+                error_details = "The driver in use cannot apply the I/O limits supplied.";
+            }
             else if (error == LaunchError::INVALID_NETWORK)
             {
                 if (reply.nets_need_bridging_size() && ask_bridge_permission(reply))
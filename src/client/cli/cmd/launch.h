@@ -19,6 +19,7 @@
 #define MULTIPASS_LAUNCH_H
 
 #include "animated_spinner.h"
+#include "host_pool.h"
 
 #include <multipass/cli/command.h>
 #include <multipass/timer.h>
@@ -43,6 +44,7 @@ public:
 
 private:
     ParseCode parse_args(ArgParser* parser) override;
+    void choose_host(const ArgParser* parser);
     ReturnCode request_launch(const ArgParser* parser);
     OptInStatus::Status ask_metrics_permission(const LaunchReply& reply);
     bool ask_bridge_permission(multipass::LaunchReply& reply);
@@ -51,6 +53,7 @@ private:
     QString petenv_name;
     std::unique_ptr<multipass::AnimatedSpinner> spinner;
     std::unique_ptr<multipass::utils::Timer> timer;
+    std::unique_ptr<HostPool> host_pool;
 };
 } // namespace cmd
 } // namespace multipass
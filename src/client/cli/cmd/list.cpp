@@ -17,14 +17,41 @@
 
 #include "list.h"
 #include "common_cli.h"
+#include "host_pool.h"
 
 #include <multipass/cli/argparser.h>
 #include <multipass/cli/formatter.h>
+#include <multipass/constants.h>
+#include <multipass/settings.h>
 
 namespace mp = multipass;
 namespace cmd = multipass::cmd;
 using RpcMethod = mp::Rpc::Stub;
 
+namespace
+{
+// Instances on the hosts of client.hosts are named after where they are, as "<name>@<host>"
+void add_pool_instances(const cmd::HostPool& pool, const std::vector<mp::optional<mp::ListReply>>& host_replies,
+                        mp::ListReply& reply, std::ostream& cerr)
+{
+    for (std::size_t i = 0; i < host_replies.size(); ++i)
+    {
+        if (!host_replies[i])
+        {
+            cerr << fmt::format("Could not list the instances on {}\n", pool.address(i));
+            continue;
+        }
+
+        for (const auto& instance : host_replies[i]->instances())
+        {
+            auto entry = reply.add_instances();
+            *entry = instance;
+            entry->set_name(fmt::format("{}@{}", instance.name(), pool.address(i)));
+        }
+    }
+}
+} // namespace
+
 mp::ReturnCode cmd::List::run(mp::ArgParser* parser)
 {
     auto ret = parse_args(parser);
@@ -33,7 +60,22 @@ mp::ReturnCode cmd::List::run(mp::ArgParser* parser)
         return parser->returnCodeFrom(ret);
     }
 
-    auto on_success = [this](ListReply& reply) {
+    request.set_verbosity_level(parser->verbosityLevel());
+
+    // Asked along with the default host, so that listing takes no longer than the slowest host
+    std::unique_ptr<HostPool> pool;
+    std::future<std::vector<optional<ListReply>>> pool_replies;
+    if (!MP_SETTINGS.get(hosts_key).isEmpty())
+    {
+        pool = std::make_unique<HostPool>();
+        pool_replies = std::async(std::launch::async,
+                                  [&pool, this] { return pool->ask_all<ListReply>(&RpcMethod::list, request); });
+    }
+
+    auto on_success = [this, &pool, &pool_replies](ListReply& reply) {
+        if (pool)
+            add_pool_instances(*pool, pool_replies.get(), reply, cerr);
+
         cout << chosen_formatter->format(reply);
 
         if (term->is_live() && update_available(reply.update_info()))
@@ -44,7 +86,6 @@ mp::ReturnCode cmd::List::run(mp::ArgParser* parser)
 
     auto on_failure = [this](grpc::Status& status) { return standard_failure_handler_for(name(), cerr, status); };
 
-    request.set_verbosity_level(parser->verbosityLevel());
     return dispatch(&RpcMethod::list, request, on_success, on_failure);
 }
 
@@ -117,7 +117,19 @@ mp::ParseCode cmd::Mount::parse_args(mp::ArgParser* parser)
                                                  "File and folder ownership will be mapped from "
                                                  "<host> to <instance> inside the instance. Can be "
                                                  "used multiple times.", "host>:<instance");
-    parser->addOptions({gid_map, uid_map});
+    QCommandLineOption mount_type({"t", "type"},
+                                  "Specify the type of mount to use.\n"
+                                  "Classic mounts use technology built into Multipass.\n"
+                                  "Native mounts use hypervisor and/or platform specific mounts, for higher "
+                                  "throughput; the instance needs to be stopped to add them.\n"
+                                  "Valid types are: 'classic' (default) and 'native'",
+                                  "type", "classic");
+    QCommandLineOption compression({"compression"},
+                                   "Compress the traffic of a classic mount, overriding the local.ssh-compression "
+                                   "setting for it.\n"
+                                   "Valid values are: 'auto', 'on' and 'off'",
+                                   "compression");
+    parser->addOptions({gid_map, uid_map, mount_type, compression});
 
     auto status = parser->commandParse(this);
     if (status != ParseCode::Ok)
@@ -158,6 +170,14 @@ mp::ParseCode cmd::Mount::parse_args(mp::ArgParser* parser)
     {
         auto parsed_target = QString(parser->positionalArguments().at(i)).split(":", QString::SkipEmptyParts);
 
+        // The source is on this machine, but the daemon on another host would look for it on its own
+        if (parsed_target.at(0).contains('@'))
+        {
+            cerr << "Instances on other hosts cannot mount local directories: \"" << parsed_target.at(0).toStdString()
+                 << "\"\n";
+            return ParseCode::CommandLineError;
+        }
+
         auto entry = request.add_target_paths();
         entry->set_instance_name(parsed_target.at(0).toStdString());
 
@@ -171,6 +191,35 @@ mp::ParseCode cmd::Mount::parse_args(mp::ArgParser* parser)
         }
     }
 
+    const auto type = parser->value(mount_type);
+    if (type == "classic")
+        request.set_mount_type(MountRequest::CLASSIC);
+    else if (type == "native")
+        request.set_mount_type(MountRequest::NATIVE);
+    else
+    {
+        cerr << "Bad mount type '" << type.toStdString() << "' specified, please use 'classic' or 'native'.\n";
+        return ParseCode::CommandLineError;
+    }
+
+    if (parser->isSet(compression))
+    {
+        const auto value = parser->value(compression);
+        if (value != "auto" && value != "on" && value != "off")
+        {
+            cerr << "Bad compression '" << value.toStdString() << "' specified, please use 'auto', 'on' or 'off'.\n";
+            return ParseCode::CommandLineError;
+        }
+
+        if (request.mount_type() == MountRequest::NATIVE)
+        {
+            cerr << "Only classic mounts can be compressed.\n";
+            return ParseCode::CommandLineError;
+        }
+
+        request.set_compression(value.toStdString());
+    }
+
     QRegExp map_matcher("^([0-9]+[:][0-9]+)$");
 
     if (parser->isSet(uid_map))
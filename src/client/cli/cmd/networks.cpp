@@ -17,6 +17,7 @@
 
 #include "networks.h"
 #include "common_cli.h"
+#include "response_cache.h"
 
 #include <multipass/cli/argparser.h>
 #include <multipass/cli/formatter.h>
@@ -33,7 +34,19 @@ mp::ReturnCode cmd::Networks::run(mp::ArgParser* parser)
         return parser->returnCodeFrom(ret);
     }
 
-    auto on_success = [this](NetworksReply& reply) {
+    NetworksRequest request;
+    request.set_verbosity_level(parser->verbosityLevel());
+
+    ResponseCache cache;
+    NetworksReply cached;
+    if (cache.load(request, cached))
+    {
+        cout << chosen_formatter->format(cached);
+        return ReturnCode::Ok;
+    }
+
+    auto on_success = [this, &request, &cache](NetworksReply& reply) {
+        cache.store(request, reply, reply.cache_ttl());
         cout << chosen_formatter->format(reply);
 
         if (term->is_live() && update_available(reply.update_info()))
@@ -44,8 +57,6 @@ mp::ReturnCode cmd::Networks::run(mp::ArgParser* parser)
 
     auto on_failure = [this](grpc::Status& status) { return standard_failure_handler_for(name(), cerr, status); };
 
-    NetworksRequest request;
-    request.set_verbosity_level(parser->verbosityLevel());
     return dispatch(&RpcMethod::networks, request, on_success, on_failure);
 }
 
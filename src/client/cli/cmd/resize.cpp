@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "resize.h"
+#include "common_cli.h"
+
+#include <multipass/cli/argparser.h>
+
+namespace mp = multipass;
+namespace cmd = multipass::cmd;
+using RpcMethod = mp::Rpc::Stub;
+
+mp::ReturnCode cmd::Resize::run(mp::ArgParser* parser)
+{
+    auto ret = parse_args(parser);
+    if (ret != ParseCode::Ok)
+    {
+        return parser->returnCodeFrom(ret);
+    }
+
+    auto on_success = [](mp::ResizeReply& reply) { return ReturnCode::Ok; };
+
+    auto on_failure = [this](grpc::Status& status) { return standard_failure_handler_for(name(), cerr, status); };
+
+    request.set_verbosity_level(parser->verbosityLevel());
+    return dispatch(&RpcMethod::resize, request, on_success, on_failure);
+}
+
+std::string cmd::Resize::name() const
+{
+    return "resize";
+}
+
+QString cmd::Resize::short_help() const
+{
+    return QStringLiteral("Change an instance's number of CPUs and memory");
+}
+
+QString cmd::Resize::description() const
+{
+    return QStringLiteral("Give an instance more or fewer CPUs, or more or less memory.\n"
+                          "Running instances get them straight away, as far as they were\n"
+                          "booted with room for, and all of it from their next start.");
+}
+
+mp::ParseCode cmd::Resize::parse_args(mp::ArgParser* parser)
+{
+    parser->addPositionalArgument("instance", "Name of the instance to resize", "<instance>");
+
+    QCommandLineOption cpusOption({"c", "cpus"}, "Number of CPUs to give the instance", "cpus");
+    QCommandLineOption memOption({"m", "mem"},
+                                 "Amount of memory to give the instance. Positive integers, in bytes, or with K, M, "
+                                 "G suffix.",
+                                 "mem");
+    parser->addOptions({cpusOption, memOption});
+
+    auto status = parser->commandParse(this);
+    if (status != ParseCode::Ok)
+        return status;
+
+    if (parser->positionalArguments().count() != 1)
+    {
+        cerr << "Wrong number of arguments\n";
+        return ParseCode::CommandLineError;
+    }
+
+    if (!parser->isSet(cpusOption) && !parser->isSet(memOption))
+    {
+        cerr << "Nothing to resize, give --cpus or --mem\n";
+        return ParseCode::CommandLineError;
+    }
+
+    request.set_instance_name(parser->positionalArguments().first().toStdString());
+
+    if (parser->isSet(cpusOption))
+    {
+        bool ok;
+        const auto num_cores = parser->value(cpusOption).toInt(&ok);
+        if (!ok || num_cores < 1)
+        {
+            cerr << "error: Invalid number of CPUs\n";
+            return ParseCode::CommandLineError;
+        }
+        request.set_num_cores(num_cores);
+    }
+
+    if (parser->isSet(memOption))
+        request.set_mem_size(parser->value(memOption).toStdString());
+
+    return status;
+}
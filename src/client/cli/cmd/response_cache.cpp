@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "response_cache.h"
+
+#include <multipass/cli/client_common.h>
+#include <multipass/settings.h>
+#include <multipass/version.h>
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+#include <memory>
+
+namespace mp = multipass;
+namespace cmd = multipass::cmd;
+
+namespace
+{
+constexpr auto cache_file_name = "response-cache.json";
+
+// Not what is asked for, but how much to say about it
+constexpr const char* ignored_fields[] = {"verbosity_level", "partial_replies"};
+
+QJsonObject read_entries(const QString& file_path)
+{
+    QFile file{file_path};
+    if (!file.open(QIODevice::ReadOnly))
+        return {};
+
+    return QJsonDocument::fromJson(file.readAll()).object();
+}
+} // namespace
+
+cmd::ResponseCache::ResponseCache()
+    : ResponseCache{QFileInfo{Settings::get_client_settings_file_path()}.dir().filePath(cache_file_name),
+                    mp::client::get_server_address()}
+{
+}
+
+cmd::ResponseCache::ResponseCache(const QString& file_path, const std::string& server_address)
+    : file_path{file_path}, server_address{server_address}
+{
+}
+
+bool cmd::ResponseCache::load(const google::protobuf::Message& request, google::protobuf::Message& reply) const
+{
+    const auto entry = read_entries(file_path).value(key_for(request)).toObject();
+    if (entry.isEmpty() || entry["expires"].toString().toLongLong() <= QDateTime::currentMSecsSinceEpoch())
+        return false;
+
+    const auto data = QByteArray::fromBase64(entry["reply"].toString().toLatin1());
+    return reply.ParseFromArray(data.constData(), data.size());
+}
+
+void cmd::ResponseCache::store(const google::protobuf::Message& request, const google::protobuf::Message& reply,
+                               int ttl_seconds)
+{
+    if (ttl_seconds <= 0)
+        return;
+
+    std::unique_ptr<google::protobuf::Message> kept{reply.New()};
+    kept->CopyFrom(reply);
+    if (auto update_info = kept->GetDescriptor()->FindFieldByName("update_info"))
+        kept->GetReflection()->ClearField(kept.get(), update_info);
+
+    // Whatever expired goes, so that the file only holds what can still be used
+    const auto now = QDateTime::currentMSecsSinceEpoch();
+    auto entries = read_entries(file_path);
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+        if (it.value().toObject()["expires"].toString().toLongLong() <= now)
+            it = entries.erase(it);
+        else
+            ++it;
+    }
+
+    const auto data = kept->SerializeAsString();
+    QJsonObject entry;
+    entry.insert("expires", QString::number(now + ttl_seconds * 1000LL));
+    entry.insert("reply", QString::fromLatin1(QByteArray(data.data(), static_cast<int>(data.size())).toBase64()));
+    entries.insert(key_for(request), entry);
+
+    // Other clients may be reading it at the same time, so the file is replaced as a whole
+    QDir{}.mkpath(QFileInfo{file_path}.absolutePath());
+    QSaveFile file{file_path};
+    if (file.open(QIODevice::WriteOnly) && file.write(QJsonDocument{entries}.toJson(QJsonDocument::Compact)) > 0)
+        file.commit();
+}
+
+QString cmd::ResponseCache::key_for(const google::protobuf::Message& request) const
+{
+    std::unique_ptr<google::protobuf::Message> relevant{request.New()};
+    relevant->CopyFrom(request);
+    for (const auto& name : ignored_fields)
+        if (auto field = relevant->GetDescriptor()->FindFieldByName(name))
+            relevant->GetReflection()->ClearField(relevant.get(), field);
+
+    QCryptographicHash hash{QCryptographicHash::Sha256};
+    for (const auto& part : {server_address, std::string{mp::version_string}, request.GetTypeName(),
+                             relevant->SerializeAsString()})
+    {
+        hash.addData(part.data(), static_cast<int>(part.size()));
+        hash.addData("", 1); // so that parts cannot run into each other
+    }
+
+    return QString::fromLatin1(hash.result().toHex());
+}
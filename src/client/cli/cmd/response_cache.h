@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_RESPONSE_CACHE_H
+#define MULTIPASS_RESPONSE_CACHE_H
+
+#include <QString>
+
+#include <google/protobuf/message.h>
+
+#include <string>
+
+namespace multipass
+{
+namespace cmd
+{
+// Replies that the daemon lets clients keep for a while, saved in the client's config directory, so that repeated
+// queries, such as those of shell completions, are answered without a round trip to the daemon. Replies are kept
+// per daemon address and per client version, and only the fields that select what is asked for tell requests apart.
+class ResponseCache
+{
+public:
+    ResponseCache();
+    ResponseCache(const QString& file_path, const std::string& server_address);
+
+    // Whether a reply to request is still fresh, in which case it is copied into reply
+    bool load(const google::protobuf::Message& request, google::protobuf::Message& reply) const;
+    // Keeps reply for ttl_seconds, if any, leaving out the update notice, which only the daemon can tell is due
+    void store(const google::protobuf::Message& request, const google::protobuf::Message& reply, int ttl_seconds);
+
+private:
+    QString key_for(const google::protobuf::Message& request) const;
+
+    const QString file_path;
+    const std::string server_address;
+};
+} // namespace cmd
+} // namespace multipass
+
+#endif // MULTIPASS_RESPONSE_CACHE_H
@@ -19,6 +19,7 @@
 #include "common_cli.h"
 
 #include "animated_spinner.h"
+#include "host_pool.h"
 #include <multipass/cli/argparser.h>
 #include <multipass/constants.h>
 #include <multipass/exceptions/cmd_exceptions.h>
@@ -85,13 +86,17 @@ mp::ReturnCode cmd::Shell::run(mp::ArgParser* parser)
         return ReturnCode::Ok;
     };
 
-    auto on_failure = [this, &instance_name, parser](grpc::Status& status) {
+    // As given, so that starting it goes to the host it is on
+    const auto instance_target = parser->positionalArguments().value(0, petenv_name);
+
+    auto on_failure = [this, &instance_name, &instance_target, parser](grpc::Status& status) {
         QStringList retry_args{};
 
-        if (status.error_code() == grpc::StatusCode::NOT_FOUND && instance_name == petenv_name.toStdString())
+        if (status.error_code() == grpc::StatusCode::NOT_FOUND && instance_name == petenv_name.toStdString() &&
+            !host_pool)
             retry_args.append({"multipass", "launch", "--name", petenv_name});
         else if (status.error_code() == grpc::StatusCode::ABORTED)
-            retry_args.append({"multipass", "start", QString::fromStdString(instance_name)});
+            retry_args.append({"multipass", "start", instance_target});
         else
             return standard_failure_handler_for(name(), cerr, status);
 
@@ -168,5 +173,15 @@ mp::ParseCode cmd::Shell::parse_args(mp::ArgParser* parser)
         entry->append(num_args ? pos_args.first().toStdString() : petenv_name.toStdString());
     }
 
+    try
+    {
+        direct_to_host(*request.mutable_instance_name(), host_pool, rpc_channel, stub);
+    }
+    catch (const mp::ValidationException& e)
+    {
+        cerr << "error: " << e.what() << std::endl;
+        return ParseCode::CommandLineError;
+    }
+
     return status;
 }
@@ -18,10 +18,14 @@
 #ifndef MULTIPASS_CONNECT_H
 #define MULTIPASS_CONNECT_H
 
+#include "host_pool.h"
+
 #include <multipass/cli/command.h>
 
 #include <QString>
 
+#include <memory>
+
 namespace multipass
 {
 namespace cmd
@@ -39,6 +43,7 @@ public:
 
 private:
     SSHInfoRequest request;
+    std::unique_ptr<HostPool> host_pool; // of the host the instances are on, when not the default one
     QString petenv_name;
 
     ParseCode parse_args(ArgParser *parser) override;
@@ -18,6 +18,7 @@
 #include "start.h"
 #include "animated_spinner.h"
 #include "common_cli.h"
+#include "host_pool.h"
 
 #include <multipass/cli/argparser.h>
 #include <multipass/constants.h>
@@ -79,7 +80,8 @@ mp::ReturnCode cmd::Start::run(mp::ArgParser* parser)
                     err_fmt = deleted_error_fmt;
                 else if (pair.second == mp::StartError::DOES_NOT_EXIST)
                 {
-                    if (pair.first != petenv_name.toStdString())
+                    // The primary instance is only launched on demand on the default host
+                    if (pair.first != petenv_name.toStdString() || host_pool)
                         err_fmt = absent_error_fmt;
                     else
                         continue;
@@ -189,5 +191,15 @@ mp::ParseCode cmd::Start::parse_args(mp::ArgParser* parser)
 
     request.mutable_instance_names()->CopyFrom(add_instance_names(parser, /*default_name=*/petenv_name.toStdString()));
 
+    try
+    {
+        direct_to_host(*request.mutable_instance_names()->mutable_instance_name(), host_pool, rpc_channel, stub);
+    }
+    catch (const mp::ValidationException& e)
+    {
+        cerr << "error: " << e.what() << std::endl;
+        return ParseCode::CommandLineError;
+    }
+
     return status;
 }
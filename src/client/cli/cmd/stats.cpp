@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "stats.h"
+#include "common_cli.h"
+
+#include <multipass/cli/argparser.h>
+
+namespace mp = multipass;
+namespace cmd = multipass::cmd;
+using RpcMethod = mp::Rpc::Stub;
+
+mp::ReturnCode cmd::Stats::run(mp::ArgParser* parser)
+{
+    auto ret = parse_args(parser);
+    if (ret != ParseCode::Ok)
+    {
+        return parser->returnCodeFrom(ret);
+    }
+
+    auto on_success = [this](mp::StatsReply& reply) {
+        cout << (request.trace() ? reply.trace() + "\n" : reply.openmetrics());
+        return ReturnCode::Ok;
+    };
+
+    auto on_failure = [this](grpc::Status& status) { return standard_failure_handler_for(name(), cerr, status); };
+
+    request.set_verbosity_level(parser->verbosityLevel());
+    return dispatch(&RpcMethod::stats, request, on_success, on_failure);
+}
+
+std::string cmd::Stats::name() const
+{
+    return "stats";
+}
+
+QString cmd::Stats::short_help() const
+{
+    return QStringLiteral("Show where the daemon spends its time");
+}
+
+QString cmd::Stats::description() const
+{
+    return QStringLiteral("Display the latencies and counters that the daemon has recorded\n"
+                          "since it started, such as how long each command and download\n"
+                          "took, in the OpenMetrics text format. With --trace, display the\n"
+                          "latest spans of work the daemon did instead, as Chrome trace\n"
+                          "events that Perfetto or chrome://tracing can open.");
+}
+
+mp::ParseCode cmd::Stats::parse_args(mp::ArgParser* parser)
+{
+    QCommandLineOption trace_option("trace", "Display recent spans of daemon work as Chrome trace events");
+    parser->addOption(trace_option);
+
+    auto status = parser->commandParse(this);
+    if (status != ParseCode::Ok)
+        return status;
+
+    if (parser->positionalArguments().count() > 0)
+    {
+        cerr << "This command takes no arguments\n";
+        return ParseCode::CommandLineError;
+    }
+
+    request.set_trace(parser->isSet(trace_option));
+
+    return status;
+}
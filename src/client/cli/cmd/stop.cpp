@@ -19,9 +19,11 @@
 #include "common_cli.h"
 
 #include "animated_spinner.h"
+#include "host_pool.h"
 
 #include <multipass/cli/argparser.h>
 #include <multipass/constants.h>
+#include <multipass/exceptions/cmd_exceptions.h>
 #include <multipass/settings.h>
 #include <multipass/utils.h>
 
@@ -116,5 +118,15 @@ mp::ParseCode cmd::Stop::parse_args(mp::ArgParser* parser)
 
     request.mutable_instance_names()->CopyFrom(add_instance_names(parser, /*default_name=*/petenv_name.toStdString()));
 
+    try
+    {
+        direct_to_host(*request.mutable_instance_names()->mutable_instance_name(), host_pool, rpc_channel, stub);
+    }
+    catch (const mp::ValidationException& e)
+    {
+        cerr << "error: " << e.what() << std::endl;
+        return ParseCode::CommandLineError;
+    }
+
     return status;
 }
@@ -20,8 +20,12 @@
 #ifndef MULTIPASS_STOP_H
 #define MULTIPASS_STOP_H
 
+#include "host_pool.h"
+
 #include <multipass/cli/command.h>
 
+#include <memory>
+
 namespace multipass
 {
 namespace cmd
@@ -38,6 +42,7 @@ public:
 
 private:
     StopRequest request;
+    std::unique_ptr<HostPool> host_pool; // of the host the instances are on, when not the default one
 
     ParseCode parse_args(ArgParser *parser) override;
 };
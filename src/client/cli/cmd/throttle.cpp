@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "throttle.h"
+#include "common_cli.h"
+
+#include <multipass/cli/argparser.h>
+#include <multipass/exceptions/cmd_exceptions.h>
+
+namespace mp = multipass;
+namespace cmd = multipass::cmd;
+using RpcMethod = mp::Rpc::Stub;
+
+mp::ReturnCode cmd::Throttle::run(mp::ArgParser* parser)
+{
+    auto ret = parse_args(parser);
+    if (ret != ParseCode::Ok)
+    {
+        return parser->returnCodeFrom(ret);
+    }
+
+    auto on_success = [](mp::ThrottleReply& reply) { return ReturnCode::Ok; };
+
+    auto on_failure = [this](grpc::Status& status) { return standard_failure_handler_for(name(), cerr, status); };
+
+    request.set_verbosity_level(parser->verbosityLevel());
+    return dispatch(&RpcMethod::throttle, request, on_success, on_failure);
+}
+
+std::string cmd::Throttle::name() const
+{
+    return "throttle";
+}
+
+QString cmd::Throttle::short_help() const
+{
+    return QStringLiteral("Limit an instance's disk and network I/O");
+}
+
+QString cmd::Throttle::description() const
+{
+    return QStringLiteral("Set the limits on an instance's disk and network I/O, so that\n"
+                          "it leaves its neighbours their share of the host. Running\n"
+                          "instances are throttled straight away. Limits not given are\n"
+                          "lifted, so a throttle with no options lifts them all.");
+}
+
+mp::ParseCode cmd::Throttle::parse_args(mp::ArgParser* parser)
+{
+    parser->addPositionalArgument("instance", "Name of the instance to throttle", "<instance>");
+    add_io_limit_options(parser);
+
+    auto status = parser->commandParse(this);
+    if (status != ParseCode::Ok)
+        return status;
+
+    if (parser->positionalArguments().count() != 1)
+    {
+        cerr << "Wrong number of arguments\n";
+        return ParseCode::CommandLineError;
+    }
+
+    request.set_instance_name(parser->positionalArguments().first().toStdString());
+
+    try
+    {
+        *request.mutable_io_limits() = parse_io_limit_options(parser);
+    }
+    catch (const mp::ValidationException& e)
+    {
+        cerr << "error: " << e.what() << "\n";
+        return ParseCode::CommandLineError;
+    }
+
+    return status;
+}
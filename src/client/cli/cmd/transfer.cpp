@@ -21,9 +21,14 @@
 #include <multipass/cli/argparser.h>
 #include <multipass/cli/client_platform.h>
 #include <multipass/ssh/sftp_client.h>
+#include <multipass/ssh/ssh_session.h>
 
 #include <QFileInfo>
 
+#include <algorithm>
+#include <map>
+#include <memory>
+
 namespace mp = multipass;
 namespace cmd = multipass::cmd;
 namespace mcp = multipass::cli::platform;
@@ -37,51 +42,60 @@ const char streaming_symbol{'-'};
 mp::ReturnCode cmd::Transfer::run(mp::ArgParser* parser)
 {
     streaming_enabled = false;
+    between_instances = false;
     auto ret = parse_args(parser);
     if (ret != ParseCode::Ok)
     {
         return parser->returnCodeFrom(ret);
     }
 
+    if (between_instances)
+        return copy_between_instances(parser);
+
     auto on_success = [this](mp::SSHInfoReply& reply) {
         // TODO: mainly for testing - need a better way to test parsing
         if (reply.ssh_info().empty())
             return ReturnCode::Ok;
 
+        if (compress)
+            mp::SSHSession::set_compression(mp::SSHSession::Compression::always);
+
+        // Sources in the same instance share one session, rather than paying for a handshake each
+        std::map<std::string, std::unique_ptr<mp::SFTPClient>> sftp_clients;
         for (const auto& source : sources)
         {
-            mp::SSHInfo ssh_info;
-            if (!source.first.empty())
-            {
-                ssh_info = reply.ssh_info().find(source.first)->second;
-            }
-            else if (!destination.first.empty())
-            {
-                ssh_info = reply.ssh_info().find(destination.first)->second;
-            }
-
-            auto host = ssh_info.host();
-            auto port = ssh_info.port();
-            auto username = ssh_info.username();
-            auto priv_key_blob = ssh_info.priv_key_base64();
+            const auto& instance_name = source.first.empty() ? destination.first : source.first;
+            const auto& ssh_info = reply.ssh_info().find(instance_name)->second;
 
             try
             {
-                mp::SFTPClient sftp_client{host, port, username, priv_key_blob};
+                auto& sftp_client = sftp_clients[instance_name];
+                if (!sftp_client)
+                    sftp_client = std::make_unique<mp::SFTPClient>(ssh_info.host(), ssh_info.port(),
+                                                                   ssh_info.username(), ssh_info.priv_key_base64());
 
                 if (streaming_enabled)
                 {
                     if (destination.first.empty())
-                        sftp_client.stream_file(source.second, term->cout());
+                        sftp_client->stream_file(source.second, term->cout());
                     else
-                        sftp_client.stream_file(destination.second, term->cin());
+                        sftp_client->stream_file(destination.second, term->cin());
+                }
+                else if (!destination.first.empty())
+                {
+                    if (recursive && QFileInfo(QString::fromStdString(source.second)).isDir())
+                        sftp_client->push_dir(source.second, destination.second, sync);
+                    else if (sync)
+                        sftp_client->sync_file(source.second, destination.second);
+                    else
+                        sftp_client->push_file(source.second, destination.second);
                 }
                 else
                 {
-                    if (!destination.first.empty())
-                        sftp_client.push_file(source.second, destination.second);
+                    if (recursive && sftp_client->is_remote_dir(source.second))
+                        sftp_client->pull_dir(source.second, destination.second);
                     else
-                        sftp_client.pull_file(source.second, destination.second);
+                        sftp_client->pull_file(source.second, destination.second);
                 }
             }
             catch (const std::exception& e)
@@ -99,6 +113,23 @@ mp::ReturnCode cmd::Transfer::run(mp::ArgParser* parser)
     return dispatch(&RpcMethod::ssh_info, request, on_success, on_failure);
 }
 
+mp::ReturnCode cmd::Transfer::copy_between_instances(mp::ArgParser* parser)
+{
+    CopyFilesRequest copy_request;
+    copy_request.set_source_instance(sources.front().first);
+    for (const auto& source : sources)
+        copy_request.add_source_paths(source.second);
+    copy_request.set_destination_instance(destination.first);
+    copy_request.set_destination_path(destination.second);
+    copy_request.set_recursive(recursive);
+    copy_request.set_verbosity_level(parser->verbosityLevel());
+
+    auto on_success = [](mp::CopyFilesReply&) { return ReturnCode::Ok; };
+    auto on_failure = [this](grpc::Status& status) { return standard_failure_handler_for(name(), cerr, status); };
+
+    return dispatch(&RpcMethod::copy_files, copy_request, on_success, on_failure);
+}
+
 std::string cmd::Transfer::name() const
 {
     return "transfer";
@@ -116,9 +147,7 @@ QString cmd::Transfer::short_help() const
 
 QString cmd::Transfer::description() const
 {
-    // TODO: Don't mention directories until we support that
-    // return QStringLiteral("Copy files and directories between the host and instances.");
-    return QStringLiteral("Copy files between the host and instances.");
+    return QStringLiteral("Copy files and directories between the host and instances.");
 }
 
 mp::ParseCode cmd::Transfer::parse_args(mp::ArgParser* parser)
@@ -132,10 +161,25 @@ mp::ParseCode cmd::Transfer::parse_args(mp::ArgParser* parser)
                                   "a path inside the instance, or '-' for stdout",
                                   "<destination>");
 
+    QCommandLineOption recursive_option({"r", "recursive"}, "Copy directories, and everything in them");
+    parser->addOption(recursive_option);
+
+    QCommandLineOption sync_option("sync", "Only send the parts of files that differ from those already in the "
+                                           "instance");
+    parser->addOption(sync_option);
+
+    QCommandLineOption compress_option({"c", "compress"}, "Compress the data on the way, for instances behind slow "
+                                                          "links");
+    parser->addOption(compress_option);
+
     auto status = parser->commandParse(this);
     if (status != ParseCode::Ok)
         return status;
 
+    recursive = parser->isSet(recursive_option);
+    sync = parser->isSet(sync_option);
+    compress = parser->isSet(compress_option);
+
     if (parser->positionalArguments().count() < 2)
     {
         cerr << "Not enough arguments given\n";
@@ -172,6 +216,12 @@ mp::ParseCode cmd::Transfer::parse_args(mp::ArgParser* parser)
         return ParseCode::CommandLineError;
     }
 
+    if (sync && (streaming_enabled || destination.first.empty() || between_instances))
+    {
+        cerr << "--sync only works when copying files from the host into an instance\n";
+        return ParseCode::CommandLineError;
+    }
+
     return ParseCode::Ok;
 }
 
@@ -206,9 +256,9 @@ mp::ParseCode cmd::Transfer::parse_sources(mp::ArgParser* parser)
                 return ParseCode::CommandLineError;
             }
 
-            if (!source.isFile())
+            if (!source.isFile() && !(recursive && source.isDir()))
             {
-                cerr << "Source path must be a file\n";
+                cerr << (recursive ? "Source path must be a file or a directory\n" : "Source path must be a file\n");
                 return ParseCode::CommandLineError;
             }
 
@@ -273,8 +323,16 @@ mp::ParseCode cmd::Transfer::parse_destination(mp::ArgParser* parser)
     {
         if (!request.instance_name().empty())
         {
-            cerr << "Cannot specify an instance name for both source and destination\n";
-            return ParseCode::CommandLineError;
+            // From one instance straight into another, which the daemon does on its own
+            if (streaming_enabled || std::any_of(sources.cbegin(), sources.cend(), [this](const auto& source) {
+                    return source.first != sources.front().first;
+                }))
+            {
+                cerr << "Sources must all be in the same instance to copy them into another\n";
+                return ParseCode::CommandLineError;
+            }
+
+            between_instances = true;
         }
 
         auto entry = request.add_instance_name();
@@ -43,10 +43,15 @@ private:
     std::vector<std::pair<std::string, std::string>> sources;
     std::pair<std::string, std::string> destination;
     bool streaming_enabled;
+    bool recursive;
+    bool sync;
+    bool compress;
+    bool between_instances; // left to the daemon, so that nothing passes through the client
 
     ParseCode parse_args(ArgParser* parser) override;
     ParseCode parse_sources(ArgParser* parser);
     ParseCode parse_destination(ArgParser* parser);
+    ReturnCode copy_between_instances(ArgParser* parser);
 };
 }
 }
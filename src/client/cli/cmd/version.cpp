@@ -17,6 +17,8 @@
 
 #include "version.h"
 #include "common_cli.h"
+#include "response_cache.h"
+
 #include <multipass/cli/argparser.h>
 #include <multipass/version.h>
 
@@ -34,7 +36,19 @@ mp::ReturnCode cmd::Version::run(mp::ArgParser* parser)
 
     cout << "multipass  " << multipass::version_string << "\n";
 
-    auto on_success = [this](mp::VersionReply& reply) {
+    mp::VersionRequest request;
+    request.set_verbosity_level(parser->verbosityLevel());
+
+    ResponseCache cache;
+    mp::VersionReply cached;
+    if (cache.load(request, cached))
+    {
+        cout << "multipassd " << cached.version() << "\n";
+        return ReturnCode::Ok;
+    }
+
+    auto on_success = [this, &request, &cache](mp::VersionReply& reply) {
+        cache.store(request, reply, reply.cache_ttl());
         cout << "multipassd " << reply.version() << "\n";
         if (term->is_live() && update_available(reply.update_info()))
             cout << update_notice(reply.update_info());
@@ -43,8 +57,6 @@ mp::ReturnCode cmd::Version::run(mp::ArgParser* parser)
 
     auto on_failure = [](grpc::Status& status) { return ReturnCode::Ok; };
 
-    mp::VersionRequest request;
-    request.set_verbosity_level(parser->verbosityLevel());
     return dispatch(&RpcMethod::version, request, on_success, on_failure);
 }
 
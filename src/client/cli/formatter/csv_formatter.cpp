@@ -30,14 +30,14 @@ std::string mp::CSVFormatter::format(const InfoReply& reply) const
         buf, "Name,State,Ipv4,Ipv6,Release,Image hash,Image release,Load,Disk usage,Disk total,Memory usage,Memory "
              "total,Mounts,AllIPv4\n");
 
-    for (const auto& info : format::sorted(reply.info()))
+    for (const InfoReply::Info& info : format::sorted(reply.info()))
     {
         fmt::format_to(buf, "{},{},{},{},{},{},{},{},{},{},{},{},", info.name(),
                        mp::format::status_string_for(info.instance_status()), info.ipv4_size() ? info.ipv4(0) : "",
                        info.ipv6_size() ? info.ipv6(0) : "", info.current_release(), info.id(), info.image_release(),
                        info.load(), info.disk_usage(), info.disk_total(), info.memory_usage(), info.memory_total());
 
-        auto mount_paths = info.mount_info().mount_paths();
+        const auto& mount_paths = info.mount_info().mount_paths();
         for (auto mount = mount_paths.cbegin(); mount != mount_paths.cend(); ++mount)
         {
             fmt::format_to(buf, "{} => {};", mount->source_path(), mount->target_path());
@@ -54,7 +54,7 @@ std::string mp::CSVFormatter::format(const ListReply& reply) const
 
     fmt::format_to(buf, "Name,State,IPv4,IPv6,Release,AllIPv4\n");
 
-    for (const auto& instance : format::sorted(reply.instances()))
+    for (const ListVMInstance& instance : format::sorted(reply.instances()))
     {
         fmt::format_to(buf, "{},{},{},{},{},\"{}\"\n", instance.name(),
                        mp::format::status_string_for(instance.instance_status()),
@@ -71,7 +71,7 @@ std::string mp::CSVFormatter::format(const NetworksReply& reply) const
 
     fmt::format_to(buf, "Name,Type,Description\n");
 
-    for (const auto& interface : format::sorted(reply.interfaces()))
+    for (const NetInterface& interface : format::sorted(reply.interfaces()))
     {
         // Quote the description because it can contain commas.
         fmt::format_to(buf, "{},{},\"{}\"\n", interface.name(), interface.type(), interface.description());
@@ -78,6 +78,12 @@ std::string mp::format::status_string_for(const mp::InstanceStatus& status)
     case mp::InstanceStatus::SUSPENDED:
         status_val = "Suspended";
         break;
+    case mp::InstanceStatus::WARMING:
+        status_val = "Warming up";
+        break;
+    case mp::InstanceStatus::FAILED:
+        status_val = "Failed";
+        break;
     default:
         status_val = "Unknown";
         break;
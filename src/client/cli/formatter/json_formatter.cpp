@@ -37,6 +37,8 @@ std::string mp::JsonFormatter::format(const InfoReply& reply) const
     {
         QJsonObject instance_info;
         instance_info.insert("state", QString::fromStdString(mp::format::status_string_for(info.instance_status())));
+        if (info.stale())
+            instance_info.insert("stale", true); // what follows is what the instance last answered
         instance_info.insert("image_hash", QString::fromStdString(info.id()));
         instance_info.insert("image_release", QString::fromStdString(info.image_release()));
         instance_info.insert("release", QString::fromStdString(info.current_release()));
@@ -98,10 +100,51 @@ std::string mp::JsonFormatter::format(const InfoReply& reply) const
             entry.insert("gid_mappings", mount_gids);
             entry.insert("source_path", QString::fromStdString(mount.source_path()));
 
+            if (mount.has_stats())
+            {
+                QJsonObject operations;
+                for (const auto& operation : mount.stats().operations())
+                    operations.insert(QString::fromStdString(operation.name()),
+                                      QJsonObject{{"count", static_cast<qint64>(operation.count())},
+                                                  {"seconds", operation.seconds()},
+                                                  {"max_seconds", operation.max_seconds()}});
+
+                entry.insert("stats", QJsonObject{{"operations", operations},
+                                                  {"bytes_read", static_cast<qint64>(mount.stats().bytes_read())},
+                                                  {"bytes_written", static_cast<qint64>(mount.stats().bytes_written())},
+                                                  {"slow_operations",
+                                                   static_cast<qint64>(mount.stats().slow_operations())}});
+            }
+
             mounts.insert(QString::fromStdString(mount.target_path()), entry);
         }
         instance_info.insert("mounts", mounts);
 
+        if (info.has_io_limits())
+        {
+            const auto& limits = info.io_limits();
+            QJsonObject io_limits;
+            io_limits.insert("disk_iops", static_cast<qint64>(limits.disk_iops()));
+            io_limits.insert("disk_iops_burst", static_cast<qint64>(limits.disk_iops_burst()));
+            io_limits.insert("disk_bytes_per_second", static_cast<qint64>(limits.disk_bytes_per_second()));
+            io_limits.insert("disk_bytes_burst", static_cast<qint64>(limits.disk_bytes_burst()));
+            io_limits.insert("network_bytes_per_second", static_cast<qint64>(limits.network_bytes_per_second()));
+            instance_info.insert("io_limits", io_limits);
+        }
+
+        if (!info.usage_history().empty())
+        {
+            QJsonArray usage_history;
+            for (const auto& point : info.usage_history())
+                usage_history.append(QJsonObject{{"timestamp", static_cast<qint64>(point.timestamp())},
+                                                 {"cpu_cores", point.cpu_cores()},
+                                                 {"memory_used", static_cast<qint64>(point.memory_used())},
+                                                 {"disk_used", static_cast<qint64>(point.disk_used())},
+                                                 {"net_rx_rate", point.net_rx_rate()},
+                                                 {"net_tx_rate", point.net_tx_rate()}});
+            instance_info.insert("usage_history", usage_history);
+        }
+
         info_obj.insert(QString::fromStdString(info.name()), instance_info);
     }
     info_json.insert("info", info_obj);
@@ -140,7 +183,7 @@ std::string mp::JsonFormatter::format(const NetworksReply& reply) const
     QJsonObject list_json;
     QJsonArray interfaces;
 
-    for (const auto& interface : format::sorted(reply.interfaces()))
+    for (const NetInterface& interface : format::sorted(reply.interfaces()))
     {
         QJsonObject interface_obj;
         interface_obj.insert("name", QString::fromStdString(interface.name()));
@@ -21,6 +21,12 @@
 
 #include <multipass/format.h>
 
+#include <QDateTime>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
 namespace mp = multipass;
 
 namespace
@@ -49,6 +55,37 @@ std::string to_usage(const std::string& usage, const std::string& total)
     return fmt::format("{} out of {}", human_readable_size(usage), human_readable_size(total));
 }
 
+// Usage history values are negative where they are unknown
+std::string to_history_size(long long bytes)
+{
+    return bytes < 0 ? "--" : human_readable_size(std::to_string(bytes));
+}
+
+std::string to_history_rate(double bytes_per_second)
+{
+    return bytes_per_second < 0 ? "--" : human_readable_size(std::to_string(std::llround(bytes_per_second))) + "/s";
+}
+
+// Only the limits that are set, each sustained one followed by its burst
+std::string to_io_limits(const mp::IoLimitOptions& limits)
+{
+    auto with_burst = [](const std::string& sustained, const std::string& burst) {
+        return burst.empty() ? sustained : fmt::format("{} (burst {})", sustained, burst);
+    };
+
+    std::vector<std::string> parts;
+    if (limits.disk_iops())
+        parts.push_back(with_burst(fmt::format("disk {} IOPS", limits.disk_iops()),
+                                   limits.disk_iops_burst() ? std::to_string(limits.disk_iops_burst()) : ""));
+    if (limits.disk_bytes_per_second())
+        parts.push_back(with_burst("disk " + to_history_rate(limits.disk_bytes_per_second()),
+                                   limits.disk_bytes_burst() ? to_history_rate(limits.disk_bytes_burst()) : ""));
+    if (limits.network_bytes_per_second())
+        parts.push_back("network " + to_history_rate(limits.network_bytes_per_second()));
+
+    return fmt::format("{}", fmt::join(parts, ", "));
+}
+
 // Computes the column width needed to display all the elements of a range [begin, end). get_width is a function
 // which takes as input the element in the range and returns its width in columns.
 auto column_width = [](const auto begin, const auto end, const auto get_width, int minimum_width = 0) {
@@ -62,10 +99,11 @@ std::string mp::TableFormatter::format(const InfoReply& reply) const
 {
     fmt::memory_buffer buf;
 
-    for (const auto& info : format::sorted(reply.info()))
+    for (const InfoReply::Info& info : format::sorted(reply.info()))
     {
         fmt::format_to(buf, "{:<16}{}\n", "Name:", info.name());
-        fmt::format_to(buf, "{:<16}{}\n", "State:", mp::format::status_string_for(info.instance_status()));
+        fmt::format_to(buf, "{:<16}{}{}\n", "State:", mp::format::status_string_for(info.instance_status()),
+                       info.stale() ? " (stale)" : "");
 
         int ipv4_size = info.ipv4_size();
         fmt::format_to(buf, "{:<16}{}\n", "IPv4:", ipv4_size ? info.ipv4(0) : "--");
@@ -91,8 +129,10 @@ std::string mp::TableFormatter::format(const InfoReply& reply) const
         fmt::format_to(buf, "{:<16}{}\n", "Load:", info.load().empty() ? "--" : info.load());
         fmt::format_to(buf, "{:<16}{}\n", "Disk usage:", to_usage(info.disk_usage(), info.disk_total()));
         fmt::format_to(buf, "{:<16}{}\n", "Memory usage:", to_usage(info.memory_usage(), info.memory_total()));
+        if (info.has_io_limits())
+            fmt::format_to(buf, "{:<16}{}\n", "I/O limits:", to_io_limits(info.io_limits()));
 
-        auto mount_paths = info.mount_info().mount_paths();
+        const auto& mount_paths = info.mount_info().mount_paths();
         for (auto mount = mount_paths.cbegin(); mount != mount_paths.cend(); ++mount)
         {
             fmt::format_to(buf, "{:<16}{:{}} => {}\n", (mount == mount_paths.cbegin()) ? "Mounts:" : " ",
@@ -120,6 +160,20 @@ std::string mp::TableFormatter::format(const InfoReply& reply) const
             }
         }
 
+        if (!info.usage_history().empty())
+        {
+            fmt::format_to(buf, "{:<16}{:<18}{:<8}{:<10}{:<10}{:<10}{}\n", "Usage history:", "Time", "CPU", "Memory",
+                           "Disk", "Net in", "Net out");
+            for (const auto& point : info.usage_history())
+                fmt::format_to(buf, "{:<16}{:<18}{:<8}{:<10}{:<10}{:<10}{}\n", "",
+                               QDateTime::fromSecsSinceEpoch(point.timestamp())
+                                   .toString("yyyy-MM-dd HH:mm")
+                                   .toStdString(),
+                               point.cpu_cores() < 0 ? "--" : fmt::format("{:.2f}", point.cpu_cores()),
+                               to_history_size(point.memory_used()), to_history_size(point.disk_used()),
+                               to_history_rate(point.net_rx_rate()), to_history_rate(point.net_tx_rate()));
+        }
+
         fmt::format_to(buf, "\n");
     }
 
@@ -136,7 +190,7 @@ std::string mp::TableFormatter::format(const ListReply& reply) const
 {
     fmt::memory_buffer buf;
 
-    auto instances = reply.instances();
+    const auto& instances = reply.instances();
 
     if (instances.empty())
         return "No instances found.\n";
@@ -150,7 +204,7 @@ std::string mp::TableFormatter::format(const ListReply& reply) const
     fmt::format_to(buf, row_format, "Name", name_column_width, "State", state_column_width, "IPv4", ip_column_width,
                    "Image");
 
-    for (const auto& instance : format::sorted(reply.instances()))
+    for (const ListVMInstance& instance : format::sorted(instances))
     {
         int ipv4_size = instance.ipv4_size();
 
@@ -174,7 +228,7 @@ std::string mp::TableFormatter::format(const NetworksReply& reply) const
 {
     fmt::memory_buffer buf;
 
-    auto interfaces = reply.interfaces();
+    const auto& interfaces = reply.interfaces();
 
     if (interfaces.empty())
         return "No network interfaces found.\n";
@@ -190,7 +244,7 @@ std::string mp::TableFormatter::format(const NetworksReply& reply) const
     const auto row_format = "{:<{}}{:<{}}{:<}\n";
     fmt::format_to(buf, row_format, "Name", name_column_width, "Type", type_column_width, "Description");
 
-    for (const auto& interface : format::sorted(reply.interfaces()))
+    for (const NetInterface& interface : format::sorted(interfaces))
     {
         fmt::format_to(buf, row_format, interface.name(), name_column_width, interface.type(), type_column_width,
                        interface.description());
@@ -34,11 +34,13 @@ std::string mp::YamlFormatter::format(const InfoReply& reply) const
 
     info_node["errors"].push_back(YAML::Null);
 
-    for (const auto& info : format::sorted(reply.info()))
+    for (const InfoReply::Info& info : format::sorted(reply.info()))
     {
         YAML::Node instance_node;
 
         instance_node["state"] = mp::format::status_string_for(info.instance_status());
+        if (info.stale())
+            instance_node["stale"] = true; // what follows is what the instance last answered
         instance_node["image_hash"] = info.id();
         instance_node["image_release"] = info.image_release();
         if (info.current_release().empty())
@@ -103,10 +105,50 @@ std::string mp::YamlFormatter::format(const InfoReply& reply) const
             }
 
             mount_node["source_path"] = mount.source_path();
+
+            if (mount.has_stats())
+            {
+                YAML::Node stats_node;
+                for (const auto& operation : mount.stats().operations())
+                {
+                    YAML::Node operation_node;
+                    operation_node["count"] = operation.count();
+                    operation_node["seconds"] = operation.seconds();
+                    operation_node["max_seconds"] = operation.max_seconds();
+                    stats_node["operations"][operation.name()] = operation_node;
+                }
+                stats_node["bytes_read"] = mount.stats().bytes_read();
+                stats_node["bytes_written"] = mount.stats().bytes_written();
+                stats_node["slow_operations"] = mount.stats().slow_operations();
+                mount_node["stats"] = stats_node;
+            }
             mounts[mount.target_path()] = mount_node;
         }
         instance_node["mounts"] = mounts;
 
+        if (info.has_io_limits())
+        {
+            YAML::Node limits_node;
+            limits_node["disk_iops"] = info.io_limits().disk_iops();
+            limits_node["disk_iops_burst"] = info.io_limits().disk_iops_burst();
+            limits_node["disk_bytes_per_second"] = info.io_limits().disk_bytes_per_second();
+            limits_node["disk_bytes_burst"] = info.io_limits().disk_bytes_burst();
+            limits_node["network_bytes_per_second"] = info.io_limits().network_bytes_per_second();
+            instance_node["io_limits"] = limits_node;
+        }
+
+        for (const auto& point : info.usage_history())
+        {
+            YAML::Node point_node;
+            point_node["timestamp"] = point.timestamp();
+            point_node["cpu_cores"] = point.cpu_cores();
+            point_node["memory_used"] = point.memory_used();
+            point_node["disk_used"] = point.disk_used();
+            point_node["net_rx_rate"] = point.net_rx_rate();
+            point_node["net_tx_rate"] = point.net_tx_rate();
+            instance_node["usage_history"].push_back(point_node);
+        }
+
         info_node[info.name()].push_back(instance_node);
     }
     return mpu::emit_yaml(info_node);
@@ -116,7 +158,7 @@ std::string mp::YamlFormatter::format(const ListReply& reply) const
 {
     YAML::Node list;
 
-    for (const auto& instance : format::sorted(reply.instances()))
+    for (const ListVMInstance& instance : format::sorted(reply.instances()))
     {
         YAML::Node instance_node;
         instance_node["state"] = mp::format::status_string_for(instance.instance_status());
@@ -137,7 +179,7 @@ std::string mp::YamlFormatter::format(const NetworksReply& reply) const
 {
     YAML::Node list;
 
-    for (const auto& interface : format::sorted(reply.interfaces()))
+    for (const NetInterface& interface : format::sorted(reply.interfaces()))
     {
         YAML::Node interface_node;
         interface_node["type"] = interface.type();
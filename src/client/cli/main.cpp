@@ -20,6 +20,7 @@
 #include <multipass/cli/client_common.h>
 #include <multipass/console.h>
 #include <multipass/constants.h>
+#include <multipass/ssh/ssh_broker.h>
 #include <multipass/top_catch_all.h>
 
 #include <QCoreApplication>
@@ -33,6 +34,9 @@ int main_impl(int argc, char* argv[])
     QCoreApplication app(argc, argv);
     QCoreApplication::setApplicationName(mp::client_name);
 
+    if (argc == 2 && QString{argv[1]} == mp::SSHBroker::run_flag)
+        return mp::SSHBroker{mp::SSHBroker::default_server_name()}.run();
+
     mp::Console::setup_environment();
     auto term = mp::Terminal::make_terminal();
 
@@ -16,7 +16,10 @@
  */
 
 #include <multipass/cli/client_common.h>
+#include <multipass/constants.h>
+#include <multipass/memory_size.h>
 #include <multipass/platform.h>
+#include <multipass/settings.h>
 #include <multipass/standard_paths.h>
 #include <multipass/utils.h>
 
@@ -25,15 +28,46 @@
 #include <multipass/logging/log.h>
 #include <multipass/logging/standard_logger.h>
 
+#include <algorithm>
+#include <limits>
+
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 
 namespace
 {
+constexpr auto keepalive_timeout_ms = 20000;
+
 mp::ReturnCode return_code_for(const grpc::StatusCode& code)
 {
     return code == grpc::StatusCode::UNAVAILABLE ? mp::ReturnCode::DaemonFail : mp::ReturnCode::CommandFail;
 }
+
+// As set in the client.rpc.* settings, for daemons reached over the network; the daemon tunes its own side
+grpc::ChannelArguments channel_arguments()
+{
+    grpc::ChannelArguments args;
+
+    if (MP_SETTINGS.get(mp::client_rpc_compression_key) == "gzip")
+        args.SetCompressionAlgorithm(GRPC_COMPRESS_GZIP);
+
+    if (const auto keepalive = MP_SETTINGS.get(mp::client_rpc_keepalive_key); !keepalive.isEmpty())
+    {
+        args.SetInt(GRPC_ARG_KEEPALIVE_TIME_MS, keepalive.toInt() * 1000);
+        args.SetInt(GRPC_ARG_KEEPALIVE_TIMEOUT_MS, keepalive_timeout_ms);
+        args.SetInt(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, 1); // for channels held on to between calls
+        args.SetInt(GRPC_ARG_HTTP2_MAX_PINGS_WITHOUT_DATA, 0);
+    }
+
+    if (const auto window = MP_SETTINGS.get(mp::client_rpc_window_key); !window.isEmpty())
+    {
+        const auto bytes = mp::MemorySize{window.toStdString()}.in_bytes();
+        args.SetInt(GRPC_ARG_HTTP2_STREAM_LOOKAHEAD_BYTES,
+                    static_cast<int>(std::min<long long>(bytes, std::numeric_limits<int>::max())));
+    }
+
+    return args;
+}
 } // namespace
 
 mp::ReturnCode mp::cmd::standard_failure_handler_for(const std::string& command, std::ostream& cerr,
@@ -73,7 +107,7 @@ std::shared_ptr<grpc::Channel> mp::client::make_channel(const std::string& serve
     {
         throw std::runtime_error("Unknown connection type");
     }
-    return grpc::CreateChannel(server_address, creds);
+    return grpc::CreateCustomChannel(server_address, creds, channel_arguments());
 }
 
 std::string mp::client::get_server_address()
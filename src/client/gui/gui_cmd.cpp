@@ -83,6 +83,8 @@ void set_input_state_for(QList<QAction*> actions, const mp::InstanceStatus& stat
         break;
     case mp::InstanceStatus::DELETED:
     case mp::InstanceStatus::SUSPENDING:
+    case mp::InstanceStatus::WARMING:
+    case mp::InstanceStatus::FAILED:
         actions[ActionType::start]->setEnabled(false);
         actions[ActionType::open_shell]->setEnabled(false);
         actions[ActionType::stop]->setEnabled(false);
@@ -272,10 +274,19 @@ void cmd::GuiCmd::create_menu()
 
     QObject::connect(&list_watcher, &QFutureWatcher<ListReply>::finished, this, &GuiCmd::update_menu);
 
-    QObject::connect(&menu_update_timer, &QTimer::timeout, this, [this] { initiate_menu_layout(); });
+    // The menu is only laid out again when the daemon reports a change. Polling remains for daemons that cannot
+    // report them, and while there is no daemon to watch
+    QObject::connect(&menu_update_timer, &QTimer::timeout, this, [this] {
+        if (watch_future.isRunning())
+            return;
+
+        initiate_menu_layout();
+        watch_future = QtConcurrent::run(&watch_pool, this, &GuiCmd::watch_instances);
+    });
 
     // Use a singleShot here to make sure the event loop is running before the quit() runs
     QObject::connect(quit_action, &QAction::triggered, [this] {
+        stop_watching_instances();
         future_synchronizer.waitForFinished();
         QTimer::singleShot(0, [] { QCoreApplication::quit(); });
     });
@@ -303,6 +314,7 @@ void cmd::GuiCmd::create_menu()
 
     initiate_menu_layout();
     initiate_about_menu_layout();
+    watch_future = QtConcurrent::run(&watch_pool, this, &GuiCmd::watch_instances);
 
     menu_update_timer.start(1s);
     about_update_timer.start(24h);
@@ -355,6 +367,37 @@ mp::ListReply cmd::GuiCmd::retrieve_all_instances()
     return list_reply;
 }
 
+void cmd::GuiCmd::watch_instances()
+{
+    grpc::ClientContext* context;
+    {
+        std::lock_guard<decltype(watch_mutex)> lock{watch_mutex};
+        if (watch_stopped)
+            return;
+
+        watch_context = std::make_unique<grpc::ClientContext>();
+        context = watch_context.get();
+    }
+
+    WatchReply reply;
+    auto reader = stub->watch(context, WatchRequest{});
+    while (reader->Read(&reply))
+        QMetaObject::invokeMethod(this, [this] { initiate_menu_layout(); }, Qt::QueuedConnection);
+    reader->Finish();
+}
+
+void cmd::GuiCmd::stop_watching_instances()
+{
+    {
+        std::lock_guard<decltype(watch_mutex)> lock{watch_mutex};
+        watch_stopped = true;
+        if (watch_context)
+            watch_context->TryCancel();
+    }
+
+    watch_future.waitForFinished();
+}
+
 void cmd::GuiCmd::create_menu_actions_for(const std::string& instance_name, const mp::InstanceStatus& state)
 {
     auto& instance_menu = instances_entries[instance_name].menu =
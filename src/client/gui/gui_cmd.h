@@ -26,11 +26,13 @@
 #include <QMenu>
 #include <QObject>
 #include <QSystemTrayIcon>
+#include <QThreadPool>
 #include <QTimer>
 
 #include <QHotkey>
 
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -75,6 +77,8 @@ private:
     void initiate_menu_layout();
     void initiate_about_menu_layout();
     ListReply retrieve_all_instances();
+    void watch_instances();
+    void stop_watching_instances();
     void create_menu_actions_for(const std::string& instance_name, const InstanceStatus& state);
     void handle_petenv_instance(const google::protobuf::RepeatedPtrField<ListVMInstance>&);
     void start_instance_for(const std::string& instance_name);
@@ -114,6 +118,13 @@ private:
     QFuture<ListReply> list_future;
     QFutureWatcher<ListReply> list_watcher;
 
+    // The watch stays open for as long as the daemon does, so it gets a thread of its own
+    QThreadPool watch_pool;
+    QFuture<void> watch_future;
+    std::mutex watch_mutex;
+    std::unique_ptr<grpc::ClientContext> watch_context; // of the watch in progress, to cancel it on quit
+    bool watch_stopped{false};
+
     QFuture<VersionReply> version_future;
     QFutureWatcher<VersionReply> version_watcher;
 
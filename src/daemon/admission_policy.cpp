@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "admission_policy.h"
+
+#include <multipass/constants.h>
+#include <multipass/format.h>
+#include <multipass/memory_size.h>
+#include <multipass/settings.h>
+
+#include <QFile>
+#include <QString>
+
+#include <thread>
+
+namespace mp = multipass;
+
+namespace
+{
+// Instances seldom keep all their vCPUs busy, unlike their memory, which is not given back
+constexpr auto cores_overcommit = 4;
+constexpr auto host_memory_share = 0.9;     // the rest is for the host itself and its page cache
+constexpr auto max_memory_pressure = 10.0; // beyond which the host is stalling enough to notice
+
+mp::AdmissionPolicy::Mode mode_from(const QString& mode)
+{
+    if (mode == "queue")
+        return mp::AdmissionPolicy::Mode::queue;
+    if (mode == "reject")
+        return mp::AdmissionPolicy::Mode::reject;
+
+    return mp::AdmissionPolicy::Mode::off;
+}
+
+std::string describe(const mp::AdmissionPolicy::Load& load)
+{
+    return fmt::format("{} cores and {:.1f}GiB", load.cores, load.memory / (1024.0 * 1024 * 1024));
+}
+} // namespace
+
+mp::AdmissionPolicy mp::AdmissionPolicy::from_settings()
+{
+    const auto& settings = MP_SETTINGS;
+    const auto cores = settings.get(admission_cpus_key);
+    const auto memory = settings.get(admission_memory_key);
+
+    return {mode_from(settings.get(admission_mode_key)),
+            {cores.isEmpty() ? static_cast<int>(std::thread::hardware_concurrency()) * cores_overcommit
+                             : cores.toInt(),
+             memory.isEmpty() ? static_cast<long long>(host_memory_total() * host_memory_share)
+                              : MemorySize{memory.toStdString()}.in_bytes()}};
+}
+
+bool mp::AdmissionPolicy::admits(const Load& committed, const Load& demand, double memory_pressure) const
+{
+    const auto total = committed + demand;
+    const auto nothing_up = !committed.cores && !committed.memory;
+
+    return total.cores <= limit.cores && (!limit.memory || total.memory <= limit.memory) &&
+           (nothing_up || memory_pressure <= max_memory_pressure);
+}
+
+bool mp::AdmissionPolicy::can_ever_admit(const Load& demand) const
+{
+    return admits({0, 0}, demand, 0);
+}
+
+std::string mp::AdmissionPolicy::describe(const Load& demand) const
+{
+    return fmt::format("{} asked for, of {} that instances may take (see local.admission.*)", ::describe(demand),
+                       limit.memory ? ::describe(limit) : fmt::format("{} cores", limit.cores));
+}
+
+long long mp::host_memory_total()
+{
+    QFile meminfo{"/proc/meminfo"};
+    if (!meminfo.open(QIODevice::ReadOnly | QIODevice::Text))
+        return 0;
+
+    for (auto line = meminfo.readLine(); !line.isEmpty(); line = meminfo.readLine())
+        if (line.startsWith("MemTotal:"))
+            return line.mid(9).trimmed().split(' ').first().toLongLong() * 1024; // in kB
+
+    return 0;
+}
+
+double mp::host_memory_pressure()
+{
+    QFile pressure{"/proc/pressure/memory"};
+    if (!pressure.open(QIODevice::ReadOnly | QIODevice::Text))
+        return 0;
+
+    // some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+    const auto line = pressure.readLine();
+    for (const auto& field : line.split(' '))
+        if (field.startsWith("avg10="))
+            return field.mid(6).toDouble();
+
+    return 0;
+}
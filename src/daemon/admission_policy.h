@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_ADMISSION_POLICY_H
+#define MULTIPASS_ADMISSION_POLICY_H
+
+#include <string>
+
+namespace multipass
+{
+// How much of the host the instances that are up may take, as configured in the local.admission.* settings. Requests
+// that would bring up more than that are queued until there is room, or turned away, rather than left to overcommit
+// the host until it swaps.
+struct AdmissionPolicy
+{
+    enum class Mode
+    {
+        off,
+        queue,
+        reject
+    };
+
+    struct Load
+    {
+        int cores;
+        long long memory; // bytes
+
+        Load operator+(const Load& other) const
+        {
+            return {cores + other.cores, memory + other.memory};
+        }
+    };
+
+    Mode mode;
+    Load limit; // zero memory for no memory limit, where the host's is unknown
+
+    // Empty limits come from the host: its cores, overcommitted, and its memory, less some for the host itself
+    static AdmissionPolicy from_settings();
+
+    // Whether what is asked for can come up next to what is committed already. On top of the limits, a host already
+    // stalling on memory takes nothing more, unless nothing is up to free some.
+    bool admits(const Load& committed, const Load& demand, double memory_pressure) const;
+    // Whether what is asked for could ever come up, with nothing else up
+    bool can_ever_admit(const Load& demand) const;
+
+    std::string describe(const Load& demand) const;
+};
+
+// The host's memory in bytes, from /proc/meminfo; zero where that is unknown
+long long host_memory_total();
+
+// The share, in percent, of the last ten seconds that some task stalled on memory, from the kernel's pressure stall
+// information; zero where that is unknown
+double host_memory_pressure();
+} // namespace multipass
+#endif // MULTIPASS_ADMISSION_POLICY_H
@@ -25,6 +25,8 @@
 #include <multipass/exceptions/unsupported_alias_exception.h>
 #include <multipass/exceptions/unsupported_remote_exception.h>
 
+#include <QtConcurrent/QtConcurrent>
+
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 
@@ -67,18 +69,78 @@ auto mp::CommonVMImageHost::info_for_full_hash(const std::string& full_hash) ->
     return info_for_full_hash_impl(full_hash);
 }
 
+void mp::CommonVMImageHost::wait_for_manifest_refresh()
+{
+    QFuture<void> refresh;
+    {
+        std::lock_guard<decltype(update_mutex)> lock{update_mutex};
+        refresh = manifest_refresh;
+    }
+
+    refresh.waitForFinished();
+}
+
 void mp::CommonVMImageHost::update_manifests()
 {
+    {
+        std::lock_guard<decltype(update_mutex)> lock{update_mutex};
+        if (!needs_update(std::chrono::steady_clock::now()))
+            return;
+
+        if (serving_manifests)
+        {
+            if (!refresh_stopped && manifest_refresh.isFinished())
+                manifest_refresh = QtConcurrent::run([this] {
+                    try
+                    {
+                        refresh_manifests();
+                    }
+                    catch (const std::exception& e)
+                    {
+                        mpl::log(mpl::Level::error, category, e.what());
+                    }
+                });
+
+            return;
+        }
+    }
+
+    refresh_manifests();
+}
+
+void mp::CommonVMImageHost::stop_manifest_refresh()
+{
+    {
+        std::lock_guard<decltype(update_mutex)> lock{update_mutex};
+        refresh_stopped = true;
+    }
+
+    wait_for_manifest_refresh();
+}
+
+bool mp::CommonVMImageHost::needs_update(std::chrono::steady_clock::time_point now) const
+{
+    return (now - last_update) > manifest_time_to_live || need_extra_update;
+}
+
+void mp::CommonVMImageHost::refresh_manifests()
+{
+    std::lock_guard<decltype(fetch_mutex)> fetch_lock{fetch_mutex};
+
     const auto now = std::chrono::steady_clock::now();
-    if ((now - last_update) > manifest_time_to_live || need_extra_update)
     {
+        std::lock_guard<decltype(update_mutex)> lock{update_mutex};
+        if (!needs_update(now)) // someone else fetched while we waited
+            return;
+
         need_extra_update = false;
+    }
 
-        clear();
-        fetch_manifests();
+    fetch_manifests();
 
-        last_update = now;
-    }
+    std::lock_guard<decltype(update_mutex)> lock{update_mutex};
+    last_update = now;
+    serving_manifests = serving_manifests || !need_extra_update;
 }
 
 void mp::CommonVMImageHost::on_manifest_empty(const std::string& details)
@@ -86,9 +148,19 @@ void mp::CommonVMImageHost::on_manifest_empty(const std::string& details)
     mpl::log(mpl::Level::info, category, details);
 }
 
+void mp::CommonVMImageHost::on_manifests_restored()
+{
+    std::lock_guard<decltype(update_mutex)> lock{update_mutex};
+    serving_manifests = true;
+}
+
 void mp::CommonVMImageHost::on_manifest_update_failure(const std::string& details)
 {
-    need_extra_update = true;
+    {
+        std::lock_guard<decltype(update_mutex)> lock{update_mutex};
+        need_extra_update = true;
+    }
+
     mpl::log(mpl::Level::warning, category, fmt::format("Could not update manifest: {}", details));
 }
 
@@ -20,10 +20,12 @@
 
 #include "multipass/vm_image_host.h"
 
+#include <QFuture>
 #include <QStringList>
 #include <QTimer>
 
 #include <chrono>
+#include <mutex>
 
 namespace multipass
 {
@@ -35,23 +37,43 @@ public:
     void for_each_entry_do(const Action& action) final;
     VMImageInfo info_for_full_hash(const std::string& full_hash) final;
 
+    // Blocks until the ongoing background refresh, if any, is done
+    void wait_for_manifest_refresh();
+
 protected:
+    // Blocks on fetching the manifests until that first succeeds. After that, stale manifests keep being served while
+    // they are refreshed in the background
     void update_manifests();
+    // Lets the ongoing refresh finish and starts no more; subclasses call this first thing on destruction, as refreshes
+    // rely on their overrides
+    void stop_manifest_refresh();
     void on_manifest_update_failure(const std::string& details);
     void on_manifest_empty(const std::string& details);
+    // Subclasses call this once they serve manifests restored from a cache, which then only get revalidated in the
+    // background
+    void on_manifests_restored();
     void check_remote_is_supported(const std::string& remote_name) const;
     void check_alias_is_supported(const std::string& alias, const std::string& remote_name) const;
     bool check_all_aliases_are_supported(const QStringList& aliases, const std::string& remote_name) const;
 
     virtual void for_each_entry_do_impl(const Action& action) = 0;
     virtual VMImageInfo info_for_full_hash_impl(const std::string& full_hash) = 0;
-    virtual void clear() = 0;
+    // Fetches a whole new set of manifests and swaps it in at once, so that readers, which keep hold of the set they
+    // started with, never see a partial one. Never runs concurrently with itself
     virtual void fetch_manifests() = 0;
 
 private:
+    bool needs_update(std::chrono::steady_clock::time_point now) const;
+    void refresh_manifests();
+
     std::chrono::seconds manifest_time_to_live;
+    std::mutex update_mutex; // guards the fields below
     std::chrono::steady_clock::time_point last_update;
     bool need_extra_update = true;
+    bool serving_manifests = false;
+    bool refresh_stopped = false;
+    QFuture<void> manifest_refresh;
+    std::mutex fetch_mutex;
     QTimer manifest_single_shot;
 };
 
@@ -25,25 +25,26 @@
 #include <multipass/exceptions/unsupported_remote_exception.h>
 
 #include <multipass/format.h>
+#include <multipass/logging/log.h>
 
 #include <QMap>
 #include <QUrl>
+#include <QtConcurrent/QtConcurrent>
 
+#include <algorithm>
+#include <exception>
+#include <map>
 #include <utility>
 
 namespace mp = multipass;
+namespace mpl = multipass::logging;
 
 namespace
 {
+constexpr auto category = "custom image host";
 constexpr auto no_remote = "";
 constexpr auto snapcraft_remote = "snapcraft";
 
-struct BaseImageInfo
-{
-    const QString last_modified;
-    const QString hash;
-};
-
 struct CustomImageInfo
 {
     QString url_prefix;
@@ -104,23 +105,48 @@ const QMap<QString, CustomImageInfo> snapcraft_image_info{
       "https://cloud-images.ubuntu.com/releases/focal/release/unpacked/"
       "ubuntu-20.04-server-cloudimg-amd64-initrd-generic"}}};
 
-auto base_image_info_for(mp::URLDownloader* url_downloader, const QString& image_url, const QString& hash_url,
-                         const QString& image_file)
+// A value computed in the thread pool, or the exception that stopped it; QtConcurrent alone would not keep its type
+template <typename T>
+struct Outcome
 {
-    const auto last_modified = url_downloader->last_modified({image_url}).toString("yyyyMMdd");
-    const auto sha256_sums = url_downloader->download({hash_url}).split('\n');
-    QString hash;
-
-    for (const QString line : sha256_sums) // intentional copy
+    T get() const
     {
-        if (line.trimmed().endsWith(image_file))
+        if (error)
+            std::rethrow_exception(error);
+        return value;
+    }
+
+    T value{};
+    std::exception_ptr error;
+};
+
+template <typename Function>
+auto run_in_pool(Function&& function)
+{
+    return QtConcurrent::run([function = std::forward<Function>(function)] {
+        Outcome<decltype(function())> outcome;
+        try
+        {
+            outcome.value = function();
+        }
+        catch (...)
         {
-            hash = line.split(' ').first();
-            break;
+            outcome.error = std::current_exception();
         }
+
+        return outcome;
+    });
+}
+
+QString hash_in(const QByteArray& sha256_sums, const QString& image_file)
+{
+    for (const QString line : sha256_sums.split('\n')) // intentional copy
+    {
+        if (line.trimmed().endsWith(image_file))
+            return line.split(' ').first();
     }
 
-    return BaseImageInfo{last_modified, hash};
+    return {};
 }
 
 auto map_aliases_to_vm_info_for(const std::vector<mp::VMImageInfo>& images)
@@ -141,17 +167,45 @@ auto map_aliases_to_vm_info_for(const std::vector<mp::VMImageInfo>& images)
 auto full_image_info_for(const QMap<QString, CustomImageInfo>& custom_image_info, mp::URLDownloader* url_downloader,
                          const QString& path_prefix)
 {
-    std::vector<mp::VMImageInfo> default_images;
+    // All the requests go out at once, with each distinct SHA256SUMS downloaded only once. The downloader's network
+    // cache turns repeated downloads into conditional requests
+    std::map<QString, QFuture<Outcome<QByteArray>>> sha256_sums;
+    std::vector<QFuture<Outcome<QString>>> last_modified;
+    std::vector<std::pair<QString, QString>> image_and_hash_urls;
 
     for (const auto& image_info : custom_image_info.toStdMap())
     {
-        auto image_file = image_info.first;
         auto prefix =
             path_prefix.isEmpty() ? image_info.second.url_prefix : QUrl::fromLocalFile(path_prefix).toString();
         QString image_url{prefix + image_info.first};
         QString hash_url{prefix + QStringLiteral("SHA256SUMS")};
 
-        auto base_image_info = base_image_info_for(url_downloader, image_url, hash_url, image_file);
+        if (sha256_sums.find(hash_url) == sha256_sums.end())
+            sha256_sums.emplace(hash_url, run_in_pool([url_downloader, hash_url] {
+                                    return url_downloader->download({hash_url});
+                                }));
+
+        last_modified.push_back(run_in_pool([url_downloader, image_url] {
+            return url_downloader->last_modified({image_url}).toString("yyyyMMdd");
+        }));
+        image_and_hash_urls.emplace_back(image_url, hash_url);
+    }
+
+    for (auto& future : last_modified)
+        future.waitForFinished();
+    for (auto& entry : sha256_sums)
+        entry.second.waitForFinished();
+
+    std::vector<mp::VMImageInfo> default_images;
+    auto i = 0u;
+
+    for (const auto& image_info : custom_image_info.toStdMap())
+    {
+        const auto& image_url = image_and_hash_urls[i].first;
+        const auto& hash_url = image_and_hash_urls[i].second;
+        const auto version = last_modified[i++].result().get();
+        const auto hash = hash_in(sha256_sums.at(hash_url).result().get(), image_info.first);
+
         mp::VMImageInfo full_image_info{image_info.second.aliases,
                                         image_info.second.os,
                                         image_info.second.release,
@@ -160,9 +214,9 @@ auto full_image_info_for(const QMap<QString, CustomImageInfo>& custom_image_info
                                         image_url, // image_location
                                         image_info.second.kernel_location,
                                         image_info.second.initrd_location,
-                                        base_image_info.hash, // id
+                                        hash, // id
                                         "",
-                                        base_image_info.last_modified, // version
+                                        version, // version
                                         0,
                                         true};
 
@@ -182,13 +236,20 @@ mp::CustomVMImageHost::CustomVMImageHost(URLDownloader* downloader, std::chrono:
 }
 
 mp::CustomVMImageHost::CustomVMImageHost(URLDownloader* downloader, std::chrono::seconds manifest_time_to_live,
-                                         const QString& path_prefix)
+                                         const QString& path_prefix, const QString& manifest_cache_path)
     : CommonVMImageHost{manifest_time_to_live},
       url_downloader{downloader},
       path_prefix{path_prefix},
-      custom_image_info{},
-      remotes{no_remote, snapcraft_remote}
+      custom_image_info{std::make_shared<const Manifests>()},
+      remotes{no_remote, snapcraft_remote},
+      manifest_cache{manifest_cache_path}
+{
+    restore_cached_manifests();
+}
+
+mp::CustomVMImageHost::~CustomVMImageHost()
 {
+    stop_manifest_refresh();
 }
 
 mp::optional<mp::VMImageInfo> mp::CustomVMImageHost::info_for(const Query& query)
@@ -238,7 +299,8 @@ std::vector<mp::VMImageInfo> mp::CustomVMImageHost::all_images_for(const std::st
 
 void mp::CustomVMImageHost::for_each_entry_do_impl(const Action& action)
 {
-    for (const auto& manifest : custom_image_info)
+    const auto current_manifests = std::atomic_load(&custom_image_info);
+    for (const auto& manifest : *current_manifests)
     {
         for (const auto& info : manifest.second->products)
         {
@@ -255,40 +317,94 @@ std::vector<std::string> mp::CustomVMImageHost::supported_remotes()
 
 void mp::CustomVMImageHost::fetch_manifests()
 {
+    const auto current_manifests = std::atomic_load(&custom_image_info);
+
+    // Both remotes are fetched at once, so that neither waits on the other's downloads
+    std::vector<std::pair<std::string, QFuture<Outcome<std::shared_ptr<const CustomManifest>>>>> fetches;
     for (const auto& spec :
          {std::make_pair(no_remote, multipass_image_info), std::make_pair(snapcraft_remote, snapcraft_image_info)})
     {
         try
         {
             check_remote_is_supported(spec.first);
+        }
+        catch (const mp::UnsupportedRemoteException&)
+        {
+            continue;
+        }
+
+        auto fetch = [this, image_info = spec.second]() -> std::shared_ptr<const CustomManifest> {
+            return full_image_info_for(image_info, url_downloader, path_prefix);
+        };
+        fetches.emplace_back(spec.first, run_in_pool(std::move(fetch)));
+    }
+
+    for (auto& fetch : fetches)
+        fetch.second.waitForFinished();
 
-            custom_image_info.emplace(spec.first, full_image_info_for(spec.second, url_downloader, path_prefix));
+    auto fetched_manifests = std::make_shared<Manifests>();
+    for (auto& fetch : fetches)
+    {
+        try
+        {
+            fetched_manifests->emplace(fetch.first, fetch.second.result().get());
         }
         catch (mp::DownloadException& e)
         {
+            // Readers are better off with the stale products than with none
             on_manifest_update_failure(e.what());
-        }
-        catch (const mp::UnsupportedRemoteException&)
-        {
-            continue;
+
+            auto current = current_manifests->find(fetch.first);
+            if (current != current_manifests->end())
+                fetched_manifests->insert(*current);
         }
     }
-}
 
-void mp::CustomVMImageHost::clear()
-{
-    custom_image_info.clear();
+    save_cached_manifests(*fetched_manifests);
+    std::atomic_store(&custom_image_info, std::shared_ptr<const Manifests>{std::move(fetched_manifests)});
 }
 
-mp::CustomManifest* mp::CustomVMImageHost::manifest_from(const std::string& remote_name)
+std::shared_ptr<const mp::CustomManifest> mp::CustomVMImageHost::manifest_from(const std::string& remote_name)
 {
     check_remote_is_supported(remote_name);
 
     update_manifests();
 
-    auto it = custom_image_info.find(remote_name);
-    if (it == custom_image_info.end())
+    const auto current_manifests = std::atomic_load(&custom_image_info);
+    auto it = current_manifests->find(remote_name);
+    if (it == current_manifests->end())
         throw std::runtime_error(fmt::format("Remote \"{}\" is unknown or unreachable.", remote_name));
 
-    return it->second.get();
+    return it->second;
+}
+
+void mp::CustomVMImageHost::restore_cached_manifests()
+{
+    Manifests restored;
+    for (auto& cached : manifest_cache.load())
+    {
+        auto known = std::find(remotes.cbegin(), remotes.cend(), cached.remote) != remotes.cend();
+        if (!known || !MP_PLATFORM.is_remote_supported(cached.remote))
+            continue;
+
+        auto map = map_aliases_to_vm_info_for(cached.products);
+        restored.emplace(cached.remote, std::unique_ptr<CustomManifest>(
+                                            new CustomManifest{std::move(cached.products), std::move(map)}));
+    }
+
+    if (!restored.empty())
+    {
+        mpl::log(mpl::Level::debug, category, fmt::format("Restored {} cached manifest(s)", restored.size()));
+        custom_image_info = std::make_shared<const Manifests>(std::move(restored));
+        on_manifests_restored();
+    }
+}
+
+void mp::CustomVMImageHost::save_cached_manifests(const Manifests& manifests) const
+{
+    std::vector<CachedManifest> cached;
+    for (const auto& manifest : manifests)
+        cached.push_back({manifest.first, QString(), QByteArray(), manifest.second->products});
+
+    manifest_cache.save(cached);
 }
@@ -19,6 +19,7 @@
 #define MULTIPASS_CUSTOM_IMAGE_HOST
 
 #include "common_image_host.h"
+#include "image_manifest_cache.h"
 
 #include <QString>
 
@@ -42,8 +43,10 @@ class CustomVMImageHost final : public CommonVMImageHost
 {
 public:
     CustomVMImageHost(URLDownloader* downloader, std::chrono::seconds manifest_time_to_live);
-    // For testing
-    CustomVMImageHost(URLDownloader* downloader, std::chrono::seconds manifest_time_to_live, const QString& path_prefix);
+    // A non-empty path_prefix replaces where the images are found, for testing
+    CustomVMImageHost(URLDownloader* downloader, std::chrono::seconds manifest_time_to_live, const QString& path_prefix,
+                      const QString& manifest_cache_path = QString());
+    ~CustomVMImageHost() override;
 
     optional<VMImageInfo> info_for(const Query& query) override;
     std::vector<std::pair<std::string, VMImageInfo>> all_info_for(const Query& query) override;
@@ -54,15 +57,19 @@ protected:
     void for_each_entry_do_impl(const Action& action) override;
     VMImageInfo info_for_full_hash_impl(const std::string& full_hash) override;
     void fetch_manifests() override;
-    void clear() override;
 
 private:
-    CustomManifest* manifest_from(const std::string& remote_name);
+    using Manifests = std::unordered_map<std::string, std::shared_ptr<const CustomManifest>>;
+
+    std::shared_ptr<const CustomManifest> manifest_from(const std::string& remote_name);
+    void restore_cached_manifests();
+    void save_cached_manifests(const Manifests& manifests) const;
 
     URLDownloader* const url_downloader;
     const QString path_prefix;
-    std::unordered_map<std::string, std::unique_ptr<CustomManifest>> custom_image_info;
+    std::shared_ptr<const Manifests> custom_image_info; // only ever swapped whole, with std::atomic_load/store
     std::vector<std::string> remotes;
+    const ImageManifestCache manifest_cache;
 };
 } // namespace multipass
 #endif // MULTIPASS_CUSTOM_IMAGE_HOST
@@ -17,9 +17,11 @@
 
 #include "daemon.h"
 #include "base_cloud_init_config.h"
-#include "json_writer.h"
+#include "json_journal.h"
 
+#include <multipass/cli/client_platform.h>
 #include <multipass/constants.h>
+#include <multipass/download_scheduler.h>
 #include <multipass/exceptions/create_image_exception.h>
 #include <multipass/exceptions/exitless_sshprocess_exception.h>
 #include <multipass/exceptions/invalid_memory_size_exception.h>
@@ -30,10 +32,12 @@
 #include <multipass/logging/client_logger.h>
 #include <multipass/logging/log.h>
 #include <multipass/name_generator.h>
+#include <multipass/native_mount.h>
 #include <multipass/network_interface.h>
 #include <multipass/platform.h>
 #include <multipass/query.h>
 #include <multipass/settings.h>
+#include <multipass/ssh/sftp_client.h>
 #include <multipass/ssh/ssh_session.h>
 #include <multipass/utils.h>
 #include <multipass/version.h>
@@ -45,27 +49,48 @@
 #include <multipass/vm_image_vault.h>
 
 #include <multipass/format.h>
+#include <multipass/instrumentation.h>
 #include <yaml-cpp/yaml.h>
 
+#include <google/protobuf/arena.h>
+
 #include <QDir>
 #include <QEventLoop>
+#include <QFile>
 #include <QFutureSynchronizer>
+#include <QHostAddress>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonParseError>
 #include <QRegularExpression>
+#include <QStorageInfo>
 #include <QString>
 #include <QSysInfo>
+#include <QThread>
+#include <QThreadPool>
 #include <QtConcurrent/QtConcurrent>
+#include <QtEndian>
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <functional>
 #include <stdexcept>
 #include <utility>
 #include <vector>
 
+#ifdef __linux__
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <linux/vm_sockets_diag.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 namespace mpu = multipass::utils;
@@ -83,6 +108,437 @@ constexpr auto uuid_file_name = "multipass-unique-id";
 constexpr auto metrics_opt_in_file = "multipassd-send-metrics.yaml";
 constexpr auto reboot_cmd = "sudo reboot";
 constexpr auto stop_ssh_cmd = "sudo systemctl stop ssh";
+// Once cloud-init is done, its state and the machine ID are dropped so that instances launched from a baked image are
+// set up as new machines, which only have to go through what the bake did not already do
+constexpr auto bake_preparation_cmd =
+    "sudo cloud-init status --wait > /dev/null; sudo cloud-init clean --logs --machine-id";
+constexpr auto default_info_timeout = std::chrono::seconds{10}; // for instances to answer info, unless asked otherwise
+constexpr auto max_concurrent_instance_operations = 8;
+constexpr auto max_concurrent_waits = 512;
+constexpr auto wait_thread_stack_size = 512u * 1024; // waiting threads only get as deep as an SSH exchange
+constexpr auto persist_instances_delay = std::chrono::milliseconds(100);
+// How long clients may keep replies for: images as long as their manifests are kept, host networks for a short while,
+// and the version for longer, since clients cache it per client version and the two are upgraded together
+constexpr auto find_reply_ttl = std::chrono::seconds{std::chrono::minutes{5}};
+constexpr auto networks_reply_ttl = std::chrono::seconds{30};
+constexpr auto version_reply_ttl = std::chrono::seconds{std::chrono::hours{1}};
+constexpr auto instance_probe_cmd =
+    "printf 'load=%s\\n' \"$(cut -d ' ' -f1-3 /proc/loadavg)\"; "
+    "free -b | awk 'NR == 2 {print \"memory_used=\" $3; print \"memory_total=\" $2}'; "
+    "df --output=used,size -B1 \"$(awk '$2 == \"/\" {print $1; exit}' /proc/mounts)\" | "
+    "awk 'NR == 2 {print \"disk_used=\" $1; print \"disk_total=\" $2}'; "
+    "printf 'release=%s\\n' \"$(lsb_release -ds 2>/dev/null)\"; "
+    "ip -brief -family inet address show scope global | awk '{sub(\"/.*\", \"\", $NF); print \"ipv4=\" $NF}'; "
+    "true";
+// The workload of bench_mount, run at a mount point in the instance. Prints one JSON object per operation, as each
+// one finishes: how many of it there were, the bytes they moved, the time they took in total and their latencies
+constexpr auto bench_mount_script = R"script(
+import json, os, random, shutil, sys, time
+
+root, size_mib = sys.argv[1], int(sys.argv[2])
+work = os.path.join(root, ".multipass-bench-{}".format(os.getpid()))
+block, page = bytes(1 << 20), bytes(4096)
+num_files = 2000
+
+def timed(op):
+    start = time.perf_counter()
+    op()
+    return time.perf_counter() - start
+
+def report(operation, latencies, num_bytes=0):
+    latencies.sort()
+    at = lambda q: latencies[min(len(latencies) - 1, int(q * len(latencies)))]
+    print(json.dumps({"operation": operation, "count": len(latencies), "bytes": num_bytes,
+                      "seconds": sum(latencies), "p50": at(0.5), "p99": at(0.99)}), flush=True)
+
+def drop_caches():  # so that reads go through the mount rather than to the page cache
+    os.system("sudo -n sysctl -q vm.drop_caches=3 >/dev/null 2>&1")
+
+os.mkdir(work)
+try:
+    path = os.path.join(work, "file")
+    with open(path, "wb", buffering=0) as f:
+        latencies = [timed(lambda: f.write(block)) for _ in range(size_mib)]
+        latencies[-1] += timed(lambda: os.fsync(f.fileno()))
+    report("seq_write", latencies, size_mib << 20)
+
+    drop_caches()
+    with open(path, "rb", buffering=0) as f:
+        latencies = [timed(lambda: f.read(len(block))) for _ in range(size_mib)]
+    report("seq_read", latencies, size_mib << 20)
+
+    offsets = [random.randrange(size_mib << 8) << 12 for _ in range(1000)]
+    drop_caches()
+    fd = os.open(path, os.O_RDONLY)
+    latencies = [timed(lambda: os.pread(fd, len(page), offset)) for offset in offsets]
+    os.close(fd)
+    report("rand_read_4k", latencies, len(page) * len(offsets))
+
+    fd = os.open(path, os.O_WRONLY)
+    latencies = [timed(lambda: os.pwrite(fd, page, offset)) for offset in offsets]
+    latencies[-1] += timed(lambda: os.fsync(fd))
+    os.close(fd)
+    report("rand_write_4k", latencies, len(page) * len(offsets))
+
+    names = [os.path.join(work, "f{}".format(i)) for i in range(num_files)]
+    report("create", [timed(lambda: os.close(os.open(name, os.O_CREAT | os.O_WRONLY, 0o644))) for name in names])
+    report("stat", [timed(lambda: os.stat(name)) for name in names])
+    report("readdir", [timed(lambda: list(os.scandir(work))) for _ in range(10)])
+    report("unlink", [timed(lambda: os.unlink(name)) for name in names])
+finally:
+    shutil.rmtree(work, ignore_errors=True)
+)script";
+constexpr std::size_t reply_arena_block_size = 256 * 1024;
+constexpr auto instances_shutdown_timeout = std::chrono::seconds{75}; // within systemd's default 90s to stop us
+constexpr auto idle_cpu_share = 0.05; // of one host core, which a guest doing nothing stays well under
+constexpr auto idle_resume_timeout = std::chrono::minutes{2};
+constexpr auto idle_resume_poll_interval = std::chrono::milliseconds{100};
+constexpr auto usage_history_recheck = std::chrono::minutes{1}; // for the interval being set, while it is not
+// Only while the guest is all but idle, and behind its other I/O. fstrim tells what it trimmed as "(<n> bytes)"
+constexpr auto guest_trim_cmd = "awk '{exit $1 >= 1}' /proc/loadavg && sudo ionice -c 3 fstrim --all --verbose";
+constexpr auto guest_trim_timeout = std::chrono::minutes{5};
+
+// Builds a reply with many nested messages on an arena, so that it takes a few large allocations rather than one
+// per field. The arena starts on a block this thread keeps from one reply of the type to the next, which covers all
+// but the largest fleets without allocating at all; a reply built while another one is still under way on the same
+// thread allocates afresh
+template <typename Reply>
+class ReplyArena
+{
+public:
+    ReplyArena() : arena{options()}, response{google::protobuf::Arena::CreateMessage<Reply>(&arena)}
+    {
+    }
+
+    ~ReplyArena()
+    {
+        if (owns_block)
+            block_in_use() = false;
+    }
+
+    Reply& reply()
+    {
+        return *response;
+    }
+
+private:
+    static bool& block_in_use()
+    {
+        thread_local bool in_use{false};
+        return in_use;
+    }
+
+    google::protobuf::ArenaOptions options()
+    {
+        google::protobuf::ArenaOptions options;
+        if (!block_in_use())
+        {
+            thread_local std::vector<char> block(reply_arena_block_size);
+            options.initial_block = block.data();
+            options.initial_block_size = block.size();
+            block_in_use() = owns_block = true;
+        }
+        return options;
+    }
+
+    bool owns_block{false};
+    google::protobuf::Arena arena;
+    Reply* response;
+};
+
+// The tag a native mount is shared under, unique to the instance and target so that it can be remounted there
+std::string native_mount_tag_for(const std::string& instance_name, const std::string& target_path)
+{
+    const auto hash = QCryptographicHash::hash(QByteArray::fromStdString(instance_name + ":" + target_path),
+                                               QCryptographicHash::Sha256);
+    return "mp" + hash.toHex().left(12).toStdString();
+}
+
+std::vector<mp::NativeMount> native_mounts_for(const std::string& instance_name,
+                                               const std::unordered_map<std::string, mp::VMMount>& mounts)
+{
+    // Nothing in the instance resolves "default" as sshfs_server does, so take the default user of Multipass images
+    const auto resolve_default_ids = [](std::unordered_map<int, int> id_map) {
+        for (auto& ids : id_map)
+            if (ids.second == mp::default_id)
+                ids.second = 1000;
+        return id_map;
+    };
+
+    std::vector<mp::NativeMount> native_mounts;
+    for (const auto& mount : mounts)
+    {
+        if (mount.second.type == mp::VMMount::Type::native)
+            native_mounts.push_back({mount.second.source_path, native_mount_tag_for(instance_name, mount.first),
+                                     resolve_default_ids(mount.second.uid_map),
+                                     resolve_default_ids(mount.second.gid_map)});
+    }
+
+    return native_mounts;
+}
+
+// Forwarded connections get through while the instance runs, or once it is resumed if it was suspended for being
+// idle; it is only looked up as they come, on the daemon's thread, which the instances are only asked about on
+mp::PortForwarder::AddressLookup address_lookup_for(QObject* daemon, const mp::VirtualMachine::ShPtr& vm,
+                                                    std::function<void()> resume)
+{
+    return [daemon, instance = std::weak_ptr<mp::VirtualMachine>{vm}, resume = std::move(resume)] {
+        resume(); // nothing to do unless it was suspended for being idle
+
+        auto address = std::make_shared<std::promise<std::string>>();
+        QMetaObject::invokeMethod(
+            daemon,
+            [instance, address] {
+                auto vm = instance.lock();
+                if (!vm || vm->current_state() != mp::VirtualMachine::State::running)
+                    return address->set_value(std::string{});
+
+                const auto ipv4 = vm->management_ipv4();
+                address->set_value(ipv4 == "UNKNOWN" ? std::string{} : ipv4);
+            },
+            Qt::QueuedConnection);
+
+        return address->get_future();
+    };
+}
+
+// Established connections in one of the kernel's TCP tables to a remote written the way it lists them
+int established_in(const QString& table, const QByteArray& remote)
+{
+    QFile tcp{table};
+    if (!tcp.open(QIODevice::ReadOnly))
+        return 0;
+
+    auto count{0};
+    tcp.readLine(); // the header
+    while (!tcp.atEnd())
+    {
+        const auto fields = tcp.readLine().simplified().split(' ');
+        if (fields.size() > 3 && fields[2] == remote && fields[3] == "01") // ESTABLISHED
+            ++count;
+    }
+
+    return count;
+}
+
+// Addresses are listed as the 32-bit words they are made of, each printed as the host would print the integer, and
+// ports in host order
+QByteArray tcp_table_entry(const quint8* address, int words, int port)
+{
+    QString entry;
+    for (auto i = 0; i < words; ++i)
+    {
+        quint32 word;
+        std::memcpy(&word, address + 4 * i, sizeof(word));
+        entry += QString{"%1"}.arg(word, 8, 16, QChar{'0'});
+    }
+
+    return QString{"%1:%2"}.arg(entry).arg(port, 4, 16, QChar{'0'}).toUpper().toLatin1();
+}
+
+// Established TCP connections from the host to the given address and port, from /proc/net/tcp and tcp6. IPv4
+// addresses show up in the latter too, mapped, from sockets open to both
+int host_tcp_connections_to(const QHostAddress& address, int port)
+{
+    bool is_ipv4{false};
+    const auto ipv4 = address.toIPv4Address(&is_ipv4);
+    const auto ipv6 = is_ipv4 ? QHostAddress{QHostAddress{ipv4}.toIPv6Address()} : address;
+
+    auto count = established_in("/proc/net/tcp6", tcp_table_entry(ipv6.toIPv6Address().c, 4, port));
+    if (is_ipv4)
+    {
+        const auto network_order = qToBigEndian(ipv4);
+        count += established_in("/proc/net/tcp", tcp_table_entry(reinterpret_cast<const quint8*>(&network_order),
+                                                                 1, port));
+    }
+
+    return count;
+}
+
+#ifdef __linux__
+// Established vsock connections to the given port of an instance, asked of the kernel's socket diagnostics
+mp::optional<int> established_vsock_connections(int diag_fd, unsigned cid, unsigned port)
+{
+    struct
+    {
+        nlmsghdr header;
+        vsock_diag_req request;
+    } message{};
+    message.header.nlmsg_len = sizeof(message);
+    message.header.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    message.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    message.request.sdiag_family = AF_VSOCK;
+    message.request.vdiag_states = 1u << TCP_ESTABLISHED;
+    if (::send(diag_fd, &message, sizeof(message), 0) < 0)
+        return mp::nullopt;
+
+    auto count{0};
+    alignas(nlmsghdr) char buffer[8192];
+    for (;;)
+    {
+        auto length = static_cast<int>(::recv(diag_fd, buffer, sizeof(buffer), 0));
+        if (length <= 0)
+            return mp::nullopt;
+
+        for (auto header = reinterpret_cast<nlmsghdr*>(buffer); NLMSG_OK(header, length);
+             header = NLMSG_NEXT(header, length))
+        {
+            if (header->nlmsg_type == NLMSG_DONE)
+                return count;
+            if (header->nlmsg_type == NLMSG_ERROR)
+                return mp::nullopt;
+
+            const auto socket = static_cast<const vsock_diag_msg*>(NLMSG_DATA(header));
+            if (socket->vdiag_dst_cid == cid && socket->vdiag_dst_port == port &&
+                socket->vdiag_state == TCP_ESTABLISHED)
+                ++count;
+        }
+    }
+}
+#endif
+
+// Established vsock connections from the host to the given port of an instance. Nothing when they cannot be listed,
+// such as without the vsock_diag module
+mp::optional<int> host_vsock_connections_to([[maybe_unused]] unsigned cid, [[maybe_unused]] unsigned port)
+{
+#ifdef __linux__
+    const auto diag_fd = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+    if (diag_fd < 0)
+        return mp::nullopt;
+
+    const auto count = established_vsock_connections(diag_fd, cid, port);
+    ::close(diag_fd);
+    return count;
+#else
+    return mp::nullopt;
+#endif
+}
+
+// Connections from the host to the instance's SSH server, over whichever it is reached by. Nothing when that cannot
+// be told
+mp::optional<int> host_connections_to(const std::string& host, int port)
+{
+    if (mp::SSHSession::is_vsock_host(host))
+        return host_vsock_connections_to(std::stoul(host.substr(host.find(':') + 1)), port);
+
+    QHostAddress address{QString::fromStdString(host)};
+    if (address.isNull())
+        return mp::nullopt;
+
+    return host_tcp_connections_to(address, port);
+}
+
+// Targets are given like sshfs ones: absolute, relative to the home directory, or starting with "~"
+std::string shell_target_path_for(const std::string& target_path)
+{
+    if (!target_path.empty() && target_path[0] == '~')
+        return "~" + mp::utils::escape_for_shell(target_path.substr(1));
+
+    return mp::utils::escape_for_shell(target_path);
+}
+
+long long trimmed_bytes(const std::string& fstrim_output)
+{
+    static const QRegularExpression bytes_regex{R"(\((\d+) bytes\))"};
+
+    long long total = 0;
+    auto matches = bytes_regex.globalMatch(QString::fromStdString(fstrim_output));
+    while (matches.hasNext())
+        total += matches.next().captured(1).toLongLong();
+
+    return total;
+}
+
+void run_for_native_mount(mp::SSHSession& session, const std::string& cmd)
+{
+    auto proc = session.exec(cmd);
+    if (proc.exit_code() != 0)
+    {
+        auto error = proc.read_std_error();
+        throw std::runtime_error(mp::utils::trim_end(error));
+    }
+}
+
+void mount_native_in(mp::SSHSession& session, const std::string& tag, const std::string& target_path)
+{
+    // Whichever of virtiofs and 9p the hypervisor could share it over
+    run_for_native_mount(session,
+                         fmt::format("T={0}; mkdir -p \"$T\" 2>/dev/null || sudo mkdir -p \"$T\"; "
+                                     "sudo mount -t virtiofs {1} \"$T\" 2>/dev/null || "
+                                     "sudo mount -t 9p -o trans=virtio,version=9p2000.L,msize=262144 {1} \"$T\"",
+                                     shell_target_path_for(target_path), tag));
+}
+
+void umount_native_in(mp::SSHSession& session, const std::string& target_path)
+{
+    run_for_native_mount(session, fmt::format("sudo umount {}", shell_target_path_for(target_path)));
+}
+
+// Installs multipass-sshfs from the host's copy of the snap, returning whether it got installed
+bool sideload_sshfs_in(const std::string& name, mp::SSHSession& session, mp::SFTPClient& sftp,
+                       mp::SSHFSSnapCache& snap_cache)
+{
+    const auto files = snap_cache.refresh();
+    if (!files)
+        return false;
+
+    const auto remote_dir = mp::utils::run_in_ssh_session(session, "mktemp -d");
+    if (remote_dir.empty())
+        return false;
+
+    try
+    {
+        const auto remote_snap = fmt::format("{}/multipass-sshfs.snap", remote_dir);
+        const auto remote_assertion = fmt::format("{}/multipass-sshfs.assert", remote_dir);
+        sftp.push_file(files->snap.toStdString(), remote_snap);
+        sftp.push_file(files->assertion.toStdString(), remote_assertion);
+
+        auto proc =
+            session.exec(fmt::format("sudo snap ack {} && sudo snap install {}", remote_assertion, remote_snap));
+        if (proc.exit_code(std::chrono::minutes(5)) != 0)
+            throw std::runtime_error(mp::utils::trim_end(proc.read_std_error()));
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::warning, category,
+                 fmt::format("Could not install the host's copy of multipass-sshfs in '{}': {}", name, e.what()));
+        snap_cache.discard(); // most likely broken, so the next instance gets a fresh download
+
+        mp::utils::run_in_ssh_session(session, fmt::format("rm -rf {}", remote_dir));
+        return false;
+    }
+
+    mp::utils::run_in_ssh_session(session, fmt::format("rm -rf {}", remote_dir));
+    return true;
+}
+
+// Gets sshfs into an instance, from the host's copy of the snap when possible, so that the store is reached once per
+// host rather than once per instance. The instance installs from the store itself otherwise.
+void install_sshfs_in(const std::string& name, mp::VirtualMachine& vm, const std::string& username,
+                      mp::SSHSession& session, const mp::SSHKeyProvider& key_provider,
+                      mp::SSHFSSnapCache& snap_cache)
+{
+    try
+    {
+        mp::SFTPClient sftp{vm.ssh_hostname(), vm.ssh_port(), username, key_provider.private_key_as_base64()};
+        if (sideload_sshfs_in(name, session, sftp, snap_cache))
+            return;
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::warning, category,
+                 fmt::format("Could not sideload multipass-sshfs in '{}': {}", name, e.what()));
+    }
+
+    mp::utils::install_sshfs_for(name, session);
+}
+
+struct MountAttempt
+{
+    bool sshfs_missing{false};
+    std::string error; // empty once the mount is served
+};
+
 const std::string sshfs_error_template = "Error enabling mount support in '{}'"
                                          "\n\nPlease install the 'multipass-sshfs' snap manually inside the instance.";
 const std::unordered_set<std::string> no_bridging_images = {
@@ -110,10 +566,19 @@ mp::Query query_from(const mp::LaunchRequest* request, const std::string& name)
     return {name, image, false, request->remote_name(), query_type, true};
 }
 
+std::string public_key_type_of(const mp::SSHKeyProvider& key_provider)
+{
+    auto key = key_provider.private_key();
+    auto type = key ? ssh_key_type_to_char(ssh_key_type(key)) : nullptr;
+    return type ? type : "ssh-rsa";
+}
+
 auto make_cloud_init_vendor_config(const mp::SSHKeyProvider& key_provider, const std::string& time_zone,
-                                   const std::string& username, const std::string& backend_version_string)
+                                   const std::string& username, const std::string& backend_version_string,
+                                   const std::string& package_cache_host)
 {
-    auto ssh_key_line = fmt::format("ssh-rsa {} {}@localhost", key_provider.public_key_as_base64(), username);
+    auto ssh_key_line = fmt::format("{} {} {}@localhost", public_key_type_of(key_provider),
+                                    key_provider.public_key_as_base64(), username);
 
     auto config = YAML::Load(mp::base_cloud_init_config);
     config["ssh_authorized_keys"].push_back(ssh_key_line);
@@ -132,6 +597,59 @@ auto make_cloud_init_vendor_config(const mp::SSHKeyProvider& key_provider, const
 
     config["write_files"].push_back(pollinate_user_agent_node);
 
+    // Lets backends with a vsock device reach sshd before, and regardless of, the instance's network. The units get
+    // written late in the first boot, so they only speed up the boots that follow
+    YAML::Node vsock_socket_node;
+    vsock_socket_node["path"] = "/etc/systemd/system/multipass-ssh-vsock.socket";
+    vsock_socket_node["content"] = "# written by Multipass\n"
+                                   "[Unit]\n"
+                                   "ConditionPathExists=/dev/vsock\n"
+                                   "[Socket]\n"
+                                   "ListenStream=vsock::22\n"
+                                   "Accept=yes\n"
+                                   "[Install]\n"
+                                   "WantedBy=sockets.target\n";
+    YAML::Node vsock_service_node;
+    vsock_service_node["path"] = "/etc/systemd/system/multipass-ssh-vsock@.service";
+    vsock_service_node["content"] = "# written by Multipass\n"
+                                    "[Service]\n"
+                                    "ExecStart=-/usr/sbin/sshd -i\n"
+                                    "RuntimeDirectory=sshd\n"
+                                    "RuntimeDirectoryPreserve=yes\n"
+                                    "StandardInput=socket\n";
+
+    config["write_files"].push_back(vsock_socket_node);
+    config["write_files"].push_back(vsock_service_node);
+    config["runcmd"].push_back("systemctl enable --now multipass-ssh-vsock.socket || true");
+
+    // apt asks the script which proxy to use on every run, so it goes straight to the mirrors, rather than fail,
+    // while the host's package cache is off or out of reach
+    if (!package_cache_host.empty())
+    {
+        const auto proxy_script = "/usr/local/lib/multipass/package-proxy";
+
+        YAML::Node apt_proxy_node;
+        apt_proxy_node["path"] = "/etc/apt/apt.conf.d/90multipass-package-cache";
+        apt_proxy_node["content"] =
+            fmt::format("// written by Multipass\nAcquire::http::Proxy-Auto-Detect \"{}\";\n", proxy_script);
+
+        YAML::Node proxy_script_node;
+        proxy_script_node["path"] = proxy_script;
+        proxy_script_node["permissions"] = "0755";
+        proxy_script_node["content"] =
+            fmt::format("#!/bin/sh\n"
+                        "# written by Multipass\n"
+                        "if timeout 2 bash -c 'exec 3<>/dev/tcp/{0}/{1}' 2>/dev/null; then\n"
+                        "    echo http://{0}:{1}\n"
+                        "else\n"
+                        "    echo DIRECT\n"
+                        "fi\n",
+                        package_cache_host, mp::package_cache_port);
+
+        config["write_files"].push_back(apt_proxy_node);
+        config["write_files"].push_back(proxy_script_node);
+    }
+
     return config;
 }
 
@@ -178,6 +696,53 @@ auto make_cloud_init_network_config(const std::string default_mac_addr,
     return network_data;
 }
 
+// A copied disk comes with its source's machine-id, which networkd derives its DHCP client identifier from. The clone
+// leases by MAC address instead, so that it does not get the source's address, and makes a machine-id of its own
+auto make_cloud_init_clone_network_config(const std::string& default_mac_addr,
+                                          const std::vector<mp::NetworkInterface>& extra_interfaces)
+{
+    auto network_data = make_cloud_init_network_config(default_mac_addr, extra_interfaces);
+
+    network_data["version"] = "2";
+    network_data["ethernets"]["default"]["match"]["macaddress"] = default_mac_addr;
+    network_data["ethernets"]["default"]["dhcp4"] = true;
+    network_data["ethernets"]["default"]["dhcp-identifier"] = "mac";
+
+    return network_data;
+}
+
+auto make_cloud_init_clone_user_config()
+{
+    YAML::Node user_data;
+    user_data["bootcmd"].push_back("cloud-init-per instance multipass-machine-id sh -c "
+                                   "'rm -f /etc/machine-id /var/lib/dbus/machine-id && systemd-machine-id-setup'");
+
+    return user_data;
+}
+
+// What create_vm() works out for an instance's networking while its image is fetched
+struct PreparedNetworking
+{
+    std::unordered_set<std::string> new_macs; // those this instance needs, should everything go well
+    std::string default_mac_address;
+    std::vector<mp::NetworkInterface> extra_interfaces;
+    YAML::Node network_data_config;
+    std::exception_ptr error;
+};
+
+// The instances of one create_vm() call, which are prepared side by side and brought up together
+struct CreateBatch
+{
+    CreateBatch(const void* server, std::size_t remaining) : remaining{remaining}, shared_stream{server}
+    {
+    }
+
+    std::size_t remaining;
+    std::vector<std::string> ready; // created, and started when launching
+    std::vector<std::string> errors;
+    mpl::SharedClientStream shared_stream; // instances are prepared and waited for in threads of their own
+};
+
 void prepare_user_data(YAML::Node& user_data_config, YAML::Node& vendor_config)
 {
     auto users = user_data_config["users"];
@@ -189,9 +754,8 @@ void prepare_user_data(YAML::Node& user_data_config, YAML::Node& vendor_config)
         keys.push_back(vendor_config["ssh_authorized_keys"][0]);
 }
 
-template <typename T>
-auto name_from(const std::string& requested_name, const std::string& workflow_name, mp::NameGenerator& name_gen,
-               const T& currently_used_names)
+std::string name_from(const std::string& requested_name, const std::string& workflow_name,
+                      mp::NameGenerator& name_gen, const mp::NameGenerator::NameFilter& is_taken)
 {
     if (!requested_name.empty())
     {
@@ -203,15 +767,7 @@ auto name_from(const std::string& requested_name, const std::string& workflow_na
     }
     else
     {
-        auto name = name_gen.make_name();
-        constexpr int num_retries = 100;
-        for (int i = 0; i < num_retries; i++)
-        {
-            if (currently_used_names.find(name) != currently_used_names.end())
-                continue;
-            return name;
-        }
-        throw std::runtime_error("unable to generate a unique name");
+        return name_gen.make_unique_name(is_taken);
     }
 }
 
@@ -238,29 +794,52 @@ std::vector<mp::NetworkInterface> read_extra_interfaces(const QJsonObject& recor
     return extra_interfaces;
 }
 
-std::unordered_map<std::string, mp::VMSpecs> load_db(const mp::Path& data_path, const mp::Path& cache_path)
+mp::IoLimits read_io_limits(const QJsonObject& record)
+{
+    const auto limits = record["io_limits"].toObject();
+    auto read = [&limits](const char* key) { return static_cast<long long>(limits[key].toDouble()); };
+
+    return {read("disk_iops"), read("disk_iops_burst"), read("disk_bytes_per_second"), read("disk_bytes_burst"),
+            read("network_bytes_per_second")};
+}
+
+std::map<std::pair<std::string, int>, int> read_port_forwards(const QJsonObject& record)
+{
+    std::map<std::pair<std::string, int>, int> forwards;
+    for (QJsonValueRef entry : record["port_forwards"].toArray())
+    {
+        // Those made before forwards were only on loopback by default have no address
+        const auto forward = entry.toObject();
+        const auto host_address = forward["host_address"].toString().toStdString();
+        forwards[{host_address.empty() ? mp::default_forward_address : host_address, forward["host_port"].toInt()}] =
+            forward["instance_port"].toInt();
+    }
+
+    return forwards;
+}
+
+std::unordered_map<std::string, mp::VMSpecs> load_db(const mp::JsonJournal& journal, const mp::Path& cache_path)
 {
-    QDir data_dir{data_path};
-    QDir cache_dir{cache_path};
-    QFile db_file{data_dir.filePath(instance_db_name)};
-    if (!db_file.open(QIODevice::ReadOnly))
+    auto records = journal.records();
+    if (records.isEmpty())
     {
         // Try to open the old location
-        db_file.setFileName(cache_dir.filePath(instance_db_name));
+        QFile db_file{QDir{cache_path}.filePath(instance_db_name)};
         if (!db_file.open(QIODevice::ReadOnly))
             return {};
-    }
 
-    QJsonParseError parse_error;
-    auto doc = QJsonDocument::fromJson(db_file.readAll(), &parse_error);
-    if (doc.isNull())
-        return {};
+        QJsonParseError parse_error;
+        auto doc = QJsonDocument::fromJson(db_file.readAll(), &parse_error);
+        if (doc.isNull())
+            return {};
 
-    auto records = doc.object();
-    if (records.isEmpty())
-        return {};
+        records = doc.object();
+        if (records.isEmpty())
+            return {};
+    }
 
     std::unordered_map<std::string, mp::VMSpecs> reconstructed_records;
+    reconstructed_records.reserve(records.size());
     for (auto it = records.constBegin(); it != records.constEnd(); ++it)
     {
         auto key = it.key().toStdString();
@@ -275,6 +854,7 @@ std::unordered_map<std::string, mp::VMSpecs> load_db(const mp::Path& data_path,
         auto state = record["state"].toInt();
         auto deleted = record["deleted"].toBool();
         auto metadata = record["metadata"].toObject();
+        auto storage_profile = record["storage_profile"].toString(mp::default_storage_profile).toStdString();
 
         if (!num_cores && !deleted && ssh_username.empty() && metadata.isEmpty() &&
             !mp::MemorySize{mem_size}.in_bytes() && !mp::MemorySize{disk_space}.in_bytes())
@@ -294,11 +874,11 @@ std::unordered_map<std::string, mp::VMSpecs> load_db(const mp::Path& data_path,
         }
 
         std::unordered_map<std::string, mp::VMMount> mounts;
-        std::unordered_map<int, int> uid_map;
-        std::unordered_map<int, int> gid_map;
-
         for (QJsonValueRef entry : record["mounts"].toArray())
         {
+            // Each mount has maps of its own, rather than carrying over those of the mounts before it
+            std::unordered_map<int, int> uid_map;
+            std::unordered_map<int, int> gid_map;
             auto target_path = entry.toObject()["target_path"].toString().toStdString();
             auto source_path = entry.toObject()["source_path"].toString().toStdString();
 
@@ -312,8 +892,13 @@ std::unordered_map<std::string, mp::VMSpecs> load_db(const mp::Path& data_path,
                 gid_map[gid_entry.toObject()["host_gid"].toInt()] = gid_entry.toObject()["instance_gid"].toInt();
             }
 
-            mp::VMMount mount{source_path, gid_map, uid_map};
-            mounts[target_path] = mount;
+            const auto type = entry.toObject()["mount_type"].toString() == "native" ? mp::VMMount::Type::native
+                                                                                     : mp::VMMount::Type::classic;
+
+            auto compression = entry.toObject()["compression"].toString().toStdString();
+
+            mounts[target_path] = {std::move(source_path), std::move(gid_map), std::move(uid_map), type,
+                                   std::move(compression)};
         }
 
         reconstructed_records[key] = {num_cores,
@@ -323,13 +908,40 @@ std::unordered_map<std::string, mp::VMSpecs> load_db(const mp::Path& data_path,
                                       read_extra_interfaces(record),
                                       ssh_username,
                                       static_cast<mp::VirtualMachine::State>(state),
-                                      mounts,
+                                      std::move(mounts),
                                       deleted,
-                                      metadata};
+                                      std::move(metadata),
+                                      std::move(storage_profile),
+                                      read_io_limits(record),
+                                      read_port_forwards(record)};
     }
     return reconstructed_records;
 }
 
+// The fields of a reply entry a request asked for, all of them when it named none. The name and status of an instance
+// cost nothing and are always there
+class RequestedFields
+{
+public:
+    RequestedFields(const google::protobuf::RepeatedPtrField<std::string>& fields,
+                    const google::protobuf::Descriptor& entry)
+        : fields{fields.begin(), fields.end()}
+    {
+        for (const auto& field : this->fields)
+            if (!entry.FindFieldByName(field))
+                throw std::invalid_argument(fmt::format("unknown field \"{}\" requested", field));
+    }
+
+    template <typename... Names>
+    bool any_of(const Names&... names) const
+    {
+        return fields.empty() || (fields.count(names) || ...);
+    }
+
+private:
+    const std::unordered_set<std::string> fields;
+};
+
 auto fetch_image_for(const std::string& name, const mp::FetchType& fetch_type, mp::VMImageVault& vault)
 {
     auto stub_prepare = [](const mp::VMImage&) -> mp::VMImage { return {}; };
@@ -340,6 +952,32 @@ auto fetch_image_for(const std::string& name, const mp::FetchType& fetch_type, m
     return vault.fetch_image(fetch_type, query, stub_prepare, stub_progress);
 }
 
+// What a clone resumed off another instance's memory runs to stop passing for it: the hostname, machine-id and SSH
+// host keys are made anew, and the NICs take the clone's MAC addresses, with netplan following suit for new leases
+std::string identity_regeneration_script(const std::string& name,
+                                         const std::vector<std::pair<std::string, std::string>>& mac_changes)
+{
+    fmt::memory_buffer script;
+    fmt::format_to(script, "set -e\n"
+                           "hostnamectl set-hostname {}\n"
+                           "rm -f /etc/machine-id /var/lib/dbus/machine-id\n"
+                           "systemd-machine-id-setup\n"
+                           "rm -f /etc/ssh/ssh_host_*\n"
+                           "ssh-keygen -A\n"
+                           "systemctl restart ssh || true\n",
+                   name);
+    for (const auto& change : mac_changes)
+        fmt::format_to(script,
+                       "sed -i 's/{0}/{1}/gI' /etc/netplan/*.yaml || true\n"
+                       "for dev in /sys/class/net/*; do\n"
+                       "  if [ \"$(cat \"$dev/address\")\" = {0} ]; then ip link set dev \"${{dev##*/}}\" address {1}; fi\n"
+                       "done\n",
+                       change.first, change.second);
+    fmt::format_to(script, "netplan apply\n");
+
+    return fmt::to_string(script);
+}
+
 auto try_mem_size(const std::string& val) -> mp::optional<mp::MemorySize>
 {
     try
@@ -431,6 +1069,23 @@ std::vector<mp::NetworkInterface> validate_extra_interfaces(const mp::LaunchRequ
     return interfaces;
 }
 
+mp::IoLimits io_limits_from(const mp::IoLimitOptions& options)
+{
+    return {options.disk_iops(), options.disk_iops_burst(), options.disk_bytes_per_second(), options.disk_bytes_burst(),
+            options.network_bytes_per_second()};
+}
+
+mp::IoLimitOptions io_limit_options_from(const mp::IoLimits& limits)
+{
+    mp::IoLimitOptions options;
+    options.set_disk_iops(limits.disk_iops);
+    options.set_disk_iops_burst(limits.disk_iops_burst);
+    options.set_disk_bytes_per_second(limits.disk_bytes_per_second);
+    options.set_disk_bytes_burst(limits.disk_bytes_burst);
+    options.set_network_bytes_per_second(limits.network_bytes_per_second);
+    return options;
+}
+
 auto validate_create_arguments(const mp::LaunchRequest* request, const mp::VirtualMachineFactory& factory)
 {
     static const auto min_mem = try_mem_size(mp::min_memory_size);
@@ -469,6 +1124,17 @@ auto validate_create_arguments(const mp::LaunchRequest* request, const mp::Virtu
     if (!request->instance_name().empty() && !mp::utils::valid_hostname(request->instance_name()))
         option_errors.add_error_codes(mp::LaunchError::INVALID_HOSTNAME);
 
+    auto storage_profile =
+        request->storage_profile().empty() ? mp::default_storage_profile : request->storage_profile();
+    if (storage_profile != mp::default_storage_profile && storage_profile != mp::performance_storage_profile)
+        option_errors.add_error_codes(mp::LaunchError::INVALID_STORAGE_PROFILE);
+
+    const auto io_limits = io_limits_from(request->io_limits());
+    if (!io_limits.valid())
+        option_errors.add_error_codes(mp::LaunchError::INVALID_IO_LIMITS);
+    else if (!factory.can_limit_io(io_limits))
+        option_errors.add_error_codes(mp::LaunchError::UNSUPPORTED_IO_LIMITS);
+
     std::vector<std::string> nets_need_bridging;
     auto extra_interfaces = validate_extra_interfaces(request, factory, nets_need_bridging, option_errors);
 
@@ -479,12 +1145,16 @@ auto validate_create_arguments(const mp::LaunchRequest* request, const mp::Virtu
         std::string instance_name;
         std::vector<mp::NetworkInterface> extra_interfaces;
         std::vector<std::string> nets_need_bridging;
+        std::string storage_profile;
+        mp::IoLimits io_limits;
         mp::LaunchError option_errors;
     } ret{mem_size,
           disk_space,
           std::move(instance_name),
           std::move(extra_interfaces),
           std::move(nets_need_bridging),
+          std::move(storage_profile),
+          io_limits,
           std::move(option_errors)};
     return ret;
 }
@@ -573,25 +1243,38 @@ auto get_metrics_opt_in(const mp::Path& data_path)
     return opt_in_data;
 }
 
+// Read-only RPCs are served straight from the gRPC threads, so that a slow one does not hold up the others; the rest
+// are queued to the main thread
 auto connect_rpc(mp::DaemonRpc& rpc, mp::Daemon& daemon)
 {
     QObject::connect(&rpc, &mp::DaemonRpc::on_create, &daemon, &mp::Daemon::create);
     QObject::connect(&rpc, &mp::DaemonRpc::on_launch, &daemon, &mp::Daemon::launch);
     QObject::connect(&rpc, &mp::DaemonRpc::on_purge, &daemon, &mp::Daemon::purge);
-    QObject::connect(&rpc, &mp::DaemonRpc::on_find, &daemon, &mp::Daemon::find);
-    QObject::connect(&rpc, &mp::DaemonRpc::on_info, &daemon, &mp::Daemon::info);
-    QObject::connect(&rpc, &mp::DaemonRpc::on_list, &daemon, &mp::Daemon::list);
-    QObject::connect(&rpc, &mp::DaemonRpc::on_networks, &daemon, &mp::Daemon::networks);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_find, &daemon, &mp::Daemon::find, Qt::DirectConnection);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_info, &daemon, &mp::Daemon::info, Qt::DirectConnection);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_list, &daemon, &mp::Daemon::list, Qt::DirectConnection);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_networks, &daemon, &mp::Daemon::networks, Qt::DirectConnection);
     QObject::connect(&rpc, &mp::DaemonRpc::on_mount, &daemon, &mp::Daemon::mount);
     QObject::connect(&rpc, &mp::DaemonRpc::on_recover, &daemon, &mp::Daemon::recover);
-    QObject::connect(&rpc, &mp::DaemonRpc::on_ssh_info, &daemon, &mp::Daemon::ssh_info);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_ssh_info, &daemon, &mp::Daemon::ssh_info, Qt::DirectConnection);
     QObject::connect(&rpc, &mp::DaemonRpc::on_start, &daemon, &mp::Daemon::start);
     QObject::connect(&rpc, &mp::DaemonRpc::on_stop, &daemon, &mp::Daemon::stop);
     QObject::connect(&rpc, &mp::DaemonRpc::on_suspend, &daemon, &mp::Daemon::suspend);
     QObject::connect(&rpc, &mp::DaemonRpc::on_restart, &daemon, &mp::Daemon::restart);
     QObject::connect(&rpc, &mp::DaemonRpc::on_delete, &daemon, &mp::Daemon::delet);
     QObject::connect(&rpc, &mp::DaemonRpc::on_umount, &daemon, &mp::Daemon::umount);
-    QObject::connect(&rpc, &mp::DaemonRpc::on_version, &daemon, &mp::Daemon::version);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_version, &daemon, &mp::Daemon::version, Qt::DirectConnection);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_watch, &daemon, &mp::Daemon::watch, Qt::DirectConnection);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_unwatch, &daemon, &mp::Daemon::unwatch, Qt::DirectConnection);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_bake, &daemon, &mp::Daemon::bake);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_stats, &daemon, &mp::Daemon::stats, Qt::DirectConnection);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_bench_mount, &daemon, &mp::Daemon::bench_mount);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_throttle, &daemon, &mp::Daemon::throttle);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_clone, &daemon, &mp::Daemon::clone);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_forward, &daemon, &mp::Daemon::forward);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_capacity, &daemon, &mp::Daemon::capacity);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_copy_files, &daemon, &mp::Daemon::copy_files, Qt::DirectConnection);
+    QObject::connect(&rpc, &mp::DaemonRpc::on_resize, &daemon, &mp::Daemon::resize);
 }
 
 template <typename Instances, typename InstanceMap, typename InstanceCheck>
@@ -704,6 +1387,33 @@ grpc::Status ssh_reboot(const std::string& hostname, int port, const std::string
     return grpc::Status::OK;
 }
 
+bool needs_stopping(mp::VirtualMachine::State state)
+{
+    using St = mp::VirtualMachine::State;
+    const auto skip_states = {St::off, St::stopped, St::suspended};
+
+    return std::none_of(cbegin(skip_states), cend(skip_states), [&state](const auto& st) { return state == st; });
+}
+
+// Used to warn the users of an instance about its shutdown, which goes ahead regardless when this fails
+mp::optional<mp::SSHSession> shutdown_session_for(mp::VirtualMachine& vm, mp::VirtualMachine::State state,
+                                                  const mp::SSHKeyProvider& key_provider)
+{
+    if (!needs_stopping(state))
+        return mp::nullopt;
+
+    try
+    {
+        return mp::SSHSession{vm.ssh_hostname(), vm.ssh_port(), vm.ssh_username(), key_provider};
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::info, category,
+                 fmt::format("Cannot open ssh session on \"{}\" shutdown: {}", vm.vm_name, e.what()));
+        return mp::nullopt;
+    }
+}
+
 mp::InstanceStatus::Status grpc_instance_status_for(const mp::VirtualMachine::State& state)
 {
     switch (state)
@@ -788,29 +1498,53 @@ std::unordered_set<std::string> mac_set_from(const mp::VMSpecs& spec)
     return macs;
 }
 
+// Whether none of the (few) addresses in t is in the (large) set s. Only t is walked, so this does not grow with s.
+bool disjoint(const std::unordered_set<std::string>& s, const std::unordered_set<std::string>& t)
+{
+    return none_of(cbegin(t), cend(t), [&s](const auto& mac) { return s.find(mac) != cend(s); });
+}
+
 // Merge the contents of t into s, iff the sets are disjoint (i.e. make s = sUt). Return whether s and t were disjoint.
 bool merge_if_disjoint(std::unordered_set<std::string>& s, const std::unordered_set<std::string>& t)
 {
-    if (any_of(cbegin(s), cend(s), [&t](const auto& mac) { return t.find(mac) != cend(t); }))
+    if (!disjoint(s, t))
         return false;
 
     s.insert(cbegin(t), cend(t));
     return true;
 }
 
-// Generate a MAC address which does not exist in the set s. Then add the address to s.
-std::string generate_unused_mac_address(std::unordered_set<std::string>& s)
+// Names the launch phase that a progress report of the given type belongs to
+const char* launch_phase_for(int progress_type)
+{
+    switch (progress_type)
+    {
+    case mp::LaunchProgress::EXTRACT:
+        return "extract";
+    case mp::LaunchProgress::VERIFY:
+        return "verify";
+    case mp::LaunchProgress::WAITING:
+        return "wait_for_image";
+    default:
+        return "download";
+    }
+}
+
+// Generate a MAC address which exists neither in the set in_use nor in the set taken. Then add the address to taken.
+std::string generate_unused_mac_address(const std::unordered_set<std::string>& in_use,
+                                        std::unordered_set<std::string>& taken)
 {
     // TODO: Checking in our list of MAC addresses does not suffice to conclude the generated MAC is unique. We
     // should also check in the ARP table.
     static constexpr auto max_tries = 5;
     for (auto i = 0; i < max_tries; ++i)
-        if (auto [it, success] = s.insert(mp::utils::generate_mac_address()); success)
-            return *it;
+        if (auto mac = mp::utils::generate_mac_address(); in_use.find(mac) == cend(in_use))
+            if (auto [it, success] = taken.insert(std::move(mac)); success)
+                return *it;
 
     throw std::runtime_error{
         fmt::format("Failed to generate an unique mac address after {} attempts. Number of mac addresses in use: {}",
-                    max_tries, s.size())};
+                    max_tries, in_use.size() + taken.size())};
 }
 
 bool is_ipv4_valid(const std::string& ipv4)
@@ -827,6 +1561,78 @@ bool is_ipv4_valid(const std::string& ipv4)
     return true;
 }
 
+// Gathers the details that only the instance itself knows; may run for several instances at once
+void probe_running_instance(mp::VirtualMachine& vm, const std::string& ssh_username, mp::SSHSessionPool& ssh_sessions,
+                            const std::string& original_release, std::chrono::steady_clock::time_point deadline,
+                            mp::InfoReply::Info& info)
+{
+    auto remaining = [deadline] {
+        const auto left = deadline - std::chrono::steady_clock::now();
+        return std::max(std::chrono::duration_cast<std::chrono::milliseconds>(left), std::chrono::milliseconds{1});
+    };
+
+    auto session =
+        ssh_sessions.acquire(vm.vm_name, vm.ssh_hostname(remaining()), vm.ssh_port(), ssh_username, remaining());
+
+    // One round-trip for everything, answering in "key=value" lines
+    std::unordered_map<std::string, std::string> values;
+    std::vector<std::string> all_ipv4;
+    for (const auto& line : mp::utils::split(mpu::run_in_ssh_session(*session, instance_probe_cmd, remaining()), "\n"))
+    {
+        const auto separator = line.find('=');
+        if (separator == std::string::npos)
+            continue;
+
+        auto key = line.substr(0, separator);
+        auto value = line.substr(separator + 1);
+        if (key == "ipv4")
+            all_ipv4.push_back(std::move(value));
+        else
+            values[key] = std::move(value);
+    }
+
+    // What the hypervisor measured takes precedence over what the instance said
+    const auto metrics = vm.metrics();
+    auto measured_or_probed = [&values](const mp::optional<long long>& measured, const std::string& key) {
+        return measured ? std::to_string(*measured) : values[key];
+    };
+
+    info.set_load(values["load"]);
+    info.set_memory_usage(measured_or_probed(metrics.memory_used, "memory_used"));
+    info.set_memory_total(measured_or_probed(metrics.memory_total, "memory_total"));
+    info.set_disk_usage(measured_or_probed(metrics.disk_used, "disk_used"));
+    info.set_disk_total(measured_or_probed(metrics.disk_total, "disk_total"));
+
+    std::string management_ip = vm.management_ipv4();
+
+    if (is_ipv4_valid(management_ip))
+        info.add_ipv4(management_ip);
+    else if (all_ipv4.empty())
+        info.add_ipv4("N/A");
+
+    for (const auto& extra_ipv4 : all_ipv4)
+        if (extra_ipv4 != management_ip)
+            info.add_ipv4(extra_ipv4);
+
+    const auto& current_release = values["release"];
+    info.set_current_release(!current_release.empty() ? current_release : original_release);
+}
+
+// What a probe found, kept apart from the reply, which the probe may outlive when the instance does not answer in time
+struct ProbeOutcome
+{
+    mp::InfoReply::Info info;
+    std::exception_ptr error;
+    bool done{false};
+};
+
+struct ProbeBatch
+{
+    std::mutex mutex; // guards the outcomes too
+    std::condition_variable cv;
+    std::size_t pending{0};
+};
+
 void add_aliases(mp::FindReply& response, const std::string& remote_name, const mp::VMImageInfo& info,
                  const std::string& default_remote)
 {
@@ -860,21 +1666,57 @@ auto timeout_for(const int requested_timeout, const int workflow_timeout)
     return mp::default_timeout;
 }
 
-} // namespace
+constexpr auto admission_retry_interval = std::chrono::seconds{2};
 
-mp::Daemon::Daemon(std::unique_ptr<const DaemonConfig> the_config)
-    : config{std::move(the_config)},
-      vm_instance_specs{load_db(
-          mp::utils::backend_directory_path(config->data_directory, config->factory->get_backend_directory_name()),
-          mp::utils::backend_directory_path(config->cache_directory, config->factory->get_backend_directory_name()))},
-      daemon_rpc{config->server_address, config->connection_type, *config->cert_provider, *config->client_cert_store},
-      metrics_provider{"https://api.jujucharms.com/omnibus/v4/multipass/metrics", get_unique_id(config->data_directory),
-                       config->data_directory},
-      metrics_opt_in{get_metrics_opt_in(config->data_directory)},
-      instance_mounts{*config->ssh_key_provider}
+std::string queue_message(std::size_t position)
 {
-    connect_rpc(daemon_rpc, *this);
-    std::vector<std::string> invalid_specs;
+    return fmt::format("Waiting for room on the host, number {} in the queue", position);
+}
+
+mp::AdmissionPolicy::Load load_of(const mp::VMSpecs& specs)
+{
+    return {specs.num_cores, specs.mem_size.in_bytes()};
+}
+
+// Counts the page cache as free, like the kernel does, for it is given up under pressure
+qint64 memory_available()
+{
+    QFile meminfo{"/proc/meminfo"};
+    if (!meminfo.open(QIODevice::ReadOnly | QIODevice::Text))
+        return 0;
+
+    for (auto line = meminfo.readLine(); !line.isEmpty(); line = meminfo.readLine())
+        if (line.startsWith("MemAvailable:"))
+            return line.mid(13).trimmed().split(' ').first().toLongLong() * 1024; // in kB
+
+    return 0;
+}
+
+} // namespace
+
+mp::Daemon::Daemon(std::unique_ptr<const DaemonConfig> the_config)
+    : config{std::move(the_config)},
+      instances_journal{QDir{mp::utils::backend_directory_path(config->data_directory,
+                                                               config->factory->get_backend_directory_name())}
+                            .filePath(instance_db_name)},
+      vm_instance_specs{load_db(
+          instances_journal,
+          mp::utils::backend_directory_path(config->cache_directory, config->factory->get_backend_directory_name()))},
+      daemon_rpc{config->server_address, config->connection_type, *config->cert_provider, *config->client_cert_store},
+      metrics_provider{"https://api.jujucharms.com/omnibus/v4/multipass/metrics", get_unique_id(config->data_directory),
+                       config->data_directory},
+      metrics_opt_in{get_metrics_opt_in(config->data_directory)},
+      instance_mounts{*config->ssh_key_provider},
+      ssh_sessions{*config->ssh_key_provider},
+      sshfs_snap_cache{QDir{config->cache_directory}.filePath("snaps")}
+{
+    wait_pool.setMaxThreadCount(max_concurrent_waits);
+    wait_pool.setStackSize(wait_thread_stack_size);
+    connect_rpc(daemon_rpc, *this);
+    vm_instances.reserve(vm_instance_specs.size());
+    std::vector<std::string> invalid_specs;
+    const auto instance_records = instances_journal.records();
+    std::unique_lock<decltype(instances_mutex)> lock{instances_mutex};
 
     for (auto& entry : vm_instance_specs)
     {
@@ -892,7 +1734,7 @@ mp::Daemon::Daemon(std::unique_ptr<const DaemonConfig> the_config)
         // only if this instance is not invalid.
         auto new_macs = mac_set_from(spec);
 
-        if (new_macs.size() <= spec.extra_interfaces.size() || !merge_if_disjoint(new_macs, allocated_mac_addrs))
+        if (new_macs.size() <= spec.extra_interfaces.size() || !disjoint(allocated_mac_addrs, new_macs))
         {
             // There is at least one repeated address in new_macs.
             mpl::log(mpl::Level::warning, category, fmt::format("{} has repeated MAC addresses", name));
@@ -923,12 +1765,20 @@ mp::Daemon::Daemon(std::unique_ptr<const DaemonConfig> the_config)
                                               {},
                                               {},
                                               {},
-                                              {}};
+                                              {},
+                                              spec.storage_profile,
+                                              spec.io_limits};
 
-        auto& instance_record = spec.deleted ? deleted_instances : vm_instances;
-        instance_record[name] = config->factory->create_virtual_machine(vm_desc, *this);
+        // Bringing the instance up takes the hypervisor, so it is left for the event loop, in between requests
+        warming_instances.emplace(name, std::move(vm_desc));
 
-        allocated_mac_addrs = std::move(new_macs); // Add the new macs to the daemon's list only if we got this far
+        // Add the new macs to the daemon's list only if we got this far
+        allocated_mac_addrs.insert(std::make_move_iterator(begin(new_macs)), std::make_move_iterator(end(new_macs)));
+
+        // Still for connections to bring back, as it was before the daemon restarted
+        if (spec.state == VirtualMachine::State::suspended &&
+            instance_records[QString::fromStdString(name)].toObject()["idle_suspended"].toBool())
+            idle_suspended.insert(name);
 
         // FIXME: somehow we're writing contradictory state to disk.
         if (spec.deleted && spec.state != VirtualMachine::State::stopped)
@@ -938,17 +1788,6 @@ mp::Daemon::Daemon(std::unique_ptr<const DaemonConfig> the_config)
                                  static_cast<int>(spec.state)));
             spec.state = VirtualMachine::State::stopped;
         }
-
-        if (spec.state == VirtualMachine::State::running && vm_instances[name]->state != VirtualMachine::State::running)
-        {
-            assert(!spec.deleted);
-            mpl::log(mpl::Level::info, category, fmt::format("{} needs starting. Starting now...", name));
-
-            QTimer::singleShot(0, [this, &name] {
-                vm_instances[name]->start();
-                on_restart(name);
-            });
-        }
     }
 
     for (const auto& bad_spec : invalid_specs)
@@ -960,497 +1799,2166 @@ mp::Daemon::Daemon(std::unique_ptr<const DaemonConfig> the_config)
     if (!invalid_specs.empty())
         persist_instances();
 
+    lock.unlock();
+    if (!warming_instances.empty())
+        QTimer::singleShot(0, this, [this] { warm_up_next_instance(); });
+
     config->vault->prune_expired_images();
 
     // Fire timer every six hours to perform maintenance on source images such as
     // pruning expired images and updating to newly released images.
-    connect(&source_images_maintenance_task, &QTimer::timeout, [this]() {
-        if (image_update_future.isRunning())
-        {
-            mpl::log(mpl::Level::info, category, "Image updater already running. Skipping…");
-        }
-        else
-        {
-            image_update_future = QtConcurrent::run([this] {
-                config->vault->prune_expired_images();
+    connect(&source_images_maintenance_task, &QTimer::timeout, [this]() { update_source_images(/*prune=*/true); });
+    source_images_maintenance_task.start(config->image_refresh_timer);
 
-                auto prepare_action = [this](const VMImage& source_image) -> VMImage {
-                    return config->factory->prepare_source_image(source_image);
-                };
+    // In between, check more often for new releases of the images in use, so that they are already in the cache
+    // by the time they are launched
+    connect(&image_prefetch_task, &QTimer::timeout, [this]() { update_source_images(/*prune=*/false); });
+    image_prefetch_task.start(config->image_prefetch_timer);
 
-                auto download_monitor = [](int download_type, int percentage) {
-                    static int last_percentage_logged = -1;
-                    if (percentage % 10 == 0)
-                    {
-                        // Note: The progress callback may be called repeatedly with the same percentage,
-                        // so this logic is to only log it once
-                        if (last_percentage_logged != percentage)
-                        {
-                            mpl::log(mpl::Level::info, category, fmt::format("  {}%", percentage));
-                            last_percentage_logged = percentage;
-                        }
-                    }
-                    return true;
-                };
-                try
-                {
-                    config->vault->update_images(config->factory->fetch_type(), prepare_action, download_monitor);
-                }
-                catch (const std::exception& e)
-                {
-                    mpl::log(mpl::Level::error, category, fmt::format("Error updating images: {}", e.what()));
-                }
-            });
-        }
-    });
-    source_images_maintenance_task.start(config->image_refresh_timer);
-}
+    // Keep the warm pool topped up, and in line with its settings
+    connect(&warm_pool_task, &QTimer::timeout, [this]() { refill_warm_pool(); });
+    warm_pool_task.start(std::chrono::minutes{1});
 
-void mp::Daemon::create(const CreateRequest* request, grpc::ServerWriter<CreateReply>* server,
-                        std::promise<grpc::Status>* status_promise) // clang-format off
-try // clang-format on
-{
-    mpl::ClientLogger<CreateReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
-    return create_vm(request, server, status_promise, /*start=*/false);
-}
-catch (const std::exception& e)
-{
-    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+    // Give the host back the disk space that instances freed
+    connect(&disk_maintenance_task, &QTimer::timeout, [this]() { reclaim_instance_disks(); });
+    disk_maintenance_task.start(config->disk_maintenance_timer);
+
+    connect(&admission_task, &QTimer::timeout, [this]() { admit_queued(); });
+
+    // Suspend instances that nothing has used for a while, as set
+    connect(&idle_task, &QTimer::timeout, [this]() { suspend_idle_instances(); });
+    idle_task.start(config->idle_check_timer);
+
+    usage_history_task.setSingleShot(true);
+    connect(&usage_history_task, &QTimer::timeout, [this]() { sample_usage(); });
+    sample_usage();
+
+    package_cache_address(); // for the instances there are already to find it
+
+    instances_writer = std::thread{&Daemon::write_instances_behind, this};
 }
 
-void mp::Daemon::launch(const LaunchRequest* request, grpc::ServerWriter<LaunchReply>* server,
-                        std::promise<grpc::Status>* status_promise) // clang-format off
-try // clang-format on
+mp::Daemon::~Daemon()
 {
-    mpl::ClientLogger<LaunchReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
-    if (metrics_opt_in.opt_in_status == OptInStatus::UNKNOWN || metrics_opt_in.opt_in_status == OptInStatus::LATER)
-    {
-        if (++metrics_opt_in.delay_opt_in_count % 3 == 0)
-        {
-            metrics_opt_in.opt_in_status = OptInStatus::PENDING;
-            persist_metrics_opt_in_data(metrics_opt_in, config->data_directory);
+    stop_idle_resumes = true; // connections waiting on a resume give up rather than hold things up
 
-            LaunchReply reply;
-            reply.set_metrics_pending(true);
-            server->Write(reply);
+    begin_shutting_down_instances();
 
-            return status_promise->set_value(grpc::Status::OK);
-        }
+    stop_disk_maintenance = true;
+    disk_maintenance_future.waitForFinished(); // a compaction under way runs to its end
+    usage_sampling_future.waitForFinished();
 
-        persist_metrics_opt_in_data(metrics_opt_in, config->data_directory);
-    }
-    else if (metrics_opt_in.opt_in_status == OptInStatus::PENDING)
-    {
-        if (request->opt_in_reply().opt_in_status() != OptInStatus::UNKNOWN)
-        {
-            metrics_opt_in.opt_in_status = request->opt_in_reply().opt_in_status();
-            persist_metrics_opt_in_data(metrics_opt_in, config->data_directory);
+    // Queued waits are run rather than dropped, as running ones may be waiting on their futures. The instances are
+    // going down, so they do not take long.
+    wait_pool.waitForDone(); // before what the waits use goes away
 
-            if (metrics_opt_in.opt_in_status == OptInStatus::DENIED)
-                metrics_provider.send_denied();
-        }
+    {
+        std::lock_guard<decltype(persist_mutex)> lock{persist_mutex};
+        stop_persisting = true;
     }
+    persist_cv.notify_one();
 
-    if (metrics_opt_in.opt_in_status == OptInStatus::ACCEPTED)
-        metrics_provider.send_metrics();
+    if (instances_writer.joinable())
+        instances_writer.join(); // after any write that was still pending
 
-    return create_vm(request, server, status_promise, /*start=*/true);
-}
-catch (const mp::StartException& e)
-{
-    auto name = e.name();
+    for (auto& queued : admission_queue)
+        queued.status_promise->set_value(grpc::Status(grpc::StatusCode::UNAVAILABLE, "The daemon is going down", ""));
 
-    release_resources(name);
-    vm_instances.erase(name);
-    persist_instances();
+    {
+        std::lock_guard<decltype(watchers_mutex)> lock{watchers_mutex};
+        for (auto& watcher : status_watchers)
+            watcher.status_promise->set_value(grpc::Status::OK);
+        status_watchers.clear();
+    }
 
-    status_promise->set_value(grpc::Status(grpc::StatusCode::ABORTED, e.what(), ""));
-}
-catch (const std::exception& e)
-{
-    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+    instances_journal.compact(); // leaves the database as plain JSON between runs
 }
 
-void mp::Daemon::purge(const PurgeRequest* request, grpc::ServerWriter<PurgeReply>* server,
-                       std::promise<grpc::Status>* status_promise) // clang-format off
-try // clang-format on
+// Every instance is set going down at once, for each to be waited for as it is destroyed, under a single deadline,
+// rather than being taken down one after the other
+void mp::Daemon::begin_shutting_down_instances()
 {
-    for (const auto& del : deleted_instances)
-        release_resources(del.first);
+    const auto suspend = MP_SETTINGS.get(mp::shutdown_action_key) != "powerdown";
+    const auto deadline = std::chrono::steady_clock::now() + instances_shutdown_timeout;
 
-    deleted_instances.clear();
-    persist_instances();
-
-    status_promise->set_value(grpc::Status::OK);
-}
-catch (const std::exception& e)
-{
-    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+    for (auto& instance : vm_instances)
+    {
+        try
+        {
+            instance.second->begin_shutdown(suspend, deadline);
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::warning, instance.first, fmt::format("Cannot begin shutting down: {}", e.what()));
+        }
+    }
 }
 
-void mp::Daemon::find(const FindRequest* request, grpc::ServerWriter<FindReply>* server,
-                      std::promise<grpc::Status>* status_promise) // clang-format off
-try // clang-format on
+// Running guests trim what they freed, which reaches their images through discard, and the images of stopped
+// instances are rewritten without it. One instance at a time, away from the main thread
+void mp::Daemon::reclaim_instance_disks()
 {
-    mpl::ClientLogger<FindReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
-    FindReply response;
-    const auto default_remote{"release"};
+    if (disk_maintenance_future.isRunning())
+        return;
 
-    if (!request->search_string().empty())
+    struct Candidate
     {
-        std::vector<std::pair<std::string, VMImageInfo>> vm_images_info;
+        std::string name;
+        VirtualMachine::ShPtr vm;
+        std::string ssh_username;
+        VirtualMachine::State state; // read here, on the main thread, that backends update it from
+    };
 
-        try
+    std::vector<Candidate> candidates;
+    {
+        std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+        for (const auto& instance : vm_instances)
         {
-            vm_images_info = config->vault->all_info_for({"", request->search_string(), false, request->remote_name(),
-                                                          Query::Type::Alias, request->allow_unsupported()});
+            auto specs = vm_instance_specs.find(instance.first);
+            if (specs != vm_instance_specs.end() && !specs->second.ephemeral)
+                candidates.push_back(
+                    {instance.first, instance.second, specs->second.ssh_username, instance.second->current_state()});
         }
-        catch (const std::exception&)
+    }
+
+    disk_maintenance_future = QtConcurrent::run([this, candidates = std::move(candidates)] {
+        for (const auto& candidate : candidates)
         {
+            if (stop_disk_maintenance)
+                return;
+
+            auto& vm = *candidate.vm;
+            const auto labels = fmt::format("instance=\"{}\"", candidate.name);
+
             try
             {
-                vm_images_info.push_back(
-                    std::make_pair("", config->workflow_provider->info_for(request->search_string())));
+                if (candidate.state == VirtualMachine::State::running)
+                {
+                    auto result = vm.run_in_guest(guest_trim_cmd, guest_trim_timeout);
+                    if (!result)
+                    {
+                        auto session =
+                            ssh_sessions.acquire(vm.vm_name, vm.ssh_hostname(), vm.ssh_port(), candidate.ssh_username);
+                        auto process = session->exec(guest_trim_cmd);
+                        result = VirtualMachine::GuestCommandResult{process.exit_code(guest_trim_timeout),
+                                                                    process.read_std_output()};
+                    }
+
+                    if (result->exit_code == 0)
+                        MP_INSTRUMENTATION.add("multipass_disk_trimmed_bytes", labels, trimmed_bytes(result->output));
+                }
+                else if (candidate.state == VirtualMachine::State::off ||
+                         candidate.state == VirtualMachine::State::stopped)
+                {
+                    // Not to be started off an image that is being rewritten, but instances busy with something else
+                    // are left for the next round rather than waited for. Backends only compact what is still stopped
+                    auto operation_lock = lock_operations_for_compaction(candidate.name);
+                    if (!operation_lock.owns_lock())
+                        continue;
+
+                    const auto start = Instrumentation::Clock::now();
+                    long long compacted;
+                    try
+                    {
+                        compacted = vm.compact_disk();
+                    }
+                    catch (...)
+                    {
+                        end_compaction();
+                        throw;
+                    }
+                    end_compaction();
+
+                    MP_INSTRUMENTATION.observe("multipass_disk_compaction_seconds", labels,
+                                               Instrumentation::Clock::now() - start);
+                    MP_INSTRUMENTATION.add("multipass_disk_compacted_bytes", labels, compacted);
+
+                    if (compacted)
+                        mpl::log(mpl::Level::info, category,
+                                 fmt::format("Compacted the disk of {}, giving back {:.1f}MiB", candidate.name,
+                                             compacted / (1024.0 * 1024)));
+                }
             }
-            catch (const std::exception&)
+            catch (const std::exception& e)
             {
-                throw std::runtime_error(
-                    fmt::format("Unable to find an image or workflow matching \"{}\"", request->search_string()));
+                mpl::log(mpl::Level::warning, category,
+                         fmt::format("Could not reclaim disk space of {}: {}", candidate.name, e.what()));
             }
         }
+    });
+}
 
-        for (const auto& [remote, info] : vm_images_info)
+// An instance is idle while its hypervisor all but stops using the host's CPU, its mounts serve nothing, and no one
+// is connected to it, over SSH from the host, other than the mounts, or through its forwarded ports
+void mp::Daemon::suspend_idle_instances()
+{
+    const auto idle_minutes = MP_SETTINGS.get(mp::idle_suspend_key);
+    if (idle_minutes.isEmpty())
+    {
+        idle_samples.clear();
+        return;
+    }
+
+    const auto idle_limit = std::chrono::minutes{idle_minutes.toInt()};
+    const auto now = std::chrono::steady_clock::now();
+
+    for (const auto& instance : vm_instances)
+    {
+        const auto& name = instance.first;
+        auto& vm = *instance.second;
+
+        auto specs = vm_instance_specs.find(name);
+        if (specs == vm_instance_specs.end() || specs->second.ephemeral ||
+            vm.current_state() != VirtualMachine::State::running)
         {
-            std::string name;
-            if (info.aliases.contains(QString::fromStdString(request->search_string())))
-            {
-                name = request->search_string();
-            }
-            else
+            idle_samples.erase(name);
+            continue;
+        }
+
+        {
+            // Running again, however it came about
+            std::lock_guard<decltype(idle_mutex)> lock{idle_mutex};
+            idle_suspended.erase(name);
+        }
+
+        try
+        {
+            const auto mounts = instance_mounts.activity_of(name);
+            IdleSample sample{vm.metrics().cpu_time_ms, mounts.operations, now, now};
+
+            auto idle{false};
+            auto previous = idle_samples.find(name);
+            if (previous != idle_samples.end() && sample.cpu_time_ms && previous->second.cpu_time_ms)
             {
-                name = info.id.toStdString();
-                name.resize(12);
+                const auto elapsed_ms =
+                    std::chrono::duration_cast<std::chrono::milliseconds>(now - previous->second.taken).count();
+                const auto cpu_share = static_cast<double>(*sample.cpu_time_ms - *previous->second.cpu_time_ms) /
+                                       std::max<long long>(elapsed_ms, 1);
+
+                // Shells are connections of their own, next to the sessions that the mounts hold
+                const auto connections = host_connections_to(vm.ssh_hostname(), vm.ssh_port());
+                idle = cpu_share <= idle_cpu_share && sample.mount_operations == previous->second.mount_operations &&
+                       connections && *connections <= static_cast<int>(mounts.sessions) &&
+                       port_forwarder.active_connections(name) == 0;
+                if (idle)
+                    sample.idle_since = previous->second.idle_since;
             }
+            idle_samples[name] = sample;
 
-            auto entry = response.add_images_info();
-            entry->set_os(info.os.toStdString());
-            entry->set_release(info.release_title.toStdString());
-            entry->set_version(info.version.toStdString());
-            auto alias_entry = entry->add_aliases_info();
-            if (!request->remote_name().empty() ||
-                (request->remote_name().empty() && vm_images_info.size() > 1 && remote != default_remote))
+            // Without the hypervisor's CPU time or the connections to it, nothing tells an idle instance apart, and
+            // it is left running
+            if (!idle || now - sample.idle_since < idle_limit)
+                continue;
+
+            auto operation_lock = lock_operations_on(name);
+            if (vm.current_state() != VirtualMachine::State::running)
+                continue;
+
+            mpl::log(mpl::Level::info, category, fmt::format("Suspending {}, idle for {} minutes", name, idle_minutes));
             {
-                alias_entry->set_remote_name(remote);
+                // Before it goes, so that connections coming in the meantime wait to bring it back
+                std::lock_guard<decltype(idle_mutex)> lock{idle_mutex};
+                idle_suspended.insert(name);
             }
-            alias_entry->set_alias(name);
-        }
-    }
-    else if (request->remote_name().empty())
-    {
-        for (const auto& image_host : config->image_hosts)
-        {
-            std::unordered_set<std::string> images_found;
-            auto action = [&images_found, &default_remote, request, &response](const std::string& remote,
-                                                                               const mp::VMImageInfo& info) {
-                if ((info.supported || request->allow_unsupported()) && !info.aliases.empty() &&
-                    images_found.find(info.release_title.toStdString()) == images_found.end())
-                {
-                    add_aliases(response, remote, info, default_remote);
-                    images_found.insert(info.release_title.toStdString());
-                }
-            };
 
-            image_host->for_each_entry_do(action);
+            vm.suspend();
+            instance_mounts.stop_all_mounts_for_instance(name);
+            idle_samples.erase(name);
         }
-
-        auto vm_workflows_info = config->workflow_provider->all_workflows();
-
-        for (const auto& info : vm_workflows_info)
+        catch (const std::exception& e)
         {
-            add_aliases(response, "", info, "");
-        }
-    }
-    else
-    {
-        const auto& remote = request->remote_name();
-        auto image_host = config->vault->image_host_for(remote);
-        auto vm_images_info = image_host->all_images_for(remote, request->allow_unsupported());
+            mpl::log(mpl::Level::warning, category, fmt::format("Could not suspend idle {}: {}", name, e.what()));
 
-        for (const auto& info : vm_images_info)
-        {
-            add_aliases(response, remote, info, "");
+            std::lock_guard<decltype(idle_mutex)> lock{idle_mutex};
+            idle_suspended.erase(name);
         }
     }
-    server->Write(response);
-    status_promise->set_value(grpc::Status::OK);
-}
-catch (const std::exception& e)
-{
-    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::info(const InfoRequest* request, grpc::ServerWriter<InfoReply>* server,
-                      std::promise<grpc::Status>* status_promise) // clang-format off
-try // clang-format on
+// Only from what the hypervisor measures on the host, so that sampling costs the instances nothing. While an
+// instance is not running, it is not sampled, and the period across the gap averages over it
+void mp::Daemon::sample_usage()
 {
-    mpl::ClientLogger<InfoReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
-    InfoReply response;
+    const auto interval = MP_SETTINGS.get(mp::usage_history_interval_key);
+    if (interval.isEmpty())
+        return usage_history_task.start(usage_history_recheck);
 
-    fmt::memory_buffer errors;
-    std::vector<decltype(vm_instances)::key_type> instances_for_info;
+    usage_history_task.start(std::chrono::seconds{interval.toInt()});
 
-    if (request->instance_names().instance_name().empty())
-    {
-        for (auto& pair : vm_instances)
-            instances_for_info.push_back(pair.first);
-    }
-    else
+    // A round that is still waiting on a slow backend makes this one a gap in the history
+    if (usage_sampling_future.isRunning())
+        return;
+
+    std::vector<std::pair<std::string, VirtualMachine::ShPtr>> running;
     {
-        for (const auto& name : request->instance_names().instance_name())
-            instances_for_info.push_back(name);
+        std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+        for (const auto& instance : vm_instances)
+            if (instance.second->current_state() == VirtualMachine::State::running)
+                running.emplace_back(instance.first, instance.second);
     }
 
-    for (const auto& name : instances_for_info)
-    {
-        auto it = vm_instances.find(name);
-        bool deleted{false};
-        if (it == vm_instances.end())
+    // Some backends ask their hypervisor over a connection that blocks until it answers, which is not to hold up the
+    // event loop
+    const auto now = UsageHistory::Clock::now();
+    usage_sampling_future = QtConcurrent::run([this, now, running = std::move(running)] {
+        for (const auto& instance : running)
         {
-            it = deleted_instances.find(name);
-            if (it == deleted_instances.end())
-            {
-                fmt::format_to(errors, "instance \"{}\" does not exist\n", name);
+            // The disk as the instance sees it where the backend can tell, or else what its image takes on the host
+            const auto metrics = instance.second->metrics();
+
+            // Not to leave a sample behind for an instance that was deleted in the meantime
+            std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+            auto it = vm_instances.find(instance.first);
+            if (it == vm_instances.end() || it->second != instance.second)
                 continue;
-            }
-            deleted = true;
-        }
 
-        auto info = response.add_info();
-        auto& vm = it->second;
-        auto present_state = vm->current_state();
-        info->set_name(name);
-        if (deleted)
-        {
-            info->mutable_instance_status()->set_status(mp::InstanceStatus::DELETED);
+            usage_history.add(instance.first, {now, metrics.cpu_time_ms, metrics.net_rx_bytes, metrics.net_tx_bytes,
+                                               metrics.memory_used,
+                                               metrics.disk_used ? metrics.disk_used : metrics.disk_allocated});
         }
-        else
+    });
+}
+
+// Waits for the instance to be back up, SSH and mounts included, if it was suspended for being idle
+void mp::Daemon::resume_if_idle(const std::string& name)
+{
+    auto is_resuming = [this, &name] {
         {
-            info->mutable_instance_status()->set_status(grpc_instance_status_for(present_state));
+            std::lock_guard<decltype(idle_mutex)> lock{idle_mutex};
+            if (idle_suspended.count(name))
+                return true;
         }
 
-        auto vm_image = fetch_image_for(name, config->factory->fetch_type(), *config->vault);
-        auto original_release = vm_image.original_release;
+        std::lock_guard<decltype(start_mutex)> lock{start_mutex};
+        return async_running_futures.find(name) != async_running_futures.end();
+    };
+
+    {
+        std::lock_guard<decltype(idle_mutex)> lock{idle_mutex};
+        if (!idle_suspended.count(name))
+            return;
+    }
+
+    // The main thread cannot wait for what it has yet to do itself
+    if (QThread::currentThread() == thread())
+        return resume_idle_instance(name);
+
+    QMetaObject::invokeMethod(this, [this, name] { resume_idle_instance(name); }, Qt::QueuedConnection);
+
+    const auto deadline = std::chrono::steady_clock::now() + idle_resume_timeout;
+    while (!stop_idle_resumes && std::chrono::steady_clock::now() < deadline && is_resuming())
+        std::this_thread::sleep_for(idle_resume_poll_interval);
+}
+
+// Runs on the main thread, which owns the instances
+void mp::Daemon::resume_idle_instance(const std::string& name)
+{
+    {
+        std::lock_guard<decltype(idle_mutex)> lock{idle_mutex};
+        if (!idle_suspended.count(name))
+            return; // resumed already, by an earlier connection
+    }
 
-        if (!vm_image.id.empty() && original_release.empty())
+    try
+    {
+        auto operation_lock = lock_operations_on(name);
+        auto it = vm_instances.find(name);
+        if (it != vm_instances.end() && it->second->current_state() == VirtualMachine::State::suspended)
         {
-            try
-            {
-                auto vm_image_info = config->image_hosts.back()->info_for_full_hash(vm_image.id);
-                original_release = vm_image_info.release_title.toStdString();
-            }
-            catch (const std::exception& e)
+            mpl::log(mpl::Level::info, category, fmt::format("Resuming idle {} for a connection", name));
+            it->second->start();
+
+            std::lock_guard<decltype(start_mutex)> lock{start_mutex};
+            if (async_running_futures.find(name) == async_running_futures.end())
             {
-                mpl::log(mpl::Level::warning, category, fmt::format("Cannot fetch image information: {}", e.what()));
+                auto future = async_running_futures[name] =
+                    QtConcurrent::run(&wait_pool, this, &Daemon::async_wait_for_ssh_and_start_mounts_for<StartReply>,
+                                      name, mp::default_timeout,
+                                      static_cast<grpc::ServerWriterInterface<StartReply>*>(nullptr));
+
+                auto watcher = new QFutureWatcher<std::string>();
+                QObject::connect(watcher, &QFutureWatcher<std::string>::finished, [this, name, watcher] {
+                    {
+                        std::lock_guard<decltype(start_mutex)> lock{start_mutex};
+                        auto it = async_running_futures.find(name);
+                        if (it != async_running_futures.end() && it->second == watcher->future())
+                            async_running_futures.erase(it);
+                    }
+
+                    if (auto error = watcher->result(); !error.empty())
+                        mpl::log(mpl::Level::warning, category, error);
+
+                    watcher->deleteLater();
+                });
+                watcher->setFuture(future);
             }
         }
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::warning, category, fmt::format("Could not resume idle {}: {}", name, e.what()));
+    }
+
+    // Only now, with the wait for it in place, for connections to go on waiting on that
+    std::lock_guard<decltype(idle_mutex)> lock{idle_mutex};
+    idle_suspended.erase(name);
+}
+
+// One instance at a time, so that requests queued in the meantime get their turn
+void mp::Daemon::warm_up_next_instance()
+{
+    if (warming_instances.empty())
+        return;
+
+    warm_up(warming_instances.begin()->first);
+    if (!warming_instances.empty())
+        QTimer::singleShot(0, this, [this] { warm_up_next_instance(); });
+}
+
+// Requests that change instances need them all in place first
+void mp::Daemon::finish_warming()
+{
+    while (!warming_instances.empty())
+        warm_up(warming_instances.begin()->first);
+}
 
-        info->set_image_release(original_release);
-        info->set_id(vm_image.id);
+void mp::Daemon::warm_up(const std::string& name)
+{
+    auto& spec = vm_instance_specs.at(name);
+    VirtualMachine::ShPtr vm;
+    std::string failure;
+    try
+    {
+        // Outside the lock, as creating the VM may mean a round-trip to the hypervisor
+        vm = config->factory->create_virtual_machine(warming_instances.at(name), *this);
+    }
+    catch (const std::exception& e)
+    {
+        failure = e.what();
+        mpl::log(mpl::Level::error, category,
+                 fmt::format("Could not bring up {}, leaving it out until the next restart: {}", name, failure));
+    }
 
-        auto vm_specs = vm_instance_specs[name];
+    try
+    {
+        if (vm)
+            vm->set_native_mounts(native_mounts_for(name, spec.mounts));
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::warning, category,
+                 fmt::format("Could not share the native mounts of {}: {}", name, e.what()));
+    }
 
-        auto mount_info = info->mutable_mount_info();
+    {
+        std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+        warming_instances.erase(name);
+        if (vm)
+            (spec.deleted ? deleted_instances : vm_instances)[name] = vm;
+        else if (!spec.deleted)
+            failed_instances[name] = failure; // so that it shows, rather than go missing
+    }
 
-        mount_info->set_longest_path_len(0);
+    for (const auto& forward : spec.port_forwards)
+    {
+        if (!vm)
+            break;
 
-        for (const auto& mount : vm_specs.mounts)
+        const auto& [host_address, host_port] = forward.first;
+        try
         {
-            if (mount.second.source_path.size() > mount_info->longest_path_len())
-            {
-                mount_info->set_longest_path_len(mount.second.source_path.size());
-            }
+            port_forwarder.add(name, host_address, host_port, forward.second,
+                               address_lookup_for(this, vm, [this, name] { resume_if_idle(name); }));
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::warning, category,
+                     fmt::format("Could not forward {}:{} to {}: {}", host_address, host_port, name, e.what()));
+        }
+    }
 
-            auto entry = mount_info->add_mount_paths();
-            entry->set_source_path(mount.second.source_path);
-            entry->set_target_path(mount.first);
+    if (vm && spec.state == VirtualMachine::State::running && vm->state != VirtualMachine::State::running)
+    {
+        assert(!spec.deleted);
+        mpl::log(mpl::Level::info, category, fmt::format("{} needs starting. Starting now...", name));
 
-            for (const auto& uid_map : mount.second.uid_map)
-            {
-                (*entry->mutable_mount_maps()->mutable_uid_map())[uid_map.first] = uid_map.second;
-            }
-            for (const auto& gid_map : mount.second.gid_map)
+        QTimer::singleShot(0, this, [this, name] {
+            vm_instances[name]->start();
+            on_restart(name);
+        });
+    }
+    else if (vm && !spec.deleted && vm->state == VirtualMachine::State::running)
+    {
+        // Kept running across the restart; what the last daemon persisted may not have caught up, and the mounts went
+        // down with it
+        mpl::log(mpl::Level::info, category, fmt::format("{} kept running", name));
+        if (spec.state != VirtualMachine::State::running)
+            persist_state_for(name, VirtualMachine::State::running);
+
+        QTimer::singleShot(0, this, [this, name] { on_restart(name); });
+    }
+}
+
+void mp::Daemon::update_source_images(bool prune)
+{
+    if (image_update_future.isRunning())
+    {
+        mpl::log(mpl::Level::info, category, "Image updater already running. Skipping…");
+        return;
+    }
+
+    image_update_future = QtConcurrent::run([this, prune] {
+        // Keep out of the way of launches
+        DownloadScheduler::PriorityScope priority{prune ? DownloadScheduler::Priority::update
+                                                        : DownloadScheduler::Priority::prefetch};
+
+        if (prune)
+            config->vault->prune_expired_images();
+
+        auto download_monitor = [](int download_type, int percentage) {
+            static int last_percentage_logged = -1;
+            if (percentage % 10 == 0)
             {
-                (*entry->mutable_mount_maps()->mutable_gid_map())[gid_map.first] = gid_map.second;
+                // Note: The progress callback may be called repeatedly with the same percentage,
+                // so this logic is to only log it once
+                if (last_percentage_logged != percentage)
+                {
+                    mpl::log(mpl::Level::info, category, fmt::format("  {}%", percentage));
+                    last_percentage_logged = percentage;
+                }
             }
+            return true;
+        };
+        auto prepare_action = [this, &download_monitor](const VMImage& source_image) -> VMImage {
+            return config->factory->prepare_source_image(source_image, download_monitor);
+        };
+        try
+        {
+            config->vault->update_images(config->factory->fetch_type(), prepare_action, download_monitor);
         }
-
-        if (mp::utils::is_running(present_state))
+        catch (const std::exception& e)
         {
-            mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), vm_specs.ssh_username,
-                                   *config->ssh_key_provider};
+            mpl::log(mpl::Level::error, category, fmt::format("Error updating images: {}", e.what()));
+        }
+    });
+}
 
-            info->set_load(mpu::run_in_ssh_session(session, "cat /proc/loadavg | cut -d ' ' -f1-3"));
-            info->set_memory_usage(mpu::run_in_ssh_session(session, "free -b | sed '1d;3d' | awk '{printf $3}'"));
-            info->set_memory_total(mpu::run_in_ssh_session(session, "free -b | sed '1d;3d' | awk '{printf $2}'"));
-            info->set_disk_usage(mpu::run_in_ssh_session(
-                session, "df --output=used `awk '$2 == \"/\" { print $1 }' /proc/mounts` -B1 | sed 1d"));
-            info->set_disk_total(mpu::run_in_ssh_session(
-                session, "df --output=size `awk '$2 == \"/\" { print $1 }' /proc/mounts` -B1 | sed 1d"));
+void mp::Daemon::refill_warm_pool()
+{
+    // Pool instances are handed over by renaming them, which is up to the backend
+    if (!config->factory->can_rename_resources())
+    {
+        mpl::log(mpl::Level::info, category, "Warm pools are not supported on this backend");
+        warm_pool_task.stop();
+        return;
+    }
 
-            std::string management_ip = vm->management_ipv4();
-            auto all_ipv4 = vm->get_all_ipv4(*config->ssh_key_provider);
+    WarmPoolSpec spec{};
+    try
+    {
+        spec = WarmPoolSpec::from_settings();
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::warning, category, fmt::format("Could not read the warm pool settings: {}", e.what()));
+        return;
+    }
 
-            if (is_ipv4_valid(management_ip))
-                info->add_ipv4(management_ip);
-            else if (all_ipv4.empty())
-                info->add_ipv4("N/A");
+    std::vector<std::string> unwanted;
+    {
+        std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+        warm_pool_spec = spec;
 
-            for (const auto& extra_ipv4 : all_ipv4)
-                if (extra_ipv4 != management_ip)
-                    info->add_ipv4(extra_ipv4);
+        for (const auto& entry : warm_pool)
+            if (entry.second.ready && !wanted_in_pool(entry.first))
+                unwanted.push_back(entry.first);
+
+        for (auto slot = 0; slot < max_warm_pool_size; ++slot)
+        {
+            const auto name = WarmPoolSpec::instance_name(slot);
+            if (warm_pool.find(name) != warm_pool.end() || filling_pool.find(name) != filling_pool.end())
+                continue;
 
-            auto current_release = mpu::run_in_ssh_session(session, "lsb_release -ds");
-            info->set_current_release(!current_release.empty() ? current_release : original_release);
+            if (slot < spec.size)
+                fill_pool_slot(name);
+            else if (config->vault->has_record_for(name))
+                // Left behind by a previous run of the daemon, with a pool that is now smaller or off
+                config->vault->remove(name);
         }
     }
 
-    auto status = grpc_status_for(errors);
-    if (status.ok())
-        server->Write(response);
-
-    status_promise->set_value(status);
+    for (const auto& name : unwanted)
+        discard_pool_instance(name);
 }
-catch (const std::exception& e)
+
+bool mp::Daemon::wanted_in_pool(const std::string& name) const
 {
-    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+    auto it = warm_pool.find(name);
+    if (it == warm_pool.end())
+        return false;
+
+    // Only the slots beyond a smaller size are let go of when the pool is resized
+    auto spec = it->second.spec;
+    spec.size = warm_pool_spec.size;
+    return it->second.slot < warm_pool_spec.size && spec == warm_pool_spec;
 }
 
-void mp::Daemon::list(const ListRequest* request, grpc::ServerWriter<ListReply>* server,
-                      std::promise<grpc::Status>* status_promise) // clang-format off
-try // clang-format on
+void mp::Daemon::fill_pool_slot(const std::string& name)
 {
-    mpl::ClientLogger<ListReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
-    ListReply response;
-    config->update_prompt->populate_if_time_to_show(response.mutable_update_info());
+    // Whatever a previous run of the daemon left behind under this name is of no use
+    if (config->vault->has_record_for(name))
+        config->vault->remove(name);
 
-    for (const auto& instance : vm_instances)
-    {
-        const auto& name = instance.first;
-        const auto& vm = instance.second;
-        auto present_state = vm->current_state();
-        auto entry = response.add_instances();
-        entry->set_name(name);
-        entry->mutable_instance_status()->set_status(grpc_instance_status_for(present_state));
+    filling_pool.insert(name);
+    mpl::log(mpl::Level::info, category, fmt::format("Preparing {} for the warm pool", name));
 
-        // FIXME: Set the release to the cached current version when supported
-        auto vm_image = fetch_image_for(name, config->factory->fetch_type(), *config->vault);
-        auto current_release = vm_image.original_release;
+    auto prepare_future_watcher = new QFutureWatcher<VirtualMachineDescription>();
+    QObject::connect(
+        prepare_future_watcher, &QFutureWatcher<VirtualMachineDescription>::finished,
+        [this, name, spec = warm_pool_spec, prepare_future_watcher] {
+            std::unique_lock<decltype(instances_mutex)> lock{instances_mutex};
+            filling_pool.erase(name);
 
-        if (!vm_image.id.empty() && current_release.empty())
-        {
             try
             {
-                auto vm_image_info = config->image_hosts.back()->info_for_full_hash(vm_image.id);
-                current_release = vm_image_info.release_title.toStdString();
+                auto vm_desc = prepare_future_watcher->future().result();
+                VMSpecs specs{vm_desc.num_cores,
+                              vm_desc.mem_size,
+                              vm_desc.disk_space,
+                              vm_desc.default_mac_address,
+                              vm_desc.extra_interfaces,
+                              config->ssh_username,
+                              VirtualMachine::State::off,
+                              {},
+                              false,
+                              QJsonObject(),
+                              vm_desc.storage_profile};
+
+                auto& pooled = warm_pool[name] = {std::stoi(name.substr(name.rfind('.') + 1)), spec, vm_desc, specs,
+                                                  nullptr, false};
+                if (!wanted_in_pool(name))
+                    throw std::runtime_error("the pool changed, or was turned off, in the meantime");
+
+                pooled.vm = config->factory->create_virtual_machine(vm_desc, *this);
+                auto vm = pooled.vm;
+                lock.unlock();
+
+                vm->start();
+
+                auto boot_future_watcher = new QFutureWatcher<std::string>();
+                QObject::connect(boot_future_watcher, &QFutureWatcher<std::string>::finished,
+                                 [this, name, boot_future_watcher] {
+                                     const auto error = boot_future_watcher->future().result();
+                                     if (error.empty())
+                                     {
+                                         settle_pool_instance(name);
+                                     }
+                                     else
+                                     {
+                                         mpl::log(mpl::Level::warning, category,
+                                                  fmt::format("Could not bring up {}: {}", name, error));
+                                         discard_pool_instance(name);
+                                     }
+
+                                     delete boot_future_watcher;
+                                 });
+                boot_future_watcher->setFuture(QtConcurrent::run(&wait_pool, [this, vm]() -> std::string {
+                    try
+                    {
+                        vm->wait_until_ssh_up(mp::default_timeout);
+                        MP_UTILS.wait_for_cloud_init(vm.get(), mp::default_timeout, *config->ssh_key_provider);
+                        return {};
+                    }
+                    catch (const std::exception& e)
+                    {
+                        return e.what();
+                    }
+                }));
             }
             catch (const std::exception& e)
             {
-                mpl::log(mpl::Level::warning, category, fmt::format("Cannot fetch image information: {}", e.what()));
+                mpl::log(mpl::Level::warning, category, fmt::format("Could not prepare {}: {}", name, e.what()));
+
+                if (!lock.owns_lock())
+                    lock.lock();
+
+                if (warm_pool.find(name) != warm_pool.end())
+                {
+                    lock.unlock();
+                    discard_pool_instance(name);
+                }
+                else
+                {
+                    config->vault->remove(name);
+                }
             }
-        }
 
-        entry->set_current_release(current_release);
+            delete prepare_future_watcher;
+        });
 
-        if (request->request_ipv4() && mp::utils::is_running(present_state))
-        {
-            std::string management_ip = vm->management_ipv4();
-            auto all_ipv4 = vm->get_all_ipv4(*config->ssh_key_provider);
+    prepare_future_watcher->setFuture(
+        QtConcurrent::run([this, name, spec = warm_pool_spec] { return prepare_pool_instance(name, spec); }));
+}
 
-            if (is_ipv4_valid(management_ip))
-                entry->add_ipv4(management_ip);
-            else if (all_ipv4.empty())
-                entry->add_ipv4("N/A");
+// A subset of what a launch goes through, with nobody to report to and nothing the pool instances could differ in
+mp::VirtualMachineDescription mp::Daemon::prepare_pool_instance(const std::string& name, const WarmPoolSpec& spec)
+{
+    // Keep out of the way of launches
+    DownloadScheduler::PriorityScope priority{DownloadScheduler::Priority::prefetch};
+
+    auto meta_data_config = make_cloud_init_meta_config(name);
+    meta_data_config["local-hostname"] = QString::fromStdString(name).replace('.', '-').toStdString();
+
+    VirtualMachineDescription vm_desc{
+        spec.num_cores,
+        spec.mem_size,
+        MemorySize{},
+        name,
+        "",
+        {},
+        config->ssh_username,
+        VMImage{},
+        "",
+        meta_data_config,
+        YAML::Node{},
+        make_cloud_init_vendor_config(*config->ssh_key_provider, "", config->ssh_username,
+                                      config->factory->get_backend_version_string().toStdString(),
+                                      package_cache_address()),
+        YAML::Node{},
+        mp::default_storage_profile};
+
+    const auto request = spec.launch_request(name);
+    auto prepare_action = [this](const VMImage& source_image) -> VMImage {
+        return config->factory->prepare_source_image(source_image, [](int, int) { return true; });
+    };
+    auto vm_image = config->vault->fetch_image(config->factory->fetch_type(), query_from(&request, name),
+                                               prepare_action, [](int, int) { return true; });
 
-            for (const auto& extra_ipv4 : all_ipv4)
-                if (extra_ipv4 != management_ip)
-                    entry->add_ipv4(extra_ipv4);
-        }
+    // Sized the way a launch that does not ask for a disk size would be, when the pool does not ask either
+    const auto image_size = config->vault->minimum_image_size_for(vm_image.id);
+    vm_desc.disk_space = compute_final_image_size(
+        image_size,
+        spec.disk_space == MemorySize{mp::default_disk_size} ? mp::nullopt : mp::make_optional(spec.disk_space),
+        config->data_directory);
+
+    {
+        // Claimed as it is picked, so that no launch prepared alongside can pick it too
+        std::lock_guard<decltype(mac_addrs_mutex)> lock{mac_addrs_mutex};
+        std::unordered_set<std::string> new_macs;
+        vm_desc.default_mac_address = generate_unused_mac_address(allocated_mac_addrs, new_macs);
+        allocated_mac_addrs.insert(vm_desc.default_mac_address);
+    }
+
+    try
+    {
+        prepare_user_data(vm_desc.user_data_config, vm_desc.vendor_data_config);
+        vm_desc.network_data_config = make_cloud_init_network_config(vm_desc.default_mac_address, {});
+
+        vm_desc.image = vm_image;
+        config->factory->configure(vm_desc);
+        config->factory->prepare_instance_image(vm_image, vm_desc);
     }
+    catch (...)
+    {
+        std::lock_guard<decltype(mac_addrs_mutex)> lock{mac_addrs_mutex};
+        allocated_mac_addrs.erase(vm_desc.default_mac_address);
+        throw;
+    }
+
+    return vm_desc;
+}
 
-    for (const auto& instance : deleted_instances)
+void mp::Daemon::settle_pool_instance(const std::string& name)
+{
+    VirtualMachine::ShPtr vm;
+    bool wanted;
     {
-        const auto& name = instance.first;
-        auto entry = response.add_instances();
-        entry->set_name(name);
-        entry->mutable_instance_status()->set_status(mp::InstanceStatus::DELETED);
+        std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+        auto it = warm_pool.find(name);
+        if (it == warm_pool.end())
+            return;
+
+        vm = it->second.vm;
+        wanted = wanted_in_pool(name); // the pool may have changed, or been turned off, while it was booting
     }
 
-    server->Write(response);
-    status_promise->set_value(grpc::Status::OK);
+    if (wanted)
+    {
+        try
+        {
+            // Reports its state under the lock, so is suspended without it
+            vm->suspend();
+
+            std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+            auto it = warm_pool.find(name);
+            if (it != warm_pool.end())
+                it->second.ready = true;
+
+            mpl::log(mpl::Level::info, category, fmt::format("{} is ready in the warm pool", name));
+            return;
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::warning, category, fmt::format("Could not suspend {}: {}", name, e.what()));
+        }
+    }
+
+    vm.reset();
+    discard_pool_instance(name);
 }
-catch (const std::exception& e)
+
+void mp::Daemon::discard_pool_instance(const std::string& name)
 {
-    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+    VirtualMachine::ShPtr vm;
+    {
+        std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+        auto it = warm_pool.find(name);
+        if (it == warm_pool.end())
+            return;
+
+        mpl::log(mpl::Level::info, category, fmt::format("Removing {} from the warm pool", name));
+
+        {
+            std::lock_guard<decltype(mac_addrs_mutex)> lock{mac_addrs_mutex};
+            for (const auto& mac : mac_set_from(it->second.specs))
+                allocated_mac_addrs.erase(mac);
+        }
+
+        vm = std::move(it->second.vm);
+        warm_pool.erase(it);
+    }
+
+    // Brought down first, should it still be up, which it reports under the lock
+    vm.reset();
+
+    std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+    config->factory->remove_resources_for(name);
+    config->vault->remove(name);
 }
 
-void mp::Daemon::networks(const NetworksRequest* request, grpc::ServerWriter<NetworksReply>* server,
-                          std::promise<grpc::Status>* status_promise) // clang-format off
-try // clang-format on
+// Hands a suspended pool instance over to a launch that asks for nothing it was not booted with. This renames it,
+// and fills in what set the launch apart once it is up
+bool mp::Daemon::claim_pool_instance(const LaunchRequest* request, const std::string& name,
+                                     const std::chrono::seconds& timeout,
+                                     grpc::ServerWriterInterface<LaunchReply>* server,
+                                     std::promise<grpc::Status>* status_promise)
 {
-    mpl::ClientLogger<NetworksReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
-    NetworksReply response;
-    config->update_prompt->populate_if_time_to_show(response.mutable_update_info());
+    // Pool instances are kept for good, which an ephemeral one must not be
+    if (!config->factory->can_rename_resources() || request->ephemeral() ||
+        !config->workflow_provider->name_from_workflow(request->image()).empty())
+        return false;
+
+    std::unique_lock<decltype(instances_mutex)> lock{instances_mutex};
+    if (!warm_pool_spec.matches(*request))
+        return false;
+
+    auto it = std::find_if(warm_pool.begin(), warm_pool.end(), [](const auto& entry) {
+        return entry.second.ready && entry.second.vm->current_state() == VirtualMachine::State::suspended;
+    });
+    if (it == warm_pool.end())
+        return false;
+
+    const auto pool_name = it->first;
+    auto pooled = std::move(it->second);
+    warm_pool.erase(it);
+    pooled.vm.reset();
+
+    try
+    {
+        config->factory->rename_resources_for(pool_name, name);
+
+        auto& vm_desc = pooled.desc;
+        vm_desc.vm_name = name;
+        vm_desc.image = config->vault->rename(pool_name, name);
+
+        // Keeping the instance-id stops cloud-init from initializing the instance over again on its next boot
+        vm_desc.meta_data_config = make_cloud_init_meta_config(name);
+        vm_desc.meta_data_config["instance-id"] = pool_name;
+        vm_desc.vendor_data_config =
+            make_cloud_init_vendor_config(*config->ssh_key_provider, request->time_zone(), config->ssh_username,
+                                          config->factory->get_backend_version_string().toStdString(),
+                                          package_cache_address());
+        QFile::remove(mp::utils::base_dir(vm_desc.image.image_path).filePath("cloud-init-config.iso"));
+        config->factory->configure(vm_desc);
+
+        vm_instance_specs[name] = pooled.specs;
+        vm_instances[name] = config->factory->create_virtual_machine(vm_desc, *this);
+        persist_instances();
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::warning, category,
+                 fmt::format("Could not hand {} over to {}, launching afresh: {}", pool_name, name, e.what()));
+
+        {
+            std::lock_guard<decltype(mac_addrs_mutex)> lock{mac_addrs_mutex};
+            for (const auto& mac : mac_set_from(pooled.specs))
+                allocated_mac_addrs.erase(mac);
+        }
+        config->factory->remove_resources_for(pool_name);
+        config->vault->remove(pool_name);
+        release_resources(name);
+        vm_instances.erase(name);
+        persist_instances();
+
+        return false;
+    }
+    auto vm = vm_instances[name];
+    lock.unlock();
+
+    mpl::log(mpl::Level::info, category, fmt::format("{} taken from the warm pool for {}", pool_name, name));
+    QTimer::singleShot(0, this, [this] { refill_warm_pool(); });
+
+    LaunchReply reply;
+    reply.set_create_message("Starting " + name);
+    mpl::write_to_client(server, reply);
+
+    try
+    {
+        vm->start();
+    }
+    catch (const std::exception& e)
+    {
+        std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+        release_resources(name);
+        vm_instances.erase(name);
+        persist_instances();
+        status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+
+        return true;
+    }
+
+    auto future_watcher = create_future_watcher([this, server, name] {
+        LaunchReply reply;
+        reply.set_vm_instance_name(name);
+        config->update_prompt->populate_if_time_to_show(reply.mutable_update_info());
+        mpl::write_to_client(server, reply);
+    });
+    future_watcher->setFuture(
+        QtConcurrent::run(&wait_pool, [this, server, name, vm, time_zone = request->time_zone(), timeout,
+                                       status_promise] {
+            try
+            {
+                vm->wait_until_ssh_up(timeout);
+
+                mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), vm->ssh_username(),
+                                       *config->ssh_key_provider};
+                for (const auto& command : warm_pool_handover_commands(name, time_zone))
+                    mpu::run_in_ssh_session(session, command);
+            }
+            catch (const std::exception& e)
+            {
+                mpl::log(mpl::Level::warning, category, fmt::format("Could not configure {}: {}", name, e.what()));
+            }
+
+            return async_wait_for_ready_all<LaunchReply>(server, std::vector<std::string>{name}, timeout,
+                                                         status_promise);
+        }));
+
+    return true;
+}
+
+void mp::Daemon::create(const CreateRequest* request, grpc::ServerWriterInterface<CreateReply>* server,
+                        std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    mpl::ClientLogger<CreateReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    finish_warming();
+    return create_vm(request, server, status_promise, /*start=*/false);
+}
+catch (const std::exception& e)
+{
+    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+}
+
+void mp::Daemon::launch(const LaunchRequest* request, grpc::ServerWriterInterface<LaunchReply>* server,
+                        std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    mpl::ClientLogger<LaunchReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    finish_warming();
+    if (metrics_opt_in.opt_in_status == OptInStatus::UNKNOWN || metrics_opt_in.opt_in_status == OptInStatus::LATER)
+    {
+        if (++metrics_opt_in.delay_opt_in_count % 3 == 0)
+        {
+            metrics_opt_in.opt_in_status = OptInStatus::PENDING;
+            persist_metrics_opt_in_data(metrics_opt_in, config->data_directory);
+
+            LaunchReply reply;
+            reply.set_metrics_pending(true);
+            mpl::write_to_client(server, reply);
+
+            return status_promise->set_value(grpc::Status::OK);
+        }
+
+        persist_metrics_opt_in_data(metrics_opt_in, config->data_directory);
+    }
+    else if (metrics_opt_in.opt_in_status == OptInStatus::PENDING)
+    {
+        if (request->opt_in_reply().opt_in_status() != OptInStatus::UNKNOWN)
+        {
+            metrics_opt_in.opt_in_status = request->opt_in_reply().opt_in_status();
+            persist_metrics_opt_in_data(metrics_opt_in, config->data_directory);
+
+            if (metrics_opt_in.opt_in_status == OptInStatus::DENIED)
+                metrics_provider.send_denied();
+        }
+    }
+
+    if (metrics_opt_in.opt_in_status == OptInStatus::ACCEPTED)
+        metrics_provider.send_metrics();
+
+    return create_vm(request, server, status_promise, /*start=*/true);
+}
+catch (const mp::StartException& e)
+{
+    auto name = e.name();
+
+    std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+    release_resources(name);
+    vm_instances.erase(name);
+    persist_instances();
+
+    status_promise->set_value(grpc::Status(grpc::StatusCode::ABORTED, e.what(), ""));
+}
+catch (const std::exception& e)
+{
+    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+}
+
+void mp::Daemon::purge(const PurgeRequest* request, grpc::ServerWriter<PurgeReply>* server,
+                       std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    finish_warming();
+    {
+        std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+        for (const auto& del : deleted_instances)
+            release_resources(del.first);
+
+        deleted_instances.clear();
+    }
+    persist_instances();
+
+    status_promise->set_value(grpc::Status::OK);
+}
+catch (const std::exception& e)
+{
+    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+}
+
+void mp::Daemon::find(const FindRequest* request, grpc::ServerWriter<FindReply>* server,
+                      std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    mpl::ClientLogger<FindReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    ReplyArena<FindReply> arena;
+    auto& response = arena.reply();
+    const auto default_remote{"release"};
+
+    if (!request->search_string().empty())
+    {
+        std::vector<std::pair<std::string, VMImageInfo>> vm_images_info;
+
+        try
+        {
+            vm_images_info = config->vault->all_info_for({"", request->search_string(), false, request->remote_name(),
+                                                          Query::Type::Alias, request->allow_unsupported()});
+        }
+        catch (const std::exception&)
+        {
+            try
+            {
+                vm_images_info.push_back(
+                    std::make_pair("", config->workflow_provider->info_for(request->search_string())));
+            }
+            catch (const std::exception&)
+            {
+                throw std::runtime_error(
+                    fmt::format("Unable to find an image or workflow matching \"{}\"", request->search_string()));
+            }
+        }
+
+        for (const auto& [remote, info] : vm_images_info)
+        {
+            std::string name;
+            if (info.aliases.contains(QString::fromStdString(request->search_string())))
+            {
+                name = request->search_string();
+            }
+            else
+            {
+                name = info.id.toStdString();
+                name.resize(12);
+            }
+
+            auto entry = response.add_images_info();
+            entry->set_os(info.os.toStdString());
+            entry->set_release(info.release_title.toStdString());
+            entry->set_version(info.version.toStdString());
+            auto alias_entry = entry->add_aliases_info();
+            if (!request->remote_name().empty() ||
+                (request->remote_name().empty() && vm_images_info.size() > 1 && remote != default_remote))
+            {
+                alias_entry->set_remote_name(remote);
+            }
+            alias_entry->set_alias(name);
+        }
+    }
+    else if (request->remote_name().empty())
+    {
+        // Clients that merge replies get each remote's images as soon as they are listed
+        std::string last_remote;
+        auto send_partial_reply = [request, server, &response] {
+            if (request->partial_replies() && response.images_info_size() > 0)
+            {
+                mpl::write_to_client(server, response);
+                response.Clear();
+            }
+        };
+
+        for (const auto& image_host : config->image_hosts)
+        {
+            std::unordered_set<std::string> images_found;
+            auto action = [&images_found, &default_remote, &last_remote, &send_partial_reply, request,
+                           &response](const std::string& remote, const mp::VMImageInfo& info) {
+                if ((info.supported || request->allow_unsupported()) && !info.aliases.empty() &&
+                    images_found.find(info.release_title.toStdString()) == images_found.end())
+                {
+                    if (remote != last_remote)
+                    {
+                        send_partial_reply();
+                        last_remote = remote;
+                    }
+
+                    add_aliases(response, remote, info, default_remote);
+                    images_found.insert(info.release_title.toStdString());
+                }
+            };
+
+            image_host->for_each_entry_do(action);
+        }
+        send_partial_reply();
+
+        auto vm_workflows_info = config->workflow_provider->all_workflows();
+
+        for (const auto& info : vm_workflows_info)
+        {
+            add_aliases(response, "", info, "");
+        }
+    }
+    else
+    {
+        const auto& remote = request->remote_name();
+        auto image_host = config->vault->image_host_for(remote);
+        auto vm_images_info = image_host->all_images_for(remote, request->allow_unsupported());
+
+        for (const auto& info : vm_images_info)
+        {
+            add_aliases(response, remote, info, "");
+        }
+    }
+    response.set_cache_ttl(find_reply_ttl.count());
+    mpl::write_to_client(server, response);
+    status_promise->set_value(grpc::Status::OK);
+}
+catch (const std::exception& e)
+{
+    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+}
+
+void mp::Daemon::info(const InfoRequest* request, grpc::ServerWriter<InfoReply>* server,
+                      std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    mpl::ClientLogger<InfoReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    ReplyArena<InfoReply> arena;
+    auto& response = arena.reply();
+
+    std::unique_ptr<RequestedFields> requested;
+    try
+    {
+        requested = std::make_unique<RequestedFields>(request->fields(), *InfoReply::Info::descriptor());
+    }
+    catch (const std::invalid_argument& e)
+    {
+        return status_promise->set_value(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, e.what(), ""));
+    }
+
+    const auto wants_probe = requested->any_of("load", "memory_usage", "memory_total", "disk_usage", "disk_total",
+                                               "ipv4", "current_release");
+    const auto wants_image = requested->any_of("image_release", "id", "current_release");
+
+    // Instances that do not answer within the budget are reported as they last answered, so that a few hung ones do
+    // not hold back the reply about all the others
+    const auto deadline = std::chrono::steady_clock::now() +
+                          (request->timeout() > 0 ? std::chrono::seconds{request->timeout()} : default_info_timeout);
+
+    // Only what the reply needs is copied under the lock, as the rest means reaching out to the instances, the vault
+    // and the image hosts, which must not hold back changes to the instances
+    struct Target
+    {
+        std::string name;
+        VirtualMachine::ShPtr vm; // null for warming or missing instances
+        bool warming{false};
+        bool deleted{false};
+        mp::optional<std::string> failure; // why it could not be brought up
+        VMSpecs specs;
+    };
+    std::vector<Target> targets;
+    {
+        std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+
+        auto target_for = [this](const std::string& name) {
+            Target target{name};
+            if (warming_instances.count(name))
+            {
+                target.warming = true;
+                return target;
+            }
+
+            if (auto failed = failed_instances.find(name); failed != failed_instances.end())
+            {
+                target.failure = failed->second;
+                return target;
+            }
+
+            auto it = vm_instances.find(name);
+            if (it == vm_instances.end())
+            {
+                it = deleted_instances.find(name);
+                if (it == deleted_instances.end())
+                    return target;
+                target.deleted = true;
+            }
+
+            target.vm = it->second;
+            target.specs = vm_instance_specs.at(name);
+            return target;
+        };
+
+        if (request->instance_names().instance_name().empty())
+        {
+            for (const auto& pair : vm_instances)
+                targets.push_back(target_for(pair.first));
+            for (const auto& pair : warming_instances)
+                if (!vm_instance_specs.at(pair.first).deleted)
+                    targets.push_back(target_for(pair.first));
+            for (const auto& pair : failed_instances)
+                targets.push_back(target_for(pair.first));
+        }
+        else
+        {
+            for (const auto& name : request->instance_names().instance_name())
+                targets.push_back(target_for(name));
+        }
+    }
+
+    fmt::memory_buffer errors;
+
+    struct Probe
+    {
+        InfoReply::Info* info;
+        std::shared_ptr<ProbeOutcome> outcome;
+    };
+    std::vector<Probe> probes;
+    auto batch = std::make_shared<ProbeBatch>();
+
+    for (const auto& target : targets)
+    {
+        const auto& name = target.name;
+        if (target.warming)
+        {
+            auto info = response.add_info();
+            info->set_name(name);
+            info->mutable_instance_status()->set_status(mp::InstanceStatus::WARMING);
+            continue;
+        }
+
+        if (target.failure)
+        {
+            auto info = response.add_info();
+            info->set_name(name);
+            info->mutable_instance_status()->set_status(mp::InstanceStatus::FAILED);
+            mpl::log(mpl::Level::warning, category,
+                     fmt::format("{} could not be brought up: {}", name, *target.failure));
+            continue;
+        }
+
+        if (!target.vm)
+        {
+            fmt::format_to(errors, "instance \"{}\" does not exist\n", name);
+            continue;
+        }
+
+        auto info = response.add_info();
+        const auto& vm = target.vm;
+        auto present_state = vm->current_state();
+        info->set_name(name);
+        if (target.deleted)
+        {
+            info->mutable_instance_status()->set_status(mp::InstanceStatus::DELETED);
+        }
+        else
+        {
+            info->mutable_instance_status()->set_status(grpc_instance_status_for(present_state));
+        }
+
+        std::string original_release;
+        if (wants_image)
+        {
+            auto vm_image = fetch_image_for(name, config->factory->fetch_type(), *config->vault);
+            original_release = vm_image.original_release;
+
+            if (!vm_image.id.empty() && original_release.empty())
+            {
+                try
+                {
+                    auto vm_image_info = config->image_hosts.back()->info_for_full_hash(vm_image.id);
+                    original_release = vm_image_info.release_title.toStdString();
+                }
+                catch (const std::exception& e)
+                {
+                    mpl::log(mpl::Level::warning, category,
+                             fmt::format("Cannot fetch image information: {}", e.what()));
+                }
+            }
+
+            info->set_image_release(original_release);
+            info->set_id(vm_image.id);
+        }
+
+        const auto& vm_specs = target.specs;
+
+        if (requested->any_of("mount_info"))
+        {
+            auto mount_info = info->mutable_mount_info();
+
+            mount_info->set_longest_path_len(0);
+
+            for (const auto& mount : vm_specs.mounts)
+            {
+                if (mount.second.source_path.size() > mount_info->longest_path_len())
+                {
+                    mount_info->set_longest_path_len(mount.second.source_path.size());
+                }
+
+                auto entry = mount_info->add_mount_paths();
+                entry->set_source_path(mount.second.source_path);
+                entry->set_target_path(mount.first);
+
+                for (const auto& uid_map : mount.second.uid_map)
+                {
+                    (*entry->mutable_mount_maps()->mutable_uid_map())[uid_map.first] = uid_map.second;
+                }
+                for (const auto& gid_map : mount.second.gid_map)
+                {
+                    (*entry->mutable_mount_maps()->mutable_gid_map())[gid_map.first] = gid_map.second;
+                }
+
+                if (const auto stats = instance_mounts.mount_stats(name, mount.first))
+                {
+                    auto entry_stats = entry->mutable_stats();
+                    for (const auto& operation : stats->operations)
+                    {
+                        auto entry_operation = entry_stats->add_operations();
+                        entry_operation->set_name(operation.first);
+                        entry_operation->set_count(operation.second.count);
+                        entry_operation->set_seconds(operation.second.seconds);
+                        entry_operation->set_max_seconds(operation.second.max_seconds);
+                    }
+                    entry_stats->set_bytes_read(stats->bytes_read);
+                    entry_stats->set_bytes_written(stats->bytes_written);
+                    entry_stats->set_slow_operations(stats->slow_operations);
+                }
+            }
+        }
+
+        if (requested->any_of("io_limits") && !vm_specs.io_limits.empty())
+            *info->mutable_io_limits() = io_limit_options_from(vm_specs.io_limits);
+
+        if (request->history_points() > 0 && requested->any_of("usage_history"))
+        {
+            for (const auto& point : usage_history.history(name, request->history_points()))
+            {
+                auto entry = info->add_usage_history();
+                entry->set_timestamp(std::chrono::duration_cast<std::chrono::seconds>(point.time.time_since_epoch())
+                                         .count());
+                entry->set_cpu_cores(point.cpu_cores.value_or(-1));
+                entry->set_memory_used(point.memory_used.value_or(-1));
+                entry->set_disk_used(point.disk_used.value_or(-1));
+                entry->set_net_rx_rate(point.net_rx_rate.value_or(-1));
+                entry->set_net_tx_rate(point.net_tx_rate.value_or(-1));
+            }
+        }
+
+        if (wants_probe && mp::utils::is_running(present_state))
+        {
+            // Probes mostly wait on the instances, so they all run at once
+            auto outcome = std::make_shared<ProbeOutcome>();
+            ++batch->pending;
+            QtConcurrent::run(&wait_pool, [this, vm, ssh_username = vm_specs.ssh_username, original_release, deadline,
+                                           outcome, batch] {
+                InfoReply::Info probed;
+                std::exception_ptr error;
+                try
+                {
+                    probe_running_instance(*vm, ssh_username, ssh_sessions, original_release, deadline, probed);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> batch_lock{batch->mutex};
+                outcome->info = std::move(probed);
+                outcome->error = error;
+                outcome->done = true;
+                --batch->pending;
+                batch->cv.notify_all();
+            });
+            probes.push_back({info, std::move(outcome)});
+        }
+    }
+
+    {
+        std::unique_lock<std::mutex> batch_lock{batch->mutex};
+        batch->cv.wait_until(batch_lock, deadline, [&batch] { return batch->pending == 0; });
+
+        std::lock_guard<decltype(last_probes_mutex)> last_probes_lock{last_probes_mutex};
+        for (auto& probe : probes)
+        {
+            const auto& name = probe.info->name();
+            if (probe.outcome->done && !probe.outcome->error)
+            {
+                probe.info->MergeFrom(probe.outcome->info);
+                last_probes[name] = probe.outcome->info;
+                continue;
+            }
+
+            std::string reason = "it did not answer in time";
+            if (probe.outcome->error)
+            {
+                try
+                {
+                    std::rethrow_exception(probe.outcome->error);
+                }
+                catch (const std::exception& e)
+                {
+                    reason = e.what();
+                }
+            }
+            mpl::log(mpl::Level::warning, category,
+                     fmt::format("Reporting what {} last answered, as probing it failed: {}", name, reason));
+
+            if (auto it = last_probes.find(name); it != last_probes.end())
+                probe.info->MergeFrom(it->second);
+            probe.info->set_stale(true);
+        }
+    }
+
+    auto status = grpc_status_for(errors);
+    if (status.ok())
+        mpl::write_to_client(server, response);
+
+    status_promise->set_value(status);
+}
+catch (const std::exception& e)
+{
+    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+}
+
+void mp::Daemon::list(const ListRequest* request, grpc::ServerWriter<ListReply>* server,
+                      std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    mpl::ClientLogger<ListReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    ReplyArena<ListReply> arena;
+    auto& response = arena.reply();
+
+    std::unique_ptr<RequestedFields> requested;
+    try
+    {
+        requested = std::make_unique<RequestedFields>(request->fields(), *ListVMInstance::descriptor());
+    }
+    catch (const std::invalid_argument& e)
+    {
+        return status_promise->set_value(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, e.what(), ""));
+    }
+
+    config->update_prompt->populate_if_time_to_show(response.mutable_update_info());
+
+    // Instances are looked at outside the lock, as that may mean reaching them over SSH
+    std::vector<std::pair<std::string, VirtualMachine::ShPtr>> instances;
+    std::vector<std::string> warming, failed, trashed_instances;
+    {
+        std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+        instances.assign(vm_instances.cbegin(), vm_instances.cend());
+        for (const auto& instance : warming_instances)
+            (vm_instance_specs.at(instance.first).deleted ? trashed_instances : warming).push_back(instance.first);
+        for (const auto& instance : failed_instances)
+            failed.push_back(instance.first);
+        for (const auto& instance : deleted_instances)
+            trashed_instances.push_back(instance.first);
+    }
+
+    for (const auto& instance : instances)
+    {
+        const auto& name = instance.first;
+        const auto& vm = instance.second;
+        auto present_state = vm->current_state();
+        auto entry = response.add_instances();
+        entry->set_name(name);
+        entry->mutable_instance_status()->set_status(grpc_instance_status_for(present_state));
+
+        if (requested->any_of("current_release"))
+            entry->set_current_release(current_release_for(name));
+
+        if (request->request_ipv4() && requested->any_of("ipv4") && mp::utils::is_running(present_state))
+        {
+            std::string management_ip = vm->management_ipv4();
+            auto all_ipv4 = vm->get_all_ipv4(*config->ssh_key_provider);
+
+            if (is_ipv4_valid(management_ip))
+                entry->add_ipv4(management_ip);
+            else if (all_ipv4.empty())
+                entry->add_ipv4("N/A");
+
+            for (const auto& extra_ipv4 : all_ipv4)
+                if (extra_ipv4 != management_ip)
+                    entry->add_ipv4(extra_ipv4);
+        }
+    }
+
+    for (const auto& name : warming)
+    {
+        auto entry = response.add_instances();
+        entry->set_name(name);
+        entry->mutable_instance_status()->set_status(mp::InstanceStatus::WARMING);
+    }
+
+    for (const auto& name : failed)
+    {
+        auto entry = response.add_instances();
+        entry->set_name(name);
+        entry->mutable_instance_status()->set_status(mp::InstanceStatus::FAILED);
+    }
+
+    for (const auto& name : trashed_instances)
+    {
+        auto entry = response.add_instances();
+        entry->set_name(name);
+        entry->mutable_instance_status()->set_status(mp::InstanceStatus::DELETED);
+    }
+
+    mpl::write_to_client(server, response);
+    status_promise->set_value(grpc::Status::OK);
+}
+catch (const std::exception& e)
+{
+    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+}
+
+void mp::Daemon::networks(const NetworksRequest* request, grpc::ServerWriter<NetworksReply>* server,
+                          std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    mpl::ClientLogger<NetworksReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    NetworksReply response;
+    config->update_prompt->populate_if_time_to_show(response.mutable_update_info());
+
+    const auto& iface_list = config->factory->networks();
+
+    for (const auto& iface : iface_list)
+    {
+        auto entry = response.add_interfaces();
+        entry->set_name(iface.id);
+        entry->set_type(iface.type);
+        entry->set_description(iface.description);
+    }
+
+    response.set_cache_ttl(networks_reply_ttl.count());
+    mpl::write_to_client(server, response);
+    status_promise->set_value(grpc::Status::OK);
+}
+catch (const std::exception& e)
+{
+    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+}
+
+void mp::Daemon::mount(const MountRequest* request, grpc::ServerWriterInterface<MountReply>* server,
+                       std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    mpl::ClientLogger<MountReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    finish_warming();
+
+    QFileInfo source_dir(QString::fromStdString(request->source_path()));
+    if (!source_dir.exists())
+    {
+        return status_promise->set_value(
+            grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                         fmt::format("source \"{}\" does not exist", request->source_path()), ""));
+    }
+
+    if (!source_dir.isDir())
+    {
+        return status_promise->set_value(
+            grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                         fmt::format("source \"{}\" is not a directory", request->source_path()), ""));
+    }
+
+    if (!source_dir.isReadable())
+    {
+        return status_promise->set_value(
+            grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                         fmt::format("source \"{}\" is not readable", request->source_path()), ""));
+    }
+
+    std::unordered_map<int, int> uid_map{request->mount_maps().uid_map().begin(),
+                                         request->mount_maps().uid_map().end()};
+    std::unordered_map<int, int> gid_map{request->mount_maps().gid_map().begin(),
+                                         request->mount_maps().gid_map().end()};
+
+    fmt::memory_buffer errors;
+    for (const auto& path_entry : request->target_paths())
+    {
+        const auto name = path_entry.instance_name();
+        auto it = vm_instances.find(name);
+        if (it == vm_instances.end())
+        {
+            fmt::format_to(errors, "instance \"{}\" does not exist\n", name);
+            continue;
+        }
+
+        auto target_path = path_entry.target_path();
+        if (mp::utils::invalid_target_path(QString::fromStdString(target_path)))
+        {
+            fmt::format_to(errors, "Unable to mount to \"{}\"\n", target_path);
+            continue;
+        }
+
+        if (instance_mounts.has_instance_already_mounted(name, target_path))
+        {
+            fmt::format_to(errors, "\"{}:{}\" is already mounted\n", name, target_path);
+            continue;
+        }
+
+        auto& vm = it->second;
+        auto& vm_specs = vm_instance_specs[name];
+
+        if (request->mount_type() == MountRequest::NATIVE)
+        {
+            // The hypervisor only shares directories it was started with
+            const auto state = vm->current_state();
+            if (state != mp::VirtualMachine::State::off && state != mp::VirtualMachine::State::stopped)
+            {
+                fmt::format_to(errors, "Please stop \"{}\" to add a native mount to it\n", name);
+                continue;
+            }
+
+            if (vm_specs.mounts.find(target_path) != vm_specs.mounts.end())
+            {
+                fmt::format_to(errors, "There is already a mount defined for \"{}:{}\"\n", name, target_path);
+                continue;
+            }
+
+            std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+            vm_specs.mounts[target_path] = {request->source_path(), gid_map, uid_map, VMMount::Type::native};
+            try
+            {
+                vm->set_native_mounts(native_mounts_for(name, vm_specs.mounts));
+            }
+            catch (const mp::NotImplementedOnThisBackendException& e)
+            {
+                vm_specs.mounts.erase(target_path);
+                fmt::format_to(errors, "error mounting \"{}\": {}\n", target_path, e.what());
+            }
+
+            continue;
+        }
+
+        if (vm->current_state() == mp::VirtualMachine::State::running)
+        {
+            try
+            {
+                instance_mounts.start_mount(vm.get(), request->source_path(), target_path, gid_map, uid_map,
+                                            request->compression());
+            }
+            catch (const mp::SSHFSMissingError&)
+            {
+                try
+                {
+                    // Force the deleteLater() event to process now to avoid unloading the apparmor profile
+                    // later.  See https://github.com/canonical/multipass/issues/1131
+                    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+
+                    MountReply mount_reply;
+                    mount_reply.set_mount_message("Enabling support for mounting");
+                    mpl::write_to_client(server, mount_reply);
+
+                    mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), vm_specs.ssh_username,
+                                           *config->ssh_key_provider};
+                    install_sshfs_in(name, *vm, vm_specs.ssh_username, session, *config->ssh_key_provider,
+                                     sshfs_snap_cache);
+                    instance_mounts.start_mount(vm.get(), request->source_path(), target_path, gid_map, uid_map,
+                                                request->compression());
+                }
+                catch (const mp::SSHFSMissingError&)
+                {
+                    return status_promise->set_value(grpc_status_for_mount_error(name));
+                }
+            }
+            catch (const std::exception& e)
+            {
+                fmt::format_to(errors, "error mounting \"{}\": {}", target_path, e.what());
+                continue;
+            }
+        }
+
+        if (vm_specs.mounts.find(target_path) != vm_specs.mounts.end())
+        {
+            fmt::format_to(errors, "There is already a mount defined for \"{}:{}\"\n", name, target_path);
+            continue;
+        }
+
+        VMMount mount{request->source_path(), gid_map, uid_map, VMMount::Type::classic, request->compression()};
+        std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+        vm_specs.mounts[target_path] = mount;
+    }
+
+    std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+    persist_instances();
+
+    status_promise->set_value(grpc_status_for(errors));
+}
+catch (const std::exception& e)
+{
+    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+}
+
+void mp::Daemon::recover(const RecoverRequest* request, grpc::ServerWriter<RecoverReply>* server,
+                         std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    mpl::ClientLogger<RecoverReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    finish_warming();
+
+    const auto [instances, status] =
+        find_requested_instances(request->instance_names().instance_name(), deleted_instances,
+                                 std::bind(&Daemon::check_instance_exists, this, std::placeholders::_1));
+
+    if (status.ok())
+    {
+        std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+        for (const auto& name : instances)
+        {
+            auto it = deleted_instances.find(name);
+            if (it != std::end(deleted_instances))
+            {
+                assert(vm_instance_specs[name].deleted);
+                vm_instance_specs[name].deleted = false;
+                vm_instances[name] = std::move(it->second);
+                deleted_instances.erase(it);
+            }
+            else
+            {
+                mpl::log(mpl::Level::debug, category,
+                         fmt::format("instance \"{}\" does not need to be recovered", name));
+            }
+        }
+
+        persist_instances();
+    }
+
+    // The others are gone, but those with their disk being compacted are left for later
+    if (busy_errors.size())
+        return status_promise->set_value(grpc_status_for(busy_errors));
+
+    status_promise->set_value(status);
+}
+catch (const std::exception& e)
+{
+    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+}
+
+void mp::Daemon::ssh_info(const SSHInfoRequest* request, grpc::ServerWriter<SSHInfoReply>* server,
+                          bool local_client, std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    mpl::ClientLogger<SSHInfoReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    SSHInfoReply response;
+
+    // Shells and commands get here first, so this is where they bring back an instance that was suspended for idling
+    for (const auto& name : request->instance_name())
+        resume_if_idle(name);
+
+    std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+    for (const auto& name : request->instance_name())
+    {
+        auto it = vm_instances.find(name);
+        if (it == vm_instances.end())
+        {
+            if (warming_instances.count(name))
+                return status_promise->set_value(grpc::Status{
+                    grpc::StatusCode::UNAVAILABLE, fmt::format("instance \"{}\" is still being brought up", name)});
+            else if (auto failed = failed_instances.find(name); failed != failed_instances.end())
+                return status_promise->set_value(grpc::Status{
+                    grpc::StatusCode::FAILED_PRECONDITION,
+                    fmt::format("instance \"{}\" could not be brought up: {}", name, failed->second)});
+            else if (deleted_instances.find(name) == deleted_instances.end())
+                return status_promise->set_value(
+                    grpc::Status{grpc::StatusCode::NOT_FOUND, fmt::format("instance \"{}\" does not exist", name)});
+            else
+                return status_promise->set_value(
+                    grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, fmt::format("instance \"{}\" is deleted", name)});
+        }
+
+        auto& vm = it->second;
+        if (vm->current_state() == VirtualMachine::State::unknown)
+            throw std::runtime_error("Cannot retrieve credentials in unknown state");
+
+        if (!mp::utils::is_running(vm->current_state()))
+        {
+            return status_promise->set_value(
+                grpc::Status(grpc::StatusCode::ABORTED, fmt::format("instance \"{}\" is not running", name)));
+        }
+
+        if (vm->state == VirtualMachine::State::delayed_shutdown)
+        {
+            if (delayed_shutdown_instances.at(name)->get_time_remaining() <= std::chrono::minutes(1))
+            {
+                return status_promise->set_value(
+                    grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                                 fmt::format("\"{}\" is scheduled to shut down in less than a minute, use "
+                                             "'multipass stop --cancel {}' to cancel the shutdown.",
+                                             name, name),
+                                 ""));
+            }
+        }
+
+        // Other hosts cannot reach the instance over vsock, only over its network
+        auto host = vm->ssh_hostname();
+        if (!local_client && SSHSession::is_vsock_host(host))
+        {
+            host = vm->management_ipv4();
+            if (host == "UNKNOWN")
+                return status_promise->set_value(grpc::Status(
+                    grpc::StatusCode::UNAVAILABLE, fmt::format("instance \"{}\" has no network address yet", name)));
+        }
+
+        mp::SSHInfo ssh_info;
+        ssh_info.set_host(host);
+        ssh_info.set_port(vm->ssh_port());
+        ssh_info.set_priv_key_base64(config->ssh_key_provider->private_key_as_base64());
+        ssh_info.set_username(vm->ssh_username());
+        (*response.mutable_ssh_info())[name] = ssh_info;
+    }
+
+    mpl::write_to_client(server, response);
+    status_promise->set_value(grpc::Status::OK);
+}
+catch (const std::exception& e)
+{
+    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+}
+
+void mp::Daemon::start(const StartRequest* request, grpc::ServerWriterInterface<StartReply>* server,
+                       std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    mpl::ClientLogger<StartReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    finish_warming();
+
+    auto timeout = request->timeout() > 0 ? std::chrono::seconds(request->timeout()) : mp::default_timeout;
+
+    if (!instances_running(vm_instances))
+        config->factory->hypervisor_health_check();
+
+    mp::StartError start_error;
+    auto* errors = start_error.mutable_instance_errors();
+
+    std::vector<decltype(vm_instances)::key_type> vms;
+    for (const auto& name : request->instance_names().instance_name())
+    {
+        auto it = vm_instances.find(name);
+        if (it == vm_instances.end())
+            errors->insert({name, deleted_instances.find(name) == deleted_instances.end()
+                                      ? mp::StartError::DOES_NOT_EXIST
+                                      : mp::StartError::INSTANCE_DELETED});
+        else if (it->second->current_state() == VirtualMachine::State::delayed_shutdown)
+            cancel_delayed_shutdown(name);
+        else if (it->second->current_state() != VirtualMachine::State::running)
+            vms.push_back(name);
+    }
+
+    if (start_error.instance_errors_size())
+        return status_promise->set_value(
+            grpc::Status(grpc::StatusCode::ABORTED, "instance(s) missing", start_error.SerializeAsString()));
+
+    if (request->instance_names().instance_name().empty())
+    {
+        for (auto& pair : vm_instances)
+        {
+            if (pair.second->current_state() == VirtualMachine::State::running)
+                continue;
+            vms.push_back(pair.first);
+        }
+    }
+
+    AdmissionPolicy::Load demand{0, 0};
+    for (const auto& name : vms)
+        demand = demand + load_of(vm_instance_specs.at(name));
+
+    auto retry = [this, request, server, status_promise] { start(request, server, status_promise); };
+    auto notify_position = [server](std::size_t position) {
+        StartReply reply;
+        reply.set_reply_message(queue_message(position));
+        return mpl::write_to_client(server, reply);
+    };
+    if (!vms.empty() && !admit(demand, retry, notify_position, status_promise))
+        return;
+
+    // Read on each request, so that a change applies to the next start
+    const auto concurrency = MP_SETTINGS.get(mp::start_concurrency_key);
+
+    auto batch = std::make_shared<StartBatch>();
+    batch->pending = {vms.cbegin(), vms.cend()};
+    batch->limit = concurrency.isEmpty() ? vms.size() : std::max(concurrency.toInt(), 1);
+    batch->timeout = timeout;
+    batch->server = server;
+    batch->status_promise = status_promise;
+
+    start_next_instances(batch);
+}
+catch (const std::exception& e)
+{
+    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+}
+
+void mp::Daemon::stop(const StopRequest* request, grpc::ServerWriter<StopReply>* server,
+                      std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    mpl::ClientLogger<StopReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    finish_warming();
+
+    auto [instances, status] =
+        find_requested_instances(request->instance_names().instance_name(), vm_instances,
+                                 std::bind(&Daemon::check_instance_operational, this, std::placeholders::_1));
+
+    if (status.ok())
+    {
+        std::function<grpc::Status(VirtualMachine&)> operation;
+        std::unordered_map<std::string, mp::optional<SSHSession>> sessions;
+        if (request->cancel_shutdown())
+            operation = std::bind(&Daemon::cancel_vm_shutdown, this, std::placeholders::_1);
+        else
+        {
+            // Connecting is the slow part and can be done for all the instances at once, unlike the shutdown itself,
+            // which is driven from this thread
+            std::mutex sessions_mutex;
+            status = cmd_vms_concurrently(
+                instances, [this, &sessions, &sessions_mutex](VirtualMachine& vm, VirtualMachine::State state) {
+                    auto session = shutdown_session_for(vm, state, *config->ssh_key_provider);
+
+                    std::lock_guard<decltype(sessions_mutex)> lock{sessions_mutex};
+                    sessions[vm.vm_name] = std::move(session);
+                    return grpc::Status::OK;
+                });
+
+            operation = [this, &sessions, delay = std::chrono::minutes(request->time_minutes())](VirtualMachine& vm) {
+                return shutdown_vm(vm, delay, std::move(sessions.at(vm.vm_name)));
+            };
+        }
+
+        if (status.ok())
+            status = cmd_vms(instances, operation);
+    }
+
+    status_promise->set_value(status);
+}
+catch (const std::exception& e)
+{
+    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+}
+
+void mp::Daemon::suspend(const SuspendRequest* request, grpc::ServerWriter<SuspendReply>* server,
+                         std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    mpl::ClientLogger<SuspendReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    finish_warming();
+
+    fmt::memory_buffer errors;
+    std::vector<decltype(vm_instances)::key_type> instances_to_suspend;
+    for (const auto& name : request->instance_names().instance_name())
+    {
+        auto it = vm_instances.find(name);
+        if (it == vm_instances.end())
+        {
+            it = deleted_instances.find(name);
+            if (it == deleted_instances.end())
+                fmt::format_to(errors, "instance \"{}\" does not exist\n", name);
+            else
+                fmt::format_to(errors, "instance \"{}\" is deleted\n", name);
+            continue;
+        }
+        // What it wrote to its disk is gone once qemu exits, so there is nothing to resume from
+        if (vm_instance_specs[name].ephemeral)
+        {
+            fmt::format_to(errors, "instance \"{}\" is ephemeral and cannot be suspended\n", name);
+            continue;
+        }
+        instances_to_suspend.push_back(name);
+    }
+
+    auto status = grpc_status_for(errors);
+    if (status.ok())
+    {
+        if (instances_to_suspend.empty())
+        {
+            for (auto& pair : vm_instances)
+                if (!vm_instance_specs[pair.first].ephemeral)
+                    instances_to_suspend.push_back(pair.first);
+        }
+
+        status = cmd_vms(instances_to_suspend, [this](auto& vm) {
+            vm.suspend();
+            instance_mounts.stop_all_mounts_for_instance(vm.vm_name);
+
+            // Suspended on purpose, so it is for the user to bring it back
+            std::lock_guard<decltype(idle_mutex)> lock{idle_mutex};
+            idle_suspended.erase(vm.vm_name);
+            return grpc::Status::OK;
+        });
+    }
+
+    status_promise->set_value(status);
+}
+catch (const std::exception& e)
+{
+    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+}
+
+void mp::Daemon::restart(const RestartRequest* request, grpc::ServerWriterInterface<RestartReply>* server,
+                         std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    mpl::ClientLogger<RestartReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    finish_warming();
+
+    auto timeout = request->timeout() > 0 ? std::chrono::seconds(request->timeout()) : mp::default_timeout;
+
+    auto [instances, status] =
+        find_requested_instances(request->instance_names().instance_name(), vm_instances,
+                                 std::bind(&Daemon::check_instance_operational, this, std::placeholders::_1));
+
+    if (!status.ok())
+    {
+        return status_promise->set_value(status);
+    }
+
+    for (const auto& name : instances)
+        cancel_delayed_shutdown(name); // the timers belong to this thread
+
+    status = cmd_vms_concurrently(instances, std::bind(&Daemon::reboot_vm, this, std::placeholders::_1,
+                                                       std::placeholders::_2)); // 1st pass to reboot all targets
+
+    if (!status.ok())
+    {
+        return status_promise->set_value(status);
+    }
+
+    auto future_watcher = create_future_watcher();
+    future_watcher->setFuture(QtConcurrent::run(&wait_pool, this, &Daemon::async_wait_for_ready_all<RestartReply>,
+                                                server, instances, timeout, status_promise));
+}
+catch (const std::exception& e)
+{
+    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+}
+
+void mp::Daemon::delet(const DeleteRequest* request, grpc::ServerWriter<DeleteReply>* server,
+                       std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    mpl::ClientLogger<DeleteReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    finish_warming();
+
+    const auto [operational_instances_to_delete, trashed_instances_to_delete, status] =
+        find_instances_to_delete(request->instance_names().instance_name(), vm_instances, deleted_instances);
+    fmt::memory_buffer busy_errors;
+
+    if (status.ok())
+    {
+        const bool purge = request->purge();
+
+        for (const auto& name : operational_instances_to_delete)
+        {
+            std::unique_lock<std::mutex> operation_lock;
+            try
+            {
+                operation_lock = lock_operations_unless_compacting(name);
+            }
+            catch (const std::runtime_error& e)
+            {
+                fmt::format_to(busy_errors, "{}\n", e.what());
+                continue;
+            }
+            assert(!vm_instance_specs[name].deleted);
+
+            auto& instance = vm_instances[name];
+
+            if (instance->current_state() == VirtualMachine::State::delayed_shutdown)
+                cancel_delayed_shutdown(name);
+
+            instance_mounts.stop_all_mounts_for_instance(name);
+            instance->shutdown();
+
+            std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+            if (purge)
+                release_resources(name);
+            else
+            {
+                deleted_instances[name] = std::move(instance);
+                vm_instance_specs[name].deleted = true;
+            }
+
+            vm_instances.erase(name);
+        }
 
-    const auto& iface_list = config->factory->networks();
+        std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+        if (purge)
+        {
+            for (const auto& name : trashed_instances_to_delete)
+            {
+                assert(vm_instance_specs[name].deleted);
+                release_resources(name);
+                deleted_instances.erase(name);
+            }
+        }
 
-    for (const auto& iface : iface_list)
-    {
-        auto entry = response.add_interfaces();
-        entry->set_name(iface.id);
-        entry->set_type(iface.type);
-        entry->set_description(iface.description);
+        persist_instances();
     }
 
-    server->Write(response);
-    status_promise->set_value(grpc::Status::OK);
+    // The others are gone, but those with their disk being compacted are left for later
+    if (busy_errors.size())
+        return status_promise->set_value(grpc_status_for(busy_errors));
+
+    status_promise->set_value(status);
 }
 catch (const std::exception& e)
 {
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::mount(const MountRequest* request, grpc::ServerWriter<MountReply>* server,
-                       std::promise<grpc::Status>* status_promise) // clang-format off
+void mp::Daemon::umount(const UmountRequest* request, grpc::ServerWriter<UmountReply>* server,
+                        std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
-    mpl::ClientLogger<MountReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
-
-    QFileInfo source_dir(QString::fromStdString(request->source_path()));
-    if (!source_dir.exists())
-    {
-        return status_promise->set_value(
-            grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
-                         fmt::format("source \"{}\" does not exist", request->source_path()), ""));
-    }
-
-    if (!source_dir.isDir())
-    {
-        return status_promise->set_value(
-            grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
-                         fmt::format("source \"{}\" is not a directory", request->source_path()), ""));
-    }
-
-    if (!source_dir.isReadable())
-    {
-        return status_promise->set_value(
-            grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
-                         fmt::format("source \"{}\" is not readable", request->source_path()), ""));
-    }
-
-    std::unordered_map<int, int> uid_map{request->mount_maps().uid_map().begin(),
-                                         request->mount_maps().uid_map().end()};
-    std::unordered_map<int, int> gid_map{request->mount_maps().gid_map().begin(),
-                                         request->mount_maps().gid_map().end()};
+    mpl::ClientLogger<UmountReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    finish_warming();
 
     fmt::memory_buffer errors;
     for (const auto& path_entry : request->target_paths())
@@ -1464,66 +3972,75 @@ try // clang-format on
         }
 
         auto target_path = path_entry.target_path();
-        if (mp::utils::invalid_target_path(QString::fromStdString(target_path)))
-        {
-            fmt::format_to(errors, "Unable to mount to \"{}\"\n", target_path);
-            continue;
-        }
-
-        if (instance_mounts.has_instance_already_mounted(name, target_path))
-        {
-            fmt::format_to(errors, "\"{}:{}\" is already mounted\n", name, target_path);
-            continue;
-        }
-
+        auto& mounts = vm_instance_specs[name].mounts;
         auto& vm = it->second;
-        auto& vm_specs = vm_instance_specs[name];
 
-        if (vm->current_state() == mp::VirtualMachine::State::running)
+        // Empty target path indicates removing all mounts for the VM instance
+        if (target_path.empty())
         {
-            try
-            {
-                instance_mounts.start_mount(vm.get(), request->source_path(), target_path, gid_map, uid_map);
-            }
-            catch (const mp::SSHFSMissingError&)
+            instance_mounts.stop_all_mounts_for_instance(name);
+            if (vm->current_state() == mp::VirtualMachine::State::running &&
+                std::any_of(mounts.cbegin(), mounts.cend(),
+                            [](const auto& mount) { return mount.second.type == VMMount::Type::native; }))
             {
                 try
                 {
-                    // Force the deleteLater() event to process now to avoid unloading the apparmor profile
-                    // later.  See https://github.com/canonical/multipass/issues/1131
-                    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
-
-                    MountReply mount_reply;
-                    mount_reply.set_mount_message("Enabling support for mounting");
-                    server->Write(mount_reply);
-
-                    mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), vm_specs.ssh_username,
+                    mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), vm_instance_specs[name].ssh_username,
                                            *config->ssh_key_provider};
-                    mp::utils::install_sshfs_for(name, session);
-                    instance_mounts.start_mount(vm.get(), request->source_path(), target_path, gid_map, uid_map);
+                    for (const auto& mount : mounts)
+                        if (mount.second.type == VMMount::Type::native)
+                            umount_native_in(session, mount.first);
                 }
-                catch (const mp::SSHFSMissingError&)
+                catch (const std::exception& e)
                 {
-                    return status_promise->set_value(grpc_status_for_mount_error(name));
+                    fmt::format_to(errors, "error unmounting native mounts of \"{}\": {}\n", name, e.what());
                 }
             }
-            catch (const std::exception& e)
+
+            std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+            mounts.clear();
+        }
+        else
+        {
+            const auto mount = mounts.find(target_path);
+            const auto native = mount != mounts.end() && mount->second.type == VMMount::Type::native;
+
+            if (vm->current_state() == mp::VirtualMachine::State::running)
             {
-                fmt::format_to(errors, "error mounting \"{}\": {}", target_path, e.what());
-                continue;
+                if (native)
+                {
+                    try
+                    {
+                        mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), vm_instance_specs[name].ssh_username,
+                                               *config->ssh_key_provider};
+                        umount_native_in(session, target_path);
+                    }
+                    catch (const std::exception& e)
+                    {
+                        fmt::format_to(errors, "error unmounting \"{}\": {}\n", target_path, e.what());
+                    }
+                }
+                else if (!instance_mounts.stop_mount(name, target_path))
+                {
+                    fmt::format_to(errors, "\"{}\" is not mounted\n", target_path);
+                }
             }
-        }
 
-        if (vm_specs.mounts.find(target_path) != vm_specs.mounts.end())
-        {
-            fmt::format_to(errors, "There is already a mount defined for \"{}:{}\"\n", name, target_path);
-            continue;
+            std::unique_lock<decltype(instances_mutex)> lock{instances_mutex};
+            auto erased = mounts.erase(target_path);
+            lock.unlock();
+
+            if (!erased)
+            {
+                fmt::format_to(errors, "\"{}\" not found in database\n", target_path);
+            }
         }
 
-        VMMount mount{request->source_path(), gid_map, uid_map};
-        vm_specs.mounts[target_path] = mount;
+        // Native mounts are gone from the next boot
+        vm->set_native_mounts(native_mounts_for(name, mounts));
     }
 
+    std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
     persist_instances();
 
     status_promise->set_value(grpc_status_for(errors));
@@ -1533,393 +4050,746 @@ catch (const std::exception& e)
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::recover(const RecoverRequest* request, grpc::ServerWriter<RecoverReply>* server,
-                         std::promise<grpc::Status>* status_promise) // clang-format off
-try // clang-format on
+void mp::Daemon::version(const VersionRequest* request, grpc::ServerWriter<VersionReply>* server,
+                         std::promise<grpc::Status>* status_promise)
 {
-    mpl::ClientLogger<RecoverReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    mpl::ClientLogger<VersionReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
 
-    const auto [instances, status] =
-        find_requested_instances(request->instance_names().instance_name(), deleted_instances,
-                                 std::bind(&Daemon::check_instance_exists, this, std::placeholders::_1));
+    VersionReply reply;
+    reply.set_version(multipass::version_string);
+    config->update_prompt->populate(reply.mutable_update_info());
+    reply.set_cache_ttl(version_reply_ttl.count());
+    mpl::write_to_client(server, reply);
+    status_promise->set_value(grpc::Status::OK);
+}
 
-    if (status.ok())
+void mp::Daemon::watch(const WatchRequest* request, grpc::ServerWriterInterface<WatchReply>* server,
+                       std::promise<grpc::Status>* status_promise)
+{
     {
-        for (const auto& name : instances)
-        {
-            auto it = deleted_instances.find(name);
-            if (it != std::end(deleted_instances))
-            {
-                assert(vm_instance_specs[name].deleted);
-                vm_instance_specs[name].deleted = false;
-                vm_instances[name] = std::move(it->second);
-                deleted_instances.erase(it);
-            }
-            else
-            {
-                mpl::log(mpl::Level::debug, category,
-                         fmt::format("instance \"{}\" does not need to be recovered", name));
-            }
-        }
-
-        persist_instances();
+        std::lock_guard<decltype(watchers_mutex)> lock{watchers_mutex};
+        status_watchers.push_back({server, status_promise});
     }
 
-    status_promise->set_value(status);
+    // Instances are only asked for their state on the main thread, which sends the first reply from there
+    QMetaObject::invokeMethod(this, [this] { push_status_changes(); }, Qt::QueuedConnection);
 }
-catch (const std::exception& e)
+
+void mp::Daemon::unwatch(grpc::ServerWriterInterface<WatchReply>* server)
 {
-    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+    {
+        std::lock_guard<decltype(watchers_mutex)> lock{watchers_mutex};
+        status_watchers.erase(std::remove_if(status_watchers.begin(), status_watchers.end(),
+                                             [server](const auto& watcher) { return watcher.server == server; }),
+                              status_watchers.end());
+    }
+
+    // A write already under way must be through before the call it writes to can go
+    std::lock_guard<decltype(watch_writes_mutex)> writes_lock{watch_writes_mutex};
 }
 
-void mp::Daemon::ssh_info(const SSHInfoRequest* request, grpc::ServerWriter<SSHInfoReply>* server,
-                          std::promise<grpc::Status>* status_promise) // clang-format off
+void mp::Daemon::bake(const BakeRequest* request, grpc::ServerWriter<BakeReply>* server,
+                      std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
-    mpl::ClientLogger<SSHInfoReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
-    SSHInfoReply response;
+    mpl::ClientLogger<BakeReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    finish_warming();
 
-    for (const auto& name : request->instance_name())
-    {
-        auto it = vm_instances.find(name);
-        if (it == vm_instances.end())
-        {
-            if (deleted_instances.find(name) == deleted_instances.end())
-                return status_promise->set_value(
-                    grpc::Status{grpc::StatusCode::NOT_FOUND, fmt::format("instance \"{}\" does not exist", name)});
-            else
-                return status_promise->set_value(
-                    grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, fmt::format("instance \"{}\" is deleted", name)});
-        }
+    const auto& name = request->instance_name();
+    const auto image_name = request->image_name().empty() ? name : request->image_name();
 
-        auto& vm = it->second;
-        if (vm->current_state() == VirtualMachine::State::unknown)
-            throw std::runtime_error("Cannot retrieve credentials in unknown state");
+    auto error = check_instance_operational(name);
+    if (!error.empty())
+        return status_promise->set_value(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, error, ""));
 
-        if (!mp::utils::is_running(vm->current_state()))
-        {
-            return status_promise->set_value(
-                grpc::Status(grpc::StatusCode::ABORTED, fmt::format("instance \"{}\" is not running", name)));
-        }
+    if (!mp::utils::valid_hostname(image_name))
+        return status_promise->set_value(
+            grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, fmt::format("Invalid image name \"{}\"", image_name), ""));
 
-        if (vm->state == VirtualMachine::State::delayed_shutdown)
-        {
-            if (delayed_shutdown_instances[name]->get_time_remaining() <= std::chrono::minutes(1))
+    VirtualMachine::ShPtr vm;
+    {
+        std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+        vm = vm_instances.at(name);
+    }
+
+    if (vm->current_state() != VirtualMachine::State::running)
+        return status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                                                      fmt::format("instance \"{}\" must be running", name), ""));
+
+    // Waiting for cloud-init and copying the disk can each take minutes, so both are left to workers; the main thread
+    // only stops the instance in between
+    auto prepared = std::make_shared<bool>(false);
+    auto prepare_watcher = create_future_watcher([this, server, status_promise, name, image_name, vm, prepared] {
+        if (!*prepared)
+            return; // the failure is reported with the operation's status
+
+        auto status = shutdown_vm(*vm, std::chrono::milliseconds::zero(), mp::nullopt);
+        if (!status.ok())
+            return status_promise->set_value(status);
+
+        auto baked = std::make_shared<bool>(false);
+        auto bake_watcher = create_future_watcher([server, image_name, baked] {
+            if (!*baked)
+                return;
+
+            BakeReply reply;
+            reply.set_image_name(fmt::format("{}:{}", mp::baked_remote_name, image_name));
+            mpl::write_to_client(server, reply);
+        });
+        bake_watcher->setFuture(QtConcurrent::run(&wait_pool, [this, name, image_name, status_promise, baked] {
+            try
             {
-                return status_promise->set_value(
-                    grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
-                                 fmt::format("\"{}\" is scheduled to shut down in less than a minute, use "
-                                             "'multipass stop --cancel {}' to cancel the shutdown.",
-                                             name, name),
-                                 ""));
+                auto operation_lock = lock_operations_on(name);
+                config->vault->bake(name, image_name);
+                *baked = true;
+                return AsyncOperationStatus{grpc::Status::OK, status_promise};
             }
+            catch (const std::exception& e)
+            {
+                return AsyncOperationStatus{grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""),
+                                            status_promise};
+            }
+        }));
+    });
+    prepare_watcher->setFuture(QtConcurrent::run(&wait_pool, [this, name, vm, status_promise, prepared] {
+        try
+        {
+            auto operation_lock = lock_operations_on(name);
+            mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), vm->ssh_username(), *config->ssh_key_provider};
+            mpu::run_in_ssh_session(session, bake_preparation_cmd);
+            *prepared = true;
+            return AsyncOperationStatus{grpc::Status::OK, nullptr}; // the status comes once the image is kept
         }
-
-        mp::SSHInfo ssh_info;
-        ssh_info.set_host(vm->ssh_hostname());
-        ssh_info.set_port(vm->ssh_port());
-        ssh_info.set_priv_key_base64(config->ssh_key_provider->private_key_as_base64());
-        ssh_info.set_username(vm->ssh_username());
-        (*response.mutable_ssh_info())[name] = ssh_info;
-    }
-
-    server->Write(response);
-    status_promise->set_value(grpc::Status::OK);
+        catch (const std::exception& e)
+        {
+            return AsyncOperationStatus{
+                grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                             fmt::format("Could not prepare {} for baking: {}", name, e.what()), ""),
+                status_promise};
+        }
+    }));
 }
 catch (const std::exception& e)
 {
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::start(const StartRequest* request, grpc::ServerWriter<StartReply>* server,
+void mp::Daemon::stats(const StatsRequest* request, grpc::ServerWriter<StatsReply>* server,
                        std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
-    mpl::ClientLogger<StartReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
-
-    auto timeout = request->timeout() > 0 ? std::chrono::seconds(request->timeout()) : mp::default_timeout;
-
-    if (!instances_running(vm_instances))
-        config->factory->hypervisor_health_check();
-
-    mp::StartError start_error;
-    auto* errors = start_error.mutable_instance_errors();
-
-    std::vector<decltype(vm_instances)::key_type> vms;
-    for (const auto& name : request->instance_names().instance_name())
-    {
-        auto it = vm_instances.find(name);
-        if (it == vm_instances.end())
-            errors->insert({name, deleted_instances.find(name) == deleted_instances.end()
-                                      ? mp::StartError::DOES_NOT_EXIST
-                                      : mp::StartError::INSTANCE_DELETED});
-        else if (it->second->current_state() == VirtualMachine::State::delayed_shutdown)
-            delayed_shutdown_instances.erase(name);
-        else if (it->second->current_state() != VirtualMachine::State::running)
-            vms.push_back(name);
-    }
-
-    if (start_error.instance_errors_size())
-        return status_promise->set_value(
-            grpc::Status(grpc::StatusCode::ABORTED, "instance(s) missing", start_error.SerializeAsString()));
-
-    if (request->instance_names().instance_name().empty())
-    {
-        for (auto& pair : vm_instances)
-        {
-            if (pair.second->current_state() == VirtualMachine::State::running)
-                continue;
-            vms.push_back(pair.first);
-        }
-    }
-
-    for (const auto& name : vms)
-    {
-        auto it = vm_instances.find(name);
-        auto state = it->second->current_state();
-        if (state != VirtualMachine::State::starting && state != VirtualMachine::State::restarting)
-            it->second->start();
-    }
+    mpl::ClientLogger<StatsReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
 
-    auto future_watcher = create_future_watcher();
-    future_watcher->setFuture(
-        QtConcurrent::run(this, &Daemon::async_wait_for_ready_all<StartReply>, server, vms, timeout, status_promise));
+    StatsReply reply;
+    reply.set_openmetrics(MP_INSTRUMENTATION.openmetrics());
+    if (request->trace())
+        reply.set_trace(MP_INSTRUMENTATION.chrome_trace());
+    mpl::write_to_client(server, reply);
+
+    status_promise->set_value(grpc::Status::OK);
 }
 catch (const std::exception& e)
 {
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::stop(const StopRequest* request, grpc::ServerWriter<StopReply>* server,
-                      std::promise<grpc::Status>* status_promise) // clang-format off
+void mp::Daemon::bench_mount(const BenchMountRequest* request, grpc::ServerWriter<BenchMountReply>* server,
+                             std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
-    mpl::ClientLogger<StopReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    mpl::ClientLogger<BenchMountReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    finish_warming();
 
-    auto [instances, status] =
-        find_requested_instances(request->instance_names().instance_name(), vm_instances,
-                                 std::bind(&Daemon::check_instance_operational, this, std::placeholders::_1));
+    const auto& name = request->instance_name();
+    const auto& target_path = request->target_path();
+    auto it = vm_instances.find(name);
+    if (it == vm_instances.end())
+        return status_promise->set_value(
+            grpc::Status(grpc::StatusCode::NOT_FOUND, fmt::format("instance \"{}\" does not exist", name), ""));
+
+    auto& vm = it->second;
+    if (vm->current_state() != VirtualMachine::State::running)
+        return status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                                                      fmt::format("instance \"{}\" is not running", name), ""));
+
+    const auto& specs = vm_instance_specs[name];
+    if (specs.mounts.find(target_path) == specs.mounts.end())
+        return status_promise->set_value(grpc::Status(
+            grpc::StatusCode::INVALID_ARGUMENT, fmt::format("\"{}\" is not mounted in \"{}\"", target_path, name), ""));
+
+    BenchMountReply reply;
+    reply.set_reply_message(fmt::format("Benchmarking {}:{}", name, target_path));
+    mpl::write_to_client(server, reply);
+
+    // The workload takes a while, so it runs away from the main thread, reporting each operation as it finishes
+    auto command = fmt::format("python3 - {} {} <<'MULTIPASS_BENCH'{}MULTIPASS_BENCH\n",
+                               mpu::escape_for_shell(target_path), std::max(request->size_mib(), 1),
+                               bench_mount_script);
+    auto future_watcher = create_future_watcher();
+    future_watcher->setFuture(QtConcurrent::run([this, server, status_promise, host = vm->ssh_hostname(),
+                                                 port = vm->ssh_port(), username = specs.ssh_username,
+                                                 command = std::move(command)]() -> AsyncOperationStatus {
+        try
+        {
+            SSHSession session{host, port, username, *config->ssh_key_provider};
+            auto process = session.exec(command);
 
-    if (status.ok())
-    {
-        std::function<grpc::Status(VirtualMachine&)> operation;
-        if (request->cancel_shutdown())
-            operation = std::bind(&Daemon::cancel_vm_shutdown, this, std::placeholders::_1);
-        else
-            operation = std::bind(&Daemon::shutdown_vm, this, std::placeholders::_1,
-                                  std::chrono::minutes(request->time_minutes()));
+            std::string pending;
+            process.read_std_output([server, &pending](const char* data, std::size_t size) {
+                pending.append(data, size);
+                for (auto end = pending.find('\n'); end != std::string::npos; end = pending.find('\n'))
+                {
+                    const auto line = QJsonDocument::fromJson(QByteArray::fromStdString(pending.substr(0, end)));
+                    pending.erase(0, end + 1);
+                    if (!line.isObject())
+                        continue;
+
+                    const auto json = line.object();
+                    BenchMountReply reply;
+                    auto result = reply.mutable_result();
+                    result->set_operation(json["operation"].toString().toStdString());
+                    result->set_count(json["count"].toVariant().toLongLong());
+                    result->set_bytes(json["bytes"].toVariant().toLongLong());
+                    result->set_seconds(json["seconds"].toDouble());
+                    result->set_p50_seconds(json["p50"].toDouble());
+                    result->set_p99_seconds(json["p99"].toDouble());
+                    mpl::write_to_client(server, reply);
+                }
+            });
 
-        status = cmd_vms(instances, operation);
-    }
+            if (process.exit_code() != 0)
+                return {grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                                     fmt::format("The workload failed: {}", mpu::trim_end(process.read_std_error())),
+                                     ""),
+                        status_promise};
 
-    status_promise->set_value(status);
+            return {grpc::Status::OK, status_promise};
+        }
+        catch (const std::exception& e)
+        {
+            return {grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""), status_promise};
+        }
+    }));
 }
 catch (const std::exception& e)
 {
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::suspend(const SuspendRequest* request, grpc::ServerWriter<SuspendReply>* server,
-                         std::promise<grpc::Status>* status_promise) // clang-format off
+void mp::Daemon::throttle(const ThrottleRequest* request, grpc::ServerWriter<ThrottleReply>* server,
+                          std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
-    mpl::ClientLogger<SuspendReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    mpl::ClientLogger<ThrottleReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    finish_warming();
 
-    fmt::memory_buffer errors;
-    std::vector<decltype(vm_instances)::key_type> instances_to_suspend;
-    for (const auto& name : request->instance_names().instance_name())
-    {
-        auto it = vm_instances.find(name);
-        if (it == vm_instances.end())
-        {
-            it = deleted_instances.find(name);
-            if (it == deleted_instances.end())
-                fmt::format_to(errors, "instance \"{}\" does not exist\n", name);
-            else
-                fmt::format_to(errors, "instance \"{}\" is deleted\n", name);
-            continue;
-        }
-        instances_to_suspend.push_back(name);
-    }
+    const auto& name = request->instance_name();
+    auto error = check_instance_operational(name);
+    if (!error.empty())
+        return status_promise->set_value(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, error, ""));
 
-    auto status = grpc_status_for(errors);
-    if (status.ok())
-    {
-        if (instances_to_suspend.empty())
-        {
-            for (auto& pair : vm_instances)
-                instances_to_suspend.push_back(pair.first);
-        }
+    const auto limits = io_limits_from(request->io_limits());
+    if (!limits.valid())
+        return status_promise->set_value(
+            grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                         "Invalid I/O limits: each burst needs a sustained limit, and can be no lower than it", ""));
+    if (!config->factory->can_limit_io(limits))
+        return status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                                                      "The driver in use cannot apply these I/O limits", ""));
 
-        status = cmd_vms(instances_to_suspend, [this](auto& vm) {
-            vm.suspend();
-            instance_mounts.stop_all_mounts_for_instance(vm.vm_name);
-            return grpc::Status::OK;
-        });
+    // Running instances are throttled straight away, the others from their next start
+    auto lock = lock_operations_on(name);
+    vm_instances.at(name)->set_io_limits(limits);
+
+    {
+        std::lock_guard<decltype(instances_mutex)> instances_lock{instances_mutex};
+        vm_instance_specs[name].io_limits = limits;
+        persist_instances();
     }
 
-    status_promise->set_value(status);
+    status_promise->set_value(grpc::Status::OK);
 }
 catch (const std::exception& e)
 {
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::restart(const RestartRequest* request, grpc::ServerWriter<RestartReply>* server,
-                         std::promise<grpc::Status>* status_promise) // clang-format off
+void mp::Daemon::resize(const ResizeRequest* request, grpc::ServerWriter<ResizeReply>* server,
+                        std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
-    mpl::ClientLogger<RestartReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    mpl::ClientLogger<ResizeReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    finish_warming();
 
-    auto timeout = request->timeout() > 0 ? std::chrono::seconds(request->timeout()) : mp::default_timeout;
+    const auto& name = request->instance_name();
+    auto error = check_instance_operational(name);
+    if (!error.empty())
+        return status_promise->set_value(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, error, ""));
 
-    auto [instances, status] =
-        find_requested_instances(request->instance_names().instance_name(), vm_instances,
-                                 std::bind(&Daemon::check_instance_operational, this, std::placeholders::_1));
+    auto lock = lock_operations_on(name);
+    const auto& specs = vm_instance_specs.at(name);
 
-    if (!status.ok())
+    auto num_cores = request->num_cores() ? request->num_cores() : specs.num_cores;
+    if (num_cores < std::stoi(mp::min_cpu_cores))
+        return status_promise->set_value(grpc::Status(
+            grpc::StatusCode::INVALID_ARGUMENT, fmt::format("Instances need at least {} vCPU", mp::min_cpu_cores), ""));
+
+    // Past what the host has, an instance, running or not, could never have it all
+    const auto host_cores = static_cast<int>(std::thread::hardware_concurrency());
+    if (host_cores && num_cores > host_cores)
+        return status_promise->set_value(
+            grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                         fmt::format("Instances can have at most the {} cores the host has", host_cores), ""));
+
+    static const auto min_mem = try_mem_size(mp::min_memory_size);
+    auto mem_size = specs.mem_size;
+    if (!request->mem_size().empty())
     {
-        return status_promise->set_value(status);
+        const auto opt_mem_size = try_mem_size(request->mem_size());
+        if (!opt_mem_size || *opt_mem_size < *min_mem)
+            return status_promise->set_value(grpc::Status(
+                grpc::StatusCode::INVALID_ARGUMENT,
+                fmt::format("Invalid memory size \"{}\", it needs to be at least {}", request->mem_size(),
+                            mp::min_memory_size),
+                ""));
+        mem_size = *opt_mem_size;
     }
 
-    status = cmd_vms(instances,
-                     std::bind(&Daemon::reboot_vm, this, std::placeholders::_1)); // 1st pass to reboot all targets
+    const auto host_memory = host_memory_total();
+    if (host_memory && mem_size.in_bytes() > host_memory)
+        return status_promise->set_value(grpc::Status(
+            grpc::StatusCode::INVALID_ARGUMENT,
+            fmt::format("Instances can have at most the {}MiB of memory the host has", host_memory / (1024 * 1024)),
+            ""));
+
+    // Running instances take as much of it as they can straight away, the rest comes with their next start
+    vm_instances.at(name)->resize(num_cores, mem_size);
 
-    if (!status.ok())
     {
-        return status_promise->set_value(status);
+        std::lock_guard<decltype(instances_mutex)> instances_lock{instances_mutex};
+        vm_instance_specs[name].num_cores = num_cores;
+        vm_instance_specs[name].mem_size = mem_size;
+        persist_instances();
     }
 
-    auto future_watcher = create_future_watcher();
-    future_watcher->setFuture(QtConcurrent::run(this, &Daemon::async_wait_for_ready_all<RestartReply>, server,
-                                                instances, timeout, status_promise));
+    status_promise->set_value(grpc::Status::OK);
 }
 catch (const std::exception& e)
 {
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::delet(const DeleteRequest* request, grpc::ServerWriter<DeleteReply>* server,
+void mp::Daemon::clone(const CloneRequest* request, grpc::ServerWriter<CloneReply>* server,
                        std::promise<grpc::Status>* status_promise) // clang-format off
 try // clang-format on
 {
-    mpl::ClientLogger<DeleteReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    mpl::ClientLogger<CloneReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    finish_warming();
 
-    const auto [operational_instances_to_delete, trashed_instances_to_delete, status] =
-        find_instances_to_delete(request->instance_names().instance_name(), vm_instances, deleted_instances);
+    const auto& source_name = request->source_name();
+    const auto& name = request->destination_name();
 
-    if (status.ok())
-    {
-        const bool purge = request->purge();
+    auto error = check_instance_operational(source_name);
+    if (!error.empty())
+        return status_promise->set_value(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, error, ""));
 
-        for (const auto& name : operational_instances_to_delete)
-        {
-            assert(!vm_instance_specs[name].deleted);
+    if (!mp::utils::valid_hostname(name) || WarmPoolSpec::is_pool_instance(name))
+        return status_promise->set_value(
+            grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, fmt::format("Invalid instance name \"{}\"", name), ""));
 
-            auto& instance = vm_instances[name];
+    if (vm_instances.count(name) || deleted_instances.count(name) || preparing_instances.count(name))
+        return status_promise->set_value(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                                                      fmt::format("instance \"{}\" already exists", name), ""));
 
-            if (instance->current_state() == VirtualMachine::State::delayed_shutdown)
-                delayed_shutdown_instances.erase(name);
+    auto lock = lock_operations_on(source_name);
+    auto source = vm_instances.at(source_name);
+    const auto source_state = source->current_state();
+    if (source_state == VirtualMachine::State::suspending)
+        return status_promise->set_value(
+            grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                         fmt::format("instance \"{}\" is suspending, wait for it to finish", source_name), ""));
 
-            instance_mounts.stop_all_mounts_for_instance(name);
-            instance->shutdown();
+    // A suspended source serves as a template: the clone resumes off its memory, on a disk layered over its own,
+    // instead of booting
+    const auto from_memory = source_state == VirtualMachine::State::suspended;
 
-            if (purge)
-                release_resources(name);
-            else
+    // The disk is only copied whole while nothing writes to it, so a running source is brought down for the copy
+    const auto was_running = mp::utils::is_running(source_state);
+    if (was_running)
+    {
+        CloneReply reply;
+        reply.set_reply_message(fmt::format("Stopping {}", source_name));
+        mpl::write_to_client(server, reply);
+
+        auto status = shutdown_vm(*source, std::chrono::milliseconds::zero(), mp::nullopt);
+        if (!status.ok())
+            return status_promise->set_value(status);
+    }
+
+    CloneReply reply;
+    reply.set_reply_message(fmt::format("Cloning {}", source_name));
+    mpl::write_to_client(server, reply);
+
+    std::unique_lock<decltype(instances_mutex)> instances_lock{instances_mutex};
+    auto specs = vm_instance_specs.at(source_name);
+    specs.state = from_memory ? VirtualMachine::State::suspended : VirtualMachine::State::stopped;
+    specs.mounts.clear();
+    specs.port_forwards.clear(); // the host ports are the source's
+    specs.deleted = false;
+    if (!from_memory)
+        specs.metadata = {}; // otherwise how to resume the source's memory
+
+    // Same hardware, but with addresses of its own
+    std::unordered_set<std::string> new_macs;
+    std::vector<std::pair<std::string, std::string>> mac_changes;
+    {
+        std::lock_guard<decltype(mac_addrs_mutex)> mac_lock{mac_addrs_mutex};
+        auto renew = [this, &new_macs, &mac_changes](std::string& mac) {
+            auto old_mac = mac;
+            mac = generate_unused_mac_address(allocated_mac_addrs, new_macs);
+            mac_changes.emplace_back(std::move(old_mac), mac);
+        };
+
+        renew(specs.default_mac_address);
+        for (auto& iface : specs.extra_interfaces)
+            renew(iface.mac_address);
+    }
+    preparing_instances.insert(name); // the name stays taken while the disk is copied
+    instances_lock.unlock();
+
+    // A new instance-id has cloud-init set the clone up as an instance of its own on its first boot, with a new
+    // hostname and host keys, over what it already has installed. The disk image is filled in once copied
+    auto vm_desc = std::make_shared<VirtualMachineDescription>(VirtualMachineDescription{
+        specs.num_cores,
+        specs.mem_size,
+        specs.disk_space,
+        name,
+        specs.default_mac_address,
+        specs.extra_interfaces,
+        specs.ssh_username,
+        VMImage{},
+        "",
+        make_cloud_init_meta_config(name),
+        from_memory ? YAML::Node{} : make_cloud_init_clone_user_config(),
+        make_cloud_init_vendor_config(*config->ssh_key_provider, "", specs.ssh_username,
+                                      config->factory->get_backend_version_string().toStdString(),
+                                      package_cache_address()),
+        from_memory ? make_cloud_init_network_config(specs.default_mac_address, specs.extra_interfaces)
+                    : make_cloud_init_clone_network_config(specs.default_mac_address, specs.extra_interfaces),
+        specs.storage_profile,
+        specs.io_limits});
+
+    // Copying the disk can take minutes, so it is left to a worker; the main thread only stops the source before and
+    // brings it back, along with the clone, after
+    auto cloned = std::make_shared<bool>(false);
+    auto clone_watcher = create_future_watcher([this, server, status_promise, source_name, name, specs, new_macs,
+                                                mac_changes, from_memory, was_running, source, vm_desc, cloned] {
+        {
+            std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+            preparing_instances.erase(name);
+        }
+
+        if (was_running)
+        {
+            try
             {
-                deleted_instances[name] = std::move(instance);
-                vm_instance_specs[name].deleted = true;
+                auto operation_lock = lock_operations_on(source_name);
+                source->start();
+                on_restart(source_name);
+            }
+            catch (const std::exception& e)
+            {
+                mpl::log(mpl::Level::warning, category,
+                         fmt::format("Could not start {} again after cloning it: {}", source_name, e.what()));
             }
-
-            vm_instances.erase(name);
         }
 
-        if (purge)
+        if (!*cloned)
+            return; // the failure is reported with the operation's status
+
+        try
         {
-            for (const auto& name : trashed_instances_to_delete)
+            std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
             {
-                assert(vm_instance_specs[name].deleted);
-                release_resources(name);
-                deleted_instances.erase(name);
+                std::lock_guard<decltype(mac_addrs_mutex)> mac_lock{mac_addrs_mutex};
+                if (!merge_if_disjoint(allocated_mac_addrs, new_macs))
+                    throw std::runtime_error(fmt::format("Repeated MAC address in {}", name));
             }
+
+            vm_instance_specs[name] = specs;
+            vm_instances[name] = config->factory->create_virtual_machine(*vm_desc, *this);
+            persist_instances();
+        }
+        catch (const std::exception& e)
+        {
+            // Gives back the disk and, when they were taken, the MAC addresses
+            std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+            release_resources(name);
+            return status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
         }
 
-        persist_instances();
-    }
+        CloneReply reply;
+        if (!from_memory)
+        {
+            reply.set_reply_message(fmt::format("Cloned {} as {}", source_name, name));
+            mpl::write_to_client(server, reply);
+            return status_promise->set_value(grpc::Status::OK);
+        }
 
-    status_promise->set_value(status);
+        reply.set_reply_message(fmt::format("Resuming {}", name));
+        mpl::write_to_client(server, reply);
+        try
+        {
+            resume_clone(server, source_name, name, mac_changes, status_promise);
+        }
+        catch (const std::exception& e)
+        {
+            status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+        }
+    });
+    clone_watcher->setFuture(
+        QtConcurrent::run(&wait_pool, [this, source_name, name, from_memory, vm_desc, cloned, status_promise] {
+            try
+            {
+                auto operation_lock = lock_operations_on(source_name);
+                vm_desc->image = from_memory ? config->vault->clone_layered(source_name, name)
+                                             : config->vault->clone(source_name, name);
+                if (from_memory)
+                    config->factory->clone_suspended_state(
+                        fetch_image_for(source_name, config->factory->fetch_type(), *config->vault), vm_desc->image);
+
+                const auto instance_dir = mp::utils::base_dir(vm_desc->image.image_path);
+                vm_desc->cloud_init_iso = instance_dir.filePath("cloud-init-config.iso");
+                QFile::remove(vm_desc->cloud_init_iso);
+                config->factory->configure(*vm_desc);
+
+                *cloned = true;
+                return AsyncOperationStatus{grpc::Status::OK, nullptr}; // the status comes once the clone is in
+            }
+            catch (const std::exception& e)
+            {
+                if (config->vault->has_record_for(name))
+                    config->vault->remove(name);
+
+                return AsyncOperationStatus{grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""),
+                                            status_promise};
+            }
+        }));
 }
 catch (const std::exception& e)
 {
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::umount(const UmountRequest* request, grpc::ServerWriter<UmountReply>* server,
-                        std::promise<grpc::Status>* status_promise) // clang-format off
-try // clang-format on
+void mp::Daemon::resume_clone(grpc::ServerWriter<CloneReply>* server, const std::string& source_name,
+                              const std::string& name,
+                              const std::vector<std::pair<std::string, std::string>>& mac_changes,
+                              std::promise<grpc::Status>* status_promise)
 {
-    mpl::ClientLogger<UmountReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    auto clone = vm_instances.at(name);
+    clone->start();
 
-    fmt::memory_buffer errors;
-    for (const auto& path_entry : request->target_paths())
-    {
-        const auto name = path_entry.instance_name();
-        auto it = vm_instances.find(name);
-        if (it == vm_instances.end())
+    // Until its identity is regenerated the clone answers as the template, so one that cannot be reached is let go of
+    auto regenerated = std::make_shared<bool>(false);
+    auto future_watcher = create_future_watcher([this, server, name, source_name, regenerated] {
+        if (*regenerated)
         {
-            fmt::format_to(errors, "instance \"{}\" does not exist\n", name);
-            continue;
+            CloneReply reply;
+            reply.set_reply_message(fmt::format("Cloned {} as {}", source_name, name));
+            mpl::write_to_client(server, reply);
+            return;
         }
 
-        auto target_path = path_entry.target_path();
-        auto& mounts = vm_instance_specs[name].mounts;
-        auto& vm = it->second;
+        auto operation_lock = lock_operations_on(name);
+        auto clone = vm_instances.at(name);
+        clone->shutdown();
 
-        // Empty target path indicates removing all mounts for the VM instance
-        if (target_path.empty())
-        {
-            instance_mounts.stop_all_mounts_for_instance(name);
-            mounts.clear();
-        }
-        else
-        {
-            if (vm->current_state() == mp::VirtualMachine::State::running)
+        std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+        release_resources(name);
+        vm_instances.erase(name);
+        persist_instances();
+    });
+    future_watcher->setFuture(
+        QtConcurrent::run(&wait_pool, [this, clone, name, regenerated, status_promise,
+                                       script = identity_regeneration_script(name, mac_changes)] {
+            try
             {
-                if (!instance_mounts.stop_mount(name, target_path))
-                {
-                    fmt::format_to(errors, "\"{}\" is not mounted\n", target_path);
-                }
-            }
+                if (!clone->run_after_resume(script, *config->ssh_key_provider, mp::default_timeout))
+                    throw std::runtime_error("cannot regenerate its identity");
 
-            auto erased = mounts.erase(target_path);
-            if (!erased)
+                clone->wait_until_ssh_up(mp::default_timeout);
+                *regenerated = true;
+                return AsyncOperationStatus{grpc::Status::OK, status_promise};
+            }
+            catch (const std::exception& e)
             {
-                fmt::format_to(errors, "\"{}\" not found in database\n", target_path);
+                return AsyncOperationStatus{
+                    grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                                 fmt::format("Could not resume {} as a clone: {}", name, e.what()), ""),
+                    status_promise};
             }
+        }));
+}
+
+void mp::Daemon::forward(const ForwardRequest* request, grpc::ServerWriter<ForwardReply>* server,
+                         std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    mpl::ClientLogger<ForwardReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    finish_warming();
+
+    const auto& name = request->instance_name();
+    auto error = check_instance_operational(name);
+    if (!error.empty())
+        return status_promise->set_value(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, error, ""));
+
+    const auto host_port = request->host_port();
+    auto valid_port = [](int port) { return port > 0 && port < 65536; };
+    if (host_port && (!valid_port(host_port) || (!request->cancel() && !valid_port(request->instance_port()))))
+        return status_promise->set_value(
+            grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Ports go from 1 to 65535", ""));
+
+    auto lock = lock_operations_on(name);
+    if (request->cancel())
+    {
+        // Without an address, the port is no longer forwarded on any of them
+        if (!port_forwarder.remove(name, request->host_address(), host_port))
+            return status_promise->set_value(grpc::Status(
+                grpc::StatusCode::INVALID_ARGUMENT, fmt::format("port {} is not forwarded to {}", host_port, name),
+                ""));
+
+        std::lock_guard<decltype(instances_mutex)> instances_lock{instances_mutex};
+        auto& forwards = vm_instance_specs[name].port_forwards;
+        for (auto it = forwards.begin(); it != forwards.end();)
+        {
+            const auto& [host_address, port] = it->first;
+            if (port == host_port && (request->host_address().empty() || host_address == request->host_address()))
+                it = forwards.erase(it);
+            else
+                ++it;
         }
+        persist_instances();
+    }
+    else if (host_port)
+    {
+        // Guest services are only put on the network when asked to
+        const auto host_address =
+            request->host_address().empty() ? std::string{default_forward_address} : request->host_address();
+        port_forwarder.add(name, host_address, host_port, request->instance_port(),
+                           address_lookup_for(this, vm_instances.at(name), [this, name] { resume_if_idle(name); }));
+
+        std::lock_guard<decltype(instances_mutex)> instances_lock{instances_mutex};
+        vm_instance_specs[name].port_forwards[{host_address, host_port}] = request->instance_port();
+        persist_instances();
     }
 
-    persist_instances();
+    ForwardReply reply;
+    for (const auto& forward : vm_instance_specs.at(name).port_forwards)
+    {
+        auto entry = reply.add_forwards();
+        entry->set_host_address(forward.first.first);
+        entry->set_host_port(forward.first.second);
+        entry->set_instance_port(forward.second);
+    }
+    mpl::write_to_client(server, reply);
 
-    status_promise->set_value(grpc_status_for(errors));
+    status_promise->set_value(grpc::Status::OK);
 }
 catch (const std::exception& e)
 {
     status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
 }
 
-void mp::Daemon::version(const VersionRequest* request, grpc::ServerWriter<VersionReply>* server,
-                         std::promise<grpc::Status>* status_promise)
+void mp::Daemon::capacity(const CapacityRequest* request, grpc::ServerWriter<CapacityReply>* server,
+                          std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
 {
-    mpl::ClientLogger<VersionReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+    mpl::ClientLogger<CapacityReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+
+    CapacityReply reply;
+    reply.set_cores(static_cast<int>(std::thread::hardware_concurrency()));
+    reply.set_memory_available(memory_available());
+    reply.set_disk_available(QStorageInfo{config->data_directory}.bytesAvailable());
+
+    {
+        std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+        auto committed_cores = 0;
+        for (const auto& item : vm_instances)
+        {
+            const auto state = item.second->current_state();
+            if (state != VirtualMachine::State::off && state != VirtualMachine::State::stopped &&
+                state != VirtualMachine::State::suspended)
+                committed_cores += vm_instance_specs.at(item.first).num_cores;
+        }
+        reply.set_committed_cores(committed_cores);
+    }
+
+    for (const auto& image : config->vault->cached_images())
+        reply.add_cached_images(image);
+
+    mpl::write_to_client(server, reply);
+    status_promise->set_value(grpc::Status::OK);
+}
+catch (const std::exception& e)
+{
+    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+}
+
+void mp::Daemon::copy_files(const CopyFilesRequest* request, grpc::ServerWriter<CopyFilesReply>* server,
+                            std::promise<grpc::Status>* status_promise) // clang-format off
+try // clang-format on
+{
+    mpl::ClientLogger<CopyFilesReply> logger{mpl::level_from(request->verbosity_level()), *config->logger, server};
+
+    // Instances are only looked at on the main thread, while sessions are opened from here, as reaching an instance
+    // can take a while
+    std::vector<VirtualMachine::ShPtr> vms;
+    auto checked = std::make_shared<std::promise<grpc::Status>>();
+    QMetaObject::invokeMethod(
+        this,
+        [this, request, checked, &vms] {
+            std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+            for (const auto& name : {request->source_instance(), request->destination_instance()})
+            {
+                auto error = check_instance_operational(name);
+                if (!error.empty())
+                    return checked->set_value(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, error, ""));
+
+                auto& vm = vm_instances.at(name);
+                if (!mp::utils::is_running(vm->current_state()))
+                    return checked->set_value(
+                        grpc::Status(grpc::StatusCode::ABORTED, fmt::format("instance \"{}\" is not running", name)));
+                vms.push_back(vm);
+            }
+            checked->set_value(grpc::Status::OK);
+        },
+        Qt::QueuedConnection);
+
+    if (auto status = checked->get_future().get(); !status.ok())
+        return status_promise->set_value(status);
+
+    auto sftp_client_for = [this](VirtualMachine& vm) {
+        return SFTPClient{std::make_unique<SSHSession>(vm.ssh_hostname(), vm.ssh_port(), vm.ssh_username(),
+                                                       *config->ssh_key_provider)};
+    };
+    auto source = sftp_client_for(*vms[0]);
+    auto destination = sftp_client_for(*vms[1]);
+
+    for (const auto& path : request->source_paths())
+    {
+        CopyFilesReply reply;
+        reply.set_reply_message(fmt::format("Copying {}:{}", request->source_instance(), path));
+        mpl::write_to_client(server, reply);
+
+        source.copy_to(destination, path, request->destination_path(), request->recursive());
+    }
 
-    VersionReply reply;
-    reply.set_version(multipass::version_string);
-    config->update_prompt->populate(reply.mutable_update_info());
-    server->Write(reply);
     status_promise->set_value(grpc::Status::OK);
 }
+catch (const std::exception& e)
+{
+    status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+}
 
 void mp::Daemon::on_shutdown()
 {
@@ -1939,19 +4809,51 @@ void mp::Daemon::on_suspend()
 
 void mp::Daemon::on_restart(const std::string& name)
 {
+    ssh_sessions.drop(name);
+
     auto future_watcher = create_future_watcher();
-    future_watcher->setFuture(QtConcurrent::run(this, &Daemon::async_wait_for_ready_all<StartReply>, nullptr,
-                                                std::vector<std::string>{name}, mp::default_timeout, nullptr));
+    future_watcher->setFuture(QtConcurrent::run(&wait_pool, this, &Daemon::async_wait_for_ready_all<StartReply>,
+                                                nullptr, std::vector<std::string>{name}, mp::default_timeout,
+                                                nullptr));
 }
 
 void mp::Daemon::persist_state_for(const std::string& name, const VirtualMachine::State& state)
 {
-    vm_instance_specs[name].state = state;
+    // Sessions do not survive the instance going down, nor should they be trusted across a restart
+    if (state != VirtualMachine::State::running)
+        ssh_sessions.drop(name);
+
+    std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+    if (WarmPoolSpec::is_pool_instance(name))
+    {
+        // The pool is not kept across daemon restarts, so there is nothing to write
+        auto it = warm_pool.find(name);
+        if (it != warm_pool.end())
+            it->second.specs.state = state;
+        return;
+    }
+
+    auto& specs = vm_instance_specs[name];
+    specs.state = state;
+
+    // Purged once it stopped, from the event loop rather than from under the instance telling its state
+    if (specs.ephemeral && (state == VirtualMachine::State::off || state == VirtualMachine::State::stopped))
+        QTimer::singleShot(0, this, [this, name] { purge_ephemeral(name); });
+
     persist_instances();
 }
 
 void mp::Daemon::update_metadata_for(const std::string& name, const QJsonObject& metadata)
 {
+    std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+    if (WarmPoolSpec::is_pool_instance(name))
+    {
+        auto it = warm_pool.find(name);
+        if (it != warm_pool.end())
+            it->second.specs.metadata = metadata;
+        return;
+    }
+
     vm_instance_specs[name].metadata = metadata;
 
     persist_instances();
@@ -1959,6 +4861,13 @@ void mp::Daemon::update_metadata_for(const std::string& name, const QJsonObject&
 
 QJsonObject mp::Daemon::retrieve_metadata_for(const std::string& name)
 {
+    if (WarmPoolSpec::is_pool_instance(name))
+    {
+        std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+        auto it = warm_pool.find(name);
+        return it != warm_pool.end() ? it->second.specs.metadata : QJsonObject{};
+    }
+
     return vm_instance_specs[name].metadata;
 }
 
@@ -1978,7 +4887,76 @@ QJsonArray to_json_array(const std::vector<mp::NetworkInterface>& extra_interfac
     return json;
 }
 
+QJsonArray to_json_array(const std::map<std::pair<std::string, int>, int>& forwards)
+{
+    QJsonArray json;
+    for (const auto& forward : forwards)
+    {
+        QJsonObject entry;
+        entry.insert("host_port", forward.first.second);
+        entry.insert("host_address", QString::fromStdString(forward.first.first));
+        entry.insert("instance_port", forward.second);
+        json.append(entry);
+    }
+
+    return json;
+}
+
+QJsonObject to_json_object(const mp::IoLimits& limits)
+{
+    QJsonObject json;
+    json.insert("disk_iops", limits.disk_iops);
+    json.insert("disk_iops_burst", limits.disk_iops_burst);
+    json.insert("disk_bytes_per_second", limits.disk_bytes_per_second);
+    json.insert("disk_bytes_burst", limits.disk_bytes_burst);
+    json.insert("network_bytes_per_second", limits.network_bytes_per_second);
+
+    return json;
+}
+
 void mp::Daemon::persist_instances()
+{
+    {
+        std::lock_guard<decltype(persist_mutex)> lock{persist_mutex};
+        persist_pending = true;
+    }
+    persist_cv.notify_one();
+}
+
+void mp::Daemon::write_instances_behind()
+{
+    std::unique_lock<decltype(persist_mutex)> lock{persist_mutex};
+    while (true)
+    {
+        persist_cv.wait(lock, [this] { return persist_pending || stop_persisting; });
+        if (!persist_pending)
+            return;
+
+        // Let a burst of changes settle into a single write, unless the daemon is going away
+        persist_cv.wait_for(lock, persist_instances_delay, [this] { return stop_persisting; });
+        persist_pending = false;
+
+        // Only the last write before going away waits for the disk
+        const auto durability = stop_persisting ? mp::WriteDurability::synced : mp::WriteDurability::relaxed;
+
+        lock.unlock();
+        try
+        {
+            write_instances(durability);
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::error, category, fmt::format("Could not persist the instances: {}", e.what()));
+        }
+
+        // Whatever watchers need to hear about came with a change to the instances; their states are read on the
+        // main thread
+        QMetaObject::invokeMethod(this, [this] { push_status_changes(); }, Qt::QueuedConnection);
+        lock.lock();
+    }
+}
+
+void mp::Daemon::write_instances(WriteDurability durability)
 {
     auto vm_spec_to_json = [](const mp::VMSpecs& specs) -> QJsonObject {
         QJsonObject json;
@@ -1989,6 +4967,9 @@ void mp::Daemon::persist_instances()
         json.insert("state", static_cast<int>(specs.state));
         json.insert("deleted", specs.deleted);
         json.insert("metadata", specs.metadata);
+        json.insert("storage_profile", QString::fromStdString(specs.storage_profile));
+        json.insert("io_limits", to_json_object(specs.io_limits));
+        json.insert("port_forwards", to_json_array(specs.port_forwards));
 
         // Write the networking information. Write first a field "mac_addr" containing the MAC address of the
         // default network interface. Then, write all the information about the rest of the interfaces.
@@ -2025,38 +5006,237 @@ void mp::Daemon::persist_instances()
             }
 
             entry.insert("gid_mappings", gid_map);
+
+            if (mount.second.type == VMMount::Type::native)
+                entry.insert("mount_type", "native");
+            if (!mount.second.compression.empty())
+                entry.insert("compression", QString::fromStdString(mount.second.compression));
+
             mounts.append(entry);
         }
 
         json.insert("mounts", mounts);
         return json;
     };
+    decltype(idle_suspended) idle;
+    {
+        std::lock_guard<decltype(idle_mutex)> lock{idle_mutex};
+        idle = idle_suspended;
+    }
+
     QJsonObject instance_records_json;
-    for (const auto& record : vm_instance_specs)
     {
-        auto key = QString::fromStdString(record.first);
-        instance_records_json.insert(key, vm_spec_to_json(record.second));
+        std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+        for (const auto& record : vm_instance_specs)
+        {
+            if (record.second.ephemeral)
+                continue;
+
+            auto json = vm_spec_to_json(record.second);
+            if (idle.count(record.first))
+                json.insert("idle_suspended", true); // for connections to resume it after the daemon restarts
+
+            instance_records_json.insert(QString::fromStdString(record.first), json);
+        }
+    }
+    instances_journal.update(instance_records_json, durability);
+}
+
+std::unordered_map<std::string, mp::InstanceStatus::Status> mp::Daemon::instance_statuses()
+{
+    std::unordered_map<std::string, InstanceStatus::Status> statuses;
+
+    // Instances are asked for their state outside the lock, as in list()
+    std::vector<std::pair<std::string, VirtualMachine::ShPtr>> instances;
+    {
+        std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+        instances.assign(vm_instances.cbegin(), vm_instances.cend());
+        for (const auto& instance : warming_instances)
+            statuses.emplace(instance.first, vm_instance_specs.at(instance.first).deleted ? InstanceStatus::DELETED
+                                                                                          : InstanceStatus::WARMING);
+        for (const auto& instance : deleted_instances)
+            statuses.emplace(instance.first, InstanceStatus::DELETED);
+        for (const auto& instance : failed_instances)
+            statuses.emplace(instance.first, InstanceStatus::FAILED);
+    }
+
+    for (const auto& instance : instances)
+        statuses.emplace(instance.first, grpc_instance_status_for(instance.second->current_state()));
+
+    return statuses;
+}
+
+void mp::Daemon::push_status_changes()
+{
+    // Watchers are written to outside watchers_mutex, so that none of them holds back the others coming and going
+    std::lock_guard<decltype(watch_writes_mutex)> writes_lock{watch_writes_mutex};
+    std::vector<StatusWatcher> watchers;
+    {
+        std::lock_guard<decltype(watchers_mutex)> lock{watchers_mutex};
+        watchers = status_watchers;
+        for (auto& watcher : status_watchers)
+            watcher.told = true;
+    }
+
+    if (watchers.empty())
+        return;
+
+    auto statuses = instance_statuses();
+
+    // New watchers hear of every instance, the others of what changed since they were last told
+    WatchReply everything, changes;
+    for (const auto& [name, status] : statuses)
+    {
+        auto entry = everything.add_instances();
+        entry->set_name(name);
+        entry->mutable_instance_status()->set_status(status);
+
+        auto it = pushed_statuses.find(name);
+        if (it == pushed_statuses.end() || it->second != status)
+            *changes.add_instances() = *entry;
+    }
+
+    for (const auto& pushed : pushed_statuses)
+        if (statuses.find(pushed.first) == statuses.end())
+            changes.add_removed_instances(pushed.first);
+
+    pushed_statuses = std::move(statuses);
+    const auto anything_changed = !changes.instances().empty() || !changes.removed_instances().empty();
+
+    // A watcher that cannot be written to has hung up
+    std::vector<grpc::ServerWriterInterface<WatchReply>*> hung_up;
+    for (const auto& watcher : watchers)
+    {
+        if (watcher.told && !anything_changed)
+            continue;
+
+        if (!watcher.server->Write(watcher.told ? changes : everything))
+            hung_up.push_back(watcher.server);
+    }
+
+    if (hung_up.empty())
+        return;
+
+    auto is_hung_up = [&hung_up](const StatusWatcher& watcher) {
+        if (std::find(hung_up.begin(), hung_up.end(), watcher.server) == hung_up.end())
+            return false;
+
+        watcher.status_promise->set_value(grpc::Status::CANCELLED);
+        return true;
+    };
+
+    std::lock_guard<decltype(watchers_mutex)> lock{watchers_mutex};
+    status_watchers.erase(std::remove_if(status_watchers.begin(), status_watchers.end(), is_hung_up),
+                          status_watchers.end());
+}
+
+// Looking the release up goes through the vault and possibly the network, too much for list(), which GUI clients
+// call every second
+std::string mp::Daemon::current_release_for(const std::string& name)
+{
+    {
+        std::lock_guard<decltype(instance_releases_mutex)> lock{instance_releases_mutex};
+        auto it = instance_releases.find(name);
+        if (it != instance_releases.end())
+            return it->second;
+    }
+
+    // FIXME: Set the release to the cached current version when supported
+    auto vm_image = fetch_image_for(name, config->factory->fetch_type(), *config->vault);
+    auto current_release = vm_image.original_release;
+
+    if (!vm_image.id.empty() && current_release.empty())
+    {
+        try
+        {
+            auto vm_image_info = config->image_hosts.back()->info_for_full_hash(vm_image.id);
+            current_release = vm_image_info.release_title.toStdString();
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::warning, category, fmt::format("Cannot fetch image information: {}", e.what()));
+            return current_release; // try again next time
+        }
     }
-    QDir data_dir{
-        mp::utils::backend_directory_path(config->data_directory, config->factory->get_backend_directory_name())};
-    mp::write_json(instance_records_json, data_dir.filePath(instance_db_name));
+
+    std::lock_guard<decltype(instance_releases_mutex)> lock{instance_releases_mutex};
+    instance_releases.emplace(name, current_release);
+    return current_release;
 }
 
 void mp::Daemon::release_resources(const std::string& instance)
 {
     config->factory->remove_resources_for(instance);
     config->vault->remove(instance);
+    {
+        std::lock_guard<decltype(instance_releases_mutex)> lock{instance_releases_mutex};
+        instance_releases.erase(instance);
+    }
+    ssh_sessions.drop(instance);
+    port_forwarder.remove_all(instance);
+    usage_history.forget(instance);
+    {
+        std::lock_guard<decltype(last_probes_mutex)> lock{last_probes_mutex};
+        last_probes.erase(instance);
+    }
 
     auto spec_it = vm_instance_specs.find(instance);
     if (spec_it != cend(vm_instance_specs))
     {
-        for (const auto& mac : mac_set_from(spec_it->second))
-            allocated_mac_addrs.erase(mac);
+        {
+            std::lock_guard<decltype(mac_addrs_mutex)> lock{mac_addrs_mutex};
+            for (const auto& mac : mac_set_from(spec_it->second))
+                allocated_mac_addrs.erase(mac);
+        }
 
         vm_instance_specs.erase(spec_it);
     }
 }
 
+void mp::Daemon::purge_ephemeral(const std::string& name)
+{
+    auto operation_lock = lock_operations_on(name);
+
+    VirtualMachine::ShPtr instance;
+    {
+        std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+        auto it = vm_instances.find(name);
+        auto specs = vm_instance_specs.find(name);
+        if (it == vm_instances.end() || specs == vm_instance_specs.end() || !specs->second.ephemeral)
+            return;
+        instance = it->second;
+    }
+
+    // Restarted in the meantime
+    const auto state = instance->current_state();
+    if (state != VirtualMachine::State::off && state != VirtualMachine::State::stopped)
+        return;
+
+    mpl::log(mpl::Level::info, category, fmt::format("Purging ephemeral instance {}", name));
+    instance_mounts.stop_all_mounts_for_instance(name);
+
+    std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+    release_resources(name);
+    vm_instances.erase(name);
+    persist_instances();
+}
+
+bool mp::Daemon::cancel_delayed_shutdown(const std::string& name)
+{
+    std::unique_ptr<DelayedShutdownTimer> timer;
+    {
+        std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+        auto it = delayed_shutdown_instances.find(name);
+        if (it == delayed_shutdown_instances.end())
+            return false;
+
+        timer = std::move(it->second);
+        delayed_shutdown_instances.erase(it);
+    }
+
+    return true; // the timer is destroyed here, outside the lock, as cancelling it may talk to the instance
+}
+
 std::string mp::Daemon::check_instance_operational(const std::string& instance_name) const
 {
     if (vm_instances.find(instance_name) == std::cend(vm_instances))
@@ -2079,9 +5259,82 @@ std::string mp::Daemon::check_instance_exists(const std::string& instance_name)
     return {};
 }
 
-void mp::Daemon::create_vm(const CreateRequest* request, grpc::ServerWriter<CreateReply>* server,
+// The phases of one launch, timed one after the other. Each phase is also observed in the daemon's metrics, which
+// aggregate them across launches
+struct mp::Daemon::LaunchTimings
+{
+    using Clock = Instrumentation::Clock;
+
+    // Ends the phase under way, if any, and starts the given one, unless it is already under way. Phase names must be
+    // string literals
+    void enter(const char* phase)
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        if (current && std::strcmp(current, phase) == 0)
+            return;
+
+        end_current();
+        current = phase;
+        since = Clock::now();
+    }
+
+    void leave()
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        end_current();
+    }
+
+    // Ends the launch, adding its phases and its total time to the reply
+    void report(const std::string& name, LaunchReply& reply)
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        end_current();
+
+        const auto total = Clock::now() - started;
+        MP_INSTRUMENTATION.observe("multipass_launch_seconds", "", total);
+
+        auto add = [&name, &reply](const char* phase, Clock::duration duration) {
+            auto timing = reply.add_timings();
+            timing->set_instance_name(name);
+            timing->set_phase(phase);
+            timing->set_microseconds(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+        };
+
+        for (const auto& phase : phases)
+            add(phase.first, phase.second);
+        add("total", total);
+    }
+
+private:
+    void end_current() // with the mutex held
+    {
+        if (!current)
+            return;
+
+        const auto duration = Clock::now() - since;
+        phases.emplace_back(current, duration);
+        MP_INSTRUMENTATION.observe("multipass_launch_phase_seconds", fmt::format("phase=\"{}\"", current), duration);
+        current = nullptr;
+    }
+
+    std::mutex mutex;
+    const Clock::time_point started{Clock::now()};
+    const char* current{nullptr};
+    Clock::time_point since;
+    std::vector<std::pair<const char*, Clock::duration>> phases;
+};
+
+auto mp::Daemon::launch_timings_for(const std::string& name) -> std::shared_ptr<LaunchTimings>
+{
+    std::lock_guard<decltype(launch_timings_mutex)> lock{launch_timings_mutex};
+    auto it = launch_timings.find(name);
+    return it == launch_timings.end() ? nullptr : it->second;
+}
+
+void mp::Daemon::create_vm(const CreateRequest* request, grpc::ServerWriterInterface<CreateReply>* server,
                            std::promise<grpc::Status>* status_promise, bool start)
 {
+    TraceSpan span{"daemon", "create_vm"};
     auto checked_args = validate_create_arguments(request, *config->factory);
 
     if (!checked_args.option_errors.error_codes().empty())
@@ -2098,7 +5351,7 @@ void mp::Daemon::create_vm(const CreateRequest* request, grpc::ServerWriter<Crea
         *reply.mutable_nets_need_bridging() = {std::make_move_iterator(nets.begin()),
                                                std::make_move_iterator(nets.end())}; /* this constructs a temporary
                                                RepeatedPtrField from the range, then move-assigns that temporary in */
-        server->Write(reply);
+        mpl::write_to_client(server, reply);
 
         return status_promise->set_value(
             grpc::Status{grpc::StatusCode::FAILED_PRECONDITION, "Missing bridges", create_error.SerializeAsString()});
@@ -2106,27 +5359,47 @@ void mp::Daemon::create_vm(const CreateRequest* request, grpc::ServerWriter<Crea
 
     // TODO: We should only need to query the Workflow Provider once for all info, so this (and timeout below) will
     //       need a refactoring to do so.
-    auto name = name_from(checked_args.instance_name, config->workflow_provider->name_from_workflow(request->image()),
-                          *config->name_generator, vm_instances);
+    // Names of instances that exist, were deleted or are being prepared are all taken, so that concurrent launches
+    // never pick the same name once it is reserved in preparing_instances below. Batches number the requested name.
+    const auto count = std::max(request->count(), 1);
+    if (count > mp::max_launch_count)
+        return status_promise->set_value(
+            grpc::Status{grpc::StatusCode::INVALID_ARGUMENT,
+                         fmt::format("At most {} instances can be launched at once", mp::max_launch_count), ""});
 
-    if (vm_instances.find(name) != vm_instances.end() || deleted_instances.find(name) != deleted_instances.end())
+    const auto workflow_name = config->workflow_provider->name_from_workflow(request->image());
+    const auto& base_name = checked_args.instance_name.empty() ? workflow_name : checked_args.instance_name;
+    std::vector<std::string> names;
+    for (auto i = 1; i <= count; ++i)
     {
-        CreateError create_error;
-        create_error.add_error_codes(CreateError::INSTANCE_EXISTS);
-
-        return status_promise->set_value(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
-                                                      fmt::format("instance \"{}\" already exists", name),
-                                                      create_error.SerializeAsString()));
+        const auto requested_name = count == 1 || base_name.empty() ? base_name : fmt::format("{}-{}", base_name, i);
+        names.push_back(name_from(requested_name, "", *config->name_generator, [this, &names](const std::string& name) {
+            return vm_instances.count(name) || deleted_instances.count(name) || preparing_instances.count(name) ||
+                   std::find(names.cbegin(), names.cend(), name) != names.cend();
+        }));
     }
 
-    if (preparing_instances.find(name) != preparing_instances.end())
+    for (const auto& name : names)
     {
-        CreateError create_error;
-        create_error.add_error_codes(CreateError::INSTANCE_EXISTS);
+        if (vm_instances.find(name) != vm_instances.end() || deleted_instances.find(name) != deleted_instances.end())
+        {
+            CreateError create_error;
+            create_error.add_error_codes(CreateError::INSTANCE_EXISTS);
 
-        return status_promise->set_value(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
-                                                      fmt::format("instance \"{}\" is being prepared", name),
-                                                      create_error.SerializeAsString()));
+            return status_promise->set_value(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                                                          fmt::format("instance \"{}\" already exists", name),
+                                                          create_error.SerializeAsString()));
+        }
+
+        if (preparing_instances.find(name) != preparing_instances.end())
+        {
+            CreateError create_error;
+            create_error.add_error_codes(CreateError::INSTANCE_EXISTS);
+
+            return status_promise->set_value(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                                                          fmt::format("instance \"{}\" is being prepared", name),
+                                                          create_error.SerializeAsString()));
+        }
     }
 
     if (!instances_running(vm_instances))
@@ -2134,190 +5407,357 @@ void mp::Daemon::create_vm(const CreateRequest* request, grpc::ServerWriter<Crea
 
     // TODO: We should only need to query the Workflow Provider once for all info, so this (and name above) will
     //       need a refactoring to do so.
-    auto timeout = timeout_for(request->timeout(), config->workflow_provider->workflow_timeout(name));
+    auto timeout = timeout_for(request->timeout(), config->workflow_provider->workflow_timeout(names.front()));
+
+    // Pool instances are only suspended, so taking one brings up as much as a new instance would
+    const AdmissionPolicy::Load instance_load{request->num_cores() ? request->num_cores()
+                                                                   : std::stoi(mp::default_cpu_cores),
+                                              checked_args.mem_size.in_bytes()};
+    if (start)
+    {
+        auto retry = [this, request, server, status_promise] { create_vm(request, server, status_promise, true); };
+        auto notify_position = [server](std::size_t position) {
+            LaunchReply reply;
+            reply.set_create_message(queue_message(position));
+            reply.set_queue_position(position);
+            return mpl::write_to_client(server, reply);
+        };
+        if (!admit({count * instance_load.cores, count * instance_load.memory}, retry, notify_position,
+                   status_promise))
+            return;
+    }
 
-    preparing_instances.insert(name);
+    if (start && count == 1 && claim_pool_instance(request, names.front(), timeout, server, status_promise))
+        return;
 
-    auto prepare_future_watcher = new QFutureWatcher<VirtualMachineDescription>();
+    auto batch = std::make_shared<CreateBatch>(server, names.size());
+    const auto batched = names.size() > 1;
     auto log_level = mpl::level_from(request->verbosity_level());
 
-    QObject::connect(
-        prepare_future_watcher, &QFutureWatcher<VirtualMachineDescription>::finished,
-        [this, server, status_promise, name, timeout, start, prepare_future_watcher, log_level] {
-            mpl::ClientLogger<CreateReply> logger{log_level, *config->logger, server};
+    // Once every instance is prepared, those that made it are waited for together; the call fails if any did not
+    auto finish_batch = [this, server, status_promise, timeout, start, batched, batch] {
+        auto errors = fmt::format("{}", fmt::join(batch->errors, "\n"));
+        if (!start || batch->ready.empty())
+        {
+            {
+                std::lock_guard<decltype(launch_timings_mutex)> lock{launch_timings_mutex};
+                for (const auto& name : batch->ready)
+                    launch_timings.erase(name);
+            }
 
-            try
+            return status_promise->set_value(errors.empty()
+                                                 ? grpc::Status::OK
+                                                 : grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, errors, ""));
+        }
+
+        // The batch is held on to until the last reply, for the instances' mounts to write to the client in turn
+        auto future_watcher = create_future_watcher([this, server, batched, batch, names = batch->ready] {
+            LaunchReply reply;
+            if (batched)
+                *reply.mutable_launched_instances() = {names.cbegin(), names.cend()};
+            else
+                reply.set_vm_instance_name(names.front());
+
+            for (const auto& name : names)
             {
-                auto vm_desc = prepare_future_watcher->future().result();
+                if (auto timings = launch_timings_for(name))
+                    timings->report(name, reply);
+
+                std::lock_guard<decltype(launch_timings_mutex)> lock{launch_timings_mutex};
+                launch_timings.erase(name);
+            }
+
+            config->update_prompt->populate_if_time_to_show(reply.mutable_update_info());
+            mpl::write_to_client(server, reply);
+        });
+        future_watcher->setFuture(QtConcurrent::run(
+            &wait_pool,
+            [this, server, batch, names = batch->ready, timeout, status_promise, errors = std::move(errors)] {
+                auto result = async_wait_for_ready_all<LaunchReply>(server, names, timeout, status_promise);
+                if (!errors.empty())
+                    result.status = grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                                                 result.status.ok()
+                                                     ? errors
+                                                     : fmt::format("{}\n{}", errors, result.status.error_message()),
+                                                 "");
+                return result;
+            }));
+    };
+
+    for (const auto& name : names)
+    {
+        preparing_instances.insert(name);
+        if (start)
+            admission_reservations[name] = instance_load;
+    }
+
+    {
+        std::lock_guard<decltype(launch_timings_mutex)> lock{launch_timings_mutex};
+        for (const auto& name : names)
+            launch_timings[name] = std::make_shared<LaunchTimings>();
+    }
 
-                vm_instance_specs[name] = {vm_desc.num_cores,
-                                           vm_desc.mem_size,
-                                           vm_desc.disk_space,
-                                           vm_desc.default_mac_address,
-                                           vm_desc.extra_interfaces,
-                                           config->ssh_username,
-                                           VirtualMachine::State::off,
-                                           {},
-                                           false,
-                                           QJsonObject()};
-                vm_instances[name] = config->factory->create_virtual_machine(vm_desc, *this);
-                preparing_instances.erase(name);
-
-                persist_instances();
-
-                if (start)
+    for (const auto& name : names)
+    {
+        auto prepare_future_watcher = new QFutureWatcher<VirtualMachineDescription>();
+
+        QObject::connect(
+            prepare_future_watcher, &QFutureWatcher<VirtualMachineDescription>::finished,
+            [this, server, name, start, prepare_future_watcher, log_level, batch, finish_batch] {
+                mpl::ClientLogger<CreateReply> logger{log_level, *config->logger, server};
+                auto timings = launch_timings_for(name);
+
+                try
                 {
-                    LaunchReply reply;
-                    reply.set_create_message("Starting " + name);
-                    server->Write(reply);
+                    auto vm_desc = prepare_future_watcher->future().result();
+                    timings->enter("create_instance");
+
+                    std::unique_lock<decltype(instances_mutex)> lock{instances_mutex};
+                    vm_instance_specs[name] = {vm_desc.num_cores,
+                                               vm_desc.mem_size,
+                                               vm_desc.disk_space,
+                                               vm_desc.default_mac_address,
+                                               vm_desc.extra_interfaces,
+                                               config->ssh_username,
+                                               VirtualMachine::State::off,
+                                               {},
+                                               false,
+                                               QJsonObject(),
+                                               vm_desc.storage_profile,
+                                               vm_desc.io_limits,
+                                               {},
+                                               vm_desc.ephemeral};
+                    vm_instances[name] = config->factory->create_virtual_machine(vm_desc, *this);
+                    {
+                        std::lock_guard<decltype(instance_releases_mutex)> releases_lock{instance_releases_mutex};
+                        instance_releases.erase(name);
+                    }
+                    preparing_instances.erase(name);
 
-                    auto& vm = vm_instances[name];
-                    vm->start();
+                    persist_instances();
+                    lock.unlock();
 
-                    auto future_watcher = create_future_watcher([this, server, name] {
+                    if (start)
+                    {
                         LaunchReply reply;
-                        reply.set_vm_instance_name(name);
-                        config->update_prompt->populate_if_time_to_show(reply.mutable_update_info());
-                        server->Write(reply);
-                    });
-                    future_watcher->setFuture(QtConcurrent::run(this, &Daemon::async_wait_for_ready_all<LaunchReply>,
-                                                                server, std::vector<std::string>{name}, timeout,
-                                                                status_promise));
+                        reply.set_create_message("Starting " + name);
+                        mpl::write_to_client(server, reply);
+
+                        timings->enter("spawn");
+                        vm_instances[name]->start();
+                    }
+
+                    admission_reservations.erase(name); // counted as up from here on
+                    timings->leave();
+                    batch->ready.push_back(name);
                 }
-                else
+                catch (const std::exception& e)
                 {
-                    status_promise->set_value(grpc::Status::OK);
+                    preparing_instances.erase(name);
+                    admission_reservations.erase(name);
+                    {
+                        std::lock_guard<decltype(launch_timings_mutex)> timings_lock{launch_timings_mutex};
+                        launch_timings.erase(name);
+                    }
+
+                    std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+                    release_resources(name);
+                    vm_instances.erase(name);
+                    persist_instances();
+                    batch->errors.push_back(e.what());
                 }
-            }
-            catch (const std::exception& e)
-            {
-                preparing_instances.erase(name);
-                release_resources(name);
-                vm_instances.erase(name);
-                persist_instances();
-                status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
-            }
 
-            delete prepare_future_watcher;
-        });
+                if (--batch->remaining == 0)
+                    finish_batch();
 
-    auto make_vm_description = [this, server, request, name, checked_args,
-                                log_level]() mutable -> VirtualMachineDescription {
-        mpl::ClientLogger<CreateReply> logger{log_level, *config->logger, server};
+                delete prepare_future_watcher;
+            });
 
-        try
-        {
-            CreateReply reply;
-            reply.set_create_message("Creating " + name);
-            server->Write(reply);
-
-            Query query;
-            VirtualMachineDescription vm_desc{
-                request->num_cores(),
-                MemorySize{request->mem_size().empty() ? "0b" : request->mem_size()},
-                MemorySize{request->disk_space().empty() ? "0b" : request->disk_space()},
-                name,
-                "",
-                {},
-                config->ssh_username,
-                VMImage{},
-                "",
-                YAML::Node{},
-                YAML::Node{},
-                make_cloud_init_vendor_config(*config->ssh_key_provider, request->time_zone(), config->ssh_username,
-                                              config->factory->get_backend_version_string().toStdString()),
-                YAML::Node{}};
+        auto make_vm_description = [this, server, request, name, checked_args, log_level,
+                                    timings = launch_timings_for(name)]() mutable -> VirtualMachineDescription {
+            TraceSpan span{"daemon", "make_vm_description"};
+            mpl::ClientLogger<CreateReply> logger{log_level, *config->logger, server};
+            timings->enter("lookup");
+            std::unordered_set<std::string> claimed_macs; // given back should the instance not make it
 
             try
             {
-                query = config->workflow_provider->fetch_workflow_for(request->image(), vm_desc);
-                query.name = name;
-            }
-            catch (const std::out_of_range&)
-            {
-                // Workflow not found, move on
-                query = query_from(request, name);
-                vm_desc.mem_size = checked_args.mem_size;
-            }
-
-            auto progress_monitor = [server](int progress_type, int percentage) {
-                CreateReply create_reply;
-                create_reply.mutable_launch_progress()->set_percent_complete(std::to_string(percentage));
-                create_reply.mutable_launch_progress()->set_type((CreateProgress::ProgressTypes)progress_type);
-                return server->Write(create_reply);
-            };
+                auto write = [server](const CreateReply& reply) { return mpl::write_to_client(server, reply); };
 
-            auto prepare_action = [this, server, &name](const VMImage& source_image) -> VMImage {
                 CreateReply reply;
-                reply.set_create_message("Preparing image for " + name);
-                server->Write(reply);
+                reply.set_create_message("Creating " + name);
+                write(reply);
+
+                Query query;
+                VirtualMachineDescription vm_desc{
+                    request->num_cores(),
+                    MemorySize{request->mem_size().empty() ? "0b" : request->mem_size()},
+                    MemorySize{request->disk_space().empty() ? "0b" : request->disk_space()},
+                    name,
+                    "",
+                    {},
+                    config->ssh_username,
+                    VMImage{},
+                    "",
+                    YAML::Node{},
+                    YAML::Node{},
+                    make_cloud_init_vendor_config(*config->ssh_key_provider, request->time_zone(), config->ssh_username,
+                                                  config->factory->get_backend_version_string().toStdString(),
+                                                  package_cache_address()),
+                    YAML::Node{},
+                    checked_args.storage_profile,
+                    checked_args.io_limits,
+                    request->ephemeral()};
 
-                return config->factory->prepare_source_image(source_image);
-            };
+                try
+                {
+                    query = config->workflow_provider->fetch_workflow_for(request->image(), vm_desc);
+                    query.name = name;
+                }
+                catch (const std::out_of_range&)
+                {
+                    // Workflow not found, move on
+                    query = query_from(request, name);
+                    vm_desc.mem_size = checked_args.mem_size;
+                }
+                query.ephemeral = vm_desc.ephemeral;
+
+                auto progress_monitor = [&write, &timings](int progress_type, int percentage) {
+                    timings->enter(launch_phase_for(progress_type));
+
+                    CreateReply create_reply;
+                    create_reply.mutable_launch_progress()->set_percent_complete(std::to_string(percentage));
+                    create_reply.mutable_launch_progress()->set_type((CreateProgress::ProgressTypes)progress_type);
+                    return write(create_reply);
+                };
 
-            auto fetch_type = config->factory->fetch_type();
+                auto prepare_action = [this, &write, &name, &timings](const VMImage& source_image) -> VMImage {
+                    timings->enter("prepare_source_image");
 
-            auto vm_image = config->vault->fetch_image(fetch_type, query, prepare_action, progress_monitor);
+                    CreateReply reply;
+                    reply.set_create_message("Preparing image for " + name);
+                    write(reply);
 
-            const auto image_size = config->vault->minimum_image_size_for(vm_image.id);
-            vm_desc.disk_space = compute_final_image_size(
-                image_size, vm_desc.disk_space.in_bytes() > 0 ? vm_desc.disk_space : checked_args.disk_space,
-                config->data_directory);
+                    // Reported as is, so that the time spent goes to preparing rather than waiting for the image
+                    auto prepare_monitor = [&write](int, int percentage) {
+                        CreateReply progress_reply;
+                        progress_reply.mutable_launch_progress()->set_percent_complete(std::to_string(percentage));
+                        progress_reply.mutable_launch_progress()->set_type(CreateProgress::WAITING);
+                        return write(progress_reply);
+                    };
+
+                    return config->factory->prepare_source_image(source_image, prepare_monitor);
+                };
+
+                // Networking does not depend on the image, so it gets ready while the image is fetched
+                auto networking = QtConcurrent::run([this, extra_interfaces = checked_args.extra_interfaces]() mutable {
+                    PreparedNetworking prepared;
+                    try
+                    {
+                        config->factory->prepare_networking(extra_interfaces);
+
+                        // The MAC's in use are looked up in place, rather than copied for each instance
+                        std::lock_guard<decltype(mac_addrs_mutex)> lock{mac_addrs_mutex};
+
+                        // check for repetition of requested macs
+                        for (auto& iface : extra_interfaces)
+                            if (!iface.mac_address.empty() &&
+                                (allocated_mac_addrs.count(iface.mac_address) ||
+                                 !prepared.new_macs.insert(iface.mac_address).second))
+                                throw std::runtime_error(fmt::format("Repeated MAC address {}", iface.mac_address));
+
+                        // generate missing macs in a second pass, to avoid repeating macs that the user requested
+                        for (auto& iface : extra_interfaces)
+                            if (iface.mac_address.empty())
+                                iface.mac_address = generate_unused_mac_address(allocated_mac_addrs, prepared.new_macs);
+
+                        prepared.default_mac_address =
+                            generate_unused_mac_address(allocated_mac_addrs, prepared.new_macs);
+                        prepared.extra_interfaces = std::move(extra_interfaces);
+                        prepared.network_data_config =
+                            make_cloud_init_network_config(prepared.default_mac_address, prepared.extra_interfaces);
+
+                        // Claimed along with picking them, so that instances prepared alongside cannot pick them too
+                        allocated_mac_addrs.insert(prepared.new_macs.cbegin(), prepared.new_macs.cend());
+                    }
+                    catch (...)
+                    {
+                        prepared.error = std::current_exception();
+                    }
 
-            reply.set_create_message("Configuring " + name);
-            server->Write(reply);
+                    return prepared;
+                });
 
-            config->factory->prepare_networking(checked_args.extra_interfaces);
+                VMImage vm_image;
+                try
+                {
+                    vm_desc.meta_data_config = make_cloud_init_meta_config(name);
+                    vm_desc.user_data_config = YAML::Load(request->cloud_init_user_data());
+                    prepare_user_data(vm_desc.user_data_config, vm_desc.vendor_data_config);
 
-            // This set stores the MAC's which need to be in the allocated_mac_addrs if everything goes well.
-            auto new_macs = allocated_mac_addrs;
+                    if (vm_desc.num_cores < std::stoi(mp::min_cpu_cores))
+                        vm_desc.num_cores = std::stoi(mp::default_cpu_cores);
 
-            // check for repetition of requested macs
-            for (auto& iface : checked_args.extra_interfaces)
-                if (!iface.mac_address.empty() && !new_macs.insert(iface.mac_address).second)
-                    throw std::runtime_error(fmt::format("Repeated MAC address {}", iface.mac_address));
+                    auto fetch_type = config->factory->fetch_type();
 
-            // generate missing macs in a second pass, to avoid repeating macs that the user requested
-            for (auto& iface : checked_args.extra_interfaces)
-                if (iface.mac_address.empty())
-                    iface.mac_address = generate_unused_mac_address(new_macs);
+                    vm_image = config->vault->fetch_image(fetch_type, query, prepare_action, progress_monitor);
+                    timings->enter("image_size");
 
-            vm_desc.default_mac_address = generate_unused_mac_address(new_macs);
-            vm_desc.extra_interfaces = checked_args.extra_interfaces;
+                    const auto image_size = config->vault->minimum_image_size_for(vm_image.id);
+                    vm_desc.disk_space = compute_final_image_size(
+                        image_size, vm_desc.disk_space.in_bytes() > 0 ? vm_desc.disk_space : checked_args.disk_space,
+                        config->data_directory);
+                }
+                catch (...)
+                {
+                    // Not to leave the factory preparing for an instance in the making
+                    if (auto prepared = networking.result(); !prepared.error)
+                        claimed_macs = std::move(prepared.new_macs);
+                    throw;
+                }
 
-            vm_desc.meta_data_config = make_cloud_init_meta_config(name);
-            vm_desc.user_data_config = YAML::Load(request->cloud_init_user_data());
-            prepare_user_data(vm_desc.user_data_config, vm_desc.vendor_data_config);
+                reply.set_create_message("Configuring " + name);
+                write(reply);
 
-            if (vm_desc.num_cores < std::stoi(mp::min_cpu_cores))
-                vm_desc.num_cores = std::stoi(mp::default_cpu_cores);
+                timings->enter("networking");
+                auto prepared = networking.result();
+                if (prepared.error)
+                    std::rethrow_exception(prepared.error);
+                claimed_macs = prepared.new_macs;
 
-            vm_desc.network_data_config =
-                make_cloud_init_network_config(vm_desc.default_mac_address, checked_args.extra_interfaces);
+                vm_desc.default_mac_address = std::move(prepared.default_mac_address);
+                vm_desc.extra_interfaces = std::move(prepared.extra_interfaces);
+                vm_desc.network_data_config = std::move(prepared.network_data_config);
 
-            vm_desc.image = vm_image;
-            config->factory->configure(vm_desc);
-            config->factory->prepare_instance_image(vm_image, vm_desc);
+                vm_desc.image = vm_image;
+                timings->enter("cloud_init_iso");
+                config->factory->configure(vm_desc);
+                timings->enter("instance_image");
+                config->factory->prepare_instance_image(vm_image, vm_desc);
+                timings->leave();
 
-            // Everything went well, add the MAC addresses used in this instance.
-            allocated_mac_addrs = std::move(new_macs);
-            return vm_desc;
-        }
-        catch (const std::exception& e)
-        {
-            throw CreateImageException(e.what());
-        }
-    };
+                return vm_desc;
+            }
+            catch (const std::exception& e)
+            {
+                {
+                    std::lock_guard<decltype(mac_addrs_mutex)> lock{mac_addrs_mutex};
+                    for (const auto& mac : claimed_macs)
+                        allocated_mac_addrs.erase(mac);
+                }
+
+                throw CreateImageException(e.what());
+            }
+        };
 
-    prepare_future_watcher->setFuture(QtConcurrent::run(make_vm_description));
+        // The vault fetches an image once for all the instances that ask for it at the same time
+        prepare_future_watcher->setFuture(QtConcurrent::run(make_vm_description));
+    }
 }
 
-grpc::Status mp::Daemon::reboot_vm(VirtualMachine& vm)
+grpc::Status mp::Daemon::reboot_vm(VirtualMachine& vm, VirtualMachine::State state)
 {
-    if (vm.state == VirtualMachine::State::delayed_shutdown)
-        delayed_shutdown_instances.erase(vm.vm_name);
-
-    if (!mp::utils::is_running(vm.current_state()))
+    if (!mp::utils::is_running(state))
         return grpc::Status{grpc::StatusCode::INVALID_ARGUMENT,
                             fmt::format("instance \"{}\" is not running", vm.vm_name), ""};
 
@@ -2325,37 +5765,29 @@ grpc::Status mp::Daemon::reboot_vm(VirtualMachine& vm)
     return ssh_reboot(vm.ssh_hostname(), vm.ssh_port(), vm.ssh_username(), *config->ssh_key_provider);
 }
 
-grpc::Status mp::Daemon::shutdown_vm(VirtualMachine& vm, const std::chrono::milliseconds delay)
+grpc::Status mp::Daemon::shutdown_vm(VirtualMachine& vm, const std::chrono::milliseconds delay,
+                                     mp::optional<SSHSession> session)
 {
     const auto& name = vm.vm_name;
-    const auto& state = vm.current_state();
-
-    using St = VirtualMachine::State;
-    const auto skip_states = {St::off, St::stopped, St::suspended};
 
-    if (std::none_of(cbegin(skip_states), cend(skip_states), [&state](const auto& st) { return state == st; }))
+    if (needs_stopping(vm.current_state()))
     {
-        delayed_shutdown_instances.erase(name);
+        cancel_delayed_shutdown(name);
 
-        mp::optional<mp::SSHSession> session;
-        try
-        {
-            session = mp::SSHSession{vm.ssh_hostname(), vm.ssh_port(), vm.ssh_username(), *config->ssh_key_provider};
-        }
-        catch (const std::exception& e)
-        {
-            mpl::log(mpl::Level::info, category,
-                     fmt::format("Cannot open ssh session on \"{}\" shutdown: {}", name, e.what()));
-        }
-
-        auto& shutdown_timer = delayed_shutdown_instances[name] = std::make_unique<DelayedShutdownTimer>(
+        auto shutdown_timer = std::make_unique<DelayedShutdownTimer>(
             &vm, std::move(session),
             std::bind(&SSHFSMounts::stop_all_mounts_for_instance, &instance_mounts, std::placeholders::_1));
 
         QObject::connect(shutdown_timer.get(), &DelayedShutdownTimer::finished,
-                         [this, name]() { delayed_shutdown_instances.erase(name); });
+                         [this, name]() { cancel_delayed_shutdown(name); });
+
+        auto timer = shutdown_timer.get();
+        {
+            std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+            delayed_shutdown_instances[name] = std::move(shutdown_timer);
+        }
 
-        shutdown_timer->start(delay);
+        timer->start(delay); // not under the lock, as shutting down right away updates the instance's state
     }
     else
         mpl::log(mpl::Level::debug, category, fmt::format("instance \"{}\" does not need stopping", name));
@@ -2365,10 +5797,7 @@ grpc::Status mp::Daemon::shutdown_vm(VirtualMachine& vm, const std::chrono::mill
 
 grpc::Status mp::Daemon::cancel_vm_shutdown(const VirtualMachine& vm)
 {
-    auto it = delayed_shutdown_instances.find(vm.vm_name);
-    if (it != delayed_shutdown_instances.end())
-        delayed_shutdown_instances.erase(it);
-    else
+    if (!cancel_delayed_shutdown(vm.vm_name))
         mpl::log(mpl::Level::debug, category,
                  fmt::format("no delayed shutdown to cancel on instance \"{}\"", vm.vm_name));
 
@@ -2381,7 +5810,14 @@ grpc::Status mp::Daemon::cmd_vms(const std::vector<std::string>& tgts, std::func
   it gives clear error messages on type mismatch (!= templated callable). */
     for (const auto& tgt : tgts)
     {
-        const auto st = cmd(*vm_instances.at(tgt));
+        auto lock = lock_operations_on(tgt);
+        VirtualMachine::ShPtr vm;
+        {
+            std::shared_lock<decltype(instances_mutex)> instances_lock{instances_mutex};
+            vm = vm_instances.at(tgt);
+        }
+
+        const auto st = cmd(*vm);
         if (!st.ok())
             return st; // Fail early
     }
@@ -2389,6 +5825,148 @@ grpc::Status mp::Daemon::cmd_vms(const std::vector<std::string>& tgts, std::func
     return grpc::Status::OK;
 }
 
+// For commands that only reach the instances over SSH: those that touch the hypervisor or Qt objects of the daemon
+// stay on the main thread, with cmd_vms(). Backends update the state of their instances from the main thread, so it is
+// read here and handed to each command, rather than read from the pool
+grpc::Status mp::Daemon::cmd_vms_concurrently(const std::vector<std::string>& tgts,
+                                              std::function<grpc::Status(VirtualMachine&, VirtualMachine::State)> cmd)
+{
+    std::vector<std::pair<std::string, VirtualMachine::ShPtr>> targets;
+    {
+        std::shared_lock<decltype(instances_mutex)> lock{instances_mutex};
+        for (const auto& tgt : tgts)
+            targets.emplace_back(tgt, vm_instances.at(tgt));
+    }
+
+    QThreadPool operation_pool;
+    operation_pool.setMaxThreadCount(max_concurrent_instance_operations);
+
+    std::vector<QFuture<std::pair<grpc::Status, std::exception_ptr>>> results;
+    for (const auto& target : targets)
+    {
+        results.push_back(QtConcurrent::run(
+            &operation_pool,
+            [this, &cmd, tgt = target.first, vm = target.second,
+             state = target.second->current_state()]() -> std::pair<grpc::Status, std::exception_ptr> {
+                try
+                {
+                    auto lock = lock_operations_on(tgt);
+                    return {cmd(*vm, state), nullptr};
+                }
+                catch (...)
+                {
+                    return {grpc::Status::OK, std::current_exception()};
+                }
+            }));
+    }
+
+    // Every target is seen to, but failures are reported in target order, the first deciding the status code
+    fmt::memory_buffer errors;
+    mp::optional<grpc::Status> first_failure;
+    auto failures = 0;
+    for (auto& result : results)
+    {
+        const auto [status, error] = result.result();
+        if (error)
+            std::rethrow_exception(error);
+
+        if (!status.ok())
+        {
+            fmt::format_to(errors, "{}\n", status.error_message());
+            if (!failures++)
+                first_failure = status;
+        }
+    }
+
+    if (!first_failure)
+        return grpc::Status::OK;
+
+    if (failures == 1)
+        return *first_failure;
+
+    auto error_string = fmt::to_string(errors);
+    error_string.pop_back();
+    return grpc::Status(first_failure->error_code(), fmt::format("The following errors occurred:\n{}", error_string),
+                        first_failure->error_details());
+}
+
+std::unique_lock<std::mutex> mp::Daemon::lock_operations_on(const std::string& name)
+{
+    std::unique_lock<decltype(operation_locks_mutex)> table_lock{operation_locks_mutex};
+    auto& instance_mutex = operation_locks[name]; // never erased, so the reference outlives table_lock
+    table_lock.unlock();
+
+    return std::unique_lock<std::mutex>{instance_mutex};
+}
+
+// The main thread is not to wait the minutes that compacting a disk takes, so it waits for others only as long as
+// they are not compacting
+std::unique_lock<std::mutex> mp::Daemon::lock_operations_unless_compacting(const std::string& name)
+{
+    std::unique_lock<decltype(operation_locks_mutex)> table_lock{operation_locks_mutex};
+    std::unique_lock<std::mutex> lock{operation_locks[name], std::defer_lock};
+    table_lock.unlock();
+
+    while (!lock.try_lock())
+    {
+        table_lock.lock();
+        const auto compacting = compacting_instance == name;
+        table_lock.unlock();
+
+        if (compacting)
+            throw std::runtime_error(
+                fmt::format("the disk of {} is being compacted, try again in a few minutes", name));
+
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+
+    return lock;
+}
+
+std::unique_lock<std::mutex> mp::Daemon::lock_operations_for_compaction(const std::string& name)
+{
+    std::lock_guard<decltype(operation_locks_mutex)> table_lock{operation_locks_mutex};
+    std::unique_lock<std::mutex> lock{operation_locks[name], std::try_to_lock};
+    if (lock.owns_lock())
+        compacting_instance = name;
+
+    return lock;
+}
+
+void mp::Daemon::end_compaction()
+{
+    std::lock_guard<decltype(operation_locks_mutex)> table_lock{operation_locks_mutex};
+    compacting_instance.clear();
+}
+
+std::string mp::Daemon::package_cache_address()
+{
+    std::lock_guard<decltype(package_cache_mutex)> lock{package_cache_mutex};
+
+    const auto host = config->factory->host_address();
+    if (host.empty() || MP_SETTINGS.get(mp::package_cache_key) != "true")
+    {
+        package_cache.reset();
+        return {};
+    }
+
+    if (!package_cache)
+    {
+        try
+        {
+            package_cache = std::make_unique<PackageCache>(
+                QDir{config->cache_directory}.filePath("packages").toStdString(), host, mp::package_cache_port);
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::warning, category, fmt::format("Cannot start the package cache: {}", e.what()));
+            return {};
+        }
+    }
+
+    return host;
+}
+
 QFutureWatcher<mp::Daemon::AsyncOperationStatus>*
 mp::Daemon::create_future_watcher(std::function<void()> const& finished_op)
 {
@@ -2407,84 +5985,253 @@ mp::Daemon::create_future_watcher(std::function<void()> const& finished_op)
 template <typename Reply>
 error_string mp::Daemon::async_wait_for_ssh_and_start_mounts_for(const std::string& name,
                                                                  const std::chrono::seconds& timeout,
-                                                                 grpc::ServerWriter<Reply>* server)
+                                                                 grpc::ServerWriterInterface<Reply>* server)
 {
     fmt::memory_buffer errors;
+    auto timings = launch_timings_for(name); // only for instances being launched
+    auto enter = [&timings](const char* phase) {
+        if (timings)
+            timings->enter(phase);
+    };
+
+    // Run alongside the mounts
+    QFuture<std::string> cloud_init;
+    QFuture<std::string> native_mounting;
+
     try
     {
         auto it = vm_instances.find(name);
         auto vm = it->second;
+        enter("ssh_up");
         vm->wait_until_ssh_up(timeout);
 
-        if (std::is_same<Reply, LaunchReply>::value)
+        // Mounts only need SSH, so they start while cloud-init carries on; whatever of the wait is left after the
+        // mounts counts as the cloud_init phase
+        constexpr auto launching = std::is_same<Reply, LaunchReply>::value;
+        if (launching)
         {
             if (server)
             {
                 Reply reply;
                 reply.set_reply_message("Waiting for initialization to complete");
-                server->Write(reply);
+                mpl::write_to_client(server, reply);
             }
 
-            MP_UTILS.wait_for_cloud_init(vm.get(), timeout, *config->ssh_key_provider);
+            cloud_init = QtConcurrent::run(&wait_pool, [this, vm, timeout]() -> std::string {
+                try
+                {
+                    MP_UTILS.wait_for_cloud_init(vm.get(), timeout, *config->ssh_key_provider);
+                    return {};
+                }
+                catch (const std::exception& e)
+                {
+                    return e.what();
+                }
+            });
         }
 
+        enter("mounts");
+
         std::vector<std::string> invalid_mounts;
-        auto& mounts = vm_instance_specs[name].mounts;
-        auto& vm_specs = vm_instance_specs[name];
-        for (const auto& mount_entry : mounts)
+        const auto ssh_username = vm_instance_specs[name].ssh_username;
+
+        // Native mounts are already shared by the hypervisor, they only need mounting; the rest go over SSHFS
+        std::unordered_map<std::string, VMMount> mounts;
+        std::vector<std::pair<std::string, std::string>> native_mounts;
+        for (const auto& mount_entry : vm_instance_specs[name].mounts)
+        {
+            if (mount_entry.second.type == VMMount::Type::native)
+                native_mounts.emplace_back(mount_entry.first, native_mount_tag_for(name, mount_entry.first));
+            else
+                mounts.insert(mount_entry);
+        }
+
+        if (!native_mounts.empty())
+        {
+            native_mounting = QtConcurrent::run(&wait_pool, [this, vm, ssh_username, native_mounts]() -> std::string {
+                fmt::memory_buffer native_errors;
+                try
+                {
+                    mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), ssh_username,
+                                           *config->ssh_key_provider};
+                    for (const auto& native_mount : native_mounts)
+                    {
+                        try
+                        {
+                            mount_native_in(session, native_mount.second, native_mount.first);
+                        }
+                        catch (const std::exception& e)
+                        {
+                            fmt::format_to(native_errors, "Could not mount \"{}\": {}\n", native_mount.first,
+                                           e.what());
+                        }
+                    }
+                }
+                catch (const std::exception& e)
+                {
+                    fmt::format_to(native_errors, "Could not mount natively: {}\n", e.what());
+                }
+
+                return fmt::to_string(native_errors);
+            });
+        }
+
+        // Serve all the mounts from one sshfs_server if they can be, otherwise start them one by one, all at once, to
+        // find those that fail; they share its session, and so have to share its compression
+        auto served_together = false;
+        const auto same_compression = std::all_of(mounts.begin(), mounts.end(), [&mounts](const auto& mount_entry) {
+            return mount_entry.second.compression == mounts.begin()->second.compression;
+        });
+        if (mounts.size() > 1 && same_compression)
         {
-            auto& target_path = mount_entry.first;
-            auto& source_path = mount_entry.second.source_path;
-            auto& uid_map = mount_entry.second.uid_map;
-            auto& gid_map = mount_entry.second.gid_map;
+            std::vector<mp::SSHFSServerConfig::Mount> all_mounts;
+            for (const auto& mount_entry : mounts)
+                all_mounts.push_back({mount_entry.second.source_path, mount_entry.first, mount_entry.second.gid_map,
+                                      mount_entry.second.uid_map});
 
             try
             {
-                instance_mounts.start_mount(vm.get(), source_path, target_path, gid_map, uid_map);
+                instance_mounts.start_mounts(vm.get(), all_mounts, mounts.begin()->second.compression);
+                served_together = true;
             }
-            catch (const mp::SSHFSMissingError&)
+            catch (const std::exception& e)
+            {
+                mpl::log(mpl::Level::debug, category,
+                         fmt::format("Could not serve the mounts of \"{}\" together: {}", name, e.what()));
+            }
+        }
+
+        if (!served_together && !mounts.empty())
+        {
+            auto start_each = [this, &vm, &mounts](const std::vector<std::string>& target_paths) {
+                std::vector<QFuture<MountAttempt>> attempts;
+                for (const auto& target_path : target_paths)
+                {
+                    const auto& mount = mounts.at(target_path);
+                    attempts.push_back(QtConcurrent::run(&wait_pool, [this, vm, target_path, mount] {
+                        MountAttempt attempt;
+                        try
+                        {
+                            instance_mounts.start_mount(vm.get(), mount.source_path, target_path, mount.gid_map,
+                                                        mount.uid_map, mount.compression);
+                        }
+                        catch (const mp::SSHFSMissingError&)
+                        {
+                            attempt.sshfs_missing = true;
+                        }
+                        catch (const std::exception& e)
+                        {
+                            attempt.error = e.what();
+                        }
+                        return attempt;
+                    }));
+                }
+
+                std::vector<MountAttempt> results;
+                for (auto& attempt : attempts)
+                    results.push_back(attempt.result());
+                return results;
+            };
+
+            std::vector<std::string> target_paths;
+            for (const auto& mount_entry : mounts)
+                target_paths.push_back(mount_entry.first);
+
+            std::vector<std::string> missing_sshfs;
+            auto attempts = start_each(target_paths);
+            for (auto i = 0u; i < attempts.size(); ++i)
             {
+                if (attempts[i].sshfs_missing)
+                    missing_sshfs.push_back(target_paths[i]);
+                else if (!attempts[i].error.empty())
+                {
+                    fmt::format_to(errors, "Removing \"{}\": {}\n", target_paths[i], attempts[i].error);
+                    invalid_mounts.push_back(target_paths[i]);
+                }
+            }
+
+            if (!missing_sshfs.empty())
+            {
+                // Installing goes through the package managers, which cloud-init may still be busy with
+                if (launching)
+                    cloud_init.waitForFinished();
+
                 try
                 {
                     if (server)
                     {
                         Reply reply;
                         reply.set_reply_message("Enabling support for mounting");
-                        server->Write(reply);
+                        mpl::write_to_client(server, reply);
                     }
 
-                    mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), vm_specs.ssh_username,
+                    mp::SSHSession session{vm->ssh_hostname(), vm->ssh_port(), ssh_username,
                                            *config->ssh_key_provider};
-                    mp::utils::install_sshfs_for(name, session);
-                    instance_mounts.start_mount(vm.get(), source_path, target_path, gid_map, uid_map);
+                    install_sshfs_in(name, *vm, ssh_username, session, *config->ssh_key_provider,
+                                     sshfs_snap_cache);
+
+                    auto retries = start_each(missing_sshfs);
+                    auto still_missing = false;
+                    for (auto i = 0u; i < retries.size(); ++i)
+                    {
+                        if (retries[i].sshfs_missing)
+                            still_missing = true;
+                        else if (!retries[i].error.empty())
+                        {
+                            fmt::format_to(errors, "Removing \"{}\": {}\n", missing_sshfs[i], retries[i].error);
+                            invalid_mounts.push_back(missing_sshfs[i]);
+                        }
+                    }
+
+                    if (still_missing)
+                        fmt::format_to(errors, sshfs_error_template + "\n", name);
                 }
                 catch (const mp::SSHFSMissingError&)
                 {
                     fmt::format_to(errors, sshfs_error_template + "\n", name);
-                    break;
+                }
+                catch (const std::exception& e)
+                {
+                    for (const auto& target_path : missing_sshfs)
+                    {
+                        fmt::format_to(errors, "Removing \"{}\": {}\n", target_path, e.what());
+                        invalid_mounts.push_back(target_path);
+                    }
                 }
             }
-            catch (const std::exception& e)
-            {
-                fmt::format_to(errors, "Removing \"{}\": {}\n", target_path, e.what());
-                invalid_mounts.push_back(target_path);
-            }
+
             persist_instances();
         }
+
+        if (!native_mounts.empty())
+            fmt::format_to(errors, "{}", native_mounting.result());
+
+        if (launching)
+        {
+            enter("cloud_init");
+            fmt::format_to(errors, "{}", cloud_init.result());
+        }
     }
     catch (const std::exception& e)
     {
         fmt::format_to(errors, e.what());
     }
 
+    // Not to leave them using the daemon once the wait that the daemon joins is over
+    cloud_init.waitForFinished();
+    native_mounting.waitForFinished();
+
+    if (timings)
+        timings->leave();
     return fmt::to_string(errors);
 }
 
 template <typename Reply>
 mp::Daemon::AsyncOperationStatus
-mp::Daemon::async_wait_for_ready_all(grpc::ServerWriter<Reply>* server, const std::vector<std::string>& vms,
+mp::Daemon::async_wait_for_ready_all(grpc::ServerWriterInterface<Reply>* server, const std::vector<std::string>& vms,
                                      const std::chrono::seconds& timeout, std::promise<grpc::Status>* status_promise)
 {
+    TraceSpan span{"daemon", "wait_for_ready"};
     QFutureSynchronizer<std::string> start_synchronizer;
     {
         std::lock_guard<decltype(start_mutex)> lock{start_mutex};
@@ -2496,8 +6243,9 @@ mp::Daemon::async_wait_for_ready_all(grpc::ServerWriter<Reply>* server, const st
             }
             else
             {
-                auto future = QtConcurrent::run(this, &Daemon::async_wait_for_ssh_and_start_mounts_for<Reply>, name,
-                                                timeout, server);
+                auto future = QtConcurrent::run(&wait_pool, this,
+                                                &Daemon::async_wait_for_ssh_and_start_mounts_for<Reply>, name, timeout,
+                                                server);
                 async_running_futures[name] = future;
                 start_synchronizer.addFuture(future);
             }
@@ -2530,13 +6278,211 @@ mp::Daemon::async_wait_for_ready_all(grpc::ServerWriter<Reply>* server, const st
         {
             Reply reply;
             config->update_prompt->populate(reply.mutable_update_info());
-            server->Write(reply);
+            mpl::write_to_client(server, reply);
         }
     }
 
     return {grpc_status_for(errors), status_promise};
 }
 
+struct mp::Daemon::StartBatch
+{
+    std::deque<std::string> pending;
+    std::size_t limit;
+    std::size_t booting{0};
+    std::chrono::seconds timeout;
+    grpc::ServerWriterInterface<StartReply>* server;
+    std::promise<grpc::Status>* status_promise;
+    fmt::memory_buffer errors;
+};
+
+// Called on the main thread, which the hypervisor needs, whenever there may be room for more instances to boot. The
+// instances are waited for on other threads, and each one that is ready makes room for the next.
+void mp::Daemon::start_next_instances(const std::shared_ptr<StartBatch>& batch)
+{
+    while (batch->booting < batch->limit && !batch->pending.empty())
+    {
+        const auto name = std::move(batch->pending.front());
+        batch->pending.pop_front();
+
+        try
+        {
+            auto lock = lock_operations_unless_compacting(name);
+            auto& vm = vm_instances.at(name);
+            auto state = vm->current_state();
+            if (state != VirtualMachine::State::starting && state != VirtualMachine::State::restarting)
+                vm->start();
+        }
+        catch (const std::exception& e)
+        {
+            fmt::format_to(batch->errors, "Could not start {}: {}\n", name, e.what());
+            continue;
+        }
+
+        StartReply reply;
+        reply.set_reply_message(fmt::format("Starting {}", name));
+        mpl::write_to_client(batch->server, reply);
+
+        QFuture<std::string> future;
+        {
+            // An instance that another request is already waiting for is not waited for twice
+            std::lock_guard<decltype(start_mutex)> lock{start_mutex};
+            auto it = async_running_futures.find(name);
+            if (it != async_running_futures.end())
+                future = it->second;
+            else
+                future = async_running_futures[name] =
+                    QtConcurrent::run(&wait_pool, this, &Daemon::async_wait_for_ssh_and_start_mounts_for<StartReply>,
+                                      name, batch->timeout, batch->server);
+        }
+
+        ++batch->booting;
+        auto watcher = new QFutureWatcher<std::string>();
+        QObject::connect(watcher, &QFutureWatcher<std::string>::finished, [this, batch, name, watcher] {
+            {
+                std::lock_guard<decltype(start_mutex)> lock{start_mutex};
+                auto it = async_running_futures.find(name);
+                if (it != async_running_futures.end() && it->second == watcher->future())
+                    async_running_futures.erase(it);
+            }
+
+            if (auto error = watcher->result(); !error.empty())
+                fmt::format_to(batch->errors, "{}\n", error);
+
+            --batch->booting;
+            watcher->deleteLater();
+            start_next_instances(batch);
+        });
+        watcher->setFuture(future);
+    }
+
+    if (batch->booting || !batch->pending.empty())
+        return;
+
+    if (config->update_prompt->is_time_to_show())
+    {
+        StartReply reply;
+        config->update_prompt->populate(reply.mutable_update_info());
+        mpl::write_to_client(batch->server, reply);
+    }
+
+    auto status = grpc_status_for(batch->errors);
+    if (!status.ok())
+        persist_instances();
+
+    batch->status_promise->set_value(status);
+}
+
+// Whether a launch or start may go ahead now, called on the main thread. Those that have to wait are queued, to be
+// retried once there is room, and those the host has no room for are turned down.
+bool mp::Daemon::admit(const AdmissionPolicy::Load& demand, std::function<void()> retry,
+                       std::function<bool(std::size_t)> notify_position, std::promise<grpc::Status>* status_promise)
+{
+    if (admission_granted)
+    {
+        admission_granted = false;
+        return true;
+    }
+
+    const auto policy = AdmissionPolicy::from_settings();
+    if (policy.mode == AdmissionPolicy::Mode::off)
+        return true;
+
+    if (!policy.can_ever_admit(demand))
+    {
+        status_promise->set_value(grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                                               fmt::format("Not enough room on the host: {}", policy.describe(demand)),
+                                               ""));
+        return false;
+    }
+
+    // Those queued already go first
+    if (admission_queue.empty() && policy.admits(committed_load(), demand, host_memory_pressure()))
+        return true;
+
+    if (policy.mode == AdmissionPolicy::Mode::reject)
+    {
+        status_promise->set_value(grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                                               fmt::format("The host is too busy: {}", policy.describe(demand)), ""));
+        return false;
+    }
+
+    const auto position = admission_queue.size() + 1;
+    if (!notify_position(position))
+    {
+        status_promise->set_value(grpc::Status::CANCELLED);
+        return false;
+    }
+
+    admission_queue.push_back({demand, std::move(retry), std::move(notify_position), status_promise, position});
+    if (!admission_task.isActive())
+        admission_task.start(admission_retry_interval);
+
+    return false;
+}
+
+void mp::Daemon::admit_queued()
+{
+    // Should queuing have been turned off since, whatever is queued goes ahead
+    const auto policy = AdmissionPolicy::from_settings();
+    while (!admission_queue.empty() &&
+           (policy.mode != AdmissionPolicy::Mode::queue ||
+            policy.admits(committed_load(), admission_queue.front().demand, host_memory_pressure())))
+    {
+        auto admitted = std::move(admission_queue.front());
+        admission_queue.pop_front();
+
+        // The retry goes through every check again, but for admission
+        admission_granted = true;
+        try
+        {
+            admitted.retry();
+        }
+        catch (const std::exception& e)
+        {
+            admitted.status_promise->set_value(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, e.what(), ""));
+        }
+        admission_granted = false;
+    }
+
+    // Those still waiting hear when they move up, and those that went away make room
+    std::size_t position = 1;
+    for (auto it = admission_queue.begin(); it != admission_queue.end();)
+    {
+        if (it->position != position && !it->notify_position(position))
+        {
+            it->status_promise->set_value(grpc::Status::CANCELLED);
+            it = admission_queue.erase(it);
+        }
+        else
+        {
+            it->position = position++;
+            ++it;
+        }
+    }
+
+    if (admission_queue.empty())
+        admission_task.stop();
+}
+
+// What the instances that are up, or on their way up, take; must be called from the main thread
+mp::AdmissionPolicy::Load mp::Daemon::committed_load()
+{
+    AdmissionPolicy::Load load{0, 0};
+    for (const auto& item : vm_instances)
+    {
+        const auto state = item.second->current_state();
+        if (state != VirtualMachine::State::off && state != VirtualMachine::State::stopped &&
+            state != VirtualMachine::State::suspended && !admission_reservations.count(item.first))
+            load = load + load_of(vm_instance_specs.at(item.first));
+    }
+
+    for (const auto& reservation : admission_reservations)
+        load = load + reservation.second;
+
+    return load;
+}
+
 void mp::Daemon::finish_async_operation(QFuture<AsyncOperationStatus> async_future)
 {
     auto it = std::find_if(async_future_watchers.begin(), async_future_watchers.end(),
@@ -18,36 +18,65 @@
 #ifndef MULTIPASS_DAEMON_H
 #define MULTIPASS_DAEMON_H
 
+#include "admission_policy.h"
 #include "daemon_config.h"
 #include "daemon_rpc.h"
+#include "json_journal.h"
+#include "package_cache.h"
+#include "port_forwarder.h"
+#include "sshfs_snap_cache.h"
+#include "usage_history.h"
+#include "warm_pool.h"
 
 #include <multipass/delayed_shutdown_timer.h>
 #include <multipass/memory_size.h>
 #include <multipass/metrics_provider.h>
 #include <multipass/network_interface.h>
+#include <multipass/optional.h>
+#include <multipass/ssh/ssh_session_pool.h>
 #include <multipass/sshfs_mount/sshfs_mounts.h>
 #include <multipass/virtual_machine.h>
+#include <multipass/virtual_machine_description.h>
 #include <multipass/vm_status_monitor.h>
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <future>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 #include <QFutureWatcher>
+#include <QThreadPool>
 
 namespace multipass
 {
 struct VMMount
 {
+    enum class Type
+    {
+        classic, // served over SSHFS
+        native   // shared by the hypervisor, only taking effect from the next boot
+    };
+
     std::string source_path;
-    std::unordered_map<int, int> gid_map;
+    std::unordered_map<int, int> gid_map; // kept as the mount handlers take them; a mount maps an id or two at most
     std::unordered_map<int, int> uid_map;
+    Type type;
+    std::string compression; // "auto", "on" or "off" for a classic mount, overriding local.ssh-compression if set
 };
 
+// Where forwarded ports are listened on unless told otherwise
+constexpr auto default_forward_address = "127.0.0.1";
+
 struct VMSpecs
 {
     int num_cores;
@@ -60,6 +89,10 @@ struct VMSpecs
     std::unordered_map<std::string, VMMount> mounts;
     bool deleted;
     QJsonObject metadata;
+    std::string storage_profile;
+    IoLimits io_limits;
+    std::map<std::pair<std::string, int>, int> port_forwards; // instance ports, by host address and port
+    bool ephemeral{false};                                    // never written out, and purged once it stops
 };
 
 struct MetricsOptInData
@@ -74,6 +107,7 @@ class Daemon : public QObject, public multipass::VMStatusMonitor
     Q_OBJECT
 public:
     explicit Daemon(std::unique_ptr<const DaemonConfig> config);
+    ~Daemon();
     Daemon(const Daemon&) = delete;
     Daemon& operator=(const Daemon&) = delete;
 
@@ -88,10 +122,10 @@ protected:
     QJsonObject retrieve_metadata_for(const std::string& name) override;
 
 public slots:
-    virtual void create(const CreateRequest* request, grpc::ServerWriter<CreateReply>* reply,
+    virtual void create(const CreateRequest* request, grpc::ServerWriterInterface<CreateReply>* reply,
                         std::promise<grpc::Status>* status_promise);
 
-    virtual void launch(const LaunchRequest* request, grpc::ServerWriter<LaunchReply>* reply,
+    virtual void launch(const LaunchRequest* request, grpc::ServerWriterInterface<LaunchReply>* reply,
                         std::promise<grpc::Status>* status_promise);
 
     virtual void purge(const PurgeRequest* request, grpc::ServerWriter<PurgeReply>* response,
@@ -109,16 +143,17 @@ public slots:
     virtual void networks(const NetworksRequest* request, grpc::ServerWriter<NetworksReply>* response,
                           std::promise<grpc::Status>* status_promise);
 
-    virtual void mount(const MountRequest* request, grpc::ServerWriter<MountReply>* response,
+    virtual void mount(const MountRequest* request, grpc::ServerWriterInterface<MountReply>* response,
                        std::promise<grpc::Status>* status_promise);
 
     virtual void recover(const RecoverRequest* request, grpc::ServerWriter<RecoverReply>* response,
                          std::promise<grpc::Status>* status_promise);
 
+    // Local clients can be handed hosts only reachable from this one, such as an instance's vsock address
     virtual void ssh_info(const SSHInfoRequest* request, grpc::ServerWriter<SSHInfoReply>* response,
-                          std::promise<grpc::Status>* status_promise);
+                          bool local_client, std::promise<grpc::Status>* status_promise);
 
-    virtual void start(const StartRequest* request, grpc::ServerWriter<StartReply>* response,
+    virtual void start(const StartRequest* request, grpc::ServerWriterInterface<StartReply>* response,
                        std::promise<grpc::Status>* status_promise);
 
     virtual void stop(const StopRequest* request, grpc::ServerWriter<StopReply>* response,
@@ -127,7 +162,7 @@ public slots:
     virtual void suspend(const SuspendRequest* request, grpc::ServerWriter<SuspendReply>* response,
                          std::promise<grpc::Status>* status_promise);
 
-    virtual void restart(const RestartRequest* request, grpc::ServerWriter<RestartReply>* response,
+    virtual void restart(const RestartRequest* request, grpc::ServerWriterInterface<RestartReply>* response,
                          std::promise<grpc::Status>* status_promise);
 
     virtual void delet(const DeleteRequest* request, grpc::ServerWriter<DeleteReply>* response,
@@ -139,18 +174,94 @@ public slots:
     virtual void version(const VersionRequest* request, grpc::ServerWriter<VersionReply>* response,
                          std::promise<grpc::Status>* status_promise);
 
+    // Keeps writing status changes to the client until it hangs up or the daemon goes away
+    virtual void watch(const WatchRequest* request, grpc::ServerWriterInterface<WatchReply>* response,
+                       std::promise<grpc::Status>* status_promise);
+    virtual void unwatch(grpc::ServerWriterInterface<WatchReply>* response);
+
+    virtual void bake(const BakeRequest* request, grpc::ServerWriter<BakeReply>* response,
+                      std::promise<grpc::Status>* status_promise);
+
+    virtual void stats(const StatsRequest* request, grpc::ServerWriter<StatsReply>* response,
+                       std::promise<grpc::Status>* status_promise);
+
+    virtual void bench_mount(const BenchMountRequest* request, grpc::ServerWriter<BenchMountReply>* response,
+                             std::promise<grpc::Status>* status_promise);
+
+    virtual void throttle(const ThrottleRequest* request, grpc::ServerWriter<ThrottleReply>* response,
+                          std::promise<grpc::Status>* status_promise);
+
+    virtual void clone(const CloneRequest* request, grpc::ServerWriter<CloneReply>* response,
+                       std::promise<grpc::Status>* status_promise);
+
+    virtual void forward(const ForwardRequest* request, grpc::ServerWriter<ForwardReply>* response,
+                         std::promise<grpc::Status>* status_promise);
+
+    virtual void capacity(const CapacityRequest* request, grpc::ServerWriter<CapacityReply>* response,
+                          std::promise<grpc::Status>* status_promise);
+
+    virtual void copy_files(const CopyFilesRequest* request, grpc::ServerWriter<CopyFilesReply>* response,
+                            std::promise<grpc::Status>* status_promise);
+
+    virtual void resize(const ResizeRequest* request, grpc::ServerWriter<ResizeReply>* response,
+                        std::promise<grpc::Status>* status_promise);
+
 private:
-    void persist_instances();
-    void release_resources(const std::string& instance);
+    void persist_instances(); // only schedules the write, so it is cheap to call after every change
+    void write_instances(WriteDurability durability);
+    void write_instances_behind();
+    std::unordered_map<std::string, InstanceStatus::Status> instance_statuses();
+    void push_status_changes();
+    void warm_up_next_instance();
+    void finish_warming();
+    void warm_up(const std::string& name);
+    void release_resources(const std::string& instance); // must be called with instances_mutex held exclusively
+    void purge_ephemeral(const std::string& name); // once it stopped, as if deleted and purged
+    bool cancel_delayed_shutdown(const std::string& name);
+    std::string current_release_for(const std::string& name);
     std::string check_instance_operational(const std::string& instance_name) const;
     std::string check_instance_exists(const std::string& instance_name) const;
-    void create_vm(const CreateRequest* request, grpc::ServerWriter<CreateReply>* server,
+    void create_vm(const CreateRequest* request, grpc::ServerWriterInterface<CreateReply>* server,
                    std::promise<grpc::Status>* status_promise, bool start);
-    grpc::Status reboot_vm(VirtualMachine& vm);
-    grpc::Status shutdown_vm(VirtualMachine& vm, const std::chrono::milliseconds delay);
+    // Whether a request that brings instances up may go ahead; if not, it is either queued, to be retried once there
+    // is room, or turned away, and its status is set
+    bool admit(const AdmissionPolicy::Load& demand, std::function<void()> retry,
+               std::function<bool(std::size_t)> notify_position, std::promise<grpc::Status>* status_promise);
+    void admit_queued();
+    AdmissionPolicy::Load committed_load();
+    grpc::Status reboot_vm(VirtualMachine& vm, VirtualMachine::State state);
+    grpc::Status shutdown_vm(VirtualMachine& vm, const std::chrono::milliseconds delay, optional<SSHSession> session);
     grpc::Status cancel_vm_shutdown(const VirtualMachine& vm);
     grpc::Status cmd_vms(const std::vector<std::string>& tgts, std::function<grpc::Status(VirtualMachine&)> cmd);
+    grpc::Status cmd_vms_concurrently(const std::vector<std::string>& tgts,
+                                      std::function<grpc::Status(VirtualMachine&, VirtualMachine::State)> cmd);
+    std::unique_lock<std::mutex> lock_operations_on(const std::string& name);
+    std::unique_lock<std::mutex> lock_operations_unless_compacting(const std::string& name); // throws if it is
+    std::unique_lock<std::mutex> lock_operations_for_compaction(const std::string& name); // unowned if others have it
+    void end_compaction();
+    // Where new instances find the package cache, empty if it is off; starts or stops the cache to follow its setting
+    std::string package_cache_address();
     void install_sshfs(VirtualMachine* vm, const std::string& name);
+    void update_source_images(bool prune);
+    void reclaim_instance_disks();
+    void begin_shutting_down_instances();
+    void suspend_idle_instances();
+    void resume_if_idle(const std::string& name); // blocks until it is back, unless called on the main thread
+    void resume_idle_instance(const std::string& name);
+    void sample_usage();
+    void refill_warm_pool();
+    void fill_pool_slot(const std::string& name); // must be called with instances_mutex held exclusively
+    VirtualMachineDescription prepare_pool_instance(const std::string& name, const WarmPoolSpec& spec);
+    void settle_pool_instance(const std::string& name);
+    void discard_pool_instance(const std::string& name); // must be called without instances_mutex held
+    bool wanted_in_pool(const std::string& name) const;  // must be called with instances_mutex held
+    // Brings up a clone made off a suspended instance's memory and has it take an identity of its own
+    void resume_clone(grpc::ServerWriter<CloneReply>* server, const std::string& source_name, const std::string& name,
+                      const std::vector<std::pair<std::string, std::string>>& mac_changes,
+                      std::promise<grpc::Status>* status_promise);
+    bool claim_pool_instance(const LaunchRequest* request, const std::string& name,
+                             const std::chrono::seconds& timeout, grpc::ServerWriterInterface<LaunchReply>* server,
+                             std::promise<grpc::Status>* status_promise);
 
     struct AsyncOperationStatus
     {
@@ -160,30 +271,129 @@ private:
 
     template <typename Reply>
     std::string async_wait_for_ssh_and_start_mounts_for(const std::string& name, const std::chrono::seconds& timeout,
-                                                        grpc::ServerWriter<Reply>* server);
+                                                        grpc::ServerWriterInterface<Reply>* server);
     template <typename Reply>
     AsyncOperationStatus
-    async_wait_for_ready_all(grpc::ServerWriter<Reply>* server, const std::vector<std::string>& vms,
+    async_wait_for_ready_all(grpc::ServerWriterInterface<Reply>* server, const std::vector<std::string>& vms,
                              const std::chrono::seconds& timeout, std::promise<grpc::Status>* status_promise);
     void finish_async_operation(QFuture<AsyncOperationStatus> async_future);
+
+    // Instances a start request brings up, no more than a limit of them booting at once
+    struct StartBatch;
+    void start_next_instances(const std::shared_ptr<StartBatch>& batch);
+
+    // Where each launch in progress has spent its time, reported back once its instance is ready
+    struct LaunchTimings;
+    std::shared_ptr<LaunchTimings> launch_timings_for(const std::string& name);
     QFutureWatcher<AsyncOperationStatus>* create_future_watcher(std::function<void()> const& finished_op = []() {});
 
+    // A pre-booted instance, kept suspended out of the instance maps until a launch claims it
+    struct PoolInstance
+    {
+        int slot;
+        WarmPoolSpec spec; // as it was when the instance was made
+        VirtualMachineDescription desc;
+        VMSpecs specs;
+        VirtualMachine::ShPtr vm;
+        bool ready; // booted, initialized and told to suspend
+    };
+
     std::unique_ptr<const DaemonConfig> config;
+    JsonJournal instances_journal; // only touched by the instances writer once the daemon is up
+    // Keyed by name, like the tables below; generated names fit in std::string's own buffer, so names are not interned
     std::unordered_map<std::string, VMSpecs> vm_instance_specs;
     std::unordered_map<std::string, VirtualMachine::ShPtr> vm_instances;
     std::unordered_map<std::string, VirtualMachine::ShPtr> deleted_instances;
+    std::unordered_map<std::string, VirtualMachineDescription> warming_instances; // loaded, but not brought up yet
+    std::unordered_map<std::string, std::string> failed_instances; // could not be brought up, with why
+    std::unordered_map<std::string, std::string> instance_releases; // an instance's image does not change
+    std::mutex instance_releases_mutex; // list() fills it in from gRPC threads
+    // Held exclusively by the main thread to change the instance maps and specs, and shared by the RPCs that read
+    // them from gRPC threads
+    std::shared_mutex instances_mutex;
     std::unordered_map<std::string, std::unique_ptr<DelayedShutdownTimer>> delayed_shutdown_instances;
     std::unordered_set<std::string> allocated_mac_addrs;
+    std::mutex mac_addrs_mutex; // instances in the making claim addresses from threads of their own
     DaemonRpc daemon_rpc;
     QTimer source_images_maintenance_task;
+    QTimer image_prefetch_task;
+    QTimer warm_pool_task;
+    QTimer disk_maintenance_task;
+    QTimer admission_task; // retries the queued requests while there are any
+    QTimer idle_task;
+    QTimer usage_history_task; // rearmed on every sample, to follow the interval set
+    WarmPoolSpec warm_pool_spec{};
+    std::unordered_map<std::string, PoolInstance> warm_pool; // guarded like the instance maps
+    std::unordered_set<std::string> filling_pool;           // slots whose image is being prepared
+
+    struct QueuedAdmission
+    {
+        AdmissionPolicy::Load demand;
+        std::function<void()> retry;
+        std::function<bool(std::size_t)> notify_position; // false once the client is gone
+        std::promise<grpc::Status>* status_promise;
+        std::size_t position;
+    };
+    std::deque<QueuedAdmission> admission_queue;                                   // only touched by the main thread
+    std::unordered_map<std::string, AdmissionPolicy::Load> admission_reservations; // instances admitted, not up yet
+    bool admission_granted{false}; // lets the queued request being retried through
     MetricsProvider metrics_provider;
     MetricsOptInData metrics_opt_in;
     SSHFSMounts instance_mounts;
+    SSHSessionPool ssh_sessions;
+    SSHFSSnapCache sshfs_snap_cache; // what instances that lack sshfs are given
+
+    struct IdleSample
+    {
+        optional<long long> cpu_time_ms;
+        quint64 mount_operations;
+        std::chrono::steady_clock::time_point taken;
+        std::chrono::steady_clock::time_point idle_since;
+    };
+    std::unordered_map<std::string, IdleSample> idle_samples; // only touched by the main thread
+    std::unordered_set<std::string> idle_suspended;          // to be resumed when connected to
+    std::mutex idle_mutex;
+    std::atomic_bool stop_idle_resumes{false};
+    UsageHistory usage_history{1440}; // a day's worth at the default interval, some 150KiB per instance
+    std::unordered_map<std::string, InfoReply::Info> last_probes; // what running instances last answered info with
+    std::mutex last_probes_mutex;
+
+    PortForwarder port_forwarder; // relays look instances up, so it goes before they do
+    std::unique_ptr<PackageCache> package_cache;
+    std::mutex package_cache_mutex; // launches and pool instances are configured from threads of their own
     std::vector<std::unique_ptr<QFutureWatcher<AsyncOperationStatus>>> async_future_watchers;
     std::unordered_map<std::string, QFuture<std::string>> async_running_futures;
+    // Runs what mostly sleeps waiting on instances (SSH, cloud-init, mounts), so that many instances coming up at once
+    // do not starve the global pool that the short-lived work shares
+    QThreadPool wait_pool;
     std::mutex start_mutex;
+    std::mutex operation_locks_mutex;
+    std::unordered_map<std::string, std::mutex> operation_locks; // held by each lifecycle command on its instance
+    std::string compacting_instance; // whose disk is being compacted, guarded by operation_locks_mutex
     std::unordered_set<std::string> preparing_instances;
+    std::unordered_map<std::string, std::shared_ptr<LaunchTimings>> launch_timings;
+    std::mutex launch_timings_mutex; // phases go by on the threads that the launch goes through
     QFuture<void> image_update_future;
+    QFuture<void> disk_maintenance_future;
+    std::atomic_bool stop_disk_maintenance{false};
+    QFuture<void> usage_sampling_future;
+    std::mutex persist_mutex;
+    std::condition_variable persist_cv;
+    bool persist_pending{false};
+    bool stop_persisting{false};
+    std::thread instances_writer;
+
+    struct StatusWatcher
+    {
+        grpc::ServerWriterInterface<WatchReply>* server;
+        std::promise<grpc::Status>* status_promise;
+        bool told{false}; // whether it had its first reply
+    };
+    std::mutex watchers_mutex;
+    std::vector<StatusWatcher> status_watchers;
+    std::mutex watch_writes_mutex; // held while writing to watchers, so that none goes away mid-write
+    // What watchers were last told, only touched on the main thread
+    std::unordered_map<std::string, InstanceStatus::Status> pushed_statuses;
 };
 } // namespace multipass
 #endif // MULTIPASS_DAEMON_H
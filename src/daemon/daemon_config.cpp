@@ -21,19 +21,26 @@
 #include "ubuntu_image_host.h"
 
 #include <multipass/client_cert_store.h>
+#include <multipass/constants.h>
 #include <multipass/default_vm_workflow_provider.h>
+#include <multipass/format.h>
 #include <multipass/logging/log.h>
 #include <multipass/logging/standard_logger.h>
+#include <multipass/memory_size.h>
 #include <multipass/name_generator.h>
 #include <multipass/platform.h>
+#include <multipass/settings.h>
 #include <multipass/ssh/openssh_key_provider.h>
+#include <multipass/ssh/ssh_session.h>
 #include <multipass/ssl_cert_provider.h>
 #include <multipass/standard_paths.h>
 #include <multipass/utils.h>
 
+#include <QDir>
 #include <QString>
 #include <QUrl>
 
+#include <algorithm>
 #include <chrono>
 #include <memory>
 
@@ -42,7 +49,9 @@ namespace mpl = multipass::logging;
 
 namespace
 {
+constexpr auto category = "daemon config";
 constexpr auto manifest_ttl = std::chrono::minutes{5};
+constexpr auto max_download_connections = 4;
 
 std::string server_name_from(const std::string& server_address)
 {
@@ -86,6 +95,39 @@ std::unique_ptr<QNetworkProxy> discover_http_proxy()
 
     return proxy_ptr;
 }
+
+// Read once, so changes take effect when the daemon restarts
+mp::DownloadScheduler::Limits download_limits()
+{
+    mp::DownloadScheduler::Limits limits;
+
+    const auto concurrency = MP_SETTINGS.get(mp::download_concurrency_key);
+    if (!concurrency.isEmpty())
+        limits.max_concurrent_downloads = std::max(concurrency.toInt(), 0);
+
+    const auto rate = MP_SETTINGS.get(mp::download_rate_key);
+    try
+    {
+        if (!rate.isEmpty())
+            limits.max_bytes_per_second = mp::MemorySize{rate.toStdString()}.in_bytes();
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::warning, category, fmt::format("Ignoring invalid download rate: {}", e.what()));
+    }
+
+    return limits;
+}
+
+// Idem
+void set_ssh_compression()
+{
+    const auto compression = MP_SETTINGS.get(mp::ssh_compression_key);
+    const auto level = MP_SETTINGS.get(mp::ssh_compression_level_key);
+
+    mp::SSHSession::set_compression(mp::SSHSession::compression_for(compression.toStdString()),
+                                    level.isEmpty() ? mp::SSHSession::default_compression_level : level.toInt());
+}
 } // namespace
 
 mp::DaemonConfig::~DaemonConfig()
@@ -122,20 +164,24 @@ std::unique_ptr<const mp::DaemonConfig> mp::DaemonConfigBuilder::build()
             data_directory = MP_STDPATHS.writableLocation(StandardPaths::AppDataLocation);
     }
     if (url_downloader == nullptr)
-        url_downloader = std::make_unique<URLDownloader>(cache_directory, std::chrono::seconds{10});
+        url_downloader =
+            std::make_unique<URLDownloader>(cache_directory, std::chrono::seconds{10}, max_download_connections,
+                                            /*resume_downloads=*/true, download_limits());
     if (factory == nullptr)
         factory = platform::vm_backend(data_directory);
     if (update_prompt == nullptr)
         update_prompt = platform::make_update_prompt();
     if (image_hosts.empty())
     {
-        image_hosts.push_back(std::make_unique<mp::CustomVMImageHost>(url_downloader.get(), manifest_ttl));
+        const QDir manifest_cache_dir{mp::utils::make_dir(cache_directory, "manifests")};
+        image_hosts.push_back(std::make_unique<mp::CustomVMImageHost>(
+            url_downloader.get(), manifest_ttl, QString(), manifest_cache_dir.filePath("custom")));
         image_hosts.push_back(std::make_unique<mp::UbuntuVMImageHost>(
             std::vector<std::pair<std::string, std::string>>{
                 {mp::release_remote, "https://cloud-images.ubuntu.com/releases/"},
                 {mp::daily_remote, "https://cloud-images.ubuntu.com/daily/"},
                 {mp::appliance_remote, "https://cdimage.ubuntu.com/ubuntu-core/appliances/"}},
-            url_downloader.get(), manifest_ttl));
+            url_downloader.get(), manifest_ttl, manifest_cache_dir.filePath("ubuntu")));
     }
     if (vault == nullptr)
     {
@@ -155,6 +201,9 @@ std::unique_ptr<const mp::DaemonConfig> mp::DaemonConfigBuilder::build()
         server_address = platform::default_server_address();
     if (ssh_key_provider == nullptr)
         ssh_key_provider = std::make_unique<OpenSSHKeyProvider>(data_directory);
+    // Read once, like the download limits
+    SSHSession::set_ciphers(MP_SETTINGS.get(mp::ssh_ciphers_key).remove(' ').toStdString());
+    set_ssh_compression();
     if (cert_provider == nullptr)
         cert_provider = std::make_unique<mp::SSLCertProvider>(mp::utils::make_dir(data_directory, "certificates"),
                                                               server_name_from(server_address));
@@ -183,5 +232,6 @@ std::unique_ptr<const mp::DaemonConfig> mp::DaemonConfigBuilder::build()
         std::move(url_downloader), std::move(factory), std::move(image_hosts), std::move(vault),
         std::move(name_generator), std::move(ssh_key_provider), std::move(cert_provider), std::move(client_cert_store),
         std::move(update_prompt), multiplexing_logger, std::move(network_proxy), std::move(workflow_provider),
-        cache_directory, data_directory, server_address, ssh_username, connection_type, image_refresh_timer});
+        cache_directory, data_directory, server_address, ssh_username, connection_type, image_refresh_timer,
+        image_prefetch_timer, disk_maintenance_timer, idle_check_timer});
 }
@@ -63,6 +63,9 @@ struct DaemonConfig
     const std::string ssh_username;
     const RpcConnectionType connection_type;
     const std::chrono::hours image_refresh_timer;
+    const std::chrono::minutes image_prefetch_timer;
+    const std::chrono::milliseconds disk_maintenance_timer;
+    const std::chrono::milliseconds idle_check_timer;
 };
 
 struct DaemonConfigBuilder
@@ -85,6 +88,9 @@ struct DaemonConfigBuilder
     std::string ssh_username;
     multipass::days days_to_expire{14};
     std::chrono::hours image_refresh_timer{6};
+    std::chrono::minutes image_prefetch_timer{30};
+    std::chrono::milliseconds disk_maintenance_timer{std::chrono::hours{6}};
+    std::chrono::milliseconds idle_check_timer{std::chrono::minutes{1}};
     multipass::logging::Level verbosity_level{multipass::logging::Level::info};
     RpcConnectionType connection_type{RpcConnectionType::ssl};
 
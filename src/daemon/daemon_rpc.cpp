@@ -18,12 +18,28 @@
 #include "daemon_rpc.h"
 #include "daemon_config.h"
 
+#include <multipass/constants.h>
 #include <multipass/format.h>
+#include <multipass/instrumentation.h>
+#include <multipass/logging/client_logger.h>
 #include <multipass/logging/log.h>
+#include <multipass/memory_size.h>
+#include <multipass/settings.h>
 #include <multipass/virtual_machine_factory.h>
 
+#include <grpcpp/alarm.h>
+#include <grpcpp/resource_quota.h>
+
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
 #include <stdexcept>
+#include <type_traits>
+#include <unordered_set>
 
 namespace mp = multipass;
 namespace mpl = multipass::logging;
@@ -31,6 +47,17 @@ namespace mpl = multipass::logging;
 namespace
 {
 constexpr auto category = "rpc";
+constexpr auto first_progress_status_check_delay = std::chrono::milliseconds(1);
+constexpr auto max_progress_status_check_delay = std::chrono::milliseconds(100);
+constexpr auto watch_status_check_interval = std::chrono::milliseconds(1000);
+// Beyond this many, watch clients are taken to have stopped reading and others are waited on
+constexpr std::size_t max_pending_replies = 64;
+constexpr auto shutdown_grace_period = std::chrono::seconds(2);
+// Calls beyond this many at once are turned away by the synchronous server rather than queued on a new thread; those
+// served off the completion queue do not count
+constexpr auto max_rpc_threads = 128;
+constexpr auto keepalive_timeout_ms = 20000;
+constexpr auto min_client_ping_interval_ms = 10000; // as often as client.rpc.keepalive lets clients ping
 
 void throw_if_server_exists(const std::string& address)
 {
@@ -49,9 +76,40 @@ void throw_if_server_exists(const std::string& address)
         throw std::runtime_error(fmt::format("a multipass daemon already exists at {}", address));
 }
 
+// For daemons reached over the network, as set in the local.rpc.* settings when the daemon starts; gRPC's defaults
+// otherwise
+void tune(grpc::ServerBuilder& builder)
+{
+    if (MP_SETTINGS.get(mp::rpc_compression_key) == "gzip")
+        builder.SetDefaultCompressionAlgorithm(GRPC_COMPRESS_GZIP); // replies only go compressed when that is smaller
+
+    // Pings keep connections open through NATs and firewalls that drop them when idle, and tell dead ones apart
+    if (const auto keepalive = MP_SETTINGS.get(mp::rpc_keepalive_key); !keepalive.isEmpty())
+    {
+        builder.AddChannelArgument(GRPC_ARG_KEEPALIVE_TIME_MS, keepalive.toInt() * 1000);
+        builder.AddChannelArgument(GRPC_ARG_KEEPALIVE_TIMEOUT_MS, keepalive_timeout_ms);
+        builder.AddChannelArgument(GRPC_ARG_HTTP2_MAX_PINGS_WITHOUT_DATA, 0);
+    }
+
+    // Clients keeping their connections alive are let through, whatever the daemon does itself
+    builder.AddChannelArgument(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, 1);
+    builder.AddChannelArgument(GRPC_ARG_HTTP2_MIN_RECV_PING_INTERVAL_WITHOUT_DATA_MS, min_client_ping_interval_ms);
+
+    // A larger window lets long streams fill links with a high bandwidth-delay product from the start
+    if (const auto window = MP_SETTINGS.get(mp::rpc_window_key); !window.isEmpty())
+    {
+        const auto bytes = mp::MemorySize{window.toStdString()}.in_bytes();
+        builder.AddChannelArgument(GRPC_ARG_HTTP2_STREAM_LOOKAHEAD_BYTES,
+                                   static_cast<int>(std::min<long long>(bytes, std::numeric_limits<int>::max())));
+    }
+
+    if (const auto max_streams = MP_SETTINGS.get(mp::rpc_max_streams_key); !max_streams.isEmpty())
+        builder.AddChannelArgument(GRPC_ARG_MAX_CONCURRENT_STREAMS, max_streams.toInt());
+}
+
 auto make_server(const std::string& server_address, mp::RpcConnectionType conn_type,
                  const mp::CertProvider& cert_provider, const mp::CertStore& client_cert_store,
-                 mp::Rpc::Service* service)
+                 mp::Rpc::Service* service, std::unique_ptr<grpc::ServerCompletionQueue>& call_queue)
 {
     throw_if_server_exists(server_address);
     grpc::ServerBuilder builder;
@@ -73,8 +131,14 @@ auto make_server(const std::string& server_address, mp::RpcConnectionType conn_t
         throw std::invalid_argument("Unknown connection type");
     }
 
+    grpc::ResourceQuota quota{"multipass_rpc"};
+    quota.SetMaxThreads(max_rpc_threads);
+
     builder.AddListeningPort(server_address, creds);
+    builder.SetResourceQuota(quota);
+    tune(builder);
     builder.RegisterService(service);
+    call_queue = builder.AddCompletionQueue();
 
     std::unique_ptr<grpc::Server> server{builder.BuildAndStart()};
     if (server == nullptr)
@@ -83,142 +147,507 @@ auto make_server(const std::string& server_address, mp::RpcConnectionType conn_t
     return server;
 }
 
+// Clients on the daemon's own host, over its unix socket or the loopback interface
+bool is_local_peer(const std::string& peer)
+{
+    return peer.rfind("unix:", 0) == 0 || peer.rfind("ipv4:127.", 0) == 0 || peer.rfind("ipv6:[::1]:", 0) == 0 ||
+           peer.rfind("ipv6:%5B::1%5D:", 0) == 0;
+}
+
 template <typename OperationSignal>
-grpc::Status emit_signal_and_wait_for_result(OperationSignal operation_signal)
+grpc::Status emit_signal_and_wait_for_result(const char* rpc, OperationSignal operation_signal, const void* stream)
 {
+    mp::ScopedTiming timing{"multipass_rpc_duration_seconds", fmt::format("rpc=\"{}\"", rpc)};
     std::promise<grpc::Status> status_promise;
     auto status_future = status_promise.get_future();
     emit operation_signal(&status_promise);
 
-    return status_future.get();
+    auto status = status_future.get();
+    mpl::wait_for_client_loggers(stream); // the stream is finished once this returns
+    return status;
 }
+
+// A call served off the completion queue, driven by the events its tags bring back. Calls are only ever handled on
+// the thread that serves the queue.
+class AsyncCall
+{
+public:
+    enum class Event
+    {
+        accepted,
+        written,
+        checked,
+        finished,
+        done
+    };
+
+    struct Tag
+    {
+        AsyncCall* call;
+        Event event;
+    };
+
+    virtual ~AsyncCall() = default;
+    virtual void handle(Event event, bool ok) = 0;
+    virtual void stop() = 0; // once the queue is shutting down, after which nothing more is started on it
+};
+
+struct AsyncCalls
+{
+    mp::DaemonRpc& rpc;
+    grpc::ServerCompletionQueue& queue;
+    std::unordered_set<AsyncCall*> live;
+    bool stopping{false};
+};
+
+// A single streaming call. What the daemon writes is queued and sent one reply at a time; the call finishes once the
+// daemon sets its status, its client loggers are gone and the queue is empty, and is dropped once gRPC has nothing
+// left of it in flight. The daemon only ever sees the call as the ServerWriterInterface it writes to.
+template <typename Request, typename Reply, auto request_call, auto signal>
+class StreamingCall : public grpc::ServerWriterInterface<Reply>, public AsyncCall
+{
+public:
+    StreamingCall(AsyncCalls& calls, const char* name) : calls{calls}, name{name}, responder{&context}
+    {
+        calls.live.insert(this);
+        context.AsyncNotifyWhenDone(&done_tag);
+        std::invoke(request_call, calls.rpc, &context, &request, &responder, &calls.queue, &calls.queue, &accepted_tag);
+    }
+
+    ~StreamingCall() override
+    {
+        calls.live.erase(this);
+    }
+
+    using grpc::ServerWriterInterface<Reply>::Write;
+
+    // Called on the daemon's threads
+    bool Write(const Reply& reply, grpc::WriteOptions) override
+    {
+        std::unique_lock<decltype(mutex)> lock{mutex};
+        if constexpr (watches)
+        {
+            // Later replies only tell what changed since, so one that falls behind is dropped rather than skipped ahead
+            if (!done && !stopped && !finishing && !broken && pending.size() >= max_pending_replies)
+            {
+                mpl::log(mpl::Level::warning, category, "Dropping a watch client that is not reading its replies");
+                broken = fell_behind = true;
+                pending.erase(pending.begin() + (writing ? 1 : 0), pending.end());
+            }
+        }
+        else
+        {
+            // Progress is held back until the client catches up, as it would be by the synchronous server
+            caught_up.wait(lock, [this] { return pending.size() < max_pending_replies || done || stopped || broken; });
+        }
+
+        if (done || stopped || finishing || broken)
+            return false;
+
+        pending.push_back(reply);
+        if (!writing)
+            write_next();
+
+        return true;
+    }
+
+    void SendInitialMetadata() override
+    {
+        // Sent along with the first reply
+    }
+
+    void handle(Event event, bool ok) override
+    {
+        switch (event)
+        {
+        case Event::accepted:
+            if (!ok) // the server is shutting down and no call will come
+            {
+                delete this;
+                return;
+            }
+
+            if (calls.stopping) // taken too late to be served, so it is only waited out
+            {
+                released = true;
+                break;
+            }
+
+            new StreamingCall{calls, name};
+            timing = std::make_unique<mp::ScopedTiming>("multipass_rpc_duration_seconds",
+                                                        fmt::format("rpc=\"{}\"", name));
+            emit std::invoke(signal, calls.rpc, &request, writer(), &status_promise);
+            check_status_later();
+            break;
+        case Event::written:
+        {
+            std::lock_guard<decltype(mutex)> lock{mutex};
+            writing = false;
+            if (!ok || stopped)
+            {
+                broken = broken || !ok;
+                pending.clear();
+            }
+            else
+            {
+                pending.pop_front();
+            }
+            caught_up.notify_all();
+
+            if (!pending.empty())
+                write_next();
+            else if (finishing && !done && !stopped)
+                finish();
+            break;
+        }
+        case Event::checked:
+            alarm_set = false;
+            if (ok && !released && !calls.stopping)
+            {
+                if (daemon_is_done())
+                    release();
+                else
+                    check_status_later();
+            }
+            break;
+        case Event::finished:
+            finishing_in_flight = false;
+            break;
+        case Event::done:
+        {
+            {
+                std::lock_guard<decltype(mutex)> lock{mutex};
+                done = true;
+            }
+            caught_up.notify_all();
+
+            // Watchers are let go as soon as their clients are; the daemon carries on with any other call regardless
+            if constexpr (watches)
+            {
+                if (alarm_set)
+                    alarm.Cancel();
+
+                // Unregistered outside the lock, since the daemon writes while holding its own
+                if (!released)
+                    emit calls.rpc.on_unwatch(writer());
+                released = true;
+            }
+            break;
+        }
+        }
+
+        delete_if_idle();
+    }
+
+    void stop() override
+    {
+        {
+            std::lock_guard<decltype(mutex)> lock{mutex};
+            stopped = true;
+        }
+        caught_up.notify_all();
+    }
+
+private:
+    // Watch replies follow the daemon's state for as long as the client likes, rather than report on one operation
+    static constexpr bool watches = std::is_same_v<Reply, mp::WatchReply>;
+    static constexpr std::chrono::milliseconds first_status_check_delay =
+        watches ? watch_status_check_interval : first_progress_status_check_delay;
+    static constexpr std::chrono::milliseconds max_status_check_delay =
+        watches ? watch_status_check_interval : max_progress_status_check_delay;
+
+    grpc::ServerWriterInterface<Reply>* writer()
+    {
+        return this; // what the daemon writes to and keys the call's client loggers on
+    }
+
+    bool daemon_is_done()
+    {
+        return status_future.wait_for(std::chrono::seconds::zero()) == std::future_status::ready &&
+               mpl::client_loggers_gone(writer());
+    }
+
+    void release()
+    {
+        released = true;
+        status = status_future.get();
+        timing.reset();
+
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        if (!done)
+        {
+            finishing = true;
+            if (!writing)
+                finish();
+        }
+    }
+
+    void write_next()
+    {
+        writing = true;
+        responder.Write(pending.front(), &written_tag);
+    }
+
+    void finish()
+    {
+        finishing_in_flight = true;
+        responder.Finish(fell_behind ? grpc::Status{grpc::StatusCode::RESOURCE_EXHAUSTED, "too far behind on replies"}
+                                     : status,
+                         &finished_tag);
+    }
+
+    // Operations are mostly over within milliseconds, so they are checked on early and then less and less often
+    void check_status_later()
+    {
+        alarm_set = true;
+        alarm.Set(&calls.queue, std::chrono::system_clock::now() + check_delay, &checked_tag);
+        check_delay = std::min(check_delay * 2, max_status_check_delay);
+    }
+
+    void delete_if_idle()
+    {
+        bool idle;
+        {
+            std::lock_guard<decltype(mutex)> lock{mutex};
+            idle = done && released && !writing && !finishing_in_flight && !alarm_set;
+        }
+
+        if (idle)
+            delete this;
+    }
+
+    AsyncCalls& calls;
+    const char* const name;
+    grpc::ServerContext context;
+    grpc::ServerAsyncWriter<Reply> responder;
+    Request request;
+    std::promise<grpc::Status> status_promise;
+    std::future<grpc::Status> status_future{status_promise.get_future()};
+    grpc::Status status;
+    std::unique_ptr<mp::ScopedTiming> timing;
+    grpc::Alarm alarm;
+    std::chrono::milliseconds check_delay{first_status_check_delay};
+
+    Tag accepted_tag{this, Event::accepted};
+    Tag written_tag{this, Event::written};
+    Tag checked_tag{this, Event::checked};
+    Tag finished_tag{this, Event::finished};
+    Tag done_tag{this, Event::done};
+
+    std::mutex mutex;
+    std::condition_variable caught_up;
+    std::deque<Reply> pending;
+    bool writing{false};
+    bool finishing{false};
+    bool broken{false};
+    bool fell_behind{false};
+    bool done{false};
+    bool stopped{false};
+    bool released{false};
+    bool alarm_set{false};
+    bool finishing_in_flight{false};
+};
 } // namespace
 
 mp::DaemonRpc::DaemonRpc(const std::string& server_address, mp::RpcConnectionType type,
                          const CertProvider& cert_provider, const CertStore& client_cert_store)
-    : server_address{server_address}, server{make_server(server_address, type, cert_provider, client_cert_store, this)}
+    : server_address{server_address},
+      server{make_server(server_address, type, cert_provider, client_cert_store, this, call_queue)},
+      call_thread{[this] { serve_async_calls(); }}
 {
     std::string ssl_enabled = type == mp::RpcConnectionType::ssl ? "on" : "off";
     mpl::log(mpl::Level::info, category, fmt::format("gRPC listening on {}, SSL:{}", server_address, ssl_enabled));
 }
 
-grpc::Status mp::DaemonRpc::create(grpc::ServerContext* context, const CreateRequest* request,
-                                   grpc::ServerWriter<CreateReply>* reply)
+mp::DaemonRpc::~DaemonRpc()
 {
-    return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_create, this, request, reply, std::placeholders::_1));
+    // Calls still going past the grace period are cancelled, which winds their state machines down
+    server->Shutdown(std::chrono::system_clock::now() + shutdown_grace_period);
+
+    // The queue is shut down from the thread that serves it, so that nothing is started on it afterwards
+    grpc::Alarm stop;
+    stop.Set(call_queue.get(), std::chrono::system_clock::now(), nullptr);
+    call_thread.join();
 }
 
-grpc::Status mp::DaemonRpc::launch(grpc::ServerContext* context, const LaunchRequest* request,
-                                   grpc::ServerWriter<LaunchReply>* reply)
+void mp::DaemonRpc::serve_async_calls()
 {
-    return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_launch, this, request, reply, std::placeholders::_1));
+    AsyncCalls calls{*this, *call_queue};
+    new StreamingCall<CreateRequest, CreateReply, &DaemonRpc::Requestcreate, &DaemonRpc::on_create>{calls, "create"};
+    new StreamingCall<LaunchRequest, LaunchReply, &DaemonRpc::Requestlaunch, &DaemonRpc::on_launch>{calls, "launch"};
+    new StreamingCall<MountRequest, MountReply, &DaemonRpc::Requestmount, &DaemonRpc::on_mount>{calls, "mount"};
+    new StreamingCall<StartRequest, StartReply, &DaemonRpc::Requeststart, &DaemonRpc::on_start>{calls, "start"};
+    new StreamingCall<RestartRequest, RestartReply, &DaemonRpc::Requestrestart, &DaemonRpc::on_restart>{calls,
+                                                                                                         "restart"};
+    new StreamingCall<WatchRequest, WatchReply, &DaemonRpc::Requestwatch, &DaemonRpc::on_watch>{calls, "watch"};
+
+    void* tag;
+    bool ok;
+    while (call_queue->Next(&tag, &ok))
+    {
+        if (tag == nullptr) // set off by the destructor, once the server is shut down
+        {
+            // Calls the daemon has yet to finish with are left to it
+            calls.stopping = true;
+            for (auto call : calls.live)
+                call->stop();
+            call_queue->Shutdown();
+            continue;
+        }
+
+        auto call_tag = static_cast<AsyncCall::Tag*>(tag);
+        call_tag->call->handle(call_tag->event, ok);
+    }
 }
 
 grpc::Status mp::DaemonRpc::purge(grpc::ServerContext* context, const PurgeRequest* request,
                                   grpc::ServerWriter<PurgeReply>* response)
 {
     return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_purge, this, request, response, std::placeholders::_1));
+        "purge", std::bind(&DaemonRpc::on_purge, this, request, response, std::placeholders::_1), response);
 }
 
 grpc::Status mp::DaemonRpc::find(grpc::ServerContext* context, const FindRequest* request,
                                  grpc::ServerWriter<FindReply>* response)
 {
     return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_find, this, request, response, std::placeholders::_1));
+        "find", std::bind(&DaemonRpc::on_find, this, request, response, std::placeholders::_1), response);
 }
 
 grpc::Status mp::DaemonRpc::info(grpc::ServerContext* context, const InfoRequest* request,
                                  grpc::ServerWriter<InfoReply>* response)
 {
     return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_info, this, request, response, std::placeholders::_1));
+        "info", std::bind(&DaemonRpc::on_info, this, request, response, std::placeholders::_1), response);
 }
 
 grpc::Status mp::DaemonRpc::list(grpc::ServerContext* context, const ListRequest* request,
                                  grpc::ServerWriter<ListReply>* response)
 {
     return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_list, this, request, response, std::placeholders::_1));
+        "list", std::bind(&DaemonRpc::on_list, this, request, response, std::placeholders::_1), response);
 }
 
 grpc::Status mp::DaemonRpc::networks(grpc::ServerContext* context, const NetworksRequest* request,
                                      grpc::ServerWriter<NetworksReply>* response)
 {
     return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_networks, this, request, response, std::placeholders::_1));
-}
-
-grpc::Status mp::DaemonRpc::mount(grpc::ServerContext* context, const MountRequest* request,
-                                  grpc::ServerWriter<MountReply>* response)
-{
-    return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_mount, this, request, response, std::placeholders::_1));
+        "networks", std::bind(&DaemonRpc::on_networks, this, request, response, std::placeholders::_1), response);
 }
 
 grpc::Status mp::DaemonRpc::recover(grpc::ServerContext* context, const RecoverRequest* request,
                                     grpc::ServerWriter<RecoverReply>* response)
 {
     return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_recover, this, request, response, std::placeholders::_1));
+        "recover", std::bind(&DaemonRpc::on_recover, this, request, response, std::placeholders::_1), response);
 }
 
 grpc::Status mp::DaemonRpc::ssh_info(grpc::ServerContext* context, const SSHInfoRequest* request,
                                      grpc::ServerWriter<SSHInfoReply>* response)
 {
     return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_ssh_info, this, request, response, std::placeholders::_1));
-}
-
-grpc::Status mp::DaemonRpc::start(grpc::ServerContext* context, const StartRequest* request,
-                                  grpc::ServerWriter<StartReply>* response)
-{
-    return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_start, this, request, response, std::placeholders::_1));
+        "ssh_info",
+        std::bind(&DaemonRpc::on_ssh_info, this, request, response, is_local_peer(context->peer()),
+                  std::placeholders::_1),
+        response);
 }
 
 grpc::Status mp::DaemonRpc::stop(grpc::ServerContext* context, const StopRequest* request,
                                  grpc::ServerWriter<StopReply>* response)
 {
     return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_stop, this, request, response, std::placeholders::_1));
+        "stop", std::bind(&DaemonRpc::on_stop, this, request, response, std::placeholders::_1), response);
 }
 
 grpc::Status mp::DaemonRpc::suspend(grpc::ServerContext* context, const SuspendRequest* request,
                                     grpc::ServerWriter<SuspendReply>* response)
 {
     return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_suspend, this, request, response, std::placeholders::_1));
-}
-
-grpc::Status mp::DaemonRpc::restart(grpc::ServerContext* context, const RestartRequest* request,
-                                    grpc::ServerWriter<RestartReply>* response)
-{
-    return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_restart, this, request, response, std::placeholders::_1));
+        "suspend", std::bind(&DaemonRpc::on_suspend, this, request, response, std::placeholders::_1), response);
 }
 
 grpc::Status mp::DaemonRpc::delet(grpc::ServerContext* context, const DeleteRequest* request,
                                   grpc::ServerWriter<DeleteReply>* response)
 {
     return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_delete, this, request, response, std::placeholders::_1));
+        "delete", std::bind(&DaemonRpc::on_delete, this, request, response, std::placeholders::_1), response);
 }
 
 grpc::Status mp::DaemonRpc::umount(grpc::ServerContext* context, const UmountRequest* request,
                                    grpc::ServerWriter<UmountReply>* response)
 {
     return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_umount, this, request, response, std::placeholders::_1));
+        "umount", std::bind(&DaemonRpc::on_umount, this, request, response, std::placeholders::_1), response);
 }
 
 grpc::Status mp::DaemonRpc::version(grpc::ServerContext* context, const VersionRequest* request,
                                     grpc::ServerWriter<VersionReply>* response)
 {
     return emit_signal_and_wait_for_result(
-        std::bind(&DaemonRpc::on_version, this, request, response, std::placeholders::_1));
+        "version", std::bind(&DaemonRpc::on_version, this, request, response, std::placeholders::_1), response);
+}
+
+grpc::Status mp::DaemonRpc::bake(grpc::ServerContext* context, const BakeRequest* request,
+                                 grpc::ServerWriter<BakeReply>* response)
+{
+    return emit_signal_and_wait_for_result(
+        "bake", std::bind(&DaemonRpc::on_bake, this, request, response, std::placeholders::_1), response);
+}
+
+grpc::Status mp::DaemonRpc::stats(grpc::ServerContext* context, const StatsRequest* request,
+                                  grpc::ServerWriter<StatsReply>* response)
+{
+    return emit_signal_and_wait_for_result(
+        "stats", std::bind(&DaemonRpc::on_stats, this, request, response, std::placeholders::_1), response);
+}
+
+grpc::Status mp::DaemonRpc::bench_mount(grpc::ServerContext* context, const BenchMountRequest* request,
+                                        grpc::ServerWriter<BenchMountReply>* response)
+{
+    return emit_signal_and_wait_for_result(
+        "bench_mount", std::bind(&DaemonRpc::on_bench_mount, this, request, response, std::placeholders::_1), response);
+}
+
+grpc::Status mp::DaemonRpc::throttle(grpc::ServerContext* context, const ThrottleRequest* request,
+                                     grpc::ServerWriter<ThrottleReply>* response)
+{
+    return emit_signal_and_wait_for_result(
+        "throttle", std::bind(&DaemonRpc::on_throttle, this, request, response, std::placeholders::_1), response);
+}
+
+grpc::Status mp::DaemonRpc::clone(grpc::ServerContext* context, const CloneRequest* request,
+                                  grpc::ServerWriter<CloneReply>* response)
+{
+    return emit_signal_and_wait_for_result(
+        "clone", std::bind(&DaemonRpc::on_clone, this, request, response, std::placeholders::_1), response);
+}
+
+grpc::Status mp::DaemonRpc::forward(grpc::ServerContext* context, const ForwardRequest* request,
+                                    grpc::ServerWriter<ForwardReply>* response)
+{
+    return emit_signal_and_wait_for_result(
+        "forward", std::bind(&DaemonRpc::on_forward, this, request, response, std::placeholders::_1), response);
+}
+
+grpc::Status mp::DaemonRpc::capacity(grpc::ServerContext* context, const CapacityRequest* request,
+                                     grpc::ServerWriter<CapacityReply>* response)
+{
+    return emit_signal_and_wait_for_result(
+        "capacity", std::bind(&DaemonRpc::on_capacity, this, request, response, std::placeholders::_1), response);
+}
+
+grpc::Status mp::DaemonRpc::copy_files(grpc::ServerContext* context, const CopyFilesRequest* request,
+                                       grpc::ServerWriter<CopyFilesReply>* response)
+{
+    return emit_signal_and_wait_for_result(
+        "copy_files", std::bind(&DaemonRpc::on_copy_files, this, request, response, std::placeholders::_1), response);
+}
+
+grpc::Status mp::DaemonRpc::resize(grpc::ServerContext* context, const ResizeRequest* request,
+                                   grpc::ServerWriter<ResizeReply>* response)
+{
+    return emit_signal_and_wait_for_result(
+        "resize", std::bind(&DaemonRpc::on_resize, this, request, response, std::placeholders::_1), response);
 }
 
 grpc::Status mp::DaemonRpc::ping(grpc::ServerContext* context, const PingRequest* request, PingReply* response)
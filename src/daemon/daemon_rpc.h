@@ -30,6 +30,7 @@
 
 #include <future>
 #include <memory>
+#include <thread>
 
 namespace multipass
 {
@@ -39,7 +40,12 @@ using CreateError = LaunchError;
 using CreateProgress = LaunchProgress;
 
 struct DaemonConfig;
-class DaemonRpc : public QObject, public multipass::Rpc::Service
+// Calls that last as long as instances take to come up, or as long as a client likes to watch, are served off a
+// completion queue; every other call holds a thread of the synchronous server until the daemon is done with it
+using AsyncRpcService = Rpc::WithAsyncMethod_create<Rpc::WithAsyncMethod_launch<Rpc::WithAsyncMethod_mount<
+    Rpc::WithAsyncMethod_start<Rpc::WithAsyncMethod_restart<Rpc::WithAsyncMethod_watch<Rpc::Service>>>>>>;
+
+class DaemonRpc : public QObject, public AsyncRpcService
 {
     Q_OBJECT
 public:
@@ -47,11 +53,12 @@ public:
               const CertStore& client_cert_store);
     DaemonRpc(const DaemonRpc&) = delete;
     DaemonRpc& operator=(const DaemonRpc&) = delete;
+    ~DaemonRpc() override;
 
 signals:
-    void on_create(const CreateRequest* request, grpc::ServerWriter<CreateReply>* reply,
+    void on_create(const CreateRequest* request, grpc::ServerWriterInterface<CreateReply>* reply,
                    std::promise<grpc::Status>* status_promise);
-    void on_launch(const LaunchRequest* request, grpc::ServerWriter<LaunchReply>* reply,
+    void on_launch(const LaunchRequest* request, grpc::ServerWriterInterface<LaunchReply>* reply,
                    std::promise<grpc::Status>* status_promise);
     void on_purge(const PurgeRequest* request, grpc::ServerWriter<PurgeReply>* response,
                   std::promise<grpc::Status>* status_promise);
@@ -63,19 +70,19 @@ signals:
                  std::promise<grpc::Status>* status_promise);
     void on_networks(const NetworksRequest* request, grpc::ServerWriter<NetworksReply>* response,
                      std::promise<grpc::Status>* status_promise);
-    void on_mount(const MountRequest* request, grpc::ServerWriter<MountReply>* response,
+    void on_mount(const MountRequest* request, grpc::ServerWriterInterface<MountReply>* response,
                   std::promise<grpc::Status>* status_promise);
     void on_recover(const RecoverRequest* request, grpc::ServerWriter<RecoverReply>* response,
                     std::promise<grpc::Status>* status_promise);
-    void on_ssh_info(const SSHInfoRequest* request, grpc::ServerWriter<SSHInfoReply>* response,
+    void on_ssh_info(const SSHInfoRequest* request, grpc::ServerWriter<SSHInfoReply>* response, bool local_client,
                      std::promise<grpc::Status>* status_promise);
-    void on_start(const StartRequest* request, grpc::ServerWriter<StartReply>* response,
+    void on_start(const StartRequest* request, grpc::ServerWriterInterface<StartReply>* response,
                   std::promise<grpc::Status>* status_promise);
     void on_stop(const StopRequest* request, grpc::ServerWriter<StopReply>* response,
                  std::promise<grpc::Status>* status_promise);
     void on_suspend(const SuspendRequest* request, grpc::ServerWriter<SuspendReply>* response,
                     std::promise<grpc::Status>* status_promise);
-    void on_restart(const RestartRequest* request, grpc::ServerWriter<RestartReply>* response,
+    void on_restart(const RestartRequest* request, grpc::ServerWriterInterface<RestartReply>* response,
                     std::promise<grpc::Status>* status_promise);
     void on_delete(const DeleteRequest* request, grpc::ServerWriter<DeleteReply>* response,
                    std::promise<grpc::Status>* status_promise);
@@ -83,16 +90,37 @@ signals:
                    std::promise<grpc::Status>* status_promise);
     void on_version(const VersionRequest* request, grpc::ServerWriter<VersionReply>* response,
                     std::promise<grpc::Status>* status_promise);
+    void on_watch(const WatchRequest* request, grpc::ServerWriterInterface<WatchReply>* response,
+                  std::promise<grpc::Status>* status_promise);
+    void on_unwatch(grpc::ServerWriterInterface<WatchReply>* response);
+    void on_bake(const BakeRequest* request, grpc::ServerWriter<BakeReply>* response,
+                 std::promise<grpc::Status>* status_promise);
+    void on_stats(const StatsRequest* request, grpc::ServerWriter<StatsReply>* response,
+                  std::promise<grpc::Status>* status_promise);
+    void on_bench_mount(const BenchMountRequest* request, grpc::ServerWriter<BenchMountReply>* response,
+                        std::promise<grpc::Status>* status_promise);
+    void on_throttle(const ThrottleRequest* request, grpc::ServerWriter<ThrottleReply>* response,
+                     std::promise<grpc::Status>* status_promise);
+    void on_clone(const CloneRequest* request, grpc::ServerWriter<CloneReply>* response,
+                  std::promise<grpc::Status>* status_promise);
+    void on_forward(const ForwardRequest* request, grpc::ServerWriter<ForwardReply>* response,
+                    std::promise<grpc::Status>* status_promise);
+    void on_capacity(const CapacityRequest* request, grpc::ServerWriter<CapacityReply>* response,
+                     std::promise<grpc::Status>* status_promise);
+    void on_copy_files(const CopyFilesRequest* request, grpc::ServerWriter<CopyFilesReply>* response,
+                       std::promise<grpc::Status>* status_promise);
+    void on_resize(const ResizeRequest* request, grpc::ServerWriter<ResizeReply>* response,
+                   std::promise<grpc::Status>* status_promise);
 
 private:
+    void serve_async_calls();
+
     const std::string server_address;
+    std::unique_ptr<grpc::ServerCompletionQueue> call_queue;
     const std::unique_ptr<grpc::Server> server;
+    std::thread call_thread;
 
 protected:
-    grpc::Status create(grpc::ServerContext* context, const CreateRequest* request,
-                        grpc::ServerWriter<CreateReply>* reply) override;
-    grpc::Status launch(grpc::ServerContext* context, const LaunchRequest* request,
-                        grpc::ServerWriter<LaunchReply>* reply) override;
     grpc::Status purge(grpc::ServerContext* context, const PurgeRequest* request,
                        grpc::ServerWriter<PurgeReply>* response) override;
     grpc::Status find(grpc::ServerContext* context, const FindRequest* request,
@@ -103,26 +131,38 @@ protected:
                       grpc::ServerWriter<ListReply>* response) override;
     grpc::Status networks(grpc::ServerContext* context, const NetworksRequest* request,
                           grpc::ServerWriter<NetworksReply>* response) override;
-    grpc::Status mount(grpc::ServerContext* context, const MountRequest* request,
-                       grpc::ServerWriter<MountReply>* response) override;
     grpc::Status recover(grpc::ServerContext* context, const RecoverRequest* request,
                          grpc::ServerWriter<RecoverReply>* response) override;
     grpc::Status ssh_info(grpc::ServerContext* context, const SSHInfoRequest* request,
                           grpc::ServerWriter<SSHInfoReply>* response) override;
-    grpc::Status start(grpc::ServerContext* context, const StartRequest* request,
-                       grpc::ServerWriter<StartReply>* response) override;
     grpc::Status stop(grpc::ServerContext* context, const StopRequest* request,
                       grpc::ServerWriter<StopReply>* response) override;
     grpc::Status suspend(grpc::ServerContext* context, const SuspendRequest* request,
                          grpc::ServerWriter<SuspendReply>* response) override;
-    grpc::Status restart(grpc::ServerContext* context, const RestartRequest* request,
-                         grpc::ServerWriter<RestartReply>* response) override;
     grpc::Status delet(grpc::ServerContext* context, const DeleteRequest* request,
                        grpc::ServerWriter<DeleteReply>* response) override;
     grpc::Status umount(grpc::ServerContext* context, const UmountRequest* request,
                         grpc::ServerWriter<UmountReply>* response) override;
     grpc::Status version(grpc::ServerContext* context, const VersionRequest* request,
                          grpc::ServerWriter<VersionReply>* response) override;
+    grpc::Status bake(grpc::ServerContext* context, const BakeRequest* request,
+                      grpc::ServerWriter<BakeReply>* response) override;
+    grpc::Status stats(grpc::ServerContext* context, const StatsRequest* request,
+                       grpc::ServerWriter<StatsReply>* response) override;
+    grpc::Status bench_mount(grpc::ServerContext* context, const BenchMountRequest* request,
+                             grpc::ServerWriter<BenchMountReply>* response) override;
+    grpc::Status throttle(grpc::ServerContext* context, const ThrottleRequest* request,
+                          grpc::ServerWriter<ThrottleReply>* response) override;
+    grpc::Status clone(grpc::ServerContext* context, const CloneRequest* request,
+                       grpc::ServerWriter<CloneReply>* response) override;
+    grpc::Status forward(grpc::ServerContext* context, const ForwardRequest* request,
+                         grpc::ServerWriter<ForwardReply>* response) override;
+    grpc::Status capacity(grpc::ServerContext* context, const CapacityRequest* request,
+                          grpc::ServerWriter<CapacityReply>* response) override;
+    grpc::Status copy_files(grpc::ServerContext* context, const CopyFilesRequest* request,
+                            grpc::ServerWriter<CopyFilesReply>* response) override;
+    grpc::Status resize(grpc::ServerContext* context, const ResizeRequest* request,
+                        grpc::ServerWriter<ResizeReply>* response) override;
     grpc::Status ping(grpc::ServerContext* context, const PingRequest* request, PingReply* response) override;
 };
 } // namespace multipass
@@ -16,30 +16,51 @@
  */
 
 #include "default_vm_image_vault.h"
-#include "json_writer.h"
+#include "json_journal.h"
+#include "zsync.h"
 
+#include <multipass/constants.h>
+#include <multipass/disk_image.h>
+#include <multipass/download_scheduler.h>
 #include <multipass/exceptions/aborted_download_exception.h>
 #include <multipass/exceptions/create_image_exception.h>
 #include <multipass/exceptions/unsupported_image_exception.h>
+#include <multipass/instrumentation.h>
 #include <multipass/logging/log.h>
+#include <multipass/memory_size.h>
 #include <multipass/platform.h>
 #include <multipass/process/qemuimg_process_spec.h>
 #include <multipass/query.h>
 #include <multipass/rpc/multipass.grpc.pb.h>
+#include <multipass/settings.h>
+#include <multipass/sha256.h>
 #include <multipass/url_downloader.h>
 #include <multipass/utils.h>
 #include <multipass/vm_image.h>
 #include <multipass/xz_image_decoder.h>
+#include <multipass/zstd_image_decoder.h>
 
 #include <multipass/format.h>
 
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QStringList>
+#include <QThread>
 #include <QUrl>
+#include <QUuid>
 #include <QtConcurrent/QtConcurrent>
 
+#include <algorithm>
+#include <cstdio>
 #include <exception>
+#include <filesystem>
+#include <iterator>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace mp = multipass;
 namespace mpl = multipass::logging;
@@ -49,6 +70,18 @@ namespace
 constexpr auto category = "image vault";
 constexpr auto instance_db_name = "multipassd-instance-image-records.json";
 constexpr auto image_db_name = "multipassd-image-records.json";
+constexpr auto hash_cache_name = "multipassd-image-hash-cache.json";
+constexpr auto reclaim_dir_name = "reclaim";
+constexpr auto mirrored_origin = "https://cloud-images.ubuntu.com/"; // what local.image-mirrors mirror
+constexpr auto ephemeral_marker_name = ".ephemeral"; // in the directory of an instance that is never recorded
+constexpr qint64 reclaim_step = 1024LL * 1024 * 1024; // how much of a file to free at a time
+constexpr qint64 tier_move_chunk = 8LL * 1024 * 1024;  // how much of a file to copy between tiers at a time
+constexpr auto hot_image_age = std::chrono::hours{24 * 3}; // unused for longer, an image goes to bulk storage
+constexpr qint64 max_delta_gap = 64 * 1024;         // unchanged bytes worth fetching to join two ranges in a request
+constexpr auto max_delta_ratio = 0.9;               // of the image, beyond which a delta is not worth it
+constexpr qint64 max_delta_range = 8 * 1024 * 1024; // bytes fetched in one request, which are held in memory
+constexpr auto image_flatten_timeout =
+    std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::minutes(10)).count();
 
 auto query_to_json(const mp::Query& query)
 {
@@ -92,19 +125,9 @@ auto record_to_json(const mp::VaultRecord& record)
     return json;
 }
 
-std::unordered_map<std::string, mp::VaultRecord> load_db(const QString& db_name)
+std::unordered_map<std::string, mp::VaultRecord> load_db(const mp::JsonJournal& journal)
 {
-    QFile db_file{db_name};
-    auto opened = db_file.open(QIODevice::ReadOnly);
-    if (!opened)
-        return {};
-
-    QJsonParseError parse_error;
-    auto doc = QJsonDocument::fromJson(db_file.readAll(), &parse_error);
-    if (doc.isNull())
-        return {};
-
-    auto records = doc.object();
+    auto records = journal.records();
     if (records.isEmpty())
         return {};
 
@@ -169,6 +192,69 @@ std::unordered_map<std::string, mp::VaultRecord> load_db(const QString& db_name)
     return reconstructed_records;
 }
 
+std::unordered_map<std::string, QJsonObject> load_hash_cache(const QString& cache_name)
+{
+    QFile cache_file{cache_name};
+    if (!cache_file.open(QIODevice::ReadOnly))
+        return {};
+
+    const auto entries = QJsonDocument::fromJson(cache_file.readAll()).object();
+
+    std::unordered_map<std::string, QJsonObject> hashes;
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it)
+    {
+        const auto entry = it.value().toObject();
+        if (!entry["path"].isString() || !entry["hash"].isString())
+            continue;
+
+        hashes[it.key().toStdString()] = entry;
+    }
+
+    return hashes;
+}
+
+// Hashes in chunks so that a background revalidation can be cut short; returns an empty string if it did not finish
+QString hash_file(const QString& file_name, const std::atomic_bool& stop)
+{
+    QFile file{file_name};
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+        return {};
+
+    mp::Sha256 hash;
+    QByteArray chunk(4 * 1024 * 1024, '\0');
+    while (!stop)
+    {
+        const auto bytes_read = file.read(chunk.data(), chunk.size());
+        if (bytes_read < 0)
+            return {};
+
+        if (bytes_read == 0)
+            return hash.result().toHex();
+
+        hash.add_data(chunk.constData(), bytes_read);
+    }
+
+    return {};
+}
+
+// Swaps path for a hard link to target in one step, so that anyone reading path always sees a whole file
+bool replace_with_link(const QString& target, const QString& path)
+{
+    const auto link_path = path + ".link";
+    QFile::remove(link_path);
+
+    if (!MP_PLATFORM.link(QFile::encodeName(target).constData(), QFile::encodeName(link_path).constData()))
+        return false;
+
+    if (std::rename(QFile::encodeName(link_path).constData(), QFile::encodeName(path).constData()) != 0)
+    {
+        QFile::remove(link_path);
+        return false;
+    }
+
+    return true;
+}
+
 void remove_source_images(const mp::VMImage& source_image, const mp::VMImage& prepared_image)
 {
     // The prepare phase may have been a no-op, check and only remove source images
@@ -192,8 +278,272 @@ void delete_image_dir(const mp::Path& image_path)
     }
 }
 
+// Interrupted downloads are kept for a while so that they can be resumed
+bool has_resumable_download(const QFileInfo& image_dir_info, const mp::days& days_to_expire)
+{
+    if (!image_dir_info.isDir())
+        return false;
+
+    const auto partials = QDir{image_dir_info.absoluteFilePath()}.entryInfoList({"*.partial"}, QDir::Files);
+    const auto expiry = QDateTime::currentDateTime().addDays(-days_to_expire.count());
+
+    return std::any_of(partials.cbegin(), partials.cend(),
+                       [&expiry](const QFileInfo& partial) { return partial.lastModified() > expiry; });
+}
+
+// Instances from the same prepared image share its data where the filesystem allows it, otherwise it is copied
+QString clone_or_copy(const QString& file_name, const QDir& output_dir)
+{
+    if (!file_name.isEmpty() && QFileInfo::exists(file_name))
+    {
+        const auto new_path = output_dir.filePath(QFileInfo{file_name}.fileName());
+        if (MP_PLATFORM.clone_file(QFile::encodeName(file_name).constData(), QFile::encodeName(new_path).constData()))
+            return new_path;
+    }
+
+    return mp::vault::copy(file_name, output_dir);
+}
+
+// Instances may run off an overlay on top of a shared image, which a copy kept for good must not depend on
+QString flatten_or_copy(const QString& file_name, const QDir& output_dir)
+{
+    const auto qcow2_info = mp::disk_image::inspect_qcow2(file_name);
+    if (!qcow2_info || qcow2_info->backing_file.isEmpty())
+        return clone_or_copy(file_name, output_dir);
+
+    const auto new_path = output_dir.filePath(QFileInfo{file_name}.fileName());
+    auto qemuimg_process = mp::platform::make_process(std::make_unique<mp::QemuImgProcessSpec>(
+        QStringList{"convert", "-O", "qcow2", file_name, new_path}, file_name, new_path));
+    auto process_state = qemuimg_process->execute(image_flatten_timeout);
+
+    if (!process_state.completed_successfully())
+    {
+        throw std::runtime_error(fmt::format("Cannot flatten image: qemu-img failed ({}) with output:\n{}",
+                                             process_state.failure_message(),
+                                             qemuimg_process->read_all_standard_error()));
+    }
+
+    return new_path;
+}
+
+void create_overlay(const QString& image_path, const QString& backing_file)
+{
+    const auto backing_path = QFileInfo{image_path}.dir().filePath(backing_file);
+    auto qemuimg_process = mp::platform::make_process(std::make_unique<mp::QemuImgProcessSpec>(
+        QStringList{"create", "-f", "qcow2", "-F", "qcow2", "-b", backing_file, image_path}, backing_path,
+        image_path));
+    auto process_state = qemuimg_process->execute();
+
+    if (!process_state.completed_successfully())
+        throw std::runtime_error(fmt::format("Cannot create overlay: qemu-img failed ({}) with output:\n{}",
+                                             process_state.failure_message(),
+                                             qemuimg_process->read_all_standard_error()));
+}
+
+// Turns what an image holds so far into a base that is never written to again, with the image carrying on as an
+// overlay on top of it. The base is stamped with the overlay's modification time, so that it is only frozen anew once
+// the overlay was written to
+QString freeze(const QString& image_path)
+{
+    const auto info = mp::disk_image::inspect_qcow2(image_path);
+    if (!info)
+        throw std::runtime_error(fmt::format("Cannot freeze {}, which is not a qcow2 image", image_path));
+
+    const QFileInfo image_info{image_path};
+    const auto frozen_prefix = image_info.fileName() + ".frozen-";
+    if (info->backing_file.startsWith(frozen_prefix))
+    {
+        const QFileInfo base_info{image_info.dir().filePath(info->backing_file)};
+        if (base_info.exists() && base_info.lastModified() == image_info.lastModified())
+            return base_info.filePath();
+    }
+
+    QString base;
+    for (auto n = 1; base.isEmpty() || QFile::exists(base); ++n)
+        base = image_info.dir().filePath(frozen_prefix + QString::number(n));
+
+    if (!QFile::rename(image_path, base))
+        throw std::runtime_error(fmt::format("Cannot freeze {}", image_path));
+
+    try
+    {
+        create_overlay(image_path, QFileInfo{base}.fileName());
+    }
+    catch (...)
+    {
+        QFile::rename(base, image_path);
+        throw;
+    }
+
+    QFile base_file{base};
+    if (base_file.open(QIODevice::ReadWrite))
+        base_file.setFileTime(QFileInfo{image_path}.lastModified(), QFileDevice::FileModificationTime);
+
+    return base;
+}
+
+// Brings a frozen base, along with the local bases under it, into another directory. They are linked rather than
+// copied, as nothing writes to them, and keep naming each other by file name
+void link_backing_chain(QString base, const QDir& output_dir)
+{
+    for (;;)
+    {
+        const auto link_path = output_dir.filePath(QFileInfo{base}.fileName());
+        if (!QFile::exists(link_path) &&
+            !MP_PLATFORM.link(QFile::encodeName(base).constData(), QFile::encodeName(link_path).constData()))
+            mp::vault::copy(base, output_dir);
+
+        const auto info = mp::disk_image::inspect_qcow2(base);
+        if (!info || info->backing_file.isEmpty() || QDir::isAbsolutePath(info->backing_file) ||
+            info->backing_file.contains("://"))
+            return;
+
+        base = QFileInfo{base}.dir().filePath(info->backing_file);
+        if (!QFile::exists(base))
+            return;
+    }
+}
+
+// qemu reads qcow2 images over https in place, but cannot decompress them as it goes. What it reads is not checked
+// against the image's hash, so plain http, which anything on the way could rewrite, is left to the verified download
+bool can_read_remotely(const mp::VMImageInfo& info)
+{
+    const QUrl url{info.image_location};
+    return url.scheme() == "https" && mp::vault::filename_for(info.image_location).endsWith(".img");
+}
+
+// A cached image takes a fraction of the space with its clusters compressed, and qemu runs it as it is. Images that
+// are not qcow2 are left alone, as are all of them where qemu-img is too old for zstd.
+void compress_cached_image(const QString& image_path)
+{
+    if (!mp::disk_image::inspect_qcow2(image_path))
+        return;
+
+    const auto compressed_path = image_path + ".compressed";
+    auto qemuimg_process = mp::platform::make_process(std::make_unique<mp::QemuImgProcessSpec>(
+        QStringList{"convert", "-c", "-O", "qcow2", "-o", "compression_type=zstd", image_path, compressed_path},
+        image_path, compressed_path));
+    auto process_state = qemuimg_process->execute(image_flatten_timeout);
+
+    // Replaced in one go, so the image is never missing from the cache
+    if (!process_state.completed_successfully() ||
+        std::rename(QFile::encodeName(compressed_path).constData(), QFile::encodeName(image_path).constData()) != 0)
+    {
+        mpl::log(mpl::Level::warning, category,
+                 fmt::format("Keeping {} uncompressed: {}", image_path,
+                             process_state.completed_successfully() ? QString{"cannot replace it"}
+                                                                    : qemuimg_process->read_all_standard_error()));
+        QFile::remove(compressed_path);
+    }
+}
+
+std::string baked_image_id(const std::string& image_name)
+{
+    return fmt::format("{}:{}", mp::baked_remote_name, image_name);
+}
+
+qint64 disk_size_of(const mp::VMImage& image)
+{
+    qint64 size{0};
+    for (const auto& path : {image.image_path, image.kernel_path, image.initrd_path})
+        if (!path.isEmpty())
+            size += QFileInfo{path}.size();
+
+    return size;
+}
+
+// Where images go when they are not used much, when it is set. Beside the cache on fast storage, which is where images
+// come to, to be used, and where they come back to when they are used again.
+mp::optional<QDir> bulk_images_dir(const QString& backend_directory_name)
+{
+    const auto path = MP_SETTINGS.get(mp::image_bulk_storage_key);
+    if (path.isEmpty())
+        return mp::nullopt;
+
+    return QDir{QDir{QDir{path}.filePath(backend_directory_name)}.filePath("images")};
+}
+
+bool is_in(const QDir& dir, const mp::Path& path)
+{
+    return !path.isEmpty() && path.startsWith(dir.absolutePath() + '/');
+}
+
+bool sync_directory(const QString& dir)
+{
+    const auto dir_fd = ::open(QFile::encodeName(dir).constData(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd < 0)
+        return false;
+
+    const auto synced = ::fsync(dir_fd) == 0;
+    ::close(dir_fd);
+    return synced;
+}
+
+// Copies the files of an image directory into another, a chunk at a time, so that stopping can come in between.
+// The copy is on disk by the time this returns, for the record to be switched over to it and the original removed.
+bool copy_image_files(const QString& from_dir, const QString& to_dir, const std::atomic_bool& stop)
+{
+    if (!QDir{}.mkpath(to_dir))
+        return false;
+
+    for (const auto& entry : QDir{from_dir}.entryInfoList(QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot))
+    {
+        QFile source{entry.absoluteFilePath()};
+        QFile destination{QDir{to_dir}.filePath(entry.fileName())};
+        if (!source.open(QIODevice::ReadOnly) || !destination.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+
+        while (!source.atEnd())
+        {
+            const auto chunk = source.read(tier_move_chunk);
+            if (stop || chunk.isEmpty() || destination.write(chunk) != chunk.size())
+                return false;
+        }
+
+        if (!destination.flush() || ::fsync(destination.handle()) != 0)
+            return false;
+    }
+
+    return sync_directory(to_dir) && sync_directory(QFileInfo{to_dir}.absolutePath());
+}
+
+mp::optional<qint64> image_cache_size_limit()
+{
+    const auto limit = MP_SETTINGS.get(mp::image_cache_size_key);
+    if (limit.isEmpty())
+        return mp::nullopt;
+
+    try
+    {
+        return mp::MemorySize{limit.toStdString()}.in_bytes();
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::warning, category, fmt::format("Ignoring invalid image cache size: {}", e.what()));
+        return mp::nullopt;
+    }
+}
+
+QStringList image_cache_peers()
+{
+    QStringList peers;
+    for (const auto& peer : MP_SETTINGS.get(mp::image_cache_peers_key).split(',', QString::SkipEmptyParts))
+        peers.append(peer.trimmed());
+
+    return peers;
+}
+
+// Peers serve the original upstream files by their SHA-256, e.g. "http://peer:8080/images/<id>"
+QString peer_image_location(const QString& peer, const mp::VMImageInfo& info)
+{
+    return (peer.endsWith('/') ? peer : peer + '/') + info.id;
+}
+
 mp::MemorySize get_image_size(const mp::Path& image_path)
 {
+    if (const auto qcow2_info = mp::disk_image::inspect_qcow2(image_path))
+        return mp::MemorySize{std::to_string(qcow2_info->virtual_size)};
+
     QStringList qemuimg_parameters{{"info", image_path}};
     auto qemuimg_process =
         mp::platform::make_process(std::make_unique<mp::QemuImgProcessSpec>(qemuimg_parameters, image_path));
@@ -225,30 +575,109 @@ mp::MemorySize get_image_size(const mp::Path& image_path)
 
     return image_size;
 }
+
+mp::VMImage traced_prepare(const mp::PrepareAction& prepare, const mp::VMImage& source_image)
+{
+    mp::TraceSpan span{"vault", "prepare"};
+    return prepare(source_image);
+}
+
+// Whether the file's data is its own to free. Shrinking a link would shrink its target, and shrinking one of several
+// hard links would shrink the data that the others still point at, such as an image the instance was linked from.
+bool owns_its_data(const QString& path)
+{
+    namespace fs = std::filesystem;
+    const fs::path file_path{path.toStdU16String()};
+
+    std::error_code error;
+    return fs::is_regular_file(fs::symlink_status(file_path, error)) && fs::hard_link_count(file_path, error) == 1;
+}
+
+// Frees large files a step at a time before removing them, so that reclaiming gigabytes does not hog the disk for
+// everybody else. Files that do not own their data are only unlinked. Stopping leaves the rest in place for the next
+// run.
+void reclaim(const QString& path, const std::atomic_bool& stop)
+{
+    QThread::currentThread()->setPriority(QThread::LowestPriority);
+
+    if (QFileInfo{path}.isSymLink()) // not to go through whatever it points at
+    {
+        QFile::remove(path);
+        return;
+    }
+
+    QDirIterator files{path, QDir::Files | QDir::Hidden | QDir::System, QDirIterator::Subdirectories};
+    while (files.hasNext())
+    {
+        QFile file{files.next()};
+        if (owns_its_data(file.fileName()))
+            for (auto size = file.size() - reclaim_step; size > 0 && !stop; size -= reclaim_step)
+                if (!file.resize(size))
+                    break;
+
+        if (stop)
+            return;
+
+        file.remove();
+    }
+
+    if (!QDir{path}.removeRecursively())
+        mpl::log(mpl::Level::warning, category, fmt::format("Could not reclaim all of {}", path));
+}
 } // namespace
 
 mp::DefaultVMImageVault::DefaultVMImageVault(std::vector<VMImageHost*> image_hosts, URLDownloader* downloader,
-                                             mp::Path cache_dir_path, mp::Path data_dir_path, mp::days days_to_expire)
+                                             mp::Path cache_dir_path, mp::Path data_dir_path, mp::days days_to_expire,
+                                             bool remote_backing_files)
     : BaseVMImageVault{image_hosts},
       url_downloader{downloader},
       cache_dir{QDir(cache_dir_path).filePath("vault")},
       data_dir{QDir(data_dir_path).filePath("vault")},
       instances_dir(data_dir.filePath("instances")),
       images_dir(cache_dir.filePath("images")),
+      backend_directory_name{QFileInfo{cache_dir_path}.fileName()},
       days_to_expire{days_to_expire},
-      prepared_image_records{load_db(cache_dir.filePath(image_db_name))},
-      instance_image_records{load_db(data_dir.filePath(instance_db_name))}
+      remote_backing_files{remote_backing_files},
+      mirror_selector{downloader, mirrored_origin},
+      image_records_journal{cache_dir.filePath(image_db_name)},
+      instance_records_journal{data_dir.filePath(instance_db_name)},
+      prepared_image_records{load_db(image_records_journal)},
+      instance_image_records{load_db(instance_records_journal)}
 {
+    for (const auto& entry : load_hash_cache(cache_dir.filePath(hash_cache_name)))
+        local_image_hashes[entry.first] = {entry.second["path"].toString(), entry.second["hash"].toString()};
+
+    // One at a time, behind everything else; what a previous run left behind goes first
+    reclaim_pool.setMaxThreadCount(1);
+    tier_pool.setMaxThreadCount(1);
+    const QDir reclaim_dir{data_dir.filePath(reclaim_dir_name)};
+    for (const auto& leftover : reclaim_dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+        reclaim_in_background(reclaim_dir.filePath(leftover));
+
+    // Ephemeral instances the daemon went down with before purging them, which are directories of their own
+    for (const auto& name : instances_dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks))
+        if (!instance_image_records.count(name.toStdString()) &&
+            QFile::exists(QDir{instances_dir.filePath(name)}.filePath(ephemeral_marker_name)))
+            reclaim_instance_directory(name);
 }
 
 mp::DefaultVMImageVault::~DefaultVMImageVault()
 {
     url_downloader->abort_all_downloads();
+    background_fetches.waitForFinished();
+    stop_revalidating = true;
+    stop_reclaiming = true;
+    stop_moving_images = true;
+    image_moves.waitForFinished();
+
+    image_records_journal.compact();
+    instance_records_journal.compact();
 }
 
 mp::VMImage mp::DefaultVMImageVault::fetch_image(const FetchType& fetch_type, const Query& query,
                                                  const PrepareAction& prepare, const ProgressMonitor& monitor)
 {
+    TraceSpan span{"vault", "fetch_image"};
     {
         std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
         auto name_entry = instance_image_records.find(query.name);
@@ -272,8 +701,9 @@ mp::VMImage mp::DefaultVMImageVault::fetch_image(const FetchType& fetch_type, co
             throw std::runtime_error(fmt::format("Custom image `{}` does not exist.", image_url.path()));
 
         source_image.image_path = image_url.path();
+        const auto image_id = local_image_hash(source_image.image_path);
 
-        if (source_image.image_path.endsWith(".xz"))
+        if (mp::vault::is_compressed_image(source_image.image_path))
         {
             source_image.image_path = extract_image_from(query.name, source_image, monitor);
         }
@@ -286,12 +716,13 @@ mp::VMImage mp::DefaultVMImageVault::fetch_image(const FetchType& fetch_type, co
         {
             auto info = get_kernel_query_info(query.name);
 
-            source_image =
-                fetch_kernel_and_initrd(info, source_image, QFileInfo(source_image.image_path).absoluteDir(), monitor);
+            const auto image_path = source_image.image_path;
+            source_image = fetch_kernel_and_initrd(info, source_image, QFileInfo(image_path).absoluteDir(),
+                                                   [&image_path] { return image_path; }, monitor);
         }
 
-        vm_image = prepare(source_image);
-        vm_image.id = mp::vault::compute_image_hash(vm_image.image_path).toStdString();
+        vm_image = traced_prepare(prepare, source_image);
+        vm_image.id = image_id.toStdString();
 
         remove_source_images(source_image, vm_image);
 
@@ -307,7 +738,7 @@ mp::VMImage mp::DefaultVMImageVault::fetch_image(const FetchType& fetch_type, co
     {
         std::string id;
         optional<VMImage> source_image{nullopt};
-        QFuture<VMImage> future;
+        InProgressFetch fetch;
 
         if (query.query_type == Query::Type::HttpDownload)
         {
@@ -329,44 +760,58 @@ mp::VMImage mp::DefaultVMImageVault::fetch_image(const FetchType& fetch_type, co
                 }
             }
 
-            auto running_future = get_image_future(id);
-            if (running_future)
-            {
-                monitor(LaunchProgress::WAITING, -1);
-                future = *running_future;
-            }
-            else
-            {
-                auto kernel_info = get_kernel_query_info(query.name);
-                const VMImageInfo info{{},
-                                       {},
-                                       {},
-                                       {},
-                                       true,
-                                       image_url.url(),
-                                       kernel_info.kernel_location,
-                                       kernel_info.initrd_location,
-                                       QString::fromStdString(id),
-                                       {},
-                                       last_modified.toString(),
-                                       0,
-                                       false};
-                const auto image_filename = mp::vault::filename_for(image_url.path());
-                // Attempt to make a sane directory name based on the filename of the image
-
-                const auto image_dir_name =
-                    QString("%1-%2")
-                        .arg(image_filename.section(".", 0, image_filename.endsWith(".xz") ? -3 : -2))
-                        .arg(last_modified.toString("yyyyMMdd"));
-                const auto image_dir = mp::utils::make_dir(images_dir, image_dir_name);
-
-                // Had to use std::bind here to workaround the 5 allowable function arguments constraint of
-                // QtConcurrent::run()
-                future = QtConcurrent::run(std::bind(&DefaultVMImageVault::download_and_prepare_source_image, this,
-                                                     info, source_image, image_dir, fetch_type, prepare, monitor));
-
-                in_progress_image_fetches[id] = future;
-            }
+            fetch = join_or_start_fetch(
+                id,
+                [&](const ProgressMonitor& fetch_monitor) {
+                    auto kernel_info = get_kernel_query_info(query.name);
+                    const VMImageInfo info{{},
+                                           {},
+                                           {},
+                                           {},
+                                           true,
+                                           image_url.url(),
+                                           kernel_info.kernel_location,
+                                           kernel_info.initrd_location,
+                                           QString::fromStdString(id),
+                                           {},
+                                           last_modified.toString(),
+                                           0,
+                                           false};
+
+                    const auto image_filename = mp::vault::filename_for(image_url.path());
+                    // Attempt to make a sane directory name based on the filename of the image
+
+                    const auto image_dir_name =
+                        QString("%1-%2")
+                            .arg(image_filename.section(".", 0, mp::vault::is_compressed_image(image_filename) ? -3 : -2))
+                            .arg(last_modified.toString("yyyyMMdd"));
+                    const auto image_dir = mp::utils::make_dir(images_dir, image_dir_name);
+
+                    auto download = std::bind(&DefaultVMImageVault::download_and_prepare_source_image, this, info,
+                                              source_image, image_dir, fetch_type, prepare, fetch_monitor);
+
+                    // The download runs in another thread, but keeps the priority of the one asking for it
+                    return QtConcurrent::run([download, priority = DownloadScheduler::current_priority()]() mutable {
+                        DownloadScheduler::PriorityScope priority_scope{priority};
+                        return download();
+                    });
+                },
+                monitor);
+        }
+        else if (query.remote_name == mp::baked_remote_name)
+        {
+            std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+            auto entry = prepared_image_records.find(baked_image_id(query.release));
+            if (entry == prepared_image_records.end())
+                throw std::runtime_error(fmt::format("No image was baked as \"{}\"", query.release));
+
+            // Launching must not make the record of a baked image one that expires
+            auto baked_query = query;
+            baked_query.persistent = true;
+            const auto id = entry->first;
+            const auto baked_image = entry->second.image;
+
+            return finalize_image_records(baked_query, baked_image, id);
         }
         else
         {
@@ -402,43 +847,46 @@ mp::VMImage mp::DefaultVMImageVault::fetch_image(const FetchType& fetch_type, co
                 }
             }
 
-            auto running_future = get_image_future(id);
-            if (running_future)
-            {
-                monitor(LaunchProgress::WAITING, -1);
-                future = *running_future;
-            }
-            else
-            {
+            auto start_fetch = [&](const PrepareAction& fetch_prepare, const ProgressMonitor& fetch_monitor) {
                 const auto image_dir =
                     mp::utils::make_dir(images_dir, QString("%1-%2").arg(info.release).arg(info.version));
 
-                // Had to use std::bind here to workaround the 5 allowable function arguments constraint of
-                // QtConcurrent::run()
-                future = QtConcurrent::run(std::bind(&DefaultVMImageVault::download_and_prepare_source_image, this,
-                                                     info, source_image, image_dir, fetch_type, prepare, monitor));
+                auto download = std::bind(&DefaultVMImageVault::download_and_prepare_source_image, this, info,
+                                          source_image, image_dir, fetch_type, fetch_prepare, fetch_monitor);
+
+                // The download runs in another thread, but keeps the priority of the one asking for it
+                return QtConcurrent::run([download, priority = DownloadScheduler::current_priority()]() mutable {
+                    DownloadScheduler::PriorityScope priority_scope{priority};
+                    return download();
+                });
+            };
+
+            // The instance boots off the remote image straight away, while the image is fetched into the cache and
+            // verified behind it. Only qcow2 images that are not compressed can be read where they are, and those
+            // need no preparing, so the fetch does not depend on the caller's prepare action outliving this call.
+            if (remote_backing_files && fetch_type == FetchType::ImageOnly && !query.name.empty() &&
+                MP_SETTINGS.get(mp::lazy_boot_key) == "true" && can_read_remotely(info))
+            {
+                auto vm_image = remote_image_instance_from(query.name, info);
+
+                auto identity = [](const VMImage& source) { return source; };
+                fetch = join_or_start_fetch(
+                    id, [&](const ProgressMonitor& fetch_monitor) { return start_fetch(identity, fetch_monitor); },
+                    background_monitor);
 
-                in_progress_image_fetches[id] = future;
+                instance_image_records[query.name] = {vm_image, query, std::chrono::system_clock::now()};
+                persist_instance_records(WriteDurability::synced);
+                complete_fetch_in_background(fetch, id, query);
+
+                return vm_image;
             }
-        }
 
-        try
-        {
-            auto prepared_image = future.result();
-            std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
-            in_progress_image_fetches.erase(id);
-            return finalize_image_records(query, prepared_image, id);
-        }
-        catch (const AbortedDownloadException&)
-        {
-            throw;
-        }
-        catch (const std::exception& e)
-        {
-            std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
-            in_progress_image_fetches.erase(id);
-            throw;
+            fetch = join_or_start_fetch(
+                id, [&](const ProgressMonitor& fetch_monitor) { return start_fetch(prepare, fetch_monitor); },
+                monitor);
         }
+
+        return wait_for_fetch(fetch, id, query, monitor);
     }
 }
 
@@ -448,99 +896,375 @@ void mp::DefaultVMImageVault::remove(const std::string& name)
     if (name_entry == instance_image_records.end())
         return;
 
-    QDir instance_dir{instances_dir};
-    if (instance_dir.cd(QString::fromStdString(name)))
-        instance_dir.removeRecursively();
+    reclaim_instance_directory(QString::fromStdString(name));
 
     instance_image_records.erase(name);
     persist_instance_records();
 }
 
-bool mp::DefaultVMImageVault::has_record_for(const std::string& name)
+// Moved out of the way right away, but deleted in the background, as it may well take gigabytes
+void mp::DefaultVMImageVault::reclaim_instance_directory(const QString& name)
 {
-    return instance_image_records.find(name) != instance_image_records.end();
+    QDir instance_dir{instances_dir};
+    if (!instance_dir.cd(name))
+        return;
+
+    const auto reclaim_path = QDir{data_dir.filePath(reclaim_dir_name)}.filePath(
+        QString{"%1.%2"}.arg(name, QUuid::createUuid().toString(QUuid::Id128)));
+    if (data_dir.mkpath(reclaim_dir_name) && QDir{}.rename(instance_dir.absolutePath(), reclaim_path))
+        reclaim_in_background(reclaim_path);
+    else
+        instance_dir.removeRecursively();
 }
 
-void mp::DefaultVMImageVault::prune_expired_images()
+void mp::DefaultVMImageVault::reclaim_in_background(const QString& path)
 {
-    std::vector<decltype(prepared_image_records)::key_type> expired_keys;
-    std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+    reclamations.addFuture(QtConcurrent::run(&reclaim_pool, [this, path] { reclaim(path, stop_reclaiming); }));
+}
 
-    for (const auto& record : prepared_image_records)
-    {
-        // Expire source images if they aren't persistent and haven't been accessed in 14 days
-        if (record.second.query.query_type == Query::Type::Alias && !record.second.query.persistent &&
-            record.second.last_accessed + days_to_expire <= std::chrono::system_clock::now())
-        {
-            mpl::log(
-                mpl::Level::info, category,
-                fmt::format("Source image {} is expired. Removing it from the cache.", record.second.query.release));
-            expired_keys.push_back(record.first);
-            delete_image_dir(record.second.image.image_path);
-        }
-    }
+// Must be called with fetch_mutex held. The files are copied without it, and the record only points at the copy once
+// that is complete; instances are copies of their own, so the image can move from under them.
+void mp::DefaultVMImageVault::move_image_in_background(const std::string& id, const QDir& destination)
+{
+    const auto from_dir = QFileInfo{prepared_image_records.at(id).image.image_path}.absolutePath();
+    const auto to_dir = destination.absoluteFilePath(QFileInfo{from_dir}.fileName());
+    if (from_dir == to_dir || !moving_images_to.insert(to_dir).second)
+        return;
 
-    // Remove any image directories that have no corresponding database entry
-    for (const auto& entry : images_dir.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot))
-    {
-        if (std::find_if(prepared_image_records.cbegin(), prepared_image_records.cend(),
-                         [&entry](const std::pair<std::string, VaultRecord>& record) {
-                             return record.second.image.image_path.contains(entry.absoluteFilePath());
-                         }) == prepared_image_records.cend())
+    image_moves.addFuture(QtConcurrent::run(&tier_pool, [this, id, from_dir, to_dir] {
+        QThread::currentThread()->setPriority(QThread::LowestPriority);
+
+        const auto copied = !QFileInfo::exists(to_dir) && copy_image_files(from_dir, to_dir, stop_moving_images);
+
+        std::unique_lock<decltype(fetch_mutex)> lock{fetch_mutex};
+        moving_images_to.erase(to_dir);
+
+        auto entry = prepared_image_records.find(id);
+        if (!copied || entry == prepared_image_records.end() ||
+            QFileInfo{entry->second.image.image_path}.absolutePath() != from_dir)
         {
-            mpl::log(mpl::Level::info, category,
-                     fmt::format("Source image {} is no longer valid. Removing it from the cache.",
-                                 entry.absoluteFilePath()));
-            delete_image_dir(entry.absoluteFilePath());
+            lock.unlock();
+            if (!stop_moving_images)
+                mpl::log(mpl::Level::debug, category, fmt::format("Not moving image {} to {}", id, to_dir));
+            if (copied || QFileInfo::exists(to_dir))
+                QDir{to_dir}.removeRecursively();
+            return;
         }
-    }
 
-    for (const auto& key : expired_keys)
-        prepared_image_records.erase(key);
+        auto relocate = [&from_dir, &to_dir](const Path& path) {
+            return path.startsWith(from_dir) ? to_dir + path.mid(from_dir.length()) : path;
+        };
 
-    persist_image_records();
+        auto& image = entry->second.image;
+        image.image_path = relocate(image.image_path);
+        image.kernel_path = relocate(image.kernel_path);
+        image.initrd_path = relocate(image.initrd_path);
+        persist_image_records(WriteDurability::synced);
+        lock.unlock();
+
+        mpl::log(mpl::Level::info, category, fmt::format("Moved image {} to {}", id, to_dir));
+        QDir{from_dir}.removeRecursively();
+    }));
 }
 
-void mp::DefaultVMImageVault::update_images(const FetchType& fetch_type, const PrepareAction& prepare,
-                                            const ProgressMonitor& monitor)
+mp::VMImage mp::DefaultVMImageVault::rename(const std::string& from, const std::string& to)
 {
-    mpl::log(mpl::Level::debug, category, "Checking for images to update…");
+    std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
 
-    std::vector<decltype(prepared_image_records)::key_type> keys_to_update;
-    for (const auto& record : prepared_image_records)
-    {
-        if (record.second.query.query_type == Query::Type::Alias &&
-            record.first.compare(0, record.second.query.release.length(), record.second.query.release) != 0)
-        {
-            try
-            {
-                auto info = info_for(record.second.query);
-                if (info.id.toStdString() != record.first)
-                {
-                    keys_to_update.push_back(record.first);
-                }
-            }
-            catch (const mp::UnsupportedImageException& e)
-            {
-                mpl::log(mpl::Level::warning, category, fmt::format("Skipping update: {}", e.what()));
-            }
-        }
+    auto entry = instance_image_records.find(from);
+    if (entry == instance_image_records.end())
+        throw std::runtime_error(fmt::format("no instance image for \"{}\"", from));
+
+    const auto from_dir = instances_dir.filePath(QString::fromStdString(from));
+    const auto to_dir = instances_dir.filePath(QString::fromStdString(to));
+    if (QFileInfo::exists(to_dir) || !QDir{}.rename(from_dir, to_dir))
+        throw std::runtime_error(fmt::format("cannot move the instance image of \"{}\" to \"{}\"", from, to));
+
+    auto relocate = [&from_dir, &to_dir](const Path& path) {
+        return path.startsWith(from_dir) ? to_dir + path.mid(from_dir.length()) : path;
+    };
+
+    auto record = std::move(entry->second);
+    instance_image_records.erase(entry);
+
+    record.image.image_path = relocate(record.image.image_path);
+    record.image.kernel_path = relocate(record.image.kernel_path);
+    record.image.initrd_path = relocate(record.image.initrd_path);
+    record.query.name = to;
+    record.last_accessed = std::chrono::system_clock::now();
+
+    auto image = record.image;
+    instance_image_records[to] = std::move(record);
+    persist_instance_records(WriteDurability::synced);
+
+    return image;
+}
+
+mp::VMImage mp::DefaultVMImageVault::bake(const std::string& instance_name, const std::string& image_name)
+{
+    std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+
+    auto entry = instance_image_records.find(instance_name);
+    if (entry == instance_image_records.end())
+        throw std::runtime_error(fmt::format("no instance image for \"{}\"", instance_name));
+
+    // Baking again under the same name replaces the image; instances launched from the old one have their own copies
+    const auto id = baked_image_id(image_name);
+    auto previous = prepared_image_records.find(id);
+    if (previous != prepared_image_records.end())
+    {
+        delete_image_dir(previous->second.image.image_path);
+        prepared_image_records.erase(previous);
+    }
+
+    const auto& instance_image = entry->second.image;
+    QDir image_dir{mp::utils::make_dir(
+        images_dir, QString::fromStdString(fmt::format("{}-{}", mp::baked_remote_name, image_name)))};
+
+    VMImage baked_image;
+    try
+    {
+        baked_image = {flatten_or_copy(instance_image.image_path, image_dir),
+                       clone_or_copy(instance_image.kernel_path, image_dir),
+                       clone_or_copy(instance_image.initrd_path, image_dir),
+                       id,
+                       instance_image.original_release,
+                       instance_image.current_release,
+                       instance_image.release_date,
+                       {image_name}};
+    }
+    catch (...)
+    {
+        image_dir.removeRecursively();
+        throw;
+    }
+
+    // Baked images are only ever replaced by baking again, so they neither expire nor get evicted
+    const Query query{"", image_name, true, mp::baked_remote_name, Query::Type::Alias};
+    prepared_image_records[id] = {baked_image, query, std::chrono::system_clock::now()};
+    persist_image_records(WriteDurability::synced);
+
+    return baked_image;
+}
+
+mp::VMImage mp::DefaultVMImageVault::clone(const std::string& source_name, const std::string& destination_name)
+{
+    std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+
+    auto entry = instance_image_records.find(source_name);
+    if (entry == instance_image_records.end())
+        throw std::runtime_error(fmt::format("no instance image for \"{}\"", source_name));
+
+    const auto destination_dir = instances_dir.filePath(QString::fromStdString(destination_name));
+    if (instance_image_records.count(destination_name) || QFileInfo::exists(destination_dir))
+        throw std::runtime_error(fmt::format("there is already an instance image for \"{}\"", destination_name));
+
+    // Flattened rather than layered on the source's image, so that either instance can go without the other
+    const auto& source_image = entry->second.image;
+    QDir image_dir{mp::utils::make_dir(instances_dir, QString::fromStdString(destination_name))};
+
+    VMImage image;
+    try
+    {
+        image = {flatten_or_copy(source_image.image_path, image_dir),
+                 clone_or_copy(source_image.kernel_path, image_dir),
+                 clone_or_copy(source_image.initrd_path, image_dir),
+                 source_image.id,
+                 source_image.original_release,
+                 source_image.current_release,
+                 source_image.release_date,
+                 source_image.aliases};
+    }
+    catch (...)
+    {
+        image_dir.removeRecursively();
+        throw;
+    }
+
+    auto query = entry->second.query;
+    query.name = destination_name;
+    instance_image_records[destination_name] = {image, query, std::chrono::system_clock::now()};
+    persist_instance_records(WriteDurability::synced);
+
+    return image;
+}
+
+mp::VMImage mp::DefaultVMImageVault::clone_layered(const std::string& source_name,
+                                                   const std::string& destination_name)
+{
+    std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+
+    auto entry = instance_image_records.find(source_name);
+    if (entry == instance_image_records.end())
+        throw std::runtime_error(fmt::format("no instance image for \"{}\"", source_name));
+
+    const auto destination_dir = instances_dir.filePath(QString::fromStdString(destination_name));
+    if (instance_image_records.count(destination_name) || QFileInfo::exists(destination_dir))
+        throw std::runtime_error(fmt::format("there is already an instance image for \"{}\"", destination_name));
+
+    // Taking no more than an empty overlay, however big the source's disk
+    const auto& source_image = entry->second.image;
+    const auto base = freeze(source_image.image_path);
+    QDir image_dir{mp::utils::make_dir(instances_dir, QString::fromStdString(destination_name))};
+
+    VMImage image;
+    try
+    {
+        link_backing_chain(base, image_dir);
+
+        const auto image_path = image_dir.filePath(QFileInfo{source_image.image_path}.fileName());
+        create_overlay(image_path, QFileInfo{base}.fileName());
+
+        image = {image_path,
+                 clone_or_copy(source_image.kernel_path, image_dir),
+                 clone_or_copy(source_image.initrd_path, image_dir),
+                 source_image.id,
+                 source_image.original_release,
+                 source_image.current_release,
+                 source_image.release_date,
+                 source_image.aliases};
+    }
+    catch (...)
+    {
+        image_dir.removeRecursively();
+        throw;
+    }
+
+    auto query = entry->second.query;
+    query.name = destination_name;
+    instance_image_records[destination_name] = {image, query, std::chrono::system_clock::now()};
+    persist_instance_records(WriteDurability::synced);
+
+    return image;
+}
+
+bool mp::DefaultVMImageVault::has_record_for(const std::string& name)
+{
+    return instance_image_records.find(name) != instance_image_records.end();
+}
+
+void mp::DefaultVMImageVault::prune_expired_images()
+{
+    std::vector<decltype(prepared_image_records)::key_type> expired_keys;
+    const auto bulk_dir = bulk_images_dir(backend_directory_name);
+    std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+
+    for (const auto& record : prepared_image_records)
+    {
+        // Expire source images if they aren't persistent and haven't been accessed in 14 days
+        if (record.second.query.query_type == Query::Type::Alias && !record.second.query.persistent &&
+            record.second.last_accessed + days_to_expire <= std::chrono::system_clock::now())
+        {
+            mpl::log(
+                mpl::Level::info, category,
+                fmt::format("Source image {} is expired. Removing it from the cache.", record.second.query.release));
+            expired_keys.push_back(record.first);
+            delete_image_dir(record.second.image.image_path);
+        }
+        else if (bulk_dir && is_in(images_dir, record.second.image.image_path) &&
+                 record.second.last_accessed + hot_image_age <= std::chrono::system_clock::now() &&
+                 in_progress_image_fetches.find(record.first) == in_progress_image_fetches.end())
+        {
+            move_image_in_background(record.first, *bulk_dir);
+        }
+    }
+
+    // Remove any image directories that have no corresponding database entry
+    auto entries = images_dir.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot);
+    if (bulk_dir)
+        entries += bulk_dir->entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot);
+
+    for (const auto& entry : entries)
+    {
+        if (has_resumable_download(entry, days_to_expire) || moving_images_to.count(entry.absoluteFilePath()))
+            continue;
+
+        if (std::find_if(prepared_image_records.cbegin(), prepared_image_records.cend(),
+                         [&entry](const std::pair<std::string, VaultRecord>& record) {
+                             return record.second.image.image_path.contains(entry.absoluteFilePath());
+                         }) == prepared_image_records.cend())
+        {
+            mpl::log(mpl::Level::info, category,
+                     fmt::format("Source image {} is no longer valid. Removing it from the cache.",
+                                 entry.absoluteFilePath()));
+            delete_image_dir(entry.absoluteFilePath());
+        }
     }
 
-    for (const auto& key : keys_to_update)
+    for (const auto& key : expired_keys)
+        prepared_image_records.erase(key);
+
+    persist_image_records();
+}
+
+void mp::DefaultVMImageVault::update_images(const FetchType& fetch_type, const PrepareAction& prepare,
+                                            const ProgressMonitor& monitor)
+{
+    mpl::log(mpl::Level::debug, category, "Checking for images to update…");
+
+    std::vector<std::pair<VaultRecord, std::string>> records_to_update;
+    {
+        std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+        for (const auto& record : prepared_image_records)
+        {
+            if (record.second.query.query_type == Query::Type::Alias &&
+                record.second.query.remote_name != mp::baked_remote_name &&
+                record.first.compare(0, record.second.query.release.length(), record.second.query.release) != 0)
+                records_to_update.emplace_back(record.second, record.first);
+        }
+    }
+
+    // The images that were launched most recently are the likeliest to be launched again, so they go first
+    std::sort(records_to_update.begin(), records_to_update.end(), [](const auto& a, const auto& b) {
+        return a.first.last_accessed > b.first.last_accessed;
+    });
+
+    for (const auto& [record, key] : records_to_update)
     {
-        const auto& record = prepared_image_records[key];
-        mpl::log(mpl::Level::info, category, fmt::format("Updating {} source image to latest", record.query.release));
         try
         {
-            fetch_image(fetch_type, record.query, prepare, monitor);
+            const auto info = info_for(record.query);
+            if (info.id.toStdString() == key)
+                continue;
+
+            mpl::log(mpl::Level::info, category,
+                     fmt::format("Updating {} source image to latest", record.query.release));
+
+            // Most of the new image is in the old one, so the download can start from there
+            auto forget_seed = [this, id = info.id.toStdString()] {
+                std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+                update_seeds.erase(id);
+            };
+            {
+                std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+                update_seeds[info.id.toStdString()] = record.image.image_path;
+            }
+            try
+            {
+                fetch_image(fetch_type, record.query, prepare, monitor);
+            }
+            catch (...)
+            {
+                forget_seed();
+                throw;
+            }
+            forget_seed();
 
-            // Remove old image
+            // Replace the old image in one go, so launches find either one or the other. The new image was not
+            // launched yet, so it inherits the old one's last access, lest updates keep stale images from expiring.
             std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+            auto updated = prepared_image_records.find(info.id.toStdString());
+            if (updated != prepared_image_records.end())
+                updated->second.last_accessed = record.last_accessed;
+
             delete_image_dir(record.image.image_path);
             prepared_image_records.erase(key);
             persist_image_records();
         }
+        catch (const mp::UnsupportedImageException& e)
+        {
+            mpl::log(mpl::Level::warning, category, fmt::format("Skipping update: {}", e.what()));
+        }
         catch (const CreateImageException& e)
         {
             mpl::log(mpl::Level::warning, category,
@@ -572,6 +1296,27 @@ mp::MemorySize mp::DefaultVMImageVault::minimum_image_size_for(const std::string
     throw std::runtime_error(fmt::format("Cannot determine minimum image size for id \'{}\'", id));
 }
 
+std::vector<std::string> mp::DefaultVMImageVault::cached_images()
+{
+    std::vector<std::string> images;
+    std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+
+    for (const auto& record : prepared_image_records)
+    {
+        const auto& query = record.second.query;
+        if (query.query_type != Query::Type::Alias)
+            continue;
+
+        const auto prefix = query.remote_name.empty() ? std::string{} : query.remote_name + ':';
+        images.push_back(prefix + query.release);
+        for (const auto& alias : record.second.image.aliases)
+            if (alias != query.release)
+                images.push_back(prefix + alias);
+    }
+
+    return images;
+}
+
 mp::VMImage mp::DefaultVMImageVault::download_and_prepare_source_image(
     const VMImageInfo& info, mp::optional<VMImage>& existing_source_image, const QDir& image_dir,
     const FetchType& fetch_type, const PrepareAction& prepare, const ProgressMonitor& monitor)
@@ -600,38 +1345,304 @@ mp::VMImage mp::DefaultVMImageVault::download_and_prepare_source_image(
 
     try
     {
-        url_downloader->download_to(info.image_location, source_image.image_path, info.size, LaunchProgress::IMAGE,
-                                    monitor);
+        auto download_image = [this, &info, &monitor, image_path = source_image.image_path] {
+            return download_source_image_from_peers(info, image_path, monitor);
+        };
+
+        if (fetch_type == FetchType::ImageKernelAndInitrd)
+            source_image = fetch_kernel_and_initrd(info, source_image, image_dir, download_image, monitor);
+        else
+            source_image.image_path = download_image();
+
+        auto prepared_image = traced_prepare(prepare, source_image);
+        remove_source_images(source_image, prepared_image);
+        if (MP_SETTINGS.get(mp::compress_images_key) == "true")
+            compress_cached_image(prepared_image.image_path);
+        deduplicate_image_files(prepared_image);
+
+        return prepared_image;
+    }
+    catch (const AbortedDownloadException&)
+    {
+        throw;
+    }
+    catch (const std::exception& e)
+    {
+        throw CreateImageException(e.what());
+    }
+}
+
+// From the best of the mirrors, moving on to the next one when a download fails. What the failed one got through is
+// carried on from there, since every mirror serves the same file
+QString mp::DefaultVMImageVault::download_source_image(const VMImageInfo& info, const QString& image_path,
+                                                       const ProgressMonitor& monitor)
+{
+    const auto candidates = mirror_selector.candidates_for(QUrl{info.image_location});
+    for (auto it = candidates.cbegin();; ++it)
+    {
+        auto mirror_info = info;
+        mirror_info.image_location = it->toString();
 
-        if (info.verify)
+        const auto start = ImageMirrorSelector::Clock::now();
+        try
         {
-            monitor(LaunchProgress::VERIFY, -1);
-            mp::vault::verify_image_download(source_image.image_path, id);
+            auto path = download_image_file(mirror_info, image_path, monitor);
+            mirror_selector.record_download(*it, QFileInfo{path}.size(), ImageMirrorSelector::Clock::now() - start);
+            return path;
         }
+        catch (const AbortedDownloadException&)
+        {
+            throw;
+        }
+        catch (const std::exception& e)
+        {
+            const auto next = std::next(it);
+            if (next == candidates.cend())
+                throw;
 
-        if (fetch_type == FetchType::ImageKernelAndInitrd)
+            mirror_selector.record_failure(*it);
+            mpl::log(mpl::Level::warning, category,
+                     fmt::format("Could not download {}: {} - trying {}", it->toString(), e.what(), next->toString()));
+            url_downloader->hand_over_partial_download(*it, *next, image_path);
+        }
+    }
+}
+
+QString mp::DefaultVMImageVault::download_image_file(const VMImageInfo& info, const QString& image_path,
+                                                     const ProgressMonitor& monitor)
+{
+    if (mp::vault::is_compressed_image(image_path))
+        return download_and_extract_image(info, image_path, monitor);
+
+    if (info.verify)
+    {
+        // The digest is computed while downloading, so there is no need to read the image back from disk
+        const auto image_hash = url_downloader->download_and_hash_to(info.image_location, image_path, info.size,
+                                                                     LaunchProgress::IMAGE, monitor);
+
+        monitor(LaunchProgress::VERIFY, -1);
+        mp::vault::verify_image_hash(image_hash, info.id);
+    }
+    else
+    {
+        url_downloader->download_to(info.image_location, image_path, info.size, LaunchProgress::IMAGE, monitor);
+    }
+
+    return image_path;
+}
+
+QString mp::DefaultVMImageVault::download_source_image_from_peers(const VMImageInfo& info, const QString& image_path,
+                                                                  const ProgressMonitor& monitor)
+{
+    // Peers are only trusted with images that can be verified against the manifest hash
+    if (info.verify)
+    {
+        for (const auto& peer : image_cache_peers())
+        {
+            auto peer_info = info;
+            peer_info.image_location = peer_image_location(peer, info);
+
+            try
+            {
+                auto path = download_source_image(peer_info, image_path, monitor);
+                mpl::log(mpl::Level::info, category,
+                         fmt::format("Fetched image {} from peer {}", info.id, peer_info.image_location));
+                return path;
+            }
+            catch (const AbortedDownloadException&)
+            {
+                throw;
+            }
+            catch (const std::exception& e)
+            {
+                mpl::log(mpl::Level::debug, category,
+                         fmt::format("Could not fetch image {} from peer {}: {}", info.id, peer, e.what()));
+                QFile::remove(image_path);
+            }
+        }
+    }
+
+    auto path = download_image_delta(info, image_path, monitor);
+    return path.isEmpty() ? download_source_image(info, image_path, monitor) : path;
+}
+
+// Puts the image together from the blocks that the image it updates shares with it, as zsync finds them, and byte
+// ranges of the image for the rest. Returns an empty path when there is nothing to start from or when it does not
+// pay off, for the whole image to be downloaded instead.
+QString mp::DefaultVMImageVault::download_image_delta(const VMImageInfo& info, const QString& image_path,
+                                                      const ProgressMonitor& monitor)
+{
+    QString seed_path;
+    {
+        std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+        auto seed = update_seeds.find(info.id.toStdString());
+        if (seed != update_seeds.end())
+            seed_path = seed->second;
+    }
+
+    // Only an image that is verified in the end can be trusted to be put together from pieces
+    if (seed_path.isEmpty() || !info.verify || mp::vault::is_compressed_image(image_path) || !QFile::exists(seed_path))
+        return {};
+
+    try
+    {
+        const QUrl image_url{info.image_location};
+        const auto control = zsync::parse(url_downloader->download(QUrl{info.image_location + ".zsync"}));
+        if (info.size > 0 && control.length != info.size)
+            throw std::runtime_error(
+                fmt::format("zsync control file for {} bytes instead of {}", control.length, info.size));
+
+        const auto sources = zsync::match(control, seed_path);
+        const auto block_count = control.block_count();
+        const auto block_size = static_cast<qint64>(control.block_size);
+        auto block_end = [&control, block_size](qint64 block) {
+            return std::min(block * block_size, control.length);
+        };
+
+        // Missing blocks close to one another are fetched together, lest each request cost more than what it saves,
+        // up to as much as is fine to hold in memory at once
+        const auto max_gap_blocks = std::max<qint64>(1, max_delta_gap / block_size);
+        const auto max_range_blocks = std::max<qint64>(1, max_delta_range / block_size);
+        std::vector<std::pair<qint64, qint64>> ranges; // of blocks, end exclusive
+        for (qint64 block = 0; block < block_count; ++block)
         {
-            source_image = fetch_kernel_and_initrd(info, source_image, image_dir, monitor);
+            if (sources[block] >= 0)
+                continue;
+
+            if (!ranges.empty() && block - ranges.back().second < max_gap_blocks &&
+                block + 1 - ranges.back().first <= max_range_blocks)
+                ranges.back().second = block + 1;
+            else
+                ranges.emplace_back(block, block + 1);
         }
 
-        if (source_image.image_path.endsWith(".xz"))
+        qint64 fetched{0};
+        for (const auto& range : ranges)
+            fetched += block_end(range.second) - block_end(range.first);
+
+        if (fetched > max_delta_ratio * control.length)
         {
-            source_image.image_path = mp::vault::extract_image(source_image.image_path, monitor, true);
+            mpl::log(mpl::Level::debug, category,
+                     fmt::format("Image {} shares too little with {} for a delta update", info.id, seed_path));
+            return {};
         }
 
-        auto prepared_image = prepare(source_image);
-        remove_source_images(source_image, prepared_image);
+        QFile seed{seed_path};
+        QFile image{image_path};
+        if (!seed.open(QIODevice::ReadOnly) || !image.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            throw std::runtime_error(fmt::format("cannot open {} or {}", seed_path, image_path));
 
-        return prepared_image;
+        Sha256 hash;
+        auto write = [&](const QByteArray& data) {
+            if (image.write(data) != data.size())
+                throw std::runtime_error(fmt::format("cannot write {}", image_path));
+
+            hash.add_data(data);
+            if (!monitor(LaunchProgress::IMAGE, static_cast<int>(image.pos() * 100 / control.length)))
+                throw AbortedDownloadException{"Download aborted"};
+        };
+
+        auto range = ranges.cbegin();
+        for (qint64 block = 0; block < block_count;)
+        {
+            if (range != ranges.cend() && range->first == block)
+            {
+                write(url_downloader->download_range(image_url, block_end(range->first), block_end(range->second)));
+                block = (range++)->second;
+                continue;
+            }
+
+            const auto size = block_end(block + 1) - block_end(block);
+            if (!seed.seek(sources[block]))
+                throw std::runtime_error(fmt::format("cannot read {}", seed_path));
+
+            const auto data = seed.read(size);
+            if (data.size() != size)
+                throw std::runtime_error(fmt::format("cannot read {}", seed_path));
+
+            write(data);
+            ++block;
+        }
+        image.close();
+
+        monitor(LaunchProgress::VERIFY, -1);
+        mp::vault::verify_image_hash(hash.result().toHex(), info.id);
+
+        mpl::log(mpl::Level::info, category,
+                 fmt::format("Updated image {} from {}, downloading {} of its {} bytes", info.id, seed_path, fetched,
+                             control.length));
+        MP_INSTRUMENTATION.add("multipass_image_delta_saved_bytes", "", control.length - fetched);
+
+        return image_path;
     }
     catch (const AbortedDownloadException&)
     {
+        QFile::remove(image_path);
         throw;
     }
     catch (const std::exception& e)
     {
-        throw CreateImageException(e.what());
+        mpl::log(mpl::Level::warning, category,
+                 fmt::format("Cannot update image {} from {}: {} - downloading all of it", info.id, seed_path,
+                             e.what()));
+        QFile::remove(image_path);
+        return {};
+    }
+}
+
+QString mp::DefaultVMImageVault::download_and_extract_image(const VMImageInfo& info,
+                                                            const QString& compressed_image_path,
+                                                            const ProgressMonitor& monitor)
+{
+    const auto image_path = mp::vault::decompressed_path(compressed_image_path);
+
+    mp::vault::DeleteOnException image_file{image_path};
+
+    // The image is decoded while it downloads, so only the decompressed image is written to disk. Corrupt data stops
+    // the download, and what went wrong with the data is reported over the download being cut short
+    auto download_and_decode = [this, &info, &monitor](auto& decoder) {
+        QString image_hash;
+        try
+        {
+            image_hash = url_downloader->stream_and_hash(
+                info.image_location, [&decoder](const QByteArray& data) { return decoder.write(data); }, info.size,
+                LaunchProgress::IMAGE, monitor);
+        }
+        catch (const AbortedDownloadException&)
+        {
+            throw;
+        }
+        catch (const std::exception&)
+        {
+            decoder.finish();
+            throw;
+        }
+
+        monitor(LaunchProgress::EXTRACT, -1);
+        decoder.finish();
+
+        return image_hash;
+    };
+
+    QString image_hash;
+    if (compressed_image_path.endsWith(".zst"))
+    {
+        ZstdStreamDecoder zstd_decoder{image_path};
+        image_hash = download_and_decode(zstd_decoder);
     }
+    else
+    {
+        XzStreamDecoder xz_decoder{image_path};
+        image_hash = download_and_decode(xz_decoder);
+    }
+
+    if (info.verify)
+    {
+        monitor(LaunchProgress::VERIFY, -1);
+        mp::vault::verify_image_hash(image_hash, info.id);
+    }
+
+    return image_path;
 }
 
 QString mp::DefaultVMImageVault::extract_image_from(const std::string& instance_name, const VMImage& source_image,
@@ -640,7 +1651,7 @@ QString mp::DefaultVMImageVault::extract_image_from(const std::string& instance_
     const auto name = QString::fromStdString(instance_name);
     const QDir output_dir{mp::utils::make_dir(instances_dir, name)};
     QFileInfo file_info{source_image.image_path};
-    const auto image_name = file_info.fileName().remove(".xz");
+    const auto image_name = mp::vault::decompressed_path(file_info.fileName());
     const auto image_path = output_dir.filePath(image_name);
 
     return mp::vault::extract_image(image_path, monitor);
@@ -652,9 +1663,9 @@ mp::VMImage mp::DefaultVMImageVault::image_instance_from(const std::string& inst
     auto name = QString::fromStdString(instance_name);
     auto output_dir = mp::utils::make_dir(instances_dir, name);
 
-    return {mp::vault::copy(prepared_image.image_path, output_dir),
-            mp::vault::copy(prepared_image.kernel_path, output_dir),
-            mp::vault::copy(prepared_image.initrd_path, output_dir),
+    return {clone_or_copy(prepared_image.image_path, output_dir),
+            clone_or_copy(prepared_image.kernel_path, output_dir),
+            clone_or_copy(prepared_image.initrd_path, output_dir),
             prepared_image.id,
             prepared_image.original_release,
             prepared_image.current_release,
@@ -662,8 +1673,61 @@ mp::VMImage mp::DefaultVMImageVault::image_instance_from(const std::string& inst
             {}};
 }
 
+// An overlay whose backing file is the remote image itself, which qemu reads through its curl driver
+mp::VMImage mp::DefaultVMImageVault::remote_image_instance_from(const std::string& instance_name,
+                                                                const VMImageInfo& info)
+{
+    const QDir output_dir{mp::utils::make_dir(instances_dir, QString::fromStdString(instance_name))};
+    const auto image_path = output_dir.filePath(mp::vault::filename_for(info.image_location));
+
+    auto qemuimg_process = mp::platform::make_process(std::make_unique<mp::QemuImgProcessSpec>(
+        QStringList{"create", "-f", "qcow2", "-F", "qcow2", "-b", info.image_location, image_path},
+        info.image_location, image_path));
+    auto process_state = qemuimg_process->execute();
+
+    if (!process_state.completed_successfully())
+    {
+        throw std::runtime_error(fmt::format("Cannot create instance image on remote image: qemu-img failed ({}) with "
+                                             "output:\n{}",
+                                             process_state.failure_message(),
+                                             qemuimg_process->read_all_standard_error()));
+    }
+
+    VMImage image;
+    image.image_path = image_path;
+    image.id = info.id.toStdString();
+    image.original_release = info.release_title.toStdString();
+    image.release_date = info.version.toStdString();
+
+    return image;
+}
+
+// Must be called with fetch_mutex held
+void mp::DefaultVMImageVault::complete_fetch_in_background(const InProgressFetch& fetch, const std::string& id,
+                                                           const Query& query)
+{
+    // The fetch is recorded as a prepared image only, the instance already has its own
+    Query prepared_query{query};
+    prepared_query.name = "";
+
+    background_fetches.addFuture(QtConcurrent::run([this, fetch, id, prepared_query] {
+        try
+        {
+            wait_for_fetch(fetch, id, prepared_query, background_monitor);
+            mpl::log(mpl::Level::info, category, fmt::format("Image {} is now cached and verified", id));
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::warning, category, fmt::format("Could not fetch image {}: {}", id, e.what()));
+        }
+    }));
+}
+
+// The kernel and initrd download alongside the image, each in a thread of its own, rather than after it
 mp::VMImage mp::DefaultVMImageVault::fetch_kernel_and_initrd(const VMImageInfo& info, const VMImage& source_image,
-                                                             const QDir& image_dir, const ProgressMonitor& monitor)
+                                                             const QDir& image_dir,
+                                                             const std::function<QString()>& download_image,
+                                                             const ProgressMonitor& monitor)
 {
     auto image{source_image};
 
@@ -671,21 +1735,126 @@ mp::VMImage mp::DefaultVMImageVault::fetch_kernel_and_initrd(const VMImageInfo&
     image.initrd_path = image_dir.filePath(mp::vault::filename_for(info.initrd_location));
     mp::vault::DeleteOnException kernel_file{image.kernel_path};
     mp::vault::DeleteOnException initrd_file{image.initrd_path};
-    url_downloader->download_to(info.kernel_location, image.kernel_path, -1, LaunchProgress::KERNEL, monitor);
-    url_downloader->download_to(info.initrd_location, image.initrd_path, -1, LaunchProgress::INITRD, monitor);
+
+    // A pool of their own, as these threads would never finish in a global pool full of fetches waiting for them
+    auto download = [this, &monitor, priority = DownloadScheduler::current_priority()](
+                        const QString& location, const QString& path, int download_type) {
+        return QtConcurrent::run(&kernel_download_pool, [=, &monitor]() -> std::exception_ptr {
+            DownloadScheduler::PriorityScope priority_scope{priority};
+            try
+            {
+                url_downloader->download_to(location, path, -1, download_type, monitor);
+                return nullptr;
+            }
+            catch (...)
+            {
+                return std::current_exception();
+            }
+        });
+    };
+
+    auto kernel_download = download(info.kernel_location, image.kernel_path, LaunchProgress::KERNEL);
+    auto initrd_download = download(info.initrd_location, image.initrd_path, LaunchProgress::INITRD);
+
+    // Whatever happens to the image, the other downloads refer to the monitor and must be waited for
+    std::exception_ptr error;
+    try
+    {
+        image.image_path = download_image();
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    for (auto* other_download : {&kernel_download, &initrd_download})
+        if (auto other_error = other_download->result(); other_error && !error)
+            error = other_error;
+
+    if (error)
+        std::rethrow_exception(error);
 
     return image;
 }
 
-mp::optional<QFuture<mp::VMImage>> mp::DefaultVMImageVault::get_image_future(const std::string& id)
+// Must be called with fetch_mutex held
+mp::DefaultVMImageVault::InProgressFetch mp::DefaultVMImageVault::join_or_start_fetch(
+    const std::string& id, const std::function<QFuture<VMImage>(const ProgressMonitor&)>& start_fetch,
+    const ProgressMonitor& monitor)
 {
     auto it = in_progress_image_fetches.find(id);
     if (it != in_progress_image_fetches.end())
     {
+        monitor(LaunchProgress::WAITING, -1);
+        it->second.progress->add(&monitor);
         return it->second;
     }
 
-    return mp::nullopt;
+    auto progress = std::make_shared<FetchProgress>();
+    progress->add(&monitor);
+
+    auto future = start_fetch([progress](int download_type, int percentage) {
+        return (*progress)(download_type, percentage);
+    });
+
+    return in_progress_image_fetches[id] = InProgressFetch{future, progress};
+}
+
+mp::VMImage mp::DefaultVMImageVault::wait_for_fetch(const InProgressFetch& fetch, const std::string& id,
+                                                    const Query& query, const ProgressMonitor& monitor)
+{
+    auto forget_fetch = [this, &fetch, &id] {
+        auto it = in_progress_image_fetches.find(id);
+        if (it != in_progress_image_fetches.end() && it->second.future == fetch.future)
+            in_progress_image_fetches.erase(it);
+    };
+
+    try
+    {
+        auto prepared_image = fetch.future.result();
+        fetch.progress->remove(&monitor);
+
+        std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+        forget_fetch();
+        return finalize_image_records(query, prepared_image, id);
+    }
+    catch (const AbortedDownloadException&)
+    {
+        fetch.progress->remove(&monitor);
+        throw;
+    }
+    catch (const std::exception& e)
+    {
+        fetch.progress->remove(&monitor);
+
+        std::lock_guard<decltype(fetch_mutex)> lock{fetch_mutex};
+        forget_fetch();
+        throw;
+    }
+}
+
+void mp::DefaultVMImageVault::FetchProgress::add(const ProgressMonitor* monitor)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    monitors.push_back(monitor);
+}
+
+void mp::DefaultVMImageVault::FetchProgress::remove(const ProgressMonitor* monitor)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    monitors.erase(std::remove(monitors.begin(), monitors.end(), monitor), monitors.end());
+}
+
+bool mp::DefaultVMImageVault::FetchProgress::operator()(int download_type, int progress)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+
+    // Keep going for as long as anyone still wants the image
+    auto keep_going = monitors.empty();
+    for (const auto monitor : monitors)
+        keep_going = (*monitor)(download_type, progress) || keep_going;
+
+    return keep_going;
 }
 
 mp::VMImage mp::DefaultVMImageVault::finalize_image_records(const Query& query, const VMImage& prepared_image,
@@ -704,12 +1873,69 @@ mp::VMImage mp::DefaultVMImageVault::finalize_image_records(const Query& query,
     prepared_query.name = "";
     prepared_image_records[id] = {prepared_image, prepared_query, std::chrono::system_clock::now()};
 
-    persist_instance_records();
-    persist_image_records();
+    // Used again, so back to fast storage, for the next instance to be copied from there
+    const auto bulk_dir = bulk_images_dir(backend_directory_name);
+    if (bulk_dir && is_in(*bulk_dir, prepared_image.image_path))
+        move_image_in_background(id, images_dir);
+
+    // A fetched image is expensive to come by again, so its records are committed for good
+    persist_instance_records(WriteDurability::synced);
+    evict_least_recently_used_images(id);
+    persist_image_records(WriteDurability::synced);
 
     return vm_image;
 }
 
+// Must be called with fetch_mutex held
+void mp::DefaultVMImageVault::evict_least_recently_used_images(const std::string& keep_id)
+{
+    const auto limit = image_cache_size_limit();
+    if (!limit)
+        return;
+
+    // With bulk storage, the limit is that of the cache on fast storage, which images over it move out of
+    const auto bulk_dir = bulk_images_dir(backend_directory_name);
+
+    qint64 cache_size{0};
+    std::vector<std::pair<std::chrono::system_clock::time_point, std::string>> candidates;
+    for (const auto& record : prepared_image_records)
+    {
+        if (bulk_dir && !is_in(images_dir, record.second.image.image_path))
+            continue;
+
+        cache_size += disk_size_of(record.second.image);
+
+        // Instances have their own copies, so only images that are being fetched or were asked to be kept are needed
+        if (record.first != keep_id && !record.second.query.persistent &&
+            in_progress_image_fetches.find(record.first) == in_progress_image_fetches.end())
+            candidates.emplace_back(record.second.last_accessed, record.first);
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+    for (auto it = candidates.cbegin(); it != candidates.cend() && cache_size > *limit; ++it)
+    {
+        const auto& record = prepared_image_records.at(it->second);
+        cache_size -= disk_size_of(record.image);
+
+        if (bulk_dir)
+        {
+            mpl::log(mpl::Level::info, category,
+                     fmt::format("Image cache is over its {} byte limit. Moving least recently used source image {} "
+                                 "to bulk storage.",
+                                 *limit, record.query.release));
+            move_image_in_background(it->second, *bulk_dir);
+            continue;
+        }
+
+        mpl::log(mpl::Level::info, category,
+                 fmt::format("Image cache is over its {} byte limit. Removing least recently used source image {}.",
+                             *limit, record.query.release));
+
+        delete_image_dir(record.image.image_path);
+        prepared_image_records.erase(it->second);
+    }
+}
+
 mp::VMImageInfo mp::DefaultVMImageVault::get_kernel_query_info(const std::string& name)
 {
     Query kernel_query{name, "default", false, "", Query::Type::Alias};
@@ -719,7 +1945,7 @@ mp::VMImageInfo mp::DefaultVMImageVault::get_kernel_query_info(const std::string
 namespace
 {
 template <typename T>
-void persist_records(const T& records, const QString& path)
+void persist_records(const T& records, mp::JsonJournal& journal, mp::WriteDurability durability)
 {
     QJsonObject json_records;
     for (const auto& record : records)
@@ -727,16 +1953,149 @@ void persist_records(const T& records, const QString& path)
         auto key = QString::fromStdString(record.first);
         json_records.insert(key, record_to_json(record.second));
     }
-    mp::write_json(json_records, path);
+    journal.update(json_records, durability);
 }
 } // namespace
 
-void mp::DefaultVMImageVault::persist_instance_records()
+// Hashing a large custom image takes a while, so it is only done again when the file looks different
+QString mp::DefaultVMImageVault::local_image_hash(const QString& image_path)
+{
+    const auto identity = MP_PLATFORM.file_identity(QFile::encodeName(image_path).constData());
+    if (identity.empty())
+        return mp::vault::compute_image_hash(image_path);
+
+    {
+        std::lock_guard<decltype(hash_cache_mutex)> lock{hash_cache_mutex};
+        auto entry = local_image_hashes.find(identity);
+        if (entry != local_image_hashes.end() && entry->second.path == image_path)
+        {
+            revalidate_local_image_hash(identity, image_path);
+            return entry->second.hash;
+        }
+    }
+
+    const auto hash = mp::vault::compute_image_hash(image_path);
+
+    std::lock_guard<decltype(hash_cache_mutex)> lock{hash_cache_mutex};
+    local_image_hashes[identity] = {image_path, hash};
+    revalidated_image_hashes.insert(identity);
+    persist_local_image_hashes();
+
+    return hash;
+}
+
+// Must be called with hash_cache_mutex held
+void mp::DefaultVMImageVault::revalidate_local_image_hash(const std::string& identity, const QString& image_path)
+{
+    // Once per daemon run is enough to catch files rewritten with their old metadata
+    if (!revalidated_image_hashes.insert(identity).second)
+        return;
+
+    hash_revalidations.addFuture(QtConcurrent::run([this, identity, image_path] {
+        const auto hash = hash_file(image_path, stop_revalidating);
+        if (hash.isEmpty())
+            return;
+
+        std::lock_guard<decltype(hash_cache_mutex)> lock{hash_cache_mutex};
+        auto entry = local_image_hashes.find(identity);
+        if (entry == local_image_hashes.end() || entry->second.hash == hash)
+            return;
+
+        mpl::log(mpl::Level::warning, category,
+                 fmt::format("Image `{}` changed without changing its metadata, updating its hash", image_path));
+        entry->second.hash = hash;
+        persist_local_image_hashes();
+    }));
+}
+
+// Kernels, initrds and images are often identical across versions and remotes, so keep a single copy of each. That
+// means reading them all through, so it happens in the background rather than holding up the launch that fetched them
+void mp::DefaultVMImageVault::deduplicate_image_files(const VMImage& image)
+{
+    std::lock_guard<decltype(hash_cache_mutex)> lock{hash_cache_mutex};
+    hash_revalidations.addFuture(QtConcurrent::run([this, image] {
+        for (const auto& path : {image.image_path, image.kernel_path, image.initrd_path})
+            deduplicate_image_file(path);
+    }));
+}
+
+void mp::DefaultVMImageVault::deduplicate_image_file(const QString& path)
+{
+    if (path.isEmpty())
+        return;
+
+    const auto identity = MP_PLATFORM.file_identity(QFile::encodeName(path).constData());
+    const auto hash = identity.empty() ? QString{} : hash_file(path, stop_revalidating);
+    if (hash.isEmpty())
+        return;
+
+    std::lock_guard<decltype(hash_cache_mutex)> lock{hash_cache_mutex};
+
+    // Only link to files the vault owns, which are never written to once prepared
+    const auto images_path = images_dir.absolutePath() + '/';
+    auto duplicate = std::find_if(local_image_hashes.cbegin(), local_image_hashes.cend(), [&](const auto& entry) {
+        return entry.first != identity && entry.second.hash == hash && entry.second.path.startsWith(images_path) &&
+               MP_PLATFORM.file_identity(QFile::encodeName(entry.second.path).constData()) == entry.first;
+    });
+
+    if (duplicate != local_image_hashes.cend() && replace_with_link(duplicate->second.path, path))
+    {
+        mpl::log(mpl::Level::debug, category,
+                 fmt::format("Deduplicated `{}` with `{}`", path, duplicate->second.path));
+        return;
+    }
+
+    local_image_hashes[identity] = {path, hash};
+    revalidated_image_hashes.insert(identity);
+    persist_local_image_hashes();
+}
+
+// Must be called with hash_cache_mutex held
+void mp::DefaultVMImageVault::persist_local_image_hashes()
 {
-    persist_records(instance_image_records, data_dir.filePath(instance_db_name));
+    QJsonObject json_hashes;
+    for (auto it = local_image_hashes.begin(); it != local_image_hashes.end();)
+    {
+        // Forget images that were changed or removed since they were hashed
+        if (MP_PLATFORM.file_identity(QFile::encodeName(it->second.path).constData()) != it->first)
+        {
+            it = local_image_hashes.erase(it);
+            continue;
+        }
+
+        QJsonObject entry;
+        entry.insert("path", it->second.path);
+        entry.insert("hash", it->second.hash);
+        json_hashes.insert(QString::fromStdString(it->first), entry);
+        ++it;
+    }
+
+    QDir{}.mkpath(cache_dir.path());
+    mp::write_json(json_hashes, cache_dir.filePath(hash_cache_name));
+}
+
+void mp::DefaultVMImageVault::persist_instance_records(WriteDurability durability)
+{
+    // Ephemeral instances are left out, their directories are marked instead, for a daemon that goes down before
+    // purging them to find what to throw away the next time
+    std::unordered_map<std::string, VaultRecord> kept_records;
+    for (const auto& record : instance_image_records)
+    {
+        if (!record.second.query.ephemeral)
+        {
+            kept_records.insert(record);
+            continue;
+        }
+
+        const QDir instance_dir{instances_dir.filePath(QString::fromStdString(record.first))};
+        if (instance_dir.exists() && !instance_dir.exists(ephemeral_marker_name))
+            QFile{instance_dir.filePath(ephemeral_marker_name)}.open(QIODevice::WriteOnly);
+    }
+
+    persist_records(kept_records, instance_records_journal, durability);
 }
 
-void mp::DefaultVMImageVault::persist_image_records()
+void mp::DefaultVMImageVault::persist_image_records(WriteDurability durability)
 {
-    persist_records(prepared_image_records, cache_dir.filePath(image_db_name));
+    persist_records(prepared_image_records, image_records_journal, durability);
 }
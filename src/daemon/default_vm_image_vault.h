@@ -18,6 +18,9 @@
 #ifndef MULTIPASS_DEFAULT_VM_IMAGE_VAULT_H
 #define MULTIPASS_DEFAULT_VM_IMAGE_VAULT_H
 
+#include "image_mirror_selector.h"
+#include "json_journal.h"
+
 #include <multipass/days.h>
 #include <multipass/optional.h>
 #include <multipass/query.h>
@@ -27,9 +30,17 @@
 
 #include <QDir>
 #include <QFuture>
+#include <QFutureSynchronizer>
+#include <QThreadPool>
 
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <set>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace multipass
 {
@@ -45,45 +56,125 @@ public:
 class DefaultVMImageVault final : public BaseVMImageVault
 {
 public:
+    // With remote_backing_files, for backends that can run an instance off an image they read over http(s),
+    // instances can be launched from images that are not fetched yet, as local.lazy-boot asks
     DefaultVMImageVault(std::vector<VMImageHost*> image_host, URLDownloader* downloader, multipass::Path cache_dir_path,
-                        multipass::Path data_dir_path, multipass::days days_to_expire);
+                        multipass::Path data_dir_path, multipass::days days_to_expire,
+                        bool remote_backing_files = false);
     ~DefaultVMImageVault();
 
     VMImage fetch_image(const FetchType& fetch_type, const Query& query, const PrepareAction& prepare,
                         const ProgressMonitor& monitor) override;
     void remove(const std::string& name) override;
     bool has_record_for(const std::string& name) override;
+    VMImage rename(const std::string& from, const std::string& to) override;
+    VMImage bake(const std::string& instance_name, const std::string& image_name) override;
+    VMImage clone(const std::string& source_name, const std::string& destination_name) override;
+    VMImage clone_layered(const std::string& source_name, const std::string& destination_name) override;
     void prune_expired_images() override;
     void update_images(const FetchType& fetch_type, const PrepareAction& prepare,
                        const ProgressMonitor& monitor) override;
     MemorySize minimum_image_size_for(const std::string& id) override;
+    std::vector<std::string> cached_images() override;
 
 private:
+    // Relays the progress of an in-progress fetch to every launch waiting on it
+    class FetchProgress
+    {
+    public:
+        void add(const ProgressMonitor* monitor);
+        void remove(const ProgressMonitor* monitor);
+        bool operator()(int download_type, int progress);
+
+    private:
+        std::mutex mutex;
+        std::vector<const ProgressMonitor*> monitors;
+    };
+
+    struct InProgressFetch
+    {
+        QFuture<VMImage> future;
+        std::shared_ptr<FetchProgress> progress;
+    };
+
+    struct LocalImageHash
+    {
+        QString path;
+        QString hash;
+    };
+
     VMImage image_instance_from(const std::string& name, const VMImage& prepared_image);
+    VMImage remote_image_instance_from(const std::string& name, const VMImageInfo& info);
     VMImage download_and_prepare_source_image(const VMImageInfo& info, optional<VMImage>& existing_source_image,
                                               const QDir& image_dir, const FetchType& fetch_type,
                                               const PrepareAction& prepare, const ProgressMonitor& monitor);
+    QString download_source_image(const VMImageInfo& info, const QString& image_path, const ProgressMonitor& monitor);
+    QString download_image_file(const VMImageInfo& info, const QString& image_path, const ProgressMonitor& monitor);
+    QString download_source_image_from_peers(const VMImageInfo& info, const QString& image_path,
+                                             const ProgressMonitor& monitor);
+    QString download_image_delta(const VMImageInfo& info, const QString& image_path, const ProgressMonitor& monitor);
+    QString download_and_extract_image(const VMImageInfo& info, const QString& compressed_image_path,
+                                       const ProgressMonitor& monitor);
     QString extract_image_from(const std::string& instance_name, const VMImage& source_image,
                                const ProgressMonitor& monitor);
     VMImage fetch_kernel_and_initrd(const VMImageInfo& info, const VMImage& source_image, const QDir& image_dir,
-                                    const ProgressMonitor& monitor);
-    optional<QFuture<VMImage>> get_image_future(const std::string& id);
+                                    const std::function<QString()>& download_image, const ProgressMonitor& monitor);
+    InProgressFetch join_or_start_fetch(const std::string& id,
+                                        const std::function<QFuture<VMImage>(const ProgressMonitor&)>& start_fetch,
+                                        const ProgressMonitor& monitor);
+    VMImage wait_for_fetch(const InProgressFetch& fetch, const std::string& id, const Query& query,
+                           const ProgressMonitor& monitor);
+    void complete_fetch_in_background(const InProgressFetch& fetch, const std::string& id, const Query& query);
     VMImage finalize_image_records(const Query& query, const VMImage& prepared_image, const std::string& id);
+    void evict_least_recently_used_images(const std::string& keep_id);
     VMImageInfo get_kernel_query_info(const std::string& name);
-    void persist_image_records();
-    void persist_instance_records();
+    void persist_image_records(WriteDurability durability = WriteDurability::relaxed);
+    void persist_instance_records(WriteDurability durability = WriteDurability::relaxed);
+    QString local_image_hash(const QString& image_path);
+    void revalidate_local_image_hash(const std::string& identity, const QString& image_path);
+    void persist_local_image_hashes();
+    void deduplicate_image_files(const VMImage& image);
+    void deduplicate_image_file(const QString& path);
+    void reclaim_in_background(const QString& path);
+    void reclaim_instance_directory(const QString& name);
+    void move_image_in_background(const std::string& id, const QDir& destination);
 
     URLDownloader* const url_downloader;
     const QDir cache_dir;
     const QDir data_dir;
     const QDir instances_dir;
     const QDir images_dir;
+    const QString backend_directory_name; // of the images in bulk storage, when local.image-bulk-storage is set
     const days days_to_expire;
+    const bool remote_backing_files;
+    ImageMirrorSelector mirror_selector;
     std::mutex fetch_mutex;
 
+    JsonJournal image_records_journal;
+    JsonJournal instance_records_journal;
     std::unordered_map<std::string, VaultRecord> prepared_image_records;
     std::unordered_map<std::string, VaultRecord> instance_image_records;
-    std::unordered_map<std::string, QFuture<VMImage>> in_progress_image_fetches;
+    std::unordered_map<std::string, InProgressFetch> in_progress_image_fetches;
+    std::unordered_map<std::string, QString> update_seeds; // image id -> path of the image it updates
+    QThreadPool kernel_download_pool;
+
+    std::mutex hash_cache_mutex;
+    std::unordered_map<std::string, LocalImageHash> local_image_hashes;
+    std::unordered_set<std::string> revalidated_image_hashes;
+    std::atomic_bool stop_revalidating{false};
+    QFutureSynchronizer<void> hash_revalidations;
+
+    QThreadPool reclaim_pool;
+    std::atomic_bool stop_reclaiming{false};
+    QFutureSynchronizer<void> reclamations; // of removed instance directories, waited for before the pool goes
+
+    QThreadPool tier_pool;
+    std::atomic_bool stop_moving_images{false};
+    std::set<QString> moving_images_to; // image directories being copied into, guarded by fetch_mutex
+    QFutureSynchronizer<void> image_moves;        // of images between fast and bulk storage
+
+    const ProgressMonitor background_monitor{[](int, int) { return true; }};
+    QFutureSynchronizer<void> background_fetches; // of images that instances were launched from before they arrived
 };
 }
 #endif // MULTIPASS_DEFAULT_VM_IMAGE_VAULT_H
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "image_manifest_cache.h"
+
+#include <multipass/format.h>
+#include <multipass/logging/log.h>
+
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+
+namespace
+{
+constexpr auto category = "manifest cache";
+constexpr quint32 cache_magic = 0x4d504d43; // "MPMC"
+constexpr quint32 cache_version = 1;
+constexpr auto stream_version = QDataStream::Qt_5_6;
+
+QDataStream& operator<<(QDataStream& stream, const mp::VMImageInfo& info)
+{
+    return stream << info.aliases << info.os << info.release << info.release_title << info.supported
+                  << info.image_location << info.kernel_location << info.initrd_location << info.id
+                  << info.stream_location << info.version << static_cast<qint64>(info.size) << info.verify;
+}
+
+QDataStream& operator>>(QDataStream& stream, mp::VMImageInfo& info)
+{
+    qint64 size;
+    stream >> info.aliases >> info.os >> info.release >> info.release_title >> info.supported >>
+        info.image_location >> info.kernel_location >> info.initrd_location >> info.id >> info.stream_location >>
+        info.version >> size >> info.verify;
+    info.size = size;
+
+    return stream;
+}
+
+std::vector<mp::CachedManifest> read_manifests(QDataStream& stream)
+{
+    quint32 magic, version, manifest_count;
+    stream >> magic >> version >> manifest_count;
+    if (stream.status() != QDataStream::Ok || magic != cache_magic || version != cache_version)
+        return {};
+
+    std::vector<mp::CachedManifest> manifests;
+    for (quint32 i = 0; i < manifest_count && stream.status() == QDataStream::Ok; ++i)
+    {
+        QString remote;
+        quint32 product_count;
+        mp::CachedManifest manifest;
+        stream >> remote >> manifest.updated_at >> manifest.digest >> product_count;
+        manifest.remote = remote.toStdString();
+
+        for (quint32 j = 0; j < product_count && stream.status() == QDataStream::Ok; ++j)
+        {
+            mp::VMImageInfo info;
+            stream >> info;
+            manifest.products.push_back(std::move(info));
+        }
+
+        manifests.push_back(std::move(manifest));
+    }
+
+    if (stream.status() != QDataStream::Ok)
+        return {};
+
+    return manifests;
+}
+} // namespace
+
+mp::ImageManifestCache::ImageManifestCache(const QString& path) : path{path}
+{
+}
+
+std::vector<mp::CachedManifest> mp::ImageManifestCache::load() const
+{
+    QFile file{path};
+    if (path.isEmpty() || !file.open(QIODevice::ReadOnly) || file.size() == 0)
+        return {};
+
+    // Mapped rather than read, since only the strings are copied out of it
+    const auto data = file.map(0, file.size());
+    if (!data)
+        return {};
+
+    const auto bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(data), static_cast<int>(file.size()));
+    QDataStream stream{bytes};
+    stream.setVersion(stream_version);
+
+    auto manifests = read_manifests(stream);
+    if (manifests.empty())
+        mpl::log(mpl::Level::debug, category, fmt::format("Ignoring {}", path));
+
+    file.unmap(data);
+
+    return manifests;
+}
+
+void mp::ImageManifestCache::save(const std::vector<CachedManifest>& manifests) const
+{
+    if (path.isEmpty())
+        return;
+
+    QSaveFile file{path};
+    if (file.open(QIODevice::WriteOnly))
+    {
+        QDataStream stream{&file};
+        stream.setVersion(stream_version);
+        stream << cache_magic << cache_version << static_cast<quint32>(manifests.size());
+
+        for (const auto& manifest : manifests)
+        {
+            stream << QString::fromStdString(manifest.remote) << manifest.updated_at << manifest.digest
+                   << static_cast<quint32>(manifest.products.size());
+            for (const auto& info : manifest.products)
+                stream << info;
+        }
+
+        if (stream.status() == QDataStream::Ok && file.commit())
+            return;
+    }
+
+    mpl::log(mpl::Level::warning, category, fmt::format("Unable to cache image manifests in {}", path));
+}
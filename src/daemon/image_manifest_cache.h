@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_IMAGE_MANIFEST_CACHE_H
+#define MULTIPASS_IMAGE_MANIFEST_CACHE_H
+
+#include <multipass/vm_image_info.h>
+
+#include <QByteArray>
+#include <QString>
+
+#include <string>
+#include <vector>
+
+namespace multipass
+{
+struct CachedManifest
+{
+    std::string remote;
+    QString updated_at;
+    QByteArray digest; // of the manifest as downloaded, when the host tracks one
+    std::vector<VMImageInfo> products;
+};
+
+// Keeps the products of an image host's manifests in a compact binary file, so that a restarted daemon can find and
+// launch images straight away, and offline, while it revalidates them in the background. An empty path keeps nothing.
+class ImageManifestCache
+{
+public:
+    explicit ImageManifestCache(const QString& path);
+
+    // Nothing when the file is missing, damaged or written by another version
+    std::vector<CachedManifest> load() const;
+    void save(const std::vector<CachedManifest>& manifests) const;
+
+private:
+    const QString path;
+};
+} // namespace multipass
+#endif // MULTIPASS_IMAGE_MANIFEST_CACHE_H
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "image_mirror_selector.h"
+
+#include <multipass/constants.h>
+#include <multipass/format.h>
+#include <multipass/instrumentation.h>
+#include <multipass/logging/log.h>
+#include <multipass/settings.h>
+#include <multipass/url_downloader.h>
+
+#include <QFuture>
+#include <QtConcurrent/QtConcurrent>
+
+#include <algorithm>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+
+namespace
+{
+constexpr auto category = "image mirrors";
+constexpr auto throughput_metric = "multipass_image_mirror_throughput_bytes";
+constexpr auto probe_interval = std::chrono::minutes{10};
+// Small enough to cost nothing, and there on any mirror that carries the releases
+constexpr auto probe_path = "releases/streams/v1/index.json";
+// Smaller downloads are over before a connection gets up to speed
+constexpr qint64 min_sample_bytes = 16 * 1024 * 1024;
+// How much each download counts for against the throughput seen before it
+constexpr auto sample_weight = 0.3;
+
+QString with_trailing_slash(const QString& url)
+{
+    return url.endsWith('/') ? url : url + '/';
+}
+
+QStringList configured_mirrors()
+{
+    QStringList mirrors;
+    for (const auto& mirror : MP_SETTINGS.get(mp::image_mirrors_key).split(',', QString::SkipEmptyParts))
+        mirrors.append(with_trailing_slash(mirror.trimmed()));
+
+    return mirrors;
+}
+
+mp::optional<mp::ImageMirrorSelector::Clock::duration> probe(mp::URLDownloader* downloader, const QString& base)
+{
+    const auto start = mp::ImageMirrorSelector::Clock::now();
+    try
+    {
+        downloader->last_modified(QUrl{base + probe_path});
+        return mp::ImageMirrorSelector::Clock::now() - start;
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::debug, category, fmt::format("Mirror {} is not answering: {}", base, e.what()));
+        return mp::nullopt;
+    }
+}
+} // namespace
+
+mp::ImageMirrorSelector::ImageMirrorSelector(URLDownloader* downloader, const QString& origin)
+    : url_downloader{downloader}, origin{with_trailing_slash(origin)}, mirrors{{this->origin}}
+{
+}
+
+std::vector<QUrl> mp::ImageMirrorSelector::candidates_for(const QUrl& location)
+{
+    const auto url = location.toString();
+    const auto bases = configured_mirrors();
+    if (!url.startsWith(origin) || bases.isEmpty())
+        return {location};
+
+    refresh(bases);
+
+    std::vector<Mirror> ranked;
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        ranked = mirrors;
+    }
+
+    std::stable_sort(ranked.begin(), ranked.end(), [](const Mirror& a, const Mirror& b) {
+        if (a.healthy != b.healthy)
+            return a.healthy;
+
+        // Each mirror gets to serve a download before the throughput it shows is held against it
+        if ((a.throughput > 0) != (b.throughput > 0))
+            return a.throughput <= 0;
+        if (a.throughput > 0)
+            return a.throughput > b.throughput;
+
+        return a.round_trip.value_or(Clock::duration::max()) < b.round_trip.value_or(Clock::duration::max());
+    });
+
+    std::vector<QUrl> candidates;
+    const auto path = url.mid(origin.size());
+    for (const auto& mirror : ranked)
+        candidates.emplace_back(mirror.base + path);
+
+    return candidates;
+}
+
+void mp::ImageMirrorSelector::record_download(const QUrl& url, qint64 bytes, Clock::duration duration)
+{
+    const auto seconds = std::chrono::duration<double>(duration).count();
+    if (bytes < min_sample_bytes || seconds <= 0)
+        return;
+
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    if (auto mirror = mirror_for(url))
+    {
+        const auto sample = bytes / seconds;
+        mirror->throughput =
+            mirror->throughput > 0 ? (1 - sample_weight) * mirror->throughput + sample_weight * sample : sample;
+        mirror->healthy = true;
+
+        MP_INSTRUMENTATION.set(throughput_metric, fmt::format("mirror=\"{}\"", mirror->base),
+                               static_cast<quint64>(mirror->throughput));
+    }
+}
+
+void mp::ImageMirrorSelector::record_failure(const QUrl& url)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    if (auto mirror = mirror_for(url))
+        mirror->healthy = false;
+}
+
+// Catches up with the configured mirrors, probing them all again when they changed or the last probe is stale
+void mp::ImageMirrorSelector::refresh(const QStringList& bases)
+{
+    std::lock_guard<decltype(probe_mutex)> probe_lock{probe_mutex};
+
+    std::vector<Mirror> probed{{origin}};
+    for (const auto& base : bases)
+        if (base != origin)
+            probed.push_back({base});
+
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        const auto unchanged = std::equal(probed.cbegin(), probed.cend(), mirrors.cbegin(), mirrors.cend(),
+                                          [](const Mirror& a, const Mirror& b) { return a.base == b.base; });
+        if (unchanged && Clock::now() - last_probe < probe_interval)
+            return;
+    }
+
+    // A mirror that is down takes as long as the downloader's timeout to tell, so they are all probed at once
+    std::vector<QFuture<optional<Clock::duration>>> probes;
+    for (const auto& mirror : probed)
+        probes.push_back(QtConcurrent::run([this, base = mirror.base] { return probe(url_downloader, base); }));
+
+    for (auto i = 0u; i < probed.size(); ++i)
+    {
+        probed[i].round_trip = probes[i].result();
+        probed[i].healthy = static_cast<bool>(probed[i].round_trip);
+    }
+
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    // The throughput learned so far stays, including from downloads that finished while probing
+    for (auto& mirror : probed)
+    {
+        const auto known = std::find_if(mirrors.cbegin(), mirrors.cend(),
+                                        [&mirror](const Mirror& other) { return other.base == mirror.base; });
+        if (known != mirrors.cend())
+            mirror.throughput = known->throughput;
+    }
+
+    mirrors = std::move(probed);
+    last_probe = Clock::now();
+}
+
+mp::ImageMirrorSelector::Mirror* mp::ImageMirrorSelector::mirror_for(const QUrl& url)
+{
+    const auto location = url.toString();
+
+    Mirror* match = nullptr;
+    for (auto& mirror : mirrors)
+        if (location.startsWith(mirror.base) && (!match || mirror.base.size() > match->base.size()))
+            match = &mirror;
+
+    return match;
+}
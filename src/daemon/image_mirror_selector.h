@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_IMAGE_MIRROR_SELECTOR_H
+#define MULTIPASS_IMAGE_MIRROR_SELECTOR_H
+
+#include <multipass/optional.h>
+
+#include <QString>
+#include <QStringList>
+#include <QUrl>
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace multipass
+{
+class URLDownloader;
+
+// Picks where images under the origin are best downloaded from, out of the origin itself and the mirrors of it in
+// local.image-mirrors, which keep its layout. Every so often, the mirrors are probed for their round trip time; their
+// throughput is learned from the downloads they serve. Those that failed are tried last, until a probe finds them up.
+class ImageMirrorSelector
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    ImageMirrorSelector(URLDownloader* downloader, const QString& origin);
+
+    // The places to download the location from, best first. Only the location itself when it is not under the
+    // origin, or there are no mirrors
+    std::vector<QUrl> candidates_for(const QUrl& location);
+    void record_download(const QUrl& url, qint64 bytes, Clock::duration duration);
+    void record_failure(const QUrl& url);
+
+private:
+    struct Mirror
+    {
+        QString base; // ending in '/', like the origin
+        optional<Clock::duration> round_trip;
+        double throughput{0}; // bytes per second, none until a download was large enough to tell
+        bool healthy{true};
+    };
+
+    void refresh(const QStringList& bases);
+    Mirror* mirror_for(const QUrl& url); // with the mutex held
+
+    URLDownloader* const url_downloader;
+    const QString origin;
+    std::mutex probe_mutex; // so that downloads starting together wait on one probe rather than each doing their own
+    std::mutex mutex;
+    std::vector<Mirror> mirrors; // the origin first
+    Clock::time_point last_probe;
+};
+} // namespace multipass
+#endif // MULTIPASS_IMAGE_MIRROR_SELECTOR_H
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "json_journal.h"
+
+#include <QFile>
+#include <QJsonDocument>
+
+#include <unistd.h>
+
+namespace mp = multipass;
+
+namespace
+{
+constexpr auto key_field = "key";
+constexpr auto value_field = "value";
+
+QJsonObject read_snapshot(const QString& path)
+{
+    QFile file{path};
+    if (!file.open(QIODevice::ReadOnly))
+        return {};
+
+    return QJsonDocument::fromJson(file.readAll()).object();
+}
+
+// Each line holds one entry: the key with its new value, or the key alone when the record went away. Returns the
+// number of entries replayed, or -1 if the journal ends in a torn one.
+int replay(const QString& path, QJsonObject& records)
+{
+    QFile file{path};
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+
+    auto entries = 0;
+    while (!file.atEnd())
+    {
+        auto entry = QJsonDocument::fromJson(file.readLine()).object();
+        if (!entry.contains(key_field))
+            return -1; // a crash hit while it was being appended, so it was never acknowledged
+
+        auto key = entry[key_field].toString();
+        if (entry.contains(value_field))
+            records.insert(key, entry[value_field]);
+        else
+            records.remove(key);
+        ++entries;
+    }
+
+    return entries;
+}
+} // namespace
+
+mp::JsonJournal::JsonJournal(const QString& snapshot_path, int max_entries)
+    : snapshot_path{snapshot_path},
+      journal_path{snapshot_path + ".journal"},
+      max_entries{max_entries},
+      current{read_snapshot(snapshot_path)}
+{
+    entries = replay(journal_path, current);
+
+    // Anything appended after a torn entry would be lost on the next replay
+    if (entries < 0)
+        compact_locked(WriteDurability::synced);
+    if (entries < 0)
+        entries = max_entries; // so the next update tries again
+}
+
+QJsonObject mp::JsonJournal::records() const
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    return current;
+}
+
+void mp::JsonJournal::update(const QJsonObject& records, WriteDurability durability)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+
+    QByteArray changes;
+    auto append = [&changes](const QJsonObject& entry) {
+        changes.append(QJsonDocument{entry}.toJson(QJsonDocument::Compact)).append('\n');
+    };
+
+    for (auto it = records.constBegin(); it != records.constEnd(); ++it)
+        if (current.value(it.key()) != it.value())
+            append({{key_field, it.key()}, {value_field, it.value()}});
+
+    for (auto it = current.constBegin(); it != current.constEnd(); ++it)
+        if (!records.contains(it.key()))
+            append({{key_field, it.key()}});
+
+    current = records;
+    if (changes.isEmpty())
+        return;
+
+    entries += changes.count('\n');
+    if (entries > max_entries)
+    {
+        compact_locked(durability);
+        return;
+    }
+
+    QFile journal{journal_path};
+    if (!journal.open(QIODevice::WriteOnly | QIODevice::Append) || journal.write(changes) != changes.size() ||
+        !journal.flush())
+    {
+        compact_locked(durability); // so that neither the changes nor a torn entry are left in the journal
+        return;
+    }
+
+    if (durability == WriteDurability::synced)
+        ::fsync(journal.handle());
+}
+
+void mp::JsonJournal::compact(WriteDurability durability)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    compact_locked(durability);
+}
+
+void mp::JsonJournal::compact_locked(WriteDurability durability)
+{
+    if (!mp::write_json(current, snapshot_path, durability))
+        return; // the journal is all there is until the snapshot can be written
+
+    // A crash before this point replays the journal over a snapshot that already holds its end result
+    QFile::remove(journal_path);
+    entries = 0;
+}
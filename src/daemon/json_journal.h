@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_JSON_JOURNAL_H
+#define MULTIPASS_JSON_JOURNAL_H
+
+#include "json_writer.h"
+
+#include <QJsonObject>
+#include <QString>
+
+#include <mutex>
+
+namespace multipass
+{
+// Keeps a JSON object of records on disk as a snapshot plus a journal of the records that changed since. Only the
+// changes are written on update; the journal is folded back into the snapshot once it grows long enough, which
+// leaves the snapshot as a plain JSON export of the records.
+class JsonJournal
+{
+public:
+    explicit JsonJournal(const QString& snapshot_path, int max_entries = 1000);
+
+    // The snapshot with the journal replayed over it
+    QJsonObject records() const;
+
+    // Appends the records that differ from the last update, and those that went away
+    void update(const QJsonObject& records, WriteDurability durability = WriteDurability::relaxed);
+
+    // Rewrites the snapshot with all the records and empties the journal
+    void compact(WriteDurability durability = WriteDurability::synced);
+
+private:
+    void compact_locked(WriteDurability durability);
+
+    const QString snapshot_path;
+    const QString journal_path;
+    const int max_entries;
+    mutable std::mutex mutex;
+    QJsonObject current;
+    int entries{0};
+};
+} // namespace multipass
+#endif // MULTIPASS_JSON_JOURNAL_H
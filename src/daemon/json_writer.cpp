@@ -19,16 +19,56 @@
 
 #include "json_writer.h"
 
-#include <QFile>
+#include <QDir>
+#include <QFileInfo>
 #include <QJsonDocument>
+#include <QTemporaryFile>
+
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace mp = multipass;
 
-void mp::write_json(const QJsonObject& root, QString file_name)
+namespace
+{
+void sync_directory_of(const QString& file_name)
+{
+    const auto dir_fd = ::open(QFile::encodeName(QFileInfo{file_name}.absolutePath()).constData(), O_RDONLY);
+    if (dir_fd < 0)
+        return;
+
+    ::fsync(dir_fd); // makes the rename itself durable
+    ::close(dir_fd);
+}
+} // namespace
+
+bool mp::write_json(const QJsonObject& root, QString file_name, WriteDurability durability)
 {
     QJsonDocument doc{root};
     auto raw_json = doc.toJson();
-    QFile db_file{file_name};
-    db_file.open(QIODevice::ReadWrite | QIODevice::Truncate);
-    db_file.write(raw_json);
+
+    // Written aside and renamed over the original, so that readers never see a partial file
+    QTemporaryFile db_file{file_name + ".XXXXXX"};
+    if (!db_file.open())
+        return false;
+
+    if (QFile::exists(file_name))
+        db_file.setPermissions(QFile::permissions(file_name));
+
+    if (db_file.write(raw_json) != raw_json.size() || !db_file.flush())
+        return false;
+
+    if (durability == WriteDurability::synced && ::fsync(db_file.handle()) != 0)
+        return false;
+
+    if (std::rename(QFile::encodeName(db_file.fileName()).constData(), QFile::encodeName(file_name).constData()) != 0)
+        return false;
+
+    db_file.setAutoRemove(false);
+    if (durability == WriteDurability::synced)
+        sync_directory_of(file_name);
+
+    return true;
 }
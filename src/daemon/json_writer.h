@@ -25,6 +25,15 @@
 
 namespace multipass
 {
-void write_json(const QJsonObject& root, QString file_name);
-}
+enum class WriteDurability
+{
+    relaxed, // atomic, but may be lost if the machine (not just the daemon) goes down right after
+    synced   // on disk, rename included, by the time write_json returns
+};
+
+// Replaces file_name atomically: on failure, or after a crash, the previous contents are left in place. Returns
+// whether the file was replaced.
+bool write_json(const QJsonObject& root, QString file_name,
+                WriteDurability durability = WriteDurability::relaxed);
+} // namespace multipass
 #endif // MULTIPASS_JSON_WRITER_H
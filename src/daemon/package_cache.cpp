@@ -0,0 +1,444 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "package_cache.h"
+
+#include <multipass/format.h>
+#include <multipass/logging/log.h>
+#include <multipass/sha256.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+namespace fs = std::filesystem;
+
+namespace
+{
+constexpr auto category = "package cache";
+constexpr auto max_head_size = 64 * 1024;
+constexpr auto buffer_size = 256 * 1024;
+constexpr auto max_age = std::chrono::hours{24 * 30};
+constexpr auto partial_prefix = ".partial-";
+
+struct Head
+{
+    std::vector<std::string> start_line; // method, target and version, or version, status and reason
+    std::vector<std::pair<std::string, std::string>> fields;
+};
+
+bool iequals(const std::string& a, const std::string& b)
+{
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) { return std::tolower(x) == std::tolower(y); });
+}
+
+bool ends_with(const std::string& text, const std::string& suffix)
+{
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::string trimmed(const std::string& text)
+{
+    const auto begin = text.find_first_not_of(" \t");
+    return begin == std::string::npos ? std::string{} : text.substr(begin, text.find_last_not_of(" \t") - begin + 1);
+}
+
+std::string field(const Head& head, const std::string& name)
+{
+    for (const auto& [field_name, value] : head.fields)
+        if (iequals(field_name, name))
+            return value;
+
+    return {};
+}
+
+Head parse_head(const std::string& text)
+{
+    Head head;
+    size_t begin = 0;
+    for (auto end = text.find("\r\n"); end != std::string::npos && end != begin; end = text.find("\r\n", begin))
+    {
+        const auto line = text.substr(begin, end - begin);
+        begin = end + 2;
+
+        if (head.start_line.empty())
+        {
+            const auto first = line.find(' ');
+            const auto second = first == std::string::npos ? first : line.find(' ', first + 1);
+
+            head.start_line.push_back(line.substr(0, first));
+            if (first != std::string::npos)
+                head.start_line.push_back(line.substr(first + 1, second - first - 1));
+            if (second != std::string::npos)
+                head.start_line.push_back(line.substr(second + 1));
+        }
+        else if (const auto colon = line.find(':'); colon != std::string::npos)
+            head.fields.emplace_back(line.substr(0, colon), trimmed(line.substr(colon + 1)));
+    }
+
+    return head;
+}
+
+// Hop-by-hop fields are dropped, and the connection is marked to be closed once the message is through
+std::string serialize(const std::string& start_line, const Head& head)
+{
+    auto text = start_line + "\r\n";
+    for (const auto& [name, value] : head.fields)
+        if (!iequals(name, "Connection") && !iequals(name, "Proxy-Connection") && !iequals(name, "Keep-Alive") &&
+            !iequals(name, "Proxy-Authorization"))
+            text += name + ": " + value + "\r\n";
+
+    return text + "Connection: close\r\n\r\n";
+}
+
+// Splits an absolute http URL, as clients send proxies; false for anything else, like CONNECT's host:port
+bool split_url(const std::string& url, std::string& host, int& port, std::string& authority, std::string& path)
+{
+    const std::string scheme{"http://"};
+    if (url.size() <= scheme.size() || !iequals(url.substr(0, scheme.size()), scheme))
+        return false;
+
+    const auto slash = url.find('/', scheme.size());
+    authority = url.substr(scheme.size(), slash - scheme.size());
+    path = slash == std::string::npos ? "/" : url.substr(slash);
+
+    const auto bracket = authority.rfind(']');
+    const auto colon = authority.rfind(':');
+    host = authority.substr(0, colon != std::string::npos && (bracket == std::string::npos || colon > bracket)
+                                   ? colon
+                                   : std::string::npos);
+    port = host.size() < authority.size() ? std::atoi(authority.c_str() + host.size() + 1) : 80;
+    if (host.size() > 2 && host.front() == '[' && host.back() == ']')
+        host = host.substr(1, host.size() - 2);
+
+    return !host.empty() && port > 0 && port < 65536;
+}
+
+bool is_package(const std::string& path)
+{
+    const auto file = path.substr(0, path.find('?'));
+    return ends_with(file, ".deb") || ends_with(file, ".udeb") || ends_with(file, ".ddeb");
+}
+
+// Reads up to the blank line that ends an HTTP head, leaving whatever came after it in rest
+bool read_head(int fd, int stop_fd, std::string& head, std::string& rest)
+{
+    std::string data;
+    char buffer[4096];
+    for (;;)
+    {
+        if (const auto end = data.find("\r\n\r\n"); end != std::string::npos)
+        {
+            head = data.substr(0, end + 4);
+            rest = data.substr(end + 4);
+            return true;
+        }
+
+        if (data.size() > max_head_size)
+            return false;
+
+        const auto received = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (received > 0)
+            data.append(buffer, static_cast<size_t>(received));
+        else if (received == 0 || (errno != EAGAIN && errno != EINTR) || !mp::wait_for(fd, POLLIN, stop_fd))
+            return false;
+    }
+}
+
+bool send_all(int fd, const char* data, size_t size, int stop_fd)
+{
+    while (size)
+    {
+        const auto sent = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (sent > 0)
+        {
+            data += sent;
+            size -= static_cast<size_t>(sent);
+        }
+        else if (sent == 0 || (errno != EAGAIN && errno != EINTR) || !mp::wait_for(fd, POLLOUT, stop_fd))
+            return false;
+    }
+
+    return true;
+}
+
+bool send_all(int fd, const std::string& data, int stop_fd)
+{
+    return send_all(fd, data.data(), data.size(), stop_fd);
+}
+
+bool write_all(int fd, const char* data, size_t size)
+{
+    while (size)
+    {
+        const auto written = ::write(fd, data, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+
+    return true;
+}
+
+void send_status(int fd, const std::string& status, int stop_fd)
+{
+    send_all(fd, fmt::format("HTTP/1.1 {}\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status), stop_fd);
+}
+
+void send_file(int client, int file, int stop_fd)
+{
+    struct stat info;
+    if (::fstat(file, &info) < 0)
+        return;
+
+    const auto head = fmt::format("HTTP/1.1 200 OK\r\nContent-Type: application/vnd.debian.binary-package\r\n"
+                                  "Content-Length: {}\r\nConnection: close\r\n\r\n",
+                                  info.st_size);
+    if (!send_all(client, head, stop_fd))
+        return;
+
+    off_t offset = 0;
+    while (offset < info.st_size)
+    {
+        const auto sent = ::sendfile(client, file, &offset, static_cast<size_t>(info.st_size - offset));
+        if (sent == 0 || (sent < 0 && ((errno != EAGAIN && errno != EINTR) || !mp::wait_for(client, POLLOUT, stop_fd))))
+            return;
+    }
+}
+
+const std::string& prepared(const std::string& cache_dir)
+{
+    std::error_code error;
+    fs::create_directories(cache_dir, error);
+    if (error)
+        throw std::runtime_error(fmt::format("cannot create package cache {}: {}", cache_dir, error.message()));
+
+    // Anything not served in a while goes, along with what interrupted downloads left behind
+    const auto oldest = fs::file_time_type::clock::now() - max_age;
+    for (const auto& entry : fs::directory_iterator{cache_dir, error})
+    {
+        std::error_code ignored;
+        if (entry.path().filename().string().rfind(partial_prefix, 0) == 0 || entry.last_write_time(ignored) < oldest)
+            fs::remove(entry.path(), ignored);
+    }
+
+    return cache_dir;
+}
+} // namespace
+
+mp::PackageCache::PackageCache(const std::string& cache_dir, const std::string& address, int port,
+                               const PackageCachePolicy& policy)
+    : cache_dir{prepared(cache_dir)},
+      address{fmt::format("{}:{}", address, port)},
+      policy{policy},
+      server{listen_on(address, port), policy.max_connections,
+             [this](UniqueFd client, int stop_fd) { handle(std::move(client), stop_fd); }}
+{
+    trim();
+}
+
+const std::string& mp::PackageCache::proxy_address() const
+{
+    return address;
+}
+
+std::string mp::PackageCache::path_for(const std::string& url) const
+{
+    Sha256 hash;
+    hash.add_data(url.data(), static_cast<qint64>(url.size()));
+    return fmt::format("{}/{}", cache_dir, hash.result().toHex().toStdString());
+}
+
+// Drops the packages served longest ago until what is left fits
+void mp::PackageCache::trim()
+{
+    struct Package
+    {
+        fs::file_time_type served;
+        std::uintmax_t size;
+        fs::path path;
+    };
+
+    std::lock_guard<decltype(trim_mutex)> lock{trim_mutex};
+    std::vector<Package> packages;
+    std::uintmax_t total = 0;
+    std::error_code error;
+    for (const auto& entry : fs::directory_iterator{cache_dir, error})
+    {
+        std::error_code ignored;
+        if (entry.path().filename().string().rfind(partial_prefix, 0) == 0 || !entry.is_regular_file(ignored))
+            continue;
+
+        packages.push_back({entry.last_write_time(ignored), entry.file_size(ignored), entry.path()});
+        total += packages.back().size;
+    }
+
+    std::sort(packages.begin(), packages.end(),
+              [](const Package& a, const Package& b) { return a.served < b.served; });
+    for (auto it = packages.begin(); it != packages.end() && total > policy.max_size; ++it)
+    {
+        std::error_code ignored;
+        if (fs::remove(it->path, ignored))
+            total -= it->size;
+    }
+}
+
+void mp::PackageCache::handle(UniqueFd client, int stop_fd)
+{
+    std::string head_text, rest;
+    if (!read_head(client.get(), stop_fd, head_text, rest))
+        return;
+
+    const auto request = parse_head(head_text);
+    std::string host, authority, path;
+    int port;
+    if (request.start_line.size() != 3 || !split_url(request.start_line[1], host, port, authority, path))
+    {
+        // CONNECT tunnels are not offered, package managers go to https mirrors directly
+        send_status(client.get(), "501 Not Implemented", stop_fd);
+        return;
+    }
+
+    // Package managers only ever fetch, and only from mirrors' plain HTTP port
+    const auto& method = request.start_line[0];
+    if (method != "GET" && method != "HEAD")
+    {
+        send_status(client.get(), "405 Method Not Allowed", stop_fd);
+        return;
+    }
+
+    if (port != policy.upstream_port)
+    {
+        send_status(client.get(), "403 Forbidden", stop_fd);
+        return;
+    }
+
+    const auto& url = request.start_line[1];
+    const auto cacheable = method == "GET" && is_package(path) && field(request, "Range").empty();
+
+    const auto cached_path = cacheable ? path_for(url) : std::string{};
+    if (cacheable)
+    {
+        if (const UniqueFd file{::open(cached_path.c_str(), O_RDONLY | O_CLOEXEC)})
+        {
+            ::futimens(file.get(), nullptr); // what is served stays
+            send_file(client.get(), file.get(), stop_fd);
+            mpl::log(mpl::Level::debug, category, fmt::format("Served {} from the cache", url));
+            return;
+        }
+    }
+
+    // Checked on the address the host resolves to, so that no name can point instances at the host or its networks
+    auto refused = false;
+    const auto upstream = connect_to(host, port, stop_fd, [this, &refused](const sockaddr* address) {
+        refused = !policy.private_upstreams && !is_public_address(address);
+        return !refused;
+    });
+    if (!upstream)
+    {
+        if (refused)
+            mpl::log(mpl::Level::debug, category, fmt::format("Refused to go to {}, it is not on the internet", host));
+        send_status(client.get(), refused ? "403 Forbidden" : "502 Bad Gateway", stop_fd);
+        return;
+    }
+
+    auto forwarded = serialize(fmt::format("{} {} {}", method, path, request.start_line[2]), request);
+    if (field(request, "Host").empty())
+        forwarded.insert(forwarded.size() - 2, fmt::format("Host: {}\r\n", authority));
+    if (!send_all(upstream.get(), forwarded + rest, stop_fd))
+        return;
+
+    if (!cacheable)
+    {
+        relay_between(client.get(), upstream.get(), stop_fd);
+        return;
+    }
+
+    if (!read_head(upstream.get(), stop_fd, head_text, rest))
+        return;
+
+    const auto response = parse_head(head_text);
+    const auto length_field = field(response, "Content-Length");
+    const auto length = std::strtoull(length_field.c_str(), nullptr, 10);
+    const auto response_head =
+        serialize(fmt::format("{} {} {}", response.start_line.size() > 0 ? response.start_line[0] : "HTTP/1.1",
+                              response.start_line.size() > 1 ? response.start_line[1] : "502",
+                              response.start_line.size() > 2 ? response.start_line[2] : ""),
+                  response);
+
+    if (response.start_line.size() < 2 || response.start_line[1] != "200" || length_field.empty() ||
+        !field(response, "Transfer-Encoding").empty())
+    {
+        if (send_all(client.get(), response_head + rest, stop_fd))
+            relay_between(client.get(), upstream.get(), stop_fd);
+        return;
+    }
+
+    // The package goes to the instance and to a file of its own at once; should the instance drop the connection,
+    // the download still goes on for the cache to have it next time
+    auto partial_path = fmt::format("{}/{}XXXXXX", cache_dir, partial_prefix);
+    UniqueFd file{::mkostemp(partial_path.data(), O_CLOEXEC)};
+    auto client_ok = send_all(client.get(), response_head, stop_fd);
+    unsigned long long received = 0;
+
+    const auto consume = [&](const char* data, size_t size) {
+        if (file && !write_all(file.get(), data, size))
+            file = UniqueFd{};
+        if (client_ok)
+            client_ok = send_all(client.get(), data, size, stop_fd);
+        received += size;
+    };
+
+    consume(rest.data(), rest.size());
+
+    std::vector<char> buffer(buffer_size);
+    while (received < length && (client_ok || file))
+    {
+        const auto got = ::recv(upstream.get(), buffer.data(), buffer.size(), 0);
+        if (got > 0)
+            consume(buffer.data(), static_cast<size_t>(got));
+        else if (got == 0 || (errno != EAGAIN && errno != EINTR) || !wait_for(upstream.get(), POLLIN, stop_fd))
+            break;
+    }
+
+    if (file && received == length && ::rename(partial_path.c_str(), cached_path.c_str()) == 0)
+    {
+        mpl::log(mpl::Level::debug, category, fmt::format("Cached {}", url));
+        trim();
+    }
+    else
+        ::unlink(partial_path.c_str());
+}
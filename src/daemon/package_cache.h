@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_PACKAGE_CACHE_H
+#define MULTIPASS_PACKAGE_CACHE_H
+
+#include "tcp_relay.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace multipass
+{
+// What instances are let through to, and how much the cache takes
+struct PackageCachePolicy
+{
+    std::uintmax_t max_size = std::uintmax_t{10} << 30; // bytes of packages kept, those served longest ago going first
+    std::size_t max_connections = 64;                   // at a time; apt opens a few, per instance
+    int upstream_port = 80;                             // the only port requests are let through to
+    bool private_upstreams = false; // whether the host's own, link-local and private addresses are let through to
+};
+
+// A plain HTTP proxy for instances' package managers, which keeps a copy of every package downloaded through it and
+// hands that out to the next instance to ask for the same URL. Everything else, including partial requests, goes
+// through untouched. Only GET and HEAD requests get through, and only to mirrors out on the internet, so that
+// instances cannot reach the host's services, nor anything else on its networks, through it. Packages that were not
+// asked for in a month are dropped when the cache starts.
+class PackageCache
+{
+public:
+    // Throws if the address cannot be listened on
+    PackageCache(const std::string& cache_dir, const std::string& address, int port,
+                 const PackageCachePolicy& policy = {});
+
+    // The host:port to point instances at
+    const std::string& proxy_address() const;
+
+private:
+    void handle(UniqueFd client, int stop_fd);
+    std::string path_for(const std::string& url) const;
+    void trim();
+
+    const std::string cache_dir;
+    const std::string address;
+    const PackageCachePolicy policy;
+    std::mutex trim_mutex; // downloads finish on threads of their own
+    TcpServer server;      // last, to stop before anything its handlers use goes
+};
+} // namespace multipass
+#endif // MULTIPASS_PACKAGE_CACHE_H
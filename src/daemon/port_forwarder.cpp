@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "port_forwarder.h"
+
+#include "tcp_relay.h"
+
+#include <multipass/format.h>
+#include <multipass/logging/log.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+#include <poll.h>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+
+namespace
+{
+constexpr auto category = "forward";
+constexpr auto address_poll_interval = std::chrono::milliseconds{100};
+
+// Counts a connection for as long as it is handled
+class CountedConnection
+{
+public:
+    explicit CountedConnection(std::atomic_int& count) : count{count}
+    {
+        ++count;
+    }
+    ~CountedConnection()
+    {
+        --count;
+    }
+
+private:
+    std::atomic_int& count;
+};
+
+// Empty once the forward is stopped, or if the daemon went without answering
+std::string wait_for_address(std::future<std::string> address, int stop_fd)
+{
+    while (address.wait_for(address_poll_interval) != std::future_status::ready)
+    {
+        pollfd fd{stop_fd, POLLIN, 0};
+        if (::poll(&fd, 1, 0) != 0)
+            return {};
+    }
+
+    try
+    {
+        return address.get();
+    }
+    catch (const std::future_error&)
+    {
+        return {};
+    }
+}
+} // namespace
+
+struct mp::PortForwarder::Forward
+{
+    Forward(const std::string& instance, UniqueFd listener, std::size_t max_connections, int instance_port,
+            AddressLookup lookup)
+        : instance{instance},
+          server{std::move(listener), max_connections,
+                 [instance, instance_port, lookup = std::move(lookup), connections = connections](UniqueFd client,
+                                                                                                  int stop_fd) {
+                     CountedConnection counted{*connections};
+
+                     const auto address = wait_for_address(lookup(), stop_fd);
+                     if (address.empty())
+                     {
+                         mpl::log(mpl::Level::debug, category,
+                                  fmt::format("Turned a connection away, {} is not running", instance));
+                         return;
+                     }
+
+                     const auto target = connect_to(address, instance_port, stop_fd);
+                     if (!target)
+                     {
+                         mpl::log(mpl::Level::debug, category,
+                                  fmt::format("Cannot connect to port {} of {}", instance_port, instance));
+                         return;
+                     }
+
+                     relay_between(client.get(), target.get(), stop_fd);
+                 }}
+    {
+    }
+
+    const std::string instance;
+    const std::shared_ptr<std::atomic_int> connections = std::make_shared<std::atomic_int>(0);
+    TcpServer server;
+};
+
+mp::PortForwarder::PortForwarder(std::size_t max_connections) : max_connections{max_connections}
+{
+}
+
+mp::PortForwarder::~PortForwarder() = default;
+
+void mp::PortForwarder::add(const std::string& instance, const std::string& host_address, int host_port,
+                            int instance_port, AddressLookup lookup)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    const auto key = std::make_pair(host_address, host_port);
+    if (forwards.count(key))
+        throw std::runtime_error(fmt::format("{}:{} is already forwarded", host_address, host_port));
+
+    forwards.emplace(key, std::make_unique<Forward>(instance, listen_on(host_address, host_port), max_connections,
+                                                    instance_port, std::move(lookup)));
+}
+
+bool mp::PortForwarder::remove(const std::string& instance, const std::string& host_address, int host_port)
+{
+    std::vector<std::unique_ptr<Forward>> removed;
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        for (auto it = forwards.begin(); it != forwards.end();)
+        {
+            if (it->second->instance == instance && it->first.second == host_port &&
+                (host_address.empty() || it->first.first == host_address))
+            {
+                removed.push_back(std::move(it->second));
+                it = forwards.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+    return !removed.empty(); // they are stopped on the way out, without holding the lock
+}
+
+void mp::PortForwarder::remove_all(const std::string& instance)
+{
+    std::vector<std::unique_ptr<Forward>> removed;
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        for (auto it = forwards.begin(); it != forwards.end();)
+        {
+            if (it->second->instance == instance)
+            {
+                removed.push_back(std::move(it->second));
+                it = forwards.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+}
+
+int mp::PortForwarder::active_connections(const std::string& instance)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+
+    auto count{0};
+    for (const auto& forward : forwards)
+        if (forward.second->instance == instance)
+            count += *forward.second->connections;
+
+    return count;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_PORT_FORWARDER_H
+#define MULTIPASS_PORT_FORWARDER_H
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace multipass
+{
+// Listens on host ports and relays each connection to a port of an instance. Data is moved between the sockets with
+// splice() through a pipe, so that it never goes through user space. Connections only get through while the instance
+// has an address; the host port stays bound in between, so nothing else can take it.
+class PortForwarder
+{
+public:
+    // Asked from relay threads for the address to reach the instance at, which comes in the future as it is to be
+    // found out on the daemon's thread; empty while the instance cannot be reached
+    using AddressLookup = std::function<std::future<std::string>()>;
+
+    explicit PortForwarder(std::size_t max_connections = 64); // at a time, to each forward
+    ~PortForwarder();
+
+    // Throws if the host address and port are in use, by another forward or anything else
+    void add(const std::string& instance, const std::string& host_address, int host_port, int instance_port,
+             AddressLookup lookup);
+    // Every forward of the host port to the instance when no host address is given; false if there were none
+    bool remove(const std::string& instance, const std::string& host_address, int host_port);
+    void remove_all(const std::string& instance);
+
+    // Connections to the instance being relayed, or waiting for it, right now
+    int active_connections(const std::string& instance);
+
+private:
+    struct Forward;
+
+    const std::size_t max_connections;
+    std::mutex mutex;
+    std::map<std::pair<std::string, int>, std::unique_ptr<Forward>> forwards; // by host address and port
+};
+} // namespace multipass
+#endif // MULTIPASS_PORT_FORWARDER_H
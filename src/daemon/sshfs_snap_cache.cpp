@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sshfs_snap_cache.h"
+
+#include <multipass/format.h>
+#include <multipass/logging/log.h>
+#include <multipass/utils.h>
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+
+namespace
+{
+constexpr auto category = "sshfs snap";
+constexpr auto snap_file = "multipass-sshfs.snap";
+constexpr auto assertion_file = "multipass-sshfs.assert";
+constexpr auto download_timeout = 5 * 60 * 1000;
+
+bool is_fresh(const QFileInfo& file)
+{
+    const auto max_age = std::chrono::duration_cast<std::chrono::seconds>(mp::SSHFSSnapCache::max_age).count();
+    return file.lastModified().secsTo(QDateTime::currentDateTime()) < max_age;
+}
+
+// The one file of the download that matches, if there is just one
+mp::optional<QString> only_match(const QDir& dir, const QString& pattern)
+{
+    const auto matches = dir.entryList({pattern}, QDir::Files);
+    if (matches.size() != 1)
+        return mp::nullopt;
+
+    return dir.filePath(matches.front());
+}
+} // namespace
+
+mp::SSHFSSnapCache::SSHFSSnapCache(const QString& directory, Download download)
+    : directory{directory}, download{std::move(download)}
+{
+}
+
+mp::optional<mp::SSHFSSnapCache::Files> mp::SSHFSSnapCache::refresh()
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    const Files files{directory.filePath(snap_file), directory.filePath(assertion_file)};
+    const QFileInfo snap{files.snap}, assertion{files.assertion};
+    const auto cached = snap.exists() && assertion.exists();
+    if (cached && is_fresh(snap))
+        return files;
+
+    // Downloaded beside the copy and swapped in whole, so that a failed download leaves the copy as it was
+    if (directory.mkpath("."))
+    {
+        QTemporaryDir download_dir{directory.filePath("download-XXXXXX")};
+        if (download_dir.isValid() && download(download_dir.path()))
+        {
+            const QDir downloaded{download_dir.path()};
+            const auto new_snap = only_match(downloaded, "multipass-sshfs_*.snap");
+            const auto new_assertion = only_match(downloaded, "multipass-sshfs_*.assert");
+            if (new_snap && new_assertion)
+            {
+                QFile::remove(files.snap);
+                QFile::remove(files.assertion);
+                if (QFile::rename(*new_assertion, files.assertion) && QFile::rename(*new_snap, files.snap))
+                    return files;
+            }
+
+            mpl::log(mpl::Level::warning, category, "The download did not bring one snap and its assertions");
+        }
+    }
+
+    if (QFile::exists(files.snap) && QFile::exists(files.assertion))
+    {
+        mpl::log(mpl::Level::info, category, "Could not refresh the host's copy, using it as it is");
+        return files;
+    }
+
+    return nullopt;
+}
+
+void mp::SSHFSSnapCache::discard()
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    QFile::remove(directory.filePath(snap_file));
+    QFile::remove(directory.filePath(assertion_file));
+}
+
+// Through the host's snapd, which checks what it downloads against the store's signatures
+bool mp::SSHFSSnapCache::download_from_store(const QString& directory)
+{
+    return mp::utils::run_cmd_for_status("snap", {"download", "multipass-sshfs", "--target-directory", directory},
+                                         download_timeout);
+}
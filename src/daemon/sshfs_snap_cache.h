@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_SSHFS_SNAP_CACHE_H
+#define MULTIPASS_SSHFS_SNAP_CACHE_H
+
+#include <multipass/optional.h>
+
+#include <QDir>
+#include <QString>
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+namespace multipass
+{
+// The host's copy of the multipass-sshfs snap and its assertions, which instances that lack sshfs are given instead of
+// each reaching the store. Only the host downloads it, so an instance cannot hand the others a copy of its making.
+// Hosts that cannot reach the store can seed it by placing multipass-sshfs.snap and multipass-sshfs.assert in it.
+class SSHFSSnapCache
+{
+public:
+    // Downloads the snap and its assertions into the directory, returning whether it did
+    using Download = std::function<bool(const QString& directory)>;
+
+    struct Files
+    {
+        QString snap;
+        QString assertion;
+    };
+
+    static constexpr auto max_age = std::chrono::hours{24 * 7};
+
+    explicit SSHFSSnapCache(const QString& directory, Download download = download_from_store);
+
+    // The copy to install, downloaded anew when missing or older than max_age. An old copy is still given when the
+    // download fails.
+    optional<Files> refresh();
+    // Drops the copy, as one that did not install, so that the next refresh downloads it again
+    void discard();
+
+    static bool download_from_store(const QString& directory);
+
+private:
+    const QDir directory;
+    const Download download;
+    std::mutex mutex; // instances missing sshfs at once download it once
+};
+} // namespace multipass
+#endif // MULTIPASS_SSHFS_SNAP_CACHE_H
@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "tcp_relay.h"
+
+#include <multipass/format.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace mp = multipass;
+
+namespace
+{
+constexpr auto connect_timeout_ms = 10000;
+constexpr auto pipe_size = 1024 * 1024;
+
+struct AddrInfoDeleter
+{
+    void operator()(addrinfo* info) const
+    {
+        freeaddrinfo(info);
+    }
+};
+
+using AddrInfoUPtr = std::unique_ptr<addrinfo, AddrInfoDeleter>;
+
+AddrInfoUPtr resolve(const std::string& host, int port, int flags)
+{
+    addrinfo hints{};
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = flags | AI_NUMERICSERV;
+
+    addrinfo* result{nullptr};
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0)
+        return nullptr;
+
+    return AddrInfoUPtr{result};
+}
+
+// One direction of a connection, moving data from one socket to the other through a pipe of its own
+class Channel
+{
+public:
+    Channel(int from, int to) : from{from}, to{to}
+    {
+        int fds[2];
+        if (::pipe2(fds, O_CLOEXEC | O_NONBLOCK) == 0)
+        {
+            pipe_out = mp::UniqueFd{fds[0]};
+            pipe_in = mp::UniqueFd{fds[1]};
+            ::fcntl(fds[1], F_SETPIPE_SZ, pipe_size); // best effort, the default is enough to work with
+        }
+    }
+
+    bool valid() const
+    {
+        return static_cast<bool>(pipe_in);
+    }
+
+    bool done() const
+    {
+        return eof && !pending;
+    }
+
+    void add_events(short& from_events, short& to_events) const
+    {
+        if (!eof && !pending)
+            from_events |= POLLIN;
+        if (pending)
+            to_events |= POLLOUT;
+    }
+
+    // Whatever can be moved without blocking; false on errors that end the connection
+    bool move()
+    {
+        if (!eof && !pending)
+        {
+            const auto spliced = ::splice(from, nullptr, pipe_in.get(), nullptr, pipe_size,
+                                          SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (spliced == 0)
+            {
+                eof = true;
+                ::shutdown(to, SHUT_WR); // pass the half-close on
+            }
+            else if (spliced > 0)
+                pending = static_cast<size_t>(spliced);
+            else if (errno != EAGAIN && errno != EINTR)
+                return false;
+        }
+
+        while (pending)
+        {
+            const auto spliced =
+                ::splice(pipe_out.get(), nullptr, to, nullptr, pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (spliced > 0)
+                pending -= static_cast<size_t>(spliced);
+            else if (spliced < 0 && (errno == EAGAIN || errno == EINTR))
+                break;
+            else
+                return false;
+        }
+
+        return true;
+    }
+
+private:
+    const int from;
+    const int to;
+    mp::UniqueFd pipe_out;
+    mp::UniqueFd pipe_in;
+    size_t pending{0};
+    bool eof{false};
+};
+} // namespace
+
+mp::UniqueFd::UniqueFd(int fd) : fd{fd}
+{
+}
+
+mp::UniqueFd::UniqueFd(UniqueFd&& other) noexcept : fd{other.fd}
+{
+    other.fd = -1;
+}
+
+mp::UniqueFd& mp::UniqueFd::operator=(UniqueFd&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (fd >= 0)
+            ::close(fd);
+        fd = other.fd;
+        other.fd = -1;
+    }
+
+    return *this;
+}
+
+mp::UniqueFd::~UniqueFd()
+{
+    if (fd >= 0)
+        ::close(fd);
+}
+
+int mp::UniqueFd::get() const
+{
+    return fd;
+}
+
+mp::UniqueFd::operator bool() const
+{
+    return fd >= 0;
+}
+
+mp::UniqueFd mp::listen_on(const std::string& address, int port)
+{
+    const auto info = resolve(address, port, AI_PASSIVE | AI_NUMERICHOST);
+    if (!info)
+        throw std::runtime_error(fmt::format("invalid address {}", address));
+
+    UniqueFd fd{::socket(info->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+    const int on = 1;
+    if (!fd || ::setsockopt(fd.get(), SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+        ::bind(fd.get(), info->ai_addr, info->ai_addrlen) < 0 || ::listen(fd.get(), SOMAXCONN) < 0)
+        throw std::runtime_error(
+            fmt::format("cannot listen on {}:{}: {}", address.empty() ? "*" : address, port, std::strerror(errno)));
+
+    return fd;
+}
+
+bool mp::is_public_address(const sockaddr* address)
+{
+    const auto is_public_ipv4 = [](std::uint32_t ip) {
+        const auto in = [ip](std::uint32_t network, int prefix) {
+            return (ip ^ network) >> (32 - prefix) == 0;
+        };
+
+        return !in(0x00000000, 8) && !in(0x0a000000, 8) && !in(0x64400000, 10) && !in(0x7f000000, 8) &&
+               !in(0xa9fe0000, 16) && !in(0xac100000, 12) && !in(0xc0000000, 24) && !in(0xc0a80000, 16) &&
+               !in(0xc6120000, 15) && !in(0xe0000000, 3); // multicast and reserved, through the broadcast address
+    };
+
+    if (address->sa_family == AF_INET)
+        return is_public_ipv4(ntohl(reinterpret_cast<const sockaddr_in*>(address)->sin_addr.s_addr));
+
+    if (address->sa_family != AF_INET6)
+        return false;
+
+    const auto& ip = reinterpret_cast<const sockaddr_in6*>(address)->sin6_addr;
+    if (IN6_IS_ADDR_V4MAPPED(&ip) || IN6_IS_ADDR_V4COMPAT(&ip))
+    {
+        std::uint32_t ipv4;
+        std::memcpy(&ipv4, ip.s6_addr + 12, sizeof(ipv4));
+        return is_public_ipv4(ntohl(ipv4));
+    }
+
+    // Only global unicast, 2000::/3, is routed on the internet; unique local, link-local and multicast are not
+    return (ip.s6_addr[0] & 0xe0) == 0x20;
+}
+
+mp::UniqueFd mp::connect_to(const std::string& host, int port, int stop_fd,
+                            const std::function<bool(const sockaddr*)>& accepts)
+{
+    const auto info = resolve(host, port, 0);
+    if (!info || (accepts && !accepts(info->ai_addr)))
+        return UniqueFd{};
+
+    UniqueFd fd{::socket(info->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+    if (!fd)
+        return fd;
+
+    if (::connect(fd.get(), info->ai_addr, info->ai_addrlen) < 0)
+    {
+        if (errno != EINPROGRESS)
+            return UniqueFd{};
+
+        pollfd fds[] = {{stop_fd, POLLIN, 0}, {fd.get(), POLLOUT, 0}};
+        int error{0};
+        socklen_t length{sizeof(error)};
+        if (::poll(fds, 2, connect_timeout_ms) <= 0 || fds[0].revents ||
+            ::getsockopt(fd.get(), SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error)
+            return UniqueFd{};
+    }
+
+    return fd;
+}
+
+bool mp::wait_for(int fd, short events, int stop_fd)
+{
+    for (;;)
+    {
+        pollfd fds[] = {{stop_fd, POLLIN, 0}, {fd, events, 0}};
+        if (::poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        return !fds[0].revents;
+    }
+}
+
+void mp::relay_between(int a, int b, int stop_fd)
+{
+    Channel to_b{a, b}, to_a{b, a};
+    if (!to_b.valid() || !to_a.valid())
+        return;
+
+    while (!to_b.done() || !to_a.done())
+    {
+        pollfd fds[] = {{stop_fd, POLLIN, 0}, {a, 0, 0}, {b, 0, 0}};
+        to_b.add_events(fds[1].events, fds[2].events);
+        to_a.add_events(fds[2].events, fds[1].events);
+
+        // A socket nothing is waited for on is left out, or its hang-up would wake the loop over and over
+        for (auto& fd : fds)
+            if (!fd.events)
+                fd.fd = -1;
+
+        if (::poll(fds, 3, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        if (fds[0].revents || !to_b.move() || !to_a.move())
+            return;
+    }
+}
+
+struct mp::TcpServer::Connection
+{
+    std::thread thread;
+    std::atomic_bool done{false};
+};
+
+mp::TcpServer::TcpServer(UniqueFd listener, std::size_t max_connections, Handler handler)
+    : handler{std::move(handler)}, max_connections{max_connections}, listener{std::move(listener)}
+{
+    int fds[2];
+    if (::pipe2(fds, O_CLOEXEC) < 0)
+        throw std::runtime_error(fmt::format("cannot create pipe: {}", std::strerror(errno)));
+    stop_out = UniqueFd{fds[0]};
+    stop_in = UniqueFd{fds[1]};
+
+    acceptor = std::thread{&TcpServer::accept_connections, this};
+}
+
+mp::TcpServer::~TcpServer()
+{
+    stop_in = UniqueFd{}; // every poll on the other end wakes up to the hang-up
+    acceptor.join();
+    for (auto& connection : connections)
+        connection.thread.join();
+}
+
+void mp::TcpServer::accept_connections()
+{
+    while (wait_for(listener.get(), POLLIN, stop_out.get()))
+    {
+        connections.remove_if([](Connection& connection) {
+            if (!connection.done)
+                return false;
+            connection.thread.join();
+            return true;
+        });
+
+        UniqueFd client{::accept4(listener.get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)};
+        if (!client)
+            continue;
+
+        // Taken off the queue all the same, or the listener would keep waking the loop up
+        if (connections.size() >= max_connections)
+            continue;
+
+        connections.emplace_back();
+        auto& connection = connections.back();
+        connection.thread = std::thread{[this, &connection](UniqueFd client) {
+                                            handler(std::move(client), stop_out.get());
+                                            connection.done = true;
+                                        },
+                                        std::move(client)};
+    }
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_TCP_RELAY_H
+#define MULTIPASS_TCP_RELAY_H
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <string>
+#include <thread>
+
+#include <sys/socket.h>
+
+namespace multipass
+{
+// Owns a socket or pipe end, closing it on the way out
+class UniqueFd
+{
+public:
+    explicit UniqueFd(int fd = -1);
+    UniqueFd(UniqueFd&& other) noexcept;
+    UniqueFd& operator=(UniqueFd&& other) noexcept;
+    ~UniqueFd();
+
+    int get() const;
+    explicit operator bool() const;
+
+private:
+    int fd;
+};
+
+// Non-blocking, like every socket here; throws if the address cannot be listened on
+UniqueFd listen_on(const std::string& address, int port);
+
+// Whether an address is out on the internet, rather than the host's own, link-local, on a private network, or any of
+// the special ranges that are not routed there
+bool is_public_address(const sockaddr* address);
+
+// Resolves host names too; invalid if the connection fails, or stop_fd wakes up before it is made. With accepts given,
+// also if it turns down the address the host resolved to, which is what is connected to, so that it cannot change in
+// between
+UniqueFd connect_to(const std::string& host, int port, int stop_fd,
+                    const std::function<bool(const sockaddr*)>& accepts = nullptr);
+
+// Polls for the events on fd, or on stop_fd waking up; false on the latter, or on errors
+bool wait_for(int fd, short events, int stop_fd);
+
+// Moves data both ways between two sockets with splice(), until both sides are done or stop_fd wakes up
+void relay_between(int a, int b, int stop_fd);
+
+// Accepts connections on a listening socket and has each handled on a thread of its own, up to max_connections at a
+// time; those past it are closed as they come. Handlers are to return once stop_fd wakes up, which it does when the
+// server is destroyed.
+class TcpServer
+{
+public:
+    using Handler = std::function<void(UniqueFd client, int stop_fd)>;
+
+    TcpServer(UniqueFd listener, std::size_t max_connections, Handler handler);
+    ~TcpServer();
+
+private:
+    struct Connection;
+
+    void accept_connections();
+
+    const Handler handler;
+    const std::size_t max_connections;
+    UniqueFd listener;
+    UniqueFd stop_out;
+    UniqueFd stop_in;
+    std::list<Connection> connections; // only touched by the acceptor until it is joined
+    std::thread acceptor;
+};
+} // namespace multipass
+#endif // MULTIPASS_TCP_RELAY_H
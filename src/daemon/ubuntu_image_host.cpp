@@ -27,15 +27,23 @@
 #include <multipass/exceptions/unsupported_image_exception.h>
 #include <multipass/exceptions/unsupported_remote_exception.h>
 
+#include <multipass/format.h>
+#include <multipass/logging/log.h>
+
+#include <QCryptographicHash>
 #include <QUrl>
+#include <QtConcurrent/QtConcurrent>
 
 #include <algorithm>
+#include <exception>
 #include <unordered_set>
 
 namespace mp = multipass;
+namespace mpl = multipass::logging;
 
 namespace
 {
+constexpr auto category = "ubuntu image host";
 constexpr auto index_path = "streams/v1/index.json";
 
 auto download_manifest(const QString& host_url, mp::URLDownloader* url_downloader)
@@ -43,8 +51,7 @@ auto download_manifest(const QString& host_url, mp::URLDownloader* url_downloade
     auto json_index = url_downloader->download({host_url + index_path});
     auto index = mp::SimpleStreamsIndex::fromJson(json_index);
 
-    auto json_manifest = url_downloader->download({host_url + index.manifest_path});
-    return mp::SimpleStreamsManifest::fromJson(json_manifest, host_url);
+    return url_downloader->download({host_url + index.manifest_path});
 }
 
 mp::VMImageInfo with_location_fully_resolved(const QString& host_url, const mp::VMImageInfo& info)
@@ -64,6 +71,33 @@ mp::VMImageInfo with_location_fully_resolved(const QString& host_url, const mp::
             info.verify};
 }
 
+// What fetching one remote's manifest came to, for the refresh to sort out once all remotes are done
+struct RemoteFetch
+{
+    QByteArray digest;
+    std::shared_ptr<const mp::SimpleStreamsManifest> manifest; // unset when the digest was the known one
+    std::exception_ptr error;
+};
+
+RemoteFetch fetch_remote(const QString& host_url, const QByteArray& known_digest, mp::URLDownloader* url_downloader)
+{
+    RemoteFetch result;
+    try
+    {
+        const auto json_manifest = download_manifest(host_url, url_downloader);
+        result.digest = QCryptographicHash::hash(json_manifest, QCryptographicHash::Sha256);
+
+        if (result.digest != known_digest)
+            result.manifest = mp::SimpleStreamsManifest::fromJson(json_manifest, host_url);
+    }
+    catch (...)
+    {
+        result.error = std::current_exception();
+    }
+
+    return result;
+}
+
 auto key_from(const std::string& search_string)
 {
     auto key = QString::fromStdString(search_string);
@@ -74,9 +108,20 @@ auto key_from(const std::string& search_string)
 } // namespace
 
 mp::UbuntuVMImageHost::UbuntuVMImageHost(std::vector<std::pair<std::string, std::string>> remotes,
-                                         URLDownloader* downloader, std::chrono::seconds manifest_time_to_live)
-    : CommonVMImageHost{manifest_time_to_live}, url_downloader{downloader}, remotes{std::move(remotes)}
+                                         URLDownloader* downloader, std::chrono::seconds manifest_time_to_live,
+                                         const QString& manifest_cache_path)
+    : CommonVMImageHost{manifest_time_to_live},
+      manifests{std::make_shared<const Manifests>()},
+      url_downloader{downloader},
+      remotes{std::move(remotes)},
+      manifest_cache{manifest_cache_path}
+{
+    restore_cached_manifests();
+}
+
+mp::UbuntuVMImageHost::~UbuntuVMImageHost()
 {
+    stop_manifest_refresh();
 }
 
 mp::optional<mp::VMImageInfo> mp::UbuntuVMImageHost::info_for(const Query& query)
@@ -115,7 +160,7 @@ std::vector<std::pair<std::string, mp::VMImageInfo>> mp::UbuntuVMImageHost::all_
 
     std::vector<std::pair<std::string, mp::VMImageInfo>> images;
 
-    mp::SimpleStreamsManifest* manifest;
+    std::shared_ptr<const mp::SimpleStreamsManifest> manifest;
 
     for (const auto& remote_name : remotes_to_search)
     {
@@ -146,15 +191,15 @@ std::vector<std::pair<std::string, mp::VMImageInfo>> mp::UbuntuVMImageHost::all_
         {
             std::unordered_set<std::string> found_hashes;
 
-            for (const auto& entry : manifest->products)
+            for (const auto* entry : manifest->products_with_id_prefix(key))
             {
-                if (entry.id.startsWith(key) && (entry.supported || query.allow_unsupported) &&
-                    found_hashes.find(entry.id.toStdString()) == found_hashes.end())
+                if ((entry->supported || query.allow_unsupported) &&
+                    found_hashes.find(entry->id.toStdString()) == found_hashes.end())
                 {
                     images.push_back(std::make_pair(
                         remote_name,
-                        with_location_fully_resolved(QString::fromStdString(remote_url_from(remote_name)), entry)));
-                    found_hashes.insert(entry.id.toStdString());
+                        with_location_fully_resolved(QString::fromStdString(remote_url_from(remote_name)), *entry)));
+                    found_hashes.insert(entry->id.toStdString());
                 }
             }
         }
@@ -165,15 +210,12 @@ std::vector<std::pair<std::string, mp::VMImageInfo>> mp::UbuntuVMImageHost::all_
 
 mp::VMImageInfo mp::UbuntuVMImageHost::info_for_full_hash_impl(const std::string& full_hash)
 {
-    for (const auto& manifest : manifests)
+    const auto current_manifests = std::atomic_load(&manifests);
+    const auto id = QString::fromStdString(full_hash);
+    for (const auto& manifest : *current_manifests)
     {
-        for (const auto& product : manifest.second->products)
-        {
-            if (product.id.toStdString() == full_hash)
-            {
-                return with_location_fully_resolved(QString::fromStdString(remote_url_from(manifest.first)), product);
-            }
-        }
+        if (const auto* product = manifest.second->product_with_id(id))
+            return with_location_fully_resolved(QString::fromStdString(remote_url_from(manifest.first)), *product);
     }
 
     // TODO: Throw a specific exception type here so callers can be more specific about what to catch
@@ -203,7 +245,8 @@ std::vector<mp::VMImageInfo> mp::UbuntuVMImageHost::all_images_for(const std::st
 
 void mp::UbuntuVMImageHost::for_each_entry_do_impl(const Action& action)
 {
-    for (const auto& manifest : manifests)
+    const auto current_manifests = std::atomic_load(&manifests);
+    for (const auto& manifest : *current_manifests)
     {
         for (const auto& product : manifest.second->products)
         {
@@ -230,14 +273,66 @@ std::vector<std::string> mp::UbuntuVMImageHost::supported_remotes()
 
 void mp::UbuntuVMImageHost::fetch_manifests()
 {
+    const auto current_manifests = std::atomic_load(&manifests);
+    auto find_current = [&current_manifests](const std::string& remote_name) {
+        return std::find_if(current_manifests->begin(), current_manifests->end(),
+                            [&remote_name](const auto& element) { return element.first == remote_name; });
+    };
+
+    // All remotes are downloaded at once, so that a refresh takes as long as the slowest of them rather than their sum
+    std::vector<std::pair<const std::pair<std::string, std::string>*, QFuture<RemoteFetch>>> fetches;
     for (const auto& remote : remotes)
     {
         try
         {
             check_remote_is_supported(remote.first);
+        }
+        catch (const mp::UnsupportedRemoteException&)
+        {
+            continue;
+        }
+
+        // Most refreshes find the products unchanged (often straight from a 304), so skip parsing them again
+        QByteArray known_digest;
+        const auto digest_it = manifest_digests.find(remote.first);
+        if (digest_it != manifest_digests.end() && find_current(remote.first) != current_manifests->end())
+            known_digest = digest_it->second;
+
+        fetches.emplace_back(&remote, QtConcurrent::run(fetch_remote, QString::fromStdString(remote.second),
+                                                        known_digest, url_downloader));
+    }
+
+    for (auto& fetch : fetches)
+        fetch.second.waitForFinished();
 
-            manifests.emplace_back(
-                std::make_pair(remote.first, download_manifest(QString::fromStdString(remote.second), url_downloader)));
+    auto fetched_manifests = std::make_shared<Manifests>();
+    auto parsed_any = false;
+
+    for (auto& fetch : fetches)
+    {
+        const auto& remote = *fetch.first;
+        const auto result = fetch.second.result();
+        const auto current = find_current(remote.first);
+        auto keep_current = [&current, &current_manifests, &fetched_manifests] {
+            if (current != current_manifests->end())
+                fetched_manifests->push_back(*current);
+        };
+
+        try
+        {
+            if (result.error)
+                std::rethrow_exception(result.error);
+
+            if (!result.manifest)
+            {
+                mpl::log(mpl::Level::debug, category, fmt::format("Manifest for \"{}\" is unchanged", remote.first));
+                keep_current();
+                continue;
+            }
+
+            fetched_manifests->emplace_back(remote.first, result.manifest);
+            manifest_digests[remote.first] = result.digest;
+            parsed_any = true;
         }
         catch (mp::EmptyManifestException& /* e */)
         {
@@ -245,39 +340,37 @@ void mp::UbuntuVMImageHost::fetch_manifests()
         }
         catch (mp::GenericManifestException& e)
         {
+            // Readers are better off with the stale products than with none
             on_manifest_update_failure(e.what());
+            keep_current();
         }
         catch (mp::DownloadException& e)
         {
             on_manifest_update_failure(e.what());
-        }
-        catch (const mp::UnsupportedRemoteException&)
-        {
-            continue;
+            keep_current();
         }
     }
-}
 
-void mp::UbuntuVMImageHost::clear()
-{
-    manifests.clear();
+    if (parsed_any || fetched_manifests->size() != current_manifests->size())
+        save_cached_manifests(*fetched_manifests);
+
+    std::atomic_store(&manifests, std::shared_ptr<const Manifests>{std::move(fetched_manifests)});
 }
 
-mp::SimpleStreamsManifest* mp::UbuntuVMImageHost::manifest_from(const std::string& remote)
+std::shared_ptr<const mp::SimpleStreamsManifest> mp::UbuntuVMImageHost::manifest_from(const std::string& remote)
 {
     check_remote_is_supported(remote);
 
     update_manifests();
 
-    auto it = std::find_if(manifests.begin(), manifests.end(),
-                           [&remote](const std::pair<std::string, std::unique_ptr<SimpleStreamsManifest>>& element) {
-                               return element.first == remote;
-                           });
+    const auto current_manifests = std::atomic_load(&manifests);
+    auto it = std::find_if(current_manifests->begin(), current_manifests->end(),
+                           [&remote](const auto& element) { return element.first == remote; });
 
-    if (it == manifests.cend())
+    if (it == current_manifests->cend())
         throw std::runtime_error(fmt::format("Remote \"{}\" is unknown or unreachable.", remote));
 
-    return it->second.get();
+    return it->second;
 }
 
 const mp::VMImageInfo* mp::UbuntuVMImageHost::match_alias(const QString& key,
@@ -305,3 +398,40 @@ std::string mp::UbuntuVMImageHost::remote_url_from(const std::string& remote_nam
 
     return url;
 }
+
+void mp::UbuntuVMImageHost::restore_cached_manifests()
+{
+    Manifests restored;
+    for (auto& cached : manifest_cache.load())
+    {
+        auto known = std::any_of(remotes.cbegin(), remotes.cend(),
+                                 [&cached](const auto& remote) { return remote.first == cached.remote; });
+        if (!known || cached.products.empty() || !MP_PLATFORM.is_remote_supported(cached.remote))
+            continue;
+
+        manifest_digests[cached.remote] = cached.digest;
+        restored.emplace_back(cached.remote,
+                              mp::SimpleStreamsManifest::fromProducts(cached.updated_at, std::move(cached.products)));
+    }
+
+    if (!restored.empty())
+    {
+        mpl::log(mpl::Level::debug, category, fmt::format("Restored {} cached manifest(s)", restored.size()));
+        manifests = std::make_shared<const Manifests>(std::move(restored));
+        on_manifests_restored();
+    }
+}
+
+void mp::UbuntuVMImageHost::save_cached_manifests(const Manifests& manifests) const
+{
+    std::vector<CachedManifest> cached;
+    for (const auto& manifest : manifests)
+    {
+        const auto digest_it = manifest_digests.find(manifest.first);
+        cached.push_back({manifest.first, manifest.second->updated_at,
+                          digest_it != manifest_digests.end() ? digest_it->second : QByteArray{},
+                          manifest.second->products});
+    }
+
+    manifest_cache.save(cached);
+}
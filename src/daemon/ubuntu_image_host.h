@@ -19,11 +19,15 @@
 #define MULTIPASS_UBUNTU_IMAGE_HOST_H
 
 #include "common_image_host.h"
+#include "image_manifest_cache.h"
 #include "multipass/simple_streams_manifest.h"
 
+#include <QByteArray>
 #include <QString>
 
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -38,7 +42,8 @@ class UbuntuVMImageHost final : public CommonVMImageHost
 {
 public:
     UbuntuVMImageHost(std::vector<std::pair<std::string, std::string>> remotes, URLDownloader* downloader,
-                      std::chrono::seconds manifest_time_to_live);
+                      std::chrono::seconds manifest_time_to_live, const QString& manifest_cache_path = QString());
+    ~UbuntuVMImageHost() override;
 
     optional<VMImageInfo> info_for(const Query& query) override;
     std::vector<std::pair<std::string, VMImageInfo>> all_info_for(const Query& query) override;
@@ -49,16 +54,21 @@ protected:
     void for_each_entry_do_impl(const Action& action) override;
     VMImageInfo info_for_full_hash_impl(const std::string& full_hash) override;
     void fetch_manifests() override;
-    void clear() override;
 
 private:
-    SimpleStreamsManifest* manifest_from(const std::string& remote);
+    using Manifests = std::vector<std::pair<std::string, std::shared_ptr<const SimpleStreamsManifest>>>;
+
+    std::shared_ptr<const SimpleStreamsManifest> manifest_from(const std::string& remote);
     const VMImageInfo* match_alias(const QString& key, const SimpleStreamsManifest& manifest) const;
-    std::vector<std::pair<std::string, std::unique_ptr<SimpleStreamsManifest>>> manifests;
+    std::shared_ptr<const Manifests> manifests; // only ever swapped whole, with std::atomic_load/store
+    std::unordered_map<std::string, QByteArray> manifest_digests;
     URLDownloader* const url_downloader;
     std::vector<std::pair<std::string, std::string>> remotes;
     std::string remote_url_from(const std::string& remote_name);
+    void restore_cached_manifests();
+    void save_cached_manifests(const Manifests& manifests) const;
     QString index_path;
+    const ImageManifestCache manifest_cache;
 };
 }
 #endif // MULTIPASS_UBUNTU_IMAGE_HOST_H
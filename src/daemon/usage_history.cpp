@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "usage_history.h"
+
+#include <algorithm>
+
+namespace mp = multipass;
+
+namespace
+{
+// Growth of a counter over consecutive samples, with the instance restarting, and the counter with it, in between
+template <typename Member>
+mp::optional<long long> growth(std::vector<mp::UsageHistory::Sample>::const_iterator first,
+                               std::vector<mp::UsageHistory::Sample>::const_iterator last, Member counter)
+{
+    mp::optional<long long> total;
+    for (auto it = first; it != last; ++it)
+    {
+        const auto& before = (*it).*counter;
+        const auto& after = (*std::next(it)).*counter;
+        if (before && after)
+            total = total.value_or(0) + (*after >= *before ? *after - *before : *after);
+    }
+
+    return total;
+}
+
+template <typename Member>
+mp::optional<long long> average(std::vector<mp::UsageHistory::Sample>::const_iterator first,
+                                std::vector<mp::UsageHistory::Sample>::const_iterator last, Member gauge)
+{
+    long long sum{0}, count{0};
+    for (auto it = first; it != last; ++it)
+    {
+        if (const auto& value = (*it).*gauge)
+        {
+            sum += *value;
+            ++count;
+        }
+    }
+
+    if (!count)
+        return mp::nullopt;
+
+    return sum / count;
+}
+} // namespace
+
+mp::UsageHistory::UsageHistory(std::size_t capacity) : capacity{std::max<std::size_t>(capacity, 2)}
+{
+}
+
+void mp::UsageHistory::add(const std::string& instance, const Sample& sample)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+
+    auto& ring = rings[instance];
+    if (ring.samples.size() < capacity)
+    {
+        ring.samples.reserve(capacity); // all at once, so that the memory taken stays as it is from then on
+        ring.samples.push_back(sample);
+    }
+    else
+    {
+        ring.samples[ring.next] = sample;
+        ring.next = (ring.next + 1) % capacity;
+    }
+}
+
+void mp::UsageHistory::forget(const std::string& instance)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    rings.erase(instance);
+}
+
+std::vector<mp::UsageHistory::Point> mp::UsageHistory::history(const std::string& instance,
+                                                               std::size_t max_points) const
+{
+    std::vector<Sample> samples;
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        auto it = rings.find(instance);
+        if (it == rings.end())
+            return {};
+
+        const auto& ring = it->second;
+        samples.reserve(ring.samples.size());
+        samples.insert(samples.end(), ring.samples.begin() + ring.next, ring.samples.end());
+        samples.insert(samples.end(), ring.samples.begin(), ring.samples.begin() + ring.next);
+    }
+
+    // Rates need a sample before, so the first one only starts the first period
+    if (samples.size() < 2)
+        return {};
+
+    const auto periods = samples.size() - 1;
+    const auto points = max_points ? std::min(max_points, periods) : periods;
+
+    std::vector<Point> history;
+    history.reserve(points);
+    for (std::size_t i = 0; i < points; ++i)
+    {
+        const auto first = samples.cbegin() + i * periods / points;
+        const auto last = samples.cbegin() + (i + 1) * periods / points;
+        const auto seconds = std::chrono::duration<double>(last->time - first->time).count();
+
+        auto rate = [seconds](const optional<long long>& growth, double scale = 1.0) -> optional<double> {
+            if (!growth || seconds <= 0)
+                return nullopt;
+            return *growth / scale / seconds;
+        };
+
+        Point point;
+        point.time = last->time;
+        point.cpu_cores = rate(growth(first, last, &Sample::cpu_time_ms), 1000.0);
+        point.net_rx_rate = rate(growth(first, last, &Sample::net_rx_bytes));
+        point.net_tx_rate = rate(growth(first, last, &Sample::net_tx_bytes));
+        point.memory_used = average(std::next(first), std::next(last), &Sample::memory_used);
+        point.disk_used = average(std::next(first), std::next(last), &Sample::disk_used);
+        history.push_back(point);
+    }
+
+    return history;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_USAGE_HISTORY_H
+#define MULTIPASS_USAGE_HISTORY_H
+
+#include <multipass/optional.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace multipass
+{
+// Resource usage of the instances over time, in a fixed number of samples per instance, the newest taking the place
+// of the oldest. Counters are kept as sampled and only turned into rates as the history is read back, downsampled to
+// as few points as asked for.
+class UsageHistory
+{
+public:
+    using Clock = std::chrono::system_clock;
+
+    struct Sample
+    {
+        Clock::time_point time;
+        optional<long long> cpu_time_ms; // counters, since the instance started
+        optional<long long> net_rx_bytes;
+        optional<long long> net_tx_bytes;
+        optional<long long> memory_used; // gauges, in bytes
+        optional<long long> disk_used;
+    };
+
+    // The period since the point before, with rates per second over it and the gauges averaged
+    struct Point
+    {
+        Clock::time_point time;
+        optional<double> cpu_cores;
+        optional<double> net_rx_rate;
+        optional<double> net_tx_rate;
+        optional<long long> memory_used;
+        optional<long long> disk_used;
+    };
+
+    explicit UsageHistory(std::size_t capacity);
+
+    void add(const std::string& instance, const Sample& sample);
+    void forget(const std::string& instance);
+
+    // Oldest first, in no more than max_points points, or one per sample when that is 0
+    std::vector<Point> history(const std::string& instance, std::size_t max_points) const;
+
+private:
+    struct Ring
+    {
+        std::vector<Sample> samples;
+        std::size_t next{0}; // where the next sample goes, once the ring is full
+    };
+
+    const std::size_t capacity;
+    mutable std::mutex mutex; // samples are added by the main thread and read by gRPC ones
+    std::unordered_map<std::string, Ring> rings;
+};
+} // namespace multipass
+#endif // MULTIPASS_USAGE_HISTORY_H
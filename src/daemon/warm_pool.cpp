@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "warm_pool.h"
+
+#include <multipass/constants.h>
+#include <multipass/exceptions/invalid_memory_size_exception.h>
+#include <multipass/settings.h>
+#include <multipass/utils.h>
+
+#include <QString>
+
+namespace mp = multipass;
+
+namespace
+{
+constexpr auto pool_instance_prefix = "warm-pool.";
+constexpr auto default_image = "default";
+
+std::string image_or_default(const std::string& image)
+{
+    return image.empty() ? default_image : image;
+}
+
+mp::MemorySize size_or(const std::string& size, const char* default_size)
+{
+    return mp::MemorySize{size.empty() ? default_size : size};
+}
+} // namespace
+
+mp::WarmPoolSpec mp::WarmPoolSpec::from_settings()
+{
+    const auto& settings = MP_SETTINGS;
+    const auto image = settings.get(warm_pool_image_key);
+
+    return {settings.get_as<int>(warm_pool_size_key),
+            image.contains(':') ? image.section(':', 0, 0).toStdString() : std::string{},
+            image_or_default(image.section(':', -1).toStdString()),
+            settings.get_as<int>(warm_pool_cpus_key),
+            MemorySize{settings.get(warm_pool_memory_key).toStdString()},
+            MemorySize{settings.get(warm_pool_disk_key).toStdString()}};
+}
+
+std::string mp::WarmPoolSpec::instance_name(int slot)
+{
+    return pool_instance_prefix + std::to_string(slot);
+}
+
+bool mp::WarmPoolSpec::is_pool_instance(const std::string& name)
+{
+    return name.rfind(pool_instance_prefix, 0) == 0;
+}
+
+mp::LaunchRequest mp::WarmPoolSpec::launch_request(const std::string& name) const
+{
+    LaunchRequest request;
+    request.set_instance_name(name);
+    request.set_remote_name(remote_name);
+    request.set_image(image);
+    request.set_num_cores(num_cores);
+    request.set_mem_size(std::to_string(mem_size.in_bytes()));
+    request.set_disk_space(std::to_string(disk_space.in_bytes()));
+
+    return request;
+}
+
+bool mp::WarmPoolSpec::matches(const LaunchRequest& request) const
+{
+    try
+    {
+        return size > 0 && request.remote_name() == remote_name && image_or_default(request.image()) == image &&
+               (request.num_cores() > 0 ? request.num_cores() : std::stoi(default_cpu_cores)) == num_cores &&
+               size_or(request.mem_size(), default_memory_size) == mem_size &&
+               size_or(request.disk_space(), default_disk_size) == disk_space && request.kernel_name().empty() &&
+               request.cloud_init_user_data().empty() && request.network_options().empty() &&
+               (request.storage_profile().empty() || request.storage_profile() == default_storage_profile) &&
+               request.io_limits().ByteSizeLong() == 0; // no limits set
+    }
+    catch (const InvalidMemorySizeException&)
+    {
+        return false;
+    }
+}
+
+bool mp::operator==(const WarmPoolSpec& a, const WarmPoolSpec& b)
+{
+    return a.size == b.size && a.remote_name == b.remote_name && a.image == b.image && a.num_cores == b.num_cores &&
+           a.mem_size == b.mem_size && a.disk_space == b.disk_space;
+}
+
+bool mp::operator!=(const WarmPoolSpec& a, const WarmPoolSpec& b)
+{
+    return !(a == b);
+}
+
+std::vector<std::string> mp::warm_pool_handover_commands(const std::string& name, const std::string& time_zone)
+{
+    // The time zone comes straight from the client
+    std::vector<std::string> commands{"sudo hostnamectl set-hostname " + mp::utils::escape_for_shell(name)};
+    if (!time_zone.empty())
+        commands.push_back("sudo timedatectl set-timezone " + mp::utils::escape_for_shell(time_zone));
+
+    return commands;
+}
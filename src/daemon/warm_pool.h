@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_WARM_POOL_H
+#define MULTIPASS_WARM_POOL_H
+
+#include <multipass/memory_size.h>
+#include <multipass/rpc/multipass.grpc.pb.h>
+
+#include <string>
+#include <vector>
+
+namespace multipass
+{
+// What the pool of pre-booted, suspended instances is made of, as configured in the local.warm-pool.* settings. A
+// launch can take an instance from the pool when it asks for nothing the pool instances were not booted with.
+struct WarmPoolSpec
+{
+    int size;
+    std::string remote_name;
+    std::string image;
+    int num_cores;
+    MemorySize mem_size;
+    MemorySize disk_space;
+
+    static WarmPoolSpec from_settings();
+
+    // Pool instances go by names that are not valid hostnames, so that no user instance can ever clash with them
+    static std::string instance_name(int slot);
+    static bool is_pool_instance(const std::string& name);
+
+    // The request a pool instance is launched with
+    LaunchRequest launch_request(const std::string& name) const;
+    bool matches(const LaunchRequest& request) const;
+};
+
+bool operator==(const WarmPoolSpec& a, const WarmPoolSpec& b);
+bool operator!=(const WarmPoolSpec& a, const WarmPoolSpec& b);
+
+// What a pool instance is told over SSH once it is handed to a launch, to take on what the launch asked for
+std::vector<std::string> warm_pool_handover_commands(const std::string& name, const std::string& time_zone);
+} // namespace multipass
+#endif // MULTIPASS_WARM_POOL_H
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "zsync.h"
+
+#include <multipass/format.h>
+
+#include <QCryptographicHash>
+#include <QFile>
+
+#include <stdexcept>
+#include <unordered_map>
+
+namespace mp = multipass;
+
+namespace
+{
+// zsync's rolling checksum: the sum of the bytes, and the sum of the bytes weighed by how far they are from the end
+struct RollingSum
+{
+    quint16 a{0};
+    quint16 b{0};
+
+    void reset(const uchar* data, int size)
+    {
+        a = b = 0;
+        for (auto i = 0; i < size; ++i)
+        {
+            a = static_cast<quint16>(a + data[i]);
+            b = static_cast<quint16>(b + (size - i) * data[i]);
+        }
+    }
+
+    // Slides the window on by one byte
+    void roll(uchar out, uchar in, int size)
+    {
+        a = static_cast<quint16>(a + in - out);
+        b = static_cast<quint16>(b + a - size * out);
+    }
+
+    quint32 value() const
+    {
+        return static_cast<quint32>(a) << 16 | b;
+    }
+};
+
+QByteArray checksum(const uchar* data, int size, int checksum_bytes)
+{
+    return QCryptographicHash::hash(QByteArray::fromRawData(reinterpret_cast<const char*>(data), size),
+                                    QCryptographicHash::Md4)
+        .left(checksum_bytes);
+}
+
+quint64 key_of(quint32 rsum, quint32 next_rsum)
+{
+    return static_cast<quint64>(rsum) << 32 | next_rsum;
+}
+} // namespace
+
+qint64 mp::zsync::ControlFile::block_count() const
+{
+    return block_size > 0 ? (length + block_size - 1) / block_size : 0;
+}
+
+mp::zsync::ControlFile mp::zsync::parse(const QByteArray& data)
+{
+    const auto header_end = data.indexOf("\n\n");
+    if (header_end < 0)
+        throw std::runtime_error("zsync control file without a header");
+
+    ControlFile control;
+    for (const auto& line : data.left(header_end).split('\n'))
+    {
+        const auto separator = line.indexOf(": ");
+        if (separator < 0)
+            continue;
+
+        const auto key = line.left(separator);
+        const auto value = QString::fromUtf8(line.mid(separator + 2)).trimmed();
+        if (key == "Length")
+            control.length = value.toLongLong();
+        else if (key == "Blocksize")
+            control.block_size = value.toInt();
+        else if (key == "URL")
+            control.url = value;
+        else if (key == "Z-URL" || key == "Z-Map2")
+            throw std::runtime_error("zsync control file for a compressed file");
+        else if (key == "Hash-Lengths")
+        {
+            const auto lengths = value.split(',');
+            if (lengths.size() != 3)
+                throw std::runtime_error(fmt::format("invalid zsync hash lengths: {}", value));
+
+            control.seq_matches = lengths[0].toInt();
+            control.rsum_bytes = lengths[1].toInt();
+            control.checksum_bytes = lengths[2].toInt();
+        }
+    }
+
+    if (control.length <= 0 || control.block_size <= 0 || control.seq_matches < 1 || control.seq_matches > 2 ||
+        control.rsum_bytes < 1 || control.rsum_bytes > 4 || control.checksum_bytes < 1 || control.checksum_bytes > 16)
+        throw std::runtime_error("invalid zsync control file header");
+
+    const auto entry_size = control.rsum_bytes + control.checksum_bytes;
+    const auto sums = data.mid(header_end + 2);
+    if (sums.size() != control.block_count() * entry_size)
+        throw std::runtime_error(fmt::format("zsync control file with {} bytes of checksums for {} blocks", sums.size(),
+                                             control.block_count()));
+
+    for (qint64 offset = 0; offset < sums.size(); offset += entry_size)
+    {
+        quint32 rsum = 0;
+        for (auto i = 0; i < control.rsum_bytes; ++i)
+            rsum = rsum << 8 | static_cast<uchar>(sums[static_cast<int>(offset) + i]);
+
+        control.rsums.push_back(rsum);
+        control.checksums.push_back(sums.mid(static_cast<int>(offset) + control.rsum_bytes, control.checksum_bytes));
+    }
+
+    return control;
+}
+
+quint32 mp::zsync::rsum(const char* data, int size)
+{
+    RollingSum sum;
+    sum.reset(reinterpret_cast<const uchar*>(data), size);
+    return sum.value();
+}
+
+// Slides a window over the seed, a byte at a time, and looks its weak checksum up among the blocks'. Only on a hit is
+// the strong checksum computed. With sequential matches, the window spans two blocks, so that the pair of weak
+// checksums keeps hits, and strong checksums, rare however short the checksums are truncated.
+std::vector<qint64> mp::zsync::match(const ControlFile& control, const QString& seed_path)
+{
+    const auto block_count = control.block_count();
+    std::vector<qint64> sources(block_count, -1);
+
+    QFile seed{seed_path};
+    if (!seed.open(QIODevice::ReadOnly))
+        return sources;
+
+    const auto block_size = control.block_size;
+    const auto pairs = control.seq_matches > 1;
+    const auto window = pairs ? 2LL * block_size : static_cast<qint64>(block_size);
+    const auto size = seed.size();
+    const auto data = size >= window ? seed.map(0, size) : nullptr;
+    if (!data)
+        return sources;
+
+    const quint32 mask = control.rsum_bytes >= 4 ? 0xffffffffu : (1u << (8 * control.rsum_bytes)) - 1;
+    const auto first_blocks = pairs ? block_count - 1 : block_count;
+    std::unordered_multimap<quint64, qint64> blocks;
+    for (qint64 i = 0; i < first_blocks; ++i)
+        blocks.emplace(key_of(control.rsums[i], pairs ? control.rsums[i + 1] : 0), i);
+
+    RollingSum sum, next_sum;
+    auto reset = [&](qint64 offset) {
+        sum.reset(data + offset, block_size);
+        if (pairs)
+            next_sum.reset(data + offset + block_size, block_size);
+    };
+
+    reset(0);
+    for (qint64 offset = 0; offset + window <= size;)
+    {
+        auto matched = false;
+        const auto hits = blocks.equal_range(key_of(sum.value() & mask, pairs ? next_sum.value() & mask : 0));
+        if (hits.first != hits.second)
+        {
+            const auto strong = checksum(data + offset, block_size, control.checksum_bytes);
+            const auto next_strong =
+                pairs ? checksum(data + offset + block_size, block_size, control.checksum_bytes) : QByteArray{};
+
+            for (auto hit = hits.first; hit != hits.second; ++hit)
+            {
+                const auto block = hit->second;
+                if (control.checksums[block] != strong || (pairs && control.checksums[block + 1] != next_strong))
+                    continue;
+
+                matched = true;
+                if (sources[block] < 0)
+                    sources[block] = offset;
+                if (pairs && sources[block + 1] < 0)
+                    sources[block + 1] = offset + block_size;
+            }
+        }
+
+        // Blocks of the file seldom overlap in the seed, so the search goes on past a match
+        if (matched)
+        {
+            offset += block_size;
+            if (offset + window <= size)
+                reset(offset);
+            continue;
+        }
+
+        if (offset + window < size)
+        {
+            sum.roll(data[offset], data[offset + block_size], block_size);
+            if (pairs)
+                next_sum.roll(data[offset + block_size], data[offset + window], block_size);
+        }
+        ++offset;
+    }
+
+    return sources;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_ZSYNC_H
+#define MULTIPASS_ZSYNC_H
+
+#include <QByteArray>
+#include <QString>
+
+#include <vector>
+
+namespace multipass
+{
+namespace zsync
+{
+// What a .zsync control file says about the file it describes: its length, and a weak rolling checksum and a truncated
+// MD4 of each of its blocks, by which an older version of the file can be searched for the blocks it still has
+struct ControlFile
+{
+    qint64 length{0};
+    int block_size{0};
+    int seq_matches{1}; // consecutive blocks that have to match together, for checksums truncated this short
+    int rsum_bytes{4};
+    int checksum_bytes{16};
+    QString url; // of the file, relative to the control file's; empty for the control file's own without ".zsync"
+    std::vector<quint32> rsums; // the low rsum_bytes of each block's
+    std::vector<QByteArray> checksums;
+
+    qint64 block_count() const;
+};
+
+// Throws std::runtime_error for control files that are malformed, or describe compressed files
+ControlFile parse(const QByteArray& data);
+
+// The weak checksum of a block, which zsync pads with zeroes to the block size when it is the file's last
+quint32 rsum(const char* data, int size);
+
+// Where in the seed each block of the file can be copied from, or -1 for the blocks that have to be downloaded
+std::vector<qint64> match(const ControlFile& control, const QString& seed_path);
+} // namespace zsync
+} // namespace multipass
+#endif // MULTIPASS_ZSYNC_H
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/format.h>
+#include <multipass/instrumentation.h>
+
+#include <algorithm>
+#include <atomic>
+
+namespace mp = multipass;
+
+namespace
+{
+std::string series(const std::string& name, const std::string& suffix, const std::string& labels,
+                   const std::string& extra_label = {})
+{
+    auto all_labels = labels;
+    if (!extra_label.empty())
+        all_labels += (all_labels.empty() ? "" : ",") + extra_label;
+
+    return all_labels.empty() ? name + suffix : fmt::format("{}{}{{{}}}", name, suffix, all_labels);
+}
+
+std::atomic<quint64> next_generation{0};
+
+auto microseconds(std::chrono::steady_clock::duration duration)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+} // namespace
+
+mp::Instrumentation::Instrumentation(const Singleton<Instrumentation>::PrivatePass& pass) noexcept
+    : Singleton<Instrumentation>::Singleton{pass}, generation{next_generation++}
+{
+}
+
+std::size_t mp::Instrumentation::bucket_of(Clock::duration duration)
+{
+    const auto seconds = std::chrono::duration<double>(duration).count();
+    return std::lower_bound(buckets.cbegin(), buckets.cend(), seconds) - buckets.cbegin();
+}
+
+void mp::Instrumentation::observe(const std::string& name, const std::string& labels, Clock::duration duration)
+{
+    const auto bucket = bucket_of(duration);
+
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    auto& histogram = histograms[{name, labels}];
+    if (bucket < buckets.size())
+        ++histogram.bucket_counts[bucket];
+    ++histogram.count;
+    histogram.sum += std::chrono::duration<double>(duration).count();
+}
+
+void mp::Instrumentation::observe_histogram(const std::string& name, const std::string& labels,
+                                            const std::array<quint64, buckets.size()>& bucket_counts, quint64 count,
+                                            double sum)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    auto& histogram = histograms[{name, labels}];
+    for (auto i = 0u; i < buckets.size(); ++i)
+        histogram.bucket_counts[i] += bucket_counts[i];
+    histogram.count += count;
+    histogram.sum += sum;
+}
+
+void mp::Instrumentation::add(const std::string& name, const std::string& labels, quint64 amount)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    counters[{name, labels}] += amount;
+}
+
+void mp::Instrumentation::set(const std::string& name, const std::string& labels, quint64 value)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    gauges[{name, labels}] = value;
+}
+
+std::string mp::Instrumentation::openmetrics() const
+{
+    fmt::memory_buffer out;
+    std::string last_name;
+
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    for (const auto& entry : histograms)
+    {
+        const auto& name = entry.first.first;
+        const auto& labels = entry.first.second;
+        const auto& histogram = entry.second;
+
+        if (name != last_name)
+            fmt::format_to(out, "# TYPE {} histogram\n", last_name = name);
+
+        quint64 cumulative = 0;
+        for (auto i = 0u; i < buckets.size(); ++i)
+        {
+            cumulative += histogram.bucket_counts[i];
+            fmt::format_to(out, "{} {}\n", series(name, "_bucket", labels, fmt::format("le=\"{:g}\"", buckets[i])),
+                           cumulative);
+        }
+        fmt::format_to(out, "{} {}\n", series(name, "_bucket", labels, "le=\"+Inf\""), histogram.count);
+        fmt::format_to(out, "{} {}\n", series(name, "_count", labels), histogram.count);
+        fmt::format_to(out, "{} {}\n", series(name, "_sum", labels), histogram.sum);
+    }
+
+    for (const auto& entry : counters)
+    {
+        const auto& name = entry.first.first;
+        if (name != last_name)
+            fmt::format_to(out, "# TYPE {} counter\n", last_name = name);
+
+        fmt::format_to(out, "{} {}\n", series(name, "_total", entry.first.second), entry.second);
+    }
+
+    for (const auto& entry : gauges)
+    {
+        const auto& name = entry.first.first;
+        if (name != last_name)
+            fmt::format_to(out, "# TYPE {} gauge\n", last_name = name);
+
+        fmt::format_to(out, "{} {}\n", series(name, "", entry.first.second), entry.second);
+    }
+
+    fmt::format_to(out, "# EOF\n");
+    return fmt::to_string(out);
+}
+
+void mp::Instrumentation::trace(const char* category, const char* name, Clock::time_point start,
+                                Clock::duration duration)
+{
+    auto& ring = ring_for_this_thread();
+
+    std::lock_guard<decltype(ring.mutex)> lock{ring.mutex};
+    ring.spans[ring.recorded++ % spans_per_thread] = {category, name, start, duration};
+}
+
+std::string mp::Instrumentation::chrome_trace() const
+{
+    std::vector<std::shared_ptr<SpanRing>> all_rings;
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        for (const auto& ring : rings)
+            if (auto live_ring = ring.lock())
+                all_rings.push_back(std::move(live_ring));
+    }
+
+    fmt::memory_buffer out;
+    fmt::format_to(out, "{{\"traceEvents\":[");
+
+    auto separator = "";
+    for (auto thread = 0u; thread < all_rings.size(); ++thread)
+    {
+        auto& ring = *all_rings[thread];
+
+        std::lock_guard<decltype(ring.mutex)> lock{ring.mutex};
+        const auto count = std::min(ring.recorded, spans_per_thread);
+        for (auto i = ring.recorded - count; i < ring.recorded; ++i)
+        {
+            const auto& span = ring.spans[i % spans_per_thread];
+            fmt::format_to(out,
+                           "{}{{\"cat\":\"{}\",\"name\":\"{}\",\"ph\":\"X\",\"ts\":{},\"dur\":{},\"pid\":1,"
+                           "\"tid\":{}}}",
+                           separator, span.category, span.name, microseconds(span.start.time_since_epoch()),
+                           microseconds(span.duration), thread + 1);
+            separator = ",";
+        }
+    }
+
+    fmt::format_to(out, "]}}");
+    return fmt::to_string(out);
+}
+
+auto mp::Instrumentation::ring_for_this_thread() -> SpanRing&
+{
+    // Each thread registers a ring the first time it traces, and again if the instance was replaced since
+    thread_local quint64 ring_generation{0};
+    thread_local std::shared_ptr<SpanRing> ring;
+
+    if (!ring || ring_generation != generation)
+    {
+        ring = std::make_shared<SpanRing>();
+        ring_generation = generation;
+
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        rings.erase(std::remove_if(rings.begin(), rings.end(), [](const auto& ring) { return ring.expired(); }),
+                    rings.end()); // those of threads that are gone
+        rings.push_back(ring);
+    }
+
+    return *ring;
+}
+
+mp::TraceSpan::TraceSpan(const char* category, const char* name)
+    : category{category}, name{name}, start{Instrumentation::Clock::now()}
+{
+}
+
+mp::TraceSpan::~TraceSpan()
+{
+    MP_INSTRUMENTATION.trace(category, name, start, Instrumentation::Clock::now() - start);
+}
+
+mp::ScopedTiming::ScopedTiming(std::string name, std::string labels)
+    : name{std::move(name)}, labels{std::move(labels)}, start{Instrumentation::Clock::now()}
+{
+}
+
+mp::ScopedTiming::~ScopedTiming()
+{
+    MP_INSTRUMENTATION.observe(name, labels, Instrumentation::Clock::now() - start);
+}
@@ -21,8 +21,10 @@
 
 #include <QFile>
 
+#include <algorithm>
 #include <array>
 #include <cctype>
+#include <stdexcept>
 
 namespace mp = multipass;
 
@@ -96,10 +98,15 @@ void set_at(T& t, SizeType offset, const V& value)
     std::copy(std::begin(value), std::end(value), t.begin() + offset);
 }
 
+// Copies a structure into the image at the given byte offset, returning the offset right after it
 template <typename T>
-void write(const T& t, QFile& f)
+uint32_t put(std::string& image, uint32_t offset, const T& t)
 {
-    f.write(reinterpret_cast<const char*>(t.data.data()), t.data.size());
+    if (offset + t.data.size() > image.size())
+        throw std::runtime_error{"too many files for cloud-init generation"};
+
+    std::copy(t.data.begin(), t.data.end(), image.begin() + offset);
+    return offset + t.data.size();
 }
 
 template <size_t size>
@@ -365,18 +372,23 @@ Size num_blocks(Size num_bytes)
     return ((num_bytes + logical_block_size - 1) / logical_block_size);
 }
 
-void seek_to_next_block(QFile& f)
+// The descriptors only differ in a few fields from one ISO to the next, so the rest is built once
+const PrimaryVolumeDescriptor& primary_descriptor_template()
 {
-    const auto next_block_pos = num_blocks(f.pos()) * logical_block_size;
-    f.seek(next_block_pos);
+    static const PrimaryVolumeDescriptor descriptor;
+    return descriptor;
 }
 
-void pad_to_end(QFile& f)
+const JolietVolumeDescriptor& joliet_descriptor_template()
 {
-    seek_to_next_block(f);
-    f.seek(f.pos() - 1);
-    char end = 0;
-    f.write(&end, 1);
+    static const JolietVolumeDescriptor descriptor;
+    return descriptor;
+}
+
+const VolumeDescriptorSetTerminator& terminator()
+{
+    static const VolumeDescriptorSetTerminator descriptor;
+    return descriptor;
 }
 } // namespace
 
@@ -385,18 +397,25 @@ void mp::CloudInitIso::add_file(const std::string& name, const std::string& data
     files.push_back(FileEntry{name, data});
 }
 
+// The whole image is laid out in memory first and then written in one go; it is only a few blocks
 void mp::CloudInitIso::write_to(const Path& path)
 {
     QFile f{path};
     if (!f.open(QIODevice::WriteOnly))
         throw std::runtime_error{"failed to open file for writing during cloud-init generation"};
 
+    const auto image = make_image();
+    if (f.write(image.data(), image.size()) != static_cast<qint64>(image.size()))
+        throw std::runtime_error{"failed to write file during cloud-init generation"};
+}
+
+std::string mp::CloudInitIso::make_image() const
+{
     const uint32_t num_reserved_bytes = 32768u;
     const uint32_t num_reserved_blocks = num_blocks(num_reserved_bytes);
-    f.seek(num_reserved_bytes);
 
-    PrimaryVolumeDescriptor prim_desc;
-    JolietVolumeDescriptor joliet_desc;
+    auto prim_desc = primary_descriptor_template();
+    auto joliet_desc = joliet_descriptor_template();
 
     const uint32_t num_blocks_for_descriptors = 3u;
     const uint32_t num_blocks_for_path_table = 2u;
@@ -417,61 +436,49 @@ void mp::CloudInitIso::write_to(const Path& path)
     // The following records are simply to specify that a root filesystem exists
     RootPathTable root_path{current_block_index + num_blocks_for_path_table};
     prim_desc.set_path_table_info(root_path.data.size(), current_block_index);
-    ++current_block_index;
+    const auto root_path_block = current_block_index++;
 
     RootPathTable joliet_root_path{current_block_index + num_blocks_for_path_table};
     joliet_desc.set_path_table_info(joliet_root_path.data.size(), current_block_index);
-    ++current_block_index;
+    const auto joliet_root_path_block = current_block_index++;
 
     RootDirRecord root_record{RootDirRecord::Type::root, current_block_index};
     RootDirRecord root_parent_record{RootDirRecord::Type::root_parent, current_block_index};
     prim_desc.set_root_dir_record(root_record);
-    ++current_block_index;
+    const auto dir_records_block = current_block_index++;
 
     RootDirRecord joliet_root_record{RootDirRecord::Type::root, current_block_index};
     RootDirRecord joliet_root_parent_record{RootDirRecord::Type::root_parent, current_block_index};
     joliet_desc.set_root_dir_record(joliet_root_record);
-    ++current_block_index;
+    const auto joliet_dir_records_block = current_block_index++;
 
-    std::vector<ISOFileRecord> iso_file_records;
-    std::vector<JolietFileRecord> joliet_file_records;
+    std::string image(volume_size * logical_block_size, '\0');
+    auto pos = put(image, num_reserved_bytes, prim_desc);
+    pos = put(image, pos, joliet_desc);
+    put(image, pos, terminator());
 
-    for (const auto& entry : files)
-    {
-        iso_file_records.emplace_back(entry.name, current_block_index, entry.data.size());
-        joliet_file_records.emplace_back(entry.name, current_block_index, entry.data.size());
-        current_block_index += num_blocks(entry.data.size());
-    }
-
-    write(prim_desc, f);
-    write(joliet_desc, f);
-    write(VolumeDescriptorSetTerminator(), f);
+    put(image, root_path_block * logical_block_size, root_path);
+    put(image, joliet_root_path_block * logical_block_size, joliet_root_path);
 
-    write(root_path, f);
-    seek_to_next_block(f);
-    write(joliet_root_path, f);
-    seek_to_next_block(f);
-
-    write(root_record, f);
-    write(root_parent_record, f);
-    for (const auto& iso_record : iso_file_records)
-    {
-        write(iso_record, f);
-    }
-    seek_to_next_block(f);
+    const auto dir_records_end = (dir_records_block + 1) * logical_block_size;
+    pos = put(image, dir_records_block * logical_block_size, root_record);
+    pos = put(image, pos, root_parent_record);
 
-    write(joliet_root_record, f);
-    write(joliet_root_parent_record, f);
-    for (const auto& joliet_record : joliet_file_records)
-    {
-        write(joliet_record, f);
-    }
-    seek_to_next_block(f);
+    const auto joliet_dir_records_end = (joliet_dir_records_block + 1) * logical_block_size;
+    auto joliet_pos = put(image, joliet_dir_records_block * logical_block_size, joliet_root_record);
+    joliet_pos = put(image, joliet_pos, joliet_root_parent_record);
 
     for (const auto& entry : files)
     {
-        f.write(entry.data.data(), entry.data.size());
-        seek_to_next_block(f);
+        const auto size = static_cast<uint32_t>(entry.data.size());
+        pos = put(image, pos, ISOFileRecord{entry.name, current_block_index, size});
+        joliet_pos = put(image, joliet_pos, JolietFileRecord{entry.name, current_block_index, size});
+        if (pos > dir_records_end || joliet_pos > joliet_dir_records_end)
+            throw std::runtime_error{"too many files for cloud-init generation"};
+
+        std::copy(entry.data.begin(), entry.data.end(), image.begin() + current_block_index * logical_block_size);
+        current_block_index += num_blocks(size);
     }
-    pad_to_end(f);
+
+    return image;
 }
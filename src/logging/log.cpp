@@ -22,16 +22,67 @@
 #include <QString>
 #include <QtGlobal>
 
+#include <chrono>
+#include <mutex>
 #include <shared_mutex>
 #include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace mpl = multipass::logging;
 
 namespace
 {
-std::shared_timed_mutex mutex;
+std::shared_mutex mutex;
 std::shared_ptr<multipass::logging::Logger> global_logger;
 
+constexpr auto limit_interval = std::chrono::seconds{10};
+constexpr auto limit_burst = 100;
+constexpr auto max_limited_kinds = 1024; // categories can be made up at runtime, after instance names and the like
+
+struct LimitState
+{
+    std::chrono::steady_clock::time_point interval_start;
+    mpl::Level level{mpl::Level::error};
+    int admitted{0};
+    int suppressed{0};
+};
+
+struct Suppressed
+{
+    mpl::Level level;
+    std::string category;
+    std::string format;
+    int count;
+};
+
+std::mutex limits_mutex;
+std::unordered_map<std::string, LimitState> limits; // keyed by category and format
+std::chrono::steady_clock::time_point last_sweep;
+
+// Drops the kinds whose interval is over, which would start afresh anyway, handing back what they had suppressed
+void sweep_limits(std::chrono::steady_clock::time_point now, std::vector<Suppressed>& summaries)
+{
+    last_sweep = now;
+    for (auto it = limits.begin(); it != limits.end();)
+    {
+        if (now - it->second.interval_start < limit_interval)
+        {
+            ++it;
+            continue;
+        }
+
+        if (it->second.suppressed > 0)
+        {
+            const auto separator = it->first.find('\0');
+            summaries.push_back({it->second.level, it->first.substr(0, separator), it->first.substr(separator + 1),
+                                 it->second.suppressed});
+        }
+        it = limits.erase(it);
+    }
+}
+
 mpl::Level to_level(QtMsgType type)
 {
     switch (type)
@@ -60,11 +111,72 @@ void mpl::log(Level level, CString category, CString message)
 {
     std::shared_lock<decltype(mutex)> lock{mutex};
     if (global_logger)
-        global_logger->log(level, category, message);
+    {
+        if (global_logger->enabled_for(level))
+            global_logger->log(level, category, message);
+    }
     else
         fmt::print(stderr, "[{}] [{}] {}\n", as_string(level).c_str(), category.c_str(), message.c_str());
 }
 
+bool mpl::admit_limited(Level level, CString category, CString format)
+{
+    const auto now = std::chrono::steady_clock::now();
+    auto key = std::string{category.c_str()} + '\0' + format.c_str();
+    std::vector<Suppressed> summaries;
+    bool admitted = true;
+
+    {
+        std::lock_guard<decltype(limits_mutex)> lock{limits_mutex};
+        if (now - last_sweep >= limit_interval || limits.size() >= max_limited_kinds)
+            sweep_limits(now, summaries);
+
+        auto it = limits.find(key);
+        if (it == limits.end() && limits.size() < max_limited_kinds)
+            it = limits.emplace(std::move(key), LimitState{now, level}).first;
+
+        // Beyond the cap, a kind goes untracked until others make room
+        if (it != limits.end())
+        {
+            auto& state = it->second;
+            if (now - state.interval_start >= limit_interval)
+            {
+                if (state.suppressed > 0)
+                    summaries.push_back({level, category.c_str(), format.c_str(), state.suppressed});
+                state = LimitState{now, level};
+            }
+
+            if (state.admitted == limit_burst)
+            {
+                ++state.suppressed;
+                admitted = false;
+            }
+            else
+            {
+                ++state.admitted;
+            }
+        }
+    }
+
+    for (const auto& summary : summaries)
+        log(summary.level, summary.category,
+            fmt::format("{} similar messages suppressed: {}", summary.count, summary.format));
+
+    return admitted;
+}
+
+std::size_t mpl::limited_kinds()
+{
+    std::lock_guard<decltype(limits_mutex)> lock{limits_mutex};
+    return limits.size();
+}
+
+bool mpl::enabled(Level level)
+{
+    std::shared_lock<decltype(mutex)> lock{mutex};
+    return !global_logger || global_logger->enabled_for(level);
+}
+
 mpl::Level mpl::get_logging_level()
 {
     if (global_logger)
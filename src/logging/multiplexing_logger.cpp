@@ -22,26 +22,55 @@
 namespace mpl = multipass::logging;
 
 multipass::logging::MultiplexingLogger::MultiplexingLogger(UPtr system_logger)
-    : Logger{system_logger->get_logging_level()}, system_logger{std::move(system_logger)}
+    : Logger{system_logger->get_logging_level()},
+      system_logger{std::move(system_logger)},
+      enabled_level{Level::error}
 {
+    update_enabled_level();
 }
 
 void mpl::MultiplexingLogger::log(mpl::Level level, CString category, CString message) const
 {
+    if (!enabled_for(level))
+        return; // without contending for the mutex
+
     std::shared_lock<decltype(mutex)> lock{mutex};
-    system_logger->log(level, category, message);
+    if (system_logger->enabled_for(level))
+        system_logger->log(level, category, message);
     for (auto logger : loggers)
-        logger->log(level, category, message);
+        if (logger->enabled_for(level))
+            logger->log(level, category, message);
+}
+
+bool mpl::MultiplexingLogger::enabled_for(Level level) const
+{
+    return level <= enabled_level.load(std::memory_order_relaxed);
 }
 
 void mpl::MultiplexingLogger::add_logger(const Logger* logger)
 {
     std::lock_guard<decltype(mutex)> lock{mutex};
     loggers.push_back(logger);
+    update_enabled_level();
 }
 
 void mpl::MultiplexingLogger::remove_logger(const Logger* logger)
 {
     std::lock_guard<decltype(mutex)> lock{mutex};
     loggers.erase(std::remove(loggers.begin(), loggers.end(), logger), loggers.end());
+    update_enabled_level();
+}
+
+void mpl::MultiplexingLogger::update_enabled_level()
+{
+    auto takes = [this](Level level) {
+        auto enabled = [level](auto logger) { return logger->enabled_for(level); };
+        return enabled(system_logger.get()) || std::any_of(loggers.cbegin(), loggers.cend(), enabled);
+    };
+
+    auto level = Level::trace;
+    while (level > Level::error && !takes(level))
+        level = static_cast<Level>(static_cast<int>(level) - 1);
+
+    enabled_level.store(level, std::memory_order_relaxed);
 }
@@ -37,11 +37,11 @@ using namespace std::literals::chrono_literals;
 namespace
 {
 constexpr auto category = "metrics";
-constexpr auto saved_metrics_file = "saved_metrics.json";
+constexpr auto saved_metrics_file = "saved_metrics.json"; // older, single document format
+constexpr auto pending_metrics_file = "pending_metrics.jsonl";
 
-void post_request(const QUrl& metrics_url, const QByteArray& body)
+void post_request(QNetworkAccessManager& manager, const QUrl& metrics_url, const QByteArray& body)
 {
-    QNetworkAccessManager manager;
     QNetworkRequest request{metrics_url};
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
     request.setHeader(QNetworkRequest::ContentLengthHeader, body.size());
@@ -70,24 +70,47 @@ void post_request(const QUrl& metrics_url, const QByteArray& body)
     }
 }
 
+// Pending metrics are journaled one per line, so that adding one does not rewrite those already saved
 auto load_saved_metrics(const mp::Path& data_path)
 {
-    QFile metrics_file{QDir(data_path).filePath(saved_metrics_file)};
+    QJsonArray metrics;
 
-    if (!metrics_file.exists())
-        return QJsonArray();
+    QFile legacy_file{QDir(data_path).filePath(saved_metrics_file)};
+    if (legacy_file.open(QIODevice::ReadOnly))
+        metrics = QJsonDocument::fromJson(legacy_file.readAll()).array();
 
-    metrics_file.open(QIODevice::ReadOnly);
-    auto metrics = QJsonDocument::fromJson(metrics_file.readAll()).array();
+    QFile metrics_file{QDir(data_path).filePath(pending_metrics_file)};
+    if (metrics_file.open(QIODevice::ReadOnly))
+    {
+        while (!metrics_file.atEnd())
+        {
+            auto metric = QJsonDocument::fromJson(metrics_file.readLine()).object();
+            if (!metric.isEmpty()) // skips a line cut short by a crash
+                metrics.push_back(metric);
+        }
+    }
 
     return metrics;
 }
 
-void persist_metrics(const QByteArray& metrics, const mp::Path& data_path)
+void append_metric(const QJsonObject& metric, const mp::Path& data_path)
+{
+    QFile metrics_file{QDir(data_path).filePath(pending_metrics_file)};
+    metrics_file.open(QIODevice::WriteOnly | QIODevice::Append);
+    metrics_file.write(QJsonDocument(metric).toJson(QJsonDocument::Compact) + '\n');
+}
+
+void persist_metrics(const QJsonArray& metrics, const mp::Path& data_path)
 {
-    QFile metrics_file{QDir(data_path).filePath(saved_metrics_file)};
+    QByteArray journal;
+    for (const auto& metric : metrics)
+        journal += QJsonDocument(metric.toObject()).toJson(QJsonDocument::Compact) + '\n';
+
+    QFile metrics_file{QDir(data_path).filePath(pending_metrics_file)};
     metrics_file.open(QIODevice::WriteOnly);
-    metrics_file.write(metrics);
+    metrics_file.write(journal);
+
+    QFile::remove(QDir(data_path).filePath(saved_metrics_file));
 }
 } // namespace
 
@@ -98,6 +121,7 @@ mp::MetricsProvider::MetricsProvider(const QUrl& url, const QString& unique_id,
       metric_batches(load_saved_metrics(data_path)),
       metrics_available{!metric_batches.isEmpty()},
       metrics_sender{[this] {
+          QNetworkAccessManager manager; // reused by every post from this thread
           std::unique_lock<std::mutex> lock(metrics_mutex);
           auto timeout = std::chrono::seconds(3600);
           auto metrics_failed{false};
@@ -118,7 +142,7 @@ mp::MetricsProvider::MetricsProvider(const QUrl& url, const QString& unique_id,
 
               try
               {
-                  post_request(metrics_url, body);
+                  post_request(manager, metrics_url, body);
 
                   if (metrics_failed)
                       metrics_failed = false;
@@ -145,7 +169,7 @@ mp::MetricsProvider::MetricsProvider(const QUrl& url, const QString& unique_id,
                       timeout = std::chrono::seconds::zero();
                   }
 
-                  persist_metrics(QJsonDocument(metric_batches).toJson(QJsonDocument::Compact), data_path);
+                  persist_metrics(metric_batches, data_path);
               }
               catch (const std::exception& e)
               {
@@ -223,7 +247,7 @@ void mp::MetricsProvider::update_and_notify_sender(const QJsonObject& metric)
     {
         std::lock_guard<std::mutex> lck(metrics_mutex);
         metric_batches.push_back(metric);
-        persist_metrics(QJsonDocument(metric_batches).toJson(QJsonDocument::Compact), data_path);
+        append_metric(metric, data_path);
         metrics_available = true;
     }
     metrics_cv.notify_one();
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/download_scheduler.h>
+
+#include <multipass/exceptions/aborted_download_exception.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+
+namespace mp = multipass;
+
+namespace
+{
+// How long a download backs off for more urgent ones before reading on, which keeps its connection alive
+constexpr auto back_off_time = std::chrono::seconds{1};
+constexpr auto abort_poll_interval = std::chrono::milliseconds{100};
+// How far ahead of the byte rate downloads may get after idling
+constexpr auto max_rate_burst = std::chrono::seconds{1};
+
+thread_local auto thread_priority = mp::DownloadScheduler::Priority::interactive;
+
+std::size_t index_of(mp::DownloadScheduler::Priority priority)
+{
+    return static_cast<std::size_t>(priority);
+}
+} // namespace
+
+mp::DownloadScheduler::PriorityScope::PriorityScope(Priority priority) : previous{thread_priority}
+{
+    thread_priority = priority;
+}
+
+mp::DownloadScheduler::PriorityScope::~PriorityScope()
+{
+    thread_priority = previous;
+}
+
+mp::DownloadScheduler::Slot::Slot(DownloadScheduler& scheduler, Priority priority)
+    : scheduler{scheduler}, download_priority{priority}
+{
+}
+
+mp::DownloadScheduler::Slot::~Slot()
+{
+    scheduler.release(download_priority);
+}
+
+mp::DownloadScheduler::Priority mp::DownloadScheduler::Slot::priority() const
+{
+    return download_priority;
+}
+
+mp::DownloadScheduler::DownloadScheduler(const Limits& limits) : limits{limits}
+{
+}
+
+mp::DownloadScheduler::Priority mp::DownloadScheduler::current_priority()
+{
+    return thread_priority;
+}
+
+std::unique_ptr<mp::DownloadScheduler::Slot> mp::DownloadScheduler::acquire(const std::atomic_bool& abort)
+{
+    const auto priority = current_priority();
+
+    std::unique_lock<decltype(mutex)> lock{mutex};
+    ++waiting[index_of(priority)];
+    while (!can_start(priority))
+    {
+        if (abort)
+        {
+            --waiting[index_of(priority)];
+            cv.notify_all();
+            throw AbortedDownloadException{"Operation canceled"};
+        }
+
+        cv.wait_for(lock, abort_poll_interval);
+    }
+
+    --waiting[index_of(priority)];
+    ++running[index_of(priority)];
+
+    return std::unique_ptr<Slot>(new Slot{*this, priority});
+}
+
+void mp::DownloadScheduler::throttle(const Slot& slot, qint64 bytes, const std::atomic_bool& abort)
+{
+    std::unique_lock<decltype(mutex)> lock{mutex};
+
+    const auto back_off_deadline = Clock::now() + back_off_time;
+    while (!abort && has_more_urgent(slot.priority()) && Clock::now() < back_off_deadline)
+        cv.wait_for(lock, abort_poll_interval);
+
+    if (limits.max_bytes_per_second <= 0)
+        return;
+
+    const auto now = Clock::now();
+    const auto transfer_time = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>{static_cast<double>(bytes) / limits.max_bytes_per_second});
+    rate_budget_time = std::max(rate_budget_time, now - max_rate_burst) + transfer_time;
+
+    const auto ready_time = rate_budget_time;
+    lock.unlock();
+
+    while (!abort && Clock::now() < ready_time)
+        std::this_thread::sleep_for(std::min<Clock::duration>(ready_time - Clock::now(), abort_poll_interval));
+}
+
+// Must be called with mutex held
+bool mp::DownloadScheduler::can_start(Priority priority) const
+{
+    const auto priority_index = index_of(priority);
+
+    int running_as_urgent{0};
+    for (std::size_t i = 0; i <= priority_index; ++i)
+    {
+        if (i < priority_index && waiting[i] > 0)
+            return false;
+
+        running_as_urgent += running[i];
+    }
+
+    // Less urgent downloads back off while this one runs, so their places do not count
+    return limits.max_concurrent_downloads <= 0 || running_as_urgent < limits.max_concurrent_downloads;
+}
+
+// Must be called with mutex held
+bool mp::DownloadScheduler::has_more_urgent(Priority priority) const
+{
+    for (std::size_t i = 0; i < index_of(priority); ++i)
+        if (running[i] > 0 || waiting[i] > 0)
+            return true;
+
+    return false;
+}
+
+void mp::DownloadScheduler::release(Priority priority)
+{
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        --running[index_of(priority)];
+    }
+
+    cv.notify_all();
+}
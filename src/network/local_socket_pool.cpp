@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "local_socket_pool.h"
+
+#include <QThread>
+
+namespace mp = multipass;
+
+namespace
+{
+bool still_up(QLocalSocket& local_socket)
+{
+    // Lets the socket notice a server that hung up in the meantime. Anything it sends unasked for is out of step.
+    return local_socket.state() == QLocalSocket::ConnectedState && !local_socket.waitForReadyRead(0) &&
+           local_socket.state() == QLocalSocket::ConnectedState && local_socket.bytesAvailable() == 0;
+}
+} // namespace
+
+mp::LocalSocketUPtr mp::LocalSocketPool::acquire(const QString& socket_path)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+
+    auto& idle = idle_sockets[socket_path];
+    const auto now = std::chrono::steady_clock::now();
+
+    for (auto it = idle.begin(); it != idle.end();)
+    {
+        if (it->local_socket->thread() != QThread::currentThread())
+        {
+            ++it;
+            continue;
+        }
+
+        auto local_socket = std::move(it->local_socket);
+        const auto fresh = now - it->since < max_idle_time;
+        it = idle.erase(it);
+
+        if (fresh && still_up(*local_socket))
+            return local_socket;
+    }
+
+    return nullptr;
+}
+
+void mp::LocalSocketPool::release(const QString& socket_path, LocalSocketUPtr local_socket)
+{
+    std::vector<LocalSocketUPtr> expired; // closed once the lock is let go of
+    std::lock_guard<decltype(mutex)> lock{mutex};
+
+    // This thread's expired connections would otherwise only go once it asks for another
+    auto& idle = idle_sockets[socket_path];
+    const auto now = std::chrono::steady_clock::now();
+    for (auto it = idle.begin(); it != idle.end();)
+    {
+        if (it->local_socket->thread() == QThread::currentThread() && now - it->since >= max_idle_time)
+        {
+            expired.push_back(std::move(it->local_socket));
+            it = idle.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    if (idle.size() >= max_idle_per_socket)
+        return;
+
+    auto thread = local_socket->thread();
+    idle.push_back({std::move(local_socket), now});
+
+    // Called in the finishing thread itself, where its connections can still be closed
+    if (watched_threads.insert(thread).second)
+        QObject::connect(thread, &QThread::finished, [pool = weak_from_this(), thread] {
+            if (auto shared_pool = pool.lock())
+                shared_pool->evict(thread);
+        });
+}
+
+void mp::LocalSocketPool::evict(QThread* thread)
+{
+    std::vector<LocalSocketUPtr> evicted; // closed once the lock is let go of
+    std::lock_guard<decltype(mutex)> lock{mutex};
+
+    watched_threads.erase(thread);
+    for (auto& entry : idle_sockets)
+    {
+        auto& idle = entry.second;
+        for (auto it = idle.begin(); it != idle.end();)
+        {
+            if (it->local_socket->thread() == thread)
+            {
+                evicted.push_back(std::move(it->local_socket));
+                it = idle.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+}
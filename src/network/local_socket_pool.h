@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_LOCAL_SOCKET_POOL_H
+#define MULTIPASS_LOCAL_SOCKET_POOL_H
+
+#include "local_socket_reply.h"
+
+#include <QString>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+class QThread;
+
+namespace multipass
+{
+// Keeps connections to local HTTP servers open once their replies are done, so that later requests to the same
+// socket skip connecting. Connections only go back to the thread that made them, since that is where their
+// notifications are delivered, and are dropped along with that thread.
+class LocalSocketPool : public std::enable_shared_from_this<LocalSocketPool>
+{
+public:
+    static constexpr std::size_t max_idle_per_socket = 4;
+    static constexpr auto max_idle_time = std::chrono::seconds{30};
+
+    // An idle connection to socket_path that is still up, or nullptr when there is none
+    LocalSocketUPtr acquire(const QString& socket_path);
+    // The pool has to be held in a shared_ptr, for the thread to find it when it finishes
+    void release(const QString& socket_path, LocalSocketUPtr local_socket);
+
+private:
+    void evict(QThread* thread);
+
+    struct IdleSocket
+    {
+        LocalSocketUPtr local_socket;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    std::mutex mutex;
+    std::map<QString, std::vector<IdleSocket>> idle_sockets;
+    std::set<QThread*> watched_threads;
+};
+} // namespace multipass
+
+#endif // MULTIPASS_LOCAL_SOCKET_POOL_H
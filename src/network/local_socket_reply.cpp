@@ -28,8 +28,8 @@ namespace mp = multipass;
 
 namespace
 {
-constexpr int len = 65536;
 constexpr int max_bytes = 32768;
+constexpr qint64 max_pending_bytes = 4 * max_bytes;
 
 // Status code mapping based on
 // https://github.com/qt/qtbase/blob/dev/src/network/access/qhttpthreaddelegate.cpp
@@ -83,8 +83,8 @@ QNetworkReply::NetworkError statusCodeFromHttp(int httpStatusCode)
 } // namespace
 
 mp::LocalSocketReply::LocalSocketReply(LocalSocketUPtr local_socket, const QNetworkRequest& request,
-                                       QIODevice* outgoingData)
-    : QNetworkReply(), local_socket{std::move(local_socket)}, reply_data{QByteArray(len, '\0')}
+                                       QIODevice* outgoingData, ReleaseSocket release_socket)
+    : QNetworkReply(), local_socket{std::move(local_socket)}, release_socket{std::move(release_socket)}
 {
     open(QIODevice::ReadOnly);
 
@@ -123,6 +123,11 @@ void mp::LocalSocketReply::abort()
     emit finished();
 }
 
+qint64 mp::LocalSocketReply::bytesAvailable() const
+{
+    return content_data.size() - offset + QNetworkReply::bytesAvailable();
+}
+
 qint64 mp::LocalSocketReply::readData(char* data, qint64 maxSize)
 {
     if (offset < content_data.size())
@@ -131,10 +136,17 @@ qint64 mp::LocalSocketReply::readData(char* data, qint64 maxSize)
         memcpy(data, content_data.constData() + offset, number);
         offset += number;
 
+        // Drops what was read once that is most of the buffer, so that a reader keeping up needs little memory
+        if (offset >= content_data.size() / 2)
+        {
+            content_data.remove(0, offset);
+            offset = 0;
+        }
+
         return number;
     }
 
-    return -1;
+    return isFinished() ? -1 : 0;
 }
 
 void mp::LocalSocketReply::send_request(const QNetworkRequest& request, QIODevice* outgoingData)
@@ -172,10 +184,6 @@ void mp::LocalSocketReply::send_request(const QNetworkRequest& request, QIODevic
         http_data += "User-Agent: " + user_agent + "\r\n";
     }
 
-    // Workaround weird issue in LXD's use of Go where Go's HTTP handler thinks there is more
-    // data and "sees" and "empty" query and reponds with an unexpected 400 error
-    http_data += "Connection: close\r\n";
-
     if (!local_socket_write(http_data))
         return;
 
@@ -215,99 +223,296 @@ void mp::LocalSocketReply::send_request(const QNetworkRequest& request, QIODevic
 
             local_socket->flush();
 
-            outgoingData->open(QIODevice::ReadOnly);
-            std::vector<char> data_buffer;
-            data_buffer.reserve(max_bytes);
+            outgoing_data = outgoingData;
+            chunked_upload = is_chunked;
+            upload_size = outgoing_data->size();
+            upload_buffer.resize(max_bytes);
+            outgoing_data->open(QIODevice::ReadOnly);
 
-            int bytes_read{0};
-            while ((bytes_read = outgoingData->read(data_buffer.data(), max_bytes)) > 0)
-            {
-                if (is_chunked && !local_socket_write(QByteArray::number(bytes_read, 16) + "\r\n"))
-                    return;
+            upload_connection = QObject::connect(local_socket.get(), &QLocalSocket::bytesWritten, this,
+                                                 &LocalSocketReply::continue_upload);
+            send_body();
 
-                if (!local_socket_write(QByteArray::fromRawData(data_buffer.data(), bytes_read)))
-                    return;
+            return;
+        }
+    }
 
-                if (is_chunked && !local_socket_write("\r\n"))
-                    return;
+    if (!local_socket_write("\r\n"))
+        return;
 
-                local_socket->waitForBytesWritten();
-            }
+    local_socket->flush();
+}
 
-            if (bytes_read < 0)
-            {
-                throw mp::HttpLocalSocketException(
-                    fmt::format("Cannot read data to send to socket: {}", outgoingData->errorString()));
-            }
+// Writes the body as the socket takes it, reading no more than it can hold at a time
+void mp::LocalSocketReply::send_body()
+{
+    while (outgoing_data && local_socket->bytesToWrite() < max_pending_bytes)
+    {
+        auto bytes_read = outgoing_data->read(upload_buffer.data(), upload_buffer.size());
+        if (bytes_read < 0)
+        {
+            const auto error_string = outgoing_data->errorString();
+            stop_upload();
+            keep_alive = false;
 
-            // Trailer part for chunked data
-            if (is_chunked && !local_socket_write("0\r\n"))
-                return;
+            throw mp::HttpLocalSocketException(fmt::format("Cannot read data to send to socket: {}", error_string));
         }
+
+        if (bytes_read == 0)
+        {
+            stop_upload();
+
+            // The body ends the request, and anything after it would be taken for the start of the next one.
+            // Chunked data ends with an empty trailer part.
+            if (chunked_upload && local_socket_write("0\r\n"))
+                local_socket_write("\r\n");
+
+            local_socket->flush();
+            return;
+        }
+
+        if (chunked_upload && !local_socket_write(QByteArray::number(bytes_read, 16) + "\r\n"))
+            return;
+
+        if (!local_socket_write(QByteArray::fromRawData(upload_buffer.constData(), bytes_read)))
+            return;
+
+        if (chunked_upload && !local_socket_write("\r\n"))
+            return;
+
+        bytes_sent += bytes_read;
+        emit uploadProgress(bytes_sent, upload_size);
     }
+}
 
-    if (!local_socket_write("\r\n"))
-        return;
+void mp::LocalSocketReply::stop_upload()
+{
+    outgoing_data = nullptr;
+    QObject::disconnect(upload_connection);
+}
 
-    local_socket->flush();
+void mp::LocalSocketReply::continue_upload()
+try
+{
+    send_body();
+}
+catch (const HttpLocalSocketException& e)
+{
+    setError(QNetworkReply::ProtocolFailure, e.what());
+    emit error(QNetworkReply::ProtocolFailure);
+
+    setFinished(true);
+    emit finished();
 }
 
 void mp::LocalSocketReply::read_reply()
 {
-    auto data_ptr = reply_data.data() + reply_offset;
-    int bytes_read{0};
+    if (isFinished())
+        return;
+
+    reply_data.append(local_socket->readAll());
+
+    if (!headers_parsed)
+        parse_headers();
 
-    do
+    if (headers_parsed)
     {
-        if (reply_offset + local_socket->bytesAvailable() > reply_data.length())
+        const auto content_size = content_data.size();
+        const auto complete = parse_body();
+
+        if (content_data.size() > content_size)
         {
-            reply_data.append(len, '\0');
-            data_ptr = reply_data.data() + reply_offset;
+            bytes_received += content_data.size() - content_size;
+            emit downloadProgress(bytes_received, content_length);
+            emit readyRead();
         }
 
-        bytes_read = local_socket->read(data_ptr, len);
-
-        reply_offset += bytes_read;
-        data_ptr += bytes_read;
-    } while (bytes_read > 0);
+        if (complete)
+            finish_reply(true);
+    }
 }
 
 void mp::LocalSocketReply::read_finish()
 {
+    if (isFinished())
+        return;
+
     if (local_socket->bytesAvailable())
         read_reply();
 
-    if (reply_offset)
-        parse_reply();
-
-    setFinished(true);
-    emit finished();
+    if (!isFinished())
+        finish_reply(false);
 }
 
-void mp::LocalSocketReply::parse_reply()
+void mp::LocalSocketReply::parse_headers()
 {
-    auto reply_lines = reply_data.split('\n');
-    auto it = reply_lines.constBegin();
+    const auto header_end = reply_data.indexOf("\r\n\r\n");
+    if (header_end < 0)
+        return;
+
+    const auto lines = reply_data.left(header_end).split('\n');
+    reply_data.remove(0, header_end + 4);
+    headers_parsed = true;
 
-    parse_status(*it);
+    status_line = lines.first();
+    const auto status_code = status_line.mid(9, 3).toInt();
 
-    for (++it; it != reply_lines.constEnd(); ++it)
+    if (status_line.startsWith("HTTP/1.0"))
+        keep_alive = false;
+
+    // These never have a body
+    if ((status_code >= 100 && status_code < 200) || status_code == 204 || status_code == 304)
+        content_length = 0;
+
+    for (auto it = lines.cbegin() + 1; it != lines.cend(); ++it)
     {
-        if ((*it).contains("Transfer-Encoding") && (*it).contains("chunked"))
+        const auto colon = it->indexOf(':');
+        if (colon < 0)
+            continue;
+
+        const auto name = it->left(colon).trimmed().toLower();
+        const auto value = it->mid(colon + 1).trimmed().toLower();
+
+        if (name == "transfer-encoding" && value.contains("chunked"))
+        {
             chunked_transfer_encoding = true;
+        }
+        else if (name == "content-length" && content_length < 0)
+        {
+            bool ok;
+            const auto length = value.toLongLong(&ok);
+            if (ok)
+                content_length = length;
+        }
+        else if (name == "connection" && value.contains("close"))
+        {
+            keep_alive = false;
+        }
+    }
+
+    if (chunked_transfer_encoding)
+        content_length = -1;
 
-        if ((*it).isEmpty() || (*it).startsWith('\r'))
+    body_remaining = content_length;
+}
+
+// Moves the body received so far over to content_data and tells whether all of it arrived
+bool mp::LocalSocketReply::parse_body()
+{
+    if (chunked_transfer_encoding)
+    {
+        while (true)
         {
-            // Advance to the body
-            // Chunked transfer encoding also includes a line with the amount of
-            // bytes (in hex) in the chunk. We just skip it for now.
-            it = chunked_transfer_encoding ? it + 2 : it + 1;
+            if (body_remaining > 0)
+            {
+                const auto size = static_cast<int>(qMin<qint64>(body_remaining, reply_data.size()));
+                content_data.append(reply_data.constData(), size);
+                reply_data.remove(0, size);
+                body_remaining -= size;
+
+                if (body_remaining > 0)
+                    return false;
+            }
+
+            if (body_remaining == 0)
+            {
+                // Chunks end with an empty line
+                if (reply_data.size() < 2)
+                    return false;
+
+                reply_data.remove(0, 2);
+                body_remaining = -1;
+            }
+
+            if (last_chunk)
+            {
+                // Trailers, if any, end with an empty line
+                auto trailer_end = reply_data.startsWith("\r\n") ? 0 : reply_data.indexOf("\r\n\r\n");
+                if (trailer_end < 0)
+                    return false;
+
+                reply_data.remove(0, trailer_end + (trailer_end ? 4 : 2));
+                if (!reply_data.isEmpty())
+                    keep_alive = false;
+
+                return true;
+            }
+
+            const auto size_end = reply_data.indexOf("\r\n");
+            if (size_end < 0)
+                return false;
 
-            content_data = (*it).trimmed();
+            bool ok;
+            const auto size = reply_data.left(size_end).split(';').first().trimmed().toLongLong(&ok, 16);
+            reply_data.remove(0, size_end + 2);
 
-            break;
+            if (!ok)
+            {
+                // Leave it to the server to end the reply by hanging up
+                chunked_transfer_encoding = false;
+                keep_alive = false;
+                return false;
+            }
+
+            if (size == 0)
+                last_chunk = true;
+            else
+                body_remaining = size;
         }
     }
+
+    if (body_remaining >= 0)
+    {
+        const auto size = static_cast<int>(qMin<qint64>(body_remaining, reply_data.size()));
+        content_data.append(reply_data.constData(), size);
+        reply_data.remove(0, size);
+        body_remaining -= size;
+
+        if (body_remaining > 0)
+            return false;
+
+        if (!reply_data.isEmpty())
+            keep_alive = false;
+
+        return true;
+    }
+
+    // Without either, the body lasts until the server hangs up
+    keep_alive = false;
+    content_data.append(reply_data);
+    reply_data.clear();
+
+    return false;
+}
+
+void mp::LocalSocketReply::finish_reply(bool complete)
+{
+    if (!headers_parsed && reply_data.isEmpty())
+    {
+        keep_alive = false;
+        setError(QNetworkReply::RemoteHostClosedError, "Connection closed before a reply arrived");
+        emit error(QNetworkReply::RemoteHostClosedError);
+    }
+    else
+    {
+        if (!headers_parsed)
+            status_line = reply_data.left(reply_data.indexOf('\n'));
+
+        if (status_line.endsWith('\r'))
+            status_line.chop(1);
+
+        parse_status(status_line);
+    }
+
+    setFinished(true);
+
+    if (complete && keep_alive && release_socket)
+    {
+        local_socket->disconnect(this);
+        release_socket(std::move(local_socket));
+    }
+
+    emit finished();
 }
 
 void mp::LocalSocketReply::parse_status(const QByteArray& status)
@@ -317,6 +522,7 @@ void mp::LocalSocketReply::parse_status(const QByteArray& status)
 
     if (!http_status_match.hasMatch())
     {
+        keep_alive = false;
         setError(QNetworkReply::ProtocolFailure, "Malformed HTTP response from server");
         emit error(QNetworkReply::ProtocolFailure);
 
@@ -340,6 +546,8 @@ bool mp::LocalSocketReply::local_socket_write(const QByteArray& data)
     auto bytes_written = local_socket->write(data);
     if (bytes_written < 0)
     {
+        stop_upload();
+        keep_alive = false;
         setError(QNetworkReply::InternalServerError, local_socket->errorString());
         emit error(QNetworkReply::InternalServerError);
 
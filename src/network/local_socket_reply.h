@@ -24,6 +24,7 @@
 #include <QNetworkRequest>
 #include <QString>
 
+#include <functional>
 #include <memory>
 
 namespace multipass
@@ -34,10 +35,16 @@ class LocalSocketReply : public QNetworkReply
 {
     Q_OBJECT
 public:
-    LocalSocketReply(LocalSocketUPtr local_socket, const QNetworkRequest& request, QIODevice* outgoingData);
+    // Called with the socket once a reply leaves it ready for another request
+    using ReleaseSocket = std::function<void(LocalSocketUPtr)>;
+
+    LocalSocketReply(LocalSocketUPtr local_socket, const QNetworkRequest& request, QIODevice* outgoingData,
+                     ReleaseSocket release_socket = nullptr);
     LocalSocketReply();
     virtual ~LocalSocketReply();
 
+    qint64 bytesAvailable() const override;
+
 public Q_SLOTS:
     void abort() override;
 
@@ -48,18 +55,36 @@ protected:
 private slots:
     void read_reply();
     void read_finish();
+    void continue_upload();
 
 private:
     void send_request(const QNetworkRequest& request, QIODevice* outgoingData);
-    void parse_reply();
+    void send_body();
+    void stop_upload();
+    void parse_headers();
+    bool parse_body();
+    void finish_reply(bool complete);
     void parse_status(const QByteArray& status);
     bool local_socket_write(const QByteArray& data);
 
     LocalSocketUPtr local_socket;
+    ReleaseSocket release_socket;
+    QIODevice* outgoing_data{nullptr};
+    QMetaObject::Connection upload_connection;
+    QByteArray upload_buffer;
+    qint64 upload_size{-1};
+    qint64 bytes_sent{0};
+    bool chunked_upload{false};
     QByteArray reply_data;
-    qint64 reply_offset{0};
+    QByteArray status_line;
     qint64 offset{0};
+    qint64 content_length{-1};
+    qint64 body_remaining{-1};
+    qint64 bytes_received{0};
+    bool headers_parsed{false};
     bool chunked_transfer_encoding{false};
+    bool last_chunk{false};
+    bool keep_alive{true};
 };
 } // namespace multipass
 
@@ -15,6 +15,7 @@
  *
  */
 
+#include "local_socket_pool.h"
 #include "local_socket_reply.h"
 
 #include <multipass/exceptions/local_socket_connection_exception.h>
@@ -23,10 +24,13 @@
 
 namespace mp = multipass;
 
-mp::NetworkAccessManager::NetworkAccessManager(QObject* parent) : QNetworkAccessManager(parent)
+mp::NetworkAccessManager::NetworkAccessManager(QObject* parent)
+    : QNetworkAccessManager(parent), local_socket_pool{std::make_shared<LocalSocketPool>()}
 {
 }
 
+mp::NetworkAccessManager::~NetworkAccessManager() = default;
+
 QNetworkReply* mp::NetworkAccessManager::createRequest(QNetworkAccessManager::Operation operation,
                                                        const QNetworkRequest& orig_request, QIODevice* device)
 {
@@ -47,13 +51,17 @@ QNetworkReply* mp::NetworkAccessManager::createRequest(QNetworkAccessManager::Op
 
         const auto socket_path = QUrl(url_parts[0]).path();
 
-        LocalSocketUPtr local_socket = std::make_unique<QLocalSocket>();
-
-        local_socket->connectToServer(socket_path);
-        if (!local_socket->waitForConnected(5000))
+        auto local_socket = local_socket_pool->acquire(socket_path);
+        if (!local_socket)
         {
-            throw LocalSocketConnectionException(
-                fmt::format("Cannot connect to {}: {}", socket_path, local_socket->errorString()));
+            local_socket = std::make_unique<QLocalSocket>();
+
+            local_socket->connectToServer(socket_path);
+            if (!local_socket->waitForConnected(5000))
+            {
+                throw LocalSocketConnectionException(
+                    fmt::format("Cannot connect to {}: {}", socket_path, local_socket->errorString()));
+            }
         }
 
         const auto server_path = url_parts[1];
@@ -64,8 +72,14 @@ QNetworkReply* mp::NetworkAccessManager::createRequest(QNetworkAccessManager::Op
 
         request.setUrl(url);
 
+        // Replies may outlive the manager, in which case their connection goes with them
+        auto release_socket = [pool = std::weak_ptr<LocalSocketPool>{local_socket_pool}, socket_path](auto socket) {
+            if (auto shared_pool = pool.lock())
+                shared_pool->release(socket_path, std::move(socket));
+        };
+
         // The caller needs to be responsible for freeing the allocated memory
-        return new LocalSocketReply(std::move(local_socket), request, device);
+        return new LocalSocketReply(std::move(local_socket), request, device, release_socket);
     }
     else
     {
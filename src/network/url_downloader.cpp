@@ -21,25 +21,40 @@
 #include <multipass/exceptions/download_exception.h>
 #include <multipass/file_ops.h>
 #include <multipass/format.h>
+#include <multipass/instrumentation.h>
 #include <multipass/logging/log.h>
+#include <multipass/sha256.h>
 
 #include <QDir>
 #include <QEventLoop>
 #include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QNetworkDiskCache>
 #include <QNetworkReply>
+#include <QThread>
 #include <QTimer>
 #include <QUrl>
 
+#include <algorithm>
 #include <memory>
+#include <vector>
 
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 
 namespace
 {
+constexpr auto download_duration_metric = "multipass_download_duration_seconds";
+constexpr auto download_bytes_metric = "multipass_download_bytes";
 constexpr auto category = "url downloader";
+constexpr qint64 min_range_size = 16 * 1024 * 1024; // Smaller downloads do not benefit from multiple connections
+constexpr auto partial_suffix = ".partial";
+constexpr auto partial_state_suffix = ".partial.json";
+// Caps what Qt buffers for each reply, so that a download held back by the scheduler also holds back the connection
+constexpr qint64 read_buffer_size = 4 * 1024 * 1024;
 using NetworkReplyUPtr = std::unique_ptr<QNetworkReply>;
+using RawHeaders = std::vector<std::pair<QByteArray, QByteArray>>;
 
 auto make_network_manager(const mp::Path& cache_dir_path)
 {
@@ -74,19 +89,25 @@ void wait_for_reply(QNetworkReply* reply, QTimer& download_timeout)
 template <typename ProgressAction, typename DownloadAction, typename ErrorAction, typename Time>
 QByteArray download(QNetworkAccessManager* manager, const Time& timeout, QUrl const& url, ProgressAction&& on_progress,
                     DownloadAction&& on_download, ErrorAction&& on_error, const std::atomic_bool& abort_download,
-                    const bool force_cache = false)
+                    const RawHeaders& raw_headers = {}, const bool force_cache = false)
 {
     QTimer download_timeout;
     download_timeout.setInterval(timeout);
 
     QNetworkRequest request{url};
+    for (const auto& header : raw_headers)
+        request.setRawHeader(header.first, header.second);
     request.setRawHeader("Connection", "Keep-Alive");
     request.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, true);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+#endif
     request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
     request.setAttribute(QNetworkRequest::CacheLoadControlAttribute,
                          force_cache ? QNetworkRequest::AlwaysCache : QNetworkRequest::PreferNetwork);
 
     NetworkReplyUPtr reply{manager->get(request)};
+    reply->setReadBufferSize(read_buffer_size);
 
     QObject::connect(reply.get(), &QNetworkReply::downloadProgress, [&](qint64 bytes_received, qint64 bytes_total) {
         on_progress(reply.get(), bytes_received, bytes_total);
@@ -111,9 +132,10 @@ QByteArray download(QNetworkAccessManager* manager, const Time& timeout, QUrl co
         }
         else
         {
-            mpl::log(mpl::Level::warning, category,
-                     fmt::format("Error getting {}: {} - trying cache.", url.toString(), msg));
-            return ::download(manager, timeout, url, on_progress, on_download, on_error, abort_download, true);
+            mpl::log_limited(mpl::Level::warning, category, "Error getting {}: {} - trying cache.", url.toString(),
+                             msg);
+            return ::download(manager, timeout, url, on_progress, on_download, on_error, abort_download, raw_headers,
+                              true);
         }
     }
 
@@ -125,8 +147,7 @@ QByteArray download(QNetworkAccessManager* manager, const Time& timeout, QUrl co
 }
 
 template <typename Time>
-auto get_header(QNetworkAccessManager* manager, const QUrl& url, const QNetworkRequest::KnownHeaders header,
-                const Time& timeout)
+NetworkReplyUPtr head(QNetworkAccessManager* manager, const QUrl& url, const Time& timeout)
 {
     QTimer download_timeout;
     download_timeout.setInterval(timeout);
@@ -147,7 +168,92 @@ auto get_header(QNetworkAccessManager* manager, const QUrl& url, const QNetworkR
         throw mp::DownloadException{url.toString().toStdString(), reply->errorString().toStdString()};
     }
 
-    return reply->header(header);
+    return reply;
+}
+
+template <typename Time>
+auto get_header(QNetworkAccessManager* manager, const QUrl& url, const QNetworkRequest::KnownHeaders header,
+                const Time& timeout)
+{
+    return head(manager, url, timeout)->header(header);
+}
+
+struct ByteRange
+{
+    qint64 size() const
+    {
+        return end - start;
+    }
+
+    bool complete() const
+    {
+        return received == size();
+    }
+
+    const qint64 start;
+    const qint64 end; // exclusive
+    qint64 received{0};
+};
+// What is needed to resume an interrupted download: how far it got and what identified the remote file
+struct PartialDownload
+{
+    qint64 offset{0};
+    QByteArray etag;
+    QByteArray last_modified;
+
+    QByteArray validator() const
+    {
+        return etag.isEmpty() ? last_modified : etag;
+    }
+};
+
+PartialDownload load_partial_download(const QUrl& url, const QString& state_path, const QFile& partial_file)
+{
+    QFile state_file{state_path};
+    if (!partial_file.exists() || !state_file.open(QIODevice::ReadOnly))
+        return {};
+
+    const auto state = QJsonDocument::fromJson(state_file.readAll()).object();
+    PartialDownload partial{static_cast<qint64>(state["offset"].toDouble()),
+                            state["etag"].toString().toUtf8(), state["last_modified"].toString().toUtf8()};
+
+    // Only trust the state if it describes the data that is actually on disk
+    if (state["url"].toString() != url.toString() || partial.offset <= 0 || partial.offset != partial_file.size() ||
+        partial.validator().isEmpty())
+        return {};
+
+    return partial;
+}
+
+bool save_partial_download(const QUrl& url, const QString& state_path, const PartialDownload& partial)
+{
+    QJsonObject state;
+    state.insert("url", url.toString());
+    state.insert("offset", partial.offset);
+    state.insert("etag", QString::fromUtf8(partial.etag));
+    state.insert("last_modified", QString::fromUtf8(partial.last_modified));
+
+    QFile state_file{state_path};
+    return state_file.open(QIODevice::WriteOnly | QIODevice::Truncate) &&
+           state_file.write(QJsonDocument{state}.toJson()) > 0;
+}
+
+bool hash_file_prefix(QFile& file, qint64 size, mp::Sha256& hash)
+{
+    if (!MP_FILEOPS.seek(file, 0))
+        return false;
+
+    for (auto remaining = size; remaining > 0;)
+    {
+        const auto data = file.read(std::min<qint64>(remaining, 1024 * 1024));
+        if (data.isEmpty())
+            return false;
+
+        hash.add_data(data);
+        remaining -= data.size();
+    }
+
+    return true;
 }
 } // namespace
 
@@ -165,69 +271,124 @@ mp::URLDownloader::URLDownloader(std::chrono::milliseconds timeout) : URLDownloa
 {
 }
 
-mp::URLDownloader::URLDownloader(const mp::Path& cache_dir, std::chrono::milliseconds timeout)
-    : cache_dir_path{QDir(cache_dir).filePath("network-cache")}, timeout{timeout}
+mp::URLDownloader::URLDownloader(const mp::Path& cache_dir, std::chrono::milliseconds timeout,
+                                 int max_connections, bool resume_downloads,
+                                 const DownloadScheduler::Limits& download_limits)
+    : cache_dir_path{QDir(cache_dir).filePath("network-cache")},
+      timeout{timeout},
+      max_connections{max_connections},
+      resume_downloads{resume_downloads},
+      scheduler{download_limits}
+{
+}
+
+mp::URLDownloader::~URLDownloader()
+{
+    std::lock_guard<decltype(network_managers_mutex)> lock{network_managers_mutex};
+    for (auto& entry : network_managers)
+        QObject::disconnect(entry.second.thread_finished);
+}
+
+QNetworkAccessManager* mp::URLDownloader::network_manager()
 {
+    auto thread = QThread::currentThread();
+
+    std::lock_guard<decltype(network_managers_mutex)> lock{network_managers_mutex};
+    auto& entry = network_managers[thread];
+    if (!entry.manager)
+    {
+        entry.manager = MP_NETMGRFACTORY.make_network_manager(cache_dir_path);
+
+        // Managers go away with their threads, e.g. when the thread pool retires an idle worker
+        entry.thread_finished = QObject::connect(
+            thread, &QThread::finished,
+            [this, thread] {
+                std::lock_guard<decltype(network_managers_mutex)> lock{network_managers_mutex};
+                network_managers.erase(thread);
+            },
+            Qt::DirectConnection);
+    }
+
+    return entry.manager.get();
 }
 
 void mp::URLDownloader::download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
                                     const mp::ProgressMonitor& monitor)
 {
-    auto manager{MP_NETMGRFACTORY.make_network_manager(cache_dir_path)};
+    download_to_file(url, file_name, size, download_type, monitor, nullptr);
+}
 
-    QFile file{file_name};
-    file.open(QIODevice::ReadWrite | QIODevice::Truncate);
+QString mp::URLDownloader::download_and_hash_to(const QUrl& url, const QString& file_name, int64_t size,
+                                                const int download_type, const mp::ProgressMonitor& monitor)
+{
+    Sha256 hash;
 
-    auto progress_monitor = [this, &monitor, download_type, size](QNetworkReply* reply, qint64 bytes_received,
-                                                                  qint64 bytes_total) {
-        if (bytes_received == 0)
-            return;
+    download_to_file(url, file_name, size, download_type, monitor, &hash);
 
-        if (bytes_total == -1 && size > 0)
-            bytes_total = size;
+    return hash.result().toHex();
+}
 
-        auto progress = (size < 0) ? size : (100 * bytes_received + bytes_total / 2) / bytes_total;
-        if (!monitor(download_type, progress))
-        {
-            abort_all_downloads();
-            reply->abort();
-        }
+QString mp::URLDownloader::stream_and_hash(const QUrl& url, const DataConsumer& consume, int64_t size,
+                                           const int download_type, const mp::ProgressMonitor& monitor)
+{
+    Sha256 hash;
+    bool consumed_data{false};
+
+    qint64 consumed_bytes{0};
+    auto track_consume = [&consume, &consumed_data, &consumed_bytes](const QByteArray& data) {
+        consumed_data = true;
+        consumed_bytes += data.size();
+        return consume(data);
     };
 
-    auto on_download = [this, &file](QNetworkReply* reply, QTimer& download_timeout) {
+    // Data handed over to the consumer cannot be taken back, so only a download that did not start can be retried
+    auto start_reply = [&consumed_data](QNetworkReply*) { return !consumed_data; };
+
+    auto manager = network_manager();
+    const auto slot = scheduler.acquire(abort_download);
+
+    {
+        ScopedTiming timing{download_duration_metric, "kind=\"stream\""};
+        download_with(manager, url, size, download_type, monitor, &hash, track_consume, start_reply, [] {}, *slot);
+    }
+    MP_INSTRUMENTATION.add(download_bytes_metric, "kind=\"stream\"", consumed_bytes);
+
+    return hash.result().toHex();
+}
+
+QByteArray mp::URLDownloader::download(const QUrl& url)
+{
+    auto manager = network_manager();
+
+    // This will connect to the QNetworkReply::readReady signal and when emitted,
+    // reset the timer.
+    auto on_download = [this](QNetworkReply* reply, QTimer& download_timeout) {
         if (abort_download)
         {
             reply->abort();
             return;
         }
 
-        if (download_timeout.isActive())
-            download_timeout.stop();
-        else
-            return;
-
-        if (MP_FILEOPS.write(file, reply->readAll()) < 0)
-        {
-            mpl::log(mpl::Level::error, category, fmt::format("error writing image: {}", file.errorString()));
-            abort_all_downloads();
-            reply->abort();
-        }
         download_timeout.start();
     };
 
-    auto on_error = [&file]() { file.remove(); };
+    ScopedTiming timing{download_duration_metric, "kind=\"small\""};
+    auto data = ::download(
+        manager, timeout, url, [](QNetworkReply*, qint64, qint64) {}, on_download, [] {}, abort_download);
+    MP_INSTRUMENTATION.add(download_bytes_metric, "kind=\"small\"", data.size());
 
-    ::download(manager.get(), timeout, url, progress_monitor, on_download, on_error, abort_download);
+    return data;
 }
 
-QByteArray mp::URLDownloader::download(const QUrl& url)
+QByteArray mp::URLDownloader::download_range(const QUrl& url, qint64 start, qint64 end)
 {
-    auto manager{MP_NETMGRFACTORY.make_network_manager(cache_dir_path)};
+    auto manager = network_manager();
+    auto ignored_range = false;
 
-    // This will connect to the QNetworkReply::readReady signal and when emitted,
-    // reset the timer.
-    auto on_download = [this](QNetworkReply* reply, QTimer& download_timeout) {
-        if (abort_download)
+    // A server that ignores the range would send the whole file instead
+    auto on_download = [this, &ignored_range](QNetworkReply* reply, QTimer& download_timeout) {
+        ignored_range = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 206;
+        if (abort_download || ignored_range)
         {
             reply->abort();
             return;
@@ -236,18 +397,407 @@ QByteArray mp::URLDownloader::download(const QUrl& url)
         download_timeout.start();
     };
 
-    return ::download(
-        manager.get(), timeout, url, [](QNetworkReply*, qint64, qint64) {}, on_download, [] {}, abort_download);
+    const auto slot = scheduler.acquire(abort_download);
+    const RawHeaders headers{{"Range", "bytes=" + QByteArray::number(start) + '-' + QByteArray::number(end - 1)}};
+
+    ScopedTiming timing{download_duration_metric, "kind=\"range\""};
+    auto data = ::download(
+        manager, timeout, url, [](QNetworkReply*, qint64, qint64) {}, on_download, [] {}, abort_download, headers);
+    MP_INSTRUMENTATION.add(download_bytes_metric, "kind=\"range\"", data.size());
+
+    if (ignored_range || data.size() != end - start)
+        throw mp::DownloadException{url.toString().toStdString(),
+                                    fmt::format("expected bytes {}-{}, got {} bytes", start, end - 1, data.size())};
+
+    return data;
 }
 
 QDateTime mp::URLDownloader::last_modified(const QUrl& url)
 {
-    auto manager{MP_NETMGRFACTORY.make_network_manager(cache_dir_path)};
+    auto manager = network_manager();
 
-    return get_header(manager.get(), url, QNetworkRequest::LastModifiedHeader, timeout).toDateTime();
+    return get_header(manager, url, QNetworkRequest::LastModifiedHeader, timeout).toDateTime();
+}
+
+void mp::URLDownloader::hand_over_partial_download(const QUrl& from, const QUrl& to, const QString& file_name)
+{
+    if (!resume_downloads)
+        return;
+
+    QFile state_file{file_name + partial_state_suffix};
+    if (!state_file.exists() || !state_file.open(QIODevice::ReadWrite))
+        return;
+
+    auto state = QJsonDocument::fromJson(state_file.readAll()).object();
+    if (state["url"].toString() != from.toString())
+        return;
+
+    state.insert("url", to.toString());
+    state.insert("etag", QString{});
+    state_file.resize(0);
+    state_file.seek(0);
+    state_file.write(QJsonDocument{state}.toJson());
 }
 
 void mp::URLDownloader::abort_all_downloads()
 {
     abort_download = true;
 }
+
+void mp::URLDownloader::download_to_file(const QUrl& url, const QString& file_name, int64_t size,
+                                         const int download_type, const mp::ProgressMonitor& monitor,
+                                         Sha256* hash)
+{
+    ScopedTiming timing{download_duration_metric, "kind=\"file\""};
+    // Resumable downloads go to a partial file, which is kept along with the state needed to resume it if the
+    // download fails, and which is renamed to file_name once complete
+    const auto slot = scheduler.acquire(abort_download);
+
+    const auto state_path = file_name + partial_state_suffix;
+    QFile file{resume_downloads ? file_name + partial_suffix : file_name};
+
+    auto partial = resume_downloads ? load_partial_download(url, state_path, file) : PartialDownload{};
+    file.open(partial.offset > 0 ? QIODevice::ReadWrite : QIODevice::ReadWrite | QIODevice::Truncate);
+
+    // Resumed data is only hashed once, reading back what is already on disk
+    if (partial.offset > 0 && (!hash || hash_file_prefix(file, partial.offset, *hash)) &&
+        MP_FILEOPS.seek(file, partial.offset))
+    {
+        mpl::log(mpl::Level::info, category,
+                 fmt::format("Resuming download of {} at byte {}", url.toString(), partial.offset));
+    }
+    else if (partial.offset > 0)
+    {
+        partial = PartialDownload{};
+        if (hash)
+            hash->reset();
+        file.resize(0);
+    }
+
+    const auto resume_offset = partial.offset;
+
+    auto write_to_file = [this, &file, &partial](const QByteArray& data) {
+        if (MP_FILEOPS.write(file, data) < 0)
+        {
+            // Nothing else is going to get written either
+            mpl::log(mpl::Level::error, category, fmt::format("error writing image: {}", file.errorString()));
+            abort_all_downloads();
+            return false;
+        }
+
+        partial.offset += data.size();
+        return true;
+    };
+
+    auto restart = [&file, &partial, hash] {
+        partial.offset = 0;
+        if (hash)
+            hash->reset();
+
+        return file.resize(0) && MP_FILEOPS.seek(file, 0);
+    };
+
+    // Only a partial response to the resuming request can be appended to the data on disk, anything else, such as
+    // replies retried from the cache or servers ignoring the range, starts the file over
+    bool first_reply{true};
+    auto start_reply = [&first_reply, &partial, &restart, resume_offset](QNetworkReply* reply) {
+        const auto resumed = first_reply && resume_offset > 0 &&
+                             reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 206;
+        const auto start_over = !first_reply || (resume_offset > 0 && !resumed);
+
+        first_reply = false;
+        partial.etag = reply->rawHeader("ETag");
+        partial.last_modified = reply->rawHeader("Last-Modified");
+
+        return !start_over || restart();
+    };
+
+    auto on_error = [this, &file, &partial, &url, &state_path]() {
+        if (!resume_downloads || partial.offset <= 0 || partial.validator().isEmpty() ||
+            !save_partial_download(url, state_path, partial))
+        {
+            file.remove();
+            QFile::remove(state_path);
+        }
+    };
+
+    auto manager = network_manager();
+
+    // Sizes known in advance spare the HEAD request for files too small to split
+    if (max_connections > 1 && resume_offset == 0 && url.scheme().startsWith("http") &&
+        (size < 0 || size >= 2 * min_range_size))
+    {
+        if (download_ranges_to(manager, url, file, download_type, monitor, hash, *slot))
+        {
+            MP_INSTRUMENTATION.add(download_bytes_metric, "kind=\"file\"", file.size());
+            finish_download_to(file, file_name, state_path);
+            return;
+        }
+
+        if (!restart())
+            throw mp::DownloadException{url.toString().toStdString(), file.errorString().toStdString()};
+    }
+
+    download_with(manager, url, size, download_type, monitor, hash, write_to_file, start_reply, on_error, *slot,
+                  resume_offset, partial.validator());
+
+    MP_INSTRUMENTATION.add(download_bytes_metric, "kind=\"file\"", file.size() - resume_offset);
+    finish_download_to(file, file_name, state_path);
+}
+
+void mp::URLDownloader::finish_download_to(QFile& file, const QString& file_name, const QString& state_path)
+{
+    if (!resume_downloads)
+        return;
+
+    QFile::remove(state_path);
+    QFile::remove(file_name);
+    if (!MP_FILEOPS.rename(file, file_name))
+        throw mp::DownloadException{file_name.toStdString(), file.errorString().toStdString()};
+}
+
+bool mp::URLDownloader::download_ranges_to(QNetworkAccessManager* manager, const QUrl& url, QFile& file,
+                                           const int download_type, const mp::ProgressMonitor& monitor,
+                                           Sha256* hash, const DownloadScheduler::Slot& slot)
+{
+    qint64 total_size{-1};
+    try
+    {
+        auto reply = head(manager, url, timeout);
+        if (reply->rawHeader("Accept-Ranges") == "bytes")
+            total_size = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+    }
+    catch (const mp::DownloadException&)
+    {
+        return false;
+    }
+
+    if (total_size < 2 * min_range_size || !MP_FILEOPS.resize(file, total_size))
+        return false;
+
+    const auto range_count = std::min<qint64>(max_connections, total_size / min_range_size);
+    const auto range_size = total_size / range_count;
+
+    std::vector<ByteRange> ranges;
+    for (qint64 i = 0; i < range_count; ++i)
+        ranges.push_back({i * range_size, i == range_count - 1 ? total_size : (i + 1) * range_size});
+
+    mpl::log(mpl::Level::debug, category,
+             fmt::format("Downloading {} over {} connections", url.toString(), range_count));
+
+    QEventLoop event_loop;
+    QTimer download_timeout;
+    download_timeout.setInterval(timeout);
+
+    std::vector<NetworkReplyUPtr> replies;
+    auto unfinished = ranges.size();
+    bool failed{false};
+    qint64 total_received{0};
+    qint64 last_progress{-1};
+
+    auto fail = [&failed, &replies] {
+        failed = true;
+        for (auto& reply : replies)
+            if (reply->isRunning())
+                reply->abort();
+    };
+
+    // The digest has to be computed in order, so data for ranges beyond the first incomplete one is hashed
+    // only once all the preceding ranges are done, reading back whatever had already been written
+    std::size_t hash_frontier{0};
+    auto advance_hash_frontier = [&] {
+        while (hash_frontier < ranges.size() && ranges[hash_frontier].complete())
+        {
+            if (++hash_frontier == ranges.size() || !hash)
+                continue;
+
+            const auto& range = ranges[hash_frontier];
+            if (!MP_FILEOPS.seek(file, range.start))
+                return false;
+
+            for (auto remaining = range.received; remaining > 0;)
+            {
+                const auto data = file.read(std::min<qint64>(remaining, 1024 * 1024));
+                if (data.isEmpty())
+                    return false;
+
+                hash->add_data(data);
+                remaining -= data.size();
+            }
+        }
+
+        return true;
+    };
+
+    QObject::connect(&download_timeout, &QTimer::timeout, [&] {
+        download_timeout.stop();
+        mpl::log(mpl::Level::warning, category, fmt::format("Network timeout getting {}", url.toString()));
+        fail();
+    });
+
+    for (std::size_t i = 0; i < ranges.size(); ++i)
+    {
+        QNetworkRequest request{url};
+        request.setRawHeader("Range",
+                             QByteArray::fromStdString(fmt::format("bytes={}-{}", ranges[i].start, ranges[i].end - 1)));
+        request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+        request.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::AlwaysNetwork);
+        request.setAttribute(QNetworkRequest::CacheSaveControlAttribute, false);
+
+        replies.emplace_back(manager->get(request));
+        auto reply = replies.back().get();
+        reply->setReadBufferSize(read_buffer_size);
+
+        QObject::connect(reply, &QNetworkReply::readyRead, [&, i, reply] {
+            scheduler.throttle(slot, reply->bytesAvailable(), abort_download);
+            if (abort_download)
+            {
+                fail();
+                return;
+            }
+
+            if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 206)
+            {
+                fail();
+                return;
+            }
+
+            auto& range = ranges[i];
+            const auto data = reply->readAll();
+            if (range.received + data.size() > range.size() ||
+                !MP_FILEOPS.seek(file, range.start + range.received) || MP_FILEOPS.write(file, data) != data.size())
+            {
+                mpl::log(mpl::Level::error, category, fmt::format("error writing image: {}", file.errorString()));
+                fail();
+                return;
+            }
+
+            if (hash && i == hash_frontier)
+                hash->add_data(data);
+
+            range.received += data.size();
+            total_received += data.size();
+
+            const auto progress = (100 * total_received + total_size / 2) / total_size;
+            if (progress != last_progress)
+            {
+                last_progress = progress;
+                if (!monitor(download_type, progress))
+                {
+                    abort_all_downloads();
+                    fail();
+                    return;
+                }
+            }
+
+            download_timeout.start();
+        });
+
+        QObject::connect(reply, &QNetworkReply::finished, [&, i, reply] {
+            if (!failed && (reply->error() != QNetworkReply::NoError || !ranges[i].complete() ||
+                            !advance_hash_frontier()))
+                fail();
+
+            if (--unfinished == 0)
+                event_loop.quit();
+        });
+    }
+
+    download_timeout.start();
+    event_loop.exec();
+
+    if (abort_download)
+    {
+        file.remove();
+        throw mp::AbortedDownloadException{"Operation canceled"};
+    }
+
+    if (failed)
+        mpl::log(mpl::Level::warning, category,
+                 fmt::format("Ranged download of {} failed - falling back to a single connection.", url.toString()));
+
+    return !failed;
+}
+
+void mp::URLDownloader::download_with(QNetworkAccessManager* manager, const QUrl& url, int64_t size,
+                                      const int download_type, const mp::ProgressMonitor& monitor,
+                                      Sha256* hash, const DataConsumer& consume,
+                                      const std::function<bool(QNetworkReply*)>& start_reply,
+                                      const std::function<void()>& on_error, const DownloadScheduler::Slot& slot,
+                                      qint64 resume_offset, const QByteArray& if_range)
+{
+    RawHeaders raw_headers;
+    if (resume_offset > 0)
+    {
+        raw_headers.emplace_back("Range", QByteArray::fromStdString(fmt::format("bytes={}-", resume_offset)));
+        raw_headers.emplace_back("If-Range", if_range);
+    }
+
+    auto progress_monitor = [this, &monitor, download_type, size, resume_offset](
+                                QNetworkReply* reply, qint64 bytes_received, qint64 bytes_total) {
+        if (bytes_received == 0)
+            return;
+
+        if (bytes_total == -1 && size > 0)
+            bytes_total = size - resume_offset;
+
+        // Progress covers the whole file, including any data resumed from disk
+        bytes_received += resume_offset;
+        bytes_total += resume_offset;
+
+        auto progress = (size < 0) ? size : (100 * bytes_received + bytes_total / 2) / bytes_total;
+        if (!monitor(download_type, progress))
+        {
+            abort_all_downloads();
+            reply->abort();
+        }
+    };
+
+    QNetworkReply* current_reply{nullptr};
+    auto on_download = [this, hash, &consume, &start_reply, &current_reply, &slot](QNetworkReply* reply,
+                                                                                   QTimer& download_timeout) {
+        if (abort_download)
+        {
+            reply->abort();
+            return;
+        }
+
+        if (download_timeout.isActive())
+            download_timeout.stop();
+        else
+            return;
+
+        // A new reply means either the first data or a retry from the cache, for which the data may start over
+        if (reply != current_reply)
+        {
+            current_reply = reply;
+            if (!start_reply(reply))
+            {
+                mpl::log(mpl::Level::error, category,
+                         fmt::format("cannot restart download of {}", reply->url().toString()));
+                reply->abort();
+                return;
+            }
+        }
+
+        scheduler.throttle(slot, reply->bytesAvailable(), abort_download);
+        if (abort_download)
+        {
+            reply->abort();
+            return;
+        }
+
+        const auto data = reply->readAll();
+        if (!consume(data))
+        {
+            reply->abort();
+        }
+        else if (hash)
+        {
+            hash->add_data(data);
+        }
+        download_timeout.start();
+    };
+
+    ::download(manager, timeout, url, progress_monitor, on_download, on_error, abort_download, raw_headers);
+}
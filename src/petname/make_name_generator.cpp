@@ -20,9 +20,23 @@
 #include "petname.h"
 #include <multipass/name_generator.h>
 
+#include <stdexcept>
+
 namespace mp = multipass;
 
 mp::NameGenerator::UPtr mp::make_default_name_generator()
 {
     return std::make_unique<mp::Petname>(mp::Petname::NumWords::TWO, "-");
-}
\ No newline at end of file
+}
+std::string mp::NameGenerator::make_unique_name(const NameFilter& is_taken)
+{
+    constexpr int num_retries = 100;
+    for (int i = 0; i < num_retries; i++)
+    {
+        auto name = make_name();
+        if (!is_taken(name))
+            return name;
+    }
+
+    throw std::runtime_error("unable to generate a unique name");
+}
@@ -21,6 +21,8 @@
 #include "multipass/petname/names.h"
 
 #include <iostream>
+#include <numeric>
+#include <stdexcept>
 
 namespace mp = multipass;
 namespace
@@ -63,9 +65,46 @@ mp::Petname::Petname(NumWords num_words, std::string separator)
 
 std::string mp::Petname::make_name()
 {
-    std::string name = multipass::petname::names[name_dist(engine)];
-    std::string adjective = multipass::petname::adjectives[adjective_dist(engine)];
-    std::string adverb = multipass::petname::adverbs[adverb_dist(engine)];
+    return name_at(name_dist(engine), adjective_dist(engine), adverb_dist(engine));
+}
+
+std::string mp::Petname::make_unique_name(const NameFilter& is_taken)
+{
+    // Word indices are packed into a single number, name first, since only the words in use vary
+    const std::size_t names_in_use = name_dist.max() - name_dist.min() + 1;
+    auto num_combinations = names_in_use;
+    if (num_words != NumWords::ONE)
+        num_combinations *= num_adjectives;
+    if (num_words == NumWords::THREE)
+        num_combinations *= num_adverbs;
+
+    // A stride coprime with the number of combinations visits each of them exactly once
+    std::uniform_int_distribution<std::size_t> dist{0, num_combinations - 1};
+    const auto start = dist(engine);
+    auto stride = dist(engine);
+    while (std::gcd(stride, num_combinations) != 1)
+        stride = (stride + 1) % num_combinations;
+
+    for (std::size_t i = 0, combination = start; i < num_combinations;
+         ++i, combination = (combination + stride) % num_combinations)
+    {
+        const auto name_index = name_dist.min() + combination % names_in_use;
+        const auto adjective_index = combination / names_in_use % num_adjectives;
+        const auto adverb_index = combination / names_in_use / num_adjectives;
+
+        auto name = name_at(name_index, adjective_index, adverb_index);
+        if (!is_taken(name))
+            return name;
+    }
+
+    throw std::runtime_error("unable to generate a unique name");
+}
+
+std::string mp::Petname::name_at(std::size_t name_index, std::size_t adjective_index, std::size_t adverb_index) const
+{
+    std::string name = multipass::petname::names[name_index];
+    std::string adjective = multipass::petname::adjectives[adjective_index];
+    std::string adverb = multipass::petname::adverbs[adverb_index];
 
     switch(num_words)
     {
@@ -49,8 +49,13 @@ public:
     explicit Petname(std::string separator);
 
     std::string make_name() override;
+    /// Walks every possible name in a random order, so a free name is found in bounded time
+    /// whenever there is one
+    std::string make_unique_name(const NameFilter& is_taken) override;
 
 private:
+    std::string name_at(std::size_t name_index, std::size_t adjective_index, std::size_t adverb_index) const;
+
     std::string separator;
     NumWords num_words;
     std::mt19937 engine;
@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "libvirt_connection.h"
+#include "libvirt_virtual_machine.h"
+
+#include <multipass/format.h>
+#include <multipass/logging/log.h>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+
+namespace
+{
+constexpr auto category = "libvirt";
+
+std::once_flag event_impl_flag;
+bool event_impl_registered{false};
+
+// The state the domain is left in, as told by the event alone
+mp::LibvirtConnection::DomainState state_after(int event, int detail)
+{
+    switch (event)
+    {
+    case VIR_DOMAIN_EVENT_STARTED:
+    case VIR_DOMAIN_EVENT_RESUMED:
+        return {VIR_DOMAIN_RUNNING, false};
+    case VIR_DOMAIN_EVENT_SUSPENDED:
+        return {VIR_DOMAIN_PAUSED, false};
+    case VIR_DOMAIN_EVENT_SHUTDOWN:
+        return {VIR_DOMAIN_SHUTDOWN, false};
+    case VIR_DOMAIN_EVENT_CRASHED:
+        return {VIR_DOMAIN_CRASHED, false};
+    case VIR_DOMAIN_EVENT_PMSUSPENDED:
+        return {VIR_DOMAIN_PMSUSPENDED, false};
+    default:
+        return {VIR_DOMAIN_SHUTOFF, event == VIR_DOMAIN_EVENT_STOPPED && detail == VIR_DOMAIN_EVENT_STOPPED_SAVED};
+    }
+}
+} // namespace
+
+mp::LibvirtConnection::LibvirtConnection(const LibvirtWrapper::UPtr& libvirt_wrapper)
+    : libvirt_wrapper{libvirt_wrapper}
+{
+}
+
+mp::LibvirtConnection::~LibvirtConnection()
+{
+    if (lifecycle_callback >= 0 && connection)
+    {
+        libvirt_wrapper->virConnectUnregisterCloseCallback(connection.get(), on_close);
+        libvirt_wrapper->virConnectDomainEventDeregisterAny(connection.get(), lifecycle_callback);
+    }
+
+    stop_event_loop();
+}
+
+virConnectPtr mp::LibvirtConnection::get()
+{
+    std::lock_guard<decltype(connection_mutex)> lock{connection_mutex};
+    // Not only asked for liveness: once states are read from what was heard, nothing else would notice it is gone
+    if (connection && !dropped && libvirt_wrapper->virConnectIsAlive(connection.get()) == 1)
+        return connection.get();
+
+    // Whatever was heard went with the connection that is gone
+    if (connection && lifecycle_callback >= 0)
+        libvirt_wrapper->virConnectUnregisterCloseCallback(connection.get(), on_close);
+    listening = dropped = false;
+    lifecycle_callback = -1;
+    {
+        std::lock_guard<decltype(mutex)> cache_lock{mutex};
+        states.clear();
+        leases.clear();
+    }
+
+    // Events are only delivered on connections opened after the event loop is in place
+    start_event_loop();
+    connection = LibVirtVirtualMachine::open_libvirt_connection(libvirt_wrapper);
+
+    if (running)
+    {
+        lifecycle_callback = libvirt_wrapper->virConnectDomainEventRegisterAny(
+            connection.get(), nullptr, VIR_DOMAIN_EVENT_ID_LIFECYCLE, VIR_DOMAIN_EVENT_CALLBACK(on_lifecycle_event),
+            this, nullptr);
+        listening = lifecycle_callback >= 0;
+
+        if (listening)
+            libvirt_wrapper->virConnectRegisterCloseCallback(connection.get(), on_close, this, nullptr);
+    }
+
+    if (!listening)
+        mpl::log(mpl::Level::warning, category, "Cannot listen for libvirt domain events, asking for states instead");
+
+    return connection.get();
+}
+
+auto mp::LibvirtConnection::domain_state(const std::string& name) -> optional<DomainState>
+{
+    if (listening)
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        auto it = states.find(name);
+        if (it != states.end())
+            return it->second;
+    }
+
+    LibVirtVirtualMachine::DomainUPtr domain{libvirt_wrapper->virDomainLookupByName(get(), name.c_str()),
+                                             libvirt_wrapper->virDomainFree};
+
+    return refresh_state(name, domain.get());
+}
+
+auto mp::LibvirtConnection::refresh_state(const std::string& name, virDomainPtr domain) -> optional<DomainState>
+{
+    auto domain_state{0};
+    optional<DomainState> ret;
+    if (domain && libvirt_wrapper->virDomainGetState(domain, &domain_state, nullptr, 0) != -1)
+        ret = DomainState{domain_state, libvirt_wrapper->virDomainHasManagedSaveImage(domain, 0) == 1};
+
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    if (ret && listening)
+        states[name] = *ret;
+    else
+        states.erase(name);
+
+    return ret;
+}
+
+void mp::LibvirtConnection::forget_state(const std::string& name)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    states.erase(name);
+}
+
+auto mp::LibvirtConnection::ip_for(const std::string& mac_addr) -> optional<IPAddress>
+{
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        auto it = leases.find(mac_addr);
+        if (it != leases.end())
+            return it->second;
+    }
+
+    optional<IPAddress> ip_address;
+
+    virConnectPtr libvirt_connection{nullptr};
+    try
+    {
+        libvirt_connection = get();
+    }
+    catch (const std::exception&)
+    {
+        return ip_address;
+    }
+
+    LibVirtVirtualMachine::NetworkUPtr network{libvirt_wrapper->virNetworkLookupByName(libvirt_connection, "default"),
+                                               libvirt_wrapper->virNetworkFree};
+
+    virNetworkDHCPLeasePtr* leases_ret = nullptr;
+    auto nleases = libvirt_wrapper->virNetworkGetDHCPLeases(network.get(), mac_addr.c_str(), &leases_ret, 0);
+
+    auto leases_deleter = [&nleases, this](virNetworkDHCPLeasePtr* leases) {
+        for (auto i = 0; i < nleases; ++i)
+        {
+            libvirt_wrapper->virNetworkDHCPLeaseFree(leases[i]);
+        }
+        free(leases);
+    };
+
+    std::unique_ptr<virNetworkDHCPLeasePtr, decltype(leases_deleter)> leases_ptr{leases_ret, leases_deleter};
+    if (nleases > 0)
+    {
+        ip_address.emplace(leases_ret[0]->ipaddr);
+
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        if (listening)
+            leases.emplace(mac_addr, *ip_address);
+    }
+
+    return ip_address;
+}
+
+void mp::LibvirtConnection::forget_lease(const std::string& mac_addr)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    leases.erase(mac_addr);
+}
+
+void mp::LibvirtConnection::watch(const std::string& name, EventHandler handler)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    handlers[name] = std::move(handler);
+}
+
+void mp::LibvirtConnection::unwatch(const std::string& name)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    handlers.erase(name);
+}
+
+int mp::LibvirtConnection::on_lifecycle_event(virConnectPtr /*connection*/, virDomainPtr domain, int event,
+                                              int detail, void* opaque)
+{
+    auto self = static_cast<LibvirtConnection*>(opaque);
+    const std::string name{self->libvirt_wrapper->virDomainGetName(domain)};
+    mpl::log(mpl::Level::trace, category, fmt::format("Lifecycle event {} ({}) for {}", event, detail, name));
+
+    // Handlers are called with the lock held, so that they are not unwatched while running
+    std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+    if (event == VIR_DOMAIN_EVENT_DEFINED || event == VIR_DOMAIN_EVENT_UNDEFINED)
+        self->states.erase(name);
+    else
+        self->states[name] = state_after(event, detail);
+
+    auto it = self->handlers.find(name);
+    if (it != self->handlers.end())
+        it->second();
+
+    return 0;
+}
+
+void mp::LibvirtConnection::on_close(virConnectPtr /*connection*/, int reason, void* opaque)
+{
+    auto self = static_cast<LibvirtConnection*>(opaque);
+    mpl::log(mpl::Level::warning, category, fmt::format("libvirt closed the connection ({}), reopening it", reason));
+
+    // Until it is reopened, states are asked for
+    std::lock_guard<decltype(self->mutex)> lock{self->mutex};
+    self->listening = false;
+    self->dropped = true;
+    self->states.clear();
+    self->leases.clear();
+}
+
+void mp::LibvirtConnection::on_wake_up(int timer, void* opaque)
+{
+    static_cast<LibvirtConnection*>(opaque)->libvirt_wrapper->virEventRemoveTimeout(timer);
+}
+
+void mp::LibvirtConnection::start_event_loop()
+{
+    // One that failed is done, and started again for the connection about to be opened
+    if (event_loop && !running)
+        event_loop.reset();
+
+    if (event_loop || !libvirt_wrapper)
+        return;
+
+    // libvirt keeps a single event loop implementation for the whole process
+    std::call_once(event_impl_flag,
+                   [this] { event_impl_registered = libvirt_wrapper->virEventRegisterDefaultImpl() == 0; });
+    if (!event_impl_registered)
+        return;
+
+    running = true;
+    event_loop = std::make_unique<AutoJoinThread>([this] {
+        while (running)
+        {
+            if (libvirt_wrapper->virEventRunDefaultImpl() < 0)
+            {
+                // What was heard so far cannot be trusted to stay current
+                mpl::log(mpl::Level::warning, category,
+                         fmt::format("libvirt event loop failed: {}", libvirt_wrapper->virGetLastErrorMessage()));
+                listening = running = false;
+                dropped = true;
+            }
+        }
+    });
+}
+
+void mp::LibvirtConnection::stop_event_loop()
+{
+    if (!event_loop)
+        return;
+
+    // Wakes the loop up for it to see it should stop
+    running = false;
+    libvirt_wrapper->virEventAddTimeout(0, on_wake_up, this, nullptr);
+    event_loop.reset();
+}
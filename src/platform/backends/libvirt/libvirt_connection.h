@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_LIBVIRT_CONNECTION_H
+#define MULTIPASS_LIBVIRT_CONNECTION_H
+
+#include "libvirt_wrapper.h"
+
+#include <multipass/auto_join_thread.h>
+#include <multipass/ip_address.h>
+#include <multipass/optional.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace multipass
+{
+// The one connection to libvirtd a factory and its instances share. It listens for domain lifecycle events, so that
+// instance states and addresses are read from what it heard rather than asked of libvirtd on every query.
+class LibvirtConnection
+{
+public:
+    struct DomainState
+    {
+        int state;
+        bool managed_save;
+    };
+    using EventHandler = std::function<void()>;
+
+    explicit LibvirtConnection(const LibvirtWrapper::UPtr& libvirt_wrapper);
+    ~LibvirtConnection();
+
+    // Opened on first use and again once libvirtd dropped it. Throws when libvirtd cannot be reached
+    virConnectPtr get();
+
+    // Asks libvirtd only about domains no event was heard for yet. Nothing for domains that are not defined
+    optional<DomainState> domain_state(const std::string& name);
+    // Asks libvirtd about the domain on hand, for callers about to act on it
+    optional<DomainState> refresh_state(const std::string& name, virDomainPtr domain);
+    void forget_state(const std::string& name);
+
+    optional<IPAddress> ip_for(const std::string& mac_addr);
+    void forget_lease(const std::string& mac_addr);
+
+    // Called in the event loop's thread whenever the domain changed state, so it must not call back in here
+    void watch(const std::string& name, EventHandler handler);
+    void unwatch(const std::string& name);
+
+private:
+    static int on_lifecycle_event(virConnectPtr connection, virDomainPtr domain, int event, int detail, void* opaque);
+    static void on_close(virConnectPtr connection, int reason, void* opaque);
+    static void on_wake_up(int timer, void* opaque);
+    void start_event_loop();
+    void stop_event_loop();
+
+    const LibvirtWrapper::UPtr& libvirt_wrapper;
+    std::mutex connection_mutex;
+    std::unique_ptr<virConnect, decltype(virConnectClose)*> connection{nullptr, nullptr};
+    int lifecycle_callback{-1};
+    std::atomic_bool listening{false};
+    std::atomic_bool dropped{false}; // told so by libvirt, or by the event loop failing
+    std::atomic_bool running{false};
+    std::unique_ptr<AutoJoinThread> event_loop;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, DomainState> states;
+    std::unordered_map<std::string, IPAddress> leases;
+    std::unordered_map<std::string, EventHandler> handlers;
+};
+} // namespace multipass
+
+#endif // MULTIPASS_LIBVIRT_CONNECTION_H
@@ -27,8 +27,12 @@
 #include <shared/linux/backend_utils.h>
 #include <shared/shared_backend_utils.h>
 
+#include <QString>
 #include <QXmlStreamReader>
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
 namespace mp = multipass;
 namespace mpl = multipass::logging;
@@ -56,78 +60,163 @@ auto instance_mac_addr_for(virDomainPtr domain, const mp::LibvirtWrapper::UPtr&
     return mac_addr;
 }
 
-auto instance_ip_for(const std::string& mac_addr, const mp::LibvirtWrapper::UPtr& libvirt_wrapper)
+auto host_architecture_for(virConnectPtr connection, const mp::LibvirtWrapper::UPtr& libvirt_wrapper)
 {
-    mp::optional<mp::IPAddress> ip_address;
+    std::string arch;
+    std::unique_ptr<char, decltype(free)*> capabilities{libvirt_wrapper->virConnectGetCapabilities(connection), free};
 
-    mp::LibVirtVirtualMachine::ConnectionUPtr connection{nullptr, nullptr};
-    try
-    {
-        connection = mp::LibVirtVirtualMachine::open_libvirt_connection(libvirt_wrapper);
-    }
-    catch (const std::exception&)
+    QXmlStreamReader reader(capabilities.get());
+
+    while (!reader.atEnd())
     {
-        return ip_address;
+        reader.readNext();
+
+        if (reader.name() == "arch")
+        {
+            arch = reader.readElementText().toStdString();
+            break;
+        }
     }
 
-    mp::LibVirtVirtualMachine::NetworkUPtr network{libvirt_wrapper->virNetworkLookupByName(connection.get(), "default"),
-                                                   libvirt_wrapper->virNetworkFree};
+    return arch;
+}
 
-    virNetworkDHCPLeasePtr* leases = nullptr;
-    auto nleases = libvirt_wrapper->virNetworkGetDHCPLeases(network.get(), mac_addr.c_str(), &leases, 0);
+// virtiofs needs the guest memory to be shareable with virtiofsd, which libvirt starts for each filesystem
+auto generate_native_mounts_xml_for(const std::vector<mp::NativeMount>& native_mounts)
+{
+    std::string memory_backing, filesystems;
+    if (native_mounts.empty())
+        return std::make_pair(memory_backing, filesystems);
 
-    auto leases_deleter = [&nleases, &libvirt_wrapper](virNetworkDHCPLeasePtr* leases) {
-        for (auto i = 0; i < nleases; ++i)
-        {
-            libvirt_wrapper->virNetworkDHCPLeaseFree(leases[i]);
-        }
-        free(leases);
-    };
+    memory_backing = "  <memoryBacking>\n"
+                     "    <source type=\'memfd\'/>\n"
+                     "    <access mode=\'shared\'/>\n"
+                     "  </memoryBacking>\n";
 
-    std::unique_ptr<virNetworkDHCPLeasePtr, decltype(leases_deleter)> leases_ptr{leases, leases_deleter};
-    if (nleases > 0)
+    for (const auto& mount : native_mounts)
     {
-        ip_address.emplace(leases[0]->ipaddr);
+        // Same semantics as the SFTP server's maps: files the host id owns appear as owned by the instance id
+        std::string idmap;
+        for (const auto& ids : mount.uid_map)
+            idmap += fmt::format("        <uid start=\'{}\' target=\'{}\' count=\'1\'/>\n", ids.second, ids.first);
+        for (const auto& ids : mount.gid_map)
+            idmap += fmt::format("        <gid start=\'{}\' target=\'{}\' count=\'1\'/>\n", ids.second, ids.first);
+        if (!idmap.empty())
+            idmap = fmt::format("      <idmap>\n{}      </idmap>\n", idmap);
+
+        filesystems += fmt::format("    <filesystem type=\'mount\' accessmode=\'passthrough\'>\n"
+                                   "      <driver type=\'virtiofs\'/>\n"
+                                   "      <source dir=\"{}\"/>\n"
+                                   "      <target dir=\"{}\"/>\n"
+                                   "{}"
+                                   "    </filesystem>\n",
+                                   QString::fromStdString(mount.source_path).toHtmlEscaped().toStdString(),
+                                   QString::fromStdString(mount.tag).toHtmlEscaped().toStdString(), idmap);
     }
 
-    return ip_address;
+    return std::make_pair(memory_backing, filesystems);
 }
 
-auto host_architecture_for(virConnectPtr connection, const mp::LibvirtWrapper::UPtr& libvirt_wrapper)
+// What the domain's definition shares, read back the way generate_native_mounts_xml_for gives it, ordered by tag
+auto native_mounts_in(virDomainPtr domain, const mp::LibvirtWrapper::UPtr& libvirt_wrapper)
 {
-    std::string arch;
-    std::unique_ptr<char, decltype(free)*> capabilities{libvirt_wrapper->virConnectGetCapabilities(connection), free};
-
-    QXmlStreamReader reader(capabilities.get());
+    std::vector<mp::NativeMount> native_mounts;
+    std::unique_ptr<char, decltype(free)*> desc{libvirt_wrapper->virDomainGetXMLDesc(domain, VIR_DOMAIN_XML_INACTIVE),
+                                                free};
 
+    QXmlStreamReader reader(desc.get());
+    auto in_filesystem = false;
     while (!reader.atEnd())
     {
         reader.readNext();
 
-        if (reader.name() == "arch")
+        if (reader.isEndElement() && reader.name() == "filesystem")
+            in_filesystem = false;
+        if (!reader.isStartElement())
+            continue;
+
+        const auto attributes = reader.attributes();
+        if (reader.name() == "filesystem")
         {
-            arch = reader.readElementText().toStdString();
-            break;
+            in_filesystem = true;
+            native_mounts.emplace_back();
         }
+        else if (!in_filesystem)
+            continue;
+        else if (reader.name() == "source")
+            native_mounts.back().source_path = attributes.value("dir").toString().toStdString();
+        else if (reader.name() == "target")
+            native_mounts.back().tag = attributes.value("dir").toString().toStdString();
+        else if (reader.name() == "uid")
+            native_mounts.back().uid_map[attributes.value("target").toInt()] = attributes.value("start").toInt();
+        else if (reader.name() == "gid")
+            native_mounts.back().gid_map[attributes.value("target").toInt()] = attributes.value("start").toInt();
     }
 
-    return arch;
+    std::sort(native_mounts.begin(), native_mounts.end(), [](const auto& a, const auto& b) { return a.tag < b.tag; });
+    return native_mounts;
+}
+
+// The disk's <iotune> and the interface's <bandwidth>, the latter being in KiB/s both ways
+auto generate_io_limits_xml_for(const mp::IoLimits& limits)
+{
+    std::string iotune, bandwidth;
+    if (limits.disk_limited())
+    {
+        auto add = [&iotune](const char* element, long long value) {
+            if (value)
+                iotune += fmt::format("        <{0}>{1}</{0}>\n", element, value);
+        };
+
+        add("total_bytes_sec", limits.disk_bytes_per_second);
+        add("total_iops_sec", limits.disk_iops);
+        add("total_bytes_sec_max", limits.disk_bytes_burst);
+        add("total_iops_sec_max", limits.disk_iops_burst);
+        iotune = fmt::format("      <iotune>\n{}      </iotune>\n", iotune);
+    }
+
+    if (limits.network_bytes_per_second)
+        bandwidth = fmt::format("      <bandwidth>\n"
+                                "        <inbound average=\'{0}\'/>\n"
+                                "        <outbound average=\'{0}\'/>\n"
+                                "      </bandwidth>\n",
+                                std::max(limits.network_bytes_per_second / 1024, 1LL));
+
+    return std::make_pair(iotune, bandwidth);
+}
+
+virTypedParameter typed_parameter(const char* field, int type, unsigned long long value)
+{
+    virTypedParameter parameter{};
+    std::strncpy(parameter.field, field, VIR_TYPED_PARAM_FIELD_LENGTH - 1);
+    parameter.type = type;
+    if (type == VIR_TYPED_PARAM_UINT)
+        parameter.value.ui = static_cast<unsigned int>(value);
+    else
+        parameter.value.ul = value;
+
+    return parameter;
 }
 
 auto generate_xml_config_for(const mp::VirtualMachineDescription& desc, const std::string& bridge_name,
+                             const std::vector<mp::NativeMount>& native_mounts, const mp::IoLimits& io_limits,
                              const std::string& arch)
 {
     static constexpr auto mem_unit = "k"; // see https://libvirt.org/formatdomain.html#elementsMemoryAllocation
     const auto memory = desc.mem_size.in_kilobytes(); /* floored here, but then "[...] the value will be rounded up to
     the nearest kibibyte by libvirt, and may be further rounded to the granularity supported by the hypervisor [...]" */
 
+    // The instance disk has no empty <backingStore/>, for libvirt to follow the chain of disks that are overlays
     auto qemu_path = fmt::format("/usr/bin/qemu-system-{}", arch);
+    const auto native_mounts_xml = generate_native_mounts_xml_for(native_mounts);
+    const auto io_limits_xml = generate_io_limits_xml_for(io_limits);
 
     return fmt::format(
         "<domain type=\'kvm\'>\n"
         "  <name>{}</name>\n"
         "  <memory unit=\'{}\'>{}</memory>\n"
         "  <currentMemory unit=\'{}\'>{}</currentMemory>\n"
+        "{}"
         "  <vcpu placement=\'static\'>{}</vcpu>\n"
         "  <resource>\n"
         "    <partition>/machine</partition>\n"
@@ -148,9 +237,9 @@ auto generate_xml_config_for(const mp::VirtualMachineDescription& desc, const st
         "    <disk type=\'file\' device=\'disk\'>\n"
         "      <driver name=\'qemu\' type=\'qcow2\' discard=\'unmap\'/>\n"
         "      <source file=\'{}\'/>\n"
-        "      <backingStore/>\n"
         "      <target dev=\'vda\' bus=\'virtio\'/>\n"
         "      <alias name=\'virtio-disk0\'/>\n"
+        "{}"
         "    </disk>\n"
         "    <disk type=\'file\' device=\'disk\'>\n"
         "      <driver name=\'qemu\' type=\'raw\'/>\n"
@@ -165,19 +254,25 @@ auto generate_xml_config_for(const mp::VirtualMachineDescription& desc, const st
         "      <target dev=\'vnet0\'/>\n"
         "      <model type=\'virtio\'/>\n"
         "      <alias name=\'net0\'/>\n"
+        "{}"
         "    </interface>\n"
+        "{}"
         "    <serial type=\'pty\'>\n"
         "      <source path=\'/dev/pts/2\'/>\n"
         "      <target port=\"0\"/>\n"
         "    </serial>\n"
+        "    <memballoon model=\'virtio\'>\n"
+        "      <stats period=\'5\'/>\n"
+        "    </memballoon>\n"
         "    <video>\n"
         "      <model type=\'qxl\' ram=\'65536\' vram=\'65536\' vgamem=\'16384\' heads=\'1\' primary=\'yes\'/>\n"
         "      <alias name=\'video0\'/>\n"
         "    </video>\n"
         "  </devices>\n"
         "</domain>",
-        desc.vm_name, mem_unit, memory, mem_unit, memory, desc.num_cores, arch, qemu_path,
-        desc.image.image_path.toStdString(), desc.cloud_init_iso.toStdString(), desc.default_mac_address, bridge_name);
+        desc.vm_name, mem_unit, memory, mem_unit, memory, native_mounts_xml.first, desc.num_cores, arch, qemu_path,
+        desc.image.image_path.toStdString(), io_limits_xml.first, desc.cloud_init_iso.toStdString(),
+        desc.default_mac_address, bridge_name, io_limits_xml.second, native_mounts_xml.second);
 }
 
 auto domain_by_name_for(const std::string& vm_name, virConnectPtr connection,
@@ -190,27 +285,26 @@ auto domain_by_name_for(const std::string& vm_name, virConnectPtr connection,
 }
 
 auto domain_by_definition_for(const mp::VirtualMachineDescription& desc, const std::string& bridge_name,
+                              const std::vector<mp::NativeMount>& native_mounts, const mp::IoLimits& io_limits,
                               virConnectPtr connection, const mp::LibvirtWrapper::UPtr& libvirt_wrapper)
 {
     mp::LibVirtVirtualMachine::DomainUPtr domain{
-        libvirt_wrapper->virDomainDefineXML(
-            connection,
-            generate_xml_config_for(desc, bridge_name, host_architecture_for(connection, libvirt_wrapper)).c_str()),
+        libvirt_wrapper->virDomainDefineXML(connection,
+                                            generate_xml_config_for(desc, bridge_name, native_mounts, io_limits,
+                                                                    host_architecture_for(connection, libvirt_wrapper))
+                                                .c_str()),
         libvirt_wrapper->virDomainFree};
 
     return domain;
 }
 
-auto refresh_instance_state_for_domain(virDomainPtr domain, const mp::VirtualMachine::State& current_instance_state,
-                                       const mp::LibvirtWrapper::UPtr& libvirt_wrapper)
+auto instance_state_for(const mp::optional<mp::LibvirtConnection::DomainState>& domain_state,
+                        const mp::VirtualMachine::State& current_instance_state)
 {
-    auto domain_state{0};
-
-    if (!domain || libvirt_wrapper->virDomainGetState(domain, &domain_state, nullptr, 0) == -1 ||
-        domain_state == VIR_DOMAIN_NOSTATE)
+    if (!domain_state || domain_state->state == VIR_DOMAIN_NOSTATE)
         return mp::VirtualMachine::State::unknown;
 
-    if (libvirt_wrapper->virDomainHasManagedSaveImage(domain, 0) == 1)
+    if (domain_state->managed_save)
         return mp::VirtualMachine::State::suspended;
 
     // Most of these libvirt domain states don't have a Multipass instance state
@@ -218,40 +312,37 @@ auto refresh_instance_state_for_domain(virDomainPtr domain, const mp::VirtualMac
     const auto domain_off_states = {VIR_DOMAIN_BLOCKED, VIR_DOMAIN_PAUSED,  VIR_DOMAIN_SHUTDOWN,
                                     VIR_DOMAIN_SHUTOFF, VIR_DOMAIN_CRASHED, VIR_DOMAIN_PMSUSPENDED};
 
-    if (std::find(domain_off_states.begin(), domain_off_states.end(), domain_state) != domain_off_states.end())
+    if (std::find(domain_off_states.begin(), domain_off_states.end(), domain_state->state) != domain_off_states.end())
         return mp::VirtualMachine::State::off;
 
-    if (domain_state == VIR_DOMAIN_RUNNING && current_instance_state == mp::VirtualMachine::State::off)
+    if (domain_state->state == VIR_DOMAIN_RUNNING && current_instance_state == mp::VirtualMachine::State::off)
         return mp::VirtualMachine::State::running;
 
     return current_instance_state;
 }
-
-bool domain_is_running(virDomainPtr domain, const mp::LibvirtWrapper::UPtr& libvirt_wrapper)
-{
-    auto domain_state{0};
-
-    if (libvirt_wrapper->virDomainGetState(domain, &domain_state, nullptr, 0) == -1 ||
-        domain_state != VIR_DOMAIN_RUNNING)
-        return false;
-
-    return true;
-}
 } // namespace
 
 mp::LibVirtVirtualMachine::LibVirtVirtualMachine(const mp::VirtualMachineDescription& desc,
                                                  const std::string& bridge_name, mp::VMStatusMonitor& monitor,
-                                                 const mp::LibvirtWrapper::UPtr& libvirt_wrapper)
+                                                 const mp::LibvirtWrapper::UPtr& libvirt_wrapper,
+                                                 mp::LibvirtConnection& connection)
     : BaseVirtualMachine{desc.vm_name},
       username{desc.ssh_username},
       desc{desc},
       monitor{&monitor},
       bridge_name{bridge_name},
-      libvirt_wrapper{libvirt_wrapper}
+      libvirt_wrapper{libvirt_wrapper},
+      connection{connection},
+      io_limits{desc.io_limits}
 {
+    // Events come in libvirt's own thread, but are dealt with in ours
+    QObject::connect(this, &LibVirtVirtualMachine::on_domain_event, this, [this] { handle_domain_event(); },
+                     Qt::QueuedConnection);
+    connection.watch(vm_name, [this] { emit on_domain_event(); });
+
     try
     {
-        initialize_domain_info(open_libvirt_connection(libvirt_wrapper).get());
+        initialize_domain_info();
     }
     catch (const std::exception&)
     {
@@ -261,6 +352,7 @@ mp::LibVirtVirtualMachine::LibVirtVirtualMachine(const mp::VirtualMachineDescrip
 
 mp::LibVirtVirtualMachine::~LibVirtVirtualMachine()
 {
+    connection.unwatch(vm_name);
     update_suspend_status = false;
 
     if (state == State::running)
@@ -269,25 +361,40 @@ mp::LibVirtVirtualMachine::~LibVirtVirtualMachine()
 
 void mp::LibVirtVirtualMachine::start()
 {
-    auto connection = open_libvirt_connection(libvirt_wrapper);
     DomainUPtr domain{nullptr, nullptr};
 
     if (state == VirtualMachine::State::unknown)
-        domain = initialize_domain_info(connection.get());
+        domain = initialize_domain_info();
     else
         domain = domain_by_name_for(vm_name, connection.get(), libvirt_wrapper);
 
-    state = refresh_instance_state_for_domain(domain.get(), state, libvirt_wrapper);
+    state = instance_state_for(connection.refresh_state(vm_name, domain.get()), state);
     if (state == State::running)
         return;
 
     if (state == State::suspended)
         mpl::log(mpl::Level::info, vm_name, fmt::format("Resuming from a suspended state"));
+    else if (definition_changed)
+    {
+        // The domain's devices are fixed by its definition, so shared directories and I/O limits need a new one
+        libvirt_wrapper->virDomainUndefine(domain.get());
+        domain = domain_by_definition_for(desc, bridge_name, native_mounts, io_limits, connection.get(),
+                                          libvirt_wrapper);
+        connection.forget_state(vm_name);
+        if (!domain)
+            throw std::runtime_error(fmt::format("failed to redefine the instance: {}",
+                                                 libvirt_wrapper->virGetLastErrorMessage()));
+
+        definition_changed = false;
+    }
 
     state = State::starting;
     update_state();
 
-    if (libvirt_wrapper->virDomainCreate(domain.get()) == -1)
+    // Until the event comes, the domain is asked about again
+    auto created = libvirt_wrapper->virDomainCreate(domain.get()) != -1;
+    connection.forget_state(vm_name);
+    if (!created)
     {
         state = State::suspended;
         update_state();
@@ -320,11 +427,14 @@ void mp::LibVirtVirtualMachine::stop()
 void mp::LibVirtVirtualMachine::shutdown()
 {
     std::unique_lock<decltype(state_mutex)> lock{state_mutex};
-    auto domain = domain_by_name_for(vm_name, open_libvirt_connection(libvirt_wrapper).get(), libvirt_wrapper);
-    state = refresh_instance_state_for_domain(domain.get(), state, libvirt_wrapper);
+    auto domain = domain_by_name_for(vm_name, connection.get(), libvirt_wrapper);
+    state = instance_state_for(connection.refresh_state(vm_name, domain.get()), state);
     if (state == State::running || state == State::delayed_shutdown || state == State::unknown)
     {
-        if (!domain || libvirt_wrapper->virDomainShutdown(domain.get()) == -1)
+        auto shut_down = domain && libvirt_wrapper->virDomainShutdown(domain.get()) != -1;
+        connection.forget_state(vm_name);
+        connection.forget_lease(mac_addr);
+        if (!shut_down)
         {
             auto warning_string{
                 fmt::format("Cannot shutdown '{}': {}", vm_name, libvirt_wrapper->virGetLastErrorMessage())};
@@ -337,7 +447,10 @@ void mp::LibVirtVirtualMachine::shutdown()
     }
     else if (state == State::starting)
     {
+        // Forgotten beforehand too, for whoever waits on the start to see the domain go
+        connection.forget_state(vm_name);
         libvirt_wrapper->virDomainDestroy(domain.get());
+        connection.forget_state(vm_name);
         state_wait.wait(lock, [this] { return shutdown_while_starting; });
         update_state();
     }
@@ -352,11 +465,13 @@ void mp::LibVirtVirtualMachine::shutdown()
 
 void mp::LibVirtVirtualMachine::suspend()
 {
-    auto domain = domain_by_name_for(vm_name, open_libvirt_connection(libvirt_wrapper).get(), libvirt_wrapper);
-    state = refresh_instance_state_for_domain(domain.get(), state, libvirt_wrapper);
+    auto domain = domain_by_name_for(vm_name, connection.get(), libvirt_wrapper);
+    state = instance_state_for(connection.refresh_state(vm_name, domain.get()), state);
     if (state == State::running || state == State::delayed_shutdown)
     {
-        if (!domain || libvirt_wrapper->virDomainManagedSave(domain.get(), 0) < 0)
+        auto saved = domain && libvirt_wrapper->virDomainManagedSave(domain.get(), 0) >= 0;
+        connection.forget_state(vm_name);
+        if (!saved)
         {
             auto warning_string{
                 fmt::format("Cannot suspend '{}': {}", vm_name, libvirt_wrapper->virGetLastErrorMessage())};
@@ -382,12 +497,14 @@ mp::VirtualMachine::State mp::LibVirtVirtualMachine::current_state()
 {
     try
     {
-        auto connection = open_libvirt_connection(libvirt_wrapper);
-        auto domain = domain_by_name_for(vm_name, connection.get(), libvirt_wrapper);
-        if (!domain)
-            initialize_domain_info(connection.get());
+        auto domain_state = connection.domain_state(vm_name);
+        if (!domain_state)
+        {
+            initialize_domain_info();
+            domain_state = connection.domain_state(vm_name);
+        }
 
-        state = refresh_instance_state_for_domain(domain.get(), state, libvirt_wrapper);
+        state = instance_state_for(domain_state, state);
     }
     catch (const std::exception&)
     {
@@ -405,8 +522,8 @@ int mp::LibVirtVirtualMachine::ssh_port()
 void mp::LibVirtVirtualMachine::ensure_vm_is_running()
 {
     auto is_vm_running = [this] {
-        auto domain = domain_by_name_for(vm_name, open_libvirt_connection(libvirt_wrapper).get(), libvirt_wrapper);
-        return domain_is_running(domain.get(), libvirt_wrapper);
+        auto domain_state = connection.domain_state(vm_name);
+        return domain_state && domain_state->state == VIR_DOMAIN_RUNNING;
     };
 
     mp::backend::ensure_vm_is_running_for(this, is_vm_running, "Instance failed to start");
@@ -414,7 +531,7 @@ void mp::LibVirtVirtualMachine::ensure_vm_is_running()
 
 std::string mp::LibVirtVirtualMachine::ssh_hostname(std::chrono::milliseconds timeout)
 {
-    auto get_ip = [this]() -> optional<IPAddress> { return instance_ip_for(mac_addr, libvirt_wrapper); };
+    auto get_ip = [this]() -> optional<IPAddress> { return connection.ip_for(mac_addr); };
 
     return mp::backend::ip_address_for(this, get_ip, timeout);
 }
@@ -428,7 +545,7 @@ std::string mp::LibVirtVirtualMachine::management_ipv4()
 {
     if (!management_ip)
     {
-        auto result = instance_ip_for(mac_addr, libvirt_wrapper);
+        auto result = connection.ip_for(mac_addr);
         if (result)
             management_ip.emplace(result.value());
         else
@@ -453,24 +570,128 @@ void mp::LibVirtVirtualMachine::update_state()
     monitor->persist_state_for(vm_name, state);
 }
 
-mp::LibVirtVirtualMachine::DomainUPtr mp::LibVirtVirtualMachine::initialize_domain_info(virConnectPtr connection)
+void mp::LibVirtVirtualMachine::set_native_mounts(const std::vector<NativeMount>& mounts)
 {
-    auto domain = domain_by_name_for(vm_name, connection, libvirt_wrapper);
+    native_mounts = mounts;
+    std::sort(native_mounts.begin(), native_mounts.end(), [](const auto& a, const auto& b) { return a.tag < b.tag; });
+
+    // Only a definition that shares something else needs replacing; one yet to be made gets these anyway
+    auto domain = domain_by_name_for(vm_name, connection.get(), libvirt_wrapper);
+    if (domain && native_mounts_in(domain.get(), libvirt_wrapper) != native_mounts)
+        definition_changed = true;
+}
+
+void mp::LibVirtVirtualMachine::set_io_limits(const IoLimits& limits)
+{
+    io_limits = limits;
+    definition_changed = true;
+
+    if (state != State::running && state != State::delayed_shutdown)
+        return;
+
+    // Both the disk and the interface take zeroes for no limit
+    std::vector<virTypedParameter> iotune{
+        typed_parameter(VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_BYTES_SEC, VIR_TYPED_PARAM_ULLONG, limits.disk_bytes_per_second),
+        typed_parameter(VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_IOPS_SEC, VIR_TYPED_PARAM_ULLONG, limits.disk_iops),
+        typed_parameter(VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_BYTES_SEC_MAX, VIR_TYPED_PARAM_ULLONG, limits.disk_bytes_burst),
+        typed_parameter(VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_IOPS_SEC_MAX, VIR_TYPED_PARAM_ULLONG, limits.disk_iops_burst)};
+    const auto kib_per_second = limits.network_bytes_per_second ? std::max(limits.network_bytes_per_second / 1024, 1LL)
+                                                                : 0LL;
+    std::vector<virTypedParameter> bandwidth{
+        typed_parameter(VIR_DOMAIN_BANDWIDTH_IN_AVERAGE, VIR_TYPED_PARAM_UINT, kib_per_second),
+        typed_parameter(VIR_DOMAIN_BANDWIDTH_OUT_AVERAGE, VIR_TYPED_PARAM_UINT, kib_per_second)};
+
+    const auto flags = VIR_DOMAIN_AFFECT_LIVE;
+    auto domain = domain_by_name_for(vm_name, connection.get(), libvirt_wrapper);
+    const auto throttled =
+        domain &&
+        libvirt_wrapper->virDomainSetBlockIoTune(domain.get(), "vda", iotune.data(), static_cast<int>(iotune.size()),
+                                                 flags) >= 0 &&
+        libvirt_wrapper->virDomainSetInterfaceParameters(domain.get(), mac_addr.c_str(), bandwidth.data(),
+                                                         static_cast<int>(bandwidth.size()), flags) >= 0;
+    if (!throttled)
+        throw std::runtime_error(
+            fmt::format("failed to throttle the instance: {}", libvirt_wrapper->virGetLastErrorMessage()));
+}
+
+mp::VirtualMachine::Metrics mp::LibVirtVirtualMachine::metrics()
+{
+    try
+    {
+        auto domain = domain_by_name_for(vm_name, connection.get(), libvirt_wrapper);
+
+        // Reported by the balloon driver in the guest, in KiB
+        virDomainMemoryStatStruct stats[VIR_DOMAIN_MEMORY_STAT_NR];
+        const auto count =
+            domain ? libvirt_wrapper->virDomainMemoryStats(domain.get(), stats, VIR_DOMAIN_MEMORY_STAT_NR, 0) : -1;
+
+        optional<long long> available, usable;
+        for (auto i = 0; i < count; ++i)
+        {
+            if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_AVAILABLE)
+                available = static_cast<long long>(stats[i].val) * 1024;
+            else if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_USABLE)
+                usable = static_cast<long long>(stats[i].val) * 1024;
+        }
+
+        if (available && usable)
+            return {*available - *usable, *available, nullopt, nullopt};
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::debug, vm_name, fmt::format("Cannot get metrics from libvirt: {}", e.what()));
+    }
+
+    return {};
+}
+
+mp::LibVirtVirtualMachine::DomainUPtr mp::LibVirtVirtualMachine::initialize_domain_info()
+{
+    auto domain = domain_by_name_for(vm_name, connection.get(), libvirt_wrapper);
 
     if (!domain)
     {
-        domain = domain_by_definition_for(desc, bridge_name, connection, libvirt_wrapper);
+        domain = domain_by_definition_for(desc, bridge_name, native_mounts, io_limits, connection.get(),
+                                          libvirt_wrapper);
     }
 
     if (mac_addr.empty())
         mac_addr = instance_mac_addr_for(domain.get(), libvirt_wrapper);
 
     management_ipv4(); // To set ip
-    state = refresh_instance_state_for_domain(domain.get(), state, libvirt_wrapper);
+    state = instance_state_for(connection.refresh_state(vm_name, domain.get()), state);
 
     return domain;
 }
 
+void mp::LibVirtVirtualMachine::handle_domain_event()
+{
+    if (state != State::running && state != State::delayed_shutdown)
+        return;
+
+    optional<LibvirtConnection::DomainState> domain_state;
+    try
+    {
+        domain_state = connection.domain_state(vm_name);
+    }
+    catch (const std::exception&)
+    {
+        return;
+    }
+
+    // Stopped behind our back, e.g. on a crash or from within the instance
+    if (domain_state && instance_state_for(domain_state, state) == State::off)
+    {
+        mpl::log(mpl::Level::info, vm_name, "Instance stopped");
+
+        state = State::off;
+        management_ip = nullopt;
+        connection.forget_lease(mac_addr);
+        update_state();
+        monitor->on_shutdown();
+    }
+}
+
 mp::LibVirtVirtualMachine::ConnectionUPtr
 mp::LibVirtVirtualMachine::open_libvirt_connection(const mp::LibvirtWrapper::UPtr& libvirt_wrapper)
 {
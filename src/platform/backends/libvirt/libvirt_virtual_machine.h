@@ -18,25 +18,32 @@
 #ifndef MULTIPASS_LIBVIRT_VIRTUAL_MACHINE_H
 #define MULTIPASS_LIBVIRT_VIRTUAL_MACHINE_H
 
+#include "libvirt_connection.h"
 #include "libvirt_wrapper.h"
 
 #include <shared/base_virtual_machine.h>
 
 #include <multipass/virtual_machine_description.h>
 
+#include <QObject>
+
 namespace multipass
 {
 class VMStatusMonitor;
 
-class LibVirtVirtualMachine final : public BaseVirtualMachine
+class LibVirtVirtualMachine final : public QObject, public BaseVirtualMachine
 {
+    Q_OBJECT
 public:
     using ConnectionUPtr = std::unique_ptr<virConnect, decltype(virConnectClose)*>;
     using DomainUPtr = std::unique_ptr<virDomain, decltype(virDomainFree)*>;
     using NetworkUPtr = std::unique_ptr<virNetwork, decltype(virNetworkFree)*>;
+    using StoragePoolUPtr = std::unique_ptr<virStoragePool, decltype(virStoragePoolFree)*>;
+    using StorageVolUPtr = std::unique_ptr<virStorageVol, decltype(virStorageVolFree)*>;
 
     LibVirtVirtualMachine(const VirtualMachineDescription& desc, const std::string& bridge_name,
-                          VMStatusMonitor& monitor, const LibvirtWrapper::UPtr& libvirt_wrapper);
+                          VMStatusMonitor& monitor, const LibvirtWrapper::UPtr& libvirt_wrapper,
+                          LibvirtConnection& connection);
     ~LibVirtVirtualMachine();
 
     void start() override;
@@ -52,11 +59,18 @@ public:
     void wait_until_ssh_up(std::chrono::milliseconds timeout) override;
     void ensure_vm_is_running() override;
     void update_state() override;
+    void set_native_mounts(const std::vector<NativeMount>& mounts) override;
+    void set_io_limits(const IoLimits& limits) override;
+    Metrics metrics() override;
 
     static ConnectionUPtr open_libvirt_connection(const LibvirtWrapper::UPtr& libvirt_wrapper);
 
+signals:
+    void on_domain_event();
+
 private:
-    DomainUPtr initialize_domain_info(virConnectPtr connection);
+    DomainUPtr initialize_domain_info();
+    void handle_domain_event();
 
     std::string mac_addr;
     const std::string username;
@@ -66,7 +80,11 @@ private:
     const std::string& bridge_name;
     // Needs to be a reference so testing can override the various libvirt functions
     const LibvirtWrapper::UPtr& libvirt_wrapper;
+    LibvirtConnection& connection;
     bool update_suspend_status{true};
+    std::vector<NativeMount> native_mounts;
+    IoLimits io_limits;
+    bool definition_changed{false}; // since the domain was defined, for a new definition before the next boot
 };
 } // namespace multipass
 
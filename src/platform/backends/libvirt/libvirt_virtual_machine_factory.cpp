@@ -18,13 +18,24 @@
 #include "libvirt_virtual_machine_factory.h"
 #include "libvirt_virtual_machine.h"
 
+#include <multipass/constants.h>
 #include <multipass/logging/log.h>
+#include <multipass/settings.h>
 #include <multipass/utils.h>
 #include <multipass/virtual_machine_description.h>
 #include <shared/linux/backend_utils.h>
 
 #include <multipass/format.h>
 
+#include <QDir>
+#include <QFileInfo>
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 
@@ -32,6 +43,33 @@ namespace
 {
 constexpr auto multipass_bridge_name = "mpvirtbr0";
 constexpr auto logging_category = "libvirt factory";
+constexpr auto overlay_pool_prefix = "multipass-";
+
+// Where one hard link to each image that instance overlays are backed by is kept. Each instance keeps another next to
+// its overlay, so an image only a single link is left to is no longer used by any instance.
+QDir backing_images_dir(const mp::Path& data_dir)
+{
+    return mp::utils::make_dir(QDir(data_dir), "backing-images");
+}
+
+void prune_backing_images(const QDir& dir)
+{
+    for (const auto& entry : dir.entryInfoList(QDir::Files))
+    {
+        struct stat st;
+        if (stat(QFile::encodeName(entry.filePath()).constData(), &st) == 0 && st.st_nlink == 1)
+        {
+            mpl::log(mpl::Level::debug, logging_category, fmt::format("Removing unused {}", entry.fileName()));
+            QFile::remove(entry.filePath());
+        }
+    }
+}
+
+void hard_link(const QString& from, const QString& to)
+{
+    if (link(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) != 0)
+        throw std::runtime_error(fmt::format("Cannot link {} to {}: {}", from, to, std::strerror(errno)));
+}
 
 auto generate_libvirt_bridge_xml_config(const mp::Path& data_dir, const std::string& bridge_name)
 {
@@ -110,8 +148,10 @@ mp::LibVirtVirtualMachineFactory::LibVirtVirtualMachineFactory(const mp::Path& d
     : libvirt_wrapper{make_libvirt_wrapper(libvirt_object_path)},
       data_dir{data_dir},
       bridge_name{enable_libvirt_network(data_dir, libvirt_wrapper)},
-      libvirt_object_path{libvirt_object_path}
+      libvirt_object_path{libvirt_object_path},
+      connection{libvirt_wrapper}
 {
+    prune_backing_images(backing_images_dir(data_dir));
 }
 
 mp::LibVirtVirtualMachineFactory::LibVirtVirtualMachineFactory(const mp::Path& data_dir)
@@ -125,14 +165,13 @@ mp::VirtualMachine::UPtr mp::LibVirtVirtualMachineFactory::create_virtual_machin
     if (bridge_name.empty())
         bridge_name = enable_libvirt_network(data_dir, libvirt_wrapper);
 
-    return std::make_unique<mp::LibVirtVirtualMachine>(desc, bridge_name, monitor, libvirt_wrapper);
+    return std::make_unique<mp::LibVirtVirtualMachine>(desc, bridge_name, monitor, libvirt_wrapper, connection);
 }
 
 mp::LibVirtVirtualMachineFactory::~LibVirtVirtualMachineFactory()
 {
     if (bridge_name == multipass_bridge_name)
     {
-        auto connection = LibVirtVirtualMachine::open_libvirt_connection(libvirt_wrapper);
         mp::LibVirtVirtualMachine::NetworkUPtr network{
             libvirt_wrapper->virNetworkLookupByName(connection.get(), "default"), libvirt_wrapper->virNetworkFree};
 
@@ -142,24 +181,133 @@ mp::LibVirtVirtualMachineFactory::~LibVirtVirtualMachineFactory()
 
 void mp::LibVirtVirtualMachineFactory::remove_resources_for(const std::string& name)
 {
-    auto connection = LibVirtVirtualMachine::open_libvirt_connection(libvirt_wrapper);
-
     libvirt_wrapper->virDomainUndefine(libvirt_wrapper->virDomainLookupByName(connection.get(), name.c_str()));
+
+    const auto pool_name = overlay_pool_prefix + name;
+    LibVirtVirtualMachine::StoragePoolUPtr pool{
+        libvirt_wrapper->virStoragePoolLookupByName(connection.get(), pool_name.c_str()),
+        libvirt_wrapper->virStoragePoolFree};
+    if (pool)
+        libvirt_wrapper->virStoragePoolDestroy(pool.get());
 }
 
-mp::VMImage mp::LibVirtVirtualMachineFactory::prepare_source_image(const VMImage& source_image)
+mp::VMImage mp::LibVirtVirtualMachineFactory::prepare_source_image(const VMImage& source_image,
+                                                                  const ProgressMonitor& monitor)
 {
     VMImage image{source_image};
-    image.image_path = mp::backend::convert_to_qcow_if_necessary(source_image.image_path);
+    image.image_path = mp::backend::convert_to_qcow_if_necessary(source_image.image_path, monitor);
     return image;
 }
 
 void mp::LibVirtVirtualMachineFactory::prepare_instance_image(const VMImage& instance_image,
                                                               const VirtualMachineDescription& desc)
 {
+    if (MP_SETTINGS.get(mp::disk_overlays_key) == "true" && !instance_image.id.empty())
+    {
+        try
+        {
+            create_overlay_for(instance_image, desc);
+            return;
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::warning, logging_category,
+                     fmt::format("Cannot create an overlay for {}, keeping a full copy: {}", desc.vm_name, e.what()));
+        }
+    }
+
     mp::backend::resize_instance_image(desc.disk_space, instance_image.image_path);
 }
 
+// Swaps the instance's copy of the image for a qcow2 overlay on top of the one copy all its instances share
+void mp::LibVirtVirtualMachineFactory::create_overlay_for(const VMImage& instance_image,
+                                                          const VirtualMachineDescription& desc)
+{
+    const auto images_dir = backing_images_dir(data_dir);
+    prune_backing_images(images_dir);
+
+    const QFileInfo image_info{instance_image.image_path};
+    const auto shared_path = images_dir.filePath(QString::fromStdString(instance_image.id));
+    const auto backing_path = image_info.dir().filePath(image_info.fileName() + ".backing");
+
+    // The first instance of an image hands its copy over to those that follow
+    const auto hands_over = !QFile::exists(shared_path);
+    if (hands_over)
+        hard_link(instance_image.image_path, shared_path);
+
+    // Moved aside rather than removed, for the instance to fall back on should the overlay not take its place
+    const auto full_copy_path = instance_image.image_path + ".full";
+    try
+    {
+        QFile::remove(backing_path);
+        hard_link(shared_path, backing_path);
+
+        const auto pool_name = overlay_pool_prefix + desc.vm_name;
+        LibVirtVirtualMachine::StoragePoolUPtr pool{
+            libvirt_wrapper->virStoragePoolLookupByName(connection.get(), pool_name.c_str()),
+            libvirt_wrapper->virStoragePoolFree};
+        if (!pool)
+        {
+            const auto pool_xml = fmt::format("<pool type='dir'>\n"
+                                              "  <name>{}</name>\n"
+                                              "  <target>\n"
+                                              "    <path>{}</path>\n"
+                                              "  </target>\n"
+                                              "</pool>",
+                                              pool_name, image_info.absolutePath().toHtmlEscaped());
+            pool = LibVirtVirtualMachine::StoragePoolUPtr{
+                libvirt_wrapper->virStoragePoolCreateXML(connection.get(), pool_xml.c_str(), 0),
+                libvirt_wrapper->virStoragePoolFree};
+        }
+
+        if (!pool)
+            throw std::runtime_error(fmt::format("Cannot create storage pool {}: {}", pool_name,
+                                                 libvirt_wrapper->virGetLastErrorMessage()));
+
+        QFile::remove(full_copy_path);
+        if (!QFile::rename(instance_image.image_path, full_copy_path))
+            throw std::runtime_error(fmt::format("Cannot move {} aside", instance_image.image_path));
+
+        const auto volume_xml = fmt::format("<volume>\n"
+                                            "  <name>{}</name>\n"
+                                            "  <capacity unit='bytes'>{}</capacity>\n"
+                                            "  <target>\n"
+                                            "    <format type='qcow2'/>\n"
+                                            "  </target>\n"
+                                            "  <backingStore>\n"
+                                            "    <path>{}</path>\n"
+                                            "    <format type='qcow2'/>\n"
+                                            "  </backingStore>\n"
+                                            "</volume>",
+                                            image_info.fileName().toHtmlEscaped(), desc.disk_space.in_bytes(),
+                                            backing_path.toHtmlEscaped());
+        LibVirtVirtualMachine::StorageVolUPtr volume{
+            libvirt_wrapper->virStorageVolCreateXML(pool.get(), volume_xml.c_str(), 0),
+            libvirt_wrapper->virStorageVolFree};
+
+        if (!volume)
+            throw std::runtime_error(
+                fmt::format("Cannot create overlay volume: {}", libvirt_wrapper->virGetLastErrorMessage()));
+    }
+    catch (...)
+    {
+        if (QFile::exists(full_copy_path))
+        {
+            QFile::remove(instance_image.image_path);
+            QFile::rename(full_copy_path, instance_image.image_path);
+        }
+
+        // Left behind, the links would keep the shared copy from ever being pruned, or have the instance keeping its
+        // full copy write to the one others are then backed by
+        QFile::remove(backing_path);
+        if (hands_over)
+            QFile::remove(shared_path);
+        throw;
+    }
+
+    QFile::remove(full_copy_path);
+}
+
 void mp::LibVirtVirtualMachineFactory::hypervisor_health_check()
 {
     mp::backend::check_for_kvm_support();
@@ -168,7 +316,7 @@ void mp::LibVirtVirtualMachineFactory::hypervisor_health_check()
     if (!libvirt_wrapper)
         libvirt_wrapper = make_libvirt_wrapper(libvirt_object_path);
 
-    LibVirtVirtualMachine::open_libvirt_connection(libvirt_wrapper);
+    connection.get();
 
     if (bridge_name.empty())
         bridge_name = enable_libvirt_network(data_dir, libvirt_wrapper);
@@ -179,8 +327,6 @@ QString mp::LibVirtVirtualMachineFactory::get_backend_version_string()
     try
     {
         unsigned long libvirt_version;
-        auto connection = LibVirtVirtualMachine::open_libvirt_connection(libvirt_wrapper);
-
         if (libvirt_wrapper->virConnectGetVersion(connection.get(), &libvirt_version) == 0 && libvirt_version != 0)
         {
             return QString("libvirt-%1.%2.%3")
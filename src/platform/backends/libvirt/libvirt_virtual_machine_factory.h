@@ -17,6 +17,7 @@
 #ifndef MULTIPASS_LIBVIRT_VIRTUAL_MACHINE_FACTORY_H
 #define MULTIPASS_LIBVIRT_VIRTUAL_MACHINE_FACTORY_H
 
+#include "libvirt_connection.h"
 #include "libvirt_wrapper.h"
 
 #include <shared/base_virtual_machine_factory.h>
@@ -38,7 +39,11 @@ public:
     VirtualMachine::UPtr create_virtual_machine(const VirtualMachineDescription& desc,
                                                 VMStatusMonitor& monitor) override;
     void remove_resources_for(const std::string& name) override;
-    VMImage prepare_source_image(const VMImage& source_image) override;
+    bool can_limit_io(const IoLimits& /*limits*/) const override
+    {
+        return true;
+    }
+    VMImage prepare_source_image(const VMImage& source_image, const ProgressMonitor& monitor) override;
     void prepare_instance_image(const VMImage& instance_image, const VirtualMachineDescription& desc) override;
     void hypervisor_health_check() override;
     QString get_backend_version_string() override;
@@ -47,9 +52,12 @@ public:
     LibvirtWrapper::UPtr libvirt_wrapper;
 
 private:
+    void create_overlay_for(const VMImage& instance_image, const VirtualMachineDescription& desc);
+
     const Path data_dir;
     std::string bridge_name;
     const std::string libvirt_object_path;
+    LibvirtConnection connection;
 };
 } // namespace multipass
 
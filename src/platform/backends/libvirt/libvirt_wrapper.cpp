@@ -58,6 +58,22 @@ mp::LibvirtWrapper::LibvirtWrapper(const std::string& filename)
           reinterpret_cast<virConnectGetCapabilities_t>(get_symbol_address_for("virConnectGetCapabilities", handle))},
       virConnectGetVersion{
           reinterpret_cast<virConnectGetVersion_t>(get_symbol_address_for("virConnectGetVersion", handle))},
+      virConnectIsAlive{reinterpret_cast<virConnectIsAlive_t>(get_symbol_address_for("virConnectIsAlive", handle))},
+      virConnectDomainEventRegisterAny{reinterpret_cast<virConnectDomainEventRegisterAny_t>(
+          get_symbol_address_for("virConnectDomainEventRegisterAny", handle))},
+      virConnectDomainEventDeregisterAny{reinterpret_cast<virConnectDomainEventDeregisterAny_t>(
+          get_symbol_address_for("virConnectDomainEventDeregisterAny", handle))},
+      virConnectRegisterCloseCallback{reinterpret_cast<virConnectRegisterCloseCallback_t>(
+          get_symbol_address_for("virConnectRegisterCloseCallback", handle))},
+      virConnectUnregisterCloseCallback{reinterpret_cast<virConnectUnregisterCloseCallback_t>(
+          get_symbol_address_for("virConnectUnregisterCloseCallback", handle))},
+      virEventRegisterDefaultImpl{reinterpret_cast<virEventRegisterDefaultImpl_t>(
+          get_symbol_address_for("virEventRegisterDefaultImpl", handle))},
+      virEventRunDefaultImpl{
+          reinterpret_cast<virEventRunDefaultImpl_t>(get_symbol_address_for("virEventRunDefaultImpl", handle))},
+      virEventAddTimeout{reinterpret_cast<virEventAddTimeout_t>(get_symbol_address_for("virEventAddTimeout", handle))},
+      virEventRemoveTimeout{
+          reinterpret_cast<virEventRemoveTimeout_t>(get_symbol_address_for("virEventRemoveTimeout", handle))},
       virNetworkLookupByName{
           reinterpret_cast<virNetworkLookupByName_t>(get_symbol_address_for("virNetworkLookupByName", handle))},
       virNetworkCreateXML{
@@ -72,7 +88,18 @@ mp::LibvirtWrapper::LibvirtWrapper(const std::string& filename)
           reinterpret_cast<virNetworkGetDHCPLeases_t>(get_symbol_address_for("virNetworkGetDHCPLeases", handle))},
       virNetworkDHCPLeaseFree{
           reinterpret_cast<virNetworkDHCPLeaseFree_t>(get_symbol_address_for("virNetworkDHCPLeaseFree", handle))},
+      virStoragePoolLookupByName{reinterpret_cast<virStoragePoolLookupByName_t>(
+          get_symbol_address_for("virStoragePoolLookupByName", handle))},
+      virStoragePoolCreateXML{
+          reinterpret_cast<virStoragePoolCreateXML_t>(get_symbol_address_for("virStoragePoolCreateXML", handle))},
+      virStoragePoolDestroy{
+          reinterpret_cast<virStoragePoolDestroy_t>(get_symbol_address_for("virStoragePoolDestroy", handle))},
+      virStoragePoolFree{reinterpret_cast<virStoragePoolFree_t>(get_symbol_address_for("virStoragePoolFree", handle))},
+      virStorageVolCreateXML{
+          reinterpret_cast<virStorageVolCreateXML_t>(get_symbol_address_for("virStorageVolCreateXML", handle))},
+      virStorageVolFree{reinterpret_cast<virStorageVolFree_t>(get_symbol_address_for("virStorageVolFree", handle))},
       virDomainUndefine{reinterpret_cast<virDomainUndefine_t>(get_symbol_address_for("virDomainUndefine", handle))},
+      virDomainGetName{reinterpret_cast<virDomainGetName_t>(get_symbol_address_for("virDomainGetName", handle))},
       virDomainLookupByName{
           reinterpret_cast<virDomainLookupByName_t>(get_symbol_address_for("virDomainLookupByName", handle))},
       virDomainGetXMLDesc{
@@ -87,6 +114,12 @@ mp::LibvirtWrapper::LibvirtWrapper(const std::string& filename)
           reinterpret_cast<virDomainManagedSave_t>(get_symbol_address_for("virDomainManagedSave", handle))},
       virDomainHasManagedSaveImage{reinterpret_cast<virDomainHasManagedSaveImage_t>(
           get_symbol_address_for("virDomainHasManagedSaveImage", handle))},
+      virDomainMemoryStats{
+          reinterpret_cast<virDomainMemoryStats_t>(get_symbol_address_for("virDomainMemoryStats", handle))},
+      virDomainSetBlockIoTune{
+          reinterpret_cast<virDomainSetBlockIoTune_t>(get_symbol_address_for("virDomainSetBlockIoTune", handle))},
+      virDomainSetInterfaceParameters{reinterpret_cast<virDomainSetInterfaceParameters_t>(
+          get_symbol_address_for("virDomainSetInterfaceParameters", handle))},
       virGetLastErrorMessage{
           reinterpret_cast<virGetLastErrorMessage_t>(get_symbol_address_for("virGetLastErrorMessage", handle))}
 {
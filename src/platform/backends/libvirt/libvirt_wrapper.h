@@ -61,6 +61,18 @@ private:
     typedef int (*virConnectClose_t)(virConnectPtr conn);
     typedef char* (*virConnectGetCapabilities_t)(virConnectPtr conn);
     typedef int (*virConnectGetVersion_t)(virConnectPtr conn, unsigned long* hvVer);
+    typedef int (*virConnectIsAlive_t)(virConnectPtr conn);
+    typedef int (*virConnectDomainEventRegisterAny_t)(virConnectPtr conn, virDomainPtr dom, int eventID,
+                                                      virConnectDomainEventGenericCallback cb, void* opaque,
+                                                      virFreeCallback freecb);
+    typedef int (*virConnectDomainEventDeregisterAny_t)(virConnectPtr conn, int callbackID);
+    typedef int (*virConnectRegisterCloseCallback_t)(virConnectPtr conn, virConnectCloseFunc cb, void* opaque,
+                                                     virFreeCallback freecb);
+    typedef int (*virConnectUnregisterCloseCallback_t)(virConnectPtr conn, virConnectCloseFunc cb);
+    typedef int (*virEventRegisterDefaultImpl_t)();
+    typedef int (*virEventRunDefaultImpl_t)();
+    typedef int (*virEventAddTimeout_t)(int timeout, virEventTimeoutCallback cb, void* opaque, virFreeCallback ff);
+    typedef int (*virEventRemoveTimeout_t)(int timer);
     typedef virNetworkPtr (*virNetworkLookupByName_t)(virConnectPtr conn, const char* name);
     typedef virNetworkPtr (*virNetworkCreateXML_t)(virConnectPtr conn, const char* xmlDesc);
     typedef int (*virNetworkDestroy_t)(virNetworkPtr network);
@@ -71,7 +83,16 @@ private:
     typedef int (*virNetworkGetDHCPLeases_t)(virNetworkPtr network, const char* mac, virNetworkDHCPLeasePtr** leases,
                                              unsigned int flags);
     typedef void (*virNetworkDHCPLeaseFree_t)(virNetworkDHCPLeasePtr lease);
+    typedef virStoragePoolPtr (*virStoragePoolLookupByName_t)(virConnectPtr conn, const char* name);
+    typedef virStoragePoolPtr (*virStoragePoolCreateXML_t)(virConnectPtr conn, const char* xmlDesc,
+                                                           unsigned int flags);
+    typedef int (*virStoragePoolDestroy_t)(virStoragePoolPtr pool);
+    typedef int (*virStoragePoolFree_t)(virStoragePoolPtr pool);
+    typedef virStorageVolPtr (*virStorageVolCreateXML_t)(virStoragePoolPtr pool, const char* xmlDesc,
+                                                         unsigned int flags);
+    typedef int (*virStorageVolFree_t)(virStorageVolPtr vol);
     typedef int (*virDomainUndefine_t)(virDomainPtr domain);
+    typedef const char* (*virDomainGetName_t)(virDomainPtr domain);
     typedef virDomainPtr (*virDomainLookupByName_t)(virConnectPtr conn, const char* name);
     typedef char* (*virDomainGetXMLDesc_t)(virDomainPtr domain, unsigned int flags);
     typedef int (*virDomainDestroy_t)(virDomainPtr domain);
@@ -82,6 +103,12 @@ private:
     typedef int (*virDomainShutdown_t)(virDomainPtr domain);
     typedef int (*virDomainManagedSave_t)(virDomainPtr domain, unsigned int flags);
     typedef int (*virDomainHasManagedSaveImage_t)(virDomainPtr domain, unsigned int flags);
+    typedef int (*virDomainMemoryStats_t)(virDomainPtr domain, virDomainMemoryStatPtr stats, unsigned int nr_stats,
+                                          unsigned int flags);
+    typedef int (*virDomainSetBlockIoTune_t)(virDomainPtr domain, const char* disk, virTypedParameterPtr params,
+                                             int nparams, unsigned int flags);
+    typedef int (*virDomainSetInterfaceParameters_t)(virDomainPtr domain, const char* device,
+                                                     virTypedParameterPtr params, int nparams, unsigned int flags);
     typedef const char* (*virGetLastErrorMessage_t)();
 
     void* handle{nullptr};
@@ -96,6 +123,15 @@ public:
     virConnectClose_t virConnectClose;
     virConnectGetCapabilities_t virConnectGetCapabilities;
     virConnectGetVersion_t virConnectGetVersion;
+    virConnectIsAlive_t virConnectIsAlive;
+    virConnectDomainEventRegisterAny_t virConnectDomainEventRegisterAny;
+    virConnectDomainEventDeregisterAny_t virConnectDomainEventDeregisterAny;
+    virConnectRegisterCloseCallback_t virConnectRegisterCloseCallback;
+    virConnectUnregisterCloseCallback_t virConnectUnregisterCloseCallback;
+    virEventRegisterDefaultImpl_t virEventRegisterDefaultImpl;
+    virEventRunDefaultImpl_t virEventRunDefaultImpl;
+    virEventAddTimeout_t virEventAddTimeout;
+    virEventRemoveTimeout_t virEventRemoveTimeout;
     virNetworkLookupByName_t virNetworkLookupByName;
     virNetworkCreateXML_t virNetworkCreateXML;
     virNetworkDestroy_t virNetworkDestroy;
@@ -105,7 +141,14 @@ public:
     virNetworkCreate_t virNetworkCreate;
     virNetworkGetDHCPLeases_t virNetworkGetDHCPLeases;
     virNetworkDHCPLeaseFree_t virNetworkDHCPLeaseFree;
+    virStoragePoolLookupByName_t virStoragePoolLookupByName;
+    virStoragePoolCreateXML_t virStoragePoolCreateXML;
+    virStoragePoolDestroy_t virStoragePoolDestroy;
+    virStoragePoolFree_t virStoragePoolFree;
+    virStorageVolCreateXML_t virStorageVolCreateXML;
+    virStorageVolFree_t virStorageVolFree;
     virDomainUndefine_t virDomainUndefine;
+    virDomainGetName_t virDomainGetName;
     virDomainLookupByName_t virDomainLookupByName;
     virDomainGetXMLDesc_t virDomainGetXMLDesc;
     virDomainDestroy_t virDomainDestroy;
@@ -116,6 +159,9 @@ public:
     virDomainShutdown_t virDomainShutdown;
     virDomainManagedSave_t virDomainManagedSave;
     virDomainHasManagedSaveImage_t virDomainHasManagedSaveImage;
+    virDomainMemoryStats_t virDomainMemoryStats;
+    virDomainSetBlockIoTune_t virDomainSetBlockIoTune;
+    virDomainSetInterfaceParameters_t virDomainSetInterfaceParameters;
     virGetLastErrorMessage_t virGetLastErrorMessage;
 };
 } // namespace multipass
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "lxd_base_instances.h"
+#include "lxd_request.h"
+
+#include <multipass/format.h>
+#include <multipass/logging/log.h>
+
+#include <QJsonArray>
+
+#include <algorithm>
+#include <array>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+
+namespace
+{
+constexpr auto category = "lxd base instances";
+constexpr auto base_prefix = "multipass-base-";
+const std::array<QString, 4> cloning_drivers{"btrfs", "ceph", "lvm", "zfs"};
+
+QString base_name(const QString& fingerprint)
+{
+    return base_prefix + fingerprint.left(32);
+}
+
+QJsonObject image_source(const QString& fingerprint)
+{
+    return {{"type", "image"}, {"fingerprint", fingerprint}};
+}
+
+QJsonObject copy_source(const QString& base)
+{
+    return {{"type", "copy"}, {"source", base}, {"instance_only", true}};
+}
+} // namespace
+
+mp::LXDBaseInstances::LXDBaseInstances(NetworkAccessManager* manager, const QUrl& base_url)
+    : manager{manager}, base_url{base_url}
+{
+}
+
+QJsonObject mp::LXDBaseInstances::source_for(const std::string& image_id)
+{
+    const auto fingerprint = QString::fromStdString(image_id);
+    if (!pool_clones_volumes())
+        return image_source(fingerprint);
+
+    const auto base = base_name(fingerprint);
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        if (ready.count(fingerprint))
+            return copy_source(base);
+
+        // Requests make way for other events while they wait, so launches racing for the base do not wait on it
+        if (!pending.insert(fingerprint).second)
+            return image_source(fingerprint);
+    }
+
+    auto made = false;
+    try
+    {
+        try
+        {
+            lxd_request(manager, "GET", QUrl(QString("%1/virtual-machines/%2").arg(base_url.toString()).arg(base)));
+        }
+        catch (const LXDNotFoundException&)
+        {
+            remove_stale_bases();
+            create_base(base, fingerprint);
+        }
+        made = true;
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::warning, category,
+                 fmt::format("Cannot make a base instance for {}: {}", image_id, e.what()));
+    }
+
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    pending.erase(fingerprint);
+    if (made)
+        ready.insert(fingerprint);
+
+    return made ? copy_source(base) : image_source(fingerprint);
+}
+
+void mp::LXDBaseInstances::forget(const std::string& image_id)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    ready.erase(QString::fromStdString(image_id));
+}
+
+void mp::LXDBaseInstances::remove_base(const std::string& image_id)
+{
+    forget(image_id);
+
+    const auto name = base_name(QString::fromStdString(image_id));
+    try
+    {
+        delete_base(name);
+    }
+    catch (const LXDNotFoundException&)
+    {
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::warning, category, fmt::format("Cannot remove base instance {}: {}", name, e.what()));
+    }
+}
+
+bool mp::LXDBaseInstances::pool_clones_volumes()
+{
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        if (clones_volumes)
+            return *clones_volumes;
+    }
+
+    try
+    {
+        const auto json_reply =
+            lxd_request(manager, "GET", QUrl(QString("%1/storage-pools/default").arg(base_url.toString())));
+        const auto driver = json_reply["metadata"].toObject()["driver"].toString();
+        const auto clones =
+            std::find(cloning_drivers.cbegin(), cloning_drivers.cend(), driver) != cloning_drivers.cend();
+
+        mpl::log(mpl::Level::debug, category,
+                 fmt::format("Storage driver {} {} volumes", driver, clones ? "clones" : "does not clone"));
+
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        clones_volumes = clones;
+        return clones;
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::debug, category, fmt::format("Cannot tell the storage driver: {}", e.what()));
+        return false;
+    }
+}
+
+void mp::LXDBaseInstances::create_base(const QString& name, const QString& fingerprint)
+{
+    mpl::log(mpl::Level::debug, category, fmt::format("Creating base instance {}", name));
+
+    QJsonObject root{{"path", "/"}, {"pool", "default"}, {"type", "disk"}};
+    QJsonObject base{{"name", name},
+                     {"description", "Base for Multipass instances, copied from rather than started"},
+                     {"config", QJsonObject{{"security.secureboot", "false"}}},
+                     {"devices", QJsonObject{{"root", root}}},
+                     {"source", image_source(fingerprint)}};
+
+    auto json_reply =
+        lxd_request(manager, "POST", QUrl(QString("%1/virtual-machines").arg(base_url.toString())), base);
+    lxd_wait(manager, base_url, json_reply, 600000);
+}
+
+void mp::LXDBaseInstances::delete_base(const QString& name)
+{
+    auto json_reply =
+        lxd_request(manager, "DELETE", QUrl(QString("%1/virtual-machines/%2").arg(base_url.toString()).arg(name)));
+    lxd_wait(manager, base_url, json_reply, 120000);
+}
+
+void mp::LXDBaseInstances::remove_stale_bases()
+{
+    const auto json_reply =
+        lxd_request(manager, "GET", QUrl(QString("%1/virtual-machines?recursion=1").arg(base_url.toString())));
+
+    for (const auto instance : json_reply["metadata"].toArray())
+    {
+        const auto name = instance.toObject()["name"].toString();
+        if (!name.startsWith(base_prefix))
+            continue;
+
+        // Without an image to look up, the lookup would be of all images, which is always there
+        const auto base_image = instance.toObject()["config"].toObject()["volatile.base_image"].toString();
+        if (!base_image.isEmpty())
+        {
+            try
+            {
+                lxd_request(manager, "GET", QUrl(QString("%1/images/%2").arg(base_url.toString()).arg(base_image)));
+                continue;
+            }
+            catch (const LXDNotFoundException&)
+            {
+            }
+        }
+
+        mpl::log(mpl::Level::debug, category, fmt::format("Removing base instance {}, its image is gone", name));
+        delete_base(name);
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_LXD_BASE_INSTANCES_H
+#define MULTIPASS_LXD_BASE_INSTANCES_H
+
+#include <multipass/optional.h>
+
+#include <QJsonObject>
+#include <QString>
+#include <QUrl>
+
+#include <mutex>
+#include <set>
+#include <string>
+
+namespace multipass
+{
+class NetworkAccessManager;
+
+// Keeps a stopped instance per image, never started, for new instances to be copies of. Where the storage pool clones
+// volumes, as ZFS, btrfs, LVM and Ceph do, a copy takes no time and shares its blocks with the base, where creating
+// from the image writes all of it out again. The bases are named apart from instances, which Multipass only knows
+// of by their own names, and removed once their images are gone from LXD.
+class LXDBaseInstances
+{
+public:
+    LXDBaseInstances(NetworkAccessManager* manager, const QUrl& base_url);
+
+    // The source to create an instance of the image from: a copy of its base when it has or can be given one, the
+    // image itself otherwise, including while another launch is still making the base
+    QJsonObject source_for(const std::string& image_id);
+    // Stops copying a base that could not be copied from
+    void forget(const std::string& image_id);
+    // Removes the base of an image that is being removed from LXD, which would otherwise keep its storage
+    void remove_base(const std::string& image_id);
+
+private:
+    bool pool_clones_volumes();
+    void create_base(const QString& name, const QString& fingerprint);
+    void delete_base(const QString& name);
+    void remove_stale_bases();
+
+    NetworkAccessManager* const manager;
+    const QUrl base_url;
+    std::mutex mutex;
+    optional<bool> clones_volumes;
+    std::set<QString> ready;
+    std::set<QString> pending;
+};
+} // namespace multipass
+
+#endif // MULTIPASS_LXD_BASE_INSTANCES_H
@@ -0,0 +1,383 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "lxd_events.h"
+#include "lxd_request.h"
+
+#include <multipass/format.h>
+#include <multipass/logging/log.h>
+
+#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <QLocalSocket>
+#include <QRandomGenerator>
+#include <QStringList>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+
+using namespace std::literals::chrono_literals;
+
+namespace
+{
+constexpr auto category = "lxd events";
+constexpr auto websocket_guid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+constexpr auto connect_timeout = 1000;
+constexpr auto read_timeout = 250;
+constexpr auto reconnect_interval = 5s;
+constexpr auto images_source = "/1.0/images";
+
+enum class Opcode : char
+{
+    continuation = 0x0,
+    text = 0x1,
+    binary = 0x2,
+    close = 0x8,
+    ping = 0x9,
+    pong = 0xa
+};
+
+QString socket_path_from(const QUrl& base_url)
+{
+    const auto url_parts = base_url.toString().split('@');
+    return url_parts.count() == 2 ? QUrl(url_parts[0]).path() : QString();
+}
+
+QString events_path_from(const QUrl& base_url)
+{
+    const auto url_parts = base_url.toString().split('@');
+    return url_parts.count() == 2
+               ? QString("/%1/events?type=operation,lifecycle&project=%2").arg(url_parts[1]).arg(mp::lxd_project_name)
+               : QString();
+}
+
+// The last component of a path like /1.0/virtual-machines/foo?project=multipass
+QString instance_name_from(const QString& source)
+{
+    return source.section('?', 0, 0).section('/', -1);
+}
+
+bool write_all(QLocalSocket& socket, const QByteArray& data)
+{
+    if (socket.write(data) != data.size())
+        return false;
+
+    while (socket.bytesToWrite() > 0)
+        if (!socket.waitForBytesWritten(connect_timeout))
+            return false;
+
+    return true;
+}
+
+// Client frames must be masked
+bool send_frame(QLocalSocket& socket, Opcode opcode, const QByteArray& payload)
+{
+    QByteArray frame;
+    frame.append(static_cast<char>(0x80 | static_cast<char>(opcode)));
+
+    const auto size = payload.size();
+    if (size < 126)
+    {
+        frame.append(static_cast<char>(0x80 | size));
+    }
+    else
+    {
+        frame.append(static_cast<char>(0x80 | 126));
+        frame.append(static_cast<char>((size >> 8) & 0xff));
+        frame.append(static_cast<char>(size & 0xff));
+    }
+
+    const auto mask = QRandomGenerator::global()->generate();
+    char mask_bytes[4];
+    for (auto i = 0; i < 4; ++i)
+        mask_bytes[i] = static_cast<char>((mask >> (8 * i)) & 0xff);
+    frame.append(mask_bytes, 4);
+
+    for (auto i = 0; i < size; ++i)
+        frame.append(static_cast<char>(payload[i] ^ mask_bytes[i % 4]));
+
+    return write_all(socket, frame);
+}
+} // namespace
+
+mp::LXDEvents::LXDEvents(const QUrl& base_url)
+    : socket_path{socket_path_from(base_url)}, events_path{events_path_from(base_url)}
+{
+    if (!socket_path.isEmpty())
+        thread = std::make_unique<AutoJoinThread>([this] { run(); });
+}
+
+mp::LXDEvents::~LXDEvents()
+{
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        running = false;
+    }
+    changed.notify_all();
+}
+
+unsigned mp::LXDEvents::image_changes() const
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    return image_change_count;
+}
+
+bool mp::LXDEvents::listening() const
+{
+    return is_listening;
+}
+
+void mp::LXDEvents::watch_operation(const QString& id)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    operations.emplace(id, Operation{});
+}
+
+void mp::LXDEvents::unwatch_operation(const QString& id)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    operations.erase(id);
+}
+
+mp::optional<QJsonObject> mp::LXDEvents::wait_for_operation(const QString& id, int& generation,
+                                                             std::chrono::milliseconds timeout)
+{
+    std::unique_lock<decltype(mutex)> lock{mutex};
+
+    auto updated = [this, &id, generation] {
+        auto it = operations.find(id);
+        return !is_listening || it == operations.end() || it->second.generation > generation;
+    };
+    changed.wait_for(lock, timeout, updated);
+
+    auto it = operations.find(id);
+    if (!is_listening || it == operations.end() || it->second.generation <= generation)
+        return nullopt;
+
+    generation = it->second.generation;
+    return it->second.latest;
+}
+
+mp::optional<int> mp::LXDEvents::cached_status_code(const QString& instance_name, unsigned& changes)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+
+    const auto& instance = instances[instance_name];
+    changes = instance.changes;
+
+    return is_listening ? instance.status_code : nullopt;
+}
+
+void mp::LXDEvents::cache_status_code(const QString& instance_name, int status_code, unsigned changes)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+
+    auto& instance = instances[instance_name];
+    if (is_listening && instance.changes == changes)
+        instance.status_code = status_code;
+}
+
+void mp::LXDEvents::handle_event(const QByteArray& message)
+{
+    const auto event = QJsonDocument::fromJson(message).object();
+    const auto type = event["type"].toString();
+    const auto metadata = event["metadata"].toObject();
+
+    if (type == QStringLiteral("operation"))
+    {
+        {
+            std::lock_guard<decltype(mutex)> lock{mutex};
+
+            auto it = operations.find(metadata["id"].toString());
+            if (it == operations.end())
+                return;
+
+            it->second.latest = metadata;
+            ++it->second.generation;
+        }
+        changed.notify_all();
+    }
+    else if (type == QStringLiteral("lifecycle") && metadata["source"].toString().startsWith(images_source))
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        ++image_change_count;
+    }
+    else if (type == QStringLiteral("lifecycle"))
+    {
+        const auto name = instance_name_from(metadata["source"].toString());
+        mpl::log(mpl::Level::trace, category, fmt::format("{}: {}", name, metadata["action"].toString()));
+
+        std::lock_guard<decltype(mutex)> lock{mutex};
+
+        auto& instance = instances[name];
+        instance.status_code = nullopt;
+        ++instance.changes;
+    }
+}
+
+void mp::LXDEvents::run()
+{
+    while (running)
+    {
+        QLocalSocket socket;
+        QByteArray buffer;
+
+        socket.connectToServer(socket_path);
+        if (socket.waitForConnected(connect_timeout) && handshake(socket, buffer))
+        {
+            mpl::log(mpl::Level::debug, category, fmt::format("Listening to events on {}", socket_path));
+            set_listening(true);
+
+            while (running && handle_frames(socket, buffer))
+                ;
+
+            set_listening(false);
+            mpl::log(mpl::Level::debug, category, "Stopped listening to events");
+        }
+
+        std::unique_lock<decltype(mutex)> lock{mutex};
+        changed.wait_for(lock, reconnect_interval, [this] { return !running; });
+    }
+}
+
+bool mp::LXDEvents::handshake(QLocalSocket& socket, QByteArray& buffer)
+{
+    QByteArray nonce;
+    for (auto i = 0; i < 16; ++i)
+        nonce.append(static_cast<char>(QRandomGenerator::global()->bounded(256)));
+    const auto key = nonce.toBase64();
+
+    const auto request = QString("GET %1 HTTP/1.1\r\n"
+                                 "Host: lxd\r\n"
+                                 "Upgrade: websocket\r\n"
+                                 "Connection: Upgrade\r\n"
+                                 "Sec-WebSocket-Key: %2\r\n"
+                                 "Sec-WebSocket-Version: 13\r\n\r\n")
+                             .arg(events_path)
+                             .arg(QString::fromLatin1(key));
+    if (!write_all(socket, request.toLatin1()))
+        return false;
+
+    int header_end;
+    while ((header_end = buffer.indexOf("\r\n\r\n")) < 0)
+    {
+        if (!running || !socket.waitForReadyRead(connect_timeout))
+            return false;
+        buffer.append(socket.readAll());
+    }
+
+    const auto lines = QString::fromLatin1(buffer.left(header_end)).split("\r\n");
+    buffer.remove(0, header_end + 4);
+
+    if (lines.isEmpty() || lines.first().section(' ', 1, 1) != QStringLiteral("101"))
+    {
+        mpl::log(mpl::Level::debug, category, fmt::format("LXD refused to send events: {}", lines.value(0)));
+        return false;
+    }
+
+    const auto expected_accept = QCryptographicHash::hash(key + websocket_guid, QCryptographicHash::Sha1).toBase64();
+    for (const auto& line : lines)
+        if (line.section(':', 0, 0).trimmed().compare("Sec-WebSocket-Accept", Qt::CaseInsensitive) == 0)
+            return line.section(':', 1).trimmed().toLatin1() == expected_accept;
+
+    return false;
+}
+
+// Handles the frames received so far, waiting a little for more. Returns false once the connection is over
+bool mp::LXDEvents::handle_frames(QLocalSocket& socket, QByteArray& buffer)
+{
+    while (buffer.size() >= 2)
+    {
+        const auto fin = (buffer[0] & 0x80) != 0;
+        const auto opcode = static_cast<Opcode>(buffer[0] & 0x0f);
+        const auto masked = (buffer[1] & 0x80) != 0;
+        quint64 length = buffer[1] & 0x7f;
+        int offset = 2;
+
+        if (length == 126 || length == 127)
+        {
+            const auto extra = length == 126 ? 2 : 8;
+            if (buffer.size() < offset + extra)
+                break;
+
+            length = 0;
+            for (auto i = 0; i < extra; ++i)
+                length = (length << 8) | static_cast<unsigned char>(buffer[offset + i]);
+            offset += extra;
+        }
+
+        const auto mask_offset = offset;
+        if (masked)
+            offset += 4;
+
+        if (static_cast<quint64>(buffer.size()) < offset + length)
+            break;
+
+        auto payload = buffer.mid(offset, static_cast<int>(length));
+        if (masked)
+            for (auto i = 0; i < payload.size(); ++i)
+                payload[i] = static_cast<char>(payload[i] ^ buffer[mask_offset + i % 4]);
+        buffer.remove(0, offset + static_cast<int>(length));
+
+        switch (opcode)
+        {
+        case Opcode::continuation:
+        case Opcode::text:
+        case Opcode::binary:
+            message.append(payload);
+            if (fin)
+            {
+                handle_event(message);
+                message.clear();
+            }
+            break;
+        case Opcode::ping:
+            if (!send_frame(socket, Opcode::pong, payload))
+                return false;
+            break;
+        case Opcode::close:
+            send_frame(socket, Opcode::close, payload);
+            return false;
+        default:
+            break;
+        }
+    }
+
+    if (socket.state() != QLocalSocket::ConnectedState)
+        return false;
+
+    if (socket.waitForReadyRead(read_timeout))
+        buffer.append(socket.readAll());
+
+    return socket.state() == QLocalSocket::ConnectedState || !buffer.isEmpty();
+}
+
+void mp::LXDEvents::set_listening(bool value)
+{
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        is_listening = value;
+        ++image_change_count; // images may have changed unheard of, before or after
+
+        if (!value)
+        {
+            instances.clear();
+            message.clear();
+        }
+    }
+    changed.notify_all();
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_LXD_EVENTS_H
+#define MULTIPASS_LXD_EVENTS_H
+
+#include <multipass/auto_join_thread.h>
+#include <multipass/optional.h>
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+#include <QUrl>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+
+class QLocalSocket;
+
+namespace multipass
+{
+// Listens to LXD's /1.0/events websocket, over the same unix socket as requests, from a thread of its own. It keeps
+// the operations being waited on up to date and tells when instances change state, reconnecting when LXD goes away.
+// Everything it offers is empty while it is not listening, for callers to ask LXD themselves.
+class LXDEvents
+{
+public:
+    explicit LXDEvents(const QUrl& base_url);
+    ~LXDEvents();
+
+    bool listening() const;
+
+    // Operations only get updates between being watched and unwatched
+    void watch_operation(const QString& id);
+    void unwatch_operation(const QString& id);
+    // Waits for an update to the operation later than the generation given, which it advances
+    optional<QJsonObject> wait_for_operation(const QString& id, int& generation, std::chrono::milliseconds timeout);
+
+    // Status codes are kept until an instance's next lifecycle event. The count of those goes along with a lookup, for
+    // a status fetched in the meantime to be kept only if nothing changed since
+    optional<int> cached_status_code(const QString& instance_name, unsigned& changes);
+    void cache_status_code(const QString& instance_name, int status_code, unsigned changes);
+
+    // Counts the lifecycle events of images, and the times events could have been missed, for what was learned of
+    // images to be kept only while it stays the same
+    unsigned image_changes() const;
+
+    // Handles one message from the websocket, as if it had come from LXD
+    void handle_event(const QByteArray& message);
+
+private:
+    struct Operation
+    {
+        QJsonObject latest;
+        int generation{0};
+    };
+    struct Instance
+    {
+        optional<int> status_code;
+        unsigned changes{0};
+    };
+
+    void run();
+    bool handshake(QLocalSocket& socket, QByteArray& buffer);
+    bool handle_frames(QLocalSocket& socket, QByteArray& buffer);
+    void set_listening(bool value);
+
+    const QString socket_path;
+    const QString events_path;
+    std::atomic_bool running{true};
+    std::atomic_bool is_listening{false};
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::map<QString, Operation> operations;
+    std::map<QString, Instance> instances;
+    unsigned image_change_count{0};
+    QByteArray message;
+    std::unique_ptr<AutoJoinThread> thread;
+};
+} // namespace multipass
+
+#endif // MULTIPASS_LXD_EVENTS_H
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "lxd_query_cache.h"
+#include "lxd_request.h"
+
+#include <multipass/format.h>
+#include <multipass/logging/log.h>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+
+namespace
+{
+constexpr auto category = "lxd query cache";
+} // namespace
+
+mp::LXDQueryCache::LXDQueryCache(NetworkAccessManager* manager, const QUrl& base_url,
+                                 std::chrono::milliseconds max_age)
+    : manager{manager}, base_url{base_url}, max_age{max_age}
+{
+}
+
+mp::optional<QJsonObject> mp::LXDQueryCache::instance_state(const QString& instance_name)
+{
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        if (instance_states && fresh(instance_states->fetched_at))
+        {
+            const auto it = instance_states->value.find(instance_name);
+            return it != instance_states->value.end() ? make_optional(it->second) : nullopt;
+        }
+    }
+
+    // Requests make way for other events while they wait, which may well be other lookups, so none waits on a lock
+    std::map<QString, QJsonObject> states;
+    try
+    {
+        const auto json_reply =
+            lxd_request(manager, "GET", QUrl(QString("%1/virtual-machines?recursion=2").arg(base_url.toString())));
+
+        for (const auto instance : json_reply["metadata"].toArray())
+        {
+            const auto state = instance.toObject()["state"];
+            if (state.isObject())
+                states.emplace(instance.toObject()["name"].toString(), state.toObject());
+        }
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::debug, category, fmt::format("Cannot list instance states: {}", e.what()));
+    }
+
+    std::lock_guard<decltype(mutex)> lock{mutex};
+
+    const auto it = states.find(instance_name);
+    auto state = it != states.end() ? make_optional(it->second) : nullopt;
+    instance_states = Entry<std::map<QString, QJsonObject>>{std::move(states), Clock::now()};
+
+    return state;
+}
+
+QJsonArray mp::LXDQueryCache::leases(const QString& network_name)
+{
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        const auto it = network_leases.find(network_name);
+        if (it != network_leases.end() && fresh(it->second.fetched_at))
+            return it->second.value;
+    }
+
+    const auto json_leases = lxd_request(
+        manager, "GET", QUrl(QString("%1/networks/%2/leases").arg(base_url.toString()).arg(network_name)));
+    const auto leases = json_leases["metadata"].toArray();
+
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    network_leases[network_name] = Entry<QJsonArray>{leases, Clock::now()};
+
+    return leases;
+}
+
+void mp::LXDQueryCache::invalidate()
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+
+    instance_states = nullopt;
+    network_leases.clear();
+}
+
+bool mp::LXDQueryCache::fresh(Clock::time_point fetched_at) const
+{
+    return Clock::now() - fetched_at < max_age;
+}
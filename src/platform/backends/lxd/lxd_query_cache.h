@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_LXD_QUERY_CACHE_H
+#define MULTIPASS_LXD_QUERY_CACHE_H
+
+#include <multipass/optional.h>
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+#include <QUrl>
+
+#include <chrono>
+#include <map>
+#include <mutex>
+
+namespace multipass
+{
+class NetworkAccessManager;
+
+// Answers lookups about every instance from one request to LXD, reusing the answers for a short while, so that listing
+// many instances does not ask about each of them in turn
+class LXDQueryCache
+{
+public:
+    LXDQueryCache(NetworkAccessManager* manager, const QUrl& base_url,
+                  std::chrono::milliseconds max_age = std::chrono::seconds{2});
+
+    // The state of an instance, like GET /virtual-machines/<name>/state has it. Empty when the listing of all of them
+    // could not tell, for callers to ask about the instance itself
+    optional<QJsonObject> instance_state(const QString& instance_name);
+    // The leases on a network, like GET /networks/<name>/leases has them. Throws like lxd_request.
+    QJsonArray leases(const QString& network_name);
+
+    // Makes the next lookups ask LXD again, once instances were changed
+    void invalidate();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    template <typename T>
+    struct Entry
+    {
+        T value;
+        Clock::time_point fetched_at;
+    };
+
+    bool fresh(Clock::time_point fetched_at) const;
+
+    NetworkAccessManager* const manager;
+    const QUrl base_url;
+    const std::chrono::milliseconds max_age;
+    std::mutex mutex;
+    optional<Entry<std::map<QString, QJsonObject>>> instance_states;
+    std::map<QString, Entry<QJsonArray>> network_leases;
+};
+} // namespace multipass
+
+#endif // MULTIPASS_LXD_QUERY_CACHE_H
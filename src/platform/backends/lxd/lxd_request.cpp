@@ -71,6 +71,14 @@ const QJsonObject lxd_request_common(const std::string& method, QUrl& url, int t
         reply->abort();
     });
 
+    // Large transfers only time out when they stall
+    auto restart_timeout = [&download_timeout](auto...) {
+        if (download_timeout.isActive())
+            download_timeout.start();
+    };
+    QObject::connect(reply, &QNetworkReply::uploadProgress, &download_timeout, restart_timeout);
+    QObject::connect(reply, &QNetworkReply::downloadProgress, &download_timeout, restart_timeout);
+
     if (!reply->isFinished())
     {
         download_timeout.start();
@@ -110,7 +118,8 @@ const QJsonObject lxd_request_common(const std::string& method, QUrl& url, int t
         throw mp::LXDJsonParseError(error_string);
     }
 
-    mpl::log(mpl::Level::trace, request_category, fmt::format("Got reply: {}", QJsonDocument(json_reply).toJson()));
+    if (mpl::enabled(mpl::Level::trace))
+        mpl::log(mpl::Level::trace, request_category, fmt::format("Got reply: {}", QJsonDocument(json_reply).toJson()));
 
     if (reply->error() != QNetworkReply::NoError)
         throw mp::LXDRuntimeError(fmt::format("Network error for {}: {} - {}", url.toString(), reply->errorString(),
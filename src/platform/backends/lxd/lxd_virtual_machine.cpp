@@ -16,6 +16,9 @@
  */
 
 #include "lxd_virtual_machine.h"
+#include "lxd_base_instances.h"
+#include "lxd_events.h"
+#include "lxd_query_cache.h"
 #include "lxd_request.h"
 
 #include <QJsonArray>
@@ -45,14 +48,44 @@ using namespace std::literals::chrono_literals;
 
 namespace
 {
-auto instance_state_for(const QString& name, mp::NetworkAccessManager* manager, const QUrl& url)
+auto fetch_status_code(const QString& name, mp::NetworkAccessManager* manager, const QUrl& url)
 {
     auto json_reply = lxd_request(manager, "GET", url);
     auto metadata = json_reply["metadata"].toObject();
     mpl::log(mpl::Level::trace, name.toStdString(),
              fmt::format("Got LXD container state: {} is {}", name, metadata["status"].toString()));
 
-    switch (metadata["status_code"].toInt(-1))
+    return metadata["status_code"].toInt(-1);
+}
+
+// Only settled states are worth keeping until the next lifecycle event
+bool settled(int status_code)
+{
+    return status_code == 102 || status_code == 103 || status_code == 110;
+}
+
+auto instance_state_for(const QString& name, mp::NetworkAccessManager* manager, const QUrl& url,
+                        mp::LXDEvents* events, mp::LXDQueryCache* queries)
+{
+    unsigned changes{0};
+    auto status_code = events ? events->cached_status_code(name, changes) : mp::nullopt;
+    if (!status_code)
+    {
+        // A listing may predate the last event, so only what is asked for here is kept until the next one
+        if (auto state = queries ? queries->instance_state(name) : mp::nullopt)
+        {
+            status_code = (*state)["status_code"].toInt(-1);
+        }
+        else
+        {
+            status_code = fetch_status_code(name, manager, url);
+
+            if (events && settled(*status_code))
+                events->cache_status_code(name, *status_code, changes);
+        }
+    }
+
+    switch (*status_code)
     {
     case 101: // Started
     case 103: // Running
@@ -71,18 +104,13 @@ auto instance_state_for(const QString& name, mp::NetworkAccessManager* manager,
     case 108: // Aborting
         return mp::VirtualMachine::State::unknown;
     default:
-        mpl::log(mpl::Level::error, name.toStdString(),
-                 fmt::format("Got unexpected LXD state: {} ({})", metadata["status_code"].toString(),
-                             metadata["status"].toInt()));
+        mpl::log(mpl::Level::error, name.toStdString(), fmt::format("Got unexpected LXD state: {}", *status_code));
         return mp::VirtualMachine::State::unknown;
     }
 }
 
-mp::optional<mp::IPAddress> get_ip_for(const QString& mac_addr, mp::NetworkAccessManager* manager, const QUrl& url)
+mp::optional<mp::IPAddress> get_ip_for(const QString& mac_addr, const QJsonArray& leases)
 {
-    const auto json_leases = lxd_request(manager, "GET", url);
-    const auto leases = json_leases["metadata"].toArray();
-
     for (const auto lease : leases)
     {
         if (lease.toObject()["hwaddr"].toString() == mac_addr)
@@ -115,6 +143,33 @@ QJsonObject generate_base_vm_config(const multipass::VirtualMachineDescription&
     return config;
 }
 
+// LXD limits a disk by either bandwidth or IOPS, the latter taking precedence here, and has no bursts
+void apply_io_limits(QJsonObject& devices, const multipass::IoLimits& limits)
+{
+    auto root = devices["root"].toObject();
+    if (limits.disk_iops)
+        root["limits.max"] = QString("%1iops").arg(limits.disk_iops);
+    else if (limits.disk_bytes_per_second)
+        root["limits.max"] = QString("%1B").arg(limits.disk_bytes_per_second);
+    else
+        root.remove("limits.max");
+    devices["root"] = root;
+
+    auto eth0 = devices["eth0"].toObject();
+    if (limits.network_bytes_per_second)
+    {
+        const auto bits = QString("%1bit").arg(limits.network_bytes_per_second * 8);
+        eth0["limits.ingress"] = bits;
+        eth0["limits.egress"] = bits;
+    }
+    else
+    {
+        eth0.remove("limits.ingress");
+        eth0.remove("limits.egress");
+    }
+    devices["eth0"] = eth0;
+}
+
 QJsonObject generate_devices_config(const multipass::VirtualMachineDescription& desc, const QString& default_mac_addr)
 {
     QJsonObject devices{{"config", QJsonObject{{"source", "cloud-init:config"}, {"type", "disk"}}},
@@ -139,6 +194,9 @@ QJsonObject generate_devices_config(const multipass::VirtualMachineDescription&
                                              {"hwaddr", QString::fromStdString(net.mac_address)}});
     }
 
+    if (!desc.io_limits.empty())
+        apply_io_limits(devices, desc.io_limits);
+
     return devices;
 }
 
@@ -146,7 +204,8 @@ QJsonObject generate_devices_config(const multipass::VirtualMachineDescription&
 
 mp::LXDVirtualMachine::LXDVirtualMachine(const VirtualMachineDescription& desc, VMStatusMonitor& monitor,
                                          NetworkAccessManager* manager, const QUrl& base_url,
-                                         const QString& bridge_name)
+                                         const QString& bridge_name, LXDEvents* events, LXDQueryCache* queries,
+                                         LXDBaseInstances* bases)
     : BaseVirtualMachine{desc.vm_name},
       name{QString::fromStdString(desc.vm_name)},
       username{desc.ssh_username},
@@ -154,6 +213,8 @@ mp::LXDVirtualMachine::LXDVirtualMachine(const VirtualMachineDescription& desc,
       manager{manager},
       base_url{base_url},
       bridge_name{bridge_name},
+      events{events},
+      queries{queries},
       mac_addr{QString::fromStdString(desc.default_mac_address)}
 {
     try
@@ -165,17 +226,37 @@ mp::LXDVirtualMachine::LXDVirtualMachine(const VirtualMachineDescription& desc,
         mpl::log(mpl::Level::debug, name.toStdString(),
                  fmt::format("Creating instance with image id: {}", desc.image.id));
 
-        QJsonObject virtual_machine{
-            {"name", name},
-            {"config", generate_base_vm_config(desc)},
-            {"devices", generate_devices_config(desc, mac_addr)},
-            {"source", QJsonObject{{"type", "image"}, {"fingerprint", QString::fromStdString(desc.image.id)}}}};
+        const QJsonObject image_source{{"type", "image"}, {"fingerprint", QString::fromStdString(desc.image.id)}};
+        QJsonObject virtual_machine{{"name", name},
+                                    {"config", generate_base_vm_config(desc)},
+                                    {"devices", generate_devices_config(desc, mac_addr)},
+                                    {"source", bases ? bases->source_for(desc.image.id) : image_source}};
 
-        auto json_reply = lxd_request(manager, "POST", QUrl(QString("%1/virtual-machines").arg(base_url.toString())),
-                                      virtual_machine);
+        auto create = [this, &virtual_machine] {
+            auto json_reply = lxd_request(manager, "POST",
+                                          QUrl(QString("%1/virtual-machines").arg(base_url.toString())),
+                                          virtual_machine);
 
-        // TODO: Need a way to pass in the daemon timeout and make in general for all back ends
-        lxd_wait(manager, base_url, json_reply, 600000);
+            // TODO: Need a way to pass in the daemon timeout and make in general for all back ends
+            lxd_wait(manager, base_url, json_reply, 600000);
+        };
+
+        try
+        {
+            create();
+        }
+        catch (const LXDRuntimeError& e)
+        {
+            if (virtual_machine["source"] == image_source)
+                throw;
+
+            // The copy only differs from creating from the image in where the root volume comes from
+            mpl::log(mpl::Level::warning, name.toStdString(),
+                     fmt::format("Cannot copy the base instance, creating from the image: {}", e.what()));
+            bases->forget(desc.image.id);
+            virtual_machine["source"] = image_source;
+            create();
+        }
 
         current_state();
     }
@@ -269,7 +350,7 @@ mp::VirtualMachine::State mp::LXDVirtualMachine::current_state()
 {
     try
     {
-        auto present_state = instance_state_for(name, manager, state_url());
+        auto present_state = instance_state_for(name, manager, state_url(), events, queries);
 
         if ((state == State::delayed_shutdown || state == State::starting) && present_state == State::running)
             return state;
@@ -325,9 +406,7 @@ void mp::LXDVirtualMachine::update_state()
 
 std::string mp::LXDVirtualMachine::ssh_hostname(std::chrono::milliseconds timeout)
 {
-    auto get_ip = [this]() -> optional<IPAddress> { return get_ip_for(mac_addr, manager, network_leases_url()); };
-
-    return mp::backend::ip_address_for(this, get_ip, timeout);
+    return mp::backend::ip_address_for(this, [this] { return get_ip(); }, timeout);
 }
 
 std::string mp::LXDVirtualMachine::ssh_username()
@@ -339,7 +418,7 @@ std::string mp::LXDVirtualMachine::management_ipv4()
 {
     if (!management_ip)
     {
-        management_ip = get_ip_for(mac_addr, manager, network_leases_url());
+        management_ip = get_ip();
         if (!management_ip)
         {
             mpl::log(mpl::Level::trace, name.toStdString(), "IP address not found.");
@@ -360,6 +439,43 @@ void mp::LXDVirtualMachine::wait_until_ssh_up(std::chrono::milliseconds timeout)
     mpu::wait_until_ssh_up(this, timeout, [this] { ensure_vm_is_running(); });
 }
 
+mp::VirtualMachine::Metrics mp::LXDVirtualMachine::metrics()
+{
+    // LXD gathers these through its agent in the instance, leaving out what it could not
+    auto byte_count = [](const QJsonObject& usage, const char* key) -> mp::optional<long long> {
+        const auto count = static_cast<long long>(usage[key].toDouble());
+        if (count > 0)
+            return count;
+        return mp::nullopt;
+    };
+
+    try
+    {
+        const auto metadata = lxd_request(manager, "GET", state_url())["metadata"].toObject();
+        const auto memory = metadata["memory"].toObject();
+        const auto root_disk = metadata["disk"].toObject()["root"].toObject();
+
+        return {byte_count(memory, "usage"), byte_count(memory, "total"), byte_count(root_disk, "usage"),
+                byte_count(root_disk, "total")};
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::debug, vm_name, fmt::format("Cannot get metrics from LXD: {}", e.what()));
+        return {};
+    }
+}
+
+void mp::LXDVirtualMachine::set_io_limits(const IoLimits& limits)
+{
+    // Devices are patched whole, so the root disk and interface go back with everything else they had
+    auto devices = lxd_request(manager, "GET", url())["metadata"].toObject()["devices"].toObject();
+    apply_io_limits(devices, limits);
+    lxd_request(manager, "PATCH", url(), QJsonObject{{"devices", devices}});
+
+    if (queries)
+        queries->invalidate();
+}
+
 const QUrl mp::LXDVirtualMachine::url()
 {
     return QString("%1/virtual-machines/%2").arg(base_url.toString()).arg(name);
@@ -389,4 +505,15 @@ void mp::LXDVirtualMachine::request_state(const QString& new_state)
     {
         // Implies the task doesn't exist, move on...
     }
+
+    if (queries)
+        queries->invalidate();
+}
+
+const mp::optional<mp::IPAddress> mp::LXDVirtualMachine::get_ip()
+{
+    if (queries)
+        return get_ip_for(mac_addr, queries->leases(bridge_name));
+
+    return get_ip_for(mac_addr, lxd_request(manager, "GET", network_leases_url())["metadata"].toArray());
 }
@@ -26,6 +26,9 @@
 
 namespace multipass
 {
+class LXDBaseInstances;
+class LXDEvents;
+class LXDQueryCache;
 class NetworkAccessManager;
 class VirtualMachineDescription;
 class VMStatusMonitor;
@@ -34,7 +37,8 @@ class LXDVirtualMachine final : public BaseVirtualMachine
 {
 public:
     LXDVirtualMachine(const VirtualMachineDescription& desc, VMStatusMonitor& monitor, NetworkAccessManager* manager,
-                      const QUrl& base_url, const QString& bridge_name);
+                      const QUrl& base_url, const QString& bridge_name, LXDEvents* events = nullptr,
+                      LXDQueryCache* queries = nullptr, LXDBaseInstances* bases = nullptr);
     ~LXDVirtualMachine() override;
     void stop() override;
     void start() override;
@@ -50,6 +54,8 @@ public:
     void ensure_vm_is_running(const std::chrono::milliseconds& timeout);
     void wait_until_ssh_up(std::chrono::milliseconds timeout) override;
     void update_state() override;
+    Metrics metrics() override;
+    void set_io_limits(const IoLimits& limits) override;
 
 private:
     const QString name;
@@ -60,6 +66,8 @@ private:
     NetworkAccessManager* manager;
     const QUrl base_url;
     const QString bridge_name;
+    LXDEvents* const events;
+    LXDQueryCache* const queries;
     const QString mac_addr;
 
     const QUrl url();
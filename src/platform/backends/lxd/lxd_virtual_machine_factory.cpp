@@ -86,7 +86,10 @@ mp::LXDVirtualMachineFactory::LXDVirtualMachineFactory(NetworkAccessManager::UPt
                                                        const QUrl& base_url)
     : manager{std::move(manager)},
       data_dir{mp::utils::make_dir(data_dir, get_backend_directory_name())},
-      base_url{base_url}
+      base_url{base_url},
+      events{std::make_unique<LXDEvents>(base_url)},
+      queries{this->manager.get(), base_url},
+      bases{this->manager.get(), base_url}
 {
 }
 
@@ -98,7 +101,8 @@ mp::LXDVirtualMachineFactory::LXDVirtualMachineFactory(const mp::Path& data_dir,
 mp::VirtualMachine::UPtr mp::LXDVirtualMachineFactory::create_virtual_machine(const VirtualMachineDescription& desc,
                                                                               VMStatusMonitor& monitor)
 {
-    return std::make_unique<mp::LXDVirtualMachine>(desc, monitor, manager.get(), base_url, multipass_bridge_name);
+    return std::make_unique<mp::LXDVirtualMachine>(desc, monitor, manager.get(), base_url, multipass_bridge_name,
+                                                   events.get(), &queries, &bases);
 }
 
 void mp::LXDVirtualMachineFactory::remove_resources_for(const std::string& name)
@@ -185,7 +189,7 @@ mp::VMImageVault::UPtr mp::LXDVirtualMachineFactory::create_image_vault(std::vec
                                                                         const mp::days& days_to_expire)
 {
     return std::make_unique<mp::LXDVMImageVault>(image_hosts, downloader, manager.get(), base_url, cache_dir_path,
-                                                 days_to_expire);
+                                                 days_to_expire, events.get(), &bases);
 }
 
 auto mp::LXDVirtualMachineFactory::networks() const -> std::vector<NetworkInterfaceInfo>
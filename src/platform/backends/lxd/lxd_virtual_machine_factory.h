@@ -18,6 +18,9 @@
 #ifndef MULTIPASS_LXD_VIRTUAL_MACHINE_FACTORY_H
 #define MULTIPASS_LXD_VIRTUAL_MACHINE_FACTORY_H
 
+#include "lxd_base_instances.h"
+#include "lxd_events.h"
+#include "lxd_query_cache.h"
 #include "lxd_request.h"
 
 #include <multipass/network_access_manager.h>
@@ -38,7 +41,11 @@ public:
     VirtualMachine::UPtr create_virtual_machine(const VirtualMachineDescription& desc,
                                                 VMStatusMonitor& monitor) override;
     void remove_resources_for(const std::string& name) override;
-    VMImage prepare_source_image(const VMImage& source_image) override
+    bool can_limit_io(const IoLimits& /*limits*/) const override
+    {
+        return true; // though a disk takes either IOPS or bandwidth, the former winning, and no bursts
+    }
+    VMImage prepare_source_image(const VMImage& source_image, const ProgressMonitor& monitor) override
     {
         return source_image;
     };
@@ -60,6 +67,9 @@ private:
     NetworkAccessManager::UPtr manager;
     const Path data_dir;
     const QUrl base_url;
+    const std::unique_ptr<LXDEvents> events;
+    LXDQueryCache queries;
+    LXDBaseInstances bases;
 };
 } // namespace multipass
 
@@ -16,10 +16,13 @@
  */
 
 #include "lxd_vm_image_vault.h"
+#include "lxd_base_instances.h"
+#include "lxd_events.h"
 #include "lxd_request.h"
 
 #include <multipass/exceptions/aborted_download_exception.h>
 #include <multipass/exceptions/local_socket_connection_exception.h>
+#include <multipass/exceptions/not_implemented_on_this_backend_exception.h>
 #include <multipass/format.h>
 #include <multipass/logging/log.h>
 #include <multipass/network_access_manager.h>
@@ -31,7 +34,8 @@
 #include <multipass/vm_image_host.h>
 
 #include <shared/linux/backend_utils.h>
-#include <shared/linux/process_factory.h>
+
+#include <scope_guard.hpp>
 
 #include <yaml-cpp/yaml.h>
 
@@ -56,6 +60,7 @@ using namespace std::literals::chrono_literals;
 namespace
 {
 constexpr auto category = "lxd image vault";
+constexpr auto inventory_max_age = 10s;
 
 const QHash<QString, QString> host_to_lxd_arch{{"x86_64", "x86_64"}, {"arm", "armv7l"}, {"arm64", "aarch64"},
                                                {"i386", "i686"},     {"power", "ppc"},  {"power64", "ppc64"},
@@ -79,13 +84,14 @@ QString post_process_downloaded_image(const QString& image_path, const mp::Progr
 {
     QString new_image_path{image_path};
 
-    if (image_path.endsWith(".xz"))
+    if (mp::vault::is_compressed_image(image_path))
     {
         new_image_path = mp::vault::extract_image(image_path, monitor, true);
     }
 
     QString original_image_path{new_image_path};
-    new_image_path = mp::backend::convert_to_qcow_if_necessary(new_image_path);
+    new_image_path = mp::backend::convert_to_qcow_if_necessary(
+        new_image_path, [&monitor](int, int percentage) { return monitor(mp::LaunchProgress::WAITING, percentage); });
 
     if (original_image_path != new_image_path)
     {
@@ -95,9 +101,39 @@ QString post_process_downloaded_image(const QString& image_path, const mp::Progr
     return new_image_path;
 }
 
-QString create_metadata_tarball(const mp::VMImageInfo& info, const QTemporaryDir& lxd_import_dir)
+// A ustar archive holding one file, as LXD expects image metadata
+QByteArray tarball_with(const QByteArray& file_name, const QByteArray& contents)
+{
+    constexpr auto block_size = 512;
+
+    auto octal = [](qint64 value, int width) {
+        return QByteArray::number(value, 8).rightJustified(width - 1, '0') + '\0';
+    };
+
+    QByteArray header(block_size, '\0');
+    header.replace(0, file_name.size(), file_name);
+    header.replace(100, 8, octal(0644, 8));
+    header.replace(108, 8, octal(0, 8));
+    header.replace(116, 8, octal(0, 8));
+    header.replace(124, 12, octal(contents.size(), 12));
+    header.replace(136, 12, octal(QDateTime::currentSecsSinceEpoch(), 12));
+    header.replace(148, 8, QByteArray(8, ' '));
+    header[156] = '0';
+    header.replace(257, 8, QByteArray("ustar\0" "00", 8));
+
+    unsigned checksum{0};
+    for (const auto c : header)
+        checksum += static_cast<unsigned char>(c);
+    header.replace(148, 8, octal(checksum, 7) + ' ');
+
+    const auto padding = (block_size - contents.size() % block_size) % block_size;
+
+    // The archive ends with two empty blocks
+    return header + contents + QByteArray(padding + 2 * block_size, '\0');
+}
+
+QByteArray create_metadata_tarball(const mp::VMImageInfo& info)
 {
-    QFile metadata_yaml_file{lxd_import_dir.filePath("metadata.yaml")};
     YAML::Node metadata_node;
 
     metadata_node["architecture"] = host_to_lxd_arch.value(QSysInfo::currentCpuArchitecture()).toStdString();
@@ -111,24 +147,7 @@ QString create_metadata_tarball(const mp::VMImageInfo& info, const QTemporaryDir
     YAML::Emitter emitter;
     emitter << metadata_node << YAML::Newline;
 
-    metadata_yaml_file.open(QIODevice::WriteOnly);
-    metadata_yaml_file.write(emitter.c_str());
-    metadata_yaml_file.close();
-
-    const auto metadata_tarball_path = lxd_import_dir.filePath("metadata.tar");
-    auto process = MP_PROCFACTORY.create_process(
-        "tar", QStringList() << "-cf" << metadata_tarball_path << "-C" << lxd_import_dir.path()
-                             << QFileInfo(metadata_yaml_file.fileName()).fileName());
-
-    auto exit_state = process->execute();
-
-    if (!exit_state.completed_successfully())
-    {
-        throw std::runtime_error(
-            fmt::format("Failed to create LXD image import metadata tarball: {}", process->read_all_standard_error()));
-    }
-
-    return metadata_tarball_path;
+    return tarball_with("metadata.yaml", emitter.c_str());
 }
 
 std::vector<std::string> copy_aliases(const QStringList& aliases)
@@ -146,13 +165,15 @@ std::vector<std::string> copy_aliases(const QStringList& aliases)
 
 mp::LXDVMImageVault::LXDVMImageVault(std::vector<VMImageHost*> image_hosts, URLDownloader* downloader,
                                      NetworkAccessManager* manager, const QUrl& base_url, const QString& cache_dir_path,
-                                     const days& days_to_expire)
+                                     const days& days_to_expire, LXDEvents* events, LXDBaseInstances* bases)
     : BaseVMImageVault{image_hosts},
       url_downloader{downloader},
       manager{manager},
       base_url{base_url},
       template_path{QString("%1/%2-").arg(cache_dir_path).arg(QCoreApplication::applicationName())},
-      days_to_expire{days_to_expire}
+      days_to_expire{days_to_expire},
+      events{events},
+      bases{bases}
 {
 }
 
@@ -250,7 +271,9 @@ mp::VMImage mp::LXDVMImageVault::fetch_image(const FetchType& fetch_type, const
 
     try
     {
-        auto json_reply = lxd_request(manager, "GET", QUrl(QString("%1/images/%2").arg(base_url.toString()).arg(id)));
+        // Most launches are of images LXD already has, which the inventory tells without asking
+        if (!inventory_image(id))
+            lxd_request(manager, "GET", QUrl(QString("%1/images/%2").arg(base_url.toString()).arg(id)));
     }
     catch (const LXDNotFoundException&)
     {
@@ -284,9 +307,7 @@ mp::VMImage mp::LXDVMImageVault::fetch_image(const FetchType& fetch_type, const
 
             monitor(LaunchProgress::WAITING, -1);
 
-            auto metadata_tarball_path = create_metadata_tarball(info, lxd_import_dir);
-
-            source_image.id = lxd_import_metadata_and_image(metadata_tarball_path, image_path);
+            source_image.id = lxd_import_metadata_and_image(create_metadata_tarball(info), image_path);
         }
         else
         {
@@ -312,6 +333,27 @@ void mp::LXDVMImageVault::remove(const std::string& name)
     }
 }
 
+mp::VMImage mp::LXDVMImageVault::rename(const std::string& /* from */, const std::string& /* to */)
+{
+    throw NotImplementedOnThisBackendException("instance renaming");
+}
+
+mp::VMImage mp::LXDVMImageVault::bake(const std::string& /* instance_name */, const std::string& /* image_name */)
+{
+    throw NotImplementedOnThisBackendException("image baking");
+}
+
+mp::VMImage mp::LXDVMImageVault::clone(const std::string& /* source_name */, const std::string& /* destination_name */)
+{
+    throw NotImplementedOnThisBackendException("instance cloning");
+}
+
+mp::VMImage mp::LXDVMImageVault::clone_layered(const std::string& /* source_name */,
+                                               const std::string& /* destination_name */)
+{
+    throw NotImplementedOnThisBackendException("instance cloning");
+}
+
 bool mp::LXDVMImageVault::has_record_for(const std::string& name)
 {
     try
@@ -335,9 +377,9 @@ bool mp::LXDVMImageVault::has_record_for(const std::string& name)
 
 void mp::LXDVMImageVault::prune_expired_images()
 {
-    auto images = retrieve_image_list();
+    const auto current = image_inventory();
 
-    for (const auto image : images)
+    for (const auto image : current->images)
     {
         auto image_info = image.toObject();
         auto properties = image_info["properties"].toObject();
@@ -361,9 +403,12 @@ void mp::LXDVMImageVault::prune_expired_images()
 
             try
             {
-                lxd_request(
-                    manager, "DELETE",
-                    QUrl(QString("%1/images/%2").arg(base_url.toString()).arg(image_info["fingerprint"].toString())));
+                const auto fingerprint = image_info["fingerprint"].toString();
+                lxd_request(manager, "DELETE", QUrl(QString("%1/images/%2").arg(base_url.toString()).arg(fingerprint)));
+                forget_image_inventory();
+
+                if (bases)
+                    bases->remove_base(fingerprint.toStdString());
             }
             catch (const LXDNotFoundException&)
             {
@@ -378,9 +423,9 @@ void mp::LXDVMImageVault::update_images(const FetchType& fetch_type, const Prepa
 {
     mpl::log(mpl::Level::debug, category, "Checking for images to update…");
 
-    auto images = retrieve_image_list();
+    const auto current = image_inventory();
 
-    for (const auto image : images)
+    for (const auto image : current->images)
     {
         auto image_info = image.toObject();
         auto image_properties = image_info["properties"].toObject();
@@ -405,6 +450,10 @@ void mp::LXDVMImageVault::update_images(const FetchType& fetch_type, const Prepa
                                        image_info["last_used_at"].toString());
 
                     lxd_request(manager, "DELETE", QUrl(QString("%1/images/%2").arg(base_url.toString()).arg(id)));
+                    forget_image_inventory();
+
+                    if (bases)
+                        bases->remove_base(id.toStdString());
                 }
             }
             catch (const LXDNotFoundException&)
@@ -421,9 +470,13 @@ mp::MemorySize mp::LXDVMImageVault::minimum_image_size_for(const std::string& id
 
     try
     {
-        auto json_reply = lxd_request(
-            manager, "GET", QUrl(QString("%1/images/%2").arg(base_url.toString()).arg(QString::fromStdString(id))));
-        const long image_size_bytes = json_reply["metadata"].toObject()["size"].toDouble();
+        auto image = inventory_image(QString::fromStdString(id));
+        if (!image)
+            image = lxd_request(manager, "GET",
+                                QUrl(QString("%1/images/%2").arg(base_url.toString()).arg(QString::fromStdString(id))))
+                        ["metadata"]
+                            .toObject();
+        const long image_size_bytes = (*image)["size"].toDouble();
         const MemorySize image_size{std::to_string(image_size_bytes)};
 
         if (image_size > lxd_image_size)
@@ -473,6 +526,7 @@ void mp::LXDVMImageVault::lxd_download_image(const QString& id, const QString& s
     auto json_reply = lxd_request(manager, "POST", QUrl(QString("%1/images").arg(base_url.toString())), image_object);
 
     poll_download_operation(json_reply, monitor);
+    forget_image_inventory();
 }
 
 void mp::LXDVMImageVault::url_download_image(const VMImageInfo& info, const QString& image_path,
@@ -480,12 +534,18 @@ void mp::LXDVMImageVault::url_download_image(const VMImageInfo& info, const QStr
 {
     mp::vault::DeleteOnException image_file{image_path};
 
-    url_downloader->download_to(info.image_location, image_path, info.size, LaunchProgress::IMAGE, monitor);
-
     if (info.verify)
     {
+        const auto image_hash =
+            url_downloader->download_and_hash_to(info.image_location, image_path, info.size, LaunchProgress::IMAGE,
+                                                 monitor);
+
         monitor(LaunchProgress::VERIFY, -1);
-        mp::vault::verify_image_download(image_path, info.id);
+        mp::vault::verify_image_hash(image_hash, info.id);
+    }
+    else
+    {
+        url_downloader->download_to(info.image_location, image_path, info.size, LaunchProgress::IMAGE, monitor);
     }
 }
 
@@ -494,40 +554,61 @@ void mp::LXDVMImageVault::poll_download_operation(const QJsonObject& json_reply,
     if (json_reply["metadata"].toObject()["class"] == QStringLiteral("task") &&
         json_reply["status_code"].toInt(-1) == 100)
     {
-        QUrl task_url(QString("%1/operations/%2")
-                          .arg(base_url.toString())
-                          .arg(json_reply["metadata"].toObject()["id"].toString()));
-
-        // Instead of polling, need to use websockets to get events
+        const auto id = json_reply["metadata"].toObject()["id"].toString();
+        QUrl task_url(QString("%1/operations/%2").arg(base_url.toString()).arg(id));
+
+        // LXD tells of progress through events. Polling is kept for when those cannot be listened to.
+        if (events)
+            events->watch_operation(id);
+        auto unwatch = sg::make_scope_guard([this, &id]() noexcept {
+            if (events)
+                events->unwatch_operation(id);
+        });
+
+        int generation{0};
+        auto polled = false;
         while (true)
         {
             try
             {
-                auto task_reply = mp::lxd_request(manager, "GET", task_url);
+                optional<QJsonObject> operation;
+                if (polled)
+                {
+                    if (events && events->listening())
+                        operation = events->wait_for_operation(id, generation, 5s);
+                    else
+                        std::this_thread::sleep_for(1s);
+                }
 
-                if (task_reply["error_code"].toInt(-1) != 0)
+                if (!operation)
                 {
-                    mpl::log(mpl::Level::error, category, task_reply["error"].toString().toStdString());
-                    break;
+                    auto task_reply = mp::lxd_request(manager, "GET", task_url);
+                    polled = true;
+
+                    if (task_reply["error_code"].toInt(-1) != 0)
+                    {
+                        mpl::log(mpl::Level::error, category, task_reply["error"].toString().toStdString());
+                        break;
+                    }
+
+                    operation = task_reply["metadata"].toObject();
                 }
 
-                auto status_code = task_reply["metadata"].toObject()["status_code"].toInt(-1);
+                auto status_code = (*operation)["status_code"].toInt(-1);
                 if (status_code == 200)
                 {
                     break;
                 }
                 else
                 {
-                    auto download_progress = parse_percent_as_int(
-                        task_reply["metadata"].toObject()["metadata"].toObject()["download_progress"].toString());
+                    auto download_progress =
+                        parse_percent_as_int((*operation)["metadata"].toObject()["download_progress"].toString());
 
                     if (!monitor(LaunchProgress::IMAGE, download_progress))
                     {
                         mp::lxd_request(manager, "DELETE", task_url);
                         throw mp::AbortedDownloadException{"Download aborted"};
                     }
-
-                    std::this_thread::sleep_for(1s);
                 }
             }
             // Implies the task is finished
@@ -539,20 +620,17 @@ void mp::LXDVMImageVault::poll_download_operation(const QJsonObject& json_reply,
     }
 }
 
-std::string mp::LXDVMImageVault::lxd_import_metadata_and_image(const QString& metadata_path, const QString& image_path)
+std::string mp::LXDVMImageVault::lxd_import_metadata_and_image(const QByteArray& metadata_tarball,
+                                                               const QString& image_path)
 {
     QHttpMultiPart lxd_multipart{QHttpMultiPart::FormDataType};
-    QFileInfo metadata_info{metadata_path}, image_info{image_path};
+    QFileInfo image_info{image_path};
 
     QHttpPart metadata_part;
     metadata_part.setHeader(QNetworkRequest::ContentTypeHeader, QVariant("application/octet-stream"));
-    metadata_part.setHeader(
-        QNetworkRequest::ContentDispositionHeader,
-        QVariant(QString("form-data; name=\"metadata\"; filename=\"%1\"").arg(metadata_info.fileName())));
-    QFile* metadata_file = new QFile(metadata_path);
-    metadata_file->open(QIODevice::ReadOnly);
-    metadata_part.setBodyDevice(metadata_file);
-    metadata_file->setParent(&lxd_multipart);
+    metadata_part.setHeader(QNetworkRequest::ContentDispositionHeader,
+                            QVariant(QString("form-data; name=\"metadata\"; filename=\"metadata.tar\"")));
+    metadata_part.setBody(metadata_tarball);
 
     QHttpPart image_part;
     image_part.setHeader(QNetworkRequest::ContentTypeHeader, QVariant("application/octet-stream"));
@@ -570,41 +648,27 @@ std::string mp::LXDVMImageVault::lxd_import_metadata_and_image(const QString& me
     auto json_reply = lxd_request(manager, "POST", QUrl(QString("%1/images").arg(base_url.toString())), lxd_multipart);
 
     auto task_reply = lxd_wait(manager, base_url, json_reply, 300000);
+    forget_image_inventory();
 
     return task_reply["metadata"].toObject()["metadata"].toObject()["fingerprint"].toString().toStdString();
 }
 
 std::string mp::LXDVMImageVault::get_lxd_image_hash_for(const QString& id)
 {
-    auto images = retrieve_image_list();
-
-    for (const auto image : images)
-    {
-        auto image_info = image.toObject();
-        auto properties = image_info["properties"].toObject();
+    const auto current = image_inventory();
+    const auto fingerprint = current->fingerprints_by_original_hash.find(id);
 
-        if (properties.contains("original_hash"))
-        {
-            auto original_hash = properties["original_hash"].toString();
-            if (original_hash == id)
-            {
-                return image_info["fingerprint"].toString().toStdString();
-            }
-        }
-    }
-
-    return {};
+    return fingerprint != current->fingerprints_by_original_hash.end() ? fingerprint->second.toStdString()
+                                                                        : std::string{};
 }
 
-QJsonArray mp::LXDVMImageVault::retrieve_image_list()
+mp::optional<QJsonArray> mp::LXDVMImageVault::retrieve_image_list()
 {
-    QJsonArray image_list;
-
     try
     {
         auto json_reply = lxd_request(manager, "GET", QUrl(QString("%1/images?recursion=1").arg(base_url.toString())));
 
-        image_list = json_reply["metadata"].toArray();
+        return json_reply["metadata"].toArray();
     }
     catch (const LXDNotFoundException&)
     {
@@ -615,5 +679,65 @@ QJsonArray mp::LXDVMImageVault::retrieve_image_list()
         mpl::log(mpl::Level::warning, category, e.what());
     }
 
-    return image_list;
+    return nullopt;
+}
+
+// LXD tells of changes to images through events. Without those, what was listed is only trusted for a short while.
+std::shared_ptr<const mp::LXDVMImageVault::ImageInventory> mp::LXDVMImageVault::image_inventory()
+{
+    std::lock_guard<decltype(inventory_mutex)> lock{inventory_mutex};
+
+    const auto listening = events && events->listening();
+    const auto image_changes = events ? events->image_changes() : 0u;
+    if (inventory && (listening ? inventory->image_changes == image_changes
+                                : std::chrono::steady_clock::now() - inventory->fetched_at < inventory_max_age))
+        return inventory;
+
+    auto listed = std::make_shared<ImageInventory>();
+    listed->fetched_at = std::chrono::steady_clock::now();
+    listed->image_changes = image_changes;
+
+    const auto images = retrieve_image_list();
+    if (!images)
+        return listed; // left out, for the next lookup to ask again
+
+    listed->images = *images;
+    for (const auto image : listed->images)
+    {
+        const auto image_info = image.toObject();
+        const auto fingerprint = image_info["fingerprint"].toString();
+        listed->by_fingerprint.emplace(fingerprint, image_info);
+
+        for (const auto alias : image_info["aliases"].toArray())
+            listed->fingerprints_by_alias.emplace(alias.toObject()["name"].toString(), fingerprint);
+
+        const auto properties = image_info["properties"].toObject();
+        if (properties.contains("original_hash"))
+            listed->fingerprints_by_original_hash.emplace(properties["original_hash"].toString(), fingerprint);
+    }
+
+    inventory = listed;
+    return inventory;
+}
+
+mp::optional<QJsonObject> mp::LXDVMImageVault::inventory_image(const QString& fingerprint_or_alias)
+{
+    const auto current = image_inventory();
+
+    auto fingerprint = fingerprint_or_alias;
+    const auto alias = current->fingerprints_by_alias.find(fingerprint_or_alias);
+    if (alias != current->fingerprints_by_alias.end())
+        fingerprint = alias->second;
+
+    const auto image = current->by_fingerprint.find(fingerprint);
+    if (image == current->by_fingerprint.end())
+        return nullopt;
+
+    return image->second;
+}
+
+void mp::LXDVMImageVault::forget_image_inventory()
+{
+    std::lock_guard<decltype(inventory_mutex)> lock{inventory_mutex};
+    inventory.reset();
 }
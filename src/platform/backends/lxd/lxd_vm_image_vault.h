@@ -19,6 +19,7 @@
 #define MULTIPASS_LXD_VM_IMAGE_VAULT_H
 
 #include <multipass/days.h>
+#include <multipass/optional.h>
 #include <multipass/query.h>
 #include <shared/base_vm_image_vault.h>
 
@@ -26,8 +27,15 @@
 #include <QJsonObject>
 #include <QUrl>
 
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+
 namespace multipass
 {
+class LXDBaseInstances;
+class LXDEvents;
 class NetworkAccessManager;
 class URLDownloader;
 
@@ -37,31 +45,54 @@ public:
     using TaskCompleteAction = std::function<void(const QJsonObject&)>;
 
     LXDVMImageVault(std::vector<VMImageHost*> image_host, URLDownloader* downloader, NetworkAccessManager* manager,
-                    const QUrl& base_url, const QString& cache_dir_path, const multipass::days& days_to_expire);
+                    const QUrl& base_url, const QString& cache_dir_path, const multipass::days& days_to_expire,
+                    LXDEvents* events = nullptr, LXDBaseInstances* bases = nullptr);
 
     VMImage fetch_image(const FetchType& fetch_type, const Query& query, const PrepareAction& prepare,
                         const ProgressMonitor& monitor) override;
     void remove(const std::string& name) override;
     bool has_record_for(const std::string& name) override;
+    VMImage rename(const std::string& from, const std::string& to) override;
+    VMImage bake(const std::string& instance_name, const std::string& image_name) override;
+    VMImage clone(const std::string& source_name, const std::string& destination_name) override;
+    VMImage clone_layered(const std::string& source_name, const std::string& destination_name) override;
     void prune_expired_images() override;
     void update_images(const FetchType& fetch_type, const PrepareAction& prepare,
                        const ProgressMonitor& monitor) override;
     MemorySize minimum_image_size_for(const std::string& id) override;
 
 private:
+    // What LXD has of images, from one listing of all of them, indexed by fingerprint, alias and original hash
+    struct ImageInventory
+    {
+        QJsonArray images;
+        std::map<QString, QJsonObject> by_fingerprint;
+        std::map<QString, QString> fingerprints_by_alias;
+        std::map<QString, QString> fingerprints_by_original_hash;
+        std::chrono::steady_clock::time_point fetched_at;
+        unsigned image_changes{0};
+    };
+
     void lxd_download_image(const QString& id, const QString& stream_location, const Query& query,
                             const ProgressMonitor& monitor, const QString& last_used = QString());
     void url_download_image(const VMImageInfo& info, const QString& image_path, const ProgressMonitor& monitor);
     void poll_download_operation(const QJsonObject& json_reply, const ProgressMonitor& monitor);
-    std::string lxd_import_metadata_and_image(const QString& metadata_path, const QString& image_path);
+    std::string lxd_import_metadata_and_image(const QByteArray& metadata_tarball, const QString& image_path);
     std::string get_lxd_image_hash_for(const QString& id);
-    QJsonArray retrieve_image_list();
+    optional<QJsonArray> retrieve_image_list();
+    std::shared_ptr<const ImageInventory> image_inventory();
+    optional<QJsonObject> inventory_image(const QString& fingerprint_or_alias);
+    void forget_image_inventory();
 
     URLDownloader* const url_downloader;
     NetworkAccessManager* manager;
     const QUrl base_url;
     const QString template_path;
     const days days_to_expire;
+    LXDEvents* const events;
+    LXDBaseInstances* const bases;
+    std::mutex inventory_mutex;
+    std::shared_ptr<const ImageInventory> inventory; // none until listed, or once images were changed from here
 };
 } // namespace multipass
 #endif // MULTIPASS_LXD_VM_IMAGE_VAULT_H
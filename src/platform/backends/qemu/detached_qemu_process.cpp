@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "detached_qemu_process.h"
+
+#include <multipass/format.h>
+#include <multipass/logging/log.h>
+
+#include <QFile>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include <signal.h>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+
+namespace
+{
+// qemu only daemonizes once its devices are set up, which with preallocated memory can take a while
+constexpr auto launch_timeout = std::chrono::minutes{5};
+constexpr auto connect_timeout_ms = 5000;
+constexpr auto adopt_attempts = 3;
+constexpr auto kill_timeout = std::chrono::seconds{5};
+
+qint64 read_pid(const QString& pid_file)
+{
+    QFile file{pid_file};
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+
+    const auto pid = file.readAll().trimmed().toLongLong();
+    return pid > 0 && ::kill(static_cast<pid_t>(pid), 0) == 0 ? pid : 0;
+}
+
+QStringList command_line_of(qint64 pid)
+{
+    QFile file{QString("/proc/%1/cmdline").arg(pid)};
+    if (!file.open(QIODevice::ReadOnly))
+        return {};
+
+    QStringList args;
+    for (const auto& arg : file.readAll().split('\0'))
+        if (!arg.isEmpty())
+            args << QString::fromLocal8Bit(arg);
+
+    return args;
+}
+
+// Until it is gone, it still holds the image, and starting anew on it would fail
+void kill_and_wait(qint64 pid)
+{
+    using namespace std::chrono_literals;
+
+    ::kill(static_cast<pid_t>(pid), SIGKILL);
+    for (auto waited = 0ms; waited < kill_timeout && ::kill(static_cast<pid_t>(pid), 0) == 0; waited += 50ms)
+        std::this_thread::sleep_for(50ms);
+}
+} // namespace
+
+mp::DetachedQemuProcess::DetachedQemuProcess(std::unique_ptr<Process> launcher, const QString& pid_file,
+                                             const QString& monitor_socket)
+    : launcher{std::move(launcher)}, pid_file{pid_file}, monitor_socket{monitor_socket}
+{
+    connect(&socket, &QLocalSocket::readyRead, this, &DetachedQemuProcess::ready_read_standard_output);
+    connect(&socket, &QLocalSocket::disconnected, this, &DetachedQemuProcess::on_hang_up);
+}
+
+mp::DetachedQemuProcess::~DetachedQemuProcess()
+{
+    // Letting go of the socket leaves qemu running
+    socket.disconnect(this);
+}
+
+std::unique_ptr<mp::DetachedQemuProcess>
+mp::DetachedQemuProcess::adopt(const QString& pid_file, const QString& monitor_socket, const QString& image_path)
+{
+    const auto pid = read_pid(pid_file);
+    if (!pid)
+        return nullptr;
+
+    // The pid may have been handed to something else since, so it has to still be a qemu running the image
+    auto command_line = command_line_of(pid);
+    if (std::none_of(command_line.cbegin(), command_line.cend(), [&image_path](const QString& arg) {
+            return arg == image_path || arg.contains("file=" + image_path + ',');
+        }))
+        return nullptr;
+
+    auto process = std::make_unique<DetachedQemuProcess>(nullptr, pid_file, monitor_socket);
+    process->pid = pid;
+    process->command_line = std::move(command_line);
+
+    // qemu may still be setting up its monitor when a daemon restarts right after it, so it gets a few tries
+    for (auto attempt = 0; attempt < adopt_attempts; ++attempt)
+    {
+        if (process->connect_monitor())
+            return process;
+        std::this_thread::sleep_for(std::chrono::seconds{1});
+    }
+
+    // Left alone, it would run on beyond any control, with the image taken
+    mpl::log(mpl::Level::warning, "qemu",
+             fmt::format("Cannot reach the monitor of qemu {} running {}, killing it", pid, image_path));
+    kill_and_wait(pid);
+    QFile::remove(pid_file);
+
+    return nullptr;
+}
+
+QString mp::DetachedQemuProcess::program() const
+{
+    return launcher ? launcher->program() : command_line.value(0);
+}
+
+QStringList mp::DetachedQemuProcess::arguments() const
+{
+    return launcher ? launcher->arguments() : command_line.mid(1);
+}
+
+QString mp::DetachedQemuProcess::working_directory() const
+{
+    return launcher ? launcher->working_directory() : QString{};
+}
+
+QProcessEnvironment mp::DetachedQemuProcess::process_environment() const
+{
+    return launcher ? launcher->process_environment() : QProcessEnvironment{};
+}
+
+qint64 mp::DetachedQemuProcess::process_id() const
+{
+    return pid;
+}
+
+void mp::DetachedQemuProcess::start()
+{
+    if (!launcher || running())
+        return;
+
+    emit state_changed(QProcess::Starting);
+
+    // Left behind by a qemu that did not exit cleanly
+    QFile::remove(pid_file);
+    QFile::remove(monitor_socket);
+    signalled = false;
+
+    state = launcher->execute(static_cast<int>(std::chrono::milliseconds{launch_timeout}.count()));
+    if (state.completed_successfully() && (pid = read_pid(pid_file)) && connect_monitor())
+    {
+        state = ProcessState{};
+        emit state_changed(QProcess::Running);
+        emit started();
+        return;
+    }
+
+    if (state.completed_successfully())
+    {
+        // Up, but out of reach
+        if (pid)
+            ::kill(static_cast<pid_t>(pid), SIGKILL);
+        state.exit_code = mp::nullopt;
+        state.error = ProcessState::Error{QProcess::FailedToStart, "cannot reach the qemu monitor"};
+    }
+
+    pid = 0;
+    emit state_changed(QProcess::NotRunning);
+    if (state.error)
+        emit error_occurred(state.error->state, state.error->message);
+}
+
+void mp::DetachedQemuProcess::terminate()
+{
+    if (pid)
+        ::kill(static_cast<pid_t>(pid), SIGTERM);
+}
+
+void mp::DetachedQemuProcess::kill()
+{
+    if (pid)
+    {
+        signalled = true;
+        ::kill(static_cast<pid_t>(pid), SIGKILL);
+    }
+}
+
+bool mp::DetachedQemuProcess::wait_for_started(int)
+{
+    return running();
+}
+
+bool mp::DetachedQemuProcess::wait_for_finished(int msecs)
+{
+    return socket.state() == QLocalSocket::UnconnectedState || socket.waitForDisconnected(msecs);
+}
+
+bool mp::DetachedQemuProcess::wait_for_ready_read(int msecs)
+{
+    return socket.waitForReadyRead(msecs);
+}
+
+bool mp::DetachedQemuProcess::running() const
+{
+    return socket.state() == QLocalSocket::ConnectedState;
+}
+
+mp::ProcessState mp::DetachedQemuProcess::process_state() const
+{
+    return state;
+}
+
+QString mp::DetachedQemuProcess::error_string() const
+{
+    return state.error ? state.error->message : socket.errorString();
+}
+
+QByteArray mp::DetachedQemuProcess::read_all_standard_output()
+{
+    return socket.readAll();
+}
+
+QByteArray mp::DetachedQemuProcess::read_all_standard_error()
+{
+    return launcher ? launcher->read_all_standard_error() : QByteArray{};
+}
+
+qint64 mp::DetachedQemuProcess::write(const QByteArray& data)
+{
+    const auto written = socket.write(data);
+    socket.flush();
+    return written;
+}
+
+void mp::DetachedQemuProcess::close_write_channel()
+{
+}
+
+void mp::DetachedQemuProcess::set_process_channel_mode(QProcess::ProcessChannelMode)
+{
+}
+
+mp::ProcessState mp::DetachedQemuProcess::execute(const int timeout)
+{
+    start();
+    wait_for_finished(timeout);
+    return process_state();
+}
+
+void mp::DetachedQemuProcess::setup_child_process()
+{
+}
+
+bool mp::DetachedQemuProcess::connect_monitor()
+{
+    socket.connectToServer(monitor_socket);
+    return socket.waitForConnected(connect_timeout_ms);
+}
+
+void mp::DetachedQemuProcess::on_hang_up()
+{
+    // qemu is not our child, so how it went is all but unknown; being killed is the one thing to tell apart
+    state = ProcessState{};
+    if (signalled)
+        state.error = ProcessState::Error{QProcess::Crashed, "qemu was killed"};
+    else
+        state.exit_code = 0;
+
+    pid = 0;
+    QFile::remove(pid_file);
+    emit state_changed(QProcess::NotRunning);
+    emit finished(state);
+}
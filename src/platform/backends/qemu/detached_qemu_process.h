@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_DETACHED_QEMU_PROCESS_H
+#define MULTIPASS_DETACHED_QEMU_PROCESS_H
+
+#include <multipass/process/process.h>
+
+#include <QLocalSocket>
+
+#include <memory>
+
+namespace multipass
+{
+// A qemu that daemonizes, so that it outlives the daemon, and is talked to over its QMP socket rather than its stdio.
+// It is started through a launcher process, the qemu command line itself, which exits once qemu is up, or adopted
+// from an earlier daemon through the pid file qemu wrote. QMP replies and events come out as standard output, and
+// qemu hanging up on the socket is taken for it finishing. Once it daemonized, its standard error goes nowhere.
+class DetachedQemuProcess : public Process
+{
+    Q_OBJECT
+public:
+    DetachedQemuProcess(std::unique_ptr<Process> launcher, const QString& pid_file, const QString& monitor_socket);
+    ~DetachedQemuProcess();
+
+    // The qemu left running on the image, if any; one whose monitor cannot be reached is killed instead
+    static std::unique_ptr<DetachedQemuProcess> adopt(const QString& pid_file, const QString& monitor_socket,
+                                                      const QString& image_path);
+
+    QString program() const override;
+    QStringList arguments() const override;
+    QString working_directory() const override;
+    QProcessEnvironment process_environment() const override;
+    qint64 process_id() const override;
+
+    void start() override;
+    void terminate() override;
+    void kill() override;
+
+    bool wait_for_started(int msecs = 30000) override;
+    bool wait_for_finished(int msecs = 30000) override;
+    bool wait_for_ready_read(int msecs = 30000) override;
+
+    bool running() const override;
+    ProcessState process_state() const override;
+    QString error_string() const override;
+
+    QByteArray read_all_standard_output() override;
+    QByteArray read_all_standard_error() override;
+
+    qint64 write(const QByteArray& data) override;
+    void close_write_channel() override;
+    void set_process_channel_mode(QProcess::ProcessChannelMode mode) override;
+
+    ProcessState execute(const int timeout = 30000) override;
+
+protected:
+    void setup_child_process() override;
+
+private:
+    bool connect_monitor();
+    void on_hang_up();
+
+    const std::unique_ptr<Process> launcher; // none when adopted
+    const QString pid_file;
+    const QString monitor_socket;
+    QLocalSocket socket;
+    qint64 pid{0};
+    QStringList command_line; // of the adopted qemu
+    ProcessState state;       // of the launcher until qemu is up, then of qemu
+    bool signalled{false};
+};
+} // namespace multipass
+
+#endif // MULTIPASS_DETACHED_QEMU_PROCESS_H
@@ -26,14 +26,22 @@
 
 #include <QDir>
 
+#include <cerrno>
+#include <cstring>
 #include <fstream>
 
+#include <sys/inotify.h>
+#include <unistd.h>
+
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 
 namespace
 {
 constexpr auto immediate_wait = 100; // period to wait for immediate dnsmasq failures, in ms
+constexpr auto leases_file_name = "dnsmasq.leases";
+constexpr uint32_t leases_watch_mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM |
+                                       IN_MOVED_TO | IN_ONLYDIR;
 
 auto make_dnsmasq_process(const mp::Path& data_dir, const QString& bridge_name, const std::string& subnet,
                           const QString& conf_file_path)
@@ -58,6 +66,19 @@ mp::DNSMasqServer::DNSMasqServer(const Path& data_dir, const QString& bridge_nam
         dnsmasq_hosts.open(QIODevice::WriteOnly);
     }
 
+    // The directory is watched rather than the file, which dnsmasq only creates once it hands out a lease
+    leases_watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (leases_watch < 0 ||
+        inotify_add_watch(leases_watch, QFile::encodeName(data_dir).constData(), leases_watch_mask) < 0)
+    {
+        mpl::log(mpl::Level::debug, "dnsmasq",
+                 fmt::format("Cannot watch the leases file, reading it on every lookup: {}", std::strerror(errno)));
+
+        if (leases_watch >= 0)
+            close(leases_watch);
+        leases_watch = -1;
+    }
+
     dnsmasq_cmd = make_dnsmasq_process(data_dir, bridge_name, subnet, conf_file.fileName());
     start_dnsmasq();
 }
@@ -80,25 +101,68 @@ mp::DNSMasqServer::~DNSMasqServer()
                 mpl::log(mpl::Level::warning, "dnsmasq", "failed to kill");
         }
     }
+
+    if (leases_watch >= 0)
+        close(leases_watch);
 }
 
 mp::optional<mp::IPAddress> mp::DNSMasqServer::get_ip_for(const std::string& hw_addr)
+{
+    std::lock_guard<decltype(leases_mutex)> lock{leases_mutex};
+
+    // Events are drained before the file is read, so that a change made while reading it is caught the next time
+    if (leases_changed() || !leases_loaded)
+        load_leases();
+
+    auto it = leases.find(hw_addr);
+    if (it == leases.end())
+        return mp::nullopt;
+
+    return mp::optional<mp::IPAddress>{it->second};
+}
+
+bool mp::DNSMasqServer::leases_changed()
+{
+    if (leases_watch < 0)
+        return true;
+
+    alignas(inotify_event) char buffer[4 * 1024];
+    auto changed = false;
+    ssize_t len;
+    while ((len = read(leases_watch, buffer, sizeof(buffer))) > 0)
+    {
+        for (auto pos = 0l; pos < len;)
+        {
+            const auto event = reinterpret_cast<const inotify_event*>(buffer + pos);
+            if (event->mask & IN_Q_OVERFLOW || (event->len && std::strcmp(event->name, leases_file_name) == 0))
+                changed = true;
+            pos += sizeof(inotify_event) + event->len;
+        }
+    }
+
+    return changed;
+}
+
+void mp::DNSMasqServer::load_leases()
 {
     // DNSMasq leases entries consist of:
     // <lease expiration> <mac addr> <ipv4> <name> * * *
-    const auto path = QDir(data_dir).filePath("dnsmasq.leases").toStdString();
+    const auto path = QDir(data_dir).filePath(leases_file_name).toStdString();
     const std::string delimiter{" "};
     const int hw_addr_idx{1};
     const int ipv4_idx{2};
     std::ifstream leases_file{path};
     std::string line;
+
+    leases.clear();
     while (getline(leases_file, line))
     {
         const auto fields = mp::utils::split(line, delimiter);
-        if (fields.size() > 2 && fields[hw_addr_idx] == hw_addr)
-            return mp::optional<mp::IPAddress>{fields[ipv4_idx]};
+        if (fields.size() > 2)
+            leases.emplace(fields[hw_addr_idx], fields[ipv4_idx]); // the first entry for an address wins
     }
-    return mp::nullopt;
+
+    leases_loaded = true;
 }
 
 void mp::DNSMasqServer::release_mac(const std::string& hw_addr)
@@ -106,24 +170,22 @@ void mp::DNSMasqServer::release_mac(const std::string& hw_addr)
     auto ip = get_ip_for(hw_addr);
     if (!ip)
     {
-        mpl::log(mpl::Level::warning, "dnsmasq", fmt::format("attempting to release non-existant addr: {}", hw_addr));
+        mpl::log_limited(mpl::Level::warning, "dnsmasq", "attempting to release non-existant addr: {}", hw_addr);
         return;
     }
 
     QProcess dhcp_release;
     QObject::connect(&dhcp_release, &QProcess::errorOccurred, [&ip, &hw_addr](QProcess::ProcessError error) {
-        mpl::log(mpl::Level::warning, "dnsmasq",
-                 fmt::format("failed to release ip addr {} with mac {}: {}", ip.value().as_string(), hw_addr,
-                             utils::qenum_to_string(error)));
+        mpl::log_limited(mpl::Level::warning, "dnsmasq", "failed to release ip addr {} with mac {}: {}",
+                         ip.value().as_string(), hw_addr, utils::qenum_to_string(error));
     });
 
     auto log_exit_status = [&ip, &hw_addr](int exit_code, QProcess::ExitStatus exit_status) {
         if (exit_code == 0 && exit_status == QProcess::NormalExit)
             return;
 
-        auto msg = fmt::format("failed to release ip addr {} with mac {}, exit_code: {}", ip.value().as_string(),
-                               hw_addr, exit_code);
-        mpl::log(mpl::Level::warning, "dnsmasq", msg);
+        mpl::log_limited(mpl::Level::warning, "dnsmasq", "failed to release ip addr {} with mac {}, exit_code: {}",
+                         ip.value().as_string(), hw_addr, exit_code);
     };
     QObject::connect(&dhcp_release, static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
                      log_exit_status);
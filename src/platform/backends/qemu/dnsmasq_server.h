@@ -25,7 +25,9 @@
 #include <QTemporaryFile>
 
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 namespace multipass
 {
@@ -48,6 +50,8 @@ protected:
 
 private:
     void start_dnsmasq();
+    bool leases_changed();
+    void load_leases();
 
     const QString data_dir;
     const QString bridge_name;
@@ -55,6 +59,13 @@ private:
     std::unique_ptr<Process> dnsmasq_cmd;
     QMetaObject::Connection finish_connection;
     QTemporaryFile conf_file;
+
+    // Leases are looked up over and over while instances boot, so they are kept by MAC address and only read again
+    // once inotify tells the leases file changed
+    int leases_watch{-1};
+    bool leases_loaded{false};
+    std::mutex leases_mutex;
+    std::unordered_map<std::string, std::string> leases;
 };
 } // namespace multipass
 #endif // MULTIPASS_DNSMASQ_SERVER_H
@@ -17,18 +17,26 @@
 
 #include "iptables_config.h"
 
+#include <multipass/constants.h>
 #include <multipass/format.h>
 #include <multipass/logging/log.h>
 #include <multipass/process/process.h>
 #include <shared/linux/process_factory.h>
 
+#include <QMap>
+#include <QTemporaryFile>
+
+#include <algorithm>
+#include <iterator>
+
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 
 namespace
 {
 // QString constants for all of the different iptables calls
-const QString iptables{QStringLiteral("iptables")};
+const QString iptables_restore{QStringLiteral("iptables-restore")};
+const QString iptables_save{QStringLiteral("iptables-save")};
 const QString negate{QStringLiteral("!")};
 
 //   Different tables to use
@@ -44,7 +52,6 @@ const QString FORWARD{QStringLiteral("FORWARD")};
 
 //   option constants
 const QString destination{QStringLiteral("--destination")};
-const QString delete_rule{QStringLiteral("--delete")};
 const QString in_interface{QStringLiteral("--in-interface")};
 const QString append_rule{QStringLiteral("--append")};
 const QString insert_rule{QStringLiteral("--insert")};
@@ -53,8 +60,7 @@ const QString match{QStringLiteral("--match")};
 const QString out_interface{QStringLiteral("--out-interface")};
 const QString protocol{QStringLiteral("--protocol")};
 const QString source{QStringLiteral("--source")};
-const QString list_rules{QStringLiteral("--list-rules")};
-const QString dash_t{QStringLiteral("-t")}; // Use short option for specifying table to avoid var conflicts
+const QString noflush{QStringLiteral("--noflush")};
 const QString wait{QStringLiteral("--wait")};
 
 //   protocol constants
@@ -68,6 +74,7 @@ const QString to_ports{QStringLiteral("--to-ports")};
 const QString port_53{QStringLiteral("53")};
 const QString port_67{QStringLiteral("67")};
 const QString port_68{QStringLiteral("68")};
+const QString port_package_cache{QString::number(mp::package_cache_port)};
 const QString port_range{QStringLiteral("1024-65535")};
 
 //   rule target constants
@@ -85,144 +92,161 @@ auto multipass_iptables_comment(const QString& bridge_name)
     return QString("generated for Multipass network %1").arg(bridge_name);
 }
 
-void add_iptables_rule(const QString& table, const QString& chain, const QStringList& rule, bool append = false)
+// Rules in iptables-restore syntax, grouped by the table they go in, so that they are all applied in one go
+using RuleBatch = QMap<QString, QStringList>;
+
+QString quoted(const QString& word)
 {
-    auto process = MP_PROCFACTORY.create_process(
-        iptables, QStringList() << wait << dash_t << table << (append ? append_rule : insert_rule) << chain << rule);
+    return word.contains(' ') ? QString{"\"%1\""}.arg(word) : word;
+}
 
-    auto exit_state = process->execute();
+void add_iptables_rule(RuleBatch& batch, const QString& table, const QString& chain, const QStringList& rule,
+                       bool append = false)
+{
+    QStringList words{append ? append_rule : insert_rule, chain};
+    std::transform(rule.cbegin(), rule.cend(), std::back_inserter(words), quoted);
 
-    if (!exit_state.completed_successfully())
-        throw std::runtime_error(
-            fmt::format("Failed to set iptables rule for table {}: {}", table, process->read_all_standard_error()));
+    batch[table] << words.join(' ');
 }
 
-void delete_iptables_rule(const QString& table, const QStringList& chain_and_rule)
+void apply_iptables_rules(const RuleBatch& batch)
 {
-    auto args = QStringList() << iptables << wait << dash_t << table << delete_rule << chain_and_rule;
+    if (batch.isEmpty())
+        return;
+
+    QTemporaryFile rules_file;
+    if (!rules_file.open())
+        throw std::runtime_error(fmt::format("Failed to write iptables rules: {}", rules_file.errorString()));
+
+    for (auto it = batch.cbegin(); it != batch.cend(); ++it)
+        rules_file.write(QString("*%1\n%2\nCOMMIT\n").arg(it.key(), it.value().join('\n')).toUtf8());
+    rules_file.close();
 
+    // Without flushing, the rules are added to and deleted from what is there, all together or not at all
     auto process =
-        MP_PROCFACTORY.create_process(QStringLiteral("sh"), QStringList() << QStringLiteral("-c") << args.join(" "));
+        MP_PROCFACTORY.create_process(iptables_restore, QStringList() << wait << noflush << rules_file.fileName());
 
     auto exit_state = process->execute();
 
     if (!exit_state.completed_successfully())
-        throw std::runtime_error(
-            fmt::format("Failed to delete iptables rule for table {}: {}", table, process->read_all_standard_error()));
+        throw std::runtime_error(fmt::format("Failed to apply iptables rules: {}", process->read_all_standard_error()));
 }
 
-auto get_iptables_rules(const QString& table)
+auto get_iptables_rules()
 {
-    auto process = MP_PROCFACTORY.create_process(iptables, QStringList() << wait << dash_t << table << list_rules);
+    auto process = MP_PROCFACTORY.create_process(iptables_save, QStringList());
 
     auto exit_state = process->execute();
 
     if (!exit_state.completed_successfully())
-        throw std::runtime_error(
-            fmt::format("Failed to get iptables list for table {}: {}", table, process->read_all_standard_error()));
+        throw std::runtime_error(fmt::format("Failed to get iptables rules: {}", process->read_all_standard_error()));
 
     return process->read_all_standard_output();
 }
 
-void set_iptables_rules(const QString& bridge_name, const QString& cidr, const QString& comment)
+void set_iptables_rules(RuleBatch& batch, const QString& bridge_name, const QString& cidr, const QString& comment)
 {
     const QStringList comment_option{match, QStringLiteral("comment"), QStringLiteral("--comment"), comment};
 
     // Setup basic iptables overrides for DHCP/DNS
-    add_iptables_rule(filter, INPUT,
+    add_iptables_rule(batch, filter, INPUT,
                       QStringList() << in_interface << bridge_name << protocol << udp << dport << port_67 << jump
                                     << ACCEPT << comment_option);
 
-    add_iptables_rule(filter, INPUT,
+    add_iptables_rule(batch, filter, INPUT,
                       QStringList() << in_interface << bridge_name << protocol << udp << dport << port_53 << jump
                                     << ACCEPT << comment_option);
 
-    add_iptables_rule(filter, INPUT,
+    add_iptables_rule(batch, filter, INPUT,
                       QStringList() << in_interface << bridge_name << protocol << tcp << dport << port_53 << jump
                                     << ACCEPT << comment_option);
 
-    add_iptables_rule(filter, OUTPUT,
+    // Let instances reach the package cache, when the daemon runs one
+    add_iptables_rule(batch, filter, INPUT,
+                      QStringList() << in_interface << bridge_name << protocol << tcp << dport << port_package_cache
+                                    << jump << ACCEPT << comment_option);
+
+    add_iptables_rule(batch, filter, OUTPUT,
                       QStringList() << out_interface << bridge_name << protocol << udp << sport << port_67 << jump
                                     << ACCEPT << comment_option);
 
-    add_iptables_rule(filter, OUTPUT,
+    add_iptables_rule(batch, filter, OUTPUT,
                       QStringList() << out_interface << bridge_name << protocol << udp << sport << port_53 << jump
                                     << ACCEPT << comment_option);
 
-    add_iptables_rule(filter, OUTPUT,
+    add_iptables_rule(batch, filter, OUTPUT,
                       QStringList() << out_interface << bridge_name << protocol << tcp << sport << port_53 << jump
                                     << ACCEPT << comment_option);
 
-    add_iptables_rule(mangle, POSTROUTING,
+    add_iptables_rule(batch, mangle, POSTROUTING,
                       QStringList() << out_interface << bridge_name << protocol << udp << dport << port_68 << jump
                                     << QStringLiteral("CHECKSUM") << QStringLiteral("--checksum-fill")
                                     << comment_option);
 
     // Do not masquerade to these reserved address blocks.
-    add_iptables_rule(nat, POSTROUTING,
+    add_iptables_rule(batch, nat, POSTROUTING,
                       QStringList() << source << cidr << destination << QStringLiteral("224.0.0.0/24") << jump << RETURN
                                     << comment_option);
 
-    add_iptables_rule(nat, POSTROUTING,
+    add_iptables_rule(batch, nat, POSTROUTING,
                       QStringList() << source << cidr << destination << QStringLiteral("255.255.255.255/32") << jump
                                     << RETURN << comment_option);
 
     // Masquerade all packets going from VMs to the LAN/Internet
-    add_iptables_rule(nat, POSTROUTING,
+    add_iptables_rule(batch, nat, POSTROUTING,
                       QStringList() << source << cidr << negate << destination << cidr << protocol << tcp << jump
                                     << MASQUERADE << to_ports << port_range << comment_option);
 
-    add_iptables_rule(nat, POSTROUTING,
+    add_iptables_rule(batch, nat, POSTROUTING,
                       QStringList() << source << cidr << negate << destination << cidr << protocol << udp << jump
                                     << MASQUERADE << to_ports << port_range << comment_option);
 
-    add_iptables_rule(nat, POSTROUTING,
+    add_iptables_rule(batch, nat, POSTROUTING,
                       QStringList() << source << cidr << negate << destination << cidr << jump << MASQUERADE
                                     << comment_option);
 
     // Allow established traffic to the private subnet
-    add_iptables_rule(filter, FORWARD,
+    add_iptables_rule(batch, filter, FORWARD,
                       QStringList() << destination << cidr << out_interface << bridge_name << match
                                     << QStringLiteral("conntrack") << QStringLiteral("--ctstate")
                                     << QStringLiteral("RELATED,ESTABLISHED") << jump << ACCEPT << comment_option);
 
     // Allow outbound traffic from the private subnet
-    add_iptables_rule(filter, FORWARD,
+    add_iptables_rule(batch, filter, FORWARD,
                       QStringList() << source << cidr << in_interface << bridge_name << jump << ACCEPT
                                     << comment_option);
 
     // Allow traffic between virtual machines
-    add_iptables_rule(filter, FORWARD,
+    add_iptables_rule(batch, filter, FORWARD,
                       QStringList() << in_interface << bridge_name << out_interface << bridge_name << jump << ACCEPT
                                     << comment_option);
 
     // Reject everything else
-    add_iptables_rule(filter, FORWARD,
+    add_iptables_rule(batch, filter, FORWARD,
                       QStringList() << in_interface << bridge_name << jump << REJECT << reject_with
                                     << icmp_port_unreachable << comment_option,
                       /*append=*/true);
 
-    add_iptables_rule(filter, FORWARD,
+    add_iptables_rule(batch, filter, FORWARD,
                       QStringList() << out_interface << bridge_name << jump << REJECT << reject_with
                                     << icmp_port_unreachable << comment_option,
                       /*append=*/true);
 }
 
-void clear_iptables_rules_for(const QString& table, const QString& bridge_name, const QString& cidr,
-                              const QString& comment)
+void clear_iptables_rules(RuleBatch& batch, const QString& bridge_name, const QString& cidr, const QString& comment)
 {
-    auto rules = QString::fromUtf8(get_iptables_rules(table));
+    // iptables-save lists each table after a "*<table>" line, with its rules as they would be appended
+    const auto rules = QString::fromUtf8(get_iptables_rules());
+    const QStringList tables{filter, nat, mangle};
+    QString table;
 
-    for (auto& rule : rules.split('\n'))
+    for (const auto& rule : rules.split('\n'))
     {
-        if (rule.contains(comment) || rule.contains(bridge_name) || rule.contains(cidr))
-        {
-            // Remove the policy type since delete doesn't use that
-            rule.remove(0, 3);
-
-            // Pass the chain and rule wholesale since we capture the whole line
-            delete_iptables_rule(table, QStringList() << rule);
-        }
+        if (rule.startsWith('*'))
+            table = rule.mid(1).trimmed();
+        else if (rule.startsWith(QStringLiteral("-A ")) && tables.contains(table) &&
+                 (rule.contains(comment) || rule.contains(bridge_name) || rule.contains(cidr)))
+            batch[table] << QStringLiteral("-D") + rule.mid(2); // The rule wholesale, but deleted
     }
 }
 } // namespace
@@ -234,8 +258,10 @@ mp::IPTablesConfig::IPTablesConfig(const QString& bridge_name, const std::string
 {
     try
     {
-        clear_all_iptables_rules();
-        set_iptables_rules(bridge_name, cidr, comment);
+        RuleBatch batch;
+        clear_iptables_rules(batch, bridge_name, cidr, comment);
+        set_iptables_rules(batch, bridge_name, cidr, comment);
+        apply_iptables_rules(batch);
     }
     catch (const std::exception& e)
     {
@@ -267,7 +293,7 @@ void mp::IPTablesConfig::verify_iptables_rules()
 
 void mp::IPTablesConfig::clear_all_iptables_rules()
 {
-    clear_iptables_rules_for(filter, bridge_name, cidr, comment);
-    clear_iptables_rules_for(nat, bridge_name, cidr, comment);
-    clear_iptables_rules_for(mangle, bridge_name, cidr, comment);
+    RuleBatch batch;
+    clear_iptables_rules(batch, bridge_name, cidr, comment);
+    apply_iptables_rules(batch);
 }
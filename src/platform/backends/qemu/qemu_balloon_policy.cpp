@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "qemu_balloon_policy.h"
+
+#include <QFile>
+#include <QRegularExpression>
+
+#include <algorithm>
+
+namespace mp = multipass;
+
+namespace
+{
+constexpr auto high_pressure = 10.0;
+constexpr auto low_pressure = 1.0;
+constexpr auto min_headroom = 256ll << 20;
+constexpr auto min_target = 512ll << 20;
+} // namespace
+
+mp::optional<double> mp::balloon::host_memory_pressure(const QString& psi_path)
+{
+    QFile psi{psi_path};
+    if (!psi.open(QIODevice::ReadOnly))
+        return nullopt;
+
+    // "some avg10=0.00 avg60=0.00 avg300=0.00 total=0", then a "full" line alike
+    const auto match = QRegularExpression{"^some avg10=([\\d.]+)"}.match(QString::fromLatin1(psi.readLine()));
+    if (!match.hasMatch())
+        return nullopt;
+
+    return match.captured(1).toDouble();
+}
+
+long long mp::balloon::target_for(long long full_size, optional<long long> guest_used, optional<double> host_pressure,
+                                  long long current_target)
+{
+    if (!host_pressure || *host_pressure < low_pressure)
+        return full_size;
+
+    if (*host_pressure < high_pressure || !guest_used)
+        return current_target;
+
+    const auto wanted = *guest_used + std::max(*guest_used / 4, min_headroom);
+    return std::min(full_size, std::max({wanted, min_target, std::min(current_target, full_size) / 2}));
+}
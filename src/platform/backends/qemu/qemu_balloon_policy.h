@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_QEMU_BALLOON_POLICY_H
+#define MULTIPASS_QEMU_BALLOON_POLICY_H
+
+#include <multipass/optional.h>
+
+#include <QString>
+
+namespace multipass
+{
+namespace balloon
+{
+// The share of time some host tasks stalled on memory over the last 10s, in percent, from Linux's pressure stall
+// information. Gives nothing on kernels without it.
+optional<double> host_memory_pressure(const QString& psi_path = "/proc/pressure/memory");
+
+// How much memory to leave an instance with. Under pressure, instances are squeezed down to what their guest reports
+// using plus headroom, by no more than half at a time; once the pressure is gone, they get all of it back. In between,
+// the current target holds.
+long long target_for(long long full_size, optional<long long> guest_used, optional<double> host_pressure,
+                     long long current_target);
+} // namespace balloon
+} // namespace multipass
+#endif // MULTIPASS_QEMU_BALLOON_POLICY_H
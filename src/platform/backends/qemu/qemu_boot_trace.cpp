@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "qemu_boot_trace.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QTextStream>
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace mp = multipass;
+
+namespace
+{
+constexpr auto window_size = 1ll << 30; // how much of the image to look at in one mapping
+
+class FileDescriptor
+{
+public:
+    explicit FileDescriptor(const QString& path) : fd{::open(QFile::encodeName(path).constData(), O_RDONLY)}
+    {
+    }
+
+    ~FileDescriptor()
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    operator int() const
+    {
+        return fd;
+    }
+
+private:
+    const int fd;
+};
+
+void add_range(std::vector<mp::boot_trace::Range>& ranges, long long offset, long long length, long long max_gap)
+{
+    if (!ranges.empty() && offset - (ranges.back().offset + ranges.back().length) <= max_gap)
+        ranges.back().length = offset + length - ranges.back().offset;
+    else
+        ranges.push_back({offset, length});
+}
+} // namespace
+
+QString mp::boot_trace::trace_path_for(const QString& image_path)
+{
+    return image_path + ".boot-trace";
+}
+
+void mp::boot_trace::start_recording(const QString& image_path)
+{
+    FileDescriptor fd{image_path};
+    if (fd < 0)
+        return;
+
+    // Pages still to be written back stay cached, so they go out first
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+std::vector<mp::boot_trace::Range> mp::boot_trace::cached_ranges(const QString& image_path, long long max_gap)
+{
+    std::vector<Range> ranges;
+
+    FileDescriptor fd{image_path};
+    const auto size = fd < 0 ? 0ll : static_cast<long long>(::lseek(fd, 0, SEEK_END));
+    const auto page_size = static_cast<long long>(::sysconf(_SC_PAGESIZE));
+
+    std::vector<unsigned char> residency;
+    for (long long window = 0; window < size; window += window_size)
+    {
+        const auto length = std::min(window_size, size - window);
+        auto mapping = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, window);
+        if (mapping == MAP_FAILED)
+            return {};
+
+        residency.resize((length + page_size - 1) / page_size);
+        const auto ret = ::mincore(mapping, length, residency.data());
+        ::munmap(mapping, length);
+        if (ret != 0)
+            return {};
+
+        for (long long page = 0; page < static_cast<long long>(residency.size()); ++page)
+        {
+            const auto offset = window + page * page_size;
+            if (residency[page] & 1)
+                add_range(ranges, offset, std::min(page_size, size - offset), max_gap);
+        }
+    }
+
+    return ranges;
+}
+
+bool mp::boot_trace::save(const QString& image_path)
+{
+    const auto ranges = cached_ranges(image_path);
+    if (ranges.empty())
+        return false;
+
+    QSaveFile file{trace_path_for(image_path)};
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QTextStream out{&file};
+    for (const auto& range : ranges)
+        out << range.offset << ' ' << range.length << '\n';
+    out.flush();
+
+    return file.commit();
+}
+
+void mp::boot_trace::discard(const QString& image_path)
+{
+    QFile::remove(trace_path_for(image_path));
+}
+
+std::vector<mp::boot_trace::Range> mp::boot_trace::load(const QString& trace_path)
+{
+    QFile file{trace_path};
+    if (!file.open(QIODevice::ReadOnly))
+        return {};
+
+    // "<offset> <length>" per line, in increasing order of offset
+    std::vector<Range> ranges;
+    while (!file.atEnd())
+    {
+        const auto fields = file.readLine().simplified().split(' ');
+        auto offset_ok = false, length_ok = false;
+        const auto offset = fields.value(0).toLongLong(&offset_ok);
+        const auto length = fields.value(1).toLongLong(&length_ok);
+        if (fields.size() != 2 || !offset_ok || !length_ok || offset < 0 || length <= 0)
+            return {};
+
+        ranges.push_back({offset, length});
+    }
+
+    return ranges;
+}
+
+long long mp::boot_trace::prefetch(const QString& image_path)
+{
+    const auto ranges = load(trace_path_for(image_path));
+    FileDescriptor fd{image_path};
+    if (ranges.empty() || fd < 0)
+        return 0;
+
+    // Kicks off the reads without waiting for them, so qemu starts right away and finds them done or under way
+    long long requested = 0;
+    for (const auto& range : ranges)
+        if (::posix_fadvise(fd, range.offset, range.length, POSIX_FADV_WILLNEED) == 0)
+            requested += range.length;
+
+    return requested;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_QEMU_BOOT_TRACE_H
+#define MULTIPASS_QEMU_BOOT_TRACE_H
+
+#include <QString>
+
+#include <vector>
+
+namespace multipass
+{
+namespace boot_trace
+{
+// Cold boots read the same scattered parts of an image every time. A boot that starts with the image out of the host's
+// page cache leaves exactly what it read in there, which is kept as the image's trace for the boots that follow to
+// read ahead, in one sweep over the disk rather than seek by seek.
+//
+// Only the instance's own image is traced. Reads that an overlay passes on to its backing file, be it shared with other
+// instances or remote, are neither recorded nor read ahead, so instances on overlays gain little.
+struct Range
+{
+    long long offset;
+    long long length;
+
+    bool operator==(const Range& other) const
+    {
+        return offset == other.offset && length == other.length;
+    }
+};
+
+// Where the trace of an image is kept, next to it
+QString trace_path_for(const QString& image_path);
+
+// Drops the image from the host's page cache, for the boot that follows to be traced
+void start_recording(const QString& image_path);
+
+// The parts of the image in the host's page cache, merged across gaps of up to max_gap bytes
+std::vector<Range> cached_ranges(const QString& image_path, long long max_gap = 256 << 10);
+
+// Keeps what is cached of the image as its trace, returning whether there was anything to keep
+bool save(const QString& image_path);
+
+// Forgets the trace, for when the image was rewritten
+void discard(const QString& image_path);
+
+std::vector<Range> load(const QString& trace_path);
+
+// Has the host read ahead what the image's trace covers, returning how many bytes it was asked for
+long long prefetch(const QString& image_path);
+} // namespace boot_trace
+} // namespace multipass
+#endif // MULTIPASS_QEMU_BOOT_TRACE_H
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "qemu_guest_agent.h"
+
+#include <multipass/format.h>
+
+#include <QJsonArray>
+#include <QJsonDocument>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace mp = multipass;
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+// A plain unix socket, so that whichever thread runs the next command can use it without an event loop
+class SocketChannel : public mp::QemuGuestAgent::Channel
+{
+public:
+    explicit SocketChannel(const QString& socket_path) : fd{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)}
+    {
+        if (fd < 0)
+            throw std::runtime_error(fmt::format("cannot create socket: {}", std::strerror(errno)));
+
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        const auto path = socket_path.toStdString();
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            ::close(fd);
+            throw std::runtime_error(fmt::format("socket path too long: {}", path));
+        }
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+        {
+            const auto error = errno;
+            ::close(fd);
+            throw std::runtime_error(fmt::format("cannot connect to {}: {}", path, std::strerror(error)));
+        }
+    }
+
+    ~SocketChannel() override
+    {
+        ::close(fd);
+    }
+
+    void write(const QByteArray& data) override
+    {
+        auto written = 0;
+        while (written < data.size())
+        {
+            const auto sent = ::send(fd, data.constData() + written, data.size() - written, MSG_NOSIGNAL);
+            if (sent < 0 && errno != EINTR)
+                throw std::runtime_error(fmt::format("cannot write to guest agent: {}", std::strerror(errno)));
+            if (sent > 0)
+                written += sent;
+        }
+    }
+
+    QByteArray read_line(std::chrono::milliseconds timeout) override
+    {
+        const auto deadline = Clock::now() + timeout;
+        int newline;
+        while ((newline = buffer.indexOf('\n')) == -1)
+        {
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+            if (left.count() <= 0)
+                return {};
+
+            pollfd poll_fd{fd, POLLIN, 0};
+            const auto ready = ::poll(&poll_fd, 1, static_cast<int>(left.count()));
+            if (ready < 0 && errno != EINTR)
+                throw std::runtime_error(fmt::format("cannot read from guest agent: {}", std::strerror(errno)));
+            if (ready <= 0)
+                continue;
+
+            char data[4096];
+            const auto received = ::recv(fd, data, sizeof(data), 0);
+            if (received == 0)
+                throw std::runtime_error("guest agent channel closed");
+            if (received < 0 && errno != EINTR)
+                throw std::runtime_error(fmt::format("cannot read from guest agent: {}", std::strerror(errno)));
+            if (received > 0)
+                buffer.append(data, static_cast<int>(received));
+        }
+
+        const auto line = buffer.left(newline);
+        buffer.remove(0, newline + 1);
+        return line;
+    }
+
+private:
+    const int fd;
+    QByteArray buffer;
+};
+
+std::chrono::milliseconds time_left(Clock::time_point deadline)
+{
+    return std::max(std::chrono::milliseconds::zero(),
+                    std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()));
+}
+} // namespace
+
+mp::QemuGuestAgent::Connector mp::QemuGuestAgent::socket_connector(const QString& socket_path)
+{
+    return [socket_path] { return std::make_unique<SocketChannel>(socket_path); };
+}
+
+mp::QemuGuestAgent::QemuGuestAgent(Connector connector, std::chrono::milliseconds sync_timeout,
+                                   std::chrono::milliseconds poll_interval)
+    : connector{std::move(connector)},
+      sync_timeout{sync_timeout},
+      poll_interval{poll_interval},
+      // Starting from the clock keeps ids from one daemon's run apart from the next one's
+      next_sync_id{Clock::now().time_since_epoch().count() & 0x7fffffff}
+{
+}
+
+mp::QemuGuestAgent::Result mp::QemuGuestAgent::run(const std::string& command, std::chrono::milliseconds timeout)
+{
+    const auto deadline = Clock::now() + timeout;
+
+    const auto args = QJsonArray{"-c", QString::fromStdString(command)};
+    const auto pid =
+        exchange("guest-exec", {{"path", "/bin/sh"}, {"arg", args}, {"capture-output", true}}, deadline)["pid"];
+
+    while (true)
+    {
+        const auto status = exchange("guest-exec-status", {{"pid", pid}}, deadline);
+        if (status["exited"].toBool())
+            return {status["exitcode"].toInt(),
+                    QByteArray::fromBase64(status["out-data"].toString().toLatin1()).toStdString()};
+
+        if (time_left(deadline) < poll_interval)
+            throw std::runtime_error(fmt::format("timed out waiting for \"{}\" in the guest", command));
+        std::this_thread::sleep_for(poll_interval);
+    }
+}
+
+QJsonObject mp::QemuGuestAgent::exchange(const QString& command, const QJsonObject& arguments,
+                                         Clock::time_point deadline)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+
+    try
+    {
+        if (!channel)
+        {
+            channel = connector();
+            synchronize(std::min(deadline, Clock::now() + sync_timeout));
+        }
+
+        return request(command, arguments, deadline);
+    }
+    catch (const std::exception&)
+    {
+        // Start over on a fresh connection, in case qemu or the agent went away
+        channel.reset();
+        throw;
+    }
+}
+
+void mp::QemuGuestAgent::synchronize(Clock::time_point deadline)
+{
+    const auto id = next_sync_id++;
+    channel->write(QJsonDocument(QJsonObject{{"execute", "guest-sync"}, {"arguments", QJsonObject{{"id", id}}}})
+                       .toJson(QJsonDocument::Compact) +
+                   '\n');
+
+    // Whatever came before the matching reply belongs to an earlier, abandoned request
+    while (true)
+    {
+        const auto message = read_message(deadline);
+        if (message["return"].toVariant().toLongLong() == id)
+            return;
+    }
+}
+
+QJsonObject mp::QemuGuestAgent::request(const QString& command, const QJsonObject& arguments,
+                                        Clock::time_point deadline)
+{
+    channel->write(QJsonDocument(QJsonObject{{"execute", command}, {"arguments", arguments}})
+                       .toJson(QJsonDocument::Compact) +
+                   '\n');
+
+    const auto message = read_message(deadline);
+    if (message.contains("error"))
+    {
+        const auto error = message["error"].toObject();
+        throw std::runtime_error(fmt::format("{}: {}", error["class"].toString(), error["desc"].toString()));
+    }
+
+    return message["return"].toObject();
+}
+
+QJsonObject mp::QemuGuestAgent::read_message(Clock::time_point deadline)
+{
+    while (true)
+    {
+        const auto line = channel->read_line(time_left(deadline));
+        if (line.isEmpty())
+            throw std::runtime_error("guest agent did not answer in time");
+
+        const auto message = QJsonDocument::fromJson(line.trimmed());
+        if (message.isObject())
+            return message.object();
+    }
+}
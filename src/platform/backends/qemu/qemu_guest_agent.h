@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_QEMU_GUEST_AGENT_H
+#define MULTIPASS_QEMU_GUEST_AGENT_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace multipass
+{
+// Runs commands through qemu-guest-agent in the instance, which answers over a virtio-serial port rather than the
+// network. Commands take turns on the channel a request at a time, so a long one does not hold up the others while
+// it runs. Each connection starts by synchronizing, so that a reply left over from an abandoned request cannot be
+// mistaken for the next one's.
+class QemuGuestAgent
+{
+public:
+    class Channel
+    {
+    public:
+        virtual ~Channel() = default;
+        virtual void write(const QByteArray& data) = 0;
+        // Returns an empty array when no whole line arrived in time
+        virtual QByteArray read_line(std::chrono::milliseconds timeout) = 0;
+    };
+
+    struct Result
+    {
+        int exit_code;
+        std::string output;
+    };
+
+    // Throws std::runtime_error when the channel cannot be opened, which is when no agent is listening on it
+    using Connector = std::function<std::unique_ptr<Channel>()>;
+    static Connector socket_connector(const QString& socket_path);
+
+    explicit QemuGuestAgent(Connector connector,
+                            std::chrono::milliseconds sync_timeout = std::chrono::seconds{1},
+                            std::chrono::milliseconds poll_interval = std::chrono::milliseconds{50});
+
+    // Runs the command with /bin/sh, throwing std::runtime_error when the agent does not answer or the command
+    // does not finish within the timeout
+    Result run(const std::string& command, std::chrono::milliseconds timeout);
+
+private:
+    // Sends one request under the lock, connecting first when there is no channel yet
+    QJsonObject exchange(const QString& command, const QJsonObject& arguments,
+                         std::chrono::steady_clock::time_point deadline);
+    QJsonObject request(const QString& command, const QJsonObject& arguments,
+                        std::chrono::steady_clock::time_point deadline);
+    void synchronize(std::chrono::steady_clock::time_point deadline);
+    QJsonObject read_message(std::chrono::steady_clock::time_point deadline);
+
+    const Connector connector;
+    const std::chrono::milliseconds sync_timeout;
+    const std::chrono::milliseconds poll_interval;
+    std::mutex mutex;
+    std::unique_ptr<Channel> channel;
+    qint64 next_sync_id;
+};
+} // namespace multipass
+#endif // MULTIPASS_QEMU_GUEST_AGENT_H
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "qemu_memory_merging.h"
+
+#include <multipass/format.h>
+#include <multipass/instrumentation.h>
+#include <multipass/logging/log.h>
+
+#include <QFile>
+
+#include <algorithm>
+
+#include <unistd.h>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+
+namespace
+{
+constexpr auto category = "ksm";
+constexpr auto saved_bytes_metric = "multipass_ksm_saved_bytes";
+constexpr auto shared_bytes_metric = "multipass_ksm_shared_bytes";
+
+// Idle hosts merge at a trickle; from low to high pressure, the scan speeds up in proportion
+constexpr auto low_pressure = 1.0;
+constexpr auto high_pressure = 10.0;
+constexpr mp::QemuMemoryMerging::ScanRate idle_rate{100, 200};
+constexpr mp::QemuMemoryMerging::ScanRate busy_rate{4000, 20};
+
+QByteArray read_from(const QString& path)
+{
+    QFile file{path};
+    return file.open(QIODevice::ReadOnly) ? file.readAll().trimmed() : QByteArray{};
+}
+} // namespace
+
+mp::QemuMemoryMerging::QemuMemoryMerging(const QString& sysfs_ksm_dir) : ksm_dir{sysfs_ksm_dir}
+{
+}
+
+mp::QemuMemoryMerging::~QemuMemoryMerging()
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    if (previous)
+        restore(*previous);
+}
+
+void mp::QemuMemoryMerging::enrol(const std::string& vm_name)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    if (!instances.insert(vm_name).second || instances.size() > 1)
+        return;
+
+    Settings settings{read_from(ksm_dir + "/run"), read_from(ksm_dir + "/pages_to_scan"),
+                      read_from(ksm_dir + "/sleep_millisecs")};
+    if (settings.run.isEmpty())
+    {
+        mpl::log(mpl::Level::warning, category, "The host has no samepage merging, instance memory is left unmerged");
+        return;
+    }
+    previous = settings;
+
+    const auto rate = scan_rate_for(nullopt);
+    write("pages_to_scan", QByteArray::number(rate.pages_to_scan));
+    write("sleep_millisecs", QByteArray::number(rate.sleep_millisecs));
+    write("run", "1");
+    last_tuned = {};
+}
+
+void mp::QemuMemoryMerging::withdraw(const std::string& vm_name)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    if (!instances.erase(vm_name) || !instances.empty() || !previous)
+        return;
+
+    restore(*previous);
+    previous = nullopt;
+
+    MP_INSTRUMENTATION.set(saved_bytes_metric, {}, 0);
+    MP_INSTRUMENTATION.set(shared_bytes_metric, {}, 0);
+}
+
+void mp::QemuMemoryMerging::tune(optional<double> host_pressure)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    const auto now = std::chrono::steady_clock::now();
+    if (!previous || now - last_tuned < tune_interval)
+        return;
+
+    last_tuned = now;
+    const auto rate = scan_rate_for(host_pressure);
+    write("pages_to_scan", QByteArray::number(rate.pages_to_scan));
+    write("sleep_millisecs", QByteArray::number(rate.sleep_millisecs));
+
+    // Every page sharing a merged one is a page saved
+    const auto page_size = static_cast<quint64>(sysconf(_SC_PAGESIZE));
+    MP_INSTRUMENTATION.set(saved_bytes_metric, {}, read_from(ksm_dir + "/pages_sharing").toULongLong() * page_size);
+    MP_INSTRUMENTATION.set(shared_bytes_metric, {}, read_from(ksm_dir + "/pages_shared").toULongLong() * page_size);
+}
+
+auto mp::QemuMemoryMerging::scan_rate_for(optional<double> host_pressure) -> ScanRate
+{
+    if (!host_pressure || *host_pressure <= low_pressure)
+        return idle_rate;
+
+    const auto share = std::min((*host_pressure - low_pressure) / (high_pressure - low_pressure), 1.0);
+    return {idle_rate.pages_to_scan + static_cast<int>(share * (busy_rate.pages_to_scan - idle_rate.pages_to_scan)),
+            idle_rate.sleep_millisecs - static_cast<int>(share * (idle_rate.sleep_millisecs - busy_rate.sleep_millisecs))};
+}
+
+void mp::QemuMemoryMerging::write(const char* file, const QByteArray& value) const
+{
+    QFile sysfs_file{ksm_dir + '/' + file};
+    if (!sysfs_file.open(QIODevice::WriteOnly) || sysfs_file.write(value) != value.size())
+        mpl::log(mpl::Level::warning, category,
+                 fmt::format("Cannot set {} to {}: {}", file, value.constData(), sysfs_file.errorString()));
+}
+
+void mp::QemuMemoryMerging::restore(const Settings& settings) const
+{
+    // Merged pages stay merged unless KSM is told to unmerge them, which would only bring the memory back
+    write("run", settings.run == "2" ? "0" : settings.run);
+    if (!settings.pages_to_scan.isEmpty())
+        write("pages_to_scan", settings.pages_to_scan);
+    if (!settings.sleep_millisecs.isEmpty())
+        write("sleep_millisecs", settings.sleep_millisecs);
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_QEMU_MEMORY_MERGING_H
+#define MULTIPASS_QEMU_MEMORY_MERGING_H
+
+#include <multipass/optional.h>
+
+#include <QByteArray>
+#include <QString>
+
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+
+namespace multipass
+{
+// Keeps the kernel's samepage merging running while instances offer it their memory, scanning harder as the host
+// runs short of memory, and reports what it saves. Whatever KSM was doing before the first instance came is restored
+// once the last one goes
+class QemuMemoryMerging
+{
+public:
+    struct ScanRate
+    {
+        int pages_to_scan;
+        int sleep_millisecs;
+    };
+
+    explicit QemuMemoryMerging(const QString& sysfs_ksm_dir = "/sys/kernel/mm/ksm");
+    ~QemuMemoryMerging();
+
+    void enrol(const std::string& vm_name);
+    void withdraw(const std::string& vm_name);
+    // Called as often as convenient, it acts at most once per tune_interval
+    void tune(optional<double> host_pressure);
+
+    // From host memory pressure, as the share of time tasks stalled on memory, in percent
+    static ScanRate scan_rate_for(optional<double> host_pressure);
+
+    static constexpr std::chrono::seconds tune_interval{30};
+
+private:
+    // What KSM was set to before the first instance was enrolled
+    struct Settings
+    {
+        QByteArray run;
+        QByteArray pages_to_scan;
+        QByteArray sleep_millisecs;
+    };
+
+    void write(const char* file, const QByteArray& value) const;
+    void restore(const Settings& settings) const;
+
+    const QString ksm_dir;
+    std::mutex mutex;
+    std::set<std::string> instances;
+    optional<Settings> previous;
+    std::chrono::steady_clock::time_point last_tuned;
+};
+} // namespace multipass
+#endif // MULTIPASS_QEMU_MEMORY_MERGING_H
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "qemu_placement.h"
+
+#include <QDir>
+#include <QFile>
+
+#include <algorithm>
+
+#include <sched.h>
+
+namespace mp = multipass;
+
+mp::QemuPlacement::QemuPlacement(const QString& sysfs_node_dir)
+{
+    const QDir nodes{sysfs_node_dir};
+    for (const auto& entry : nodes.entryList({"node*"}, QDir::Dirs))
+    {
+        bool ok;
+        const auto node = entry.mid(4).toInt(&ok);
+        QFile cpu_list{nodes.filePath(entry + "/cpulist")};
+        if (!ok || !cpu_list.open(QIODevice::ReadOnly))
+            continue;
+
+        auto cpus = parse_cpu_list(QString::fromLatin1(cpu_list.readAll()));
+        if (!cpus.empty())
+            node_cpus.emplace(node, std::move(cpus));
+    }
+}
+
+auto mp::QemuPlacement::allocate(const std::string& vm_name, int num_cores) -> optional<Allocation>
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    release_locked(vm_name);
+
+    auto users_of = [this](const std::vector<int>& cpus) {
+        auto users = 0;
+        for (auto cpu : cpus)
+            users += cpu_users[cpu];
+        return static_cast<double>(users) / cpus.size();
+    };
+
+    const std::vector<int>* best_cpus = nullptr;
+    auto best_node = -1;
+    for (const auto& [node, cpus] : node_cpus)
+        if (static_cast<int>(cpus.size()) >= num_cores && (!best_cpus || users_of(cpus) < users_of(*best_cpus)))
+        {
+            best_cpus = &cpus;
+            best_node = node;
+        }
+
+    if (!best_cpus)
+        return nullopt;
+
+    auto cpus = *best_cpus;
+    std::stable_sort(cpus.begin(), cpus.end(), [this](int a, int b) { return cpu_users[a] < cpu_users[b]; });
+    cpus.resize(num_cores);
+    for (auto cpu : cpus)
+        ++cpu_users[cpu];
+
+    return allocations[vm_name] = Allocation{best_node, std::move(cpus)};
+}
+
+void mp::QemuPlacement::release(const std::string& vm_name)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    release_locked(vm_name);
+}
+
+void mp::QemuPlacement::release_locked(const std::string& vm_name)
+{
+    auto it = allocations.find(vm_name);
+    if (it == allocations.end())
+        return;
+
+    for (auto cpu : it->second.cpus)
+        --cpu_users[cpu];
+    allocations.erase(it);
+}
+
+bool mp::QemuPlacement::pin(qint64 thread_id, const std::vector<int>& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus)
+        CPU_SET(cpu, &set);
+
+    return sched_setaffinity(static_cast<pid_t>(thread_id), sizeof(set), &set) == 0;
+}
+
+std::vector<int> mp::QemuPlacement::parse_cpu_list(const QString& cpu_list)
+{
+    std::vector<int> cpus;
+    for (const auto& range : cpu_list.trimmed().split(',', QString::SkipEmptyParts))
+    {
+        const auto bounds = range.split('-');
+        bool first_ok, last_ok;
+        const auto first = bounds.first().toInt(&first_ok);
+        const auto last = bounds.last().toInt(&last_ok);
+        if (!first_ok || !last_ok || bounds.size() > 2)
+            return {};
+
+        for (auto cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
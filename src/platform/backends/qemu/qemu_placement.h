@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_QEMU_PLACEMENT_H
+#define MULTIPASS_QEMU_PLACEMENT_H
+
+#include <multipass/optional.h>
+
+#include <QString>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace multipass
+{
+// Hands out host cores to running instances, keeping each instance within one NUMA node and spreading instances
+// over the cores and nodes that others use the least
+class QemuPlacement
+{
+public:
+    struct Allocation
+    {
+        int node;
+        std::vector<int> cpus; // one per vCPU, in order
+    };
+
+    explicit QemuPlacement(const QString& sysfs_node_dir = "/sys/devices/system/node");
+
+    // Gives nothing when no node has enough cores, leaving the instance to float
+    optional<Allocation> allocate(const std::string& vm_name, int num_cores);
+    void release(const std::string& vm_name);
+
+    // Restricts a thread, or a whole process when given its pid, to the given host cores
+    static bool pin(qint64 thread_id, const std::vector<int>& cpus);
+    // Parses a kernel CPU list like "0-3,8,10-11"
+    static std::vector<int> parse_cpu_list(const QString& cpu_list);
+
+private:
+    void release_locked(const std::string& vm_name);
+
+    std::map<int, std::vector<int>> node_cpus;
+    std::mutex mutex;
+    std::map<std::string, Allocation> allocations;
+    std::map<int, int> cpu_users;
+};
+} // namespace multipass
+#endif // MULTIPASS_QEMU_PLACEMENT_H
@@ -17,15 +17,26 @@
 
 #include "qemu_virtual_machine.h"
 
+#include "detached_qemu_process.h"
 #include "dnsmasq_server.h"
+#include "qemu_balloon_policy.h"
+#include "qemu_boot_trace.h"
+#include "qemu_guest_agent.h"
+#include "qemu_memory_merging.h"
+#include "qemu_placement.h"
 #include "qemu_vm_process_spec.h"
-#include "qemu_vmstate_process_spec.h"
+#include "qmp_client.h"
+#include "virtiofsd_process_spec.h"
 #include <shared/linux/backend_utils.h>
+#include <shared/linux/netlink.h>
 #include <shared/linux/process_factory.h>
 #include <shared/shared_backend_utils.h>
 
+#include <multipass/constants.h>
+#include <multipass/instrumentation.h>
 #include <multipass/logging/log.h>
 #include <multipass/process/process.h>
+#include <multipass/settings.h>
 #include <multipass/ssh/ssh_session.h>
 #include <multipass/utils.h>
 #include <multipass/vm_status_monitor.h>
@@ -33,18 +44,33 @@
 #include <multipass/format.h>
 
 #include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QHash>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QProcess>
+#include <QStandardPaths>
 #include <QString>
 #include <QStringList>
 #include <QSysInfo>
-#include <QTemporaryFile>
+#include <QTimer>
 
+#include <algorithm>
+#include <cerrno>
+#include <mutex>
 #include <thread>
+#include <unordered_map>
+
+#include <linux/vm_sockets.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 namespace mp = multipass;
 namespace mpl = multipass::logging;
@@ -54,6 +80,80 @@ namespace
 constexpr auto suspend_tag = "suspend";
 constexpr auto machine_type_key = "machine_type";
 constexpr auto arguments_key = "arguments";
+constexpr auto balloon_path = "/machine/peripheral/balloon0";
+constexpr auto hotplug_memory_path = "/machine/peripheral/vmem0";
+constexpr auto peripheral_path = "/machine/peripheral/"; // where devices added with an id go, unlike boot vCPUs
+constexpr auto metrics_interval = std::chrono::seconds{5};
+constexpr auto guest_agent_retry_interval = std::chrono::seconds{30};
+constexpr qint64 unlimited_migration_bandwidth = Q_INT64_C(1) << 40; // qemu otherwise caps it at 32MiB/s
+constexpr auto qmp_reply_timeout = std::chrono::seconds{10};
+
+constexpr auto vsock_probe_timeout = std::chrono::milliseconds{100};
+
+// Whether something in the instance accepts connections on the port, connecting only to hang up straight away
+bool vsock_listening(unsigned cid, int port)
+{
+    const auto fd = ::socket(AF_VSOCK, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0)
+        return false;
+
+    sockaddr_vm address{};
+    address.svm_family = AF_VSOCK;
+    address.svm_cid = cid;
+    address.svm_port = static_cast<unsigned>(port);
+
+    auto error = ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ? errno : 0;
+    if (error == EINPROGRESS)
+    {
+        pollfd poll_fd{fd, POLLOUT, 0};
+        socklen_t length = sizeof(error);
+        error = ETIMEDOUT;
+        if (::poll(&poll_fd, 1, static_cast<int>(vsock_probe_timeout.count())) > 0)
+            ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+    }
+
+    ::close(fd);
+    return error == 0;
+}
+
+// The vsock addresses of this daemon's instances. Those derived from different names can still be the same, which
+// vhost-vsock would refuse to boot the second instance with
+std::mutex vsock_cids_mutex;
+std::unordered_map<unsigned, std::string> vsock_cids;
+
+unsigned claim_vsock_cid(const std::string& vm_name)
+{
+    std::lock_guard<decltype(vsock_cids_mutex)> lock{vsock_cids_mutex};
+    for (auto attempt = 0u;; ++attempt)
+    {
+        const auto [it, claimed] = vsock_cids.emplace(mp::QemuVMProcessSpec::guest_cid(vm_name, attempt), vm_name);
+        if (claimed || it->second == vm_name)
+            return it->first;
+    }
+}
+
+void release_vsock_cid(unsigned cid, const std::string& vm_name)
+{
+    std::lock_guard<decltype(vsock_cids_mutex)> lock{vsock_cids_mutex};
+    if (auto it = vsock_cids.find(cid); it != vsock_cids.end() && it->second == vm_name)
+        vsock_cids.erase(it);
+}
+
+// The CID the instance was booted with, which a resumed instance keeps from its saved arguments
+mp::optional<unsigned> vsock_cid_in(const QStringList& arguments)
+{
+    for (const auto& arg : arguments)
+    {
+        if (!arg.startsWith("vhost-vsock-pci,"))
+            continue;
+
+        for (const auto& option : arg.split(','))
+            if (option.startsWith("guest-cid="))
+                return option.mid(QString{"guest-cid="}.size()).toUInt();
+    }
+
+    return mp::nullopt;
+}
 
 bool use_cdrom_set(const QJsonObject& metadata)
 {
@@ -85,7 +185,11 @@ QStringList get_arguments(const QJsonObject& metadata)
 }
 
 auto make_qemu_process(const mp::VirtualMachineDescription& desc, const mp::optional<QJsonObject>& resume_metadata,
-                       const std::string& tap_device_name)
+                       const std::string& tap_device_name,
+                       const std::vector<mp::QemuVMProcessSpec::SharedDirectory>& shared_directories,
+                       const mp::QemuVMProcessSpec::HostFeatures& host_features,
+                       const mp::QemuVMProcessSpec::Placement& placement, const QString& guest_agent_socket,
+                       const mp::optional<mp::QemuVMProcessSpec::Detachment>& detachment, bool fast_boot)
 {
     if (!QFile::exists(desc.image.image_path) || !QFile::exists(desc.cloud_init_iso))
     {
@@ -96,13 +200,18 @@ auto make_qemu_process(const mp::VirtualMachineDescription& desc, const mp::opti
     if (resume_metadata)
     {
         const auto& data = resume_metadata.value();
-        resume_data = mp::QemuVMProcessSpec::ResumeData{suspend_tag, get_vm_machine(data), use_cdrom_set(data),
-                                                        get_arguments(data)};
+        resume_data = mp::QemuVMProcessSpec::ResumeData{
+            suspend_tag, get_vm_machine(data), use_cdrom_set(data), get_arguments(data),
+            QFile::exists(mp::QemuVMProcessSpec::memory_state_file(desc.image.image_path))};
     }
 
-    auto process_spec =
-        std::make_unique<mp::QemuVMProcessSpec>(desc, QString::fromStdString(tap_device_name), resume_data);
-    auto process = MP_PROCFACTORY.create_process(std::move(process_spec));
+    auto process_spec = std::make_unique<mp::QemuVMProcessSpec>(desc, QString::fromStdString(tap_device_name),
+                                                                resume_data, shared_directories, host_features,
+                                                                placement, guest_agent_socket, detachment, fast_boot);
+    mp::Process::UPtr process = MP_PROCFACTORY.create_process(std::move(process_spec));
+    if (detachment)
+        process = std::make_unique<mp::DetachedQemuProcess>(std::move(process), detachment->pid_file,
+                                                            detachment->monitor_socket);
 
     mpl::log(mpl::Level::debug, desc.vm_name, fmt::format("process working dir '{}'", process->working_directory()));
     mpl::log(mpl::Level::info, desc.vm_name, fmt::format("process program '{}'", process->program()));
@@ -110,35 +219,163 @@ auto make_qemu_process(const mp::VirtualMachineDescription& desc, const mp::opti
     return process;
 }
 
-void remove_tap_device(const QString& tap_device_name)
+QString find_virtiofsd()
+{
+    // Distributions ship it outside of $PATH, since it is only meant to be run by hypervisors
+    auto virtiofsd = QStandardPaths::findExecutable("virtiofsd", {"/usr/libexec", "/usr/lib/qemu"});
+    return virtiofsd.isEmpty() ? QStandardPaths::findExecutable("virtiofsd") : virtiofsd;
+}
+
+// Sockets for qemu and its helpers go next to the instance's image, out of other users' reach, or in the daemon's
+// private runtime directory when that path is too long for a socket address
+QString socket_path_for(const mp::VirtualMachineDescription& desc, const QString& file_name)
 {
-    if (mp::utils::run_cmd_for_status("ip", {"addr", "show", tap_device_name}))
+    const auto path = QFileInfo{desc.image.image_path}.absoluteDir().filePath(file_name);
+    if (static_cast<size_t>(QFile::encodeName(path).size()) < sizeof(sockaddr_un::sun_path))
+        return path;
+
+    return QDir{QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation)}.filePath(
+        QString("%1-%2").arg(QString::fromStdString(desc.vm_name), file_name));
+}
+
+// virtiofsd only creates its socket once it is ready to serve, and qemu fails to start without it
+bool wait_for_socket(const QString& socket_path, mp::Process& virtiofsd)
+{
+    using namespace std::chrono_literals;
+    for (auto waited = 0ms; waited < 5s; waited += 50ms)
     {
-        mp::utils::run_cmd_for_status("ip", {"link", "delete", tap_device_name});
+        if (QFile::exists(socket_path))
+            return true;
+        if (!virtiofsd.running())
+            return false;
+
+        std::this_thread::sleep_for(50ms);
     }
+
+    return false;
+}
+
+// Of instances that went down along with the daemon, for the factory to remove all at once
+std::mutex released_taps_mutex;
+QStringList released_taps;
+
+// User and system time of the process, from /proc/<pid>/stat
+mp::optional<long long> cpu_time_ms_of(qint64 pid)
+{
+    QFile stat{QString("/proc/%1/stat").arg(pid)};
+    if (!stat.open(QIODevice::ReadOnly))
+        return mp::nullopt;
+
+    // The command name may hold anything, spaces and parentheses included, so fields are counted from its end
+    const auto contents = stat.readAll();
+    const auto fields = contents.mid(contents.lastIndexOf(')') + 2).split(' ');
+    if (fields.size() < 13)
+        return mp::nullopt;
+
+    static const auto ticks_per_second = sysconf(_SC_CLK_TCK);
+    const auto ticks = fields[11].toLongLong() + fields[12].toLongLong(); // utime and stime, fields 14 and 15
+    return ticks * 1000 / ticks_per_second;
+}
+
+// What the file takes on the host's disk, holes left out
+mp::optional<long long> allocated_bytes_of(const QString& path)
+{
+    struct stat file_stat;
+    if (::stat(QFile::encodeName(path).constData(), &file_stat) != 0)
+        return mp::nullopt;
+
+    return static_cast<long long>(file_stat.st_blocks) * 512;
 }
 
-auto qmp_execute_json(const QString& cmd)
+// Counters of the tap device, from the host's side of it
+mp::optional<long long> tap_bytes(const std::string& tap_device_name, const char* counter)
 {
-    QJsonObject qmp;
-    qmp.insert("execute", cmd);
-    return QJsonDocument(qmp).toJson();
+    QFile file{QString("/sys/class/net/%1/statistics/%2").arg(QString::fromStdString(tap_device_name), counter)};
+    if (!file.open(QIODevice::ReadOnly))
+        return mp::nullopt;
+
+    bool ok;
+    const auto bytes = file.readAll().trimmed().toLongLong(&ok);
+    if (!ok)
+        return mp::nullopt;
+
+    return bytes;
 }
 
-auto hmc_to_qmp_json(const QString& command_line)
+void remove_tap_device(const QString& tap_device_name)
 {
-    auto qmp = QJsonDocument::fromJson(qmp_execute_json("human-monitor-command")).object();
+    if (mp::backend::link_exists(tap_device_name))
+    {
+        try
+        {
+            mp::backend::NetlinkBatch{}.delete_link(tap_device_name).commit();
+        }
+        catch (const std::runtime_error& e)
+        {
+            mpl::log(mpl::Level::warning, tap_device_name.toStdString(),
+                     fmt::format("Failed to delete tap device: {}", e.what()));
+        }
+    }
+}
 
-    QJsonObject cmd_line;
-    cmd_line.insert("command-line", command_line);
+// Reads the snapshot names straight out of a qcow2 image's snapshot table (see qemu's docs/interop/qcow2.txt).
+// Gives nothing when the image is not a qcow2 file this can make sense of.
+mp::optional<bool> qcow2_has_snapshot(const mp::Path& image_path, const QByteArray& tag)
+{
+    constexpr quint32 qcow2_magic = 0x514649fb; // "QFI\xfb"
+    constexpr quint32 max_snapshots = 65536;
+
+    QFile image{image_path};
+    if (!image.open(QIODevice::ReadOnly))
+        return mp::nullopt;
+
+    QDataStream stream{&image}; // big endian, like qcow2
+    quint32 magic, version, nb_snapshots;
+    quint64 snapshots_offset;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != qcow2_magic || version < 2)
+        return mp::nullopt;
+
+    image.seek(60);
+    stream >> nb_snapshots >> snapshots_offset;
+    if (stream.status() != QDataStream::Ok || nb_snapshots > max_snapshots ||
+        (nb_snapshots && !image.seek(static_cast<qint64>(snapshots_offset))))
+        return mp::nullopt;
+
+    for (quint32 i = 0; i < nb_snapshots; ++i)
+    {
+        quint64 l1_table_offset, vm_clock_nsec;
+        quint32 l1_size, date_sec, date_nsec, vm_state_size, extra_data_size;
+        quint16 id_str_size, name_size;
+        stream >> l1_table_offset >> l1_size >> id_str_size >> name_size >> date_sec >> date_nsec >> vm_clock_nsec >>
+            vm_state_size >> extra_data_size;
+
+        const auto name_start = image.pos() + extra_data_size + id_str_size;
+        if (stream.status() != QDataStream::Ok || !image.seek(name_start))
+            return mp::nullopt;
+
+        const auto name = image.read(name_size);
+        if (name.size() != name_size)
+            return mp::nullopt;
+        if (name == tag)
+            return true;
 
-    qmp.insert("arguments", cmd_line);
+        const auto entry_end = name_start + name_size;
+        if (!image.seek(entry_end + (8 - entry_end % 8) % 8)) // entries are padded to 8 bytes
+            return mp::nullopt;
+    }
 
-    return QJsonDocument(qmp).toJson();
+    return false;
 }
 
 bool instance_image_has_snapshot(const mp::Path& image_path)
 {
+    if (QFile::exists(mp::QemuVMProcessSpec::memory_state_file(image_path)))
+        return true;
+
+    if (auto has_snapshot = qcow2_has_snapshot(image_path, suspend_tag))
+        return *has_snapshot;
+
     auto process = MP_PROCFACTORY.create_process("qemu-img", QStringList{"snapshot", "-l", image_path});
     auto process_state = process->execute();
     if (!process_state.completed_successfully())
@@ -160,42 +397,39 @@ bool instance_image_has_snapshot(const mp::Path& image_path)
     return false;
 }
 
-auto get_qemu_machine_type()
+// vCPUs are hot-added with ids made from the slot they go in, which the saved arguments recognise them by
+QString hot_added_vcpu_id(const QJsonObject& props)
 {
-    QTemporaryFile dump_file;
-    if (!dump_file.open())
-    {
-        return QString();
-    }
+    QStringList ids;
+    for (const auto& key : props.keys())
+        ids << QString::number(props[key].toInt());
 
-    auto process_spec = std::make_unique<mp::QemuVmStateProcessSpec>(dump_file.fileName());
-    auto process = MP_PROCFACTORY.create_process(std::move(process_spec));
-    auto process_state = process->execute();
-
-    if (!process_state.completed_successfully())
-    {
-        throw std::runtime_error(
-            fmt::format("Internal error: qemu-system-x86_64 failed getting vmstate ({}) with output:\n{}",
-                        process_state.failure_message(), process->read_all_standard_error()));
-    }
+    return "vcpu-" + ids.join('-');
+}
 
-    auto vmstate = QJsonDocument::fromJson(dump_file.readAll()).object();
+QString hot_added_vcpu_device(const QJsonObject& vcpu)
+{
+    const auto props = vcpu["props"].toObject();
+    auto device = vcpu["type"].toString() + ",id=" + hot_added_vcpu_id(props);
+    for (const auto& key : props.keys())
+        device += QString(",%1=%2").arg(key).arg(props[key].toInt());
 
-    auto machine_type = vmstate["vmschkmachine"].toObject()["Name"].toString();
-    return machine_type;
+    return device;
 }
 
-auto generate_metadata(const QStringList& args)
+auto generate_metadata(const QString& machine_type, const QStringList& args)
 {
     QJsonObject metadata;
-    metadata[machine_type_key] = get_qemu_machine_type();
+    metadata[machine_type_key] = machine_type;
     metadata[arguments_key] = QJsonArray::fromStringList(args);
     return metadata;
 }
 } // namespace
 
 mp::QemuVirtualMachine::QemuVirtualMachine(const VirtualMachineDescription& desc, const std::string& tap_device_name,
-                                           DNSMasqServer& dnsmasq_server, VMStatusMonitor& monitor)
+                                           DNSMasqServer& dnsmasq_server, VMStatusMonitor& monitor,
+                                           QemuPlacement& placement, QemuMemoryMerging& memory_merging,
+                                           TraitsProvider qemu_traits, TapSetup set_up_tap)
     : BaseVirtualMachine{instance_image_has_snapshot(desc.image.image_path) ? State::suspended : State::off,
                          desc.vm_name},
       tap_device_name{tap_device_name},
@@ -203,20 +437,78 @@ mp::QemuVirtualMachine::QemuVirtualMachine(const VirtualMachineDescription& desc
       mac_addr{desc.default_mac_address},
       username{desc.ssh_username},
       dnsmasq_server{&dnsmasq_server},
-      monitor{&monitor}
+      monitor{&monitor},
+      placement{&placement},
+      memory_merging{&memory_merging},
+      qemu_traits{std::move(qemu_traits)},
+      set_up_tap{std::move(set_up_tap)},
+      claimed_vsock_cid{claim_vsock_cid(desc.vm_name)},
+      guest_agent_socket{socket_path_for(desc, "qga.sock")},
+      guest_agent{std::make_unique<QemuGuestAgent>(QemuGuestAgent::socket_connector(guest_agent_socket))},
+      monitor_socket{socket_path_for(desc, "qmp.sock")}
 {
     QObject::connect(this, &QemuVirtualMachine::on_delete_memory_snapshot, this,
                      [this] {
                          mpl::log(mpl::Level::debug, vm_name, fmt::format("Deleted memory snapshot"));
-                         vm_process->write(hmc_to_qmp_json("delvm " + QString::fromStdString(suspend_tag)));
+                         if (!QFile::remove(QemuVMProcessSpec::memory_state_file(desc.image.image_path)))
+                             qmp->human_monitor_command("delvm " + QString::fromStdString(suspend_tag));
                          delete_memory_snapshot = false;
                      },
                      Qt::QueuedConnection);
+
+    // Kept fresh in the background, so that metrics() never waits on qemu
+    metrics_timer.setInterval(std::chrono::duration_cast<std::chrono::milliseconds>(metrics_interval).count());
+    QObject::connect(&metrics_timer, &QTimer::timeout, this, [this] {
+        request_guest_memory_stats();
+        adjust_balloon();
+        if (merging_memory)
+            this->memory_merging->tune(balloon::host_memory_pressure());
+    });
+    metrics_timer.start();
+
+    if (desc.io_limits.network_bytes_per_second)
+        mpl::log(mpl::Level::warning, vm_name, "qemu cannot limit network bandwidth, leaving it unlimited");
+
+    if (auto process = DetachedQemuProcess::adopt(QemuVMProcessSpec::pid_file(desc.image.image_path), monitor_socket,
+                                                  desc.image.image_path))
+        adopt(std::move(process));
 }
 
 mp::QemuVirtualMachine::~QemuVirtualMachine()
 {
-    if (vm_process)
+    release_vsock_cid(claimed_vsock_cid, vm_name);
+
+    // Left for the next daemon to adopt, along with its tap. virtiofsd goes down with the daemon though, so instances
+    // sharing directories through it are suspended as before
+    if (detached && vm_process && vm_process->running() && state != State::suspending && virtiofsd_processes.empty())
+    {
+        mpl::log(mpl::Level::info, vm_name, "Leaving the instance running");
+        vm_process->disconnect();
+        vm_process.reset(nullptr);
+        return;
+    }
+
+    if (vm_process && shutdown_deadline)
+    {
+        // Set going down along with the other instances, so what is left of the deadline is for all of them at once
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(*shutdown_deadline -
+                                                                                std::chrono::steady_clock::now());
+        if (vm_process->running() && !vm_process->wait_for_finished(std::max(static_cast<int>(left.count()), 0)))
+        {
+            mpl::log(mpl::Level::warning, vm_name, "Did not go down in time, killing it");
+            vm_process->kill();
+            vm_process->wait_for_finished(1000);
+        }
+
+        // Cut short, the memory state would have the instance taken for suspended, only to fail to resume from it
+        if (migrating_out)
+        {
+            mpl::log(mpl::Level::warning, vm_name, "Did not save its memory state in time, dropping it");
+            QFile::remove(QemuVMProcessSpec::memory_state_file(desc.image.image_path));
+            migrating_out = false;
+        }
+    }
+    else if (vm_process)
     {
         update_shutdown_status = false;
 
@@ -232,7 +524,64 @@ mp::QemuVirtualMachine::~QemuVirtualMachine()
         vm_process->wait_for_finished();
     }
 
-    remove_tap_device(QString::fromStdString(tap_device_name));
+    stop_virtiofsd();
+    release_cpus();
+    withdraw_from_merging();
+
+    if (shutdown_deadline)
+    {
+        std::lock_guard<decltype(released_taps_mutex)> lock{released_taps_mutex};
+        released_taps << QString::fromStdString(tap_device_name);
+    }
+    else
+    {
+        remove_tap_device(QString::fromStdString(tap_device_name));
+    }
+}
+
+void mp::QemuVirtualMachine::begin_shutdown(bool suspend_instance, std::chrono::steady_clock::time_point deadline)
+{
+    // Left running, as the destructor would
+    if (!vm_process ||
+        (detached && vm_process->running() && state != State::suspending && virtiofsd_processes.empty()))
+        return;
+
+    update_shutdown_status = false;
+    shutdown_deadline = deadline;
+
+    if (state == State::running && suspend_instance)
+        suspend();
+    else if ((state == State::running || state == State::delayed_shutdown || state == State::unknown) &&
+             vm_process->running())
+        qmp->execute("system_powerdown");
+    else if (state != State::suspended)
+        vm_process->kill();
+}
+
+void mp::QemuVirtualMachine::remove_released_tap_devices()
+{
+    std::lock_guard<decltype(released_taps_mutex)> lock{released_taps_mutex};
+
+    mp::backend::NetlinkBatch batch;
+    auto any{false};
+    for (const auto& tap : released_taps)
+        if (mp::backend::link_exists(tap))
+        {
+            batch.delete_link(tap);
+            any = true;
+        }
+
+    try
+    {
+        if (any)
+            batch.commit();
+    }
+    catch (const std::runtime_error& e)
+    {
+        mpl::log(mpl::Level::warning, "qemu", fmt::format("Failed to delete tap devices: {}", e.what()));
+    }
+
+    released_taps.clear();
 }
 
 void mp::QemuVirtualMachine::start()
@@ -243,7 +592,37 @@ void mp::QemuVirtualMachine::start()
     if (state == State::suspending)
         throw std::runtime_error("cannot start the instance while suspending");
 
-    initialize_vm_process();
+    TraceSpan span{"qemu", "start"};
+    mp::optional<QemuTraits> traits;
+    if (state != State::suspended)
+        traits = qemu_traits();
+
+    // Resumed instances keep the memory layout they were booted with, but their vCPUs can still be pinned
+    QemuVMProcessSpec::Placement placement_spec;
+    release_cpus();
+    withdraw_from_merging();
+    if (MP_SETTINGS.get(mp::cpu_pinning_key) == "true")
+    {
+        if (auto allocation = placement->allocate(vm_name, desc.num_cores))
+        {
+            placement_spec.host_node = allocation->node;
+            pinned_cpus = std::move(allocation->cpus);
+        }
+        else
+            mpl::log(mpl::Level::warning, vm_name,
+                     fmt::format("No host NUMA node has {} cores to spare, leaving vCPUs unpinned", desc.num_cores));
+    }
+    placement_spec.hugepages = MP_SETTINGS.get(mp::hugepages_key) == "true";
+    placement_spec.memory_merge = MP_SETTINGS.get(mp::memory_merge_key) == "true";
+    placement_spec.vsock_cid = claimed_vsock_cid;
+    if (placement_spec.memory_merge && placement_spec.hugepages)
+        mpl::log(mpl::Level::warning, vm_name, "Memory on hugepages cannot be merged, leaving it unmerged");
+    // An ephemeral instance is purged once it stops, which it would miss if it outlived the daemon
+    detached = MP_SETTINGS.get(mp::keep_running_key) == "true" && !desc.ephemeral;
+
+    initialize_vm_process(traits, placement_spec, MP_SETTINGS.get(mp::fast_boot_key) == "true");
+    reclaim_memory = MP_SETTINGS.get(mp::memory_reclaim_key) == "true";
+    balloon_target = desc.mem_size.in_bytes();
 
     if (state == State::suspended)
     {
@@ -254,12 +633,35 @@ void mp::QemuVirtualMachine::start()
     }
     else
     {
-        monitor->update_metadata_for(vm_name, generate_metadata(vm_process->arguments()));
+        monitor->update_metadata_for(vm_name, generate_metadata(traits->machine_type, vm_process->arguments()));
+
+        // Cold boots read ahead what the first traced one did; resuming reads the memory snapshot instead. Drives
+        // opened with O_DIRECT, as under the performance profile, go around the page cache, which then neither shows
+        // what the boot read nor serves what is read ahead
+        recording_boot_trace = false;
+        if (MP_SETTINGS.get(mp::boot_readahead_key) == "true" &&
+            desc.storage_profile != mp::performance_storage_profile)
+        {
+            if (auto requested = boot_trace::prefetch(desc.image.image_path))
+                mpl::log(mpl::Level::debug, vm_name, fmt::format("Reading {} bytes of the image ahead", requested));
+            else
+            {
+                boot_trace::start_recording(desc.image.image_path);
+                recording_boot_trace = true;
+            }
+        }
     }
 
-    vm_process->start();
-    if (!vm_process->wait_for_started())
+    bool started{false};
     {
+        TraceSpan spawn_span{"qemu", "spawn"};
+        vm_process->start();
+        started = vm_process->wait_for_started();
+    }
+    if (!started)
+    {
+        release_cpus();
+        withdraw_from_merging();
         auto process_state = vm_process->process_state();
         if (process_state.error)
         {
@@ -277,7 +679,17 @@ void mp::QemuVirtualMachine::start()
         }
     }
 
-    vm_process->write(qmp_execute_json("qmp_capabilities"));
+    set_up_monitor();
+    pin_vcpus();
+
+    // A resumed instance, having had no traits asked for, keeps the limits it was booted with until told otherwise
+    if (!traits)
+        throttle_disk();
+
+    // What the image still reads from the remote image it was launched off is copied in while the instance runs,
+    // after which qemu takes the backing file out of it. Stopping part way leaves it for the next start
+    if (QemuVMProcessSpec::has_remote_backing_file(desc.image.image_path))
+        qmp->execute("block-stream", {{"job-id", "stream-hda"}, {"device", "hda"}});
 }
 
 void mp::QemuVirtualMachine::stop()
@@ -294,7 +706,7 @@ void mp::QemuVirtualMachine::shutdown()
     else if ((state == State::running || state == State::delayed_shutdown || state == State::unknown) &&
              vm_process->running())
     {
-        vm_process->write(qmp_execute_json("system_powerdown"));
+        qmp->execute("system_powerdown");
         vm_process->wait_for_finished();
     }
     else
@@ -313,7 +725,15 @@ void mp::QemuVirtualMachine::suspend()
 {
     if ((state == State::running || state == State::delayed_shutdown) && vm_process->running())
     {
-        vm_process->write(hmc_to_qmp_json("savevm " + QString::fromStdString(suspend_tag)));
+        // Migrating the memory out to a file of its own is much faster than savevm into the image, and keeps the
+        // image from growing by the size of the memory
+        qmp->execute("migrate-set-capabilities",
+                     {{"capabilities", QJsonArray{QJsonObject{{"capability", "events"}, {"state", true}}}}});
+        qmp->execute("migrate-set-parameters", {{"max-bandwidth", unlimited_migration_bandwidth}});
+        const auto memory_state_file = QemuVMProcessSpec::memory_state_file(desc.image.image_path);
+        record_hot_added_vcpus();
+        qmp->execute("migrate", {{"uri", "exec:cat > " + QemuVMProcessSpec::shell_quote(memory_state_file)}});
+        migrating_out = true;
 
         if (update_shutdown_status)
         {
@@ -347,6 +767,69 @@ void mp::QemuVirtualMachine::update_state()
     monitor->persist_state_for(vm_name, state);
 }
 
+void mp::QemuVirtualMachine::set_native_mounts(const std::vector<NativeMount>& mounts)
+{
+    native_mounts = mounts;
+}
+
+void mp::QemuVirtualMachine::set_io_limits(const IoLimits& limits)
+{
+    if (limits.network_bytes_per_second)
+        throw NotImplementedOnThisBackendException("network I/O limits");
+
+    desc.io_limits = limits;
+    if (vm_process && vm_process->running())
+        throttle_disk();
+}
+
+long long mp::QemuVirtualMachine::compact_disk()
+{
+    if (state != State::off && state != State::stopped)
+        return 0;
+
+    // Nothing to give back from an image that has not been written to since it was last compacted
+    const auto last_modified = QFileInfo{desc.image.image_path}.lastModified();
+    if (last_modified == compacted_image_modified)
+        return 0;
+
+    const auto compacted = mp::backend::compact_instance_image(desc.image.image_path);
+    boot_trace::discard(desc.image.image_path); // the image's clusters moved
+    compacted_image_modified = QFileInfo{desc.image.image_path}.lastModified();
+
+    return compacted;
+}
+
+void mp::QemuVirtualMachine::resize(int num_cores, const MemorySize& mem_size)
+{
+    if (vm_process && vm_process->running())
+    {
+        // What it was booted with leaves room for so much; more takes a restart
+        const auto capacity = QemuVMProcessSpec::hotplug_capacity(vm_process->arguments());
+        if (num_cores > capacity.max_cores)
+            throw std::runtime_error(fmt::format("{} can have at most {} vCPUs until it restarts", vm_name,
+                                                 capacity.max_cores));
+        if (mem_size.in_bytes() > capacity.max_memory)
+            throw std::runtime_error(fmt::format("{} can have at most {}MiB of memory until it restarts", vm_name,
+                                                 capacity.max_memory / (1024 * 1024)));
+
+        plug_vcpus(num_cores);
+
+        // virtio-mem plugs in and takes out memory on top of what the instance booted with, which stays
+        if (capacity.max_memory > capacity.boot_memory)
+        {
+            const auto requested_size = std::max(0LL, mem_size.in_bytes() - capacity.boot_memory);
+            wait_for_reply(qmp->execute(
+                "qom-set", {{"path", hotplug_memory_path}, {"property", "requested-size"}, {"value", requested_size}}));
+        }
+        if (mem_size.in_bytes() < capacity.boot_memory)
+            mpl::log(mpl::Level::info, vm_name,
+                     "Memory below what the instance booted with is taken out when it restarts");
+    }
+
+    desc.num_cores = num_cores;
+    desc.mem_size = mem_size;
+}
+
 void mp::QemuVirtualMachine::on_started()
 {
     state = State::starting;
@@ -376,7 +859,11 @@ void mp::QemuVirtualMachine::on_shutdown()
 
     management_ip = nullopt;
     update_state();
+    forget_guest_memory_stats();
     vm_process.reset(nullptr);
+    stop_virtiofsd();
+    release_cpus();
+    withdraw_from_merging();
     lock.unlock();
     monitor->on_shutdown();
 }
@@ -384,6 +871,9 @@ void mp::QemuVirtualMachine::on_shutdown()
 void mp::QemuVirtualMachine::on_suspend()
 {
     state = State::suspended;
+    forget_guest_memory_stats();
+    release_cpus();
+    withdraw_from_merging();
     monitor->on_suspend();
 }
 
@@ -397,6 +887,172 @@ void mp::QemuVirtualMachine::on_restart()
     monitor->on_restart(vm_name);
 }
 
+mp::VirtualMachine::Metrics mp::QemuVirtualMachine::metrics()
+{
+    std::lock_guard<decltype(metrics_mutex)> lock{metrics_mutex};
+    return guest_memory;
+}
+
+auto mp::QemuVirtualMachine::run_in_guest(const std::string& command, std::chrono::milliseconds timeout)
+    -> optional<GuestCommandResult>
+{
+    if (!mp::utils::is_running(current_state()))
+        return nullopt;
+
+    {
+        std::lock_guard<decltype(guest_agent_mutex)> lock{guest_agent_mutex};
+        if (std::chrono::steady_clock::now() < guest_agent_retry_after)
+            return nullopt;
+    }
+
+    try
+    {
+        auto result = guest_agent->run(command, timeout);
+        return GuestCommandResult{result.exit_code, std::move(result.output)};
+    }
+    catch (const std::exception& e)
+    {
+        mpl::log(mpl::Level::debug, vm_name, fmt::format("guest agent unavailable, falling back to SSH: {}", e.what()));
+
+        std::lock_guard<decltype(guest_agent_mutex)> lock{guest_agent_mutex};
+        guest_agent_retry_after = std::chrono::steady_clock::now() + guest_agent_retry_interval;
+        return nullopt;
+    }
+}
+
+bool mp::QemuVirtualMachine::run_after_resume(const std::string& command, const SSHKeyProvider& key_provider,
+                                              std::chrono::milliseconds timeout)
+{
+    // Neither the agent nor vsock care what addresses the guest has, which is what the command is usually there to fix
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    for (auto now = std::chrono::steady_clock::now(); now < deadline; now = std::chrono::steady_clock::now())
+    {
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
+        try
+        {
+            return guest_agent->run(command, remaining).exit_code == 0;
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::trace, vm_name, fmt::format("guest agent not answering yet: {}", e.what()));
+        }
+
+        if (vsock_cid && vsock_listening(*vsock_cid, ssh_port()))
+        {
+            try
+            {
+                SSHSession session{SSHSession::vsock_host(*vsock_cid), ssh_port(), ssh_username(), key_provider};
+                auto process =
+                    session.exec(mp::utils::to_cmd({"sudo", "sh", "-c", command}, mp::utils::QuoteType::quote_every_arg));
+                return process.exit_code(remaining) == 0;
+            }
+            catch (const std::exception& e)
+            {
+                mpl::log(mpl::Level::trace, vm_name, fmt::format("vsock SSH not answering yet: {}", e.what()));
+            }
+        }
+
+        std::this_thread::sleep_for(std::chrono::seconds{1});
+    }
+
+    return false;
+}
+
+void mp::QemuVirtualMachine::request_guest_memory_stats()
+{
+    if (!vm_process || !vm_process->running())
+        return;
+
+    {
+        // All read from the host, which is cheap enough to do on every round
+        const auto cpu_time_ms = cpu_time_ms_of(vm_process->process_id());
+        const auto disk_allocated = allocated_bytes_of(desc.image.image_path);
+        const auto net_rx_bytes = tap_bytes(tap_device_name, "tx_bytes"); // what the host sends the instance
+        const auto net_tx_bytes = tap_bytes(tap_device_name, "rx_bytes");
+
+        std::lock_guard<decltype(metrics_mutex)> lock{metrics_mutex};
+        guest_memory.cpu_time_ms = cpu_time_ms;
+        guest_memory.disk_allocated = disk_allocated;
+        guest_memory.net_rx_bytes = net_rx_bytes;
+        guest_memory.net_tx_bytes = net_tx_bytes;
+    }
+
+    qmp->execute("qom-get", {{"path", balloon_path}, {"property", "guest-stats"}}, [this](const QJsonObject& value) {
+        // Counters the guest did not report are -1, and all of them are until its first report
+        const auto stats = value["stats"].toObject();
+        const auto total = static_cast<long long>(stats["stat-total-memory"].toDouble(-1));
+        const auto available = static_cast<long long>(stats["stat-available-memory"].toDouble(-1));
+        if (value["last-update"].toDouble() <= 0 || total <= 0 || available < 0)
+            return;
+
+        std::lock_guard<decltype(metrics_mutex)> lock{metrics_mutex};
+        guest_memory.memory_used = total - available;
+        guest_memory.memory_total = total;
+    });
+}
+
+// Gives each vCPU thread a host core of its own, keeping qemu and the threads it starts later on the same cores
+void mp::QemuVirtualMachine::pin_vcpus()
+{
+    if (pinned_cpus.empty())
+        return;
+
+    if (!QemuPlacement::pin(vm_process->process_id(), pinned_cpus))
+        mpl::log(mpl::Level::warning, vm_name, "Unable to pin qemu to its host cores");
+
+    qmp->execute("query-cpus-fast", {}, [this, cpus = pinned_cpus](const QJsonObject& value) {
+        for (const auto& vcpu_value : value["output"].toArray())
+        {
+            const auto vcpu = vcpu_value.toObject();
+            const auto index = vcpu["cpu-index"].toInt(-1);
+            const auto thread_id = static_cast<qint64>(vcpu["thread-id"].toDouble());
+            if (index < 0 || index >= static_cast<int>(cpus.size()) || !QemuPlacement::pin(thread_id, {cpus[index]}))
+                mpl::log(mpl::Level::warning, vm_name, fmt::format("Unable to pin vCPU {}", index));
+        }
+    });
+}
+
+void mp::QemuVirtualMachine::release_cpus()
+{
+    if (pinned_cpus.empty())
+        return;
+
+    placement->release(vm_name);
+    pinned_cpus.clear();
+}
+
+void mp::QemuVirtualMachine::withdraw_from_merging()
+{
+    if (!merging_memory)
+        return;
+
+    memory_merging->withdraw(vm_name);
+    merging_memory = false;
+}
+
+// Under host memory pressure, takes back what the guest is not using. Pages it frees go back anyway with free page
+// reporting, but not the ones it keeps around as cache.
+void mp::QemuVirtualMachine::adjust_balloon()
+{
+    if (!reclaim_memory || state != State::running || !vm_process || !vm_process->running())
+        return;
+
+    const auto target = balloon::target_for(desc.mem_size.in_bytes(), metrics().memory_used,
+                                            balloon::host_memory_pressure(), balloon_target);
+    if (target != balloon_target)
+    {
+        mpl::log(mpl::Level::debug, vm_name, fmt::format("Ballooning memory to {} bytes", target));
+        qmp->execute("balloon", {{"value", target}});
+        balloon_target = target;
+    }
+}
+
+void mp::QemuVirtualMachine::forget_guest_memory_stats()
+{
+    std::lock_guard<decltype(metrics_mutex)> lock{metrics_mutex};
+    guest_memory = {};
+}
+
 void mp::QemuVirtualMachine::ensure_vm_is_running()
 {
     auto is_vm_running = [this] { return (vm_process && vm_process->running()); };
@@ -408,7 +1064,41 @@ std::string mp::QemuVirtualMachine::ssh_hostname(std::chrono::milliseconds timeo
 {
     auto get_ip = [this]() -> optional<IPAddress> { return dnsmasq_server->get_ip_for(mac_addr); };
 
-    return mp::backend::ip_address_for(this, get_ip, timeout);
+    if (vsock_ssh)
+        return SSHSession::vsock_host(*vsock_cid);
+    if (!vsock_cid || vsock_without_ssh)
+        return mp::backend::ip_address_for(this, get_ip, timeout);
+
+    // Whichever comes first: sshd answering over vsock, which does not wait for the instance's network, or a lease
+    std::string hostname;
+    auto action = [this, &get_ip, &hostname] {
+        ensure_vm_is_running();
+        if (vsock_listening(*vsock_cid, ssh_port()))
+        {
+            vsock_ssh = true;
+            hostname = SSHSession::vsock_host(*vsock_cid);
+            return mp::utils::TimeoutAction::done;
+        }
+
+        if (auto ip = get_ip())
+        {
+            // The image does not listen on vsock, or not yet on this boot
+            vsock_without_ssh = true;
+            management_ip.emplace(*ip);
+            hostname = ip->as_string();
+            return mp::utils::TimeoutAction::done;
+        }
+
+        return mp::utils::TimeoutAction::retry;
+    };
+
+    auto on_timeout = [this] {
+        state = State::unknown;
+        throw std::runtime_error("failed to determine IP address");
+    };
+
+    mp::utils::try_action_for(on_timeout, timeout, action);
+    return hostname;
 }
 
 std::string mp::QemuVirtualMachine::ssh_username()
@@ -439,58 +1129,131 @@ void mp::QemuVirtualMachine::wait_until_ssh_up(std::chrono::milliseconds timeout
 {
     mp::utils::wait_until_ssh_up(this, timeout, std::bind(&QemuVirtualMachine::ensure_vm_is_running, this));
 
+    // What the boot read is what it needed to get this far
+    if (recording_boot_trace)
+    {
+        recording_boot_trace = false;
+        if (boot_trace::save(desc.image.image_path))
+            mpl::log(mpl::Level::debug, vm_name, "Recorded what the boot read of the image");
+    }
+
     if (delete_memory_snapshot)
     {
         emit on_delete_memory_snapshot();
     }
 }
 
-void mp::QemuVirtualMachine::initialize_vm_process()
+void mp::QemuVirtualMachine::adopt(std::unique_ptr<Process> process)
+{
+    mpl::log(mpl::Level::info, vm_name, fmt::format("Adopting qemu {}, left running", process->process_id()));
+
+    // Whatever the instance was last resumed from is behind it by now
+    if (state == State::suspended)
+        emit on_delete_memory_snapshot();
+
+    state = State::running;
+    detached = true;
+    vm_process = std::move(process);
+    connect_vm_process();
+
+    // Its vCPUs float until it is next started, the cores they had being nobody's to hand out any more
+    reclaim_memory = MP_SETTINGS.get(mp::memory_reclaim_key) == "true";
+    balloon_target = desc.mem_size.in_bytes();
+    set_up_monitor();
+}
+
+void mp::QemuVirtualMachine::set_up_monitor()
+{
+    qmp->execute("qmp_capabilities");
+    qmp->execute("qom-set", {{"path", balloon_path},
+                             {"property", "guest-stats-polling-interval"},
+                             {"value", static_cast<int>(metrics_interval.count())}});
+
+    // Resumed instances merge their memory if they were booted to
+    if (vm_process->arguments().contains("mem-merge=on"))
+    {
+        memory_merging->enrol(vm_name);
+        merging_memory = true;
+    }
+}
+
+void mp::QemuVirtualMachine::initialize_vm_process(const optional<QemuTraits>& traits,
+                                                   const QemuVMProcessSpec::Placement& placement_spec, bool fast_boot)
 {
+    // A resumed instance keeps the devices it was booted with, and neither virtiofs nor 9p let it be suspended
+    std::vector<QemuVMProcessSpec::SharedDirectory> shared_directories;
+    if (state != State::suspended && !native_mounts.empty())
+    {
+        stop_virtiofsd();
+        const auto virtiofsd = find_virtiofsd();
+
+        for (const auto& mount : native_mounts)
+        {
+            QString socket_path;
+            if (!virtiofsd.isEmpty())
+            {
+                socket_path = socket_path_for(desc, QString("%1.sock").arg(QString::fromStdString(mount.tag)));
+                QFile::remove(socket_path);
+
+                auto process = MP_PROCFACTORY.create_process(
+                    std::make_unique<VirtiofsdProcessSpec>(virtiofsd, vm_name, mount, socket_path));
+                process->start();
+
+                if (!process->wait_for_started() || !wait_for_socket(socket_path, *process))
+                {
+                    stop_virtiofsd();
+                    throw std::runtime_error(fmt::format("virtiofsd failed to share \"{}\": {}", mount.source_path,
+                                                         process->read_all_standard_error()));
+                }
+
+                virtiofsd_processes.push_back(std::move(process));
+            }
+
+            shared_directories.push_back({mount, socket_path});
+        }
+    }
+
+    // Left behind by an instance that did not exit cleanly, it would keep qemu from listening
+    QFile::remove(guest_agent_socket);
+    {
+        std::lock_guard<decltype(guest_agent_mutex)> lock{guest_agent_mutex};
+        guest_agent_retry_after = {};
+    }
+
+    optional<QemuVMProcessSpec::Detachment> detachment;
+    if (detached)
+        detachment = QemuVMProcessSpec::Detachment{QemuVMProcessSpec::pid_file(desc.image.image_path), monitor_socket};
+
     vm_process = make_qemu_process(
         desc, ((state == State::suspended) ? mp::make_optional(monitor->retrieve_metadata_for(vm_name)) : mp::nullopt),
-        tap_device_name);
+        tap_device_name, shared_directories, traits ? traits->host_features : QemuVMProcessSpec::HostFeatures{},
+        placement_spec, guest_agent_socket, detachment, fast_boot);
+
+    // Taken from the arguments rather than the description: one suspended before taps had queues resumes with none
+    set_up_tap(QemuVMProcessSpec::opens_multi_queue_tap(vm_process->arguments()));
+    connect_vm_process();
+}
+
+void mp::QemuVirtualMachine::connect_vm_process()
+{
+    vsock_cid = vsock_cid_in(vm_process->arguments());
+    vsock_ssh = vsock_without_ssh = false;
 
     QObject::connect(vm_process.get(), &Process::started, [this]() {
         mpl::log(mpl::Level::info, vm_name, "process started");
         on_started();
     });
 
+    qmp = std::make_unique<QmpClient>([this](const QByteArray& command) {
+        if (vm_process)
+            vm_process->write(command);
+    });
+    subscribe_to_qmp_events();
+
     QObject::connect(vm_process.get(), &Process::ready_read_standard_output, [this]() {
         auto qmp_output = vm_process->read_all_standard_output();
         mpl::log(mpl::Level::debug, vm_name, fmt::format("QMP: {}", qmp_output));
-        auto qmp_object = QJsonDocument::fromJson(qmp_output.split('\n').first()).object();
-        auto event = qmp_object["event"];
-
-        if (!event.isNull())
-        {
-            if (event.toString() == "RESET" && state != State::restarting)
-            {
-                mpl::log(mpl::Level::info, vm_name, "VM restarting");
-                on_restart();
-            }
-            else if (event.toString() == "POWERDOWN")
-            {
-                mpl::log(mpl::Level::info, vm_name, "VM powering down");
-            }
-            else if (event.toString() == "SHUTDOWN")
-            {
-                mpl::log(mpl::Level::info, vm_name, "VM shut down");
-            }
-            else if (event.toString() == "STOP")
-            {
-                mpl::log(mpl::Level::info, vm_name, "VM suspending");
-            }
-            else if (event.toString() == "RESUME")
-            {
-                mpl::log(mpl::Level::info, vm_name, "VM suspended");
-                if (state == State::suspending || state == State::running)
-                {
-                    vm_process->kill();
-                    on_suspend();
-                }
-            }
-        }
+        qmp->feed(qmp_output);
     });
 
     QObject::connect(vm_process.get(), &Process::ready_read_standard_error, [this]() {
@@ -516,6 +1279,8 @@ void mp::QemuVirtualMachine::initialize_vm_process()
         });
 
     QObject::connect(vm_process.get(), &Process::finished, [this](ProcessState process_state) {
+        qmp->abandon("qemu exited");
+
         if (process_state.exit_code)
         {
             mpl::log(mpl::Level::info, vm_name,
@@ -541,3 +1306,181 @@ void mp::QemuVirtualMachine::initialize_vm_process()
         }
     });
 }
+
+void mp::QemuVirtualMachine::subscribe_to_qmp_events()
+{
+    qmp->subscribe("RESET", [this](const QJsonObject&) {
+        if (state != State::restarting)
+        {
+            mpl::log(mpl::Level::info, vm_name, "VM restarting");
+            on_restart();
+        }
+    });
+    qmp->subscribe("POWERDOWN",
+                   [this](const QJsonObject&) { mpl::log(mpl::Level::info, vm_name, "VM powering down"); });
+    qmp->subscribe("SHUTDOWN", [this](const QJsonObject&) { mpl::log(mpl::Level::info, vm_name, "VM shut down"); });
+    qmp->subscribe("STOP", [this](const QJsonObject&) { mpl::log(mpl::Level::info, vm_name, "VM suspending"); });
+    qmp->subscribe("MIGRATION", [this](const QJsonObject& data) {
+        const auto status = data["status"].toString();
+        if (status == "completed" || status == "failed")
+            migrating_out = false;
+
+        if (status == "completed" && (state == State::suspending || state == State::running))
+        {
+            mpl::log(mpl::Level::info, vm_name, "VM suspended");
+            vm_process->kill();
+            on_suspend();
+        }
+        else if (status == "failed")
+        {
+            mpl::log(mpl::Level::warning, vm_name, "Failed to save the memory state, saving a snapshot instead");
+            QFile::remove(QemuVMProcessSpec::memory_state_file(desc.image.image_path));
+            saving_snapshot = true;
+            qmp->human_monitor_command("savevm " + QString::fromStdString(suspend_tag));
+        }
+    });
+    qmp->subscribe("RESUME", [this](const QJsonObject&) {
+        if (saving_snapshot && (state == State::suspending || state == State::running))
+        {
+            mpl::log(mpl::Level::info, vm_name, "VM suspended");
+            saving_snapshot = false;
+            vm_process->kill();
+            on_suspend();
+        }
+    });
+    qmp->subscribe("BLOCK_JOB_COMPLETED", [this](const QJsonObject& data) {
+        mpl::log(mpl::Level::debug, vm_name,
+                 fmt::format("Block job on {} completed: {}", data["device"].toString(),
+                             data.contains("error") ? data["error"].toString() : "ok"));
+
+        if (data["type"].toString() == "stream" && !data.contains("error"))
+            mpl::log(mpl::Level::info, vm_name, "Image copied in full, it no longer reads from the remote image");
+        else if (data["type"].toString() == "stream")
+            mpl::log(mpl::Level::warning, vm_name,
+                     fmt::format("Could not copy the image in full, it still reads from the remote image: {}",
+                                 data["error"].toString()));
+    });
+}
+
+void mp::QemuVirtualMachine::throttle_disk()
+{
+    // Zeroes lift the limits; reads and writes are limited together, as on the command line
+    const auto& limits = desc.io_limits;
+    qmp->execute("block_set_io_throttle", {{"device", "hda"},
+                                           {"iops", limits.disk_iops},
+                                           {"iops_rd", 0},
+                                           {"iops_wr", 0},
+                                           {"iops_max", limits.disk_iops_burst},
+                                           {"bps", limits.disk_bytes_per_second},
+                                           {"bps_rd", 0},
+                                           {"bps_wr", 0},
+                                           {"bps_max", limits.disk_bytes_burst}});
+}
+
+// Hot-adds vCPUs into the slots -smp left free, or takes out the ones hot-added before. Those the instance booted with
+// stay until it restarts, and the guest onlines and offlines the others as they come and go
+void mp::QemuVirtualMachine::plug_vcpus(int num_cores)
+{
+    const auto value = wait_for_reply(qmp->execute("query-hotpluggable-cpus"));
+
+    // qemu lists the slots from the last one
+    std::vector<QJsonObject> free_slots, hot_added;
+    auto plugged = 0;
+    for (const auto& vcpu_value : value["output"].toArray())
+    {
+        const auto vcpu = vcpu_value.toObject();
+        if (!vcpu.contains("qom-path"))
+        {
+            free_slots.push_back(vcpu);
+            continue;
+        }
+
+        ++plugged;
+        if (vcpu["qom-path"].toString().startsWith(peripheral_path))
+            hot_added.push_back(vcpu);
+    }
+
+    for (; plugged < num_cores && !free_slots.empty(); ++plugged)
+    {
+        const auto slot = free_slots.back();
+        free_slots.pop_back();
+
+        const auto props = slot["props"].toObject();
+        auto arguments = props;
+        arguments["driver"] = slot["type"];
+        arguments["id"] = hot_added_vcpu_id(props);
+        wait_for_reply(qmp->execute("device_add", arguments));
+    }
+
+    for (auto it = hot_added.cbegin(); plugged > num_cores && it != hot_added.cend(); ++it, --plugged)
+        wait_for_reply(qmp->execute("device_del", {{"id", (*it)["qom-path"].toString().section('/', -1)}}));
+
+    if (plugged > num_cores)
+        mpl::log(mpl::Level::info, vm_name,
+                 fmt::format("{} of the vCPUs the instance booted with are taken out when it restarts",
+                             plugged - num_cores));
+}
+
+// Replies come in with qemu's output, which is read on this thread, so it is taken in here until the reply is there.
+// Throws qemu's description of what failed
+QJsonObject mp::QemuVirtualMachine::wait_for_reply(std::future<QJsonObject> reply)
+{
+    const auto deadline = std::chrono::steady_clock::now() + qmp_reply_timeout;
+    while (reply.wait_for(std::chrono::seconds::zero()) != std::future_status::ready)
+    {
+        const auto left =
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0 || !vm_process || !vm_process->running())
+            throw std::runtime_error(fmt::format("{} did not answer its monitor in time", vm_name));
+
+        vm_process->wait_for_ready_read(static_cast<int>(left.count()));
+    }
+
+    return reply.get();
+}
+
+// An instance resumes into a qemu started from its saved arguments, which need the vCPUs hot-added since it booted
+void mp::QemuVirtualMachine::record_hot_added_vcpus()
+{
+    qmp->execute("query-hotpluggable-cpus", {}, [this](const QJsonObject& value) {
+        auto metadata = monitor->retrieve_metadata_for(vm_name);
+        const auto saved_arguments = metadata[arguments_key].toArray();
+        if (saved_arguments.isEmpty())
+            return;
+
+        QStringList arguments;
+        for (auto i = 0; i < saved_arguments.size(); ++i)
+        {
+            // Those recorded on an earlier suspend are replaced with the ones there are now
+            const auto next = i + 1 < saved_arguments.size() ? saved_arguments[i + 1].toString() : QString{};
+            if (saved_arguments[i].toString() == "-device" && next.contains(",id=vcpu-"))
+                ++i;
+            else
+                arguments << saved_arguments[i].toString();
+        }
+
+        for (const auto& vcpu_value : value["output"].toArray())
+        {
+            const auto vcpu = vcpu_value.toObject();
+            if (vcpu["qom-path"].toString().startsWith(peripheral_path))
+                arguments << "-device" << hot_added_vcpu_device(vcpu);
+        }
+
+        metadata[arguments_key] = QJsonArray::fromStringList(arguments);
+        monitor->update_metadata_for(vm_name, metadata);
+    });
+}
+
+void mp::QemuVirtualMachine::stop_virtiofsd()
+{
+    for (auto& process : virtiofsd_processes)
+    {
+        if (process->running())
+        {
+            process->kill();
+            process->wait_for_finished();
+        }
+    }
+
+    virtiofsd_processes.clear();
+}
@@ -18,25 +18,52 @@
 #ifndef MULTIPASS_QEMU_VIRTUAL_MACHINE_H
 #define MULTIPASS_QEMU_VIRTUAL_MACHINE_H
 
+#include "qemu_vm_process_spec.h"
+
 #include <shared/base_virtual_machine.h>
 
 #include <multipass/process/process.h>
 #include <multipass/virtual_machine_description.h>
 
+#include <QDateTime>
+#include <QJsonObject>
 #include <QObject>
 #include <QStringList>
+#include <QTimer>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <vector>
 
 namespace multipass
 {
 class DNSMasqServer;
+class QemuGuestAgent;
+class QemuMemoryMerging;
+class QemuPlacement;
+class QmpClient;
 class VMStatusMonitor;
 
 class QemuVirtualMachine final : public QObject, public BaseVirtualMachine
 {
     Q_OBJECT
 public:
+    // What the factory found out about the qemu binary, asked for on every start from off
+    struct QemuTraits
+    {
+        QString machine_type; // to record for resuming
+        QemuVMProcessSpec::HostFeatures host_features;
+    };
+    using TraitsProvider = std::function<QemuTraits()>;
+    // Sets the instance's tap up, with multiple queues or not, before qemu is started
+    using TapSetup = std::function<void(bool multi_queue)>;
+
     QemuVirtualMachine(const VirtualMachineDescription& desc, const std::string& tap_device_name,
-                       DNSMasqServer& dnsmasq_server, VMStatusMonitor& monitor);
+                       DNSMasqServer& dnsmasq_server, VMStatusMonitor& monitor, QemuPlacement& placement,
+                       QemuMemoryMerging& memory_merging, TraitsProvider qemu_traits, TapSetup set_up_tap);
     ~QemuVirtualMachine();
 
     void start() override;
@@ -52,6 +79,18 @@ public:
     void ensure_vm_is_running() override;
     void wait_until_ssh_up(std::chrono::milliseconds timeout) override;
     void update_state() override;
+    void set_native_mounts(const std::vector<NativeMount>& mounts) override;
+    Metrics metrics() override;
+    optional<GuestCommandResult> run_in_guest(const std::string& command, std::chrono::milliseconds timeout) override;
+    bool run_after_resume(const std::string& command, const SSHKeyProvider& key_provider,
+                          std::chrono::milliseconds timeout) override;
+    void set_io_limits(const IoLimits& limits) override;
+    long long compact_disk() override;
+    void resize(int num_cores, const MemorySize& mem_size) override;
+    void begin_shutdown(bool suspend, std::chrono::steady_clock::time_point deadline) override;
+
+    // Removes the taps of instances that went down along with the daemon, all in one go
+    static void remove_released_tap_devices();
 
 signals:
     void on_delete_memory_snapshot();
@@ -62,18 +101,63 @@ private:
     void on_shutdown();
     void on_suspend();
     void on_restart();
-    void initialize_vm_process();
+    void adopt(std::unique_ptr<Process> process);
+    void set_up_monitor();
+    void initialize_vm_process(const optional<QemuTraits>& traits, const QemuVMProcessSpec::Placement& placement_spec,
+                               bool fast_boot);
+    void connect_vm_process();
+    void subscribe_to_qmp_events();
+    void request_guest_memory_stats();
+    void forget_guest_memory_stats();
+    void adjust_balloon();
+    void pin_vcpus();
+    void release_cpus();
+    void withdraw_from_merging();
+    void stop_virtiofsd();
+    void throttle_disk();
+    void plug_vcpus(int num_cores);
+    void record_hot_added_vcpus();
+    QJsonObject wait_for_reply(std::future<QJsonObject> reply);
 
     const std::string tap_device_name;
-    const VirtualMachineDescription desc;
+    VirtualMachineDescription desc; // with the I/O limits and size set since, for the next boot
     std::unique_ptr<Process> vm_process{nullptr};
+    std::unique_ptr<QmpClient> qmp;
+    std::vector<NativeMount> native_mounts;
+    std::vector<std::unique_ptr<Process>> virtiofsd_processes;
     const std::string mac_addr;
     const std::string username;
     DNSMasqServer* dnsmasq_server;
     VMStatusMonitor* monitor;
+    QemuPlacement* placement;
+    QemuMemoryMerging* memory_merging;
+    const TraitsProvider qemu_traits;
+    const TapSetup set_up_tap;
     std::string saved_error_msg;
     bool update_shutdown_status{true};
+    optional<std::chrono::steady_clock::time_point> shutdown_deadline; // going down along with the daemon
     bool delete_memory_snapshot{false};
+    bool saving_snapshot{false};
+    bool migrating_out{false}; // the memory state is being written to its file, of no use until it completes
+    QTimer metrics_timer;
+    std::mutex metrics_mutex;
+    Metrics guest_memory;
+    bool reclaim_memory{false};
+    long long balloon_target{0};
+    std::vector<int> pinned_cpus; // by vCPU index, empty while the instance floats
+    bool merging_memory{false};
+    optional<unsigned> vsock_cid;       // when this boot has a vsock device
+    std::atomic<bool> vsock_ssh{false}; // sshd answered over it, for the rest of the boot
+    std::atomic<bool> vsock_without_ssh{false};
+    const unsigned claimed_vsock_cid; // kept from other instances' for as long as this one is around
+    const QString guest_agent_socket;
+    const std::unique_ptr<QemuGuestAgent> guest_agent;
+    std::mutex guest_agent_mutex;
+    std::chrono::steady_clock::time_point guest_agent_retry_after; // instances without an agent are not asked again
+    const QString monitor_socket;                                  // for qemu to listen on when detached
+    bool detached{false};                                          // qemu outlives the daemon, with local.keep-running
+    QDateTime compacted_image_modified; // when the image was last written, as of its last compaction
+    bool recording_boot_trace{false};   // until this boot gets to ssh, with local.boot-readahead
 };
 } // namespace multipass
 
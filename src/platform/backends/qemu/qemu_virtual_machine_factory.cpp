@@ -17,19 +17,38 @@
 
 #include "qemu_virtual_machine_factory.h"
 #include "qemu_virtual_machine.h"
+#include "qemu_vm_process_spec.h"
+#include "qemu_vmstate_process_spec.h"
 
+#include <multipass/constants.h>
 #include <multipass/format.h>
 #include <multipass/logging/log.h>
 #include <multipass/network_interface_info.h>
 #include <multipass/optional.h>
+#include <multipass/platform.h>
+#include <multipass/settings.h>
 #include <multipass/utils.h>
 #include <multipass/virtual_machine_description.h>
 
 #include <shared/linux/backend_utils.h>
+#include <shared/linux/netlink.h>
 #include <shared/linux/process_factory.h>
 
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QRegularExpression>
+#include <QSaveFile>
+#include <QSysInfo>
 #include <QTcpSocket>
+#include <QTemporaryFile>
+#include <QVersionNumber>
+
+#include <algorithm>
+#include <thread>
+
+#include <unistd.h>
 
 namespace mp = multipass;
 namespace mpl = multipass::logging;
@@ -38,6 +57,12 @@ namespace
 {
 constexpr auto category = "qemu factory";
 constexpr auto multipass_bridge_name = "mpqemubr0";
+constexpr auto machine_type_cache_name = "qemu-machine-type.json";
+constexpr auto backend_version_key = "backend_version";
+constexpr auto machine_type_key = "machine_type";
+constexpr auto unknown_backend_version = "qemu-unknown";
+constexpr auto vhost_net_device = "/dev/vhost-net";
+constexpr auto vhost_vsock_device = "/dev/vhost-vsock";
 
 // An interface name can only be 15 characters, so this generates a hash of the
 // VM instance name with a "tap-" prefix and then truncates it.
@@ -53,40 +78,91 @@ void create_virtual_switch(const std::string& subnet, const QString& bridge_name
 {
     const QString dummy_name{bridge_name + "-dummy"};
 
-    if (!mp::utils::run_cmd_for_status("ip", {"addr", "show", bridge_name}))
+    if (!mp::backend::link_exists(bridge_name))
     {
         const auto mac_address = mp::utils::generate_mac_address();
         const auto cidr = fmt::format("{}.1/24", subnet);
         const auto broadcast = fmt::format("{}.255", subnet);
 
-        mp::utils::run_cmd_for_status("ip",
-                                      {"link", "add", dummy_name, "address", mac_address.c_str(), "type", "dummy"});
-        mp::utils::run_cmd_for_status("ip", {"link", "add", bridge_name, "type", "bridge"});
-        mp::utils::run_cmd_for_status("ip", {"link", "set", dummy_name, "master", bridge_name});
-        mp::utils::run_cmd_for_status(
-            "ip", {"address", "add", cidr.c_str(), "dev", bridge_name, "broadcast", broadcast.c_str()});
-        mp::utils::run_cmd_for_status("ip", {"link", "set", bridge_name, "up"});
+        try
+        {
+            // The dummy is enslaved and the address added once both links exist to be looked up
+            mp::backend::NetlinkBatch{}
+                .add_link(dummy_name, "dummy", mac_address)
+                .add_link(bridge_name, "bridge")
+                .commit();
+            mp::backend::NetlinkBatch{}
+                .set_master(dummy_name, bridge_name)
+                .add_address(bridge_name, cidr, broadcast)
+                .set_up(bridge_name)
+                .commit();
+        }
+        catch (const std::runtime_error& e)
+        {
+            mpl::log(mpl::Level::warning, category, fmt::format("Failed to set up {}: {}", bridge_name, e.what()));
+        }
     }
 }
 
+// Taps other than the dummy still on the bridge belong to instances left running, which the next daemon adopts
+bool bridge_in_use(const QString& bridge_name, const QString& dummy_name)
+{
+    const auto ports = QDir{QString("/sys/class/net/%1/brif").arg(bridge_name)}.entryList(QDir::AllEntries |
+                                                                                          QDir::NoDotAndDotDot);
+    return std::any_of(ports.cbegin(), ports.cend(), [&dummy_name](const QString& port) { return port != dummy_name; });
+}
+
 void delete_virtual_switch(const QString& bridge_name)
 {
     const QString dummy_name{bridge_name + "-dummy"};
 
-    if (mp::utils::run_cmd_for_status("ip", {"addr", "show", bridge_name}))
+    if (bridge_in_use(bridge_name, dummy_name))
+    {
+        mpl::log(mpl::Level::info, category, fmt::format("Keeping {} for the instances left running", bridge_name));
+        return;
+    }
+
+    if (mp::backend::link_exists(bridge_name))
     {
-        mp::utils::run_cmd_for_status("ip", {"link", "delete", bridge_name});
-        mp::utils::run_cmd_for_status("ip", {"link", "delete", dummy_name});
+        try
+        {
+            mp::backend::NetlinkBatch{}.delete_link(bridge_name).delete_link(dummy_name).commit();
+        }
+        catch (const std::runtime_error& e)
+        {
+            mpl::log(mpl::Level::warning, category, fmt::format("Failed to delete {}: {}", bridge_name, e.what()));
+        }
     }
 }
 
-void create_tap_device(const QString& tap_name, const QString& bridge_name)
+bool tap_is_multi_queue(const QString& tap_name)
 {
-    if (!mp::utils::run_cmd_for_status("ip", {"addr", "show", tap_name}))
+    constexpr auto iff_multi_queue = 0x0100;
+
+    QFile tun_flags{QString("/sys/class/net/%1/tun_flags").arg(tap_name)};
+    if (!tun_flags.open(QIODevice::ReadOnly))
+        return false;
+
+    return tun_flags.readAll().trimmed().toInt(nullptr, 16) & iff_multi_queue;
+}
+
+// qemu can only open the tap's queues with the flags it was created with, so one left over with others is recreated
+void create_tap_device(const QString& tap_name, const QString& bridge_name, bool multi_queue)
+{
+    try
+    {
+        if (mp::backend::link_exists(tap_name) && tap_is_multi_queue(tap_name) != multi_queue)
+            mp::backend::NetlinkBatch{}.delete_link(tap_name).commit();
+
+        if (!mp::backend::link_exists(tap_name))
+        {
+            mp::backend::create_tap(tap_name, multi_queue);
+            mp::backend::NetlinkBatch{}.set_master(tap_name, bridge_name).set_up(tap_name).commit();
+        }
+    }
+    catch (const std::runtime_error& e)
     {
-        mp::utils::run_cmd_for_status("ip", {"tuntap", "add", tap_name, "mode", "tap"});
-        mp::utils::run_cmd_for_status("ip", {"link", "set", tap_name, "master", bridge_name});
-        mp::utils::run_cmd_for_status("ip", {"link", "set", tap_name, "up"});
+        mpl::log(mpl::Level::warning, category, fmt::format("Failed to set up {}: {}", tap_name, e.what()));
     }
 }
 
@@ -116,6 +192,53 @@ mp::DNSMasqServer create_dnsmasq_server(const mp::Path& network_dir, const QStri
 
     return {network_dir, bridge_name, subnet};
 }
+
+QString probe_machine_type()
+{
+    QTemporaryFile dump_file;
+    if (!dump_file.open())
+    {
+        return QString();
+    }
+
+    auto process_spec = std::make_unique<mp::QemuVmStateProcessSpec>(dump_file.fileName());
+    auto process = MP_PROCFACTORY.create_process(std::move(process_spec));
+    auto process_state = process->execute();
+
+    if (!process_state.completed_successfully())
+    {
+        throw std::runtime_error(
+            fmt::format("Internal error: qemu-system-x86_64 failed getting vmstate ({}) with output:\n{}",
+                        process_state.failure_message(), process->read_all_standard_error()));
+    }
+
+    auto vmstate = QJsonDocument::fromJson(dump_file.readAll()).object();
+
+    return vmstate["vmschkmachine"].toObject()["Name"].toString();
+}
+
+QString read_machine_type_cache(const QString& cache_path, const QString& backend_version)
+{
+    QFile cache_file{cache_path};
+    if (!cache_file.open(QIODevice::ReadOnly))
+        return QString();
+
+    auto cache = QJsonDocument::fromJson(cache_file.readAll()).object();
+    return cache[backend_version_key].toString() == backend_version ? cache[machine_type_key].toString() : QString();
+}
+
+void write_machine_type_cache(const QString& cache_path, const QString& backend_version, const QString& machine_type)
+{
+    QJsonObject cache;
+    cache[backend_version_key] = backend_version;
+    cache[machine_type_key] = machine_type;
+
+    QSaveFile cache_file{cache_path};
+    if (!cache_file.open(QIODevice::WriteOnly) || cache_file.write(QJsonDocument(cache).toJson()) == -1 ||
+        !cache_file.commit())
+        mpl::log(mpl::Level::warning, category,
+                 fmt::format("Unable to cache the machine type in {}", qUtf8Printable(cache_path)));
+}
 } // namespace
 
 mp::QemuVirtualMachineFactory::QemuVirtualMachineFactory(const mp::Path& data_dir)
@@ -123,12 +246,19 @@ mp::QemuVirtualMachineFactory::QemuVirtualMachineFactory(const mp::Path& data_di
       network_dir{mp::utils::make_dir(QDir(data_dir), "network")},
       subnet{mp::backend::get_subnet(network_dir, bridge_name)},
       dnsmasq_server{create_dnsmasq_server(network_dir, bridge_name, subnet)},
-      iptables_config{bridge_name, subnet}
+      iptables_config{bridge_name, subnet},
+      machine_type_cache_path{QDir(data_dir).filePath(machine_type_cache_name)},
+      // Every launch asks for the version, which only changes with the binary, so it is probed once in the background
+      backend_version_probe{mp::execute_async([] {
+          return MP_PROCFACTORY.create_process("qemu-system-" + mp::backend::cpu_arch(), {"--version"});
+      })}
 {
 }
 
 mp::QemuVirtualMachineFactory::~QemuVirtualMachineFactory()
 {
+    backend_version_probe.waitForFinished();
+    QemuVirtualMachine::remove_released_tap_devices();
     delete_virtual_switch(bridge_name);
 }
 
@@ -136,9 +266,13 @@ mp::VirtualMachine::UPtr mp::QemuVirtualMachineFactory::create_virtual_machine(c
                                                                                VMStatusMonitor& monitor)
 {
     auto tap_device_name = generate_tap_device_name(desc.vm_name);
-    create_tap_device(QString::fromStdString(tap_device_name), bridge_name);
 
-    auto vm = std::make_unique<mp::QemuVirtualMachine>(desc, tap_device_name, dnsmasq_server, monitor);
+    // The tap is only set up once qemu's arguments are known, and left alone for a qemu adopted with it open
+    auto vm = std::make_unique<mp::QemuVirtualMachine>(
+        desc, tap_device_name, dnsmasq_server, monitor, placement, memory_merging, [this] { return qemu_traits(); },
+        [this, tap = QString::fromStdString(tap_device_name)](bool multi_queue) {
+            create_tap_device(tap, bridge_name, multi_queue);
+        });
 
     name_to_mac_map.emplace(desc.vm_name, desc.default_mac_address);
     return vm;
@@ -151,12 +285,48 @@ void mp::QemuVirtualMachineFactory::remove_resources_for(const std::string& name
     {
         dnsmasq_server.release_mac(it->second);
     }
+
+    // Those of its qemu and mount processes, which are otherwise kept loaded for as long as the daemon runs
+    MP_PROCFACTORY.unload_policies_for(QString::fromStdString(name));
+}
+
+void mp::QemuVirtualMachineFactory::rename_resources_for(const std::string& from, const std::string& to)
+{
+    // The MAC stays leased; creating the VM again under the new name records it for that name
+    auto it = name_to_mac_map.find(from);
+    if (it != name_to_mac_map.end())
+    {
+        auto mac = std::move(it->second);
+        name_to_mac_map.erase(it);
+        name_to_mac_map[to] = std::move(mac);
+    }
 }
 
-mp::VMImage mp::QemuVirtualMachineFactory::prepare_source_image(const mp::VMImage& source_image)
+void mp::QemuVirtualMachineFactory::clone_suspended_state(const VMImage& source_image, const VMImage& clone_image)
+{
+    // The memory is never written to once migrated out, so every clone can resume off the one file
+    const auto source_state = QemuVMProcessSpec::memory_state_file(source_image.image_path);
+    const auto clone_state = QemuVMProcessSpec::memory_state_file(clone_image.image_path);
+    if (!QFile::exists(source_state))
+        throw std::runtime_error("the instance was suspended into its image, start and suspend it again to clone it");
+
+    QFile::remove(clone_state);
+    if (!MP_PLATFORM.link(QFile::encodeName(source_state).constData(), QFile::encodeName(clone_state).constData()) &&
+        !QFile::copy(source_state, clone_state))
+        throw std::runtime_error(fmt::format("cannot carry the memory of the instance over to {}", clone_state));
+}
+
+mp::FetchType mp::QemuVirtualMachineFactory::fetch_type()
+{
+    // Instances boot their image's kernel directly with local.fast-boot, so it comes along with the image
+    return MP_SETTINGS.get(mp::fast_boot_key) == "true" ? FetchType::ImageKernelAndInitrd : FetchType::ImageOnly;
+}
+
+mp::VMImage mp::QemuVirtualMachineFactory::prepare_source_image(const mp::VMImage& source_image,
+                                                               const ProgressMonitor& monitor)
 {
     VMImage image{source_image};
-    image.image_path = mp::backend::convert_to_qcow_if_necessary(source_image.image_path);
+    image.image_path = mp::backend::convert_to_qcow_if_necessary(source_image.image_path, monitor);
     return image;
 }
 
@@ -166,6 +336,22 @@ void mp::QemuVirtualMachineFactory::prepare_instance_image(const mp::VMImage& in
     mp::backend::resize_instance_image(desc.disk_space, instance_image.image_path);
 }
 
+// qemu runs instances off overlays of images it reads over http(s), for them to boot before the image arrives
+mp::VMImageVault::UPtr mp::QemuVirtualMachineFactory::create_image_vault(std::vector<VMImageHost*> image_hosts,
+                                                                         URLDownloader* downloader,
+                                                                         const Path& cache_dir_path,
+                                                                         const Path& data_dir_path,
+                                                                         const days& days_to_expire)
+{
+    return std::make_unique<DefaultVMImageVault>(image_hosts, downloader, cache_dir_path, data_dir_path,
+                                                 days_to_expire, /*remote_backing_files=*/true);
+}
+
+std::string mp::QemuVirtualMachineFactory::host_address() const
+{
+    return fmt::format("{}.1", subnet);
+}
+
 void mp::QemuVirtualMachineFactory::hypervisor_health_check()
 {
     mp::backend::check_for_kvm_support();
@@ -177,21 +363,21 @@ void mp::QemuVirtualMachineFactory::hypervisor_health_check()
 
 QString mp::QemuVirtualMachineFactory::get_backend_version_string()
 {
-    auto process = MP_PROCFACTORY.create_process("qemu-system-" + mp::backend::cpu_arch(), {"--version"});
+    const auto probe = backend_version_probe.result();
+    const auto& exit_state = probe.state;
 
     auto version_re = QRegularExpression("^QEMU emulator version ([\\d\\.]+)");
-    auto exit_state = process->execute();
 
     if (exit_state.completed_successfully())
     {
-        auto match = version_re.match(process->read_all_standard_output());
+        auto match = version_re.match(probe.standard_output);
 
         if (match.hasMatch())
             return QString("qemu-%1").arg(match.captured(1));
         else
         {
             mpl::log(mpl::Level::error, category,
-                     fmt::format("Failed to parse QEMU version out: '{}'", process->read_all_standard_output()));
+                     fmt::format("Failed to parse QEMU version out: '{}'", probe.standard_output));
             return QString("qemu-unknown");
         }
     }
@@ -206,9 +392,48 @@ QString mp::QemuVirtualMachineFactory::get_backend_version_string()
         {
             mpl::log(mpl::Level::error, category,
                      fmt::format("Qemu fail: '{}' with outputs:\n{}\n{}", exit_state.failure_message(),
-                                 process->read_all_standard_output(), process->read_all_standard_error()));
+                                 probe.standard_output, probe.standard_error));
         }
     }
 
     return QString("qemu-unknown");
 }
+
+mp::QemuVirtualMachine::QemuTraits mp::QemuVirtualMachineFactory::qemu_traits()
+{
+    std::lock_guard<decltype(machine_type_mutex)> lock{machine_type_mutex};
+    if (cached_backend_version.isEmpty())
+        cached_backend_version = get_backend_version_string();
+
+    // Free page reporting came with qemu 5.1, and older versions refuse to start with it, as does virtio-mem. io_uring
+    // needs qemu 5.0 and a 5.1 kernel, falling back to native aio otherwise
+    const auto version = QVersionNumber::fromString(cached_backend_version.mid(QString{"qemu-"}.size()));
+    const auto kernel_version = QVersionNumber::fromString(QSysInfo::kernelVersion());
+    return {machine_type(cached_backend_version),
+            {version >= QVersionNumber{5, 1}, version >= QVersionNumber{5, 0} && kernel_version >= QVersionNumber{5, 1},
+             QFile::exists(vhost_net_device), QFile::exists(vhost_vsock_device), version >= QVersionNumber{5, 1},
+             static_cast<int>(std::thread::hardware_concurrency()),
+             static_cast<long long>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE)}};
+}
+
+// The machine type only changes with the qemu binary, so it is probed once and kept on disk next to the version
+// it came from, sparing every start an extra qemu process
+QString mp::QemuVirtualMachineFactory::machine_type(const QString& backend_version)
+{
+    if (!cached_machine_type.isEmpty())
+        return cached_machine_type;
+
+    const auto known_version = backend_version != unknown_backend_version;
+
+    if (known_version)
+        cached_machine_type = read_machine_type_cache(machine_type_cache_path, backend_version);
+
+    if (cached_machine_type.isEmpty())
+    {
+        cached_machine_type = probe_machine_type();
+        if (known_version && !cached_machine_type.isEmpty())
+            write_machine_type_cache(machine_type_cache_path, backend_version, cached_machine_type);
+    }
+
+    return cached_machine_type;
+}
@@ -18,13 +18,19 @@
 #define MULTIPASS_QEMU_VIRTUAL_MACHINE_FACTORY_H
 
 #include "dnsmasq_server.h"
+#include "qemu_memory_merging.h"
+#include "qemu_placement.h"
 #include "iptables_config.h"
+#include "qemu_virtual_machine.h"
 
 #include <multipass/path.h>
+#include <multipass/process/async_process.h>
 #include <shared/base_virtual_machine_factory.h>
 
+#include <QFuture>
 #include <QString>
 
+#include <mutex>
 #include <string>
 #include <unordered_map>
 
@@ -39,18 +45,43 @@ public:
     VirtualMachine::UPtr create_virtual_machine(const VirtualMachineDescription& desc,
                                                 VMStatusMonitor& monitor) override;
     void remove_resources_for(const std::string& name) override;
-    VMImage prepare_source_image(const VMImage& source_image) override;
+    void rename_resources_for(const std::string& from, const std::string& to) override;
+    bool can_rename_resources() const override
+    {
+        return true;
+    }
+    bool can_limit_io(const IoLimits& limits) const override
+    {
+        return !limits.network_bytes_per_second; // netdev has no rate limit
+    }
+    void clone_suspended_state(const VMImage& source_image, const VMImage& clone_image) override;
+    FetchType fetch_type() override;
+    VMImage prepare_source_image(const VMImage& source_image, const ProgressMonitor& monitor) override;
     void prepare_instance_image(const VMImage& instance_image, const VirtualMachineDescription& desc) override;
     void hypervisor_health_check() override;
     QString get_backend_version_string() override;
+    VMImageVault::UPtr create_image_vault(std::vector<VMImageHost*> image_hosts, URLDownloader* downloader,
+                                          const Path& cache_dir_path, const Path& data_dir_path,
+                                          const days& days_to_expire) override;
+    std::string host_address() const override;
 
 private:
+    QemuVirtualMachine::QemuTraits qemu_traits();
+    QString machine_type(const QString& backend_version);
+
     const QString bridge_name;
     const Path network_dir;
     const std::string subnet;
     DNSMasqServer dnsmasq_server;
     IPTablesConfig iptables_config;
+    QemuPlacement placement;
+    QemuMemoryMerging memory_merging;
     std::unordered_map<std::string, std::string> name_to_mac_map;
+    const QString machine_type_cache_path;
+    QFuture<ProcessOutput> backend_version_probe;
+    std::mutex machine_type_mutex;
+    QString cached_backend_version;
+    QString cached_machine_type;
 };
 } // namespace multipass
 
@@ -17,18 +17,153 @@
 
 #include "qemu_vm_process_spec.h"
 
+#include <multipass/constants.h>
+#include <multipass/disk_image.h>
 #include <multipass/exceptions/snap_environment_exception.h>
 #include <multipass/format.h>
 #include <multipass/logging/log.h>
 #include <multipass/snap_utils.h>
 #include <shared/linux/backend_utils.h>
 
+#include <algorithm>
+#include <cstdint>
+
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 namespace mu = multipass::utils;
 
 namespace
 {
+const auto hugepages_dir = QStringLiteral("/dev/hugepages");
+// What qemu needs on top of the guest memory, for its own code, device state and buffers
+constexpr long long guest_memory_overhead = 256LL * 1024 * 1024;
+// Ubuntu cloud images label their root file system so
+const auto fast_boot_kernel_arguments = QStringLiteral("root=LABEL=cloudimg-rootfs ro console=ttyS0");
+// Where qemu keeps the temporary overlay that takes an ephemeral instance's writes, so that they stay in memory
+const auto ephemeral_overlay_dir = QStringLiteral("/dev/shm");
+// Linux onlines hot-added memory in blocks of this many MiB
+constexpr long long hotplug_memory_block_mb = 128;
+// How many times what it booted with an instance can grow its memory to while it runs; the guest sets aside some of
+// its own memory to describe all that it could be given
+constexpr long long max_memory_growth = 4;
+constexpr long long mib = 1024LL * 1024;
+
+// Value of the option in a comma-separated list of them, e.g. maxcpus in "2,maxcpus=8"
+QString option_value(const QString& arg, const QString& option)
+{
+    for (const auto& opt : arg.split(','))
+        if (opt.startsWith(option + '='))
+            return opt.mid(option.size() + 1);
+
+    return {};
+}
+
+// Sizes are always given to qemu in MiB
+long long megabytes_in(const QString& size)
+{
+    return QString{size}.remove('M').toLongLong();
+}
+
+QString with_option(const QString& arg, const QString& option, const QString& value)
+{
+    auto options = arg.split(',');
+    for (auto& opt : options)
+        if (opt.startsWith(option + '='))
+            opt = option + '=' + value;
+
+    return options.join(',');
+}
+
+// Limits on the instance disk, in the names -drive takes them by
+QString drive_throttling(const mp::IoLimits& limits)
+{
+    QString options;
+    auto add = [&options](const char* name, long long value) {
+        if (value)
+            options += QString(",throttling.%1=%2").arg(name).arg(value);
+    };
+
+    add("iops-total", limits.disk_iops);
+    add("iops-total-max", limits.disk_iops_burst);
+    add("bps-total", limits.disk_bytes_per_second);
+    add("bps-total-max", limits.disk_bytes_burst);
+
+    return options;
+}
+
+unsigned vsock_cid_for(const mp::VirtualMachineDescription& desc, const mp::QemuVMProcessSpec::Placement& placement)
+{
+    return placement.vsock_cid ? placement.vsock_cid : mp::QemuVMProcessSpec::guest_cid(desc.vm_name);
+}
+
+// Saved arguments name the files and tap device the instance had when it was suspended. Those follow the instance
+// when it is handed over to another name, so point them at where they are now.
+QStringList relocated_arguments(QStringList args, const mp::VirtualMachineDescription& desc,
+                                const QString& tap_device_name, const QString& guest_agent_socket, unsigned vsock_cid)
+{
+    for (auto i = 0; i < args.size(); ++i)
+    {
+        auto& arg = args[i];
+        const auto& previous = i > 0 ? args[i - 1] : QString{};
+
+        if (previous == "-hda")
+            arg = desc.image.image_path;
+        else if (previous == "-cdrom")
+            arg = desc.cloud_init_iso;
+        else if (previous == "-kernel" && !desc.image.kernel_path.isEmpty())
+            arg = desc.image.kernel_path;
+        else if (previous == "-initrd" && !desc.image.initrd_path.isEmpty())
+            arg = desc.image.initrd_path;
+        else if (previous == "-drive" && arg.contains(",id=hda"))
+            arg = with_option(arg, "file", desc.image.image_path);
+        else if (previous == "-drive" && arg.contains(",format=raw") && arg.contains(",read-only"))
+            arg = with_option(arg, "file", desc.cloud_init_iso);
+        else if (previous == "-netdev" && arg.startsWith("tap,id=hostnet0,"))
+            arg = with_option(arg, "ifname", tap_device_name);
+        else if (previous == "-chardev" && arg.startsWith("socket,id=qga0,") && !guest_agent_socket.isEmpty())
+            arg = with_option(arg, "path", guest_agent_socket);
+        // A clone resumes off the memory of another instance, but must not come up with its address or vsock id
+        else if (previous == "-device" && arg.startsWith("virtio-net-pci,netdev=hostnet0,"))
+            arg = with_option(arg, "mac", QString::fromStdString(desc.default_mac_address));
+        else if (previous == "-device" && arg.startsWith("vhost-vsock-pci,"))
+            arg = with_option(arg, "guest-cid", QString::number(vsock_cid));
+    }
+
+    return args;
+}
+
+// A qemu run as the daemon's child has its monitor on stdio, one that daemonizes has it on a socket. Saved arguments
+// carry whichever way the instance was booted, so they are turned around to how it runs this time.
+QStringList with_monitor(QStringList args, const mp::optional<mp::QemuVMProcessSpec::Detachment>& detachment)
+{
+    if (!detachment && !args.contains("-daemonize"))
+        return args;
+
+    QStringList kept;
+    for (auto i = 0; i < args.size(); ++i)
+    {
+        const auto& arg = args[i];
+        if (arg == "-qmp" || arg == "-display" || arg == "-monitor" || arg == "-pidfile")
+            ++i; // along with its value
+        else if (arg != "-nographic" && arg != "-daemonize")
+            kept << arg;
+    }
+
+    if (detachment)
+        kept << "-qmp" << QString("unix:%1,server=on,wait=off").arg(detachment->monitor_socket) << "-display"
+             << "none"
+             << "-monitor"
+             << "none"
+             << "-daemonize"
+             << "-pidfile" << detachment->pid_file;
+    else
+        kept << "-qmp"
+             << "stdio"
+             << "-nographic";
+
+    return kept;
+}
+
 // This returns the initial two Qemu command line options we used in Multipass. Only of use to resume old suspended
 // images.
 //  === Do not change this! ===
@@ -72,10 +207,100 @@ QStringList initial_qemu_arguments(const mp::VirtualMachineDescription& desc, co
 }
 } // namespace
 
+QString mp::QemuVMProcessSpec::memory_state_file(const QString& image_path)
+{
+    return image_path + ".memory";
+}
+
+QString mp::QemuVMProcessSpec::pid_file(const QString& image_path)
+{
+    return image_path + ".pid";
+}
+
+QString mp::QemuVMProcessSpec::shell_quote(const QString& path)
+{
+    return "'" + QString{path}.replace("'", "'\\''") + "'";
+}
+
 mp::QemuVMProcessSpec::QemuVMProcessSpec(const mp::VirtualMachineDescription& desc, const QString& tap_device_name,
-                                         const multipass::optional<ResumeData>& resume_data)
-    : desc(desc), tap_device_name(tap_device_name), resume_data{resume_data}
+                                         const multipass::optional<ResumeData>& resume_data,
+                                         const std::vector<SharedDirectory>& shared_directories,
+                                         const HostFeatures& host_features, const Placement& placement,
+                                         const QString& guest_agent_socket,
+                                         const multipass::optional<Detachment>& detachment, bool fast_boot)
+    : desc(desc),
+      tap_device_name(tap_device_name),
+      resume_data{resume_data},
+      shared_directories{shared_directories},
+      host_features{host_features},
+      placement{placement},
+      guest_agent_socket{guest_agent_socket},
+      detachment{detachment},
+      fast_boot{fast_boot && !desc.image.kernel_path.isEmpty()}
+{
+}
+
+unsigned mp::QemuVMProcessSpec::guest_cid(const std::string& vm_name, unsigned attempt)
+{
+    // FNV-1a, which unlike qHash stays the same from one run and Qt version to the next
+    std::uint32_t hash = 2166136261u;
+    for (const auto c : vm_name)
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+
+    return 3 + (hash + attempt) % 0x7ffffffcu;
+}
+
+bool mp::QemuVMProcessSpec::has_remote_backing_file(const QString& image_path)
+{
+    const auto qcow2_info = mp::disk_image::inspect_qcow2(image_path);
+    return qcow2_info && qcow2_info->backing_file.startsWith("https://");
+}
+
+mp::QemuVMProcessSpec::HotplugCapacity mp::QemuVMProcessSpec::hotplug_capacity(const QStringList& arguments)
+{
+    HotplugCapacity capacity;
+    bool hotplug_memory{false};
+    for (auto i = 1; i < arguments.size(); ++i)
+    {
+        const auto& previous = arguments[i - 1];
+        const auto& arg = arguments[i];
+
+        if (previous == "-smp")
+        {
+            const auto max_cores = option_value(arg, "maxcpus");
+            capacity.max_cores = (max_cores.isEmpty() ? arg.section(',', 0, 0) : max_cores).toInt();
+        }
+        else if (previous == "-m")
+        {
+            const auto max_memory = option_value(arg, "maxmem");
+            capacity.boot_memory = megabytes_in(arg.section(',', 0, 0)) * mib;
+            capacity.max_memory = max_memory.isEmpty() ? capacity.boot_memory : megabytes_in(max_memory) * mib;
+        }
+        else if (previous == "-device" && arg.startsWith("virtio-mem-pci,"))
+        {
+            hotplug_memory = true;
+        }
+    }
+
+    // Without a virtio-mem device, the room maxmem leaves is of no use
+    if (!hotplug_memory)
+        capacity.max_memory = capacity.boot_memory;
+
+    return capacity;
+}
+
+int mp::QemuVMProcessSpec::network_queues(const VirtualMachineDescription& desc)
+{
+    return std::max(desc.num_cores, 1);
+}
+
+bool mp::QemuVMProcessSpec::opens_multi_queue_tap(const QStringList& arguments)
 {
+    for (auto i = 1; i < arguments.size(); ++i)
+        if (arguments[i - 1] == "-netdev" && arguments[i].startsWith("tap,id=hostnet0,"))
+            return option_value(arguments[i], "queues").toInt() > 1;
+
+    return false;
 }
 
 QStringList mp::QemuVMProcessSpec::arguments() const
@@ -87,7 +312,8 @@ QStringList mp::QemuVMProcessSpec::arguments() const
         if (resume_data->arguments.length() > 0)
         {
             // arguments used were saved externally, import them
-            args = resume_data->arguments;
+            args = relocated_arguments(resume_data->arguments, desc, tap_device_name, guest_agent_socket,
+                                       vsock_cid_for(desc, placement));
         }
         else
         {
@@ -96,7 +322,10 @@ QStringList mp::QemuVMProcessSpec::arguments() const
         }
 
         // need to append extra arguments for resume
-        args << "-loadvm" << resume_data->suspend_tag;
+        if (resume_data->from_memory_state_file)
+            args << "-incoming" << QString("exec:cat %1").arg(shell_quote(memory_state_file(desc.image.image_path)));
+        else
+            args << "-loadvm" << resume_data->suspend_tag;
 
         QString machine_type = resume_data->machine_type;
         if (!machine_type.isEmpty())
@@ -113,25 +342,78 @@ QStringList mp::QemuVMProcessSpec::arguments() const
     {
         auto mem_size = QString::number(desc.mem_size.in_megabytes()) + 'M'; /* flooring here; format documented in
     `man qemu-system`, under `-m` option; including suffix to avoid relying on default unit */
+        // Room for virtio-mem to plug more memory in later, up to what the host has, within a few times what the
+        // instance booted with. Hugepages would have it all reserved up front
+        auto hotplug_memory_mb = 0LL;
+        if (host_features.virtio_mem && !placement.hugepages)
+            hotplug_memory_mb = std::min(std::max(0LL, host_features.memory / mib - desc.mem_size.in_megabytes()),
+                                         (max_memory_growth - 1) * desc.mem_size.in_megabytes()) /
+                                hotplug_memory_block_mb * hotplug_memory_block_mb;
 
         args << "--enable-kvm";
-        // The VM image itself
-        args << "-device"
-             << "virtio-scsi-pci,id=scsi0"
-             << "-drive" << QString("file=%1,if=none,format=qcow2,discard=unmap,id=hda").arg(desc.image.image_path)
-             << "-device"
-             << "scsi-hd,drive=hda,bus=scsi0.0";
-        // Number of cpu cores
-        args << "-smp" << QString::number(desc.num_cores);
+        // The VM image itself, throttled when the instance has limits, which qmp can change while it runs. What is
+        // read from a remote backing file is kept in the image, so nothing is fetched twice
+        const auto drive_options = drive_throttling(desc.io_limits) +
+                                   (has_remote_backing_file(desc.image.image_path) ? ",copy-on-read=on" : "") +
+                                   (desc.ephemeral ? ",snapshot=on" : "");
+        if (desc.storage_profile == mp::performance_storage_profile)
+        {
+            // An I/O thread of its own and a queue per vCPU take disk requests off qemu's main loop
+            args << "-object"
+                 << "iothread,id=iothread0"
+                 << "-drive"
+                 << QString("file=%1,if=none,format=qcow2,discard=unmap,detect-zeroes=unmap,cache=none,aio=%2,id=hda%3")
+                        .arg(desc.image.image_path)
+                        .arg(host_features.io_uring ? "io_uring" : "native")
+                        .arg(drive_options)
+                 << "-device"
+                 << QString("virtio-blk-pci,drive=hda,iothread=iothread0,num-queues=%1").arg(desc.num_cores);
+        }
+        else
+        {
+            args << "-device"
+                 << "virtio-scsi-pci,id=scsi0"
+                 << "-drive"
+                 << QString("file=%1,if=none,format=qcow2,discard=unmap,id=hda%2")
+                        .arg(desc.image.image_path)
+                        .arg(drive_options)
+                 << "-device"
+                 << "scsi-hd,drive=hda,bus=scsi0.0";
+        }
+        // Number of cpu cores, with room to hot-add up to as many as the host has
+        args << "-smp"
+             << (host_features.cores > desc.num_cores
+                     ? QString("%1,maxcpus=%2").arg(desc.num_cores).arg(host_features.cores)
+                     : QString::number(desc.num_cores));
         // Memory to use for VM
-        args << "-m" << mem_size;
-        // Create a virtual NIC in the VM
+        args << "-m"
+             << (hotplug_memory_mb ? QString("%1,maxmem=%2M")
+                                         .arg(mem_size)
+                                         .arg(desc.mem_size.in_megabytes() + hotplug_memory_mb)
+                                   : mem_size);
+        // Offered to the kernel's samepage merging, which cannot merge pages backed by hugetlbfs
+        if (placement.memory_merge && !placement.hugepages)
+            args << "-machine"
+                 << "mem-merge=on";
+        // Lets the guest report its memory usage, and hand back the pages it frees
+        args << "-device"
+             << QString("virtio-balloon-pci,id=balloon0%1")
+                    .arg(host_features.free_page_reporting ? ",free-page-reporting=on" : "");
+        // Create a virtual NIC in the VM, with MSI-X vectors for each queue pair plus config and control
+        const auto queues = network_queues(desc);
         args << "-device"
-             << QString("virtio-net-pci,netdev=hostnet0,id=net0,mac=%1")
-                    .arg(QString::fromStdString(desc.default_mac_address));
-        // Create tap device to connect to virtual bridge
+             << QString("virtio-net-pci,netdev=hostnet0,id=net0,mac=%1%2")
+                    .arg(QString::fromStdString(desc.default_mac_address))
+                    .arg(queues > 1 ? QString(",mq=on,vectors=%1").arg(2 * queues + 2) : QString());
+        // A socket the host can reach the instance on before, and regardless of, its network coming up
+        if (host_features.vhost_vsock)
+            args << "-device" << QString("vhost-vsock-pci,id=vsock0,guest-cid=%1").arg(vsock_cid_for(desc, placement));
+        // Create tap device to connect to virtual bridge, moving packets in the kernel when vhost-net is there
         args << "-netdev";
-        args << QString("tap,id=hostnet0,ifname=%1,script=no,downscript=no").arg(tap_device_name);
+        args << QString("tap,id=hostnet0,ifname=%1,script=no,downscript=no%2%3")
+                    .arg(tap_device_name)
+                    .arg(host_features.vhost_net ? ",vhost=on" : "")
+                    .arg(queues > 1 ? QString(",queues=%1").arg(queues) : QString());
         // Control interface
         args << "-qmp"
              << "stdio";
@@ -148,9 +430,101 @@ QStringList mp::QemuVMProcessSpec::arguments() const
              << "-nographic";
         // Cloud-init disk
         args << "-cdrom" << desc.cloud_init_iso;
+
+        // Guest memory; vhost-user needs it to be shareable with virtiofsd
+        const auto shared_memory = std::any_of(shared_directories.cbegin(), shared_directories.cend(),
+                                               [](const auto& dir) { return !dir.virtiofs_socket.isEmpty(); });
+        QString memory_backend;
+        if (placement.hugepages)
+            memory_backend = QString("memory-backend-file,id=mem,size=%1,mem-path=%2,prealloc=on%3")
+                                 .arg(mem_size)
+                                 .arg(hugepages_dir)
+                                 .arg(shared_memory ? ",share=on" : "");
+        else if (shared_memory)
+            memory_backend = QString("memory-backend-memfd,id=mem,size=%1,share=on").arg(mem_size);
+        else if (placement.host_node)
+            memory_backend = QString("memory-backend-ram,id=mem,size=%1").arg(mem_size);
+
+        if (!memory_backend.isEmpty())
+        {
+            if (placement.host_node)
+                memory_backend += QString(",host-nodes=%1,policy=bind").arg(*placement.host_node);
+
+            args << "-object" << memory_backend << "-numa"
+                 << "node,memdev=mem";
+        }
+
+        // Only what the guest is asked to plug in is ever allocated, starting with none
+        if (hotplug_memory_mb)
+        {
+            auto hotplug_backend = QString("%1,id=hotmem0,size=%2M%3")
+                                       .arg(shared_memory ? "memory-backend-memfd" : "memory-backend-ram")
+                                       .arg(hotplug_memory_mb)
+                                       .arg(shared_memory ? ",share=on" : "");
+            if (placement.host_node)
+                hotplug_backend += QString(",host-nodes=%1,policy=bind").arg(*placement.host_node);
+
+            args << "-object" << hotplug_backend << "-device"
+                 << QString("virtio-mem-pci,id=vmem0,memdev=hotmem0,requested-size=0%1")
+                        .arg(memory_backend.isEmpty() ? "" : ",node=0");
+        }
+
+        for (auto i = 0u; i < shared_directories.size(); ++i)
+        {
+            const auto& dir = shared_directories[i];
+            const auto tag = QString::fromStdString(dir.mount.tag);
+
+            if (!dir.virtiofs_socket.isEmpty())
+            {
+                args << "-chardev" << QString("socket,id=fs%1,path=%2").arg(i).arg(dir.virtiofs_socket) << "-device"
+                     << QString("vhost-user-fs-pci,chardev=fs%1,tag=%2").arg(i).arg(tag);
+            }
+            else
+            {
+                if (!dir.mount.uid_map.empty() || !dir.mount.gid_map.empty())
+                    mpl::log(mpl::Level::warning, desc.vm_name,
+                             fmt::format("virtiofsd not found, sharing \"{}\" over 9p without any id mapping",
+                                         dir.mount.source_path));
+
+                args << "-virtfs"
+                     << QString("local,path=%1,mount_tag=%2,security_model=passthrough,id=fs%3")
+                            .arg(QString::fromStdString(dir.mount.source_path))
+                            .arg(tag)
+                            .arg(i);
+            }
+        }
+
+        // qemu listens on the socket, for the daemon to reach qemu-guest-agent whenever the instance runs one
+        if (!guest_agent_socket.isEmpty())
+            args << "-chardev" << QString("socket,id=qga0,path=%1,server=on,wait=off").arg(guest_agent_socket)
+                 << "-device"
+                 << "virtio-serial-pci,id=serial0"
+                 << "-device"
+                 << "virtserialport,bus=serial0.0,chardev=qga0,name=org.qemu.guest_agent.0";
+
+        // Skips the firmware and the guest's bootloader, and the default devices that only slow probing down
+        if (fast_boot)
+        {
+            args << "-machine"
+                 << "q35"
+                 << "-nodefaults"
+                 << "-kernel" << desc.image.kernel_path;
+            if (!desc.image.initrd_path.isEmpty())
+                args << "-initrd" << desc.image.initrd_path;
+            args << "-append" << fast_boot_kernel_arguments;
+        }
     }
 
-    return args;
+    return with_monitor(args, detachment);
+}
+
+QProcessEnvironment mp::QemuVMProcessSpec::environment() const
+{
+    auto environment = QemuBaseProcessSpec::environment();
+    if (desc.ephemeral)
+        environment.insert("TMPDIR", ephemeral_overlay_dir);
+
+    return environment;
 }
 
 QString mp::QemuVMProcessSpec::apparmor_profile() const
@@ -162,6 +536,8 @@ profile %1 flags=(attach_disconnected) {
   #include <abstractions/base>
   #include <abstractions/consoles>
   #include <abstractions/nameservice>
+  # for reading remote backing files over https
+  #include <abstractions/ssl_certs>
 
   # required for reading disk images
   capability dac_override,
@@ -179,6 +555,8 @@ profile %1 flags=(attach_disconnected) {
   signal (receive) peer=%2,
 
   /dev/net/tun rw,
+  /dev/vhost-net rw,
+  /dev/vhost-vsock rw,
   /dev/kvm rw,
   /dev/ptmx rw,
   /dev/kqemu rw,
@@ -223,8 +601,9 @@ profile %1 flags=(attach_disconnected) {
 
   # Disk images
   %6 rwk,  # QCow2 filesystem image
+  %6.memory rw,  # memory state, while suspended
   %7 rk,   # cloud-init ISO
-}
+%8}
     )END");
 
     /* Customisations depending on if running inside snap or not */
@@ -244,11 +623,60 @@ profile %1 flags=(attach_disconnected) {
         firmware = "/usr/share/seabios/*";
     }
 
+    // Directories shared over 9p are accessed by qemu itself, those over virtiofs through virtiofsd's socket
+    QString extra_rules;
+    for (const auto& dir : shared_directories)
+    {
+        if (dir.virtiofs_socket.isEmpty())
+            extra_rules +=
+                QString("  %1/ rw,\n  %1/** rwlk,\n").arg(QString::fromStdString(dir.mount.source_path));
+        else
+            extra_rules += QString("  %1 rw,\n").arg(dir.virtiofs_socket);
+    }
+
+    // Guest memory backed by hugetlbfs
+    if (placement.hugepages)
+        extra_rules += QString("  %1/ r,\n  owner %1/** rw,\n").arg(hugepages_dir);
+
+    if (!guest_agent_socket.isEmpty())
+        extra_rules += QString("  %1 rw,\n").arg(guest_agent_socket);
+
+    if (detachment)
+        extra_rules += QString("  %1 rw,\n  %2 rw,\n").arg(detachment->pid_file, detachment->monitor_socket);
+
+    if (fast_boot)
+        for (const auto& path : {desc.image.kernel_path, desc.image.initrd_path})
+            if (!path.isEmpty())
+                extra_rules += QString("  %1 r,\n").arg(path);
+
+    if (desc.ephemeral)
+        extra_rules += QString("  owner %1/vl.* rwk,\n").arg(ephemeral_overlay_dir);
+
     return profile_template.arg(apparmor_profile_name(), signal_peer, firmware, root_dir, program(),
-                                desc.image.image_path, desc.cloud_init_iso);
+                                desc.image.image_path, desc.cloud_init_iso, extra_rules);
 }
 
 QString mp::QemuVMProcessSpec::identifier() const
 {
     return QString::fromStdString(desc.vm_name);
 }
+
+mp::ResourceControls mp::QemuVMProcessSpec::resource_controls() const
+{
+    mp::ResourceControls controls;
+    controls.group = QString::fromStdString(desc.vm_name);
+    controls.leaf = "qemu";
+    // Bigger instances get a bigger share of a busy host, up to what they were given plus room for qemu's own threads
+    controls.cpu_weight = std::min(100 * desc.num_cores, 10000);
+    controls.cpu_max_cores = desc.num_cores + 1;
+    controls.memory_high = desc.mem_size.in_bytes() + guest_memory_overhead;
+    controls.io_weight = desc.storage_profile == mp::performance_storage_profile ? 200 : 100;
+
+    return controls;
+}
+
+// Left running when the daemon stops, to be adopted by the next one
+bool mp::QemuVMProcessSpec::outlives_daemon() const
+{
+    return static_cast<bool>(detachment);
+}
@@ -20,9 +20,12 @@
 
 #include "qemu_base_process_spec.h"
 
+#include <multipass/native_mount.h>
 #include <multipass/optional.h>
 #include <multipass/virtual_machine_description.h>
 
+#include <vector>
+
 namespace multipass
 {
 
@@ -35,22 +38,95 @@ public:
         QString machine_type;
         bool use_cdrom_flag; // to be removed, should be replaced by "arguments"
         QStringList arguments;
+        bool from_memory_state_file{false}; // rather than from the suspend_tag snapshot in the image
+    };
+
+    struct SharedDirectory
+    {
+        NativeMount mount;
+        QString virtiofs_socket; // empty when there is no virtiofsd to serve it, falling back to 9p
+    };
+
+    // What the host and qemu binary support, for instances booting afresh
+    struct HostFeatures
+    {
+        bool free_page_reporting{false};
+        bool io_uring{false}; // for the performance storage profile
+        bool vhost_net{false};
+        bool vhost_vsock{false}; // to reach the instance's sshd without going through its network
+        bool virtio_mem{false}; // to plug memory into running instances, and take it out again
+        // The host's cores, and memory in bytes, that running instances can be resized up to; none when zero
+        int cores{0};
+        long long memory{0};
+    };
+
+    // What an instance booted with the given arguments can be resized to without restarting
+    struct HotplugCapacity
+    {
+        int max_cores{0};
+        long long boot_memory{0}; // bytes, which stay plugged until the next boot
+        long long max_memory{0};
+    };
+
+    struct Placement
+    {
+        multipass::optional<int> host_node; // to take the guest memory from
+        bool hugepages{false};
+        bool memory_merge{false}; // lets the kernel merge guest pages with identical pages of other instances
+        unsigned vsock_cid{0};    // its address on the host's vsock bus, guest_cid()'s first pick when zero
+    };
+
+    // For qemu to daemonize, outliving the daemon, with its monitor on a socket rather than on stdio
+    struct Detachment
+    {
+        QString pid_file;
+        QString monitor_socket;
     };
 
     static QString default_machine_type();
+    // Where a suspended instance's memory is migrated to, next to its image
+    static QString memory_state_file(const QString& image_path);
+    // Where a detached qemu writes its pid, next to its image
+    static QString pid_file(const QString& image_path);
+    // Quotes a path for the shell that qemu runs exec: migrations in
+    static QString shell_quote(const QString& path);
+    // Queue pairs of the instance's tap and NIC, one per vCPU; the tap must be multi-queue when there is more than one
+    static int network_queues(const VirtualMachineDescription& desc);
+    // Whether qemu, run with these arguments, opens the tap with more than one queue
+    static bool opens_multi_queue_tap(const QStringList& arguments);
+    // The instance's vsock address, derived from its name; the first three are reserved for the host. Names can hash
+    // to the same one, so each attempt after the first picks the next address along
+    static unsigned guest_cid(const std::string& vm_name, unsigned attempt = 0);
+    // Whether the image is an overlay still reading from the remote image it was launched off, with local.lazy-boot
+    static bool has_remote_backing_file(const QString& image_path);
+    static HotplugCapacity hotplug_capacity(const QStringList& arguments);
 
     explicit QemuVMProcessSpec(const VirtualMachineDescription& desc, const QString& tap_device_name,
-                               const multipass::optional<ResumeData>& resume_data);
+                               const multipass::optional<ResumeData>& resume_data,
+                               const std::vector<SharedDirectory>& shared_directories = {},
+                               const HostFeatures& host_features = {}, const Placement& placement = {},
+                               const QString& guest_agent_socket = {},
+                               const multipass::optional<Detachment>& detachment = multipass::nullopt,
+                               bool fast_boot = false);
 
     QStringList arguments() const override;
+    QProcessEnvironment environment() const override;
 
     QString apparmor_profile() const override;
     QString identifier() const override;
+    ResourceControls resource_controls() const override;
+    bool outlives_daemon() const override;
 
 private:
     const VirtualMachineDescription desc;
     const QString tap_device_name;
     const multipass::optional<ResumeData> resume_data;
+    const std::vector<SharedDirectory> shared_directories;
+    const HostFeatures host_features;
+    const Placement placement;
+    const QString guest_agent_socket; // empty for no channel to a guest agent
+    const multipass::optional<Detachment> detachment;
+    const bool fast_boot; // straight into the image's kernel, when it has one, on a machine without legacy devices
 };
 
 } // namespace multipass
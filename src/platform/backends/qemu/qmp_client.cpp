@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "qmp_client.h"
+
+#include <multipass/format.h>
+
+#include <QJsonDocument>
+
+#include <stdexcept>
+
+namespace mp = multipass;
+
+mp::QmpClient::QmpClient(Writer writer) : writer{std::move(writer)}
+{
+}
+
+mp::QmpClient::~QmpClient()
+{
+    abandon("qemu monitor closed");
+}
+
+std::future<QJsonObject> mp::QmpClient::execute(const QString& command, const QJsonObject& arguments)
+{
+    PendingReply pending_reply;
+    auto reply = pending_reply.reply.get_future();
+
+    send(command, arguments, std::move(pending_reply));
+    return reply;
+}
+
+void mp::QmpClient::execute(const QString& command, const QJsonObject& arguments, ReplyHandler on_reply)
+{
+    send(command, arguments, {std::promise<QJsonObject>{}, std::move(on_reply)});
+}
+
+std::future<QJsonObject> mp::QmpClient::human_monitor_command(const QString& command_line)
+{
+    return execute("human-monitor-command", {{"command-line", command_line}});
+}
+
+void mp::QmpClient::subscribe(const QString& event, EventHandler handler)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    event_handlers[event].push_back(std::move(handler));
+}
+
+void mp::QmpClient::send(const QString& command, const QJsonObject& arguments, PendingReply pending_reply)
+{
+    QJsonObject qmp;
+    qmp.insert("execute", command);
+    if (!arguments.isEmpty())
+        qmp.insert("arguments", arguments);
+
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        const auto id = next_id++;
+        qmp.insert("id", id);
+        pending.emplace(id, std::move(pending_reply));
+    }
+
+    writer(QJsonDocument(qmp).toJson(QJsonDocument::Compact));
+}
+
+void mp::QmpClient::feed(const QByteArray& output)
+{
+    std::vector<QJsonObject> messages;
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        buffer.append(output);
+
+        // qemu ends each message with a newline and never breaks a line within one
+        int newline;
+        while ((newline = buffer.indexOf('\n')) != -1)
+        {
+            const auto line = buffer.left(newline).trimmed();
+            buffer.remove(0, newline + 1);
+
+            const auto message = QJsonDocument::fromJson(line);
+            if (message.isObject())
+                messages.push_back(message.object());
+        }
+
+        // A message still missing its newline can be complete too
+        const auto rest = QJsonDocument::fromJson(buffer.trimmed());
+        if (rest.isObject())
+        {
+            messages.push_back(rest.object());
+            buffer.clear();
+        }
+    }
+
+    // Outside the lock, so that handlers can send commands of their own
+    for (const auto& message : messages)
+        dispatch(message);
+}
+
+void mp::QmpClient::abandon(const std::string& reason)
+{
+    std::unordered_map<qint64, PendingReply> abandoned;
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        abandoned.swap(pending);
+        buffer.clear();
+    }
+
+    for (auto& entry : abandoned)
+        entry.second.reply.set_exception(std::make_exception_ptr(std::runtime_error(reason)));
+}
+
+void mp::QmpClient::dispatch(const QJsonObject& message)
+{
+    if (message.contains("event"))
+    {
+        std::vector<EventHandler> handlers;
+        {
+            std::lock_guard<decltype(mutex)> lock{mutex};
+            auto it = event_handlers.find(message["event"].toString());
+            if (it != event_handlers.end())
+                handlers = it->second;
+        }
+
+        for (const auto& handler : handlers)
+            handler(message["data"].toObject());
+    }
+    else if (message.contains("id"))
+    {
+        PendingReply pending_reply;
+        {
+            std::lock_guard<decltype(mutex)> lock{mutex};
+            auto it = pending.find(message["id"].toVariant().toLongLong());
+            if (it == pending.end())
+                return;
+
+            pending_reply = std::move(it->second);
+            pending.erase(it);
+        }
+
+        if (message.contains("error"))
+        {
+            const auto error = message["error"].toObject();
+            pending_reply.reply.set_exception(std::make_exception_ptr(std::runtime_error(
+                fmt::format("{}: {}", error["class"].toString(), error["desc"].toString()))));
+        }
+        else
+        {
+            // human-monitor-command returns its output as a string, which is kept under "output"
+            const auto value = message["return"];
+            const auto result = value.isObject() ? value.toObject() : QJsonObject{{"output", value}};
+
+            if (pending_reply.on_reply)
+                pending_reply.on_reply(result);
+            else
+                pending_reply.reply.set_value(result);
+        }
+    }
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_QMP_CLIENT_H
+#define MULTIPASS_QMP_CLIENT_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace multipass
+{
+// Speaks the QEMU Machine Protocol over whatever carries it to and from qemu. Commands are tagged with ids, so that
+// their replies can be awaited, and events are dispatched to the handlers subscribed to them.
+class QmpClient
+{
+public:
+    using Writer = std::function<void(const QByteArray&)>;
+    using EventHandler = std::function<void(const QJsonObject& data)>;
+    using ReplyHandler = std::function<void(const QJsonObject& value)>;
+
+    explicit QmpClient(Writer writer);
+    ~QmpClient();
+
+    // The future holds the command's "return" value, or a std::runtime_error with qemu's description of its failure
+    std::future<QJsonObject> execute(const QString& command, const QJsonObject& arguments = {});
+    std::future<QJsonObject> human_monitor_command(const QString& command_line);
+    // Or has the handler called with the "return" value from whichever thread feeds output in; not at all on failure
+    void execute(const QString& command, const QJsonObject& arguments, ReplyHandler on_reply);
+
+    // Handlers are called from whichever thread feeds output in, in the order they were subscribed
+    void subscribe(const QString& event, EventHandler handler);
+
+    // Takes in output from qemu, which may hold several messages or end half way through one
+    void feed(const QByteArray& output);
+    // Fails every command still waiting for its reply, for when qemu went away
+    void abandon(const std::string& reason);
+
+private:
+    struct PendingReply
+    {
+        std::promise<QJsonObject> reply;
+        ReplyHandler on_reply;
+    };
+
+    void send(const QString& command, const QJsonObject& arguments, PendingReply pending_reply);
+    void dispatch(const QJsonObject& message);
+
+    const Writer writer;
+    std::mutex mutex;
+    QByteArray buffer;
+    qint64 next_id{0};
+    std::unordered_map<qint64, PendingReply> pending;
+    std::map<QString, std::vector<EventHandler>> event_handlers;
+};
+} // namespace multipass
+#endif // MULTIPASS_QMP_CLIENT_H
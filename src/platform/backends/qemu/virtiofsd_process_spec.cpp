@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "virtiofsd_process_spec.h"
+
+#include <multipass/exceptions/snap_environment_exception.h>
+#include <multipass/snap_utils.h>
+
+namespace mp = multipass;
+namespace mu = multipass::utils;
+
+mp::VirtiofsdProcessSpec::VirtiofsdProcessSpec(const QString& program, const std::string& vm_name,
+                                               const mp::NativeMount& mount, const QString& socket_path)
+    : virtiofsd_program{program}, vm_name{vm_name}, mount{mount}, socket_path{socket_path}
+{
+}
+
+QString mp::VirtiofsdProcessSpec::program() const
+{
+    return virtiofsd_program;
+}
+
+QStringList mp::VirtiofsdProcessSpec::arguments() const
+{
+    QStringList args{QString("--socket-path=%1").arg(socket_path),
+                     QString("--shared-dir=%1").arg(QString::fromStdString(mount.source_path)), "--cache=auto"};
+
+    // Same semantics as the SFTP server's maps: files the host id owns appear as owned by the instance id
+    for (const auto& ids : mount.uid_map)
+        args << QString("--translate-uid=map:%1:%2:1").arg(ids.second).arg(ids.first);
+    for (const auto& ids : mount.gid_map)
+        args << QString("--translate-gid=map:%1:%2:1").arg(ids.second).arg(ids.first);
+
+    return args;
+}
+
+mp::logging::Level mp::VirtiofsdProcessSpec::error_log_level() const
+{
+    // virtiofsd logs every request it fails on stderr
+    return mp::logging::Level::debug;
+}
+
+QString mp::VirtiofsdProcessSpec::apparmor_profile() const
+{
+    QString profile_template(R"END(
+#include <tunables/global>
+profile %1 flags=(attach_disconnected) {
+  #include <abstractions/base>
+
+  # for sandboxing the shared directory and for serving files of any owner
+  capability chown,
+  capability dac_override,
+  capability dac_read_search,
+  capability fowner,
+  capability fsetid,
+  capability mknod,
+  capability setfcap,
+  capability setgid,
+  capability setuid,
+  capability sys_admin,
+  capability sys_chroot,
+  capability sys_resource,
+
+  mount,
+  umount,
+  pivot_root,
+
+  # Allow multipassd send virtiofsd signals
+  signal (receive) peer=%2,
+
+  @{PROC}/** r,
+
+  # binary and its libs
+  %3 ixr,
+  %4/{,usr/}lib/{,@{multiarch}/}{,**/}*.so* rm,
+
+  # the shared directory and the vhost-user socket
+  %5/ rw,
+  %5/** rwlk,
+  %6 rw,
+}
+    )END");
+
+    /* Customisations depending on if running inside snap or not */
+    QString root_dir;    // root directory: either "" or $SNAP
+    QString signal_peer; // who can send kill signal to virtiofsd
+
+    try
+    {
+        root_dir = mu::snap_dir();
+        signal_peer = "snap.multipass.multipassd";
+    }
+    catch (const mp::SnapEnvironmentException&)
+    {
+        signal_peer = "unconfined";
+    }
+
+    return profile_template.arg(apparmor_profile_name(), signal_peer, virtiofsd_program, root_dir,
+                                QString::fromStdString(mount.source_path), socket_path);
+}
+
+QString mp::VirtiofsdProcessSpec::identifier() const
+{
+    return QString::fromStdString(vm_name + "." + mount.tag);
+}
+
+// Shares the instance's group, within the limits its qemu process sets on it
+mp::ResourceControls mp::VirtiofsdProcessSpec::resource_controls() const
+{
+    mp::ResourceControls controls;
+    controls.group = QString::fromStdString(vm_name);
+    controls.leaf = "virtiofsd";
+
+    return controls;
+}
@@ -32,14 +32,20 @@ std::vector<std::string> BaseVirtualMachine::get_all_ipv4(const SSHKeyProvider&
 
     if (current_state() == State::running)
     {
+        constexpr auto ip_a_cmd = "ip -brief -family inet address show scope global";
         QString ip_a_output;
 
         try
         {
-            SSHSession session{ssh_hostname(), ssh_port(), ssh_username(), key_provider};
-
-            ip_a_output = QString::fromStdString(
-                mpu::run_in_ssh_session(session, "ip -brief -family inet address show scope global"));
+            if (const auto result = run_in_guest(ip_a_cmd, std::chrono::seconds{5}); result && result->exit_code == 0)
+            {
+                ip_a_output = QString::fromStdString(result->output);
+            }
+            else
+            {
+                SSHSession session{ssh_hostname(), ssh_port(), ssh_username(), key_provider};
+                ip_a_output = QString::fromStdString(mpu::run_in_ssh_session(session, ip_a_cmd));
+            }
 
             QRegularExpression ipv4_re{QStringLiteral("([\\d\\.]+)\\/\\d+\\s*$"), QRegularExpression::MultilineOption};
 
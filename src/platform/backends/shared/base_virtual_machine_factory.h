@@ -44,6 +44,26 @@ public:
         return {};
     };
 
+    void rename_resources_for(const std::string& /*from*/, const std::string& /*to*/) override
+    {
+        throw NotImplementedOnThisBackendException("instance renaming");
+    }
+
+    bool can_rename_resources() const override
+    {
+        return false;
+    }
+
+    bool can_limit_io(const IoLimits& limits) const override
+    {
+        return limits.empty();
+    }
+
+    void clone_suspended_state(const VMImage& /*source_image*/, const VMImage& /*clone_image*/) override
+    {
+        throw NotImplementedOnThisBackendException("cloning suspended instances");
+    }
+
     void prepare_networking(std::vector<NetworkInterface>& /*extra_interfaces*/) override
     {
         // only certain backends need to do anything to prepare networking
@@ -64,6 +84,11 @@ public:
         throw NotImplementedOnThisBackendException("networks");
     };
 
+    std::string host_address() const override
+    {
+        return {};
+    };
+
 };
 } // namespace multipass
 
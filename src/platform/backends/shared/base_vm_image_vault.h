@@ -68,6 +68,11 @@ public:
         return images_info;
     };
 
+    std::vector<std::string> cached_images() override
+    {
+        return {};
+    };
+
 protected:
     virtual VMImageInfo info_for(const Query& query) const
     {
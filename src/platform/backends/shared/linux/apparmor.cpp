@@ -26,8 +26,11 @@
 #include <sys/apparmor.h>
 
 #include <QDir>
+#include <QFile>
 #include <QProcess>
 
+#include <cstdlib>
+
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 
@@ -122,6 +125,25 @@ void mp::AppArmor::remove_policy(const QByteArray& aa_policy) const
     }
 }
 
+QStringList mp::AppArmor::loaded_profiles() const
+{
+    char* mountpoint{nullptr};
+    if (aa_find_mountpoint(&mountpoint) != 0)
+        return {};
+
+    QFile profiles{QDir{QString::fromLocal8Bit(mountpoint)}.filePath("profiles")};
+    std::free(mountpoint);
+    if (!profiles.open(QIODevice::ReadOnly | QIODevice::Text))
+        return {};
+
+    // One "<name> (<mode>)" per line
+    QStringList names;
+    for (const auto& line : QString::fromUtf8(profiles.readAll()).split('\n', QString::SkipEmptyParts))
+        names << line.left(line.lastIndexOf(" ("));
+
+    return names;
+}
+
 void mp::AppArmor::next_exec_under_policy(const QByteArray& aa_policy_name) const
 {
     int ret = aa_change_onexec(aa_policy_name.constData());
@@ -31,6 +31,9 @@ public:
     void load_policy(const QByteArray& aa_policy) const;
     void remove_policy(const QByteArray& aa_policy) const;
 
+    // Names of the profiles loaded in the kernel, including those loaded by earlier daemons
+    QStringList loaded_profiles() const;
+
     void next_exec_under_policy(const QByteArray& aa_policy_name) const;
 
 private:
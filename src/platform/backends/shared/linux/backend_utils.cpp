@@ -18,6 +18,7 @@
 #include "backend_utils.h"
 #include "dbus_wrappers.h"
 #include "process_factory.h"
+#include <multipass/disk_image.h>
 #include <multipass/format.h>
 #include <multipass/logging/log.h>
 #include <multipass/memory_size.h>
@@ -33,6 +34,8 @@
 
 #include <QCoreApplication>
 #include <QDBusMetaType>
+#include <QFile>
+#include <QFileInfo>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QProcess>
@@ -41,17 +44,20 @@
 #include <QSysInfo>
 #include <QtDBus/QtDBus>
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <exception>
 #include <mutex>
 #include <random>
+#include <thread>
 #include <type_traits>
 
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/kvm.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 namespace mp = multipass;
@@ -72,6 +78,20 @@ const auto nm_settings_obj = QStringLiteral("/org/freedesktop/NetworkManager/Set
 const auto nm_settings_ifc = QStringLiteral("org.freedesktop.NetworkManager.Settings");
 const auto nm_connection_ifc = QStringLiteral("org.freedesktop.NetworkManager.Settings.Connection");
 constexpr auto max_bridge_name_len = 15; // maximum number of characters in a bridge name
+constexpr auto max_convert_coroutines = 16; // the most qemu-img convert takes
+
+// The last of the percentages that `qemu-img convert -p` prints as "(12.34/100%)", or -1 when there are none
+int convert_percentage_in(const QByteArray& output)
+{
+    static const QRegularExpression progress{R"(\((\d+)(\.\d+)?/100%\))"};
+
+    int percentage = -1;
+    auto matches = progress.globalMatch(QString::fromUtf8(output));
+    while (matches.hasNext())
+        percentage = matches.next().captured(1).toInt();
+
+    return percentage;
+}
 
 bool subnet_used_locally(const std::string& subnet)
 {
@@ -182,6 +202,34 @@ auto make_bridge_rollback_guard(const mpl::CString& log_category, const mpdbus::
     });
 }
 
+// Maintenance that runs behind the instances, with a fraction of the CPU and disk when the host is busy
+class BackgroundQemuImgProcessSpec : public mp::QemuImgProcessSpec
+{
+public:
+    using QemuImgProcessSpec::QemuImgProcessSpec;
+
+    mp::ResourceControls resource_controls() const override
+    {
+        mp::ResourceControls controls;
+        controls.group = "maintenance";
+        controls.leaf = "qemu-img";
+        controls.cpu_weight = 10;
+        controls.io_weight = 10;
+
+        return controls;
+    }
+};
+
+// What a file takes on disk, holes left out
+long long allocated_bytes(const QString& path)
+{
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0)
+        return 0;
+
+    return static_cast<long long>(st.st_blocks) * 512;
+}
+
 } // namespace
 
 std::string mp::backend::generate_random_subnet()
@@ -223,6 +271,9 @@ std::string mp::backend::get_subnet(const mp::Path& network_dir, const QString&
 
 void mp::backend::resize_instance_image(const MemorySize& disk_space, const mp::Path& image_path)
 {
+    if (mp::disk_image::grow_qcow2(image_path, static_cast<quint64>(disk_space.in_bytes())))
+        return;
+
     auto disk_size = QString::number(disk_space.in_bytes()); // format documented in `man qemu-img` (look for "size")
     QStringList qemuimg_parameters{{"resize", image_path, disk_size}};
     auto qemuimg_process =
@@ -237,10 +288,55 @@ void mp::backend::resize_instance_image(const MemorySize& disk_space, const mp::
     }
 }
 
-mp::Path mp::backend::convert_to_qcow_if_necessary(const mp::Path& image_path)
+long long mp::backend::compact_instance_image(const mp::Path& image_path)
+{
+    // Internal snapshots, a suspended instance's among them, do not survive a conversion, and an overlay still reading
+    // from a remote image is left to fill in first
+    const auto info = mp::disk_image::inspect_qcow2(image_path);
+    if (!info || info->snapshot_count || info->backing_file.contains("://"))
+        return 0;
+
+    const auto compacted_path = image_path + ".compact";
+    QFile::remove(compacted_path); // from a compaction that did not finish
+
+    // Only the clusters the guest still uses are written out, on top of the same backing file if there is one
+    QStringList args{"convert", "-O", "qcow2"};
+    if (!info->backing_file.isEmpty())
+    {
+        const auto backing_path = QFileInfo{image_path}.dir().filePath(info->backing_file);
+        args << "-B" << info->backing_file << "-F" << (mp::disk_image::inspect_qcow2(backing_path) ? "qcow2" : "raw");
+    }
+    args << image_path << compacted_path;
+
+    auto qemuimg_process = mp::platform::make_process(
+        std::make_unique<BackgroundQemuImgProcessSpec>(args, image_path, compacted_path));
+    const auto process_state = qemuimg_process->execute(mp::backend::image_resize_timeout);
+    if (!process_state.completed_successfully())
+    {
+        QFile::remove(compacted_path);
+        throw std::runtime_error(fmt::format("Cannot compact instance image: qemu-img failed ({}) with output:\n{}",
+                                             process_state.failure_message(),
+                                             qemuimg_process->read_all_standard_error()));
+    }
+
+    const auto before = allocated_bytes(image_path), after = allocated_bytes(compacted_path);
+    if (!after || after >= before || !QFile::setPermissions(compacted_path, QFile::permissions(image_path)) ||
+        ::rename(QFile::encodeName(compacted_path).constData(), QFile::encodeName(image_path).constData()) != 0)
+    {
+        QFile::remove(compacted_path);
+        return 0;
+    }
+
+    return before - after;
+}
+
+mp::Path mp::backend::convert_to_qcow_if_necessary(const mp::Path& image_path, const ProgressMonitor& monitor)
 {
     // Check if raw image file, and if so, convert to qcow2 format.
     // TODO: we could support converting from other the image formats that qemu-img can deal with
+    if (mp::disk_image::inspect_qcow2(image_path))
+        return image_path;
+
     const auto qcow2_path{image_path + ".qcow2"};
 
     auto qemuimg_info_spec =
@@ -260,9 +356,25 @@ mp::Path mp::backend::convert_to_qcow_if_necessary(const mp::Path& image_path)
 
     if (image_record["format"].toString() == "raw")
     {
+        // Clusters are read and written by several coroutines at once, in whatever order they complete. qemu-img
+        // leaves the runs of zeroes that raw images are mostly made of unallocated, rather than writing them out.
+        const auto coroutines = std::clamp(static_cast<int>(std::thread::hardware_concurrency()), 1,
+                                           max_convert_coroutines);
         auto qemuimg_convert_spec = std::make_unique<mp::QemuImgProcessSpec>(
-            QStringList{"convert", "-p", "-O", "qcow2", image_path, qcow2_path}, image_path, qcow2_path);
+            QStringList{"convert", "-p", "-m", QString::number(coroutines), "-W", "-O", "qcow2", image_path,
+                        qcow2_path},
+            image_path, qcow2_path);
         auto qemuimg_convert_process = MP_PROCFACTORY.create_process(std::move(qemuimg_convert_spec));
+
+        // The conversion goes on whatever the monitor says, since others may be waiting on the same image
+        int last_percentage = -1;
+        QObject::connect(qemuimg_convert_process.get(), &mp::Process::ready_read_standard_output,
+                         [&qemuimg_convert_process, &monitor, &last_percentage] {
+                             const auto percentage = convert_percentage_in(
+                                 qemuimg_convert_process->read_all_standard_output());
+                             if (percentage > last_percentage)
+                                 monitor(0, last_percentage = percentage);
+                         });
         process_state = qemuimg_convert_process->execute(mp::backend::image_resize_timeout);
 
         if (!process_state.completed_successfully())
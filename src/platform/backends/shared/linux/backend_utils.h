@@ -19,6 +19,7 @@
 #define MULTIPASS_BACKEND_UTILS_H
 
 #include <multipass/path.h>
+#include <multipass/progress_monitor.h>
 
 #include <chrono>
 #include <stdexcept>
@@ -36,7 +37,12 @@ namespace backend
 std::string generate_random_subnet();
 std::string get_subnet(const Path& network_dir, const QString& bridge_name);
 void resize_instance_image(const MemorySize& disk_space, const multipass::Path& image_path);
-Path convert_to_qcow_if_necessary(const Path& image_path);
+// Rewrites a qcow2 image without the clusters its guest freed, returning how many bytes the host got back. Images
+// that are not qcow2, have internal snapshots or still read from a remote image are left alone.
+long long compact_instance_image(const multipass::Path& image_path);
+// Converts raw images to qcow2, leaving out their zeroes. How far along the conversion is goes to monitor as a
+// percentage, under a progress type that is the monitor's own to pick.
+Path convert_to_qcow_if_necessary(const Path& image_path, const ProgressMonitor& monitor = [](int, int) { return true; });
 QString cpu_arch();
 void check_for_kvm_support();
 void check_if_kvm_is_in_use();
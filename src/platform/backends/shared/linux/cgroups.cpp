@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cgroups.h"
+
+#include <multipass/format.h>
+#include <multipass/logging/log.h>
+
+#include <QDir>
+#include <QFile>
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+
+namespace
+{
+constexpr auto category = "cgroups";
+constexpr auto daemon_leaf = "daemon";
+const QStringList wanted_controllers{"cpu", "memory", "io"};
+constexpr long long cpu_period_us = 100000;
+// The daemon outweighs any instance when the host is busy, and keeps enough memory to answer its clients
+constexpr auto daemon_weight = 1000;
+constexpr auto daemon_memory_low = 256LL * 1024 * 1024;
+
+QByteArray read_from(const QString& path)
+{
+    QFile file{path};
+    if (!file.open(QIODevice::ReadOnly))
+        throw mp::CgroupsException(fmt::format("cannot read {}: {}", path, file.errorString()));
+
+    return file.readAll();
+}
+
+void write_to(const QString& path, const QByteArray& value)
+{
+    QFile file{path};
+    if (!file.open(QIODevice::WriteOnly | QIODevice::ExistingOnly) || file.write(value) != value.size())
+        throw mp::CgroupsException(fmt::format("cannot write \"{}\" to {}: {}", value.constData(), path, file.errorString()));
+}
+
+void make_group(const QString& path)
+{
+    if (!QDir().mkpath(path))
+        throw mp::CgroupsException(fmt::format("cannot create {}", path));
+}
+
+QString group_of_this_process(const QString& self_cgroup_file)
+{
+    // The one hierarchy of cgroup v2 is listed as "0::<path>"
+    for (const auto& line : read_from(self_cgroup_file).split('\n'))
+        if (line.startsWith("0::"))
+            return QString::fromUtf8(line.mid(3)).trimmed();
+
+    throw mp::CgroupsException("cgroup v2 is not in use");
+}
+
+QString base_of(const QString& hierarchy_root, const QString& self_cgroup_file)
+{
+    auto group = group_of_this_process(self_cgroup_file);
+    if (group.endsWith(QString{"/"} + daemon_leaf)) // placed by an earlier run
+        group.chop(static_cast<int>(std::strlen(daemon_leaf)) + 1);
+
+    if (group.isEmpty() || group == "/")
+        throw mp::CgroupsException("the daemon runs in the root group");
+
+    return hierarchy_root + group;
+}
+} // namespace
+
+mp::Cgroups::Cgroups(const QString& hierarchy_root, const QString& self_cgroup_file)
+    : base{base_of(hierarchy_root, self_cgroup_file)}
+{
+    const auto available = QString::fromUtf8(read_from(base + "/cgroup.controllers")).simplified().split(' ');
+    for (const auto& controller : wanted_controllers)
+        if (available.contains(controller))
+            controllers << controller;
+
+    if (controllers.isEmpty())
+        throw mp::CgroupsException(fmt::format("none of the {} controllers are available", wanted_controllers.join(", ")));
+
+    // A group cannot both hold processes and hand controllers down, so everything in the base moves to the daemon's leaf
+    const auto daemon_group = base + '/' + daemon_leaf;
+    make_group(daemon_group);
+    for (const auto& pid : read_from(base + "/cgroup.procs").split('\n'))
+        if (!pid.isEmpty())
+            write_to(daemon_group + "/cgroup.procs", pid);
+
+    enable_controllers();
+
+    if (controllers.contains("cpu"))
+        write_to(daemon_group + "/cpu.weight", QByteArray::number(daemon_weight));
+    if (controllers.contains("memory"))
+        write_to(daemon_group + "/memory.low", QByteArray::number(daemon_memory_low));
+    if (controllers.contains("io"))
+        write_to(daemon_group + "/io.weight", "default " + QByteArray::number(daemon_weight));
+
+    mpl::log(mpl::Level::info, category, fmt::format("Placing instances in groups below {}", base));
+}
+
+std::string mp::Cgroups::prepare(const ResourceControls& controls) const
+{
+    const auto group = base + '/' + controls.group;
+    const auto leaf = group + '/' + controls.leaf;
+
+    std::lock_guard<decltype(leaves_mutex)> lock{leaves_mutex};
+    enable_controllers();
+    make_group(leaf);
+    ++leaf_users[leaf];
+
+    if (controllers.contains("cpu"))
+    {
+        if (controls.cpu_weight)
+            write_to(group + "/cpu.weight", QByteArray::number(controls.cpu_weight));
+        if (controls.cpu_max_cores)
+            write_to(group + "/cpu.max",
+                     QByteArray::number(controls.cpu_max_cores * cpu_period_us) + ' ' +
+                         QByteArray::number(cpu_period_us));
+    }
+
+    if (controllers.contains("memory") && controls.memory_high)
+        write_to(group + "/memory.high", QByteArray::number(controls.memory_high));
+
+    if (controllers.contains("io") && controls.io_weight)
+        write_to(group + "/io.weight", "default " + QByteArray::number(controls.io_weight));
+
+    return (leaf + "/cgroup.procs").toStdString();
+}
+
+bool mp::Cgroups::join(const std::string& procs_file) noexcept
+{
+    const auto fd = ::open(procs_file.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    const auto written = ::write(fd, "0", 1); // "0" stands for the writing process
+    ::close(fd);
+
+    return written == 1;
+}
+
+void mp::Cgroups::release(const ResourceControls& controls) const
+{
+    const auto group = base + '/' + controls.group;
+    const auto leaf = group + '/' + controls.leaf;
+
+    // A leaf removed while others are yet to join it would leave them in the daemon's group
+    std::lock_guard<decltype(leaves_mutex)> lock{leaves_mutex};
+    auto it = leaf_users.find(leaf);
+    if (it != leaf_users.end() && --it->second > 0)
+        return;
+    if (it != leaf_users.end())
+        leaf_users.erase(it);
+
+    // Groups that still hold processes, or leaves of other processes, refuse to go
+    QDir{}.rmdir(leaf);
+    QDir{}.rmdir(group);
+}
+
+void mp::Cgroups::enable_controllers() const
+{
+    // Unless the unit running the daemon delegates its group, systemd may take the controllers back on a reload, so
+    // they are handed down again before every placement
+    QByteArray enabled;
+    for (const auto& controller : controllers)
+        enabled += (enabled.isEmpty() ? "+" : " +") + controller.toLatin1();
+    write_to(base + "/cgroup.subtree_control", enabled);
+}
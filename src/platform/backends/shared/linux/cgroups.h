@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_CGROUPS_H
+#define MULTIPASS_CGROUPS_H
+
+#include <multipass/process/process_spec.h>
+
+#include <QString>
+#include <QStringList>
+
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+namespace multipass
+{
+
+// Places the processes an instance needs in a cgroup v2 group of their own, below the one the daemon was started in,
+// so that the host scheduler weighs instances against each other and a busy instance cannot starve the daemon. The
+// daemon moves to a leaf of its own, weighted well above any instance
+class Cgroups
+{
+public:
+    // Takes the daemon's group from self_cgroup_file and enables the controllers below it
+    explicit Cgroups(const QString& hierarchy_root = "/sys/fs/cgroup",
+                     const QString& self_cgroup_file = "/proc/self/cgroup");
+
+    // Creates the group and leaf in controls, applying its limits, and returns the file to join the leaf through. Every
+    // call is to be matched by one to release()
+    std::string prepare(const ResourceControls& controls) const;
+    // Moves the calling process to the leaf whose procs file prepare() gave. Only async-signal-safe calls are made,
+    // so that a forked child can join before it executes the program
+    static bool join(const std::string& procs_file) noexcept;
+    // Removes the leaf once the last process it was prepared for is done with it and, when nothing else is left in
+    // it, the group
+    void release(const ResourceControls& controls) const;
+
+private:
+    void enable_controllers() const;
+
+    const QString base;
+    QStringList controllers; // those of cpu, memory and io that the host has
+    mutable std::mutex leaves_mutex;
+    // Processes of a kind share a leaf, which must outlive the last of them to join it
+    mutable std::map<QString, int> leaf_users; // leaf path -> processes prepared for it and not yet released
+};
+
+class CgroupsException : public std::runtime_error
+{
+public:
+    CgroupsException(const std::string& msg) : runtime_error{msg}
+    {
+    }
+};
+
+} // namespace multipass
+
+#endif // MULTIPASS_CGROUPS_H
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2018-2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "netlink.h"
+
+#include <multipass/format.h>
+
+#include <QFile>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <linux/if_link.h>
+#include <linux/if_tun.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace mp = multipass;
+
+namespace
+{
+template <typename T>
+T* append(std::vector<char>& buffer, std::size_t size = sizeof(T))
+{
+    const auto offset = buffer.size();
+    buffer.resize(offset + NLMSG_ALIGN(size));
+
+    return reinterpret_cast<T*>(buffer.data() + offset);
+}
+
+void append_attribute(std::vector<char>& buffer, uint16_t type, const void* data, std::size_t size)
+{
+    auto attribute = append<rtattr>(buffer, RTA_LENGTH(size));
+    attribute->rta_type = type;
+    attribute->rta_len = RTA_LENGTH(size);
+    std::memcpy(RTA_DATA(attribute), data, size);
+}
+
+void append_attribute(std::vector<char>& buffer, uint16_t type, const QString& value)
+{
+    const auto bytes = value.toLocal8Bit();
+    append_attribute(buffer, type, bytes.constData(), bytes.size() + 1); // including the terminating null
+}
+
+unsigned int index_of(const QString& name)
+{
+    const auto index = if_nametoindex(name.toLocal8Bit().constData());
+    if (index == 0)
+        throw std::runtime_error(fmt::format("Cannot find network link {}: {}", name, std::strerror(errno)));
+
+    return index;
+}
+
+std::vector<unsigned char> mac_address_bytes(const std::string& mac_address)
+{
+    std::vector<unsigned char> bytes;
+    for (const auto& octet : QString::fromStdString(mac_address).split(':'))
+        bytes.push_back(static_cast<unsigned char>(octet.toUInt(nullptr, 16)));
+
+    return bytes;
+}
+
+in_addr ipv4_address(const std::string& address)
+{
+    in_addr parsed{};
+    if (inet_pton(AF_INET, address.c_str(), &parsed) != 1)
+        throw std::runtime_error(fmt::format("Invalid IPv4 address: {}", address));
+
+    return parsed;
+}
+
+class NetlinkSocket
+{
+public:
+    NetlinkSocket() : fd{socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE)}
+    {
+        if (fd < 0)
+            throw std::runtime_error(fmt::format("Cannot open a netlink socket: {}", std::strerror(errno)));
+    }
+
+    ~NetlinkSocket()
+    {
+        close(fd);
+    }
+
+    const int fd;
+};
+} // namespace
+
+auto mp::backend::NetlinkBatch::add_message(uint16_t type, uint16_t flags, std::string description) -> Message&
+{
+    messages.push_back({{}, std::move(description)});
+    auto& message = messages.back();
+
+    auto header = append<nlmsghdr>(message.buffer);
+    header->nlmsg_type = type;
+    header->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+
+    return message;
+}
+
+mp::backend::NetlinkBatch& mp::backend::NetlinkBatch::add_link(const QString& name, const QString& kind,
+                                                               const std::string& mac_address)
+{
+    auto& buffer =
+        add_message(RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL, fmt::format("add {} link {}", kind, name)).buffer;
+    append<ifinfomsg>(buffer)->ifi_family = AF_UNSPEC;
+    append_attribute(buffer, IFLA_IFNAME, name);
+
+    if (!mac_address.empty())
+    {
+        const auto bytes = mac_address_bytes(mac_address);
+        append_attribute(buffer, IFLA_ADDRESS, bytes.data(), bytes.size());
+    }
+
+    // The kind goes in a nested attribute, which is sized once its contents are in
+    const auto link_info_offset = buffer.size();
+    append_attribute(buffer, IFLA_LINKINFO, nullptr, 0);
+    append_attribute(buffer, IFLA_INFO_KIND, kind.toLocal8Bit().constData(), kind.toLocal8Bit().size());
+    reinterpret_cast<rtattr*>(buffer.data() + link_info_offset)->rta_len = buffer.size() - link_info_offset;
+
+    return *this;
+}
+
+mp::backend::NetlinkBatch& mp::backend::NetlinkBatch::delete_link(const QString& name)
+{
+    auto& buffer = add_message(RTM_DELLINK, 0, fmt::format("delete link {}", name)).buffer;
+    append<ifinfomsg>(buffer)->ifi_family = AF_UNSPEC;
+    append_attribute(buffer, IFLA_IFNAME, name);
+
+    return *this;
+}
+
+mp::backend::NetlinkBatch& mp::backend::NetlinkBatch::set_master(const QString& name, const QString& master)
+{
+    const uint32_t master_index = index_of(master);
+
+    auto& buffer = add_message(RTM_NEWLINK, 0, fmt::format("set master of {} to {}", name, master)).buffer;
+    append<ifinfomsg>(buffer)->ifi_family = AF_UNSPEC;
+    append_attribute(buffer, IFLA_IFNAME, name);
+    append_attribute(buffer, IFLA_MASTER, &master_index, sizeof(master_index));
+
+    return *this;
+}
+
+mp::backend::NetlinkBatch& mp::backend::NetlinkBatch::set_up(const QString& name)
+{
+    auto& buffer = add_message(RTM_NEWLINK, 0, fmt::format("set {} up", name)).buffer;
+    auto info = append<ifinfomsg>(buffer);
+    info->ifi_family = AF_UNSPEC;
+    info->ifi_flags = IFF_UP;
+    info->ifi_change = IFF_UP;
+    append_attribute(buffer, IFLA_IFNAME, name);
+
+    return *this;
+}
+
+mp::backend::NetlinkBatch& mp::backend::NetlinkBatch::add_address(const QString& name, const std::string& cidr,
+                                                                  const std::string& broadcast)
+{
+    const auto separator = cidr.find('/');
+    const auto local = ipv4_address(cidr.substr(0, separator));
+    const auto broadcast_address = ipv4_address(broadcast);
+    const auto index = index_of(name);
+
+    auto& buffer =
+        add_message(RTM_NEWADDR, NLM_F_CREATE | NLM_F_REPLACE, fmt::format("add address {} to {}", cidr, name)).buffer;
+    auto address = append<ifaddrmsg>(buffer);
+    address->ifa_family = AF_INET;
+    address->ifa_prefixlen = separator == std::string::npos ? 32 : std::stoi(cidr.substr(separator + 1));
+    address->ifa_index = index;
+    append_attribute(buffer, IFA_LOCAL, &local, sizeof(local));
+    append_attribute(buffer, IFA_ADDRESS, &local, sizeof(local));
+    append_attribute(buffer, IFA_BROADCAST, &broadcast_address, sizeof(broadcast_address));
+
+    return *this;
+}
+
+void mp::backend::NetlinkBatch::commit()
+{
+    if (messages.empty())
+        return;
+
+    NetlinkSocket netlink;
+    std::vector<char> batch;
+    for (auto i = 0u; i < messages.size(); ++i)
+    {
+        auto& buffer = messages[i].buffer;
+        auto header = reinterpret_cast<nlmsghdr*>(buffer.data());
+        header->nlmsg_len = buffer.size();
+        header->nlmsg_seq = i + 1;
+        batch.insert(batch.end(), buffer.begin(), buffer.end());
+    }
+
+    sockaddr_nl kernel{};
+    kernel.nl_family = AF_NETLINK;
+    if (sendto(netlink.fd, batch.data(), batch.size(), 0, reinterpret_cast<sockaddr*>(&kernel), sizeof(kernel)) < 0)
+        throw std::runtime_error(fmt::format("Cannot send to netlink: {}", std::strerror(errno)));
+
+    // Every change is acknowledged, with the error it ran into if any
+    std::string first_error;
+    auto acks = 0u;
+    alignas(nlmsghdr) char reply[8192];
+    while (acks < messages.size())
+    {
+        auto len = recv(netlink.fd, reply, sizeof(reply), 0);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error(fmt::format("Cannot receive from netlink: {}", std::strerror(errno)));
+        }
+
+        for (auto header = reinterpret_cast<nlmsghdr*>(reply); NLMSG_OK(header, static_cast<unsigned int>(len));
+             header = NLMSG_NEXT(header, len))
+        {
+            if (header->nlmsg_type != NLMSG_ERROR)
+                continue;
+
+            ++acks;
+            const auto error = reinterpret_cast<nlmsgerr*>(NLMSG_DATA(header))->error;
+            if (error != 0 && first_error.empty() && header->nlmsg_seq > 0 && header->nlmsg_seq <= messages.size())
+                first_error = fmt::format("Cannot {}: {}", messages[header->nlmsg_seq - 1].description,
+                                          std::strerror(-error));
+        }
+    }
+
+    messages.clear();
+    if (!first_error.empty())
+        throw std::runtime_error(first_error);
+}
+
+bool mp::backend::link_exists(const QString& name)
+{
+    return if_nametoindex(name.toLocal8Bit().constData()) != 0;
+}
+
+void mp::backend::create_tap(const QString& name, bool multi_queue)
+{
+    const auto fd = open("/dev/net/tun", O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error(fmt::format("Cannot open /dev/net/tun: {}", std::strerror(errno)));
+
+    ifreq request{};
+    std::strncpy(request.ifr_name, name.toLocal8Bit().constData(), IFNAMSIZ - 1);
+    request.ifr_flags = IFF_TAP | IFF_NO_PI | (multi_queue ? IFF_MULTI_QUEUE : 0);
+
+    // The device stays once the descriptor is closed, for qemu to open it
+    const auto created = ioctl(fd, TUNSETIFF, &request) == 0 && ioctl(fd, TUNSETPERSIST, 1) == 0;
+    const auto error = errno;
+    close(fd);
+
+    if (!created)
+        throw std::runtime_error(fmt::format("Cannot create tap device {}: {}", name, std::strerror(error)));
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2018-2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_NETLINK_H
+#define MULTIPASS_NETLINK_H
+
+#include <QString>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace multipass
+{
+namespace backend
+{
+// Changes network links and addresses over rtnetlink. The changes in a batch are sent to the kernel in one go and
+// applied in the order they were added. Masters and the links addresses go on are looked up as the change is added,
+// so they must exist by then; anything created in the same batch cannot be referred to that way.
+class NetlinkBatch
+{
+public:
+    NetlinkBatch& add_link(const QString& name, const QString& kind, const std::string& mac_address = {});
+    NetlinkBatch& delete_link(const QString& name);
+    NetlinkBatch& set_master(const QString& name, const QString& master);
+    NetlinkBatch& set_up(const QString& name);
+    NetlinkBatch& add_address(const QString& name, const std::string& cidr, const std::string& broadcast);
+
+    // Throws with the first change the kernel refused, after all of them were tried
+    void commit();
+
+private:
+    struct Message
+    {
+        std::vector<char> buffer;
+        std::string description;
+    };
+
+    Message& add_message(uint16_t type, uint16_t flags, std::string description);
+
+    std::vector<Message> messages;
+};
+
+bool link_exists(const QString& name);
+
+// Creates a persistent tap device, the way `ip tuntap add <name> mode tap` does
+void create_tap(const QString& name, bool multi_queue);
+} // namespace backend
+} // namespace multipass
+#endif // MULTIPASS_NETLINK_H
@@ -25,19 +25,60 @@
 #include <multipass/process/simple_process_spec.h>
 #include <multipass/snap_utils.h>
 
+#include <unistd.h>
+
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 
 namespace
 {
-class AppArmoredProcess : public mp::BasicProcess
+// Joins the cgroup leaf prepared for it, if any, before executing the program
+class PlacedProcess : public mp::BasicProcess
 {
 public:
-    AppArmoredProcess(const mp::AppArmor& aa, std::shared_ptr<mp::ProcessSpec> spec)
-        : mp::BasicProcess{spec}, apparmor{aa}
+    PlacedProcess(std::shared_ptr<mp::ProcessSpec> spec, const mp::Cgroups* cgroups, std::string procs_file)
+        : mp::BasicProcess{spec}, procs_file{std::move(procs_file)}
+    {
+        if (cgroups && !this->procs_file.empty())
+        {
+            // A process that never starts never finishes either
+            connect(this, &PlacedProcess::finished, [this, cgroups](const mp::ProcessState&) { release(cgroups); });
+            connect(this, &PlacedProcess::error_occurred,
+                    [this, cgroups](QProcess::ProcessError error, const QString&) {
+                        if (error == QProcess::FailedToStart)
+                            release(cgroups);
+                    });
+        }
+    }
+
+    void setup_child_process() override
+    {
+        mp::BasicProcess::setup_child_process();
+
+        // Nothing can be logged from here; a child that fails to join is left in the daemon's group
+        if (!procs_file.empty())
+            mp::Cgroups::join(procs_file);
+    }
+
+private:
+    void release(const mp::Cgroups* cgroups)
     {
-        apparmor.load_policy(process_spec->apparmor_profile().toLatin1());
+        if (!released)
+            cgroups->release(process_spec->resource_controls());
+        released = true;
+    }
 
+    const std::string procs_file;
+    bool released{false};
+};
+
+class AppArmoredProcess : public PlacedProcess
+{
+public:
+    AppArmoredProcess(const mp::AppArmor& aa, std::shared_ptr<mp::ProcessSpec> spec, const mp::Cgroups* cgroups,
+                      std::string procs_file)
+        : PlacedProcess{spec, cgroups, std::move(procs_file)}, apparmor{aa}
+    {
         connect(this, &AppArmoredProcess::state_changed, [this](QProcess::ProcessState state) {
             if (state == QProcess::Starting)
             {
@@ -49,24 +90,11 @@ public:
 
     void setup_child_process() final
     {
-        mp::BasicProcess::setup_child_process();
+        PlacedProcess::setup_child_process();
 
         apparmor.next_exec_under_policy(process_spec->apparmor_profile_name().toLatin1());
     }
 
-    ~AppArmoredProcess()
-    {
-        try
-        {
-            apparmor.remove_policy(process_spec->apparmor_profile().toLatin1());
-        }
-        catch (const std::exception& e)
-        {
-            // It's not considered an error when an apparmor cannot be removed
-            mpl::log(mpl::Level::info, "apparmor", e.what());
-        }
-    }
-
 private:
     const mp::AppArmor& apparmor;
 };
@@ -97,34 +125,89 @@ mp::optional<mp::AppArmor> create_apparmor()
         return mp::nullopt;
     }
 }
+
+mp::optional<mp::Cgroups> create_cgroups()
+{
+    if (qEnvironmentVariableIsSet("DISABLE_CGROUPS"))
+    {
+        mpl::log(mpl::Level::warning, "cgroups", "Cgroups disabled by environment variable");
+        return mp::nullopt;
+    }
+
+    if (geteuid() != 0) // only the daemon, running as root, places processes
+        return mp::nullopt;
+
+    try
+    {
+        return mp::optional<mp::Cgroups>{mp::in_place}; // built in place, its leaf bookkeeping staying put
+    }
+    catch (const mp::CgroupsException& e)
+    {
+        mpl::log(mpl::Level::warning, "cgroups", fmt::format("Failed to place instances in cgroups: {}", e.what()));
+        return mp::nullopt;
+    }
+}
 } // namespace
 
 mp::ProcessFactory::ProcessFactory(const Singleton<ProcessFactory>::PrivatePass& pass)
-    : Singleton<ProcessFactory>::Singleton{pass}, apparmor{create_apparmor()}
+    : Singleton<ProcessFactory>::Singleton{pass}, apparmor{create_apparmor()}, cgroups{create_cgroups()}
 {
 }
 
+mp::ProcessFactory::~ProcessFactory()
+{
+    for (const auto& policy : loaded_policies)
+    {
+        if (lasting_policies.count(policy.first))
+            continue;
+
+        try
+        {
+            apparmor->remove_policy(policy.second);
+        }
+        catch (const std::exception& e)
+        {
+            // It's not considered an error when an apparmor cannot be removed
+            mpl::log(mpl::Level::info, "apparmor", e.what());
+        }
+    }
+}
+
 // This is the default ProcessFactory that creates a Process with no security mechanisms enabled
 std::unique_ptr<mp::Process> mp::ProcessFactory::create_process(std::unique_ptr<mp::ProcessSpec>&& process_spec) const
 {
-    if (apparmor && !process_spec->apparmor_profile().isNull())
+    std::shared_ptr<ProcessSpec> spec = std::move(process_spec);
+    const auto cgroups_ptr = cgroups ? &cgroups.value() : nullptr;
+
+    std::string procs_file;
+    const auto controls = spec->resource_controls();
+    if (cgroups && !controls.group.isEmpty())
+    {
+        try
+        {
+            procs_file = cgroups->prepare(controls);
+        }
+        catch (const mp::CgroupsException& e)
+        {
+            mpl::log(mpl::Level::warning, "cgroups", e.what());
+        }
+    }
+
+    if (apparmor && !spec->apparmor_profile().isNull())
     {
-        std::shared_ptr<ProcessSpec> spec = std::move(process_spec);
         try
         {
-            return std::make_unique<AppArmoredProcess>(apparmor.value(), spec);
+            load_policy_once(*spec);
+            return std::make_unique<AppArmoredProcess>(apparmor.value(), spec, cgroups_ptr, procs_file);
         }
         catch (const mp::AppArmorException& e)
         {
             // TODO: This won't fly in strict mode (#1074), since we'll be confined by snapd
             mpl::log(mpl::Level::warning, "apparmor", e.what());
-            return std::make_unique<BasicProcess>(spec);
         }
     }
-    else
-    {
-        return std::make_unique<BasicProcess>(std::move(process_spec));
-    }
+
+    return std::make_unique<PlacedProcess>(spec, cgroups_ptr, procs_file);
 }
 
 std::unique_ptr<mp::Process> mp::ProcessFactory::create_process(const QString& command,
@@ -132,3 +215,68 @@ std::unique_ptr<mp::Process> mp::ProcessFactory::create_process(const QString& c
 {
     return create_process(simple_process_spec(command, arguments));
 }
+
+void mp::ProcessFactory::unload_policies_for(const QString& identifier) const
+{
+    if (!apparmor)
+        return;
+
+    // Profiles are named after the identifier and then the executable, as in ProcessSpec::apparmor_profile_name()
+    const auto prefix = "multipass." + identifier + '.';
+
+    std::lock_guard<decltype(policy_mutex)> lock{policy_mutex};
+    for (auto it = loaded_policies.begin(); it != loaded_policies.end();)
+    {
+        if (!it->first.startsWith(prefix))
+        {
+            ++it;
+            continue;
+        }
+
+        try
+        {
+            apparmor->remove_policy(it->second);
+        }
+        catch (const std::exception& e)
+        {
+            // It's not considered an error when an apparmor cannot be removed
+            mpl::log(mpl::Level::info, "apparmor", e.what());
+        }
+
+        lasting_policies.erase(it->first);
+        it = loaded_policies.erase(it);
+    }
+
+    // Those loaded by earlier daemons, for processes that outlived them, are only known to the kernel
+    for (const auto& name : apparmor->loaded_profiles())
+    {
+        if (!name.startsWith(prefix))
+            continue;
+
+        try
+        {
+            apparmor->remove_policy(QString("profile \"%1\" {}").arg(name).toUtf8()); // removal goes by name alone
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::info, "apparmor", e.what());
+        }
+    }
+}
+
+void mp::ProcessFactory::load_policy_once(const ProcessSpec& process_spec) const
+{
+    const auto name = process_spec.apparmor_profile_name();
+    const auto policy = process_spec.apparmor_profile().toLatin1();
+
+    std::lock_guard<decltype(policy_mutex)> lock{policy_mutex};
+    if (process_spec.outlives_daemon())
+        lasting_policies.insert(name);
+
+    auto it = loaded_policies.find(name);
+    if (it != loaded_policies.end() && it->second == policy)
+        return;
+
+    apparmor->load_policy(policy); // replaces whatever was loaded under the same name
+    loaded_policies[name] = policy;
+}
@@ -18,9 +18,13 @@
 #ifndef MULTIPASS_PROCESS_FACTORY_H
 #define MULTIPASS_PROCESS_FACTORY_H
 
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
 
 #include "apparmor.h"
+#include "cgroups.h"
 #include <multipass/optional.h>
 #include <multipass/process/process_spec.h>
 #include <multipass/singleton.h>
@@ -35,12 +39,23 @@ class ProcessFactory : public Singleton<ProcessFactory>
 {
 public:
     ProcessFactory(const Singleton<ProcessFactory>::PrivatePass&);
+    ~ProcessFactory();
 
     virtual std::unique_ptr<Process> create_process(std::unique_ptr<ProcessSpec>&& process_spec) const;
     std::unique_ptr<Process> create_process(const QString& command, const QStringList& args = QStringList()) const;
 
+    // Unloads the policies of the processes that ran with this identifier, once they are gone for good
+    void unload_policies_for(const QString& identifier) const;
+
 private:
+    void load_policy_once(const ProcessSpec& process_spec) const;
+
     const multipass::optional<AppArmor> apparmor;
+    const multipass::optional<Cgroups> cgroups;
+    mutable std::mutex policy_mutex;
+    // Policies stay loaded between processes, so that respawning a process with the same policy skips the parser
+    mutable std::map<QString, QByteArray> loaded_policies; // profile name -> policy text
+    mutable std::set<QString> lasting_policies;            // left loaded for processes that outlive the daemon
 };
 
 } // namespace multipass
@@ -60,17 +60,25 @@ QString mp::SSHFSServerProcessSpec::program() const
 
 QStringList mp::SSHFSServerProcessSpec::arguments() const
 {
-    return QStringList() << QString::fromStdString(config.host) << QString::number(config.port)
-                         << QString::fromStdString(config.username) << QString::fromStdString(config.source_path)
-                         << QString::fromStdString(config.target_path) << serialise_id_map(config.uid_map)
-                         << serialise_id_map(config.gid_map)
-                         << QString::number(static_cast<int>(mp::logging::get_logging_level()));
+    auto arguments = QStringList() << QString::fromStdString(config.host) << QString::number(config.port)
+                                   << QString::fromStdString(config.username)
+                                   << QString::fromStdString(config.source_path)
+                                   << QString::fromStdString(config.target_path) << serialise_id_map(config.uid_map)
+                                   << serialise_id_map(config.gid_map);
+
+    for (const auto& mount : config.additional_mounts)
+        arguments << QString::fromStdString(mount.source_path) << QString::fromStdString(mount.target_path)
+                  << serialise_id_map(mount.uid_map) << serialise_id_map(mount.gid_map);
+
+    return arguments << QString::number(static_cast<int>(mp::logging::get_logging_level()));
 }
 
 QProcessEnvironment mp::SSHFSServerProcessSpec::environment() const
 {
     QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
     env.insert("KEY", QString::fromStdString(config.private_key));
+    env.insert("COMPRESSION", QString::number(config.compression));
+    env.insert("COMPRESSION_LEVEL", QString::number(config.compression_level));
     return env;
 }
 
@@ -118,7 +126,7 @@ profile %1 flags=(attach_disconnected) {
     # allow full access just to this user-specified source directory on the host
     %4/ rw,
     %4/** rwlk,
-}
+%5}
     )END");
 
     /* Customisations depending on if running inside snap or not */
@@ -139,11 +147,25 @@ profile %1 flags=(attach_disconnected) {
         signal_peer = "unconfined";
     }
 
+    QString additional_sources; // likewise for the other directories the process serves
+    for (const auto& mount : config.additional_mounts)
+        additional_sources += QString("    %1/ rw,\n    %1/** rwlk,\n").arg(QString::fromStdString(mount.source_path));
+
     return profile_template.arg(apparmor_profile_name(), signal_peer, root_dir,
-                                QString::fromStdString(config.source_path));
+                                QString::fromStdString(config.source_path), additional_sources);
 }
 
 QString mp::SSHFSServerProcessSpec::identifier() const
 {
     return QString::fromStdString(config.instance) + "." + target_hash;
 }
+
+// Shares the instance's group, within the limits its backend sets on it
+mp::ResourceControls mp::SSHFSServerProcessSpec::resource_controls() const
+{
+    mp::ResourceControls controls;
+    controls.group = QString::fromStdString(config.instance);
+    controls.leaf = "sshfs";
+
+    return controls;
+}
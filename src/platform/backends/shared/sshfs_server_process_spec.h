@@ -37,6 +37,7 @@ public:
 
     QString apparmor_profile() const override;
     QString identifier() const override;
+    ResourceControls resource_controls() const override;
 
 private:
     const SSHFSServerConfig config;
@@ -17,8 +17,11 @@
 
 #include "journald_logger.h"
 
+#include <multipass/format.h>
+
 #define SD_JOURNAL_SUPPRESS_LOCATION
 #include <syslog.h>
+#include <sys/uio.h>
 #include <systemd/sd-journal.h>
 
 namespace mpl = multipass::logging;
@@ -41,17 +44,77 @@ constexpr auto to_syslog_priority(const mpl::Level& level) noexcept
     }
     return 42;
 }
+
+void send(int priority, const std::string& category, const std::string& message)
+{
+    const auto priority_field = fmt::format("PRIORITY={}", priority);
+    const auto category_field = "CATEGORY=" + category;
+    const auto message_field = "MESSAGE=" + message;
+
+    // sd_journal_sendv takes the fields as they are, sparing the formatting that sd_journal_send does
+    const iovec fields[] = {{const_cast<char*>(message_field.data()), message_field.size()},
+                            {const_cast<char*>(priority_field.data()), priority_field.size()},
+                            {const_cast<char*>(category_field.data()), category_field.size()}};
+    sd_journal_sendv(fields, 3);
+}
 } // namespace
 
-mpl::JournaldLogger::JournaldLogger(mpl::Level level) : Logger{level}
+mpl::JournaldLogger::JournaldLogger(mpl::Level level, std::size_t max_queued)
+    : Logger{level}, max_queued{max_queued}, sender{[this] { send_queued(); }}
 {
 }
 
+mpl::JournaldLogger::~JournaldLogger()
+{
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        running = false;
+    }
+    queue_cv.notify_one();
+}
+
 void mpl::JournaldLogger::log(mpl::Level level, CString category, CString message) const
 {
     if (level <= logging_level)
     {
-        sd_journal_send("MESSAGE=%s", message.c_str(), "PRIORITY=%i", to_syslog_priority(level), "CATEGORY=%s",
-                        category.c_str(), nullptr);
+        {
+            std::lock_guard<decltype(mutex)> lock{mutex};
+            if (queue.size() >= max_queued)
+            {
+                ++dropped;
+                return;
+            }
+
+            queue.push_back({to_syslog_priority(level), category.c_str(), message.c_str()});
+        }
+        queue_cv.notify_one();
+    }
+}
+
+void mpl::JournaldLogger::send_queued()
+{
+    std::vector<Entry> batch;
+    std::unique_lock<decltype(mutex)> lock{mutex};
+
+    while (true)
+    {
+        queue_cv.wait(lock, [this] { return !queue.empty() || !running; });
+        if (queue.empty())
+            return;
+
+        // Everything queued so far goes out in one go, leaving the queue free for new messages meanwhile
+        batch.swap(queue);
+        const auto dropped_now = dropped;
+        dropped = 0;
+        lock.unlock();
+
+        for (const auto& entry : batch)
+            send(entry.priority, entry.category, entry.message);
+
+        if (dropped_now > 0)
+            send(LOG_WARNING, "logging", fmt::format("Dropped {} messages while the journal was busy", dropped_now));
+
+        batch.clear(); // keeps the capacity for the next batch
+        lock.lock();
     }
 }
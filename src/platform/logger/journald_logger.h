@@ -18,17 +18,45 @@
 #ifndef MULTIPASS_JOURNALD_LOGGER_H
 #define MULTIPASS_JOURNALD_LOGGER_H
 
+#include <multipass/auto_join_thread.h>
 #include <multipass/logging/logger.h>
 
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
 namespace multipass
 {
 namespace logging
 {
+// Hands messages over to a thread of its own that sends them to the journal, so that logging threads never wait on
+// journald. Messages logged while the queue is full are dropped and reported once there is room again.
 class JournaldLogger : public Logger
 {
 public:
-    explicit JournaldLogger(Level level);
+    explicit JournaldLogger(Level level, std::size_t max_queued = 10000);
+    ~JournaldLogger() override; // sends what is still queued
     void log(Level level, CString category, CString message) const override;
+
+private:
+    struct Entry
+    {
+        int priority;
+        std::string category;
+        std::string message;
+    };
+
+    void send_queued();
+
+    const std::size_t max_queued;
+    mutable std::mutex mutex;
+    mutable std::condition_variable queue_cv;
+    mutable std::vector<Entry> queue;
+    mutable std::size_t dropped{0};
+    bool running{true};
+    AutoJoinThread sender;
 };
 } // namespace logging
 } // namespace multipass
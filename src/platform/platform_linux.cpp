@@ -44,7 +44,18 @@
 #include <QString>
 #include <QTextStream>
 
+#include <cstring>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
 #include <linux/if_arp.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace mp = multipass;
 namespace mpl = multipass::logging;
@@ -152,12 +163,27 @@ void update_bridges(std::map<std::string, mp::NetworkInterfaceInfo>& networks)
         }
     }
 }
+
+std::map<std::string, mp::NetworkInterfaceInfo> read_networks_from(const QDir& sys_dir)
+{
+    auto ifaces_info = std::map<std::string, mp::NetworkInterfaceInfo>();
+    for (const auto& entry : sys_dir.entryList(QDir::NoDotAndDotDot | QDir::Dirs))
+    {
+        if (auto iface = get_network(QDir{sys_dir.filePath(entry)}); iface)
+        {
+            auto name = iface->id; // (can't rely on param evaluation order)
+            ifaces_info.emplace(std::move(name), std::move(*iface));
+        }
+    }
+
+    return ifaces_info;
+}
 } // namespace
 
 std::map<std::string, mp::NetworkInterfaceInfo> mp::platform::Platform::get_network_interfaces_info() const
 {
-    static const auto sysfs = QDir{QStringLiteral("/sys/class/net")};
-    return detail::get_network_interfaces_from(sysfs);
+    static detail::NetworkInterfaceInventory inventory{QDir{QStringLiteral("/sys/class/net")}};
+    return inventory.interfaces();
 }
 
 QString mp::platform::Platform::get_workflows_url_override()
@@ -181,24 +207,204 @@ bool mp::platform::Platform::link(const char* target, const char* link)
     return ::link(target, link) == 0;
 }
 
+bool mp::platform::Platform::clone_file(const char* source, const char* target)
+{
+    const auto source_fd = ::open(source, O_RDONLY | O_CLOEXEC);
+    if (source_fd < 0)
+        return false;
+
+    struct stat source_stat;
+    const auto target_fd =
+        ::fstat(source_fd, &source_stat) == 0
+            ? ::open(target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, source_stat.st_mode & ALLPERMS)
+            : -1;
+
+    // Reflinks share the data extents of the source (e.g. on btrfs and XFS). Failing that, copy_file_range()
+    // still lets the filesystem share or copy them in-kernel, without going through userspace buffers. Only the
+    // data extents are copied, so that holes in sparse images stay holes.
+    auto cloned = target_fd >= 0 && ::ioctl(target_fd, FICLONE, source_fd) == 0;
+    if (target_fd >= 0 && !cloned && ::ftruncate(target_fd, source_stat.st_size) == 0)
+    {
+        off_t data_start{0};
+        cloned = true;
+        while (cloned && data_start < source_stat.st_size)
+        {
+            auto data_offset = ::lseek(source_fd, data_start, SEEK_DATA);
+            if (data_offset < 0)
+            {
+                if (errno == ENXIO) // only a hole left
+                    break;
+                data_offset = data_start; // filesystem cannot tell, so copy everything
+            }
+
+            auto data_end = ::lseek(source_fd, data_offset, SEEK_HOLE);
+            if (data_end < 0)
+                data_end = source_stat.st_size;
+
+            off64_t source_offset{data_offset}, target_offset{data_offset};
+            while (source_offset < data_end)
+            {
+                const auto copied = ::copy_file_range(source_fd, &source_offset, target_fd, &target_offset,
+                                                      static_cast<size_t>(data_end - source_offset), 0);
+                if (copied <= 0)
+                {
+                    cloned = false;
+                    break;
+                }
+            }
+
+            data_start = data_end;
+        }
+    }
+
+    if (target_fd >= 0)
+        ::close(target_fd);
+    ::close(source_fd);
+
+    if (!cloned && target_fd >= 0)
+        ::unlink(target);
+
+    return cloned;
+}
+
 auto mp::platform::detail::get_network_interfaces_from(const QDir& sys_dir)
     -> std::map<std::string, NetworkInterfaceInfo>
 {
-    auto ifaces_info = std::map<std::string, mp::NetworkInterfaceInfo>();
-    for (const auto& entry : sys_dir.entryList(QDir::NoDotAndDotDot | QDir::Dirs))
+    auto ifaces_info = read_networks_from(sys_dir);
+    update_bridges(ifaces_info);
+
+    return ifaces_info;
+}
+
+mp::platform::detail::NetworkInterfaceInventory::NetworkInterfaceInventory(const QDir& sys_dir, bool watch_links)
+    : sys_dir{sys_dir}, watch_links{watch_links}
+{
+    if (!watch_links)
+        return;
+
+    netlink_fd = ::socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+    sockaddr_nl address{};
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = RTMGRP_LINK;
+    if (netlink_fd >= 0 && ::bind(netlink_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0)
     {
-        if (auto iface = get_network(QDir{sys_dir.filePath(entry)}); iface)
+        // A dump of the current links tells their indices, so that renames can be told from new interfaces later
+        struct
         {
-            auto name = iface->id; // (can't rely on param evaluation order)
-            ifaces_info.emplace(std::move(name), std::move(*iface));
+            nlmsghdr header;
+            rtgenmsg body;
+        } request{};
+        request.header.nlmsg_len = NLMSG_LENGTH(sizeof(rtgenmsg));
+        request.header.nlmsg_type = RTM_GETLINK;
+        request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        request.body.rtgen_family = AF_UNSPEC;
+        ::send(netlink_fd, &request, request.header.nlmsg_len, 0);
+
+        return;
+    }
+
+    mpl::log(mpl::Level::warning, category,
+             fmt::format("Could not watch network links, interfaces will be rescanned on every lookup: {}",
+                         std::strerror(errno)));
+    if (netlink_fd >= 0)
+        ::close(netlink_fd);
+    netlink_fd = -1;
+}
+
+mp::platform::detail::NetworkInterfaceInventory::~NetworkInterfaceInventory()
+{
+    if (netlink_fd >= 0)
+        ::close(netlink_fd);
+}
+
+auto mp::platform::detail::NetworkInterfaceInventory::interfaces() -> std::map<std::string, NetworkInterfaceInfo>
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+
+    if (netlink_fd >= 0)
+        read_link_events();
+    else if (watch_links)
+        all_stale = true;
+
+    if (all_stale)
+    {
+        known = read_networks_from(sys_dir);
+        all_stale = false;
+        stale.clear();
+    }
+    else if (!stale.empty())
+    {
+        for (const auto& [name, net] : known)
+            if (net.type == "bridge") // their members come and go with link events of the members
+                stale.insert(name);
+
+        for (const auto& name : stale)
+        {
+            const auto entry = QString::fromStdString(name);
+            if (auto iface = sys_dir.exists(entry) ? get_network(QDir{sys_dir.filePath(entry)}) : mp::nullopt; iface)
+                known[name] = std::move(*iface);
+            else
+                known.erase(name);
         }
+        stale.clear();
     }
 
+    auto ifaces_info = known;
     update_bridges(ifaces_info);
 
     return ifaces_info;
 }
 
+void mp::platform::detail::NetworkInterfaceInventory::invalidate(const std::string& name)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    stale.insert(name);
+}
+
+void mp::platform::detail::NetworkInterfaceInventory::read_link_events()
+{
+    alignas(nlmsghdr) char buffer[8192];
+    for (;;)
+    {
+        const auto received = ::recv(netlink_fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (received < 0 && errno == ENOBUFS) // events were dropped, so nothing can be trusted
+        {
+            all_stale = true;
+            continue;
+        }
+        if (received <= 0) // EAGAIN once there is nothing left
+            break;
+
+        auto remaining = static_cast<int>(received);
+        for (auto header = reinterpret_cast<nlmsghdr*>(buffer); NLMSG_OK(header, remaining);
+             header = NLMSG_NEXT(header, remaining))
+        {
+            if (header->nlmsg_type != RTM_NEWLINK && header->nlmsg_type != RTM_DELLINK)
+                continue;
+
+            const auto info = static_cast<ifinfomsg*>(NLMSG_DATA(header));
+            std::string name;
+            auto attributes_length = static_cast<int>(IFLA_PAYLOAD(header));
+            for (auto attribute = IFLA_RTA(info); RTA_OK(attribute, attributes_length);
+                 attribute = RTA_NEXT(attribute, attributes_length))
+                if (attribute->rta_type == IFLA_IFNAME)
+                    name = static_cast<const char*>(RTA_DATA(attribute));
+
+            if (auto it = names_by_index.find(info->ifi_index); it != names_by_index.end() && it->second != name)
+                stale.insert(it->second); // renamed
+
+            if (!name.empty())
+                stale.insert(name);
+
+            if (header->nlmsg_type == RTM_DELLINK)
+                names_by_index.erase(info->ifi_index);
+            else
+                names_by_index[info->ifi_index] = name;
+        }
+    }
+}
+
 std::map<QString, QString> mp::platform::extra_settings_defaults()
 {
     return {};
@@ -20,11 +20,44 @@
 
 #include <multipass/network_interface_info.h>
 
+#include <QDir>
+
 #include <map>
+#include <mutex>
+#include <set>
+#include <string>
 
 namespace multipass::platform::detail
 {
 std::map<std::string, NetworkInterfaceInfo> get_network_interfaces_from(const QDir& sys_dir);
-}
+
+// Keeps what get_network_interfaces_from finds, looking up again only the interfaces that rtnetlink reports as added,
+// changed or removed. Should the netlink socket be unavailable, every lookup rescans sys_dir. Without watch_links,
+// interfaces are only looked up again when invalidated.
+class NetworkInterfaceInventory
+{
+public:
+    explicit NetworkInterfaceInventory(const QDir& sys_dir, bool watch_links = true);
+    ~NetworkInterfaceInventory();
+    NetworkInterfaceInventory(const NetworkInterfaceInventory&) = delete;
+    NetworkInterfaceInventory& operator=(const NetworkInterfaceInventory&) = delete;
+
+    std::map<std::string, NetworkInterfaceInfo> interfaces();
+    // Have the next lookup read the named interface again
+    void invalidate(const std::string& name);
+
+private:
+    void read_link_events();
+
+    const QDir sys_dir;
+    const bool watch_links;
+    int netlink_fd{-1};
+    std::mutex mutex;
+    bool all_stale{true};
+    std::set<std::string> stale;
+    std::map<int, std::string> names_by_index;
+    std::map<std::string, NetworkInterfaceInfo> known; // bridge links unfiltered
+};
+} // namespace multipass::platform::detail
 
 #endif // MULTIPASS_PLATFORM_LINUX_DETAIL_H
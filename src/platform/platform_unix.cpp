@@ -14,6 +14,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <multipass/format.h>
 #include <multipass/platform.h>
 #include <multipass/platform_unix.h>
 
@@ -67,6 +68,25 @@ int mp::platform::Platform::utime(const char* path, int atime, int mtime)
     return ::lutimes(path, tv);
 }
 
+std::string mp::platform::Platform::file_identity(const char* path)
+{
+    struct stat st
+    {
+    };
+
+    if (::stat(path, &st) < 0)
+        return {};
+
+#ifdef __APPLE__
+    const auto& mtime = st.st_mtimespec;
+#else
+    const auto& mtime = st.st_mtim;
+#endif
+
+    return fmt::format("{}:{}:{}:{}", st.st_dev, st.st_ino, st.st_size,
+                       static_cast<long long>(mtime.tv_sec) * 1000000000 + mtime.tv_nsec);
+}
+
 int mp::platform::symlink_attr_from(const char* path, sftp_attributes_struct* attr)
 {
     struct stat st
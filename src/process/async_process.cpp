@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/process/async_process.h>
+
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+
+#include <exception>
+#include <memory>
+
+namespace mp = multipass;
+
+namespace
+{
+// Short-lived tools mostly wait on the kernel or on disk, so a few run alongside without taking over the global pool
+constexpr auto max_spawning_threads = 4;
+
+QThreadPool* spawning_pool()
+{
+    static const auto pool = [] {
+        auto pool = std::make_unique<QThreadPool>();
+        pool->setMaxThreadCount(max_spawning_threads);
+        return pool;
+    }();
+
+    return pool.get();
+}
+} // namespace
+
+QFuture<mp::ProcessOutput> mp::execute_async(std::function<Process::UPtr()> make_process, int timeout)
+{
+    return QtConcurrent::run(spawning_pool(), [make_process = std::move(make_process), timeout] {
+        ProcessOutput output;
+        try
+        {
+            auto process = make_process();
+            output.state = process->execute(timeout);
+
+            if (output.state.exit_code)
+            {
+                output.standard_output = process->read_all_standard_output();
+                output.standard_error = process->read_all_standard_error();
+            }
+        }
+        catch (const std::exception& e)
+        {
+            output.state.error = ProcessState::Error{QProcess::FailedToStart, QString::fromUtf8(e.what())};
+        }
+
+        return output;
+    });
+}
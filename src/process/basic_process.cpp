@@ -16,9 +16,12 @@
  */
 
 #include <multipass/format.h>
+#include <multipass/instrumentation.h>
 #include <multipass/logging/log.h>
 #include <multipass/process/basic_process.h>
 
+#include <QFileInfo>
+
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 
@@ -192,6 +195,8 @@ void mp::BasicProcess::set_process_channel_mode(QProcess::ProcessChannelMode mod
 
 mp::ProcessState mp::BasicProcess::execute(const int timeout)
 {
+    ScopedTiming timing{"multipass_process_duration_seconds",
+                        fmt::format("program=\"{}\"", QFileInfo(process_spec->program()).fileName())};
     mp::ProcessState exit_state;
     start();
 
@@ -53,6 +53,18 @@ QString multipass::ProcessSpec::identifier() const
     return QString();
 }
 
+// Processes are left in the daemon's own group, unless they do the work of a particular instance
+mp::ResourceControls mp::ProcessSpec::resource_controls() const
+{
+    return {};
+}
+
+// Processes go down with the daemon, and their AppArmor policies are unloaded along with them
+bool mp::ProcessSpec::outlives_daemon() const
+{
+    return false;
+}
+
 // String used to register this profile with AppArmor
 const QString mp::ProcessSpec::apparmor_profile_name() const
 {
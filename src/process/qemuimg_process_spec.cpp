@@ -81,7 +81,13 @@ profile %1 flags=(attach_disconnected) {
         signal_peer = "unconfined";
     }
 
-    if (!source_image.isEmpty())
+    // A remote image is read over https by qemu's curl driver, which needs to resolve its host and check its certificate
+    if (source_image.startsWith("https://"))
+        images.append("  #include <abstractions/nameservice>\n"
+                      "  #include <abstractions/ssl_certs>\n"
+                      "  network inet stream,\n"
+                      "  network inet6 stream,\n");
+    else if (!source_image.isEmpty())
         images.append(QString("  %1 rk,\n").arg(source_image));
 
     if (!target_image.isEmpty())
@@ -19,13 +19,21 @@
 
 #include <QFileInfo>
 #include <QHash>
-#include <QJsonDocument>
-#include <QJsonObject>
+#include <QString>
 #include <QSysInfo>
 
 #include <multipass/exceptions/manifest_exceptions.h>
+#include <multipass/optional.h>
 #include <multipass/utils.h>
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <string>
+
 namespace mp = multipass;
 
 namespace
@@ -34,29 +42,393 @@ const QHash<QString, QString> arch_to_manifest{{"x86_64", "amd64"}, {"arm", "arm
                                                {"i386", "i386"},    {"power", "powerpc"}, {"power64", "ppc64el"},
                                                {"s390x", "s390x"}};
 
-QJsonObject parse_manifest(const QByteArray& json)
+// Pulls the values it is asked for out of a JSON document in place. Whatever is skipped is only checked for syntax,
+// never built, so the cost of parsing follows the data that is wanted rather than the size of the document.
+class JsonReader
 {
-    QJsonParseError parse_error;
-    const auto doc = QJsonDocument::fromJson(json, &parse_error);
-    if (doc.isNull())
-        throw mp::GenericManifestException(parse_error.errorString().toStdString());
+public:
+    explicit JsonReader(const QByteArray& json, int position = 0)
+        : begin{json.constData()}, cur{begin + position}, end{begin + json.size()}
+    {
+    }
 
-    if (!doc.isObject())
-        throw mp::GenericManifestException("invalid manifest object");
-    return doc.object();
+    int position()
+    {
+        skip_whitespace();
+        return static_cast<int>(cur - begin);
+    }
+
+    char peek()
+    {
+        skip_whitespace();
+        return cur < end ? *cur : '\0';
+    }
+
+    bool consume(char c)
+    {
+        if (peek() != c)
+            return false;
+
+        ++cur;
+        return true;
+    }
+
+    void expect(char c)
+    {
+        if (!consume(c))
+            fail(std::string{"expected '"} + c + "'");
+    }
+
+    void expect_end()
+    {
+        if (peek() != '\0' || cur != end)
+            fail("garbage at the end of the document");
+    }
+
+    // Calls on_member with each member's key, leaving the reader on the value, which on_member must read or skip
+    template <typename OnMember>
+    void read_object(OnMember&& on_member)
+    {
+        const NestingGuard guard{*this};
+        expect('{');
+        if (consume('}'))
+            return;
+
+        do
+        {
+            if (peek() != '"')
+                fail("expected an object member name");
+
+            const auto key = read_utf8();
+            expect(':');
+            on_member(key);
+        } while (consume(','));
+
+        expect('}');
+    }
+
+    // These convert like QJsonValue does, defaulting (and skipping the value) when its type is not the expected one
+    QString string_or_empty()
+    {
+        if (peek() == '"')
+            return QString::fromUtf8(read_utf8());
+
+        skip_value();
+        return {};
+    }
+
+    bool bool_or_false()
+    {
+        if (peek() == 't')
+        {
+            expect_word("true");
+            return true;
+        }
+
+        skip_value();
+        return false;
+    }
+
+    int int_or(int default_value)
+    {
+        if (peek() != '-' && !std::isdigit(static_cast<unsigned char>(peek())))
+        {
+            skip_value();
+            return default_value;
+        }
+
+        const auto number = read_number();
+        const auto in_range = number >= std::numeric_limits<int>::min() && number <= std::numeric_limits<int>::max();
+        return in_range && static_cast<int>(number) == number ? static_cast<int>(number) : default_value;
+    }
+
+    void skip_value()
+    {
+        switch (peek())
+        {
+        case '{':
+            read_object([this](const QByteArray&) { skip_value(); });
+            break;
+        case '[':
+        {
+            const NestingGuard guard{*this};
+            expect('[');
+            if (!consume(']'))
+            {
+                do
+                    skip_value();
+                while (consume(','));
+                expect(']');
+            }
+            break;
+        }
+        case '"':
+            read_utf8();
+            break;
+        case 't':
+            expect_word("true");
+            break;
+        case 'f':
+            expect_word("false");
+            break;
+        case 'n':
+            expect_word("null");
+            break;
+        default:
+            read_number();
+        }
+    }
+
+private:
+    struct NestingGuard
+    {
+        explicit NestingGuard(JsonReader& reader) : reader{reader}
+        {
+            if (++reader.depth > max_depth)
+                reader.fail("too deeply nested document");
+        }
+
+        ~NestingGuard()
+        {
+            --reader.depth;
+        }
+
+        JsonReader& reader;
+    };
+
+    [[noreturn]] void fail(const std::string& what) const
+    {
+        throw mp::GenericManifestException(what + " at offset " + std::to_string(cur - begin));
+    }
+
+    void skip_whitespace()
+    {
+        while (cur < end && (*cur == ' ' || *cur == '\n' || *cur == '\r' || *cur == '\t'))
+            ++cur;
+    }
+
+    void expect_word(const char* word)
+    {
+        const auto length = std::strlen(word);
+        if (static_cast<std::size_t>(end - cur) < length || std::strncmp(cur, word, length) != 0)
+            fail("illegal value");
+
+        cur += length;
+    }
+
+    double read_number()
+    {
+        const auto start = cur;
+        auto skip_digits = [this] {
+            const auto digits_start = cur;
+            while (cur < end && std::isdigit(static_cast<unsigned char>(*cur)))
+                ++cur;
+            return cur != digits_start;
+        };
+
+        if (cur < end && *cur == '-')
+            ++cur;
+        auto valid = skip_digits();
+        if (valid && cur < end && *cur == '.')
+        {
+            ++cur;
+            valid = skip_digits();
+        }
+        if (valid && cur < end && (*cur == 'e' || *cur == 'E'))
+        {
+            ++cur;
+            if (cur < end && (*cur == '+' || *cur == '-'))
+                ++cur;
+            valid = skip_digits();
+        }
+
+        auto ok = false;
+        const auto number = QByteArray::fromRawData(start, static_cast<int>(cur - start)).toDouble(&ok);
+        if (!valid || !ok)
+            fail("illegal number");
+
+        return number;
+    }
+
+    // The raw bytes of a string, sharing the document's unless there are escape sequences to decode
+    QByteArray read_utf8()
+    {
+        expect('"');
+        const auto start = cur;
+        while (cur < end && *cur != '"' && *cur != '\\' && static_cast<unsigned char>(*cur) >= 0x20)
+            ++cur;
+
+        if (cur < end && *cur == '"')
+            return QByteArray::fromRawData(start, static_cast<int>(cur++ - start));
+
+        QByteArray decoded{start, static_cast<int>(cur - start)};
+        while (true)
+        {
+            if (cur == end)
+                fail("unterminated string");
+
+            const auto c = *cur++;
+            if (c == '"')
+                return decoded;
+            if (static_cast<unsigned char>(c) < 0x20)
+                fail("illegal value in string");
+            if (c != '\\')
+            {
+                decoded.append(c);
+                continue;
+            }
+            if (cur == end)
+                fail("unterminated string");
+
+            switch (*cur++)
+            {
+            case '"':
+                decoded.append('"');
+                break;
+            case '\\':
+                decoded.append('\\');
+                break;
+            case '/':
+                decoded.append('/');
+                break;
+            case 'b':
+                decoded.append('\b');
+                break;
+            case 'f':
+                decoded.append('\f');
+                break;
+            case 'n':
+                decoded.append('\n');
+                break;
+            case 'r':
+                decoded.append('\r');
+                break;
+            case 't':
+                decoded.append('\t');
+                break;
+            case 'u':
+                append_code_point(decoded);
+                break;
+            default:
+                fail("illegal escape sequence");
+            }
+        }
+    }
+
+    uint read_hex4()
+    {
+        if (end - cur < 4)
+            fail("illegal unicode escape sequence");
+
+        auto ok = false;
+        const auto value = QByteArray::fromRawData(cur, 4).toUInt(&ok, 16);
+        if (!ok || !std::all_of(cur, cur + 4, [](char c) { return std::isxdigit(static_cast<unsigned char>(c)); }))
+            fail("illegal unicode escape sequence");
+
+        cur += 4;
+        return value;
+    }
+
+    void append_code_point(QByteArray& decoded)
+    {
+        auto code_point = read_hex4();
+        if (code_point >= 0xd800 && code_point < 0xdc00 && end - cur >= 2 && cur[0] == '\\' && cur[1] == 'u')
+        {
+            const auto rewind = cur;
+            cur += 2;
+            const auto low = read_hex4();
+            if (low >= 0xdc00 && low < 0xe000)
+                code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+            else
+                cur = rewind;
+        }
+
+        decoded.append(QString::fromUcs4(&code_point, 1).toUtf8());
+    }
+
+    static constexpr int max_depth = 1024;
+
+    const char* const begin;
+    const char* cur;
+    const char* const end;
+    int depth{0};
+};
+
+struct ImageItem
+{
+    QString path;
+    QString sha256;
+    int size = -1;
+    mp::optional<QString> kvm_sha256;
+    mp::optional<QString> disk1_sha256;
+};
+
+struct ProductVersion
+{
+    bool has_items = false;
+    ImageItem image;
+};
+
+ImageItem read_image_item(JsonReader& reader)
+{
+    ImageItem item;
+    if (reader.peek() != '{')
+    {
+        reader.skip_value();
+        return item;
+    }
+
+    reader.read_object([&reader, &item](const QByteArray& key) {
+        if (key == "path")
+            item.path = reader.string_or_empty();
+        else if (key == "sha256")
+            item.sha256 = reader.string_or_empty();
+        else if (key == "size")
+            item.size = reader.int_or(-1);
+        else if (key == "combined_disk-kvm-img_sha256")
+            item.kvm_sha256 = reader.string_or_empty();
+        else if (key == "combined_disk1-img_sha256")
+            item.disk1_sha256 = reader.string_or_empty();
+        else
+            reader.skip_value();
+    });
+
+    return item;
 }
 
-QString latest_version_in(const QJsonObject& versions)
+// Versions by name, sorted like QJsonObject keys, which the products used to be built from
+std::map<QString, ProductVersion> read_versions(JsonReader& reader, const char* image_key)
 {
-    QString max_version;
-    for (auto it = versions.constBegin(); it != versions.constEnd(); ++it)
+    std::map<QString, ProductVersion> versions;
+    if (reader.peek() != '{')
     {
-        const auto version = it.key();
-        if (version < max_version)
-            continue;
-        max_version = version;
+        reader.skip_value();
+        return versions;
     }
-    return max_version;
+
+    reader.read_object([&reader, &versions, image_key](const QByteArray& version_name) {
+        ProductVersion version;
+        if (reader.peek() != '{')
+            reader.skip_value();
+        else
+            reader.read_object([&reader, &version, image_key](const QByteArray& key) {
+                if (key != "items" || reader.peek() != '{')
+                    return reader.skip_value();
+
+                version = ProductVersion{};
+                reader.read_object([&reader, &version, image_key](const QByteArray& item_name) {
+                    version.has_items = true;
+                    if (item_name == image_key)
+                        version.image = read_image_item(reader);
+                    else
+                        reader.skip_value();
+                });
+            });
+
+        versions[QString::fromUtf8(version_name)] = std::move(version);
+    });
+
+    return versions;
 }
 
 QString derive_unpacked_file_path_prefix_from(const QString& image_location)
@@ -77,77 +449,91 @@ QString derive_unpacked_file_path_prefix_from(const QString& image_location)
 std::unique_ptr<mp::SimpleStreamsManifest> mp::SimpleStreamsManifest::fromJson(const QByteArray& json,
                                                                                const QString& host_url)
 {
-    const auto manifest = parse_manifest(json);
-    const auto updated = manifest["updated"].toString();
-
-    const auto manifest_products = manifest["products"].toObject();
-    if (manifest_products.isEmpty())
-        throw mp::GenericManifestException("No products found");
-
-    auto arch = arch_to_manifest.value(QSysInfo::currentCpuArchitecture());
+    const auto arch = arch_to_manifest.value(QSysInfo::currentCpuArchitecture()).toUtf8();
+    const auto driver = utils::get_driver_str();
+    const auto lxd_driver = driver == "lxd";
+    const auto image_key = lxd_driver ? "lxd.tar.xz" : "disk1.img";
 
-    if (arch.isEmpty())
-        throw mp::GenericManifestException("Unsupported cloud image architecture");
-
-    std::vector<VMImageInfo> products;
-    for (const auto& value : manifest_products)
+    JsonReader reader{json};
+    if (reader.peek() != '{')
     {
-        const auto product = value.toObject();
-
-        if (product["arch"].toString() != arch)
-            continue;
+        reader.skip_value();
+        reader.expect_end();
+        throw mp::GenericManifestException("invalid manifest object");
+    }
 
-        const auto product_aliases = product["aliases"].toString().split(",");
+    QString updated;
+    auto product_count = 0;
+    // By product name, sorted like QJsonObject keys
+    std::map<QString, std::vector<VMImageInfo>> products_by_name;
+
+    auto read_product = [&](const QByteArray& product_name) {
+        ++product_count;
+        if (reader.peek() != '{')
+            return reader.skip_value();
+
+        // The versions are only read once the product turns out to be for this architecture, wherever "arch" is
+        QString product_arch, aliases, release, release_title;
+        auto supported = false;
+        auto versions_position = -1;
+        reader.read_object([&](const QByteArray& key) {
+            if (key == "arch")
+                product_arch = reader.string_or_empty();
+            else if (key == "aliases")
+                aliases = reader.string_or_empty();
+            else if (key == "release")
+                release = reader.string_or_empty();
+            else if (key == "release_title")
+                release_title = reader.string_or_empty();
+            else if (key == "supported")
+                supported = reader.bool_or_false();
+            else
+            {
+                if (key == "versions")
+                    versions_position = reader.position();
+                reader.skip_value();
+            }
+        });
 
-        const auto release = product["release"].toString();
-        const auto release_title = product["release_title"].toString();
-        const auto supported = product["supported"].toBool();
+        auto& products = products_by_name[QString::fromUtf8(product_name)];
+        products.clear();
+        if (arch.isEmpty() || product_arch.toUtf8() != arch || versions_position < 0)
+            return;
 
-        const auto versions = product["versions"].toObject();
-        if (versions.isEmpty())
-            continue;
+        JsonReader versions_reader{json, versions_position};
+        const auto versions = read_versions(versions_reader, image_key);
+        if (versions.empty())
+            return;
 
-        const auto latest_version = latest_version_in(versions);
+        const auto product_aliases = aliases.split(",");
+        const auto& latest_version = versions.crbegin()->first;
 
-        for (auto it = versions.constBegin(); it != versions.constEnd(); ++it)
+        for (const auto& entry : versions)
         {
-            const auto version_string = it.key();
-            const auto version = versions[version_string].toObject();
-            const auto items = version["items"].toObject();
-            if (items.isEmpty())
+            const auto& version_string = entry.first;
+            const auto& version = entry.second;
+            if (!version.has_items)
                 continue;
 
-            const auto& driver = utils::get_driver_str();
-
-            QJsonObject image;
             QString sha256, image_location, kernel_location, initrd_location;
             int size = -1;
 
             // TODO: make this a VM factory call with a preference list
-            if (driver == "lxd")
+            if (lxd_driver)
             {
-                image = items["lxd.tar.xz"].toObject();
-
-                if (image.contains("combined_disk-kvm-img_sha256"))
-                {
-                    sha256 = image["combined_disk-kvm-img_sha256"].toString();
-                }
-                else if (image.contains("combined_disk1-img_sha256"))
-                {
-                    sha256 = image["combined_disk1-img_sha256"].toString();
-                }
+                if (version.image.kvm_sha256)
+                    sha256 = *version.image.kvm_sha256;
+                else if (version.image.disk1_sha256)
+                    sha256 = *version.image.disk1_sha256;
 
                 if (sha256.isEmpty())
-                {
                     continue;
-                }
             }
             else
             {
-                image = items["disk1.img"].toObject();
-                image_location = image["path"].toString();
-                sha256 = image["sha256"].toString();
-                size = image["size"].toInt(-1);
+                image_location = version.image.path;
+                sha256 = version.image.sha256;
+                size = version.image.size;
 
                 // NOTE: These are not defined in the manifest itself
                 // so they are not guaranteed to be correct or exist in the server
@@ -157,16 +543,48 @@ std::unique_ptr<mp::SimpleStreamsManifest> mp::SimpleStreamsManifest::fromJson(c
             }
 
             // Aliases always alias to the latest version
-            const QStringList& aliases = version_string == latest_version ? product_aliases : QStringList();
-            products.push_back({aliases, "Ubuntu", release, release_title, supported, image_location, kernel_location,
-                                initrd_location, sha256, host_url, version_string, size, true});
+            const QStringList& version_aliases = version_string == latest_version ? product_aliases : QStringList();
+            products.push_back({version_aliases, "Ubuntu", release, release_title, supported, image_location,
+                                kernel_location, initrd_location, sha256, host_url, version_string, size, true});
         }
-    }
+    };
+
+    reader.read_object([&](const QByteArray& key) {
+        if (key == "updated")
+            updated = reader.string_or_empty();
+        else if (key == "products" && reader.peek() == '{')
+        {
+            product_count = 0;
+            products_by_name.clear();
+            reader.read_object(read_product);
+        }
+        else
+            reader.skip_value();
+    });
+    reader.expect_end();
+
+    if (product_count == 0)
+        throw mp::GenericManifestException("No products found");
+
+    if (arch.isEmpty())
+        throw mp::GenericManifestException("Unsupported cloud image architecture");
+
+    std::vector<VMImageInfo> products;
+    for (auto& entry : products_by_name)
+        std::move(entry.second.begin(), entry.second.end(), std::back_inserter(products));
 
     if (products.empty())
         throw mp::EmptyManifestException("No supported products found.");
 
-    QMap<QString, const VMImageInfo*> map;
+    return fromProducts(updated, std::move(products));
+}
+
+std::unique_ptr<mp::SimpleStreamsManifest> mp::SimpleStreamsManifest::fromProducts(const QString& updated_at,
+                                                                                   std::vector<VMImageInfo> products)
+{
+    QHash<QString, const VMImageInfo*> map;
+    std::vector<const VMImageInfo*> by_id;
+    by_id.reserve(products.size());
 
     for (const auto& product : products)
     {
@@ -175,8 +593,36 @@ std::unique_ptr<mp::SimpleStreamsManifest> mp::SimpleStreamsManifest::fromJson(c
         {
             map[alias] = &product;
         }
+
+        by_id.push_back(&product);
     }
 
+    // Stable, so that the first product comes first among those sharing an id
+    std::stable_sort(by_id.begin(), by_id.end(), [](const auto* a, const auto* b) { return a->id < b->id; });
+
     return std::unique_ptr<SimpleStreamsManifest>(
-        new SimpleStreamsManifest{updated, std::move(products), std::move(map)});
+        new SimpleStreamsManifest{updated_at, std::move(products), std::move(map), std::move(by_id)});
+}
+
+const mp::VMImageInfo* mp::SimpleStreamsManifest::product_with_id(const QString& id) const
+{
+    auto it = std::lower_bound(products_by_id.cbegin(), products_by_id.cend(), id,
+                               [](const auto* product, const QString& id) { return product->id < id; });
+
+    return it != products_by_id.cend() && (*it)->id == id ? *it : nullptr;
+}
+
+std::vector<const mp::VMImageInfo*> mp::SimpleStreamsManifest::products_with_id_prefix(const QString& prefix) const
+{
+    std::vector<const VMImageInfo*> matches;
+    auto it = std::lower_bound(products_by_id.cbegin(), products_by_id.cend(), prefix,
+                               [](const auto* product, const QString& prefix) { return product->id < prefix; });
+
+    for (; it != products_by_id.cend() && (*it)->id.startsWith(prefix); ++it)
+        matches.push_back(*it);
+
+    // Back to the order of products, which all live in the one vector
+    std::sort(matches.begin(), matches.end());
+
+    return matches;
 }
@@ -24,15 +24,23 @@
 #include <QFile>
 
 #include <memory>
+#include <tuple>
+#include <utility>
 
 namespace mp = multipass;
 namespace
 {
 
-mp::OpenSSHKeyProvider::KeyUPtr create_priv_key(const QString& priv_key_path)
+QString key_file_name_for(mp::OpenSSHKeyProvider::KeyType type)
+{
+    return type == mp::OpenSSHKeyProvider::KeyType::ed25519 ? "id_ed25519" : "id_rsa";
+}
+
+mp::OpenSSHKeyProvider::KeyUPtr create_priv_key(const QString& priv_key_path, mp::OpenSSHKeyProvider::KeyType type)
 {
     ssh_key priv_key;
-    auto ret = ssh_pki_generate(SSH_KEYTYPE_RSA, 2048, &priv_key);
+    auto ret = type == mp::OpenSSHKeyProvider::KeyType::ed25519 ? ssh_pki_generate(SSH_KEYTYPE_ED25519, 0, &priv_key)
+                                                                 : ssh_pki_generate(SSH_KEYTYPE_RSA, 2048, &priv_key);
     if (ret != SSH_OK)
         throw std::runtime_error("unable to generate ssh key");
 
@@ -45,19 +53,32 @@ mp::OpenSSHKeyProvider::KeyUPtr create_priv_key(const QString& priv_key_path)
     return key;
 }
 
-mp::OpenSSHKeyProvider::KeyUPtr get_priv_key(const QDir& key_dir)
+mp::OpenSSHKeyProvider::KeyUPtr import_priv_key(const QString& priv_key_path)
+{
+    if (!QFile::exists(priv_key_path))
+        return nullptr;
+
+    ssh_key priv_key;
+    const auto path = priv_key_path.toStdString();
+    if (ssh_pki_import_privkey_file(path.c_str(), nullptr, nullptr, nullptr, &priv_key) != SSH_OK)
+        return nullptr;
+
+    return mp::OpenSSHKeyProvider::KeyUPtr{priv_key};
+}
+
+// A key that is already there is kept, whatever its type, since the instances launched so far only accept that one
+std::pair<QString, mp::OpenSSHKeyProvider::KeyUPtr> get_priv_key(const QDir& key_dir,
+                                                                 mp::OpenSSHKeyProvider::KeyType preferred_type)
 {
-    auto priv_key_path = key_dir.filePath("id_rsa");
-    if (QFile::exists(priv_key_path))
+    for (auto type : {mp::OpenSSHKeyProvider::KeyType::ed25519, mp::OpenSSHKeyProvider::KeyType::rsa})
     {
-        ssh_key priv_key;
-        auto imported =
-            ssh_pki_import_privkey_file(priv_key_path.toStdString().c_str(), nullptr, nullptr, nullptr, &priv_key);
-        if (imported != SSH_OK)
-            return create_priv_key(priv_key_path);
-        return mp::OpenSSHKeyProvider::KeyUPtr{priv_key};
+        auto priv_key_path = key_dir.filePath(key_file_name_for(type));
+        if (auto priv_key = import_priv_key(priv_key_path))
+            return {priv_key_path, std::move(priv_key)};
     }
-    return create_priv_key(priv_key_path);
+
+    auto priv_key_path = key_dir.filePath(key_file_name_for(preferred_type));
+    return {priv_key_path, create_priv_key(priv_key_path, preferred_type)};
 }
 } // namespace
 
@@ -66,14 +87,15 @@ void mp::OpenSSHKeyProvider::KeyDeleter::operator()(ssh_key key)
     ssh_key_free(key);
 }
 
-mp::OpenSSHKeyProvider::OpenSSHKeyProvider(const mp::Path& cache_dir)
-    : ssh_key_dir{mp::utils::make_dir(cache_dir, "ssh-keys")}, priv_key{get_priv_key(ssh_key_dir)}
+mp::OpenSSHKeyProvider::OpenSSHKeyProvider(const mp::Path& cache_dir, KeyType preferred_type)
+    : ssh_key_dir{mp::utils::make_dir(cache_dir, "ssh-keys")}
 {
+    std::tie(priv_key_path, priv_key) = get_priv_key(ssh_key_dir, preferred_type);
 }
 
 std::string mp::OpenSSHKeyProvider::private_key_as_base64() const
 {
-    QFile key_file{ssh_key_dir.filePath("id_rsa")};
+    QFile key_file{priv_key_path};
     auto opened = key_file.open(QIODevice::ReadOnly);
     if (!opened)
         throw std::runtime_error(fmt::format("Unable to open private key file '{}'", key_file.fileName()));
@@ -16,18 +16,35 @@
  */
 
 #include <multipass/ssh/sftp_client.h>
+#include <multipass/ssh/ssh_client_key_provider.h>
 #include <multipass/ssh/throw_on_error.h>
 #include <multipass/utils.h>
 
-#include "ssh_client_key_provider.h"
-
 #include <multipass/format.h>
 
+#include <algorithm>
 #include <array>
-#include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <fcntl.h>
-
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <sys/time.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
 #include <QFile>
+#include <QFileInfo>
 
 namespace mp = multipass;
 
@@ -36,9 +53,22 @@ namespace
 // TODO: For push/pull, use actual file permissions
 constexpr int file_mode = 0664;
 constexpr auto max_transfer = 65536u;
+constexpr auto sync_block_size = 16 * max_transfer;
+constexpr auto stream_buffers = 4u;
+constexpr std::uint8_t fxp_write = 6;   // SSH_FXP_WRITE, which libssh keeps private
+constexpr std::uint8_t fxp_status = 101; // SSH_FXP_STATUS
 const std::string stream_file_name{"stream_output.dat"};
 
+// Prints the sha256 of each block of a file in the instance, one per line. It stays clear of single quotes, so that
+// it can be handed to python3 -c in them.
+constexpr auto block_signatures_script = "import hashlib, sys\n"
+                                         "f = open(sys.argv[2], \"rb\")\n"
+                                         "for block in iter(lambda: f.read(int(sys.argv[1])), b\"\"):\n"
+                                         "    print(hashlib.sha256(block).hexdigest())";
+
 using SFTPFileUPtr = std::unique_ptr<sftp_file_struct, int (*)(sftp_file)>;
+using SFTPDirUPtr = std::unique_ptr<sftp_dir_struct, int (*)(sftp_dir)>;
+using SFTPAttributesUPtr = std::unique_ptr<sftp_attributes_struct, void (*)(sftp_attributes)>;
 
 mp::SFTPSessionUPtr make_sftp_session(ssh_session session)
 {
@@ -63,23 +93,236 @@ std::string full_destination(const std::string& destination_path, const std::str
 
     return destination_path;
 }
+
+// Qt keeps the owner, group and other permissions in the same order as a unix mode, a nibble each
+int unix_mode_from(QFileDevice::Permissions permissions)
+{
+    const auto bits = static_cast<int>(permissions);
+    return ((bits >> 12) & 07) << 6 | ((bits >> 4) & 07) << 3 | (bits & 07);
+}
+
+QFileDevice::Permissions qt_permissions_from(uint32_t mode)
+{
+    const auto owner = (mode >> 6) & 07;
+    return QFileDevice::Permissions(owner << 12 | owner << 8 | ((mode >> 3) & 07) << 4 | (mode & 07));
+}
+
+void set_local_metadata(const std::string& path, const sftp_attributes_struct& attributes)
+{
+    // By path rather than through an open file, which directories cannot be opened as
+    if (attributes.flags & SSH_FILEXFER_ATTR_ACMODTIME)
+    {
+        timeval times[2]{};
+        times[0].tv_sec = attributes.atime;
+        times[1].tv_sec = attributes.mtime;
+        if (::utimes(path.c_str(), times) != 0)
+            throw std::runtime_error(
+                fmt::format("[sftp pull] could not set times of \"{}\": {}", path, std::strerror(errno)));
+    }
+
+    if (attributes.flags & SSH_FILEXFER_ATTR_PERMISSIONS)
+        QFile::setPermissions(QString::fromStdString(path), qt_permissions_from(attributes.permissions));
+}
+
+void append_u32(std::string& packet, std::uint32_t value)
+{
+    for (auto shift : {24, 16, 8, 0})
+        packet.push_back(static_cast<char>((value >> shift) & 0xff));
+}
+
+void append_u64(std::string& packet, std::uint64_t value)
+{
+    append_u32(packet, static_cast<std::uint32_t>(value >> 32));
+    append_u32(packet, static_cast<std::uint32_t>(value));
+}
+
+std::uint32_t read_u32(const std::string& buffer, std::size_t pos)
+{
+    std::uint32_t value = 0;
+    for (auto i = pos; i < pos + 4 && i < buffer.size(); ++i)
+        value = (value << 8) | static_cast<std::uint8_t>(buffer[i]);
+    return value;
+}
+
+// libssh 0.9 only knows how to write synchronously, waiting for each SSH_FXP_WRITE's status before sending the next.
+// This writes packets for an open remote file straight to the sftp channel instead, and collects their statuses
+// behind them, so that up to a window of writes are in flight at once. It must have collected every status before
+// libssh is asked to do anything else with the session, so that libssh only ever sees replies to its own requests.
+class PipelinedWriter
+{
+public:
+    PipelinedWriter(sftp_file file, std::size_t window) : file{file}, window{window}, offset{file->offset}
+    {
+    }
+
+    // Every packet names its own offset, so writes elsewhere in the file need not wait for those in flight
+    void seek(std::uint64_t new_offset)
+    {
+        offset = new_offset;
+    }
+
+    void write(const char* data, std::uint32_t size)
+    {
+        if (outstanding >= window)
+            await_status();
+
+        const auto handle_size = static_cast<std::uint32_t>(ssh_string_len(file->handle));
+        std::string header;
+        append_u32(header, 1 + 4 + 4 + handle_size + 8 + 4 + size);
+        header.push_back(static_cast<char>(fxp_write));
+        append_u32(header, ++file->sftp->id_counter);
+        append_u32(header, handle_size);
+        header.append(static_cast<const char*>(ssh_string_data(file->handle)), handle_size);
+        append_u64(header, offset);
+        append_u32(header, size);
+
+        send(header.data(), static_cast<std::uint32_t>(header.size()));
+        send(data, size);
+
+        offset += size;
+        ++outstanding;
+    }
+
+    void finish()
+    {
+        while (outstanding > 0)
+            await_status();
+
+        file->offset = offset;
+    }
+
+private:
+    void send(const char* data, std::uint32_t size)
+    {
+        if (ssh_channel_write(file->sftp->channel, data, size) != static_cast<int>(size))
+            throw mp::SSHException("[sftp push] remote write failed: could not send data");
+    }
+
+    std::string receive(std::uint32_t size)
+    {
+        std::string buffer(size, '\0');
+        for (std::uint32_t received = 0; received < size;)
+        {
+            auto r = ssh_channel_read_timeout(file->sftp->channel, &buffer[received], size - received, 0, -1);
+            if (r <= 0)
+                throw mp::SSHException("[sftp push] remote write failed: could not read status");
+            received += r;
+        }
+
+        return buffer;
+    }
+
+    void await_status()
+    {
+        auto length = read_u32(receive(4), 0);
+        auto reply = receive(length);
+        --outstanding;
+
+        if (reply.empty() || static_cast<std::uint8_t>(reply[0]) != fxp_status)
+            throw mp::SSHException("[sftp push] remote write failed: unexpected reply");
+
+        if (auto status = read_u32(reply, 5); status != SSH_FX_OK)
+        {
+            auto message_size = read_u32(reply, 9);
+            auto message = reply.size() >= 13 ? reply.substr(13, message_size) : std::string{};
+            throw mp::SSHException(fmt::format("[sftp push] remote write failed: '{}'",
+                                               message.empty() ? std::to_string(status) : message));
+        }
+    }
+
+    sftp_file file;
+    const std::size_t window;
+    std::uint64_t offset;
+    std::size_t outstanding{0};
+};
+
+// Hands chunks over from one thread to another, holding the producer back while a few are waiting already
+class ChunkQueue
+{
+public:
+    explicit ChunkQueue(std::size_t capacity) : capacity{capacity}
+    {
+    }
+
+    // Returns false once the consumer gave up, there being no point in producing more
+    bool push(std::string chunk)
+    {
+        std::unique_lock<decltype(mutex)> lock{mutex};
+        cond.wait(lock, [this] { return chunks.size() < capacity || abandoned; });
+        if (abandoned)
+            return false;
+
+        chunks.push_back(std::move(chunk));
+        cond.notify_all();
+        return true;
+    }
+
+    // Returns nothing once the producer finished and every chunk was taken, or once either side gave up
+    std::optional<std::string> pop()
+    {
+        std::unique_lock<decltype(mutex)> lock{mutex};
+        cond.wait(lock, [this] { return !chunks.empty() || finished || abandoned; });
+        if (chunks.empty() || abandoned)
+            return std::nullopt;
+
+        auto chunk = std::move(chunks.front());
+        chunks.pop_front();
+        cond.notify_all();
+        return chunk;
+    }
+
+    void finish()
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        finished = true;
+        cond.notify_all();
+    }
+
+    void abandon()
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        abandoned = true;
+        cond.notify_all();
+    }
+
+    bool was_abandoned()
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        return abandoned;
+    }
+
+private:
+    const std::size_t capacity;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::string> chunks;
+    bool finished{false};
+    bool abandoned{false};
+};
 } // namespace
 
 mp::SFTPClient::SFTPClient(const std::string& host, int port, const std::string& username,
-                           const std::string& priv_key_blob)
-    : SFTPClient{std::make_unique<mp::SSHSession>(host, port, username, mp::SSHClientKeyProvider(priv_key_blob))}
+                           const std::string& priv_key_blob, std::size_t transfer_window)
+    : SFTPClient{std::make_unique<mp::SSHSession>(host, port, username, mp::SSHClientKeyProvider(priv_key_blob)),
+                 transfer_window}
 {
 }
 
-mp::SFTPClient::SFTPClient(SSHSessionUPtr ssh_session)
-    : ssh_session{std::move(ssh_session)}, sftp{make_sftp_session(*this->ssh_session)}
+mp::SFTPClient::SFTPClient(SSHSessionUPtr ssh_session, std::size_t transfer_window)
+    : ssh_session{std::move(ssh_session)},
+      sftp{make_sftp_session(*this->ssh_session)},
+      transfer_window{std::max<std::size_t>(transfer_window, 1)}
 {
     SSH::throw_on_error(sftp, *this->ssh_session, "[sftp pull] init failed", sftp_init);
 }
 
 void mp::SFTPClient::push_file(const std::string& source_path, const std::string& destination_path)
 {
-    auto full_destination_path = full_destination(destination_path, mp::utils::filename_for(source_path));
+    push_file_to(source_path, full_destination(destination_path, mp::utils::filename_for(source_path)));
+}
+
+void mp::SFTPClient::push_file_to(const std::string& source_path, const std::string& full_destination_path)
+{
     SFTPFileUPtr file_handle{
         sftp_open(sftp.get(), full_destination_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, file_mode), sftp_close};
     SSH::throw_on_error(sftp, *ssh_session, "[sftp push] open failed", sftp_get_error);
@@ -88,6 +331,7 @@ void mp::SFTPClient::push_file(const std::string& source_path, const std::string
     if (!source.open(QIODevice::ReadOnly))
         throw std::runtime_error(fmt::format("[sftp push] error opening file for reading: {}", source.errorString()));
 
+    PipelinedWriter writer{file_handle.get(), transfer_window};
     std::array<char, max_transfer> data;
     while (true)
     {
@@ -99,14 +343,19 @@ void mp::SFTPClient::push_file(const std::string& source_path, const std::string
         if (r == 0)
             break;
 
-        sftp_write(file_handle.get(), data.data(), r);
-        SSH::throw_on_error(sftp, *ssh_session, "[sftp push] remote write failed", sftp_get_error);
+        writer.write(data.data(), static_cast<std::uint32_t>(r));
     }
+
+    writer.finish();
 }
 
 void mp::SFTPClient::pull_file(const std::string& source_path, const std::string& destination_path)
 {
-    auto full_destination_path = full_destination(destination_path, mp::utils::filename_for(source_path));
+    pull_file_to(source_path, full_destination(destination_path, mp::utils::filename_for(source_path)));
+}
+
+void mp::SFTPClient::pull_file_to(const std::string& source_path, const std::string& full_destination_path)
+{
     QFile destination(QString::fromStdString(full_destination_path));
     if (!destination.open(QIODevice::WriteOnly))
         throw std::runtime_error(
@@ -115,19 +364,258 @@ void mp::SFTPClient::pull_file(const std::string& source_path, const std::string
     SFTPFileUPtr file_handle{sftp_open(sftp.get(), source_path.c_str(), O_RDONLY, file_mode), sftp_close};
     SSH::throw_on_error(sftp, *ssh_session, "[sftp pull] open failed", sftp_get_error);
 
+    read_pipelined(file_handle.get(), [&destination](const char* data, int size) {
+        if (destination.write(data, size) == -1)
+            throw std::runtime_error(fmt::format("[sftp pull] error writing to file: {}", destination.errorString()));
+    });
+}
+
+void mp::SFTPClient::read_pipelined(sftp_file file, const std::function<void(const char*, int)>& consume)
+{
+    // Reads are asked for ahead of time, at consecutive offsets, and collected in the order they were asked for.
+    // A short read that is not at the end of the file would leave a gap before the reads behind it, so on any short
+    // read the rest are collected and dropped, and reading resumes from where that short read ended.
+    std::deque<std::pair<std::uint32_t, std::uint64_t>> requests; // request id and offset
+    auto eof = false;
     std::array<char, max_transfer> data;
     while (true)
     {
-        auto r = sftp_read(file_handle.get(), data.data(), data.size());
-
-        if (r == 0)
+        while (!eof && requests.size() < transfer_window)
+        {
+            auto offset = sftp_tell64(file);
+            auto id = sftp_async_read_begin(file, max_transfer);
+            if (id < 0)
+                SSH::throw_on_error(sftp, *ssh_session, "[sftp pull] read failed", sftp_get_error);
+            requests.emplace_back(static_cast<std::uint32_t>(id), offset);
+        }
+
+        if (requests.empty())
             break;
 
+        auto [id, offset] = requests.front();
+        requests.pop_front();
+        auto r = sftp_async_read(file, data.data(), max_transfer, id);
+
         if (r < 0)
             SSH::throw_on_error(sftp, *ssh_session, "[sftp pull] read failed", sftp_get_error);
 
-        if (destination.write(data.data(), r) == -1)
-            throw std::runtime_error(fmt::format("[sftp pull] error writing to file: {}", destination.errorString()));
+        if (r > 0)
+            consume(data.data(), r);
+
+        if (static_cast<std::uint32_t>(r) < max_transfer)
+        {
+            for (const auto& request : requests)
+                sftp_async_read(file, data.data(), max_transfer, request.first);
+            requests.clear();
+
+            eof = r == 0;
+            sftp_seek64(file, offset + r);
+        }
+    }
+}
+
+void mp::SFTPClient::sync_file(const std::string& source_path, const std::string& destination_path)
+{
+    sync_file_to(source_path, full_destination(destination_path, mp::utils::filename_for(source_path)));
+}
+
+void mp::SFTPClient::sync_file_to(const std::string& source_path, const std::string& full_destination_path)
+{
+    // Blocks are compared where they stand, so this pays off for files changed in place rather than shifted about
+    const auto signatures = remote_block_signatures(full_destination_path);
+    if (signatures.empty())
+        return push_file_to(source_path, full_destination_path);
+
+    QFile source(QString::fromStdString(source_path));
+    if (!source.open(QIODevice::ReadOnly))
+        throw std::runtime_error(fmt::format("[sftp sync] error opening file for reading: {}", source.errorString()));
+
+    SFTPFileUPtr file_handle{sftp_open(sftp.get(), full_destination_path.c_str(), O_WRONLY | O_CREAT, file_mode),
+                             sftp_close};
+    SSH::throw_on_error(sftp, *ssh_session, "[sftp sync] open failed", sftp_get_error);
+
+    PipelinedWriter writer{file_handle.get(), transfer_window};
+    std::uint64_t offset = 0;
+    for (std::size_t block = 0;; ++block)
+    {
+        const auto data = source.read(sync_block_size);
+        if (data.isEmpty())
+        {
+            if (source.error() != QFileDevice::NoError)
+                throw std::runtime_error(fmt::format("[sftp sync] error reading file: {}", source.errorString()));
+            break;
+        }
+
+        if (block >= signatures.size() ||
+            QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex().toStdString() != signatures[block])
+        {
+            writer.seek(offset);
+            for (auto pos = 0; pos < data.size(); pos += max_transfer)
+                writer.write(data.constData() + pos, std::min<std::uint32_t>(max_transfer, data.size() - pos));
+        }
+
+        offset += data.size();
+    }
+    writer.finish();
+
+    // Cut off whatever the destination held beyond the end of the source
+    sftp_attributes_struct attributes{};
+    attributes.flags = SSH_FILEXFER_ATTR_SIZE;
+    attributes.size = offset;
+    SSH::throw_on_error(sftp, *ssh_session, "[sftp sync] truncate failed", sftp_setstat,
+                        full_destination_path.c_str(), &attributes);
+}
+
+std::vector<std::string> mp::SFTPClient::remote_block_signatures(const std::string& path)
+{
+    auto process = ssh_session->exec(fmt::format("python3 -c '{}' {} {}", block_signatures_script, sync_block_size,
+                                                 mp::utils::escape_for_shell(path)));
+    std::istringstream output{process.read_std_output()};
+
+    // Having nothing to compare with, whether for want of the file or of python, just means pushing all of it
+    std::vector<std::string> signatures;
+    if (process.exit_code() == 0)
+        for (std::string line; std::getline(output, line);)
+            signatures.push_back(line);
+
+    return signatures;
+}
+
+bool mp::SFTPClient::is_remote_dir(const std::string& path)
+{
+    SFTPAttributesUPtr attributes{sftp_stat(sftp.get(), path.c_str()), sftp_attributes_free};
+    return attributes && attributes->type == SSH_FILEXFER_TYPE_DIRECTORY;
+}
+
+void mp::SFTPClient::push_dir(const std::string& source_path, const std::string& destination_path, bool sync)
+{
+    const QDir source_dir{QDir::cleanPath(QFileInfo{QString::fromStdString(source_path)}.absoluteFilePath())};
+    const auto dir_name = source_dir.dirName().toStdString();
+
+    auto target = destination_path;
+    if (destination_path.empty())
+        target = dir_name;
+    else if (is_remote_dir(destination_path))
+        target = fmt::format("{}/{}", destination_path, dir_name);
+
+    // Directories stay open to their owner while they are filled, and only get their own permissions and times once
+    // everything in them is in place, innermost first
+    std::vector<std::pair<std::string, QFileInfo>> dirs{{target, QFileInfo{source_dir.path()}}};
+    make_remote_dir(target);
+
+    // Links to directories are left out, as following them could lead anywhere, including back up the tree
+    QDirIterator entries{source_dir.path(), QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot,
+                         QDirIterator::Subdirectories};
+    while (entries.hasNext())
+    {
+        const QFileInfo entry{entries.next()};
+        const auto remote_path = fmt::format("{}/{}", target, source_dir.relativeFilePath(entry.filePath()));
+
+        if (entry.isDir() && !entry.isSymLink())
+        {
+            make_remote_dir(remote_path);
+            dirs.emplace_back(remote_path, entry);
+        }
+        else if (entry.isFile())
+        {
+            if (sync)
+                sync_file_to(entry.filePath().toStdString(), remote_path);
+            else
+                push_file_to(entry.filePath().toStdString(), remote_path);
+            set_remote_metadata(remote_path, entry);
+        }
+    }
+
+    for (auto dir = dirs.rbegin(); dir != dirs.rend(); ++dir)
+        set_remote_metadata(dir->first, dir->second);
+}
+
+void mp::SFTPClient::pull_dir(const std::string& source_path, const std::string& destination_path)
+{
+    SFTPAttributesUPtr attributes{sftp_stat(sftp.get(), source_path.c_str()), sftp_attributes_free};
+    if (!attributes)
+        throw SSHException(fmt::format("[sftp pull] stat failed: '{}'", ssh_get_error(*ssh_session)));
+
+    if (attributes->type != SSH_FILEXFER_TYPE_DIRECTORY)
+        throw std::runtime_error(fmt::format("[sftp pull] \"{}\" is not a directory", source_path));
+
+    const auto dir_name = QDir{QDir::cleanPath(QString::fromStdString(source_path))}.dirName().toStdString();
+    const auto full_destination_path = full_destination(destination_path, dir_name);
+    pull_tree(source_path, full_destination_path);
+    set_local_metadata(full_destination_path, *attributes);
+}
+
+void mp::SFTPClient::pull_tree(const std::string& source_path, const std::string& full_destination_path)
+{
+    if (!QDir{}.mkpath(QString::fromStdString(full_destination_path)))
+        throw std::runtime_error(fmt::format("[sftp pull] error creating directory: {}", full_destination_path));
+
+    SFTPDirUPtr dir{sftp_opendir(sftp.get(), source_path.c_str()), sftp_closedir};
+    if (!dir)
+        throw SSHException(fmt::format("[sftp pull] open directory failed: '{}'", ssh_get_error(*ssh_session)));
+
+    for (SFTPAttributesUPtr entry{sftp_readdir(sftp.get(), dir.get()), sftp_attributes_free}; entry;
+         entry.reset(sftp_readdir(sftp.get(), dir.get())))
+    {
+        const std::string name{entry->name};
+        if (name == "." || name == "..")
+            continue;
+
+        const auto remote_path = fmt::format("{}/{}", source_path, name);
+        const auto local_path = fmt::format("{}/{}", full_destination_path, name);
+
+        // Links are followed to files, but not into directories, for the same reason as when pushing
+        SFTPAttributesUPtr link_target{nullptr, sftp_attributes_free};
+        if (entry->type == SSH_FILEXFER_TYPE_SYMLINK)
+            link_target.reset(sftp_stat(sftp.get(), remote_path.c_str()));
+        const auto& attributes = link_target ? *link_target : *entry;
+
+        if (attributes.type == SSH_FILEXFER_TYPE_DIRECTORY && !link_target)
+        {
+            pull_tree(remote_path, local_path);
+            set_local_metadata(local_path, attributes);
+        }
+        else if (attributes.type == SSH_FILEXFER_TYPE_REGULAR)
+        {
+            pull_file_to(remote_path, local_path);
+            set_local_metadata(local_path, attributes);
+        }
+    }
+
+    if (!sftp_dir_eof(dir.get()))
+        throw SSHException(fmt::format("[sftp pull] read directory failed: '{}'", ssh_get_error(*ssh_session)));
+}
+
+void mp::SFTPClient::make_remote_dir(const std::string& path)
+{
+    if (sftp_mkdir(sftp.get(), path.c_str(), 0700) != SSH_OK && !is_remote_dir(path))
+        throw SSHException(fmt::format("[sftp push] could not create directory \"{}\": '{}'", path,
+                                       ssh_get_error(*ssh_session)));
+}
+
+void mp::SFTPClient::set_remote_metadata(const std::string& path, const QFileInfo& info)
+{
+    SSH::throw_on_error(sftp, *ssh_session, "[sftp push] could not set permissions", sftp_chmod, path.c_str(),
+                        unix_mode_from(info.permissions()));
+
+    timeval times[2]{};
+    times[0].tv_sec = info.lastRead().toSecsSinceEpoch();
+    times[1].tv_sec = info.lastModified().toSecsSinceEpoch();
+    SSH::throw_on_error(sftp, *ssh_session, "[sftp push] could not set times", sftp_utimes, path.c_str(), times);
+}
+
+void mp::SFTPClient::set_remote_metadata(const std::string& path, const sftp_attributes_struct& attributes)
+{
+    if (attributes.flags & SSH_FILEXFER_ATTR_PERMISSIONS)
+        SSH::throw_on_error(sftp, *ssh_session, "[sftp copy] could not set permissions", sftp_chmod, path.c_str(),
+                            attributes.permissions & 07777);
+
+    if (attributes.flags & SSH_FILEXFER_ATTR_ACMODTIME)
+    {
+        timeval times[2]{};
+        times[0].tv_sec = attributes.atime;
+        times[1].tv_sec = attributes.mtime;
+        SSH::throw_on_error(sftp, *ssh_session, "[sftp copy] could not set times", sftp_utimes, path.c_str(), times);
     }
 }
 
@@ -138,13 +626,38 @@ void mp::SFTPClient::stream_file(const std::string& destination_path, std::istre
         sftp_open(sftp.get(), full_destination_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, file_mode), sftp_close};
     SSH::throw_on_error(sftp, *ssh_session, "[sftp stream] open failed", sftp_get_error);
 
-    std::array<char, max_transfer> data;
-    while (!cin.eof())
+    // Another thread reads the input while this one keeps a window of writes in flight, so neither waits on the other
+    ChunkQueue chunks{stream_buffers};
+    std::thread reader{[&cin, &chunks] {
+        std::string chunk(max_transfer, '\0');
+        while (cin.read(&chunk[0], chunk.size()) || cin.gcount() > 0)
+        {
+            chunk.resize(static_cast<std::size_t>(cin.gcount()));
+            if (!chunks.push(std::move(chunk)))
+                return;
+
+            chunk.assign(max_transfer, '\0');
+        }
+
+        chunks.finish();
+    }};
+
+    try
+    {
+        PipelinedWriter writer{file_handle.get(), transfer_window};
+        while (auto chunk = chunks.pop())
+            writer.write(chunk->data(), static_cast<std::uint32_t>(chunk->size()));
+
+        writer.finish();
+    }
+    catch (...)
     {
-        cin.read(data.data(), data.size());
-        sftp_write(file_handle.get(), data.data(), cin.gcount());
-        SSH::throw_on_error(sftp, *ssh_session, "[sftp push] remote write failed", sftp_get_error);
+        chunks.abandon();
+        reader.join();
+        throw;
     }
+
+    reader.join();
 }
 
 void mp::SFTPClient::stream_file(const std::string& source_path, std::ostream& cout)
@@ -152,18 +665,154 @@ void mp::SFTPClient::stream_file(const std::string& source_path, std::ostream& c
     SFTPFileUPtr file_handle{sftp_open(sftp.get(), source_path.c_str(), O_RDONLY, file_mode), sftp_close};
     SSH::throw_on_error(sftp, *ssh_session, "[sftp pull] open failed", sftp_get_error);
 
-    std::array<char, max_transfer> data;
-    while (true)
+    // Another thread writes out what came in while this one keeps a window of reads in flight
+    ChunkQueue chunks{stream_buffers};
+    std::thread writer{[&cout, &chunks] {
+        while (auto chunk = chunks.pop())
+        {
+            if (!cout.write(chunk->data(), chunk->size()))
+            {
+                chunks.abandon();
+                return;
+            }
+        }
+    }};
+
+    try
     {
-        auto r = sftp_read(file_handle.get(), data.data(), data.size());
+        read_pipelined(file_handle.get(), [&chunks](const char* data, int size) {
+            if (!chunks.push({data, static_cast<std::size_t>(size)}))
+                throw std::runtime_error("[sftp pull] error writing to output");
+        });
+        chunks.finish();
+    }
+    catch (...)
+    {
+        chunks.abandon();
+        writer.join();
+        throw;
+    }
 
-        if (r == 0)
-            break;
+    writer.join();
+    if (chunks.was_abandoned())
+        throw std::runtime_error("[sftp pull] error writing to output");
+}
 
-        if (r < 0)
-            SSH::throw_on_error(sftp, *ssh_session, "[sftp pull] read failed", sftp_get_error);
+void mp::SFTPClient::copy_to(SFTPClient& destination, const std::string& source_path,
+                             const std::string& destination_path, bool recursive)
+{
+    SFTPAttributesUPtr attributes{sftp_stat(sftp.get(), source_path.c_str()), sftp_attributes_free};
+    if (!attributes)
+        throw SSHException(fmt::format("[sftp copy] stat failed: '{}'", ssh_get_error(*ssh_session)));
+
+    const auto name = QDir{QDir::cleanPath(QString::fromStdString(source_path))}.dirName().toStdString();
+    auto target = destination_path;
+    if (destination_path.empty())
+        target = name;
+    else if (destination.is_remote_dir(destination_path))
+        target = fmt::format("{}/{}", destination_path, name);
+
+    if (attributes->type == SSH_FILEXFER_TYPE_DIRECTORY)
+    {
+        if (!recursive)
+            throw std::runtime_error(fmt::format("[sftp copy] \"{}\" is a directory", source_path));
+
+        copy_tree_to(destination, source_path, target);
+    }
+    else
+        copy_file_to(destination, source_path, target);
+
+    destination.set_remote_metadata(target, *attributes);
+}
+
+void mp::SFTPClient::copy_file_to(SFTPClient& destination, const std::string& source_path,
+                                  const std::string& full_destination_path)
+{
+    SFTPFileUPtr source_handle{sftp_open(sftp.get(), source_path.c_str(), O_RDONLY, file_mode), sftp_close};
+    SSH::throw_on_error(sftp, *ssh_session, "[sftp copy] open failed", sftp_get_error);
+
+    SFTPFileUPtr destination_handle{sftp_open(destination.sftp.get(), full_destination_path.c_str(),
+                                              O_WRONLY | O_CREAT | O_TRUNC, file_mode),
+                                    sftp_close};
+    SSH::throw_on_error(destination.sftp, *destination.ssh_session, "[sftp copy] open failed", sftp_get_error);
+
+    // The two sessions are independent, so one thread keeps a window of reads in flight on the source while another
+    // keeps one of writes in flight on the destination
+    ChunkQueue chunks{stream_buffers};
+    std::exception_ptr write_error;
+    std::thread writer{[&destination, &destination_handle, &chunks, &write_error] {
+        try
+        {
+            PipelinedWriter pipelined_writer{destination_handle.get(), destination.transfer_window};
+            while (auto chunk = chunks.pop())
+                pipelined_writer.write(chunk->data(), static_cast<std::uint32_t>(chunk->size()));
+
+            pipelined_writer.finish();
+        }
+        catch (...)
+        {
+            write_error = std::current_exception();
+            chunks.abandon();
+        }
+    }};
+
+    try
+    {
+        read_pipelined(source_handle.get(), [&chunks](const char* data, int size) {
+            if (!chunks.push({data, static_cast<std::size_t>(size)}))
+                throw std::runtime_error("[sftp copy] the destination gave up");
+        });
+        chunks.finish();
+    }
+    catch (...)
+    {
+        chunks.abandon();
+        writer.join();
+        if (write_error)
+            std::rethrow_exception(write_error);
+        throw;
+    }
+
+    writer.join();
+    if (write_error)
+        std::rethrow_exception(write_error);
+}
 
-        assert(r <= max_transfer);
-        cout.write(data.data(), r);
+void mp::SFTPClient::copy_tree_to(SFTPClient& destination, const std::string& source_path,
+                                  const std::string& full_destination_path)
+{
+    destination.make_remote_dir(full_destination_path);
+
+    SFTPDirUPtr dir{sftp_opendir(sftp.get(), source_path.c_str()), sftp_closedir};
+    if (!dir)
+        throw SSHException(fmt::format("[sftp copy] open directory failed: '{}'", ssh_get_error(*ssh_session)));
+
+    for (SFTPAttributesUPtr entry{sftp_readdir(sftp.get(), dir.get()), sftp_attributes_free}; entry;
+         entry.reset(sftp_readdir(sftp.get(), dir.get())))
+    {
+        const std::string name{entry->name};
+        if (name == "." || name == "..")
+            continue;
+
+        const auto remote_path = fmt::format("{}/{}", source_path, name);
+        const auto target_path = fmt::format("{}/{}", full_destination_path, name);
+
+        // Links are followed to files, but not into directories, as when pulling
+        SFTPAttributesUPtr link_target{nullptr, sftp_attributes_free};
+        if (entry->type == SSH_FILEXFER_TYPE_SYMLINK)
+            link_target.reset(sftp_stat(sftp.get(), remote_path.c_str()));
+        const auto& attributes = link_target ? *link_target : *entry;
+
+        if (attributes.type == SSH_FILEXFER_TYPE_DIRECTORY && !link_target)
+            copy_tree_to(destination, remote_path, target_path);
+        else if (attributes.type == SSH_FILEXFER_TYPE_REGULAR)
+            copy_file_to(destination, remote_path, target_path);
+        else
+            continue;
+
+        destination.set_remote_metadata(target_path, attributes);
     }
+
+    if (!sftp_dir_eof(dir.get()))
+        throw SSHException(fmt::format("[sftp copy] read directory failed: '{}'", ssh_get_error(*ssh_session)));
 }
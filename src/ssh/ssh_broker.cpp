@@ -0,0 +1,485 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/constants.h>
+#include <multipass/exceptions/ssh_exception.h>
+#include <multipass/format.h>
+#include <multipass/logging/log.h>
+#include <multipass/ssh/ssh_broker.h>
+#include <multipass/ssh/ssh_client_key_provider.h>
+#include <multipass/ssh/throw_on_error.h>
+#include <multipass/standard_paths.h>
+#include <multipass/terminal.h>
+#include <multipass/utils.h>
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QEventLoop>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QProcess>
+#include <QThread>
+#include <QTimer>
+
+#include <algorithm>
+#include <array>
+#include <istream>
+#include <stdexcept>
+#include <thread>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+
+namespace
+{
+constexpr auto category = "ssh broker";
+constexpr auto connect_timeout = 200;  // ms
+constexpr auto request_timeout = 5000; // ms
+constexpr auto poll_interval = 20;     // ms
+constexpr qint64 max_pending_bytes = 1024 * 1024;
+
+using ChannelUPtr = std::unique_ptr<ssh_channel_struct, void (*)(ssh_channel)>;
+
+enum class Frame : quint8
+{
+    request,
+    started,
+    unavailable, // the command did not run, so the client can still run it by itself
+    input,
+    input_end,
+    output,
+    error_output,
+    exit_status,
+    failure
+};
+
+constexpr std::array<std::pair<int, Frame>, 2> output_streams{{{0, Frame::output}, {1, Frame::error_output}}};
+
+void write_frame(QLocalSocket& socket, Frame type, const QByteArray& payload = {})
+{
+    QDataStream stream{&socket};
+    stream << static_cast<quint8>(type) << payload;
+
+    socket.flush();
+    if (socket.bytesToWrite() > max_pending_bytes)
+        socket.waitForBytesWritten(-1);
+}
+
+std::optional<std::pair<Frame, QByteArray>> read_frame(QLocalSocket& socket)
+{
+    QDataStream stream{&socket};
+    stream.startTransaction();
+
+    quint8 type;
+    QByteArray payload;
+    stream >> type >> payload;
+    if (!stream.commitTransaction())
+        return std::nullopt;
+
+    return std::make_pair(static_cast<Frame>(type), payload);
+}
+
+std::optional<std::pair<Frame, QByteArray>> wait_for_frame(QLocalSocket& socket, int timeout)
+{
+    auto frame = read_frame(socket);
+    while (!frame && socket.waitForReadyRead(timeout))
+        frame = read_frame(socket);
+
+    return frame;
+}
+
+QByteArray make_request(const std::string& host, int port, const std::string& username,
+                        const std::string& priv_key_blob, const std::vector<std::string>& args)
+{
+    QJsonArray command;
+    for (const auto& arg : args)
+        command.append(QString::fromStdString(arg));
+
+    QJsonObject request{{"host", QString::fromStdString(host)},
+                        {"port", port},
+                        {"username", QString::fromStdString(username)},
+                        {"key", QString::fromStdString(priv_key_blob)},
+                        {"command", command}};
+    return QJsonDocument{request}.toJson(QJsonDocument::Compact);
+}
+
+ChannelUPtr open_exec_channel(ssh_session session, const std::string& cmd)
+{
+    ChannelUPtr channel{ssh_channel_new(session), ssh_channel_free};
+    mp::SSH::throw_on_error(channel, session, "[ssh broker] channel creation failed", ssh_channel_open_session);
+    mp::SSH::throw_on_error(channel, session, "[ssh broker] exec request failed", ssh_channel_request_exec,
+                            cmd.c_str());
+
+    return channel;
+}
+
+void relay(QLocalSocket& socket, ssh_channel channel, ssh_session session)
+{
+    std::array<char, 64 * 1024> data;
+    auto input_open = true;
+
+    for (;;)
+    {
+        const auto eof = ssh_channel_is_eof(channel) || !ssh_channel_is_open(channel);
+        for (const auto& [is_stderr, frame] : output_streams)
+        {
+            int read;
+            while ((read = ssh_channel_read_nonblocking(channel, data.data(), data.size(), is_stderr)) > 0)
+                write_frame(socket, frame, QByteArray(data.data(), read));
+
+            if (read == SSH_ERROR)
+                throw mp::SSHException(fmt::format("[ssh broker] read failed: '{}'", ssh_get_error(session)));
+        }
+
+        if (eof)
+            break;
+
+        if (socket.state() != QLocalSocket::ConnectedState)
+            return; // nobody left to hear the outcome
+
+        if (input_open)
+        {
+            socket.waitForReadyRead(poll_interval);
+            while (auto frame = read_frame(socket))
+            {
+                const auto& [type, payload] = *frame;
+                if (type == Frame::input && ssh_channel_write(channel, payload.constData(), payload.size()) < 0)
+                    throw mp::SSHException(fmt::format("[ssh broker] write failed: '{}'", ssh_get_error(session)));
+                else if (type == Frame::input_end)
+                {
+                    ssh_channel_send_eof(channel);
+                    input_open = false;
+                }
+            }
+        }
+        else
+            ssh_channel_poll_timeout(channel, poll_interval, 0);
+    }
+
+    write_frame(socket, Frame::exit_status, QByteArray::number(ssh_channel_get_exit_status(channel)));
+}
+
+// Reads the client's input on the side, there being no portable way to poll a standard stream
+class InputPump
+{
+public:
+    explicit InputPump(std::istream& in) : state{std::make_shared<State>()}, thread{&InputPump::pump, state, &in}
+    {
+    }
+
+    ~InputPump()
+    {
+        if (ended())
+            thread.join();
+        else
+            thread.detach(); // blocked on input that may never come; the process will not wait for it
+    }
+
+    // Moves what was read so far to data, returning whether the input ended
+    bool take(QByteArray& data)
+    {
+        std::lock_guard<decltype(state->mutex)> lock{state->mutex};
+        data.swap(state->data);
+        return state->ended;
+    }
+
+private:
+    bool ended() const
+    {
+        std::lock_guard<decltype(state->mutex)> lock{state->mutex};
+        return state->ended;
+    }
+
+    struct State
+    {
+        std::mutex mutex;
+        QByteArray data;
+        bool ended = false;
+    };
+
+    static void pump(std::shared_ptr<State> state, std::istream* in)
+    {
+        std::array<char, 4096> chunk;
+        while (in->get(chunk[0]))
+        {
+            const auto more = in->readsome(chunk.data() + 1, chunk.size() - 1);
+
+            std::lock_guard<decltype(state->mutex)> lock{state->mutex};
+            state->data.append(chunk.data(), static_cast<int>(more + 1));
+        }
+
+        std::lock_guard<decltype(state->mutex)> lock{state->mutex};
+        state->ended = true;
+    }
+
+    std::shared_ptr<State> state;
+    std::thread thread;
+};
+} // namespace
+
+class mp::SSHBroker::Server : public QLocalServer
+{
+public:
+    explicit Server(SSHBroker& broker) : broker{broker}
+    {
+    }
+
+protected:
+    void incomingConnection(quintptr socket_descriptor) override
+    {
+        broker.start_serving(socket_descriptor);
+    }
+
+private:
+    SSHBroker& broker;
+};
+
+struct mp::SSHBroker::KeyedPool
+{
+    KeyedPool(const std::string& priv_key_blob, std::chrono::seconds max_idle_time)
+        : key_provider{priv_key_blob}, pool{key_provider, max_idle_time}
+    {
+    }
+
+    SSHClientKeyProvider key_provider;
+    SSHSessionPool pool;
+};
+
+mp::SSHBroker::SSHBroker(const QString& server_name, std::chrono::milliseconds idle_timeout)
+    : server_name{server_name}, idle_timeout{idle_timeout}, last_active{std::chrono::steady_clock::now()}
+{
+}
+
+mp::SSHBroker::~SSHBroker() = default;
+
+int mp::SSHBroker::run()
+{
+    QEventLoop loop; // before the server, which needs an event dispatcher in this thread to listen
+    Server server{*this};
+    server.setSocketOptions(QLocalServer::UserAccessOption);
+
+    if (!server.listen(server_name))
+    {
+        QLocalSocket probe;
+        probe.connectToServer(server_name);
+        if (probe.waitForConnected(connect_timeout))
+            return EXIT_SUCCESS; // another broker is serving already
+
+        QLocalServer::removeServer(server_name); // left behind by a broker that did not close
+        if (!server.listen(server_name))
+        {
+            mpl::log(mpl::Level::warning, category,
+                     fmt::format("Could not listen on {}: {}", server_name, server.errorString()));
+            return EXIT_FAILURE;
+        }
+    }
+
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        last_active = std::chrono::steady_clock::now();
+    }
+
+    QTimer idle_check;
+    QObject::connect(&idle_check, &QTimer::timeout, &loop, [this, &loop] {
+        if (idle())
+            loop.quit();
+    });
+    idle_check.start(std::max(static_cast<int>(idle_timeout.count() / 4), 10));
+
+    loop.exec();
+    server.close();
+
+    std::vector<std::unique_ptr<QThread>> finishing;
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        finishing.swap(workers);
+    }
+
+    for (const auto& worker : finishing)
+        worker->wait();
+
+    return EXIT_SUCCESS;
+}
+
+std::optional<int> mp::SSHBroker::exec(const QString& server_name, const std::string& host, int port,
+                                       const std::string& username, const std::string& priv_key_blob,
+                                       const std::vector<std::string>& args, Terminal* term)
+{
+    QLocalSocket socket;
+    socket.connectToServer(server_name);
+    if (!socket.waitForConnected(connect_timeout))
+        return std::nullopt;
+
+    write_frame(socket, Frame::request, make_request(host, port, username, priv_key_blob, args));
+
+    const auto reply = wait_for_frame(socket, -1); // the broker may need to connect first
+    if (!reply || reply->first != Frame::started)
+    {
+        mpl::log(mpl::Level::debug, category,
+                 fmt::format("The broker could not run the command: {}",
+                             reply ? reply->second.toStdString() : "no reply"));
+        return std::nullopt;
+    }
+
+    InputPump input{term->cin()};
+    auto input_sent = false;
+    for (;;)
+    {
+        if (!input_sent)
+        {
+            QByteArray data;
+            input_sent = input.take(data);
+            if (!data.isEmpty())
+                write_frame(socket, Frame::input, data);
+            if (input_sent)
+                write_frame(socket, Frame::input_end);
+        }
+
+        const auto connected =
+            socket.waitForReadyRead(poll_interval) || socket.state() == QLocalSocket::ConnectedState;
+        while (auto frame = read_frame(socket))
+        {
+            const auto& [type, payload] = *frame;
+            switch (type)
+            {
+            case Frame::output:
+                term->cout().write(payload.constData(), payload.size()).flush();
+                break;
+            case Frame::error_output:
+                term->cerr().write(payload.constData(), payload.size()).flush();
+                break;
+            case Frame::exit_status:
+                return payload.toInt();
+            case Frame::failure:
+                throw std::runtime_error(payload.toStdString());
+            default:
+                break;
+            }
+        }
+
+        if (!connected)
+            throw std::runtime_error("lost the connection to the ssh broker");
+    }
+}
+
+QString mp::SSHBroker::default_server_name()
+{
+#ifdef MULTIPASS_PLATFORM_WINDOWS
+    return QStringLiteral("%1-ssh-broker-%2").arg(mp::client_name, QString::fromLocal8Bit(qgetenv("USERNAME")));
+#else
+    const auto config_dir = QDir{MP_STDPATHS.writableLocation(StandardPaths::GenericConfigLocation)};
+    const auto client_dir = QDir{config_dir.absoluteFilePath(mp::client_name)};
+    client_dir.mkpath(".");
+
+    return client_dir.absoluteFilePath("ssh-broker");
+#endif
+}
+
+void mp::SSHBroker::spawn()
+{
+    QProcess broker;
+    broker.setProgram(QCoreApplication::applicationFilePath());
+    broker.setArguments({run_flag});
+    broker.setStandardInputFile(QProcess::nullDevice()); // keep pipes the client was given from waiting on the broker
+    broker.setStandardOutputFile(QProcess::nullDevice());
+    broker.setStandardErrorFile(QProcess::nullDevice());
+
+    if (!broker.startDetached())
+        mpl::log(mpl::Level::debug, category, "Could not start the ssh broker");
+}
+
+void mp::SSHBroker::start_serving(quintptr socket_descriptor)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    const auto finished = [](const auto& worker) { return worker->isFinished(); };
+    workers.erase(std::remove_if(workers.begin(), workers.end(), finished), workers.end());
+
+    ++active_clients;
+    last_active = std::chrono::steady_clock::now();
+
+    // QThreads rather than std::threads, so that the sockets they serve get an event dispatcher
+    workers.emplace_back(QThread::create([this, socket_descriptor] { serve(socket_descriptor); }));
+    workers.back()->start();
+}
+
+void mp::SSHBroker::serve(quintptr socket_descriptor)
+{
+    QLocalSocket socket;
+    if (socket.setSocketDescriptor(socket_descriptor))
+    {
+        auto started = false;
+        try
+        {
+            const auto request = wait_for_frame(socket, request_timeout);
+            if (!request || request->first != Frame::request)
+                throw std::runtime_error("no command to run");
+
+            const auto json = QJsonDocument::fromJson(request->second).object();
+            const auto host = json["host"].toString().toStdString();
+            const auto port = json["port"].toInt();
+            std::vector<std::string> args;
+            for (const auto& arg : json["command"].toArray())
+                args.push_back(arg.toString().toStdString());
+
+            auto lease = pool_for(json["key"].toString().toStdString())
+                             .acquire(fmt::format("{}:{}", host, port), host, port,
+                                      json["username"].toString().toStdString());
+            auto channel = open_exec_channel(*lease, utils::to_cmd(args, utils::QuoteType::quote_every_arg));
+
+            write_frame(socket, Frame::started);
+            started = true;
+            relay(socket, channel.get(), *lease);
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::debug, category, fmt::format("Could not relay the command: {}", e.what()));
+            write_frame(socket, started ? Frame::failure : Frame::unavailable, e.what());
+        }
+
+        socket.waitForBytesWritten(request_timeout);
+        socket.disconnectFromServer();
+    }
+
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    --active_clients;
+    last_active = std::chrono::steady_clock::now();
+}
+
+mp::SSHSessionPool& mp::SSHBroker::pool_for(const std::string& priv_key_blob)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+
+    auto& keyed_pool = pools[priv_key_blob];
+    if (!keyed_pool)
+    {
+        const auto max_idle_time = std::max(std::chrono::duration_cast<std::chrono::seconds>(idle_timeout),
+                                            std::chrono::seconds{1});
+        keyed_pool = std::make_unique<KeyedPool>(priv_key_blob, max_idle_time);
+    }
+
+    return keyed_pool->pool;
+}
+
+bool mp::SSHBroker::idle() const
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    return active_clients == 0 && std::chrono::steady_clock::now() - last_active >= idle_timeout;
+}
@@ -16,11 +16,10 @@
  */
 
 #include <multipass/ssh/ssh_client.h>
+#include <multipass/ssh/ssh_client_key_provider.h>
 #include <multipass/ssh/throw_on_error.h>
 #include <multipass/utils.h>
 
-#include "ssh_client_key_provider.h"
-
 namespace mp = multipass;
 
 namespace
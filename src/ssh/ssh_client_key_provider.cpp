@@ -15,7 +15,7 @@
  *
  */
 
-#include "ssh_client_key_provider.h"
+#include <multipass/ssh/ssh_client_key_provider.h>
 
 #include <stdexcept>
 
@@ -25,7 +25,7 @@ namespace
 {
 mp::SSHClientKeyProvider::KeyUPtr import_priv_key(const std::string& priv_key_blob)
 {
-    ssh_key priv_key;
+    ssh_key priv_key{nullptr};
     ssh_pki_import_privkey_base64(priv_key_blob.c_str(), nullptr, nullptr, nullptr, &priv_key);
 
     return mp::SSHClientKeyProvider::KeyUPtr{priv_key};
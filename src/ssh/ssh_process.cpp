@@ -24,8 +24,8 @@
 
 #include <libssh/callbacks.h>
 
-#include <array>
-#include <sstream>
+#include <algorithm>
+#include <cstdint>
 
 #include <cerrno>
 #include <cstring>
@@ -36,33 +36,15 @@ namespace mpl = multipass::logging;
 namespace
 {
 constexpr auto category = "ssh process";
+constexpr std::uint32_t initial_read_size = 64 * 1024;
+constexpr std::uint32_t max_read_size = 1024 * 1024;
 
-class ExitStatusCallback
+std::uint32_t next_read_size(std::uint32_t size, int last_read)
 {
-public:
-    ExitStatusCallback(ssh_channel channel, mp::optional<int>& exit_status) : channel{channel}
-    {
-        ssh_callbacks_init(&cb);
-        cb.channel_exit_status_function = channel_exit_status_cb;
-        cb.userdata = &exit_status;
-        ssh_add_channel_callbacks(channel, &cb);
-    }
-    ~ExitStatusCallback()
-    {
-        ssh_remove_channel_callbacks(channel, &cb);
-    }
-
-private:
-    static void channel_exit_status_cb(ssh_session, ssh_channel, int exit_status, void* userdata)
-    {
-        auto exit_code = reinterpret_cast<mp::optional<int>*>(userdata);
-        *exit_code = exit_status;
-    }
-    ssh_channel channel;
-    ssh_channel_callbacks_struct cb{};
-};
+    return static_cast<std::uint32_t>(last_read) == size ? std::min(2 * size, max_read_size) : size;
+}
 
-auto make_channel(ssh_session session, const std::string& cmd)
+auto open_channel(ssh_session session, const std::string& cmd)
 {
     if (!ssh_is_connected(session))
         throw mp::SSHException(
@@ -70,23 +52,76 @@ auto make_channel(ssh_session session, const std::string& cmd)
 
     mp::SSHProcess::ChannelUPtr channel{ssh_channel_new(session), ssh_channel_free};
     mp::SSH::throw_on_error(channel, session, "[ssh proc] failed to open session channel", ssh_channel_open_session);
-    mp::SSH::throw_on_error(channel, session, "[ssh proc] exec request failed", ssh_channel_request_exec, cmd.c_str());
     return channel;
 }
+
+// Processes on the same session wait on one event between them, so that polling for any of them hears from all of
+// them, whoever ends up waiting
+std::shared_ptr<ssh_event_struct> event_for(ssh_session session, mp::SSHProcess::SharedEvent& shared_event)
+{
+    std::lock_guard<decltype(shared_event.mutex)> lock{shared_event.mutex};
+    auto event = shared_event.event.lock();
+    if (!event)
+    {
+        auto free_event = [session](ssh_event event) {
+            ssh_event_remove_session(event, session);
+            ssh_event_free(event);
+        };
+
+        event = std::shared_ptr<ssh_event_struct>{ssh_event_new(), free_event};
+        ssh_event_add_session(event.get(), session);
+        shared_event.event = event;
+    }
+
+    return event;
+}
 } // namespace
 
-mp::SSHProcess::SSHProcess(ssh_session session, const std::string& cmd)
-    : session{session}, cmd{cmd}, channel{make_channel(session, cmd)}
+// Heard for as long as the process is, so that an exit is caught whenever libssh comes across it, not just while
+// someone is asking for it
+struct mp::SSHProcess::ExitStatusWatch
+{
+    explicit ExitStatusWatch(ssh_channel channel) : channel{channel}
+    {
+        ssh_callbacks_init(&callbacks);
+        callbacks.channel_exit_status_function = on_exit_status;
+        callbacks.userdata = this;
+        ssh_add_channel_callbacks(channel, &callbacks);
+    }
+
+    ~ExitStatusWatch()
+    {
+        ssh_remove_channel_callbacks(channel, &callbacks);
+    }
+
+    static void on_exit_status(ssh_session, ssh_channel, int exit_status, void* userdata)
+    {
+        static_cast<ExitStatusWatch*>(userdata)->exit_status = exit_status;
+    }
+
+    ssh_channel channel;
+    ssh_channel_callbacks_struct callbacks{};
+    mp::optional<int> exit_status;
+};
+
+mp::SSHProcess::SSHProcess(ssh_session session, const std::string& cmd, std::shared_ptr<SharedEvent> shared_event)
+    : session{session},
+      cmd{cmd},
+      channel{open_channel(session, cmd)},
+      exit_status_watch{std::make_unique<ExitStatusWatch>(channel.get())},
+      shared_event{std::move(shared_event)}
 {
+    SSH::throw_on_error(channel, session, "[ssh proc] exec request failed", ssh_channel_request_exec, cmd.c_str());
 }
 
+mp::SSHProcess::SSHProcess(SSHProcess&&) = default;
+mp::SSHProcess::~SSHProcess() = default;
+
 int mp::SSHProcess::exit_code(std::chrono::milliseconds timeout)
 {
-    exit_status = nullopt;
-    ExitStatusCallback cb{channel.get(), exit_status};
-
-    std::unique_ptr<ssh_event_struct, decltype(ssh_event_free)*> event{ssh_event_new(), ssh_event_free};
-    ssh_event_add_session(event.get(), session);
+    auto& exit_status = exit_status_watch->exit_status;
+    if (!exit_status && !event)
+        event = event_for(session, *shared_event);
 
     auto deadline = std::chrono::steady_clock::now() + timeout;
 
@@ -112,48 +147,92 @@ std::string mp::SSHProcess::read_std_error()
     return read_stream(StreamType::err);
 }
 
+void mp::SSHProcess::read_std_output(const OutputHandler& handler)
+{
+    read_stream(StreamType::out, handler);
+}
+
+void mp::SSHProcess::read_std_error(const OutputHandler& handler)
+{
+    read_stream(StreamType::err, handler);
+}
+
 std::string mp::SSHProcess::read_stream(StreamType type, int timeout)
 {
-    mpl::log(mpl::Level::debug, category,
-             fmt::format("{}:{} {}(type = {}, timeout = {}): ", __FILE__, __LINE__, __FUNCTION__,
-                         static_cast<int>(type), timeout));
+    std::string output;
+    if (!has_output_to_read())
+        return output;
+
+    // Reads go straight into the end of the output, asking for more at a time while they keep filling what they get
+    auto size = initial_read_size;
+    for (auto num_bytes = 1; num_bytes > 0; size = next_read_size(size, num_bytes))
+    {
+        const auto end = output.size();
+        output.resize(end + size);
+        num_bytes = read_chunk(type, &output[end], size, timeout);
+        output.resize(end + num_bytes);
+    }
+
+    return output;
+}
+
+void mp::SSHProcess::read_stream(StreamType type, const OutputHandler& handler, int timeout)
+{
+    if (!has_output_to_read())
+        return;
+
+    std::string buffer;
+    auto size = initial_read_size;
+    for (auto num_bytes = 1; num_bytes > 0; size = next_read_size(size, num_bytes))
+    {
+        buffer.resize(size);
+        num_bytes = read_chunk(type, &buffer[0], size, timeout);
+        if (num_bytes > 0)
+            handler(buffer.data(), num_bytes);
+    }
+}
+
+bool mp::SSHProcess::has_output_to_read()
+{
     // If the channel is closed there's no output to read
     if (ssh_channel_is_closed(channel.get()))
     {
         mpl::log(mpl::Level::debug, category,
                  fmt::format("{}:{} {}(): channel closed", __FILE__, __LINE__, __FUNCTION__));
-        return std::string();
+        return false;
     }
 
-    std::stringstream output;
-    std::array<char, 256> buffer;
-    int num_bytes{0};
-    const bool is_std_err = type == StreamType::err;
-    do
+    return true;
+}
+
+// Returns the number of bytes read, or 0 once there is nothing more to come
+int mp::SSHProcess::read_chunk(StreamType type, char* data, std::uint32_t size, int timeout)
+{
+    const auto num_bytes = ssh_channel_read_timeout(channel.get(), data, size, type == StreamType::err, timeout);
+    if (mpl::enabled(mpl::Level::trace))
+        mpl::log(mpl::Level::trace, category,
+                 fmt::format("{}:{} {}(type = {}, timeout = {}): num_bytes = {}", __FILE__, __LINE__, __FUNCTION__,
+                             static_cast<int>(type), timeout, num_bytes));
+
+    if (num_bytes < 0)
     {
-        num_bytes = ssh_channel_read_timeout(channel.get(), buffer.data(), buffer.size(), is_std_err, timeout);
-        mpl::log(mpl::Level::debug, category,
-                 fmt::format("{}:{} {}(): num_bytes = {}", __FILE__, __LINE__, __FUNCTION__, num_bytes));
-        if (num_bytes < 0)
+        // Latest libssh now returns an error if the channel has been closed instead of returning 0 bytes
+        if (ssh_channel_is_closed(channel.get()))
         {
-            // Latest libssh now returns an error if the channel has been closed instead of returning 0 bytes
-            if (ssh_channel_is_closed(channel.get()))
-            {
-                mpl::log(mpl::Level::debug, category,
-                         fmt::format("{}:{} {}(): channel closed", __FILE__, __LINE__, __FUNCTION__));
-                return output.str();
-            }
-
-            throw mp::SSHException(
-                fmt::format("error while reading ssh channel for remote process '{}' - error: {}", cmd, num_bytes));
+            mpl::log(mpl::Level::debug, category,
+                     fmt::format("{}:{} {}(): channel closed", __FILE__, __LINE__, __FUNCTION__));
+            return 0;
         }
-        output.write(buffer.data(), num_bytes);
-    } while (num_bytes > 0);
 
-    return output.str();
+        throw mp::SSHException(
+            fmt::format("error while reading ssh channel for remote process '{}' - error: {}", cmd, num_bytes));
+    }
+
+    return num_bytes;
 }
 
 ssh_channel mp::SSHProcess::release_channel()
 {
+    exit_status_watch.reset();
     return channel.release();
 }
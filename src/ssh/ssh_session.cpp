@@ -17,6 +17,7 @@
 
 #include <multipass/exceptions/ssh_exception.h>
 #include <multipass/format.h>
+#include <multipass/instrumentation.h>
 #include <multipass/logging/log.h>
 #include <multipass/ssh/ssh_key_provider.h>
 #include <multipass/ssh/ssh_session.h>
@@ -27,11 +28,175 @@
 
 #include <QDir>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
 #include <string>
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__aarch64__) && defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+#ifdef __linux__
+#include <linux/vm_sockets.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 
+namespace
+{
+std::mutex ciphers_mutex;
+std::string chosen_ciphers;
+
+// Connecting takes one round trip: well under a millisecond on the virtual link to a local instance, tens of them across
+// the links whose bandwidth, rather than the CPU, holds transfers back
+constexpr auto slow_link = std::chrono::milliseconds{20};
+constexpr auto compressed = "zlib@openssh.com,zlib,none";
+constexpr auto uncompressed = "none";
+
+std::mutex compression_mutex;
+// Only the daemon, and the processes it starts, follow local.ssh-compression; the CLI compresses when asked to
+auto chosen_compression = mp::SSHSession::Compression::never;
+auto chosen_compression_level = mp::SSHSession::default_compression_level;
+
+bool cpu_accelerates_aes()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 1);
+    return info[2] & (1 << 25); // AES-NI
+#elif defined(__x86_64__) || defined(__i386__)
+    unsigned eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_AES);
+#elif defined(__aarch64__) && defined(__linux__)
+    return getauxval(AT_HWCAP) & HWCAP_AES; // ARMv8 crypto extensions
+#elif defined(__aarch64__) && defined(__APPLE__)
+    return true; // every Apple arm64 CPU has them
+#else
+    return false;
+#endif
+}
+
+// Without AES instructions, ChaCha20-Poly1305 is the quickest; with them, AES-GCM is several times quicker still
+std::string ciphers()
+{
+    std::lock_guard<decltype(ciphers_mutex)> lock{ciphers_mutex};
+    if (!chosen_ciphers.empty())
+        return chosen_ciphers;
+
+    static const std::string automatic_ciphers =
+        cpu_accelerates_aes()
+            ? "aes128-gcm@openssh.com,aes256-gcm@openssh.com,chacha20-poly1305@openssh.com,aes256-ctr"
+            : "chacha20-poly1305@openssh.com,aes128-gcm@openssh.com,aes256-gcm@openssh.com,aes256-ctr";
+    return automatic_ciphers;
+}
+
+constexpr auto vsock_prefix = "vsock:";
+
+// Hands libssh a socket already connected within the timeout, which it then closes with the session
+#ifndef _WIN32
+// The error connecting a non-blocking socket ended in, 0 once it is connected
+int connect_within(int fd, const sockaddr* address, socklen_t length, std::chrono::milliseconds timeout)
+{
+    auto error = ::connect(fd, address, length) < 0 ? errno : 0;
+    if (error == EINPROGRESS)
+    {
+        pollfd poll_fd{fd, POLLOUT, 0};
+        socklen_t error_length = sizeof(error);
+        error = ETIMEDOUT;
+        if (::poll(&poll_fd, 1, static_cast<int>(timeout.count())) > 0)
+            ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_length);
+    }
+
+    return error;
+}
+
+// Connects the session's socket itself, to time the link alone: the handshake that follows also waits on the key
+// exchange's crypto, which a busy instance is slow at however close it is
+std::chrono::steady_clock::duration connect_tcp(ssh_session session, const std::string& host, int port,
+                                                std::chrono::milliseconds timeout)
+{
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses{nullptr};
+    if (const auto error = ::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses))
+        throw mp::SSHException(fmt::format("ssh connection failed: {}: {}", host, ::gai_strerror(error)));
+    std::unique_ptr<addrinfo, decltype(&::freeaddrinfo)> address_list{addresses, ::freeaddrinfo};
+
+    auto error = EHOSTUNREACH;
+    for (auto address = addresses; address; address = address->ai_next)
+    {
+        const auto fd = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0)
+        {
+            error = errno;
+            continue;
+        }
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        const auto start = std::chrono::steady_clock::now();
+        error = connect_within(fd, address->ai_addr, address->ai_addrlen, timeout);
+        const auto round_trip = std::chrono::steady_clock::now() - start;
+
+        if (!error && ssh_options_set(session, SSH_OPTIONS_FD, &fd) == SSH_OK)
+            return round_trip;
+
+        ::close(fd);
+        if (!error)
+            throw mp::SSHException(fmt::format("ssh connection failed: {}: {}", host, ssh_get_error(session)));
+    }
+
+    throw mp::SSHException(fmt::format("ssh connection failed: {}: {}", host, std::strerror(error)));
+}
+#endif
+
+void connect_vsock(ssh_session session, const std::string& host, [[maybe_unused]] int port,
+                   [[maybe_unused]] std::chrono::milliseconds timeout)
+{
+#ifdef __linux__
+    const auto cid = static_cast<unsigned>(std::strtoul(host.c_str() + std::strlen(vsock_prefix), nullptr, 10));
+    const auto fd = ::socket(AF_VSOCK, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0)
+        throw mp::SSHException(fmt::format("cannot create vsock socket: {}", std::strerror(errno)));
+
+    sockaddr_vm address{};
+    address.svm_family = AF_VSOCK;
+    address.svm_cid = cid;
+    address.svm_port = static_cast<unsigned>(port);
+
+    const auto error = connect_within(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address), timeout);
+    if (error || ssh_options_set(session, SSH_OPTIONS_FD, &fd) != SSH_OK)
+    {
+        ::close(fd);
+        throw mp::SSHException(
+            fmt::format("ssh connection failed: {}: {}", host, error ? std::strerror(error) : ssh_get_error(session)));
+    }
+#else
+    throw mp::SSHException(fmt::format("ssh connection failed: {} needs Linux", host));
+#endif
+}
+} // namespace
+
 mp::SSHSession::SSHSession(const std::string& host, int port, const std::string& username,
                            const SSHKeyProvider* key_provider, const std::chrono::milliseconds timeout)
     : session{ssh_new(), ssh_free}
@@ -42,22 +207,55 @@ mp::SSHSession::SSHSession(const std::string& host, int port, const std::string&
     const long timeout_secs = std::chrono::duration_cast<std::chrono::seconds>(timeout).count();
     const int nodelay{1};
     auto ssh_dir = QDir(MP_STDPATHS.writableLocation(StandardPaths::AppConfigLocation)).filePath("ssh").toStdString();
+    const auto preferred_ciphers = ciphers();
+    const auto chosen = compression();
+    auto level = compression_level();
+    auto compression = chosen == Compression::always ? compressed : uncompressed;
+
+    const auto connect_start = std::chrono::steady_clock::now();
+    if (is_vsock_host(host))
+    {
+        // libssh only checks the host name's syntax, having been handed a socket that is already connected
+        const auto name = "vsock-" + host.substr(std::strlen(vsock_prefix));
+        set_option(SSH_OPTIONS_HOST, name.c_str());
 
-    set_option(SSH_OPTIONS_HOST, host.c_str());
+        connect_vsock(session.get(), host, port, timeout);
+    }
+    else
+    {
+        set_option(SSH_OPTIONS_HOST, host.c_str());
+#ifndef _WIN32
+        if (chosen == Compression::automatic && connect_tcp(session.get(), host, port, timeout) >= slow_link)
+            compression = compressed;
+#endif
+    }
     set_option(SSH_OPTIONS_PORT, &port);
     set_option(SSH_OPTIONS_USER, username.c_str());
     set_option(SSH_OPTIONS_TIMEOUT, &timeout_secs);
     set_option(SSH_OPTIONS_NODELAY, &nodelay);
-    set_option(SSH_OPTIONS_CIPHERS_C_S, "chacha20-poly1305@openssh.com,aes256-ctr");
-    set_option(SSH_OPTIONS_CIPHERS_S_C, "chacha20-poly1305@openssh.com,aes256-ctr");
+    set_option(SSH_OPTIONS_CIPHERS_C_S, preferred_ciphers.c_str());
+    set_option(SSH_OPTIONS_CIPHERS_S_C, preferred_ciphers.c_str());
+    // Elliptic curve key exchange and host keys cost a fraction of what their RSA and DH counterparts do to set up
+    set_option(SSH_OPTIONS_KEY_EXCHANGE, "curve25519-sha256,curve25519-sha256@libssh.org,ecdh-sha2-nistp256,"
+                                         "diffie-hellman-group14-sha256,diffie-hellman-group14-sha1");
+    set_option(SSH_OPTIONS_HOSTKEYS, "ssh-ed25519,ecdsa-sha2-nistp256,rsa-sha2-512,rsa-sha2-256,ssh-rsa");
+    set_option(SSH_OPTIONS_COMPRESSION_C_S, compression);
+    set_option(SSH_OPTIONS_COMPRESSION_S_C, compression);
+    set_option(SSH_OPTIONS_COMPRESSION_LEVEL, &level);
     set_option(SSH_OPTIONS_SSH_DIR, ssh_dir.c_str());
 
+    if (compression == compressed)
+        mpl::log(mpl::Level::debug, "ssh session", fmt::format("Compressing traffic with {}:{}", host, port));
+
+    TraceSpan span{"ssh", "connect"};
     SSH::throw_on_error(session, "ssh connection failed", ssh_connect);
     if (key_provider)
     {
         SSH::throw_on_error(session, "ssh failed to authenticate", ssh_userauth_publickey, nullptr,
                             key_provider->private_key());
     }
+    MP_INSTRUMENTATION.observe("multipass_ssh_session_setup_seconds", {},
+                               std::chrono::steady_clock::now() - connect_start);
 }
 
 mp::SSHSession::SSHSession(const std::string& host, int port, const std::string& username,
@@ -71,10 +269,57 @@ mp::SSHSession::SSHSession(const std::string& host, int port, const std::chrono:
 {
 }
 
+std::string mp::SSHSession::vsock_host(unsigned cid)
+{
+    return fmt::format("{}{}", vsock_prefix, cid);
+}
+
+bool mp::SSHSession::is_vsock_host(const std::string& host)
+{
+    return host.rfind(vsock_prefix, 0) == 0;
+}
+
 mp::SSHProcess mp::SSHSession::exec(const std::string& cmd)
 {
     mpl::log(mpl::Level::debug, "ssh session", fmt::format("Executing '{}'", cmd));
-    return {session.get(), cmd};
+    return {session.get(), cmd, shared_event};
+}
+
+void mp::SSHSession::set_ciphers(const std::string& ciphers)
+{
+    std::lock_guard<decltype(ciphers_mutex)> lock{ciphers_mutex};
+    chosen_ciphers = ciphers;
+}
+
+void mp::SSHSession::set_compression(Compression compression, int level)
+{
+    std::lock_guard<decltype(compression_mutex)> lock{compression_mutex};
+    chosen_compression = compression;
+    chosen_compression_level = std::clamp(level, 1, 9);
+}
+
+mp::SSHSession::Compression mp::SSHSession::compression()
+{
+    std::lock_guard<decltype(compression_mutex)> lock{compression_mutex};
+    return chosen_compression;
+}
+
+mp::SSHSession::Compression mp::SSHSession::compression_for(const std::string& setting)
+{
+    if (setting == "on")
+        return Compression::always;
+    if (setting == "off")
+        return Compression::never;
+    if (setting == "auto")
+        return Compression::automatic;
+
+    return compression();
+}
+
+int mp::SSHSession::compression_level()
+{
+    std::lock_guard<decltype(compression_mutex)> lock{compression_mutex};
+    return chosen_compression_level;
 }
 
 void mp::SSHSession::force_shutdown()
@@ -110,6 +355,16 @@ const char* name_for(ssh_options_e type)
         return "client to server ciphers";
     case SSH_OPTIONS_CIPHERS_S_C:
         return "server to client ciphers";
+    case SSH_OPTIONS_KEY_EXCHANGE:
+        return "key exchange methods";
+    case SSH_OPTIONS_HOSTKEYS:
+        return "host key types";
+    case SSH_OPTIONS_COMPRESSION_C_S:
+        return "client to server compression";
+    case SSH_OPTIONS_COMPRESSION_S_C:
+        return "server to client compression";
+    case SSH_OPTIONS_COMPRESSION_LEVEL:
+        return "compression level";
     case SSH_OPTIONS_SSH_DIR:
         return "ssh config directory";
     default:
@@ -126,10 +381,15 @@ std::string as_string(ssh_options_e type, const void* value)
     case SSH_OPTIONS_USER:
     case SSH_OPTIONS_CIPHERS_C_S:
     case SSH_OPTIONS_CIPHERS_S_C:
+    case SSH_OPTIONS_KEY_EXCHANGE:
+    case SSH_OPTIONS_HOSTKEYS:
+    case SSH_OPTIONS_COMPRESSION_C_S:
+    case SSH_OPTIONS_COMPRESSION_S_C:
     case SSH_OPTIONS_SSH_DIR:
         return std::string(reinterpret_cast<const char*>(value));
     case SSH_OPTIONS_PORT:
     case SSH_OPTIONS_NODELAY:
+    case SSH_OPTIONS_COMPRESSION_LEVEL:
         return std::to_string(*reinterpret_cast<const int*>(value));
     case SSH_OPTIONS_TIMEOUT:
         return std::to_string(*reinterpret_cast<const long*>(value));
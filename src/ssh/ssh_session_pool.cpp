@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/ssh/ssh_session_pool.h>
+
+#include <algorithm>
+#include <exception>
+
+namespace mp = multipass;
+
+namespace
+{
+constexpr auto max_idle_sessions_per_instance = 2u;
+} // namespace
+
+mp::SSHSessionPool::Lease::Lease(SSHSessionPool& pool, const std::string& instance, unsigned generation,
+                                 const std::string& host, int port, const std::string& username,
+                                 std::unique_ptr<SSHSession> session)
+    : pool{&pool},
+      instance{instance},
+      generation{generation},
+      host{host},
+      port{port},
+      username{username},
+      session{std::move(session)},
+      initial_exc_count{std::uncaught_exceptions()}
+{
+}
+
+mp::SSHSessionPool::Lease::~Lease()
+{
+    // A failure while the session was in use may have left it in any state, so only clean returns are pooled
+    if (session && initial_exc_count == std::uncaught_exceptions())
+        pool->give_back(*this);
+}
+
+mp::SSHSession& mp::SSHSessionPool::Lease::operator*() const
+{
+    return *session;
+}
+
+mp::SSHSession* mp::SSHSessionPool::Lease::operator->() const
+{
+    return session.get();
+}
+
+mp::SSHSessionPool::SSHSessionPool(const SSHKeyProvider& key_provider, std::chrono::seconds max_idle_time)
+    : key_provider{key_provider}, max_idle_time{max_idle_time}
+{
+}
+
+mp::SSHSessionPool::Lease mp::SSHSessionPool::acquire(const std::string& instance, const std::string& host, int port,
+                                                      const std::string& username, std::chrono::milliseconds timeout)
+{
+    unsigned generation;
+    std::vector<IdleSession> stale;
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        generation = generations[instance];
+
+        auto& sessions = idle_sessions[instance];
+        const auto now = Clock::now();
+        while (!sessions.empty())
+        {
+            auto candidate = std::move(sessions.back());
+            sessions.pop_back();
+
+            if (candidate.host == host && candidate.port == port && candidate.username == username &&
+                now - candidate.idle_since < max_idle_time && ssh_is_connected(*candidate.session))
+                return {*this, instance, generation, host, port, username, std::move(candidate.session)};
+
+            stale.push_back(std::move(candidate)); // disconnect outside the lock
+        }
+    }
+
+    stale.clear();
+    return {*this,    instance, generation, host, port, username,
+            std::make_unique<SSHSession>(host, port, username, key_provider, timeout)};
+}
+
+void mp::SSHSessionPool::drop(const std::string& instance)
+{
+    std::vector<IdleSession> dropped;
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        ++generations[instance];
+
+        auto it = idle_sessions.find(instance);
+        if (it != idle_sessions.end())
+        {
+            dropped = std::move(it->second);
+            idle_sessions.erase(it);
+        }
+    }
+}
+
+void mp::SSHSessionPool::give_back(Lease& lease)
+{
+    std::unique_ptr<SSHSession> discarded;
+    std::lock_guard<std::mutex> lock{mutex};
+
+    auto& sessions = idle_sessions[lease.instance];
+    if (generations[lease.instance] != lease.generation || sessions.size() >= max_idle_sessions_per_instance)
+    {
+        discarded = std::move(lease.session);
+        return;
+    }
+
+    sessions.push_back({lease.host, lease.port, lease.username, std::move(lease.session), Clock::now()});
+}
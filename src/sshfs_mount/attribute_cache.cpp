@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/sshfs_mount/attribute_cache.h>
+
+#include <multipass/format.h>
+#include <multipass/logging/log.h>
+
+#include <QDir>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+
+namespace
+{
+constexpr auto category = "sftp attribute cache";
+constexpr uint32_t watch_mask = IN_ATTRIB | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MODIFY | IN_MOVE_SELF |
+                                IN_MOVED_FROM | IN_MOVED_TO | IN_DONT_FOLLOW | IN_ONLYDIR;
+
+std::string clean(const std::string& path)
+{
+    return QDir::cleanPath(QString::fromStdString(path)).toStdString();
+}
+
+std::string parent_of(const std::string& path)
+{
+    const auto pos = path.find_last_of('/');
+    if (pos == std::string::npos)
+        return {};
+
+    return pos == 0 ? "/" : path.substr(0, pos);
+}
+
+bool is_within(const std::string& path, const std::string& dir)
+{
+    return path == dir ||
+           (path.compare(0, dir.size(), dir) == 0 && (dir.back() == '/' || path[dir.size()] == '/'));
+}
+
+template <typename Map>
+void erase_tree(Map& map, const std::string& path)
+{
+    const auto prefix = path.back() == '/' ? path : path + '/';
+    auto it = map.lower_bound(prefix);
+    while (it != map.end() && it->first.compare(0, prefix.size(), prefix) == 0)
+        it = map.erase(it);
+}
+} // namespace
+
+mp::AttributeCache::AttributeCache(const std::string& root, std::size_t max_entries, std::size_t max_watches)
+    : root{root.empty() ? root : clean(root)},
+      max_entries{max_entries},
+      max_watches{max_watches}
+{
+    if (this->root.empty())
+        return;
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0 || pipe2(stop_fds, O_CLOEXEC) < 0)
+    {
+        mpl::log(mpl::Level::warning, category,
+                 fmt::format("Cannot watch \'{}\', not caching attributes: {}", this->root, std::strerror(errno)));
+        if (inotify_fd >= 0)
+            close(inotify_fd);
+        inotify_fd = -1;
+        return;
+    }
+
+    watcher = std::thread{&AttributeCache::watch_events, this};
+}
+
+mp::AttributeCache::~AttributeCache()
+{
+    if (watcher.joinable())
+    {
+        const char stop{0};
+        while (write(stop_fds[1], &stop, 1) < 0 && errno == EINTR)
+            ;
+        watcher.join(); // closes the inotify descriptor on its way out
+
+        close(stop_fds[0]);
+        close(stop_fds[1]);
+    }
+}
+
+auto mp::AttributeCache::attributes_of(const std::string& path, bool follow, const StatFunction& stat) -> Attributes
+{
+    const auto key = clean(path);
+    uint64_t observed_generation;
+    bool watched;
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        auto it = entries.find(key);
+        if (it != entries.end())
+        {
+            const auto& cached = follow ? it->second.followed : it->second.unfollowed;
+            if (cached)
+                return *cached;
+        }
+
+        // Watch before looking, so that no change can slip between the two
+        watched = watch_up_to(parent_of(key));
+        observed_generation = generation;
+    }
+
+    const auto attributes = stat();
+    if (!watched || attributes.through_link)
+        return attributes;
+
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    if (observed_generation == generation)
+    {
+        if (entries.size() >= max_entries && entries.count(key) == 0)
+            entries.erase(entries.begin());
+
+        auto& entry = entries[key];
+        (follow ? entry.followed : entry.unfollowed) = attributes;
+    }
+
+    return attributes;
+}
+
+void mp::AttributeCache::invalidate(const std::string& path)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    forget(clean(path));
+}
+
+void mp::AttributeCache::invalidate_tree(const std::string& path)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    forget_tree(clean(path));
+}
+
+// Watches every directory from the root down to dir, as renaming any of them moves what is cached below
+bool mp::AttributeCache::watch_up_to(const std::string& dir)
+{
+    if (inotify_fd < 0 || !is_within(dir, root))
+        return false;
+
+    std::vector<std::string> unwatched;
+    for (auto current = dir; !watches.count(current); current = parent_of(current))
+    {
+        unwatched.push_back(current);
+        if (current == root)
+            break;
+    }
+
+    for (auto it = unwatched.rbegin(); it != unwatched.rend(); ++it)
+    {
+        if (watches.size() >= max_watches)
+            return false;
+
+        const auto wd = inotify_add_watch(inotify_fd, it->c_str(), watch_mask);
+        if (wd < 0 || watched_dirs.count(wd)) // symlinks and directories reachable by other paths are left out
+            return false;
+
+        watches.emplace(*it, wd);
+        watched_dirs.emplace(wd, *it);
+    }
+
+    return true;
+}
+
+// Both need the mutex held
+void mp::AttributeCache::forget(const std::string& path)
+{
+    ++generation;
+
+    entries.erase(path);
+    entries.erase(parent_of(path)); // its times changed too
+}
+
+void mp::AttributeCache::forget_tree(const std::string& path)
+{
+    forget(path);
+    erase_tree(entries, path);
+
+    for (auto it = watches.begin(); it != watches.end();)
+    {
+        if (is_within(it->first, path))
+        {
+            inotify_rm_watch(inotify_fd, it->second);
+            watched_dirs.erase(it->second);
+            it = watches.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+void mp::AttributeCache::watch_events()
+{
+    alignas(inotify_event) char buffer[16 * 1024];
+    pollfd fds[]{{inotify_fd, POLLIN, 0}, {stop_fds[0], POLLIN, 0}};
+
+    while (true)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            mpl::log(mpl::Level::error, category,
+                     fmt::format("Stopped watching for changes: {}", std::strerror(errno)));
+            break;
+        }
+
+        if (fds[1].revents)
+            break;
+
+        const auto len = read(inotify_fd, buffer, sizeof(buffer));
+        for (auto pos = 0l; pos < len;)
+        {
+            const auto event = reinterpret_cast<const inotify_event*>(buffer + pos);
+            handle_event(event->wd, event->mask, event->len ? event->name : "");
+            pos += sizeof(inotify_event) + event->len;
+        }
+    }
+
+    // Nothing would tell stale entries apart from now on
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    ++generation;
+    entries.clear();
+    close(inotify_fd);
+    inotify_fd = -1;
+}
+
+void mp::AttributeCache::handle_event(int wd, uint32_t mask, const std::string& name)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    if (mask & IN_Q_OVERFLOW)
+    {
+        ++generation;
+        entries.clear();
+        return;
+    }
+
+    auto it = watched_dirs.find(wd);
+    if (it == watched_dirs.end())
+        return;
+
+    const auto dir = it->second;
+    if (mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+        forget_tree(dir); // drops the watch too, as it would otherwise follow the directory elsewhere
+    else if (!name.empty())
+    {
+        const auto path = dir == "/" ? dir + name : dir + '/' + name;
+        if (mask & IN_ISDIR)
+            forget_tree(path);
+        else
+            forget(path);
+    }
+}
@@ -29,7 +29,17 @@
 
 #include <QDateTime>
 #include <QDir>
+#include <QDirIterator>
 #include <QFile>
+#include <QThread>
+#include <QtConcurrent/QtConcurrent>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/statvfs.h>
 
 namespace mp = multipass;
 namespace mpl = multipass::logging;
@@ -38,8 +48,25 @@ namespace
 {
 constexpr auto category = "sftp server";
 using SftpHandleUPtr = std::unique_ptr<ssh_string_struct, void (*)(ssh_string)>;
+using MsgUPtr = std::unique_ptr<sftp_client_message_struct, decltype(sftp_client_message_free)*>;
 using namespace std::literals::chrono_literals;
 
+// At least, or one per host core where there are more, so that parallel I/O in the guest spreads over them
+constexpr auto min_concurrent_requests = 8;
+constexpr auto max_read_length = 255u * 1024u;     // as much as OpenSSH's sftp-server sends back
+constexpr auto max_pending_write = 1024u * 1024u;
+constexpr auto read_ahead_window = 4ll * 1024 * 1024;
+constexpr auto reads_before_read_ahead = 2;
+// sshfs keeps several reads in flight and the pool may serve them out of order, so near enough still counts as in order
+constexpr auto sequential_read_slack = static_cast<qint64>(min_concurrent_requests) * max_read_length;
+constexpr auto max_names_reply_size = 60u * 1024u; // well within what sftp clients take in one packet
+constexpr auto name_entry_overhead = 64u;          // the lengths and attributes that go with each name
+constexpr auto max_name_entry_size = 1024u;        // a longest file name, twice, plus the rest of the long name
+constexpr auto pending_requests_poll_interval = 1ms;
+constexpr auto shared_session_poll_interval = 100ms;
+constexpr auto sshfs_exit_status_timeout = 250ms;
+constexpr auto slow_operation_threshold = 1s;
+
 enum Permissions
 {
     read_user = 0400,
@@ -53,13 +80,6 @@ enum Permissions
     exec_other = 01
 };
 
-auto make_sftp_session(ssh_session session, ssh_channel channel)
-{
-    mp::SftpServer::SftpSessionUptr sftp_server_session{sftp_server_new(session, channel), sftp_free};
-    mp::SSH::throw_on_error(sftp_server_session, session, "[sftp] server init failed", sftp_server_init);
-    return sftp_server_session;
-}
-
 int reply_ok(sftp_client_message msg)
 {
     return sftp_reply_status(msg, SSH_FX_OK, nullptr);
@@ -85,78 +105,26 @@ int reply_unsupported(sftp_client_message msg)
     return sftp_reply_status(msg, SSH_FX_OP_UNSUPPORTED, "Unsupported message");
 }
 
-fmt::memory_buffer& operator<<(fmt::memory_buffer& buf, const char* v)
+std::string longname_from(const sftp_attributes_struct& attr, const std::string& filename)
 {
-    fmt::format_to(buf, v);
-    return buf;
-}
-
-auto longname_from(const QFileInfo& file_info, const std::string& filename)
-{
-    fmt::memory_buffer out;
-    auto mode = file_info.permissions();
-
-    if (file_info.isSymLink())
-        out << "l";
-    else if (file_info.isDir())
-        out << "d";
-    else
-        out << "-";
-
-    /* user */
-    if (mode & QFileDevice::ReadOwner)
-        out << "r";
-    else
-        out << "-";
-
-    if (mode & QFileDevice::WriteOwner)
-        out << "w";
-    else
-        out << "-";
-
-    if (mode & QFileDevice::ExeOwner)
-        out << "x";
-    else
-        out << "-";
-
-    /*group*/
-    if (mode & QFileDevice::ReadGroup)
-        out << "r";
-    else
-        out << "-";
-
-    if (mode & QFileDevice::WriteGroup)
-        out << "w";
-    else
-        out << "-";
-
-    if (mode & QFileDevice::ExeGroup)
-        out << "x";
-    else
-        out << "-";
-
-    /* other */
-    if (mode & QFileDevice::ReadOther)
-        out << "r";
-    else
-        out << "-";
-
-    if (mode & QFileDevice::WriteOther)
-        out << "w";
-    else
-        out << "-";
-
-    if (mode & QFileDevice::ExeOther)
-        out << "x";
-    else
-        out << "-";
-
-    fmt::format_to(out, " 1 {} {} {}", file_info.ownerId(), file_info.groupId(), file_info.size());
-
-    const auto timestamp = file_info.lastModified().toString("MMM d hh:mm:ss yyyy").toStdString();
-    fmt::format_to(out, " {} {}", timestamp, filename);
-
-    return out;
+    const auto type = attr.permissions & SSH_S_IFMT;
+    const auto perms = attr.permissions;
+    const char mode[]{type == SSH_S_IFLNK ? 'l' : type == SSH_S_IFDIR ? 'd' : '-',
+                      perms & Permissions::read_user ? 'r' : '-',
+                      perms & Permissions::write_user ? 'w' : '-',
+                      perms & Permissions::exec_user ? 'x' : '-',
+                      perms & Permissions::read_group ? 'r' : '-',
+                      perms & Permissions::write_group ? 'w' : '-',
+                      perms & Permissions::exec_group ? 'x' : '-',
+                      perms & Permissions::read_other ? 'r' : '-',
+                      perms & Permissions::write_other ? 'w' : '-',
+                      perms & Permissions::exec_other ? 'x' : '-',
+                      '\0'};
+
+    const auto timestamp =
+        QDateTime::fromSecsSinceEpoch(attr.mtime).toString("MMM d hh:mm:ss yyyy").toStdString();
+
+    return fmt::format("{} 1 {} {} {} {} {}", mode, attr.uid, attr.gid, attr.size, timestamp, filename);
 }
 
 auto to_qt_permissions(uint32_t perms)
@@ -211,6 +179,78 @@ auto to_unix_permissions(QFile::Permissions perms)
     return out;
 }
 
+// Requests that change nothing, so they can be served alongside each other in any order. Anything else waits for
+// them all to be answered first. Reads don't move the file position, so even those on the same handle can overlap.
+bool runs_concurrently(uint8_t type)
+{
+    switch (type)
+    {
+    case SFTP_READ:
+    case SFTP_FSTAT:
+    case SFTP_STAT:
+    case SFTP_LSTAT:
+    case SFTP_REALPATH:
+    case SFTP_READLINK:
+        return true;
+    default:
+        return false;
+    }
+}
+
+const char* operation_name(uint8_t type)
+{
+    switch (type)
+    {
+    case SFTP_REALPATH:
+        return "realpath";
+    case SFTP_OPENDIR:
+        return "opendir";
+    case SFTP_MKDIR:
+        return "mkdir";
+    case SFTP_RMDIR:
+        return "rmdir";
+    case SFTP_LSTAT:
+        return "lstat";
+    case SFTP_STAT:
+        return "stat";
+    case SFTP_FSTAT:
+        return "fstat";
+    case SFTP_READDIR:
+        return "readdir";
+    case SFTP_CLOSE:
+        return "close";
+    case SFTP_OPEN:
+        return "open";
+    case SFTP_READ:
+        return "read";
+    case SFTP_WRITE:
+        return "write";
+    case SFTP_RENAME:
+        return "rename";
+    case SFTP_REMOVE:
+        return "remove";
+    case SFTP_SETSTAT:
+        return "setstat";
+    case SFTP_FSETSTAT:
+        return "fsetstat";
+    case SFTP_READLINK:
+        return "readlink";
+    case SFTP_SYMLINK:
+        return "symlink";
+    case SFTP_EXTENDED:
+        return "extended";
+    default:
+        return "unknown";
+    }
+}
+
+// Each worker reads into its own buffer, grown as needed and kept for the next read
+std::vector<char>& read_buffer()
+{
+    thread_local std::vector<char> buffer;
+    return buffer;
+}
+
 auto validate_path(const std::string& source_path, const std::string& current_path)
 {
     if (source_path.empty())
@@ -220,13 +260,172 @@ auto validate_path(const std::string& source_path, const std::string& current_pa
 }
 
 template <typename T>
-auto handle_from(sftp_client_message msg, const std::unordered_map<void*, std::unique_ptr<T>>& handles) -> T*
+auto handle_from(sftp_client_message msg, const mp::HandleTable<T>& handles) -> T*
+{
+    if (msg->handle == nullptr)
+        return nullptr;
+    return handles.find(ssh_string_data(msg->handle), ssh_string_len(msg->handle));
+}
+
+template <typename T>
+auto handle_from(const std::string& handle, const mp::HandleTable<T>& handles) -> T*
 {
-    const auto id = sftp_handle(msg->sftp, msg->handle);
-    auto entry = handles.find(id);
-    if (entry != handles.end())
-        return entry->second.get();
-    return nullptr;
+    return handles.find(handle.data(), handle.size());
+}
+
+bool remove_handle(sftp_client_message msg, mp::HandleTable<QFile>& files, mp::HandleTable<QDirIterator>& dirs)
+{
+    if (msg->handle == nullptr)
+        return false;
+
+    const auto data = ssh_string_data(msg->handle);
+    const auto size = ssh_string_len(msg->handle);
+    return files.remove(data, size) || dirs.remove(data, size);
+}
+
+auto reply_handle(sftp_client_message msg, const std::string& handle)
+{
+    SftpHandleUPtr handle_string{ssh_string_new(handle.size()), ssh_string_free};
+    if (handle_string == nullptr || ssh_string_fill(handle_string.get(), handle.data(), handle.size()) != 0)
+        return SSH_ERROR;
+
+    return sftp_reply_handle(msg, handle_string.get());
+}
+
+// libssh only parses the arguments of the extensions it knows about, so the others are read from the raw message,
+// which starts with the request id and the extension name
+class ExtendedArgs
+{
+public:
+    explicit ExtendedArgs(sftp_client_message msg)
+        : data{static_cast<const unsigned char*>(ssh_buffer_get(msg->complete_message))},
+          left{ssh_buffer_get_len(msg->complete_message)}
+    {
+        u32();    // id
+        string(); // extension name
+    }
+
+    bool ok() const
+    {
+        return valid;
+    }
+
+    uint32_t u32()
+    {
+        return static_cast<uint32_t>(number(4));
+    }
+
+    uint64_t u64()
+    {
+        return number(8);
+    }
+
+    std::string string()
+    {
+        const auto len = u32();
+        if (!valid || len > left)
+            return fail(), std::string{};
+
+        std::string out(reinterpret_cast<const char*>(data), len);
+        data += len;
+        left -= len;
+        return out;
+    }
+
+private:
+    uint64_t number(uint32_t len)
+    {
+        if (!valid || len > left)
+            return fail(), 0;
+
+        uint64_t out = 0;
+        for (uint32_t i = 0; i < len; ++i)
+            out = (out << 8) | data[i];
+        data += len;
+        left -= len;
+        return out;
+    }
+
+    void fail()
+    {
+        valid = false;
+        left = 0;
+    }
+
+    const unsigned char* data;
+    uint32_t left;
+    bool valid{true};
+};
+
+void append_u32(std::string& out, uint32_t value)
+{
+    for (auto shift : {24, 16, 8, 0})
+        out.push_back(static_cast<char>((value >> shift) & 0xff));
+}
+
+void append_u64(std::string& out, uint64_t value)
+{
+    append_u32(out, static_cast<uint32_t>(value >> 32));
+    append_u32(out, static_cast<uint32_t>(value));
+}
+
+void append_string(std::string& out, const std::string& value)
+{
+    append_u32(out, static_cast<uint32_t>(value.size()));
+    out += value;
+}
+
+// sftp_server_init() only advertises the extensions libssh knows of, so clients would not use the others that
+// handle_extended() serves: the version packet is sent from here instead
+int init_sftp_server(sftp_session sftp)
+{
+    std::unique_ptr<sftp_packet_struct, decltype(sftp_packet_free)*> packet{sftp_packet_read(sftp), sftp_packet_free};
+    if (packet == nullptr || packet->type != SSH_FXP_INIT || ssh_buffer_get_len(packet->payload) < 4)
+        return SSH_ERROR;
+
+    const auto version = static_cast<const unsigned char*>(ssh_buffer_get(packet->payload));
+    sftp->client_version = (version[0] << 24) | (version[1] << 16) | (version[2] << 8) | version[3];
+
+    std::string payload;
+    append_u32(payload, LIBSFTP_VERSION);
+    for (const auto& extension : {std::make_pair("posix-rename@openssh.com", "1"),
+                                  std::make_pair("hardlink@openssh.com", "1"), std::make_pair("fsync@openssh.com", "1"),
+                                  std::make_pair("statvfs@openssh.com", "2"), std::make_pair("limits@openssh.com", "1"),
+                                  std::make_pair("copy-data", "1")})
+    {
+        append_string(payload, extension.first);
+        append_string(payload, extension.second);
+    }
+
+    std::unique_ptr<ssh_buffer_struct, decltype(ssh_buffer_free)*> reply{ssh_buffer_new(), ssh_buffer_free};
+    if (reply == nullptr || ssh_buffer_add_data(reply.get(), payload.data(), payload.size()) != SSH_OK)
+        return SSH_ERROR;
+
+    return sftp_packet_write(sftp, SSH_FXP_VERSION, reply.get()) < 0 ? SSH_ERROR : SSH_OK;
+}
+
+auto make_sftp_session(mp::SharedSSHSession& shared_session, ssh_channel channel)
+{
+    std::lock_guard<decltype(shared_session.mutex)> lock{shared_session.mutex};
+    ssh_session session = shared_session.session;
+    mp::SftpServer::SftpSessionUptr sftp_server_session{sftp_server_new(session, channel), sftp_free};
+    mp::SSH::throw_on_error(sftp_server_session, session, "[sftp] server init failed", init_sftp_server);
+    return sftp_server_session;
+}
+
+// libssh has no reply for extensions, so the packet is put together here
+int reply_extended(sftp_client_message msg, const std::string& payload)
+{
+    constexpr uint8_t extended_reply = 201; // SSH_FXP_EXTENDED_REPLY
+
+    std::string packet;
+    append_u32(packet, static_cast<uint32_t>(payload.size() + 5));
+    packet.push_back(static_cast<char>(extended_reply));
+    append_u32(packet, msg->id);
+    packet += payload;
+
+    const auto written = ssh_channel_write(msg->sftp->channel, packet.data(), static_cast<uint32_t>(packet.size()));
+    return written == static_cast<int>(packet.size()) ? 0 : -1;
 }
 
 void check_sshfs_status(mp::SSHSession& session, mp::SSHProcess& sshfs_process)
@@ -242,37 +441,79 @@ void check_sshfs_status(mp::SSHSession& session, mp::SSHProcess& sshfs_process)
     }
 }
 
-auto create_sshfs_process(mp::SSHSession& session, const std::string& sshfs_exec_line, const std::string& source,
-                          const std::string& target)
+auto create_sshfs_process(mp::SharedSSHSession& shared_session, const std::string& sshfs_exec_line,
+                          const std::string& source, const std::string& target, bool replacing = false)
 {
-    auto sshfs_process = session.exec(fmt::format("sudo {} :\"{}\" \"{}\"", sshfs_exec_line, source, target));
+    // A replacement goes in the same exec as unmounting what is left of the last one, lazily in case anything in the
+    // instance still holds on to it, so that the mount is back as soon as it can be
+    const auto cleanup = replacing ? fmt::format("sudo umount -l \"{}\" 2>/dev/null; ", target) : std::string{};
+
+    std::lock_guard<decltype(shared_session.mutex)> lock{shared_session.mutex};
+    auto& session = shared_session.session;
+    auto sshfs_process =
+        session.exec(fmt::format("{}sudo {} :\"{}\" \"{}\"", cleanup, sshfs_exec_line, source, target));
 
     check_sshfs_status(session, sshfs_process);
 
     return std::make_unique<mp::SSHProcess>(std::move(sshfs_process));
 }
+
 } // namespace
 
 mp::SftpServer::SftpServer(SSHSession&& session, const std::string& source, const std::string& target,
                            const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map,
                            int default_uid, int default_gid, const std::string& sshfs_exec_line)
+    : SftpServer{std::make_shared<SharedSSHSession>(std::move(session)),
+                 false,
+                 source,
+                 target,
+                 gid_map,
+                 uid_map,
+                 default_uid,
+                 default_gid,
+                 sshfs_exec_line}
+{
+}
+
+mp::SftpServer::SftpServer(std::shared_ptr<SharedSSHSession> session, const std::string& source,
+                           const std::string& target, const std::unordered_map<int, int>& gid_map,
+                           const std::unordered_map<int, int>& uid_map, int default_uid, int default_gid,
+                           const std::string& sshfs_exec_line)
+    : SftpServer{std::move(session), true, source, target, gid_map, uid_map, default_uid, default_gid, sshfs_exec_line}
+{
+}
+
+mp::SftpServer::SftpServer(std::shared_ptr<SharedSSHSession> session, bool session_is_shared,
+                           const std::string& source, const std::string& target,
+                           const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map,
+                           int default_uid, int default_gid, const std::string& sshfs_exec_line)
     : ssh_session{std::move(session)},
-      sshfs_process{create_sshfs_process(ssh_session, sshfs_exec_line, mp::utils::escape_char(source, '"'),
+      session_is_shared{session_is_shared},
+      sshfs_process{create_sshfs_process(*ssh_session, sshfs_exec_line, mp::utils::escape_char(source, '"'),
                                          mp::utils::escape_char(target, '"'))},
-      sftp_server_session{make_sftp_session(ssh_session, sshfs_process->release_channel())},
+      sftp_server_session{make_sftp_session(*ssh_session, sshfs_process->release_channel())},
       source_path{source},
       target_path{target},
       gid_map{gid_map},
       uid_map{uid_map},
       default_uid{default_uid},
       default_gid{default_gid},
-      sshfs_exec_line{sshfs_exec_line}
+      sshfs_exec_line{sshfs_exec_line},
+      attribute_cache{source}
 {
+    request_pool.setMaxThreadCount(std::max(min_concurrent_requests, QThread::idealThreadCount()));
+    watch_sshfs_channel();
 }
 
 mp::SftpServer::~SftpServer()
 {
     stop_invoked = true;
+
+    // Closing the channel uses the session, which others may be using
+    wait_for_pending_requests();
+    std::lock_guard<decltype(ssh_session->mutex)> lock{ssh_session->mutex};
+    sftp_server_session.reset();
+    sshfs_process.reset();
 }
 
 sftp_attributes_struct mp::SftpServer::attr_from(const QFileInfo& file_info)
@@ -334,8 +575,36 @@ int mp::SftpServer::mapped_gid_for(const int gid)
     return gid;
 }
 
+mp::AttributeCache::Attributes mp::SftpServer::attributes_for(const std::string& filename, const bool follow)
+{
+    return attribute_cache.attributes_of(filename, follow, [this, &filename, follow] {
+        QFileInfo file_info(QString::fromStdString(filename));
+        AttributeCache::Attributes attributes{{}, file_info.isSymLink() || file_info.exists(), false};
+
+        if (!follow && file_info.isSymLink())
+        {
+            mp::platform::symlink_attr_from(filename.c_str(), &attributes.attr);
+            attributes.attr.uid = mapped_uid_for(attributes.attr.uid);
+            attributes.attr.gid = mapped_gid_for(attributes.attr.gid);
+        }
+        else
+        {
+            if (file_info.isSymLink())
+            {
+                file_info = QFileInfo(file_info.symLinkTarget());
+                attributes.through_link = true;
+            }
+
+            attributes.attr = attr_from(file_info);
+        }
+
+        return attributes;
+    });
+}
+
 void mp::SftpServer::process_message(sftp_client_message msg)
 {
+    const auto start = std::chrono::steady_clock::now();
     int ret = 0;
     const auto type = sftp_client_message_get_type(msg);
     switch (type)
@@ -399,79 +668,313 @@ void mp::SftpServer::process_message(sftp_client_message msg)
     }
     if (ret != 0)
         mpl::log(mpl::Level::error, category, fmt::format("error occurred when replying to client: {}", ret));
+
+    record(operation_name(type), std::chrono::steady_clock::now() - start, sftp_client_message_get_filename(msg));
 }
 
-void mp::SftpServer::run()
+sftp_client_message mp::SftpServer::next_message()
+{
+    // While requests are being served, their replies need the session too, as do the other servers when the session
+    // is shared, so in those cases only look for new requests that have already arrived, rather than blocking on them
+    while (!stop_invoked)
+    {
+        bool pending;
+        {
+            std::lock_guard<decltype(pending_mutex)> lock{pending_mutex};
+            pending = pending_requests > 0;
+        }
+
+        if (!pending && !session_is_shared)
+            break;
+
+        std::uint64_t arrivals{0};
+        if (session_is_shared)
+        {
+            // Polling the channel takes in whatever came in on the session, for the other servers' channels too
+            SharedSSHSession::Turn turn{*ssh_session};
+            arrivals = ssh_session->arrivals();
+            if (ssh_channel_poll_timeout(sftp_server_session->channel, 0, 0) != 0) // data, or an error to read
+                return sftp_get_client_message(sftp_server_session.get());
+        }
+        else
+        {
+            std::lock_guard<decltype(ssh_session->mutex)> lock{ssh_session->mutex};
+            if (ssh_channel_poll_timeout(sftp_server_session->channel, 0, 0) != 0)
+                return sftp_get_client_message(sftp_server_session.get());
+        }
+
+        if (pending)
+        {
+            std::unique_lock<decltype(pending_mutex)> lock{pending_mutex};
+            pending_cv.wait_for(lock, pending_requests_poll_interval, [this] { return pending_requests == 0; });
+        }
+        else
+        {
+            // Until something comes in, or another server takes in something that may be for this one
+            ssh_session->wait_for_data(arrivals, shared_session_poll_interval);
+        }
+    }
+
+    if (session_is_shared) // stopping, and the session stays up for the others
+        return nullptr;
+
+    std::lock_guard<decltype(ssh_session->mutex)> lock{ssh_session->mutex};
+    return sftp_get_client_message(sftp_server_session.get());
+}
+
+void mp::SftpServer::dispatch(sftp_client_message msg)
+{
+    const auto type = sftp_client_message_get_type(msg);
+    if (type != SFTP_WRITE) // anything else could look at what was written
+        flush_pending_write();
+
+    if (!runs_concurrently(type))
+    {
+        MsgUPtr client_msg{msg, sftp_client_message_free};
+        wait_for_pending_requests();
+        if (session_is_shared) // the other servers keep polling the session on threads of their own
+        {
+            SharedSSHSession::Turn turn{*ssh_session};
+            process_message(msg);
+        }
+        else
+        {
+            process_message(msg);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<decltype(pending_mutex)> lock{pending_mutex};
+        ++pending_requests;
+    }
+
+    QtConcurrent::run(&request_pool, [this, msg] {
+        try
+        {
+            process_message(msg);
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::error, category, fmt::format("error occurred when serving a request: {}", e.what()));
+        }
+        sftp_client_message_free(msg);
+
+        {
+            std::lock_guard<decltype(pending_mutex)> lock{pending_mutex};
+            --pending_requests;
+        }
+        pending_cv.notify_all();
+    });
+}
+
+bool mp::SftpServer::flush_pending_write()
+{
+    if (pending_write.data.empty())
+        return true;
+
+    const auto start = std::chrono::steady_clock::now();
+    auto file = pending_write.file;
+    const auto size = static_cast<qint64>(pending_write.data.size());
+    const auto written = MP_FILEOPS.write_at(*file, pending_write.data.data(), size, pending_write.offset);
+    pending_write.data.clear();
+    attribute_cache.invalidate(file->fileName().toStdString());
+
+    // The write requests only fill the pending write, so this is where writing takes its time
+    record("flush", std::chrono::steady_clock::now() - start);
+    if (written > 0)
+        bytes_written += written;
+
+    if (written != size)
+    {
+        mpl::log_limited(mpl::Level::error, category, "{}: write failed for \'{}\' at {}: {}", __FUNCTION__,
+                         file->fileName(), pending_write.offset, std::strerror(errno));
+        failed_writes.insert(file);
+        return false;
+    }
+
+    return true;
+}
+
+void mp::SftpServer::read_ahead(QFile* file, qint64 offset, qint64 length)
 {
-    using MsgUPtr = std::unique_ptr<sftp_client_message_struct, decltype(sftp_client_message_free)*>;
+    qint64 from, to;
+    {
+        std::lock_guard<std::mutex> lock{read_ahead_mutex};
+        auto& ahead = read_aheads[file];
 
+        if (std::abs(offset - ahead.next_offset) > sequential_read_slack)
+        {
+            ahead = ReadAhead{offset + length};
+            return;
+        }
+
+        ahead.next_offset = std::max(ahead.next_offset, offset + length);
+        if (++ahead.sequential_reads < reads_before_read_ahead ||
+            ahead.advised_to >= ahead.next_offset + read_ahead_window / 2)
+            return;
+
+        // The page cache is kept coherent with writes, so what it reads ahead never needs throwing away
+        from = std::max(ahead.advised_to, ahead.next_offset);
+        to = ahead.advised_to = ahead.next_offset + read_ahead_window;
+    }
+
+    MP_FILEOPS.advise_will_need(*file, from, to - from);
+}
+
+void mp::SftpServer::record(const char* operation, std::chrono::steady_clock::duration duration, const char* path)
+{
+    const auto seconds = std::chrono::duration<double>(duration).count();
+    const auto slow = duration >= slow_operation_threshold;
+    {
+        std::lock_guard<std::mutex> lock{stats_mutex};
+        auto& stats = sftp_stats.operations[operation];
+        const auto bucket = Instrumentation::bucket_of(duration);
+        if (bucket < stats.bucket_counts.size())
+            ++stats.bucket_counts[bucket];
+        ++stats.count;
+        stats.seconds += seconds;
+        stats.max_seconds = std::max(stats.max_seconds, seconds);
+        sftp_stats.slow_operations += slow;
+    }
+
+    if (slow)
+        mpl::log_limited(mpl::Level::warning, category, "slow {} in '{}'{}: {:.3f}s", operation, target_path,
+                         path ? fmt::format(" of '{}'", path) : "", seconds);
+}
+
+mp::SftpStats mp::SftpServer::stats() const
+{
+    std::unique_lock<std::mutex> lock{stats_mutex};
+    auto stats = sftp_stats;
+    lock.unlock();
+
+    stats.bytes_read = bytes_read;
+    stats.bytes_written = bytes_written;
+    return stats;
+}
+
+void mp::SftpServer::wait_for_pending_requests()
+{
+    std::unique_lock<decltype(pending_mutex)> lock{pending_mutex};
+    pending_cv.wait(lock, [this] { return pending_requests == 0; });
+}
+
+template <typename Reply>
+int mp::SftpServer::reply(Reply&& send)
+{
+    if (session_is_shared) // the reply may take in requests for the other servers too
+    {
+        SharedSSHSession::Turn turn{*ssh_session};
+        return send();
+    }
+
+    std::lock_guard<decltype(ssh_session->mutex)> lock{ssh_session->mutex};
+    return send();
+}
+
+void mp::SftpServer::run()
+{
     while (true)
     {
-        MsgUPtr client_msg{sftp_get_client_message(sftp_server_session.get()), sftp_client_message_free};
+        MsgUPtr client_msg{next_message(), sftp_client_message_free};
         auto msg = client_msg.get();
         if (msg == nullptr)
         {
-            if (stop_invoked)
-                break;
-
-            int status{0};
-            try
-            {
-                status = sshfs_process->exit_code(250ms);
-            }
-            catch (const mp::ExitlessSSHProcessException&)
-            {
-                status = 1;
-            }
+            wait_for_pending_requests();
+            flush_pending_write();
 
-            if (status != 0)
-            {
-                mpl::log(mpl::Level::error, category,
-                         "sshfs in the instance appears to have exited unexpectedly.  Trying to recover.");
-                auto proc = ssh_session.exec(fmt::format("findmnt --source :{}  -o TARGET -n", source_path));
-                auto mount_path = proc.read_std_output();
-                if (!mount_path.empty())
-                {
-                    ssh_session.exec(fmt::format("sudo umount {}", mount_path));
-                }
-
-                sshfs_process =
-                    create_sshfs_process(ssh_session, sshfs_exec_line, mp::utils::escape_char(source_path, '"'),
-                                         mp::utils::escape_char(target_path, '"'));
-                sftp_server_session = make_sftp_session(ssh_session, sshfs_process->release_channel());
-
-                continue;
-            }
-            else
-            {
+            if (stop_invoked || sshfs_exit_status() == 0)
                 break;
-            }
+
+            mpl::log(mpl::Level::error, category,
+                     "sshfs in the instance appears to have exited unexpectedly.  Trying to recover.");
+            remount();
+            continue;
         }
 
-        process_message(msg);
+        dispatch(client_msg.release());
+    }
+}
+
+// Learns of sshfs going away from the channel itself, as whatever reads the session gets to its last packets
+void mp::SftpServer::watch_sshfs_channel()
+{
+    std::lock_guard<decltype(ssh_session->mutex)> lock{ssh_session->mutex};
+    sshfs_exit_code = nullopt;
+    sshfs_channel_closed = false;
+
+    sshfs_channel_callbacks = {};
+    ssh_callbacks_init(&sshfs_channel_callbacks);
+    sshfs_channel_callbacks.userdata = this;
+    sshfs_channel_callbacks.channel_exit_status_function = [](ssh_session, ssh_channel, int exit_status, void* server) {
+        static_cast<SftpServer*>(server)->sshfs_exit_code = exit_status;
+    };
+    sshfs_channel_callbacks.channel_eof_function = [](ssh_session, ssh_channel, void* server) {
+        static_cast<SftpServer*>(server)->sshfs_channel_closed = true;
+    };
+    sshfs_channel_callbacks.channel_close_function = [](ssh_session, ssh_channel, void* server) {
+        static_cast<SftpServer*>(server)->sshfs_channel_closed = true;
+    };
+    ssh_add_channel_callbacks(sftp_server_session->channel, &sshfs_channel_callbacks);
+}
+
+int mp::SftpServer::sshfs_exit_status()
+{
+    std::lock_guard<decltype(ssh_session->mutex)> lock{ssh_session->mutex};
+
+    // The exit status comes ahead of the channel closing, so it is normally in by now; otherwise give it a moment
+    if (!sshfs_exit_code && !sshfs_channel_closed)
+    {
+        std::unique_ptr<ssh_event_struct, decltype(ssh_event_free)*> event{ssh_event_new(), ssh_event_free};
+        ssh_event_add_session(event.get(), ssh_session->session);
+        ssh_event_dopoll(event.get(), std::chrono::milliseconds(sshfs_exit_status_timeout).count());
     }
+
+    return sshfs_exit_code.value_or(1); // gone without an exit status, like when killed
+}
+
+void mp::SftpServer::remount()
+{
+    // Whatever the instance had open went with the old sshfs' FUSE connection and cannot be brought back, so only the
+    // host side of those handles is left to let go of
+    open_file_handles.clear();
+    open_dir_handles.clear();
+    failed_writes.clear();
+    {
+        std::lock_guard<decltype(ssh_session->mutex)> lock{ssh_session->mutex};
+        sftp_server_session.reset();
+    }
+
+    sshfs_process = create_sshfs_process(*ssh_session, sshfs_exec_line, mp::utils::escape_char(source_path, '"'),
+                                         mp::utils::escape_char(target_path, '"'), true);
+    sftp_server_session = make_sftp_session(*ssh_session, sshfs_process->release_channel());
+    watch_sshfs_channel();
 }
 
 void mp::SftpServer::stop()
 {
     stop_invoked = true;
-    ssh_session.force_shutdown();
+    if (!session_is_shared) // otherwise, next_message notices
+        ssh_session->session.force_shutdown();
 }
 
 int mp::SftpServer::handle_close(sftp_client_message msg)
 {
-    const auto id = sftp_handle(sftp_server_session.get(), msg->handle);
-
-    auto erased = open_file_handles.erase(id);
-    erased += open_dir_handles.erase(id);
-    if (erased == 0)
+    const auto file = handle_from(msg, open_file_handles);
+    const auto write_failed = file != nullptr && failed_writes.erase(file) > 0;
+    if (file != nullptr)
     {
-        mpl::log(mpl::Level::error, category, fmt::format("{}: bad handle requested", __FUNCTION__));
+        std::lock_guard<std::mutex> lock{read_ahead_mutex};
+        read_aheads.erase(file);
+    }
+    if (!remove_handle(msg, open_file_handles, open_dir_handles))
+    {
+        mpl::log_limited(mpl::Level::error, category, "{}: bad handle requested", __FUNCTION__);
         return reply_bad_handle(msg, "close");
     }
 
-    sftp_handle_remove(sftp_server_session.get(), id);
-    return reply_ok(msg);
+    return write_failed ? reply_failure(msg) : reply_ok(msg);
 }
 
 int mp::SftpServer::handle_fstat(sftp_client_message msg)
@@ -479,17 +982,12 @@ int mp::SftpServer::handle_fstat(sftp_client_message msg)
     auto file = handle_from(msg, open_file_handles);
     if (file == nullptr)
     {
-        mpl::log(mpl::Level::error, category, fmt::format("{}: bad handle requested", __FUNCTION__));
-        return reply_bad_handle(msg, "fstat");
+        mpl::log_limited(mpl::Level::error, category, "{}: bad handle requested", __FUNCTION__);
+        return reply([&] { return reply_bad_handle(msg, "fstat"); });
     }
 
-    QFileInfo file_info(*file);
-
-    if (file_info.isSymLink())
-        file_info = QFileInfo(file_info.symLinkTarget());
-
-    auto attr = attr_from(file_info);
-    return sftp_reply_attr(msg, &attr);
+    auto attr = attributes_for(file->fileName().toStdString(), true).attr;
+    return reply([&] { return sftp_reply_attr(msg, &attr); });
 }
 
 int mp::SftpServer::handle_mkdir(sftp_client_message msg)
@@ -503,6 +1001,7 @@ int mp::SftpServer::handle_mkdir(sftp_client_message msg)
         return reply_perm_denied(msg);
     }
 
+    attribute_cache.invalidate(filename);
     QDir dir(filename);
     if (!dir.mkdir(filename))
     {
@@ -542,6 +1041,7 @@ int mp::SftpServer::handle_rmdir(sftp_client_message msg)
         return reply_perm_denied(msg);
     }
 
+    attribute_cache.invalidate_tree(filename);
     QDir dir(filename);
     if (!MP_FILEOPS.rmdir(dir, filename))
     {
@@ -588,6 +1088,9 @@ int mp::SftpServer::handle_open(sftp_client_message msg)
     if (flags & SSH_FXF_TRUNC)
         mode |= QIODevice::Truncate;
 
+    if (flags & (SSH_FXF_WRITE | SSH_FXF_CREAT | SSH_FXF_TRUNC))
+        attribute_cache.invalidate(filename);
+
     auto file = std::make_unique<QFile>(filename);
 
     auto exists = QFileInfo(filename).isSymLink() || file->exists();
@@ -619,16 +1122,8 @@ int mp::SftpServer::handle_open(sftp_client_message msg)
         }
     }
 
-    SftpHandleUPtr sftp_handle{sftp_handle_alloc(sftp_server_session.get(), file.get()), ssh_string_free};
-    if (!sftp_handle)
-    {
-        mpl::log(mpl::Level::error, category, "Cannot allocate handle for open()");
-        return reply_failure(msg);
-    }
-
-    open_file_handles.emplace(file.get(), std::move(file));
-
-    return sftp_reply_handle(msg, sftp_handle.get());
+    // The file stays open for as long as the handle, every read and write on it going straight to its descriptor
+    return reply_handle(msg, open_file_handles.add(std::move(file)));
 }
 
 int mp::SftpServer::handle_opendir(sftp_client_message msg)
@@ -655,19 +1150,9 @@ int mp::SftpServer::handle_opendir(sftp_client_message msg)
         return reply_perm_denied(msg);
     }
 
-    auto entry_list =
-        std::make_unique<QFileInfoList>(dir.entryInfoList(QDir::AllEntries | QDir::System | QDir::Hidden));
+    auto entries = std::make_unique<QDirIterator>(dir.path(), QDir::AllEntries | QDir::System | QDir::Hidden);
 
-    SftpHandleUPtr sftp_handle{sftp_handle_alloc(sftp_server_session.get(), entry_list.get()), ssh_string_free};
-    if (!sftp_handle)
-    {
-        mpl::log(mpl::Level::error, category, "Cannot allocate handle for opendir()");
-        return reply_failure(msg);
-    }
-
-    open_dir_handles.emplace(entry_list.get(), std::move(entry_list));
-
-    return sftp_reply_handle(msg, sftp_handle.get());
+    return reply_handle(msg, open_dir_handles.add(std::move(entries)));
 }
 
 int mp::SftpServer::handle_read(sftp_client_message msg)
@@ -675,34 +1160,30 @@ int mp::SftpServer::handle_read(sftp_client_message msg)
     auto file = handle_from(msg, open_file_handles);
     if (file == nullptr)
     {
-        mpl::log(mpl::Level::error, category, fmt::format("{}: bad handle requested", __FUNCTION__));
-        return reply_bad_handle(msg, "read");
+        mpl::log_limited(mpl::Level::error, category, "{}: bad handle requested", __FUNCTION__);
+        return reply([&] { return reply_bad_handle(msg, "read"); });
     }
 
-    const auto max_packet_size = 65536u;
-    const auto len = std::min(msg->len, max_packet_size);
-
-    std::vector<char> data;
-    data.reserve(len);
-
-    if (!MP_FILEOPS.seek(*file, msg->offset))
-    {
-        mpl::log(mpl::Level::error, category,
-                 fmt::format("{}: cannot seek to position {} in \'{}\'", __FUNCTION__, msg->offset, file->fileName()));
-        return reply_failure(msg);
-    }
+    const auto len = std::min(msg->len, max_read_length);
+    auto& data = read_buffer();
+    data.resize(std::max<size_t>(data.size(), len));
 
-    auto r = MP_FILEOPS.read(*file, data.data(), len);
+    auto r = MP_FILEOPS.read_at(*file, data.data(), len, msg->offset);
     if (r < 0)
     {
-        mpl::log(mpl::Level::error, category,
-                 fmt::format("{}: read failed for {}: {}", __FUNCTION__, file->fileName(), file->errorString()));
-        return sftp_reply_status(msg, SSH_FX_FAILURE, file->errorString().toStdString().c_str());
+        const std::string error = std::strerror(errno);
+        mpl::log_limited(mpl::Level::error, category, "{}: read failed for {} at {}: {}", __FUNCTION__,
+                         file->fileName(), msg->offset, error);
+        return reply([&] { return sftp_reply_status(msg, SSH_FX_FAILURE, error.c_str()); });
     }
     else if (r == 0)
-        return sftp_reply_status(msg, SSH_FX_EOF, "End of file");
+        return reply([&] { return sftp_reply_status(msg, SSH_FX_EOF, "End of file"); });
+
+    const auto ret = reply([&] { return sftp_reply_data(msg, data.data(), r); });
+    bytes_read += r;
+    read_ahead(file, msg->offset, r);
 
-    return sftp_reply_data(msg, data.data(), r);
+    return ret;
 }
 
 int mp::SftpServer::handle_readdir(sftp_client_message msg)
@@ -710,33 +1191,24 @@ int mp::SftpServer::handle_readdir(sftp_client_message msg)
     auto dir_entries = handle_from(msg, open_dir_handles);
     if (dir_entries == nullptr)
     {
-        mpl::log(mpl::Level::error, category, fmt::format("{}: bad handle requested", __FUNCTION__));
+        mpl::log_limited(mpl::Level::error, category, "{}: bad handle requested", __FUNCTION__);
         return reply_bad_handle(msg, "readdir");
     }
 
-    if (dir_entries->empty())
+    if (!dir_entries->hasNext())
         return sftp_reply_status(msg, SSH_FX_EOF, nullptr);
 
-    const auto max_num_entries_per_packet = 50;
-    const auto num_entries = std::min(dir_entries->size(), max_num_entries_per_packet);
-
-    for (int i = 0; i < num_entries; i++)
+    // Entries are read as they are sent, so even huge directories are never held whole
+    std::size_t reply_size = 0;
+    while (dir_entries->hasNext() && reply_size + max_name_entry_size <= max_names_reply_size)
     {
-        const QFileInfo entry = dir_entries->takeFirst();
-        const auto filename = entry.fileName().toStdString();
-        sftp_attributes_struct attr{};
-        if (entry.isSymLink())
-        {
-            mp::platform::symlink_attr_from(entry.absoluteFilePath().toStdString().c_str(), &attr);
-            attr.uid = mapped_uid_for(attr.uid);
-            attr.gid = mapped_gid_for(attr.gid);
-        }
-        else
-        {
-            attr = attr_from(entry);
-        }
-        const auto longname = longname_from(entry, filename);
-        sftp_reply_names_add(msg, filename.c_str(), longname.data(), &attr);
+        const auto path = dir_entries->next().toStdString();
+        const auto filename = dir_entries->fileName().toStdString();
+        auto attr = attributes_for(path, false).attr;
+        const auto longname = longname_from(attr, filename);
+
+        sftp_reply_names_add(msg, filename.c_str(), longname.c_str(), &attr);
+        reply_size += filename.size() + longname.size() + name_entry_overhead;
     }
 
     return sftp_reply_names(msg);
@@ -750,19 +1222,19 @@ int mp::SftpServer::handle_readlink(sftp_client_message msg)
         mpl::log(
             mpl::Level::error, category,
             fmt::format("{}: cannot validate path \'{}\' against source \'{}\'", __FUNCTION__, filename, source_path));
-        return reply_perm_denied(msg);
+        return reply([&] { return reply_perm_denied(msg); });
     }
 
     auto link = QFile::symLinkTarget(filename);
     if (link.isEmpty())
     {
         mpl::log(mpl::Level::error, category, fmt::format("{}: invalid link for \'{}\'", __FUNCTION__, filename));
-        return sftp_reply_status(msg, SSH_FX_NO_SUCH_FILE, "invalid link");
+        return reply([&] { return sftp_reply_status(msg, SSH_FX_NO_SUCH_FILE, "invalid link"); });
     }
 
     sftp_attributes_struct attr{};
     sftp_reply_names_add(msg, link.toStdString().c_str(), link.toStdString().c_str(), &attr);
-    return sftp_reply_names(msg);
+    return reply([&] { return sftp_reply_names(msg); });
 }
 
 int mp::SftpServer::handle_realpath(sftp_client_message msg)
@@ -773,11 +1245,11 @@ int mp::SftpServer::handle_realpath(sftp_client_message msg)
         mpl::log(
             mpl::Level::error, category,
             fmt::format("{}: cannot validate path \'{}\' against source \'{}\'", __FUNCTION__, filename, source_path));
-        return reply_perm_denied(msg);
+        return reply([&] { return reply_perm_denied(msg); });
     }
 
     auto realpath = QFileInfo(filename).absoluteFilePath();
-    return sftp_reply_name(msg, realpath.toStdString().c_str(), nullptr);
+    return reply([&] { return sftp_reply_name(msg, realpath.toStdString().c_str(), nullptr); });
 }
 
 int mp::SftpServer::handle_remove(sftp_client_message msg)
@@ -791,6 +1263,7 @@ int mp::SftpServer::handle_remove(sftp_client_message msg)
         return reply_perm_denied(msg);
     }
 
+    attribute_cache.invalidate(filename);
     QFile file{filename};
     if (!MP_FILEOPS.remove(file))
     {
@@ -828,6 +1301,9 @@ int mp::SftpServer::handle_rename(sftp_client_message msg)
         return reply_perm_denied(msg);
     }
 
+    attribute_cache.invalidate_tree(source);
+    attribute_cache.invalidate_tree(target);
+
     QFile target_file{target};
     if (target_file.exists())
     {
@@ -859,7 +1335,7 @@ int mp::SftpServer::handle_setstat(sftp_client_message msg)
         auto handle = handle_from(msg, open_file_handles);
         if (handle == nullptr)
         {
-            mpl::log(mpl::Level::error, category, fmt::format("{}: bad handle requested", __FUNCTION__));
+            mpl::log_limited(mpl::Level::error, category, "{}: bad handle requested", __FUNCTION__);
             return reply_bad_handle(msg, "setstat");
         }
 
@@ -884,6 +1360,8 @@ int mp::SftpServer::handle_setstat(sftp_client_message msg)
         }
     }
 
+    attribute_cache.invalidate(filename.toStdString());
+
     QFile file{filename};
 
     if (msg->attr->flags & SSH_FILEXFER_ATTR_SIZE)
@@ -936,34 +1414,18 @@ int mp::SftpServer::handle_stat(sftp_client_message msg, const bool follow)
         mpl::log(
             mpl::Level::error, category,
             fmt::format("{}: cannot validate path \'{}\' against source \'{}\'", __FUNCTION__, filename, source_path));
-        return reply_perm_denied(msg);
+        return reply([&] { return reply_perm_denied(msg); });
     }
 
-    QFileInfo file_info(filename);
-    if (!file_info.isSymLink() && !file_info.exists())
+    auto attributes = attributes_for(filename, follow);
+    if (!attributes.exists)
     {
         mpl::log(mpl::Level::error, category,
                  fmt::format("{}: cannot stat  \'{}\': no such file", __FUNCTION__, filename));
-        return sftp_reply_status(msg, SSH_FX_NO_SUCH_FILE, "no such file");
+        return reply([&] { return sftp_reply_status(msg, SSH_FX_NO_SUCH_FILE, "no such file"); });
     }
 
-    sftp_attributes_struct attr{};
-
-    if (!follow && file_info.isSymLink())
-    {
-        mp::platform::symlink_attr_from(filename, &attr);
-        attr.uid = mapped_uid_for(attr.uid);
-        attr.gid = mapped_gid_for(attr.gid);
-    }
-    else
-    {
-        if (file_info.isSymLink())
-            file_info = QFileInfo(file_info.symLinkTarget());
-
-        attr = attr_from(file_info);
-    }
-
-    return sftp_reply_attr(msg, &attr);
+    return reply([&] { return sftp_reply_attr(msg, &attributes.attr); });
 }
 
 int mp::SftpServer::handle_symlink(sftp_client_message msg)
@@ -979,6 +1441,8 @@ int mp::SftpServer::handle_symlink(sftp_client_message msg)
         return reply_perm_denied(msg);
     }
 
+    attribute_cache.invalidate(new_name);
+
     if (!MP_PLATFORM.symlink(old_name, new_name, QFileInfo(old_name).isDir()))
     {
         mpl::log(mpl::Level::error, category,
@@ -1005,35 +1469,31 @@ int mp::SftpServer::handle_write(sftp_client_message msg)
     auto file = handle_from(msg, open_file_handles);
     if (file == nullptr)
     {
-        mpl::log(mpl::Level::error, category, fmt::format("{}: bad handle requested", __FUNCTION__));
+        mpl::log_limited(mpl::Level::error, category, "{}: bad handle requested", __FUNCTION__);
         return reply_bad_handle(msg, "write");
     }
 
-    auto len = ssh_string_len(msg->data);
-    auto data_ptr = ssh_string_get_char(msg->data);
-    if (!MP_FILEOPS.seek(*file, msg->offset))
-    {
-        mpl::log(mpl::Level::error, category,
-                 fmt::format("{}: cannot seek to position {} in \'{}\'", __FUNCTION__, msg->offset, file->fileName()));
-        return reply_failure(msg);
-    }
+    attribute_cache.invalidate(file->fileName().toStdString());
 
-    do
-    {
-        auto r = MP_FILEOPS.write(*file, data_ptr, len);
-        if (r < 0)
-        {
-            mpl::log(
-                mpl::Level::error, category,
-                fmt::format("{}: write failed for \'{}\': {}", __FUNCTION__, file->fileName(), file->errorString()));
-            return reply_failure(msg);
-        }
+    if (failed_writes.count(file))
+        return reply_failure(msg); // already logged
 
-        file->flush();
+    const auto len = ssh_string_len(msg->data);
+    const auto data = ssh_string_get_char(msg->data);
+    const auto offset = static_cast<qint64>(msg->offset);
+    if (pending_write.file != file || pending_write.offset + static_cast<qint64>(pending_write.data.size()) != offset)
+        flush_pending_write();
 
-        data_ptr += r;
-        len -= r;
-    } while (len > 0);
+    // Hold on to small writes, to send them together with those that follow on
+    if (pending_write.data.empty())
+    {
+        pending_write.file = file;
+        pending_write.offset = offset;
+    }
+    pending_write.data.insert(pending_write.data.end(), data, data + len);
+
+    if (pending_write.data.size() >= max_pending_write && !flush_pending_write())
+        return reply_failure(msg);
 
     return reply_ok(msg);
 }
@@ -1061,6 +1521,8 @@ int mp::SftpServer::handle_extended(sftp_client_message msg)
             return reply_perm_denied(msg);
         }
 
+        attribute_cache.invalidate(new_name);
+
         if (!MP_PLATFORM.link(old_name, new_name))
         {
             mpl::log(mpl::Level::error, category,
@@ -1072,6 +1534,22 @@ int mp::SftpServer::handle_extended(sftp_client_message msg)
     {
         return handle_rename(msg);
     }
+    else if (method == "fsync@openssh.com")
+    {
+        return handle_fsync(msg);
+    }
+    else if (method == "statvfs@openssh.com")
+    {
+        return handle_statvfs(msg);
+    }
+    else if (method == "limits@openssh.com")
+    {
+        return handle_limits(msg);
+    }
+    else if (method == "copy-data")
+    {
+        return handle_copy_data(msg);
+    }
     else
     {
         mpl::log(mpl::Level::warning, category, fmt::format("Unhandled extended method requested: {}", method));
@@ -1080,3 +1558,115 @@ int mp::SftpServer::handle_extended(sftp_client_message msg)
 
     return reply_ok(msg);
 }
+
+int mp::SftpServer::handle_fsync(sftp_client_message msg)
+{
+    ExtendedArgs args{msg};
+    const auto handle = args.string();
+    auto file = handle_from(handle, open_file_handles);
+    if (!args.ok() || file == nullptr)
+    {
+        mpl::log_limited(mpl::Level::error, category, "{}: bad handle requested", __FUNCTION__);
+        return reply_bad_handle(msg, "fsync");
+    }
+
+    // A write that failed earlier is not one that syncing could make good on
+    if (failed_writes.count(file) > 0)
+    {
+        mpl::log(mpl::Level::error, category,
+                 fmt::format("{}: cannot sync '{}', as a write to it failed", __FUNCTION__, file->fileName()));
+        return reply_failure(msg);
+    }
+
+    if (!MP_FILEOPS.sync(*file))
+    {
+        mpl::log(mpl::Level::error, category,
+                 fmt::format("{}: failed to sync '{}': {}", __FUNCTION__, file->fileName(), std::strerror(errno)));
+        return reply_failure(msg);
+    }
+
+    return reply_ok(msg);
+}
+
+int mp::SftpServer::handle_statvfs(sftp_client_message msg)
+{
+    ExtendedArgs args{msg};
+    const auto path = args.string();
+    if (!args.ok() || !validate_path(source_path, path))
+    {
+        mpl::log(mpl::Level::error, category,
+                 fmt::format("{}: cannot validate path \'{}\' against source \'{}\'", __FUNCTION__, path, source_path));
+        return reply_perm_denied(msg);
+    }
+
+    struct statvfs fs;
+    if (::statvfs(path.c_str(), &fs) != 0)
+    {
+        mpl::log(mpl::Level::error, category,
+                 fmt::format("{}: cannot get file system info for '{}': {}", __FUNCTION__, path, std::strerror(errno)));
+        return reply_failure(msg);
+    }
+
+    constexpr uint64_t read_only = 1, no_setuid = 2; // as sftp clients know them
+    const uint64_t flags = (fs.f_flag & ST_RDONLY ? read_only : 0) | (fs.f_flag & ST_NOSUID ? no_setuid : 0);
+
+    std::string payload;
+    for (uint64_t value : {static_cast<uint64_t>(fs.f_bsize), static_cast<uint64_t>(fs.f_frsize),
+                           static_cast<uint64_t>(fs.f_blocks), static_cast<uint64_t>(fs.f_bfree),
+                           static_cast<uint64_t>(fs.f_bavail), static_cast<uint64_t>(fs.f_files),
+                           static_cast<uint64_t>(fs.f_ffree), static_cast<uint64_t>(fs.f_favail),
+                           static_cast<uint64_t>(fs.f_fsid), flags, static_cast<uint64_t>(fs.f_namemax)})
+        append_u64(payload, value);
+
+    return reply_extended(msg, payload);
+}
+
+int mp::SftpServer::handle_limits(sftp_client_message msg)
+{
+    constexpr uint64_t max_packet_length = 256u * 1024u;
+
+    std::string payload;
+    append_u64(payload, max_packet_length);
+    append_u64(payload, max_read_length);
+    append_u64(payload, max_read_length); // writes come in packets just as big
+    append_u64(payload, 0);               // no limit on open handles
+
+    return reply_extended(msg, payload);
+}
+
+int mp::SftpServer::handle_copy_data(sftp_client_message msg)
+{
+    ExtendedArgs args{msg};
+    auto from = handle_from(args.string(), open_file_handles);
+    const auto from_offset = args.u64();
+    auto length = args.u64();
+    auto to = handle_from(args.string(), open_file_handles);
+    const auto to_offset = args.u64();
+    if (!args.ok() || from == nullptr || to == nullptr)
+    {
+        mpl::log_limited(mpl::Level::error, category, "{}: bad handle requested", __FUNCTION__);
+        return reply_bad_handle(msg, "copy-data");
+    }
+
+    if (length == 0) // all the way to the end of the file
+        length = from_offset < static_cast<uint64_t>(from->size()) ? from->size() - from_offset : 0;
+
+    if (from->fileName() == to->fileName() && from_offset < to_offset + length && to_offset < from_offset + length)
+    {
+        mpl::log(mpl::Level::error, category,
+                 fmt::format("{}: cannot copy overlapping ranges of '{}'", __FUNCTION__, from->fileName()));
+        return reply_failure(msg);
+    }
+
+    attribute_cache.invalidate(to->fileName().toStdString());
+
+    if (MP_FILEOPS.copy_range(*from, from_offset, *to, to_offset, length) < 0)
+    {
+        mpl::log(mpl::Level::error, category,
+                 fmt::format("{}: failed copying from '{}' to '{}': {}", __FUNCTION__, from->fileName(),
+                             to->fileName(), std::strerror(errno)));
+        return reply_failure(msg);
+    }
+
+    return reply_ok(msg);
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/sshfs_mount/sftp_stats.h>
+
+#include <QJsonArray>
+
+namespace mp = multipass;
+
+namespace
+{
+QJsonValue to_json_value(quint64 value)
+{
+    return static_cast<qint64>(value);
+}
+
+quint64 from_json_value(const QJsonValue& value)
+{
+    return static_cast<quint64>(value.toDouble());
+}
+} // namespace
+
+QJsonObject mp::SftpStats::to_json() const
+{
+    QJsonObject json_operations;
+    for (const auto& entry : operations)
+    {
+        const auto& operation = entry.second;
+
+        QJsonArray bucket_counts;
+        for (const auto bucket_count : operation.bucket_counts)
+            bucket_counts.append(to_json_value(bucket_count));
+
+        json_operations.insert(QString::fromStdString(entry.first),
+                               QJsonObject{{"buckets", bucket_counts},
+                                           {"count", to_json_value(operation.count)},
+                                           {"seconds", operation.seconds},
+                                           {"max_seconds", operation.max_seconds}});
+    }
+
+    return {{"operations", json_operations},
+            {"bytes_read", to_json_value(bytes_read)},
+            {"bytes_written", to_json_value(bytes_written)},
+            {"slow_operations", to_json_value(slow_operations)}};
+}
+
+mp::SftpStats mp::SftpStats::from_json(const QJsonObject& json)
+{
+    SftpStats stats;
+
+    const auto json_operations = json["operations"].toObject();
+    for (auto it = json_operations.constBegin(); it != json_operations.constEnd(); ++it)
+    {
+        const auto json_operation = it.value().toObject();
+        auto& operation = stats.operations[it.key().toStdString()];
+
+        const auto bucket_counts = json_operation["buckets"].toArray();
+        for (auto i = 0u; i < operation.bucket_counts.size() && i < static_cast<unsigned>(bucket_counts.size()); ++i)
+            operation.bucket_counts[i] = from_json_value(bucket_counts[i]);
+
+        operation.count = from_json_value(json_operation["count"]);
+        operation.seconds = json_operation["seconds"].toDouble();
+        operation.max_seconds = json_operation["max_seconds"].toDouble();
+    }
+
+    stats.bytes_read = from_json_value(json["bytes_read"]);
+    stats.bytes_written = from_json_value(json["bytes_written"]);
+    stats.slow_operations = from_json_value(json["slow_operations"]);
+
+    return stats;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/ssh/shared_ssh_session.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace mp = multipass;
+
+namespace
+{
+bool has_incoming_data(ssh_session session)
+{
+    pollfd fd{ssh_get_fd(session), POLLIN, 0};
+    return ::poll(&fd, 1, 0) > 0;
+}
+} // namespace
+
+mp::SharedSSHSession::SharedSSHSession(SSHSession&& session) : session{std::move(session)}
+{
+    // Without it, waiters only find what others took in for them once their timeout passes
+    if (::pipe(wakeup_pipe) == 0)
+    {
+        ::fcntl(wakeup_pipe[0], F_SETFL, O_NONBLOCK);
+        ::fcntl(wakeup_pipe[1], F_SETFL, O_NONBLOCK);
+    }
+    else
+    {
+        wakeup_pipe[0] = wakeup_pipe[1] = -1;
+    }
+}
+
+mp::SharedSSHSession::~SharedSSHSession()
+{
+    for (const auto fd : wakeup_pipe)
+        if (fd >= 0)
+            ::close(fd);
+}
+
+mp::SharedSSHSession::Turn::Turn(SharedSSHSession& shared)
+    : shared{shared}, lock{shared.mutex}, incoming{has_incoming_data(shared.session)}
+{
+}
+
+mp::SharedSSHSession::Turn::~Turn()
+{
+    if (incoming)
+        shared.announce_arrival();
+}
+
+std::uint64_t mp::SharedSSHSession::arrivals()
+{
+    std::lock_guard<decltype(arrivals_mutex)> lock{arrivals_mutex};
+    return arrival_count;
+}
+
+void mp::SharedSSHSession::announce_arrival()
+{
+    std::lock_guard<decltype(arrivals_mutex)> lock{arrivals_mutex};
+    ++arrival_count;
+
+    if (waiting && !woken && wakeup_pipe[1] >= 0)
+    {
+        const char byte{0};
+        woken = ::write(wakeup_pipe[1], &byte, 1) == 1;
+    }
+}
+
+void mp::SharedSSHSession::wait_for_data(std::uint64_t seen, std::chrono::milliseconds timeout)
+{
+    {
+        std::lock_guard<decltype(arrivals_mutex)> lock{arrivals_mutex};
+        if (arrival_count != seen)
+            return;
+        ++waiting;
+    }
+
+    pollfd fds[]{{ssh_get_fd(session), POLLIN, 0}, {wakeup_pipe[0], POLLIN, 0}};
+    ::poll(fds, wakeup_pipe[0] >= 0 ? 2 : 1, timeout.count());
+
+    // The pipe stays readable until the last of those it was written for is awake, so that none of them misses it
+    std::lock_guard<decltype(arrivals_mutex)> lock{arrivals_mutex};
+    if (--waiting == 0 && woken)
+    {
+        char buffer[16];
+        while (::read(wakeup_pipe[0], buffer, sizeof(buffer)) > 0)
+            ;
+        woken = false;
+    }
+}
@@ -87,6 +87,9 @@ auto get_sshfs_exec_and_options(mp::SSHSession& session)
 
     auto version_info{run_cmd(session, fmt::format("sudo {} -V", sshfs_exec))};
 
+    // sshfs 3.7 and later can spread requests over several connections (max_conns), but not in slave mode, where its
+    // one connection is its standard input and output. Requests on that one are pipelined, and the host serves them
+    // concurrently instead
     sshfs_exec += " -o slave -o transform_symlinks -o allow_other -o Compression=no";
 
     auto fuse_version_line = mp::utils::match_line_for(version_info, fuse_version_string);
@@ -167,8 +170,15 @@ void set_owner_for(mp::SSHSession& session, const std::string& root, const std::
                                  relative_target.substr(0, relative_target.find_first_of('/'))));
 }
 
-auto make_sftp_server(mp::SSHSession&& session, const std::string& source, const std::string& target,
-                      const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map)
+struct MountSetup
+{
+    std::string sshfs_exec_line;
+    std::string target;
+    int default_uid;
+    int default_gid;
+};
+
+auto prepare_mount(mp::SSHSession& session, const std::string& source, const std::string& target)
 {
     mpl::log(mpl::Level::debug, category,
              fmt::format("{}:{} {}(source = {}, target = {}, …): ", __FILE__, __LINE__, __FUNCTION__, source, target));
@@ -196,15 +206,47 @@ auto make_sftp_server(mp::SSHSession&& session, const std::string& source, const
         set_owner_for(session, leading, missing, default_uid, default_gid);
     }
 
-    return std::make_unique<mp::SftpServer>(std::move(session), source, leading + missing, gid_map, uid_map,
-                                            default_uid, default_gid, sshfs_exec_line);
+    return MountSetup{sshfs_exec_line, leading + missing, default_uid, default_gid};
+}
+
+auto make_sftp_server(mp::SSHSession&& session, const std::string& source, const std::string& target,
+                      const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map)
+{
+    const auto setup = prepare_mount(session, source, target);
+
+    return std::make_unique<mp::SftpServer>(std::move(session), source, setup.target, gid_map, uid_map,
+                                            setup.default_uid, setup.default_gid, setup.sshfs_exec_line);
+}
+
+auto make_sftp_server(std::shared_ptr<mp::SharedSSHSession> session, const std::string& source,
+                      const std::string& target, const std::unordered_map<int, int>& gid_map,
+                      const std::unordered_map<int, int>& uid_map)
+{
+    std::unique_lock<decltype(session->mutex)> lock{session->mutex};
+    const auto setup = prepare_mount(session->session, source, target);
+    lock.unlock();
+
+    return std::make_unique<mp::SftpServer>(std::move(session), source, setup.target, gid_map, uid_map,
+                                            setup.default_uid, setup.default_gid, setup.sshfs_exec_line);
 }
 
 } // namespace
 
 mp::SshfsMount::SshfsMount(SSHSession&& session, const std::string& source, const std::string& target,
                            const std::unordered_map<int, int>& gid_map, const std::unordered_map<int, int>& uid_map)
-    : sftp_server{make_sftp_server(std::move(session), source, target, gid_map, uid_map)}, sftp_thread{[this] {
+    : SshfsMount{make_sftp_server(std::move(session), source, target, gid_map, uid_map)}
+{
+}
+
+mp::SshfsMount::SshfsMount(std::shared_ptr<SharedSSHSession> session, const std::string& source,
+                           const std::string& target, const std::unordered_map<int, int>& gid_map,
+                           const std::unordered_map<int, int>& uid_map)
+    : SshfsMount{make_sftp_server(std::move(session), source, target, gid_map, uid_map)}
+{
+}
+
+mp::SshfsMount::SshfsMount(std::unique_ptr<SftpServer> server)
+    : sftp_server{std::move(server)}, sftp_thread{[this] {
           std::cout << "Connected" << std::endl;
           sftp_server->run();
           std::cout << "Stopped" << std::endl;
@@ -223,3 +265,8 @@ void mp::SshfsMount::stop()
     if (sftp_thread.joinable())
         sftp_thread.join();
 }
+
+mp::SftpStats mp::SshfsMount::stats() const
+{
+    return sftp_server->stats();
+}
@@ -17,15 +17,22 @@
 
 #include <multipass/exceptions/sshfs_missing_error.h>
 #include <multipass/format.h>
+#include <multipass/instrumentation.h>
 #include <multipass/logging/log.h>
 #include <multipass/platform.h>
 #include <multipass/ssh/ssh_key_provider.h>
+#include <multipass/ssh/ssh_session.h>
 #include <multipass/sshfs_mount/sshfs_mounts.h>
 #include <multipass/sshfs_server_config.h>
 #include <multipass/utils.h>
 #include <multipass/virtual_machine.h>
 
 #include <QEventLoop>
+#include <QJsonDocument>
+#include <QtConcurrent/QtConcurrent>
+
+#include <algorithm>
+#include <unordered_set>
 
 namespace mp = multipass;
 namespace mpl = multipass::logging;
@@ -33,6 +40,48 @@ namespace mpl = multipass::logging;
 namespace
 {
 constexpr auto category = "sshfs-mounts";
+constexpr auto stats_prefix = "Stats ";
+
+std::string label_value(const std::string& value)
+{
+    std::string escaped;
+    for (const auto c : value)
+    {
+        if (c == '\\' || c == '"')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+// The stats are counted since the process started, while the metrics go on across processes, so they take the growth
+void add_to_metrics(const std::string& instance, const std::string& target_path, const mp::SftpStats& now,
+                    const mp::SftpStats& before)
+{
+    const auto labels = fmt::format("instance=\"{}\",mount=\"{}\"", label_value(instance), label_value(target_path));
+
+    for (const auto& entry : now.operations)
+    {
+        auto growth = entry.second;
+        const auto previous = before.operations.find(entry.first);
+        if (previous != before.operations.end())
+        {
+            for (auto i = 0u; i < growth.bucket_counts.size(); ++i)
+                growth.bucket_counts[i] -= previous->second.bucket_counts[i];
+            growth.count -= previous->second.count;
+            growth.seconds -= previous->second.seconds;
+        }
+
+        if (growth.count)
+            MP_INSTRUMENTATION.observe_histogram("multipass_mount_operation_seconds",
+                                                 fmt::format("{},operation=\"{}\"", labels, entry.first),
+                                                 growth.bucket_counts, growth.count, growth.seconds);
+    }
+
+    MP_INSTRUMENTATION.add("multipass_mount_read_bytes", labels, now.bytes_read - before.bytes_read);
+    MP_INSTRUMENTATION.add("multipass_mount_written_bytes", labels, now.bytes_written - before.bytes_written);
+    MP_INSTRUMENTATION.add("multipass_mount_slow_operations", labels, now.slow_operations - before.slow_operations);
+}
 
 template <typename Signal>
 void start_and_block_until(mp::Process* process, Signal signal, std::function<bool(mp::Process* process)> ready_decider)
@@ -64,63 +113,101 @@ mp::SSHFSMounts::SSHFSMounts(const SSHKeyProvider& key_provider) : key(key_provi
 
 void mp::SSHFSMounts::start_mount(VirtualMachine* vm, const std::string& source_path, const std::string& target_path,
                                   const std::unordered_map<int, int>& gid_map,
-                                  const std::unordered_map<int, int>& uid_map)
+                                  const std::unordered_map<int, int>& uid_map, const std::string& compression)
 {
+    start_mounts(vm, {{source_path, target_path, gid_map, uid_map}}, compression);
+}
+
+void mp::SSHFSMounts::start_mounts(VirtualMachine* vm, const std::vector<SSHFSServerConfig::Mount>& mounts,
+                                   const std::string& compression)
+{
+    if (mounts.empty())
+        return;
+
     mp::SSHFSServerConfig config;
     config.host = vm->ssh_hostname();
     config.port = vm->ssh_port();
     config.username = vm->ssh_username();
     config.instance = vm->vm_name;
-    config.target_path = target_path;
-    config.source_path = source_path;
-    config.uid_map = uid_map;
-    config.gid_map = gid_map;
+    config.target_path = mounts.front().target_path;
+    config.source_path = mounts.front().source_path;
+    config.uid_map = mounts.front().uid_map;
+    config.gid_map = mounts.front().gid_map;
+    config.additional_mounts.assign(mounts.begin() + 1, mounts.end());
     config.private_key = key;
+    config.compression = static_cast<int>(SSHSession::compression_for(compression));
+    config.compression_level = SSHSession::compression_level();
+
+    start_server(config);
+}
+
+void mp::SSHFSMounts::start_server(const SSHFSServerConfig& config)
+{
+    std::vector<std::string> target_paths{config.target_path};
+    for (const auto& mount : config.additional_mounts)
+        target_paths.push_back(mount.target_path);
 
     auto sshfs_server_process_t = mp::platform::make_sshfs_server_process(config);
     // FIXME: ProcessFactory really should return qt_delete_later_unique_ptr<Process> as Process emits signals
     // and the respective slots may be called on the event loop, but unique_ptr can delete the Process before
     // the slots are fired, causing a crash.
-    mp::qt_delete_later_unique_ptr<mp::Process> sshfs_server_process(sshfs_server_process_t.release());
+    auto server = std::make_shared<ServerProcess>(
+        ServerProcess{mp::qt_delete_later_unique_ptr<mp::Process>(sshfs_server_process_t.release()), config});
+    auto sshfs_server_process = server->process.get();
 
     QObject::connect(
-        sshfs_server_process.get(), &mp::Process::finished, this,
-        [this, instance = vm->vm_name, target_path](mp::ProcessState exit_state) {
-            if (exit_state.completed_successfully())
-            {
-                mpl::log(mpl::Level::info, category,
-                         fmt::format("Mount '{}' in instance \"{}\" has stopped", target_path, instance));
-            }
-            else
+        sshfs_server_process, &mp::Process::finished, this,
+        [this, instance = config.instance, target_paths, sshfs_server_process](mp::ProcessState exit_state) {
+            for (const auto& target_path : target_paths)
             {
-                mpl::log(mpl::Level::warning, // not error as it failing can indicate we need to install sshfs in the VM
-                         category,
-                         fmt::format("Mount '{}' in instance \"{}\" has stopped unexpectedly: {}", target_path,
-                                     instance, exit_state.failure_message()));
-            }
+                if (exit_state.completed_successfully())
+                {
+                    mpl::log(mpl::Level::info, category,
+                             fmt::format("Mount '{}' in instance \"{}\" has stopped", target_path, instance));
+                }
+                else
+                {
+                    mpl::log(mpl::Level::warning, // not error as it failing can indicate we need to install sshfs in
+                             category,            // the VM
+                             fmt::format("Mount '{}' in instance \"{}\" has stopped unexpectedly: {}", target_path,
+                                         instance, exit_state.failure_message()));
+                }
 
-            mount_processes[instance].erase(target_path);
+                // The mount may be served by another process by now
+                std::lock_guard<decltype(mutex)> lock{mutex};
+                auto& instance_mounts = mount_processes[instance];
+                auto entry = instance_mounts.find(target_path);
+                if (entry != instance_mounts.end() && entry->second->process.get() == sshfs_server_process)
+                    instance_mounts.erase(entry);
+            }
         });
 
     QObject::connect(
-        sshfs_server_process.get(), &mp::Process::error_occurred, this,
-        [instance = vm->vm_name, target_path, process = sshfs_server_process.get()](QProcess::ProcessError error,
-                                                                                    QString error_string) {
+        sshfs_server_process, &mp::Process::error_occurred, this,
+        [instance = config.instance, target_path = config.target_path,
+         process = sshfs_server_process](QProcess::ProcessError error, QString error_string) {
             mpl::log(mpl::Level::error, category,
                      fmt::format("There was an error with sshfs_server for instance \"{}\" with path '{}': {} - {}",
                                  instance, target_path, mp::utils::qenum_to_string(error), error_string));
         });
 
-    mpl::log(mpl::Level::info, category, fmt::format("mounting {} => {} in {}", source_path, target_path, vm->vm_name));
+    for (const auto& mount : config.additional_mounts)
+        mpl::log(mpl::Level::info, category,
+                 fmt::format("mounting {} => {} in {}", mount.source_path, mount.target_path, config.instance));
+    mpl::log(mpl::Level::info, category,
+             fmt::format("mounting {} => {} in {}", config.source_path, config.target_path, config.instance));
     mpl::log(mpl::Level::info, category,
              fmt::format("process program '{}'", sshfs_server_process->program().toStdString()));
     mpl::log(mpl::Level::info, category,
              fmt::format("process arguments '{}'", sshfs_server_process->arguments().join(", ").toStdString()));
 
-    start_and_block_until(
-        sshfs_server_process.get(), &mp::Process::ready_read_standard_output, [](mp::Process* process) {
-            return process->read_all_standard_output().contains("Connected"); // Magic string printed by sshfs_server
-        });
+    // sshfs_server prints "Connected" for each of its mounts once it serves it
+    auto connected = 0;
+    start_and_block_until(sshfs_server_process, &mp::Process::ready_read_standard_output,
+                          [&connected, mount_count = target_paths.size()](mp::Process* process) {
+                              connected += process->read_all_standard_output().count("Connected");
+                              return static_cast<size_t>(connected) >= mount_count;
+                          });
 
     // Check in case sshfs_server stopped, usually due to an error
     auto process_state = sshfs_server_process->process_state();
@@ -134,11 +221,60 @@ void mp::SSHFSMounts::start_mount(VirtualMachine* vm, const std::string& source_
             fmt::format("{}: {}", process_state.failure_message(), sshfs_server_process->read_all_standard_error()));
     }
 
-    mount_processes[vm->vm_name][target_path] = std::move(sshfs_server_process);
+    QObject::connect(sshfs_server_process, &mp::Process::ready_read_standard_output, this,
+                     [this, instance = config.instance, weak_server = std::weak_ptr<ServerProcess>{server}] {
+                         if (auto server = weak_server.lock())
+                             read_stats(instance, *server);
+                     });
+
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    for (const auto& target_path : target_paths)
+        mount_processes[config.instance][target_path] = server;
+}
+
+void mp::SSHFSMounts::read_stats(const std::string& instance, ServerProcess& server)
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    server.output += server.process->read_all_standard_output();
+
+    for (int end; (end = server.output.indexOf('\n')) >= 0; server.output.remove(0, end + 1))
+    {
+        const auto line = server.output.left(end);
+        if (!line.startsWith(stats_prefix))
+            continue;
+
+        const auto json = QJsonDocument::fromJson(line.mid(qstrlen(stats_prefix))).object();
+        const auto target_path = json["target_path"].toString().toStdString();
+        if (target_path.empty())
+            continue;
+
+        auto stats = SftpStats::from_json(json);
+        auto& last_stats = server.stats[target_path];
+        add_to_metrics(instance, target_path, stats, last_stats);
+        last_stats = std::move(stats);
+    }
+}
+
+void mp::SSHFSMounts::restart_server(const SSHFSServerConfig& config)
+{
+    // Starting waits for the process to connect to the instance
+    restarts.addFuture(QtConcurrent::run([this, config] {
+        try
+        {
+            start_server(config);
+        }
+        catch (const std::exception& e)
+        {
+            mpl::log(mpl::Level::warning, category,
+                     fmt::format("Failed to restart the other mounts in instance \"{}\": {}", config.instance,
+                                 e.what()));
+        }
+    }));
 }
 
 bool mp::SSHFSMounts::stop_mount(const std::string& instance, const std::string& path)
 {
+    std::unique_lock<decltype(mutex)> lock{mutex};
     auto sshfs_mount_it = mount_processes.find(instance);
     if (sshfs_mount_it == mount_processes.end())
     {
@@ -149,10 +285,43 @@ bool mp::SSHFSMounts::stop_mount(const std::string& instance, const std::string&
     auto map_entry = sshfs_mount_map.find(path);
     if (map_entry != sshfs_mount_map.end())
     {
-        auto& sshfs_mount = map_entry->second;
+        auto server = map_entry->second;
         mpl::log(mpl::Level::info, category,
                  fmt::format("stopping sshfs_server for \"{}\" serving '{}'", instance, path));
-        sshfs_mount->terminate(); // TODO - if non-responsive, then kill()
+        server->process->terminate(); // TODO - if non-responsive, then kill()
+
+        if (server->config.additional_mounts.empty())
+            return true;
+
+        // The process served other mounts too, so start another one for those
+        std::vector<SSHFSServerConfig::Mount> remaining{
+            {server->config.source_path, server->config.target_path, server->config.gid_map, server->config.uid_map}};
+        remaining.insert(remaining.end(), server->config.additional_mounts.begin(),
+                         server->config.additional_mounts.end());
+        remaining.erase(std::remove_if(remaining.begin(), remaining.end(),
+                                       [&path](const auto& mount) { return mount.target_path == path; }),
+                        remaining.end());
+
+        for (const auto& mount : server->config.additional_mounts)
+            sshfs_mount_map.erase(mount.target_path);
+        sshfs_mount_map.erase(server->config.target_path);
+        lock.unlock();
+
+        auto config = server->config;
+        config.source_path = remaining.front().source_path;
+        config.target_path = remaining.front().target_path;
+        config.gid_map = remaining.front().gid_map;
+        config.uid_map = remaining.front().uid_map;
+        config.additional_mounts.assign(remaining.begin() + 1, remaining.end());
+
+        // Only once the process is gone, so that its mounts are before they are served again, which is not for the
+        // caller to wait on
+        if (server->process->running())
+            QObject::connect(server->process.get(), &mp::Process::finished, this,
+                             [this, config](mp::ProcessState) { restart_server(config); });
+        else
+            restart_server(config);
+
         return true;
     }
     return false;
@@ -160,6 +329,7 @@ bool mp::SSHFSMounts::stop_mount(const std::string& instance, const std::string&
 
 void mp::SSHFSMounts::stop_all_mounts_for_instance(const std::string& instance)
 {
+    std::lock_guard<decltype(mutex)> lock{mutex};
     auto mounts_it = mount_processes.find(instance);
     if (mounts_it == mount_processes.end() || mounts_it->second.empty())
     {
@@ -167,11 +337,13 @@ void mp::SSHFSMounts::stop_all_mounts_for_instance(const std::string& instance)
     }
     else
     {
+        std::unordered_set<mp::Process*> terminated; // some may serve several of the mounts
         for (auto& sshfs_mount : mounts_it->second)
         {
             mpl::log(mpl::Level::debug, category,
                      fmt::format("Stopping mount '{}' in instance \"{}\"", sshfs_mount.first, instance));
-            sshfs_mount.second->terminate();
+            if (terminated.insert(sshfs_mount.second->process.get()).second)
+                sshfs_mount.second->process->terminate();
         }
     }
     mount_processes[instance].clear();
@@ -179,6 +351,7 @@ void mp::SSHFSMounts::stop_all_mounts_for_instance(const std::string& instance)
 
 bool mp::SSHFSMounts::has_instance_already_mounted(const std::string& instance, const std::string& path) const
 {
+    std::lock_guard<decltype(mutex)> lock{mutex};
     auto entry = mount_processes.find(instance);
     if (entry != mount_processes.end() && entry->second.find(path) != entry->second.end())
     {
@@ -186,3 +359,42 @@ bool mp::SSHFSMounts::has_instance_already_mounted(const std::string& instance,
     }
     return false;
 }
+
+mp::optional<mp::SftpStats> mp::SSHFSMounts::mount_stats(const std::string& instance, const std::string& path) const
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    auto instance_mounts = mount_processes.find(instance);
+    if (instance_mounts == mount_processes.end())
+        return nullopt;
+
+    auto entry = instance_mounts->second.find(path);
+    if (entry == instance_mounts->second.end())
+        return nullopt;
+
+    auto stats = entry->second->stats.find(path);
+    if (stats == entry->second->stats.end())
+        return nullopt;
+
+    return stats->second;
+}
+
+mp::SSHFSMounts::Activity mp::SSHFSMounts::activity_of(const std::string& instance) const
+{
+    std::lock_guard<decltype(mutex)> lock{mutex};
+
+    Activity activity;
+    auto instance_mounts = mount_processes.find(instance);
+    if (instance_mounts == mount_processes.end())
+        return activity;
+
+    // One process may serve several of the mounts
+    std::unordered_set<const ServerProcess*> servers;
+    for (const auto& mount : instance_mounts->second)
+        if (servers.insert(mount.second.get()).second)
+            for (const auto& stats : mount.second->stats)
+                for (const auto& operation : stats.second.operations)
+                    activity.operations += operation.second.count;
+
+    activity.sessions = servers.size();
+    return activity;
+}
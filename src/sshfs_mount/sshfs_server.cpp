@@ -15,18 +15,25 @@
  *
  */
 
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include <QJsonDocument>
 #include <QStringList>
 
-#include "../ssh/ssh_client_key_provider.h" // FIXME
 #include <multipass/exceptions/sshfs_missing_error.h>
 #include <multipass/logging/log.h>
 #include <multipass/logging/multiplexing_logger.h>
 #include <multipass/logging/standard_logger.h>
 #include <multipass/platform.h>
+#include <multipass/ssh/shared_ssh_session.h>
+#include <multipass/ssh/ssh_client_key_provider.h>
 #include <multipass/ssh/ssh_session.h>
 #include <multipass/sshfs_mount/sshfs_mount.h>
 
@@ -37,6 +44,16 @@ using namespace std;
 
 namespace
 {
+constexpr auto stats_interval = std::chrono::seconds{5};
+
+struct MountArgs
+{
+    string source_path;
+    string target_path;
+    unordered_map<int, int> uid_map;
+    unordered_map<int, int> gid_map;
+};
+
 unordered_map<int, int> deserialise_id_map(const char* in)
 {
     unordered_map<int, int> id_map;
@@ -63,11 +80,21 @@ unordered_map<int, int> deserialise_id_map(const char* in)
     }
     return id_map;
 }
+
+// The daemon picks these lines out of the output, to show in info and in the metrics
+void report_stats(const string& target_path, const mp::SshfsMount& sshfs_mount)
+{
+    auto json = sshfs_mount.stats().to_json();
+    json.insert("target_path", QString::fromStdString(target_path));
+
+    cout << "Stats " + QJsonDocument{json}.toJson(QJsonDocument::Compact).toStdString() + "\n" << flush;
+}
 } // namespace
 
 int main(int argc, char* argv[])
 {
-    if (argc != 9)
+    // host, port and username, then the source, target, uid map and gid map of each mount, then the log level
+    if (argc < 9 || (argc - 5) % 4 != 0)
     {
         cerr << "Incorrect arguments" << endl;
         exit(2);
@@ -80,14 +107,18 @@ int main(int argc, char* argv[])
         exit(2);
     }
     const auto priv_key_blob = string(key);
+    // The daemon's compression, or that of the mount, for the session is this process's own
+    const auto compression = qgetenv("COMPRESSION");
+    if (!compression.isEmpty())
+        mp::SSHSession::set_compression(static_cast<mp::SSHSession::Compression>(compression.toInt()),
+                                        qgetenv("COMPRESSION_LEVEL").toInt());
     const auto host = string(argv[1]);
     const int port = atoi(argv[2]);
     const auto username = string(argv[3]);
-    const auto source_path = string(argv[4]);
-    const auto target_path = string(argv[5]);
-    const unordered_map<int, int> uid_map = deserialise_id_map(argv[6]);
-    const unordered_map<int, int> gid_map = deserialise_id_map(argv[7]);
-    const mpl::Level log_level = static_cast<mpl::Level>(atoi(argv[8]));
+    vector<MountArgs> mounts_args;
+    for (int i = 4; i + 4 < argc; i += 4)
+        mounts_args.push_back({argv[i], argv[i + 1], deserialise_id_map(argv[i + 2]), deserialise_id_map(argv[i + 3])});
+    const mpl::Level log_level = static_cast<mpl::Level>(atoi(argv[argc - 1]));
 
     auto logger = mpp::make_logger(log_level);
     if (!logger)
@@ -102,13 +133,45 @@ int main(int argc, char* argv[])
         auto watchdog = mpp::make_quit_watchdog(); // called while there is only one thread
 
         mp::SSHSession session{host, port, username, mp::SSHClientKeyProvider{priv_key_blob}};
-        mp::SshfsMount sshfs_mount(move(session), source_path, target_path, gid_map, uid_map);
+        vector<unique_ptr<mp::SshfsMount>> sshfs_mounts;
+        if (mounts_args.size() == 1)
+        {
+            const auto& args = mounts_args.front();
+            sshfs_mounts.push_back(make_unique<mp::SshfsMount>(move(session), args.source_path, args.target_path,
+                                                               args.gid_map, args.uid_map));
+        }
+        else
+        {
+            // All the mounts take turns on one session, over a channel each
+            auto shared_session = make_shared<mp::SharedSSHSession>(move(session));
+            for (const auto& args : mounts_args)
+                sshfs_mounts.push_back(make_unique<mp::SshfsMount>(shared_session, args.source_path, args.target_path,
+                                                                   args.gid_map, args.uid_map));
+        }
+
+        mutex stats_mutex;
+        condition_variable stats_cv;
+        bool stopping = false;
+        thread stats_reporter{[&] {
+            unique_lock<mutex> lock{stats_mutex};
+            while (!stats_cv.wait_for(lock, stats_interval, [&stopping] { return stopping; }))
+                for (auto i = 0u; i < sshfs_mounts.size(); ++i)
+                    report_stats(mounts_args[i].target_path, *sshfs_mounts[i]);
+        }};
 
         // ssh lives on its own thread, use this thread to listen for quit signal
         if (int sig = watchdog())
             cout << "Received signal " << sig << ". Stopping" << endl;
 
-        sshfs_mount.stop();
+        {
+            lock_guard<mutex> lock{stats_mutex};
+            stopping = true;
+        }
+        stats_cv.notify_one();
+        stats_reporter.join();
+
+        for (auto& sshfs_mount : sshfs_mounts)
+            sshfs_mount->stop();
         exit(0);
     }
     catch (const mp::SSHFSMissingError&)
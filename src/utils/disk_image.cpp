@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/disk_image.h>
+#include <multipass/file_ops.h>
+
+#include <QFile>
+#include <QtEndian>
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace mp = multipass;
+namespace mpdi = multipass::disk_image;
+
+namespace
+{
+// Header layout as documented in qemu's docs/interop/qcow2.txt; all fields are big-endian
+constexpr quint32 qcow2_magic = 0x514649fb; // "QFI\xfb"
+constexpr auto v2_header_size = 72;
+constexpr auto v3_header_size = 104;
+constexpr auto size_offset = 24;
+constexpr auto l1_entry_size = 8u;
+
+struct Qcow2Header
+{
+    quint32 version;
+    quint64 backing_file_offset;
+    quint32 backing_file_size;
+    quint32 cluster_bits;
+    quint64 size;
+    quint32 crypt_method;
+    quint32 l1_size;
+    quint64 l1_table_offset;
+    quint32 nb_snapshots;
+    quint64 incompatible_features;
+    quint64 autoclear_features;
+};
+
+template <typename T>
+T field(const std::array<char, v3_header_size>& header, int offset)
+{
+    return qFromBigEndian<T>(header.data() + offset);
+}
+
+mp::optional<Qcow2Header> read_header(QFile& file)
+{
+    std::array<char, v3_header_size> raw{};
+    const auto read = MP_FILEOPS.read_at(file, raw.data(), raw.size(), 0);
+    if (read < v2_header_size || field<quint32>(raw, 0) != qcow2_magic)
+        return mp::nullopt;
+
+    Qcow2Header header{};
+    header.version = field<quint32>(raw, 4);
+    if (header.version != 2 && (header.version != 3 || read < v3_header_size))
+        return mp::nullopt;
+
+    header.backing_file_offset = field<quint64>(raw, 8);
+    header.backing_file_size = field<quint32>(raw, 16);
+    header.cluster_bits = field<quint32>(raw, 20);
+    header.size = field<quint64>(raw, size_offset);
+    header.crypt_method = field<quint32>(raw, 32);
+    header.l1_size = field<quint32>(raw, 36);
+    header.l1_table_offset = field<quint64>(raw, 40);
+    header.nb_snapshots = field<quint32>(raw, 60);
+    if (header.version == 3)
+    {
+        header.incompatible_features = field<quint64>(raw, 72);
+        header.autoclear_features = field<quint64>(raw, 88);
+    }
+
+    if (header.cluster_bits < 9 || header.cluster_bits > 21)
+        return mp::nullopt;
+
+    return header;
+}
+
+// The number of L1 entries needed to map size bytes; each one points to an L2 table of a cluster's worth of entries
+quint64 l1_entries_for(quint64 size, quint32 cluster_bits)
+{
+    const auto bytes_per_l1_entry = quint64{1} << (2 * cluster_bits - 3);
+    return (size + bytes_per_l1_entry - 1) / bytes_per_l1_entry;
+}
+} // namespace
+
+mp::optional<mpdi::Qcow2Info> mpdi::inspect_qcow2(const Path& image_path)
+{
+    QFile file{image_path};
+    if (!MP_FILEOPS.open(file, QIODevice::ReadOnly))
+        return nullopt;
+
+    const auto header = read_header(file);
+    if (!header)
+        return nullopt;
+
+    Qcow2Info info{header->size, header->version, {}, header->nb_snapshots};
+    if (header->backing_file_offset && header->backing_file_size)
+    {
+        QByteArray backing_file(static_cast<int>(std::min(header->backing_file_size, 1023u)), '\0');
+        if (MP_FILEOPS.read_at(file, backing_file.data(), backing_file.size(),
+                               static_cast<qint64>(header->backing_file_offset)) != backing_file.size())
+            return nullopt;
+
+        info.backing_file = QString::fromUtf8(backing_file);
+    }
+
+    return info;
+}
+
+bool mpdi::grow_qcow2(const Path& image_path, quint64 new_size)
+{
+    QFile file{image_path};
+    if (!MP_FILEOPS.open(file, QIODevice::ReadWrite))
+        return false;
+
+    const auto header = read_header(file);
+    if (!header || header->nb_snapshots || header->crypt_method || header->incompatible_features ||
+        header->autoclear_features || new_size < header->size || new_size % 512)
+        return false;
+
+    if (new_size == header->size)
+        return true;
+
+    // qemu allocates the L1 table in whole clusters, so it can take more entries without moving while they fit there
+    const auto cluster_size = quint64{1} << header->cluster_bits;
+    const auto l1_clusters = (header->l1_size * l1_entry_size + cluster_size - 1) / cluster_size;
+    const auto new_l1_size = std::max<quint64>(l1_entries_for(new_size, header->cluster_bits), header->l1_size);
+    if (header->l1_table_offset % cluster_size || new_l1_size > l1_clusters * cluster_size / l1_entry_size)
+        return false;
+
+    // Clear the entries coming into use before the header points at them, so a crash in between leaves a valid image
+    if (new_l1_size > header->l1_size)
+    {
+        const std::vector<char> zeros((new_l1_size - header->l1_size) * l1_entry_size, '\0');
+        const auto pos = static_cast<qint64>(header->l1_table_offset + header->l1_size * l1_entry_size);
+        if (MP_FILEOPS.write_at(file, zeros.data(), static_cast<qint64>(zeros.size()), pos) < 0 ||
+            !MP_FILEOPS.sync(file))
+            return false;
+    }
+
+    // size, crypt_method and l1_size are contiguous, so a single write updates them together
+    std::array<char, 16> update{};
+    const auto update_size = static_cast<qint64>(update.size());
+    qToBigEndian<quint64>(new_size, update.data());
+    qToBigEndian<quint32>(header->crypt_method, update.data() + 8);
+    qToBigEndian<quint32>(static_cast<quint32>(new_l1_size), update.data() + 12);
+
+    return MP_FILEOPS.write_at(file, update.data(), update_size, size_offset) == update_size &&
+           MP_FILEOPS.sync(file);
+}
@@ -17,8 +17,201 @@
 
 #include <multipass/file_ops.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define MULTIPASS_HAVE_IO_URING
+#endif
+#endif
+
 namespace mp = multipass;
 
+namespace
+{
+#ifdef MULTIPASS_HAVE_IO_URING
+constexpr unsigned ring_entries = 64;
+
+// Cleared for good the first time the kernel turns a ring down, whether it predates io_uring or has it disabled
+std::atomic_bool io_uring_available{true};
+
+// One per thread, so that submitting needs no locking; readv and writev, unlike plain read and write, go back to
+// the first kernels with io_uring
+class IoUring
+{
+public:
+    static IoUring* for_this_thread()
+    {
+        thread_local std::unique_ptr<IoUring> ring = [] {
+            std::unique_ptr<IoUring> ring;
+            if (io_uring_available)
+            {
+                ring.reset(new IoUring);
+                if (!ring->ready())
+                {
+                    io_uring_available = false;
+                    ring.reset();
+                }
+            }
+            return ring;
+        }();
+
+        return ring.get();
+    }
+
+    ~IoUring()
+    {
+        if (sqes != MAP_FAILED)
+            ::munmap(sqes, sqes_size);
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+            ::munmap(cq_ring, cq_ring_size);
+        if (sq_ring != MAP_FAILED)
+            ::munmap(sq_ring, sq_ring_size);
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    // Carries out up to capacity() requests, leaving short transfers for the caller to finish
+    void run(std::vector<mp::FileOps::IoRequest>& requests, std::size_t first, std::size_t count)
+    {
+        iovecs.resize(count);
+        auto tail = *sq_tail;
+        for (auto i = 0u; i < count; ++i)
+        {
+            auto& request = requests[first + i];
+            iovecs[i] = {request.data, static_cast<std::size_t>(request.size)};
+
+            const auto index = tail++ & *sq_mask;
+            auto& sqe = sqes[index];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = request.write ? IORING_OP_WRITEV : IORING_OP_READV;
+            sqe.fd = request.file->handle();
+            sqe.addr = reinterpret_cast<std::uint64_t>(&iovecs[i]);
+            sqe.len = 1;
+            sqe.off = static_cast<std::uint64_t>(request.pos);
+            sqe.user_data = first + i;
+            sq_array[index] = index;
+        }
+        __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+        std::size_t to_submit = count, outstanding = count;
+        while (outstanding > 0)
+        {
+            const auto r = ::syscall(__NR_io_uring_enter, fd, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (r < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            {
+                // The kernel takes entries in order and only when entered, so those it did not take can be taken
+                // back and retried one at a time, once the ones in flight are done
+                __atomic_store_n(sq_tail, tail - static_cast<unsigned>(to_submit), __ATOMIC_RELEASE);
+                for (auto i = count - to_submit; i < count; ++i)
+                    requests[first + i].result = retry;
+                outstanding -= to_submit;
+                to_submit = 0;
+                broken = true;
+            }
+            else if (r > 0)
+            {
+                to_submit -= std::min<std::size_t>(to_submit, r);
+            }
+
+            auto head = *cq_head;
+            while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+            {
+                const auto& cqe = cqes[head++ & *cq_mask];
+                auto& request = requests[cqe.user_data];
+                request.result = cqe.res < 0 ? -1 : cqe.res;
+                request.error = cqe.res < 0 ? -cqe.res : 0;
+                --outstanding;
+            }
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+
+    std::size_t capacity() const
+    {
+        return ring_entries;
+    }
+
+    static constexpr qint64 pending = -2, retry = -3;
+
+private:
+    IoUring()
+    {
+        io_uring_params params{};
+        fd = static_cast<int>(::syscall(__NR_io_uring_setup, ring_entries, &params));
+        if (fd < 0)
+            return;
+
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+        sq_ring = ::mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                         IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED)
+            return;
+
+        cq_ring = params.features & IORING_FEAT_SINGLE_MMAP
+                      ? sq_ring
+                      : ::mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                               IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED)
+            return;
+
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                                                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED)
+            return;
+
+        const auto sq = static_cast<char*>(sq_ring), cq = static_cast<char*>(cq_ring);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    bool ready() const
+    {
+        return fd >= 0 && sqes != MAP_FAILED;
+    }
+
+public:
+    // After the kernel refused a batch, the thread goes back to one call at a time
+    bool broken{false};
+
+private:
+
+    int fd{-1};
+    void* sq_ring{MAP_FAILED};
+    void* cq_ring{MAP_FAILED};
+    io_uring_sqe* sqes{static_cast<io_uring_sqe*>(MAP_FAILED)};
+    std::size_t sq_ring_size{0}, cq_ring_size{0}, sqes_size{0};
+    unsigned *sq_tail{nullptr}, *sq_mask{nullptr}, *sq_array{nullptr};
+    unsigned *cq_head{nullptr}, *cq_tail{nullptr}, *cq_mask{nullptr};
+    io_uring_cqe* cqes{nullptr};
+    std::vector<iovec> iovecs; // the kernel reads them as it takes each entry
+};
+#endif
+} // namespace
+
 mp::FileOps::FileOps(const Singleton<FileOps>::PrivatePass& pass) noexcept : Singleton<FileOps>::Singleton{pass}
 {
 }
@@ -43,6 +236,16 @@ qint64 mp::FileOps::read(QFile& file, char* data, qint64 maxSize)
     return file.read(data, maxSize);
 }
 
+qint64 mp::FileOps::read_at(QFile& file, char* data, qint64 maxSize, qint64 pos)
+{
+    ssize_t r;
+    do
+        r = ::pread(file.handle(), data, maxSize, pos);
+    while (r < 0 && errno == EINTR);
+
+    return r;
+}
+
 bool mp::FileOps::remove(QFile& file)
 {
     return file.remove();
@@ -77,3 +280,127 @@ qint64 mp::FileOps::write(QFile& file, const QByteArray& data)
 {
     return file.write(data);
 }
+
+qint64 mp::FileOps::write_at(QFile& file, const char* data, qint64 size, qint64 pos)
+{
+    for (qint64 written = 0; written < size;)
+    {
+        const auto r = ::pwrite(file.handle(), data + written, size - written, pos + written);
+        if (r < 0 && errno != EINTR)
+            return -1;
+
+        if (r > 0)
+            written += r;
+    }
+
+    return size;
+}
+
+qint64 mp::FileOps::copy_range(QFile& from, qint64 from_pos, QFile& to, qint64 to_pos, qint64 size)
+{
+    constexpr qint64 max_chunk = 1 << 30;
+    qint64 copied = 0;
+
+    // Let the kernel copy, or share the extents, where the file system can
+    while (copied < size)
+    {
+        loff_t in = from_pos + copied, out = to_pos + copied;
+        const auto r = ::copy_file_range(from.handle(), &in, to.handle(), &out, std::min(size - copied, max_chunk), 0);
+        if (r == 0)
+            return copied;
+
+        if (r > 0)
+            copied += r;
+        else if (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL)
+            break;
+        else if (errno != EINTR)
+            return -1;
+    }
+
+    std::vector<char> buffer(std::min<qint64>(size - copied, 256 * 1024));
+    while (copied < size)
+    {
+        const auto len = std::min<qint64>(size - copied, buffer.size());
+        const auto r = ::pread(from.handle(), buffer.data(), len, from_pos + copied);
+        if (r == 0)
+            break;
+
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        if (write_at(to, buffer.data(), r, to_pos + copied) < 0)
+            return -1;
+        copied += r;
+    }
+
+    return copied;
+}
+
+bool mp::FileOps::sync(QFile& file)
+{
+    return ::fsync(file.handle()) == 0;
+}
+
+bool mp::FileOps::advise_will_need(QFile& file, qint64 pos, qint64 size)
+{
+    return ::posix_fadvise(file.handle(), pos, size, POSIX_FADV_WILLNEED) == 0;
+}
+
+bool mp::FileOps::submit(std::vector<IoRequest>& requests)
+{
+    for (auto& request : requests)
+        request.result = -1, request.error = 0;
+
+#ifdef MULTIPASS_HAVE_IO_URING
+    auto ring = IoUring::for_this_thread();
+    if (ring && !ring->broken)
+    {
+        for (auto& request : requests)
+            request.result = IoUring::pending;
+        for (std::size_t first = 0; first < requests.size() && !ring->broken; first += ring->capacity())
+            ring->run(requests, first, std::min(ring->capacity(), requests.size() - first));
+    }
+#endif
+
+    auto all_done = true;
+    for (auto& request : requests)
+    {
+        // What the ring did not get to, or only got part of the way through, is finished one call at a time
+        const auto done = std::max<qint64>(request.result, 0);
+        if (request.result >= 0 && (request.result == request.size || (!request.write && request.result == 0)))
+            continue;
+        if (request.result == -1 && request.error)
+        {
+            all_done = false;
+            continue;
+        }
+
+        qint64 rest;
+        if (request.write)
+        {
+            rest = write_at(*request.file, request.data + done, request.size - done, request.pos + done);
+        }
+        else
+        {
+            rest = 0;
+            for (qint64 r; done + rest < request.size; rest += r)
+                if ((r = read_at(*request.file, request.data + done + rest, request.size - done - rest,
+                                 request.pos + done + rest)) <= 0)
+                {
+                    if (r < 0)
+                        rest = -1;
+                    break;
+                }
+        }
+
+        request.result = rest < 0 ? -1 : done + rest;
+        request.error = rest < 0 ? errno : 0;
+        all_done = all_done && rest >= 0;
+    }
+
+    return all_done;
+}
@@ -16,14 +16,18 @@
  */
 
 #include <multipass/constants.h>
+#include <multipass/exceptions/invalid_memory_size_exception.h>
+#include <multipass/memory_size.h>
 #include <multipass/platform.h>
 #include <multipass/settings.h>
 #include <multipass/standard_paths.h>
 #include <multipass/utils.h> // TODO move out
 
 #include <QDir>
+#include <QFileInfo>
 #include <QKeySequence>
 #include <QSettings>
+#include <QUrl>
 
 #include <algorithm>
 #include <cassert>
@@ -31,7 +35,9 @@
 #include <fstream>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <utility>
 
 namespace mp = multipass;
 
@@ -42,19 +48,153 @@ const auto daemon_root = QStringLiteral("local");
 const auto client_root = QStringLiteral("client");
 const auto petenv_name = QStringLiteral("primary");
 const auto autostart_default = QStringLiteral("true");
+const auto ssh_broker_default = QStringLiteral("false");
+const auto memory_reclaim_default = QStringLiteral("false");
+const auto cpu_pinning_default = QStringLiteral("false");
+const auto hugepages_default = QStringLiteral("false");
+const auto disk_overlays_default = QStringLiteral("false");
+const auto memory_merge_default = QStringLiteral("false");
+const auto lazy_boot_default = QStringLiteral("false");
+const auto compress_images_default = QStringLiteral("false");
+const auto package_cache_default = QStringLiteral("false");
+const auto keep_running_default = QStringLiteral("false");
+const auto shutdown_action_default = QStringLiteral("suspend");
+const auto usage_history_interval_default = QStringLiteral("60"); // seconds
+const auto rpc_compression_default = QStringLiteral("none");
+const auto min_rpc_keepalive = 10; // seconds; daemons turn away clients that ping more often
+const auto fast_boot_default = QStringLiteral("false");
+const auto boot_readahead_default = QStringLiteral("false");
+const auto admission_mode_default = QStringLiteral("off");
+const auto warm_pool_size_default = QStringLiteral("0");
+const auto ssh_compression_default = QStringLiteral("auto");
 
 QString default_hotkey()
 {
     return QKeySequence{mp::hotkey_default}.toString(QKeySequence::NativeText); // outcome depends on platform
 }
 
+bool valid_peers(const QString& val)
+{
+    const auto peers = val.split(',', QString::SkipEmptyParts);
+    return std::all_of(peers.cbegin(), peers.cend(), [](const QString& peer) {
+        const QUrl url{peer.trimmed(), QUrl::StrictMode};
+        return url.isValid() && (url.scheme() == "http" || url.scheme() == "https") && !url.host().isEmpty();
+    });
+}
+
+bool valid_hosts(const QString& val)
+{
+    const auto hosts = val.split(',', QString::SkipEmptyParts);
+    return std::all_of(hosts.cbegin(), hosts.cend(), [](const QString& host) {
+        try
+        {
+            mp::utils::validate_server_address(host.trimmed().toStdString());
+            return true;
+        }
+        catch (const std::runtime_error&)
+        {
+            return false;
+        }
+    });
+}
+
+bool valid_count(const QString& val)
+{
+    bool ok;
+    return val.toInt(&ok) > 0 && ok;
+}
+
+bool valid_keepalive(const QString& val)
+{
+    bool ok;
+    return val.toInt(&ok) >= min_rpc_keepalive && ok;
+}
+
+bool valid_size(const QString& val)
+{
+    try
+    {
+        mp::MemorySize{val.toStdString()};
+        return true;
+    }
+    catch (const mp::InvalidMemorySizeException&)
+    {
+        return false;
+    }
+}
+
+bool valid_ciphers(const QString& val)
+{
+    static const auto known_ciphers = QStringList{"aes128-gcm@openssh.com", "aes256-gcm@openssh.com",
+                                                  "chacha20-poly1305@openssh.com", "aes128-ctr", "aes192-ctr",
+                                                  "aes256-ctr"};
+    const auto ciphers = val.split(',');
+    return std::all_of(ciphers.cbegin(), ciphers.cend(),
+                       [](const auto& cipher) { return known_ciphers.contains(cipher.trimmed()); });
+}
+
+bool valid_pool_size(const QString& val)
+{
+    bool ok;
+    const auto size = val.toInt(&ok);
+    return ok && size >= 0 && size <= mp::max_warm_pool_size;
+}
+
+bool valid_level(const QString& val)
+{
+    bool ok;
+    const auto level = val.toInt(&ok);
+    return ok && level >= 1 && level <= 9;
+}
+
 std::map<QString, QString> make_defaults()
 { // clang-format off
     auto ret = std::map<QString, QString>{{mp::petenv_key, petenv_name},
                                           {mp::driver_key, mp::platform::default_driver()},
                                           {mp::autostart_key, autostart_default},
                                           {mp::hotkey_key, default_hotkey()},
-                                          {mp::bridged_interface_key, ""}};
+                                          {mp::bridged_interface_key, ""},
+                                          {mp::image_cache_size_key, ""},
+                                          {mp::image_cache_peers_key, ""},
+                                          {mp::image_bulk_storage_key, ""},
+                                          {mp::image_mirrors_key, ""},
+                                          {mp::download_concurrency_key, ""},
+                                          {mp::download_rate_key, ""},
+                                          {mp::start_concurrency_key, ""},
+                                          {mp::ssh_ciphers_key, ""},
+                                          {mp::ssh_compression_key, ssh_compression_default},
+                                          {mp::ssh_compression_level_key, ""},
+                                          {mp::ssh_broker_key, ssh_broker_default},
+                                          {mp::hosts_key, ""},
+                                          {mp::client_rpc_compression_key, rpc_compression_default},
+                                          {mp::client_rpc_keepalive_key, ""},
+                                          {mp::client_rpc_window_key, ""},
+                                          {mp::memory_reclaim_key, memory_reclaim_default},
+                                          {mp::cpu_pinning_key, cpu_pinning_default},
+                                          {mp::hugepages_key, hugepages_default},
+                                          {mp::memory_merge_key, memory_merge_default},
+                                          {mp::admission_mode_key, admission_mode_default},
+                                          {mp::admission_cpus_key, ""},
+                                          {mp::admission_memory_key, ""},
+                                          {mp::warm_pool_size_key, warm_pool_size_default},
+                                          {mp::warm_pool_image_key, ""},
+                                          {mp::warm_pool_cpus_key, mp::default_cpu_cores},
+                                          {mp::warm_pool_memory_key, mp::default_memory_size},
+                                          {mp::warm_pool_disk_key, mp::default_disk_size},
+                                          {mp::disk_overlays_key, disk_overlays_default},
+                                          {mp::lazy_boot_key, lazy_boot_default},
+                                          {mp::compress_images_key, compress_images_default},
+                                          {mp::package_cache_key, package_cache_default},
+                                          {mp::keep_running_key, keep_running_default},
+                                          {mp::shutdown_action_key, shutdown_action_default},
+                                          {mp::idle_suspend_key, ""},
+                                          {mp::usage_history_interval_key, usage_history_interval_default},
+                                          {mp::rpc_compression_key, rpc_compression_default},
+                                          {mp::rpc_keepalive_key, ""},
+                                          {mp::rpc_window_key, ""},
+                                          {mp::rpc_max_streams_key, ""},
+                                          {mp::fast_boot_key, fast_boot_default},
+                                          {mp::boot_readahead_key, boot_readahead_default}};
 
     for(const auto& [k, v] : mp::platform::extra_settings_defaults())
         ret.insert_or_assign(k, v);
@@ -113,24 +253,26 @@ void check_status(const QSettings& settings, const QString& attempted_operation)
                                      : QStringLiteral("access error (consider running with an administrative role)")};
 }
 
-QString checked_get(const QSettings& settings, const QString& key, const QString& fallback, std::mutex& mutex)
+// Another process may write the file at any time, so every read checks that it still looks the same
+auto file_signature(const QString& file_name)
 {
-    std::lock_guard<std::mutex> lock{mutex};
+    const QFileInfo file_info{file_name};
+    return std::make_pair(file_info.lastModified(), file_info.exists() ? file_info.size() : qint64{-1});
+}
 
-    auto ret = settings.value(key, fallback).toString();
+std::map<QString, QString> values_in(const QSettings& settings)
+{
+    std::map<QString, QString> ret;
+    for (const auto& key : settings.allKeys())
+        ret.emplace(key, settings.value(key).toString());
 
-    check_status(settings, QStringLiteral("read"));
     return ret;
 }
 
-void checked_set(QSettings& settings, const QString& key, const QString& val, std::mutex& mutex)
+QString value_or(const std::map<QString, QString>& values, const QString& key, const QString& fallback)
 {
-    std::lock_guard<std::mutex> lock{mutex};
-
-    settings.setValue(key, val);
-
-    settings.sync(); // flush to confirm we can write
-    check_status(settings, QStringLiteral("read/write"));
+    auto it = values.find(key);
+    return it != values.end() ? it->second : fallback;
 }
 
 QString interpret_bool(QString val)
@@ -167,8 +309,23 @@ std::set<QString> multipass::Settings::keys() const
 QString mp::Settings::get(const QString& key) const
 {
     const auto& default_ret = get_default(key); // make sure the key is valid before reading from disk
+    const auto file_name = file_for(key);
+    const auto [modified, size] = file_signature(file_name); // looked at first, so that a newer file is read again
+
+    {
+        std::shared_lock<decltype(mutex)> lock{mutex};
+        auto it = cache.find(file_name);
+        if (it != cache.end() && it->second.modified == modified && it->second.size == size)
+            return value_or(it->second.values, key, default_ret);
+    }
+
+    std::lock_guard<decltype(mutex)> lock{mutex};
     auto settings = persistent_settings(key);
-    return checked_get(*settings, key, default_ret, mutex);
+    auto values = values_in(*settings);
+    check_status(*settings, QStringLiteral("read"));
+
+    const auto& cached = cache[file_name] = CachedFile{modified, size, std::move(values)};
+    return value_or(cached.values, key, default_ret);
 }
 
 void mp::Settings::set(const QString& key, const QString& val)
@@ -206,11 +363,78 @@ void multipass::Settings::set_aux(const QString& key, QString val) // work with
         throw InvalidSettingsException{key, val, "Invalid hostname"};
     else if (key == driver_key && !mp::platform::is_backend_supported(val))
         throw InvalidSettingsException(key, val, "Invalid driver");
-    else if (key == autostart_key && (val = interpret_bool(val)) != "true" && val != "false")
+    else if ((key == autostart_key || key == ssh_broker_key || key == memory_reclaim_key || key == cpu_pinning_key ||
+              key == hugepages_key || key == memory_merge_key || key == disk_overlays_key || key == lazy_boot_key ||
+              key == compress_images_key || key == package_cache_key || key == keep_running_key ||
+              key == fast_boot_key || key == boot_readahead_key) &&
+             (val = interpret_bool(val)) != "true" && val != "false")
         throw InvalidSettingsException(key, val, "Invalid flag, try \"true\" or \"false\"");
+    else if (key == image_cache_size_key && !val.isEmpty() && !valid_size(val))
+        throw InvalidSettingsException(key, val, "Invalid size, try e.g. \"20G\", or leave it empty for no limit");
+    else if (key == image_cache_peers_key && !valid_peers(val))
+        throw InvalidSettingsException(key, val, "Invalid peers, try comma-separated http(s) URLs");
+    else if (key == image_bulk_storage_key && !val.isEmpty() && !QDir::isAbsolutePath(val))
+        throw InvalidSettingsException(key, val, "Invalid path, try an absolute one, or leave it empty");
+    else if (key == image_mirrors_key && !valid_peers(val))
+        throw InvalidSettingsException(key, val, "Invalid mirrors, try comma-separated http(s) URLs");
+    else if (key == hosts_key && !valid_hosts(val))
+        throw InvalidSettingsException(key, val,
+                                       "Invalid hosts, try comma-separated addresses like \"10.0.0.2:51001\"");
+    else if (key == download_concurrency_key && !val.isEmpty() && !valid_count(val))
+        throw InvalidSettingsException(key, val, "Invalid count, try a positive number, or leave it empty");
+    else if (key == start_concurrency_key && !val.isEmpty() && !valid_count(val))
+        throw InvalidSettingsException(key, val, "Invalid count, try a positive number, or leave it empty");
+    else if (key == download_rate_key && !val.isEmpty() && !valid_size(val))
+        throw InvalidSettingsException(key, val, "Invalid rate, try e.g. \"5M\" (per second), or leave it empty");
+    else if (key == ssh_ciphers_key && !val.isEmpty() && !valid_ciphers(val))
+        throw InvalidSettingsException(key, val, "Invalid ciphers, try a comma-separated list like "
+                                                 "\"aes128-gcm@openssh.com,aes256-ctr\", or leave it empty");
+    else if (key == ssh_compression_key && val != "auto" && val != "on" && val != "off")
+        throw InvalidSettingsException(key, val, "Invalid compression, try \"auto\", \"on\" or \"off\"");
+    else if (key == ssh_compression_level_key && !val.isEmpty() && !valid_level(val))
+        throw InvalidSettingsException(key, val, "Invalid level, try 1 (fastest) to 9 (smallest), or leave it empty");
+    else if (key == admission_mode_key && val != "off" && val != "queue" && val != "reject")
+        throw InvalidSettingsException(key, val, "Invalid mode, try \"off\", \"queue\" or \"reject\"");
+    else if (key == shutdown_action_key && val != "suspend" && val != "powerdown")
+        throw InvalidSettingsException(key, val, "Invalid action, try \"suspend\" or \"powerdown\"");
+    else if (key == idle_suspend_key && !val.isEmpty() && !valid_count(val))
+        throw InvalidSettingsException(key, val, "Invalid minutes, try a positive number, or leave it empty");
+    else if (key == usage_history_interval_key && !val.isEmpty() && !valid_count(val))
+        throw InvalidSettingsException(key, val, "Invalid seconds, try a positive number, or leave it empty");
+    else if ((key == rpc_compression_key || key == client_rpc_compression_key) && val != "none" && val != "gzip")
+        throw InvalidSettingsException(key, val, "Invalid compression, try \"none\" or \"gzip\"");
+    else if ((key == rpc_keepalive_key || key == client_rpc_keepalive_key) && !val.isEmpty() && !valid_keepalive(val))
+        throw InvalidSettingsException(
+            key, val, QString{"Invalid seconds, try %1 or more, or leave it empty for none"}.arg(min_rpc_keepalive));
+    else if ((key == rpc_window_key || key == client_rpc_window_key) && !val.isEmpty() && !valid_size(val))
+        throw InvalidSettingsException(key, val, "Invalid size, try e.g. \"4M\", or leave it empty for gRPC's own");
+    else if (key == rpc_max_streams_key && !val.isEmpty() && !valid_count(val))
+        throw InvalidSettingsException(key, val, "Invalid count, try a positive number, or leave it empty");
+    else if (key == admission_cpus_key && !val.isEmpty() && !valid_count(val))
+        throw InvalidSettingsException(key, val, "Invalid count, try a positive number, or leave it empty");
+    else if (key == admission_memory_key && !val.isEmpty() && !valid_size(val))
+        throw InvalidSettingsException(key, val, "Invalid size, try e.g. \"24G\", or leave it empty");
+    else if (key == warm_pool_size_key && !valid_pool_size(val))
+        throw InvalidSettingsException(key, val,
+                                       QString{"Invalid size, try 0 (no pool) to %1"}.arg(max_warm_pool_size));
+    else if (key == warm_pool_cpus_key && !valid_count(val))
+        throw InvalidSettingsException(key, val, "Invalid count, try a positive number");
+    else if ((key == warm_pool_memory_key || key == warm_pool_disk_key) && !valid_size(val))
+        throw InvalidSettingsException(key, val, "Invalid size, try e.g. \"2G\"");
     else if (key == winterm_key || key == hotkey_key)
         val = mp::platform::interpret_setting(key, val);
 
+    const auto file_name = file_for(key);
+    std::lock_guard<decltype(mutex)> lock{mutex};
+    cache.erase(file_name);
+
     auto settings = persistent_settings(key);
-    checked_set(*settings, key, val, mutex);
+    settings->setValue(key, val);
+
+    settings->sync(); // flush to confirm we can write
+    check_status(*settings, QStringLiteral("read/write"));
+
+    // What was just written is what the next read would find, so it goes straight into the cache
+    const auto [modified, size] = file_signature(file_name);
+    cache[file_name] = CachedFile{modified, size, values_in(*settings)};
 }
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/sha256.h>
+
+#include <openssl/evp.h>
+
+#include <stdexcept>
+
+namespace mp = multipass;
+
+mp::Sha256::Sha256() : context{EVP_MD_CTX_new(), EVP_MD_CTX_free}
+{
+    if (!context)
+        throw std::runtime_error("Cannot allocate a SHA-256 context");
+
+    reset();
+}
+
+mp::Sha256::~Sha256() = default;
+
+void mp::Sha256::add_data(const char* data, qint64 size)
+{
+    if (size > 0 && !EVP_DigestUpdate(context.get(), data, static_cast<std::size_t>(size)))
+        throw std::runtime_error("Cannot compute SHA-256 digest");
+}
+
+void mp::Sha256::add_data(const QByteArray& data)
+{
+    add_data(data.constData(), data.size());
+}
+
+void mp::Sha256::reset()
+{
+    if (!EVP_DigestInit_ex(context.get(), EVP_sha256(), nullptr))
+        throw std::runtime_error("Cannot initialise SHA-256 digest");
+}
+
+QByteArray mp::Sha256::result() const
+{
+    // Finalising consumes the context, so a copy of it is finalised instead, for more data to be added after
+    std::unique_ptr<EVP_MD_CTX, void (*)(EVP_MD_CTX*)> final_context{EVP_MD_CTX_new(), EVP_MD_CTX_free};
+    QByteArray digest(EVP_MAX_MD_SIZE, '\0');
+    unsigned int size{0};
+
+    if (!final_context || !EVP_MD_CTX_copy_ex(final_context.get(), context.get()) ||
+        !EVP_DigestFinal_ex(final_context.get(), reinterpret_cast<unsigned char*>(digest.data()), &size))
+        throw std::runtime_error("Cannot compute SHA-256 digest");
+
+    digest.resize(static_cast<int>(size));
+    return digest;
+}
@@ -20,7 +20,9 @@
 #include <multipass/exceptions/exitless_sshprocess_exception.h>
 #include <multipass/exceptions/sshfs_missing_error.h>
 #include <multipass/format.h>
+#include <multipass/instrumentation.h>
 #include <multipass/logging/log.h>
+#include <multipass/optional.h>
 #include <multipass/settings.h>
 #include <multipass/ssh/ssh_session.h>
 #include <multipass/standard_paths.h>
@@ -52,6 +54,11 @@ namespace
 {
 constexpr auto category = "utils";
 
+// Blocks on the instance itself until cloud-init is done, where it is recent enough to support that. The file is
+// what tells, either way.
+constexpr auto cloud_init_wait_cmd =
+    "cloud-init status --wait >/dev/null 2>&1; [ -e /var/lib/cloud/instance/boot-finished ]";
+
 auto quote_for(const std::string& arg, mp::utils::QuoteType quote_type)
 {
     if (quote_type == mp::utils::QuoteType::no_quotes)
@@ -95,21 +102,40 @@ void mp::Utils::exit(int code)
 void mp::Utils::wait_for_cloud_init(mp::VirtualMachine* virtual_machine, std::chrono::milliseconds timeout,
                                     const mp::SSHKeyProvider& key_provider)
 {
-    auto action = [virtual_machine, &key_provider] {
+    ScopedTiming timing{"multipass_cloud_init_wait_seconds"};
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    mp::optional<mp::SSHSession> session; // kept across attempts, so that each one need not go through a handshake
+
+    auto action = [virtual_machine, &key_provider, &session, deadline] {
         virtual_machine->ensure_vm_is_running();
         try
         {
-            mp::SSHSession session{virtual_machine->ssh_hostname(), virtual_machine->ssh_port(),
-                                   virtual_machine->ssh_username(), key_provider};
+            // The instance does the waiting, so give it what is left of the timeout
+            auto time_left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline -
+                                                                                   std::chrono::steady_clock::now());
+            time_left = std::max(time_left, std::chrono::milliseconds{1s});
 
-            std::lock_guard<decltype(virtual_machine->state_mutex)> lock{virtual_machine->state_mutex};
-            auto ssh_process = session.exec({"[ -e /var/lib/cloud/instance/boot-finished ]"});
-            return ssh_process.exit_code() == 0 ? mp::utils::TimeoutAction::done : mp::utils::TimeoutAction::retry;
+            if (const auto result = virtual_machine->run_in_guest(cloud_init_wait_cmd, time_left))
+                return result->exit_code == 0 ? mp::utils::TimeoutAction::done : mp::utils::TimeoutAction::retry;
+
+            if (!session)
+                session.emplace(virtual_machine->ssh_hostname(), virtual_machine->ssh_port(),
+                                virtual_machine->ssh_username(), key_provider);
+
+            auto ssh_process = [virtual_machine, &session] {
+                std::lock_guard<decltype(virtual_machine->state_mutex)> lock{virtual_machine->state_mutex};
+                return session->exec(cloud_init_wait_cmd);
+            }();
+
+            auto exit_code = ssh_process.exit_code(time_left);
+            return exit_code == 0 ? mp::utils::TimeoutAction::done : mp::utils::TimeoutAction::retry;
         }
         catch (const std::exception& e)
         {
+            session.reset(); // it may be what failed, so the next attempt starts afresh
+
             std::lock_guard<decltype(virtual_machine->state_mutex)> lock{virtual_machine->state_mutex};
-            mpl::log(mpl::Level::warning, virtual_machine->vm_name, e.what());
+            mpl::log_limited(mpl::Level::warning, virtual_machine->vm_name, "{}", e.what());
             return mp::utils::TimeoutAction::retry;
         }
     };
@@ -245,6 +271,7 @@ void mp::utils::wait_until_ssh_up(VirtualMachine* virtual_machine, std::chrono::
                                   std::function<void()> const& ensure_vm_is_running)
 {
     mpl::log(mpl::Level::debug, virtual_machine->vm_name, "Waiting for SSH to be up");
+    ScopedTiming timing{"multipass_ssh_up_wait_seconds"};
     auto action = [virtual_machine, &ensure_vm_is_running] {
         ensure_vm_is_running();
         try
@@ -323,12 +350,13 @@ void mp::utils::install_sshfs_for(const std::string& name, mp::SSHSession& sessi
 
 // Executes a given command on the given session. Returns the output of the command, with spaces and feeds trimmed.
 // Caveat emptor: if the command fails, an empty string is returned.
-std::string mp::utils::run_in_ssh_session(mp::SSHSession& session, const std::string& cmd)
+std::string mp::utils::run_in_ssh_session(mp::SSHSession& session, const std::string& cmd,
+                                          std::chrono::milliseconds timeout)
 {
     mpl::log(mpl::Level::debug, category, fmt::format("executing '{}'", cmd));
     auto proc = session.exec(cmd);
 
-    if (proc.exit_code() != 0)
+    if (proc.exit_code(timeout) != 0)
     {
         auto error_msg = proc.read_std_error();
         mpl::log(mpl::Level::warning, category,
@@ -15,18 +15,27 @@
  *
  */
 
+#include <multipass/file_ops.h>
 #include <multipass/format.h>
+#include <multipass/sha256.h>
+#include <multipass/sparse_writer.h>
 #include <multipass/vm_image_host.h>
 #include <multipass/vm_image_vault.h>
 #include <multipass/xz_image_decoder.h>
+#include <multipass/zstd_image_decoder.h>
 
-#include <QCryptographicHash>
 #include <QFileInfo>
 
 #include <stdexcept>
+#include <vector>
 
 namespace mp = multipass;
 
+namespace
+{
+constexpr qint64 hash_read_size = 4 * 1024 * 1024;
+} // namespace
+
 QString mp::vault::filename_for(const mp::Path& path)
 {
     QFileInfo file_info(path);
@@ -44,7 +53,49 @@ QString mp::vault::copy(const QString& file_name, const QDir& output_dir)
     QFileInfo info{file_name};
     const auto source_name = info.fileName();
     auto new_path = output_dir.filePath(source_name);
-    QFile::copy(file_name, new_path);
+
+    // Like QFile::copy(), an existing file is left alone
+    QFile source{file_name}, target{new_path};
+    if (target.exists() || !source.open(QIODevice::ReadOnly) || !target.open(QIODevice::WriteOnly))
+        return new_path;
+
+    // Each round reads the next batch while writing out the last one, all submitted together
+    constexpr qint64 chunk_size = 1024 * 1024, chunks_per_batch = 8;
+    mp::SparseWriter writer{target};
+    std::vector<char> batches[2]{std::vector<char>(chunk_size * chunks_per_batch),
+                                 std::vector<char>(chunk_size * chunks_per_batch)};
+    qint64 pos = 0, filled = 0; // of the batch read last round
+    bool at_end = false, failed = false;
+    for (auto round = 0; !failed && (!at_end || filled > 0); ++round)
+    {
+        auto& reading = batches[round % 2];
+        auto& writing = batches[(round + 1) % 2];
+        std::vector<mp::FileOps::IoRequest> requests;
+
+        const auto read_pos = pos + filled;
+        if (!at_end)
+            for (qint64 i = 0; i < chunks_per_batch; ++i)
+                requests.push_back({&source, reading.data() + i * chunk_size, chunk_size, read_pos + i * chunk_size});
+        const auto reads = requests.size();
+        writer.queue(writing.data(), filled, pos, requests);
+
+        failed = !MP_FILEOPS.submit(requests);
+        pos = read_pos;
+        filled = 0;
+        for (auto i = 0u; i < reads && !at_end; ++i)
+        {
+            filled += requests[i].result;
+            at_end = requests[i].result < chunk_size;
+        }
+    }
+
+    if (failed || !(target.size() >= pos || target.resize(pos)))
+    {
+        target.remove();
+        throw std::runtime_error(fmt::format("failed to copy {} to {}", file_name, new_path));
+    }
+
+    target.setPermissions(source.permissions());
     return new_path;
 }
 
@@ -56,16 +107,21 @@ void mp::vault::delete_file(const mp::Path& path)
 
 QString mp::vault::compute_image_hash(const mp::Path& image_path)
 {
+    // Unbuffered, the large reads go straight from the page cache to the buffer, which stays the same throughout
     QFile image_file(image_path);
-    if (!image_file.open(QFile::ReadOnly))
+    if (!image_file.open(QFile::ReadOnly | QFile::Unbuffered))
     {
         throw std::runtime_error("Cannot open image file for computing hash");
     }
 
-    QCryptographicHash hash(QCryptographicHash::Sha256);
-    if (!hash.addData(&image_file))
+    mp::Sha256 hash;
+    std::vector<char> buffer(hash_read_size);
+    for (qint64 bytes_read; (bytes_read = image_file.read(buffer.data(), hash_read_size)) != 0;)
     {
-        throw std::runtime_error("Cannot read image file to compute hash");
+        if (bytes_read < 0)
+            throw std::runtime_error("Cannot read image file to compute hash");
+
+        hash.add_data(buffer.data(), bytes_read);
     }
 
     return hash.result().toHex();
@@ -73,22 +129,35 @@ QString mp::vault::compute_image_hash(const mp::Path& image_path)
 
 void mp::vault::verify_image_download(const mp::Path& image_path, const QString& image_hash)
 {
-    auto computed_hash = compute_image_hash(image_path);
+    verify_image_hash(compute_image_hash(image_path), image_hash);
+}
 
+void mp::vault::verify_image_hash(const QString& computed_hash, const QString& image_hash)
+{
     if (computed_hash != image_hash)
     {
         throw std::runtime_error("Downloaded image hash does not match");
     }
 }
 
-QString mp::vault::extract_image(const mp::Path& image_path, const mp::ProgressMonitor& monitor, const bool delete_file)
+bool mp::vault::is_compressed_image(const mp::Path& image_path)
+{
+    return image_path.endsWith(".xz") || image_path.endsWith(".zst");
+}
+
+QString mp::vault::decompressed_path(const mp::Path& image_path)
 {
-    mp::XzImageDecoder xz_decoder(image_path);
-    QString new_image_path{image_path};
+    return is_compressed_image(image_path) ? image_path.left(image_path.lastIndexOf('.')) : image_path;
+}
 
-    new_image_path.remove(".xz");
+QString mp::vault::extract_image(const mp::Path& image_path, const mp::ProgressMonitor& monitor, const bool delete_file)
+{
+    const auto new_image_path = decompressed_path(image_path);
 
-    xz_decoder.decode_to(new_image_path, monitor);
+    if (image_path.endsWith(".zst"))
+        mp::ZstdImageDecoder{image_path}.decode_to(new_image_path, monitor);
+    else
+        mp::XzImageDecoder{image_path}.decode_to(new_image_path, monitor);
 
     mp::vault::delete_file(image_path);
 
@@ -26,6 +26,7 @@
 #include <multipass/url_downloader.h>
 #include <multipass/utils.h>
 
+#include <QCryptographicHash>
 #include <QFile>
 #include <QFileInfo>
 
@@ -80,6 +81,16 @@ auto workflows_map_for(const std::string& archive_file_path, bool& needs_update)
 
     return workflows_map;
 }
+
+QByteArray archive_digest(const QString& archive_file_path)
+{
+    QFile archive{archive_file_path};
+    QCryptographicHash hash{QCryptographicHash::Sha256};
+    if (!archive.open(QIODevice::ReadOnly) || !hash.addData(&archive))
+        return {};
+
+    return hash.result();
+}
 } // namespace
 
 mp::DefaultVMWorkflowProvider::DefaultVMWorkflowProvider(const QUrl& workflows_url, URLDownloader* downloader,
@@ -102,127 +113,53 @@ mp::DefaultVMWorkflowProvider::DefaultVMWorkflowProvider(URLDownloader* download
 mp::Query mp::DefaultVMWorkflowProvider::fetch_workflow_for(const std::string& workflow_name,
                                                             VirtualMachineDescription& vm_desc)
 {
+    std::lock_guard<decltype(workflows_mutex)> lock{workflows_mutex};
     update_workflows();
 
-    Query query{"", "default", false, "", Query::Type::Alias};
-    auto& workflow_config = workflow_map.at(workflow_name);
-
-    auto workflow_instance = workflow_config["instances"][workflow_name];
-
-    // TODO: Abstract all of the following YAML schema boilerplate
-    if (workflow_instance["image"])
-    {
-        // TODO: Support http later.
-        // This only supports the "alias" and "remote:alias" scheme at this time
-        auto image_str{workflow_config["instances"][workflow_name]["image"].as<std::string>()};
-        auto tokens = mp::utils::split(image_str, ":");
-
-        if (tokens.size() == 2)
-        {
-            query.remote_name = tokens[0];
-            query.release = tokens[1];
-        }
-        else if (tokens.size() == 1)
-        {
-            query.release = tokens[0];
-        }
-        else
+    const auto& workflow = workflow_map.at(workflow_name);
+    auto check = [this](const std::string& error) {
+        if (!error.empty())
         {
             needs_update = true;
-            throw InvalidWorkflowException("Unsupported image scheme in Workflow");
+            throw InvalidWorkflowException(error);
         }
-    }
+    };
 
-    if (workflow_instance["limits"]["min-cpu"])
-    {
-        try
-        {
-            auto min_cpus = workflow_instance["limits"]["min-cpu"].as<int>();
+    check(workflow.image_error);
+    Query query{"", workflow.release, false, workflow.remote_name, Query::Type::Alias};
 
-            if (vm_desc.num_cores == 0)
-            {
-                vm_desc.num_cores = min_cpus;
-            }
-            else if (vm_desc.num_cores < min_cpus)
-            {
-                throw WorkflowMinimumException("Number of CPUs", std::to_string(min_cpus));
-            }
-        }
-        catch (const YAML::BadConversion&)
-        {
-            needs_update = true;
-            throw InvalidWorkflowException(fmt::format("Minimum CPU value in workflow is invalid"));
-        }
+    check(workflow.min_cpus_error);
+    if (workflow.min_cpus)
+    {
+        if (vm_desc.num_cores == 0)
+            vm_desc.num_cores = *workflow.min_cpus;
+        else if (vm_desc.num_cores < *workflow.min_cpus)
+            throw WorkflowMinimumException("Number of CPUs", std::to_string(*workflow.min_cpus));
     }
 
-    if (workflow_instance["limits"]["min-mem"])
+    check(workflow.min_mem_error);
+    if (workflow.min_mem)
     {
-        auto min_mem_size_str{workflow_instance["limits"]["min-mem"].as<std::string>()};
-
-        try
-        {
-            MemorySize min_mem_size{min_mem_size_str};
-
-            if (vm_desc.mem_size.in_bytes() == 0)
-            {
-                vm_desc.mem_size = min_mem_size;
-            }
-            else if (vm_desc.mem_size < min_mem_size)
-            {
-                throw WorkflowMinimumException("Memory size", min_mem_size_str);
-            }
-        }
-        catch (const InvalidMemorySizeException&)
-        {
-            needs_update = true;
-            throw InvalidWorkflowException(fmt::format("Minimum memory size value in workflow is invalid"));
-        }
+        if (vm_desc.mem_size.in_bytes() == 0)
+            vm_desc.mem_size = workflow.min_mem->second;
+        else if (vm_desc.mem_size < workflow.min_mem->second)
+            throw WorkflowMinimumException("Memory size", workflow.min_mem->first);
     }
 
-    if (workflow_instance["limits"]["min-disk"])
+    check(workflow.min_disk_error);
+    if (workflow.min_disk)
     {
-        auto min_disk_space_str{workflow_instance["limits"]["min-disk"].as<std::string>()};
-
-        try
-        {
-            MemorySize min_disk_space{min_disk_space_str};
-
-            if (vm_desc.disk_space.in_bytes() == 0)
-            {
-                vm_desc.disk_space = min_disk_space;
-            }
-            else if (vm_desc.disk_space < min_disk_space)
-            {
-                throw WorkflowMinimumException("Disk space", min_disk_space_str);
-            }
-        }
-        catch (const InvalidMemorySizeException&)
-        {
-            needs_update = true;
-            throw InvalidWorkflowException(fmt::format("Minimum disk space value in workflow is invalid"));
-        }
+        if (vm_desc.disk_space.in_bytes() == 0)
+            vm_desc.disk_space = workflow.min_disk->second;
+        else if (vm_desc.disk_space < workflow.min_disk->second)
+            throw WorkflowMinimumException("Disk space", workflow.min_disk->first);
     }
 
-    if (workflow_instance["cloud-init"]["vendor-data"])
+    check(workflow.vendor_data_error);
+    for (const auto& config : workflow.vendor_data)
     {
-        try
-        {
-            auto cloud_init_config = YAML::Load(workflow_instance["cloud-init"]["vendor-data"].as<std::string>());
-
-            for (const auto& config : cloud_init_config)
-            {
-                if (config.first.IsScalar())
-                {
-                    vm_desc.vendor_data_config[config.first.Scalar()] = config.second;
-                }
-            }
-        }
-        catch (const YAML::BadConversion&)
-        {
-            needs_update = true;
-            throw InvalidWorkflowException(
-                fmt::format("Cannot convert cloud-init data for the {} workflow", workflow_name));
-        }
+        // Cloned, as the description gets amended with the instance's own data
+        vm_desc.vendor_data_config[config.first] = YAML::Clone(config.second);
     }
 
     return query;
@@ -230,61 +167,33 @@ mp::Query mp::DefaultVMWorkflowProvider::fetch_workflow_for(const std::string& w
 
 mp::VMImageInfo mp::DefaultVMWorkflowProvider::info_for(const std::string& workflow_name)
 {
+    std::lock_guard<decltype(workflows_mutex)> lock{workflows_mutex};
     update_workflows();
 
-    static constexpr auto missing_key_template{"The \'{}\' key is required for the {} workflow"};
-    static constexpr auto bad_conversion_template{"Cannot convert \'{}\' key for the {} workflow"};
-    auto& workflow_config = workflow_map.at(workflow_name);
-
-    VMImageInfo image_info;
-    image_info.aliases.append(QString::fromStdString(workflow_name));
-
-    const auto description_key{"description"};
-    const auto version_key{"version"};
-
-    if (!workflow_config[description_key])
+    const auto& workflow = workflow_map.at(workflow_name);
+    if (!workflow.info_error.empty())
     {
         needs_update = true;
-        throw InvalidWorkflowException(fmt::format(missing_key_template, description_key, workflow_name));
+        throw InvalidWorkflowException(workflow.info_error);
     }
 
-    if (!workflow_config[version_key])
-    {
-        needs_update = true;
-        throw InvalidWorkflowException(fmt::format(missing_key_template, version_key, workflow_name));
-    }
-
-    try
-    {
-        image_info.release_title = QString::fromStdString(workflow_config[description_key].as<std::string>());
-    }
-    catch (const YAML::BadConversion&)
-    {
-        needs_update = true;
-        throw InvalidWorkflowException(fmt::format(bad_conversion_template, description_key, workflow_name));
-    }
-
-    try
-    {
-        image_info.version = QString::fromStdString(workflow_config["version"].as<std::string>());
-    }
-    catch (const YAML::BadConversion&)
-    {
-        needs_update = true;
-        throw InvalidWorkflowException(fmt::format(bad_conversion_template, version_key, workflow_name));
-    }
+    VMImageInfo image_info;
+    image_info.aliases.append(QString::fromStdString(workflow_name));
+    image_info.release_title = workflow.description;
+    image_info.version = workflow.version;
 
     return image_info;
 }
 
 std::vector<mp::VMImageInfo> mp::DefaultVMWorkflowProvider::all_workflows()
 {
+    std::lock_guard<decltype(workflows_mutex)> lock{workflows_mutex};
     update_workflows();
 
     bool will_need_update{false};
     std::vector<VMImageInfo> workflow_info;
 
-    for (const auto& [key, config] : workflow_map)
+    for (const auto& [key, workflow] : workflow_map)
     {
         try
         {
@@ -308,6 +217,7 @@ std::vector<mp::VMImageInfo> mp::DefaultVMWorkflowProvider::all_workflows()
 
 std::string mp::DefaultVMWorkflowProvider::name_from_workflow(const std::string& workflow_name)
 {
+    std::lock_guard<decltype(workflows_mutex)> lock{workflows_mutex};
     if (workflow_map.count(workflow_name) == 1)
         return workflow_name;
 
@@ -316,42 +226,179 @@ std::string mp::DefaultVMWorkflowProvider::name_from_workflow(const std::string&
 
 int mp::DefaultVMWorkflowProvider::workflow_timeout(const std::string& workflow_name)
 {
-    auto timeout_seconds{0};
+    std::lock_guard<decltype(workflows_mutex)> lock{workflows_mutex};
+
+    auto it = workflow_map.find(workflow_name);
+    if (it == workflow_map.end())
+        return 0;
+
+    if (!it->second.timeout_error.empty())
+    {
+        needs_update = true;
+        throw InvalidWorkflowException(it->second.timeout_error);
+    }
+
+    return it->second.timeout_seconds;
+}
+
+auto mp::DefaultVMWorkflowProvider::workflow_from(const std::string& workflow_name, const YAML::Node& workflow_config)
+    -> Workflow
+{
+    static constexpr auto missing_key_template{"The \'{}\' key is required for the {} workflow"};
+    static constexpr auto bad_conversion_template{"Cannot convert \'{}\' key for the {} workflow"};
+    const auto description_key{"description"};
+    const auto version_key{"version"};
+
+    Workflow workflow;
+
+    if (!workflow_config[description_key])
+        workflow.info_error = fmt::format(missing_key_template, description_key, workflow_name);
+    else if (!workflow_config[version_key])
+        workflow.info_error = fmt::format(missing_key_template, version_key, workflow_name);
+    else
+    {
+        try
+        {
+            workflow.description = QString::fromStdString(workflow_config[description_key].as<std::string>());
+        }
+        catch (const YAML::BadConversion&)
+        {
+            workflow.info_error = fmt::format(bad_conversion_template, description_key, workflow_name);
+        }
 
-    try
+        try
+        {
+            if (workflow.info_error.empty())
+                workflow.version = QString::fromStdString(workflow_config[version_key].as<std::string>());
+        }
+        catch (const YAML::BadConversion&)
+        {
+            workflow.info_error = fmt::format(bad_conversion_template, version_key, workflow_name);
+        }
+    }
+
+    const auto workflow_instance = workflow_config["instances"][workflow_name];
+
+    // TODO: Abstract all of the following YAML schema boilerplate
+    if (workflow_instance["image"])
     {
-        workflow_map.at(workflow_name);
+        // TODO: Support http later.
+        // This only supports the "alias" and "remote:alias" scheme at this time
+        try
+        {
+            auto tokens = mp::utils::split(workflow_instance["image"].as<std::string>(), ":");
 
-        auto& workflow_config = workflow_map.at(workflow_name);
+            if (tokens.size() == 2)
+            {
+                workflow.remote_name = tokens[0];
+                workflow.release = tokens[1];
+            }
+            else if (tokens.size() == 1)
+            {
+                workflow.release = tokens[0];
+            }
+            else
+            {
+                workflow.image_error = "Unsupported image scheme in Workflow";
+            }
+        }
+        catch (const YAML::BadConversion&)
+        {
+            workflow.image_error = "Unsupported image scheme in Workflow";
+        }
+    }
 
-        auto workflow_instance = workflow_config["instances"][workflow_name];
+    if (workflow_instance["limits"]["min-cpu"])
+    {
+        try
+        {
+            workflow.min_cpus = workflow_instance["limits"]["min-cpu"].as<int>();
+        }
+        catch (const YAML::BadConversion&)
+        {
+            workflow.min_cpus_error = "Minimum CPU value in workflow is invalid";
+        }
+    }
 
-        if (workflow_instance["timeout"])
+    auto size_limit = [&workflow_instance](const char* key, std::string& error, const char* error_message) {
+        optional<std::pair<std::string, MemorySize>> limit;
+        if (workflow_instance["limits"][key])
         {
             try
             {
-                timeout_seconds = workflow_instance["timeout"].as<int>();
+                auto size_str = workflow_instance["limits"][key].as<std::string>();
+                limit.emplace(size_str, MemorySize{size_str});
             }
             catch (const YAML::BadConversion&)
             {
-                needs_update = true;
-                throw InvalidWorkflowException(fmt::format("Invalid timeout given in workflow"));
+                error = error_message;
+            }
+            catch (const InvalidMemorySizeException&)
+            {
+                error = error_message;
+            }
+        }
+
+        return limit;
+    };
+
+    workflow.min_mem =
+        size_limit("min-mem", workflow.min_mem_error, "Minimum memory size value in workflow is invalid");
+    workflow.min_disk =
+        size_limit("min-disk", workflow.min_disk_error, "Minimum disk space value in workflow is invalid");
+
+    if (workflow_instance["cloud-init"]["vendor-data"])
+    {
+        try
+        {
+            auto cloud_init_config = YAML::Load(workflow_instance["cloud-init"]["vendor-data"].as<std::string>());
+
+            for (const auto& config : cloud_init_config)
+            {
+                if (config.first.IsScalar())
+                {
+                    workflow.vendor_data.emplace_back(config.first.Scalar(), config.second);
+                }
             }
         }
+        catch (const YAML::Exception&)
+        {
+            workflow.vendor_data.clear();
+            workflow.vendor_data_error =
+                fmt::format("Cannot convert cloud-init data for the {} workflow", workflow_name);
+        }
     }
-    catch (const std::out_of_range&)
+
+    if (workflow_instance["timeout"])
     {
-        // Ignore
+        try
+        {
+            workflow.timeout_seconds = workflow_instance["timeout"].as<int>();
+        }
+        catch (const YAML::BadConversion&)
+        {
+            workflow.timeout_error = "Invalid timeout given in workflow";
+        }
     }
 
-    return timeout_seconds;
+    return workflow;
 }
 
 void mp::DefaultVMWorkflowProvider::fetch_workflows()
 {
     url_downloader->download_to(workflows_url, archive_file_path, -1, -1, [](auto...) { return true; });
 
-    workflow_map = workflows_map_for(archive_file_path.toStdString(), needs_update);
+    // Most refreshes download the same archive again, which then needs no reading
+    auto hash = archive_digest(archive_file_path);
+    if (!hash.isEmpty() && hash == archive_hash)
+        return;
+
+    std::map<std::string, Workflow> workflows;
+    for (const auto& [name, config] : workflows_map_for(archive_file_path.toStdString(), needs_update))
+        workflows.emplace(name, workflow_from(name, config));
+
+    workflow_map = std::move(workflows);
+    archive_hash = std::move(hash);
 }
 
 void mp::DefaultVMWorkflowProvider::update_workflows()
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/sparse_writer.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace mp = multipass;
+
+namespace
+{
+// Matches the block size of common filesystems, the smallest hole they can keep
+constexpr qint64 block_size = 4096;
+} // namespace
+
+mp::SparseWriter::SparseWriter(QFile& file) : file{file}
+{
+}
+
+bool mp::SparseWriter::write(const char* data, qint64 size)
+{
+    return for_each_run(data, size, [this, data](qint64 offset, qint64 length, bool zero) {
+        return zero ? file.seek(file.pos() + length) : file.write(data + offset, length) == length;
+    });
+}
+
+void mp::SparseWriter::queue(char* data, qint64 size, qint64 pos, std::vector<FileOps::IoRequest>& requests)
+{
+    for_each_run(data, size, [this, data, pos, &requests](qint64 offset, qint64 length, bool zero) {
+        if (!zero)
+            requests.push_back({&file, data + offset, length, pos + offset, true});
+        return true;
+    });
+}
+
+bool mp::SparseWriter::for_each_run(const char* data, qint64 size,
+                                    const std::function<bool(qint64, qint64, bool)>& on_run)
+{
+    auto block_length = [size](qint64 offset) { return std::min(block_size, size - offset); };
+
+    for (qint64 offset = 0; offset < size;)
+    {
+        // Coalesce runs of blocks of the same kind into a single seek or write
+        const auto zero = is_zero(data + offset, block_length(offset));
+        auto end = offset + block_length(offset);
+        while (end < size && is_zero(data + end, block_length(end)) == zero)
+            end += block_length(end);
+
+        if (!on_run(offset, end - offset, zero))
+            return false;
+
+        offset = end;
+    }
+
+    return true;
+}
+
+bool mp::SparseWriter::finish()
+{
+    return file.pos() <= file.size() || file.resize(file.pos());
+}
+
+bool mp::SparseWriter::is_zero(const char* data, qint64 size)
+{
+    // Comparing the data with itself shifted by one byte lets the C library's vectorised memcmp do the work
+    return size <= 0 || (data[0] == 0 && std::memcmp(data, data + 1, static_cast<std::size_t>(size - 1)) == 0);
+}
@@ -20,13 +20,30 @@
 #include <multipass/rpc/multipass.grpc.pb.h>
 
 #include <multipass/format.h>
+#include <multipass/sparse_writer.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace mp = multipass;
 
 namespace
 {
+// Decoders start on several threads at once, and the tables must not be rewritten under ones already reading them
+void init_crc_tables()
+{
+    static std::once_flag once;
+    std::call_once(once, [] {
+        xz_crc32_init();
+        xz_crc64_init();
+    });
+}
+
 bool verify_decode(const xz_ret& ret)
 {
     switch (ret)
@@ -52,13 +69,237 @@ bool verify_decode(const xz_ret& ret)
 
     return true;
 }
+
+constexpr auto xz_header_size = 12;
+constexpr auto xz_footer_size = 12;
+
+struct XzBlock
+{
+    qint64 offset;
+    qint64 size;
+    qint64 decoded_offset;
+    qint64 decoded_size;
+};
+
+quint32 read_le32(const char* data)
+{
+    const auto bytes = reinterpret_cast<const unsigned char*>(data);
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<quint32>(bytes[3]) << 24);
+}
+
+bool read_varint(const QByteArray& data, int& pos, quint64& value)
+{
+    value = 0;
+    for (auto i = 0; i < 9 && pos < data.size(); ++i)
+    {
+        const auto byte = static_cast<unsigned char>(data[pos++]);
+        value |= static_cast<quint64>(byte & 0x7f) << (i * 7);
+        if (!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+// Reads the block layout of a single-stream xz file from its index. Anything that is not simple enough to decode
+// block by block yields no blocks at all, such as concatenated streams, padding or a corrupt index.
+std::vector<XzBlock> read_blocks(QFile& xz_file)
+{
+    const auto file_size = xz_file.size();
+    if (file_size < xz_header_size + xz_footer_size)
+        return {};
+
+    const auto header = xz_file.read(xz_header_size);
+    if (!xz_file.seek(file_size - xz_footer_size))
+        return {};
+    const auto footer = xz_file.read(xz_footer_size);
+
+    if (header.size() != xz_header_size || !header.startsWith(QByteArray("\xfd" "7zXZ\0", 6)) ||
+        footer.size() != xz_footer_size || !footer.endsWith("YZ") || footer.mid(8, 2) != header.mid(6, 2))
+        return {};
+
+    const auto index_size = (static_cast<qint64>(read_le32(footer.constData() + 4)) + 1) * 4;
+    const auto index_offset = file_size - xz_footer_size - index_size;
+    if (index_offset < xz_header_size || !xz_file.seek(index_offset))
+        return {};
+
+    const auto index = xz_file.read(index_size);
+    if (index.size() != index_size || index[0] != '\0' ||
+        xz_crc32(reinterpret_cast<const uint8_t*>(index.constData()), index.size() - 4, 0) !=
+            read_le32(index.constData() + index.size() - 4))
+        return {};
+
+    auto pos = 1;
+    quint64 record_count;
+    if (!read_varint(index, pos, record_count) || record_count > static_cast<quint64>(index_size))
+        return {};
+
+    std::vector<XzBlock> blocks;
+    qint64 offset{xz_header_size}, decoded_offset{0};
+    for (quint64 i = 0; i < record_count; ++i)
+    {
+        quint64 unpadded_size, uncompressed_size;
+        if (!read_varint(index, pos, unpadded_size) || !read_varint(index, pos, uncompressed_size) ||
+            unpadded_size > static_cast<quint64>(file_size))
+            return {};
+
+        const auto block_size = static_cast<qint64>((unpadded_size + 3) & ~quint64{3});
+        blocks.push_back({offset, block_size, decoded_offset, static_cast<qint64>(uncompressed_size)});
+        offset += block_size;
+        decoded_offset += static_cast<qint64>(uncompressed_size);
+    }
+
+    if (offset != index_offset)
+        return {};
+
+    return blocks;
+}
+
+// Decodes one block on its own, by feeding the decoder the stream header followed by just that block
+void decode_block(const mp::Path& xz_file_path, const QByteArray& stream_header, const XzBlock& block,
+                  const QString& decoded_file_path, std::atomic<qint64>& bytes_decoded, const std::atomic_bool& stop)
+{
+    QFile xz_file{xz_file_path};
+    if (!xz_file.open(QIODevice::ReadOnly) || !xz_file.seek(block.offset))
+        throw std::runtime_error(fmt::format("failed to open {} for reading", xz_file.fileName()));
+
+    QFile decoded_file{decoded_file_path};
+    if (!decoded_file.open(QIODevice::ReadWrite) || !decoded_file.seek(block.decoded_offset))
+        throw std::runtime_error(fmt::format("failed to open {} for writing", decoded_file.fileName()));
+    mp::SparseWriter writer{decoded_file};
+
+    mp::XzImageDecoder::XzDecoderUPtr xz_decoder{xz_dec_init(XZ_DYNALLOC, 1u << 26), xz_dec_end};
+    if (!xz_decoder)
+        throw std::runtime_error("xz decoder memory allocation failed");
+
+    struct xz_buf decode_buf
+    {
+    };
+    const auto max_size = 65536u;
+
+    std::vector<char> read_data(max_size), write_data(max_size);
+    decode_buf.out = reinterpret_cast<unsigned char*>(write_data.data());
+    decode_buf.out_size = max_size;
+
+    qint64 written{0};
+    auto run_decoder = [&] {
+        bool output_full;
+        do
+        {
+            if (!verify_decode(xz_dec_run(xz_decoder.get(), &decode_buf)) ||
+                written + static_cast<qint64>(decode_buf.out_pos) > block.decoded_size)
+                throw std::runtime_error("xz file is corrupt");
+
+            // The image was sized up front, so zeros can be skipped over
+            output_full = decode_buf.out_pos == decode_buf.out_size;
+            if (!writer.write(write_data.data(), decode_buf.out_pos))
+                throw std::runtime_error(
+                    fmt::format("failed to write to {}: {}", decoded_file.fileName(), decoded_file.errorString()));
+
+            written += decode_buf.out_pos;
+            bytes_decoded += decode_buf.out_pos;
+            decode_buf.out_pos = 0;
+        } while (decode_buf.in_pos < decode_buf.in_size || output_full);
+    };
+
+    decode_buf.in = reinterpret_cast<const unsigned char*>(stream_header.constData());
+    decode_buf.in_pos = 0;
+    decode_buf.in_size = stream_header.size();
+    run_decoder();
+
+    for (auto remaining = block.size; remaining > 0 && !stop;)
+    {
+        const auto bytes_read = xz_file.read(read_data.data(), std::min<qint64>(remaining, max_size));
+        if (bytes_read <= 0)
+            throw std::runtime_error("xz file is truncated");
+
+        decode_buf.in = reinterpret_cast<const unsigned char*>(read_data.data());
+        decode_buf.in_pos = 0;
+        decode_buf.in_size = bytes_read;
+        run_decoder();
+
+        remaining -= bytes_read;
+    }
+
+    if (!stop && written != block.decoded_size)
+        throw std::runtime_error("xz file is corrupt");
+}
+
+// Blocks are independent of each other, so they are decoded in parallel straight into their place in the image
+void decode_blocks_to(QFile& xz_file, const std::vector<XzBlock>& blocks, const mp::Path& decoded_image_path,
+                      const mp::ProgressMonitor& monitor)
+{
+    if (!xz_file.seek(0))
+        throw std::runtime_error(fmt::format("failed to read {}", xz_file.fileName()));
+    const auto stream_header = xz_file.read(xz_header_size);
+
+    {
+        QFile decoded_file{decoded_image_path};
+        if (!decoded_file.open(QIODevice::WriteOnly) ||
+            !decoded_file.resize(blocks.back().decoded_offset + blocks.back().decoded_size))
+            throw std::runtime_error(fmt::format("failed to open {} for writing", decoded_file.fileName()));
+    }
+
+    const auto total_size = blocks.back().decoded_offset + blocks.back().decoded_size;
+    const auto thread_count = std::max(1u, std::min<unsigned>(std::thread::hardware_concurrency(), blocks.size()));
+
+    std::atomic<std::size_t> next_block{0};
+    std::atomic<qint64> bytes_decoded{0};
+    std::atomic_bool stop{false};
+    std::mutex mutex;
+    std::condition_variable cv;
+    unsigned finished_threads{0};
+    std::exception_ptr error;
+
+    std::vector<std::thread> threads;
+    for (auto i = 0u; i < thread_count; ++i)
+    {
+        threads.emplace_back([&] {
+            try
+            {
+                for (auto block = next_block++; block < blocks.size() && !stop; block = next_block++)
+                    decode_block(xz_file.fileName(), stream_header, blocks[block], decoded_image_path, bytes_decoded,
+                                 stop);
+            }
+            catch (...)
+            {
+                std::lock_guard<decltype(mutex)> lock{mutex};
+                if (!error)
+                    error = std::current_exception();
+                stop = true;
+            }
+
+            std::lock_guard<decltype(mutex)> lock{mutex};
+            ++finished_threads;
+            cv.notify_all();
+        });
+    }
+
+    // Progress is reported from here, as the monitor is not expected to be called from several threads
+    {
+        std::unique_lock<decltype(mutex)> lock{mutex};
+        while (!cv.wait_for(lock, std::chrono::milliseconds(250), [&] { return finished_threads == thread_count; }))
+        {
+            lock.unlock();
+            monitor(LaunchProgress::EXTRACT, total_size ? static_cast<int>(bytes_decoded * 100 / total_size) : 100);
+            lock.lock();
+        }
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    if (error)
+        std::rethrow_exception(error);
+
+    monitor(LaunchProgress::EXTRACT, 100);
+}
 } // namespace
 
 mp::XzImageDecoder::XzImageDecoder(const Path& xz_file_path)
     : xz_file{xz_file_path}, xz_decoder{xz_dec_init(XZ_DYNALLOC, 1u << 26), xz_dec_end}
 {
-    xz_crc32_init();
-    xz_crc64_init();
+    init_crc_tables();
 }
 
 void mp::XzImageDecoder::decode_to(const Path& decoded_image_path, const ProgressMonitor& monitor)
@@ -66,10 +307,25 @@ void mp::XzImageDecoder::decode_to(const Path& decoded_image_path, const Progres
     if (!xz_file.open(QIODevice::ReadOnly))
         throw std::runtime_error(fmt::format("failed to open {} for reading", xz_file.fileName()));
 
+    const auto blocks = read_blocks(xz_file);
+    if (blocks.size() > 1)
+        return decode_blocks_to(xz_file, blocks, decoded_image_path, monitor);
+
+    // Not split into blocks, so it can only be decoded as one stream
+    if (!xz_file.seek(0))
+        throw std::runtime_error(fmt::format("failed to read {}", xz_file.fileName()));
+
     QFile decoded_file{decoded_image_path};
     if (!decoded_file.open(QIODevice::WriteOnly))
         throw std::runtime_error(fmt::format("failed to open {} for writing", decoded_file.fileName()));
 
+    mp::SparseWriter writer{decoded_file};
+    auto write_out = [&decoded_file, &writer](const char* data, qint64 size) {
+        if (!writer.write(data, size))
+            throw std::runtime_error(
+                fmt::format("failed to write to {}: {}", decoded_file.fileName(), decoded_file.errorString()));
+    };
+
     struct xz_buf decode_buf
     {
     };
@@ -102,14 +358,151 @@ void mp::XzImageDecoder::decode_to(const Path& decoded_image_path, const Progres
 
         if (!verify_decode(xz_dec_run(xz_decoder.get(), &decode_buf)))
         {
-            decoded_file.write(write_data.data(), decode_buf.out_pos);
+            write_out(write_data.data(), decode_buf.out_pos);
+            if (!writer.finish())
+                throw std::runtime_error(fmt::format("failed to resize {}", decoded_file.fileName()));
             return;
         }
 
         if (decode_buf.out_pos == max_size)
         {
-            decoded_file.write(write_data.data(), decode_buf.out_pos);
+            write_out(write_data.data(), decode_buf.out_pos);
+            decode_buf.out_pos = 0;
+        }
+    }
+}
+
+mp::XzStreamDecoder::XzStreamDecoder(const Path& decoded_file_path, std::size_t max_queued_chunks)
+    : decoded_file{decoded_file_path},
+      xz_decoder{xz_dec_init(XZ_DYNALLOC, 1u << 26), xz_dec_end},
+      max_queued_chunks{max_queued_chunks}
+{
+    init_crc_tables();
+
+    if (!decoded_file.open(QIODevice::WriteOnly))
+        throw std::runtime_error(fmt::format("failed to open {} for writing", decoded_file.fileName()));
+
+    worker = std::thread{&XzStreamDecoder::decode, this};
+}
+
+mp::XzStreamDecoder::~XzStreamDecoder()
+{
+    {
+        std::lock_guard<decltype(queue_mutex)> lock{queue_mutex};
+        input_done = true;
+        queued_chunks.clear();
+    }
+    queue_cv.notify_all();
+
+    if (worker.joinable())
+        worker.join();
+}
+
+bool mp::XzStreamDecoder::write(const QByteArray& chunk)
+{
+    std::unique_lock<decltype(queue_mutex)> lock{queue_mutex};
+    queue_cv.wait(lock, [this] { return decoding_done || queued_chunks.size() < max_queued_chunks; });
+
+    if (decoding_done)
+        return !decode_error;
+
+    queued_chunks.push_back(chunk);
+    lock.unlock();
+    queue_cv.notify_all();
+
+    return true;
+}
+
+void mp::XzStreamDecoder::finish()
+{
+    {
+        std::lock_guard<decltype(queue_mutex)> lock{queue_mutex};
+        input_done = true;
+    }
+    queue_cv.notify_all();
+
+    if (worker.joinable())
+        worker.join();
+
+    if (decode_error)
+        std::rethrow_exception(decode_error);
+}
+
+bool mp::XzStreamDecoder::next_chunk(QByteArray& chunk)
+{
+    std::unique_lock<decltype(queue_mutex)> lock{queue_mutex};
+    queue_cv.wait(lock, [this] { return input_done || !queued_chunks.empty(); });
+
+    if (queued_chunks.empty())
+        return false;
+
+    chunk = std::move(queued_chunks.front());
+    queued_chunks.pop_front();
+    lock.unlock();
+    queue_cv.notify_all();
+
+    return true;
+}
+
+void mp::XzStreamDecoder::decode()
+{
+    std::exception_ptr error;
+
+    try
+    {
+        struct xz_buf decode_buf
+        {
+        };
+        const auto max_size = 65536u;
+
+        std::vector<char> write_data(max_size);
+        QByteArray chunk;
+
+        decode_buf.out = reinterpret_cast<unsigned char*>(write_data.data());
+        decode_buf.out_pos = 0;
+        decode_buf.out_size = max_size;
+
+        SparseWriter writer{decoded_file};
+        auto write_out = [this, &writer, &write_data, &decode_buf] {
+            if (!writer.write(write_data.data(), decode_buf.out_pos))
+                throw std::runtime_error(
+                    fmt::format("failed to write to {}: {}", decoded_file.fileName(), decoded_file.errorString()));
             decode_buf.out_pos = 0;
+        };
+
+        bool stream_end{false};
+        while (!stream_end && next_chunk(chunk))
+        {
+            decode_buf.in = reinterpret_cast<const unsigned char*>(chunk.constData());
+            decode_buf.in_pos = 0;
+            decode_buf.in_size = chunk.size();
+
+            while (!stream_end && decode_buf.in_pos < decode_buf.in_size)
+            {
+                stream_end = !verify_decode(xz_dec_run(xz_decoder.get(), &decode_buf));
+
+                if (stream_end || decode_buf.out_pos == max_size)
+                    write_out();
+            }
         }
+
+        if (!stream_end)
+            throw std::runtime_error("xz file is truncated");
+
+        if (!writer.finish())
+            throw std::runtime_error(fmt::format("failed to resize {}", decoded_file.fileName()));
+        decoded_file.close();
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    {
+        std::lock_guard<decltype(queue_mutex)> lock{queue_mutex};
+        decode_error = error;
+        decoding_done = true;
+        queued_chunks.clear();
     }
+    queue_cv.notify_all();
 }
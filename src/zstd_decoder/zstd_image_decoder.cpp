@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/zstd_image_decoder.h>
+
+#include <multipass/rpc/multipass.grpc.pb.h>
+
+#include <multipass/format.h>
+
+namespace mp = multipass;
+
+namespace
+{
+constexpr auto read_size = 1 << 20;
+} // namespace
+
+mp::ZstdStreamDecoder::ZstdStreamDecoder(const Path& decoded_file_path)
+    : decoded_file{decoded_file_path},
+      writer{decoded_file},
+      zstd_decoder{ZSTD_createDStream(), ZSTD_freeDStream},
+      write_data(ZSTD_DStreamOutSize())
+{
+    if (!zstd_decoder)
+        throw std::runtime_error("zstd decoder memory allocation failed");
+
+    if (!decoded_file.open(QIODevice::WriteOnly))
+        throw std::runtime_error(fmt::format("failed to open {} for writing", decoded_file.fileName()));
+}
+
+bool mp::ZstdStreamDecoder::write(const QByteArray& chunk)
+{
+    if (decode_error)
+        return false;
+
+    try
+    {
+        decode(chunk);
+    }
+    catch (...)
+    {
+        decode_error = std::current_exception();
+        return false;
+    }
+
+    return true;
+}
+
+void mp::ZstdStreamDecoder::finish()
+{
+    if (decode_error)
+        std::rethrow_exception(decode_error);
+
+    // What the decoder holds back for want of output space comes out without any more input
+    for (auto output_full = true; output_full && frame_remaining;)
+    {
+        ZSTD_inBuffer input{nullptr, 0, 0};
+        ZSTD_outBuffer output{write_data.data(), write_data.size(), 0};
+        frame_remaining = ZSTD_decompressStream(zstd_decoder.get(), &output, &input);
+        write_out(output);
+        output_full = output.pos == output.size;
+    }
+
+    if (!had_data || frame_remaining)
+        throw std::runtime_error("zstd file is truncated");
+
+    if (!writer.finish())
+        throw std::runtime_error(fmt::format("failed to resize {}", decoded_file.fileName()));
+}
+
+void mp::ZstdStreamDecoder::decode(const QByteArray& chunk)
+{
+    ZSTD_inBuffer input{chunk.constData(), static_cast<std::size_t>(chunk.size()), 0};
+    had_data = had_data || !chunk.isEmpty();
+
+    // Frames may follow one another, as they do in files written by pzstd or zstd -T
+    while (input.pos < input.size)
+    {
+        ZSTD_outBuffer output{write_data.data(), write_data.size(), 0};
+        frame_remaining = ZSTD_decompressStream(zstd_decoder.get(), &output, &input);
+        write_out(output);
+    }
+}
+
+void mp::ZstdStreamDecoder::write_out(const ZSTD_outBuffer& output)
+{
+    if (ZSTD_isError(frame_remaining))
+        throw std::runtime_error(fmt::format("zstd file is corrupt: {}", ZSTD_getErrorName(frame_remaining)));
+
+    // The decoded image starts out empty, so zeros can be skipped over
+    if (!writer.write(write_data.data(), static_cast<qint64>(output.pos)))
+        throw std::runtime_error(
+            fmt::format("failed to write to {}: {}", decoded_file.fileName(), decoded_file.errorString()));
+}
+
+mp::ZstdImageDecoder::ZstdImageDecoder(const Path& zstd_file_path) : zstd_file{zstd_file_path}
+{
+}
+
+void mp::ZstdImageDecoder::decode_to(const Path& decoded_image_path, const ProgressMonitor& monitor)
+{
+    if (!zstd_file.open(QIODevice::ReadOnly))
+        throw std::runtime_error(fmt::format("failed to open {} for reading", zstd_file.fileName()));
+
+    ZstdStreamDecoder decoder{decoded_image_path};
+
+    const auto file_size = zstd_file.size();
+    qint64 total_bytes_read{0};
+    for (auto chunk = zstd_file.read(read_size); !chunk.isEmpty() && decoder.write(chunk);
+         chunk = zstd_file.read(read_size))
+    {
+        total_bytes_read += chunk.size();
+        monitor(LaunchProgress::EXTRACT, static_cast<int>(total_bytes_read * 100 / file_size));
+    }
+
+    decoder.finish();
+}
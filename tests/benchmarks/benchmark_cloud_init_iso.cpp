@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "temp_dir.h"
+
+#include <multipass/cloud_init_iso.h>
+
+#include <benchmark/benchmark.h>
+
+#include <QDir>
+
+#include <string>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+namespace
+{
+// Writes a seed image the size of the cloud-init configuration of an instance, with the given user-data size in KiB
+void cloud_init_iso_write_to(benchmark::State& state)
+{
+    mpt::TempDir temp_dir;
+    const auto iso_path = QDir{temp_dir.path()}.filePath("cloud-init-config.iso");
+    const std::string user_data(state.range(0) * 1024, 'u');
+
+    for (auto _ : state)
+    {
+        mp::CloudInitIso iso;
+        iso.add_file("meta-data", "#cloud-config\ninstance-id: bench\nlocal-hostname: bench\n");
+        iso.add_file("vendor-data", "#cloud-config\n{}\n");
+        iso.add_file("user-data", user_data);
+        iso.add_file("network-config", "version: 2\n");
+        iso.write_to(iso_path);
+    }
+
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(user_data.size()));
+}
+} // namespace
+
+BENCHMARK(cloud_init_iso_write_to)->RangeMultiplier(8)->Range(1, 512);
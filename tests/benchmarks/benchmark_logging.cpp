@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/logging/log.h>
+#include <multipass/logging/multiplexing_logger.h>
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+
+namespace
+{
+class NullLogger : public mpl::Logger
+{
+public:
+    explicit NullLogger(mpl::Level level) : Logger{level}
+    {
+    }
+
+    void log(mpl::Level, mpl::CString, mpl::CString) const override
+    {
+    }
+};
+
+// Sets up a multiplexer like the daemon's, with a number of client loggers attached next to the system one
+struct Multiplexer
+{
+    explicit Multiplexer(int num_clients, mpl::Level client_level)
+        : multiplexer{std::make_shared<mpl::MultiplexingLogger>(std::make_unique<NullLogger>(mpl::Level::info))}
+    {
+        for (auto i = 0; i < num_clients; ++i)
+        {
+            clients.push_back(std::make_unique<NullLogger>(client_level));
+            multiplexer->add_logger(clients.back().get());
+        }
+
+        mpl::set_logger(multiplexer);
+    }
+
+    ~Multiplexer()
+    {
+        for (const auto& client : clients)
+            multiplexer->remove_logger(client.get());
+        mpl::set_logger(nullptr);
+    }
+
+    std::shared_ptr<mpl::MultiplexingLogger> multiplexer;
+    std::vector<std::unique_ptr<NullLogger>> clients;
+};
+
+void multiplexing_logger_log_taken(benchmark::State& state)
+{
+    Multiplexer multiplexer{static_cast<int>(state.range(0)), mpl::Level::debug};
+
+    for (auto _ : state)
+        mpl::log(mpl::Level::info, "benchmark", "a message that every logger takes");
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Messages that no logger takes, as most debug or trace messages are in practice
+void multiplexing_logger_log_dropped(benchmark::State& state)
+{
+    Multiplexer multiplexer{static_cast<int>(state.range(0)), mpl::Level::info};
+
+    for (auto _ : state)
+        mpl::log(mpl::Level::trace, "benchmark", "a message that no logger takes");
+
+    state.SetItemsProcessed(state.iterations());
+}
+} // namespace
+
+BENCHMARK(multiplexing_logger_log_taken)->Arg(0)->Arg(1)->Arg(8);
+BENCHMARK(multiplexing_logger_log_dropped)->Arg(0)->Arg(1)->Arg(8);
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "sftp_server_test_fixture.h"
+
+#include "file_operations.h"
+#include "mock_ssh_process_exit_status.h"
+#include "temp_dir.h"
+
+#include <multipass/format.h>
+#include <multipass/ssh/ssh_session.h>
+#include <multipass/sshfs_mount/sftp_server.h>
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <memory>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+namespace
+{
+using StringUPtr = std::unique_ptr<ssh_string_struct, void (*)(ssh_string)>;
+
+// Plays sshfs to the server with the mocked libssh of the tests, answering from a temporary directory
+struct SftpServerBench : public mpt::SftpServerMocks
+{
+    mp::SftpServer make_sftpserver()
+    {
+        mp::SSHSession session{"a", 42};
+        return {std::move(session), source, source, {}, {}, 1000, 1000, "sshfs"};
+    }
+
+    sftp_client_message add_msg(uint8_t type)
+    {
+        auto msg = std::make_unique<sftp_client_message_struct>();
+        msg->type = type;
+        messages.push(msg.get());
+        owned_messages.push_back(std::move(msg));
+        return owned_messages.back().get();
+    }
+
+    // Whatever the server replies with, it is not that of a previous round that a message refers to
+    void reset_messages()
+    {
+        owned_messages.clear();
+        last_handle.reset();
+    }
+
+    auto make_msg_handler()
+    {
+        return [this](auto...) -> sftp_client_message {
+            if (messages.empty())
+                return nullptr;
+            auto msg = messages.front();
+            messages.pop();
+            if (msg->handle == nullptr)
+                msg->handle = last_handle.get();
+            return msg;
+        };
+    }
+
+    auto make_handle_reply()
+    {
+        return [this](sftp_client_message, ssh_string handle) {
+            last_handle.reset(ssh_string_copy(handle));
+            return SSH_OK;
+        };
+    }
+
+    mpt::ExitStatusMock exit_status_mock; // sshfs stays up in between rounds
+    mpt::TempDir temp_dir;
+    std::string source{temp_dir.path().toStdString()};
+    std::queue<sftp_client_message> messages;
+    std::vector<std::unique_ptr<sftp_client_message_struct>> owned_messages;
+    StringUPtr last_handle{nullptr, ssh_string_free};
+};
+
+std::vector<char> as_char_array(const std::string& s)
+{
+    std::vector<char> out(s.begin(), s.end());
+    out.push_back('\0');
+    return out;
+}
+
+// Reads a file of range(0) MiB through, in the 64 KiB requests that sshfs sends by default
+void sftp_server_handle_read(benchmark::State& state)
+{
+    constexpr auto read_size = 64u * 1024u;
+    const auto file_size = static_cast<std::size_t>(state.range(0)) * 1024u * 1024u;
+
+    SftpServerBench bench;
+    const auto file_name = bench.source + "/test-file";
+    mpt::make_file_with_content(QString::fromStdString(file_name), std::string(file_size, 'x'));
+    auto name = as_char_array(file_name);
+
+    std::atomic<std::size_t> bytes_read{0};
+    REPLACE(sftp_reply_handle, bench.make_handle_reply());
+    REPLACE(sftp_get_client_message, bench.make_msg_handler());
+    REPLACE(sftp_reply_data, [&bytes_read](auto, auto, int len) {
+        bytes_read += len;
+        return SSH_OK;
+    });
+
+    auto sftp = bench.make_sftpserver();
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        bench.reset_messages();
+        auto open_msg = bench.add_msg(SFTP_OPEN);
+        open_msg->filename = name.data();
+        open_msg->flags |= SSH_FXF_READ;
+        for (std::size_t offset = 0; offset < file_size; offset += read_size)
+        {
+            auto read_msg = bench.add_msg(SFTP_READ);
+            read_msg->offset = offset;
+            read_msg->len = read_size;
+        }
+        bench.add_msg(SFTP_CLOSE);
+        state.ResumeTiming();
+
+        sftp.run();
+    }
+
+    state.SetBytesProcessed(bytes_read);
+}
+
+// Lists a directory of range(0) files through, as `ls` in a mount would
+void sftp_server_handle_readdir(benchmark::State& state)
+{
+    const auto num_files = static_cast<int>(state.range(0));
+
+    SftpServerBench bench;
+    for (auto i = 0; i < num_files; ++i)
+        mpt::make_file_with_content(QString::fromStdString(fmt::format("{}/a-file-name-{}", bench.source, i)));
+    auto dir_name = as_char_array(bench.source);
+
+    std::atomic<int64_t> entries{0};
+    REPLACE(sftp_reply_handle, bench.make_handle_reply());
+    REPLACE(sftp_get_client_message, bench.make_msg_handler());
+    REPLACE(sftp_reply_names_add, [&entries](auto...) {
+        ++entries;
+        return SSH_OK;
+    });
+    REPLACE(sftp_reply_names, [](auto...) { return SSH_OK; });
+
+    auto sftp = bench.make_sftpserver();
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        bench.reset_messages();
+        bench.add_msg(SFTP_OPENDIR)->filename = dir_name.data();
+        for (auto i = 0; i < num_files / 50 + 2; ++i) // a reply takes some 60 names, the last ones find the end
+            bench.add_msg(SFTP_READDIR);
+        bench.add_msg(SFTP_CLOSE);
+        state.ResumeTiming();
+
+        sftp.run();
+    }
+
+    state.SetItemsProcessed(entries);
+}
+} // namespace
+
+BENCHMARK(sftp_server_handle_read)->Arg(1)->Arg(64)->UseRealTime();
+BENCHMARK(sftp_server_handle_readdir)->Arg(100)->Arg(5000)->UseRealTime();
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "file_operations.h"
+
+#include <multipass/simple_streams_manifest.h>
+
+#include <benchmark/benchmark.h>
+
+#include <QJsonDocument>
+#include <QJsonObject>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+namespace
+{
+// Grows the test manifest to the given number of products, so that parsing is measured at the size of the real ones
+QByteArray manifest_with(int num_products)
+{
+    auto manifest = QJsonDocument::fromJson(mpt::load_test_file("good_manifest.json")).object();
+    const auto originals = manifest["products"].toObject();
+
+    QJsonObject products;
+    for (auto i = 0; products.size() < num_products; ++i)
+    {
+        for (auto it = originals.begin(); it != originals.end() && products.size() < num_products; ++it)
+        {
+            const auto suffix = QString("-%1").arg(i);
+            auto product = it.value().toObject();
+            product["aliases"] = product["aliases"].toString().replace(",", suffix + ",") + suffix;
+            products.insert(it.key() + suffix, product);
+        }
+    }
+
+    manifest["products"] = products;
+    return QJsonDocument{manifest}.toJson(QJsonDocument::Compact);
+}
+
+void simple_streams_manifest_from_json(benchmark::State& state)
+{
+    const auto json = manifest_with(static_cast<int>(state.range(0)));
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(mp::SimpleStreamsManifest::fromJson(json, "http://stream/url"));
+
+    state.SetBytesProcessed(state.iterations() * json.size());
+}
+} // namespace
+
+// The released cloud images manifest has a few dozen products, the daily one a few hundred
+BENCHMARK(simple_streams_manifest_from_json)->Arg(2)->Arg(50)->Arg(500);
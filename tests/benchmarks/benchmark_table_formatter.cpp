@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/cli/table_formatter.h>
+#include <multipass/format.h>
+#include <multipass/rpc/multipass.grpc.pb.h>
+
+#include <benchmark/benchmark.h>
+
+namespace mp = multipass;
+
+namespace
+{
+// Names that do not come sorted, so that the formatter sorts them as it would for a real fleet
+std::string name_for(int i)
+{
+    return fmt::format("instance-{}", (i * 7919) % 100003);
+}
+
+mp::ListReply list_reply_with(int num_instances)
+{
+    mp::ListReply list_reply;
+    for (auto i = 0; i < num_instances; ++i)
+    {
+        auto list_entry = list_reply.add_instances();
+        list_entry->set_name(name_for(i));
+        list_entry->mutable_instance_status()->set_status(i % 3 ? mp::InstanceStatus::RUNNING
+                                                                 : mp::InstanceStatus::STOPPED);
+        list_entry->set_current_release("20.04 LTS");
+        list_entry->add_ipv4(fmt::format("10.{}.{}.{}", i / 65536 % 256, i / 256 % 256, i % 256));
+    }
+
+    return list_reply;
+}
+
+mp::InfoReply info_reply_with(int num_instances)
+{
+    mp::InfoReply info_reply;
+    for (auto i = 0; i < num_instances; ++i)
+    {
+        auto info_entry = info_reply.add_info();
+        info_entry->set_name(name_for(i));
+        info_entry->mutable_instance_status()->set_status(mp::InstanceStatus::RUNNING);
+        info_entry->set_image_release("20.04 LTS");
+        info_entry->set_id("1797c5c82016c1e65f4008fcf89deae3a044ef76087a9ec5b907c6d64a3609ac");
+
+        auto mount_info = info_entry->mutable_mount_info();
+        mount_info->set_longest_path_len(19);
+        auto mount_entry = mount_info->add_mount_paths();
+        mount_entry->set_source_path("/home/user/source");
+        mount_entry->set_target_path("source");
+        (*mount_entry->mutable_mount_maps()->mutable_uid_map())[1000] = 1000;
+        (*mount_entry->mutable_mount_maps()->mutable_gid_map())[1000] = 1000;
+
+        info_entry->set_load("0.45 0.51 0.15");
+        info_entry->set_memory_usage("60817408");
+        info_entry->set_memory_total("1503238554");
+        info_entry->set_disk_usage("1288490188");
+        info_entry->set_disk_total("5153960756");
+        info_entry->set_current_release("Ubuntu 20.04.2 LTS");
+        info_entry->add_ipv4(fmt::format("10.{}.{}.{}", i / 65536 % 256, i / 256 % 256, i % 256));
+    }
+
+    return info_reply;
+}
+
+void table_formatter_list(benchmark::State& state)
+{
+    const auto reply = list_reply_with(static_cast<int>(state.range(0)));
+    const mp::TableFormatter formatter;
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(formatter.format(reply));
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void table_formatter_info(benchmark::State& state)
+{
+    const auto reply = info_reply_with(static_cast<int>(state.range(0)));
+    const mp::TableFormatter formatter;
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(formatter.format(reply));
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+} // namespace
+
+BENCHMARK(table_formatter_list)->Arg(10)->Arg(1000);
+BENCHMARK(table_formatter_info)->Arg(10)->Arg(1000);
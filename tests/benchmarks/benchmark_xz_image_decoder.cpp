@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "temp_dir.h"
+
+#include <multipass/xz_image_decoder.h>
+
+#include <benchmark/benchmark.h>
+
+#include <QDir>
+#include <QFileInfo>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+namespace
+{
+// Decodes the xz image at $MULTIPASS_BENCHMARK_XZ_IMAGE, e.g. a downloaded Ubuntu Core image (the one in test_data is
+// only a placeholder)
+void xz_image_decoder_decode_to(benchmark::State& state)
+{
+    const auto xz_path = qEnvironmentVariable("MULTIPASS_BENCHMARK_XZ_IMAGE");
+    if (xz_path.isEmpty())
+    {
+        state.SkipWithError("MULTIPASS_BENCHMARK_XZ_IMAGE is not set");
+        return;
+    }
+
+    mpt::TempDir temp_dir;
+    const auto decoded_path = QDir{temp_dir.path()}.filePath("decoded.img");
+    const auto monitor = [](auto...) { return true; };
+
+    for (auto _ : state)
+    {
+        mp::XzImageDecoder decoder{xz_path};
+        decoder.decode_to(decoded_path, monitor);
+    }
+
+    state.SetBytesProcessed(state.iterations() * QFileInfo{decoded_path}.size());
+}
+} // namespace
+
+BENCHMARK(xz_image_decoder_decode_to)->Unit(benchmark::kMillisecond);
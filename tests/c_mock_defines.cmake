@@ -31,6 +31,7 @@ add_c_mocks(
   ssh_new
   ssh_connect
   ssh_is_connected
+  ssh_get_fd
   ssh_options_set
   ssh_userauth_publickey
   ssh_channel_is_closed
@@ -41,12 +42,21 @@ add_c_mocks(
   ssh_channel_request_pty
   ssh_channel_change_pty_size
   ssh_channel_read_timeout
+  ssh_channel_read_nonblocking
+  ssh_channel_is_eof
+  ssh_channel_is_open
+  ssh_channel_send_eof
+  ssh_channel_poll_timeout
+  ssh_channel_write
   ssh_channel_get_exit_status
   ssh_event_dopoll
   ssh_add_channel_callbacks
   sftp_server_new
   sftp_free
   sftp_server_init
+  sftp_packet_read
+  sftp_packet_write
+  sftp_packet_free
   sftp_reply_status
   sftp_reply_attr
   sftp_reply_data
@@ -66,6 +76,17 @@ add_c_mocks(
   sftp_open
   sftp_write
   sftp_read
+  sftp_async_read_begin
+  sftp_async_read
+  sftp_stat
+  sftp_mkdir
+  sftp_chmod
+  sftp_setstat
+  sftp_utimes
+  sftp_opendir
+  sftp_readdir
+  sftp_dir_eof
+  sftp_closedir
   sftp_free
   sftp_get_error
   sftp_close
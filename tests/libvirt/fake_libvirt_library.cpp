@@ -23,6 +23,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <chrono>
+#include <thread>
+
 namespace mpt = multipass::test;
 
 /*
@@ -53,6 +56,56 @@ int virConnectGetVersion(virConnectPtr /*conn*/, unsigned long* hvVer)
     return 0;
 }
 
+int virConnectIsAlive(virConnectPtr /*conn*/)
+{
+    return 1;
+}
+
+int virConnectDomainEventRegisterAny(virConnectPtr /*conn*/, virDomainPtr /*dom*/, int /*eventID*/,
+                                     virConnectDomainEventGenericCallback /*cb*/, void* /*opaque*/,
+                                     virFreeCallback /*freecb*/)
+{
+    return 0;
+}
+
+int virConnectDomainEventDeregisterAny(virConnectPtr /*conn*/, int /*callbackID*/)
+{
+    return 0;
+}
+
+int virConnectRegisterCloseCallback(virConnectPtr /*conn*/, virConnectCloseFunc /*cb*/, void* /*opaque*/,
+                                    virFreeCallback /*freecb*/)
+{
+    return 0;
+}
+
+int virConnectUnregisterCloseCallback(virConnectPtr /*conn*/, virConnectCloseFunc /*cb*/)
+{
+    return 0;
+}
+
+int virEventRegisterDefaultImpl()
+{
+    return 0;
+}
+
+int virEventRunDefaultImpl()
+{
+    // Stands in for waiting on events that never come
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return 0;
+}
+
+int virEventAddTimeout(int /*timeout*/, virEventTimeoutCallback /*cb*/, void* /*opaque*/, virFreeCallback /*ff*/)
+{
+    return 1;
+}
+
+int virEventRemoveTimeout(int /*timer*/)
+{
+    return 0;
+}
+
 int virDomainCreate(virDomainPtr /*domain*/)
 {
     return 0;
@@ -80,6 +133,11 @@ int virDomainGetState(virDomainPtr /*domain*/, int* state, int* /*reason*/, unsi
     return 0;
 }
 
+const char* virDomainGetName(virDomainPtr /*domain*/)
+{
+    return "pied-piper-valley";
+}
+
 char* virDomainGetXMLDesc(virDomainPtr /*domain*/, unsigned int /*flags*/)
 {
     return strdup("mac");
@@ -95,6 +153,24 @@ virDomainPtr virDomainLookupByName(virConnectPtr /*conn*/, const char* /*name*/)
     return mpt::fake_handle<virDomainPtr>();
 }
 
+int virDomainMemoryStats(virDomainPtr /*domain*/, virDomainMemoryStatPtr /*stats*/, unsigned int /*nr_stats*/,
+                         unsigned int /*flags*/)
+{
+    return 0;
+}
+
+int virDomainSetBlockIoTune(virDomainPtr /*domain*/, const char* /*disk*/, virTypedParameterPtr /*params*/,
+                            int /*nparams*/, unsigned int /*flags*/)
+{
+    return 0;
+}
+
+int virDomainSetInterfaceParameters(virDomainPtr /*domain*/, const char* /*device*/, virTypedParameterPtr /*params*/,
+                                    int /*nparams*/, unsigned int /*flags*/)
+{
+    return 0;
+}
+
 int virDomainManagedSave(virDomainPtr /*domain*/, unsigned int /*flags*/)
 {
     return 0;
@@ -156,6 +232,36 @@ virNetworkPtr virNetworkLookupByName(virConnectPtr /*conn*/, const char* /*name*
     return mpt::fake_handle<virNetworkPtr>();
 }
 
+virStoragePoolPtr virStoragePoolLookupByName(virConnectPtr /*conn*/, const char* /*name*/)
+{
+    return nullptr;
+}
+
+virStoragePoolPtr virStoragePoolCreateXML(virConnectPtr /*conn*/, const char* /*xmlDesc*/, unsigned int /*flags*/)
+{
+    return mpt::fake_handle<virStoragePoolPtr>();
+}
+
+int virStoragePoolDestroy(virStoragePoolPtr /*pool*/)
+{
+    return 0;
+}
+
+int virStoragePoolFree(virStoragePoolPtr /*pool*/)
+{
+    return 0;
+}
+
+virStorageVolPtr virStorageVolCreateXML(virStoragePoolPtr /*pool*/, const char* /*xmlDesc*/, unsigned int /*flags*/)
+{
+    return mpt::fake_handle<virStorageVolPtr>();
+}
+
+int virStorageVolFree(virStorageVolPtr /*vol*/)
+{
+    return 0;
+}
+
 const char* virGetLastErrorMessage()
 {
     static char fake_error[64] = "";
@@ -19,6 +19,9 @@
 
 #include "tests/extra_assertions.h"
 #include "tests/fake_handle.h"
+#include "tests/file_operations.h"
+#include "tests/mock_process_factory.h"
+#include "tests/mock_settings.h"
 #include "tests/mock_ssh.h"
 #include "tests/mock_status_monitor.h"
 #include "tests/stub_ssh_key_provider.h"
@@ -27,13 +30,20 @@
 #include "tests/temp_file.h"
 
 #include <multipass/auto_join_thread.h>
+#include <multipass/constants.h>
 #include <multipass/exceptions/start_exception.h>
 #include <multipass/memory_size.h>
 #include <multipass/platform.h>
 #include <multipass/virtual_machine.h>
 #include <multipass/virtual_machine_description.h>
 
+#include <QCoreApplication>
+
+#include <atomic>
 #include <cstdlib>
+#include <thread>
+
+#include <sys/stat.h>
 
 #include <gmock/gmock.h>
 
@@ -58,12 +68,33 @@ struct LibVirtBackend : public Test
                                                       {},
                                                       {},
                                                       {},
+                                                      {},
                                                       {}};
     mpt::TempDir data_dir;
     // This indicates that LibvirtWrapper should open the test executable
     std::string fake_libvirt_path{""};
+
+    // Stand in for libvirt's event loop, calling back as events come
+    static int register_lifecycle_callback(virConnectPtr, virDomainPtr, int, virConnectDomainEventGenericCallback cb,
+                                           void* opaque, virFreeCallback)
+    {
+        lifecycle_callback = reinterpret_cast<virConnectDomainEventCallback>(cb);
+        lifecycle_opaque = opaque;
+        return 1;
+    }
+
+    static void send_lifecycle_event(int event, int detail)
+    {
+        lifecycle_callback(nullptr, mpt::fake_handle<virDomainPtr>(), event, detail, lifecycle_opaque);
+    }
+
+    static virConnectDomainEventCallback lifecycle_callback;
+    static void* lifecycle_opaque;
 };
 
+virConnectDomainEventCallback LibVirtBackend::lifecycle_callback{nullptr};
+void* LibVirtBackend::lifecycle_opaque{nullptr};
+
 TEST_F(LibVirtBackend, libvirt_wrapper_missing_libvirt_throws)
 {
     EXPECT_THROW(mp::LibvirtWrapper{"missing_libvirt"}, mp::LibvirtOpenException);
@@ -104,6 +135,34 @@ TEST_F(LibVirtBackend, creates_in_suspended_state_with_managed_save)
     EXPECT_THAT(machine->current_state(), Eq(mp::VirtualMachine::State::suspended));
 }
 
+TEST_F(LibVirtBackend, reports_memory_metrics_from_the_balloon)
+{
+    mp::LibVirtVirtualMachineFactory backend{data_dir.path(), fake_libvirt_path};
+    backend.libvirt_wrapper->virDomainMemoryStats = [](auto, virDomainMemoryStatPtr stats, auto, auto) {
+        stats[0] = {VIR_DOMAIN_MEMORY_STAT_AVAILABLE, 4096};
+        stats[1] = {VIR_DOMAIN_MEMORY_STAT_USABLE, 1024};
+        return 2;
+    };
+
+    mpt::StubVMStatusMonitor stub_monitor;
+    auto machine = backend.create_virtual_machine(default_description, stub_monitor);
+    const auto metrics = machine->metrics();
+
+    EXPECT_EQ(metrics.memory_used, 3 * 1024 * 1024);
+    EXPECT_EQ(metrics.memory_total, 4 * 1024 * 1024);
+    EXPECT_FALSE(metrics.disk_used);
+}
+
+TEST_F(LibVirtBackend, reports_no_memory_metrics_without_balloon_stats)
+{
+    mp::LibVirtVirtualMachineFactory backend{data_dir.path(), fake_libvirt_path};
+
+    mpt::StubVMStatusMonitor stub_monitor;
+    auto machine = backend.create_virtual_machine(default_description, stub_monitor);
+
+    EXPECT_FALSE(machine->metrics().memory_used);
+}
+
 TEST_F(LibVirtBackend, machine_sends_monitoring_events)
 {
     REPLACE(ssh_connect, [](auto...) { return SSH_OK; });
@@ -278,17 +337,150 @@ TEST_F(LibVirtBackend, current_state_delayed_shutdown_domain_off)
 TEST_F(LibVirtBackend, current_state_off_domain_starts_running)
 {
     mp::LibVirtVirtualMachineFactory backend{data_dir.path(), fake_libvirt_path};
+    backend.libvirt_wrapper->virConnectDomainEventRegisterAny = register_lifecycle_callback;
+
     NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
     auto machine = backend.create_virtual_machine(default_description, mock_monitor);
 
     EXPECT_THAT(machine->current_state(), Eq(mp::VirtualMachine::State::off));
 
+    send_lifecycle_event(VIR_DOMAIN_EVENT_STARTED, VIR_DOMAIN_EVENT_STARTED_BOOTED);
+
+    EXPECT_THAT(machine->current_state(), Eq(mp::VirtualMachine::State::running));
+}
+
+TEST_F(LibVirtBackend, current_state_does_not_ask_libvirt_again)
+{
+    static auto get_state_calls{0};
+    get_state_calls = 0;
+
+    mp::LibVirtVirtualMachineFactory backend{data_dir.path(), fake_libvirt_path};
     backend.libvirt_wrapper->virDomainGetState = [](auto, auto state, auto, auto) {
-        *state = VIR_DOMAIN_RUNNING;
+        ++get_state_calls;
+        *state = VIR_DOMAIN_SHUTOFF;
         return 0;
     };
 
-    EXPECT_THAT(machine->current_state(), Eq(mp::VirtualMachine::State::running));
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    auto machine = backend.create_virtual_machine(default_description, mock_monitor);
+    const auto calls_on_creation = get_state_calls;
+
+    EXPECT_THAT(machine->current_state(), Eq(mp::VirtualMachine::State::off));
+    EXPECT_THAT(machine->current_state(), Eq(mp::VirtualMachine::State::off));
+    EXPECT_EQ(get_state_calls, calls_on_creation);
+}
+
+TEST_F(LibVirtBackend, asks_libvirt_for_state_when_not_listening_for_events)
+{
+    static auto get_state_calls{0};
+    get_state_calls = 0;
+
+    mp::LibVirtVirtualMachineFactory backend{data_dir.path(), fake_libvirt_path};
+    backend.libvirt_wrapper->virConnectDomainEventRegisterAny = [](auto...) { return -1; };
+    backend.libvirt_wrapper->virDomainGetState = [](auto, auto state, auto, auto) {
+        ++get_state_calls;
+        *state = VIR_DOMAIN_SHUTOFF;
+        return 0;
+    };
+
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    auto machine = backend.create_virtual_machine(default_description, mock_monitor);
+    const auto calls_on_creation = get_state_calls;
+
+    machine->current_state();
+
+    EXPECT_EQ(get_state_calls, calls_on_creation + 1);
+}
+
+TEST_F(LibVirtBackend, reopens_the_connection_libvirt_closed)
+{
+    static auto opens{0};
+    static auto get_state_calls{0};
+    static auto alive{1};
+    static virConnectCloseFunc close_callback{nullptr};
+    static void* close_opaque{nullptr};
+    opens = get_state_calls = 0;
+    alive = 1;
+
+    mp::LibVirtVirtualMachineFactory backend{data_dir.path(), fake_libvirt_path};
+    backend.libvirt_wrapper->virConnectDomainEventRegisterAny = register_lifecycle_callback;
+    backend.libvirt_wrapper->virConnectOpen = [](auto...) {
+        ++opens;
+        alive = 1;
+        return mpt::fake_handle<virConnectPtr>();
+    };
+    backend.libvirt_wrapper->virConnectIsAlive = [](auto...) { return alive; };
+    backend.libvirt_wrapper->virConnectRegisterCloseCallback = [](auto, virConnectCloseFunc cb, void* opaque, auto) {
+        close_callback = cb;
+        close_opaque = opaque;
+        return 0;
+    };
+    backend.libvirt_wrapper->virDomainGetState = [](auto, auto state, auto, auto) {
+        ++get_state_calls;
+        *state = VIR_DOMAIN_SHUTOFF;
+        return 0;
+    };
+
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    auto machine = backend.create_virtual_machine(default_description, mock_monitor);
+    EXPECT_THAT(machine->current_state(), Eq(mp::VirtualMachine::State::off));
+
+    const auto opens_before = opens;
+    const auto calls_before = get_state_calls;
+    ASSERT_NE(close_callback, nullptr);
+
+    // Without it, the states heard before libvirtd went away would be taken for current
+    alive = 0;
+    close_callback(nullptr, VIR_CONNECT_CLOSE_REASON_EOF, close_opaque);
+
+    EXPECT_THAT(machine->current_state(), Eq(mp::VirtualMachine::State::off));
+    EXPECT_EQ(opens, opens_before + 1);
+    EXPECT_EQ(get_state_calls, calls_before + 1);
+}
+
+TEST_F(LibVirtBackend, listens_again_once_the_event_loop_failed)
+{
+    static std::atomic_int registrations{0}, loop_runs{0};
+    registrations = loop_runs = 0;
+
+    mp::LibVirtVirtualMachineFactory backend{data_dir.path(), fake_libvirt_path};
+    backend.libvirt_wrapper->virConnectDomainEventRegisterAny = [](auto...) { return ++registrations; };
+    backend.libvirt_wrapper->virEventRunDefaultImpl = [] {
+        std::this_thread::sleep_for(10ms);
+        return ++loop_runs == 1 ? -1 : 0;
+    };
+
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    auto machine = backend.create_virtual_machine(default_description, mock_monitor);
+    machine->current_state();
+    ASSERT_EQ(registrations, 1);
+
+    const auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (loop_runs < 1 && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(10ms);
+    std::this_thread::sleep_for(50ms); // for the failure to be taken in
+
+    machine->current_state();
+
+    EXPECT_EQ(registrations, 2);
+}
+
+TEST_F(LibVirtBackend, machine_turns_off_when_domain_crashes)
+{
+    mp::LibVirtVirtualMachineFactory backend{data_dir.path(), fake_libvirt_path};
+    backend.libvirt_wrapper->virConnectDomainEventRegisterAny = register_lifecycle_callback;
+
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    auto machine = backend.create_virtual_machine(default_description, mock_monitor);
+    machine->state = mp::VirtualMachine::State::running;
+
+    EXPECT_CALL(mock_monitor, persist_state_for(_, Eq(mp::VirtualMachine::State::off)));
+    EXPECT_CALL(mock_monitor, on_shutdown());
+
+    send_lifecycle_event(VIR_DOMAIN_EVENT_STOPPED, VIR_DOMAIN_EVENT_STOPPED_CRASHED);
+    QCoreApplication::processEvents();
+
+    EXPECT_EQ(machine->state, mp::VirtualMachine::State::off);
 }
 
 TEST_F(LibVirtBackend, returns_version_string)
@@ -436,6 +628,184 @@ TEST_F(LibVirtBackend, shutdown_while_starting_throws_and_sets_correct_state)
     EXPECT_EQ(machine->current_state(), mp::VirtualMachine::State::off);
 }
 
+TEST_F(LibVirtBackend, keeps_the_definition_when_it_shares_the_native_mounts_already)
+{
+    static int undefined;
+    undefined = 0;
+    mp::LibVirtVirtualMachineFactory backend{data_dir.path(), fake_libvirt_path};
+    backend.libvirt_wrapper->virDomainGetXMLDesc = [](auto...) {
+        return strdup("<domain><devices>"
+                      "<filesystem type='mount' accessmode='passthrough'><driver type='virtiofs'/>"
+                      "<source dir='/home/user/src'/><target dir='mp0123456789ab'/>"
+                      "<idmap><uid start='1000' target='501' count='1'/><gid start='1000' target='20' count='1'/>"
+                      "</idmap></filesystem>"
+                      "<serial type='pty'><source path='/dev/pts/2'/><target port='0'/></serial>"
+                      "</devices></domain>");
+    };
+    backend.libvirt_wrapper->virDomainUndefine = [](auto) {
+        ++undefined;
+        return 0;
+    };
+
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    auto machine = backend.create_virtual_machine(default_description, mock_monitor);
+    machine->set_native_mounts({{"/home/user/src", "mp0123456789ab", {{501, 1000}}, {{20, 1000}}}});
+    machine->start();
+
+    EXPECT_EQ(undefined, 0);
+}
+
+TEST_F(LibVirtBackend, redefines_the_domain_when_its_native_mounts_change)
+{
+    static int undefined;
+    undefined = 0;
+    mp::LibVirtVirtualMachineFactory backend{data_dir.path(), fake_libvirt_path};
+    backend.libvirt_wrapper->virDomainGetXMLDesc = [](auto...) {
+        return strdup("<domain><devices>"
+                      "<filesystem type='mount' accessmode='passthrough'><driver type='virtiofs'/>"
+                      "<source dir='/home/user/src'/><target dir='mp0123456789ab'/></filesystem>"
+                      "</devices></domain>");
+    };
+    backend.libvirt_wrapper->virDomainUndefine = [](auto) {
+        ++undefined;
+        return 0;
+    };
+
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    auto machine = backend.create_virtual_machine(default_description, mock_monitor);
+    machine->set_native_mounts({{"/home/user/src", "mp0123456789ab", {{501, 1000}}, {}}}); // now with an id map
+    machine->start();
+
+    EXPECT_EQ(undefined, 1);
+}
+
+TEST_F(LibVirtBackend, overlays_share_one_copy_of_the_image)
+{
+    auto& mock_settings = mpt::MockSettings::mock_instance();
+    EXPECT_CALL(mock_settings, get(_)).Times(AnyNumber());
+    EXPECT_CALL(mock_settings, get(Eq(mp::disk_overlays_key))).WillRepeatedly(Return("true"));
+
+    static std::string volume_xml;
+    mp::LibVirtVirtualMachineFactory backend{data_dir.path(), fake_libvirt_path};
+    backend.libvirt_wrapper->virStorageVolCreateXML = [](auto, const char* xml, auto) {
+        volume_xml = xml;
+        return mpt::fake_handle<virStorageVolPtr>();
+    };
+
+    mpt::TempDir instances_dir;
+    auto make_instance = [&](const char* name) {
+        QDir{instances_dir.path()}.mkpath(name);
+        mp::VMImage image;
+        image.image_path = QDir{instances_dir.path()}.filePath(QString{name} + "/image.img");
+        image.id = "deadbeef";
+        mpt::make_file_with_content(image.image_path, "the image");
+
+        auto desc = default_description;
+        desc.vm_name = name;
+        desc.disk_space = mp::MemorySize{"5G"};
+        backend.prepare_instance_image(image, desc);
+
+        return image.image_path;
+    };
+
+    make_instance("first");
+    const auto second_image = make_instance("second");
+
+    const auto shared_image = QDir{data_dir.path()}.filePath("backing-images/deadbeef");
+    struct stat st;
+    ASSERT_EQ(stat(QFile::encodeName(shared_image).constData(), &st), 0);
+    EXPECT_EQ(st.st_nlink, 3u);
+
+    EXPECT_EQ(mpt::load(second_image + ".backing"), "the image");
+    EXPECT_THAT(volume_xml, HasSubstr("<name>image.img</name>"));
+    EXPECT_THAT(volume_xml, HasSubstr("<path>" + (second_image + ".backing").toStdString() + "</path>"));
+    EXPECT_THAT(volume_xml, HasSubstr("<capacity unit='bytes'>5368709120</capacity>"));
+}
+
+TEST_F(LibVirtBackend, instance_keeps_a_copy_of_its_own_without_an_overlay)
+{
+    auto& mock_settings = mpt::MockSettings::mock_instance();
+    EXPECT_CALL(mock_settings, get(_)).Times(AnyNumber());
+    EXPECT_CALL(mock_settings, get(Eq(mp::disk_overlays_key))).WillRepeatedly(Return("true"));
+
+    auto factory = mpt::MockProcessFactory::Inject(); // for the resize the copy goes through
+    mp::LibVirtVirtualMachineFactory backend{data_dir.path(), fake_libvirt_path};
+    backend.libvirt_wrapper->virStorageVolCreateXML = [](auto...) -> virStorageVolPtr { return nullptr; };
+
+    mpt::TempDir instance_dir;
+    mp::VMImage image;
+    image.image_path = QDir{instance_dir.path()}.filePath("image.img");
+    image.id = "deadbeef";
+    mpt::make_file_with_content(image.image_path, "the image");
+
+    auto desc = default_description;
+    desc.disk_space = mp::MemorySize{"5G"};
+    backend.prepare_instance_image(image, desc);
+
+    EXPECT_EQ(mpt::load(image.image_path), "the image");
+    EXPECT_FALSE(QFile::exists(image.image_path + ".backing"));
+    EXPECT_FALSE(QFile::exists(image.image_path + ".full"));
+    EXPECT_FALSE(QFile::exists(QDir{data_dir.path()}.filePath("backing-images/deadbeef")));
+
+    struct stat st;
+    ASSERT_EQ(stat(QFile::encodeName(image.image_path).constData(), &st), 0);
+    EXPECT_EQ(st.st_nlink, 1u);
+}
+
+TEST_F(LibVirtBackend, failed_overlay_leaves_no_link_to_the_shared_copy)
+{
+    auto& mock_settings = mpt::MockSettings::mock_instance();
+    EXPECT_CALL(mock_settings, get(_)).Times(AnyNumber());
+    EXPECT_CALL(mock_settings, get(Eq(mp::disk_overlays_key))).WillRepeatedly(Return("true"));
+
+    static auto pools_created{0};
+    pools_created = 0;
+    auto factory = mpt::MockProcessFactory::Inject();
+    mp::LibVirtVirtualMachineFactory backend{data_dir.path(), fake_libvirt_path};
+    backend.libvirt_wrapper->virStorageVolCreateXML = [](auto...) { return mpt::fake_handle<virStorageVolPtr>(); };
+    backend.libvirt_wrapper->virStoragePoolLookupByName = [](auto...) -> virStoragePoolPtr { return nullptr; };
+    backend.libvirt_wrapper->virStoragePoolCreateXML = [](auto...) -> virStoragePoolPtr {
+        return ++pools_created == 1 ? mpt::fake_handle<virStoragePoolPtr>() : nullptr;
+    };
+
+    mpt::TempDir instances_dir;
+    auto make_instance = [&](const char* name) {
+        QDir{instances_dir.path()}.mkpath(name);
+        mp::VMImage image;
+        image.image_path = QDir{instances_dir.path()}.filePath(QString{name} + "/image.img");
+        image.id = "deadbeef";
+        mpt::make_file_with_content(image.image_path, "the image");
+
+        auto desc = default_description;
+        desc.vm_name = name;
+        backend.prepare_instance_image(image, desc);
+
+        return image.image_path;
+    };
+
+    make_instance("first");
+    const auto second_image = make_instance("second");
+
+    EXPECT_EQ(mpt::load(second_image), "the image");
+    EXPECT_FALSE(QFile::exists(second_image + ".backing"));
+
+    // Only the first instance's own link is left
+    struct stat st;
+    ASSERT_EQ(stat(QFile::encodeName(QDir{data_dir.path()}.filePath("backing-images/deadbeef")).constData(), &st), 0);
+    EXPECT_EQ(st.st_nlink, 2u);
+}
+
+TEST_F(LibVirtBackend, removes_backing_images_no_instance_uses)
+{
+    QDir{data_dir.path()}.mkpath("backing-images");
+    const auto unused_image = QDir{data_dir.path()}.filePath("backing-images/deadbeef");
+    mpt::make_file_with_content(unused_image, "the image");
+
+    mp::LibVirtVirtualMachineFactory backend{data_dir.path(), fake_libvirt_path};
+
+    EXPECT_FALSE(QFile::exists(unused_image));
+}
+
 TEST_F(LibVirtBackend, lists_no_networks)
 {
     mp::LibVirtVirtualMachineFactory backend(data_dir.path(), fake_libvirt_path);
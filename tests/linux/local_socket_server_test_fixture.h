@@ -23,6 +23,8 @@
 #include <QLocalSocket>
 #include <QString>
 
+#include <memory>
+
 namespace multipass
 {
 namespace test
@@ -55,7 +57,64 @@ public:
         });
     }
 
+    // Answers each request as it comes, leaving connections open
+    template <typename Handler>
+    void keep_alive_server_handler(Handler&& response_handler)
+    {
+        QObject::connect(&test_server, &QLocalServer::newConnection, [&] {
+            auto client_connection = test_server.nextPendingConnection();
+            ++connections;
+
+            QObject::connect(client_connection, &QLocalSocket::readyRead, [&response_handler, client_connection] {
+                client_connection->write(response_handler(client_connection->readAll()));
+                client_connection->flush();
+            });
+        });
+    }
+
+    // Answers once the whole request, body and all, is in. The server shares the client's event loop, so a body
+    // larger than the socket can hold only gets through when the client does not block writing it
+    template <typename Handler>
+    void whole_request_server_handler(Handler&& response_handler)
+    {
+        QObject::connect(&test_server, &QLocalServer::newConnection, [&] {
+            auto client_connection = test_server.nextPendingConnection();
+            auto request = std::make_shared<QByteArray>();
+
+            QObject::connect(client_connection, &QLocalSocket::readyRead,
+                             [&response_handler, client_connection, request] {
+                                 *request += client_connection->readAll();
+                                 if (!is_complete(*request))
+                                     return;
+
+                                 client_connection->write(response_handler(*request));
+                                 client_connection->flush();
+                                 request->clear();
+                             });
+        });
+    }
+
+    int connections{0};
+
 private:
+    static bool is_complete(const QByteArray& request)
+    {
+        const auto header_end = request.indexOf("\r\n\r\n");
+        if (header_end < 0)
+            return false;
+
+        const auto headers = request.left(header_end + 2).toLower();
+        const auto length_at = headers.indexOf("content-length:");
+        if (length_at >= 0)
+        {
+            const auto value_at = length_at + qstrlen("content-length:");
+            const auto length = headers.mid(value_at, headers.indexOf("\r\n", value_at) - value_at).trimmed();
+            return request.size() - (header_end + 4) >= length.toLongLong();
+        }
+
+        return !headers.contains("transfer-encoding: chunked") || request.endsWith("\r\n0\r\n\r\n");
+    }
+
     QLocalServer test_server;
 };
 } // namespace test
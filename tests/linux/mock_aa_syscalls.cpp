@@ -18,3 +18,4 @@
 #include "mock_aa_syscalls.h"
 
 extern "C" IMPL_MOCK_DEFAULT(0, aa_is_enabled);
+extern "C" IMPL_MOCK_DEFAULT(1, aa_find_mountpoint);
@@ -23,5 +23,6 @@
 #include <sys/apparmor.h>
 
 DECL_MOCK(aa_is_enabled);
+DECL_MOCK(aa_find_mountpoint);
 
 #endif // MULTIPASS_MOCK_AA_SYSCALLS_H
@@ -30,6 +30,8 @@
 
 #include <QFile>
 
+#include <cstring>
+
 namespace mp = multipass;
 namespace mpl = multipass::logging;
 namespace mpt = multipass::test;
@@ -39,9 +41,16 @@ using namespace testing;
 namespace
 {
 const auto apparmor_output_file = "/tmp/multipass-apparmor-profile.txt";
+const auto apparmor_profile_template = "profile test_apparmor_profile() { %1 }";
 const auto apparmor_profile_text = "profile test_apparmor_profile() { stuff }";
 class TestProcessSpec : public mp::ProcessSpec
 {
+public:
+    explicit TestProcessSpec(const QString& profile_body = "stuff", const QString& identifier = QString())
+        : profile_body{profile_body}, id{identifier}
+    {
+    }
+
     QString program() const override
     {
         return "test_prog";
@@ -52,8 +61,16 @@ class TestProcessSpec : public mp::ProcessSpec
     }
     QString apparmor_profile() const override
     {
-        return apparmor_profile_text;
+        return QString{apparmor_profile_template}.arg(profile_body);
     }
+    QString identifier() const override
+    {
+        return id;
+    }
+
+private:
+    const QString profile_body;
+    const QString id;
 };
 } // namespace
 
@@ -126,11 +143,45 @@ TEST_F(ApparmoredProcessNoFactoryTest, no_output_file_when_no_apparmor)
     EXPECT_FALSE(QFile::exists(apparmor_output_file));
 }
 
-TEST_F(ApparmoredProcessTest, unloads_profile_with_apparmor_on_process_out_of_scope)
+TEST_F(ApparmoredProcessTest, keeps_profile_loaded_when_process_goes_out_of_scope)
 {
     auto process = process_factory.create_process(std::make_unique<TestProcessSpec>());
     process.reset();
 
+    QFile apparmor_input(apparmor_output_file);
+    ASSERT_TRUE(apparmor_input.open(QIODevice::ReadOnly | QIODevice::Text));
+    auto input = apparmor_input.readAll();
+
+    EXPECT_FALSE(input.contains("-R,"));
+}
+
+TEST_F(ApparmoredProcessTest, loads_the_same_profile_only_once)
+{
+    auto process = process_factory.create_process(std::make_unique<TestProcessSpec>());
+    ASSERT_TRUE(QFile::remove(apparmor_output_file));
+
+    auto other_process = process_factory.create_process(std::make_unique<TestProcessSpec>());
+
+    EXPECT_FALSE(QFile::exists(apparmor_output_file));
+}
+
+TEST_F(ApparmoredProcessTest, reloads_profile_when_its_text_changes)
+{
+    auto process = process_factory.create_process(std::make_unique<TestProcessSpec>());
+    ASSERT_TRUE(QFile::remove(apparmor_output_file));
+
+    auto other_process = process_factory.create_process(std::make_unique<TestProcessSpec>("other stuff"));
+
+    QFile apparmor_input(apparmor_output_file);
+    ASSERT_TRUE(apparmor_input.open(QIODevice::ReadOnly | QIODevice::Text));
+    EXPECT_TRUE(apparmor_input.readAll().contains("other stuff"));
+}
+
+TEST_F(ApparmoredProcessNoFactoryTest, unloads_profiles_with_apparmor_when_factory_goes_away)
+{
+    MP_PROCFACTORY.create_process(std::make_unique<TestProcessSpec>());
+    mp::ProcessFactory::reset();
+
     // apparmor profile should have been removed
     QFile apparmor_input(apparmor_output_file);
     ASSERT_TRUE(apparmor_input.open(QIODevice::ReadOnly | QIODevice::Text));
@@ -140,6 +191,61 @@ TEST_F(ApparmoredProcessTest, unloads_profile_with_apparmor_on_process_out_of_sc
     EXPECT_TRUE(input.contains(apparmor_profile_text));
 }
 
+TEST_F(ApparmoredProcessTest, unloads_the_profiles_of_an_instance_that_is_gone)
+{
+    process_factory.create_process(std::make_unique<TestProcessSpec>("gone stuff", "gone"));
+    process_factory.create_process(std::make_unique<TestProcessSpec>("mount stuff", "gone.mount"));
+    process_factory.create_process(std::make_unique<TestProcessSpec>("kept stuff", "kept"));
+    ASSERT_TRUE(QFile::remove(apparmor_output_file));
+
+    // Each removal overwrites the file, so they are told apart by loading again afterwards
+    process_factory.unload_policies_for("gone");
+    QFile apparmor_input(apparmor_output_file);
+    ASSERT_TRUE(apparmor_input.open(QIODevice::ReadOnly | QIODevice::Text));
+    const auto input = apparmor_input.readAll();
+    apparmor_input.close();
+
+    EXPECT_TRUE(input.contains("args: -W, -R,"));
+    EXPECT_FALSE(input.contains("kept stuff"));
+
+    ASSERT_TRUE(QFile::remove(apparmor_output_file));
+    process_factory.create_process(std::make_unique<TestProcessSpec>("gone stuff", "gone"));
+    EXPECT_TRUE(QFile::exists(apparmor_output_file)); // loaded anew
+
+    ASSERT_TRUE(QFile::remove(apparmor_output_file));
+    process_factory.create_process(std::make_unique<TestProcessSpec>("mount stuff", "gone.mount"));
+    EXPECT_TRUE(QFile::exists(apparmor_output_file));
+
+    ASSERT_TRUE(QFile::remove(apparmor_output_file));
+    process_factory.create_process(std::make_unique<TestProcessSpec>("kept stuff", "kept"));
+    EXPECT_FALSE(QFile::exists(apparmor_output_file)); // still loaded
+}
+
+TEST_F(ApparmoredProcessTest, unloads_the_profiles_earlier_daemons_loaded_for_an_instance_that_is_gone)
+{
+    mpt::TempDir securityfs;
+    QFile profiles{securityfs.path() + "/profiles"};
+    ASSERT_TRUE(profiles.open(QIODevice::WriteOnly));
+    profiles.write("multipass.gone.qemu-system-x86_64 (enforce)\nmultipass.kept.qemu-system-x86_64 (enforce)\n");
+    profiles.close();
+
+    const auto mountpoint = securityfs.path().toLocal8Bit();
+    REPLACE(aa_find_mountpoint, [&mountpoint](char** mnt) {
+        *mnt = strdup(mountpoint.constData());
+        return 0;
+    });
+
+    process_factory.unload_policies_for("gone");
+
+    QFile apparmor_input(apparmor_output_file);
+    ASSERT_TRUE(apparmor_input.open(QIODevice::ReadOnly | QIODevice::Text));
+    const auto input = apparmor_input.readAll();
+
+    EXPECT_TRUE(input.contains("args: -W, -R,"));
+    EXPECT_TRUE(input.contains("profile \"multipass.gone.qemu-system-x86_64\" {}"));
+    EXPECT_FALSE(input.contains("kept"));
+}
+
 // Copies of tests in LinuxProcessTest
 TEST_F(ApparmoredProcessTest, execute_missing_command)
 {
@@ -312,8 +418,6 @@ TEST_F(ApparmoredProcessNoFactoryTest, logsAllExpectedMessagesOnStart)
     auto process = process_factory.create_process(std::make_unique<TestProcessSpec>());
 
     logger_scope.mock_logger->expect_log(mpl::Level::debug, "Applied AppArmor policy: multipass.test_prog");
-    logger_scope.mock_logger->expect_log(mpl::Level::trace,
-                                         fmt::format("Removing AppArmor policy:\n{}", apparmor_profile_text));
     logger_scope.mock_logger->expect_log(
         mpl::Level::debug, fmt::format("started: {} {}", process->program(), process->arguments().join(' ')));
 
@@ -25,12 +25,16 @@
 #include <shared/shared_backend_utils.h>
 
 #include "tests/extra_assertions.h"
+#include "tests/file_operations.h"
 #include "tests/mock_logger.h"
 #include "tests/mock_process_factory.h"
 #include "tests/mock_singleton_helpers.h"
+#include "tests/temp_dir.h"
 
+#include <QDir>
 #include <QMap>
 #include <QVariant>
+#include <QtEndian>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -96,14 +100,17 @@ void simulate_qemuimg_convert(const mpt::MockProcess* process, const QString& im
     ASSERT_EQ(process->program().toStdString(), "qemu-img");
 
     const auto args = process->arguments();
-    ASSERT_EQ(args.size(), 6);
+    ASSERT_EQ(args.size(), 9);
 
     EXPECT_EQ(args.at(0), "convert");
     EXPECT_EQ(args.at(1), "-p");
-    EXPECT_EQ(args.at(2), "-O");
-    EXPECT_EQ(args.at(3), "qcow2");
-    EXPECT_EQ(args.at(4), img_path);
-    EXPECT_EQ(args.at(5), expected_img_path);
+    EXPECT_EQ(args.at(2), "-m");
+    EXPECT_THAT(args.at(3).toInt(), AllOf(Ge(1), Le(16)));
+    EXPECT_EQ(args.at(4), "-W");
+    EXPECT_EQ(args.at(5), "-O");
+    EXPECT_EQ(args.at(6), "qcow2");
+    EXPECT_EQ(args.at(7), img_path);
+    EXPECT_EQ(args.at(8), expected_img_path);
 
     EXPECT_CALL(*process, execute).WillOnce(Return(produce_result));
 }
@@ -230,6 +237,88 @@ TEST_P(ImageConversionTestSuite, properly_handles_image_conversion)
 
 INSTANTIATE_TEST_SUITE_P(BackendUtils, ImageConversionTestSuite, ValuesIn(image_conversion_inputs));
 
+TEST(BackendUtils, image_conversion_reports_progress)
+{
+    const auto img_path = "/fake/img/path";
+    auto process_count = 0;
+    auto mock_factory_scope = mpt::MockProcessFactory::Inject();
+
+    mock_factory_scope->register_callback([&](mpt::MockProcess* process) {
+        if (++process_count == 1)
+        {
+            simulate_qemuimg_info_with_json(process, img_path, success, "{\n    \"format\": \"raw\"\n}");
+            return;
+        }
+
+        EXPECT_CALL(*process, read_all_standard_output)
+            .WillOnce(Return("    (0.00/100%)\r    (25.50/100%)\r"))
+            .WillOnce(Return("    (25.50/100%)\r"))
+            .WillOnce(Return("    (100.00/100%)\r"));
+        EXPECT_CALL(*process, execute).WillOnce([process](int) {
+            for (auto i = 0; i < 3; ++i)
+                emit process->ready_read_standard_output();
+            return success;
+        });
+    });
+
+    std::vector<int> percentages;
+    mp::backend::convert_to_qcow_if_necessary(img_path, [&percentages](int, int percentage) {
+        percentages.push_back(percentage);
+        return true;
+    });
+
+    EXPECT_THAT(percentages, ElementsAre(25, 100));
+}
+
+namespace
+{
+// The header of a qcow2 v2 image, which is all there is to inspect
+QString make_qcow2_header(const QDir& dir, quint32 snapshots)
+{
+    std::string header(72, '\0');
+    qToBigEndian<quint32>(0x514649fb, &header[0]);
+    qToBigEndian<quint32>(2, &header[4]);
+    qToBigEndian<quint32>(16, &header[20]);
+    qToBigEndian<quint32>(snapshots, &header[60]);
+
+    const auto image_path = dir.filePath("image.img");
+    mpt::make_file_with_content(image_path, header);
+    return image_path;
+}
+} // namespace
+
+TEST(BackendUtils, compacting_leaves_images_with_snapshots_alone)
+{
+    mpt::TempDir temp_dir;
+    const auto image_path = make_qcow2_header(temp_dir.path(), 1);
+
+    auto process_count = 0;
+    auto mock_factory_scope = mpt::MockProcessFactory::Inject();
+    mock_factory_scope->register_callback([&process_count](mpt::MockProcess*) { ++process_count; });
+
+    EXPECT_EQ(mp::backend::compact_instance_image(image_path), 0);
+    EXPECT_EQ(process_count, 0);
+}
+
+TEST(BackendUtils, compacting_rewrites_the_image_and_throws_when_qemuimg_fails)
+{
+    mpt::TempDir temp_dir;
+    const auto image_path = make_qcow2_header(temp_dir.path(), 0);
+
+    auto process_count = 0;
+    auto mock_factory_scope = mpt::MockProcessFactory::Inject();
+    mock_factory_scope->register_callback([&](mpt::MockProcess* process) {
+        ++process_count;
+        EXPECT_EQ(process->arguments(), QStringList({"convert", "-O", "qcow2", image_path, image_path + ".compact"}));
+        EXPECT_CALL(*process, execute(mp::backend::image_resize_timeout)).WillOnce(Return(failure));
+    });
+
+    MP_EXPECT_THROW_THAT(mp::backend::compact_instance_image(image_path), std::runtime_error,
+                         mpt::match_what(HasSubstr("Cannot compact instance image: qemu-img failed")));
+    EXPECT_EQ(process_count, 1);
+    EXPECT_TRUE(QFile::exists(image_path));
+}
+
 namespace mp_dbus = mp::backend::dbus;
 class MockDBusProvider : public mp_dbus::DBusProvider
 {
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <src/platform/backends/shared/linux/cgroups.h>
+
+#include "tests/file_operations.h"
+#include "tests/temp_dir.h"
+
+#include <QDir>
+#include <QFile>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+using namespace testing;
+
+namespace
+{
+// Stands in for the cgroup filesystem, which has the kernel create the interface files of a group with it
+struct Cgroups : public Test
+{
+    Cgroups()
+    {
+        make_group("/multipass.service", {"cgroup.controllers", "cgroup.procs", "cgroup.subtree_control"});
+        make_group("/multipass.service/daemon", {"cgroup.procs", "cpu.weight", "memory.low", "io.weight"});
+        mpt::make_file_with_content(base + "/cgroup.controllers", "cpuset cpu io memory pids\n");
+        mpt::make_file_with_content(base + "/cgroup.procs", "1234\n");
+        mpt::make_file_with_content(self_cgroup_file, "0::/multipass.service\n");
+    }
+
+    void make_group(const QString& group, const QStringList& files)
+    {
+        QDir().mkpath(root.path() + group);
+        for (const auto& file : files)
+            mpt::make_file_with_content(root.path() + group + '/' + file, "");
+    }
+
+    static void overwrite(const QString& path, const QByteArray& content)
+    {
+        QFile file{path};
+        ASSERT_TRUE(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        file.write(content);
+    }
+
+    mpt::TempDir root;
+    const QString base = root.path() + "/multipass.service";
+    const QString self_cgroup_file = root.path() + "/self_cgroup";
+    const mp::ResourceControls controls{"primary", "qemu", 200, 3, 1024LL * 1024 * 1024, 150};
+};
+} // namespace
+
+TEST_F(Cgroups, throws_without_cgroup_v2)
+{
+    overwrite(self_cgroup_file, "12:cpu,cpuacct:/multipass.service\n");
+
+    EXPECT_THROW(mp::Cgroups(root.path(), self_cgroup_file), mp::CgroupsException);
+}
+
+TEST_F(Cgroups, throws_when_daemon_runs_in_root_group)
+{
+    overwrite(self_cgroup_file, "0::/\n");
+
+    EXPECT_THROW(mp::Cgroups(root.path(), self_cgroup_file), mp::CgroupsException);
+}
+
+TEST_F(Cgroups, moves_daemon_to_weighted_leaf)
+{
+    mp::Cgroups cgroups{root.path(), self_cgroup_file};
+
+    EXPECT_EQ(mpt::load(base + "/daemon/cgroup.procs"), "1234");
+    EXPECT_EQ(mpt::load(base + "/cgroup.subtree_control"), "+cpu +memory +io");
+    EXPECT_EQ(mpt::load(base + "/daemon/cpu.weight"), "1000");
+    EXPECT_EQ(mpt::load(base + "/daemon/io.weight"), "default 1000");
+}
+
+TEST_F(Cgroups, finds_base_again_from_daemon_leaf)
+{
+    overwrite(self_cgroup_file, "0::/multipass.service/daemon\n");
+
+    mp::Cgroups cgroups{root.path(), self_cgroup_file};
+
+    EXPECT_EQ(mpt::load(base + "/cgroup.subtree_control"), "+cpu +memory +io");
+}
+
+TEST_F(Cgroups, only_enables_controllers_host_has)
+{
+    overwrite(base + "/cgroup.controllers", "cpu pids\n");
+
+    mp::Cgroups cgroups{root.path(), self_cgroup_file};
+
+    EXPECT_EQ(mpt::load(base + "/cgroup.subtree_control"), "+cpu");
+}
+
+TEST_F(Cgroups, prepare_applies_limits_to_instance_group)
+{
+    make_group("/multipass.service/primary", {"cpu.weight", "cpu.max", "memory.high", "io.weight"});
+    mp::Cgroups cgroups{root.path(), self_cgroup_file};
+
+    EXPECT_EQ(cgroups.prepare(controls), (base + "/primary/qemu/cgroup.procs").toStdString());
+    EXPECT_EQ(mpt::load(base + "/primary/cpu.weight"), "200");
+    EXPECT_EQ(mpt::load(base + "/primary/cpu.max"), "300000 100000");
+    EXPECT_EQ(mpt::load(base + "/primary/memory.high"), "1073741824");
+    EXPECT_EQ(mpt::load(base + "/primary/io.weight"), "default 150");
+}
+
+TEST_F(Cgroups, prepare_leaves_unset_limits_alone)
+{
+    mp::Cgroups cgroups{root.path(), self_cgroup_file};
+
+    EXPECT_NO_THROW(cgroups.prepare(mp::ResourceControls{"primary", "sshfs"}));
+    EXPECT_TRUE(QDir(base + "/primary/sshfs").exists());
+}
+
+TEST_F(Cgroups, release_removes_empty_group)
+{
+    mp::Cgroups cgroups{root.path(), self_cgroup_file};
+    cgroups.prepare(mp::ResourceControls{"primary", "sshfs"});
+
+    cgroups.release(mp::ResourceControls{"primary", "sshfs"});
+
+    EXPECT_FALSE(QDir(base + "/primary").exists());
+}
+
+TEST_F(Cgroups, release_keeps_group_with_other_leaves)
+{
+    mp::Cgroups cgroups{root.path(), self_cgroup_file};
+    cgroups.prepare(mp::ResourceControls{"primary", "sshfs"});
+    cgroups.prepare(mp::ResourceControls{"primary", "virtiofsd"});
+
+    cgroups.release(mp::ResourceControls{"primary", "sshfs"});
+
+    EXPECT_FALSE(QDir(base + "/primary/sshfs").exists());
+    EXPECT_TRUE(QDir(base + "/primary/virtiofsd").exists());
+}
+
+TEST_F(Cgroups, release_keeps_leaf_until_last_process_prepared_for_it_is_done)
+{
+    mp::Cgroups cgroups{root.path(), self_cgroup_file};
+    const mp::ResourceControls sshfs{"primary", "sshfs"};
+    cgroups.prepare(sshfs);
+    cgroups.prepare(sshfs);
+
+    cgroups.release(sshfs);
+    EXPECT_TRUE(QDir(base + "/primary/sshfs").exists());
+
+    cgroups.release(sshfs);
+    EXPECT_FALSE(QDir(base + "/primary").exists());
+}
+
+TEST_F(Cgroups, prepare_hands_controllers_down_again)
+{
+    mp::Cgroups cgroups{root.path(), self_cgroup_file};
+    overwrite(base + "/cgroup.subtree_control", ""); // as systemd leaves it after a reload
+
+    cgroups.prepare(mp::ResourceControls{"primary", "sshfs"});
+
+    EXPECT_EQ(mpt::load(base + "/cgroup.subtree_control"), "+cpu +memory +io");
+}
+
+TEST_F(Cgroups, join_fails_for_missing_leaf)
+{
+    EXPECT_FALSE(mp::Cgroups::join((base + "/missing/cgroup.procs").toStdString()));
+}
@@ -20,6 +20,7 @@
 #include "mock_q_local_socket.h"
 #include "tests/temp_dir.h"
 
+#include <src/network/local_socket_pool.h>
 #include <src/network/local_socket_reply.h>
 
 #include <multipass/exceptions/http_local_socket_exception.h>
@@ -27,7 +28,9 @@
 #include <multipass/network_access_manager.h>
 #include <multipass/version.h>
 
+#include <atomic>
 #include <random>
+#include <thread>
 
 #include <QBuffer>
 #include <QEventLoop>
@@ -205,10 +208,9 @@ TEST_F(LocalNetworkAccessManager, client_posts_correct_data)
     QByteArray expected_data{"POST /1.0 HTTP/1.1\r\n"
                              "Host: test\r\n"
                              "User-Agent: Test\r\n"
-                             "Connection: close\r\n"
                              "Content-Type: application/x-www-form-urlencoded\r\n"
                              "Content-Length: 11\r\n\r\n"
-                             "Hello World\r\n"};
+                             "Hello World"};
 
     QByteArray http_response{"HTTP/1.1 200 OK\r\n\r\n"};
 
@@ -222,6 +224,83 @@ TEST_F(LocalNetworkAccessManager, client_posts_correct_data)
     handle_request(base_url, "POST", "Hello World");
 }
 
+TEST_F(LocalNetworkAccessManager, reuses_connections_kept_alive)
+{
+    auto requests = 0;
+    auto server_response = [&requests](auto...) {
+        return ++requests == 1 ? QByteArray{"HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nHello"}
+                               : QByteArray{"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                            "5\r\nHello\r\n6\r\n again\r\n0\r\n\r\n"};
+    };
+    test_server.keep_alive_server_handler(server_response);
+
+    auto first_reply = handle_request(base_url, "GET");
+    auto second_reply = handle_request(base_url, "GET");
+
+    ASSERT_EQ(first_reply->error(), QNetworkReply::NoError);
+    ASSERT_EQ(second_reply->error(), QNetworkReply::NoError);
+    EXPECT_EQ(first_reply->readAll(), "Hello");
+    EXPECT_EQ(second_reply->readAll(), "Hello again");
+    EXPECT_EQ(test_server.connections, 1);
+}
+
+TEST_F(LocalNetworkAccessManager, does_not_reuse_connections_the_server_closes)
+{
+    auto server_response = [](auto...) {
+        return QByteArray{"HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 5\r\n\r\nHello"};
+    };
+    test_server.keep_alive_server_handler(server_response);
+
+    handle_request(base_url, "GET");
+    handle_request(base_url, "GET");
+
+    EXPECT_EQ(test_server.connections, 2);
+}
+
+TEST_F(LocalNetworkAccessManager, pool_drops_the_connections_of_a_thread_that_finished)
+{
+    struct TrackedSocket : public QLocalSocket
+    {
+        explicit TrackedSocket(std::atomic_bool& destroyed) : destroyed{destroyed}
+        {
+        }
+
+        ~TrackedSocket() override
+        {
+            destroyed = true;
+        }
+
+        std::atomic_bool& destroyed;
+    };
+
+    auto pool = std::make_shared<mp::LocalSocketPool>();
+    std::atomic_bool kept_socket_destroyed{false}, dropped_socket_destroyed{false};
+
+    pool->release(socket_path, std::make_unique<TrackedSocket>(kept_socket_destroyed));
+    std::thread{[&pool, this, &dropped_socket_destroyed] {
+        pool->release(socket_path, std::make_unique<TrackedSocket>(dropped_socket_destroyed));
+    }}.join();
+
+    EXPECT_TRUE(dropped_socket_destroyed);
+    EXPECT_FALSE(kept_socket_destroyed);
+}
+
+TEST_F(LocalNetworkAccessManager, body_is_readable_as_it_arrives)
+{
+    auto server_response = [](auto...) { return QByteArray{"HTTP/1.1 200 OK\r\nContent-Length: 11\r\n\r\nHello"}; };
+    test_server.keep_alive_server_handler(server_response);
+
+    QNetworkRequest request{base_url};
+    std::unique_ptr<QNetworkReply> reply{manager.sendCustomRequest(request, "GET")};
+
+    QObject::connect(reply.get(), &QNetworkReply::readyRead, &event_loop, &QEventLoop::quit);
+    QTimer::singleShot(2000, &event_loop, &QEventLoop::quit);
+    event_loop.exec();
+
+    EXPECT_FALSE(reply->isFinished());
+    EXPECT_EQ(reply->readAll(), "Hello");
+}
+
 TEST_F(LocalNetworkAccessManager, bad_http_server_response_has_error)
 {
     QByteArray malformed_http_response{"FOO/1.4 42 Yo\r\n"};
@@ -314,6 +393,64 @@ TEST_F(LocalNetworkAccessManager, sending_chunked_data_receives_expected_data)
     handle_request(base_url, "POST", random_data);
 }
 
+TEST_F(LocalNetworkAccessManager, large_upload_goes_through_while_the_event_loop_runs)
+{
+    const auto upload_data = generate_random_data(4 * 1024 * 1024);
+    QByteArray received_body;
+    auto server_response = [&received_body](const QByteArray& request) {
+        received_body = request.mid(request.indexOf("\r\n\r\n") + 4);
+        return QByteArray{"HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n"};
+    };
+    test_server.whole_request_server_handler(server_response);
+
+    QNetworkRequest request{base_url};
+    request.setHeader(QNetworkRequest::ContentLengthHeader, upload_data.size());
+    std::unique_ptr<QNetworkReply> reply{manager.sendCustomRequest(request, "PUT", upload_data)};
+
+    std::vector<std::pair<qint64, qint64>> progress;
+    QObject::connect(reply.get(), &QNetworkReply::uploadProgress,
+                     [&progress](qint64 sent, qint64 total) { progress.emplace_back(sent, total); });
+    QObject::connect(reply.get(), &QNetworkReply::finished, &event_loop, &QEventLoop::quit);
+    QTimer::singleShot(10000, &event_loop, &QEventLoop::quit);
+    event_loop.exec();
+
+    ASSERT_TRUE(reply->isFinished());
+    EXPECT_EQ(reply->error(), QNetworkReply::NoError);
+    EXPECT_EQ(received_body, upload_data);
+
+    // Sent a piece at a time, as the socket took it
+    ASSERT_GT(progress.size(), 1u);
+    EXPECT_EQ(progress.back(), std::make_pair(qint64{upload_data.size()}, qint64{upload_data.size()}));
+}
+
+TEST_F(LocalNetworkAccessManager, large_chunked_upload_arrives_whole)
+{
+    const auto upload_data = generate_random_data(1024 * 1024);
+    QByteArray received_body;
+    auto server_response = [&received_body](const QByteArray& request) {
+        // Reassembled from its chunks
+        for (auto pos = request.indexOf("\r\n\r\n") + 4; pos < request.size();)
+        {
+            const auto size_end = request.indexOf("\r\n", pos);
+            const auto size = request.mid(pos, size_end - pos).toInt(nullptr, 16);
+            if (size == 0)
+                break;
+
+            received_body += request.mid(size_end + 2, size);
+            pos = size_end + 2 + size + 2;
+        }
+
+        return QByteArray{"HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n"};
+    };
+    test_server.whole_request_server_handler(server_response);
+
+    auto reply = handle_request(base_url, "POST", upload_data);
+
+    ASSERT_TRUE(reply->isFinished());
+    EXPECT_EQ(reply->error(), QNetworkReply::NoError);
+    EXPECT_EQ(received_body, upload_data);
+}
+
 TEST_F(LocalNetworkAccessManager, overflowing_response_works)
 {
     auto reply_data = generate_random_data(max_content * 2);
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <src/platform/backends/shared/linux/netlink.h>
+
+#include <gmock/gmock.h>
+
+#include <stdexcept>
+
+namespace mp = multipass;
+using namespace testing;
+
+TEST(Netlink, loopback_link_exists)
+{
+    EXPECT_TRUE(mp::backend::link_exists("lo"));
+}
+
+TEST(Netlink, unknown_link_does_not_exist)
+{
+    EXPECT_FALSE(mp::backend::link_exists("mp-no-such-link"));
+}
+
+TEST(Netlink, commits_empty_batch_without_talking_to_the_kernel)
+{
+    EXPECT_NO_THROW(mp::backend::NetlinkBatch{}.commit());
+}
+
+TEST(Netlink, throws_with_the_change_the_kernel_refused)
+{
+    // Refused either for the missing link or, unprivileged, for the lack of permission
+    EXPECT_THROW(
+        {
+            try
+            {
+                mp::backend::NetlinkBatch{}.delete_link("mp-no-such-link").commit();
+            }
+            catch (const std::runtime_error& e)
+            {
+                EXPECT_THAT(e.what(), HasSubstr("delete link mp-no-such-link"));
+                throw;
+            }
+        },
+        std::runtime_error);
+}
+
+TEST(Netlink, cannot_enslave_to_unknown_master)
+{
+    EXPECT_THROW(mp::backend::NetlinkBatch{}.set_master("lo", "mp-no-such-link"), std::runtime_error);
+}
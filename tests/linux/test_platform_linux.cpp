@@ -323,6 +323,55 @@ TEST_F(PlatformLinux, test_libvirt_in_env_var_is_ignored)
     aux_test_driver_factory<mp::QemuVirtualMachineFactory>("qemu");
 }
 
+TEST_F(PlatformLinux, cloneFileDuplicatesContents)
+{
+    mpt::TempDir temp_dir;
+    const auto source = temp_dir.path() + "/source.img";
+    const auto target = temp_dir.path() + "/target.img";
+    mpt::make_file_with_content(source, "some image data");
+
+    ASSERT_TRUE(MP_PLATFORM.clone_file(source.toStdString().c_str(), target.toStdString().c_str()));
+
+    QFile target_file{target};
+    ASSERT_TRUE(target_file.open(QIODevice::ReadOnly));
+    EXPECT_EQ(target_file.readAll(), "some image data");
+}
+
+TEST_F(PlatformLinux, cloneFileFailsOnMissingSource)
+{
+    mpt::TempDir temp_dir;
+    const auto target = temp_dir.path() + "/target.img";
+
+    EXPECT_FALSE(MP_PLATFORM.clone_file((temp_dir.path() + "/missing.img").toStdString().c_str(),
+                                        target.toStdString().c_str()));
+    EXPECT_FALSE(QFile::exists(target));
+}
+
+TEST_F(PlatformLinux, fileIdentityChangesWithContents)
+{
+    mpt::TempDir temp_dir;
+    const auto path = (temp_dir.path() + "/image.img").toStdString();
+    mpt::make_file_with_content(QString::fromStdString(path), "some image data");
+
+    const auto identity = MP_PLATFORM.file_identity(path.c_str());
+    EXPECT_FALSE(identity.empty());
+    EXPECT_EQ(MP_PLATFORM.file_identity(path.c_str()), identity);
+
+    QFile file{QString::fromStdString(path)};
+    ASSERT_TRUE(file.open(QIODevice::Append));
+    file.write("more data");
+    file.close();
+
+    EXPECT_NE(MP_PLATFORM.file_identity(path.c_str()), identity);
+}
+
+TEST_F(PlatformLinux, fileIdentityIsEmptyForMissingFile)
+{
+    mpt::TempDir temp_dir;
+
+    EXPECT_TRUE(MP_PLATFORM.file_identity((temp_dir.path() + "/missing.img").toStdString().c_str()).empty());
+}
+
 TEST_F(PlatformLinux, workflowsURLOverrideSetReturnsExpectedData)
 {
     const QString fake_url{"https://a.fake.url"};
@@ -554,4 +603,45 @@ INSTANTIATE_TEST_SUITE_P(
     Values(Param{{"en0", true}}, Param{{"en0", false}}, Param{{"en0", false}, {"en1", true}},
            Param{{"asdf", true}, {"ggi", true}, {"a1", true}, {"fu", false}, {"ho", true}, {"ra", false}}));
 
+TEST_F(PlatformLinux, inventory_reads_interfaces_again_only_once_invalidated)
+{
+    const mpt::TempDir tmp_dir;
+    QDir fake_sys_class_net{tmp_dir.path()};
+    ASSERT_EQ(mpt::make_file_with_content(fake_sys_class_net.filePath("eth0") + "/type", "1"), 1);
+
+    mp::platform::detail::NetworkInterfaceInventory inventory{fake_sys_class_net, /* watch_links = */ false};
+    EXPECT_THAT(inventory.interfaces(), ElementsAre(Key("eth0")));
+
+    ASSERT_EQ(mpt::make_file_with_content(fake_sys_class_net.filePath("eth1") + "/type", "1"), 1);
+    EXPECT_THAT(inventory.interfaces(), ElementsAre(Key("eth0")));
+
+    inventory.invalidate("eth1");
+    EXPECT_THAT(inventory.interfaces(), ElementsAre(Key("eth0"), Key("eth1")));
+
+    ASSERT_TRUE(QDir{fake_sys_class_net.filePath("eth0")}.removeRecursively());
+    inventory.invalidate("eth0");
+    EXPECT_THAT(inventory.interfaces(), ElementsAre(Key("eth1")));
+}
+
+TEST_F(PlatformLinux, inventory_updates_bridges_along_with_their_members)
+{
+    const mpt::TempDir tmp_dir;
+    QDir fake_sys_class_net{tmp_dir.path()};
+    QDir bridge_dir{fake_sys_class_net.filePath("br0")};
+    ASSERT_EQ(mpt::make_file_with_content(bridge_dir.filePath("type"), "1"), 1);
+    ASSERT_TRUE(bridge_dir.mkpath("bridge"));
+    ASSERT_TRUE(bridge_dir.mkpath("brif"));
+
+    mp::platform::detail::NetworkInterfaceInventory inventory{fake_sys_class_net, /* watch_links = */ false};
+    EXPECT_THAT(inventory.interfaces(),
+                ElementsAre(Pair("br0", Field(&mp::NetworkInterfaceInfo::description, StrEq("Network bridge")))));
+
+    ASSERT_EQ(mpt::make_file_with_content(fake_sys_class_net.filePath("eth0") + "/type", "1"), 1);
+    ASSERT_TRUE(bridge_dir.mkpath("brif/eth0"));
+    inventory.invalidate("eth0");
+
+    EXPECT_THAT(inventory.interfaces(),
+                Contains(Pair("br0", Field(&mp::NetworkInterfaceInfo::description, HasSubstr("eth0")))));
+}
+
 } // namespace
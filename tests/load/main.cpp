@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rpc_load.h"
+
+#include "stub_cert_store.h"
+#include "stub_certprovider.h"
+#include "stub_image_host.h"
+#include "stub_logger.h"
+#include "stub_ssh_key_provider.h"
+#include "stub_virtual_machine_factory.h"
+#include "stub_vm_image_vault.h"
+#include "stub_vm_workflow_provider.h"
+#include "temp_dir.h"
+
+#include <src/daemon/daemon.h>
+#include <src/daemon/daemon_config.h>
+#include <src/platform/update/disabled_update_prompt.h>
+
+#include <multipass/cli/client_common.h>
+#include <multipass/constants.h>
+#include <multipass/format.h>
+#include <multipass/top_catch_all.h>
+
+#include <fmt/ostream.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+#include <iostream>
+#include <thread>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+namespace
+{
+// A daemon that answers on this process' main thread, like multipassd does, but whose instances are stubs, so that
+// only the RPC and daemon overhead gets measured
+std::unique_ptr<mp::Daemon> make_stub_daemon(const mpt::TempDir& dir, const std::string& address)
+{
+    mp::DaemonConfigBuilder config_builder;
+    config_builder.server_address = address;
+    config_builder.cache_directory = dir.path() + "/cache";
+    config_builder.data_directory = dir.path() + "/data";
+    config_builder.vault = std::make_unique<mpt::StubVMImageVault>();
+    config_builder.factory = std::make_unique<mpt::StubVirtualMachineFactory>();
+    config_builder.image_hosts.push_back(std::make_unique<mpt::StubVMImageHost>());
+    config_builder.ssh_key_provider = std::make_unique<mpt::StubSSHKeyProvider>();
+    config_builder.cert_provider = std::make_unique<mpt::StubCertProvider>();
+    config_builder.client_cert_store = std::make_unique<mpt::StubCertStore>();
+    config_builder.connection_type = mp::RpcConnectionType::insecure;
+    config_builder.logger = std::make_unique<mpt::StubLogger>();
+    config_builder.update_prompt = std::make_unique<mp::DisabledUpdatePrompt>();
+    config_builder.workflow_provider = std::make_unique<mpt::StubVMWorkflowProvider>();
+
+    return std::make_unique<mp::Daemon>(config_builder.build());
+}
+
+std::map<std::string, int> parse_mix(const QString& value)
+{
+    std::map<std::string, int> mix;
+    for (const auto& entry : value.split(',', QString::SkipEmptyParts))
+    {
+        const auto parts = entry.split('=');
+        auto ok = false;
+        const auto weight = parts.size() == 2 ? parts[1].toInt(&ok) : 1;
+        if (parts.size() > 2 || (parts.size() == 2 && !ok))
+            throw std::invalid_argument(fmt::format("invalid mix entry \"{}\"", entry.toStdString()));
+
+        mix[parts[0].trimmed().toStdString()] = weight;
+    }
+
+    return mix;
+}
+
+int positive_int(const QCommandLineParser& parser, const QCommandLineOption& option)
+{
+    auto ok = false;
+    const auto value = parser.value(option).toInt(&ok);
+    if (!ok || value < 1)
+        throw std::invalid_argument(fmt::format("--{} must be a positive integer", option.names().first()));
+
+    return value;
+}
+
+int main_impl(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    // The client's name, so that the client certificate it registered with the daemon is picked up
+    QCoreApplication::setApplicationName(mp::client_name);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Fires a mix of RPCs at a multipass daemon and reports their latencies");
+    parser.addHelpOption();
+
+    QCommandLineOption stub_option{"stub", "Serve the load from an in-process daemon with stub instances"};
+    QCommandLineOption address_option{"address", "The daemon to load, instead of the client's default", "address"};
+    QCommandLineOption clients_option{"clients", "Number of concurrent clients", "n", "8"};
+    QCommandLineOption channels_option{"channels", "Number of gRPC channels the clients share", "n", "8"};
+    QCommandLineOption rate_option{"rate", "Calls per second across all clients, 0 for unthrottled", "calls", "0"};
+    QCommandLineOption duration_option{"duration", "Seconds to keep the load up", "seconds", "30"};
+    QCommandLineOption timeout_option{"timeout", "Seconds before a call is given up on", "seconds", "60"};
+    QCommandLineOption mix_option{
+        "mix", "Operations and their weights, out of list, info, find, start, stop and launch", "op=weight,...",
+        "list=4,info=4,find=1"};
+    QCommandLineOption instances_option{"instances", "Existing instances for info, start and stop", "name,..."};
+    QCommandLineOption image_option{"image", "The image to launch from", "image"};
+    QCommandLineOption keep_option{"keep", "Keep the instances that launch created"};
+    parser.addOptions({stub_option, address_option, clients_option, channels_option, rate_option, duration_option,
+                       timeout_option, mix_option, instances_option, image_option, keep_option});
+    parser.process(app);
+
+    mpt::RpcLoad::Options options;
+    options.clients = positive_int(parser, clients_option);
+    options.duration = std::chrono::seconds{positive_int(parser, duration_option)};
+    options.call_timeout = std::chrono::seconds{positive_int(parser, timeout_option)};
+    options.rate = std::max(0.0, parser.value(rate_option).toDouble());
+    options.mix = parse_mix(parser.value(mix_option));
+    options.image = parser.value(image_option).toStdString();
+    for (const auto& name : parser.value(instances_option).split(',', QString::SkipEmptyParts))
+        options.instances.push_back(name.toStdString());
+
+    std::unique_ptr<mpt::TempDir> stub_dir;
+    std::unique_ptr<mp::Daemon> daemon;
+    std::unique_ptr<mp::CertProvider> cert_provider;
+    std::string address;
+    auto connection_type = mp::RpcConnectionType::ssl;
+    if (parser.isSet(stub_option))
+    {
+        stub_dir = std::make_unique<mpt::TempDir>();
+        address = fmt::format("unix:{}/multipass_socket", stub_dir->path());
+        daemon = make_stub_daemon(*stub_dir, address);
+        cert_provider = std::make_unique<mpt::StubCertProvider>();
+        connection_type = mp::RpcConnectionType::insecure;
+    }
+    else
+    {
+        address = parser.isSet(address_option) ? parser.value(address_option).toStdString()
+                                               : mp::client::get_server_address();
+        cert_provider = mp::client::get_cert_provider();
+    }
+
+    std::vector<std::shared_ptr<grpc::Channel>> channels;
+    for (auto i = positive_int(parser, channels_option); i > 0; --i)
+        channels.push_back(mp::client::make_channel(address, connection_type, *cert_provider));
+
+    mpt::RpcLoad load{std::move(channels), options};
+    fmt::print(std::cout, "Loading {} with {} clients for {}s\n", address, options.clients, options.duration.count());
+
+    // The load comes from other threads, leaving this one to serve the RPCs when the daemon is in-process
+    std::map<std::string, mpt::OperationStats> stats;
+    std::thread runner{[&] {
+        stats = load.run();
+        if (!parser.isSet(keep_option))
+            load.clean_up();
+
+        QMetaObject::invokeMethod(&app, "quit", Qt::QueuedConnection);
+    }};
+
+    app.exec();
+    runner.join();
+
+    mpt::RpcLoad::report(stats, options.duration, std::cout);
+    return EXIT_SUCCESS;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    return mp::top_catch_all("rpc_load", /* fallback_return = */ EXIT_FAILURE, main_impl, argc, argv);
+}
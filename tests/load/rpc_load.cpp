@@ -0,0 +1,346 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rpc_load.h"
+
+#include <fmt/format.h>
+#include <fmt/ostream.h>
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+namespace
+{
+template <typename Reply, typename Request>
+grpc::Status read_all(std::unique_ptr<grpc::ClientReader<Reply>> (mp::Rpc::Stub::*rpc)(grpc::ClientContext*,
+                                                                                         const Request&),
+                      mp::Rpc::Stub& stub, const Request& request, std::chrono::seconds timeout)
+{
+    grpc::ClientContext context;
+    context.set_deadline(std::chrono::system_clock::now() + timeout);
+
+    auto reader = (stub.*rpc)(&context, request);
+    Reply reply;
+    while (reader->Read(&reply))
+        ;
+
+    return reader->Finish();
+}
+
+std::string status_name(grpc::StatusCode code)
+{
+    switch (code)
+    {
+    case grpc::StatusCode::CANCELLED:
+        return "cancelled";
+    case grpc::StatusCode::INVALID_ARGUMENT:
+        return "invalid argument";
+    case grpc::StatusCode::DEADLINE_EXCEEDED:
+        return "deadline exceeded";
+    case grpc::StatusCode::NOT_FOUND:
+        return "not found";
+    case grpc::StatusCode::FAILED_PRECONDITION:
+        return "failed precondition";
+    case grpc::StatusCode::ABORTED:
+        return "aborted";
+    case grpc::StatusCode::UNAVAILABLE:
+        return "unavailable";
+    default:
+        return fmt::format("status {}", static_cast<int>(code));
+    }
+}
+
+std::string format_latency(std::chrono::microseconds latency)
+{
+    if (latency.count() < 1000)
+        return fmt::format("{}us", latency.count());
+    if (latency.count() < 1000000)
+        return fmt::format("{:.1f}ms", latency.count() / 1e3);
+
+    return fmt::format("{:.2f}s", latency.count() / 1e6);
+}
+} // namespace
+
+void mpt::LatencyHistogram::record(std::chrono::microseconds latency)
+{
+    auto bucket = std::size_t{0};
+    for (auto bound = std::chrono::microseconds::rep{1}; bound < latency.count() && bucket < num_buckets - 1;
+         bound <<= 1)
+        ++bucket;
+
+    ++buckets[bucket];
+    longest = std::max(longest, latency);
+}
+
+void mpt::LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for (auto i = std::size_t{0}; i < num_buckets; ++i)
+        buckets[i] += other.buckets[i];
+
+    longest = std::max(longest, other.longest);
+}
+
+std::uint64_t mpt::LatencyHistogram::count() const
+{
+    auto total = std::uint64_t{0};
+    for (auto n : buckets)
+        total += n;
+
+    return total;
+}
+
+std::chrono::microseconds mpt::LatencyHistogram::quantile(double q) const
+{
+    const auto total = count();
+    if (!total)
+        return std::chrono::microseconds{0};
+
+    const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(q * total + 0.5));
+    auto seen = std::uint64_t{0};
+    for (auto i = std::size_t{0}; i < num_buckets; ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+            return std::min(std::chrono::microseconds{std::chrono::microseconds::rep{1} << i}, longest);
+    }
+
+    return longest;
+}
+
+std::chrono::microseconds mpt::LatencyHistogram::max() const
+{
+    return longest;
+}
+
+void mpt::LatencyHistogram::print(std::ostream& out) const
+{
+    const auto widest = *std::max_element(buckets.begin(), buckets.end());
+    if (!widest)
+        return;
+
+    for (auto i = std::size_t{0}; i < num_buckets; ++i)
+    {
+        if (!buckets[i])
+            continue;
+
+        const auto bound = std::chrono::microseconds{std::chrono::microseconds::rep{1} << i};
+        const auto bar = std::string(static_cast<std::size_t>(40.0 * buckets[i] / widest + 0.5), '#');
+        fmt::print(out, "    <= {:>9} {:>8} {}\n", format_latency(bound), buckets[i], bar);
+    }
+}
+
+const std::vector<std::string>& mpt::RpcLoad::operations()
+{
+    static const std::vector<std::string> names{"list", "info", "find", "start", "stop", "launch"};
+    return names;
+}
+
+mpt::RpcLoad::RpcLoad(std::vector<std::shared_ptr<grpc::Channel>> channels, Options options)
+    : channels{std::move(channels)}, options{std::move(options)}, instances{this->options.instances}
+{
+    if (this->channels.empty() || this->options.clients < 1)
+        throw std::invalid_argument("need at least one channel and one client");
+
+    for (const auto& [operation, weight] : this->options.mix)
+    {
+        if (std::find(operations().begin(), operations().end(), operation) == operations().end())
+            throw std::invalid_argument(fmt::format("unknown operation \"{}\"", operation));
+        if (weight < 0)
+            throw std::invalid_argument(fmt::format("negative weight for \"{}\"", operation));
+        if (weight && instances.empty() && (operation == "start" || operation == "stop") &&
+            !this->options.mix.count("launch"))
+            throw std::invalid_argument(fmt::format("\"{}\" needs instances to act on", operation));
+    }
+}
+
+std::map<std::string, mpt::OperationStats> mpt::RpcLoad::run()
+{
+    std::vector<std::string> names;
+    std::vector<int> weights;
+    for (const auto& [operation, weight] : options.mix)
+    {
+        names.push_back(operation);
+        weights.push_back(weight);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + options.duration;
+    const auto interval =
+        options.rate > 0 ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                               std::chrono::duration<double>{options.clients / options.rate})
+                         : std::chrono::steady_clock::duration::zero();
+
+    std::vector<std::map<std::string, OperationStats>> per_client(options.clients);
+    std::vector<std::thread> clients;
+    for (auto client = 0; client < options.clients; ++client)
+    {
+        clients.emplace_back([&, client] {
+            auto stub = Rpc::NewStub(channels[client % channels.size()]);
+            std::mt19937 generator{static_cast<std::mt19937::result_type>(client)};
+            std::discrete_distribution<std::size_t> pick(weights.begin(), weights.end());
+
+            // Staggered so that the clients do not all fire at once
+            auto due = start + interval * client / options.clients;
+            for (auto seq = 0;; ++seq, due += interval)
+            {
+                if (interval.count())
+                    std::this_thread::sleep_until(due);
+
+                const auto sent = std::chrono::steady_clock::now();
+                if (sent >= end)
+                    break;
+
+                const auto& operation = names[pick(generator)];
+                const auto status = call(*stub, operation, client, seq);
+                const auto latency = std::chrono::steady_clock::now() - (interval.count() ? due : sent);
+
+                auto& stats = per_client[client][operation];
+                stats.latencies.record(std::chrono::duration_cast<std::chrono::microseconds>(latency));
+                if (!status.ok())
+                    ++stats.errors[status.error_code()];
+            }
+        });
+    }
+
+    for (auto& client : clients)
+        client.join();
+
+    std::map<std::string, OperationStats> stats;
+    for (const auto& client_stats : per_client)
+    {
+        for (const auto& [operation, operation_stats] : client_stats)
+        {
+            auto& merged = stats[operation];
+            merged.latencies.merge(operation_stats.latencies);
+            for (const auto& [code, count] : operation_stats.errors)
+                merged.errors[code] += count;
+        }
+    }
+
+    return stats;
+}
+
+void mpt::RpcLoad::clean_up()
+{
+    if (launched.empty())
+        return;
+
+    DeleteRequest request;
+    request.set_purge(true);
+    for (const auto& name : launched)
+        request.mutable_instance_names()->add_instance_name(name);
+
+    auto stub = Rpc::NewStub(channels.front());
+    read_all(&Rpc::Stub::delet, *stub, request, options.call_timeout);
+    launched.clear();
+}
+
+void mpt::RpcLoad::report(const std::map<std::string, OperationStats>& stats, std::chrono::seconds duration,
+                          std::ostream& out)
+{
+    const auto row_format = "{:<8}{:>9}{:>10}{:>9}{:>10}{:>10}{:>10}{:>10}\n";
+    fmt::print(out, row_format, "Op", "Calls", "Calls/s", "Errors", "p50", "p90", "p99", "Max");
+    for (const auto& [operation, operation_stats] : stats)
+    {
+        const auto& latencies = operation_stats.latencies;
+        auto errors = std::uint64_t{0};
+        for (const auto& error : operation_stats.errors)
+            errors += error.second;
+
+        fmt::print(out, row_format, operation, latencies.count(),
+                   fmt::format("{:.1f}", static_cast<double>(latencies.count()) / duration.count()),
+                   fmt::format("{:.1f}%", 100.0 * errors / std::max<std::uint64_t>(1, latencies.count())),
+                   format_latency(latencies.quantile(0.5)), format_latency(latencies.quantile(0.9)),
+                   format_latency(latencies.quantile(0.99)), format_latency(latencies.max()));
+    }
+
+    for (const auto& [operation, operation_stats] : stats)
+    {
+        fmt::print(out, "\n{}:\n", operation);
+        operation_stats.latencies.print(out);
+        for (const auto& [code, count] : operation_stats.errors)
+            fmt::print(out, "    {}: {}\n", status_name(code), count);
+    }
+}
+
+grpc::Status mpt::RpcLoad::call(Rpc::Stub& stub, const std::string& operation, int client, int seq)
+{
+    if (operation == "list")
+        return read_all(&Rpc::Stub::list, stub, ListRequest{}, options.call_timeout);
+
+    if (operation == "find")
+        return read_all(&Rpc::Stub::find, stub, FindRequest{}, options.call_timeout);
+
+    if (operation == "info")
+    {
+        InfoRequest request;
+        const auto name = pick_instance(client + seq);
+        if (!name.empty())
+            request.mutable_instance_names()->add_instance_name(name);
+
+        return read_all(&Rpc::Stub::info, stub, request, options.call_timeout);
+    }
+
+    if (operation == "start" || operation == "stop")
+    {
+        const auto name = pick_instance(client + seq);
+        if (name.empty())
+            return grpc::Status{grpc::StatusCode::FAILED_PRECONDITION, "no instances yet"};
+
+        if (operation == "start")
+        {
+            StartRequest request;
+            request.mutable_instance_names()->add_instance_name(name);
+            return read_all(&Rpc::Stub::start, stub, request, options.call_timeout);
+        }
+
+        StopRequest request;
+        request.mutable_instance_names()->add_instance_name(name);
+        return read_all(&Rpc::Stub::stop, stub, request, options.call_timeout);
+    }
+
+    LaunchRequest request;
+    const auto name = fmt::format("load-{}-{}", client, seq);
+    request.set_instance_name(name);
+    request.set_image(options.image);
+
+    // Recorded up front, so that clean_up also catches launches that failed half way
+    {
+        std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+        launched.push_back(name);
+    }
+
+    auto status = read_all(&Rpc::Stub::launch, stub, request, options.call_timeout);
+    if (status.ok())
+    {
+        std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+        instances.push_back(name);
+    }
+
+    return status;
+}
+
+std::string mpt::RpcLoad::pick_instance(int seq)
+{
+    std::lock_guard<decltype(instances_mutex)> lock{instances_mutex};
+    return instances.empty() ? std::string{} : instances[seq % instances.size()];
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_RPC_LOAD_H
+#define MULTIPASS_RPC_LOAD_H
+
+#include <multipass/rpc/multipass.grpc.pb.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace multipass
+{
+namespace test
+{
+// Latencies in power-of-two buckets of microseconds, which is precise enough to tell queueing apart from work
+class LatencyHistogram
+{
+public:
+    static constexpr std::size_t num_buckets = 32;
+
+    void record(std::chrono::microseconds latency);
+    void merge(const LatencyHistogram& other);
+
+    std::uint64_t count() const;
+    // The upper bound of the bucket holding the given quantile, in [0, 1]
+    std::chrono::microseconds quantile(double q) const;
+    std::chrono::microseconds max() const;
+    void print(std::ostream& out) const;
+
+private:
+    std::array<std::uint64_t, num_buckets> buckets{};
+    std::chrono::microseconds longest{0};
+};
+
+struct OperationStats
+{
+    LatencyHistogram latencies;
+    std::map<grpc::StatusCode, std::uint64_t> errors;
+};
+
+// Fires a weighted mix of RPCs at a daemon from a number of clients spread across channels. Each client sends on an
+// open-loop schedule, so latencies are measured from when a call was due rather than from when it went out, and time
+// spent waiting behind the daemon's main thread shows up instead of being hidden by a slower send rate.
+class RpcLoad
+{
+public:
+    struct Options
+    {
+        int clients{8};
+        // Calls per second across all clients; as fast as the daemon answers when zero
+        double rate{0};
+        std::chrono::seconds duration{30};
+        std::chrono::seconds call_timeout{60};
+        // Operation names (list, info, find, start, stop, launch) to relative weights
+        std::map<std::string, int> mix{{"list", 4}, {"info", 4}, {"find", 1}};
+        // What info, start and stop act on; launch adds the instances it creates
+        std::vector<std::string> instances;
+        std::string image;
+    };
+
+    static const std::vector<std::string>& operations();
+
+    RpcLoad(std::vector<std::shared_ptr<grpc::Channel>> channels, Options options);
+
+    // Blocks until the duration is over and the calls in flight are done
+    std::map<std::string, OperationStats> run();
+    // Deletes and purges what launch created
+    void clean_up();
+
+    static void report(const std::map<std::string, OperationStats>& stats, std::chrono::seconds duration,
+                       std::ostream& out);
+
+private:
+    grpc::Status call(Rpc::Stub& stub, const std::string& operation, int client, int seq);
+    std::string pick_instance(int seq);
+
+    const std::vector<std::shared_ptr<grpc::Channel>> channels;
+    const Options options;
+    std::mutex instances_mutex;
+    std::vector<std::string> instances;
+    std::vector<std::string> launched;
+};
+} // namespace test
+} // namespace multipass
+#endif // MULTIPASS_RPC_LOAD_H
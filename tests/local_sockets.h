@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_LOCAL_SOCKETS_H
+#define MULTIPASS_LOCAL_SOCKETS_H
+
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace multipass
+{
+namespace test
+{
+// Blocking TCP sockets on loopback, for tests to stand in for the services and clients of what relays connections
+inline sockaddr_in loopback_address(int port)
+{
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    return address;
+}
+
+inline int listen_on_any_port(int& port)
+{
+    const auto fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    auto address = loopback_address(0);
+    socklen_t length{sizeof(address)};
+    ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    ::listen(fd, 4);
+    ::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length);
+    port = ntohs(address.sin_port);
+    return fd;
+}
+
+inline int free_port()
+{
+    int port;
+    ::close(listen_on_any_port(port));
+    return port;
+}
+
+// -1 if nothing listens on the port
+inline int connect_to_port(int port)
+{
+    const auto fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const auto address = loopback_address(port);
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+inline void write_all(int fd, const std::string& data)
+{
+    for (size_t written = 0; written < data.size();)
+        written += ::write(fd, data.data() + written, data.size() - written);
+}
+
+inline std::string read_all(int fd)
+{
+    std::string data;
+    char buffer[65536];
+    for (ssize_t bytes; (bytes = ::read(fd, buffer, sizeof(buffer))) > 0;)
+        data.append(buffer, bytes);
+    return data;
+}
+
+// Stands in for a service in an instance, sending back what it gets on its first connection
+struct EchoServer
+{
+    EchoServer() : fd{listen_on_any_port(port)}
+    {
+        thread = std::thread{[this] {
+            const auto client = ::accept(fd, nullptr, nullptr);
+            write_all(client, read_all(client));
+            ::close(client);
+        }};
+    }
+
+    ~EchoServer()
+    {
+        ::shutdown(fd, SHUT_RDWR);
+        thread.join();
+        ::close(fd);
+    }
+
+    int port;
+    int fd;
+    std::thread thread;
+};
+} // namespace test
+} // namespace multipass
+#endif // MULTIPASS_LOCAL_SOCKETS_H
@@ -15,6 +15,7 @@
  *
  */
 
+#include <src/platform/backends/lxd/lxd_base_instances.h>
 #include <src/platform/backends/lxd/lxd_virtual_machine.h>
 #include <src/platform/backends/lxd/lxd_virtual_machine_factory.h>
 #include <src/platform/backends/lxd/lxd_vm_image_vault.h>
@@ -39,6 +40,7 @@
 #include <multipass/virtual_machine_description.h>
 
 #include <QJsonDocument>
+#include <QJsonObject>
 #include <QString>
 #include <QUrl>
 
@@ -76,6 +78,7 @@ struct LXDBackend : public Test
                                                       {},
                                                       {},
                                                       {},
+                                                      {},
                                                       {}};
 
     mpt::MockLogger::Scope logger_scope = mpt::MockLogger::inject();
@@ -267,6 +270,212 @@ TEST_F(LXDBackend, creates_in_stopped_state)
     EXPECT_EQ(machine.current_state(), mp::VirtualMachine::State::stopped);
 }
 
+TEST_F(LXDBackend, creates_as_copy_of_base_instance_on_cloning_pool)
+{
+    mpt::StubVMStatusMonitor stub_monitor;
+    default_description.image.id = "aedb5a84aaf2e4e443e090511156366a2800c26cec1b6a46f44d153c4bf04205";
+
+    bool vm_created{false};
+    std::vector<QJsonObject> posted;
+
+    EXPECT_CALL(*mock_network_access_manager, createRequest(_, _, _))
+        .WillRepeatedly([&vm_created, &posted](auto, auto request, auto outgoingData) {
+            auto op = request.attribute(QNetworkRequest::CustomVerbAttribute).toString();
+            auto url = request.url().toString();
+
+            if (op == "GET")
+            {
+                if (url.contains("1.0/storage-pools/default"))
+                {
+                    return new mpt::MockLocalSocketReply(
+                        R"({"type": "sync", "status_code": 200, "metadata": {"name": "default", "driver": "zfs"}})");
+                }
+                else if (url.contains("1.0/virtual-machines?recursion=1"))
+                {
+                    return new mpt::MockLocalSocketReply(R"({"type": "sync", "status_code": 200, "metadata": []})");
+                }
+                else if (url.contains("1.0/operations/0020444c-2e4c-49d5-83ed-3275e3f6d005"))
+                {
+                    vm_created = posted.size() == 2;
+                    return new mpt::MockLocalSocketReply(mpt::create_vm_finished_data);
+                }
+                else if (vm_created && url.contains("1.0/virtual-machines/pied-piper-valley"))
+                {
+                    return new mpt::MockLocalSocketReply(mpt::vm_info_data);
+                }
+            }
+            else if (op == "POST" && url.contains("1.0/virtual-machines"))
+            {
+                outgoingData->open(QIODevice::ReadOnly);
+                posted.push_back(QJsonDocument::fromJson(outgoingData->readAll()).object());
+                return new mpt::MockLocalSocketReply(mpt::create_vm_data);
+            }
+
+            return new mpt::MockLocalSocketReply(mpt::not_found_data, QNetworkReply::ContentNotFoundError);
+        });
+
+    mp::LXDBaseInstances bases{mock_network_access_manager.get(), base_url};
+    mp::LXDVirtualMachine machine{default_description, stub_monitor, mock_network_access_manager.get(), base_url,
+                                  bridge_name, nullptr, nullptr, &bases};
+
+    ASSERT_EQ(posted.size(), 2u);
+    const auto base = posted[0]["name"].toString();
+    EXPECT_TRUE(base.startsWith("multipass-base-"));
+    EXPECT_EQ(posted[0]["source"].toObject()["type"], "image");
+    EXPECT_EQ(posted[1]["name"], "pied-piper-valley");
+    EXPECT_EQ(posted[1]["source"].toObject()["type"], "copy");
+    EXPECT_EQ(posted[1]["source"].toObject()["source"], base);
+    EXPECT_EQ(machine.current_state(), mp::VirtualMachine::State::stopped);
+}
+
+TEST_F(LXDBackend, creates_from_the_image_when_the_base_instance_cannot_be_copied)
+{
+    mpt::StubVMStatusMonitor stub_monitor;
+    default_description.image.id = "aedb5a84aaf2e4e443e090511156366a2800c26cec1b6a46f44d153c4bf04205";
+
+    std::vector<QJsonObject> posted;
+
+    EXPECT_CALL(*mock_network_access_manager, createRequest(_, _, _))
+        .WillRepeatedly([&posted](auto, auto request, auto outgoingData) {
+            auto op = request.attribute(QNetworkRequest::CustomVerbAttribute).toString();
+            auto url = request.url().toString();
+
+            if (op == "GET")
+            {
+                if (url.contains("1.0/storage-pools/default"))
+                {
+                    return new mpt::MockLocalSocketReply(
+                        R"({"type": "sync", "status_code": 200, "metadata": {"name": "default", "driver": "zfs"}})");
+                }
+                else if (url.contains("1.0/virtual-machines?recursion=1"))
+                {
+                    return new mpt::MockLocalSocketReply(R"({"type": "sync", "status_code": 200, "metadata": []})");
+                }
+                else if (url.contains("1.0/operations/0020444c-2e4c-49d5-83ed-3275e3f6d005"))
+                {
+                    // The copy of the base fails, the base and the instance from the image do not
+                    if (posted.size() == 2)
+                        return new mpt::MockLocalSocketReply(R"({"type": "sync", "status_code": 200,
+                                                                 "metadata": {"status_code": 400, "err": "no copy"}})");
+                    return new mpt::MockLocalSocketReply(mpt::create_vm_finished_data);
+                }
+                else if (posted.size() == 3 && url.contains("1.0/virtual-machines/pied-piper-valley"))
+                {
+                    return new mpt::MockLocalSocketReply(mpt::vm_info_data);
+                }
+            }
+            else if (op == "POST" && url.contains("1.0/virtual-machines"))
+            {
+                outgoingData->open(QIODevice::ReadOnly);
+                posted.push_back(QJsonDocument::fromJson(outgoingData->readAll()).object());
+                return new mpt::MockLocalSocketReply(mpt::create_vm_data);
+            }
+
+            return new mpt::MockLocalSocketReply(mpt::not_found_data, QNetworkReply::ContentNotFoundError);
+        });
+
+    mp::LXDBaseInstances bases{mock_network_access_manager.get(), base_url};
+    mp::LXDVirtualMachine machine{default_description, stub_monitor, mock_network_access_manager.get(), base_url,
+                                  bridge_name, nullptr, nullptr, &bases};
+
+    ASSERT_EQ(posted.size(), 3u);
+    EXPECT_EQ(posted[1]["source"].toObject()["type"], "copy");
+    EXPECT_EQ(posted[2]["name"], "pied-piper-valley");
+    EXPECT_EQ(posted[2]["source"].toObject()["type"], "image");
+    EXPECT_EQ(machine.current_state(), mp::VirtualMachine::State::stopped);
+}
+
+TEST_F(LXDBackend, creates_from_the_image_while_another_launch_makes_the_base_instance)
+{
+    const std::string image_id{"aedb5a84aaf2e4e443e090511156366a2800c26cec1b6a46f44d153c4bf04205"};
+    mp::LXDBaseInstances bases{mock_network_access_manager.get(), base_url};
+    QJsonObject source_meanwhile;
+
+    EXPECT_CALL(*mock_network_access_manager, createRequest(_, _, _))
+        .WillRepeatedly([&bases, &image_id, &source_meanwhile](auto, auto request, auto) {
+            auto op = request.attribute(QNetworkRequest::CustomVerbAttribute).toString();
+            auto url = request.url().toString();
+
+            if (op == "GET" && url.contains("1.0/storage-pools/default"))
+            {
+                return new mpt::MockLocalSocketReply(
+                    R"({"type": "sync", "status_code": 200, "metadata": {"name": "default", "driver": "zfs"}})");
+            }
+            else if (op == "GET" && url.contains("1.0/virtual-machines?recursion=1"))
+            {
+                return new mpt::MockLocalSocketReply(R"({"type": "sync", "status_code": 200, "metadata": []})");
+            }
+            else if (op == "GET" && url.contains("1.0/operations/0020444c-2e4c-49d5-83ed-3275e3f6d005"))
+            {
+                return new mpt::MockLocalSocketReply(mpt::create_vm_finished_data);
+            }
+            else if (op == "POST" && url.contains("1.0/virtual-machines"))
+            {
+                // Another launch of the image comes along while the base is made
+                source_meanwhile = bases.source_for(image_id);
+                return new mpt::MockLocalSocketReply(mpt::create_vm_data);
+            }
+
+            return new mpt::MockLocalSocketReply(mpt::not_found_data, QNetworkReply::ContentNotFoundError);
+        });
+
+    const auto source = bases.source_for(image_id);
+
+    EXPECT_EQ(source["type"], "copy");
+    EXPECT_EQ(source_meanwhile["type"], "image");
+    EXPECT_EQ(source_meanwhile["fingerprint"], QString::fromStdString(image_id));
+}
+
+TEST_F(LXDBackend, removes_base_instances_without_a_base_image)
+{
+    const std::string image_id{"aedb5a84aaf2e4e443e090511156366a2800c26cec1b6a46f44d153c4bf04205"};
+    QStringList deleted;
+    auto images_looked_up = 0;
+
+    EXPECT_CALL(*mock_network_access_manager, createRequest(_, _, _))
+        .WillRepeatedly([&deleted, &images_looked_up](auto, auto request, auto) {
+            auto op = request.attribute(QNetworkRequest::CustomVerbAttribute).toString();
+            auto url = request.url().toString();
+
+            if (op == "GET" && url.contains("1.0/storage-pools/default"))
+            {
+                return new mpt::MockLocalSocketReply(
+                    R"({"type": "sync", "status_code": 200, "metadata": {"name": "default", "driver": "zfs"}})");
+            }
+            else if (op == "GET" && url.contains("1.0/virtual-machines?recursion=1"))
+            {
+                return new mpt::MockLocalSocketReply(
+                    R"({"type": "sync", "status_code": 200, "metadata": [{"name": "multipass-base-0123"}]})");
+            }
+            else if (op == "GET" && url.contains("1.0/images"))
+            {
+                ++images_looked_up;
+                return new mpt::MockLocalSocketReply(R"({"type": "sync", "status_code": 200, "metadata": []})");
+            }
+            else if (op == "GET" && url.contains("1.0/operations/0020444c-2e4c-49d5-83ed-3275e3f6d005"))
+            {
+                return new mpt::MockLocalSocketReply(mpt::create_vm_finished_data);
+            }
+            else if (op == "POST" && url.contains("1.0/virtual-machines"))
+            {
+                return new mpt::MockLocalSocketReply(mpt::create_vm_data);
+            }
+            else if (op == "DELETE")
+            {
+                deleted << url.section('/', -1);
+                return new mpt::MockLocalSocketReply(R"({"type": "sync", "status_code": 200, "metadata": {}})");
+            }
+
+            return new mpt::MockLocalSocketReply(mpt::not_found_data, QNetworkReply::ContentNotFoundError);
+        });
+
+    mp::LXDBaseInstances bases{mock_network_access_manager.get(), base_url};
+    bases.source_for(image_id);
+
+    EXPECT_THAT(deleted, ElementsAre("multipass-base-0123"));
+    EXPECT_EQ(images_looked_up, 0);
+}
+
 TEST_F(LXDBackend, machine_persists_and_sets_state_on_start)
 {
     NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
@@ -601,7 +810,7 @@ TEST_F(LXDBackend, prepare_source_image_does_not_modify)
     const mp::VMImage original_image{"/path/to/image",          "", "", "deadbeef", "bin", "baz", "the past",
                                      {"fee", "fi", "fo", "fum"}};
 
-    auto source_image = backend.prepare_source_image(original_image);
+    auto source_image = backend.prepare_source_image(original_image, [](int, int) { return true; });
 
     EXPECT_EQ(source_image.image_path, original_image.image_path);
     EXPECT_EQ(source_image.kernel_path, original_image.kernel_path);
@@ -803,6 +1012,63 @@ TEST_F(LXDBackend, returns_expected_network_info)
     EXPECT_EQ(machine.VirtualMachine::ssh_hostname(), "10.217.27.168");
 }
 
+TEST_F(LXDBackend, metrics_are_what_lxd_reports_of_the_instance)
+{
+    mpt::StubVMStatusMonitor stub_monitor;
+
+    auto state = QJsonDocument::fromJson(mpt::vm_state_fully_running_data).object();
+    auto metadata = state["metadata"].toObject();
+    metadata["memory"] = QJsonObject{{"usage", 536870912}, {"total", 1073741824}};
+    metadata["disk"] = QJsonObject{{"root", QJsonObject{{"usage", 100352}}}}; // no total, which LXD leaves out at times
+    state["metadata"] = metadata;
+    const auto state_data = QJsonDocument{state}.toJson();
+
+    EXPECT_CALL(*mock_network_access_manager, createRequest(_, _, _))
+        .WillRepeatedly([&state_data](auto, auto request, auto) {
+            auto op = request.attribute(QNetworkRequest::CustomVerbAttribute).toString();
+            auto url = request.url().toString();
+
+            if (op == "GET" && url.contains("1.0/virtual-machines/pied-piper-valley/state"))
+                return new mpt::MockLocalSocketReply(state_data);
+
+            return new mpt::MockLocalSocketReply(mpt::not_found_data, QNetworkReply::ContentNotFoundError);
+        });
+
+    mp::LXDVirtualMachine machine{default_description, stub_monitor, mock_network_access_manager.get(), base_url,
+                                  bridge_name};
+
+    const auto metrics = machine.metrics();
+    EXPECT_EQ(metrics.memory_used, mp::optional<long long>{536870912});
+    EXPECT_EQ(metrics.memory_total, mp::optional<long long>{1073741824});
+    EXPECT_EQ(metrics.disk_used, mp::optional<long long>{100352});
+    EXPECT_FALSE(metrics.disk_total);
+}
+
+TEST_F(LXDBackend, metrics_are_empty_when_lxd_cannot_be_asked)
+{
+    mpt::StubVMStatusMonitor stub_monitor;
+
+    auto lxd_gone = false;
+    EXPECT_CALL(*mock_network_access_manager, createRequest(_, _, _))
+        .WillRepeatedly([&lxd_gone](auto, auto request, auto) {
+            auto op = request.attribute(QNetworkRequest::CustomVerbAttribute).toString();
+            auto url = request.url().toString();
+
+            if (!lxd_gone && op == "GET" && url.contains("1.0/virtual-machines/pied-piper-valley/state"))
+                return new mpt::MockLocalSocketReply(mpt::vm_state_fully_running_data);
+
+            return new mpt::MockLocalSocketReply(mpt::not_found_data, QNetworkReply::ContentNotFoundError);
+        });
+
+    mp::LXDVirtualMachine machine{default_description, stub_monitor, mock_network_access_manager.get(), base_url,
+                                  bridge_name};
+    lxd_gone = true;
+
+    const auto metrics = machine.metrics();
+    EXPECT_FALSE(metrics.memory_used);
+    EXPECT_FALSE(metrics.disk_used);
+}
+
 TEST_F(LXDBackend, ssh_hostname_timeout_throws_and_sets_unknown_state)
 {
     mpt::StubVMStatusMonitor stub_monitor;
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <src/platform/backends/lxd/lxd_events.h>
+
+#include "tests/temp_dir.h"
+
+#include <multipass/auto_join_thread.h>
+
+#include <QCryptographicHash>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QThread>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+using namespace std::literals::chrono_literals;
+using namespace testing;
+
+namespace
+{
+// Accepts one client on the socket, upgrades it to a websocket and sends it the events it is given
+class FakeEventsServer
+{
+public:
+    explicit FakeEventsServer(const QString& socket_path) : thread{[this, socket_path] { serve(socket_path); }}
+    {
+        for (auto attempts = 0; attempts < 100 && !ready; ++attempts)
+            QThread::msleep(10);
+    }
+
+    ~FakeEventsServer()
+    {
+        stopped = true;
+    }
+
+    void send(const QByteArray& event)
+    {
+        std::lock_guard<decltype(mutex)> lock{mutex};
+        pending.push_back(event);
+    }
+
+private:
+    void serve(const QString& socket_path)
+    {
+        QLocalServer server;
+        server.listen(socket_path);
+        ready = true;
+
+        while (!stopped && !server.waitForNewConnection(50))
+            ;
+        if (stopped)
+            return;
+
+        std::unique_ptr<QLocalSocket> socket{server.nextPendingConnection()};
+        QByteArray request;
+        while (!stopped && !request.contains("\r\n\r\n"))
+            if (socket->waitForReadyRead(50))
+                request.append(socket->readAll());
+
+        auto key = request.mid(request.indexOf("Sec-WebSocket-Key: ") + 19);
+        key.truncate(key.indexOf('\r'));
+        const auto accept =
+            QCryptographicHash::hash(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11", QCryptographicHash::Sha1).toBase64();
+        socket->write("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                      "Sec-WebSocket-Accept: " +
+                      accept + "\r\n\r\n");
+        socket->waitForBytesWritten(1000);
+
+        while (!stopped)
+        {
+            std::vector<QByteArray> events;
+            {
+                std::lock_guard<decltype(mutex)> lock{mutex};
+                events.swap(pending);
+            }
+
+            for (const auto& event : events)
+            {
+                QByteArray frame(1, '\x81');
+                frame.append(static_cast<char>(126));
+                frame.append(static_cast<char>(event.size() >> 8));
+                frame.append(static_cast<char>(event.size() & 0xff));
+                socket->write(frame + event);
+                socket->waitForBytesWritten(1000);
+            }
+
+            socket->waitForReadyRead(50);
+            socket->readAll();
+        }
+    }
+
+    std::atomic_bool ready{false}, stopped{false};
+    std::mutex mutex;
+    std::vector<QByteArray> pending;
+    mp::AutoJoinThread thread;
+};
+
+struct LXDEvents : public Test
+{
+    void wait_until_listening(mp::LXDEvents& events)
+    {
+        for (auto attempts = 0; attempts < 200 && !events.listening(); ++attempts)
+            QThread::msleep(10);
+        ASSERT_TRUE(events.listening());
+    }
+
+    mpt::TempDir temp_dir;
+    QString socket_path{temp_dir.path() + "/lxd.socket"};
+    QUrl base_url{QString("unix://%1@1.0").arg(socket_path)};
+};
+} // namespace
+
+TEST_F(LXDEvents, does_not_listen_without_lxd)
+{
+    mp::LXDEvents events{base_url};
+    events.watch_operation("foo");
+
+    int generation{0};
+    EXPECT_FALSE(events.listening());
+    EXPECT_EQ(events.wait_for_operation("foo", generation, 10ms), mp::nullopt);
+}
+
+TEST_F(LXDEvents, hands_operation_updates_to_waiters)
+{
+    FakeEventsServer server{socket_path};
+    mp::LXDEvents events{base_url};
+    wait_until_listening(events);
+
+    events.watch_operation("foo");
+    server.send(R"({"type": "operation", "metadata": {"id": "foo", "status_code": 200}})");
+
+    int generation{0};
+    auto operation = events.wait_for_operation("foo", generation, 5s);
+    ASSERT_TRUE(operation);
+    EXPECT_EQ((*operation)["status_code"].toInt(), 200);
+    EXPECT_EQ(generation, 1);
+}
+
+TEST_F(LXDEvents, ignores_operations_not_watched)
+{
+    FakeEventsServer server{socket_path};
+    mp::LXDEvents events{base_url};
+    wait_until_listening(events);
+
+    events.handle_event(R"({"type": "operation", "metadata": {"id": "foo", "status_code": 200}})");
+    events.watch_operation("foo");
+
+    int generation{0};
+    EXPECT_EQ(events.wait_for_operation("foo", generation, 10ms), mp::nullopt);
+}
+
+TEST_F(LXDEvents, lifecycle_events_drop_cached_status_codes)
+{
+    FakeEventsServer server{socket_path};
+    mp::LXDEvents events{base_url};
+    wait_until_listening(events);
+
+    unsigned changes{0};
+    EXPECT_EQ(events.cached_status_code("pied-piper-valley", changes), mp::nullopt);
+    events.cache_status_code("pied-piper-valley", 103, changes);
+    EXPECT_EQ(events.cached_status_code("pied-piper-valley", changes), 103);
+
+    events.handle_event(R"({"type": "lifecycle", "metadata": {"action": "instance-stopped",
+                            "source": "/1.0/virtual-machines/pied-piper-valley?project=multipass"}})");
+    EXPECT_EQ(events.cached_status_code("pied-piper-valley", changes), mp::nullopt);
+}
+
+TEST_F(LXDEvents, does_not_cache_status_codes_fetched_before_a_change)
+{
+    FakeEventsServer server{socket_path};
+    mp::LXDEvents events{base_url};
+    wait_until_listening(events);
+
+    unsigned changes{0};
+    events.cached_status_code("pied-piper-valley", changes);
+    events.handle_event(R"({"type": "lifecycle", "metadata": {"action": "instance-started",
+                            "source": "/1.0/virtual-machines/pied-piper-valley"}})");
+    events.cache_status_code("pied-piper-valley", 102, changes);
+
+    EXPECT_EQ(events.cached_status_code("pied-piper-valley", changes), mp::nullopt);
+}
+
+TEST_F(LXDEvents, counts_image_lifecycle_events)
+{
+    FakeEventsServer server{socket_path};
+    mp::LXDEvents events{base_url};
+    wait_until_listening(events);
+
+    const auto before = events.image_changes();
+    events.handle_event(R"({"type": "lifecycle", "metadata": {"action": "image-deleted",
+                            "source": "/1.0/images/d4e5f6?project=multipass"}})");
+    EXPECT_EQ(events.image_changes(), before + 1);
+
+    events.handle_event(R"({"type": "lifecycle", "metadata": {"action": "instance-started",
+                            "source": "/1.0/virtual-machines/pied-piper-valley"}})");
+    EXPECT_EQ(events.image_changes(), before + 1);
+}
@@ -15,6 +15,7 @@
  *
  */
 
+#include <src/platform/backends/lxd/lxd_base_instances.h>
 #include <src/platform/backends/lxd/lxd_vm_image_vault.h>
 
 #include "mock_local_socket_reply.h"
@@ -542,6 +543,46 @@ TEST_F(LXDImageVault, update_image_downloads_new_and_deletes_old_and_logs_expect
     EXPECT_TRUE(delete_requested);
 }
 
+TEST_F(LXDImageVault, update_image_removes_the_base_instance_of_the_old_image)
+{
+    QStringList deleted_instances;
+
+    ON_CALL(*mock_network_access_manager.get(), createRequest(_, _, _))
+        .WillByDefault([&deleted_instances](auto, auto request, auto) {
+            auto op = request.attribute(QNetworkRequest::CustomVerbAttribute).toString();
+            auto url = request.url().toString();
+
+            if (op == "GET" && url.contains("1.0/images"))
+            {
+                return new mpt::MockLocalSocketReply(mpt::image_info_update_source_info);
+            }
+            else if (op == "POST" && url.contains("1.0/images"))
+            {
+                return new mpt::MockLocalSocketReply(mpt::image_download_task_data);
+            }
+            else if (op == "DELETE" && url.contains("1.0/images"))
+            {
+                return new mpt::MockLocalSocketReply(mpt::image_delete_task_data);
+            }
+            else if (op == "DELETE" && url.contains("1.0/virtual-machines/"))
+            {
+                deleted_instances << url.section('/', -1);
+                return new mpt::MockLocalSocketReply(R"({"type": "sync", "status_code": 200, "metadata": {}})");
+            }
+
+            return new mpt::MockLocalSocketReply(mpt::not_found_data, QNetworkReply::ContentNotFoundError);
+        });
+
+    mp::LXDBaseInstances bases{mock_network_access_manager.get(), base_url};
+    mp::LXDVMImageVault image_vault{hosts,       &stub_url_downloader, mock_network_access_manager.get(),
+                                    base_url,    cache_dir.path(),     mp::days{0},
+                                    nullptr,     &bases};
+
+    image_vault.update_images(mp::FetchType::ImageOnly, stub_prepare, stub_monitor);
+
+    EXPECT_THAT(deleted_instances, ElementsAre("multipass-base-aedb5a84aaf2e4e443e090511156366a"));
+}
+
 TEST_F(LXDImageVault, update_image_not_downloaded_when_no_new_image)
 {
     bool download_requested{false};
@@ -653,6 +694,42 @@ TEST_F(LXDImageVault, image_hash_delete_requested_on_expiration)
     EXPECT_TRUE(delete_requested);
 }
 
+TEST_F(LXDImageVault, prune_removes_the_base_instance_of_the_expired_image)
+{
+    QStringList deleted_instances;
+
+    ON_CALL(*mock_network_access_manager.get(), createRequest(_, _, _))
+        .WillByDefault([&deleted_instances](auto, auto request, auto) {
+            auto op = request.attribute(QNetworkRequest::CustomVerbAttribute).toString();
+            auto url = request.url().toString();
+
+            if (op == "GET" && url.contains("1.0/images"))
+            {
+                return new mpt::MockLocalSocketReply(mpt::image_info_data);
+            }
+            else if (op == "DELETE" && url.contains("1.0/images"))
+            {
+                return new mpt::MockLocalSocketReply(mpt::image_delete_task_data);
+            }
+            else if (op == "DELETE" && url.contains("1.0/virtual-machines/"))
+            {
+                deleted_instances << url.section('/', -1);
+                return new mpt::MockLocalSocketReply(R"({"type": "sync", "status_code": 200, "metadata": {}})");
+            }
+
+            return new mpt::MockLocalSocketReply(mpt::not_found_data, QNetworkReply::ContentNotFoundError);
+        });
+
+    mp::LXDBaseInstances bases{mock_network_access_manager.get(), base_url};
+    mp::LXDVMImageVault image_vault{hosts,       &stub_url_downloader, mock_network_access_manager.get(),
+                                    base_url,    cache_dir.path(),     mp::days{0},
+                                    nullptr,     &bases};
+
+    image_vault.prune_expired_images();
+
+    EXPECT_THAT(deleted_instances, ElementsAre("multipass-base-e3b0c44298fc1c149afbf4c8996fb924"));
+}
+
 TEST_F(LXDImageVault, prune_uses_last_update_property_on_new_unused_image)
 {
     bool delete_requested{false};
@@ -773,32 +850,42 @@ TEST_F(LXDImageVault, custom_image_found_returns_expected_info)
     EXPECT_EQ(image.release_date, mpt::snapcraft_image_version);
 }
 
-TEST_F(LXDImageVault, custom_image_downloads_and_creates_correct_upload)
+TEST_F(LXDImageVault, image_list_is_reused_across_fetches)
 {
-    const std::string content{"This is a fake image!"};
-    mpt::TrackingURLDownloader url_downloader{content};
-    auto factory = mpt::MockProcessFactory::Inject();
-    factory->register_callback([](mpt::MockProcess* process) {
-        if (process->program().startsWith("tar"))
-        {
-            auto tar_args = process->arguments();
+    int list_requests{0};
+    ON_CALL(*mock_network_access_manager.get(), createRequest(_, _, _))
+        .WillByDefault([&list_requests](auto, auto request, auto) {
+            auto op = request.attribute(QNetworkRequest::CustomVerbAttribute).toString();
+            auto url = request.url().toString();
 
-            EXPECT_EQ(tar_args.size(), 5);
-            QFile output_file{tar_args[1]}, input_file{tar_args[3] + "/" + tar_args[4]};
+            if (op == "GET" && url.contains("1.0/images?recursion=1"))
+            {
+                ++list_requests;
+                return new mpt::MockLocalSocketReply(mpt::image_info_data);
+            }
+
+            return new mpt::MockLocalSocketReply(mpt::not_found_data, QNetworkReply::ContentNotFoundError);
+        });
 
-            output_file.open(QIODevice::WriteOnly);
-            input_file.open(QIODevice::ReadOnly);
+    mp::LXDVMImageVault image_vault{hosts,    &stub_url_downloader, mock_network_access_manager.get(),
+                                    base_url, cache_dir.path(),     mp::days{0}};
 
-            output_file.write(input_file.readAll());
+    const mp::Query query{"", "snapcraft", false, "release", mp::Query::Type::Alias};
+    image_vault.fetch_image(mp::FetchType::ImageOnly, query, stub_prepare, stub_monitor);
+    auto image = image_vault.fetch_image(mp::FetchType::ImageOnly, query, stub_prepare, stub_monitor);
 
-            mp::ProcessState exit_state;
-            exit_state.exit_code = 0;
-            ON_CALL(*process, execute(_)).WillByDefault(Return(exit_state));
-        }
-    });
+    EXPECT_EQ(image.id, mpt::lxd_snapcraft_image_id);
+    EXPECT_EQ(list_requests, 1);
+}
+
+TEST_F(LXDImageVault, custom_image_downloads_and_creates_correct_upload)
+{
+    const std::string content{"This is a fake image!"};
+    mpt::TrackingURLDownloader url_downloader{content};
+    auto factory = mpt::MockProcessFactory::Inject();
 
     ON_CALL(*mock_network_access_manager.get(), createRequest(_, _, _))
-        .WillByDefault([](auto, auto request, auto outgoingData) {
+        .WillByDefault([&content](auto, auto request, auto outgoingData) {
             auto op = request.attribute(QNetworkRequest::CustomVerbAttribute).toString();
             auto url = request.url().toString();
 
@@ -809,6 +896,12 @@ TEST_F(LXDImageVault, custom_image_downloads_and_creates_correct_upload)
                 EXPECT_TRUE(content_header.contains("multipart/form-data"));
                 EXPECT_TRUE(content_header.contains("boundary"));
 
+                outgoingData->open(QIODevice::ReadOnly);
+                const auto body = outgoingData->readAll();
+                EXPECT_TRUE(body.contains("metadata.yaml"));
+                EXPECT_TRUE(body.contains(QByteArray("ustar\0" "00", 8)));
+                EXPECT_TRUE(body.contains(content.c_str()));
+
                 return new mpt::MockLocalSocketReply(mpt::image_upload_task_data);
             }
             else if (op == "GET" && url.contains("1.0/operations/dcce4fda-aab9-4117-89c1-9f42b8e3f4a8"))
@@ -926,24 +1019,6 @@ TEST_F(LXDImageVault, http_based_image_downloads_and_creates_correct_upload)
     const std::string content{"This is a fake image!"};
     mpt::TrackingURLDownloader url_downloader{content};
     auto factory = mpt::MockProcessFactory::Inject();
-    factory->register_callback([](mpt::MockProcess* process) {
-        if (process->program().startsWith("tar"))
-        {
-            auto tar_args = process->arguments();
-
-            EXPECT_EQ(tar_args.size(), 5);
-            QFile output_file{tar_args[1]}, input_file{tar_args[3] + "/" + tar_args[4]};
-
-            output_file.open(QIODevice::WriteOnly);
-            input_file.open(QIODevice::ReadOnly);
-
-            output_file.write(input_file.readAll());
-
-            mp::ProcessState exit_state;
-            exit_state.exit_code = 0;
-            ON_CALL(*process, execute(_)).WillByDefault(Return(exit_state));
-        }
-    });
 
     ON_CALL(*mock_network_access_manager, createRequest(_, _, _))
         .WillByDefault([](auto, auto request, auto outgoingData) {
@@ -992,24 +1067,6 @@ TEST_F(LXDImageVault, file_based_fetch_copies_image_and_returns_expected_info)
     mpt::TempFile file;
 
     auto factory = mpt::MockProcessFactory::Inject();
-    factory->register_callback([](mpt::MockProcess* process) {
-        if (process->program().startsWith("tar"))
-        {
-            auto tar_args = process->arguments();
-
-            EXPECT_EQ(tar_args.size(), 5);
-            QFile output_file{tar_args[1]}, input_file{tar_args[3] + "/" + tar_args[4]};
-
-            output_file.open(QIODevice::WriteOnly);
-            input_file.open(QIODevice::ReadOnly);
-
-            output_file.write(input_file.readAll());
-
-            mp::ProcessState exit_state;
-            exit_state.exit_code = 0;
-            ON_CALL(*process, execute(_)).WillByDefault(Return(exit_state));
-        }
-    });
 
     ON_CALL(*mock_network_access_manager, createRequest(_, _, _))
         .WillByDefault([](auto, auto request, auto outgoingData) {
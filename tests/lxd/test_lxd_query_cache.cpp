@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <src/platform/backends/lxd/lxd_query_cache.h>
+
+#include "mock_local_socket_reply.h"
+#include "mock_lxd_server_responses.h"
+#include "mock_network_access_manager.h"
+
+#include <QUrl>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace
+{
+const QByteArray instances_data{R"({"type": "sync", "status_code": 200, "metadata": [
+    {"name": "foo", "state": {"status": "Running", "status_code": 103}},
+    {"name": "bar", "state": {"status": "Stopped", "status_code": 102}}]})"};
+const QByteArray leases_data{R"({"type": "sync", "status_code": 200, "metadata": [
+    {"hostname": "foo", "hwaddr": "00:16:3e:fe:f2:b9", "address": "10.217.27.168", "type": "dynamic"}]})"};
+
+struct LXDQueryCache : public Test
+{
+    LXDQueryCache()
+    {
+        ON_CALL(mock_network_access_manager, createRequest(_, _, _)).WillByDefault([this](auto, auto request, auto) {
+            const auto url = request.url().toString();
+
+            if (url.contains("1.0/virtual-machines?recursion=2"))
+            {
+                ++instance_requests;
+                return new mpt::MockLocalSocketReply(instances_data);
+            }
+            else if (url.contains("1.0/networks/mpbr0/leases"))
+            {
+                ++lease_requests;
+                return new mpt::MockLocalSocketReply(leases_data);
+            }
+
+            return new mpt::MockLocalSocketReply(mpt::not_found_data, QNetworkReply::ContentNotFoundError);
+        });
+    }
+
+    NiceMock<mpt::MockNetworkAccessManager> mock_network_access_manager;
+    QUrl base_url{"unix:///foo@1.0"};
+    int instance_requests{0}, lease_requests{0};
+};
+} // namespace
+
+TEST_F(LXDQueryCache, answers_for_all_instances_from_one_request)
+{
+    mp::LXDQueryCache queries{&mock_network_access_manager, base_url};
+
+    const auto foo_state = queries.instance_state("foo");
+    const auto bar_state = queries.instance_state("bar");
+
+    ASSERT_TRUE(foo_state);
+    ASSERT_TRUE(bar_state);
+    EXPECT_EQ((*foo_state)["status_code"].toInt(), 103);
+    EXPECT_EQ((*bar_state)["status_code"].toInt(), 102);
+    EXPECT_EQ(instance_requests, 1);
+}
+
+TEST_F(LXDQueryCache, does_not_know_instances_missing_from_the_listing)
+{
+    mp::LXDQueryCache queries{&mock_network_access_manager, base_url};
+
+    EXPECT_EQ(queries.instance_state("baz"), mp::nullopt);
+    EXPECT_EQ(instance_requests, 1);
+}
+
+TEST_F(LXDQueryCache, does_not_know_instances_when_listing_fails)
+{
+    ON_CALL(mock_network_access_manager, createRequest(_, _, _)).WillByDefault([](auto...) {
+        return new mpt::MockLocalSocketReply(mpt::not_found_data, QNetworkReply::ContentNotFoundError);
+    });
+    mp::LXDQueryCache queries{&mock_network_access_manager, base_url};
+
+    EXPECT_EQ(queries.instance_state("foo"), mp::nullopt);
+}
+
+TEST_F(LXDQueryCache, asks_again_once_answers_are_old)
+{
+    mp::LXDQueryCache queries{&mock_network_access_manager, base_url, 0ms};
+
+    queries.instance_state("foo");
+    queries.instance_state("foo");
+
+    EXPECT_EQ(instance_requests, 2);
+}
+
+TEST_F(LXDQueryCache, asks_again_once_invalidated)
+{
+    mp::LXDQueryCache queries{&mock_network_access_manager, base_url};
+
+    queries.instance_state("foo");
+    queries.leases("mpbr0");
+    queries.invalidate();
+    queries.instance_state("foo");
+    queries.leases("mpbr0");
+
+    EXPECT_EQ(instance_requests, 2);
+    EXPECT_EQ(lease_requests, 2);
+}
+
+TEST_F(LXDQueryCache, fetches_leases_once_per_network)
+{
+    mp::LXDQueryCache queries{&mock_network_access_manager, base_url};
+
+    EXPECT_EQ(queries.leases("mpbr0").size(), 1);
+    EXPECT_EQ(queries.leases("mpbr0").size(), 1);
+    EXPECT_EQ(lease_requests, 1);
+}
@@ -30,6 +30,8 @@ int main(int argc, char* argv[])
 {
     QCoreApplication app(argc, argv);
     QCoreApplication::setApplicationName("multipass_tests");
+    // Tests run as root would otherwise have the process factory rearrange the host's cgroups around them
+    qputenv("DISABLE_CGROUPS", "1");
 
     ::testing::InitGoogleTest(&argc, argv);
     mp::test::MockStandardPaths::mockit();
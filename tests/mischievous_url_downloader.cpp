@@ -30,6 +30,12 @@ void mpt::MischievousURLDownloader::download_to(const QUrl& url, const QString&
     URLDownloader::download_to(choose_url(url), file_name, size, download_type, monitor);
 }
 
+QString mpt::MischievousURLDownloader::download_and_hash_to(const QUrl& url, const QString& file_name, int64_t size,
+                                                        const int download_type, const mp::ProgressMonitor& monitor)
+{
+    return URLDownloader::download_and_hash_to(choose_url(url), file_name, size, download_type, monitor);
+}
+
 QByteArray mpt::MischievousURLDownloader::download(const QUrl& url)
 {
     return URLDownloader::download(choose_url(url));
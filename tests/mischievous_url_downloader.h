@@ -22,6 +22,8 @@
 
 #include <QUrl>
 
+#include <atomic>
+
 namespace multipass
 {
 namespace test
@@ -33,11 +35,13 @@ public:
 
     void download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
                      const ProgressMonitor& monitor) override;
+    QString download_and_hash_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                                 const ProgressMonitor& monitor) override;
     QByteArray download(const QUrl& url) override;
     QDateTime last_modified(const QUrl& url) override;
 
 public:
-    int mischiefs = 0;
+    std::atomic_int mischiefs{0}; // image hosts fetch their remotes concurrently
 
 private:
     const QUrl& choose_url(const QUrl& url);
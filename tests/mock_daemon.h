@@ -31,26 +31,47 @@ struct MockDaemon : public Daemon
 {
     using Daemon::Daemon;
 
-    MOCK_METHOD3(create, void(const CreateRequest*, grpc::ServerWriter<CreateReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(launch, void(const LaunchRequest*, grpc::ServerWriter<LaunchReply>*, std::promise<grpc::Status>*));
+    MOCK_METHOD3(create,
+                 void(const CreateRequest*, grpc::ServerWriterInterface<CreateReply>*, std::promise<grpc::Status>*));
+    MOCK_METHOD3(launch,
+                 void(const LaunchRequest*, grpc::ServerWriterInterface<LaunchReply>*, std::promise<grpc::Status>*));
     MOCK_METHOD3(purge, void(const PurgeRequest*, grpc::ServerWriter<PurgeReply>*, std::promise<grpc::Status>*));
     MOCK_METHOD3(find, void(const FindRequest* request, grpc::ServerWriter<FindReply>*, std::promise<grpc::Status>*));
     MOCK_METHOD3(info, void(const InfoRequest*, grpc::ServerWriter<InfoReply>*, std::promise<grpc::Status>*));
     MOCK_METHOD3(list, void(const ListRequest*, grpc::ServerWriter<ListReply>*, std::promise<grpc::Status>*));
     MOCK_METHOD3(mount,
-                 void(const MountRequest* request, grpc::ServerWriter<MountReply>*, std::promise<grpc::Status>*));
+                 void(const MountRequest* request, grpc::ServerWriterInterface<MountReply>*,
+                      std::promise<grpc::Status>*));
     MOCK_METHOD3(recover, void(const RecoverRequest*, grpc::ServerWriter<RecoverReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(ssh_info, void(const SSHInfoRequest*, grpc::ServerWriter<SSHInfoReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(start, void(const StartRequest*, grpc::ServerWriter<StartReply>*, std::promise<grpc::Status>*));
+    MOCK_METHOD4(ssh_info,
+                 void(const SSHInfoRequest*, grpc::ServerWriter<SSHInfoReply>*, bool, std::promise<grpc::Status>*));
+    MOCK_METHOD3(start,
+                 void(const StartRequest*, grpc::ServerWriterInterface<StartReply>*, std::promise<grpc::Status>*));
     MOCK_METHOD3(stop, void(const StopRequest*, grpc::ServerWriter<StopReply>*, std::promise<grpc::Status>*));
     MOCK_METHOD3(suspend, void(const SuspendRequest*, grpc::ServerWriter<SuspendReply>*, std::promise<grpc::Status>*));
-    MOCK_METHOD3(restart, void(const RestartRequest*, grpc::ServerWriter<RestartReply>*, std::promise<grpc::Status>*));
+    MOCK_METHOD3(restart,
+                 void(const RestartRequest*, grpc::ServerWriterInterface<RestartReply>*, std::promise<grpc::Status>*));
     MOCK_METHOD3(delet, void(const DeleteRequest*, grpc::ServerWriter<DeleteReply>*, std::promise<grpc::Status>*));
     MOCK_METHOD3(umount, void(const UmountRequest*, grpc::ServerWriter<UmountReply>*, std::promise<grpc::Status>*));
     MOCK_METHOD3(version, void(const VersionRequest*, grpc::ServerWriter<VersionReply>*, std::promise<grpc::Status>*));
+    MOCK_METHOD3(bake, void(const BakeRequest*, grpc::ServerWriter<BakeReply>*, std::promise<grpc::Status>*));
+    MOCK_METHOD3(stats, void(const StatsRequest*, grpc::ServerWriter<StatsReply>*, std::promise<grpc::Status>*));
+    MOCK_METHOD3(bench_mount,
+                 void(const BenchMountRequest*, grpc::ServerWriter<BenchMountReply>*, std::promise<grpc::Status>*));
+    MOCK_METHOD3(throttle,
+                 void(const ThrottleRequest*, grpc::ServerWriter<ThrottleReply>*, std::promise<grpc::Status>*));
+    MOCK_METHOD3(clone, void(const CloneRequest*, grpc::ServerWriter<CloneReply>*, std::promise<grpc::Status>*));
+    MOCK_METHOD3(forward,
+                 void(const ForwardRequest*, grpc::ServerWriter<ForwardReply>*, std::promise<grpc::Status>*));
+    MOCK_METHOD3(capacity,
+                 void(const CapacityRequest*, grpc::ServerWriter<CapacityReply>*, std::promise<grpc::Status>*));
+    MOCK_METHOD3(copy_files,
+                 void(const CopyFilesRequest*, grpc::ServerWriter<CopyFilesReply>*, std::promise<grpc::Status>*));
+    MOCK_METHOD3(resize, void(const ResizeRequest*, grpc::ServerWriter<ResizeReply>*, std::promise<grpc::Status>*));
 
     template <typename Request, typename Reply>
-    void set_promise_value(const Request*, grpc::ServerWriter<Reply>*, std::promise<grpc::Status>* status_promise)
+    void set_promise_value(const Request*, grpc::ServerWriterInterface<Reply>*,
+                           std::promise<grpc::Status>* status_promise)
     {
         status_promise->set_value(grpc::Status::OK);
     }
@@ -35,6 +35,7 @@ public:
     MOCK_METHOD2(rmdir, bool(QDir&, const QString& dirName));
     MOCK_METHOD2(open, bool(QFile&, QIODevice::OpenMode));
     MOCK_METHOD3(read, qint64(QFile&, char*, qint64));
+    MOCK_METHOD4(read_at, qint64(QFile&, char*, qint64, qint64));
     MOCK_METHOD1(remove, bool(QFile&));
     MOCK_METHOD2(rename, bool(QFile&, const QString& newName));
     MOCK_METHOD2(resize, bool(QFile&, qint64 sz));
@@ -42,6 +43,11 @@ public:
     MOCK_METHOD2(setPermissions, bool(QFile&, QFileDevice::Permissions));
     MOCK_METHOD3(write, qint64(QFile&, const char*, qint64));
     MOCK_METHOD2(write, qint64(QFile&, const QByteArray&));
+    MOCK_METHOD4(write_at, qint64(QFile&, const char*, qint64, qint64));
+    MOCK_METHOD5(copy_range, qint64(QFile&, qint64, QFile&, qint64, qint64));
+    MOCK_METHOD1(sync, bool(QFile&));
+    MOCK_METHOD3(advise_will_need, bool(QFile&, qint64, qint64));
+    MOCK_METHOD1(submit, bool(std::vector<IoRequest>&));
 
     MP_MOCK_SINGLETON_BOILERPLATE(MockFileOps, FileOps);
 };
@@ -41,6 +41,12 @@ public:
     MOCK_CONST_METHOD3(log, void(multipass::logging::Level level, multipass::logging::CString category,
                                  multipass::logging::CString message));
 
+    // Take everything, whatever the level, so that tests can set expectations on any message
+    bool enabled_for(multipass::logging::Level) const override
+    {
+        return true;
+    }
+
     class Scope
     {
     public:
@@ -69,6 +69,11 @@ public:
         setHeader(header, value);
     }
 
+    void set_raw_header(const QByteArray& header, const QByteArray& value)
+    {
+        setRawHeader(header, value);
+    }
+
 public Q_SLOTS:
     MOCK_METHOD0(abort, void());
 };
@@ -38,6 +38,8 @@ public:
     MOCK_METHOD2(link, bool(const char*, const char*));
     MOCK_METHOD3(symlink, bool(const char*, const char*, bool));
     MOCK_METHOD3(utime, int(const char*, int, int));
+    MOCK_METHOD2(clone_file, bool(const char*, const char*));
+    MOCK_METHOD1(file_identity, std::string(const char*));
 
     MP_MOCK_SINGLETON_BOILERPLATE(MockPlatform, Platform);
 };
@@ -25,16 +25,19 @@ using namespace ::testing;
 
 std::unique_ptr<mp::Process> mpt::MockProcessFactory::create_process(std::unique_ptr<mp::ProcessSpec>&& spec) const
 {
-    auto process = std::make_unique<NiceMock<mpt::MockProcess>>(std::move(spec),
-                                                                const_cast<std::vector<ProcessInfo>&>(process_list));
+    auto process = std::make_unique<NiceMock<mpt::MockProcess>>(std::move(spec));
+    {
+        // Processes may be created on other threads, such as those of execute_async()
+        std::lock_guard<decltype(process_list_mutex)> lock{process_list_mutex};
+        process_list.push_back({process->program(), process->arguments()});
+    }
+
     if (callback)
         (*callback)(process.get());
     return process;
 }
 
-mpt::MockProcess::MockProcess(std::unique_ptr<mp::ProcessSpec>&& spec,
-                              std::vector<mpt::MockProcessFactory::ProcessInfo>& process_list)
-    : spec{std::move(spec)}
+mpt::MockProcess::MockProcess(std::unique_ptr<mp::ProcessSpec>&& spec) : spec{std::move(spec)}
 {
     success_exit_state.exit_code = 0;
 
@@ -48,9 +51,6 @@ mpt::MockProcess::MockProcess(std::unique_ptr<mp::ProcessSpec>&& spec,
     ON_CALL(*this, process_state()).WillByDefault(Return(success_exit_state));
     ON_CALL(*this, execute(_)).WillByDefault(Return(success_exit_state));
     ON_CALL(*this, wait_for_started(_)).WillByDefault(Return(true));
-
-    mpt::MockProcessFactory::ProcessInfo p{program(), arguments()};
-    process_list.emplace_back(p);
 }
 
 void mpt::MockProcessFactory::register_callback(const mpt::MockProcessFactory::Callback& cb)
@@ -72,7 +72,9 @@ mpt::MockProcessFactory::Scope::~Scope()
 
 std::vector<mpt::MockProcessFactory::ProcessInfo> mpt::MockProcessFactory::Scope::process_list()
 {
-    return mock_instance().process_list;
+    auto& factory = mock_instance();
+    std::lock_guard<decltype(factory.process_list_mutex)> lock{factory.process_list_mutex};
+    return factory.process_list;
 }
 
 mpt::MockProcessFactory& mpt::MockProcessFactory::mock_instance()
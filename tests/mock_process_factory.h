@@ -24,6 +24,7 @@
 #include <multipass/process/process.h>
 
 #include <functional>
+#include <mutex>
 
 using namespace testing;
 
@@ -66,7 +67,8 @@ public:
 private:
     static MockProcessFactory& mock_instance();
     void register_callback(const Callback& callback);
-    std::vector<ProcessInfo> process_list;
+    mutable std::mutex process_list_mutex;
+    mutable std::vector<ProcessInfo> process_list;
     multipass::optional<Callback> callback;
 };
 
@@ -85,7 +87,7 @@ public:
     MOCK_METHOD1(wait_for_started, bool(int msecs));
     MOCK_METHOD1(wait_for_finished, bool(int msecs));
 
-    MockProcess(std::unique_ptr<ProcessSpec>&& spec, std::vector<MockProcessFactory::ProcessInfo>& process_list);
+    explicit MockProcess(std::unique_ptr<ProcessSpec>&& spec);
 
     QString program() const override;
     QStringList arguments() const override;
@@ -28,7 +28,18 @@ DECL_MOCK(sftp_init);
 DECL_MOCK(sftp_open);
 DECL_MOCK(sftp_write);
 DECL_MOCK(sftp_read);
+DECL_MOCK(sftp_async_read_begin);
+DECL_MOCK(sftp_async_read);
 DECL_MOCK(sftp_get_error);
+DECL_MOCK(sftp_stat);
+DECL_MOCK(sftp_mkdir);
+DECL_MOCK(sftp_chmod);
+DECL_MOCK(sftp_setstat);
+DECL_MOCK(sftp_utimes);
+DECL_MOCK(sftp_opendir);
+DECL_MOCK(sftp_readdir);
+DECL_MOCK(sftp_dir_eof);
+DECL_MOCK(sftp_closedir);
 DECL_MOCK(sftp_close);
 
 #endif // MULTIPASS_MOCK_SFTP_H
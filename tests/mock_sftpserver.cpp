@@ -20,6 +20,9 @@ extern "C"
 {
     IMPL_MOCK_DEFAULT(2, sftp_server_new);
     IMPL_MOCK_DEFAULT(1, sftp_server_init);
+    IMPL_MOCK_DEFAULT(1, sftp_packet_read);
+    IMPL_MOCK_DEFAULT(3, sftp_packet_write);
+    IMPL_MOCK_DEFAULT(1, sftp_packet_free);
     IMPL_MOCK_DEFAULT(3, sftp_reply_status);
     IMPL_MOCK_DEFAULT(2, sftp_reply_attr);
     IMPL_MOCK_DEFAULT(3, sftp_reply_data);
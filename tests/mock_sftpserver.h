@@ -24,6 +24,9 @@
 
 DECL_MOCK(sftp_server_new);
 DECL_MOCK(sftp_server_init);
+DECL_MOCK(sftp_packet_read);
+DECL_MOCK(sftp_packet_write);
+DECL_MOCK(sftp_packet_free);
 DECL_MOCK(sftp_reply_status);
 DECL_MOCK(sftp_reply_attr);
 DECL_MOCK(sftp_reply_data);
@@ -29,6 +29,8 @@ struct MockURLDownloader : public multipass::URLDownloader
     MockURLDownloader() : URLDownloader{std::chrono::seconds(10)} {};
 
     MOCK_METHOD5(download_to, void(const QUrl&, const QString&, int64_t, const int, const ProgressMonitor&));
+    MOCK_METHOD3(download_range, QByteArray(const QUrl&, qint64, qint64));
+    MOCK_METHOD1(last_modified, QDateTime(const QUrl&));
 };
 } // namespace test
 } // namespace multipass
@@ -56,6 +56,11 @@ struct MockVirtualMachine : public multipass::VirtualMachine
     MOCK_METHOD0(ensure_vm_is_running, void());
     MOCK_METHOD1(wait_until_ssh_up, void(std::chrono::milliseconds));
     MOCK_METHOD0(update_state, void());
+    MOCK_METHOD0(metrics, Metrics());
+    MOCK_METHOD1(set_io_limits, void(const IoLimits&));
+    MOCK_METHOD0(compact_disk, long long());
+    MOCK_METHOD2(resize, void(int, const MemorySize&));
+    MOCK_METHOD3(run_after_resume, bool(const std::string&, const SSHKeyProvider&, std::chrono::milliseconds));
 };
 } // namespace test
 } // namespace multipass
@@ -33,10 +33,14 @@ struct MockVirtualMachineFactory : public VirtualMachineFactory
 {
     MOCK_METHOD2(create_virtual_machine, VirtualMachine::UPtr(const VirtualMachineDescription&, VMStatusMonitor&));
     MOCK_METHOD1(remove_resources_for, void(const std::string&));
+    MOCK_METHOD2(rename_resources_for, void(const std::string&, const std::string&));
+    MOCK_CONST_METHOD0(can_rename_resources, bool());
+    MOCK_CONST_METHOD1(can_limit_io, bool(const IoLimits&));
+    MOCK_METHOD2(clone_suspended_state, void(const VMImage&, const VMImage&));
 
     MOCK_METHOD0(fetch_type, FetchType());
     MOCK_METHOD1(prepare_networking, void(std::vector<NetworkInterface>&));
-    MOCK_METHOD1(prepare_source_image, VMImage(const VMImage&));
+    MOCK_METHOD2(prepare_source_image, VMImage(const VMImage&, const ProgressMonitor&));
     MOCK_METHOD2(prepare_instance_image, void(const VMImage&, const VirtualMachineDescription&));
     MOCK_METHOD0(hypervisor_health_check, void());
     MOCK_METHOD0(get_backend_directory_name, QString());
@@ -45,6 +49,7 @@ struct MockVirtualMachineFactory : public VirtualMachineFactory
                  VMImageVault::UPtr(std::vector<VMImageHost*>, URLDownloader*, const Path&, const Path&, const days&));
     MOCK_METHOD1(configure, void(VirtualMachineDescription&));
     MOCK_CONST_METHOD0(networks, std::vector<NetworkInterfaceInfo>());
+    MOCK_CONST_METHOD0(host_address, std::string());
 };
 }
 }
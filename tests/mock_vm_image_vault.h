@@ -46,11 +46,16 @@ public:
     MOCK_METHOD4(fetch_image, VMImage(const FetchType&, const Query&, const PrepareAction&, const ProgressMonitor&));
     MOCK_METHOD1(remove, void(const std::string&));
     MOCK_METHOD1(has_record_for, bool(const std::string&));
+    MOCK_METHOD2(rename, VMImage(const std::string&, const std::string&));
+    MOCK_METHOD2(bake, VMImage(const std::string&, const std::string&));
+    MOCK_METHOD2(clone, VMImage(const std::string&, const std::string&));
+    MOCK_METHOD2(clone_layered, VMImage(const std::string&, const std::string&));
     MOCK_METHOD0(prune_expired_images, void());
     MOCK_METHOD3(update_images, void(const FetchType&, const PrepareAction&, const ProgressMonitor&));
     MOCK_METHOD1(minimum_image_size_for, MemorySize(const std::string&));
     MOCK_CONST_METHOD1(image_host_for, VMImageHost*(const std::string&));
     MOCK_CONST_METHOD1(all_info_for, std::vector<std::pair<std::string, VMImageInfo>>(const Query&));
+    MOCK_METHOD0(cached_images, std::vector<std::string>());
 
 private:
     TempFile dummy_image;
@@ -50,6 +50,12 @@ int main(int argc, char* argv[])
             {
                 break;
             }
+            else if (execute == "migrate")
+            {
+                std::cout << "{\"timestamp\": {\"seconds\": 1541188919, \"microseconds\": 838498}, \"event\": "
+                             "\"MIGRATION\", \"data\": {\"status\": \"completed\"}}"
+                          << std::endl;
+            }
             else if (execute == "human-monitor-command")
             {
                 auto args = json_object["arguments"].toObject();
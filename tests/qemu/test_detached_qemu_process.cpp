@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <src/platform/backends/qemu/detached_qemu_process.h>
+
+#include "tests/mock_logger.h"
+#include "tests/temp_dir.h"
+
+#include <gmock/gmock.h>
+
+#include <QFile>
+#include <QLocalServer>
+#include <QProcess>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+namespace mpt = multipass::test;
+using namespace testing;
+
+namespace
+{
+struct DetachedQemuProcess : public Test
+{
+    DetachedQemuProcess()
+    {
+        logger_scope.mock_logger->screen_logs(mpl::Level::error);
+
+        // Stands in for a qemu left running on the image; the trailing command keeps the shell from exec-ing sleep
+        qemu.start("sh", {"-c", "sleep 600; :", "sh", image_path});
+        EXPECT_TRUE(qemu.waitForStarted());
+
+        QFile file{pid_file};
+        EXPECT_TRUE(file.open(QIODevice::WriteOnly));
+        file.write(QByteArray::number(qemu.processId()));
+    }
+
+    ~DetachedQemuProcess()
+    {
+        qemu.kill();
+        qemu.waitForFinished();
+    }
+
+    mpt::TempDir instance_dir;
+    const QString image_path{instance_dir.path() + "/image.img"};
+    const QString pid_file{instance_dir.path() + "/image.img.pid"};
+    const QString monitor_socket{instance_dir.path() + "/qmp.sock"};
+    mpt::MockLogger::Scope logger_scope = mpt::MockLogger::inject();
+    QProcess qemu;
+};
+} // namespace
+
+TEST_F(DetachedQemuProcess, adopts_the_qemu_whose_monitor_answers)
+{
+    QLocalServer monitor;
+    ASSERT_TRUE(monitor.listen(monitor_socket));
+
+    const auto process = mp::DetachedQemuProcess::adopt(pid_file, monitor_socket, image_path);
+
+    ASSERT_TRUE(process);
+    EXPECT_EQ(process->process_id(), qemu.processId());
+    EXPECT_EQ(qemu.state(), QProcess::Running);
+}
+
+TEST_F(DetachedQemuProcess, leaves_what_does_not_run_the_image_alone)
+{
+    const auto process = mp::DetachedQemuProcess::adopt(pid_file, monitor_socket, instance_dir.path() + "/other.img");
+
+    EXPECT_FALSE(process);
+    EXPECT_EQ(qemu.state(), QProcess::Running);
+    EXPECT_TRUE(QFile::exists(pid_file));
+}
+
+TEST_F(DetachedQemuProcess, kills_the_qemu_whose_monitor_cannot_be_reached)
+{
+    logger_scope.mock_logger->expect_log(mpl::Level::warning, "killing it");
+
+    const auto process = mp::DetachedQemuProcess::adopt(pid_file, monitor_socket, image_path);
+
+    EXPECT_FALSE(process);
+    EXPECT_TRUE(qemu.waitForFinished(5000));
+    EXPECT_EQ(qemu.exitStatus(), QProcess::CrashExit);
+    EXPECT_FALSE(QFile::exists(pid_file));
+}
@@ -106,6 +106,33 @@ TEST_F(DNSMasqServer, finds_ip)
     EXPECT_THAT(ip.value(), Eq(mp::IPAddress(expected_ip)));
 }
 
+TEST_F(DNSMasqServer, finds_ip_of_lease_changed_after_lookup)
+{
+    auto dns = make_default_dnsmasq_server();
+    make_lease_entry();
+    ASSERT_TRUE(dns.get_ip_for(hw_addr));
+
+    const std::string new_ip{"10.177.224.23"};
+    mpt::make_file_with_content(QDir{data_dir.path()}.filePath("dnsmasq.leases"),
+                                "0 "s + hw_addr + " "s + new_ip + " dummy_name *");
+
+    auto ip = dns.get_ip_for(hw_addr);
+
+    ASSERT_TRUE(ip);
+    EXPECT_THAT(ip.value(), Eq(mp::IPAddress(new_ip)));
+}
+
+TEST_F(DNSMasqServer, forgets_ip_of_lease_gone_after_lookup)
+{
+    auto dns = make_default_dnsmasq_server();
+    make_lease_entry();
+    ASSERT_TRUE(dns.get_ip_for(hw_addr));
+
+    QFile::remove(QDir{data_dir.path()}.filePath("dnsmasq.leases"));
+
+    EXPECT_FALSE(dns.get_ip_for(hw_addr));
+}
+
 TEST_F(DNSMasqServer, returns_null_ip_when_leases_file_does_not_exist)
 {
     auto dns = make_default_dnsmasq_server();
@@ -21,8 +21,11 @@
 #include "tests/mock_process_factory.h"
 #include "tests/reset_process_factory.h"
 
+#include <QFile>
 #include <QString>
 
+#include <algorithm>
+
 namespace mp = multipass;
 namespace mpt = multipass::test;
 using namespace testing;
@@ -39,23 +42,27 @@ struct IPTablesConfig : public Test
     const std::string subnet{"192.168.2"};
 
     mpt::MockProcessFactory::Callback iptables_callback = [this](mpt::MockProcess* process) {
-        if (process->program() == "iptables")
+        if (process->program() == "iptables-save")
         {
-            if (process->arguments().contains(goodbr0))
-            {
-                mp::ProcessState exit_state;
-                exit_state.exit_code = 0;
-                EXPECT_CALL(*process, execute(_)).WillOnce(Return(exit_state));
-            }
-            else if (process->arguments().contains(evilbr0))
-            {
+            ON_CALL(*process, read_all_standard_output()).WillByDefault(Return(saved_rules));
+        }
+        else if (process->program() == "iptables-restore")
+        {
+            EXPECT_CALL(*process, execute(_)).WillOnce([this, process](auto) {
+                QFile rules_file{process->arguments().last()};
+                rules_file.open(QIODevice::ReadOnly);
+                restored_rules << QString::fromUtf8(rules_file.readAll());
+
                 mp::ProcessState exit_state;
-                exit_state.exit_code = 1;
-                EXPECT_CALL(*process, execute(_)).WillOnce(Return(exit_state));
-                ON_CALL(*process, read_all_standard_error()).WillByDefault(Return("Evil bridge detected!\n"));
-            }
+                exit_state.exit_code = restored_rules.last().contains(evilbr0) ? 1 : 0;
+                return exit_state;
+            });
+            ON_CALL(*process, read_all_standard_error()).WillByDefault(Return("Evil bridge detected!\n"));
         }
     };
+
+    QByteArray saved_rules;
+    QStringList restored_rules;
 };
 } // namespace
 
@@ -78,3 +85,46 @@ TEST_F(IPTablesConfig, iptables_error_throws)
 
     EXPECT_THROW(iptables_config.verify_iptables_rules(), std::runtime_error);
 }
+
+TEST_F(IPTablesConfig, applies_all_rules_in_one_restore_without_flushing)
+{
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback(iptables_callback);
+
+    mp::IPTablesConfig iptables_config{goodbr0, subnet};
+
+    auto restores = factory->process_list();
+    restores.erase(std::remove_if(restores.begin(), restores.end(),
+                                  [](const auto& info) { return info.command != "iptables-restore"; }),
+                   restores.end());
+    ASSERT_EQ(restores.size(), 1u);
+    EXPECT_TRUE(restores.front().arguments.contains("--noflush"));
+
+    ASSERT_EQ(restored_rules.size(), 1);
+    const auto& rules = restored_rules.front();
+    EXPECT_TRUE(rules.contains("*filter\n"));
+    EXPECT_TRUE(rules.contains("*nat\n"));
+    EXPECT_TRUE(rules.contains("*mangle\n"));
+    EXPECT_EQ(rules.count("COMMIT\n"), 3);
+    EXPECT_TRUE(rules.contains("--insert INPUT --in-interface goodbr0 --protocol udp --dport 67 --jump ACCEPT "
+                               "--match comment --comment \"generated for Multipass network goodbr0\""));
+    EXPECT_TRUE(rules.contains("--append FORWARD --out-interface goodbr0 --jump REJECT"));
+}
+
+TEST_F(IPTablesConfig, deletes_previous_rules_in_the_same_restore)
+{
+    saved_rules = "*nat\n"
+                  ":POSTROUTING ACCEPT [0:0]\n"
+                  "-A POSTROUTING -s 192.168.2.0/24 -d 224.0.0.0/24 -j RETURN\n"
+                  "-A POSTROUTING -s 10.0.0.0/24 -j MASQUERADE\n"
+                  "COMMIT\n";
+
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback(iptables_callback);
+
+    mp::IPTablesConfig iptables_config{goodbr0, subnet};
+
+    ASSERT_EQ(restored_rules.size(), 1);
+    EXPECT_TRUE(restored_rules.front().contains("-D POSTROUTING -s 192.168.2.0/24 -d 224.0.0.0/24 -j RETURN\n"));
+    EXPECT_FALSE(restored_rules.front().contains("10.0.0.0/24"));
+}
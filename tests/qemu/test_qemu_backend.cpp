@@ -15,13 +15,20 @@
  *
  */
 
+#include <src/platform/backends/qemu/qemu_boot_trace.h>
+#include <src/platform/backends/qemu/qemu_memory_merging.h>
+#include <src/platform/backends/qemu/qemu_placement.h>
 #include <src/platform/backends/qemu/qemu_virtual_machine.h>
 #include <src/platform/backends/qemu/qemu_virtual_machine_factory.h>
 
 #include "mock_dnsmasq_server.h"
 #include "tests/extra_assertions.h"
+#include "tests/file_operations.h"
 #include "tests/mock_environment_helpers.h"
+#include "tests/mock_logger.h"
 #include "tests/mock_process_factory.h"
+#include "tests/mock_settings.h"
+#include "tests/mock_ssh.h"
 #include "tests/mock_status_monitor.h"
 #include "tests/stub_process_factory.h"
 #include "tests/stub_ssh_key_provider.h"
@@ -31,22 +38,102 @@
 #include "tests/test_with_mocked_bin_path.h"
 
 #include <multipass/auto_join_thread.h>
+#include <multipass/constants.h>
 #include <multipass/exceptions/start_exception.h>
 #include <multipass/memory_size.h>
 #include <multipass/platform.h>
 #include <multipass/virtual_machine.h>
 #include <multipass/virtual_machine_description.h>
 
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
 #include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <memory>
 #include <thread>
+#include <utility>
 
 namespace mp = multipass;
+namespace mpl = multipass::logging;
 namespace mpt = multipass::test;
 using namespace testing;
 
 namespace
 { // copied from QemuVirtualMachine implementation
 constexpr auto suspend_tag = "suspend";
+
+QJsonObject vcpu_slot(int socket, bool plugged)
+{
+    QJsonObject slot{{"type", "host-x86_64-cpu"},
+                     {"vcpus-count", 1},
+                     {"props", QJsonObject{{"socket-id", socket}, {"core-id", 0}, {"thread-id", 0}}}};
+    if (plugged)
+        slot["qom-path"] = QString("/machine/unattached/device[%1]").arg(socket);
+
+    return slot;
+}
+
+// Answers the monitor commands written to qemu straight away, as qemu would: with an error for the one given to fail,
+// and with two vCPUs plugged and two slots free when asked about them. Gives what qemu is yet to send, for events
+std::shared_ptr<QByteArray> answer_qmp(mpt::MockProcess* process, std::vector<QString>& commands,
+                                       const QString& failing_command = {})
+{
+    auto output = std::make_shared<QByteArray>();
+    ON_CALL(*process, read_all_standard_output()).WillByDefault([output] { return std::exchange(*output, {}); });
+    ON_CALL(*process, write(_)).WillByDefault([process, output, &commands, failing_command](const QByteArray& data) {
+        const auto command = QJsonDocument::fromJson(data).object();
+        const auto name = command["execute"].toString();
+        commands.push_back(name);
+
+        QJsonObject reply{{"id", command["id"]}};
+        if (name == failing_command)
+            reply["error"] = QJsonObject{{"class", "GenericError"}, {"desc", "no free bus"}};
+        else if (name == "query-hotpluggable-cpus")
+            reply["return"] = QJsonArray{vcpu_slot(3, false), vcpu_slot(2, false), vcpu_slot(1, true),
+                                         vcpu_slot(0, true)};
+        else
+            reply["return"] = QJsonObject{};
+
+        output->append(QJsonDocument(reply).toJson(QJsonDocument::Compact) + "\n");
+        emit process->ready_read_standard_output();
+        return static_cast<qint64>(data.size());
+    });
+
+    return output;
+}
+
+// Just enough of a qcow2 image for its snapshot table to be read
+void write_qcow2_with_snapshots(const QString& file_name, const QStringList& snapshot_names)
+{
+    constexpr quint64 snapshots_offset = 0x10000;
+
+    QFile image{file_name};
+    image.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    QDataStream stream{&image};
+
+    stream << quint32{0x514649fb} << quint32{3};
+    image.seek(60);
+    stream << static_cast<quint32>(snapshot_names.size()) << snapshots_offset;
+
+    image.seek(snapshots_offset);
+    for (const auto& name : snapshot_names)
+    {
+        const auto id = QByteArray::number(image.pos());
+        const auto name_bytes = name.toUtf8();
+        stream << quint64{0} << quint32{0} << static_cast<quint16>(id.size()) << static_cast<quint16>(name_bytes.size())
+               << quint32{0} << quint32{0} << quint64{0} << quint32{0} << quint32{16};
+        image.write(QByteArray(16, '\0') + id + name_bytes);
+        image.write(QByteArray((8 - image.pos() % 8) % 8, '\0'));
+    }
+}
 } // namespace
 
 struct QemuBackend : public mpt::TestWithMockedBinPath
@@ -65,11 +152,20 @@ struct QemuBackend : public mpt::TestWithMockedBinPath
                                                       {},
                                                       {},
                                                       {},
+                                                      {},
                                                       {}};
     mpt::TempDir data_dir;
     const std::string tap_device{"tapfoo"};
     const QString bridge_name{"dummy-bridge"};
     const std::string subnet{"192.168.64"};
+    mp::QemuPlacement placement{data_dir.path()};          // no NUMA nodes to place on
+    mp::QemuMemoryMerging memory_merging{data_dir.path()}; // nor KSM to merge with
+    std::vector<bool> taps_set_up; // whether each was multi-queue
+
+    mp::QemuVirtualMachine::TraitsProvider no_traits = [] { return mp::QemuVirtualMachine::QemuTraits{}; };
+    mp::QemuVirtualMachine::TapSetup record_tap_setup = [this](bool multi_queue) {
+        taps_set_up.push_back(multi_queue);
+    };
 
     mpt::MockProcessFactory::Callback handle_external_process_calls = [](mpt::MockProcess* process) {
         // Have "qemu-img snapshot" return a string with the suspend tag in it
@@ -80,7 +176,7 @@ struct QemuBackend : public mpt::TestWithMockedBinPath
             ON_CALL(*process, execute(_)).WillByDefault(Return(exit_state));
             ON_CALL(*process, read_all_standard_output()).WillByDefault(Return(suspend_tag));
         }
-        else if (process->program() == "iptables")
+        else if (process->program().startsWith("iptables"))
         {
             mp::ProcessState exit_state;
             exit_state.exit_code = 0;
@@ -90,6 +186,13 @@ struct QemuBackend : public mpt::TestWithMockedBinPath
     mpt::SetEnvScope env_scope{"DISABLE_APPARMOR", "1"};
 };
 
+TEST_F(QemuBackend, can_rename_resources_for_the_warm_pool)
+{
+    mp::QemuVirtualMachineFactory backend{data_dir.path()};
+
+    EXPECT_TRUE(backend.can_rename_resources());
+}
+
 TEST_F(QemuBackend, creates_in_off_state)
 {
     mpt::StubVMStatusMonitor stub_monitor;
@@ -99,6 +202,33 @@ TEST_F(QemuBackend, creates_in_off_state)
     EXPECT_THAT(machine->current_state(), Eq(mp::VirtualMachine::State::off));
 }
 
+TEST_F(QemuBackend, reads_suspended_state_from_qcow2_snapshot_table)
+{
+    write_qcow2_with_snapshots(dummy_image.name(), {"before-upgrade", suspend_tag});
+    auto factory = mpt::MockProcessFactory::Inject();
+    mpt::StubVMStatusMonitor stub_monitor;
+    mp::QemuVirtualMachineFactory backend{data_dir.path()};
+
+    auto machine = backend.create_virtual_machine(default_description, stub_monitor);
+    EXPECT_THAT(machine->current_state(), Eq(mp::VirtualMachine::State::suspended));
+
+    auto processes = factory->process_list();
+    EXPECT_TRUE(std::none_of(processes.cbegin(), processes.cend(),
+                             [](const mpt::MockProcessFactory::ProcessInfo& process_info) {
+                                 return process_info.command == "qemu-img";
+                             }));
+}
+
+TEST_F(QemuBackend, reads_off_state_from_qcow2_snapshot_table_without_suspend_tag)
+{
+    write_qcow2_with_snapshots(dummy_image.name(), {"before-upgrade"});
+    mpt::StubVMStatusMonitor stub_monitor;
+    mp::QemuVirtualMachineFactory backend{data_dir.path()};
+
+    auto machine = backend.create_virtual_machine(default_description, stub_monitor);
+    EXPECT_THAT(machine->current_state(), Eq(mp::VirtualMachine::State::off));
+}
+
 TEST_F(QemuBackend, machine_in_off_state_handles_shutdown)
 {
     mpt::StubVMStatusMonitor stub_monitor;
@@ -302,7 +432,7 @@ TEST_F(QemuBackend, verify_some_common_qemu_arguments)
 
     ASSERT_TRUE(qemu != processes.cend());
     EXPECT_TRUE(qemu->arguments.contains("--enable-kvm"));
-    EXPECT_TRUE(qemu->arguments.contains("virtio-net-pci,netdev=hostnet0,id=net0,mac="));
+    EXPECT_TRUE(qemu->arguments.contains("virtio-net-pci,netdev=hostnet0,id=net0,mac=,mq=on,vectors=6"));
     EXPECT_TRUE(qemu->arguments.contains("-nographic"));
     EXPECT_TRUE(qemu->arguments.contains("-serial"));
     EXPECT_TRUE(qemu->arguments.contains("-qmp"));
@@ -313,6 +443,68 @@ TEST_F(QemuBackend, verify_some_common_qemu_arguments)
     EXPECT_TRUE(qemu->arguments.contains("null,id=char0"));
 }
 
+TEST_F(QemuBackend, keeps_the_guest_agent_socket_in_the_instance_directory)
+{
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback(handle_external_process_calls);
+    mp::QemuVirtualMachineFactory backend{data_dir.path()};
+
+    auto machine = backend.create_virtual_machine(default_description, mock_monitor);
+    machine->start();
+    machine->state = mp::VirtualMachine::State::running;
+
+    auto processes = factory->process_list();
+    auto qemu = std::find_if(processes.cbegin(), processes.cend(),
+                             [](const mpt::MockProcessFactory::ProcessInfo& process_info) {
+                                 return process_info.command.startsWith("qemu-system-");
+                             });
+
+    ASSERT_TRUE(qemu != processes.cend());
+    const auto instance_dir = QFileInfo{dummy_image.name()}.absoluteDir();
+    EXPECT_TRUE(qemu->arguments.contains(
+        QString("socket,id=qga0,path=%1,server=on,wait=off").arg(instance_dir.filePath("qga.sock"))));
+}
+
+TEST_F(QemuBackend, keeps_the_monitor_socket_of_detached_qemu_in_the_instance_directory)
+{
+    auto& mock_settings = mpt::MockSettings::mock_instance();
+    EXPECT_CALL(mock_settings, get(_)).Times(AnyNumber());
+    EXPECT_CALL(mock_settings, get(Eq(mp::keep_running_key))).WillRepeatedly(Return("true"));
+
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback(handle_external_process_calls);
+    mp::QemuVirtualMachineFactory backend{data_dir.path()};
+
+    auto machine = backend.create_virtual_machine(default_description, mock_monitor);
+    machine->start();
+
+    auto processes = factory->process_list();
+    auto qemu = std::find_if(processes.cbegin(), processes.cend(),
+                             [](const mpt::MockProcessFactory::ProcessInfo& process_info) {
+                                 return process_info.command.startsWith("qemu-system-");
+                             });
+
+    ASSERT_TRUE(qemu != processes.cend());
+    const auto instance_dir = QFileInfo{dummy_image.name()}.absoluteDir();
+    EXPECT_TRUE(qemu->arguments.contains(QString("unix:%1,server=on,wait=off").arg(instance_dir.filePath("qmp.sock"))));
+}
+
+TEST_F(QemuBackend, runs_nothing_in_the_guest_when_no_agent_listens)
+{
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback(handle_external_process_calls);
+    mp::QemuVirtualMachineFactory backend{data_dir.path()};
+
+    auto machine = backend.create_virtual_machine(default_description, mock_monitor);
+    machine->start();
+    machine->state = mp::VirtualMachine::State::running;
+
+    EXPECT_FALSE(machine->run_in_guest("true", std::chrono::seconds{1}));
+}
+
 TEST_F(QemuBackend, verify_qemu_arguments_when_resuming_suspend_image)
 {
     auto factory = mpt::MockProcessFactory::Inject();
@@ -336,6 +528,34 @@ TEST_F(QemuBackend, verify_qemu_arguments_when_resuming_suspend_image)
     EXPECT_TRUE(qemu->arguments.contains(suspend_tag));
 }
 
+TEST_F(QemuBackend, resumes_from_memory_state_file)
+{
+    QFile memory_state{dummy_image.name() + ".memory"};
+    ASSERT_TRUE(memory_state.open(QIODevice::WriteOnly));
+    memory_state.close();
+    auto factory = mpt::MockProcessFactory::Inject();
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    mp::QemuVirtualMachineFactory backend{data_dir.path()};
+
+    auto machine = backend.create_virtual_machine(default_description, mock_monitor);
+    ASSERT_EQ(machine->current_state(), mp::VirtualMachine::State::suspended);
+
+    machine->start();
+    machine->state = mp::VirtualMachine::State::running;
+
+    auto processes = factory->process_list();
+    auto qemu = std::find_if(processes.cbegin(), processes.cend(),
+                             [](const mpt::MockProcessFactory::ProcessInfo& process_info) {
+                                 return process_info.command.startsWith("qemu-system-");
+                             });
+
+    ASSERT_TRUE(qemu != processes.cend());
+    EXPECT_TRUE(qemu->arguments.contains("-incoming"));
+    EXPECT_FALSE(qemu->arguments.contains("-loadvm"));
+
+    memory_state.remove();
+}
+
 TEST_F(QemuBackend, verify_qemu_arguments_when_resuming_suspend_image_uses_metadata)
 {
     constexpr auto machine_type = "k0mPuT0R";
@@ -364,6 +584,47 @@ TEST_F(QemuBackend, verify_qemu_arguments_when_resuming_suspend_image_uses_metad
     EXPECT_TRUE(qemu->arguments.contains(machine_type));
 }
 
+TEST_F(QemuBackend, probes_the_machine_type_once_per_qemu_version)
+{
+    constexpr auto machine_type = "pc-i440fx-k0mPuT0R";
+
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback([](mpt::MockProcess* process) {
+        if (process->arguments().contains("--version"))
+        {
+            ON_CALL(*process, read_all_standard_output()).WillByDefault(Return("QEMU emulator version 4.2.1\n"));
+        }
+        else if (process->arguments().contains("-dump-vmstate"))
+        {
+            QFile dump_file{process->arguments().last()};
+            dump_file.open(QIODevice::WriteOnly);
+            dump_file.write(QString("{\"vmschkmachine\": {\"Name\": \"%1\"}}").arg(machine_type).toUtf8());
+        }
+    });
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+
+    EXPECT_CALL(mock_monitor, update_metadata_for(_, Truly([machine_type](const QJsonObject& metadata) {
+                                                      return metadata["machine_type"] == machine_type;
+                                                  })))
+        .Times(3);
+
+    {
+        mp::QemuVirtualMachineFactory backend{data_dir.path()};
+        backend.create_virtual_machine(default_description, mock_monitor)->start();
+        backend.create_virtual_machine(default_description, mock_monitor)->start();
+    }
+
+    mp::QemuVirtualMachineFactory backend{data_dir.path()}; // as after a daemon restart
+    backend.create_virtual_machine(default_description, mock_monitor)->start();
+
+    auto processes = factory->process_list();
+    EXPECT_EQ(std::count_if(processes.cbegin(), processes.cend(),
+                            [](const mpt::MockProcessFactory::ProcessInfo& process_info) {
+                                return process_info.arguments.contains("-dump-vmstate");
+                            }),
+              1);
+}
+
 TEST_F(QemuBackend, verify_qemu_command_version_when_resuming_suspend_image_using_cdrom_key)
 {
     auto factory = mpt::MockProcessFactory::Inject();
@@ -389,6 +650,106 @@ TEST_F(QemuBackend, verify_qemu_command_version_when_resuming_suspend_image_usin
     EXPECT_TRUE(qemu->arguments.contains("-cdrom"));
 }
 
+TEST_F(QemuBackend, sets_up_a_multi_queue_tap_for_an_instance_with_several_cores)
+{
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback(handle_external_process_calls);
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    NiceMock<mpt::MockDNSMasqServer> mock_dnsmasq_server{data_dir.path(), bridge_name, subnet};
+
+    mp::QemuVirtualMachine machine{default_description, tap_device, mock_dnsmasq_server, mock_monitor, placement,
+                                   memory_merging, no_traits, record_tap_setup};
+    EXPECT_TRUE(taps_set_up.empty());
+
+    machine.start();
+    machine.state = mp::VirtualMachine::State::running;
+
+    EXPECT_THAT(taps_set_up, ElementsAre(true));
+}
+
+TEST_F(QemuBackend, gives_instances_whose_names_hash_alike_their_own_vsock_cids)
+{
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback(handle_external_process_calls);
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    NiceMock<mpt::MockDNSMasqServer> mock_dnsmasq_server{data_dir.path(), bridge_name, subnet};
+    mp::QemuVirtualMachine::TraitsProvider vsock_traits = [] {
+        mp::QemuVirtualMachine::QemuTraits traits;
+        traits.host_features.vhost_vsock = true;
+        return traits;
+    };
+
+    // Two names that FNV-1a takes to the same address
+    auto first_description = default_description, second_description = default_description;
+    first_description.vm_name = "vm-36872";
+    second_description.vm_name = "vm-79820";
+    ASSERT_EQ(mp::QemuVMProcessSpec::guest_cid(first_description.vm_name),
+              mp::QemuVMProcessSpec::guest_cid(second_description.vm_name));
+
+    mp::QemuVirtualMachine first{first_description, tap_device, mock_dnsmasq_server, mock_monitor, placement,
+                                 memory_merging, vsock_traits, record_tap_setup};
+    mp::QemuVirtualMachine second{second_description, tap_device, mock_dnsmasq_server, mock_monitor, placement,
+                                  memory_merging, vsock_traits, record_tap_setup};
+    first.start();
+    first.state = mp::VirtualMachine::State::running;
+    second.start();
+    second.state = mp::VirtualMachine::State::running;
+
+    QStringList vsock_devices;
+    for (const auto& process : factory->process_list())
+        for (const auto& arg : process.arguments)
+            if (arg.startsWith("vhost-vsock-pci,"))
+                vsock_devices << arg;
+
+    ASSERT_THAT(vsock_devices.size(), Eq(2));
+    EXPECT_NE(vsock_devices[0], vsock_devices[1]);
+}
+
+TEST_F(QemuBackend, keeps_a_single_queue_tap_for_an_instance_suspended_without_queues)
+{
+    write_qcow2_with_snapshots(dummy_image.name(), {suspend_tag});
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback(handle_external_process_calls);
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    NiceMock<mpt::MockDNSMasqServer> mock_dnsmasq_server{data_dir.path(), bridge_name, subnet};
+
+    // As saved before taps had a queue per vCPU, which the suspended guest's NIC still expects
+    EXPECT_CALL(mock_monitor, retrieve_metadata_for(_))
+        .WillOnce(Return(QJsonObject({{"arguments", QJsonArray{"-device", "virtio-net-pci,netdev=hostnet0,id=net0,mac=",
+                                                               "-netdev",
+                                                               "tap,id=hostnet0,ifname=tapold,script=no,downscript=no"}}})));
+
+    mp::QemuVirtualMachine machine{default_description, tap_device, mock_dnsmasq_server, mock_monitor, placement,
+                                   memory_merging, no_traits, record_tap_setup};
+    ASSERT_EQ(machine.current_state(), mp::VirtualMachine::State::suspended);
+
+    machine.start();
+    machine.state = mp::VirtualMachine::State::running;
+
+    EXPECT_THAT(taps_set_up, ElementsAre(false));
+
+    auto processes = factory->process_list();
+    auto qemu = std::find_if(processes.cbegin(), processes.cend(),
+                             [](const mpt::MockProcessFactory::ProcessInfo& process_info) {
+                                 return process_info.command.startsWith("qemu-system-");
+                             });
+
+    ASSERT_TRUE(qemu != processes.cend());
+    EXPECT_TRUE(qemu->arguments.contains(
+        QString("tap,id=hostnet0,ifname=%1,script=no,downscript=no").arg(QString::fromStdString(tap_device))));
+}
+
+TEST_F(QemuBackend, opens_multi_queue_tap_only_with_more_than_one_queue)
+{
+    EXPECT_TRUE(mp::QemuVMProcessSpec::opens_multi_queue_tap(
+        {"-netdev", "tap,id=hostnet0,ifname=tap0,script=no,downscript=no,vhost=on,queues=4"}));
+    EXPECT_FALSE(mp::QemuVMProcessSpec::opens_multi_queue_tap(
+        {"-netdev", "tap,id=hostnet0,ifname=tap0,script=no,downscript=no,queues=1"}));
+    EXPECT_FALSE(
+        mp::QemuVMProcessSpec::opens_multi_queue_tap({"-netdev", "tap,id=hostnet0,ifname=tap0,script=no,downscript=no"}));
+    EXPECT_FALSE(mp::QemuVMProcessSpec::opens_multi_queue_tap({"tap,id=hostnet0,queues=4"}));
+}
+
 TEST_F(QemuBackend, verify_qemu_arguments_from_metadata_are_used)
 {
     constexpr auto suspend_tag = "suspend";
@@ -450,6 +811,26 @@ TEST_F(QemuBackend, returns_version_string)
     EXPECT_EQ(backend.get_backend_version_string(), "qemu-2.11.1");
 }
 
+TEST_F(QemuBackend, probes_version_once)
+{
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback([](mpt::MockProcess* process) {
+        if (process->arguments().contains("--version"))
+            ON_CALL(*process, read_all_standard_output()).WillByDefault(Return("QEMU emulator version 4.2.1\n"));
+    });
+
+    mp::QemuVirtualMachineFactory backend{data_dir.path()};
+    for (auto i = 0; i < 3; ++i)
+        EXPECT_EQ(backend.get_backend_version_string(), "qemu-4.2.1");
+
+    auto processes = factory->process_list();
+    EXPECT_EQ(std::count_if(processes.cbegin(), processes.cend(),
+                            [](const mpt::MockProcessFactory::ProcessInfo& process_info) {
+                                return process_info.arguments.contains("--version");
+                            }),
+              1);
+}
+
 TEST_F(QemuBackend, returns_version_string_when_failed_parsing)
 {
     constexpr auto qemu_version_output = "Unparsable version string";
@@ -523,7 +904,8 @@ TEST_F(QemuBackend, ssh_hostname_returns_expected_value)
         return mp::optional<mp::IPAddress>{expected_ip};
     });
 
-    mp::QemuVirtualMachine machine{default_description, tap_device, mock_dnsmasq_server, stub_monitor};
+    mp::QemuVirtualMachine machine{default_description, tap_device, mock_dnsmasq_server, stub_monitor, placement,
+                                   memory_merging, no_traits, record_tap_setup};
     machine.start();
     machine.state = mp::VirtualMachine::State::running;
 
@@ -538,7 +920,8 @@ TEST_F(QemuBackend, gets_management_ip)
 
     EXPECT_CALL(mock_dnsmasq_server, get_ip_for(_)).WillOnce(Return(expected_ip));
 
-    mp::QemuVirtualMachine machine{default_description, tap_device, mock_dnsmasq_server, stub_monitor};
+    mp::QemuVirtualMachine machine{default_description, tap_device, mock_dnsmasq_server, stub_monitor, placement,
+                                   memory_merging, no_traits, record_tap_setup};
     machine.start();
     machine.state = mp::VirtualMachine::State::running;
 
@@ -552,7 +935,8 @@ TEST_F(QemuBackend, fails_to_get_management_ip_if_dnsmasq_does_not_return_an_ip)
 
     EXPECT_CALL(mock_dnsmasq_server, get_ip_for(_)).WillOnce(Return(mp::nullopt));
 
-    mp::QemuVirtualMachine machine{default_description, tap_device, mock_dnsmasq_server, stub_monitor};
+    mp::QemuVirtualMachine machine{default_description, tap_device, mock_dnsmasq_server, stub_monitor, placement,
+                                   memory_merging, no_traits, record_tap_setup};
     machine.start();
     machine.state = mp::VirtualMachine::State::running;
 
@@ -566,7 +950,8 @@ TEST_F(QemuBackend, ssh_hostname_timeout_throws_and_sets_unknown_state)
 
     ON_CALL(mock_dnsmasq_server, get_ip_for(_)).WillByDefault([](auto...) { return mp::nullopt; });
 
-    mp::QemuVirtualMachine machine{default_description, tap_device, mock_dnsmasq_server, stub_monitor};
+    mp::QemuVirtualMachine machine{default_description, tap_device, mock_dnsmasq_server, stub_monitor, placement,
+                                   memory_merging, no_traits, record_tap_setup};
     machine.start();
     machine.state = mp::VirtualMachine::State::running;
 
@@ -574,6 +959,348 @@ TEST_F(QemuBackend, ssh_hostname_timeout_throws_and_sets_unknown_state)
     EXPECT_EQ(machine.state, mp::VirtualMachine::State::unknown);
 }
 
+struct QemuBackendBootTrace : public QemuBackend
+{
+    QemuBackendBootTrace()
+    {
+        EXPECT_CALL(mock_settings, get(_)).Times(AnyNumber());
+        EXPECT_CALL(mock_settings, get(Eq(mp::boot_readahead_key))).WillRepeatedly(Return("true"));
+        ON_CALL(mock_dnsmasq_server, get_ip_for(_)).WillByDefault(Return(mp::IPAddress{"10.10.0.36"}));
+        connect.returnValue(SSH_OK);
+
+        QFile image{dummy_image.name()};
+        EXPECT_TRUE(image.open(QIODevice::WriteOnly));
+        image.write(QByteArray(2 * 4096, 'x'));
+    }
+
+    // Starts the instance and has it come up, standing in for the boot by reading the whole image
+    void boot(const mp::VirtualMachineDescription& description)
+    {
+        mp::QemuVirtualMachine machine{description, tap_device, mock_dnsmasq_server, stub_monitor, placement,
+                                       memory_merging, no_traits, record_tap_setup};
+        machine.start();
+        mpt::load(dummy_image.name());
+        machine.wait_until_ssh_up(std::chrono::seconds{5});
+    }
+
+    mpt::MockSettings& mock_settings = mpt::MockSettings::mock_instance();
+    mpt::StubVMStatusMonitor stub_monitor;
+    NiceMock<mpt::MockDNSMasqServer> mock_dnsmasq_server{data_dir.path(), bridge_name, subnet};
+    decltype(MOCK(ssh_connect)) connect{MOCK(ssh_connect)};
+    const QString trace_path{mp::boot_trace::trace_path_for(dummy_image.name())};
+};
+
+TEST_F(QemuBackendBootTrace, records_what_the_first_cold_boot_read_once_ssh_is_up)
+{
+    boot(default_description);
+
+    EXPECT_THAT(mp::boot_trace::load(trace_path), Not(IsEmpty()));
+}
+
+TEST_F(QemuBackendBootTrace, reads_ahead_rather_than_tracing_boots_again)
+{
+    QFile trace{trace_path};
+    ASSERT_TRUE(trace.open(QIODevice::WriteOnly));
+    trace.write("0 4096\n");
+    trace.close();
+
+    boot(default_description);
+
+    EXPECT_EQ(mpt::load(trace_path), "0 4096\n");
+}
+
+TEST_F(QemuBackendBootTrace, leaves_instances_on_the_performance_profile_untraced)
+{
+    auto description = default_description;
+    description.storage_profile = mp::performance_storage_profile;
+
+    boot(description);
+
+    EXPECT_FALSE(QFile::exists(trace_path));
+}
+
+TEST_F(QemuBackendBootTrace, leaves_boots_untraced_without_the_setting)
+{
+    EXPECT_CALL(mock_settings, get(Eq(mp::boot_readahead_key))).WillRepeatedly(Return("false"));
+
+    boot(default_description);
+
+    EXPECT_FALSE(QFile::exists(trace_path));
+}
+
+TEST_F(QemuBackend, puts_virtiofsd_sockets_in_the_instance_directory)
+{
+    mpt::TempDir bin_dir;
+    const auto virtiofsd = QDir{bin_dir.path()}.filePath("virtiofsd");
+    mpt::make_file_with_content(virtiofsd, "#!/bin/sh\n");
+    QFile::setPermissions(virtiofsd, QFile::ReadOwner | QFile::ExeOwner);
+    mpt::SetEnvScope path_scope{"PATH", (bin_dir.path() + ":" + qgetenv("PATH")).toUtf8()};
+
+    mpt::TempDir instance_dir;
+    auto desc = default_description;
+    desc.image.image_path = QDir{instance_dir.path()}.filePath("image.img");
+    mpt::make_file_with_content(desc.image.image_path);
+
+    static QString socket_path;
+    socket_path.clear();
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback([this](mpt::MockProcess* process) {
+        handle_external_process_calls(process);
+
+        if (process->program().endsWith("virtiofsd"))
+        {
+            // virtiofsd creates its socket once it is ready
+            socket_path = process->arguments().filter("--socket-path=").value(0).section('=', 1);
+            ON_CALL(*process, start()).WillByDefault(Invoke([] { mpt::make_file_with_content(socket_path, ""); }));
+        }
+    });
+    mp::QemuVirtualMachineFactory backend{data_dir.path()};
+
+    auto machine = backend.create_virtual_machine(desc, mock_monitor);
+    machine->set_native_mounts({{"/home/user/src", "mp0123456789ab", {}, {}}});
+    machine->start();
+    machine->state = mp::VirtualMachine::State::running;
+
+    EXPECT_EQ(socket_path, QDir{instance_dir.path()}.filePath("mp0123456789ab.sock"));
+}
+
+TEST_F(QemuBackend, fetches_the_image_kernel_with_fast_boot)
+{
+    auto& mock_settings = mpt::MockSettings::mock_instance();
+    EXPECT_CALL(mock_settings, get(_)).Times(AnyNumber());
+    EXPECT_CALL(mock_settings, get(Eq(mp::fast_boot_key))).WillOnce(Return("true")).WillOnce(Return("false"));
+
+    mp::QemuVirtualMachineFactory backend{data_dir.path()};
+
+    EXPECT_EQ(backend.fetch_type(), mp::FetchType::ImageKernelAndInitrd);
+    EXPECT_EQ(backend.fetch_type(), mp::FetchType::ImageOnly);
+}
+
+TEST_F(QemuBackend, clones_carry_the_memory_state_of_their_source_over)
+{
+    mpt::TempDir source_dir, clone_dir;
+    mp::VMImage source_image, clone_image;
+    source_image.image_path = QDir{source_dir.path()}.filePath("ubuntu.img");
+    clone_image.image_path = QDir{clone_dir.path()}.filePath("ubuntu.img");
+    mpt::make_file_with_content(source_image.image_path + ".memory", "memory");
+    mpt::make_file_with_content(clone_image.image_path + ".memory", "stale");
+    mp::QemuVirtualMachineFactory backend{data_dir.path()};
+
+    backend.clone_suspended_state(source_image, clone_image);
+
+    EXPECT_EQ(mpt::load(clone_image.image_path + ".memory"), "memory");
+    EXPECT_EQ(mpt::load(source_image.image_path + ".memory"), "memory");
+}
+
+TEST_F(QemuBackend, cannot_clone_the_memory_of_an_instance_suspended_into_its_image)
+{
+    mpt::TempDir source_dir, clone_dir;
+    mp::VMImage source_image, clone_image;
+    source_image.image_path = QDir{source_dir.path()}.filePath("ubuntu.img");
+    clone_image.image_path = QDir{clone_dir.path()}.filePath("ubuntu.img");
+    mp::QemuVirtualMachineFactory backend{data_dir.path()};
+
+    MP_EXPECT_THROW_THAT(backend.clone_suspended_state(source_image, clone_image), std::runtime_error,
+                         mpt::match_what(HasSubstr("suspended into its image")));
+    EXPECT_FALSE(QFile::exists(clone_image.image_path + ".memory"));
+}
+
+TEST_F(QemuBackend, hot_adds_vcpus_once_qemu_has_plugged_them)
+{
+    std::vector<QString> commands;
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback([this, &commands](mpt::MockProcess* process) {
+        handle_external_process_calls(process);
+        if (process->program().startsWith("qemu-system-"))
+            answer_qmp(process, commands);
+    });
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    NiceMock<mpt::MockDNSMasqServer> mock_dnsmasq_server{data_dir.path(), bridge_name, subnet};
+    const mp::QemuVirtualMachine::TraitsProvider four_cores = [] {
+        mp::QemuVirtualMachine::QemuTraits traits;
+        traits.host_features.cores = 4;
+        return traits;
+    };
+
+    mp::QemuVirtualMachine machine{default_description, tap_device, mock_dnsmasq_server, mock_monitor, placement,
+                                   memory_merging, four_cores, record_tap_setup};
+    machine.start();
+    machine.state = mp::VirtualMachine::State::running;
+    commands.clear();
+
+    machine.resize(4, default_description.mem_size);
+
+    EXPECT_THAT(commands, ElementsAre("query-hotpluggable-cpus", "device_add", "device_add"));
+}
+
+TEST_F(QemuBackend, resize_reports_what_qemu_failed_to_plug)
+{
+    std::vector<QString> commands;
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback([this, &commands](mpt::MockProcess* process) {
+        handle_external_process_calls(process);
+        if (process->program().startsWith("qemu-system-"))
+            answer_qmp(process, commands, "device_add");
+    });
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    NiceMock<mpt::MockDNSMasqServer> mock_dnsmasq_server{data_dir.path(), bridge_name, subnet};
+    const mp::QemuVirtualMachine::TraitsProvider four_cores = [] {
+        mp::QemuVirtualMachine::QemuTraits traits;
+        traits.host_features.cores = 4;
+        return traits;
+    };
+
+    mp::QemuVirtualMachine machine{default_description, tap_device, mock_dnsmasq_server, mock_monitor, placement,
+                                   memory_merging, four_cores, record_tap_setup};
+    machine.start();
+    machine.state = mp::VirtualMachine::State::running;
+
+    MP_EXPECT_THROW_THAT(machine.resize(3, default_description.mem_size), std::runtime_error,
+                         mpt::match_what(HasSubstr("GenericError: no free bus")));
+}
+
+TEST_F(QemuBackend, reports_the_cpu_time_qemu_took_on_the_host)
+{
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback([this](mpt::MockProcess* process) {
+        handle_external_process_calls(process);
+        if (process->program().startsWith("qemu-system-")) // this very process stands in for it
+            ON_CALL(*process, process_id()).WillByDefault(Return(QCoreApplication::applicationPid()));
+    });
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    NiceMock<mpt::MockDNSMasqServer> mock_dnsmasq_server{data_dir.path(), bridge_name, subnet};
+
+    mp::QemuVirtualMachine machine{default_description, tap_device, mock_dnsmasq_server, mock_monitor, placement,
+                                   memory_merging, no_traits, record_tap_setup};
+    machine.start();
+    machine.state = mp::VirtualMachine::State::running;
+
+    // Metrics are refreshed in the background, every few seconds
+    for (auto i = 0; i < 150 && !machine.metrics().cpu_time_ms; ++i)
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+
+    const auto cpu_time_ms = machine.metrics().cpu_time_ms;
+    ASSERT_TRUE(cpu_time_ms);
+    EXPECT_GE(*cpu_time_ms, 0);
+    EXPECT_LE(*cpu_time_ms, static_cast<long long>(std::clock()) * 1000 / CLOCKS_PER_SEC);
+}
+
+struct QemuBackendShutdown : public QemuBackend
+{
+    QemuBackendShutdown()
+    {
+        factory->register_callback([this](mpt::MockProcess* process) {
+            handle_external_process_calls(process);
+            if (process->program().startsWith("qemu-system-"))
+            {
+                vm_process = process;
+                qmp_output = answer_qmp(process, commands);
+            }
+        });
+    }
+
+    std::unique_ptr<mp::QemuVirtualMachine> started_machine()
+    {
+        auto machine = std::make_unique<mp::QemuVirtualMachine>(default_description, tap_device, mock_dnsmasq_server,
+                                                                mock_monitor, placement, memory_merging, no_traits,
+                                                                record_tap_setup);
+        machine->start();
+        machine->state = mp::VirtualMachine::State::running;
+        commands.clear();
+
+        return machine;
+    }
+
+    void send_qmp_event(const QString& event, const QJsonObject& data)
+    {
+        qmp_output->append(QJsonDocument(QJsonObject{{"event", event}, {"data", data}}).toJson(QJsonDocument::Compact) +
+                           "\n");
+        emit vm_process->ready_read_standard_output();
+    }
+
+    void write_memory_state()
+    {
+        QFile memory_state{memory_state_file};
+        ASSERT_TRUE(memory_state.open(QIODevice::WriteOnly));
+        memory_state.write("partial");
+    }
+
+    std::unique_ptr<mpt::MockProcessFactory::Scope> factory = mpt::MockProcessFactory::Inject();
+    mpt::MockProcess* vm_process = nullptr;
+    std::shared_ptr<QByteArray> qmp_output;
+    std::vector<QString> commands;
+    NiceMock<mpt::MockVMStatusMonitor> mock_monitor;
+    NiceMock<mpt::MockDNSMasqServer> mock_dnsmasq_server{data_dir.path(), bridge_name, subnet};
+    const QString memory_state_file{dummy_image.name() + ".memory"};
+    mpt::MockLogger::Scope logger_scope = mpt::MockLogger::inject();
+};
+
+TEST_F(QemuBackendShutdown, begins_suspending_when_going_down_with_the_daemon)
+{
+    auto machine = started_machine();
+
+    machine->begin_shutdown(true, std::chrono::steady_clock::now() + std::chrono::minutes{1});
+
+    EXPECT_THAT(commands, Contains("migrate"));
+    EXPECT_THAT(commands, Not(Contains("system_powerdown")));
+
+    send_qmp_event("MIGRATION", {{"status", "completed"}});
+    EXPECT_EQ(machine->current_state(), mp::VirtualMachine::State::suspended);
+}
+
+TEST_F(QemuBackendShutdown, begins_powering_down_when_not_to_suspend)
+{
+    auto machine = started_machine();
+
+    machine->begin_shutdown(false, std::chrono::steady_clock::now() + std::chrono::minutes{1});
+
+    EXPECT_THAT(commands, Contains("system_powerdown"));
+    EXPECT_THAT(commands, Not(Contains("migrate")));
+}
+
+TEST_F(QemuBackendShutdown, kills_what_is_not_down_by_the_deadline_and_drops_its_partial_memory_state)
+{
+    auto machine = started_machine();
+    machine->begin_shutdown(true, std::chrono::steady_clock::now());
+    write_memory_state();
+
+    EXPECT_CALL(*vm_process, wait_for_finished(_)).WillRepeatedly(Return(false));
+    EXPECT_CALL(*vm_process, kill()).Times(AtLeast(1));
+    logger_scope.mock_logger->expect_log(mpl::Level::warning, "Did not go down in time");
+    logger_scope.mock_logger->expect_log(mpl::Level::warning, "dropping it");
+    machine.reset();
+
+    EXPECT_FALSE(QFile::exists(memory_state_file));
+}
+
+TEST_F(QemuBackendShutdown, keeps_the_memory_state_saved_by_the_deadline)
+{
+    auto machine = started_machine();
+    machine->begin_shutdown(true, std::chrono::steady_clock::now());
+    write_memory_state();
+    send_qmp_event("MIGRATION", {{"status", "completed"}});
+
+    ON_CALL(*vm_process, wait_for_finished(_)).WillByDefault(Return(false));
+    logger_scope.mock_logger->expect_log(mpl::Level::warning, "dropping it", Exactly(0));
+    machine.reset();
+
+    EXPECT_TRUE(QFile::exists(memory_state_file));
+    QFile::remove(memory_state_file);
+}
+
+TEST_F(QemuBackendShutdown, leaves_taps_for_later_and_passes_over_those_already_gone)
+{
+    auto machine = started_machine();
+    machine->begin_shutdown(false, std::chrono::steady_clock::now());
+    ON_CALL(*vm_process, wait_for_finished(_)).WillByDefault(Return(true));
+    machine.reset();
+
+    logger_scope.mock_logger->expect_log(mpl::Level::warning, "Failed to delete tap devices", Exactly(0));
+    EXPECT_NO_THROW(mp::QemuVirtualMachine::remove_released_tap_devices());
+    EXPECT_NO_THROW(mp::QemuVirtualMachine::remove_released_tap_devices());
+}
+
 TEST_F(QemuBackend, lists_no_networks)
 {
     mp::QemuVirtualMachineFactory backend{data_dir.path()};
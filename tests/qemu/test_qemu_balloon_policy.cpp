@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <src/platform/backends/qemu/qemu_balloon_policy.h>
+
+#include "tests/temp_file.h"
+
+#include <gmock/gmock.h>
+
+#include <QFile>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+
+namespace
+{
+constexpr auto gib = 1ll << 30;
+} // namespace
+
+TEST(QemuBalloonPolicy, reads_some_pressure_from_psi)
+{
+    mpt::TempFile psi;
+    QFile psi_file{psi.name()};
+    ASSERT_TRUE(psi_file.open(QIODevice::WriteOnly));
+    psi_file.write("some avg10=12.50 avg60=3.00 avg300=1.00 total=123456\n"
+                   "full avg10=2.00 avg60=0.50 avg300=0.10 total=23456\n");
+    psi_file.close();
+
+    EXPECT_EQ(mp::balloon::host_memory_pressure(psi.name()), 12.5);
+}
+
+TEST(QemuBalloonPolicy, reads_no_pressure_without_psi)
+{
+    EXPECT_FALSE(mp::balloon::host_memory_pressure("/this/does/not/exist"));
+}
+
+TEST(QemuBalloonPolicy, gives_everything_back_without_pressure)
+{
+    EXPECT_EQ(mp::balloon::target_for(4 * gib, gib, 0.5, 2 * gib), 4 * gib);
+    EXPECT_EQ(mp::balloon::target_for(4 * gib, gib, mp::nullopt, 2 * gib), 4 * gib);
+}
+
+TEST(QemuBalloonPolicy, holds_under_moderate_pressure)
+{
+    EXPECT_EQ(mp::balloon::target_for(4 * gib, gib, 5.0, 3 * gib), 3 * gib);
+}
+
+TEST(QemuBalloonPolicy, squeezes_down_to_what_the_guest_uses_under_high_pressure)
+{
+    EXPECT_EQ(mp::balloon::target_for(8 * gib, 2 * gib, 20.0, 4 * gib), 2 * gib + gib / 2);
+}
+
+TEST(QemuBalloonPolicy, squeezes_by_no_more_than_half_at_a_time)
+{
+    EXPECT_EQ(mp::balloon::target_for(8 * gib, gib, 20.0, 8 * gib), 4 * gib);
+}
+
+TEST(QemuBalloonPolicy, holds_without_guest_stats)
+{
+    EXPECT_EQ(mp::balloon::target_for(8 * gib, mp::nullopt, 20.0, 8 * gib), 8 * gib);
+}
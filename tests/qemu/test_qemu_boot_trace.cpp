@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <src/platform/backends/qemu/qemu_boot_trace.h>
+
+#include "tests/file_operations.h"
+#include "tests/temp_dir.h"
+
+#include <QFile>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+
+namespace
+{
+struct QemuBootTrace : public Test
+{
+    mpt::TempDir dir;
+    QString image_path{dir.path() + "/ubuntu.img"};
+    QString trace_path{mp::boot_trace::trace_path_for(image_path)};
+};
+} // namespace
+
+TEST_F(QemuBootTrace, keeps_the_trace_next_to_the_image)
+{
+    EXPECT_TRUE(trace_path.startsWith(image_path));
+    EXPECT_TRUE(trace_path != image_path);
+}
+
+TEST_F(QemuBootTrace, loads_ranges)
+{
+    mpt::make_file_with_content(trace_path, "0 4096\n65536 8192\n");
+
+    EXPECT_THAT(mp::boot_trace::load(trace_path),
+                ElementsAre(mp::boot_trace::Range{0, 4096}, mp::boot_trace::Range{65536, 8192}));
+}
+
+TEST_F(QemuBootTrace, loads_nothing_from_malformed_traces)
+{
+    mpt::make_file_with_content(trace_path, "0 4096\n65536\n");
+    EXPECT_THAT(mp::boot_trace::load(trace_path), IsEmpty());
+
+    mpt::make_file_with_content(trace_path, "0 -1\n");
+    EXPECT_THAT(mp::boot_trace::load(trace_path), IsEmpty());
+}
+
+TEST_F(QemuBootTrace, loads_nothing_without_a_trace)
+{
+    EXPECT_THAT(mp::boot_trace::load(trace_path), IsEmpty());
+}
+
+TEST_F(QemuBootTrace, merges_cached_pages_into_ranges)
+{
+    const auto content = std::string(3 * 4096 + 100, 'x');
+    mpt::make_file_with_content(image_path, content);
+    mpt::load(image_path); // for it to be cached whatever the file system
+
+    EXPECT_THAT(mp::boot_trace::cached_ranges(image_path),
+                ElementsAre(mp::boot_trace::Range{0, static_cast<long long>(content.size())}));
+}
+
+TEST_F(QemuBootTrace, saves_what_is_cached_and_prefetches_it)
+{
+    const auto content = std::string(2 * 4096, 'x');
+    mpt::make_file_with_content(image_path, content);
+    mpt::load(image_path);
+
+    ASSERT_TRUE(mp::boot_trace::save(image_path));
+    EXPECT_EQ(mp::boot_trace::load(trace_path), mp::boot_trace::cached_ranges(image_path));
+    EXPECT_EQ(mp::boot_trace::prefetch(image_path), static_cast<long long>(content.size()));
+}
+
+TEST_F(QemuBootTrace, prefetches_nothing_without_a_trace)
+{
+    mpt::make_file_with_content(image_path, "image");
+
+    EXPECT_EQ(mp::boot_trace::prefetch(image_path), 0);
+}
+
+TEST_F(QemuBootTrace, discards_the_trace)
+{
+    mpt::make_file_with_content(trace_path, "0 4096\n");
+    mp::boot_trace::discard(image_path);
+
+    EXPECT_FALSE(QFile::exists(trace_path));
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <src/platform/backends/qemu/qemu_guest_agent.h>
+
+#include <gmock/gmock.h>
+
+#include <QJsonArray>
+#include <QJsonDocument>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <stdexcept>
+
+namespace mp = multipass;
+using namespace testing;
+
+namespace
+{
+using Responder = std::function<std::vector<QByteArray>(const QJsonObject& request)>;
+
+// Answers each request with whatever lines the test's responder makes of it
+class FakeChannel : public mp::QemuGuestAgent::Channel
+{
+public:
+    FakeChannel(Responder& respond, std::vector<QJsonObject>& requests) : respond{respond}, requests{requests}
+    {
+    }
+
+    void write(const QByteArray& data) override
+    {
+        const auto request = QJsonDocument::fromJson(data).object();
+        requests.push_back(request);
+        for (const auto& line : respond(request))
+            lines.push_back(line);
+    }
+
+    QByteArray read_line(std::chrono::milliseconds) override
+    {
+        if (lines.empty())
+            return {};
+
+        auto line = lines.front();
+        lines.pop_front();
+        return line;
+    }
+
+private:
+    Responder& respond;
+    std::vector<QJsonObject>& requests;
+    std::deque<QByteArray> lines;
+};
+
+QByteArray reply(const QJsonValue& value)
+{
+    return QJsonDocument(QJsonObject{{"return", value}}).toJson(QJsonDocument::Compact);
+}
+} // namespace
+
+struct TestQemuGuestAgent : public Test
+{
+    // A well-behaved agent whose command exits on the second status poll
+    std::vector<QByteArray> agent(const QJsonObject& request)
+    {
+        const auto command = request["execute"].toString();
+        if (command == "guest-sync")
+            return {reply(request["arguments"].toObject()["id"])};
+        if (command == "guest-exec")
+            return {reply(QJsonObject{{"pid", 42}})};
+        if (command == "guest-exec-status")
+        {
+            if (++polls < 2)
+                return {reply(QJsonObject{{"exited", false}})};
+            return {reply(QJsonObject{{"exited", true}, {"exitcode", 3}, {"out-data", QString{"aGVsbG8K"}}})};
+        }
+        return {};
+    }
+
+    Responder respond{[this](const QJsonObject& request) { return agent(request); }};
+    std::vector<QJsonObject> requests;
+    int connections{0};
+    int polls{0};
+    mp::QemuGuestAgent guest_agent{[this] {
+                                       ++connections;
+                                       return std::make_unique<FakeChannel>(respond, requests);
+                                   },
+                                   std::chrono::milliseconds{100}, std::chrono::milliseconds{1}};
+};
+
+TEST_F(TestQemuGuestAgent, runs_commands_with_the_shell_and_returns_their_output)
+{
+    const auto result = guest_agent.run("echo hello; exit 3", std::chrono::seconds{1});
+
+    EXPECT_THAT(result.exit_code, Eq(3));
+    EXPECT_THAT(result.output, Eq("hello\n"));
+
+    ASSERT_THAT(requests.size(), Ge(3u));
+    const auto exec = requests[1];
+    EXPECT_THAT(exec["execute"].toString(), Eq("guest-exec"));
+    EXPECT_THAT(exec["arguments"].toObject()["path"].toString(), Eq("/bin/sh"));
+    EXPECT_THAT(exec["arguments"].toObject()["arg"].toArray().last().toString(), Eq("echo hello; exit 3"));
+    EXPECT_THAT(requests.back()["arguments"].toObject()["pid"].toInt(), Eq(42));
+}
+
+TEST_F(TestQemuGuestAgent, skips_replies_left_over_from_earlier_requests)
+{
+    respond = [this](const QJsonObject& request) {
+        auto lines = agent(request);
+        if (request["execute"].toString() == "guest-sync")
+            lines.insert(lines.begin(), {reply(QJsonObject{{"pid", 7}}), "garbage"});
+        return lines;
+    };
+
+    EXPECT_THAT(guest_agent.run("true", std::chrono::seconds{1}).exit_code, Eq(3));
+    EXPECT_THAT(requests.back()["arguments"].toObject()["pid"].toInt(), Eq(42));
+}
+
+TEST_F(TestQemuGuestAgent, throws_on_agent_errors_and_reconnects_for_the_next_command)
+{
+    auto fail = true;
+    respond = [this, &fail](const QJsonObject& request) -> std::vector<QByteArray> {
+        if (fail && request["execute"].toString() == "guest-exec")
+            return {R"({"error": {"class": "GenericError", "desc": "no such file"}})"};
+        return agent(request);
+    };
+
+    EXPECT_THROW(guest_agent.run("true", std::chrono::seconds{1}), std::runtime_error);
+
+    fail = false;
+    EXPECT_NO_THROW(guest_agent.run("true", std::chrono::seconds{1}));
+    EXPECT_THAT(connections, Eq(2));
+}
+
+TEST_F(TestQemuGuestAgent, throws_when_no_agent_answers)
+{
+    respond = [](const QJsonObject&) { return std::vector<QByteArray>{}; };
+
+    EXPECT_THROW(guest_agent.run("true", std::chrono::seconds{1}), std::runtime_error);
+}
+
+TEST_F(TestQemuGuestAgent, throws_when_the_command_outlasts_its_timeout)
+{
+    respond = [this](const QJsonObject& request) {
+        if (request["execute"].toString() == "guest-exec-status")
+            return std::vector<QByteArray>{reply(QJsonObject{{"exited", false}})};
+        return agent(request);
+    };
+
+    EXPECT_THROW(guest_agent.run("sleep 100", std::chrono::milliseconds{20}), std::runtime_error);
+}
+
+TEST_F(TestQemuGuestAgent, lets_other_commands_through_while_one_runs)
+{
+    std::promise<void> slow_running;
+    std::atomic<bool> quick_done{false};
+    respond = [&](const QJsonObject& request) -> std::vector<QByteArray> {
+        const auto command = request["execute"].toString();
+        const auto arguments = request["arguments"].toObject();
+        if (command == "guest-exec")
+            return {reply(QJsonObject{{"pid", arguments["arg"].toArray().last().toString() == "slow" ? 1 : 2}})};
+        if (command == "guest-exec-status" && arguments["pid"].toInt() == 1)
+        {
+            if (polls++ == 0)
+                slow_running.set_value();
+            return {reply(QJsonObject{{"exited", quick_done.load()}, {"exitcode", 1}})};
+        }
+        if (command == "guest-exec-status")
+            return {reply(QJsonObject{{"exited", true}, {"exitcode", 2}})};
+        return agent(request);
+    };
+
+    // The slow command only finishes once the quick one has, which it could not do were it kept waiting
+    auto slow = std::async(std::launch::async, [this] { return guest_agent.run("slow", std::chrono::seconds{5}); });
+    slow_running.get_future().wait();
+
+    EXPECT_THAT(guest_agent.run("quick", std::chrono::seconds{1}).exit_code, Eq(2));
+    quick_done = true;
+    EXPECT_THAT(slow.get().exit_code, Eq(1));
+}
+
+TEST_F(TestQemuGuestAgent, synchronizes_once_per_connection)
+{
+    guest_agent.run("true", std::chrono::seconds{1});
+    polls = 0;
+    guest_agent.run("true", std::chrono::seconds{1});
+
+    const auto syncs = std::count_if(requests.cbegin(), requests.cend(), [](const QJsonObject& request) {
+        return request["execute"].toString() == "guest-sync";
+    });
+    EXPECT_THAT(syncs, Eq(1));
+    EXPECT_THAT(connections, Eq(1));
+}
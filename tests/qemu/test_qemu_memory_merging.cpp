@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <src/platform/backends/qemu/qemu_memory_merging.h>
+
+#include "tests/file_operations.h"
+#include "tests/temp_dir.h"
+
+#include <multipass/format.h>
+#include <multipass/instrumentation.h>
+
+#include <QFile>
+
+#include <gmock/gmock.h>
+
+#include <unistd.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+
+namespace
+{
+struct QemuMemoryMerging : public Test
+{
+    QemuMemoryMerging()
+    {
+        for (const auto& file : {"pages_to_scan", "sleep_millisecs", "pages_shared", "pages_sharing"})
+            mpt::make_file_with_content(sysfs.path() + '/' + file, "0\n");
+        mpt::make_file_with_content(sysfs.path() + "/run", "0\n");
+    }
+
+    ~QemuMemoryMerging()
+    {
+        mp::Instrumentation::reset();
+    }
+
+    QByteArray ksm(const char* file)
+    {
+        return mpt::load(sysfs.path() + '/' + file);
+    }
+
+    void overwrite(const char* file, const QByteArray& content)
+    {
+        QFile sysfs_file{sysfs.path() + '/' + file};
+        ASSERT_TRUE(sysfs_file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        sysfs_file.write(content);
+    }
+
+    mpt::TempDir sysfs;
+};
+} // namespace
+
+TEST_F(QemuMemoryMerging, scans_at_a_trickle_without_pressure)
+{
+    const auto rate = mp::QemuMemoryMerging::scan_rate_for(mp::nullopt);
+    const auto calm = mp::QemuMemoryMerging::scan_rate_for(0.5);
+
+    EXPECT_EQ(rate.pages_to_scan, calm.pages_to_scan);
+    EXPECT_EQ(rate.sleep_millisecs, calm.sleep_millisecs);
+    EXPECT_EQ(rate.pages_to_scan, 100);
+}
+
+TEST_F(QemuMemoryMerging, scans_harder_as_pressure_grows)
+{
+    const auto some = mp::QemuMemoryMerging::scan_rate_for(5.0);
+    const auto high = mp::QemuMemoryMerging::scan_rate_for(50.0);
+
+    EXPECT_GT(some.pages_to_scan, 100);
+    EXPECT_GT(high.pages_to_scan, some.pages_to_scan);
+    EXPECT_LT(high.sleep_millisecs, some.sleep_millisecs);
+    EXPECT_EQ(high.pages_to_scan, mp::QemuMemoryMerging::scan_rate_for(10.0).pages_to_scan);
+}
+
+TEST_F(QemuMemoryMerging, runs_while_instances_are_enrolled)
+{
+    mp::QemuMemoryMerging merging{sysfs.path()};
+
+    merging.enrol("first");
+    merging.enrol("second");
+    EXPECT_EQ(ksm("run"), "1");
+
+    merging.withdraw("first");
+    EXPECT_EQ(ksm("run"), "1");
+
+    merging.withdraw("second");
+    EXPECT_EQ(ksm("run"), "0");
+}
+
+TEST_F(QemuMemoryMerging, leaves_ksm_running_when_it_was_before)
+{
+    overwrite("run", "1\n");
+    mp::QemuMemoryMerging merging{sysfs.path()};
+
+    merging.enrol("first");
+    merging.withdraw("first");
+
+    EXPECT_EQ(ksm("run"), "1");
+}
+
+TEST_F(QemuMemoryMerging, restores_ksm_when_destroyed)
+{
+    {
+        mp::QemuMemoryMerging merging{sysfs.path()};
+        merging.enrol("first");
+    }
+
+    EXPECT_EQ(ksm("run"), "0");
+}
+
+TEST_F(QemuMemoryMerging, restores_scan_rate_when_last_instance_goes)
+{
+    overwrite("pages_to_scan", "250\n");
+    overwrite("sleep_millisecs", "75\n");
+    mp::QemuMemoryMerging merging{sysfs.path()};
+
+    merging.enrol("first");
+    merging.tune(50.0);
+    ASSERT_NE(ksm("pages_to_scan"), "250");
+
+    merging.withdraw("first");
+
+    EXPECT_EQ(ksm("pages_to_scan"), "250");
+    EXPECT_EQ(ksm("sleep_millisecs"), "75");
+}
+
+TEST_F(QemuMemoryMerging, restores_scan_rate_when_destroyed)
+{
+    overwrite("sleep_millisecs", "75\n");
+    {
+        mp::QemuMemoryMerging merging{sysfs.path()};
+        merging.enrol("first");
+    }
+
+    EXPECT_EQ(ksm("sleep_millisecs"), "75");
+}
+
+TEST_F(QemuMemoryMerging, tunes_scan_rate_and_reports_savings)
+{
+    overwrite("pages_shared", "10\n");
+    overwrite("pages_sharing", "30\n");
+    mp::QemuMemoryMerging merging{sysfs.path()};
+
+    merging.enrol("first");
+    merging.tune(50.0);
+
+    EXPECT_EQ(ksm("pages_to_scan"), QByteArray::number(mp::QemuMemoryMerging::scan_rate_for(50.0).pages_to_scan));
+    const auto page_size = sysconf(_SC_PAGESIZE);
+    const auto metrics = MP_INSTRUMENTATION.openmetrics();
+    EXPECT_THAT(metrics, HasSubstr(fmt::format("multipass_ksm_saved_bytes {}\n", 30 * page_size)));
+    EXPECT_THAT(metrics, HasSubstr(fmt::format("multipass_ksm_shared_bytes {}\n", 10 * page_size)));
+}
+
+TEST_F(QemuMemoryMerging, does_not_tune_again_too_soon)
+{
+    mp::QemuMemoryMerging merging{sysfs.path()};
+
+    merging.enrol("first");
+    merging.tune(50.0);
+    merging.tune(mp::nullopt);
+
+    EXPECT_EQ(ksm("pages_to_scan"), QByteArray::number(mp::QemuMemoryMerging::scan_rate_for(50.0).pages_to_scan));
+}
+
+TEST_F(QemuMemoryMerging, does_nothing_without_ksm)
+{
+    mp::QemuMemoryMerging merging{sysfs.path() + "/missing"};
+
+    merging.enrol("first");
+    merging.tune(50.0);
+
+    EXPECT_THAT(MP_INSTRUMENTATION.openmetrics(), Not(HasSubstr("multipass_ksm")));
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <src/platform/backends/qemu/qemu_placement.h>
+
+#include "tests/temp_dir.h"
+
+#include <gmock/gmock.h>
+
+#include <QDir>
+#include <QFile>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+
+namespace
+{
+struct QemuPlacement : public Test
+{
+    void add_node(int node, const QByteArray& cpu_list)
+    {
+        const auto node_dir = QString("node%1").arg(node);
+        ASSERT_TRUE(QDir{sysfs.path()}.mkpath(node_dir));
+
+        QFile file{QDir{sysfs.path()}.filePath(node_dir + "/cpulist")};
+        ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+        file.write(cpu_list + '\n');
+    }
+
+    mpt::TempDir sysfs;
+};
+} // namespace
+
+TEST_F(QemuPlacement, parses_cpu_lists)
+{
+    EXPECT_THAT(mp::QemuPlacement::parse_cpu_list("0-3,8,10-11\n"), ElementsAre(0, 1, 2, 3, 8, 10, 11));
+    EXPECT_THAT(mp::QemuPlacement::parse_cpu_list("5"), ElementsAre(5));
+    EXPECT_THAT(mp::QemuPlacement::parse_cpu_list("0-a"), IsEmpty());
+}
+
+TEST_F(QemuPlacement, keeps_instances_within_a_node)
+{
+    add_node(0, "0-3");
+    add_node(1, "4-7");
+    mp::QemuPlacement placement{sysfs.path()};
+
+    auto first = placement.allocate("first", 2);
+    auto second = placement.allocate("second", 2);
+
+    ASSERT_TRUE(first && second);
+    EXPECT_EQ(first->node, 0);
+    EXPECT_THAT(first->cpus, ElementsAre(0, 1));
+    EXPECT_EQ(second->node, 1);
+    EXPECT_THAT(second->cpus, ElementsAre(4, 5));
+}
+
+TEST_F(QemuPlacement, spreads_over_the_least_used_cores)
+{
+    add_node(0, "0-3");
+    mp::QemuPlacement placement{sysfs.path()};
+
+    placement.allocate("first", 2);
+    auto second = placement.allocate("second", 2);
+
+    ASSERT_TRUE(second);
+    EXPECT_THAT(second->cpus, ElementsAre(2, 3));
+}
+
+TEST_F(QemuPlacement, reuses_released_cores)
+{
+    add_node(0, "0-1");
+    mp::QemuPlacement placement{sysfs.path()};
+
+    placement.allocate("first", 1);
+    placement.allocate("second", 1);
+    placement.release("first");
+    auto third = placement.allocate("third", 1);
+
+    ASSERT_TRUE(third);
+    EXPECT_THAT(third->cpus, ElementsAre(0));
+}
+
+TEST_F(QemuPlacement, gives_nothing_when_no_node_is_big_enough)
+{
+    add_node(0, "0-1");
+    add_node(1, "2-3");
+    mp::QemuPlacement placement{sysfs.path()};
+
+    EXPECT_FALSE(placement.allocate("wide", 4));
+}
@@ -17,10 +17,17 @@
 
 #include <src/platform/backends/qemu/qemu_vm_process_spec.h>
 
+#include "tests/file_operations.h"
 #include "tests/mock_environment_helpers.h"
+#include "tests/temp_dir.h"
+
+#include <multipass/constants.h>
+
 #include <gmock/gmock.h>
 
+#include <QDir>
 #include <QTemporaryDir>
+#include <QtEndian>
 
 namespace mp = multipass;
 namespace mpt = multipass::test;
@@ -40,6 +47,7 @@ struct TestQemuVMProcessSpec : public Test
                                              {},
                                              {},
                                              {},
+                                             {},
                                              {}};
     const QString tap_device_name{"tap_device"};
 };
@@ -60,9 +68,12 @@ TEST_F(TestQemuVMProcessSpec, default_arguments_correct)
                                              "-m",
                                              "3072M",
                                              "-device",
-                                             "virtio-net-pci,netdev=hostnet0,id=net0,mac=00:11:22:33:44:55",
+                                             "virtio-balloon-pci,id=balloon0",
+                                             "-device",
+                                             "virtio-net-pci,netdev=hostnet0,id=net0,mac=00:11:22:33:44:55,mq=on,"
+                                             "vectors=6",
                                              "-netdev",
-                                             "tap,id=hostnet0,ifname=tap_device,script=no,downscript=no",
+                                             "tap,id=hostnet0,ifname=tap_device,script=no,downscript=no,queues=2",
                                              "-qmp",
                                              "stdio",
                                              "-cpu",
@@ -76,6 +87,114 @@ TEST_F(TestQemuVMProcessSpec, default_arguments_correct)
                                              "/path/to/cloud_init.iso"}));
 }
 
+TEST_F(TestQemuVMProcessSpec, balloon_reports_free_pages_when_supported)
+{
+    mp::QemuVMProcessSpec::HostFeatures host_features;
+    host_features.free_page_reporting = true;
+
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, {}, host_features);
+
+    EXPECT_TRUE(spec.arguments().contains("virtio-balloon-pci,id=balloon0,free-page-reporting=on"));
+}
+
+TEST_F(TestQemuVMProcessSpec, performance_storage_profile_gives_the_disk_an_iothread)
+{
+    auto performance_desc = desc;
+    performance_desc.storage_profile = mp::performance_storage_profile;
+
+    mp::QemuVMProcessSpec::HostFeatures host_features;
+    host_features.io_uring = true;
+
+    mp::QemuVMProcessSpec spec(performance_desc, tap_device_name, mp::nullopt, {}, host_features);
+
+    const auto args = spec.arguments();
+    const auto disk_args = args.mid(args.indexOf("--enable-kvm") + 1, 6);
+    EXPECT_EQ(disk_args,
+              QStringList({"-object", "iothread,id=iothread0", "-drive",
+                           "file=/path/to/image,if=none,format=qcow2,discard=unmap,detect-zeroes=unmap,cache=none,"
+                           "aio=io_uring,id=hda",
+                           "-device", "virtio-blk-pci,drive=hda,iothread=iothread0,num-queues=2"}));
+}
+
+TEST_F(TestQemuVMProcessSpec, performance_storage_profile_falls_back_to_native_aio)
+{
+    auto performance_desc = desc;
+    performance_desc.storage_profile = mp::performance_storage_profile;
+
+    mp::QemuVMProcessSpec spec(performance_desc, tap_device_name, mp::nullopt);
+
+    EXPECT_EQ(spec.arguments().filter("aio=native").size(), 1);
+}
+
+TEST_F(TestQemuVMProcessSpec, io_limits_throttle_the_disk)
+{
+    auto limited_desc = desc;
+    limited_desc.io_limits.disk_iops = 100;
+    limited_desc.io_limits.disk_iops_burst = 400;
+
+    mp::QemuVMProcessSpec spec(limited_desc, tap_device_name, mp::nullopt);
+
+    const auto drives = spec.arguments().filter("id=hda");
+    ASSERT_EQ(drives.size(), 1);
+    EXPECT_THAT(drives.first().toStdString(), HasSubstr(",throttling.iops-total=100,throttling.iops-total-max=400"));
+    EXPECT_THAT(drives.first().toStdString(), Not(HasSubstr("throttling.bps-total")));
+}
+
+TEST_F(TestQemuVMProcessSpec, remote_backing_file_is_copied_on_read)
+{
+    // A qcow2 v2 header of an overlay on a remote image, as created by local.lazy-boot
+    const std::string backing_file{"https://cloud-images.ubuntu.com/focal/focal-server-cloudimg-amd64.img"};
+    std::string header(72, '\0');
+    qToBigEndian<quint32>(0x514649fb, &header[0]);
+    qToBigEndian<quint32>(2, &header[4]);
+    qToBigEndian<quint64>(header.size(), &header[8]);
+    qToBigEndian<quint32>(static_cast<quint32>(backing_file.size()), &header[16]);
+    qToBigEndian<quint32>(16, &header[20]);
+
+    mpt::TempDir temp_dir;
+    auto overlay_desc = desc;
+    overlay_desc.image.image_path = QDir{temp_dir.path()}.filePath("overlay.img");
+    mpt::make_file_with_content(overlay_desc.image.image_path, header + backing_file);
+
+    mp::QemuVMProcessSpec spec(overlay_desc, tap_device_name, mp::nullopt);
+
+    ASSERT_TRUE(mp::QemuVMProcessSpec::has_remote_backing_file(overlay_desc.image.image_path));
+    const auto drives = spec.arguments().filter("id=hda");
+    ASSERT_EQ(drives.size(), 1);
+    EXPECT_THAT(drives.first().toStdString(), HasSubstr(",copy-on-read=on"));
+    EXPECT_TRUE(spec.apparmor_profile().contains("#include <abstractions/ssl_certs>"));
+}
+
+TEST_F(TestQemuVMProcessSpec, local_image_is_not_copied_on_read)
+{
+    EXPECT_FALSE(mp::QemuVMProcessSpec::has_remote_backing_file(desc.image.image_path));
+    EXPECT_TRUE(mp::QemuVMProcessSpec(desc, tap_device_name, mp::nullopt).arguments().filter("copy-on-read").isEmpty());
+}
+
+TEST_F(TestQemuVMProcessSpec, network_moves_packets_in_the_kernel_when_vhost_net_is_there)
+{
+    mp::QemuVMProcessSpec::HostFeatures host_features;
+    host_features.vhost_net = true;
+
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, {}, host_features);
+
+    EXPECT_TRUE(
+        spec.arguments().contains("tap,id=hostnet0,ifname=tap_device,script=no,downscript=no,vhost=on,queues=2"));
+    EXPECT_TRUE(spec.apparmor_profile().contains("/dev/vhost-net rw,"));
+}
+
+TEST_F(TestQemuVMProcessSpec, single_core_network_has_a_single_queue)
+{
+    auto single_core_desc = desc;
+    single_core_desc.num_cores = 1;
+
+    mp::QemuVMProcessSpec spec(single_core_desc, tap_device_name, mp::nullopt);
+
+    const auto args = spec.arguments();
+    EXPECT_TRUE(args.contains("virtio-net-pci,netdev=hostnet0,id=net0,mac=00:11:22:33:44:55"));
+    EXPECT_TRUE(args.contains("tap,id=hostnet0,ifname=tap_device,script=no,downscript=no"));
+}
+
 TEST_F(TestQemuVMProcessSpec, legacy_resume_arguments_correct)
 {
     const mp::QemuVMProcessSpec::ResumeData resume_data{"suspend_tag", "machine_type", false, {}};
@@ -152,6 +271,82 @@ TEST_F(TestQemuVMProcessSpec, resume_arguments_taken_from_resumedata)
     EXPECT_EQ(spec.arguments(), QStringList({"-one", "-two", "-loadvm", "suspend_tag", "-machine", "machine_type"}));
 }
 
+TEST_F(TestQemuVMProcessSpec, resume_arguments_follow_the_instance_files_and_tap_device)
+{
+    const mp::QemuVMProcessSpec::ResumeData resume_data{
+        "suspend_tag",
+        "machine_type",
+        false,
+        {"-drive", "file=/old/image,if=none,format=qcow2,discard=unmap,id=hda", "-netdev",
+         "tap,id=hostnet0,ifname=tap-old,script=no,downscript=no,vhost=on", "-cdrom", "/old/cloud-init-config.iso"}};
+
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, resume_data);
+
+    EXPECT_EQ(spec.arguments(),
+              QStringList({"-drive", "file=/path/to/image,if=none,format=qcow2,discard=unmap,id=hda", "-netdev",
+                           "tap,id=hostnet0,ifname=tap_device,script=no,downscript=no,vhost=on", "-cdrom",
+                           "/path/to/cloud_init.iso", "-loadvm", "suspend_tag", "-machine", "machine_type"}));
+}
+
+TEST_F(TestQemuVMProcessSpec, resume_arguments_follow_the_image_kernel_and_initrd)
+{
+    const mp::QemuVMProcessSpec::ResumeData resume_data{
+        "suspend_tag", "machine_type", false, {"-kernel", "/old/vmlinuz", "-initrd", "/old/initrd"}};
+    auto kernel_desc = desc;
+    kernel_desc.image.kernel_path = "/path/to/vmlinuz";
+    kernel_desc.image.initrd_path = "/path/to/initrd";
+
+    mp::QemuVMProcessSpec spec(kernel_desc, tap_device_name, resume_data);
+
+    EXPECT_EQ(spec.arguments(), QStringList({"-kernel", "/path/to/vmlinuz", "-initrd", "/path/to/initrd", "-loadvm",
+                                             "suspend_tag", "-machine", "machine_type"}));
+}
+
+TEST_F(TestQemuVMProcessSpec, resume_arguments_keep_the_kernel_when_the_image_has_none_at_hand)
+{
+    const mp::QemuVMProcessSpec::ResumeData resume_data{
+        "suspend_tag", "machine_type", false, {"-kernel", "/old/vmlinuz", "-initrd", "/old/initrd"}};
+
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, resume_data);
+
+    EXPECT_EQ(spec.arguments(), QStringList({"-kernel", "/old/vmlinuz", "-initrd", "/old/initrd", "-loadvm",
+                                             "suspend_tag", "-machine", "machine_type"}));
+}
+
+TEST_F(TestQemuVMProcessSpec, resume_arguments_give_a_clone_its_own_mac_and_vsock_cid)
+{
+    const mp::QemuVMProcessSpec::ResumeData resume_data{
+        "suspend_tag",
+        "machine_type",
+        false,
+        {"-device", "virtio-net-pci,netdev=hostnet0,id=net0,mac=52:54:00:aa:bb:cc", "-device",
+         "vhost-vsock-pci,id=vsock0,guest-cid=1234"},
+        true};
+
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, resume_data);
+
+    const auto args = spec.arguments();
+    EXPECT_TRUE(args.contains("virtio-net-pci,netdev=hostnet0,id=net0,mac=00:11:22:33:44:55"));
+    EXPECT_TRUE(args.contains(QString("vhost-vsock-pci,id=vsock0,guest-cid=%1")
+                                  .arg(mp::QemuVMProcessSpec::guest_cid(desc.vm_name))));
+}
+
+TEST_F(TestQemuVMProcessSpec, resume_from_memory_state_file_migrates_it_in)
+{
+    const mp::QemuVMProcessSpec::ResumeData resume_data{"suspend_tag", "machine_type", false, {"-one"}, true};
+
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, resume_data);
+
+    EXPECT_EQ(spec.arguments(),
+              QStringList({"-one", "-incoming", "exec:cat '/path/to/image.memory'", "-machine", "machine_type"}));
+    EXPECT_TRUE(spec.apparmor_profile().contains("/path/to/image.memory rw,"));
+}
+
+TEST_F(TestQemuVMProcessSpec, shell_quote_escapes_single_quotes)
+{
+    EXPECT_EQ(mp::QemuVMProcessSpec::shell_quote("/it's/here"), "'/it'\\''s/here'");
+}
+
 TEST_F(TestQemuVMProcessSpec, resume_with_missing_machine_type_guesses_correctly)
 {
     mp::QemuVMProcessSpec::ResumeData resume_data_missing_machine_info;
@@ -163,6 +358,234 @@ TEST_F(TestQemuVMProcessSpec, resume_with_missing_machine_type_guesses_correctly
     EXPECT_EQ(spec.arguments(), QStringList({"-args", "-loadvm", "suspend_tag"}));
 }
 
+TEST_F(TestQemuVMProcessSpec, shared_directories_served_by_virtiofsd_share_memory)
+{
+    const std::vector<mp::QemuVMProcessSpec::SharedDirectory> shared{
+        {{"/home/user/src", "mpsrc", {{1000, 1000}}, {}}, "/tmp/mp-mpsrc.sock"}};
+
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, shared);
+
+    const auto args = spec.arguments();
+    const auto tail = args.mid(args.indexOf("/path/to/cloud_init.iso") + 1);
+    EXPECT_EQ(tail, QStringList({"-object", "memory-backend-memfd,id=mem,size=3072M,share=on", "-numa",
+                                 "node,memdev=mem", "-chardev", "socket,id=fs0,path=/tmp/mp-mpsrc.sock", "-device",
+                                 "vhost-user-fs-pci,chardev=fs0,tag=mpsrc"}));
+}
+
+TEST_F(TestQemuVMProcessSpec, shared_directories_without_virtiofsd_fall_back_to_9p)
+{
+    const std::vector<mp::QemuVMProcessSpec::SharedDirectory> shared{{{"/home/user/src", "mpsrc", {}, {}}, ""}};
+
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, shared);
+
+    const auto args = spec.arguments();
+    EXPECT_FALSE(args.contains("-numa"));
+    EXPECT_EQ(args.mid(args.indexOf("/path/to/cloud_init.iso") + 1),
+              QStringList({"-virtfs", "local,path=/home/user/src,mount_tag=mpsrc,security_model=passthrough,id=fs0"}));
+    EXPECT_TRUE(spec.apparmor_profile().contains("/home/user/src/** rwlk,"));
+}
+
+TEST_F(TestQemuVMProcessSpec, placement_binds_memory_to_the_host_node)
+{
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, {}, {}, {1, false});
+
+    const auto args = spec.arguments();
+    EXPECT_EQ(args.mid(args.indexOf("/path/to/cloud_init.iso") + 1),
+              QStringList({"-object", "memory-backend-ram,id=mem,size=3072M,host-nodes=1,policy=bind", "-numa",
+                           "node,memdev=mem"}));
+}
+
+TEST_F(TestQemuVMProcessSpec, hugepages_back_memory_shared_with_virtiofsd)
+{
+    const std::vector<mp::QemuVMProcessSpec::SharedDirectory> shared{
+        {{"/home/user/src", "mpsrc", {}, {}}, "/tmp/mp-mpsrc.sock"}};
+
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, shared, {}, {mp::nullopt, true});
+
+    EXPECT_TRUE(spec.arguments().contains(
+        "memory-backend-file,id=mem,size=3072M,mem-path=/dev/hugepages,prealloc=on,share=on"));
+    EXPECT_TRUE(spec.apparmor_profile().contains("owner /dev/hugepages/** rw,"));
+}
+
+TEST_F(TestQemuVMProcessSpec, memory_merge_offers_guest_memory_to_ksm)
+{
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, {}, {}, {mp::nullopt, false, true});
+
+    const auto args = spec.arguments();
+    EXPECT_EQ(args.mid(args.indexOf("-m"), 4), QStringList({"-m", "3072M", "-machine", "mem-merge=on"}));
+}
+
+TEST_F(TestQemuVMProcessSpec, memory_merge_is_left_out_with_hugepages)
+{
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, {}, {}, {mp::nullopt, true, true});
+
+    EXPECT_FALSE(spec.arguments().contains("mem-merge=on"));
+}
+
+TEST_F(TestQemuVMProcessSpec, host_capacity_leaves_room_to_hot_add_vcpus_and_memory)
+{
+    mp::QemuVMProcessSpec::HostFeatures host_features;
+    host_features.virtio_mem = true;
+    host_features.cores = 8;
+    host_features.memory = 16LL * 1024 * 1024 * 1024 + 100;
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, {}, host_features);
+
+    const auto args = spec.arguments();
+    EXPECT_EQ(args.mid(args.indexOf("-smp"), 4), QStringList({"-smp", "2,maxcpus=8", "-m", "3072M,maxmem=12288M"}));
+    EXPECT_TRUE(args.contains("memory-backend-ram,id=hotmem0,size=9216M"));
+    EXPECT_TRUE(args.contains("virtio-mem-pci,id=vmem0,memdev=hotmem0,requested-size=0"));
+
+    const auto capacity = mp::QemuVMProcessSpec::hotplug_capacity(args);
+    EXPECT_EQ(capacity.max_cores, 8);
+    EXPECT_EQ(capacity.boot_memory, 3072LL * 1024 * 1024);
+    EXPECT_EQ(capacity.max_memory, 12288LL * 1024 * 1024);
+}
+
+TEST_F(TestQemuVMProcessSpec, hotplug_memory_stays_within_what_the_host_has)
+{
+    mp::QemuVMProcessSpec::HostFeatures host_features;
+    host_features.virtio_mem = true;
+    host_features.memory = 8LL * 1024 * 1024 * 1024;
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, {}, host_features);
+
+    const auto args = spec.arguments();
+    EXPECT_TRUE(args.contains("3072M,maxmem=8192M"));
+    EXPECT_TRUE(args.contains("memory-backend-ram,id=hotmem0,size=5120M"));
+}
+
+TEST_F(TestQemuVMProcessSpec, hugepages_leave_out_hotplug_memory)
+{
+    mp::QemuVMProcessSpec::HostFeatures host_features;
+    host_features.virtio_mem = true;
+    host_features.memory = 16LL * 1024 * 1024 * 1024;
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, {}, host_features, {mp::nullopt, true});
+
+    const auto args = spec.arguments();
+    EXPECT_TRUE(args.contains("3072M"));
+    EXPECT_TRUE(args.filter("virtio-mem-pci").isEmpty());
+
+    const auto capacity = mp::QemuVMProcessSpec::hotplug_capacity(args);
+    EXPECT_EQ(capacity.max_cores, 2);
+    EXPECT_EQ(capacity.max_memory, capacity.boot_memory);
+}
+
+TEST_F(TestQemuVMProcessSpec, vhost_vsock_adds_a_vsock_device_with_the_instance_cid)
+{
+    mp::QemuVMProcessSpec::HostFeatures host_features;
+    host_features.vhost_vsock = true;
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, {}, host_features);
+
+    const auto cid = mp::QemuVMProcessSpec::guest_cid(desc.vm_name);
+    EXPECT_THAT(cid, Ge(3u));
+    EXPECT_THAT(cid, Eq(mp::QemuVMProcessSpec::guest_cid(desc.vm_name)));
+    EXPECT_THAT(cid, Ne(mp::QemuVMProcessSpec::guest_cid(desc.vm_name + "2")));
+    EXPECT_TRUE(spec.arguments().contains(QString("vhost-vsock-pci,id=vsock0,guest-cid=%1").arg(cid)));
+}
+
+TEST_F(TestQemuVMProcessSpec, vsock_device_takes_the_cid_the_instance_was_placed_at)
+{
+    mp::QemuVMProcessSpec::HostFeatures host_features;
+    host_features.vhost_vsock = true;
+    mp::QemuVMProcessSpec::Placement placement;
+    placement.vsock_cid = mp::QemuVMProcessSpec::guest_cid(desc.vm_name, 1);
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, {}, host_features, placement);
+
+    EXPECT_THAT(placement.vsock_cid, Ne(mp::QemuVMProcessSpec::guest_cid(desc.vm_name)));
+    EXPECT_TRUE(
+        spec.arguments().contains(QString("vhost-vsock-pci,id=vsock0,guest-cid=%1").arg(placement.vsock_cid)));
+}
+
+TEST_F(TestQemuVMProcessSpec, guest_agent_socket_adds_a_virtio_serial_port)
+{
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, {}, {}, {}, "/tmp/mp-vm_name.qga");
+
+    const auto args = spec.arguments();
+    EXPECT_TRUE(args.contains("socket,id=qga0,path=/tmp/mp-vm_name.qga,server=on,wait=off"));
+    EXPECT_TRUE(args.contains("virtserialport,bus=serial0.0,chardev=qga0,name=org.qemu.guest_agent.0"));
+    EXPECT_TRUE(spec.apparmor_profile().contains("/tmp/mp-vm_name.qga rw,"));
+}
+
+TEST_F(TestQemuVMProcessSpec, no_guest_agent_socket_leaves_out_the_port)
+{
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt);
+
+    EXPECT_FALSE(spec.arguments().contains("virtio-serial-pci,id=serial0"));
+}
+
+TEST_F(TestQemuVMProcessSpec, detached_qemu_daemonizes_with_its_monitor_on_a_socket)
+{
+    const mp::QemuVMProcessSpec::Detachment detachment{"/path/to/image.pid", "/tmp/mp-vm_name.qmp"};
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, {}, {}, {}, {}, detachment);
+
+    const auto args = spec.arguments();
+    EXPECT_THAT(args.mid(args.size() - 9),
+                ElementsAre("-qmp", "unix:/tmp/mp-vm_name.qmp,server=on,wait=off", "-display", "none", "-monitor",
+                            "none", "-daemonize", "-pidfile", "/path/to/image.pid"));
+    EXPECT_FALSE(args.contains("stdio"));
+    EXPECT_FALSE(args.contains("-nographic"));
+    EXPECT_TRUE(spec.apparmor_profile().contains("/path/to/image.pid rw,"));
+    EXPECT_TRUE(spec.apparmor_profile().contains("/tmp/mp-vm_name.qmp rw,"));
+    EXPECT_TRUE(spec.outlives_daemon());
+}
+
+TEST_F(TestQemuVMProcessSpec, resuming_attached_puts_the_monitor_back_on_stdio)
+{
+    const mp::QemuVMProcessSpec::ResumeData resume_data{
+        "suspend_tag",
+        "machine_type",
+        false,
+        {"-one", "-qmp", "unix:/tmp/mp-vm_name.qmp,server=on,wait=off", "-display", "none", "-monitor", "none",
+         "-daemonize", "-pidfile", "/path/to/image.pid"}};
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, resume_data);
+
+    EXPECT_EQ(spec.arguments(), QStringList({"-one", "-qmp", "stdio", "-nographic", "-loadvm", "suspend_tag",
+                                             "-machine", "machine_type"}));
+    EXPECT_FALSE(spec.outlives_daemon());
+}
+
+TEST_F(TestQemuVMProcessSpec, fast_boot_boots_the_image_kernel_directly)
+{
+    auto kernel_desc = desc;
+    kernel_desc.image.kernel_path = "/path/to/vmlinuz";
+    kernel_desc.image.initrd_path = "/path/to/initrd";
+    mp::QemuVMProcessSpec spec(kernel_desc, tap_device_name, mp::nullopt, {}, {}, {}, {}, mp::nullopt, true);
+
+    const auto args = spec.arguments().join(' ');
+    EXPECT_THAT(args.toStdString(), HasSubstr("-machine q35 -nodefaults -kernel /path/to/vmlinuz "
+                                              "-initrd /path/to/initrd -append root=LABEL=cloudimg-rootfs"));
+    EXPECT_TRUE(spec.apparmor_profile().contains("/path/to/vmlinuz r,"));
+    EXPECT_TRUE(spec.apparmor_profile().contains("/path/to/initrd r,"));
+}
+
+TEST_F(TestQemuVMProcessSpec, fast_boot_without_a_kernel_boots_through_firmware)
+{
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt, {}, {}, {}, {}, mp::nullopt, true);
+
+    EXPECT_FALSE(spec.arguments().contains("-kernel"));
+    EXPECT_FALSE(spec.arguments().contains("-nodefaults"));
+}
+
+TEST_F(TestQemuVMProcessSpec, ephemeral_instance_writes_to_a_temporary_overlay_in_memory)
+{
+    auto ephemeral_desc = desc;
+    ephemeral_desc.ephemeral = true;
+    mp::QemuVMProcessSpec spec(ephemeral_desc, tap_device_name, mp::nullopt);
+
+    const auto drives = spec.arguments().filter("id=hda");
+    ASSERT_EQ(drives.size(), 1);
+    EXPECT_THAT(drives.first().toStdString(), HasSubstr(",snapshot=on"));
+    EXPECT_EQ(spec.environment().value("TMPDIR"), "/dev/shm");
+    EXPECT_TRUE(spec.apparmor_profile().contains("owner /dev/shm/vl.* rwk,"));
+}
+
+TEST_F(TestQemuVMProcessSpec, persistent_instance_writes_to_its_image)
+{
+    mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt);
+
+    EXPECT_TRUE(spec.arguments().filter("snapshot=on").isEmpty());
+    EXPECT_FALSE(spec.apparmor_profile().contains("/dev/shm/vl.*"));
+}
+
 TEST_F(TestQemuVMProcessSpec, apparmor_profile_has_correct_name)
 {
     mp::QemuVMProcessSpec spec(desc, tap_device_name, mp::nullopt);
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <src/platform/backends/qemu/qmp_client.h>
+
+#include <gmock/gmock.h>
+
+#include <QJsonDocument>
+
+#include <chrono>
+
+namespace mp = multipass;
+using namespace testing;
+
+struct TestQmpClient : public Test
+{
+    bool ready(std::future<QJsonObject>& reply)
+    {
+        return reply.wait_for(std::chrono::seconds::zero()) == std::future_status::ready;
+    }
+
+    std::vector<QJsonObject> written;
+    mp::QmpClient qmp{
+        [this](const QByteArray& command) { written.push_back(QJsonDocument::fromJson(command).object()); }};
+};
+
+TEST_F(TestQmpClient, tags_commands_with_ids)
+{
+    qmp.execute("qmp_capabilities");
+    qmp.human_monitor_command("savevm suspend");
+
+    ASSERT_EQ(written.size(), 2u);
+    EXPECT_EQ(written[0]["execute"], "qmp_capabilities");
+    EXPECT_EQ(written[1]["execute"], "human-monitor-command");
+    EXPECT_EQ(written[1]["arguments"].toObject()["command-line"], "savevm suspend");
+    EXPECT_NE(written[0]["id"], written[1]["id"]);
+}
+
+TEST_F(TestQmpClient, resolves_the_reply_with_the_matching_id)
+{
+    auto first = qmp.execute("query-status");
+    auto second = qmp.execute("query-status");
+
+    qmp.feed(QString("{\"return\": {\"status\": \"paused\"}, \"id\": %1}\r\n").arg(written[1]["id"].toInt()).toUtf8());
+
+    ASSERT_TRUE(ready(second));
+    EXPECT_FALSE(ready(first));
+    EXPECT_EQ(second.get()["status"], "paused");
+}
+
+TEST_F(TestQmpClient, hands_replies_to_their_handlers)
+{
+    QJsonObject stats;
+    qmp.execute("qom-get", {{"property", "guest-stats"}}, [&stats](const QJsonObject& value) { stats = value; });
+
+    qmp.feed(QString("{\"return\": {\"last-update\": 1}, \"id\": %1}\n").arg(written[0]["id"].toInt()).toUtf8());
+
+    EXPECT_EQ(stats["last-update"], 1);
+}
+
+TEST_F(TestQmpClient, fails_the_reply_to_an_erroneous_command)
+{
+    auto reply = qmp.execute("no-such-command");
+
+    qmp.feed(QString("{\"error\": {\"class\": \"CommandNotFound\", \"desc\": \"nope\"}, \"id\": %1}\n")
+                 .arg(written[0]["id"].toInt())
+                 .toUtf8());
+
+    EXPECT_THROW(reply.get(), std::runtime_error);
+}
+
+TEST_F(TestQmpClient, dispatches_events_split_across_reads)
+{
+    QStringList devices;
+    qmp.subscribe("BLOCK_JOB_COMPLETED", [&devices](const QJsonObject& data) { devices << data["device"].toString(); });
+
+    qmp.feed("{\"QMP\": {\"version\": {}}}\r\n{\"event\": \"BLOCK_JOB_COMPLETED\", \"da");
+    qmp.feed("ta\": {\"device\": \"disk0\"}}\r\n{\"event\": \"STOP\"}\r\n");
+
+    EXPECT_EQ(devices, QStringList{"disk0"});
+}
+
+TEST_F(TestQmpClient, fails_pending_replies_when_abandoned)
+{
+    auto reply = qmp.execute("system_powerdown");
+
+    qmp.abandon("qemu exited");
+
+    EXPECT_THROW(reply.get(), std::runtime_error);
+}
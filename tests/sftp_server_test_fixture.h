@@ -24,38 +24,55 @@
 
 #include <gtest/gtest.h>
 
+#include <memory>
+
 namespace multipass
 {
 namespace test
 {
-struct SftpServerTest : public testing::Test
+// The mocked libssh an SftpServer is driven through, for tests and benchmarks alike
+struct SftpServerMocks
 {
-    SftpServerTest()
-        : free_sftp{mock_sftp_free, [](sftp_session sftp) {
+    SftpServerMocks()
+        : free_sftp{mock_sftp_free,
+                    [](sftp_session sftp) {
                         std::free(sftp->handles);
                         std::free(sftp);
-                    }}
+                    }},
+          free_packet{mock_sftp_packet_free, [](sftp_packet) {}} // the init packet belongs to the fixture
     {
+        const char client_version[] = {0, 0, 0, 3};
+        ssh_buffer_add_data(init_payload.get(), client_version, sizeof(client_version));
+
         connect.returnValue(SSH_OK);
         is_connected.returnValue(true);
         open_session.returnValue(SSH_OK);
         request_exec.returnValue(SSH_OK);
-        init_sftp.returnValue(SSH_OK);
+        read_packet.returnValue(&init_packet);
+        write_packet.returnValue(0);
         reply_status.returnValue(SSH_OK);
         get_client_msg.returnValue(nullptr);
-        handle_sftp.returnValue(nullptr);
+        poll_channel.returnValue(1);
     }
 
     decltype(MOCK(ssh_connect)) connect{MOCK(ssh_connect)};
     decltype(MOCK(ssh_is_connected)) is_connected{MOCK(ssh_is_connected)};
     decltype(MOCK(ssh_channel_open_session)) open_session{MOCK(ssh_channel_open_session)};
     decltype(MOCK(ssh_channel_request_exec)) request_exec{MOCK(ssh_channel_request_exec)};
-    decltype(MOCK(sftp_server_init)) init_sftp{MOCK(sftp_server_init)};
+    decltype(MOCK(sftp_packet_read)) read_packet{MOCK(sftp_packet_read)};
+    decltype(MOCK(sftp_packet_write)) write_packet{MOCK(sftp_packet_write)};
     decltype(MOCK(sftp_reply_status)) reply_status{MOCK(sftp_reply_status)};
+    decltype(MOCK(ssh_channel_poll_timeout)) poll_channel{MOCK(ssh_channel_poll_timeout)};
     decltype(MOCK(sftp_get_client_message)) get_client_msg{MOCK(sftp_get_client_message)};
     decltype(MOCK(sftp_client_message_free)) msg_free{MOCK(sftp_client_message_free)};
-    decltype(MOCK(sftp_handle)) handle_sftp{MOCK(sftp_handle)};
     MockScope<decltype(mock_sftp_free)> free_sftp;
+    MockScope<decltype(mock_sftp_packet_free)> free_packet;
+    std::unique_ptr<ssh_buffer_struct, decltype(ssh_buffer_free)*> init_payload{ssh_buffer_new(), ssh_buffer_free};
+    sftp_packet_struct init_packet{nullptr, SSH_FXP_INIT, init_payload.get()};
+};
+
+struct SftpServerTest : public testing::Test, public SftpServerMocks
+{
 };
 } // namespace test
 } // namespace multipass
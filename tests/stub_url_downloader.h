@@ -19,11 +19,13 @@
 #define MULTIPASS_STUB_URL_DOWNLOADER_H
 
 #include <multipass/url_downloader.h>
+#include <multipass/vm_image_vault.h>
 
 namespace multipass
 {
 namespace test
 {
+// Downloads nothing. Fakes that do override download_to, and hash whatever it left in the file along with it.
 struct StubURLDownloader : public multipass::URLDownloader
 {
     StubURLDownloader() : multipass::URLDownloader{std::chrono::seconds(10)}
@@ -33,6 +35,13 @@ struct StubURLDownloader : public multipass::URLDownloader
                      const multipass::ProgressMonitor&) override
     {
     }
+
+    QString download_and_hash_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                                 const multipass::ProgressMonitor& monitor) override
+    {
+        download_to(url, file_name, size, download_type, monitor);
+        return multipass::vault::compute_image_hash(file_name);
+    }
     QByteArray download(const QUrl& url) override
     {
         return {};
@@ -44,7 +44,8 @@ struct StubVirtualMachineFactory : public multipass::BaseVirtualMachineFactory
         return multipass::FetchType::ImageOnly;
     }
 
-    multipass::VMImage prepare_source_image(const multipass::VMImage& source_image) override
+    multipass::VMImage prepare_source_image(const multipass::VMImage& source_image,
+                                            const multipass::ProgressMonitor& monitor) override
     {
         return source_image;
     }
@@ -39,6 +39,26 @@ struct StubVMImageVault final : public multipass::VMImageVault
         return false;
     }
 
+    VMImage rename(const std::string&, const std::string&) override
+    {
+        return {};
+    }
+
+    VMImage bake(const std::string&, const std::string&) override
+    {
+        return {};
+    }
+
+    VMImage clone(const std::string&, const std::string&) override
+    {
+        return {};
+    }
+
+    VMImage clone_layered(const std::string&, const std::string&) override
+    {
+        return {};
+    }
+
     void prune_expired_images() override{};
     void update_images(const FetchType& fetch_type, const PrepareAction& prepare,
                        const ProgressMonitor& monitor) override{};
@@ -58,6 +78,11 @@ struct StubVMImageVault final : public multipass::VMImageVault
         return {};
     }
 
+    std::vector<std::string> cached_images() override
+    {
+        return {};
+    }
+
     TempFile dummy_image;
 };
 }
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mock_settings.h"
+
+#include "src/daemon/admission_policy.h"
+
+#include <multipass/constants.h>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+
+namespace
+{
+constexpr auto gigabyte = 1024LL * 1024 * 1024;
+
+struct AdmissionPolicy : public Test
+{
+    mp::AdmissionPolicy policy{mp::AdmissionPolicy::Mode::queue, {8, 16 * gigabyte}};
+};
+} // namespace
+
+TEST_F(AdmissionPolicy, admits_what_fits_next_to_what_is_up)
+{
+    EXPECT_TRUE(policy.admits({4, 8 * gigabyte}, {4, 8 * gigabyte}, 0));
+}
+
+TEST_F(AdmissionPolicy, turns_away_more_cores_than_the_limit)
+{
+    EXPECT_FALSE(policy.admits({6, 2 * gigabyte}, {4, 2 * gigabyte}, 0));
+}
+
+TEST_F(AdmissionPolicy, turns_away_more_memory_than_the_limit)
+{
+    EXPECT_FALSE(policy.admits({1, 12 * gigabyte}, {1, 8 * gigabyte}, 0));
+}
+
+TEST_F(AdmissionPolicy, turns_away_anything_while_the_host_stalls_on_memory)
+{
+    EXPECT_FALSE(policy.admits({1, gigabyte}, {1, gigabyte}, 25.0));
+}
+
+TEST_F(AdmissionPolicy, memory_pressure_does_not_hold_back_the_first_instance)
+{
+    EXPECT_TRUE(policy.admits({0, 0}, {1, gigabyte}, 25.0));
+}
+
+TEST_F(AdmissionPolicy, knows_what_can_never_fit)
+{
+    EXPECT_TRUE(policy.can_ever_admit({8, 16 * gigabyte}));
+    EXPECT_FALSE(policy.can_ever_admit({16, gigabyte}));
+}
+
+TEST_F(AdmissionPolicy, no_memory_limit_where_unknown)
+{
+    policy.limit.memory = 0;
+
+    EXPECT_TRUE(policy.admits({1, 64 * gigabyte}, {1, 64 * gigabyte}, 0));
+}
+
+TEST_F(AdmissionPolicy, comes_from_the_settings)
+{
+    auto& mock_settings = mpt::MockSettings::mock_instance();
+    EXPECT_CALL(mock_settings, get(_)).Times(AnyNumber());
+    EXPECT_CALL(mock_settings, get(Eq(mp::admission_mode_key))).WillRepeatedly(Return("reject"));
+    EXPECT_CALL(mock_settings, get(Eq(mp::admission_cpus_key))).WillRepeatedly(Return("12"));
+    EXPECT_CALL(mock_settings, get(Eq(mp::admission_memory_key))).WillRepeatedly(Return("24G"));
+
+    const auto from_settings = mp::AdmissionPolicy::from_settings();
+
+    EXPECT_EQ(from_settings.mode, mp::AdmissionPolicy::Mode::reject);
+    EXPECT_EQ(from_settings.limit.cores, 12);
+    EXPECT_EQ(from_settings.limit.memory, 24 * gigabyte);
+}
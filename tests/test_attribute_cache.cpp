@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "file_operations.h"
+#include "temp_dir.h"
+
+#include <multipass/sshfs_mount/attribute_cache.h>
+
+#include <gmock/gmock.h>
+
+#include <QDir>
+#include <QFile>
+
+#include <chrono>
+#include <thread>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+using namespace testing;
+
+namespace
+{
+struct AttributeCache : public Test
+{
+    AttributeCache() : file_name{(temp_dir.path() + "/dir/test-file").toStdString()}
+    {
+        QDir{temp_dir.path()}.mkdir("dir");
+        mpt::make_file_with_content(QString::fromStdString(file_name));
+    }
+
+    mp::AttributeCache::Attributes stat(const std::string& path)
+    {
+        return cache.attributes_of(path, false, [this, &path] {
+            ++num_stats;
+            QFileInfo info{QString::fromStdString(path)};
+            mp::AttributeCache::Attributes attributes{{}, info.exists(), false};
+            attributes.attr.size = info.size();
+            return attributes;
+        });
+    }
+
+    template <typename Predicate>
+    bool eventually(Predicate&& predicate)
+    {
+        for (auto i = 0; i < 200; ++i)
+        {
+            if (predicate())
+                return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds{5});
+        }
+        return false;
+    }
+
+    mpt::TempDir temp_dir;
+    std::string file_name;
+    mp::AttributeCache cache{temp_dir.path().toStdString()};
+    int num_stats{0};
+};
+
+TEST_F(AttributeCache, stats_each_path_once)
+{
+    stat(file_name);
+    stat(file_name);
+
+    EXPECT_THAT(num_stats, Eq(1));
+}
+
+TEST_F(AttributeCache, forgets_files_changed_behind_its_back)
+{
+    const auto original_size = stat(file_name).attr.size;
+
+    QFile file{QString::fromStdString(file_name)};
+    ASSERT_TRUE(file.open(QIODevice::Append));
+    file.write("more");
+    file.close();
+
+    EXPECT_TRUE(eventually([this, original_size] { return stat(file_name).attr.size == original_size + 4; }));
+}
+
+TEST_F(AttributeCache, forgets_what_was_under_a_renamed_directory)
+{
+    ASSERT_TRUE(stat(file_name).exists);
+    ASSERT_TRUE(QDir{temp_dir.path()}.rename("dir", "other"));
+
+    EXPECT_TRUE(eventually([this] { return !stat(file_name).exists; }));
+}
+
+TEST_F(AttributeCache, forgets_invalidated_paths)
+{
+    stat(file_name);
+    cache.invalidate(file_name);
+    stat(file_name);
+
+    EXPECT_THAT(num_stats, Eq(2));
+}
+
+TEST_F(AttributeCache, does_not_keep_paths_outside_its_root)
+{
+    const auto outside = QDir::tempPath().toStdString();
+    stat(outside);
+    stat(outside);
+
+    EXPECT_THAT(num_stats, Eq(2));
+}
+} // namespace
@@ -40,7 +40,7 @@ struct MockBaseFactory : mp::BaseVirtualMachineFactory
     MOCK_METHOD2(create_virtual_machine,
                  mp::VirtualMachine::UPtr(const mp::VirtualMachineDescription&, mp::VMStatusMonitor&));
     MOCK_METHOD1(remove_resources_for, void(const std::string&));
-    MOCK_METHOD1(prepare_source_image, mp::VMImage(const mp::VMImage&));
+    MOCK_METHOD2(prepare_source_image, mp::VMImage(const mp::VMImage&, const mp::ProgressMonitor&));
     MOCK_METHOD2(prepare_instance_image, void(const mp::VMImage&, const mp::VirtualMachineDescription&));
     MOCK_METHOD0(hypervisor_health_check, void());
     MOCK_METHOD0(get_backend_version_string, QString());
@@ -88,6 +88,13 @@ TEST_F(BaseFactory, networks_throws)
     ASSERT_THROW(factory.networks(), mp::NotImplementedOnThisBackendException);
 }
 
+TEST_F(BaseFactory, rename_resources_for_throws)
+{
+    MockBaseFactory factory;
+
+    ASSERT_THROW(factory.rename_resources_for("foo", "bar"), mp::NotImplementedOnThisBackendException);
+}
+
 // Ideally, we'd define some unique YAML for each node and test the contents of the ISO image,
 // but we'd need a cross-platfrom library to read files in an ISO image and that is beyond scope
 // at this time.  Instead, just make sure an ISO image is created and has the expected path.
@@ -113,7 +120,8 @@ TEST_F(BaseFactory, creates_cloud_init_iso_image)
                                           metadata,
                                           user_data,
                                           vendor_data,
-                                          network_data};
+                                          network_data,
+                                          {}};
 
     MockBaseFactory factory;
     factory.configure(vm_desc);
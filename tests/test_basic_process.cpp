@@ -15,6 +15,7 @@
  *
  */
 
+#include <multipass/process/async_process.h>
 #include <multipass/process/basic_process.h>
 #include <multipass/process/simple_process_spec.h>
 
@@ -22,6 +23,10 @@
 
 #include <gmock/gmock.h>
 
+#include <QThread>
+
+#include <stdexcept>
+
 namespace mp = multipass;
 namespace mpt = multipass::test;
 
@@ -262,3 +267,29 @@ TEST_F(BasicProcessTest, reports_previous_pid_after_finished)
     ASSERT_GT(pid, 0);
     EXPECT_EQ(process.process_id(), pid);
 }
+
+TEST_F(BasicProcessTest, execute_async_runs_process_off_the_calling_thread)
+{
+    const auto caller = QThread::currentThread();
+    QThread* runner = nullptr;
+    auto future = mp::execute_async([&runner] {
+        runner = QThread::currentThread();
+        return std::make_unique<mp::BasicProcess>(mp::simple_process_spec("mock_process", {"7"}));
+    });
+
+    const auto output = future.result();
+    ASSERT_TRUE(output.state.exit_code);
+    EXPECT_EQ(*output.state.exit_code, 7);
+    EXPECT_NE(runner, caller);
+}
+
+TEST_F(BasicProcessTest, execute_async_reports_failure_to_create_process)
+{
+    auto future = mp::execute_async([]() -> mp::Process::UPtr { throw std::runtime_error{"no such tool"}; });
+
+    const auto output = future.result();
+    EXPECT_FALSE(output.state.completed_successfully());
+    ASSERT_TRUE(output.state.error);
+    EXPECT_EQ(output.state.error->state, QProcess::FailedToStart);
+    EXPECT_EQ(output.state.failure_message(), "no such tool");
+}
@@ -94,6 +94,22 @@ struct MockDaemonRpc : public mp::DaemonRpc
                                       grpc::ServerWriter<mp::UmountReply>* response));
     MOCK_METHOD3(version, grpc::Status(grpc::ServerContext* context, const mp::VersionRequest* request,
                                        grpc::ServerWriter<mp::VersionReply>* response));
+    MOCK_METHOD3(bake, grpc::Status(grpc::ServerContext* context, const mp::BakeRequest* request,
+                                    grpc::ServerWriter<mp::BakeReply>* response));
+    MOCK_METHOD3(stats, grpc::Status(grpc::ServerContext* context, const mp::StatsRequest* request,
+                                     grpc::ServerWriter<mp::StatsReply>* response));
+    MOCK_METHOD3(bench_mount, grpc::Status(grpc::ServerContext* context, const mp::BenchMountRequest* request,
+                                           grpc::ServerWriter<mp::BenchMountReply>* response));
+    MOCK_METHOD3(throttle, grpc::Status(grpc::ServerContext* context, const mp::ThrottleRequest* request,
+                                        grpc::ServerWriter<mp::ThrottleReply>* response));
+    MOCK_METHOD3(clone, grpc::Status(grpc::ServerContext* context, const mp::CloneRequest* request,
+                                     grpc::ServerWriter<mp::CloneReply>* response));
+    MOCK_METHOD3(forward, grpc::Status(grpc::ServerContext* context, const mp::ForwardRequest* request,
+                                       grpc::ServerWriter<mp::ForwardReply>* response));
+    MOCK_METHOD3(copy_files, grpc::Status(grpc::ServerContext* context, const mp::CopyFilesRequest* request,
+                                          grpc::ServerWriter<mp::CopyFilesReply>* response));
+    MOCK_METHOD3(resize, grpc::Status(grpc::ServerContext* context, const mp::ResizeRequest* request,
+                                      grpc::ServerWriter<mp::ResizeReply>* response));
     MOCK_METHOD3(ping,
                  grpc::Status(grpc::ServerContext* context, const mp::PingRequest* request, mp::PingReply* response));
 };
@@ -313,15 +329,60 @@ TEST_F(Client, transfer_cmd_fails_source_is_dir)
                 Eq(mp::ReturnCode::CommandLineError));
 }
 
+TEST_F(Client, transfer_cmd_recursive_source_dir_ok)
+{
+    EXPECT_CALL(mock_daemon, ssh_info(_, _, _));
+    EXPECT_THAT(send_command({"transfer", "-r", mpt::test_data_path().toStdString(), "test-vm:bar"}),
+                Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, transfer_cmd_sync_into_instance_ok)
+{
+    EXPECT_CALL(mock_daemon, ssh_info(_, _, _));
+    EXPECT_THAT(send_command({"transfer", "--sync", mpt::test_data_path().toStdString() + "good_index.json",
+                              "test-vm:bar"}),
+                Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, transfer_cmd_compress_ok)
+{
+    EXPECT_CALL(mock_daemon, ssh_info(_, _, _));
+    EXPECT_THAT(send_command({"transfer", "--compress", "test-vm:foo", mpt::test_data_path().toStdString()}),
+                Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, transfer_cmd_sync_fails_out_of_instance)
+{
+    EXPECT_THAT(send_command({"transfer", "--sync", "test-vm:foo", mpt::test_data_path().toStdString()}),
+                Eq(mp::ReturnCode::CommandLineError));
+}
+
 TEST_F(Client, transfer_cmd_fails_no_instance)
 {
     EXPECT_THAT(send_command({"transfer", mpt::test_data_path().toStdString() + "good_index.json", "."}),
                 Eq(mp::ReturnCode::CommandLineError));
 }
 
-TEST_F(Client, transfer_cmd_fails_instance_both_source_destination)
+TEST_F(Client, transfer_cmd_between_instances_goes_through_daemon)
+{
+    EXPECT_CALL(mock_daemon, copy_files(_, _, _));
+    EXPECT_CALL(mock_daemon, ssh_info(_, _, _)).Times(0);
+    EXPECT_THAT(send_command({"transfer", "test-vm1:foo", "test-vm2:bar"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, transfer_cmd_fails_sources_in_several_places_into_instance)
 {
-    EXPECT_THAT(send_command({"transfer", "test-vm1:foo", "test-vm2:bar"}), Eq(mp::ReturnCode::CommandLineError));
+    EXPECT_THAT(send_command({"transfer", "test-vm1:foo", mpt::test_data_path().toStdString() + "good_index.json",
+                              "test-vm2:bar"}),
+                Eq(mp::ReturnCode::CommandLineError));
+    EXPECT_THAT(send_command({"transfer", "test-vm1:foo", "test-vm3:baz", "test-vm2:bar"}),
+                Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, transfer_cmd_sync_fails_between_instances)
+{
+    EXPECT_THAT(send_command({"transfer", "--sync", "test-vm1:foo", "test-vm2:bar"}),
+                Eq(mp::ReturnCode::CommandLineError));
 }
 
 TEST_F(Client, transfer_cmd_fails_too_few_args)
@@ -586,6 +647,98 @@ TEST_F(Client, launch_cmd_cpu_option_fails_no_value)
     EXPECT_THAT(send_command({"launch", "-c"}), Eq(mp::ReturnCode::CommandLineError));
 }
 
+TEST_F(Client, launch_cmd_storage_profile_option_ok)
+{
+    EXPECT_CALL(mock_daemon, launch(_, Property(&mp::LaunchRequest::storage_profile, StrEq("performance")), _));
+    EXPECT_THAT(send_command({"launch", "--storage-profile", "performance"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, launch_cmd_ephemeral_option_ok)
+{
+    EXPECT_CALL(mock_daemon, launch(_, Property(&mp::LaunchRequest::ephemeral, true), _));
+    EXPECT_THAT(send_command({"launch", "--ephemeral"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, launch_cmd_storage_profile_option_fails_no_value)
+{
+    EXPECT_THAT(send_command({"launch", "--storage-profile"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, launch_cmd_io_limit_options_ok)
+{
+    EXPECT_CALL(mock_daemon,
+                launch(_,
+                       Property(&mp::LaunchRequest::io_limits,
+                                AllOf(Property(&mp::IoLimitOptions::disk_iops, Eq(500)),
+                                      Property(&mp::IoLimitOptions::disk_bytes_per_second, Eq(100 << 20)),
+                                      Property(&mp::IoLimitOptions::network_bytes_per_second, Eq(1 << 20)))),
+                       _));
+    EXPECT_THAT(send_command({"launch", "--disk-iops", "500", "--disk-bandwidth", "100M", "--network-bandwidth", "1M"}),
+                Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, launch_cmd_io_limit_options_fail_bad_values)
+{
+    EXPECT_THAT(send_command({"launch", "--disk-iops", "-1"}), Eq(mp::ReturnCode::CommandLineError));
+    EXPECT_THAT(send_command({"launch", "--disk-bandwidth", "fast"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, launch_cmd_count_option_ok)
+{
+    EXPECT_CALL(mock_daemon, launch(_, Property(&mp::LaunchRequest::count, Eq(20)), _));
+    EXPECT_THAT(send_command({"launch", "--count", "20"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, launch_cmd_count_option_fails_when_not_positive)
+{
+    for (const auto& count : {"0", "-2", "many"})
+        EXPECT_THAT(send_command({"launch", "--count", count}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, launch_cmd_count_option_fails_above_the_maximum)
+{
+    EXPECT_CALL(mock_daemon, launch(_, _, _)).Times(0);
+    EXPECT_THAT(send_command({"launch", "--count", std::to_string(mp::max_launch_count + 1)}),
+                Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, launch_cmd_reports_every_instance_of_a_batch)
+{
+    EXPECT_CALL(mock_daemon, launch(_, _, _)).WillOnce([](auto, auto, auto* server) {
+        mp::LaunchReply reply;
+        reply.add_launched_instances("ci-1");
+        reply.add_launched_instances("ci-2");
+        server->Write(reply);
+        return grpc::Status{};
+    });
+
+    std::stringstream cout_stream;
+    EXPECT_THAT(send_command({"launch", "--name", "ci", "--count", "2"}, cout_stream), Eq(mp::ReturnCode::Ok));
+    EXPECT_THAT(cout_stream.str(), AllOf(HasSubstr("Launched: ci-1\n"), HasSubstr("Launched: ci-2\n")));
+}
+
+TEST_F(Client, launch_cmd_reports_timings_only_when_asked)
+{
+    EXPECT_CALL(mock_daemon, launch(_, _, _)).Times(2).WillRepeatedly([](auto, auto, auto* server) {
+        mp::LaunchReply reply;
+        reply.set_vm_instance_name("foo");
+        auto timing = reply.add_timings();
+        timing->set_instance_name("foo");
+        timing->set_phase("download");
+        timing->set_microseconds(1500000);
+        server->Write(reply);
+        return grpc::Status{};
+    });
+
+    std::stringstream cout_stream;
+    EXPECT_THAT(send_command({"launch"}, cout_stream), Eq(mp::ReturnCode::Ok));
+    EXPECT_THAT(cout_stream.str(), Not(HasSubstr("download")));
+
+    cout_stream.str("");
+    EXPECT_THAT(send_command({"launch", "--timings"}, cout_stream), Eq(mp::ReturnCode::Ok));
+    EXPECT_THAT(cout_stream.str(), AllOf(HasSubstr("Timings for foo:\n"), ContainsRegex("download +1\\.500s")));
+}
+
 TEST_F(Client, DISABLE_ON_MACOS(launch_cmd_custom_image_file_ok))
 {
     EXPECT_CALL(mock_daemon, launch(_, _, _));
@@ -784,6 +937,54 @@ TEST_F(Client, exec_cmd_help_ok)
     EXPECT_THAT(send_command({"exec", "-h"}), Eq(mp::ReturnCode::Ok));
 }
 
+TEST_F(Client, exec_cmd_instances_takes_every_positional_as_command)
+{
+    EXPECT_CALL(mock_daemon,
+                ssh_info(_, Property(&mp::SSHInfoRequest::instance_name, ElementsAre(StrEq("foo"), StrEq("bar"))), _));
+    EXPECT_THAT(send_command({"exec", "--instances", "foo,bar", "--", "cmd"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, exec_cmd_all_runs_on_running_instances_only)
+{
+    EXPECT_CALL(mock_daemon, list(_, _, _))
+        .WillOnce([](Unused, Unused, grpc::ServerWriter<mp::ListReply>* response) {
+            mp::ListReply list_reply;
+            auto running = list_reply.add_instances();
+            running->set_name("foo");
+            running->mutable_instance_status()->set_status(mp::InstanceStatus::RUNNING);
+            auto stopped = list_reply.add_instances();
+            stopped->set_name("bar");
+            stopped->mutable_instance_status()->set_status(mp::InstanceStatus::STOPPED);
+            response->Write(list_reply);
+
+            return grpc::Status{};
+        });
+    EXPECT_CALL(mock_daemon, ssh_info(_, make_ssh_info_instance_matcher("foo"), _));
+    EXPECT_THAT(send_command({"exec", "--all", "cmd"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, exec_cmd_all_without_running_instances_does_nothing)
+{
+    EXPECT_CALL(mock_daemon, list(_, _, _)).WillOnce(Invoke(make_fill_listreply({mp::InstanceStatus::STOPPED})));
+    EXPECT_CALL(mock_daemon, ssh_info(_, _, _)).Times(0);
+    EXPECT_THAT(send_command({"exec", "--all", "cmd"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, exec_cmd_all_and_instances_fails)
+{
+    EXPECT_THAT(send_command({"exec", "--all", "--instances", "foo", "cmd"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, exec_cmd_instances_without_command_fails)
+{
+    EXPECT_THAT(send_command({"exec", "--instances", "foo"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, exec_cmd_bad_parallel_fails)
+{
+    EXPECT_THAT(send_command({"exec", "--all", "--parallel", "0", "cmd"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
 TEST_F(Client, exec_cmd_no_double_dash_unknown_option_fails_print_suggested_command)
 {
     std::stringstream cerr_stream;
@@ -871,6 +1072,29 @@ TEST_F(Client, info_cmd_fails_with_names_and_all)
     EXPECT_THAT(send_command({"info", "--all", "foo", "bar"}), Eq(mp::ReturnCode::CommandLineError));
 }
 
+TEST_F(Client, info_cmd_passes_the_timeout_on)
+{
+    EXPECT_CALL(mock_daemon, info(_, Property(&mp::InfoRequest::timeout, Eq(3)), _));
+    EXPECT_THAT(send_command({"info", "--all", "--timeout", "3"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, info_cmd_fails_with_invalid_timeout)
+{
+    EXPECT_THAT(send_command({"info", "--all", "--timeout", "-1"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, info_cmd_asks_for_the_usage_history_with_history)
+{
+    EXPECT_CALL(mock_daemon, info(_, Property(&mp::InfoRequest::history_points, Gt(0)), _));
+    EXPECT_THAT(send_command({"info", "foo", "--history"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, info_cmd_leaves_the_usage_history_out_by_default)
+{
+    EXPECT_CALL(mock_daemon, info(_, Property(&mp::InfoRequest::history_points, Eq(0)), _));
+    EXPECT_THAT(send_command({"info", "foo"}), Eq(mp::ReturnCode::Ok));
+}
+
 // list cli tests
 TEST_F(Client, list_cmd_ok_no_args)
 {
@@ -902,6 +1126,13 @@ TEST_F(Client, mount_cmd_good_absolute_source_path)
     EXPECT_THAT(send_command({"mount", mpt::test_data_path().toStdString(), "test-vm:test"}), Eq(mp::ReturnCode::Ok));
 }
 
+TEST_F(Client, mount_cmd_fails_for_instances_on_other_hosts)
+{
+    EXPECT_CALL(mock_daemon, mount(_, _, _)).Times(0);
+    EXPECT_THAT(send_command({"mount", mpt::test_data_path().toStdString(), "test-vm@other-host:test"}),
+                Eq(mp::ReturnCode::CommandLineError));
+}
+
 TEST_F(Client, mount_cmd_good_relative_source_path)
 {
     EXPECT_CALL(mock_daemon, mount(_, _, _));
@@ -966,6 +1197,45 @@ TEST_F(Client, mount_cmd_fails_invalid_host_int_gid_map)
                 Eq(mp::ReturnCode::CommandLineError));
 }
 
+TEST_F(Client, mount_cmd_defaults_to_classic_type)
+{
+    EXPECT_CALL(mock_daemon, mount(_, Property(&mp::MountRequest::mount_type, Eq(mp::MountRequest::CLASSIC)), _));
+    EXPECT_THAT(send_command({"mount", mpt::test_data_path().toStdString(), "test-vm:test"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, mount_cmd_good_native_type)
+{
+    EXPECT_CALL(mock_daemon, mount(_, Property(&mp::MountRequest::mount_type, Eq(mp::MountRequest::NATIVE)), _));
+    EXPECT_THAT(send_command({"mount", mpt::test_data_path().toStdString(), "--type", "native", "test-vm:test"}),
+                Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, mount_cmd_fails_invalid_type)
+{
+    EXPECT_THAT(send_command({"mount", mpt::test_data_path().toStdString(), "-t", "nfs", "test-vm:test"}),
+                Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, mount_cmd_passes_compression)
+{
+    EXPECT_CALL(mock_daemon, mount(_, Property(&mp::MountRequest::compression, Eq("off")), _));
+    EXPECT_THAT(send_command({"mount", mpt::test_data_path().toStdString(), "--compression", "off", "test-vm:test"}),
+                Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, mount_cmd_fails_invalid_compression)
+{
+    EXPECT_THAT(send_command({"mount", mpt::test_data_path().toStdString(), "--compression", "zstd", "test-vm:test"}),
+                Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, mount_cmd_fails_compression_of_native_mount)
+{
+    EXPECT_THAT(send_command({"mount", mpt::test_data_path().toStdString(), "--type", "native", "--compression", "on",
+                              "test-vm:test"}),
+                Eq(mp::ReturnCode::CommandLineError));
+}
+
 // recover cli tests
 TEST_F(Client, recover_cmd_fails_no_args)
 {
@@ -1000,6 +1270,273 @@ TEST_F(Client, recover_cmd_fails_with_names_and_all)
     EXPECT_THAT(send_command({"recover", "--all", "foo", "bar"}), Eq(mp::ReturnCode::CommandLineError));
 }
 
+// bake cli tests
+TEST_F(Client, bake_cmd_fails_no_args)
+{
+    EXPECT_THAT(send_command({"bake"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, bake_cmd_fails_with_too_many_args)
+{
+    EXPECT_THAT(send_command({"bake", "foo", "bar", "baz"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, bake_cmd_ok_with_instance_name)
+{
+    EXPECT_CALL(mock_daemon, bake(_, Property(&mp::BakeRequest::instance_name, StrEq("foo")), _));
+    EXPECT_THAT(send_command({"bake", "foo"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, bake_cmd_forwards_image_name)
+{
+    EXPECT_CALL(mock_daemon, bake(_, Property(&mp::BakeRequest::image_name, StrEq("ci")), _));
+    EXPECT_THAT(send_command({"bake", "foo", "ci"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, bake_cmd_help_ok)
+{
+    EXPECT_THAT(send_command({"bake", "-h"}), Eq(mp::ReturnCode::Ok));
+}
+
+// clone cli tests
+TEST_F(Client, clone_cmd_fails_without_new_name)
+{
+    EXPECT_THAT(send_command({"clone", "foo"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, clone_cmd_fails_with_too_many_args)
+{
+    EXPECT_THAT(send_command({"clone", "foo", "bar", "baz"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, clone_cmd_ok_with_source_and_new_name)
+{
+    EXPECT_CALL(mock_daemon, clone(_,
+                                   AllOf(Property(&mp::CloneRequest::source_name, StrEq("foo")),
+                                         Property(&mp::CloneRequest::destination_name, StrEq("bar"))),
+                                   _));
+    EXPECT_THAT(send_command({"clone", "foo", "bar"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, clone_cmd_help_ok)
+{
+    EXPECT_THAT(send_command({"clone", "-h"}), Eq(mp::ReturnCode::Ok));
+}
+
+// forward cli tests
+TEST_F(Client, forward_cmd_lists_with_instance_only)
+{
+    EXPECT_CALL(mock_daemon, forward(_,
+                                     AllOf(Property(&mp::ForwardRequest::instance_name, StrEq("foo")),
+                                           Property(&mp::ForwardRequest::host_port, 0)),
+                                     _));
+    EXPECT_THAT(send_command({"forward", "foo"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, forward_cmd_ok_with_host_and_instance_ports)
+{
+    EXPECT_CALL(mock_daemon, forward(_,
+                                     AllOf(Property(&mp::ForwardRequest::host_port, 8080),
+                                           Property(&mp::ForwardRequest::instance_port, 80),
+                                           Property(&mp::ForwardRequest::host_address, StrEq("127.0.0.1"))),
+                                     _));
+    EXPECT_THAT(send_command({"forward", "foo", "8080:80", "--address", "127.0.0.1"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, forward_cmd_uses_single_port_for_both)
+{
+    EXPECT_CALL(mock_daemon, forward(_,
+                                     AllOf(Property(&mp::ForwardRequest::host_port, 5432),
+                                           Property(&mp::ForwardRequest::instance_port, 5432)),
+                                     _));
+    EXPECT_THAT(send_command({"forward", "foo", "5432"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, forward_cmd_cancels_host_port)
+{
+    EXPECT_CALL(mock_daemon, forward(_,
+                                     AllOf(Property(&mp::ForwardRequest::cancel, true),
+                                           Property(&mp::ForwardRequest::host_port, 8080)),
+                                     _));
+    EXPECT_THAT(send_command({"forward", "--cancel", "foo", "8080"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, forward_cmd_fails_with_invalid_ports)
+{
+    EXPECT_THAT(send_command({"forward", "foo", "8080:99999"}), Eq(mp::ReturnCode::CommandLineError));
+    EXPECT_THAT(send_command({"forward", "foo", "a:b"}), Eq(mp::ReturnCode::CommandLineError));
+    EXPECT_THAT(send_command({"forward", "--cancel", "foo", "8080:80"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, forward_cmd_cancel_fails_without_port)
+{
+    EXPECT_THAT(send_command({"forward", "--cancel", "foo"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+// stats cli tests
+TEST_F(Client, stats_cmd_ok_no_args)
+{
+    EXPECT_CALL(mock_daemon, stats(_, _, _));
+    EXPECT_THAT(send_command({"stats"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, stats_cmd_forwards_trace_option)
+{
+    EXPECT_CALL(mock_daemon, stats(_, Property(&mp::StatsRequest::trace, IsTrue()), _));
+    EXPECT_THAT(send_command({"stats", "--trace"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, stats_cmd_fails_with_args)
+{
+    EXPECT_THAT(send_command({"stats", "foo"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, stats_cmd_help_ok)
+{
+    EXPECT_THAT(send_command({"stats", "-h"}), Eq(mp::ReturnCode::Ok));
+}
+
+// batch cli tests
+TEST_F(Client, batch_runs_each_line_with_fresh_commands)
+{
+    std::stringstream cin{"stats --trace\n\n# a comment\nstats\n"};
+
+    InSequence seq;
+    EXPECT_CALL(mock_daemon, stats(_, Property(&mp::StatsRequest::trace, IsTrue()), _));
+    EXPECT_CALL(mock_daemon, stats(_, Property(&mp::StatsRequest::trace, IsFalse()), _));
+    EXPECT_THAT(send_command({"--batch"}, trash_stream, trash_stream, cin), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, batch_splits_lines_on_quotes)
+{
+    std::stringstream cin{"start 'foo bar' \"baz\"\n"};
+
+    EXPECT_CALL(mock_daemon, start(_, Property(&mp::StartRequest::instance_names, Truly([](const auto& names) {
+                                                   return names.instance_name_size() == 2 &&
+                                                          names.instance_name(0) == "foo bar" &&
+                                                          names.instance_name(1) == "baz";
+                                               })),
+                                   _));
+    EXPECT_THAT(send_command({"--batch"}, trash_stream, trash_stream, cin), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, batch_carries_on_past_failures_and_reports_them)
+{
+    std::stringstream cin{"stats foo\nstats\n"};
+
+    EXPECT_CALL(mock_daemon, stats(_, _, _));
+    EXPECT_THAT(send_command({"--batch"}, trash_stream, trash_stream, cin), Eq(mp::ReturnCode::CommandLineError));
+}
+
+// bench-mount cli tests
+TEST_F(Client, bench_mount_cmd_forwards_instance_path_and_size)
+{
+    EXPECT_CALL(mock_daemon,
+                bench_mount(_,
+                            AllOf(Property(&mp::BenchMountRequest::instance_name, StrEq("foo")),
+                                  Property(&mp::BenchMountRequest::target_path, StrEq("/home/ubuntu/src")),
+                                  Property(&mp::BenchMountRequest::size_mib, Eq(16))),
+                            _));
+    EXPECT_THAT(send_command({"bench-mount", "foo:/home/ubuntu/src", "--size", "16"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, bench_mount_cmd_fails_without_a_mount)
+{
+    EXPECT_THAT(send_command({"bench-mount"}), Eq(mp::ReturnCode::CommandLineError));
+    EXPECT_THAT(send_command({"bench-mount", "foo"}), Eq(mp::ReturnCode::CommandLineError));
+    EXPECT_THAT(send_command({"bench-mount", "foo:"}), Eq(mp::ReturnCode::CommandLineError));
+    EXPECT_THAT(send_command({"bench-mount", "foo:/a", "foo:/b"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, bench_mount_cmd_fails_with_bad_size)
+{
+    EXPECT_THAT(send_command({"bench-mount", "foo:/a", "--size", "0"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, bench_mount_cmd_prints_results)
+{
+    EXPECT_CALL(mock_daemon, bench_mount(_, _, _)).WillOnce([](auto, auto, auto* server) {
+        mp::BenchMountReply reply;
+        auto result = reply.mutable_result();
+        result->set_operation("seq_read");
+        result->set_count(128);
+        result->set_bytes(128 << 20);
+        result->set_seconds(2);
+        result->set_p50_seconds(0.015);
+        result->set_p99_seconds(0.0001);
+        server->Write(reply);
+        return grpc::Status{};
+    });
+
+    std::stringstream cout_stream;
+    EXPECT_THAT(send_command({"bench-mount", "foo:/a"}, cout_stream), Eq(mp::ReturnCode::Ok));
+    EXPECT_THAT(cout_stream.str(), AllOf(HasSubstr("Throughput"), HasSubstr("seq_read"), HasSubstr("67.1 MB/s"),
+                                         HasSubstr("15.0ms"), HasSubstr("100us")));
+}
+
+TEST_F(Client, bench_mount_cmd_help_ok)
+{
+    EXPECT_THAT(send_command({"bench-mount", "-h"}), Eq(mp::ReturnCode::Ok));
+}
+
+// throttle cli tests
+TEST_F(Client, throttle_cmd_forwards_instance_and_limits)
+{
+    EXPECT_CALL(mock_daemon,
+                throttle(_,
+                         AllOf(Property(&mp::ThrottleRequest::instance_name, StrEq("foo")),
+                               Property(&mp::ThrottleRequest::io_limits,
+                                        AllOf(Property(&mp::IoLimitOptions::disk_iops, Eq(100)),
+                                              Property(&mp::IoLimitOptions::disk_iops_burst, Eq(400)),
+                                              Property(&mp::IoLimitOptions::disk_bytes_burst, Eq(0))))),
+                         _));
+    EXPECT_THAT(send_command({"throttle", "foo", "--disk-iops", "100", "--disk-iops-burst", "400"}),
+                Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, throttle_cmd_fails_without_one_instance)
+{
+    EXPECT_THAT(send_command({"throttle"}), Eq(mp::ReturnCode::CommandLineError));
+    EXPECT_THAT(send_command({"throttle", "foo", "bar"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, throttle_cmd_help_ok)
+{
+    EXPECT_THAT(send_command({"throttle", "-h"}), Eq(mp::ReturnCode::Ok));
+}
+
+// resize cli tests
+TEST_F(Client, resize_cmd_forwards_instance_and_size)
+{
+    EXPECT_CALL(mock_daemon, resize(_,
+                                    AllOf(Property(&mp::ResizeRequest::instance_name, StrEq("foo")),
+                                          Property(&mp::ResizeRequest::num_cores, Eq(4)),
+                                          Property(&mp::ResizeRequest::mem_size, StrEq("8G"))),
+                                    _));
+    EXPECT_THAT(send_command({"resize", "foo", "--cpus", "4", "--mem", "8G"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, resize_cmd_leaves_out_what_is_not_given)
+{
+    EXPECT_CALL(mock_daemon, resize(_,
+                                    AllOf(Property(&mp::ResizeRequest::num_cores, Eq(2)),
+                                          Property(&mp::ResizeRequest::mem_size, IsEmpty())),
+                                    _));
+    EXPECT_THAT(send_command({"resize", "foo", "--cpus", "2"}), Eq(mp::ReturnCode::Ok));
+}
+
+TEST_F(Client, resize_cmd_fails_without_anything_to_resize)
+{
+    EXPECT_THAT(send_command({"resize", "foo"}), Eq(mp::ReturnCode::CommandLineError));
+    EXPECT_THAT(send_command({"resize", "--cpus", "2"}), Eq(mp::ReturnCode::CommandLineError));
+    EXPECT_THAT(send_command({"resize", "foo", "--cpus", "none"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
+TEST_F(Client, resize_cmd_help_ok)
+{
+    EXPECT_THAT(send_command({"resize", "-h"}), Eq(mp::ReturnCode::Ok));
+}
+
 // start cli tests
 TEST_F(Client, start_cmd_ok_with_one_arg)
 {
@@ -1273,6 +1810,12 @@ TEST_F(Client, stop_cmd_succeeds_with_multiple_args)
     EXPECT_THAT(send_command({"stop", "foo", "bar"}), Eq(mp::ReturnCode::Ok));
 }
 
+TEST_F(Client, stop_cmd_fails_with_instances_on_different_hosts)
+{
+    EXPECT_CALL(mock_daemon, stop(_, _, _)).Times(0);
+    EXPECT_THAT(send_command({"stop", "foo", "bar@other-host"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
 TEST_F(Client, stop_cmd_help_ok)
 {
     EXPECT_THAT(send_command({"stop", "-h"}), Eq(mp::ReturnCode::Ok));
@@ -1608,6 +2151,12 @@ TEST_F(Client, delete_cmd_fails_with_names_and_all)
     EXPECT_THAT(send_command({"delete", "--all", "foo", "bar"}), Eq(mp::ReturnCode::CommandLineError));
 }
 
+TEST_F(Client, delete_cmd_fails_with_instances_on_different_hosts)
+{
+    EXPECT_CALL(mock_daemon, delet(_, _, _)).Times(0);
+    EXPECT_THAT(send_command({"delete", "foo@one-host", "bar@other-host"}), Eq(mp::ReturnCode::CommandLineError));
+}
+
 TEST_F(Client, delete_cmd_accepts_purge_option)
 {
     EXPECT_CALL(mock_daemon, delet(_, _, _)).Times(2);
@@ -1654,7 +2203,20 @@ TEST_P(TestBasicGetSetOptions, set_cmd_allows_empty_val)
 
 INSTANTIATE_TEST_SUITE_P(Client, TestBasicGetSetOptions,
                          Values(mp::petenv_key, mp::driver_key, mp::autostart_key, mp::hotkey_key,
-                                mp::bridged_interface_key));
+                                mp::bridged_interface_key, mp::image_cache_size_key, mp::image_cache_peers_key,
+                                mp::download_concurrency_key, mp::download_rate_key, mp::start_concurrency_key,
+                                mp::ssh_ciphers_key, mp::ssh_compression_key, mp::ssh_compression_level_key,
+                                mp::ssh_broker_key, mp::memory_reclaim_key, mp::cpu_pinning_key, mp::hugepages_key,
+                                mp::memory_merge_key, mp::warm_pool_size_key, mp::warm_pool_image_key,
+                                mp::warm_pool_cpus_key, mp::warm_pool_memory_key, mp::warm_pool_disk_key,
+                                mp::disk_overlays_key, mp::lazy_boot_key, mp::compress_images_key,
+                                mp::package_cache_key, mp::keep_running_key, mp::hosts_key,
+                                mp::admission_mode_key, mp::admission_cpus_key, mp::admission_memory_key,
+                                mp::fast_boot_key, mp::image_mirrors_key, mp::image_bulk_storage_key,
+                                mp::shutdown_action_key, mp::idle_suspend_key, mp::usage_history_interval_key,
+                                mp::rpc_compression_key, mp::rpc_keepalive_key, mp::rpc_window_key,
+                                mp::rpc_max_streams_key, mp::client_rpc_compression_key,
+                                mp::client_rpc_keepalive_key, mp::client_rpc_window_key, mp::boot_readahead_key));
 
 TEST_F(Client, get_cmd_fails_with_no_arguments)
 {
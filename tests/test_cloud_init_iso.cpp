@@ -45,3 +45,30 @@ TEST_F(CloudInitIso, creates_iso_file)
     EXPECT_TRUE(file.exists());
     EXPECT_THAT(file.size(), Ge(0));
 }
+
+TEST_F(CloudInitIso, lays_out_files_after_directory_records)
+{
+    mp::CloudInitIso iso;
+    iso.add_file("meta-data", "meta");
+    iso.add_file("user-data", "user");
+    iso.write_to(iso_path);
+
+    QFile file{iso_path};
+    ASSERT_TRUE(file.open(QIODevice::ReadOnly));
+    const auto image = file.readAll();
+
+    constexpr auto block_size = 2048;
+    EXPECT_EQ(image.size(), 25 * block_size);
+    EXPECT_EQ(image.mid(16 * block_size + 1, 5), "CD001");
+    EXPECT_EQ(image.mid(23 * block_size, 5), QByteArray("meta\0", 5));
+    EXPECT_EQ(image.mid(24 * block_size, 5), QByteArray("user\0", 5));
+}
+
+TEST_F(CloudInitIso, throws_when_directory_records_overflow)
+{
+    mp::CloudInitIso iso;
+    for (auto i = 0; i < 100; ++i)
+        iso.add_file("file-" + std::to_string(i), "data");
+
+    EXPECT_THROW(iso.write_to(iso_path), std::runtime_error);
+}
@@ -22,12 +22,14 @@
 #include "mischievous_url_downloader.h"
 #include "mock_platform.h"
 #include "path.h"
+#include "temp_dir.h"
 
 #include <multipass/exceptions/unsupported_alias_exception.h>
 #include <multipass/exceptions/unsupported_remote_exception.h>
 #include <multipass/format.h>
 #include <multipass/query.h>
 
+#include <QDir>
 #include <QUrl>
 
 #include <gmock/gmock.h>
@@ -302,22 +304,26 @@ TEST_F(CustomImageHost, handles_and_recovers_from_initial_network_failure)
     EXPECT_TRUE(host.info_for(query));
 }
 
-TEST_F(CustomImageHost, handles_and_recovers_from_later_network_failure)
+TEST_F(CustomImageHost, keeps_serving_manifests_through_later_network_failure)
 {
     const auto ttl = 0s; // to ensure updates are always retried
     mp::CustomVMImageHost host{&url_downloader, ttl, test_path};
 
     const auto query = make_query("core", "snapcraft");
     EXPECT_TRUE(host.info_for(query));
+    host.wait_for_manifest_refresh();
 
     url_downloader.mischiefs = 1000;
-    EXPECT_THROW(host.info_for(query), std::runtime_error);
+    EXPECT_TRUE(host.info_for(query));
+    host.wait_for_manifest_refresh();
+    EXPECT_TRUE(host.info_for(query));
+    host.wait_for_manifest_refresh();
 
     url_downloader.mischiefs = 0;
     EXPECT_TRUE(host.info_for(query));
 }
 
-TEST_F(CustomImageHost, handles_and_recovers_from_independent_server_failures)
+TEST_F(CustomImageHost, keeps_serving_remotes_through_independent_server_failures)
 {
     const auto ttl = 0h;
     mp::CustomVMImageHost host{&url_downloader, ttl, test_path};
@@ -327,9 +333,30 @@ TEST_F(CustomImageHost, handles_and_recovers_from_independent_server_failures)
 
     for (size_t i = 0; i < num_remotes; ++i)
     {
+        host.wait_for_manifest_refresh();
         url_downloader.mischiefs = i;
-        EXPECT_EQ(mpt::count_remotes(host), num_remotes - i);
+        EXPECT_EQ(mpt::count_remotes(host), num_remotes);
+        host.wait_for_manifest_refresh();
+        EXPECT_EQ(mpt::count_remotes(host), num_remotes);
+    }
+}
+
+TEST_F(CustomImageHost, serves_cached_manifests_after_restart_and_offline)
+{
+    mpt::TempDir cache_dir;
+    const auto cache_path = QDir{cache_dir.path()}.filePath("custom");
+    const auto query = make_query("core", "snapcraft");
+    {
+        mp::CustomVMImageHost host{&url_downloader, default_ttl, test_path, cache_path};
+        EXPECT_TRUE(host.info_for(query));
     }
+
+    url_downloader.mischiefs = 1000;
+    mp::CustomVMImageHost host{&url_downloader, default_ttl, test_path, cache_path};
+
+    EXPECT_TRUE(host.info_for(query));
+    host.wait_for_manifest_refresh();
+    EXPECT_TRUE(host.info_for(query));
 }
 
 TEST_F(CustomImageHost, info_for_unsupported_remote_throws)
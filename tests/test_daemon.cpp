@@ -15,10 +15,14 @@
  *
  */
 
+#include <multipass/auto_join_thread.h>
 #include <multipass/constants.h>
 #include <multipass/default_vm_workflow_provider.h>
+#include <multipass/logging/client_logger.h>
 #include <multipass/logging/log.h>
+#include <multipass/logging/multiplexing_logger.h>
 #include <multipass/name_generator.h>
+#include <multipass/ssh/ssh_session.h>
 #include <multipass/version.h>
 #include <multipass/virtual_machine_factory.h>
 #include <multipass/vm_image_host.h>
@@ -27,17 +31,20 @@
 #include "dummy_ssh_key_provider.h"
 #include "extra_assertions.h"
 #include "file_operations.h"
+#include "local_sockets.h"
 #include "mock_daemon.h"
 #include "mock_environment_helpers.h"
 #include "mock_logger.h"
 #include "mock_platform.h"
 #include "mock_process_factory.h"
 #include "mock_settings.h"
+#include "mock_ssh.h"
 #include "mock_utils.h"
 #include "mock_virtual_machine.h"
 #include "mock_vm_image_vault.h"
 #include "mock_vm_workflow_provider.h"
 #include "path.h"
+#include "stub_logger.h"
 #include "tracking_url_downloader.h"
 
 #include <yaml-cpp/yaml.h>
@@ -45,19 +52,29 @@
 #include <gtest/gtest.h>
 
 #include <QCoreApplication>
+#include <QDir>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QNetworkProxyFactory>
 #include <QStorageInfo>
 #include <QString>
 #include <QSysInfo>
+#include <QTimer>
 
 #include <scope_guard.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <ostream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <unordered_set>
 
 namespace mp = multipass;
 namespace mpl = multipass::logging;
@@ -135,8 +152,10 @@ TEST_F(Daemon, receives_commands)
         .WillOnce(Invoke(&daemon, &mpt::MockDaemon::set_promise_value<mp::PurgeRequest, mp::PurgeReply>));
     EXPECT_CALL(daemon, find(_, _, _))
         .WillOnce(Invoke(&daemon, &mpt::MockDaemon::set_promise_value<mp::FindRequest, mp::FindReply>));
-    EXPECT_CALL(daemon, ssh_info(_, _, _))
-        .WillOnce(Invoke(&daemon, &mpt::MockDaemon::set_promise_value<mp::SSHInfoRequest, mp::SSHInfoReply>));
+    EXPECT_CALL(daemon, ssh_info(_, _, true, _)) // over the daemon's own socket
+        .WillOnce([](auto, auto, auto, std::promise<grpc::Status>* status_promise) {
+            status_promise->set_value(grpc::Status::OK);
+        });
     EXPECT_CALL(daemon, info(_, _, _))
         .WillOnce(Invoke(&daemon, &mpt::MockDaemon::set_promise_value<mp::InfoRequest, mp::InfoReply>));
     EXPECT_CALL(daemon, list(_, _, _))
@@ -159,6 +178,18 @@ TEST_F(Daemon, receives_commands)
         .WillOnce(Invoke(&daemon, &mpt::MockDaemon::set_promise_value<mp::MountRequest, mp::MountReply>));
     EXPECT_CALL(daemon, umount(_, _, _))
         .WillOnce(Invoke(&daemon, &mpt::MockDaemon::set_promise_value<mp::UmountRequest, mp::UmountReply>));
+    EXPECT_CALL(daemon, bake(_, _, _))
+        .WillOnce(Invoke(&daemon, &mpt::MockDaemon::set_promise_value<mp::BakeRequest, mp::BakeReply>));
+    EXPECT_CALL(daemon, stats(_, _, _))
+        .WillOnce(Invoke(&daemon, &mpt::MockDaemon::set_promise_value<mp::StatsRequest, mp::StatsReply>));
+    EXPECT_CALL(daemon, bench_mount(_, _, _))
+        .WillOnce(Invoke(&daemon, &mpt::MockDaemon::set_promise_value<mp::BenchMountRequest, mp::BenchMountReply>));
+    EXPECT_CALL(daemon, throttle(_, _, _))
+        .WillOnce(Invoke(&daemon, &mpt::MockDaemon::set_promise_value<mp::ThrottleRequest, mp::ThrottleReply>));
+    EXPECT_CALL(daemon, clone(_, _, _))
+        .WillOnce(Invoke(&daemon, &mpt::MockDaemon::set_promise_value<mp::CloneRequest, mp::CloneReply>));
+    EXPECT_CALL(daemon, resize(_, _, _))
+        .WillOnce(Invoke(&daemon, &mpt::MockDaemon::set_promise_value<mp::ResizeRequest, mp::ResizeReply>));
 
     send_commands({{"test_create", "foo"},
                    {"launch", "foo"},
@@ -175,7 +206,13 @@ TEST_F(Daemon, receives_commands)
                    {"version"},
                    {"find", "something"},
                    {"mount", ".", "target"},
-                   {"umount", "instance"}});
+                   {"umount", "instance"},
+                   {"bake", "foo"},
+                   {"stats"},
+                   {"bench-mount", "foo:bar"},
+                   {"throttle", "foo"},
+                   {"clone", "foo", "bar"},
+                   {"resize", "foo", "--cpus", "4"}});
 }
 
 TEST_F(Daemon, provides_version)
@@ -188,6 +225,48 @@ TEST_F(Daemon, provides_version)
     EXPECT_THAT(stream.str(), HasSubstr(mp::version_string));
 }
 
+TEST_F(Daemon, provides_rpc_timings)
+{
+    mp::Daemon daemon{config_builder.build()};
+    send_command({"version"});
+
+    std::stringstream stream;
+    send_command({"stats"}, stream);
+
+    EXPECT_THAT(stream.str(), HasSubstr("multipass_rpc_duration_seconds_count{rpc=\"version\"}"));
+    EXPECT_THAT(stream.str(), HasSubstr("# EOF"));
+}
+
+TEST_F(Daemon, bench_mount_fails_for_unknown_instances)
+{
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream cerr_stream;
+    send_command({"bench-mount", "foo:/nowhere"}, trash_stream, cerr_stream);
+
+    EXPECT_THAT(cerr_stream.str(), HasSubstr("instance \"foo\" does not exist"));
+}
+
+TEST_F(Daemon, throttle_fails_for_unknown_instances)
+{
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream cerr_stream;
+    send_command({"throttle", "foo", "--disk-iops", "100"}, trash_stream, cerr_stream);
+
+    EXPECT_THAT(cerr_stream.str(), HasSubstr("instance \"foo\" does not exist"));
+}
+
+TEST_F(Daemon, resize_fails_for_unknown_instances)
+{
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream cerr_stream;
+    send_command({"resize", "foo", "--cpus", "4"}, trash_stream, cerr_stream);
+
+    EXPECT_THAT(cerr_stream.str(), HasSubstr("instance \"foo\" does not exist"));
+}
+
 TEST_F(Daemon, failed_restart_command_returns_fulfilled_promise)
 {
     mp::Daemon daemon{config_builder.build()};
@@ -202,6 +281,278 @@ TEST_F(Daemon, failed_restart_command_returns_fulfilled_promise)
     EXPECT_TRUE(is_ready(status_promise.get_future()));
 }
 
+TEST_F(Daemon, list_rejects_unknown_fields)
+{
+    mp::Daemon daemon{config_builder.build()};
+
+    mp::ListRequest request;
+    request.add_fields("name");
+    request.add_fields("colour");
+    std::promise<grpc::Status> status_promise;
+
+    daemon.list(&request, nullptr, &status_promise);
+
+    auto status = status_promise.get_future().get();
+    EXPECT_EQ(status.error_code(), grpc::StatusCode::INVALID_ARGUMENT);
+    EXPECT_THAT(status.error_message(), HasSubstr("colour"));
+}
+
+TEST_F(Daemon, info_rejects_unknown_fields)
+{
+    mp::Daemon daemon{config_builder.build()};
+
+    mp::InfoRequest request;
+    request.add_fields("memory_usage");
+    request.add_fields("flavour");
+    std::promise<grpc::Status> status_promise;
+
+    daemon.info(&request, nullptr, &status_promise);
+
+    auto status = status_promise.get_future().get();
+    EXPECT_EQ(status.error_code(), grpc::StatusCode::INVALID_ARGUMENT);
+    EXPECT_THAT(status.error_message(), HasSubstr("flavour"));
+}
+
+TEST_F(Daemon, list_does_only_the_work_behind_the_requested_fields)
+{
+    auto mock_image_vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    // Only to recreate the instance, its release not being asked for
+    EXPECT_CALL(*mock_image_vault, fetch_image(_, Field(&mp::Query::name, "real-zebraphant"), _, _))
+        .WillOnce(DoDefault());
+    config_builder.vault = std::move(mock_image_vault);
+
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        ON_CALL(*vm, current_state()).WillByDefault(Return(mp::VirtualMachine::State::running));
+        EXPECT_CALL(*vm, management_ipv4()).Times(0);
+        EXPECT_CALL(*vm, get_all_ipv4(_)).Times(0);
+        return vm;
+    });
+
+    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    config_builder.data_directory = temp_dir->path();
+    mp::Daemon daemon{config_builder.build()};
+
+    mp::ListRequest request;
+    request.set_request_ipv4(true);
+    request.add_fields("name");
+    request.add_fields("instance_status");
+
+    mp::ListReply reply;
+    grpc::Status status;
+    mp::AutoJoinThread t([this, &request, &reply, &status] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        grpc::ClientContext context;
+        auto reader = stub->list(&context, request);
+
+        while (reader->Read(&reply) && reply.instances_size() == 0)
+            ;
+        status = reader->Finish();
+        loop.quit();
+    });
+    loop.exec();
+
+    EXPECT_TRUE(status.ok());
+    ASSERT_EQ(reply.instances_size(), 1);
+    EXPECT_EQ(reply.instances(0).name(), "real-zebraphant");
+    EXPECT_EQ(reply.instances(0).instance_status().status(), mp::InstanceStatus::RUNNING);
+    EXPECT_EQ(reply.instances(0).ipv4_size(), 0);
+    EXPECT_TRUE(reply.instances(0).current_release().empty());
+}
+
+TEST_F(Daemon, info_does_only_the_work_behind_the_requested_fields)
+{
+    auto mock_image_vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    // Only to recreate the instance, its image not being asked for
+    EXPECT_CALL(*mock_image_vault, fetch_image(_, Field(&mp::Query::name, "real-zebraphant"), _, _))
+        .WillOnce(DoDefault());
+    config_builder.vault = std::move(mock_image_vault);
+
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        ON_CALL(*vm, current_state()).WillByDefault(Return(mp::VirtualMachine::State::running));
+        EXPECT_CALL(*vm, ssh_hostname(_)).Times(0); // no probe
+        return vm;
+    });
+
+    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    config_builder.data_directory = temp_dir->path();
+    mp::Daemon daemon{config_builder.build()};
+
+    mp::InfoRequest request;
+    request.mutable_instance_names()->add_instance_name("real-zebraphant");
+    request.add_fields("instance_status");
+
+    mp::InfoReply reply;
+    grpc::Status status;
+    mp::AutoJoinThread t([this, &request, &reply, &status] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        grpc::ClientContext context;
+        auto reader = stub->info(&context, request);
+
+        while (reader->Read(&reply) && reply.info_size() == 0)
+            ;
+        status = reader->Finish();
+        loop.quit();
+    });
+    loop.exec();
+
+    EXPECT_TRUE(status.ok());
+    ASSERT_EQ(reply.info_size(), 1);
+    const auto& info = reply.info(0);
+    EXPECT_EQ(info.name(), "real-zebraphant");
+    EXPECT_EQ(info.instance_status().status(), mp::InstanceStatus::RUNNING);
+    EXPECT_TRUE(info.id().empty());
+    EXPECT_FALSE(info.has_mount_info());
+    EXPECT_TRUE(info.load().empty());
+}
+
+TEST_F(Daemon, writes_every_client_log_line_before_the_status)
+{
+    mpt::MockDaemon daemon{config_builder.build()};
+    mpl::MultiplexingLogger mpx{std::make_unique<mpt::StubLogger>()};
+    constexpr auto num_lines = 200;
+    constexpr auto num_replies = 10;
+
+    EXPECT_CALL(daemon, version(_, _, _))
+        .WillOnce([&mpx](auto, grpc::ServerWriter<mp::VersionReply>* server,
+                         std::promise<grpc::Status>* status_promise) {
+            mpl::ClientLogger<mp::VersionReply> logger{mpl::Level::info, mpx, server, num_lines};
+
+            // Lines come from elsewhere while the request writes replies of its own
+            std::thread other_thread{[&mpx] {
+                for (auto i = 0; i < num_lines; ++i)
+                    mpx.log(mpl::Level::info, "test", "line");
+            }};
+
+            mp::VersionReply reply;
+            reply.set_version("version");
+            for (auto i = 0; i < num_replies; ++i)
+                mpl::write_to_client(server, reply);
+
+            other_thread.join();
+            status_promise->set_value(grpc::Status::OK); // while the logger may still be writing
+        });
+
+    auto log_lines = 0, replies = 0;
+    grpc::Status status;
+    mp::AutoJoinThread t([this, &log_lines, &replies, &status] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        grpc::ClientContext context;
+        auto reader = stub->version(&context, mp::VersionRequest{});
+
+        mp::VersionReply reply;
+        while (reader->Read(&reply))
+            ++(reply.log_line().empty() ? replies : log_lines);
+
+        status = reader->Finish();
+        loop.quit();
+    });
+    loop.exec();
+
+    EXPECT_TRUE(status.ok());
+    EXPECT_EQ(replies, num_replies);
+    EXPECT_EQ(log_lines, num_lines);
+}
+
+TEST_F(Daemon, writes_from_threads_sharing_a_client_stream_go_one_at_a_time)
+{
+    mpt::MockDaemon daemon{config_builder.build()};
+    constexpr auto num_threads = 8;
+    constexpr auto num_replies = 100;
+
+    EXPECT_CALL(daemon, version(_, _, _))
+        .WillOnce([](auto, grpc::ServerWriter<mp::VersionReply>* server, std::promise<grpc::Status>* status_promise) {
+            mpl::SharedClientStream shared_stream{server};
+
+            std::vector<std::thread> threads;
+            for (auto i = 0; i < num_threads; ++i)
+                threads.emplace_back([server] {
+                    mp::VersionReply reply;
+                    reply.set_version("version");
+                    for (auto j = 0; j < num_replies; ++j)
+                        mpl::write_to_client(server, reply);
+                });
+
+            for (auto& thread : threads)
+                thread.join();
+
+            status_promise->set_value(grpc::Status::OK);
+        });
+
+    auto replies = 0;
+    grpc::Status status;
+    mp::AutoJoinThread t([this, &replies, &status] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        grpc::ClientContext context;
+        auto reader = stub->version(&context, mp::VersionRequest{});
+
+        mp::VersionReply reply;
+        while (reader->Read(&reply))
+            replies += reply.version() == "version";
+
+        status = reader->Finish();
+        loop.quit();
+    });
+    loop.exec();
+
+    EXPECT_TRUE(status.ok());
+    EXPECT_EQ(replies, num_threads * num_replies);
+}
+
+TEST_F(Daemon, serves_more_start_calls_at_once_than_the_server_has_threads)
+{
+    mpt::MockDaemon daemon{config_builder.build()};
+    constexpr std::size_t num_calls = 200; // past the synchronous server's thread quota
+
+    std::vector<std::pair<grpc::ServerWriterInterface<mp::StartReply>*, std::promise<grpc::Status>*>> held_calls;
+    EXPECT_CALL(daemon, start(_, _, _))
+        .Times(num_calls)
+        .WillRepeatedly([&held_calls](auto, grpc::ServerWriterInterface<mp::StartReply>* server,
+                                      std::promise<grpc::Status>* status_promise) {
+            // Every call is held until the last one comes in, as long as instances might take to come up
+            held_calls.emplace_back(server, status_promise);
+            if (held_calls.size() < num_calls)
+                return;
+
+            mp::StartReply reply;
+            reply.set_reply_message("started");
+            for (const auto& [held_server, held_promise] : held_calls)
+            {
+                mpl::write_to_client(held_server, reply);
+                held_promise->set_value(grpc::Status::OK);
+            }
+        });
+
+    std::size_t replies = 0, oks = 0;
+    mp::AutoJoinThread t([this, &replies, &oks] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        std::vector<std::unique_ptr<grpc::ClientContext>> contexts;
+        std::vector<std::unique_ptr<grpc::ClientReader<mp::StartReply>>> readers;
+        for (std::size_t i = 0; i < num_calls; ++i)
+        {
+            contexts.push_back(std::make_unique<grpc::ClientContext>());
+            readers.push_back(stub->start(contexts.back().get(), mp::StartRequest{}));
+        }
+
+        for (auto& reader : readers)
+        {
+            mp::StartReply reply;
+            while (reader->Read(&reply))
+                replies += reply.reply_message() == "started";
+
+            oks += reader->Finish().ok();
+        }
+        loop.quit();
+    });
+    loop.exec();
+
+    EXPECT_EQ(replies, num_calls);
+    EXPECT_EQ(oks, num_calls);
+}
+
 TEST_F(Daemon, proxy_contains_valid_info)
 {
     auto guard = sg::make_scope_guard([]() noexcept {          // std::terminate ok if this throws
@@ -358,7 +709,7 @@ TEST_P(DaemonCreateLaunchTestSuite, on_creation_hooks_up_platform_prepare_source
     auto mock_factory = use_a_mock_vm_factory();
     mp::Daemon daemon{config_builder.build()};
 
-    EXPECT_CALL(*mock_factory, prepare_source_image(_));
+    EXPECT_CALL(*mock_factory, prepare_source_image(_, _));
     send_command({GetParam()});
 }
 
@@ -585,6 +936,54 @@ TEST_P(DaemonCreateLaunchTestSuite, adds_pollinate_user_agent_to_cloud_init_conf
     send_command({GetParam()});
 }
 
+TEST_P(DaemonCreateLaunchTestSuite, points_apt_at_the_package_cache)
+{
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(mock_settings, get(Eq(mp::package_cache_key))).WillRepeatedly(Return("true"));
+    ON_CALL(*mock_factory, host_address()).WillByDefault(Return("127.0.0.42"));
+    mp::Daemon daemon{config_builder.build()};
+
+    const std::vector<std::pair<std::string, std::string>> apt_conf{
+        {"path", "/etc/apt/apt.conf.d/90multipass-package-cache"},
+        {"content", "// written by Multipass\n"
+                    "Acquire::http::Proxy-Auto-Detect \"/usr/local/lib/multipass/package-proxy\";\n"}};
+    EXPECT_CALL(*mock_factory, prepare_instance_image(_, _))
+        .WillOnce([&apt_conf](const multipass::VMImage&, const mp::VirtualMachineDescription& desc) {
+            ASSERT_THAT(desc.vendor_data_config, YAMLNodeContainsSequence("write_files"));
+            const auto& write_stanza = desc.vendor_data_config["write_files"];
+            EXPECT_THAT(write_stanza, YAMLSequenceContainsStringMap(apt_conf));
+
+            auto script_found = false;
+            for (const auto& node : write_stanza)
+                if (node["path"].as<std::string>() == "/usr/local/lib/multipass/package-proxy")
+                {
+                    script_found = true;
+                    EXPECT_EQ(node["permissions"].as<std::string>(), "0755");
+                    EXPECT_THAT(node["content"].as<std::string>(), HasSubstr("echo http://127.0.0.42:3142\n"));
+                    EXPECT_THAT(node["content"].as<std::string>(), HasSubstr("echo DIRECT\n"));
+                }
+            EXPECT_TRUE(script_found);
+        });
+
+    send_command({GetParam()});
+}
+
+TEST_P(DaemonCreateLaunchTestSuite, leaves_apt_alone_without_the_package_cache)
+{
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(mock_settings, get(Eq(mp::package_cache_key))).WillRepeatedly(Return("false"));
+    ON_CALL(*mock_factory, host_address()).WillByDefault(Return("127.0.0.42"));
+    mp::Daemon daemon{config_builder.build()};
+
+    EXPECT_CALL(*mock_factory, prepare_instance_image(_, _))
+        .WillOnce([](const multipass::VMImage&, const mp::VirtualMachineDescription& desc) {
+            for (const auto& node : desc.vendor_data_config["write_files"])
+                EXPECT_THAT(node["path"].as<std::string>(), Not(HasSubstr("package")));
+        });
+
+    send_command({GetParam()});
+}
+
 TEST_P(DaemonCreateLaunchTestSuite, workflow_found_passes_expected_data)
 {
     auto mock_factory = use_a_mock_vm_factory();
@@ -955,6 +1354,13 @@ plant_instance_json(const std::string& contents)
     return {std::move(temp_dir), filename};
 }
 
+// Loaded instances are only brought up once the event loop gets to them
+void process_events_until(const std::function<bool()>& done)
+{
+    for (auto i = 0; i < 500 && !done(); ++i)
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+}
+
 void check_interfaces_in_json(const QString& file, const std::string& mac,
                               const std::vector<mp::NetworkInterface>& extra_interfaces)
 {
@@ -997,20 +1403,22 @@ TEST_F(Daemon, reads_mac_addresses_from_json)
 
     // Make the daemon look for the JSON on our temporary directory. It will read the contents of the file.
     config_builder.data_directory = temp_dir->path();
-    mp::Daemon daemon{config_builder.build()};
+    {
+        mp::Daemon daemon{config_builder.build()};
 
-    // By issuing the `list` command, we check at least that the instance was indeed read and there were no errors.
-    std::stringstream stream;
-    send_command({"list"}, stream);
-    EXPECT_THAT(stream.str(), HasSubstr("real-zebraphant"));
+        // By issuing the `list` command, we check at least that the instance was indeed read and there were no errors.
+        std::stringstream stream;
+        send_command({"list"}, stream);
+        EXPECT_THAT(stream.str(), HasSubstr("real-zebraphant"));
 
-    // Removing the JSON is possible now because data was already read. This step is not necessary, but doing it we
-    // make sure that the file was indeed rewritten after the next step.
-    QFile::remove(filename);
+        // Removing the JSON is possible now because data was already read. This step is not necessary, but doing it
+        // we make sure that the file was indeed rewritten after the next step.
+        QFile::remove(filename);
 
-    // The purge command will be apparently no-op, because there are no deleted instances. However, it will trigger
-    // a rewriting of the JSON, which will be useful for us to check if the data was correctly read.
-    send_command({"purge"});
+        // The purge command will be apparently no-op, because there are no deleted instances. However, it will
+        // trigger a rewriting of the JSON, which will be useful for us to check if the data was correctly read.
+        send_command({"purge"});
+    } // the daemon finishes any pending write before it goes
 
     // Finally, check the contents of the file. If they match with what we read, we are done.
     check_interfaces_in_json(filename, mac_addr, extra_interfaces);
@@ -1040,111 +1448,1876 @@ TEST_F(Daemon, refuses_launch_with_invalid_network_interface)
     EXPECT_THAT(err_stream.str(), HasSubstr("Invalid network options supplied"));
 }
 
-TEST_F(Daemon, refuses_launch_because_bridging_is_not_implemented)
+TEST_F(Daemon, launches_with_the_requested_storage_profile)
 {
-    // Use the stub factory, which throws when networks() is called.
+    auto mock_factory = use_a_mock_vm_factory();
     mp::Daemon daemon{config_builder.build()};
 
-    std::stringstream err_stream;
-    send_command({"launch", "--network", "eth0"}, std::cout, err_stream);
-    EXPECT_THAT(err_stream.str(), HasSubstr("The bridging feature is not implemented on this backend"));
+    EXPECT_CALL(*mock_factory, create_virtual_machine(_, _))
+        .WillOnce([](const mp::VirtualMachineDescription& vm_desc, auto&) {
+            EXPECT_EQ(vm_desc.storage_profile, mp::performance_storage_profile);
+            return std::make_unique<mpt::StubVirtualMachine>();
+        });
+
+    send_command({"launch", "--storage-profile", "performance"});
 }
 
-TEST_P(RefuseBridging, old_image)
+TEST_F(Daemon, launches_a_count_of_instances_after_the_requested_name)
 {
-    const auto [remote, image] = GetParam();
-    std::string full_image_name = remote.empty() ? image : remote + ":" + image;
-
     auto mock_factory = use_a_mock_vm_factory();
+    mp::Daemon daemon{config_builder.build()};
+
+    std::vector<std::string> names, macs;
+    EXPECT_CALL(*mock_factory, create_virtual_machine(_, _))
+        .Times(3)
+        .WillRepeatedly([&names, &macs](const mp::VirtualMachineDescription& vm_desc, auto&) {
+            names.push_back(vm_desc.vm_name);
+            macs.push_back(vm_desc.default_mac_address);
+            return std::make_unique<mpt::StubVirtualMachine>();
+        });
+
+    send_command({"launch", "--name", "ci", "--count", "3"});
 
+    EXPECT_THAT(names, UnorderedElementsAre("ci-1", "ci-2", "ci-3"));
+    ASSERT_THAT(macs.size(), Eq(3u));
+    EXPECT_THAT(std::unordered_set<std::string>(macs.cbegin(), macs.cend()).size(), Eq(3u));
+}
+
+TEST_F(Daemon, leaves_ephemeral_instances_out_of_the_instances_database)
+{
+    use_a_mock_vm_factory();
     mp::Daemon daemon{config_builder.build()};
 
-    EXPECT_CALL(*mock_factory, networks());
+    send_commands({{"launch", "--name", "passing", "--ephemeral"}, {"launch", "--name", "lasting"}});
 
-    std::stringstream err_stream;
-    send_command({"launch", full_image_name, "--network", "eth0"}, std::cout, err_stream);
-    EXPECT_THAT(err_stream.str(), HasSubstr("Automatic network configuration not available for"));
+    const auto json = mpt::load(QDir{data_dir.path()}.filePath("multipassd-vm-instances.json"));
+    const auto instances = QJsonDocument::fromJson(json).object();
+    EXPECT_TRUE(instances.contains("lasting"));
+    EXPECT_FALSE(instances.contains("passing"));
 }
 
-std::vector<std::string> old_releases{"10.04",   "lucid",  "11.10",   "oneiric", "12.04", "precise", "12.10",
-                                      "quantal", "13.04",  "raring",  "13.10",   "saucy", "14.04",   "trusty",
-                                      "14.10",   "utopic", "15.04",   "vivid",   "15.10", "wily",    "16.04",
-                                      "xenial",  "16.10",  "yakkety", "17.04",   "zesty"};
+TEST_F(Daemon, purges_ephemeral_instances_once_they_stop)
+{
+    auto mock_factory = use_a_mock_vm_factory();
+    mp::VMStatusMonitor* monitor{nullptr};
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([&monitor](const auto&, auto& the_monitor) {
+        monitor = &the_monitor;
+        return std::make_unique<mpt::StubVirtualMachine>();
+    });
 
-INSTANTIATE_TEST_SUITE_P(DaemonRefuseRelease, RefuseBridging, Combine(Values("release", ""), ValuesIn(old_releases)));
-INSTANTIATE_TEST_SUITE_P(DaemonRefuseSnapcraft, RefuseBridging, Values(std::make_tuple("snapcraft", "core")));
+    mp::Daemon daemon{config_builder.build()};
+    send_command({"launch", "--name", "passing", "--ephemeral"});
+    ASSERT_NE(monitor, nullptr);
 
-constexpr auto ghost_template = R"(
-"{}": {{
-    "deleted": false,
-    "disk_space": "0",
-    "mac_addr": "",
-    "mem_size": "0",
-    "metadata": {{}},
-    "mounts": [],
-    "num_cores": 0,
-    "ssh_username": "",
-    "state": 0
-}})";
-constexpr auto valid_template = R"(
-"{}": {{
-    "deleted": false,
-    "disk_space": "3232323232",
-    "mac_addr": "ab:cd:ef:12:34:{}",
-    "mem_size": "2323232323",
-    "metadata": {{}},
-    "mounts": [],
-    "num_cores": 4,
-    "ssh_username": "ubuntu",
-    "state": 1
-}})";
+    monitor->persist_state_for("passing", mp::VirtualMachine::State::stopped);
 
-TEST_F(Daemon, skips_over_instance_ghosts_in_db) // which will have been sometimes writen for purged instances
+    std::stringstream stream;
+    send_command({"list"}, stream);
+    EXPECT_THAT(stream.str(), Not(HasSubstr("passing")));
+}
+
+TEST_F(Daemon, keeps_ephemeral_instances_restarted_before_their_purge)
 {
-    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    auto mock_factory = use_a_mock_vm_factory();
+    mp::VMStatusMonitor* monitor{nullptr};
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([&monitor](const auto& desc, auto& the_monitor) {
+        monitor = &the_monitor;
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        ON_CALL(*vm, current_state()).WillByDefault(Return(mp::VirtualMachine::State::running));
+        return vm;
+    });
 
-    const auto id1 = "valid1";
-    const auto id2 = "valid2";
-    auto ghost1 = fmt::format(ghost_template, "ghost1");
-    auto ghost2 = fmt::format(ghost_template, "ghost2");
-    auto valid1 = fmt::format(valid_template, id1, "56");
-    auto valid2 = fmt::format(valid_template, id2, "78");
-    const auto [temp_dir, filename] = plant_instance_json(fmt::format(
-        "{{\n{},\n{},\n{},\n{}\n}}", std::move(ghost1), std::move(ghost2), std::move(valid1), std::move(valid2)));
+    mp::Daemon daemon{config_builder.build()};
+    send_command({"launch", "--name", "passing", "--ephemeral"});
+    ASSERT_NE(monitor, nullptr);
 
-    config_builder.data_directory = temp_dir->path();
+    monitor->persist_state_for("passing", mp::VirtualMachine::State::stopped);
+
+    std::stringstream stream;
+    send_command({"list"}, stream);
+    EXPECT_THAT(stream.str(), HasSubstr("passing"));
+}
+
+TEST_F(Daemon, refuses_to_launch_more_instances_at_once_than_allowed)
+{
     auto mock_factory = use_a_mock_vm_factory();
+    mp::Daemon daemon{config_builder.build()};
 
     EXPECT_CALL(*mock_factory, create_virtual_machine).Times(0);
-    EXPECT_CALL(*mock_factory, create_virtual_machine(Field(&mp::VirtualMachineDescription::vm_name, id1), _)).Times(1);
-    EXPECT_CALL(*mock_factory, create_virtual_machine(Field(&mp::VirtualMachineDescription::vm_name, id2), _)).Times(1);
 
-    mp::Daemon daemon{config_builder.build()};
+    grpc::Status status;
+    mp::AutoJoinThread t([this, &status] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        grpc::ClientContext context;
+        mp::LaunchRequest request;
+        request.set_count(mp::max_launch_count + 1);
+        auto reader = stub->launch(&context, request);
+
+        mp::LaunchReply reply;
+        while (reader->Read(&reply))
+            ;
+
+        status = reader->Finish();
+        loop.quit();
+    });
+    loop.exec();
+
+    EXPECT_EQ(status.error_code(), grpc::StatusCode::INVALID_ARGUMENT);
+    EXPECT_THAT(status.error_message(), HasSubstr(std::to_string(mp::max_launch_count)));
 }
 
-TEST_F(Daemon, ctor_lets_exceptions_arising_from_vm_creation_through)
+TEST_F(Daemon, launch_reports_its_phases)
 {
-    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
-    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
-    config_builder.data_directory = temp_dir->path();
-
-    const std::string msg = "asdf";
     auto mock_factory = use_a_mock_vm_factory();
-    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce(Throw(std::runtime_error{msg}));
+    mp::Daemon daemon{config_builder.build()};
 
-    MP_EXPECT_THROW_THAT(mp::Daemon{config_builder.build()}, std::runtime_error, mpt::match_what(msg));
+    std::stringstream stream;
+    send_command({"launch", "--timings"}, stream);
+
+    EXPECT_THAT(stream.str(), HasSubstr("Timings for "));
+    for (const auto& phase : {"lookup", "cloud_init_iso", "instance_image", "create_instance", "spawn", "ssh_up",
+                              "cloud_init", "mounts", "total"})
+        EXPECT_THAT(stream.str(), HasSubstr(fmt::format("  {} ", phase)));
 }
 
-TEST_F(Daemon, ctor_drops_removed_instances)
+TEST_F(Daemon, starts_no_more_instances_at_once_than_configured)
 {
-    const std::string stayed{"foo"}, gone{"fighters"};
-    auto stayed_json = fmt::format(valid_template, stayed, "12");
-    auto gone_json = fmt::format(valid_template, gone, "34");
-    const auto [temp_dir, filename] =
-        plant_instance_json(fmt::format("{{\n{},\n{}\n}}", std::move(stayed_json), std::move(gone_json)));
-    config_builder.data_directory = temp_dir->path();
+    auto mock_factory = use_a_mock_vm_factory();
+    mp::Daemon daemon{config_builder.build()};
 
-    auto mock_image_vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    std::mutex events_mutex;
+    std::vector<std::string> events;
+    auto record = [&events_mutex, &events](const std::string& event) {
+        std::lock_guard<decltype(events_mutex)> lock{events_mutex};
+        events.push_back(event);
+    };
+
+    EXPECT_CALL(*mock_factory, create_virtual_machine).Times(2).WillRepeatedly([&record](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        EXPECT_CALL(*vm, start()).WillOnce([&record] { record("start"); });
+        EXPECT_CALL(*vm, wait_until_ssh_up(_)).WillOnce([&record](auto) { record("ready"); });
+        return vm;
+    });
+    EXPECT_CALL(mock_settings, get(Eq(mp::start_concurrency_key))).WillRepeatedly(Return("1"));
+
+    send_commands({{"test_create"}, {"test_create"}, {"start", "--all"}});
+
+    EXPECT_THAT(events, ElementsAre("start", "ready", "start", "ready"));
+}
+
+// "busy" is up and takes the single core instances may have, so starting "idle" has to wait for room
+struct DaemonAdmission : public Daemon
+{
+    DaemonAdmission()
+    {
+        EXPECT_CALL(mock_settings, get(Eq(mp::admission_cpus_key))).WillRepeatedly(Return("1"));
+        EXPECT_CALL(mock_settings, get(Eq(mp::admission_memory_key))).WillRepeatedly(Return("100G"));
+    }
+
+    void create_instances(bool idle_starts)
+    {
+        auto make_vm = [idle_starts](const auto& desc, auto&) {
+            auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+            const auto busy = desc.vm_name == "busy";
+            ON_CALL(*vm, current_state())
+                .WillByDefault(Return(busy ? mp::VirtualMachine::State::running : mp::VirtualMachine::State::stopped));
+            EXPECT_CALL(*vm, start()).Times(!busy && idle_starts ? 1 : 0);
+            return vm;
+        };
+        EXPECT_CALL(*mock_factory, create_virtual_machine).Times(2).WillRepeatedly(make_vm);
+
+        send_commands({{"test_create", "busy"}, {"test_create", "idle"}});
+    }
+
+    mpt::MockVirtualMachineFactory* mock_factory{use_a_mock_vm_factory()};
+};
+
+TEST_F(DaemonAdmission, rejects_starts_past_the_limits)
+{
+    EXPECT_CALL(mock_settings, get(Eq(mp::admission_mode_key))).WillRepeatedly(Return("reject"));
+    mp::Daemon daemon{config_builder.build()};
+    create_instances(/*idle_starts=*/false);
+
+    std::stringstream err_stream;
+    send_command({"start", "idle"}, trash_stream, err_stream);
+    EXPECT_THAT(err_stream.str(), HasSubstr("The host is too busy"));
+}
+
+TEST_F(DaemonAdmission, rejects_what_could_never_fit)
+{
+    EXPECT_CALL(mock_settings, get(Eq(mp::admission_mode_key))).WillRepeatedly(Return("queue"));
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream err_stream;
+    send_command({"launch", "--cpus", "2"}, trash_stream, err_stream);
+    EXPECT_THAT(err_stream.str(), HasSubstr("Not enough room on the host"));
+}
+
+TEST_F(DaemonAdmission, queues_starts_until_there_is_room)
+{
+    // Queuing is turned off while the start waits, which lets it through on the next retry
+    std::atomic_int queue_reads{0};
+    EXPECT_CALL(mock_settings, get(Eq(mp::admission_mode_key))).WillRepeatedly([&queue_reads] {
+        return QString{queue_reads-- > 0 ? "queue" : "off"};
+    });
+    mp::Daemon daemon{config_builder.build()};
+    create_instances(/*idle_starts=*/true);
+
+    queue_reads = 1;
+    std::stringstream out_stream;
+    send_command({"start", "idle"}, out_stream);
+    EXPECT_THAT(out_stream.str(), HasSubstr("Waiting for room on the host, number 1 in the queue"));
+}
+
+TEST_F(Daemon, restart_reports_every_instance_it_cannot_reboot)
+{
+    auto mock_factory = use_a_mock_vm_factory();
+    mp::Daemon daemon{config_builder.build()};
+
+    // Backends update their state from the main thread, so it is only read there, even for work done on a pool
+    const auto main_thread = std::this_thread::get_id();
+    std::atomic_int reads_off_main_thread{0};
+    EXPECT_CALL(*mock_factory, create_virtual_machine).Times(2).WillRepeatedly([&](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        ON_CALL(*vm, current_state()).WillByDefault([&] {
+            if (std::this_thread::get_id() != main_thread)
+                ++reads_off_main_thread;
+            return mp::VirtualMachine::State::stopped;
+        });
+        return vm;
+    });
+
+    send_commands({{"test_create"}, {"test_create"}});
+
+    std::stringstream err_stream;
+    send_command({"restart", "--all"}, trash_stream, err_stream);
+
+    const auto errors = err_stream.str();
+    EXPECT_THAT(errors, HasSubstr("The following errors occurred"));
+    EXPECT_NE(errors.find("is not running"), errors.rfind("is not running"));
+    EXPECT_EQ(reads_off_main_thread, 0);
+}
+
+TEST_F(Daemon, stop_reads_instance_states_on_the_main_thread)
+{
+    auto mock_factory = use_a_mock_vm_factory();
+    mp::Daemon daemon{config_builder.build()};
+
+    const auto main_thread = std::this_thread::get_id();
+    std::atomic_int reads_off_main_thread{0};
+    EXPECT_CALL(*mock_factory, create_virtual_machine).Times(2).WillRepeatedly([&](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        ON_CALL(*vm, current_state()).WillByDefault([&] {
+            if (std::this_thread::get_id() != main_thread)
+                ++reads_off_main_thread;
+            return mp::VirtualMachine::State::stopped;
+        });
+        EXPECT_CALL(*vm, shutdown()).Times(0); // already stopped
+        return vm;
+    });
+
+    send_commands({{"test_create"}, {"test_create"}, {"stop", "--all"}});
+
+    EXPECT_EQ(reads_off_main_thread, 0);
+}
+
+TEST_F(Daemon, capacity_counts_the_cores_of_running_instances_from_the_main_thread)
+{
+    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    config_builder.data_directory = temp_dir->path();
+
+    const auto main_thread = std::this_thread::get_id();
+    std::atomic_int reads_off_main_thread{0};
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([&](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        ON_CALL(*vm, current_state()).WillByDefault([&] {
+            if (std::this_thread::get_id() != main_thread)
+                ++reads_off_main_thread;
+            return mp::VirtualMachine::State::running;
+        });
+        return vm;
+    });
+
+    mp::Daemon daemon{config_builder.build()};
+
+    mp::CapacityReply reply;
+    grpc::Status status;
+    mp::AutoJoinThread t([this, &reply, &status] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        grpc::ClientContext context;
+        auto reader = stub->capacity(&context, mp::CapacityRequest{});
+
+        reader->Read(&reply);
+        status = reader->Finish();
+        loop.quit();
+    });
+    loop.exec();
+
+    EXPECT_TRUE(status.ok());
+    EXPECT_GT(reply.cores(), 0);
+    EXPECT_EQ(reply.committed_cores(), 1);
+    EXPECT_EQ(reads_off_main_thread, 0);
+}
+
+TEST_F(Daemon, copy_files_checks_the_instances_on_the_main_thread)
+{
+    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    config_builder.data_directory = temp_dir->path();
+
+    const auto main_thread = std::this_thread::get_id();
+    std::atomic_int reads_off_main_thread{0};
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([&](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        ON_CALL(*vm, current_state()).WillByDefault([&] {
+            if (std::this_thread::get_id() != main_thread)
+                ++reads_off_main_thread;
+            return mp::VirtualMachine::State::stopped;
+        });
+        return vm;
+    });
+
+    mp::Daemon daemon{config_builder.build()};
+
+    grpc::Status stopped_status, missing_status;
+    mp::AutoJoinThread t([this, &stopped_status, &missing_status] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        auto copy = [&stub](const std::string& destination) {
+            mp::CopyFilesRequest request;
+            request.set_source_instance("real-zebraphant");
+            request.set_destination_instance(destination);
+            request.add_source_paths("foo");
+            request.set_destination_path("bar");
+
+            grpc::ClientContext context;
+            mp::CopyFilesReply reply;
+            auto reader = stub->copy_files(&context, request);
+            while (reader->Read(&reply))
+                ;
+            return reader->Finish();
+        };
+
+        stopped_status = copy("real-zebraphant");
+        missing_status = copy("ghost");
+        loop.quit();
+    });
+    loop.exec();
+
+    EXPECT_EQ(stopped_status.error_code(), grpc::StatusCode::ABORTED);
+    EXPECT_THAT(stopped_status.error_message(), HasSubstr("is not running"));
+    EXPECT_EQ(missing_status.error_code(), grpc::StatusCode::INVALID_ARGUMENT);
+    EXPECT_THAT(missing_status.error_message(), HasSubstr("\"ghost\" does not exist"));
+    EXPECT_EQ(reads_off_main_thread, 0);
+}
+
+TEST_F(Daemon, compacts_the_disks_of_stopped_instances_reading_their_state_on_the_main_thread)
+{
+    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    config_builder.data_directory = temp_dir->path();
+    config_builder.disk_maintenance_timer = std::chrono::milliseconds{10};
+
+    const auto main_thread = std::this_thread::get_id();
+    std::atomic_int reads_off_main_thread{0};
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([&](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        ON_CALL(*vm, current_state()).WillByDefault([&] {
+            if (std::this_thread::get_id() != main_thread)
+                ++reads_off_main_thread;
+            return mp::VirtualMachine::State::stopped;
+        });
+        EXPECT_CALL(*vm, compact_disk).WillOnce([this] {
+            QMetaObject::invokeMethod(&loop, &QEventLoop::quit, Qt::QueuedConnection);
+            return 0;
+        });
+        return vm;
+    });
+
+    mp::Daemon daemon{config_builder.build()};
+    QTimer::singleShot(std::chrono::seconds{10}, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    EXPECT_EQ(reads_off_main_thread, 0);
+}
+
+TEST_F(Daemon, refuses_to_start_an_instance_while_its_disk_is_compacted)
+{
+    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    config_builder.data_directory = temp_dir->path();
+    config_builder.disk_maintenance_timer = std::chrono::milliseconds{10};
+
+    std::promise<void> compacting, compacted;
+    auto compaction_started = compacting.get_future();
+    auto compaction_released = compacted.get_future().share();
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([&](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        ON_CALL(*vm, current_state()).WillByDefault(Return(mp::VirtualMachine::State::stopped));
+        EXPECT_CALL(*vm, start).Times(0);
+        EXPECT_CALL(*vm, compact_disk)
+            .WillOnce([&compacting, compaction_released] {
+                compacting.set_value();
+                compaction_released.wait();
+                return 0;
+            })
+            .WillRepeatedly(Return(0));
+        return vm;
+    });
+
+    mp::Daemon daemon{config_builder.build()};
+
+    grpc::Status status;
+    mp::AutoJoinThread t([this, &status, &compaction_started, &compacted] {
+        compaction_started.wait();
+
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        grpc::ClientContext context;
+        mp::StartRequest request;
+        request.mutable_instance_names()->add_instance_name("real-zebraphant");
+        auto reader = stub->start(&context, request);
+
+        mp::StartReply reply;
+        while (reader->Read(&reply))
+            ;
+        status = reader->Finish();
+        compacted.set_value();
+        loop.quit();
+    });
+    loop.exec();
+
+    EXPECT_FALSE(status.ok());
+    EXPECT_THAT(status.error_message(), HasSubstr("is being compacted"));
+}
+
+TEST_F(Daemon, refuses_launch_with_invalid_storage_profile)
+{
+    use_a_mock_vm_factory();
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream err_stream;
+    send_command({"launch", "--storage-profile", "turbo"}, std::cout, err_stream);
+    EXPECT_THAT(err_stream.str(), HasSubstr("Invalid storage profile supplied: turbo."));
+}
+
+TEST_F(Daemon, refuses_launch_with_io_limits_the_driver_cannot_apply)
+{
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, can_limit_io(Field(&mp::IoLimits::network_bytes_per_second, Gt(0))))
+        .WillOnce(Return(false));
+    EXPECT_CALL(*mock_factory, create_virtual_machine).Times(0);
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream err_stream;
+    send_command({"launch", "--network-bandwidth", "1M"}, std::cout, err_stream);
+    EXPECT_THAT(err_stream.str(), HasSubstr("The driver in use cannot apply the I/O limits supplied."));
+}
+
+TEST_F(Daemon, refuses_launch_because_bridging_is_not_implemented)
+{
+    // Use the stub factory, which throws when networks() is called.
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream err_stream;
+    send_command({"launch", "--network", "eth0"}, std::cout, err_stream);
+    EXPECT_THAT(err_stream.str(), HasSubstr("The bridging feature is not implemented on this backend"));
+}
+
+TEST_P(RefuseBridging, old_image)
+{
+    const auto [remote, image] = GetParam();
+    std::string full_image_name = remote.empty() ? image : remote + ":" + image;
+
+    auto mock_factory = use_a_mock_vm_factory();
+
+    mp::Daemon daemon{config_builder.build()};
+
+    EXPECT_CALL(*mock_factory, networks());
+
+    std::stringstream err_stream;
+    send_command({"launch", full_image_name, "--network", "eth0"}, std::cout, err_stream);
+    EXPECT_THAT(err_stream.str(), HasSubstr("Automatic network configuration not available for"));
+}
+
+std::vector<std::string> old_releases{"10.04",   "lucid",  "11.10",   "oneiric", "12.04", "precise", "12.10",
+                                      "quantal", "13.04",  "raring",  "13.10",   "saucy", "14.04",   "trusty",
+                                      "14.10",   "utopic", "15.04",   "vivid",   "15.10", "wily",    "16.04",
+                                      "xenial",  "16.10",  "yakkety", "17.04",   "zesty"};
+
+INSTANTIATE_TEST_SUITE_P(DaemonRefuseRelease, RefuseBridging, Combine(Values("release", ""), ValuesIn(old_releases)));
+INSTANTIATE_TEST_SUITE_P(DaemonRefuseSnapcraft, RefuseBridging, Values(std::make_tuple("snapcraft", "core")));
+
+constexpr auto ghost_template = R"(
+"{}": {{
+    "deleted": false,
+    "disk_space": "0",
+    "mac_addr": "",
+    "mem_size": "0",
+    "metadata": {{}},
+    "mounts": [],
+    "num_cores": 0,
+    "ssh_username": "",
+    "state": 0
+}})";
+constexpr auto valid_template = R"(
+"{}": {{
+    "deleted": false,
+    "disk_space": "3232323232",
+    "mac_addr": "ab:cd:ef:12:34:{}",
+    "mem_size": "2323232323",
+    "metadata": {{}},
+    "mounts": [],
+    "num_cores": 4,
+    "ssh_username": "ubuntu",
+    "state": 1
+}})";
+
+TEST_F(Daemon, skips_over_instance_ghosts_in_db) // which will have been sometimes writen for purged instances
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const auto id1 = "valid1";
+    const auto id2 = "valid2";
+    auto ghost1 = fmt::format(ghost_template, "ghost1");
+    auto ghost2 = fmt::format(ghost_template, "ghost2");
+    auto valid1 = fmt::format(valid_template, id1, "56");
+    auto valid2 = fmt::format(valid_template, id2, "78");
+    const auto [temp_dir, filename] = plant_instance_json(fmt::format(
+        "{{\n{},\n{},\n{},\n{}\n}}", std::move(ghost1), std::move(ghost2), std::move(valid1), std::move(valid2)));
+
+    config_builder.data_directory = temp_dir->path();
+    auto mock_factory = use_a_mock_vm_factory();
+
+    EXPECT_CALL(*mock_factory, create_virtual_machine).Times(0);
+    EXPECT_CALL(*mock_factory, create_virtual_machine(Field(&mp::VirtualMachineDescription::vm_name, id1), _)).Times(1);
+    EXPECT_CALL(*mock_factory, create_virtual_machine(Field(&mp::VirtualMachineDescription::vm_name, id2), _)).Times(1);
+
+    mp::Daemon daemon{config_builder.build()};
+    send_command({"purge"}); // commands that change instances wait for them all to be brought up
+}
+
+TEST_F(Daemon, reads_id_mappings_of_each_mount_on_their_own)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+
+    const auto mount_template = "{{\"source_path\": \"/src/{0}\", \"target_path\": \"/dst/{0}\", "
+                                "\"uid_mappings\": [{{\"host_uid\": {1}, \"instance_uid\": {1}}}], "
+                                "\"gid_mappings\": [{{\"host_gid\": {1}, \"instance_gid\": {1}}}]}}";
+    auto contents = QString::fromStdString(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    contents.replace("\"mounts\": [\n        ]",
+                     QString::fromStdString(fmt::format("\"mounts\": [{}, {}]", fmt::format(mount_template, "a", 1000),
+                                                        fmt::format(mount_template, "b", 2000))));
+    const auto [temp_dir, filename] = plant_instance_json(contents.toStdString());
+
+    config_builder.data_directory = temp_dir->path();
+    {
+        mp::Daemon daemon{config_builder.build()};
+        send_command({"purge"}); // rewrites the database
+    }
+
+    const auto mounts =
+        QJsonDocument::fromJson(mpt::load(filename)).object()["real-zebraphant"].toObject()["mounts"].toArray();
+    ASSERT_THAT(mounts.size(), Eq(2));
+    for (const auto& mount : mounts)
+    {
+        EXPECT_THAT(mount.toObject()["uid_mappings"].toArray().size(), Eq(1));
+        EXPECT_THAT(mount.toObject()["gid_mappings"].toArray().size(), Eq(1));
+    }
+}
+
+TEST_F(Daemon, list_looks_up_instance_release_once)
+{
+    auto mock_image_vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    // Once to recreate the instance, once for its release
+    EXPECT_CALL(*mock_image_vault, fetch_image(_, Field(&mp::Query::name, "real-zebraphant"), _, _))
+        .Times(2)
+        .WillRepeatedly(DoDefault());
+    config_builder.vault = std::move(mock_image_vault);
+
+    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    config_builder.data_directory = temp_dir->path();
+    mp::Daemon daemon{config_builder.build()};
+
+    for (auto i = 0; i < 3; ++i)
+    {
+        std::stringstream stream;
+        send_command({"list"}, stream);
+        EXPECT_THAT(stream.str(), HasSubstr("real-zebraphant"));
+    }
+}
+
+TEST_F(Daemon, info_reports_missing_instances_alongside_others)
+{
+    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    config_builder.data_directory = temp_dir->path();
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream out_stream, err_stream;
+    send_command({"info", "real-zebraphant", "nope"}, out_stream, err_stream);
+
+    EXPECT_THAT(err_stream.str(), HasSubstr("instance \"nope\" does not exist"));
+}
+
+TEST_F(Daemon, info_prefers_what_the_hypervisor_measured_over_what_the_instance_said)
+{
+    auto mock_factory = use_a_mock_vm_factory();
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    mp::Daemon daemon{config_builder.build()};
+
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        mp::VirtualMachine::Metrics metrics;
+        metrics.memory_used = 1234;
+        metrics.memory_total = 5678;
+        ON_CALL(*vm, current_state()).WillByDefault(Return(mp::VirtualMachine::State::running));
+        ON_CALL(*vm, metrics()).WillByDefault(Return(metrics));
+        return vm;
+    });
+    send_command({"launch", "--name", "measured"});
+
+    // What the instance answers the probe with, which has the disk usage the hypervisor left out
+    const std::string probe_output{"memory_used=1\nmemory_total=2\ndisk_used=3\ndisk_total=4\n"};
+    std::mutex ssh_mutex;
+    std::size_t read{0};
+    ssh_channel_callbacks callbacks{nullptr};
+    REPLACE(ssh_connect, [](auto...) { return SSH_OK; });
+    REPLACE(ssh_is_connected, [](auto...) { return true; });
+    REPLACE(ssh_userauth_publickey, [](auto...) { return SSH_AUTH_SUCCESS; });
+    REPLACE(ssh_channel_open_session, [](auto...) { return SSH_OK; });
+    REPLACE(ssh_channel_request_exec, [](auto...) { return SSH_OK; });
+    REPLACE(ssh_channel_get_exit_status, [](auto...) { return 0; });
+    REPLACE(ssh_add_channel_callbacks, [&ssh_mutex, &callbacks](ssh_channel, ssh_channel_callbacks cb) {
+        std::lock_guard<std::mutex> lock{ssh_mutex};
+        callbacks = cb;
+        return SSH_OK;
+    });
+    REPLACE(ssh_event_dopoll, [&ssh_mutex, &callbacks](ssh_event, int) {
+        std::lock_guard<std::mutex> lock{ssh_mutex};
+        callbacks->channel_exit_status_function(nullptr, nullptr, 0, callbacks->userdata);
+        return SSH_OK;
+    });
+    REPLACE(ssh_channel_read_timeout,
+            [&ssh_mutex, &probe_output, &read](ssh_channel, void* dest, uint32_t count, int is_stderr, int) {
+                std::lock_guard<std::mutex> lock{ssh_mutex};
+                if (is_stderr)
+                    return 0;
+
+                const auto num_to_copy = std::min(static_cast<std::size_t>(count), probe_output.size() - read);
+                std::copy_n(probe_output.begin() + read, num_to_copy, reinterpret_cast<char*>(dest));
+                read += num_to_copy;
+                return static_cast<int>(num_to_copy);
+            });
+
+    std::stringstream stream;
+    send_command({"info", "measured", "--format", "json"}, stream);
+
+    const auto info = QJsonDocument::fromJson(QByteArray::fromStdString(stream.str()))
+                          .object()["info"]
+                          .toObject()["measured"]
+                          .toObject();
+    EXPECT_EQ(info["memory"].toObject()["used"].toInt(), 1234);
+    EXPECT_EQ(info["memory"].toObject()["total"].toInt(), 5678);
+    EXPECT_EQ(info["disks"].toObject()["sda1"].toObject()["used"].toString(), "3");
+}
+
+TEST_F(Daemon, info_reaches_instances_without_holding_them)
+{
+    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    config_builder.data_directory = temp_dir->path();
+
+    mp::Daemon* daemon_ptr{nullptr};
+    std::atomic_bool in_info{false}, changed_meanwhile{false};
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([&](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        ON_CALL(*vm, current_state()).WillByDefault([&] {
+            // Changing the instances while info asks after one must not have to wait for it
+            if (in_info.exchange(false))
+            {
+                mp::PurgeRequest request;
+                std::promise<grpc::Status> status_promise;
+                auto purge = std::async(std::launch::async,
+                                        [&] { daemon_ptr->purge(&request, nullptr, &status_promise); });
+                changed_meanwhile = purge.wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+            }
+            return mp::VirtualMachine::State::stopped;
+        });
+        return vm;
+    });
+
+    mp::Daemon daemon{config_builder.build()};
+    daemon_ptr = &daemon;
+
+    in_info = true;
+    std::stringstream out_stream;
+    send_command({"info", "real-zebraphant"}, out_stream);
+
+    EXPECT_FALSE(in_info);
+    EXPECT_TRUE(changed_meanwhile);
+    EXPECT_THAT(out_stream.str(), HasSubstr("real-zebraphant"));
+}
+
+TEST_F(Daemon, watch_starts_with_every_instance)
+{
+    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    config_builder.data_directory = temp_dir->path();
+    mp::Daemon daemon{config_builder.build()};
+
+    mp::WatchReply reply;
+    grpc::Status status;
+    mp::AutoJoinThread t([this, &reply, &status] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        grpc::ClientContext context;
+        auto reader = stub->watch(&context, mp::WatchRequest{});
+
+        reader->Read(&reply);
+        context.TryCancel();
+        status = reader->Finish();
+        loop.quit();
+    });
+    loop.exec();
+
+    ASSERT_EQ(reply.instances_size(), 1);
+    EXPECT_EQ(reply.instances(0).name(), "real-zebraphant");
+    EXPECT_EQ(status.error_code(), grpc::StatusCode::CANCELLED);
+}
+
+TEST_F(Daemon, watch_serves_many_clients_at_once)
+{
+    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    config_builder.data_directory = temp_dir->path();
+    mp::Daemon daemon{config_builder.build()};
+
+    constexpr auto num_watchers = 8;
+    std::vector<mp::WatchReply> replies(num_watchers);
+    mp::AutoJoinThread t([this, &replies] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        std::vector<std::unique_ptr<grpc::ClientContext>> contexts;
+        std::vector<std::unique_ptr<grpc::ClientReader<mp::WatchReply>>> readers;
+        for (auto i = 0; i < num_watchers; ++i)
+        {
+            contexts.push_back(std::make_unique<grpc::ClientContext>());
+            readers.push_back(stub->watch(contexts.back().get(), mp::WatchRequest{}));
+        }
+
+        for (auto i = 0; i < num_watchers; ++i)
+            readers[i]->Read(&replies[i]);
+
+        for (auto i = 0; i < num_watchers; ++i)
+        {
+            contexts[i]->TryCancel();
+            readers[i]->Finish();
+        }
+        loop.quit();
+    });
+    loop.exec();
+
+    for (const auto& reply : replies)
+    {
+        ASSERT_EQ(reply.instances_size(), 1);
+        EXPECT_EQ(reply.instances(0).name(), "real-zebraphant");
+    }
+}
+
+TEST_F(Daemon, watch_reads_instance_states_on_the_main_thread)
+{
+    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    config_builder.data_directory = temp_dir->path();
+
+    const auto main_thread = std::this_thread::get_id();
+    std::atomic_int reads_off_main_thread{0};
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([&](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        ON_CALL(*vm, current_state()).WillByDefault([&] {
+            if (std::this_thread::get_id() != main_thread)
+                ++reads_off_main_thread;
+            return mp::VirtualMachine::State::stopped;
+        });
+        return vm;
+    });
+
+    mp::Daemon daemon{config_builder.build()};
+
+    mp::WatchReply reply;
+    mp::AutoJoinThread t([this, &reply] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        grpc::ClientContext context;
+        auto reader = stub->watch(&context, mp::WatchRequest{});
+
+        reader->Read(&reply);
+        context.TryCancel();
+        reader->Finish();
+        loop.quit();
+    });
+    loop.exec();
+
+    ASSERT_EQ(reply.instances_size(), 1);
+    EXPECT_EQ(reply.instances(0).instance_status().status(), mp::InstanceStatus::STOPPED);
+    EXPECT_EQ(reads_off_main_thread, 0);
+}
+
+TEST_F(Daemon, watch_tells_of_instances_that_went_away)
+{
+    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    config_builder.data_directory = temp_dir->path();
+    mp::Daemon daemon{config_builder.build()};
+
+    mp::WatchReply first_reply, change;
+    mp::AutoJoinThread t([this, &first_reply, &change] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        grpc::ClientContext context;
+        auto reader = stub->watch(&context, mp::WatchRequest{});
+        reader->Read(&first_reply);
+
+        mp::DeleteRequest request;
+        request.mutable_instance_names()->add_instance_name("real-zebraphant");
+        request.set_purge(true);
+        grpc::ClientContext delete_context;
+        mp::DeleteReply delete_reply;
+        auto deleter = stub->delet(&delete_context, request);
+        while (deleter->Read(&delete_reply))
+            ;
+        deleter->Finish();
+
+        reader->Read(&change);
+        context.TryCancel();
+        reader->Finish();
+        loop.quit();
+    });
+    loop.exec();
+
+    ASSERT_EQ(first_reply.instances_size(), 1);
+    EXPECT_EQ(change.instances_size(), 0);
+    EXPECT_THAT(change.removed_instances(), ElementsAre("real-zebraphant"));
+}
+
+TEST_F(Daemon, watch_sends_the_whole_picture_to_late_watchers_only)
+{
+    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    config_builder.data_directory = temp_dir->path();
+    mp::Daemon daemon{config_builder.build()};
+
+    mp::WatchReply first_reply, late_reply;
+    std::atomic_bool early_got_more{false};
+    mp::AutoJoinThread t([this, &first_reply, &late_reply, &early_got_more] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        grpc::ClientContext early_context, late_context;
+        auto early_reader = stub->watch(&early_context, mp::WatchRequest{});
+        early_reader->Read(&first_reply);
+
+        auto late_reader = stub->watch(&late_context, mp::WatchRequest{});
+        late_reader->Read(&late_reply);
+
+        // Nothing changed, so the early watcher hears nothing more before it hangs up
+        mp::AutoJoinThread early_read([&early_reader, &early_got_more] {
+            mp::WatchReply reply;
+            early_got_more = early_reader->Read(&reply);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        early_context.TryCancel();
+        late_context.TryCancel();
+        early_read.thread.join();
+        early_reader->Finish();
+        late_reader->Finish();
+        loop.quit();
+    });
+    loop.exec();
+
+    ASSERT_EQ(first_reply.instances_size(), 1);
+    ASSERT_EQ(late_reply.instances_size(), 1);
+    EXPECT_EQ(late_reply.instances(0).name(), "real-zebraphant");
+    EXPECT_FALSE(early_got_more);
+}
+
+TEST_F(Daemon, bake_refuses_unknown_instances)
+{
+    auto mock_image_vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    EXPECT_CALL(*mock_image_vault, bake).Times(0);
+    config_builder.vault = std::move(mock_image_vault);
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream err_stream;
+    send_command({"bake", "nope"}, trash_stream, err_stream);
+
+    EXPECT_THAT(err_stream.str(), HasSubstr("instance \"nope\" does not exist"));
+}
+
+// The instances run whatever they are sent over SSH, recording it, answering with output and ending it with
+// exit_status
+struct InstanceShell
+{
+    std::atomic_int exit_status{0};
+    std::mutex ssh_mutex;
+    std::vector<std::string> commands;
+    std::string output; // what each command prints
+    bool output_read{false};
+    ssh_channel_callbacks callbacks{nullptr};
+
+    MockScope<decltype(mock_ssh_connect)> connect{mock_ssh_connect, [](auto...) { return SSH_OK; }};
+    MockScope<decltype(mock_ssh_is_connected)> is_connected{mock_ssh_is_connected, [](auto...) { return true; }};
+    MockScope<decltype(mock_ssh_userauth_publickey)> userauth{mock_ssh_userauth_publickey,
+                                                              [](auto...) { return SSH_AUTH_SUCCESS; }};
+    MockScope<decltype(mock_ssh_channel_open_session)> open_session{mock_ssh_channel_open_session,
+                                                                    [](auto...) { return SSH_OK; }};
+    MockScope<decltype(mock_ssh_channel_request_exec)> request_exec{
+        mock_ssh_channel_request_exec, [this](ssh_channel, const char* command) {
+            std::lock_guard<std::mutex> lock{ssh_mutex};
+            commands.emplace_back(command);
+            output_read = false;
+            return SSH_OK;
+        }};
+    MockScope<decltype(mock_ssh_channel_get_exit_status)> get_exit_status{
+        mock_ssh_channel_get_exit_status, [this](auto...) { return exit_status.load(); }};
+    MockScope<decltype(mock_ssh_add_channel_callbacks)> add_callbacks{
+        mock_ssh_add_channel_callbacks, [this](ssh_channel, ssh_channel_callbacks cb) {
+            std::lock_guard<std::mutex> lock{ssh_mutex};
+            callbacks = cb;
+            return SSH_OK;
+        }};
+    MockScope<decltype(mock_ssh_event_dopoll)> dopoll{mock_ssh_event_dopoll, [this](ssh_event, int) {
+                                                          std::lock_guard<std::mutex> lock{ssh_mutex};
+                                                          callbacks->channel_exit_status_function(
+                                                              nullptr, nullptr, exit_status, callbacks->userdata);
+                                                          return SSH_OK;
+                                                      }};
+    MockScope<decltype(mock_ssh_channel_is_closed)> is_closed{mock_ssh_channel_is_closed, [](auto...) { return 0; }};
+    MockScope<decltype(mock_ssh_channel_read_timeout)> read_timeout{
+        mock_ssh_channel_read_timeout, [this](ssh_channel, void* dest, uint32_t count, int is_stderr, int) {
+            std::lock_guard<std::mutex> lock{ssh_mutex};
+            if (is_stderr || output_read)
+                return 0;
+
+            output_read = true;
+            const auto num_bytes = std::min<std::size_t>(count, output.size());
+            std::copy_n(output.data(), num_bytes, static_cast<char*>(dest));
+            return static_cast<int>(num_bytes);
+        }};
+};
+
+struct DaemonBake : public Daemon, public InstanceShell
+{
+    DaemonBake()
+    {
+        auto mock_image_vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+        vault = mock_image_vault.get();
+        config_builder.vault = std::move(mock_image_vault);
+
+        auto mock_factory = use_a_mock_vm_factory();
+        EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([this](const auto& desc, auto&) {
+            auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+            vm->state = mp::VirtualMachine::State::running;
+            ON_CALL(*vm, current_state()).WillByDefault(Return(mp::VirtualMachine::State::running));
+            this->vm = vm.get();
+            return vm;
+        });
+    }
+
+    NiceMock<mpt::MockVMImageVault>* vault;
+    NiceMock<mpt::MockVirtualMachine>* vm{nullptr};
+};
+
+TEST_F(DaemonBake, keeps_the_cleaned_and_stopped_instance_as_an_image)
+{
+    mp::Daemon daemon{config_builder.build()};
+    send_command({"launch", "--name", "baker"});
+    ASSERT_NE(vm, nullptr);
+
+    commands.clear(); // those that launching sent
+    EXPECT_CALL(*vm, shutdown());
+    EXPECT_CALL(*vault, bake("baker", "pie"));
+
+    std::stringstream out_stream;
+    send_command({"bake", "baker", "pie"}, out_stream);
+
+    EXPECT_THAT(out_stream.str(), HasSubstr(fmt::format("{}:pie", mp::baked_remote_name)));
+    ASSERT_EQ(commands.size(), 1u);
+    EXPECT_THAT(commands.front(), HasSubstr("cloud-init status --wait"));
+    EXPECT_THAT(commands.front(), HasSubstr("cloud-init clean --logs --machine-id"));
+}
+
+TEST_F(DaemonBake, leaves_the_instance_running_when_it_cannot_be_prepared)
+{
+    mp::Daemon daemon{config_builder.build()};
+    send_command({"launch", "--name", "baker"});
+    ASSERT_NE(vm, nullptr);
+
+    exit_status = 1;
+    EXPECT_CALL(*vm, shutdown()).Times(0);
+    EXPECT_CALL(*vault, bake).Times(0);
+
+    std::stringstream err_stream;
+    send_command({"bake", "baker"}, trash_stream, err_stream);
+
+    EXPECT_THAT(err_stream.str(), HasSubstr("Could not prepare baker for baking"));
+}
+
+TEST_F(DaemonBake, reports_an_image_that_could_not_be_kept)
+{
+    mp::Daemon daemon{config_builder.build()};
+    send_command({"launch", "--name", "baker"});
+    ASSERT_NE(vm, nullptr);
+
+    EXPECT_CALL(*vault, bake("baker", "baker")).WillOnce(Throw(std::runtime_error{"out of flour"}));
+
+    std::stringstream out_stream, err_stream;
+    send_command({"bake", "baker"}, out_stream, err_stream);
+
+    EXPECT_THAT(err_stream.str(), HasSubstr("out of flour"));
+    EXPECT_THAT(out_stream.str(), Not(HasSubstr("Baked")));
+}
+
+// With a running instance that has /dst mounted
+struct DaemonSSHInfo : public Daemon, public InstanceShell
+{
+    DaemonSSHInfo()
+    {
+        config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+        temp_dir = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {})).first;
+        config_builder.data_directory = temp_dir->path();
+
+        // Reached over vsock, before the instance has an address on its network
+        auto mock_factory = use_a_mock_vm_factory();
+        EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([](const auto& desc, auto&) {
+            auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+            ON_CALL(*vm, current_state()).WillByDefault(Return(mp::VirtualMachine::State::running));
+            ON_CALL(*vm, ssh_hostname()).WillByDefault(Return(mp::SSHSession::vsock_host(42)));
+            ON_CALL(*vm, management_ipv4()).WillByDefault(Return("UNKNOWN"));
+            return vm;
+        });
+    }
+
+    std::unique_ptr<mpt::TempDir> temp_dir;
+};
+
+TEST_F(DaemonSSHInfo, hands_local_clients_the_vsock_host)
+{
+    mp::Daemon daemon{config_builder.build()};
+
+    grpc::Status status;
+    mp::SSHInfoReply reply;
+    mp::AutoJoinThread t([this, &status, &reply] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        grpc::ClientContext context;
+        mp::SSHInfoRequest request;
+        request.add_instance_name("real-zebraphant");
+        auto reader = stub->ssh_info(&context, request);
+
+        mp::SSHInfoReply read;
+        while (reader->Read(&read))
+            if (read.ssh_info_size())
+                reply = read;
+
+        status = reader->Finish();
+        loop.quit();
+    });
+    loop.exec();
+
+    ASSERT_TRUE(status.ok()) << status.error_message();
+    EXPECT_EQ(reply.ssh_info().at("real-zebraphant").host(), mp::SSHSession::vsock_host(42));
+}
+
+TEST_F(DaemonSSHInfo, has_other_hosts_wait_for_the_network_of_an_instance_reached_over_vsock)
+{
+    mp::Daemon daemon{config_builder.build()};
+
+    mp::SSHInfoRequest request;
+    request.add_instance_name("real-zebraphant");
+    std::promise<grpc::Status> status_promise;
+
+    daemon.ssh_info(&request, nullptr, false, &status_promise);
+
+    const auto status = status_promise.get_future().get();
+    EXPECT_EQ(status.error_code(), grpc::StatusCode::UNAVAILABLE);
+    EXPECT_THAT(status.error_message(), HasSubstr("no network address"));
+}
+
+struct DaemonThrottle : public Daemon
+{
+    DaemonThrottle()
+    {
+        config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+        temp_dir = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {})).first;
+        config_builder.data_directory = temp_dir->path();
+
+        mock_factory = use_a_mock_vm_factory();
+        EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([this](const auto& desc, auto&) {
+            auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+            mock_vm = vm.get();
+            return vm;
+        });
+    }
+
+    std::unique_ptr<mpt::TempDir> temp_dir;
+    mpt::MockVirtualMachineFactory* mock_factory = nullptr;
+    mpt::MockVirtualMachine* mock_vm = nullptr;
+};
+
+TEST_F(DaemonThrottle, applies_the_limits_and_shows_them_in_info)
+{
+    mp::Daemon daemon{config_builder.build()};
+    process_events_until([this] { return mock_vm != nullptr; });
+    ASSERT_NE(mock_vm, nullptr);
+    EXPECT_CALL(*mock_vm, set_io_limits(Field(&mp::IoLimits::disk_iops, 500)));
+
+    std::stringstream cerr_stream;
+    send_command({"throttle", "real-zebraphant", "--disk-iops", "500"}, trash_stream, cerr_stream);
+    EXPECT_EQ(cerr_stream.str(), "");
+
+    std::stringstream info_stream;
+    send_command({"info", "real-zebraphant"}, info_stream);
+    EXPECT_THAT(info_stream.str(), HasSubstr("I/O limits:     disk 500 IOPS"));
+}
+
+TEST_F(DaemonThrottle, refuses_limits_the_driver_cannot_apply)
+{
+    ON_CALL(*mock_factory, can_limit_io(_)).WillByDefault(Return(false));
+    mp::Daemon daemon{config_builder.build()};
+    process_events_until([this] { return mock_vm != nullptr; });
+    ASSERT_NE(mock_vm, nullptr);
+    EXPECT_CALL(*mock_vm, set_io_limits).Times(0);
+
+    std::stringstream cerr_stream;
+    send_command({"throttle", "real-zebraphant", "--network-bandwidth", "1M"}, trash_stream, cerr_stream);
+    EXPECT_THAT(cerr_stream.str(), HasSubstr("The driver in use cannot apply these I/O limits"));
+
+    std::stringstream info_stream;
+    send_command({"info", "real-zebraphant"}, info_stream);
+    EXPECT_THAT(info_stream.str(), Not(HasSubstr("I/O limits:")));
+}
+
+struct DaemonResize : public Daemon
+{
+    DaemonResize()
+    {
+        config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+        std::tie(temp_dir, filename) = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+        config_builder.data_directory = temp_dir->path();
+
+        auto mock_factory = use_a_mock_vm_factory();
+        EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([this](const auto& desc, auto&) {
+            auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+            mock_vm = vm.get();
+            return vm;
+        });
+    }
+
+    QJsonObject recorded_instance()
+    {
+        return QJsonDocument::fromJson(mpt::load(filename)).object()["real-zebraphant"].toObject();
+    }
+
+    std::unique_ptr<mpt::TempDir> temp_dir;
+    QString filename;
+    mpt::MockVirtualMachine* mock_vm = nullptr;
+};
+
+TEST_F(DaemonResize, resizes_the_instance_and_records_its_new_size)
+{
+    mp::Daemon daemon{config_builder.build()};
+    process_events_until([this] { return mock_vm != nullptr; });
+    ASSERT_NE(mock_vm, nullptr);
+    EXPECT_CALL(*mock_vm, resize(1, mp::MemorySize{"1G"}));
+
+    std::stringstream cerr_stream;
+    send_command({"resize", "real-zebraphant", "--cpus", "1", "--mem", "1G"}, trash_stream, cerr_stream);
+    EXPECT_EQ(cerr_stream.str(), "");
+
+    const auto instance = recorded_instance();
+    EXPECT_EQ(instance["num_cores"].toInt(), 1);
+    EXPECT_EQ(instance["mem_size"].toString(), QString::number(mp::MemorySize{"1G"}.in_bytes()));
+}
+
+TEST_F(DaemonResize, refuses_more_memory_than_the_host_has)
+{
+    mp::Daemon daemon{config_builder.build()};
+    process_events_until([this] { return mock_vm != nullptr; });
+    ASSERT_NE(mock_vm, nullptr);
+    EXPECT_CALL(*mock_vm, resize).Times(0);
+    const auto recorded = recorded_instance();
+
+    std::stringstream cerr_stream;
+    send_command({"resize", "real-zebraphant", "--mem", "1000000G"}, trash_stream, cerr_stream);
+
+    EXPECT_THAT(cerr_stream.str(), HasSubstr("of memory the host has"));
+    EXPECT_EQ(recorded_instance(), recorded);
+}
+
+TEST_F(DaemonResize, leaves_the_recorded_size_alone_when_the_instance_cannot_take_the_new_one)
+{
+    mp::Daemon daemon{config_builder.build()};
+    process_events_until([this] { return mock_vm != nullptr; });
+    ASSERT_NE(mock_vm, nullptr);
+    EXPECT_CALL(*mock_vm, resize)
+        .WillOnce(Throw(std::runtime_error{"real-zebraphant can have at most 1 vCPUs until it restarts"}));
+    const auto recorded = recorded_instance();
+
+    std::stringstream cerr_stream;
+    send_command({"resize", "real-zebraphant", "--cpus", "1"}, trash_stream, cerr_stream);
+
+    EXPECT_THAT(cerr_stream.str(), HasSubstr("can have at most 1 vCPUs"));
+    EXPECT_EQ(recorded_instance(), recorded);
+}
+
+// With an instance that takes no CPU, set to be suspended as soon as it is seen idle
+struct DaemonIdle : public Daemon
+{
+    DaemonIdle()
+    {
+        config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+        config_builder.idle_check_timer = std::chrono::milliseconds{10};
+
+        auto mock_factory = use_a_mock_vm_factory();
+        EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([this](const auto& desc, auto& monitor) {
+            auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+            vm->state = state; // kept as recorded across the restart
+            ON_CALL(*vm, current_state()).WillByDefault([this] { return state; });
+            ON_CALL(*vm, ssh_hostname()).WillByDefault([this] { return ssh_host; });
+            ON_CALL(*vm, ssh_port()).WillByDefault([this] { return ssh_port; });
+            ON_CALL(*vm, metrics()).WillByDefault([this] {
+                mp::VirtualMachine::Metrics metrics;
+                metrics.cpu_time_ms = cpu_time_ms += cpu_ms_per_check;
+                return metrics;
+            });
+            ON_CALL(*vm, suspend()).WillByDefault([this, &monitor, name = desc.vm_name] {
+                state = mp::VirtualMachine::State::suspended;
+                monitor.persist_state_for(name, state);
+                ++suspends;
+                loop.quit();
+            });
+            ON_CALL(*vm, start()).WillByDefault([this] {
+                state = mp::VirtualMachine::State::running;
+                ++starts;
+                loop.quit();
+            });
+            mock_vm = vm.get();
+            return vm;
+        });
+    }
+
+    void SetUp() override
+    {
+        Daemon::SetUp();
+        EXPECT_CALL(mock_settings, get(Eq(mp::idle_suspend_key))).WillRepeatedly(Return("0"));
+    }
+
+    void plant_instance(mp::VirtualMachine::State recorded_state, bool idle_suspended = false)
+    {
+        auto records = QJsonDocument::fromJson(QByteArray::fromStdString(fake_json_contents("ab:ab:ab:ab:ab:ab", {})))
+                           .object();
+        auto instance = records["real-zebraphant"].toObject();
+        instance["state"] = static_cast<int>(recorded_state);
+        if (idle_suspended)
+            instance["idle_suspended"] = true;
+        records["real-zebraphant"] = instance;
+
+        std::tie(temp_dir, filename) = plant_instance_json(QJsonDocument{records}.toJson().toStdString());
+        config_builder.data_directory = temp_dir->path();
+        state = recorded_state;
+    }
+
+    // Checks for a while, which an idle instance takes a couple of rounds of to be suspended in
+    void run_idle_checks()
+    {
+        QTimer::singleShot(std::chrono::milliseconds{500}, &loop, &QEventLoop::quit);
+        loop.exec();
+    }
+
+    QJsonObject recorded_instance()
+    {
+        return QJsonDocument::fromJson(mpt::load(filename)).object()["real-zebraphant"].toObject();
+    }
+
+    std::unique_ptr<mpt::TempDir> temp_dir;
+    QString filename;
+    mpt::MockVirtualMachine* mock_vm = nullptr;
+    mp::VirtualMachine::State state{mp::VirtualMachine::State::running};
+    std::string ssh_host{"127.0.0.1"};
+    int ssh_port{mpt::free_port()};
+    long long cpu_time_ms{0};
+    long long cpu_ms_per_check{0};
+    int suspends{0};
+    int starts{0};
+};
+
+TEST_F(DaemonIdle, suspends_instances_that_sit_idle_and_records_it)
+{
+    plant_instance(mp::VirtualMachine::State::running);
+    {
+        mp::Daemon daemon{config_builder.build()};
+        run_idle_checks();
+    }
+
+    EXPECT_EQ(suspends, 1);
+    EXPECT_TRUE(recorded_instance()["idle_suspended"].toBool());
+}
+
+TEST_F(DaemonIdle, leaves_instances_that_use_the_cpu_running)
+{
+    cpu_ms_per_check = 1000;
+    plant_instance(mp::VirtualMachine::State::running);
+
+    mp::Daemon daemon{config_builder.build()};
+    run_idle_checks();
+
+    EXPECT_EQ(suspends, 0);
+}
+
+TEST_F(DaemonIdle, leaves_instances_with_connections_from_the_host_running)
+{
+    plant_instance(mp::VirtualMachine::State::running);
+    const auto listening = mpt::listen_on_any_port(ssh_port);
+    const auto shell = mpt::connect_to_port(ssh_port);
+    ASSERT_GE(shell, 0);
+
+    mp::Daemon daemon{config_builder.build()};
+    run_idle_checks();
+
+    EXPECT_EQ(suspends, 0);
+    ::close(shell);
+    ::close(listening);
+}
+
+TEST_F(DaemonIdle, counts_connections_over_ipv6_too)
+{
+    plant_instance(mp::VirtualMachine::State::running);
+
+    const auto listening = ::socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in6 address{};
+    address.sin6_family = AF_INET6;
+    address.sin6_addr = in6addr_loopback;
+    socklen_t length{sizeof(address)};
+    ASSERT_EQ(::bind(listening, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    ASSERT_EQ(::listen(listening, 1), 0);
+    ::getsockname(listening, reinterpret_cast<sockaddr*>(&address), &length);
+
+    const auto shell = ::socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_EQ(::connect(shell, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    ssh_host = "::1";
+    ssh_port = ntohs(address.sin6_port);
+
+    mp::Daemon daemon{config_builder.build()};
+    run_idle_checks();
+
+    EXPECT_EQ(suspends, 0);
+    ::close(shell);
+    ::close(listening);
+}
+
+TEST_F(DaemonIdle, leaves_instances_it_cannot_tell_connections_to_running)
+{
+    ssh_host = "localhost"; // not an address the host's connections are listed by
+    plant_instance(mp::VirtualMachine::State::running);
+
+    mp::Daemon daemon{config_builder.build()};
+    run_idle_checks();
+
+    EXPECT_EQ(suspends, 0);
+}
+
+TEST_F(DaemonIdle, resumes_instances_suspended_for_idling_before_a_restart_for_shells)
+{
+    plant_instance(mp::VirtualMachine::State::suspended, true);
+    mp::Daemon daemon{config_builder.build()};
+    process_events_until([this] { return mock_vm != nullptr; });
+    ASSERT_NE(mock_vm, nullptr);
+
+    mp::AutoJoinThread t([this] {
+        auto stub = mp::Rpc::NewStub(grpc::CreateChannel(server_address, grpc::InsecureChannelCredentials()));
+        grpc::ClientContext context;
+        mp::SSHInfoRequest request;
+        request.add_instance_name("real-zebraphant");
+        auto reader = stub->ssh_info(&context, request);
+
+        mp::SSHInfoReply reply;
+        while (reader->Read(&reply))
+            ;
+        reader->Finish();
+    });
+    QTimer::singleShot(std::chrono::seconds{10}, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    EXPECT_EQ(starts, 1);
+}
+
+TEST_F(DaemonIdle, leaves_instances_suspended_by_the_user_suspended_for_shells)
+{
+    plant_instance(mp::VirtualMachine::State::suspended);
+    mp::Daemon daemon{config_builder.build()};
+    process_events_until([this] { return mock_vm != nullptr; });
+    ASSERT_NE(mock_vm, nullptr);
+
+    mp::SSHInfoRequest request;
+    request.add_instance_name("real-zebraphant");
+    std::promise<grpc::Status> status_promise;
+    daemon.ssh_info(&request, nullptr, false, &status_promise);
+
+    EXPECT_EQ(status_promise.get_future().get().error_code(), grpc::StatusCode::ABORTED);
+    EXPECT_EQ(starts, 0);
+}
+
+TEST_F(Daemon, samples_usage_without_holding_up_the_event_loop)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    EXPECT_CALL(mock_settings, get(Eq(mp::usage_history_interval_key))).WillRepeatedly(Return("60"));
+
+    // Stands in for a backend that takes its time to answer
+    std::promise<void> answered;
+    auto answer = answered.get_future().share();
+    std::atomic_bool asked{false};
+    std::thread::id asked_on;
+
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([&](const auto& desc, auto&) {
+        auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        vm->state = mp::VirtualMachine::State::running;
+        ON_CALL(*vm, current_state()).WillByDefault(Return(mp::VirtualMachine::State::running));
+        ON_CALL(*vm, metrics()).WillByDefault([&] {
+            asked_on = std::this_thread::get_id();
+            asked = true;
+            answer.wait();
+            return mp::VirtualMachine::Metrics{};
+        });
+        return vm;
+    });
+
+    auto records = QJsonDocument::fromJson(QByteArray::fromStdString(fake_json_contents("ab:ab:ab:ab:ab:ab", {})))
+                       .object();
+    auto instance = records["real-zebraphant"].toObject();
+    instance["state"] = static_cast<int>(mp::VirtualMachine::State::running);
+    records["real-zebraphant"] = instance;
+    const auto [temp_dir, filename] = plant_instance_json(QJsonDocument{records}.toJson().toStdString());
+    config_builder.data_directory = temp_dir->path();
+
+    {
+        mp::Daemon daemon{config_builder.build()};
+
+        auto timer_fired = false;
+        QTimer::singleShot(0, [&timer_fired] { timer_fired = true; });
+        process_events_until([&] { return asked && timer_fired; });
+
+        EXPECT_TRUE(asked);
+        EXPECT_TRUE(timer_fired);
+        EXPECT_NE(asked_on, std::this_thread::get_id());
+
+        answered.set_value(); // for the daemon to wait on what is still sampling as it goes down
+    }
+}
+
+struct DaemonForward : public Daemon
+{
+    DaemonForward()
+    {
+        config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    }
+
+    void plant(const std::string& port_forwards = "")
+    {
+        auto contents = QString::fromStdString(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+        contents.replace("\"mounts\": [\n        ]",
+                         QString::fromStdString(fmt::format("\"mounts\": [], \"port_forwards\": [{}]", port_forwards)));
+        temp_dir = plant_instance_json(contents.toStdString()).first;
+        config_builder.data_directory = temp_dir->path();
+
+        auto mock_factory = use_a_mock_vm_factory();
+        EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([](const auto& desc, auto&) {
+            auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+            ON_CALL(*vm, current_state()).WillByDefault(Return(mp::VirtualMachine::State::running));
+            ON_CALL(*vm, management_ipv4()).WillByDefault(Return("127.0.0.1"));
+            return vm;
+        });
+    }
+
+    std::string forward(const std::vector<std::string>& args)
+    {
+        std::vector<std::string> command{"forward", "real-zebraphant"};
+        command.insert(command.end(), args.begin(), args.end());
+
+        std::stringstream out_stream, err_stream;
+        send_command(command, out_stream, err_stream);
+        EXPECT_EQ(err_stream.str(), "");
+        return out_stream.str();
+    }
+
+    std::unique_ptr<mpt::TempDir> temp_dir;
+    mpt::EchoServer server;
+    const int host_port = mpt::free_port();
+};
+
+TEST_F(DaemonForward, listens_on_loopback_unless_told_otherwise)
+{
+    plant();
+    mp::Daemon daemon{config_builder.build()};
+
+    EXPECT_EQ(forward({fmt::format("{}:{}", host_port, server.port)}),
+              fmt::format("127.0.0.1:{} -> real-zebraphant:{}\n", host_port, server.port));
+}
+
+TEST_F(DaemonForward, puts_forwards_made_without_address_on_loopback)
+{
+    plant(fmt::format("{{\"host_port\": {}, \"host_address\": \"\", \"instance_port\": {}}}", host_port, server.port));
+    mp::Daemon daemon{config_builder.build()};
+
+    EXPECT_EQ(forward({}), fmt::format("127.0.0.1:{} -> real-zebraphant:{}\n", host_port, server.port));
+}
+
+TEST_F(DaemonForward, relays_to_the_running_instance)
+{
+    plant();
+    mp::Daemon daemon{config_builder.build()};
+    forward({fmt::format("{}:{}", host_port, server.port)});
+
+    // The instance is asked for its address on this thread, which runs the loop until the client is done
+    std::string echoed;
+    mp::AutoJoinThread t([this, &echoed] {
+        const auto client = mpt::connect_to_port(host_port);
+        if (client >= 0)
+        {
+            mpt::write_all(client, "hello");
+            ::shutdown(client, SHUT_WR);
+            echoed = mpt::read_all(client);
+            ::close(client);
+        }
+        loop.quit();
+    });
+    loop.exec();
+
+    EXPECT_EQ(echoed, "hello");
+}
+
+TEST_F(DaemonForward, keeps_the_same_port_apart_on_other_addresses)
+{
+    plant();
+    mp::Daemon daemon{config_builder.build()};
+    const auto ports = fmt::format("{}:{}", host_port, server.port);
+    forward({"--address", "127.0.0.1", ports});
+    EXPECT_EQ(forward({"--address", "127.0.0.2", ports}),
+              fmt::format("127.0.0.1:{0} -> real-zebraphant:{1}\n127.0.0.2:{0} -> real-zebraphant:{1}\n", host_port,
+                          server.port));
+
+    EXPECT_EQ(forward({"--cancel", "--address", "127.0.0.2", std::to_string(host_port)}),
+              fmt::format("127.0.0.1:{} -> real-zebraphant:{}\n", host_port, server.port));
+    EXPECT_EQ(forward({"--cancel", std::to_string(host_port)}), "No ports are forwarded to real-zebraphant\n");
+}
+
+struct DaemonBenchMount : public Daemon, public InstanceShell
+{
+    DaemonBenchMount()
+    {
+        config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+        auto contents = QString::fromStdString(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+        contents.replace("\"mounts\": [\n        ]",
+                         "\"mounts\": [{\"source_path\": \"/src\", \"target_path\": \"/dst\", \"uid_mappings\": [], "
+                         "\"gid_mappings\": []}]");
+        temp_dir = plant_instance_json(contents.toStdString()).first;
+        config_builder.data_directory = temp_dir->path();
+
+        auto mock_factory = use_a_mock_vm_factory();
+        EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce([](const auto& desc, auto&) {
+            auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+            ON_CALL(*vm, current_state()).WillByDefault(Return(mp::VirtualMachine::State::running));
+            return vm;
+        });
+    }
+
+    std::unique_ptr<mpt::TempDir> temp_dir;
+};
+
+TEST_F(DaemonBenchMount, streams_what_the_workload_measures)
+{
+    output = "{\"operation\": \"seq_read\", \"count\": 128, \"bytes\": 134217728, \"seconds\": 2, "
+             "\"p50\": 0.015, \"p99\": 0.0001}\n"
+             "not a result\n"
+             "{\"operation\": \"create\", \"count\": 100, \"bytes\": 0, \"seconds\": 1, \"p50\": 0.01, "
+             "\"p99\": 0.02}\n";
+
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream out_stream, err_stream;
+    send_command({"bench-mount", "real-zebraphant:/dst", "--size", "8"}, out_stream, err_stream);
+
+    EXPECT_THAT(err_stream.str(), Not(HasSubstr("fail")));
+    EXPECT_THAT(out_stream.str(), AllOf(HasSubstr("seq_read"), HasSubstr("67.1 MB/s"), HasSubstr("create")));
+    ASSERT_EQ(commands.size(), 1u);
+    EXPECT_THAT(commands.front(), AllOf(HasSubstr("python3 - "), HasSubstr("/dst"), HasSubstr(" 8 ")));
+}
+
+TEST_F(DaemonBenchMount, reports_a_workload_that_failed)
+{
+    exit_status = 1;
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream err_stream;
+    send_command({"bench-mount", "real-zebraphant:/dst"}, trash_stream, err_stream);
+
+    EXPECT_THAT(err_stream.str(), HasSubstr("The workload failed"));
+}
+
+TEST_F(Daemon, clone_refuses_unknown_instances)
+{
+    auto mock_image_vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    EXPECT_CALL(*mock_image_vault, clone).Times(0);
+    config_builder.vault = std::move(mock_image_vault);
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream err_stream;
+    send_command({"clone", "nope", "copy"}, trash_stream, err_stream);
+
+    EXPECT_THAT(err_stream.str(), HasSubstr("instance \"nope\" does not exist"));
+}
+
+// With instance real-zebraphant, which the vault copies into whatever clone is asked of it
+struct DaemonClone : public Daemon
+{
+    DaemonClone()
+    {
+        auto mock_image_vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+        vault = mock_image_vault.get();
+        config_builder.vault = std::move(mock_image_vault);
+        std::tie(temp_dir, instances_file) = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+        config_builder.data_directory = temp_dir->path();
+
+        auto image_for = [this](const auto&, const auto& name) {
+            mp::VMImage image;
+            image.image_path = QDir{temp_dir->path()}.filePath(QString::fromStdString(name) + "/disk.img");
+            return image;
+        };
+        ON_CALL(*vault, clone(_, _)).WillByDefault(image_for);
+        ON_CALL(*vault, clone_layered(_, _)).WillByDefault(image_for);
+
+        mock_factory = use_a_mock_vm_factory();
+        EXPECT_CALL(*mock_factory, create_virtual_machine(Field(&mp::VirtualMachineDescription::vm_name, source), _))
+            .WillOnce([this](const auto& desc, auto&) {
+                auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+                ON_CALL(*vm, current_state()).WillByDefault(Invoke([this] { return source_state; }));
+                source_vm = vm.get();
+                return vm;
+            });
+    }
+
+    // Has the clone resumed off the source's memory, telling the script it was given to regenerate its identity
+    void expect_resumed_clone(bool regenerated, std::string& script, std::string& mac_address)
+    {
+        EXPECT_CALL(*mock_factory, create_virtual_machine(Field(&mp::VirtualMachineDescription::vm_name, "copy"), _))
+            .WillOnce([regenerated, &script, &mac_address](const auto& desc, auto&) {
+                auto vm = std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+                mac_address = desc.default_mac_address;
+                EXPECT_CALL(*vm, start());
+                EXPECT_CALL(*vm, run_after_resume).WillOnce([regenerated, &script](const auto& command, auto&&...) {
+                    script = command;
+                    return regenerated;
+                });
+                EXPECT_CALL(*vm, shutdown()).Times(regenerated ? 0 : 1);
+                return vm;
+            });
+    }
+
+    bool instance_recorded(const std::string& name)
+    {
+        return QJsonDocument::fromJson(mpt::load(instances_file)).object().contains(QString::fromStdString(name));
+    }
+
+    const std::string source{"real-zebraphant"};
+    mp::VirtualMachine::State source_state{mp::VirtualMachine::State::stopped};
+    std::unique_ptr<mpt::TempDir> temp_dir;
+    QString instances_file;
+    NiceMock<mpt::MockVMImageVault>* vault;
+    mpt::MockVirtualMachineFactory* mock_factory;
+    mpt::MockVirtualMachine* source_vm{nullptr};
+};
+
+TEST_F(DaemonClone, copies_an_instance_into_one_with_addresses_and_a_machine_id_of_its_own)
+{
+    mp::VirtualMachineDescription clone_desc;
+    EXPECT_CALL(*vault, clone(source, "copy"));
+    EXPECT_CALL(*mock_factory, create_virtual_machine(Field(&mp::VirtualMachineDescription::vm_name, "copy"), _))
+        .WillOnce([&clone_desc](const auto& desc, auto&) {
+            clone_desc = desc;
+            return std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        });
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream out_stream;
+    send_command({"clone", source, "copy"}, out_stream);
+
+    EXPECT_THAT(out_stream.str(), HasSubstr("Cloned real-zebraphant as copy"));
+    EXPECT_NE(clone_desc.default_mac_address, "ab:ab:ab:ab:ab:ab");
+    EXPECT_EQ(clone_desc.meta_data_config["instance-id"].as<std::string>(), "copy");
+    EXPECT_EQ(clone_desc.network_data_config["ethernets"]["default"]["dhcp-identifier"].as<std::string>(), "mac");
+    EXPECT_EQ(clone_desc.network_data_config["ethernets"]["default"]["match"]["macaddress"].as<std::string>(),
+              clone_desc.default_mac_address);
+    EXPECT_THAT(clone_desc.user_data_config["bootcmd"][0].as<std::string>(), HasSubstr("systemd-machine-id-setup"));
+
+    std::stringstream list_stream;
+    send_command({"list"}, list_stream);
+    EXPECT_THAT(list_stream.str(), HasSubstr("copy"));
+}
+
+TEST_F(DaemonClone, stops_a_running_source_for_the_copy_and_starts_it_again)
+{
+    source_state = mp::VirtualMachine::State::running;
+    mp::Daemon daemon{config_builder.build()};
+    ASSERT_NE(source_vm, nullptr);
+    EXPECT_CALL(*mock_factory, create_virtual_machine(Field(&mp::VirtualMachineDescription::vm_name, "copy"), _))
+        .WillOnce([](const auto& desc, auto&) {
+            return std::make_unique<NiceMock<mpt::MockVirtualMachine>>(desc.vm_name);
+        });
+
+    {
+        InSequence seq;
+        EXPECT_CALL(*source_vm, shutdown());
+        EXPECT_CALL(*vault, clone(source, "copy"));
+        EXPECT_CALL(*source_vm, start());
+    }
+
+    std::stringstream out_stream;
+    send_command({"clone", source, "copy"}, out_stream);
+
+    EXPECT_THAT(out_stream.str(), HasSubstr("Stopping real-zebraphant"));
+    EXPECT_THAT(out_stream.str(), HasSubstr("Cloned real-zebraphant as copy"));
+}
+
+TEST_F(DaemonClone, gives_back_the_disk_and_addresses_of_a_clone_that_cannot_be_created)
+{
+    EXPECT_CALL(*mock_factory, create_virtual_machine(Field(&mp::VirtualMachineDescription::vm_name, "copy"), _))
+        .WillOnce(Throw(std::runtime_error{"no room at the inn"}));
+    EXPECT_CALL(*mock_factory, remove_resources_for("copy"));
+    EXPECT_CALL(*vault, remove("copy"));
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream err_stream;
+    send_command({"clone", source, "copy"}, trash_stream, err_stream);
+    EXPECT_THAT(err_stream.str(), HasSubstr("no room at the inn"));
+
+    std::stringstream list_stream;
+    send_command({"list"}, list_stream);
+    EXPECT_THAT(list_stream.str(), Not(HasSubstr("copy")));
+}
+
+TEST_F(DaemonClone, reports_a_disk_that_cannot_be_copied)
+{
+    EXPECT_CALL(*vault, clone(source, "copy")).WillOnce(Throw(std::runtime_error{"disk full"}));
+    EXPECT_CALL(*mock_factory, create_virtual_machine(Field(&mp::VirtualMachineDescription::vm_name, "copy"), _))
+        .Times(0);
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream err_stream;
+    send_command({"clone", source, "copy"}, trash_stream, err_stream);
+
+    EXPECT_THAT(err_stream.str(), HasSubstr("disk full"));
+}
+
+TEST_F(DaemonClone, resumes_a_suspended_source_as_a_clone_with_an_identity_of_its_own)
+{
+    source_state = mp::VirtualMachine::State::suspended;
+    EXPECT_CALL(*vault, clone_layered(source, "copy"));
+    EXPECT_CALL(*vault, clone(_, _)).Times(0);
+    EXPECT_CALL(*mock_factory, clone_suspended_state(_, _));
+
+    std::string script, mac_address;
+    expect_resumed_clone(true, script, mac_address);
+    {
+        mp::Daemon daemon{config_builder.build()};
+
+        std::stringstream out_stream;
+        send_command({"clone", source, "copy"}, out_stream);
+
+        EXPECT_THAT(out_stream.str(), HasSubstr("Resuming copy"));
+        EXPECT_THAT(out_stream.str(), HasSubstr("Cloned real-zebraphant as copy"));
+    }
+
+    EXPECT_THAT(script, HasSubstr("hostnamectl set-hostname copy\n"));
+    EXPECT_THAT(script, HasSubstr("systemd-machine-id-setup\n"));
+    EXPECT_THAT(script, HasSubstr("ssh-keygen -A\n"));
+    EXPECT_THAT(script, HasSubstr(fmt::format("sed -i 's/ab:ab:ab:ab:ab:ab/{}/gI' /etc/netplan/*.yaml", mac_address)));
+    EXPECT_THAT(script, EndsWith("netplan apply\n"));
+    EXPECT_TRUE(instance_recorded("copy"));
+}
+
+TEST_F(DaemonClone, lets_go_of_a_clone_whose_identity_cannot_be_regenerated)
+{
+    source_state = mp::VirtualMachine::State::suspended;
+    EXPECT_CALL(*mock_factory, remove_resources_for("copy"));
+    EXPECT_CALL(*vault, remove("copy"));
+
+    std::string script, mac_address;
+    expect_resumed_clone(false, script, mac_address);
+    {
+        mp::Daemon daemon{config_builder.build()};
+
+        std::stringstream err_stream;
+        send_command({"clone", source, "copy"}, trash_stream, err_stream);
+        EXPECT_THAT(err_stream.str(), HasSubstr("Could not resume copy as a clone: cannot regenerate its identity"));
+
+        std::stringstream list_stream;
+        send_command({"list"}, list_stream);
+        EXPECT_THAT(list_stream.str(), Not(HasSubstr("copy")));
+    }
+
+    EXPECT_FALSE(instance_recorded("copy")); // not to come back on the next start
+}
+
+TEST_F(DaemonClone, reports_a_source_whose_memory_cannot_be_cloned)
+{
+    source_state = mp::VirtualMachine::State::suspended;
+    EXPECT_CALL(*mock_factory, clone_suspended_state)
+        .WillOnce(Throw(std::runtime_error{"the instance was suspended into its image"}));
+    EXPECT_CALL(*mock_factory, create_virtual_machine(Field(&mp::VirtualMachineDescription::vm_name, "copy"), _))
+        .Times(0);
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream err_stream;
+    send_command({"clone", source, "copy"}, trash_stream, err_stream);
+
+    EXPECT_THAT(err_stream.str(), HasSubstr("suspended into its image"));
+}
+
+TEST_F(Daemon, logs_exceptions_arising_from_vm_creation)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    config_builder.data_directory = temp_dir->path();
+
+    const std::string msg = "asdf";
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce(Throw(std::runtime_error{msg}));
+
+    auto logger_scope = mpt::MockLogger::inject();
+    logger_scope.mock_logger->screen_logs(mpl::Level::error);
+    logger_scope.mock_logger->expect_log(mpl::Level::error, msg);
+
+    mp::Daemon daemon{config_builder.build()};
+    send_command({"purge"});
+}
+
+TEST_F(Daemon, lists_instances_that_could_not_be_brought_up_as_failed)
+{
+    config_builder.vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    const auto [temp_dir, filename] = plant_instance_json(fake_json_contents("ab:ab:ab:ab:ab:ab", {}));
+    config_builder.data_directory = temp_dir->path();
+
+    auto mock_factory = use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_factory, create_virtual_machine).WillOnce(Throw(std::runtime_error{"no hypervisor"}));
+
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream list_stream, shell_err_stream;
+    send_commands({{"purge"}, {"list"}, {"shell", "real-zebraphant"}}, list_stream, shell_err_stream); // purge warms up
+
+    EXPECT_THAT(list_stream.str(), ContainsRegex("real-zebraphant +Failed"));
+    EXPECT_THAT(shell_err_stream.str(), HasSubstr("could not be brought up: no hypervisor"));
+}
+
+TEST_F(Daemon, ctor_drops_removed_instances)
+{
+    const std::string stayed{"foo"}, gone{"fighters"};
+    auto stayed_json = fmt::format(valid_template, stayed, "12");
+    auto gone_json = fmt::format(valid_template, gone, "34");
+    const auto [temp_dir, filename] =
+        plant_instance_json(fmt::format("{{\n{},\n{}\n}}", std::move(stayed_json), std::move(gone_json)));
+    config_builder.data_directory = temp_dir->path();
+
+    auto mock_image_vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
     EXPECT_CALL(*mock_image_vault, fetch_image(_, Field(&mp::Query::name, stayed), _, _))
         .WillRepeatedly(DoDefault()); // returns an image that can be verified to exist for this instance
     EXPECT_CALL(*mock_image_vault, fetch_image(_, Field(&mp::Query::name, gone), _, _))
@@ -1159,13 +3332,15 @@ TEST_F(Daemon, ctor_drops_removed_instances)
     EXPECT_CALL(*mock_factory, create_virtual_machine(Field(&mp::VirtualMachineDescription::vm_name, gone), _))
         .Times(0);
 
-    mp::Daemon daemon{config_builder.build()};
-
-    std::stringstream stream;
-    send_command({"list"}, stream);
-
     auto instance_matchers = AllOf(HasSubstr(stayed), Not(HasSubstr(gone)));
-    EXPECT_THAT(stream.str(), instance_matchers);
+    {
+        mp::Daemon daemon{config_builder.build()};
+        send_command({"purge"}); // commands that change instances wait for them all to be brought up
+
+        std::stringstream stream;
+        send_command({"list"}, stream);
+        EXPECT_THAT(stream.str(), instance_matchers);
+    } // the daemon finishes any pending write before it goes
 
     auto updated_json = mpt::load(filename);
     EXPECT_THAT(updated_json.toStdString(), instance_matchers);
@@ -1218,6 +3393,7 @@ TEST_F(Daemon, prevents_repetition_of_loaded_mac_addresses)
 
     auto mock_factory = use_a_mock_vm_factory();
     mp::Daemon daemon{config_builder.build()};
+    send_command({"purge"}); // brings the loaded instance up before the expectation below
 
     std::stringstream stream;
     EXPECT_CALL(*mock_factory, create_virtual_machine).Times(0); // expect *no* call
@@ -1282,6 +3458,24 @@ TEST_F(Daemon, does_not_hold_on_to_macs_when_image_preparation_fails)
     send_command(cmd); // and confirm we can repeat the same mac
 }
 
+TEST_F(Daemon, does_not_hold_on_to_macs_when_the_image_cannot_be_fetched)
+{
+    auto mock_image_vault = std::make_unique<NiceMock<mpt::MockVMImageVault>>();
+    EXPECT_CALL(*mock_image_vault, fetch_image)
+        .WillOnce(Throw(std::runtime_error{"no image"}))
+        .WillRepeatedly(DoDefault());
+    config_builder.vault = std::move(mock_image_vault);
+
+    auto mock_factory = use_a_mock_vm_factory();
+    mp::Daemon daemon{config_builder.build()};
+
+    EXPECT_CALL(*mock_factory, create_virtual_machine).Times(1);
+
+    auto cmd = std::vector<std::string>{"launch", "--network", "mac=52:54:00:73:76:28,name=wlan0"};
+    send_command(cmd); // fails while the MAC is already claimed
+    send_command(cmd); // which gives it back
+}
+
 TEST_F(Daemon, releases_macs_when_launch_fails)
 {
     auto mock_factory = use_a_mock_vm_factory();
@@ -1364,6 +3558,33 @@ INSTANTIATE_TEST_SUITE_P(Daemon, DaemonLaunchTimeoutValueTestSuite,
                                 std::make_tuple(1000, 600, 1000), std::make_tuple(1000, 0, 1000),
                                 std::make_tuple(0, 0, 300)));
 
+TEST_F(Daemon, launch_reports_failing_cloud_init_waits)
+{
+    use_a_mock_vm_factory();
+    EXPECT_CALL(*mock_utils, wait_for_cloud_init(_, _, _)).WillOnce(Throw(std::runtime_error{"cloud-init broke"}));
+
+    mp::Daemon daemon{config_builder.build()};
+
+    std::stringstream err_stream;
+    send_command({"launch"}, trash_stream, err_stream);
+    EXPECT_THAT(err_stream.str(), HasSubstr("cloud-init broke"));
+}
+
+TEST_F(Daemon, launch_is_done_only_once_the_cloud_init_wait_is)
+{
+    use_a_mock_vm_factory();
+    std::atomic_bool waited{false};
+    EXPECT_CALL(*mock_utils, wait_for_cloud_init(_, _, _)).WillOnce([&waited](auto...) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{200}); // outlasting the mounts, of which there are none
+        waited = true;
+    });
+
+    mp::Daemon daemon{config_builder.build()};
+    send_command({"launch"});
+
+    EXPECT_TRUE(waited);
+}
+
 TEST_F(Daemon, launches_with_bridged)
 {
     mpt::MockVirtualMachineFactory* mock_factory = use_a_mock_vm_factory();
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "file_operations.h"
+#include "temp_dir.h"
+
+#include <multipass/disk_image.h>
+
+#include <QDir>
+#include <QtEndian>
+
+#include <gmock/gmock.h>
+
+#include <algorithm>
+
+namespace mp = multipass;
+namespace mpdi = multipass::disk_image;
+namespace mpt = multipass::test;
+using namespace testing;
+
+namespace
+{
+constexpr quint64 gigabyte = 1024ull * 1024 * 1024;
+constexpr quint32 cluster_bits = 16;
+constexpr quint64 cluster_size = 1ull << cluster_bits;
+constexpr quint64 l1_table_offset = 3 * cluster_size;
+
+struct DiskImage : public Test
+{
+    // A v3 image of 2GiB with 64KiB clusters, which takes 4 L1 entries in a table of one cluster
+    std::string make_qcow2(quint64 size = 2 * gigabyte, quint32 l1_size = 4, quint32 snapshots = 0,
+                           const std::string& backing_file = {})
+    {
+        std::string image(l1_table_offset + cluster_size, '\xff');
+        std::fill_n(image.begin(), l1_table_offset, '\0');
+        std::fill_n(image.begin() + l1_table_offset, l1_size * 8, '\x01');
+
+        auto data = &image[0];
+        qToBigEndian<quint32>(0x514649fb, data);
+        qToBigEndian<quint32>(3, data + 4);
+        if (!backing_file.empty())
+        {
+            qToBigEndian<quint64>(104, data + 8);
+            qToBigEndian<quint32>(static_cast<quint32>(backing_file.size()), data + 16);
+            image.replace(104, backing_file.size(), backing_file);
+        }
+        qToBigEndian<quint32>(cluster_bits, data + 20);
+        qToBigEndian<quint64>(size, data + 24);
+        qToBigEndian<quint32>(l1_size, data + 36);
+        qToBigEndian<quint64>(l1_table_offset, data + 40);
+        qToBigEndian<quint32>(snapshots, data + 60);
+        qToBigEndian<quint32>(104, data + 100);
+
+        mpt::make_file_with_content(image_path, image);
+        return image;
+    }
+
+    quint32 l1_size() const
+    {
+        return qFromBigEndian<quint32>(mpt::load(image_path).constData() + 36);
+    }
+
+    mpt::TempDir temp_dir;
+    QString image_path{QDir{temp_dir.path()}.filePath("image.qcow2")};
+};
+} // namespace
+
+TEST_F(DiskImage, inspects_qcow2_header)
+{
+    make_qcow2(2 * gigabyte, 4, 1, "base.img");
+
+    const auto info = mpdi::inspect_qcow2(image_path);
+
+    ASSERT_TRUE(info);
+    EXPECT_EQ(info->virtual_size, 2 * gigabyte);
+    EXPECT_EQ(info->version, 3u);
+    EXPECT_EQ(info->backing_file, "base.img");
+    EXPECT_EQ(info->snapshot_count, 1u);
+}
+
+TEST_F(DiskImage, leaves_other_formats_alone)
+{
+    mpt::make_file_with_content(image_path, std::string(512, '\0'));
+
+    EXPECT_FALSE(mpdi::inspect_qcow2(image_path));
+    EXPECT_FALSE(mpdi::grow_qcow2(image_path, 4 * gigabyte));
+    EXPECT_FALSE(mpdi::inspect_qcow2(image_path + ".missing"));
+}
+
+TEST_F(DiskImage, grows_image_within_its_l1_table)
+{
+    make_qcow2();
+
+    ASSERT_TRUE(mpdi::grow_qcow2(image_path, 5 * gigabyte));
+
+    EXPECT_EQ(mpdi::inspect_qcow2(image_path)->virtual_size, 5 * gigabyte);
+    EXPECT_EQ(l1_size(), 10u);
+
+    const auto image = mpt::load(image_path);
+    EXPECT_EQ(image.mid(l1_table_offset, 4 * 8), QByteArray(4 * 8, '\x01'));
+    EXPECT_EQ(image.mid(l1_table_offset + 4 * 8, 6 * 8), QByteArray(6 * 8, '\0'));
+    EXPECT_EQ(image.at(l1_table_offset + 10 * 8), '\xff');
+}
+
+TEST_F(DiskImage, does_not_grow_images_with_snapshots)
+{
+    const auto original = make_qcow2(2 * gigabyte, 4, 1);
+
+    EXPECT_FALSE(mpdi::grow_qcow2(image_path, 5 * gigabyte));
+    EXPECT_EQ(mpt::load(image_path).toStdString(), original);
+}
+
+TEST_F(DiskImage, does_not_grow_beyond_its_l1_table)
+{
+    const auto original = make_qcow2();
+
+    // One cluster holds 8192 entries of 512MiB each
+    EXPECT_FALSE(mpdi::grow_qcow2(image_path, 4097 * gigabyte));
+    EXPECT_EQ(mpt::load(image_path).toStdString(), original);
+}
+
+TEST_F(DiskImage, does_not_shrink)
+{
+    make_qcow2();
+
+    EXPECT_FALSE(mpdi::grow_qcow2(image_path, gigabyte));
+    EXPECT_TRUE(mpdi::grow_qcow2(image_path, 2 * gigabyte));
+    EXPECT_EQ(mpdi::inspect_qcow2(image_path)->virtual_size, 2 * gigabyte);
+}
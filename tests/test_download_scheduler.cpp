@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/download_scheduler.h>
+#include <multipass/exceptions/aborted_download_exception.h>
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace mp = multipass;
+
+using namespace std::chrono_literals;
+using namespace testing;
+
+namespace
+{
+using Priority = mp::DownloadScheduler::Priority;
+
+struct DownloadScheduler : public Test
+{
+    // Starts a download with the given priority in another thread, which holds its slot until released
+    std::thread start_download(mp::DownloadScheduler& scheduler, Priority priority, std::atomic_bool& started,
+                               const std::atomic_bool& release)
+    {
+        return std::thread{[&scheduler, priority, &started, &release, this] {
+            mp::DownloadScheduler::PriorityScope scope{priority};
+            const auto slot = scheduler.acquire(abort);
+            started = true;
+            while (!release)
+                std::this_thread::sleep_for(1ms);
+        }};
+    }
+
+    std::atomic_bool abort{false};
+};
+} // namespace
+
+TEST_F(DownloadScheduler, threadsDefaultToInteractivePriority)
+{
+    EXPECT_EQ(mp::DownloadScheduler::current_priority(), Priority::interactive);
+
+    {
+        mp::DownloadScheduler::PriorityScope scope{Priority::update};
+        EXPECT_EQ(mp::DownloadScheduler::current_priority(), Priority::update);
+    }
+
+    EXPECT_EQ(mp::DownloadScheduler::current_priority(), Priority::interactive);
+}
+
+TEST_F(DownloadScheduler, waitsForASlotOverTheConcurrencyLimit)
+{
+    mp::DownloadScheduler scheduler{{1, 0}};
+    auto slot = scheduler.acquire(abort);
+
+    std::atomic_bool started{false}, release{true};
+    auto download = start_download(scheduler, Priority::interactive, started, release);
+
+    std::this_thread::sleep_for(200ms);
+    EXPECT_FALSE(started);
+
+    slot.reset();
+    download.join();
+    EXPECT_TRUE(started);
+}
+
+TEST_F(DownloadScheduler, lessUrgentDownloadsDoNotTakeUpSlots)
+{
+    mp::DownloadScheduler scheduler{{1, 0}};
+
+    std::atomic_bool update_started{false}, release_update{false};
+    auto update = start_download(scheduler, Priority::update, update_started, release_update);
+    while (!update_started)
+        std::this_thread::sleep_for(1ms);
+
+    EXPECT_NO_THROW(scheduler.acquire(abort));
+
+    release_update = true;
+    update.join();
+}
+
+TEST_F(DownloadScheduler, abortsWhileWaitingForASlot)
+{
+    mp::DownloadScheduler scheduler{{1, 0}};
+    const auto slot = scheduler.acquire(abort);
+
+    abort = true;
+    EXPECT_THROW(scheduler.acquire(abort), mp::AbortedDownloadException);
+}
+
+TEST_F(DownloadScheduler, throttlesToTheByteRate)
+{
+    constexpr qint64 rate = 1024 * 1024;
+    mp::DownloadScheduler scheduler{{0, rate}};
+    const auto slot = scheduler.acquire(abort);
+
+    // The first second's worth goes through at once, as idle time builds up some allowance
+    const auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < 4; ++i)
+        scheduler.throttle(*slot, rate / 2, abort);
+
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 900ms);
+}
+
+TEST_F(DownloadScheduler, lessUrgentDownloadsBackOff)
+{
+    mp::DownloadScheduler scheduler{{0, 0}};
+    const auto interactive_slot = scheduler.acquire(abort);
+
+    mp::DownloadScheduler::PriorityScope scope{Priority::prefetch};
+    const auto prefetch_slot = scheduler.acquire(abort);
+
+    const auto start = std::chrono::steady_clock::now();
+    scheduler.throttle(*prefetch_slot, 1, abort);
+    scheduler.throttle(*interactive_slot, 1, abort);
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_GE(elapsed, 900ms);
+    EXPECT_LT(elapsed, 5s);
+}
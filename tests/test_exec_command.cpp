@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mock_settings.h"
+#include "mock_ssh.h"
+#include "stub_terminal.h"
+
+#include <multipass/constants.h>
+#include <multipass/format.h>
+#include <src/client/cli/cmd/exec.h>
+
+#include <gmock/gmock.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace
+{
+// Each instance is told apart by its SSH port, and runs on one thread at a time
+thread_local int instance_port{0};
+thread_local std::size_t next_chunk{0};
+thread_local ssh_channel_callbacks channel_callbacks{nullptr};
+
+struct ExecOnAll : public Test
+{
+    ExecOnAll()
+    {
+        EXPECT_CALL(mock_settings, get(Eq(mp::ssh_broker_key))).WillRepeatedly(Return("false"));
+
+        connect.returnValue(SSH_OK);
+        is_connected.returnValue(true);
+        userauth.returnValue(SSH_AUTH_SUCCESS);
+        open_session.returnValue(SSH_OK);
+        is_closed.returnValue(0);
+
+        REPLACE(ssh_options_set, [](ssh_session, ssh_options_e type, const void* value) {
+            if (type == SSH_OPTIONS_PORT)
+            {
+                instance_port = *static_cast<const int*>(value);
+                next_chunk = 0;
+            }
+            return SSH_OK;
+        });
+        REPLACE(ssh_channel_request_exec, [this](auto...) {
+            {
+                std::unique_lock<std::mutex> lock{running_mutex};
+                most_running = std::max(most_running, ++running);
+                running_cv.notify_all();
+                running_cv.wait_for(lock, 2s, [this] { return running >= expected_running; });
+            }
+            return SSH_OK;
+        });
+        REPLACE(ssh_channel_read_timeout, [this](ssh_channel, void* dest, uint32_t, int is_stderr, int) {
+            const auto& chunks = output.at(instance_port);
+            if (is_stderr)
+                return 0;
+
+            if (next_chunk == chunks.size())
+            {
+                std::lock_guard<std::mutex> lock{running_mutex};
+                --running;
+                return 0;
+            }
+
+            std::this_thread::sleep_for(1ms); // for the others to get a word in
+            const auto& chunk = chunks[next_chunk++];
+            std::memcpy(dest, chunk.data(), chunk.size());
+            return static_cast<int>(chunk.size());
+        });
+        REPLACE(ssh_add_channel_callbacks, [](ssh_channel, ssh_channel_callbacks callbacks) {
+            channel_callbacks = callbacks;
+            return SSH_OK;
+        });
+        REPLACE(ssh_event_dopoll, [this](auto...) {
+            channel_callbacks->channel_exit_status_function(nullptr, nullptr, exit_codes.at(instance_port),
+                                                            channel_callbacks->userdata);
+            return SSH_OK;
+        });
+    }
+
+    void add_instance(const std::string& name, int port, std::vector<std::string> chunks, int exit_code = 0)
+    {
+        auto& ssh_info = (*reply.mutable_ssh_info())[name];
+        ssh_info.set_host("localhost");
+        ssh_info.set_port(port);
+        ssh_info.set_username("ubuntu");
+        ssh_info.set_priv_key_base64("key");
+
+        output[port] = std::move(chunks);
+        exit_codes[port] = exit_code;
+    }
+
+    mp::ReturnCode exec_on_all(int max_parallel)
+    {
+        expected_running = std::min<int>(max_parallel, reply.ssh_info_size());
+        return mp::cmd::Exec::exec_on_all(reply, {"foo"}, &term, max_parallel);
+    }
+
+    std::vector<std::string> output_lines()
+    {
+        std::vector<std::string> lines;
+        std::istringstream stream{cout.str()};
+        for (std::string line; std::getline(stream, line);)
+            lines.push_back(line);
+        return lines;
+    }
+
+    mpt::MockSettings& mock_settings = mpt::MockSettings::mock_instance();
+    decltype(MOCK(ssh_connect)) connect{MOCK(ssh_connect)};
+    decltype(MOCK(ssh_is_connected)) is_connected{MOCK(ssh_is_connected)};
+    decltype(MOCK(ssh_userauth_publickey)) userauth{MOCK(ssh_userauth_publickey)};
+    decltype(MOCK(ssh_channel_open_session)) open_session{MOCK(ssh_channel_open_session)};
+    decltype(MOCK(ssh_channel_is_closed)) is_closed{MOCK(ssh_channel_is_closed)};
+
+    mp::SSHInfoReply reply;
+    std::map<int, std::vector<std::string>> output; // by port
+    std::map<int, int> exit_codes;                   // idem
+    std::mutex running_mutex;
+    std::condition_variable running_cv;
+    int running{0};
+    int most_running{0};
+    int expected_running{0}; // that commands wait, for a while, to be running alongside
+    std::stringstream cout, cerr, cin;
+    mpt::StubTerminal term{cout, cerr, cin};
+};
+} // namespace
+
+TEST_F(ExecOnAll, runs_on_as_many_instances_at_a_time_as_allowed)
+{
+    for (auto i = 1; i <= 4; ++i)
+        add_instance(fmt::format("instance-{}", i), i, {"done\n"});
+
+    EXPECT_EQ(exec_on_all(2), mp::ReturnCode::Ok);
+    EXPECT_EQ(most_running, 2);
+    EXPECT_THAT(output_lines(), UnorderedElementsAre("instance-1: done", "instance-2: done", "instance-3: done",
+                                                     "instance-4: done"));
+}
+
+TEST_F(ExecOnAll, runs_on_every_instance_at_once_within_the_limit)
+{
+    for (auto i = 1; i <= 3; ++i)
+        add_instance(fmt::format("instance-{}", i), i, {"done\n"});
+
+    EXPECT_EQ(exec_on_all(8), mp::ReturnCode::Ok);
+    EXPECT_EQ(most_running, 3);
+}
+
+TEST_F(ExecOnAll, prefixes_whole_lines_put_together_from_partial_output)
+{
+    add_instance("foo", 1, {"hel", "lo\nwor", "ld"});
+
+    EXPECT_EQ(exec_on_all(1), mp::ReturnCode::Ok);
+    EXPECT_EQ(cout.str(), "foo: hello\nfoo: world\n");
+}
+
+TEST_F(ExecOnAll, keeps_lines_of_instances_running_alongside_apart)
+{
+    std::vector<std::string> first, second;
+    for (auto i = 0; i < 20; ++i)
+    {
+        first.insert(first.end(), {"from ", "first\n"});
+        second.insert(second.end(), {"from ", "second\n"});
+    }
+    add_instance("first", 1, first);
+    add_instance("second", 2, second);
+
+    EXPECT_EQ(exec_on_all(2), mp::ReturnCode::Ok);
+
+    const auto lines = output_lines();
+    EXPECT_EQ(lines.size(), 40u);
+    EXPECT_THAT(lines, Each(AnyOf("first: from first", "second: from second")));
+}
+
+TEST_F(ExecOnAll, fails_with_the_status_of_the_first_instance_it_failed_on)
+{
+    add_instance("a", 1, {}, 0);
+    add_instance("b", 2, {}, 7);
+    add_instance("c", 3, {}, 9);
+
+    EXPECT_EQ(static_cast<int>(exec_on_all(3)), 7);
+    EXPECT_EQ(cerr.str(), "b: exited with status 7\nc: exited with status 9\n");
+}
+
+TEST_F(ExecOnAll, fails_on_instances_it_cannot_reach)
+{
+    REPLACE(ssh_connect, [](auto...) { return instance_port == 1 ? SSH_ERROR : SSH_OK; });
+    add_instance("a", 1, {});
+    add_instance("b", 2, {"fine\n"});
+
+    EXPECT_EQ(exec_on_all(1), mp::ReturnCode::CommandFail);
+    EXPECT_THAT(cerr.str(), HasSubstr("a: exec failed: "));
+    EXPECT_EQ(cout.str(), "b: fine\n");
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "file_operations.h"
+#include "temp_dir.h"
+
+#include <multipass/file_ops.h>
+
+#include <gmock/gmock.h>
+
+#include <QDir>
+
+#include <cerrno>
+#include <string>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+
+struct FileOpsSubmit : public Test
+{
+    mpt::TempDir temp_dir;
+    QString file_name{QDir{temp_dir.path()}.filePath("file")};
+};
+
+TEST_F(FileOpsSubmit, carries_out_reads_and_writes_together)
+{
+    mpt::make_file_with_content(file_name, "0123456789");
+    QFile file{file_name};
+    ASSERT_TRUE(file.open(QIODevice::ReadWrite));
+
+    std::string first(4, ' '), last(4, ' '), written{"abc"};
+    std::vector<mp::FileOps::IoRequest> requests{{&file, first.data(), 4, 0},
+                                                 {&file, last.data(), 4, 6},
+                                                 {&file, written.data(), 3, 10, true}};
+
+    EXPECT_TRUE(MP_FILEOPS.submit(requests));
+    EXPECT_THAT(first, Eq("0123"));
+    EXPECT_THAT(last, Eq("6789"));
+    EXPECT_THAT(requests[2].result, Eq(3));
+
+    file.close();
+    EXPECT_THAT(mpt::load(file_name).toStdString(), Eq("0123456789abc"));
+}
+
+TEST_F(FileOpsSubmit, reads_come_up_short_at_the_end_of_the_file)
+{
+    mpt::make_file_with_content(file_name, "0123456789");
+    QFile file{file_name};
+    ASSERT_TRUE(file.open(QIODevice::ReadOnly));
+
+    std::string data(8, ' '), beyond(8, ' ');
+    std::vector<mp::FileOps::IoRequest> requests{{&file, data.data(), 8, 4}, {&file, beyond.data(), 8, 20}};
+
+    EXPECT_TRUE(MP_FILEOPS.submit(requests));
+    EXPECT_THAT(requests[0].result, Eq(6));
+    EXPECT_THAT(data.substr(0, 6), Eq("456789"));
+    EXPECT_THAT(requests[1].result, Eq(0));
+}
+
+TEST_F(FileOpsSubmit, reports_failed_requests_with_their_error)
+{
+    mpt::make_file_with_content(file_name, "0123456789");
+    QFile file{file_name};
+    ASSERT_TRUE(file.open(QIODevice::ReadOnly));
+
+    std::string data(4, ' ');
+    std::vector<mp::FileOps::IoRequest> requests{{&file, data.data(), 4, 0}, {&file, data.data(), 4, 0, true}};
+
+    EXPECT_FALSE(MP_FILEOPS.submit(requests));
+    EXPECT_THAT(requests[0].result, Eq(4));
+    EXPECT_THAT(requests[1].result, Eq(-1));
+    EXPECT_THAT(requests[1].error, Eq(EBADF));
+}
+
+TEST_F(FileOpsSubmit, takes_more_requests_than_fit_in_one_go)
+{
+    const std::string contents(1000, 'x');
+    mpt::make_file_with_content(file_name, contents);
+    QFile file{file_name};
+    ASSERT_TRUE(file.open(QIODevice::ReadOnly));
+
+    std::string data(contents.size(), ' ');
+    std::vector<mp::FileOps::IoRequest> requests;
+    for (auto i = 0; i < 200; ++i)
+        requests.push_back({&file, data.data() + i * 5, 5, i * 5});
+
+    EXPECT_TRUE(MP_FILEOPS.submit(requests));
+    EXPECT_THAT(data, Eq(contents));
+}
@@ -68,6 +68,24 @@ TEST(InstanceStatusString, SUSPENDED_status_returns_Suspended)
     EXPECT_THAT(status_string, Eq("Suspended"));
 }
 
+TEST(InstanceStatusString, WARMING_status_returns_Warming_up)
+{
+    mp::InstanceStatus status;
+    status.set_status(mp::InstanceStatus::WARMING);
+    auto status_string = mp::format::status_string_for(status);
+
+    EXPECT_THAT(status_string, Eq("Warming up"));
+}
+
+TEST(InstanceStatusString, FAILED_status_returns_Failed)
+{
+    mp::InstanceStatus status;
+    status.set_status(mp::InstanceStatus::FAILED);
+    auto status_string = mp::format::status_string_for(status);
+
+    EXPECT_THAT(status_string, Eq("Failed"));
+}
+
 TEST(InstanceStatusString, RESTARTING_status_returns_Restarting)
 {
     mp::InstanceStatus status;
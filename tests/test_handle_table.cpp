@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <multipass/sshfs_mount/handle_table.h>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+
+using namespace testing;
+
+namespace
+{
+struct HandleTable : public Test
+{
+    int* find(const std::string& handle)
+    {
+        return table.find(handle.data(), handle.size());
+    }
+
+    bool remove(const std::string& handle)
+    {
+        return table.remove(handle.data(), handle.size());
+    }
+
+    mp::HandleTable<int> table{'f'};
+};
+} // namespace
+
+TEST_F(HandleTable, finds_what_was_added)
+{
+    const auto first = table.add(std::make_unique<int>(1));
+    const auto second = table.add(std::make_unique<int>(2));
+
+    ASSERT_THAT(find(first), NotNull());
+    ASSERT_THAT(find(second), NotNull());
+    EXPECT_EQ(*find(first), 1);
+    EXPECT_EQ(*find(second), 2);
+    EXPECT_EQ(table.size(), 2u);
+}
+
+TEST_F(HandleTable, handles_have_a_fixed_size)
+{
+    EXPECT_EQ(table.add(std::make_unique<int>(1)).size(), mp::HandleTable<int>::handle_size);
+}
+
+TEST_F(HandleTable, removed_handles_are_not_found)
+{
+    const auto handle = table.add(std::make_unique<int>(1));
+
+    EXPECT_TRUE(remove(handle));
+    EXPECT_THAT(find(handle), IsNull());
+    EXPECT_FALSE(remove(handle));
+    EXPECT_EQ(table.size(), 0u);
+}
+
+TEST_F(HandleTable, reused_slots_do_not_answer_to_stale_handles)
+{
+    const auto stale = table.add(std::make_unique<int>(1));
+    remove(stale);
+
+    const auto fresh = table.add(std::make_unique<int>(2));
+
+    EXPECT_NE(fresh, stale);
+    EXPECT_THAT(find(stale), IsNull());
+    ASSERT_THAT(find(fresh), NotNull());
+    EXPECT_EQ(*find(fresh), 2);
+}
+
+TEST_F(HandleTable, handles_of_another_kind_are_not_found)
+{
+    mp::HandleTable<int> other{'d'};
+    const auto handle = other.add(std::make_unique<int>(1));
+
+    EXPECT_THAT(find(handle), IsNull());
+}
+
+TEST_F(HandleTable, malformed_handles_are_not_found)
+{
+    table.add(std::make_unique<int>(1));
+
+    EXPECT_THAT(find(""), IsNull());
+    EXPECT_THAT(find("f"), IsNull());
+    EXPECT_THAT(table.find(nullptr, mp::HandleTable<int>::handle_size), IsNull());
+    EXPECT_THAT(find(std::string(mp::HandleTable<int>::handle_size, 'f')), IsNull());
+}
+
+TEST_F(HandleTable, clear_forgets_every_handle)
+{
+    const auto first = table.add(std::make_unique<int>(1));
+    const auto second = table.add(std::make_unique<int>(2));
+
+    table.clear();
+
+    EXPECT_THAT(find(first), IsNull());
+    EXPECT_THAT(find(second), IsNull());
+    EXPECT_EQ(table.size(), 0u);
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <src/client/cli/cmd/host_pool.h>
+
+#include <multipass/exceptions/cmd_exceptions.h>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+
+using namespace testing;
+
+namespace
+{
+constexpr auto gigabyte = 1024LL * 1024 * 1024;
+
+mp::cmd::HostCapacity capacity(int free_cores, long long memory_gigabytes, std::vector<std::string> images = {})
+{
+    return {free_cores + 2, 2, memory_gigabytes * gigabyte, 100 * gigabyte, std::move(images)};
+}
+
+struct BestHost : public Test
+{
+    mp::LaunchRequest request;
+};
+} // namespace
+
+TEST_F(BestHost, picks_the_host_with_the_most_memory)
+{
+    EXPECT_EQ(mp::cmd::best_host_for(request, {capacity(4, 2), capacity(4, 8), capacity(4, 4)}), 1u);
+}
+
+TEST_F(BestHost, prefers_hosts_that_have_the_image)
+{
+    request.set_image("focal");
+
+    EXPECT_EQ(mp::cmd::best_host_for(request, {capacity(4, 8), capacity(4, 2, {"focal"})}), 1u);
+}
+
+TEST_F(BestHost, tells_images_of_other_remotes_apart)
+{
+    request.set_image("20.04");
+    request.set_remote_name("daily");
+
+    EXPECT_EQ(mp::cmd::best_host_for(request, {capacity(4, 2, {"20.04"}), capacity(4, 8)}), 1u);
+    EXPECT_EQ(mp::cmd::best_host_for(request, {capacity(4, 2, {"daily:20.04"}), capacity(4, 8)}), 0u);
+}
+
+TEST_F(BestHost, passes_over_hosts_without_room)
+{
+    request.set_num_cores(4);
+    request.set_mem_size("4G");
+
+    EXPECT_EQ(mp::cmd::best_host_for(request, {capacity(2, 16), capacity(8, 2), capacity(4, 6)}), 2u);
+}
+
+TEST_F(BestHost, counts_every_instance_asked_for)
+{
+    request.set_num_cores(2);
+    request.set_count(3);
+
+    EXPECT_EQ(mp::cmd::best_host_for(request, {capacity(4, 16), capacity(6, 8)}), 1u);
+}
+
+TEST_F(BestHost, passes_over_hosts_that_did_not_answer)
+{
+    EXPECT_EQ(mp::cmd::best_host_for(request, {mp::nullopt, capacity(1, 2)}), 1u);
+}
+
+TEST_F(BestHost, finds_none_when_no_host_has_room)
+{
+    request.set_num_cores(16);
+
+    EXPECT_FALSE(mp::cmd::best_host_for(request, {capacity(4, 16), mp::nullopt}));
+}
+
+TEST(HostPool, takes_the_host_off_instance_names)
+{
+    std::string name{"foo@10.0.0.2:50051"};
+
+    EXPECT_EQ(mp::cmd::take_host_from(name), mp::make_optional<std::string>("10.0.0.2:50051"));
+    EXPECT_EQ(name, "foo");
+}
+
+TEST(HostPool, finds_no_host_in_plain_instance_names)
+{
+    std::string name{"foo"};
+
+    EXPECT_FALSE(mp::cmd::take_host_from(name));
+    EXPECT_EQ(name, "foo");
+}
+
+TEST(HostPool, leaves_commands_on_instances_of_the_default_host_alone)
+{
+    google::protobuf::RepeatedPtrField<std::string> names;
+    names.Add("foo");
+    names.Add("bar");
+    std::unique_ptr<mp::cmd::HostPool> pool;
+    grpc::Channel* channel{nullptr};
+    mp::Rpc::Stub* stub{nullptr};
+
+    EXPECT_FALSE(mp::cmd::direct_to_host(names, pool, channel, stub));
+    EXPECT_FALSE(pool);
+    EXPECT_EQ(stub, nullptr);
+    EXPECT_THAT(names, ElementsAre("foo", "bar"));
+}
+
+TEST(HostPool, refuses_instances_on_different_hosts_together)
+{
+    google::protobuf::RepeatedPtrField<std::string> names;
+    names.Add("foo@one-host");
+    names.Add("bar");
+    std::unique_ptr<mp::cmd::HostPool> pool;
+    grpc::Channel* channel{nullptr};
+    mp::Rpc::Stub* stub{nullptr};
+
+    EXPECT_THROW(mp::cmd::direct_to_host(names, pool, channel, stub), mp::ValidationException);
+    EXPECT_FALSE(pool);
+}
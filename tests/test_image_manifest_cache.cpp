@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "src/daemon/image_manifest_cache.h"
+
+#include "file_operations.h"
+#include "temp_dir.h"
+
+#include <QDir>
+#include <QFile>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+
+namespace
+{
+struct ImageManifestCache : public Test
+{
+    mpt::TempDir temp_dir;
+    QString file_name{QDir{temp_dir.path()}.filePath("manifests")};
+    mp::VMImageInfo info{{"xenial", "default"},
+                         "Ubuntu",
+                         "16.04",
+                         "Xenial Xerus",
+                         true,
+                         "server/releases/xenial/release-20170516/ubuntu-16.04-server-cloudimg-amd64-disk1.img",
+                         "",
+                         "",
+                         "8842e7a8adb01c7a30cc702b01a5330a1951b12042816e87efd24b61c5e2239f",
+                         "http://stream/location",
+                         "20170516",
+                         313524224,
+                         true};
+};
+} // namespace
+
+TEST_F(ImageManifestCache, loads_what_it_saved)
+{
+    mp::ImageManifestCache cache{file_name};
+    cache.save({{"release", "Wed, 17 May 2017 03:52:48 +0000", "digest", {info}}, {"daily", "", "", {}}});
+
+    const auto manifests = cache.load();
+
+    ASSERT_EQ(manifests.size(), 2u);
+    EXPECT_EQ(manifests[0].remote, "release");
+    EXPECT_EQ(manifests[0].updated_at, "Wed, 17 May 2017 03:52:48 +0000");
+    EXPECT_EQ(manifests[0].digest, "digest");
+    ASSERT_EQ(manifests[0].products.size(), 1u);
+
+    const auto& product = manifests[0].products.front();
+    EXPECT_EQ(product.aliases, info.aliases);
+    EXPECT_EQ(product.release_title, info.release_title);
+    EXPECT_EQ(product.image_location, info.image_location);
+    EXPECT_EQ(product.id, info.id);
+    EXPECT_EQ(product.stream_location, info.stream_location);
+    EXPECT_EQ(product.version, info.version);
+    EXPECT_EQ(product.size, info.size);
+    EXPECT_TRUE(product.supported);
+    EXPECT_TRUE(product.verify);
+
+    EXPECT_EQ(manifests[1].remote, "daily");
+    EXPECT_TRUE(manifests[1].products.empty());
+}
+
+TEST_F(ImageManifestCache, loads_nothing_without_a_file)
+{
+    EXPECT_TRUE(mp::ImageManifestCache{file_name}.load().empty());
+}
+
+TEST_F(ImageManifestCache, loads_nothing_from_a_damaged_file)
+{
+    mp::ImageManifestCache cache{file_name};
+    cache.save({{"release", "", "", {info, info}}});
+
+    QFile file{file_name};
+    ASSERT_TRUE(file.open(QIODevice::ReadWrite));
+    ASSERT_TRUE(file.resize(file.size() / 2));
+    file.close();
+
+    EXPECT_TRUE(cache.load().empty());
+}
+
+TEST_F(ImageManifestCache, loads_nothing_from_another_format)
+{
+    mpt::make_file_with_content(file_name, "{\"release\": []}");
+
+    EXPECT_TRUE(mp::ImageManifestCache{file_name}.load().empty());
+}
+
+TEST_F(ImageManifestCache, keeps_nothing_without_a_path)
+{
+    mp::ImageManifestCache cache{QString()};
+    cache.save({{"release", "", "", {info}}});
+
+    EXPECT_TRUE(cache.load().empty());
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mock_settings.h"
+#include "mock_url_downloader.h"
+
+#include "src/daemon/image_mirror_selector.h"
+
+#include <multipass/constants.h>
+#include <multipass/exceptions/download_exception.h>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+
+namespace
+{
+constexpr auto origin = "https://cloud-images.ubuntu.com/";
+constexpr auto image = "releases/focal/release/ubuntu-20.04-server-cloudimg-amd64.img";
+constexpr auto megabyte = 1024LL * 1024;
+
+struct ImageMirrorSelector : public Test
+{
+    ImageMirrorSelector()
+    {
+        EXPECT_CALL(mock_settings, get(_)).Times(AnyNumber());
+        EXPECT_CALL(mock_settings, get(Eq(mp::image_mirrors_key)))
+            .WillRepeatedly(Return("http://near.example/ubuntu, http://far.example/ubuntu/"));
+        EXPECT_CALL(downloader, last_modified(_)).WillRepeatedly(Return(QDateTime{}));
+    }
+
+    QUrl at(const QString& base) const
+    {
+        return QUrl{base + image};
+    }
+
+    mpt::MockSettings& mock_settings = mpt::MockSettings::mock_instance();
+    NiceMock<mpt::MockURLDownloader> downloader;
+    mp::ImageMirrorSelector selector{&downloader, origin};
+};
+} // namespace
+
+TEST_F(ImageMirrorSelector, offers_every_mirror_and_the_origin)
+{
+    const auto candidates = selector.candidates_for(at(origin));
+
+    EXPECT_THAT(candidates, UnorderedElementsAre(at(origin), at("http://near.example/ubuntu/"),
+                                                 at("http://far.example/ubuntu/")));
+}
+
+TEST_F(ImageMirrorSelector, leaves_locations_elsewhere_alone)
+{
+    const QUrl elsewhere{"https://cdimage.ubuntu.com/ubuntu-core/appliances/some.img"};
+
+    EXPECT_THAT(selector.candidates_for(elsewhere), ElementsAre(elsewhere));
+}
+
+TEST_F(ImageMirrorSelector, puts_the_fastest_first)
+{
+    selector.candidates_for(at(origin));
+    selector.record_download(at(origin), 100 * megabyte, std::chrono::seconds{10});
+    selector.record_download(at("http://near.example/ubuntu/"), 100 * megabyte, std::chrono::seconds{1});
+    selector.record_download(at("http://far.example/ubuntu/"), 100 * megabyte, std::chrono::seconds{20});
+
+    EXPECT_THAT(selector.candidates_for(at(origin)),
+                ElementsAre(at("http://near.example/ubuntu/"), at(origin), at("http://far.example/ubuntu/")));
+}
+
+TEST_F(ImageMirrorSelector, tries_what_failed_last)
+{
+    selector.candidates_for(at(origin));
+    selector.record_download(at(origin), 100 * megabyte, std::chrono::seconds{10});
+    selector.record_download(at("http://near.example/ubuntu/"), 100 * megabyte, std::chrono::seconds{1});
+    selector.record_download(at("http://far.example/ubuntu/"), 100 * megabyte, std::chrono::seconds{20});
+    selector.record_failure(at("http://near.example/ubuntu/"));
+
+    EXPECT_THAT(selector.candidates_for(at(origin)).back(), Eq(at("http://near.example/ubuntu/")));
+}
+
+TEST_F(ImageMirrorSelector, passes_over_mirrors_that_do_not_answer_probes)
+{
+    EXPECT_CALL(downloader, last_modified(Truly([](const QUrl& url) { return url.host() == "near.example"; })))
+        .WillRepeatedly(Throw(mp::DownloadException{"http://near.example/", "unreachable"}));
+
+    EXPECT_THAT(selector.candidates_for(at(origin)).back(), Eq(at("http://near.example/ubuntu/")));
+}
@@ -16,31 +16,51 @@
  */
 
 #include "src/daemon/default_vm_image_vault.h"
+#include "src/daemon/json_journal.h"
 
 #include "disabling_macros.h"
 #include "extra_assertions.h"
 #include "file_operations.h"
 #include "mock_image_host.h"
+#include "mock_platform.h"
 #include "mock_process_factory.h"
+#include "mock_settings.h"
 #include "path.h"
 #include "stub_url_downloader.h"
 #include "temp_dir.h"
 #include "temp_file.h"
 #include "tracking_url_downloader.h"
+#include "zsync_control_file.h"
 
+#include <multipass/constants.h>
+#include <multipass/disk_image.h>
 #include <multipass/exceptions/aborted_download_exception.h>
 #include <multipass/exceptions/create_image_exception.h>
+#include <multipass/exceptions/download_exception.h>
 #include <multipass/format.h>
 #include <multipass/query.h>
+#include <multipass/rpc/multipass.grpc.pb.h>
 #include <multipass/url_downloader.h>
 #include <multipass/utils.h>
 
+#include <QCryptographicHash>
 #include <QDateTime>
+#include <QFile>
+#include <QJsonObject>
+#include <QPair>
 #include <QThread>
 #include <QUrl>
+#include <QtEndian>
 
 #include <gmock/gmock.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <thread>
+
 namespace mp = multipass;
 namespace mpt = multipass::test;
 
@@ -50,28 +70,17 @@ namespace
 {
 const QDateTime default_last_modified{QDate(2019, 6, 25), QTime(13, 15, 0)};
 
-struct BadURLDownloader : public mp::URLDownloader
+struct BadURLDownloader : public mpt::StubURLDownloader
 {
-    BadURLDownloader() : mp::URLDownloader{std::chrono::seconds(10)}
-    {
-    }
     void download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
                      const mp::ProgressMonitor&) override
     {
         mpt::make_file_with_content(file_name, "Bad hash");
     }
-
-    QByteArray download(const QUrl& url) override
-    {
-        return {};
-    }
 };
 
-struct HttpURLDownloader : public mp::URLDownloader
+struct HttpURLDownloader : public mpt::StubURLDownloader
 {
-    HttpURLDownloader() : mp::URLDownloader{std::chrono::seconds(10)}
-    {
-    }
     void download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
                      const mp::ProgressMonitor&) override
     {
@@ -80,11 +89,6 @@ struct HttpURLDownloader : public mp::URLDownloader
         downloaded_files << file_name;
     }
 
-    QByteArray download(const QUrl& url) override
-    {
-        return {};
-    }
-
     QDateTime last_modified(const QUrl& url) override
     {
         return default_last_modified;
@@ -94,11 +98,8 @@ struct HttpURLDownloader : public mp::URLDownloader
     QStringList downloaded_urls;
 };
 
-struct RunningURLDownloader : public mp::URLDownloader
+struct RunningURLDownloader : public mpt::StubURLDownloader
 {
-    RunningURLDownloader() : mp::URLDownloader{std::chrono::seconds(10)}
-    {
-    }
     void download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
                      const mp::ProgressMonitor&) override
     {
@@ -107,11 +108,118 @@ struct RunningURLDownloader : public mp::URLDownloader
 
         throw mp::AbortedDownloadException("Aborted!");
     }
+};
+
+struct SlowURLDownloader : public mpt::TrackingURLDownloader
+{
+    void download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                     const mp::ProgressMonitor& monitor) override
+    {
+        started = true;
+        while (!release)
+            QThread::yieldCurrentThread();
+
+        // Keep reporting until everyone waiting on the download heard about it
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!progress_relayed && std::chrono::steady_clock::now() < deadline)
+            monitor(download_type, 50);
+
+        TrackingURLDownloader::download_to(url, file_name, size, download_type, monitor);
+    }
+
+    std::atomic_bool started{false};
+    std::atomic_bool release{false};
+    std::atomic_bool progress_relayed{false};
+};
+
+struct OverlapURLDownloader : public mpt::TrackingURLDownloader
+{
+    void download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                     const mp::ProgressMonitor& monitor) override
+    {
+        if (download_type == mp::LaunchProgress::IMAGE)
+        {
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (!kernel_started && std::chrono::steady_clock::now() < deadline)
+                QThread::yieldCurrentThread();
+
+            overlapped = kernel_started.load();
+        }
+        else if (download_type == mp::LaunchProgress::KERNEL)
+        {
+            kernel_started = true;
+        }
+
+        TrackingURLDownloader::download_to(url, file_name, size, download_type, monitor);
+    }
+
+    std::atomic_bool kernel_started{false};
+    std::atomic_bool overlapped{false};
+};
+
+struct PeerURLDownloader : public mpt::TrackingURLDownloader
+{
+    void download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                     const mp::ProgressMonitor& monitor) override
+    {
+        QFile file{file_name};
+        file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+        file.write(url.host() == bad_peer ? "corrupt" : "");
+        downloaded_urls << url.toString();
+        downloaded_files << file_name;
+    }
+
+    QString bad_peer{"bad-peer"};
+};
+
+// Serves an image to start with, then the zsync control file and the byte ranges of the one that updates it
+struct DeltaURLDownloader : public mpt::TrackingURLDownloader
+{
+    DeltaURLDownloader(const QByteArray& old_image, const QByteArray& new_image, int block_size)
+        : TrackingURLDownloader{old_image.toStdString()}, new_image{new_image}, block_size{block_size}
+    {
+    }
 
     QByteArray download(const QUrl& url) override
     {
-        return {};
+        return url.toString().endsWith(".zsync") ? mpt::zsync_control_file_for(new_image, block_size) : QByteArray{};
+    }
+
+    QByteArray download_range(const QUrl& url, qint64 start, qint64 end) override
+    {
+        ranges.emplace_back(start, end);
+        return new_image.mid(start, end - start);
+    }
+
+    const QByteArray new_image;
+    const int block_size;
+    std::vector<std::pair<qint64, qint64>> ranges;
+};
+
+// Fails the downloads from the first mirrors it is asked for, recording where the partial downloads were handed over
+struct MirrorURLDownloader : public mpt::TrackingURLDownloader
+{
+    void download_to(const QUrl& url, const QString& file_name, int64_t size, const int download_type,
+                     const mp::ProgressMonitor& monitor) override
+    {
+        if (failures_left > 0)
+        {
+            --failures_left;
+            failed_urls << url.toString();
+            throw mp::DownloadException{url.toString().toStdString(), "mirror down"};
+        }
+
+        TrackingURLDownloader::download_to(url, file_name, size, download_type, monitor);
     }
+
+    void hand_over_partial_download(const QUrl& from, const QUrl& to, const QString& file_name) override
+    {
+        handed_over << qMakePair(from.toString(), to.toString());
+    }
+
+    int failures_left{1};
+    QStringList failed_urls;
+    QList<QPair<QString, QString>> handed_over;
 };
 
 struct ImageVault : public testing::Test
@@ -180,6 +288,41 @@ TEST_F(ImageVault, downloads_image)
     EXPECT_TRUE(url_downloader.downloaded_urls.contains(host.image.url()));
 }
 
+TEST_F(ImageVault, moves_on_to_the_next_mirror_when_a_download_fails)
+{
+    EXPECT_CALL(mpt::MockSettings::mock_instance(), get(Eq(mp::image_mirrors_key)))
+        .WillRepeatedly(Return("http://one.example/, http://another.example/"));
+    host.mock_bionic_image_info.image_location = "https://cloud-images.ubuntu.com/releases/bionic/bionic.img";
+
+    MirrorURLDownloader mirror_downloader;
+    mp::DefaultVMImageVault vault{hosts, &mirror_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    auto vm_image = vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+
+    ASSERT_THAT(mirror_downloader.failed_urls.size(), Eq(1));
+    ASSERT_THAT(mirror_downloader.downloaded_urls.size(), Eq(1));
+    EXPECT_NE(mirror_downloader.failed_urls.first(), mirror_downloader.downloaded_urls.first());
+    EXPECT_THAT(mirror_downloader.downloaded_urls.first().toStdString(), EndsWith("releases/bionic/bionic.img"));
+    EXPECT_THAT(mirror_downloader.handed_over, ElementsAre(qMakePair(mirror_downloader.failed_urls.first(),
+                                                                     mirror_downloader.downloaded_urls.first())));
+    EXPECT_THAT(vm_image.id, Eq(mpt::default_id));
+}
+
+TEST_F(ImageVault, fails_the_download_once_every_mirror_failed)
+{
+    EXPECT_CALL(mpt::MockSettings::mock_instance(), get(Eq(mp::image_mirrors_key)))
+        .WillRepeatedly(Return("http://one.example/, http://another.example/"));
+    host.mock_bionic_image_info.image_location = "https://cloud-images.ubuntu.com/releases/bionic/bionic.img";
+
+    MirrorURLDownloader mirror_downloader;
+    mirror_downloader.failures_left = 3;
+    mp::DefaultVMImageVault vault{hosts, &mirror_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+
+    EXPECT_ANY_THROW(vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor));
+    EXPECT_THAT(mirror_downloader.failed_urls.size(), Eq(3));
+    EXPECT_THAT(mirror_downloader.handed_over.size(), Eq(2));
+    EXPECT_TRUE(mirror_downloader.downloaded_urls.isEmpty());
+}
+
 TEST_F(ImageVault, returned_image_contains_instance_name)
 {
     mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
@@ -202,6 +345,16 @@ TEST_F(ImageVault, downloads_kernel_and_initrd)
     EXPECT_FALSE(vm_image.initrd_path.isEmpty());
 }
 
+TEST_F(ImageVault, downloads_kernel_and_initrd_alongside_image)
+{
+    OverlapURLDownloader overlap_downloader;
+    mp::DefaultVMImageVault vault{hosts, &overlap_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    vault.fetch_image(mp::FetchType::ImageKernelAndInitrd, default_query, stub_prepare, stub_monitor);
+
+    EXPECT_TRUE(overlap_downloader.overlapped);
+    EXPECT_THAT(overlap_downloader.downloaded_files.size(), Eq(3));
+}
+
 TEST_F(ImageVault, calls_prepare)
 {
     mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
@@ -233,6 +386,598 @@ TEST_F(ImageVault, records_instanced_images)
     EXPECT_THAT(vm_image1.id, Eq(vm_image2.id));
 }
 
+TEST_F(ImageVault, concurrent_fetches_share_download_and_progress)
+{
+    SlowURLDownloader slow_downloader;
+    mp::DefaultVMImageVault vault{hosts, &slow_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+
+    std::atomic_bool joined{false};
+    mp::ProgressMonitor second_monitor{[&](int, int progress) {
+        if (progress == -1)
+            joined = true;
+        else if (progress == 50)
+            slow_downloader.progress_relayed = true;
+        return true;
+    }};
+
+    mp::VMImage first_image, second_image;
+    std::thread first_fetch{
+        [&] { first_image = vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor); }};
+
+    while (!slow_downloader.started)
+        QThread::yieldCurrentThread();
+
+    mp::Query second_query{"second-instance", "xenial", false, "", mp::Query::Type::Alias};
+    std::thread second_fetch{
+        [&] { second_image = vault.fetch_image(mp::FetchType::ImageOnly, second_query, stub_prepare, second_monitor); }};
+
+    while (!joined)
+        QThread::yieldCurrentThread();
+    slow_downloader.release = true;
+
+    first_fetch.join();
+    second_fetch.join();
+
+    EXPECT_THAT(slow_downloader.downloaded_files.size(), Eq(1));
+    EXPECT_TRUE(slow_downloader.progress_relayed);
+    EXPECT_THAT(first_image.id, Eq(second_image.id));
+}
+
+TEST_F(ImageVault, fetches_verified_image_from_peer_first)
+{
+    EXPECT_CALL(mpt::MockSettings::mock_instance(), get(Eq(mp::image_cache_peers_key)))
+        .WillRepeatedly(Return("http://good-peer:8080/images"));
+
+    PeerURLDownloader peer_downloader;
+    mp::DefaultVMImageVault vault{hosts, &peer_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+
+    EXPECT_THAT(peer_downloader.downloaded_urls,
+                ElementsAre(QString("http://good-peer:8080/images/%1").arg(mpt::default_id)));
+}
+
+TEST_F(ImageVault, falls_back_to_upstream_when_peer_image_does_not_verify)
+{
+    EXPECT_CALL(mpt::MockSettings::mock_instance(), get(Eq(mp::image_cache_peers_key)))
+        .WillRepeatedly(Return("http://bad-peer/"));
+
+    PeerURLDownloader peer_downloader;
+    mp::DefaultVMImageVault vault{hosts, &peer_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    auto vm_image = vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+
+    EXPECT_THAT(peer_downloader.downloaded_urls,
+                ElementsAre(QString("http://bad-peer/%1").arg(mpt::default_id), host.image.url()));
+    EXPECT_THAT(vm_image.id, Eq(mpt::default_id));
+}
+
+TEST_F(ImageVault, lazy_boot_launches_off_remote_image_while_it_is_fetched)
+{
+    EXPECT_CALL(mpt::MockSettings::mock_instance(), get(Eq(mp::lazy_boot_key))).WillRepeatedly(Return("true"));
+
+    auto remote_info = host.mock_bionic_image_info;
+    remote_info.image_location = "https://cloud-images.ubuntu.com/xenial/current/xenial-server-cloudimg-amd64.img";
+    remote_info.verify = false;
+    ON_CALL(host, info_for(_)).WillByDefault(Return(remote_info));
+
+    auto mock_factory_scope = mpt::MockProcessFactory::Inject();
+    {
+        mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}, true};
+        auto vm_image = vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+
+        EXPECT_TRUE(vm_image.image_path.contains(QString::fromStdString(instance_name)));
+        EXPECT_THAT(vm_image.id, Eq(remote_info.id.toStdString()));
+    }
+
+    const auto processes = mock_factory_scope->process_list();
+    ASSERT_THAT(processes.size(), Eq(1u));
+    EXPECT_THAT(processes.front().arguments,
+                ElementsAre("create", "-f", "qcow2", "-F", "qcow2", "-b", remote_info.image_location, _));
+    EXPECT_TRUE(url_downloader.downloaded_urls.contains(remote_info.image_location));
+}
+
+TEST_F(ImageVault, lazy_boot_waits_for_the_verified_download_of_images_served_over_plain_http)
+{
+    EXPECT_CALL(mpt::MockSettings::mock_instance(), get(Eq(mp::lazy_boot_key))).WillRepeatedly(Return("true"));
+
+    auto remote_info = host.mock_bionic_image_info;
+    remote_info.image_location = "http://cloud-images.ubuntu.com/xenial/current/xenial-server-cloudimg-amd64.img";
+    remote_info.verify = false;
+    ON_CALL(host, info_for(_)).WillByDefault(Return(remote_info));
+
+    auto mock_factory_scope = mpt::MockProcessFactory::Inject();
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}, true};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+
+    for (const auto& process : mock_factory_scope->process_list())
+        EXPECT_THAT(process.arguments, Not(Contains(remote_info.image_location)));
+}
+
+TEST_F(ImageVault, lazy_boot_is_left_to_backends_that_read_remote_images)
+{
+    EXPECT_CALL(mpt::MockSettings::mock_instance(), get(Eq(mp::lazy_boot_key))).WillRepeatedly(Return("true"));
+
+    auto mock_factory_scope = mpt::MockProcessFactory::Inject();
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+
+    EXPECT_TRUE(mock_factory_scope->process_list().empty());
+}
+
+namespace
+{
+// A qcow2 v2 header, as far as the vault looks into images, followed by the name of the backing file if any
+QByteArray qcow2_header(const QByteArray& backing_file = {})
+{
+    QByteArray header(72, '\0');
+    qToBigEndian<quint32>(0x514649fb, header.data());
+    qToBigEndian<quint32>(2, header.data() + 4);
+    qToBigEndian<quint32>(16, header.data() + 20); // cluster bits
+    if (!backing_file.isEmpty())
+    {
+        qToBigEndian<quint64>(header.size(), header.data() + 8);
+        qToBigEndian<quint32>(backing_file.size(), header.data() + 16);
+        header.append(backing_file);
+    }
+    return header;
+}
+
+struct ImageVaultCompression : public ImageVault
+{
+    ImageVaultCompression()
+    {
+        EXPECT_CALL(mpt::MockSettings::mock_instance(), get(Eq(mp::compress_images_key)))
+            .WillRepeatedly(Return("true"));
+    }
+
+    // Has qemu-img convert write its output, or fail, and leaves the other processes to succeed
+    void fake_qemuimg_convert(bool succeed)
+    {
+        mock_factory_scope->register_callback([succeed](mpt::MockProcess* process) {
+            if (process->arguments().value(0) != "convert")
+                return;
+
+            ON_CALL(*process, execute).WillByDefault([process, succeed](auto) {
+                mp::ProcessState state;
+                state.exit_code = succeed ? 0 : 1;
+                if (succeed)
+                    mpt::make_file_with_content(process->arguments().constLast(), "compressed");
+                return state;
+            });
+            ON_CALL(*process, read_all_standard_error).WillByDefault(Return("Invalid parameter 'compression_type'"));
+        });
+    }
+
+    // Leaves a qcow2 image in the cache, remembering where
+    mp::VMImageVault::PrepareAction qcow2_prepare{[this](const mp::VMImage& source_image) {
+        QFile file{source_image.image_path};
+        EXPECT_TRUE(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        file.write(qcow2_header());
+        cached_image_path = source_image.image_path;
+        return source_image;
+    }};
+
+    std::unique_ptr<mpt::MockProcessFactory::Scope> mock_factory_scope = mpt::MockProcessFactory::Inject();
+    QString cached_image_path;
+};
+} // namespace
+
+TEST_F(ImageVaultCompression, compresses_cached_qcow2_images_with_zstd)
+{
+    fake_qemuimg_convert(true);
+
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, qcow2_prepare, stub_monitor);
+
+    const auto processes = mock_factory_scope->process_list();
+    const auto convert = std::find_if(processes.cbegin(), processes.cend(),
+                                      [](const auto& process) { return process.arguments.value(0) == "convert"; });
+    ASSERT_NE(convert, processes.cend());
+    EXPECT_THAT(convert->arguments, ElementsAre("convert", "-c", "-O", "qcow2", "-o", "compression_type=zstd",
+                                                cached_image_path, cached_image_path + ".compressed"));
+    EXPECT_EQ(mpt::load(cached_image_path), "compressed");
+    EXPECT_FALSE(QFile::exists(cached_image_path + ".compressed"));
+}
+
+TEST_F(ImageVaultCompression, keeps_cached_image_as_it_is_when_qemu_img_cannot_compress_it)
+{
+    fake_qemuimg_convert(false);
+
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, qcow2_prepare, stub_monitor);
+
+    ASSERT_FALSE(cached_image_path.isEmpty());
+    EXPECT_EQ(mpt::load(cached_image_path), qcow2_header());
+    EXPECT_FALSE(QFile::exists(cached_image_path + ".compressed"));
+}
+
+TEST_F(ImageVaultCompression, leaves_images_that_are_not_qcow2_alone)
+{
+    fake_qemuimg_convert(true);
+
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+
+    for (const auto& process : mock_factory_scope->process_list())
+        EXPECT_NE(process.arguments.value(0), "convert");
+}
+
+namespace
+{
+struct ImageVaultLayered : public ImageVault
+{
+    ImageVaultLayered()
+    {
+        // Has qemu-img create write an overlay naming its backing file, unless told to fail for the image
+        mock_factory_scope->register_callback([this](mpt::MockProcess* process) {
+            if (process->arguments().value(0) != "create")
+                return;
+
+            ON_CALL(*process, execute).WillByDefault([this, process](auto) {
+                const auto args = process->arguments();
+                mp::ProcessState state;
+                state.exit_code = overlay_fails(args.constLast()) ? 1 : 0;
+                if (!*state.exit_code)
+                    write_image(args.constLast(), qcow2_header(args.value(6).toUtf8()));
+                return state;
+            });
+        });
+    }
+
+    void write_image(const QString& path, const QByteArray& contents)
+    {
+        QFile file{path};
+        ASSERT_TRUE(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        file.write(contents);
+    }
+
+    // The source instance, with a qcow2 image of its own
+    mp::VMImage fetch_source(mp::DefaultVMImageVault& vault)
+    {
+        auto image = vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+        write_image(image.image_path, qcow2_header());
+        return image;
+    }
+
+    QString backing_file_of(const QString& image_path)
+    {
+        const auto info = mp::disk_image::inspect_qcow2(image_path);
+        return info ? info->backing_file : QString{};
+    }
+
+    QString beside(const QString& image_path, const QString& file_name)
+    {
+        return QFileInfo{image_path}.dir().filePath(file_name);
+    }
+
+    std::unique_ptr<mpt::MockProcessFactory::Scope> mock_factory_scope = mpt::MockProcessFactory::Inject();
+    std::function<bool(const QString&)> overlay_fails = [](const QString&) { return false; };
+};
+} // namespace
+
+TEST_F(ImageVaultLayered, clone_layered_gives_an_overlay_on_a_frozen_base)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    const auto source = fetch_source(vault);
+
+    const auto cloned = vault.clone_layered(instance_name, "copy");
+
+    const auto base = QFileInfo{source.image_path}.fileName() + ".frozen-1";
+    EXPECT_EQ(backing_file_of(source.image_path), base);
+    EXPECT_EQ(mpt::load(beside(source.image_path, base)), qcow2_header());
+
+    EXPECT_TRUE(cloned.image_path.contains("copy"));
+    EXPECT_EQ(backing_file_of(cloned.image_path), base);
+    EXPECT_EQ(mpt::load(beside(cloned.image_path, base)), qcow2_header());
+    EXPECT_TRUE(vault.has_record_for("copy"));
+    EXPECT_EQ(cloned.id, source.id);
+}
+
+TEST_F(ImageVaultLayered, clones_of_a_source_left_alone_share_its_base)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    const auto source = fetch_source(vault);
+
+    const auto first = vault.clone_layered(instance_name, "copy");
+    const auto second = vault.clone_layered(instance_name, "other");
+
+    const auto base = QFileInfo{source.image_path}.fileName() + ".frozen-1";
+    EXPECT_EQ(backing_file_of(source.image_path), base);
+    EXPECT_EQ(backing_file_of(first.image_path), base);
+    EXPECT_EQ(backing_file_of(second.image_path), base);
+    EXPECT_FALSE(QFile::exists(beside(source.image_path, QFileInfo{source.image_path}.fileName() + ".frozen-2")));
+}
+
+TEST_F(ImageVaultLayered, freezes_a_new_base_once_the_source_was_written_to)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    const auto source = fetch_source(vault);
+    vault.clone_layered(instance_name, "copy");
+
+    QFile source_file{source.image_path};
+    ASSERT_TRUE(source_file.open(QIODevice::ReadWrite));
+    source_file.setFileTime(QFileInfo{source.image_path}.lastModified().addSecs(60), QFileDevice::FileModificationTime);
+    source_file.close();
+
+    const auto cloned = vault.clone_layered(instance_name, "other");
+
+    const auto file_name = QFileInfo{source.image_path}.fileName();
+    EXPECT_EQ(backing_file_of(source.image_path), file_name + ".frozen-2");
+    EXPECT_EQ(backing_file_of(cloned.image_path), file_name + ".frozen-2");
+    EXPECT_EQ(backing_file_of(beside(cloned.image_path, file_name + ".frozen-2")), file_name + ".frozen-1");
+    EXPECT_EQ(mpt::load(beside(cloned.image_path, file_name + ".frozen-1")), qcow2_header());
+}
+
+TEST_F(ImageVaultLayered, leaves_nothing_of_a_clone_whose_overlay_cannot_be_created)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    const auto source = fetch_source(vault);
+    overlay_fails = [](const QString& path) { return path.contains("/copy/"); };
+
+    EXPECT_THROW(vault.clone_layered(instance_name, "copy"), std::runtime_error);
+
+    EXPECT_FALSE(vault.has_record_for("copy"));
+    EXPECT_FALSE(QFileInfo::exists(QFileInfo{QFileInfo{source.image_path}.path()}.dir().filePath("copy")));
+}
+
+TEST_F(ImageVaultLayered, restores_a_source_that_cannot_be_frozen)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    const auto source = fetch_source(vault);
+    overlay_fails = [&source](const QString& path) { return path == source.image_path; };
+
+    EXPECT_THROW(vault.clone_layered(instance_name, "copy"), std::runtime_error);
+
+    EXPECT_EQ(mpt::load(source.image_path), qcow2_header());
+    EXPECT_FALSE(QFile::exists(source.image_path + ".frozen-1"));
+    EXPECT_FALSE(vault.has_record_for("copy"));
+}
+
+TEST_F(ImageVaultLayered, clone_layered_refuses_unknown_and_existing_instances)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    fetch_source(vault);
+
+    EXPECT_THROW(vault.clone_layered("nope", "copy"), std::runtime_error);
+    EXPECT_THROW(vault.clone_layered(instance_name, instance_name), std::runtime_error);
+}
+
+TEST_F(ImageVault, evicts_least_recently_used_images_over_cache_size_limit)
+{
+    EXPECT_CALL(mpt::MockSettings::mock_instance(), get(Eq(mp::image_cache_size_key))).WillRepeatedly(Return("10"));
+
+    auto other_info = host.mock_bionic_image_info;
+    other_info.aliases = {"other"};
+    other_info.id = "other-id";
+    other_info.version = "other-version";
+    other_info.verify = false;
+    ON_CALL(host, info_for(Field(&mp::Query::release, StrEq("other")))).WillByDefault(Return(other_info));
+
+    QStringList prepared_paths;
+    auto prepare = [&prepared_paths](const mp::VMImage& source_image) -> mp::VMImage {
+        QFile image_file{source_image.image_path};
+        image_file.open(QIODevice::WriteOnly);
+        image_file.write("8 bytes!");
+        prepared_paths << source_image.image_path;
+        return source_image;
+    };
+
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, prepare, stub_monitor);
+
+    auto other_query = default_query;
+    other_query.name = "other-instance";
+    other_query.release = "other";
+    vault.fetch_image(mp::FetchType::ImageOnly, other_query, prepare, stub_monitor);
+
+    ASSERT_EQ(prepared_paths.size(), 2);
+    EXPECT_FALSE(QFileInfo::exists(prepared_paths[0]));
+    EXPECT_TRUE(QFileInfo::exists(prepared_paths[1]));
+}
+
+TEST_F(ImageVault, moves_images_over_cache_size_limit_to_bulk_storage)
+{
+    mpt::TempDir bulk_dir;
+    EXPECT_CALL(mpt::MockSettings::mock_instance(), get(Eq(mp::image_cache_size_key))).WillRepeatedly(Return("10"));
+    EXPECT_CALL(mpt::MockSettings::mock_instance(), get(Eq(mp::image_bulk_storage_key)))
+        .WillRepeatedly(Return(bulk_dir.path()));
+
+    auto other_info = host.mock_bionic_image_info;
+    other_info.aliases = {"other"};
+    other_info.id = "other-id";
+    other_info.version = "other-version";
+    other_info.verify = false;
+    ON_CALL(host, info_for(Field(&mp::Query::release, StrEq("other")))).WillByDefault(Return(other_info));
+
+    QStringList prepared_paths;
+    auto prepare = [&prepared_paths](const mp::VMImage& source_image) -> mp::VMImage {
+        QFile image_file{source_image.image_path};
+        image_file.open(QIODevice::WriteOnly);
+        image_file.write("8 bytes!");
+        prepared_paths << source_image.image_path;
+        return source_image;
+    };
+
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, prepare, stub_monitor);
+
+    auto other_query = default_query;
+    other_query.name = "other-instance";
+    other_query.release = "other";
+    vault.fetch_image(mp::FetchType::ImageOnly, other_query, prepare, stub_monitor);
+
+    ASSERT_EQ(prepared_paths.size(), 2);
+    for (auto i = 0; i < 500 && QFileInfo::exists(prepared_paths[0]); ++i)
+        QThread::msleep(10);
+
+    const auto moved_path = QDir{QDir{bulk_dir.path()}.filePath(QFileInfo{cache_dir.path()}.fileName())}.filePath(
+        prepared_paths[0].mid(QDir{cache_dir.path()}.filePath("vault").length() + 1));
+    EXPECT_FALSE(QFileInfo::exists(prepared_paths[0]));
+    EXPECT_TRUE(QFileInfo::exists(moved_path));
+    EXPECT_TRUE(QFileInfo::exists(prepared_paths[1]));
+}
+
+TEST_F(ImageVault, moves_images_back_to_fast_storage_when_used_again)
+{
+    mpt::TempDir bulk_dir;
+    EXPECT_CALL(mpt::MockSettings::mock_instance(), get(Eq(mp::image_cache_size_key))).WillRepeatedly(Return("10"));
+    EXPECT_CALL(mpt::MockSettings::mock_instance(), get(Eq(mp::image_bulk_storage_key)))
+        .WillRepeatedly(Return(bulk_dir.path()));
+
+    auto other_info = host.mock_bionic_image_info;
+    other_info.aliases = {"other"};
+    other_info.id = "other-id";
+    other_info.version = "other-version";
+    other_info.verify = false;
+    ON_CALL(host, info_for(Field(&mp::Query::release, StrEq("other")))).WillByDefault(Return(other_info));
+
+    QStringList prepared_paths;
+    auto prepare = [&prepared_paths](const mp::VMImage& source_image) -> mp::VMImage {
+        QFile image_file{source_image.image_path};
+        image_file.open(QIODevice::WriteOnly);
+        image_file.write("8 bytes!");
+        prepared_paths << source_image.image_path;
+        return source_image;
+    };
+
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, prepare, stub_monitor);
+
+    auto other_query = default_query;
+    other_query.name = "other-instance";
+    other_query.release = "other";
+    vault.fetch_image(mp::FetchType::ImageOnly, other_query, prepare, stub_monitor);
+
+    ASSERT_EQ(prepared_paths.size(), 2);
+    for (auto i = 0; i < 500 && QFileInfo::exists(prepared_paths[0]); ++i)
+        QThread::msleep(10);
+    ASSERT_FALSE(QFileInfo::exists(prepared_paths[0]));
+
+    auto again_query = default_query;
+    again_query.name = "another-instance";
+    vault.fetch_image(mp::FetchType::ImageOnly, again_query, prepare, stub_monitor);
+
+    for (auto i = 0; i < 500 && !QFileInfo::exists(prepared_paths[0]); ++i)
+        QThread::msleep(10);
+
+    const auto bulk_path = QDir{QDir{bulk_dir.path()}.filePath(QFileInfo{cache_dir.path()}.fileName())}.filePath(
+        prepared_paths[0].mid(QDir{cache_dir.path()}.filePath("vault").length() + 1));
+    EXPECT_EQ(prepared_paths.size(), 2);
+    EXPECT_EQ(mpt::load(prepared_paths[0]), "8 bytes!");
+    EXPECT_FALSE(QFileInfo::exists(bulk_path));
+}
+
+TEST_F(ImageVault, moves_images_unused_for_days_to_bulk_storage)
+{
+    QString image_path;
+    auto prepare = [&image_path](const mp::VMImage& source_image) -> mp::VMImage {
+        mpt::make_file_with_content(source_image.image_path);
+        image_path = source_image.image_path;
+        return source_image;
+    };
+
+    {
+        mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{14}};
+        vault.fetch_image(mp::FetchType::ImageOnly, default_query, prepare, stub_monitor);
+    }
+
+    // Last used four days ago, past the three an image stays on fast storage for
+    const auto records_path = QDir{cache_dir.path()}.filePath("vault/multipassd-image-records.json");
+    mp::JsonJournal journal{records_path};
+    auto records = journal.records();
+    auto record = records[mpt::default_id].toObject();
+    const auto four_days_ago = std::chrono::system_clock::now() - std::chrono::hours{24 * 4};
+    record["last_accessed"] = static_cast<qint64>(four_days_ago.time_since_epoch().count());
+    records[mpt::default_id] = record;
+    journal.update(records);
+    journal.compact();
+
+    mpt::TempDir bulk_dir;
+    EXPECT_CALL(mpt::MockSettings::mock_instance(), get(Eq(mp::image_bulk_storage_key)))
+        .WillRepeatedly(Return(bulk_dir.path()));
+
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{14}};
+    vault.prune_expired_images();
+
+    ASSERT_FALSE(image_path.isEmpty());
+    for (auto i = 0; i < 500 && QFileInfo::exists(image_path); ++i)
+        QThread::msleep(10);
+
+    const auto moved_path = QDir{QDir{bulk_dir.path()}.filePath(QFileInfo{cache_dir.path()}.fileName())}.filePath(
+        image_path.mid(QDir{cache_dir.path()}.filePath("vault").length() + 1));
+    EXPECT_FALSE(QFileInfo::exists(image_path));
+    EXPECT_TRUE(QFileInfo::exists(moved_path));
+    EXPECT_EQ(QFileInfo{mp::JsonJournal{records_path}.records()[mpt::default_id].toObject()["image"]
+                            .toObject()["path"]
+                            .toString()},
+              QFileInfo{moved_path});
+}
+
+TEST_F(ImageVault, leaves_recently_used_images_on_fast_storage)
+{
+    mpt::TempDir bulk_dir;
+    EXPECT_CALL(mpt::MockSettings::mock_instance(), get(Eq(mp::image_bulk_storage_key)))
+        .WillRepeatedly(Return(bulk_dir.path()));
+
+    QString image_path;
+    auto prepare = [&image_path](const mp::VMImage& source_image) -> mp::VMImage {
+        mpt::make_file_with_content(source_image.image_path);
+        image_path = source_image.image_path;
+        return source_image;
+    };
+
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{14}};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, prepare, stub_monitor);
+    vault.prune_expired_images();
+    QThread::msleep(100);
+
+    ASSERT_FALSE(image_path.isEmpty());
+    EXPECT_TRUE(QFileInfo::exists(image_path));
+}
+
+TEST_F(ImageVault, DISABLE_ON_WINDOWS_AND_MACOS(stores_identical_prepared_images_once))
+{
+    auto other_info = host.mock_bionic_image_info;
+    other_info.aliases = {"other"};
+    other_info.id = "other-id";
+    other_info.version = "other-version";
+    other_info.verify = false;
+    ON_CALL(host, info_for(Field(&mp::Query::release, StrEq("other")))).WillByDefault(Return(other_info));
+
+    QStringList prepared_paths;
+    auto prepare = [&prepared_paths](const mp::VMImage& source_image) -> mp::VMImage {
+        QFile image_file{source_image.image_path};
+        image_file.open(QIODevice::WriteOnly);
+        image_file.write("same prepared contents");
+        prepared_paths << source_image.image_path;
+        return source_image;
+    };
+
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, prepare, stub_monitor);
+
+    auto other_query = default_query;
+    other_query.name = "other-instance";
+    other_query.release = "other";
+    vault.fetch_image(mp::FetchType::ImageOnly, other_query, prepare, stub_monitor);
+
+    ASSERT_EQ(prepared_paths.size(), 2);
+    ASSERT_NE(prepared_paths[0], prepared_paths[1]);
+
+    // Deduplication runs in the background, after the fetch has returned
+    const auto identity = MP_PLATFORM.file_identity(QFile::encodeName(prepared_paths[0]).constData());
+    EXPECT_FALSE(identity.empty());
+
+    auto other_identity = MP_PLATFORM.file_identity(QFile::encodeName(prepared_paths[1]).constData());
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (other_identity != identity && std::chrono::steady_clock::now() < deadline)
+    {
+        QThread::msleep(10);
+        other_identity = MP_PLATFORM.file_identity(QFile::encodeName(prepared_paths[1]).constData());
+    }
+
+    EXPECT_EQ(other_identity, identity);
+}
+
 TEST_F(ImageVault, caches_prepared_images)
 {
     mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
@@ -273,6 +1018,199 @@ TEST_F(ImageVault, remembers_instance_images)
     EXPECT_THAT(vm_image1.image_path, Eq(vm_image2.image_path));
 }
 
+TEST_F(ImageVault, renamed_instance_image_moves_with_its_record)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    auto vm_image = vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+
+    auto renamed_image = vault.rename(instance_name, "new-name");
+
+    EXPECT_FALSE(vault.has_record_for(instance_name));
+    EXPECT_TRUE(vault.has_record_for("new-name"));
+    EXPECT_FALSE(QFile::exists(vm_image.image_path));
+    EXPECT_TRUE(QFile::exists(renamed_image.image_path));
+    EXPECT_TRUE(renamed_image.image_path.contains("new-name"));
+    EXPECT_EQ(renamed_image.id, vm_image.id);
+}
+
+TEST_F(ImageVault, rename_throws_without_a_record)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+
+    EXPECT_THROW(vault.rename(instance_name, "new-name"), std::runtime_error);
+}
+
+TEST_F(ImageVault, remove_moves_the_instance_image_out_of_the_way_right_away)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    auto vm_image = vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+
+    vault.remove(instance_name);
+
+    EXPECT_FALSE(QFile::exists(vm_image.image_path));
+    EXPECT_FALSE(vault.has_record_for(instance_name));
+}
+
+TEST_F(ImageVault, reclaims_what_a_previous_run_left_behind)
+{
+    const auto leftover_dir = QDir{data_dir.path()}.filePath("vault/reclaim/gone.1234");
+    mpt::make_file_with_content(QDir{leftover_dir}.filePath("image.img"));
+
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+
+    for (auto attempts = 0; attempts < 500 && QFile::exists(leftover_dir); ++attempts)
+        QThread::msleep(10);
+
+    EXPECT_FALSE(QFile::exists(leftover_dir));
+}
+
+TEST_F(ImageVault, marks_ephemeral_instances_rather_than_recording_them)
+{
+    auto query = default_query;
+    query.ephemeral = true;
+
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    auto vm_image = vault.fetch_image(mp::FetchType::ImageOnly, query, stub_prepare, stub_monitor);
+
+    EXPECT_TRUE(QFileInfo{vm_image.image_path}.dir().exists(".ephemeral"));
+
+    mp::DefaultVMImageVault another_vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    EXPECT_FALSE(another_vault.has_record_for(instance_name));
+}
+
+TEST_F(ImageVault, reclaims_ephemeral_instances_a_previous_run_left_behind)
+{
+    auto query = default_query;
+    query.ephemeral = true;
+
+    QString ephemeral_dir;
+    {
+        mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+        ephemeral_dir = QFileInfo{vault.fetch_image(mp::FetchType::ImageOnly, query, stub_prepare, stub_monitor)
+                                      .image_path}
+                            .absolutePath();
+    }
+    ASSERT_TRUE(QFile::exists(ephemeral_dir));
+
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+
+    for (auto attempts = 0; attempts < 500 && QFile::exists(ephemeral_dir); ++attempts)
+        QThread::msleep(10);
+
+    EXPECT_FALSE(QFile::exists(ephemeral_dir));
+}
+
+TEST_F(ImageVault, DISABLE_ON_WINDOWS(reclaiming_leaves_the_data_of_links_alone))
+{
+    // Sparse, but large enough to be shrunk a step at a time if it were the instance's own
+    constexpr qint64 shared_size = 3LL * 1024 * 1024 * 1024;
+    mpt::TempDir shared_dir;
+    const auto linked = QDir{shared_dir.path()}.filePath("linked.img");
+    const auto pointed_at = QDir{shared_dir.path()}.filePath("pointed-at.img");
+    for (const auto& path : {linked, pointed_at})
+    {
+        QFile file{path};
+        ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+        ASSERT_TRUE(file.resize(shared_size));
+    }
+
+    const QDir leftover_dir{QDir{data_dir.path()}.filePath("vault/reclaim/gone.1234")};
+    ASSERT_TRUE(leftover_dir.mkpath("."));
+    std::filesystem::create_hard_link(linked.toStdString(), leftover_dir.filePath("hard.img").toStdString());
+    ASSERT_TRUE(QFile::link(pointed_at, leftover_dir.filePath("soft.img")));
+
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+
+    for (auto attempts = 0; attempts < 500 && leftover_dir.exists(); ++attempts)
+        QThread::msleep(10);
+
+    EXPECT_FALSE(leftover_dir.exists());
+    EXPECT_EQ(QFileInfo{linked}.size(), shared_size);
+    EXPECT_EQ(QFileInfo{pointed_at}.size(), shared_size);
+}
+
+TEST_F(ImageVault, DISABLE_ON_WINDOWS(does_not_reclaim_a_marked_instance_directory_through_a_link))
+{
+    mpt::TempDir elsewhere;
+    const auto kept = QDir{elsewhere.path()}.filePath("image.img");
+    mpt::make_file_with_content(QDir{elsewhere.path()}.filePath(".ephemeral"));
+    mpt::make_file_with_content(kept);
+
+    const auto instances_dir = QDir{data_dir.path()}.filePath("vault/instances");
+    ASSERT_TRUE(QDir{}.mkpath(instances_dir));
+    ASSERT_TRUE(QFile::link(elsewhere.path(), QDir{instances_dir}.filePath("linked")));
+
+    {
+        mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    }
+
+    EXPECT_TRUE(QFile::exists(kept));
+}
+
+TEST_F(ImageVault, baked_image_launches_from_a_copy_of_its_own)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    auto vm_image = vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+
+    auto baked_image = vault.bake(instance_name, "ci");
+    vault.remove(instance_name);
+
+    const mp::Query baked_query{"other", "ci", false, mp::baked_remote_name, mp::Query::Type::Alias};
+    auto launched_image = vault.fetch_image(mp::FetchType::ImageOnly, baked_query, stub_prepare, stub_monitor);
+
+    EXPECT_THAT(url_downloader.downloaded_files.size(), Eq(1));
+    EXPECT_TRUE(QFile::exists(baked_image.image_path));
+    EXPECT_TRUE(QFile::exists(launched_image.image_path));
+    EXPECT_TRUE(launched_image.image_path.contains("other"));
+    EXPECT_EQ(launched_image.id, baked_image.id);
+    EXPECT_EQ(launched_image.original_release, vm_image.original_release);
+}
+
+TEST_F(ImageVault, baked_images_are_neither_expired_nor_updated)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+    auto baked_image = vault.bake(instance_name, "ci");
+
+    vault.prune_expired_images();
+    EXPECT_NO_THROW(vault.update_images(mp::FetchType::ImageOnly, stub_prepare, stub_monitor));
+
+    EXPECT_TRUE(QFile::exists(baked_image.image_path));
+}
+
+TEST_F(ImageVault, launching_an_image_never_baked_throws)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    const mp::Query baked_query{instance_name, "ci", false, mp::baked_remote_name, mp::Query::Type::Alias};
+
+    EXPECT_THROW(vault.fetch_image(mp::FetchType::ImageOnly, baked_query, stub_prepare, stub_monitor),
+                 std::runtime_error);
+    EXPECT_THROW(vault.bake(instance_name, "ci"), std::runtime_error);
+}
+
+TEST_F(ImageVault, clone_gives_an_instance_a_copy_of_its_own)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    auto vm_image = vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+
+    auto cloned_image = vault.clone(instance_name, "copy");
+    vault.remove(instance_name);
+
+    EXPECT_TRUE(vault.has_record_for("copy"));
+    EXPECT_TRUE(QFile::exists(cloned_image.image_path));
+    EXPECT_TRUE(cloned_image.image_path.contains("copy"));
+    EXPECT_EQ(cloned_image.id, vm_image.id);
+}
+
+TEST_F(ImageVault, clone_refuses_unknown_and_existing_instances)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+
+    EXPECT_THROW(vault.clone("nope", "copy"), std::runtime_error);
+    EXPECT_THROW(vault.clone(instance_name, instance_name), std::runtime_error);
+}
+
 TEST_F(ImageVault, remembers_prepared_images)
 {
     int prepare_called_count{0};
@@ -387,6 +1325,32 @@ TEST_F(ImageVault, DISABLE_ON_WINDOWS_AND_MACOS(file_based_fetch_copies_image_an
     EXPECT_EQ(vm_image.id, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
 }
 
+TEST_F(ImageVault, DISABLE_ON_WINDOWS_AND_MACOS(file_based_fetch_reuses_hash_of_unchanged_file))
+{
+    mpt::TempFile file;
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
+    auto query = default_query;
+
+    query.release = file.url().toStdString();
+    query.query_type = mp::Query::Type::LocalFile;
+
+    auto [mock_platform, guard] = mpt::MockPlatform::inject();
+    EXPECT_CALL(*mock_platform, file_identity).WillRepeatedly(Return("unchanged"));
+
+    auto first_image = vault.fetch_image(mp::FetchType::ImageOnly, query, stub_prepare, stub_monitor);
+
+    // Different contents behind the same identity can only be told apart by rehashing
+    QFile image_file{file.name()};
+    ASSERT_TRUE(image_file.open(QIODevice::WriteOnly));
+    image_file.write("new contents");
+    image_file.close();
+
+    query.name = "second-instance";
+    auto second_image = vault.fetch_image(mp::FetchType::ImageOnly, query, stub_prepare, stub_monitor);
+
+    EXPECT_EQ(second_image.id, first_image.id);
+}
+
 TEST_F(ImageVault, invalid_custom_image_file_throws)
 {
     mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{0}};
@@ -509,6 +1473,60 @@ TEST_F(ImageVault, image_update_creates_new_dir_and_removes_old)
     EXPECT_FALSE(QFileInfo::exists(original_absolute_path));
 }
 
+TEST_F(ImageVault, image_update_keeps_last_access_of_replaced_image)
+{
+    mp::DefaultVMImageVault vault{hosts, &url_downloader, cache_dir.path(), data_dir.path(), mp::days{1}};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+
+    const auto records_path = QDir{cache_dir.path()}.filePath("vault/multipassd-image-records.json");
+    auto last_accessed = [&records_path](const QString& id) {
+        return mp::JsonJournal{records_path}.records()[id].toObject()["last_accessed"].toDouble();
+    };
+    const auto original_last_accessed = last_accessed(mpt::default_id);
+
+    const QString new_id{"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b856"};
+    host.mock_bionic_image_info.id = new_id;
+    host.mock_bionic_image_info.version = "20180825";
+    host.mock_bionic_image_info.verify = false;
+
+    QThread::msleep(10);
+    vault.update_images(mp::FetchType::ImageOnly, stub_prepare, stub_monitor);
+
+    EXPECT_EQ(last_accessed(new_id), original_last_accessed);
+}
+
+TEST_F(ImageVault, image_update_downloads_what_the_old_image_lacks_in_bounded_ranges)
+{
+    constexpr auto block_size = 64 * 1024;
+    constexpr auto mib = 1024 * 1024;
+    const QByteArray old_image = QByteArray(4 * mib, 's') + QByteArray(16 * mib, 'o');
+    const QByteArray new_image = QByteArray(4 * mib, 's') + QByteArray(16 * mib, 'n');
+    auto sha256 = [](const QByteArray& data) {
+        return QString{QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex()};
+    };
+
+    host.mock_bionic_image_info.id = sha256(old_image);
+    host.mock_bionic_image_info.size = old_image.size();
+    DeltaURLDownloader delta_downloader{old_image, new_image, block_size};
+    mp::DefaultVMImageVault vault{hosts, &delta_downloader, cache_dir.path(), data_dir.path(), mp::days{1}};
+    vault.fetch_image(mp::FetchType::ImageOnly, default_query, stub_prepare, stub_monitor);
+
+    host.mock_bionic_image_info.id = sha256(new_image);
+    host.mock_bionic_image_info.size = new_image.size();
+    host.mock_bionic_image_info.version = "20180825";
+    vault.update_images(mp::FetchType::ImageOnly, stub_prepare, stub_monitor);
+
+    // Only the image to start with was downloaded whole, and no range is held in memory past 8MiB
+    EXPECT_THAT(delta_downloader.downloaded_urls.size(), Eq(1));
+    EXPECT_THAT(delta_downloader.ranges, ElementsAre(std::make_pair(4LL * mib, 12LL * mib),
+                                                     std::make_pair(12LL * mib, 20LL * mib)));
+
+    const mp::Query another_query{"another-instance", "xenial", false, "", mp::Query::Type::Alias};
+    const auto updated_image = vault.fetch_image(mp::FetchType::ImageOnly, another_query, stub_prepare, stub_monitor);
+    EXPECT_EQ(updated_image.id, sha256(new_image).toStdString());
+    EXPECT_EQ(mpt::load(updated_image.image_path), new_image);
+}
+
 TEST_F(ImageVault, aborted_download_throws)
 {
     RunningURLDownloader running_url_downloader;
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/instrumentation.h>
+
+#include <gmock/gmock.h>
+
+#include <QString>
+
+#include <future>
+#include <thread>
+
+namespace mp = multipass;
+
+using namespace std::chrono_literals;
+using namespace testing;
+
+namespace
+{
+struct Instrumentation : public Test
+{
+    ~Instrumentation()
+    {
+        mp::Instrumentation::reset();
+    }
+
+    mp::Instrumentation& instrumentation{MP_INSTRUMENTATION};
+};
+} // namespace
+
+TEST_F(Instrumentation, renders_nothing_but_eof_before_recording)
+{
+    EXPECT_EQ(instrumentation.openmetrics(), "# EOF\n");
+}
+
+TEST_F(Instrumentation, renders_cumulative_histogram_buckets)
+{
+    instrumentation.observe("op_seconds", "kind=\"a\"", 250ms);
+    instrumentation.observe("op_seconds", "kind=\"a\"", 2s);
+
+    const auto text = instrumentation.openmetrics();
+    EXPECT_THAT(text, HasSubstr("# TYPE op_seconds histogram\n"));
+    EXPECT_THAT(text, HasSubstr("op_seconds_bucket{kind=\"a\",le=\"0.1\"} 0\n"));
+    EXPECT_THAT(text, HasSubstr("op_seconds_bucket{kind=\"a\",le=\"0.5\"} 1\n"));
+    EXPECT_THAT(text, HasSubstr("op_seconds_bucket{kind=\"a\",le=\"1\"} 1\n"));
+    EXPECT_THAT(text, HasSubstr("op_seconds_bucket{kind=\"a\",le=\"5\"} 2\n"));
+    EXPECT_THAT(text, HasSubstr("op_seconds_bucket{kind=\"a\",le=\"+Inf\"} 2\n"));
+    EXPECT_THAT(text, HasSubstr("op_seconds_count{kind=\"a\"} 2\n"));
+    EXPECT_THAT(text, HasSubstr("op_seconds_sum{kind=\"a\"} 2.25\n"));
+}
+
+TEST_F(Instrumentation, counts_slow_observations_only_in_the_last_bucket)
+{
+    instrumentation.observe("op_seconds", {}, 1h);
+
+    const auto text = instrumentation.openmetrics();
+    EXPECT_THAT(text, HasSubstr("op_seconds_bucket{le=\"300\"} 0\n"));
+    EXPECT_THAT(text, HasSubstr("op_seconds_bucket{le=\"+Inf\"} 1\n"));
+    EXPECT_THAT(text, HasSubstr("op_seconds_count 1\n"));
+}
+
+TEST_F(Instrumentation, folds_in_histograms_kept_elsewhere)
+{
+    instrumentation.observe("op_seconds", {}, 250ms);
+
+    std::array<quint64, mp::Instrumentation::buckets.size()> bucket_counts{};
+    bucket_counts[mp::Instrumentation::bucket_of(2ms)] = 3;
+    instrumentation.observe_histogram("op_seconds", {}, bucket_counts, 4, 0.0078125);
+
+    const auto text = instrumentation.openmetrics();
+    EXPECT_THAT(text, HasSubstr("op_seconds_bucket{le=\"0.005\"} 3\n"));
+    EXPECT_THAT(text, HasSubstr("op_seconds_bucket{le=\"0.5\"} 4\n"));
+    EXPECT_THAT(text, HasSubstr("op_seconds_bucket{le=\"+Inf\"} 5\n"));
+    EXPECT_THAT(text, HasSubstr("op_seconds_sum 0.2578125\n"));
+}
+
+TEST_F(Instrumentation, renders_counters_with_total_suffix)
+{
+    instrumentation.add("transferred_bytes", "kind=\"file\"", 10);
+    instrumentation.add("transferred_bytes", "kind=\"file\"", 5);
+
+    const auto text = instrumentation.openmetrics();
+    EXPECT_THAT(text, HasSubstr("# TYPE transferred_bytes counter\n"));
+    EXPECT_THAT(text, HasSubstr("transferred_bytes_total{kind=\"file\"} 15\n"));
+}
+
+TEST_F(Instrumentation, renders_latest_gauge_value)
+{
+    instrumentation.set("saved_bytes", {}, 10);
+    instrumentation.set("saved_bytes", {}, 4);
+
+    const auto text = instrumentation.openmetrics();
+    EXPECT_THAT(text, HasSubstr("# TYPE saved_bytes gauge\n"));
+    EXPECT_THAT(text, HasSubstr("saved_bytes 4\n"));
+}
+
+TEST_F(Instrumentation, scoped_timing_observes_its_lifetime)
+{
+    {
+        mp::ScopedTiming timing{"scope_seconds"};
+        std::this_thread::sleep_for(2ms);
+    }
+
+    const auto text = instrumentation.openmetrics();
+    EXPECT_THAT(text, HasSubstr("scope_seconds_bucket{le=\"0.001\"} 0\n"));
+    EXPECT_THAT(text, HasSubstr("scope_seconds_count 1\n"));
+}
+
+TEST_F(Instrumentation, renders_no_trace_events_before_tracing)
+{
+    EXPECT_EQ(instrumentation.chrome_trace(), "{\"traceEvents\":[]}");
+}
+
+TEST_F(Instrumentation, renders_spans_as_complete_trace_events)
+{
+    const auto start = mp::Instrumentation::Clock::time_point{5ms};
+    instrumentation.trace("cat", "first", start, 2ms);
+    instrumentation.trace("cat", "second", start + 2ms, 1ms);
+
+    EXPECT_EQ(instrumentation.chrome_trace(),
+              "{\"traceEvents\":["
+              "{\"cat\":\"cat\",\"name\":\"first\",\"ph\":\"X\",\"ts\":5000,\"dur\":2000,\"pid\":1,\"tid\":1},"
+              "{\"cat\":\"cat\",\"name\":\"second\",\"ph\":\"X\",\"ts\":7000,\"dur\":1000,\"pid\":1,\"tid\":1}]}");
+}
+
+TEST_F(Instrumentation, keeps_only_the_latest_spans_of_a_thread)
+{
+    const auto spans = mp::Instrumentation::spans_per_thread;
+    for (auto i = 0u; i < spans; ++i)
+        instrumentation.trace("cat", "old", {}, 1ms);
+    instrumentation.trace("cat", "new", {}, 1ms);
+
+    const auto trace = QString::fromStdString(instrumentation.chrome_trace());
+    EXPECT_EQ(trace.count("\"name\":\"old\""), static_cast<int>(spans) - 1);
+    EXPECT_EQ(trace.count("\"name\":\"new\""), 1);
+}
+
+TEST_F(Instrumentation, traces_each_thread_separately)
+{
+    std::promise<void> traced, rendered;
+    std::thread elsewhere{[&traced, rendered = rendered.get_future()] {
+        {
+            mp::TraceSpan span{"cat", "elsewhere"};
+        }
+        traced.set_value();
+        rendered.wait(); // spans go with their thread
+    }};
+    traced.get_future().wait();
+    {
+        mp::TraceSpan span{"cat", "here"};
+    }
+
+    const auto trace = instrumentation.chrome_trace();
+    rendered.set_value();
+    elsewhere.join();
+
+    EXPECT_THAT(trace, HasSubstr("\"name\":\"elsewhere\""));
+    EXPECT_THAT(trace, HasSubstr("\"name\":\"here\""));
+    EXPECT_THAT(trace, HasSubstr("\"tid\":2"));
+}
+
+TEST_F(Instrumentation, drops_the_spans_of_threads_that_finished)
+{
+    for (auto i = 0; i < 100; ++i)
+        std::thread{[] { mp::TraceSpan span{"cat", "gone"}; }}.join();
+    {
+        mp::TraceSpan span{"cat", "here"};
+    }
+
+    const auto trace = instrumentation.chrome_trace();
+    EXPECT_THAT(trace, Not(HasSubstr("\"name\":\"gone\"")));
+    EXPECT_THAT(trace, HasSubstr("\"name\":\"here\""));
+    EXPECT_THAT(trace, HasSubstr("\"tid\":1"));
+}
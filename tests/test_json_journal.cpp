@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "src/daemon/json_journal.h"
+
+#include "file_operations.h"
+#include "temp_dir.h"
+
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+
+namespace
+{
+struct JsonJournal : public Test
+{
+    QJsonObject read_snapshot() const
+    {
+        return QJsonDocument::fromJson(mpt::load(snapshot_path)).object();
+    }
+
+    mpt::TempDir temp_dir;
+    QString snapshot_path{QDir{temp_dir.path()}.filePath("records.json")};
+    QString journal_path{snapshot_path + ".journal"};
+    QJsonObject foo{{"foo", QJsonObject{{"cores", 1}}}};
+    QJsonObject foo_and_bar{{"foo", QJsonObject{{"cores", 1}}}, {"bar", QJsonObject{{"cores", 2}}}};
+};
+} // namespace
+
+TEST_F(JsonJournal, reads_existing_snapshot)
+{
+    mpt::make_file_with_content(snapshot_path, QJsonDocument{foo}.toJson().toStdString());
+
+    EXPECT_EQ(mp::JsonJournal{snapshot_path}.records(), foo);
+}
+
+TEST_F(JsonJournal, replays_updates)
+{
+    {
+        mp::JsonJournal journal{snapshot_path};
+        journal.update(foo_and_bar);
+        journal.update(foo);
+    }
+
+    EXPECT_FALSE(QFile::exists(snapshot_path));
+    EXPECT_EQ(mp::JsonJournal{snapshot_path}.records(), foo);
+}
+
+TEST_F(JsonJournal, appends_only_what_changed)
+{
+    mp::JsonJournal journal{snapshot_path};
+    journal.update(foo);
+    const auto size = QFile{journal_path}.size();
+
+    journal.update(foo_and_bar);
+
+    EXPECT_EQ(mpt::load(journal_path).count('\n'), 2);
+    EXPECT_THAT(mpt::load(journal_path).mid(size).toStdString(), AllOf(HasSubstr("bar"), Not(HasSubstr("foo"))));
+}
+
+TEST_F(JsonJournal, writes_nothing_without_changes)
+{
+    mp::JsonJournal journal{snapshot_path};
+    journal.update(foo);
+    const auto size = QFile{journal_path}.size();
+
+    journal.update(foo);
+
+    EXPECT_EQ(QFile{journal_path}.size(), size);
+}
+
+TEST_F(JsonJournal, compacts_into_snapshot)
+{
+    mp::JsonJournal journal{snapshot_path};
+    journal.update(foo_and_bar);
+
+    journal.compact();
+
+    EXPECT_FALSE(QFile::exists(journal_path));
+    EXPECT_EQ(read_snapshot(), foo_and_bar);
+}
+
+TEST_F(JsonJournal, compacts_when_journal_grows_too_long)
+{
+    mp::JsonJournal journal{snapshot_path, 2};
+    journal.update(foo);
+    journal.update(foo_and_bar);
+
+    journal.update(QJsonObject{});
+
+    EXPECT_FALSE(QFile::exists(journal_path));
+    EXPECT_EQ(read_snapshot(), QJsonObject{});
+}
+
+TEST_F(JsonJournal, ignores_and_compacts_torn_entry)
+{
+    {
+        mp::JsonJournal journal{snapshot_path};
+        journal.update(foo);
+    }
+    QFile journal_file{journal_path};
+    ASSERT_TRUE(journal_file.open(QIODevice::WriteOnly | QIODevice::Append));
+    journal_file.write("{\"key\": \"bar\", \"val");
+    journal_file.close();
+
+    EXPECT_EQ(mp::JsonJournal{snapshot_path}.records(), foo);
+    EXPECT_FALSE(QFile::exists(journal_path));
+    EXPECT_EQ(read_snapshot(), foo);
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "src/daemon/json_writer.h"
+
+#include "file_operations.h"
+#include "temp_dir.h"
+
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+
+namespace
+{
+struct JsonWriter : public TestWithParam<mp::WriteDurability>
+{
+    QJsonObject read_back() const
+    {
+        return QJsonDocument::fromJson(mpt::load(file_name)).object();
+    }
+
+    mpt::TempDir temp_dir;
+    QString file_name{QDir{temp_dir.path()}.filePath("records.json")};
+    QJsonObject root{{"foo", "bar"}};
+};
+} // namespace
+
+TEST_P(JsonWriter, writes_new_file)
+{
+    mp::write_json(root, file_name, GetParam());
+
+    EXPECT_EQ(read_back(), root);
+}
+
+TEST_P(JsonWriter, replaces_existing_contents)
+{
+    mpt::make_file_with_content(file_name, "{\"some\": \"older and much longer contents than the new ones\"}");
+
+    mp::write_json(root, file_name, GetParam());
+
+    EXPECT_EQ(read_back(), root);
+}
+
+TEST_P(JsonWriter, keeps_permissions_of_existing_file)
+{
+    mpt::make_file_with_content(file_name, "{}");
+    QFile::setPermissions(file_name, QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup);
+    const auto permissions = QFile::permissions(file_name);
+
+    mp::write_json(root, file_name, GetParam());
+
+    EXPECT_EQ(QFile::permissions(file_name), permissions);
+}
+
+TEST_P(JsonWriter, leaves_no_temporary_files_behind)
+{
+    mp::write_json(root, file_name, GetParam());
+
+    EXPECT_THAT(QDir{temp_dir.path()}.entryList(QDir::Files), ElementsAre("records.json"));
+}
+
+TEST_P(JsonWriter, does_nothing_when_directory_is_missing)
+{
+    const auto missing_dir_file = QDir{temp_dir.path()}.filePath("missing/records.json");
+
+    EXPECT_NO_THROW(mp::write_json(root, missing_dir_file, GetParam()));
+    EXPECT_FALSE(QFile::exists(missing_dir_file));
+}
+
+INSTANTIATE_TEST_SUITE_P(JsonWriter, JsonWriter,
+                         Values(mp::WriteDurability::relaxed, mp::WriteDurability::synced));
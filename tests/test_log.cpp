@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mock_logger.h"
+
+#include <multipass/logging/log.h>
+
+#include <gmock/gmock.h>
+
+namespace mpl = multipass::logging;
+namespace mpt = multipass::test;
+
+using namespace testing;
+
+TEST(Log, log_limited_formats_admitted_messages)
+{
+    auto logger_scope = mpt::MockLogger::inject();
+    logger_scope.mock_logger->expect_log(mpl::Level::error, "bad handle 3 in read");
+
+    mpl::log_limited(mpl::Level::error, "log-test-format", "bad handle {} in {}", 3, "read");
+}
+
+TEST(Log, log_limited_suppresses_repeats_beyond_a_burst)
+{
+    auto logger_scope = mpt::MockLogger::inject();
+    logger_scope.mock_logger->expect_log(mpl::Level::warning, "flooding", Exactly(100));
+
+    for (auto i = 0; i < 1000; ++i)
+        mpl::log_limited(mpl::Level::warning, "log-test-burst", "flooding {}", i);
+}
+
+TEST(Log, log_limited_counts_formats_separately)
+{
+    auto logger_scope = mpt::MockLogger::inject();
+    logger_scope.mock_logger->expect_log(mpl::Level::warning, "first", Exactly(100));
+    logger_scope.mock_logger->expect_log(mpl::Level::warning, "second", Exactly(1));
+
+    for (auto i = 0; i < 200; ++i)
+        mpl::log_limited(mpl::Level::warning, "log-test-separate", "first {}", i);
+    mpl::log_limited(mpl::Level::warning, "log-test-separate", "second {}", 0);
+}
+
+TEST(Log, log_limited_tracks_a_bounded_number_of_kinds)
+{
+    auto logger_scope = mpt::MockLogger::inject(mpl::Level::warning);
+    EXPECT_CALL(*logger_scope.mock_logger, log).Times(AnyNumber());
+
+    // Categories made up at runtime, as after instance names, must not grow the tracking without end
+    for (auto i = 0; i < 5000; ++i)
+        mpl::log_limited(mpl::Level::warning, fmt::format("log-test-kind-{}", i), "message {}", i);
+
+    EXPECT_LE(mpl::limited_kinds(), 1024u);
+}
@@ -22,6 +22,8 @@
 #include "temp_file.h"
 
 #include <QDateTime>
+#include <QDir>
+#include <QFile>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -157,3 +159,28 @@ TEST_F(MetricsProvider, opt_out_denied_valid)
         EXPECT_THAT(denied["denied"].toInt(), Eq(1));
     }
 }
+
+TEST_F(MetricsProvider, sends_metrics_saved_by_previous_runs)
+{
+    QFile legacy_file{QDir(metrics_dir.path()).filePath("saved_metrics.json")};
+    ASSERT_TRUE(legacy_file.open(QIODevice::WriteOnly));
+    legacy_file.write(R"([{"denied":1}])");
+    legacy_file.close();
+
+    QFile journal{QDir(metrics_dir.path()).filePath("pending_metrics.jsonl")};
+    ASSERT_TRUE(journal.open(QIODevice::WriteOnly));
+    journal.write("{\"denied\":2}\n{\"den"); // the last line was cut short
+    journal.close();
+
+    mp::MetricsProvider metrics_provider{metrics_file.url(), mp::utils::make_uuid(), metrics_dir.path()};
+
+    wait_for_metrics();
+
+    QFile file{metrics_file.name()};
+    file.open(QIODevice::ReadOnly);
+    auto metric_batches = QJsonDocument::fromJson(file.readAll()).array();
+
+    ASSERT_THAT(metric_batches.size(), Eq(2));
+    EXPECT_THAT(metric_batches[0].toObject()["denied"].toInt(), Eq(1));
+    EXPECT_THAT(metric_batches[1].toObject()["denied"].toInt(), Eq(2));
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mock_logger.h"
+
+#include <multipass/logging/log.h>
+#include <multipass/logging/multiplexing_logger.h>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpl = multipass::logging;
+namespace mpt = multipass::test;
+
+using namespace testing;
+
+namespace
+{
+class CountingLogger : public mpl::Logger
+{
+public:
+    CountingLogger(mpl::Level level) : mpl::Logger{level}
+    {
+    }
+
+    void log(mpl::Level, mpl::CString, mpl::CString) const override
+    {
+        ++count;
+    }
+
+    mutable int count{0};
+};
+
+TEST(MultiplexingLogger, is_enabled_only_up_to_the_system_logger_level)
+{
+    mpl::MultiplexingLogger logger{std::make_unique<CountingLogger>(mpl::Level::info)};
+
+    EXPECT_TRUE(logger.enabled_for(mpl::Level::error));
+    EXPECT_TRUE(logger.enabled_for(mpl::Level::info));
+    EXPECT_FALSE(logger.enabled_for(mpl::Level::debug));
+}
+
+TEST(MultiplexingLogger, follows_the_most_verbose_registered_logger)
+{
+    mpl::MultiplexingLogger logger{std::make_unique<CountingLogger>(mpl::Level::warning)};
+    CountingLogger client{mpl::Level::trace};
+
+    logger.add_logger(&client);
+    EXPECT_TRUE(logger.enabled_for(mpl::Level::trace));
+
+    logger.remove_logger(&client);
+    EXPECT_FALSE(logger.enabled_for(mpl::Level::info));
+}
+
+TEST(MultiplexingLogger, dispatches_only_to_loggers_that_take_the_level)
+{
+    auto system_logger = std::make_unique<CountingLogger>(mpl::Level::error);
+    const auto& system_count = system_logger->count;
+    mpl::MultiplexingLogger logger{std::move(system_logger)};
+    CountingLogger client{mpl::Level::debug};
+    logger.add_logger(&client);
+
+    logger.log(mpl::Level::debug, "test", "msg");
+    logger.log(mpl::Level::trace, "test", "msg");
+    logger.log(mpl::Level::error, "test", "msg");
+
+    EXPECT_EQ(system_count, 1);
+    EXPECT_EQ(client.count, 2);
+}
+
+TEST(MultiplexingLogger, is_enabled_for_everything_with_a_mock_logger_registered)
+{
+    mpl::MultiplexingLogger logger{std::make_unique<CountingLogger>(mpl::Level::error)};
+    auto guard = mpt::MockLogger::inject();
+
+    logger.add_logger(guard.mock_logger.get());
+    EXPECT_TRUE(logger.enabled_for(mpl::Level::trace));
+    logger.remove_logger(guard.mock_logger.get());
+}
+
+TEST(Log, is_enabled_as_far_as_the_global_logger_is)
+{
+    auto logger = std::make_shared<CountingLogger>(mpl::Level::info);
+    mpl::set_logger(logger);
+
+    EXPECT_TRUE(mpl::enabled(mpl::Level::info));
+    EXPECT_FALSE(mpl::enabled(mpl::Level::debug));
+
+    mpl::log(mpl::Level::debug, "test", "msg");
+    EXPECT_EQ(logger->count, 0);
+
+    mpl::set_logger(nullptr);
+}
+} // namespace
@@ -1079,6 +1079,66 @@ INSTANTIATE_TEST_SUITE_P(FindOutputFormatter, FormatterSuite, ValuesIn(find_form
 INSTANTIATE_TEST_SUITE_P(NonOrderableNetworksOutputFormatter, FormatterSuite,
                          ValuesIn(non_orderable_networks_formatter_outputs), print_param_name);
 
+TEST(OutputFormatter, info_shows_the_io_limits_that_are_set)
+{
+    auto reply = construct_single_instance_info_reply();
+    auto limits = reply.mutable_info(0)->mutable_io_limits();
+    limits->set_disk_iops(500);
+    limits->set_disk_iops_burst(1000);
+    limits->set_network_bytes_per_second(1048576);
+
+    EXPECT_THAT(mp::TableFormatter().format(reply),
+                HasSubstr("I/O limits:     disk 500 IOPS (burst 1000), network 1.0M/s\n"));
+    EXPECT_THAT(mp::JsonFormatter().format(reply), HasSubstr("\"network_bytes_per_second\": 1048576"));
+    EXPECT_THAT(mp::YamlFormatter().format(reply), HasSubstr("disk_iops_burst: 1000"));
+}
+
+TEST(OutputFormatter, info_leaves_out_io_limits_that_were_never_set)
+{
+    const auto reply = construct_single_instance_info_reply();
+
+    EXPECT_THAT(mp::TableFormatter().format(reply), Not(HasSubstr("I/O limits:")));
+    EXPECT_THAT(mp::JsonFormatter().format(reply), Not(HasSubstr("io_limits")));
+    EXPECT_THAT(mp::YamlFormatter().format(reply), Not(HasSubstr("io_limits")));
+}
+
+TEST(OutputFormatter, info_shows_the_usage_history)
+{
+    auto reply = construct_single_instance_info_reply();
+    auto point = reply.mutable_info(0)->add_usage_history();
+    point->set_timestamp(1600000000);
+    point->set_cpu_cores(0.5);
+    point->set_memory_used(1048576);
+    point->set_disk_used(2147483648);
+    point->set_net_rx_rate(1024);
+    point->set_net_tx_rate(-1); // unknown
+
+    const auto table = mp::TableFormatter().format(reply);
+    EXPECT_THAT(table, HasSubstr("Usage history:  Time              CPU     Memory    Disk      Net in    Net out\n"));
+    EXPECT_THAT(table, HasSubstr("0.50    1.0M      2.0G      1.0K/s    --\n"));
+
+    const auto json = mp::JsonFormatter().format(reply);
+    EXPECT_THAT(json, HasSubstr("\"usage_history\": ["));
+    EXPECT_THAT(json, HasSubstr("\"timestamp\": 1600000000"));
+    EXPECT_THAT(json, HasSubstr("\"cpu_cores\": 0.5"));
+    EXPECT_THAT(json, HasSubstr("\"disk_used\": 2147483648"));
+
+    const auto yaml = mp::YamlFormatter().format(reply);
+    EXPECT_THAT(yaml, HasSubstr("usage_history:"));
+    EXPECT_THAT(yaml, HasSubstr("timestamp: 1600000000"));
+    EXPECT_THAT(yaml, HasSubstr("memory_used: 1048576"));
+    EXPECT_THAT(yaml, HasSubstr("net_tx_rate: -1"));
+}
+
+TEST(OutputFormatter, info_leaves_out_a_usage_history_that_was_not_asked_for)
+{
+    const auto reply = construct_single_instance_info_reply();
+
+    EXPECT_THAT(mp::TableFormatter().format(reply), Not(HasSubstr("Usage history:")));
+    EXPECT_THAT(mp::JsonFormatter().format(reply), Not(HasSubstr("usage_history")));
+    EXPECT_THAT(mp::YamlFormatter().format(reply), Not(HasSubstr("usage_history")));
+}
+
 #if GTEST_HAS_POSIX_RE
 TEST_P(PetenvFormatterSuite, pet_env_first_in_output)
 {
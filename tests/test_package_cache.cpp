@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "local_sockets.h"
+#include "temp_dir.h"
+
+#include "src/daemon/package_cache.h"
+
+#include <multipass/format.h>
+
+#include <gmock/gmock.h>
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+using namespace testing;
+
+namespace
+{
+const auto loopback = std::string{"127.0.0.1"};
+
+std::string read_request(int fd)
+{
+    std::string data;
+    char byte;
+    while (data.find("\r\n\r\n") == std::string::npos && ::read(fd, &byte, 1) == 1)
+        data += byte;
+    return data;
+}
+
+// Stands in for an archive mirror, answering every request with the same body
+struct Mirror
+{
+    Mirror() : fd{mpt::listen_on_any_port(port)}
+    {
+        thread = std::thread{[this] {
+            for (int client; (client = ::accept(fd, nullptr, nullptr)) >= 0;)
+            {
+                last_request = read_request(client);
+                ++requests;
+                mpt::write_all(client,
+                               fmt::format("HTTP/1.1 200 OK\r\nContent-Length: {}\r\n\r\n{}", body.size(), body));
+                ::close(client);
+            }
+        }};
+    }
+
+    ~Mirror()
+    {
+        ::shutdown(fd, SHUT_RDWR);
+        thread.join();
+        ::close(fd);
+    }
+
+    const std::string body = std::string(1024 * 1024, 'p');
+    int port;
+    int fd;
+    std::atomic_int requests{0};
+    std::string last_request;
+    std::thread thread;
+};
+
+struct PackageCache : public Test
+{
+    PackageCache()
+    {
+        policy.upstream_port = mirror.port;
+        policy.private_upstreams = true; // the mirror is on loopback
+    }
+
+    std::string request(const std::string& method, const std::string& host, int port, const std::string& path)
+    {
+        const auto client = mpt::connect_to_port(proxy_port);
+        if (client < 0)
+            return {};
+
+        mpt::write_all(client, fmt::format("{} http://{}:{}{} HTTP/1.1\r\nProxy-Connection: keep-alive\r\n\r\n",
+                                           method, host, port, path));
+        const auto response = mpt::read_all(client);
+        ::close(client);
+
+        return response;
+    }
+
+    std::string get(const std::string& path)
+    {
+        return request("GET", loopback, mirror.port, path);
+    }
+
+    static std::string body_of(const std::string& response)
+    {
+        const auto end = response.find("\r\n\r\n");
+        return end == std::string::npos ? std::string{} : response.substr(end + 4);
+    }
+
+    mpt::TempDir cache_dir;
+    Mirror mirror;
+    const int proxy_port = mpt::free_port();
+    mp::PackageCachePolicy policy;
+};
+} // namespace
+
+TEST_F(PackageCache, serves_packages_again_from_cache)
+{
+    mp::PackageCache cache{cache_dir.path().toStdString(), loopback, proxy_port, policy};
+
+    EXPECT_EQ(body_of(get("/pool/main/h/hello/hello_2.10_amd64.deb")), mirror.body);
+    EXPECT_EQ(body_of(get("/pool/main/h/hello/hello_2.10_amd64.deb")), mirror.body);
+    EXPECT_EQ(mirror.requests, 1);
+}
+
+TEST_F(PackageCache, passes_everything_else_through)
+{
+    mp::PackageCache cache{cache_dir.path().toStdString(), loopback, proxy_port, policy};
+
+    EXPECT_EQ(body_of(get("/dists/focal/InRelease")), mirror.body);
+    EXPECT_EQ(body_of(get("/dists/focal/InRelease")), mirror.body);
+    EXPECT_EQ(mirror.requests, 2);
+}
+
+TEST_F(PackageCache, forwards_origin_form_requests)
+{
+    mp::PackageCache cache{cache_dir.path().toStdString(), loopback, proxy_port, policy};
+    get("/dists/focal/InRelease");
+
+    EXPECT_THAT(mirror.last_request, StartsWith("GET /dists/focal/InRelease HTTP/1.1\r\n"));
+    EXPECT_THAT(mirror.last_request, HasSubstr(fmt::format("Host: {}:{}\r\n", loopback, mirror.port)));
+    EXPECT_THAT(mirror.last_request, HasSubstr("Connection: close\r\n"));
+    EXPECT_THAT(mirror.last_request, Not(HasSubstr("Proxy-Connection")));
+}
+
+TEST_F(PackageCache, turns_tunnels_away)
+{
+    mp::PackageCache cache{cache_dir.path().toStdString(), loopback, proxy_port, policy};
+
+    const auto client = mpt::connect_to_port(proxy_port);
+    ASSERT_GE(client, 0);
+    mpt::write_all(client, "CONNECT archive.ubuntu.com:443 HTTP/1.1\r\n\r\n");
+
+    EXPECT_THAT(mpt::read_all(client), StartsWith("HTTP/1.1 501"));
+    ::close(client);
+    EXPECT_EQ(mirror.requests, 0);
+}
+
+TEST_F(PackageCache, drops_stale_packages_on_start)
+{
+    const auto stale = cache_dir.path().toStdString() + "/stale";
+    const auto fresh = cache_dir.path().toStdString() + "/fresh";
+    std::ofstream{stale} << "old";
+    std::ofstream{fresh} << "new";
+
+    const timespec long_ago[] = {{0, 0}, {0, 0}};
+    ASSERT_EQ(::utimensat(AT_FDCWD, stale.c_str(), long_ago, 0), 0);
+
+    mp::PackageCache cache{cache_dir.path().toStdString(), loopback, proxy_port, policy};
+
+    EXPECT_NE(::access(stale.c_str(), F_OK), 0);
+    EXPECT_EQ(::access(fresh.c_str(), F_OK), 0);
+}
+
+TEST_F(PackageCache, proxy_address_names_host_and_port)
+{
+    mp::PackageCache cache{cache_dir.path().toStdString(), loopback, proxy_port, policy};
+
+    EXPECT_EQ(cache.proxy_address(), fmt::format("{}:{}", loopback, proxy_port));
+}
+
+TEST_F(PackageCache, turns_away_requests_other_than_fetches)
+{
+    mp::PackageCache cache{cache_dir.path().toStdString(), loopback, proxy_port, policy};
+
+    EXPECT_THAT(request("POST", loopback, mirror.port, "/dists/focal/InRelease"), StartsWith("HTTP/1.1 405"));
+    EXPECT_THAT(request("DELETE", loopback, mirror.port, "/pool/main/h/hello/hello_2.10_amd64.deb"),
+                StartsWith("HTTP/1.1 405"));
+    EXPECT_EQ(mirror.requests, 0);
+}
+
+TEST_F(PackageCache, lets_head_requests_through)
+{
+    mp::PackageCache cache{cache_dir.path().toStdString(), loopback, proxy_port, policy};
+
+    EXPECT_THAT(request("HEAD", loopback, mirror.port, "/dists/focal/InRelease"), StartsWith("HTTP/1.1 200"));
+    EXPECT_THAT(mirror.last_request, StartsWith("HEAD /dists/focal/InRelease HTTP/1.1\r\n"));
+}
+
+TEST_F(PackageCache, turns_away_ports_other_than_http)
+{
+    mp::PackageCache cache{cache_dir.path().toStdString(), loopback, proxy_port, mp::PackageCachePolicy{}};
+
+    EXPECT_THAT(get("/dists/focal/InRelease"), StartsWith("HTTP/1.1 403"));
+    EXPECT_EQ(mirror.requests, 0);
+}
+
+TEST_F(PackageCache, turns_away_hosts_off_the_internet)
+{
+    policy.private_upstreams = false;
+    mp::PackageCache cache{cache_dir.path().toStdString(), loopback, proxy_port, policy};
+
+    EXPECT_THAT(get("/dists/focal/InRelease"), StartsWith("HTTP/1.1 403"));
+    EXPECT_THAT(request("GET", "localhost", mirror.port, "/dists/focal/InRelease"), StartsWith("HTTP/1.1 403"));
+    EXPECT_EQ(mirror.requests, 0);
+}
+
+TEST_F(PackageCache, drops_packages_served_longest_ago_past_max_size)
+{
+    policy.max_size = mirror.body.size() * 3 / 2;
+    mp::PackageCache cache{cache_dir.path().toStdString(), loopback, proxy_port, policy};
+
+    get("/pool/main/h/hello/hello_2.10_amd64.deb");
+    get("/pool/main/h/hello/hello_2.11_amd64.deb");
+    ASSERT_EQ(mirror.requests, 2);
+
+    get("/pool/main/h/hello/hello_2.11_amd64.deb"); // kept
+    EXPECT_EQ(mirror.requests, 2);
+    get("/pool/main/h/hello/hello_2.10_amd64.deb"); // dropped
+    EXPECT_EQ(mirror.requests, 3);
+}
+
+TEST_F(PackageCache, trims_cache_to_max_size_on_start)
+{
+    const auto old = cache_dir.path().toStdString() + "/old";
+    const auto recent = cache_dir.path().toStdString() + "/recent";
+    std::ofstream{old} << std::string(1024, 'o');
+    std::ofstream{recent} << std::string(1024, 'r');
+
+    const auto an_hour_ago = ::time(nullptr) - 3600;
+    const timespec served[] = {{an_hour_ago, 0}, {an_hour_ago, 0}};
+    ASSERT_EQ(::utimensat(AT_FDCWD, old.c_str(), served, 0), 0);
+
+    policy.max_size = 1024;
+    mp::PackageCache cache{cache_dir.path().toStdString(), loopback, proxy_port, policy};
+
+    EXPECT_NE(::access(old.c_str(), F_OK), 0);
+    EXPECT_EQ(::access(recent.c_str(), F_OK), 0);
+}
+
+TEST(PublicAddresses, are_told_apart_from_the_host_and_private_networks)
+{
+    const auto is_public = [](const std::string& ip) {
+        sockaddr_storage storage{};
+        auto ipv4 = reinterpret_cast<sockaddr_in*>(&storage);
+        auto ipv6 = reinterpret_cast<sockaddr_in6*>(&storage);
+        if (::inet_pton(AF_INET, ip.c_str(), &ipv4->sin_addr) == 1)
+            ipv4->sin_family = AF_INET;
+        else if (::inet_pton(AF_INET6, ip.c_str(), &ipv6->sin6_addr) == 1)
+            ipv6->sin6_family = AF_INET6;
+
+        return mp::is_public_address(reinterpret_cast<const sockaddr*>(&storage));
+    };
+
+    for (const auto ip : {"91.189.91.38", "8.8.8.8", "2620:2d:4000:1::16", "::ffff:91.189.91.38"})
+        EXPECT_TRUE(is_public(ip)) << ip;
+
+    for (const auto ip : {"127.0.0.1", "10.1.2.3", "172.16.0.1", "172.31.255.255", "192.168.64.1", "169.254.169.254",
+                          "100.64.0.1", "0.0.0.0", "224.0.0.1", "255.255.255.255", "::1", "::", "fe80::1",
+                          "fd00::1", "ff02::1", "::ffff:127.0.0.1", "::ffff:169.254.169.254"})
+        EXPECT_FALSE(is_public(ip)) << ip;
+}
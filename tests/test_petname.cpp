@@ -22,6 +22,7 @@
 #include <gmock/gmock.h>
 
 #include <regex>
+#include <stdexcept>
 #include <string>
 #include <unordered_set>
 #include <vector>
@@ -96,3 +97,44 @@ TEST(Petname, can_generate_at_least_hundred_unique_names)
 
     EXPECT_THAT(name_set.size(), Ge(expected_num_unique_names));
 }
+
+TEST(Petname, unique_name_skips_taken_names)
+{
+    mp::Petname name_generator{mp::Petname::NumWords::TWO, "-"};
+    const auto taken = name_generator.make_name();
+
+    for (auto i = 0; i < 100; ++i)
+        EXPECT_NE(name_generator.make_unique_name([&taken](const std::string& name) { return name == taken; }), taken);
+}
+
+TEST(Petname, unique_name_finds_the_last_free_name)
+{
+    mp::Petname name_generator{mp::Petname::NumWords::ONE, "-"};
+    std::unordered_set<std::string> taken;
+    const auto is_taken = [&taken](const std::string& name) { return taken.count(name) > 0; };
+
+    // Take all names but one, then expect that one every time
+    std::string last;
+    try
+    {
+        while (true)
+        {
+            last = name_generator.make_unique_name(is_taken);
+            taken.insert(last);
+        }
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+
+    ASSERT_THAT(taken.size(), Ge(100u));
+    taken.erase(last);
+    EXPECT_EQ(name_generator.make_unique_name(is_taken), last);
+}
+
+TEST(Petname, unique_name_throws_when_all_names_are_taken)
+{
+    mp::Petname name_generator{mp::Petname::NumWords::ONE, "-"};
+
+    EXPECT_THROW(name_generator.make_unique_name([](const std::string&) { return true; }), std::runtime_error);
+}
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "local_sockets.h"
+
+#include "src/daemon/port_forwarder.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace
+{
+const auto loopback = std::string{"127.0.0.1"};
+
+std::future<std::string> ready(const std::string& address)
+{
+    std::promise<std::string> promise;
+    promise.set_value(address);
+    return promise.get_future();
+}
+
+struct PortForwarder : public Test
+{
+    mp::PortForwarder forwarder;
+    mpt::EchoServer server;
+    const int host_port = mpt::free_port();
+    const mp::PortForwarder::AddressLookup running = [] { return ready(loopback); };
+};
+} // namespace
+
+TEST_F(PortForwarder, relays_both_ways)
+{
+    forwarder.add("foo", loopback, host_port, server.port, running);
+
+    std::string data(4 * 1024 * 1024, '\0');
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<char>(i * 7);
+
+    const auto client = mpt::connect_to_port(host_port);
+    ASSERT_GE(client, 0);
+    std::thread writer{[client, &data] {
+        mpt::write_all(client, data);
+        ::shutdown(client, SHUT_WR);
+    }};
+
+    const auto echoed = mpt::read_all(client);
+    writer.join();
+    ::close(client);
+
+    EXPECT_EQ(echoed, data);
+}
+
+TEST_F(PortForwarder, turns_connections_away_while_instance_is_unreachable)
+{
+    forwarder.add("foo", loopback, host_port, server.port, [] { return ready(""); });
+
+    const auto client = mpt::connect_to_port(host_port);
+    ASSERT_GE(client, 0);
+    char byte;
+
+    EXPECT_EQ(::read(client, &byte, 1), 0);
+    ::close(client);
+}
+
+TEST_F(PortForwarder, turns_connections_away_when_address_never_comes)
+{
+    forwarder.add("foo", loopback, host_port, server.port, [] { return std::promise<std::string>{}.get_future(); });
+
+    const auto client = mpt::connect_to_port(host_port);
+    ASSERT_GE(client, 0);
+    char byte;
+
+    EXPECT_EQ(::read(client, &byte, 1), 0); // the promise is broken as it goes
+    ::close(client);
+}
+
+TEST_F(PortForwarder, stops_waiting_for_address_when_removed)
+{
+    std::promise<void> looked_up;
+    std::promise<std::string> address; // never answered
+    forwarder.add("foo", loopback, host_port, server.port, [&looked_up, &address] {
+        looked_up.set_value();
+        return address.get_future();
+    });
+
+    const auto client = mpt::connect_to_port(host_port);
+    ASSERT_GE(client, 0);
+    looked_up.get_future().wait();
+
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(forwarder.remove("foo", loopback, host_port));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 5s);
+
+    char byte;
+    EXPECT_EQ(::read(client, &byte, 1), 0);
+    ::close(client);
+}
+
+TEST_F(PortForwarder, throws_on_address_and_port_forwarded_already)
+{
+    forwarder.add("foo", loopback, host_port, server.port, running);
+
+    EXPECT_THROW(forwarder.add("bar", loopback, host_port, server.port, running), std::runtime_error);
+}
+
+TEST_F(PortForwarder, forwards_same_port_on_different_addresses)
+{
+    forwarder.add("foo", loopback, host_port, server.port, running);
+    EXPECT_NO_THROW(forwarder.add("bar", "127.0.0.2", host_port, server.port, running));
+
+    EXPECT_TRUE(forwarder.remove("bar", "127.0.0.2", host_port));
+    const auto client = mpt::connect_to_port(host_port);
+    EXPECT_GE(client, 0);
+    ::close(client);
+}
+
+TEST_F(PortForwarder, throws_on_port_in_use)
+{
+    EXPECT_THROW(forwarder.add("foo", loopback, server.port, server.port, running), std::runtime_error);
+}
+
+TEST_F(PortForwarder, remove_frees_host_port)
+{
+    forwarder.add("foo", loopback, host_port, server.port, running);
+
+    EXPECT_FALSE(forwarder.remove("bar", loopback, host_port));
+    EXPECT_FALSE(forwarder.remove("foo", "127.0.0.2", host_port));
+    EXPECT_TRUE(forwarder.remove("foo", loopback, host_port));
+    EXPECT_EQ(mpt::connect_to_port(host_port), -1);
+}
+
+TEST_F(PortForwarder, remove_without_address_frees_port_on_every_address)
+{
+    forwarder.add("foo", loopback, host_port, server.port, running);
+    forwarder.add("foo", "127.0.0.2", host_port, server.port, running);
+
+    EXPECT_TRUE(forwarder.remove("foo", "", host_port));
+    EXPECT_FALSE(forwarder.remove("foo", "127.0.0.2", host_port));
+    EXPECT_EQ(mpt::connect_to_port(host_port), -1);
+}
+
+TEST_F(PortForwarder, remove_all_leaves_other_instances_alone)
+{
+    const auto other_port = mpt::free_port();
+    forwarder.add("foo", loopback, host_port, server.port, running);
+    forwarder.add("bar", loopback, other_port, server.port, running);
+
+    forwarder.remove_all("foo");
+
+    EXPECT_FALSE(forwarder.remove("foo", loopback, host_port));
+    EXPECT_TRUE(forwarder.remove("bar", loopback, other_port));
+}
+
+TEST_F(PortForwarder, counts_connections_while_they_are_handled)
+{
+    std::promise<void> looked_up;
+    std::promise<std::string> address;
+    forwarder.add("foo", loopback, host_port, server.port, [&looked_up, &address] {
+        looked_up.set_value();
+        return address.get_future();
+    });
+
+    const auto client = mpt::connect_to_port(host_port);
+    ASSERT_GE(client, 0);
+    looked_up.get_future().wait();
+
+    EXPECT_EQ(forwarder.active_connections("foo"), 1);
+    EXPECT_EQ(forwarder.active_connections("bar"), 0);
+
+    address.set_value("");
+    char byte;
+    EXPECT_EQ(::read(client, &byte, 1), 0);
+    ::close(client);
+}
+
+TEST_F(PortForwarder, turns_connections_away_past_the_limit)
+{
+    mp::PortForwarder limited{1};
+    std::promise<void> looked_up;
+    std::promise<std::string> address;
+    limited.add("foo", loopback, host_port, server.port, [&looked_up, &address] {
+        looked_up.set_value();
+        return address.get_future();
+    });
+
+    const auto first = mpt::connect_to_port(host_port);
+    ASSERT_GE(first, 0);
+    looked_up.get_future().wait();
+
+    const auto second = mpt::connect_to_port(host_port);
+    ASSERT_GE(second, 0);
+    char byte;
+    EXPECT_EQ(::read(second, &byte, 1), 0);
+    EXPECT_EQ(limited.active_connections("foo"), 1);
+
+    address.set_value("");
+    EXPECT_EQ(::read(first, &byte, 1), 0);
+    ::close(first);
+    ::close(second);
+}
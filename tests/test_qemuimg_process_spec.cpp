@@ -108,6 +108,23 @@ TEST(TestQemuImgProcessSpec, apparmor_profile_running_as_snap_with_only_target_c
     EXPECT_TRUE(spec.apparmor_profile().contains(QString("%1 rwk,").arg(target_image)));
 }
 
+TEST(TestQemuImgProcessSpec, apparmor_profile_with_remote_source_allows_network)
+{
+    const QByteArray snap_name{"multipass"};
+    QTemporaryDir snap_dir;
+    QString source_image{"https://cloud-images.ubuntu.com/image.img"}, target_image{"/target/image/file"};
+
+    mpt::SetEnvScope e("SNAP", snap_dir.path().toUtf8());
+    mpt::SetEnvScope e2("SNAP_NAME", snap_name);
+    mp::QemuImgProcessSpec spec({}, source_image, target_image);
+
+    EXPECT_TRUE(spec.apparmor_profile().contains("network inet stream,"));
+    EXPECT_TRUE(spec.apparmor_profile().contains("#include <abstractions/nameservice>"));
+    EXPECT_TRUE(spec.apparmor_profile().contains("#include <abstractions/ssl_certs>"));
+    EXPECT_FALSE(spec.apparmor_profile().contains(QString("%1 rk,").arg(source_image)));
+    EXPECT_TRUE(spec.apparmor_profile().contains(QString("%1 rwk,").arg(target_image)));
+}
+
 TEST(TestQemuImgProcessSpec,
      DISABLE_ON_WINDOWS(apparmor_profile_running_as_symlinked_snap_correct)) // TODO tests involving apparmor should
                                                                              // probably be moved elsewhere
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "temp_dir.h"
+
+#include <src/client/cli/cmd/response_cache.h>
+
+#include <multipass/rpc/multipass.grpc.pb.h>
+
+#include <QDir>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+using namespace testing;
+
+namespace
+{
+struct ResponseCache : public Test
+{
+    ResponseCache()
+    {
+        request.set_search_string("focal");
+        reply.add_images_info()->set_release("20.04 LTS");
+    }
+
+    mp::cmd::ResponseCache cache_for(const std::string& server_address = "unix:/run/multipass_socket")
+    {
+        return {QDir{temp_dir.path()}.filePath("cache/response-cache.json"), server_address};
+    }
+
+    mpt::TempDir temp_dir;
+    mp::FindRequest request;
+    mp::FindReply reply;
+};
+} // namespace
+
+TEST_F(ResponseCache, answers_with_stored_reply)
+{
+    cache_for().store(request, reply, 60);
+
+    mp::FindReply cached;
+    ASSERT_TRUE(cache_for().load(request, cached));
+    ASSERT_EQ(cached.images_info_size(), 1);
+    EXPECT_EQ(cached.images_info(0).release(), "20.04 LTS");
+}
+
+TEST_F(ResponseCache, does_not_keep_replies_without_ttl)
+{
+    cache_for().store(request, reply, 0);
+
+    mp::FindReply cached;
+    EXPECT_FALSE(cache_for().load(request, cached));
+}
+
+TEST_F(ResponseCache, does_not_answer_with_expired_reply)
+{
+    cache_for().store(request, reply, -1);
+
+    mp::FindReply cached;
+    EXPECT_FALSE(cache_for().load(request, cached));
+}
+
+TEST_F(ResponseCache, tells_requests_apart)
+{
+    cache_for().store(request, reply, 60);
+
+    auto other_request = request;
+    other_request.set_search_string("bionic");
+
+    mp::FindReply cached;
+    EXPECT_FALSE(cache_for().load(other_request, cached));
+}
+
+TEST_F(ResponseCache, ignores_verbosity)
+{
+    cache_for().store(request, reply, 60);
+
+    auto verbose_request = request;
+    verbose_request.set_verbosity_level(3);
+    verbose_request.set_partial_replies(true);
+
+    mp::FindReply cached;
+    EXPECT_TRUE(cache_for().load(verbose_request, cached));
+}
+
+TEST_F(ResponseCache, tells_daemons_apart)
+{
+    cache_for().store(request, reply, 60);
+
+    mp::FindReply cached;
+    EXPECT_FALSE(cache_for("localhost:50051").load(request, cached));
+}
+
+TEST_F(ResponseCache, leaves_out_update_notice)
+{
+    mp::VersionRequest version_request;
+    mp::VersionReply version_reply;
+    version_reply.set_version("1.8.0");
+    version_reply.mutable_update_info()->set_version("1.9.0");
+    cache_for().store(version_request, version_reply, 60);
+
+    mp::VersionReply cached;
+    ASSERT_TRUE(cache_for().load(version_request, cached));
+    EXPECT_EQ(cached.version(), "1.8.0");
+    EXPECT_FALSE(cached.has_update_info());
+}
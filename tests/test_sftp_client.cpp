@@ -15,9 +15,11 @@
  *
  */
 
+#include "extra_assertions.h"
 #include "file_operations.h"
 #include "mock_sftp.h"
 #include "mock_ssh.h"
+#include "mock_ssh_process_exit_status.h"
 #include "path.h"
 #include "temp_dir.h"
 
@@ -26,6 +28,18 @@
 
 #include <gmock/gmock.h>
 
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include <sys/time.h>
+
 namespace mp = multipass;
 namespace mpt = multipass::test;
 
@@ -36,6 +50,81 @@ sftp_file get_dummy_sftp_file()
     return static_cast<sftp_file_struct*>(calloc(1, sizeof(struct sftp_file_struct)));
 }
 
+std::uint32_t read_u32(const std::string& buffer, std::size_t pos)
+{
+    std::uint32_t value = 0;
+    for (auto i = pos; i < pos + 4; ++i)
+        value = (value << 8) | static_cast<std::uint8_t>(buffer.at(i));
+    return value;
+}
+
+void append_u32(std::string& buffer, std::uint32_t value)
+{
+    for (auto shift : {24, 16, 8, 0})
+        buffer.push_back(static_cast<char>((value >> shift) & 0xff));
+}
+
+sftp_attributes make_remote_attributes(const std::string& name, uint8_t type)
+{
+    auto attributes = static_cast<sftp_attributes>(std::calloc(1, sizeof(struct sftp_attributes_struct)));
+    attributes->name = strdup(name.c_str());
+    attributes->type = type;
+    attributes->flags = SSH_FILEXFER_ATTR_PERMISSIONS | SSH_FILEXFER_ATTR_ACMODTIME;
+    attributes->permissions = type == SSH_FILEXFER_TYPE_DIRECTORY ? 0750 : 0640;
+    attributes->atime = attributes->mtime = type == SSH_FILEXFER_TYPE_DIRECTORY ? 1500000000 : 1600000000;
+    return attributes;
+}
+
+// Stands in for the server end of the sftp channel, taking in SSH_FXP_WRITE packets and answering each with a status
+struct FakeWriteServer
+{
+    int write(const void* data, uint32_t size)
+    {
+        incoming.append(static_cast<const char*>(data), size);
+        while (incoming.size() >= 4 && incoming.size() >= 4 + read_u32(incoming, 0))
+        {
+            auto length = read_u32(incoming, 0);
+            auto id = read_u32(incoming, 5);
+            auto handle_size = read_u32(incoming, 9);
+            auto offset = uint64_t{read_u32(incoming, 9 + 4 + handle_size)} << 32 |
+                          read_u32(incoming, 9 + 4 + handle_size + 4);
+            auto data_size = read_u32(incoming, 9 + 4 + handle_size + 8);
+            offsets.push_back(offset);
+            received.append(incoming, 9 + 4 + handle_size + 8 + 4, data_size);
+            incoming.erase(0, 4 + length);
+
+            std::string status;
+            append_u32(status, 1 + 4 + 4 + 4);
+            status.push_back(101);
+            append_u32(status, id);
+            append_u32(status, id == failing_id ? 4 : 0);
+            append_u32(status, 0);
+            replies.append(status);
+
+            max_outstanding = std::max(max_outstanding, ++outstanding);
+        }
+
+        return size;
+    }
+
+    int read(void* data, uint32_t size)
+    {
+        size = std::min<uint32_t>(size, replies.size());
+        std::memcpy(data, replies.data(), size);
+        replies.erase(0, size);
+        // a status is 17 bytes, collected as its length and then the rest
+        if (size > 4)
+            --outstanding;
+
+        return size > 0 ? static_cast<int>(size) : SSH_ERROR;
+    }
+
+    std::string incoming, received, replies;
+    std::vector<uint64_t> offsets;
+    std::uint32_t failing_id{0};
+    std::size_t outstanding{0}, max_outstanding{0};
+};
+
 struct SFTPClient : public testing::Test
 {
     SFTPClient()
@@ -53,9 +142,9 @@ struct SFTPClient : public testing::Test
         close.returnValue(SSH_OK);
     }
 
-    mp::SFTPClient make_sftp_client()
+    mp::SFTPClient make_sftp_client(std::size_t transfer_window = mp::SFTPClient::default_transfer_window)
     {
-        return {std::make_unique<mp::SSHSession>("b", 43)};
+        return {std::make_unique<mp::SSHSession>("b", 43), transfer_window};
     }
 
     decltype(MOCK(ssh_connect)) connect{MOCK(ssh_connect)};
@@ -122,16 +211,68 @@ TEST_F(SFTPClient, push_throws_on_sftp_write_error)
         file->sftp = session;
         return file;
     });
-    REPLACE(sftp_write, [](sftp_file file, auto...) {
-        file->sftp->errnum = SSH_ERROR;
-        return -1;
-    });
+    REPLACE(ssh_channel_write, [](auto...) { return SSH_ERROR; });
 
     auto sftp = make_sftp_client();
 
     EXPECT_THROW(sftp.push_file(file_name.toStdString(), "bar"), std::runtime_error);
 }
 
+TEST_F(SFTPClient, push_pipelines_writes_within_the_transfer_window)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    const std::string content(5 * 65536 + 42, 'x');
+    mpt::make_file_with_content(file_name, content);
+
+    FakeWriteServer server;
+    REPLACE(sftp_init, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_open, [](sftp_session session, auto...) {
+        sftp_file file = get_dummy_sftp_file();
+        file->sftp = session;
+        return file;
+    });
+    REPLACE(ssh_channel_write, [&server](ssh_channel, const void* data, uint32_t size) {
+        return server.write(data, size);
+    });
+    REPLACE(ssh_channel_read_timeout, [&server](ssh_channel, void* data, uint32_t size, auto...) {
+        return server.read(data, size);
+    });
+
+    auto sftp = make_sftp_client(3);
+
+    EXPECT_NO_THROW(sftp.push_file(file_name.toStdString(), "bar"));
+    EXPECT_EQ(server.received, content);
+    EXPECT_EQ(server.max_outstanding, 3u);
+    EXPECT_EQ(server.outstanding, 0u);
+}
+
+TEST_F(SFTPClient, push_throws_on_failed_write_status)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    mpt::make_file_with_content(file_name, std::string(4 * 65536, 'x'));
+
+    FakeWriteServer server;
+    server.failing_id = 2;
+    REPLACE(sftp_init, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_open, [](sftp_session session, auto...) {
+        sftp_file file = get_dummy_sftp_file();
+        file->sftp = session;
+        return file;
+    });
+    REPLACE(ssh_channel_write, [&server](ssh_channel, const void* data, uint32_t size) {
+        return server.write(data, size);
+    });
+    REPLACE(ssh_channel_read_timeout, [&server](ssh_channel, void* data, uint32_t size, auto...) {
+        return server.read(data, size);
+    });
+
+    auto sftp = make_sftp_client(2);
+
+    EXPECT_THROW(sftp.push_file(file_name.toStdString(), "bar"), std::runtime_error);
+}
+
 TEST_F(SFTPClient, pull_throws_on_sftp_open_failed)
 {
     const std::string source_path{"foo"};
@@ -157,7 +298,8 @@ TEST_F(SFTPClient, pull_throws_on_sftp_read_failed)
         file->sftp = session;
         return file;
     });
-    REPLACE(sftp_read, [](sftp_file file, auto...) {
+    REPLACE(sftp_async_read_begin, [](auto...) { return 1; });
+    REPLACE(sftp_async_read, [](sftp_file file, auto...) {
         file->sftp->errnum = SSH_ERROR;
         return -1;
     });
@@ -167,6 +309,456 @@ TEST_F(SFTPClient, pull_throws_on_sftp_read_failed)
     EXPECT_THROW(sftp.pull_file(source_path, "bar"), std::runtime_error);
 }
 
+TEST_F(SFTPClient, pull_reads_ahead_within_the_transfer_window)
+{
+    mpt::TempDir temp_dir;
+    auto destination = temp_dir.path() + "/test-file";
+    std::string content(3 * 65536 + 42, 'x');
+    for (auto i = 0u; i < content.size(); i += 1000)
+        content[i] = 'a' + i % 26;
+
+    std::map<int, uint64_t> requests;
+    std::size_t max_outstanding = 0;
+    REPLACE(sftp_init, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_open, [](sftp_session session, auto...) {
+        auto file = get_dummy_sftp_file();
+        file->sftp = session;
+        return file;
+    });
+    REPLACE(sftp_async_read_begin, [&requests, &max_outstanding](sftp_file file, uint32_t len) {
+        auto id = static_cast<int>(++file->sftp->id_counter);
+        requests[id] = file->offset;
+        file->offset += len;
+        max_outstanding = std::max(max_outstanding, requests.size());
+        return id;
+    });
+    REPLACE(sftp_async_read, [&requests, &content](sftp_file file, void* data, uint32_t len, uint32_t id) {
+        auto offset = requests.at(id);
+        requests.erase(id);
+        if (file->eof)
+            return 0;
+
+        // serve the second chunk short, as a server may for any read
+        uint64_t size = 0;
+        if (offset < content.size())
+            size = std::min<uint64_t>(offset == 65536 ? 1000 : len, content.size() - offset);
+        else
+            file->eof = 1;
+
+        std::memcpy(data, content.data() + offset, size);
+        return static_cast<int>(size);
+    });
+
+    auto sftp = make_sftp_client(2);
+
+    EXPECT_NO_THROW(sftp.pull_file("foo", destination.toStdString()));
+    EXPECT_EQ(mpt::load(destination).toStdString(), content);
+    EXPECT_EQ(max_outstanding, 2u);
+}
+
+TEST_F(SFTPClient, sync_pushes_only_the_blocks_that_differ)
+{
+    constexpr auto block_size = 16 * 65536;
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    std::string content(3 * block_size + 10, 'x');
+    mpt::make_file_with_content(file_name, content);
+
+    // the instance holds the first three blocks, with the second of them different
+    std::string signatures;
+    for (auto block = 0; block < 3; ++block)
+    {
+        auto data = QByteArray::fromStdString(content.substr(block * block_size, block_size));
+        if (block == 1)
+            data[0] = 'y';
+        signatures += QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex().toStdString() + "\n";
+    }
+
+    mpt::ExitStatusMock exit_status_mock;
+    FakeWriteServer server;
+    uint64_t truncated_size = 0;
+    std::string command;
+    REPLACE(sftp_init, [](auto...) { return SSH_OK; });
+    REPLACE(ssh_channel_is_closed, [](auto...) { return 0; });
+    REPLACE(ssh_channel_request_exec, [&command](ssh_channel, const char* cmd) {
+        command = cmd;
+        return SSH_OK;
+    });
+    REPLACE(sftp_open, [](sftp_session session, auto...) {
+        sftp_file file = get_dummy_sftp_file();
+        file->sftp = session;
+        return file;
+    });
+    REPLACE(sftp_setstat, [&truncated_size](sftp_session, const char*, sftp_attributes attributes) {
+        truncated_size = attributes->size;
+        return SSH_OK;
+    });
+    REPLACE(ssh_channel_write, [&server](ssh_channel, const void* data, uint32_t size) {
+        return server.write(data, size);
+    });
+    REPLACE(ssh_channel_read_timeout,
+            [&server, &signatures](ssh_channel channel, void* data, uint32_t size, int is_stderr, auto...) {
+                if (channel == nullptr) // the sftp channel of the dummy session
+                    return server.read(data, size);
+
+                size = is_stderr ? 0 : std::min<uint32_t>(size, signatures.size());
+                std::memcpy(data, signatures.data(), size);
+                signatures.erase(0, size);
+                return static_cast<int>(size);
+            });
+
+    auto sftp = make_sftp_client();
+
+    EXPECT_NO_THROW(sftp.sync_file(file_name.toStdString(), "bar"));
+    EXPECT_THAT(command, testing::HasSubstr("python3 -c"));
+    EXPECT_EQ(server.received, std::string(block_size + 10, 'x'));
+    EXPECT_EQ(server.offsets.front(), uint64_t{block_size});
+    EXPECT_EQ(server.offsets.back(), uint64_t{3 * block_size});
+    EXPECT_EQ(truncated_size, content.size());
+}
+
+// testing directory methods
+
+TEST_F(SFTPClient, push_dir_recreates_the_tree_with_its_metadata)
+{
+    mpt::TempDir temp_dir;
+    const auto source = temp_dir.path() + "/tree";
+    ASSERT_TRUE(QDir{}.mkpath(source + "/sub"));
+    mpt::make_file_with_content(source + "/a", "some content");
+    mpt::make_file_with_content(source + "/sub/b", "some content");
+    QFile::setPermissions(source + "/a", QFileDevice::ReadOwner | QFileDevice::WriteOwner | QFileDevice::ReadGroup);
+
+    std::vector<std::string> dirs, files;
+    std::map<std::string, mode_t> modes;
+    FakeWriteServer server;
+    REPLACE(sftp_init, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_stat, [](auto...) { return nullptr; });
+    REPLACE(sftp_mkdir, [&dirs](sftp_session, const char* path, auto...) {
+        dirs.emplace_back(path);
+        return SSH_OK;
+    });
+    REPLACE(sftp_open, [&files](sftp_session session, const char* path, auto...) {
+        files.emplace_back(path);
+        sftp_file file = get_dummy_sftp_file();
+        file->sftp = session;
+        return file;
+    });
+    REPLACE(sftp_chmod, [&modes](sftp_session, const char* path, mode_t mode) {
+        modes[path] = mode;
+        return SSH_OK;
+    });
+    std::map<std::string, long> mtimes;
+    REPLACE(sftp_utimes, [&mtimes](sftp_session, const char* path, const timeval* times) {
+        mtimes[path] = times[1].tv_sec;
+        return SSH_OK;
+    });
+    REPLACE(ssh_channel_write, [&server](ssh_channel, const void* data, uint32_t size) {
+        return server.write(data, size);
+    });
+    REPLACE(ssh_channel_read_timeout, [&server](ssh_channel, void* data, uint32_t size, auto...) {
+        return server.read(data, size);
+    });
+
+    const timeval dir_times[2]{{1500000000, 0}, {1500000000, 0}};
+    for (const auto& dir : {source + "/sub", source})
+        ASSERT_EQ(::utimes(QFile::encodeName(dir).constData(), dir_times), 0);
+
+    auto sftp = make_sftp_client();
+
+    EXPECT_NO_THROW(sftp.push_dir(source.toStdString(), "bar"));
+    EXPECT_THAT(dirs, testing::ElementsAre("bar", "bar/sub"));
+    EXPECT_THAT(files, testing::UnorderedElementsAre("bar/a", "bar/sub/b"));
+    EXPECT_EQ(server.received, "some contentsome content");
+    EXPECT_EQ(modes.at("bar/a"), 0640u);
+    EXPECT_EQ(modes.size(), 4u);
+    EXPECT_EQ(mtimes.at("bar"), 1500000000);
+    EXPECT_EQ(mtimes.at("bar/sub"), 1500000000);
+}
+
+TEST_F(SFTPClient, pull_dir_recreates_the_tree_with_its_metadata)
+{
+    mpt::TempDir temp_dir;
+
+    static const std::map<std::string, std::vector<std::pair<std::string, uint8_t>>> listings{
+        {"foo",
+         {{".", SSH_FILEXFER_TYPE_DIRECTORY}, {"a", SSH_FILEXFER_TYPE_REGULAR}, {"sub", SSH_FILEXFER_TYPE_DIRECTORY}}},
+        {"foo/sub", {{"b", SSH_FILEXFER_TYPE_REGULAR}}}};
+    auto make_attributes = [](const std::string& name, uint8_t type) {
+        auto attributes = static_cast<sftp_attributes>(std::calloc(1, sizeof(struct sftp_attributes_struct)));
+        attributes->name = strdup(name.c_str());
+        attributes->type = type;
+        attributes->flags = SSH_FILEXFER_ATTR_PERMISSIONS | SSH_FILEXFER_ATTR_ACMODTIME;
+        attributes->permissions = type == SSH_FILEXFER_TYPE_DIRECTORY ? 0750 : 0640;
+        attributes->atime = attributes->mtime = type == SSH_FILEXFER_TYPE_DIRECTORY ? 1500000000 : 1600000000;
+        return attributes;
+    };
+
+    std::map<int, uint64_t> requests;
+    REPLACE(sftp_init, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_stat, [&make_attributes](sftp_session, const char* path) {
+        return make_attributes(path, SSH_FILEXFER_TYPE_DIRECTORY);
+    });
+    REPLACE(sftp_opendir, [](sftp_session, const char* path) {
+        auto dir = static_cast<sftp_dir>(std::calloc(1, sizeof(struct sftp_dir_struct)));
+        dir->name = strdup(path);
+        return dir;
+    });
+    REPLACE(sftp_readdir, [&make_attributes](sftp_session, sftp_dir dir) -> sftp_attributes {
+        const auto& listing = listings.at(dir->name);
+        if (dir->count >= listing.size())
+            return nullptr;
+
+        const auto& entry = listing[dir->count++];
+        return make_attributes(entry.first, entry.second);
+    });
+    REPLACE(sftp_dir_eof, [](auto...) { return 1; });
+    REPLACE(sftp_closedir, [](sftp_dir dir) {
+        std::free(dir->name);
+        std::free(dir);
+        return SSH_OK;
+    });
+    REPLACE(sftp_open, [](sftp_session session, auto...) {
+        auto file = get_dummy_sftp_file();
+        file->sftp = session;
+        return file;
+    });
+    REPLACE(sftp_async_read_begin, [&requests](sftp_file file, uint32_t len) {
+        auto id = static_cast<int>(++file->sftp->id_counter);
+        requests[id] = file->offset;
+        file->offset += len;
+        return id;
+    });
+    REPLACE(sftp_async_read, [&requests](sftp_file, void* data, uint32_t, uint32_t id) {
+        auto offset = requests.at(id);
+        requests.erase(id);
+        if (offset > 0)
+            return 0;
+
+        std::memcpy(data, "hello", 5);
+        return 5;
+    });
+
+    auto sftp = make_sftp_client();
+
+    EXPECT_NO_THROW(sftp.pull_dir("foo", temp_dir.path().toStdString()));
+    EXPECT_EQ(mpt::load(temp_dir.path() + "/foo/a"), "hello");
+    EXPECT_EQ(mpt::load(temp_dir.path() + "/foo/sub/b"), "hello");
+    EXPECT_EQ(QFile::permissions(temp_dir.path() + "/foo/a"),
+              QFileDevice::ReadOwner | QFileDevice::ReadUser | QFileDevice::WriteOwner | QFileDevice::WriteUser |
+                  QFileDevice::ReadGroup);
+    EXPECT_EQ(QFileInfo{temp_dir.path() + "/foo/a"}.lastModified().toSecsSinceEpoch(), 1600000000);
+    EXPECT_EQ(QFileInfo{temp_dir.path() + "/foo/sub"}.lastModified().toSecsSinceEpoch(), 1500000000);
+    EXPECT_EQ(QFileInfo{temp_dir.path() + "/foo"}.lastModified().toSecsSinceEpoch(), 1500000000);
+}
+
+// testing copy method
+
+TEST_F(SFTPClient, copy_passes_a_file_on_with_its_metadata)
+{
+    std::vector<std::string> files;
+    std::map<std::string, mode_t> modes;
+    std::map<std::string, long> mtimes;
+    std::map<int, uint64_t> requests;
+    FakeWriteServer server;
+    REPLACE(sftp_init, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_stat, [](sftp_session, const char* path) -> sftp_attributes {
+        return std::string{path} == "foo" ? make_remote_attributes(path, SSH_FILEXFER_TYPE_REGULAR) : nullptr;
+    });
+    REPLACE(sftp_open, [&files](sftp_session session, const char* path, auto...) {
+        files.emplace_back(path);
+        auto file = get_dummy_sftp_file();
+        file->sftp = session;
+        return file;
+    });
+    REPLACE(sftp_async_read_begin, [&requests](sftp_file file, uint32_t len) {
+        auto id = static_cast<int>(++file->sftp->id_counter);
+        requests[id] = file->offset;
+        file->offset += len;
+        return id;
+    });
+    REPLACE(sftp_async_read, [&requests](sftp_file, void* data, uint32_t, uint32_t id) {
+        auto offset = requests.at(id);
+        requests.erase(id);
+        if (offset > 0)
+            return 0;
+
+        std::memcpy(data, "hello", 5);
+        return 5;
+    });
+    REPLACE(ssh_channel_write, [&server](ssh_channel, const void* data, uint32_t size) {
+        return server.write(data, size);
+    });
+    REPLACE(ssh_channel_read_timeout, [&server](ssh_channel, void* data, uint32_t size, auto...) {
+        return server.read(data, size);
+    });
+    REPLACE(sftp_chmod, [&modes](sftp_session, const char* path, mode_t mode) {
+        modes[path] = mode;
+        return SSH_OK;
+    });
+    REPLACE(sftp_utimes, [&mtimes](sftp_session, const char* path, const timeval* times) {
+        mtimes[path] = times[1].tv_sec;
+        return SSH_OK;
+    });
+
+    auto source = make_sftp_client();
+    auto destination = make_sftp_client();
+
+    EXPECT_NO_THROW(source.copy_to(destination, "foo", "bar"));
+    EXPECT_THAT(files, testing::ElementsAre("foo", "bar"));
+    EXPECT_EQ(server.received, "hello");
+    EXPECT_EQ(modes.at("bar"), 0640u);
+    EXPECT_EQ(mtimes.at("bar"), 1600000000);
+}
+
+TEST_F(SFTPClient, copy_recreates_the_tree_without_following_links_to_directories)
+{
+    static const std::map<std::string, std::vector<std::pair<std::string, uint8_t>>> listings{
+        {"foo",
+         {{".", SSH_FILEXFER_TYPE_DIRECTORY},
+          {"a", SSH_FILEXFER_TYPE_REGULAR},
+          {"link", SSH_FILEXFER_TYPE_SYMLINK},
+          {"sub", SSH_FILEXFER_TYPE_DIRECTORY}}},
+        {"foo/sub", {{"b", SSH_FILEXFER_TYPE_REGULAR}}}};
+
+    std::vector<std::string> dirs, files;
+    std::map<std::string, mode_t> modes;
+    std::map<std::string, long> mtimes;
+    std::map<int, uint64_t> requests;
+    FakeWriteServer server;
+    REPLACE(sftp_init, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_stat, [](sftp_session, const char* path) -> sftp_attributes {
+        // nothing is there yet on the destination, and the link leads to a directory
+        return std::string{path}.rfind("bar", 0) == 0 ? nullptr
+                                                      : make_remote_attributes(path, SSH_FILEXFER_TYPE_DIRECTORY);
+    });
+    REPLACE(sftp_mkdir, [&dirs](sftp_session, const char* path, auto...) {
+        dirs.emplace_back(path);
+        return SSH_OK;
+    });
+    REPLACE(sftp_opendir, [](sftp_session, const char* path) {
+        auto dir = static_cast<sftp_dir>(std::calloc(1, sizeof(struct sftp_dir_struct)));
+        dir->name = strdup(path);
+        return dir;
+    });
+    REPLACE(sftp_readdir, [](sftp_session, sftp_dir dir) -> sftp_attributes {
+        const auto& listing = listings.at(dir->name);
+        if (dir->count >= listing.size())
+            return nullptr;
+
+        const auto& entry = listing[dir->count++];
+        return make_remote_attributes(entry.first, entry.second);
+    });
+    REPLACE(sftp_dir_eof, [](auto...) { return 1; });
+    REPLACE(sftp_closedir, [](sftp_dir dir) {
+        std::free(dir->name);
+        std::free(dir);
+        return SSH_OK;
+    });
+    REPLACE(sftp_open, [&files](sftp_session session, const char* path, auto...) {
+        files.emplace_back(path);
+        auto file = get_dummy_sftp_file();
+        file->sftp = session;
+        return file;
+    });
+    REPLACE(sftp_async_read_begin, [&requests](sftp_file file, uint32_t len) {
+        auto id = static_cast<int>(++file->sftp->id_counter);
+        requests[id] = file->offset;
+        file->offset += len;
+        return id;
+    });
+    REPLACE(sftp_async_read, [&requests](sftp_file, void* data, uint32_t, uint32_t id) {
+        auto offset = requests.at(id);
+        requests.erase(id);
+        if (offset > 0)
+            return 0;
+
+        std::memcpy(data, "hello", 5);
+        return 5;
+    });
+    REPLACE(ssh_channel_write, [&server](ssh_channel, const void* data, uint32_t size) {
+        return server.write(data, size);
+    });
+    REPLACE(ssh_channel_read_timeout, [&server](ssh_channel, void* data, uint32_t size, auto...) {
+        return server.read(data, size);
+    });
+    REPLACE(sftp_chmod, [&modes](sftp_session, const char* path, mode_t mode) {
+        modes[path] = mode;
+        return SSH_OK;
+    });
+    REPLACE(sftp_utimes, [&mtimes](sftp_session, const char* path, const timeval* times) {
+        mtimes[path] = times[1].tv_sec;
+        return SSH_OK;
+    });
+
+    auto source = make_sftp_client();
+    auto destination = make_sftp_client();
+
+    EXPECT_NO_THROW(source.copy_to(destination, "foo", "bar", true));
+    EXPECT_THAT(dirs, testing::ElementsAre("bar", "bar/sub"));
+    EXPECT_THAT(files, testing::ElementsAre("foo/a", "bar/a", "foo/sub/b", "bar/sub/b"));
+    EXPECT_EQ(server.received, "hellohello");
+    EXPECT_EQ(modes.at("bar/a"), 0640u);
+    EXPECT_EQ(modes.at("bar/sub"), 0750u);
+    EXPECT_EQ(modes.count("bar/link"), 0u);
+    EXPECT_EQ(mtimes.at("bar/sub/b"), 1600000000);
+    EXPECT_EQ(mtimes.at("bar"), 1500000000);
+}
+
+TEST_F(SFTPClient, copy_refuses_directories_unless_recursive)
+{
+    REPLACE(sftp_init, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_stat, [](sftp_session, const char* path) {
+        return make_remote_attributes(path, SSH_FILEXFER_TYPE_DIRECTORY);
+    });
+
+    auto source = make_sftp_client();
+    auto destination = make_sftp_client();
+
+    MP_EXPECT_THROW_THAT(source.copy_to(destination, "foo", "bar"), std::runtime_error,
+                         mpt::match_what(testing::HasSubstr("is a directory")));
+}
+
+TEST_F(SFTPClient, copy_throws_when_the_destination_fails_to_write)
+{
+    std::string content(8 * 65536, 'x');
+    std::map<int, uint64_t> requests;
+    FakeWriteServer server;
+    server.failing_id = 2;
+    REPLACE(sftp_init, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_stat, [](sftp_session, const char* path) -> sftp_attributes {
+        return std::string{path} == "foo" ? make_remote_attributes(path, SSH_FILEXFER_TYPE_REGULAR) : nullptr;
+    });
+    REPLACE(sftp_open, [](sftp_session session, auto...) {
+        auto file = get_dummy_sftp_file();
+        file->sftp = session;
+        return file;
+    });
+    REPLACE(sftp_async_read_begin, [&requests](sftp_file file, uint32_t len) {
+        auto id = static_cast<int>(++file->sftp->id_counter);
+        requests[id] = file->offset;
+        file->offset += len;
+        return id;
+    });
+    REPLACE(sftp_async_read, [&requests, &content](sftp_file, void* data, uint32_t len, uint32_t id) {
+        auto offset = requests.at(id);
+        requests.erase(id);
+        const auto size = offset < content.size() ? std::min<uint64_t>(len, content.size() - offset) : 0;
+        std::memcpy(data, content.data() + offset, size);
+        return static_cast<int>(size);
+    });
+    REPLACE(ssh_channel_write, [&server](ssh_channel, const void* data, uint32_t size) {
+        return server.write(data, size);
+    });
+    REPLACE(ssh_channel_read_timeout, [&server](ssh_channel, void* data, uint32_t size, auto...) {
+        return server.read(data, size);
+    });
+
+    auto source = make_sftp_client(2);
+    auto destination = make_sftp_client(2);
+
+    EXPECT_THROW(source.copy_to(destination, "foo", "bar"), std::runtime_error);
+}
+
 // testing stream method
 
 TEST_F(SFTPClient, in_steam_throws_on_sftp_open_failed)
@@ -191,10 +783,7 @@ TEST_F(SFTPClient, in_stream_throws_on_write_failed)
         file->sftp = session;
         return file;
     });
-    REPLACE(sftp_write, [](sftp_file file, auto...) {
-        file->sftp->errnum = SSH_ERROR;
-        return -1;
-    });
+    REPLACE(ssh_channel_write, [](auto...) { return SSH_ERROR; });
 
     auto sftp = make_sftp_client();
 
@@ -202,6 +791,33 @@ TEST_F(SFTPClient, in_stream_throws_on_write_failed)
     EXPECT_THROW(sftp.stream_file("bar", fake_cin), std::runtime_error);
 }
 
+TEST_F(SFTPClient, in_stream_pipelines_writes_within_the_transfer_window)
+{
+    const std::string content(5 * 65536 + 42, 'x');
+    std::istringstream fake_cin{content};
+
+    FakeWriteServer server;
+    REPLACE(sftp_init, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_open, [](sftp_session session, auto...) {
+        auto file = get_dummy_sftp_file();
+        file->sftp = session;
+        return file;
+    });
+    REPLACE(ssh_channel_write, [&server](ssh_channel, const void* data, uint32_t size) {
+        return server.write(data, size);
+    });
+    REPLACE(ssh_channel_read_timeout, [&server](ssh_channel, void* data, uint32_t size, auto...) {
+        return server.read(data, size);
+    });
+
+    auto sftp = make_sftp_client(3);
+
+    EXPECT_NO_THROW(sftp.stream_file("bar", fake_cin));
+    EXPECT_EQ(server.received, content);
+    EXPECT_EQ(server.max_outstanding, 3u);
+    EXPECT_EQ(server.outstanding, 0u);
+}
+
 TEST_F(SFTPClient, out_stream_throws_on_sftp_open_failed)
 {
     const std::string source_path{"bar"};
@@ -228,9 +844,9 @@ TEST_F(SFTPClient, out_stream_throws_on_sftp_read_failed)
         file->sftp = session;
         return file;
     });
-    REPLACE(sftp_read, [](sftp_file file, auto...) {
+    REPLACE(sftp_async_read_begin, [](sftp_file file, auto...) {
         file->sftp->errnum = SSH_ERROR;
-        return -1;
+        return SSH_ERROR;
     });
 
     auto sftp = make_sftp_client();
@@ -244,21 +860,26 @@ TEST_F(SFTPClient, out_stream_writes_data_with_nulls)
     using namespace std::string_literals;
 
     REPLACE(sftp_init, [](auto...) { return SSH_OK; });
-    REPLACE(sftp_open, [](auto...) { return nullptr; });
+    REPLACE(sftp_open, [](sftp_session session, auto...) {
+        auto file = get_dummy_sftp_file();
+        file->sftp = session;
+        return file;
+    });
 
     static const auto source_data = "a\0b\0\xab c"s;
     static const auto data_size = source_data.size();
     auto have_read = false;
 
-    REPLACE(sftp_read, [&have_read](sftp_file /*file*/, void* buf, size_t count) -> ssize_t {
+    REPLACE(sftp_async_read_begin, [](sftp_file file, auto...) { return static_cast<int>(++file->sftp->id_counter); });
+    REPLACE(sftp_async_read, [&have_read](sftp_file /*file*/, void* buf, uint32_t count, auto...) {
         EXPECT_GE(count, data_size);
 
         if (have_read)
-            return 0L;
+            return 0;
 
         have_read = true;
         memcpy(buf, source_data.data(), data_size);
-        return data_size;
+        return static_cast<int>(data_size);
     });
 
     auto sftp = make_sftp_client();
@@ -267,3 +888,48 @@ TEST_F(SFTPClient, out_stream_writes_data_with_nulls)
     EXPECT_NO_THROW(sftp.stream_file("fake path", out));
     EXPECT_EQ(out.str(), source_data);
 }
+
+TEST_F(SFTPClient, out_stream_reads_ahead_within_the_transfer_window)
+{
+    std::string content(3 * 65536 + 42, 'x');
+    for (auto i = 0u; i < content.size(); i += 1000)
+        content[i] = 'a' + i % 26;
+
+    std::map<int, uint64_t> requests;
+    std::size_t max_outstanding = 0;
+    REPLACE(sftp_init, [](auto...) { return SSH_OK; });
+    REPLACE(sftp_open, [](sftp_session session, auto...) {
+        auto file = get_dummy_sftp_file();
+        file->sftp = session;
+        return file;
+    });
+    REPLACE(sftp_async_read_begin, [&requests, &max_outstanding](sftp_file file, uint32_t len) {
+        auto id = static_cast<int>(++file->sftp->id_counter);
+        requests[id] = file->offset;
+        file->offset += len;
+        max_outstanding = std::max(max_outstanding, requests.size());
+        return id;
+    });
+    REPLACE(sftp_async_read, [&requests, &content](sftp_file file, void* data, uint32_t len, uint32_t id) {
+        auto offset = requests.at(id);
+        requests.erase(id);
+        if (file->eof)
+            return 0;
+
+        uint64_t size = 0;
+        if (offset < content.size())
+            size = std::min<uint64_t>(len, content.size() - offset);
+        else
+            file->eof = 1;
+
+        std::memcpy(data, content.data() + offset, size);
+        return static_cast<int>(size);
+    });
+
+    auto sftp = make_sftp_client(2);
+    std::ostringstream out;
+
+    EXPECT_NO_THROW(sftp.stream_file("foo", out));
+    EXPECT_EQ(out.str(), content);
+    EXPECT_EQ(max_outstanding, 2u);
+}
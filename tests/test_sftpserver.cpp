@@ -33,7 +33,15 @@
 
 #include <gmock/gmock.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <queue>
+#include <set>
+#include <thread>
+
+#include <unistd.h>
 
 namespace mp = multipass;
 namespace mpl = multipass::logging;
@@ -74,11 +82,22 @@ struct SftpServer : public mp::test::SftpServerTest
                 return nullptr;
             auto msg = messages.front();
             messages.pop();
+            if (msg->handle == nullptr)
+                msg->handle = last_handle.get();
             return msg;
         };
         return msg_handler;
     }
 
+    // Keeps the handle the server replies with, for the requests that follow to refer to, as sshfs would
+    auto make_handle_reply()
+    {
+        return [this](sftp_client_message, ssh_string handle) {
+            last_handle.reset(ssh_string_copy(handle));
+            return SSH_OK;
+        };
+    }
+
     auto make_reply_status(sftp_client_message expected_msg, uint32_t expected_status, int& num_calls)
     {
         auto reply_status = [expected_msg, expected_status, &num_calls](sftp_client_message msg, uint32_t status,
@@ -93,6 +112,7 @@ struct SftpServer : public mp::test::SftpServerTest
 
     mpt::ExitStatusMock exit_status_mock;
     std::queue<sftp_client_message> messages;
+    StringUPtr last_handle{nullptr, ssh_string_free};
     std::unordered_map<int, int> default_map;
     int default_id{1000};
     mpt::MockLogger::Scope logger_scope = mpt::MockLogger::inject();
@@ -210,6 +230,35 @@ auto make_data(const std::string& in)
     return out;
 }
 
+using BufferUPtr = std::unique_ptr<ssh_buffer_struct, void (*)(ssh_buffer)>;
+
+std::string sftp_u32(uint32_t value)
+{
+    std::string out;
+    for (auto shift : {24, 16, 8, 0})
+        out.push_back(static_cast<char>((value >> shift) & 0xff));
+    return out;
+}
+
+std::string sftp_u64(uint64_t value)
+{
+    return sftp_u32(static_cast<uint32_t>(value >> 32)) + sftp_u32(static_cast<uint32_t>(value));
+}
+
+std::string sftp_string(const std::string& value)
+{
+    return sftp_u32(static_cast<uint32_t>(value.size())) + value;
+}
+
+// What libssh keeps of an extended request, for the server to read the arguments of extensions it doesn't parse
+auto make_extended_message(const std::string& submessage, const std::string& args)
+{
+    const auto payload = sftp_u32(42) + sftp_string(submessage) + args;
+    BufferUPtr out{ssh_buffer_new(), ssh_buffer_free};
+    ssh_buffer_add_data(out.get(), payload.data(), static_cast<uint32_t>(payload.size()));
+    return out;
+}
+
 bool content_match(const QString& path, const std::string& data)
 {
     auto content = mpt::load(path);
@@ -260,10 +309,28 @@ bool compare_permission(uint32_t ssh_permissions, const QFileInfo& file, Permiss
 
 TEST_F(SftpServer, throws_when_failed_to_init)
 {
-    REPLACE(sftp_server_init, [](auto...) { return SSH_ERROR; });
+    REPLACE(sftp_packet_read, [](auto...) -> sftp_packet { return nullptr; });
     EXPECT_THROW(make_sftpserver(), std::runtime_error);
 }
 
+TEST_F(SftpServer, advertises_the_extensions_it_serves)
+{
+    uint8_t type{0};
+    std::string version_packet;
+    REPLACE(sftp_packet_write, [&type, &version_packet](sftp_session, uint8_t packet_type, ssh_buffer payload) {
+        type = packet_type;
+        version_packet.assign(static_cast<const char*>(ssh_buffer_get(payload)), ssh_buffer_get_len(payload));
+        return static_cast<int>(version_packet.size());
+    });
+
+    auto sftp = make_sftpserver();
+
+    EXPECT_EQ(type, SSH_FXP_VERSION);
+    for (const auto& extension : {"posix-rename@openssh.com", "hardlink@openssh.com", "fsync@openssh.com",
+                                  "statvfs@openssh.com", "limits@openssh.com", "copy-data"})
+        EXPECT_THAT(version_packet, HasSubstr(extension));
+}
+
 TEST_F(SftpServer, throws_when_sshfs_errors_on_start)
 {
     bool invoked{false};
@@ -318,6 +385,34 @@ TEST_F(SftpServer, sshfs_restarts_on_error)
     EXPECT_TRUE(invoked);
 }
 
+TEST_F(SftpServer, sshfs_restart_unmounts_lazily_in_the_same_exec)
+{
+    std::vector<std::string> commands;
+    auto request_exec = [this, &commands](ssh_channel, const char* raw_cmd) {
+        commands.emplace_back(raw_cmd);
+        exit_status_mock.return_exit_code(SSH_OK);
+        return SSH_OK;
+    };
+
+    REPLACE(ssh_channel_request_exec, request_exec);
+
+    auto sftp = make_sftpserver();
+
+    auto get_client_msg = [this, &commands](auto...) {
+        if (commands.size() == 1)
+            exit_status_mock.return_exit_code(SSH_ERROR);
+
+        return nullptr;
+    };
+    REPLACE(sftp_get_client_message, get_client_msg);
+
+    sftp.run();
+
+    ASSERT_THAT(commands, SizeIs(2));
+    EXPECT_THAT(commands.back(), HasSubstr("sudo umount -l"));
+    EXPECT_THAT(commands.back(), HasSubstr("sudo sshfs"));
+}
+
 TEST_F(SftpServer, stops_after_a_null_message)
 {
     auto sftp = make_sftpserver();
@@ -339,6 +434,103 @@ TEST_F(SftpServer, frees_message)
     msg_free.expectCalled(1).withValues(msg.get());
 }
 
+TEST_F(SftpServer, serves_requests_over_shared_session)
+{
+    auto session = std::make_shared<mp::SharedSSHSession>(mp::SSHSession{"a", 42});
+    mp::SftpServer sftp1{session, "", "", default_map, default_map, default_id, default_id, "sshfs"};
+    mp::SftpServer sftp2{session, "", "", default_map, default_map, default_id, default_id, "sshfs"};
+
+    int num_calls{0};
+    auto reply_status = [&num_calls](sftp_client_message, uint32_t status, const char*) {
+        EXPECT_THAT(status, Eq(SSH_FX_OP_UNSUPPORTED));
+        ++num_calls;
+        return SSH_OK;
+    };
+    REPLACE(sftp_reply_status, reply_status);
+    REPLACE(sftp_get_client_message, make_msg_handler());
+
+    auto msg1 = make_msg(SFTP_BAD_MESSAGE);
+    sftp1.run();
+
+    auto msg2 = make_msg(SFTP_BAD_MESSAGE);
+    sftp2.run();
+
+    EXPECT_THAT(num_calls, Eq(2));
+}
+
+TEST_F(SftpServer, replies_to_changes_over_shared_session_in_turn_with_the_other_servers)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    auto session = std::make_shared<mp::SharedSSHSession>(mp::SSHSession{"a", 42});
+    const auto path = temp_dir.path().toStdString();
+    mp::SftpServer writer{session, path, path, default_map, default_map, default_id, default_id, "sshfs"};
+    mp::SftpServer poller{session, "", "", default_map, default_map, default_id, default_id, "sshfs"};
+
+    auto open_msg = make_msg(SFTP_OPEN);
+    auto name = name_as_char_array(file_name.toStdString());
+    sftp_attributes_struct attr{};
+    attr.permissions = 0777;
+    open_msg->filename = name.data();
+    open_msg->attr = &attr;
+    open_msg->flags |= SSH_FXF_WRITE | SSH_FXF_TRUNC;
+
+    auto write_msg = make_msg(SFTP_WRITE);
+    auto data = make_data("The answer is always 42");
+    write_msg->data = data.get();
+    write_msg->offset = 0;
+
+    auto close_msg = make_msg(SFTP_CLOSE);
+
+    // Always readable, so that the poller keeps going back to the session rather than sleeping
+    int busy_socket[2];
+    ASSERT_EQ(::pipe(busy_socket), 0);
+    const char byte{0};
+    ASSERT_EQ(::write(busy_socket[1], &byte, 1), 1);
+    REPLACE(ssh_get_fd, [&busy_socket](auto...) { return busy_socket[0]; });
+
+    std::atomic<int> in_session{0};
+    std::atomic<bool> overlapped{false};
+    const auto use_session = [&in_session, &overlapped] {
+        if (++in_session > 1)
+            overlapped = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        --in_session;
+    };
+
+    const auto writer_thread = std::this_thread::get_id();
+    REPLACE(ssh_channel_poll_timeout, [&use_session, writer_thread](auto...) {
+        use_session();
+        return std::this_thread::get_id() == writer_thread ? 1 : 0;
+    });
+
+    int num_replies{0};
+    REPLACE(sftp_reply_handle, [this, &use_session, &num_replies](sftp_client_message msg, ssh_string handle) {
+        use_session();
+        ++num_replies;
+        return make_handle_reply()(msg, handle);
+    });
+    REPLACE(sftp_reply_status, [&use_session, &num_replies](sftp_client_message, uint32_t status, const char*) {
+        EXPECT_EQ(status, SSH_FX_OK);
+        use_session();
+        ++num_replies;
+        return SSH_OK;
+    });
+    REPLACE(sftp_get_client_message, make_msg_handler());
+
+    std::thread polling{[&poller] { poller.run(); }};
+    writer.run();
+    poller.stop();
+    polling.join();
+
+    ::close(busy_socket[0]);
+    ::close(busy_socket[1]);
+
+    EXPECT_EQ(num_replies, 3);
+    EXPECT_FALSE(overlapped);
+    EXPECT_TRUE(content_match(file_name, "The answer is always 42"));
+}
+
 TEST_F(SftpServer, handles_realpath)
 {
     mpt::TempFile file;
@@ -414,31 +606,6 @@ TEST_F(SftpServer, opendir_not_readable_fails)
     EXPECT_EQ(perm_denied_num_calls, 1);
 }
 
-TEST_F(SftpServer, opendir_no_handle_allocated_fails)
-{
-    auto dir_name = name_as_char_array(mpt::test_data_path().toStdString());
-
-    auto sftp = make_sftpserver(mpt::test_data_path().toStdString());
-    auto msg = make_msg(SFTP_OPENDIR);
-    msg->filename = dir_name.data();
-
-    int failure_num_calls{0};
-    auto reply_status = make_reply_status(msg.get(), SSH_FX_FAILURE, failure_num_calls);
-
-    REPLACE(sftp_handle_alloc, [](auto...) { return nullptr; });
-    REPLACE(sftp_get_client_message, make_msg_handler());
-    REPLACE(sftp_reply_status, reply_status);
-
-    logger_scope.mock_logger->screen_logs(mpl::Level::error);
-    EXPECT_CALL(*logger_scope.mock_logger,
-                log(Eq(mpl::Level::error), mpt::MockLogger::make_cstring_matcher(StrEq("sftp server")),
-                    mpt::MockLogger::make_cstring_matcher(StrEq("Cannot allocate handle for opendir()"))));
-
-    sftp.run();
-
-    EXPECT_EQ(failure_num_calls, 1);
-}
-
 TEST_F(SftpServer, handles_mkdir)
 {
     mpt::TempDir temp_dir;
@@ -1185,37 +1352,46 @@ TEST_F(SftpServer, open_chown_failure_fails)
     EXPECT_EQ(failure_num_calls, 1);
 }
 
-TEST_F(SftpServer, open_no_handle_allocated_fails)
+TEST_F(SftpServer, closed_handles_are_not_found_again)
 {
     mpt::TempDir temp_dir;
-    auto file_name = temp_dir.path() + "/test-file";
-
-    ASSERT_FALSE(QFile::exists(file_name));
 
     auto sftp = make_sftpserver(temp_dir.path().toStdString());
-    auto msg = make_msg(SFTP_OPEN);
-    msg->flags |= SSH_FXF_WRITE;
-    sftp_attributes_struct attr{};
-    attr.permissions = 0777;
-    msg->attr = &attr;
-    auto name = name_as_char_array(file_name.toStdString());
-    msg->filename = name.data();
+    auto open_dir_msg = make_msg(SFTP_OPENDIR);
+    auto dir_name = name_as_char_array(temp_dir.path().toStdString());
+    open_dir_msg->filename = dir_name.data();
 
-    int failure_num_calls{0};
-    auto reply_status = make_reply_status(msg.get(), SSH_FX_FAILURE, failure_num_calls);
+    auto close_msg = make_msg(SFTP_CLOSE);
+    auto reopen_dir_msg = make_msg(SFTP_OPENDIR);
+    reopen_dir_msg->filename = dir_name.data();
+    auto stale_close_msg = make_msg(SFTP_CLOSE);
+
+    StringUPtr first_handle{nullptr, ssh_string_free};
+    REPLACE(sftp_reply_handle, [this, &first_handle](sftp_client_message, ssh_string handle) {
+        last_handle.reset(ssh_string_copy(handle));
+        if (!first_handle)
+            first_handle.reset(ssh_string_copy(handle));
+        return SSH_OK;
+    });
 
-    REPLACE(sftp_handle_alloc, [](auto...) { return nullptr; });
-    REPLACE(sftp_get_client_message, make_msg_handler());
-    REPLACE(sftp_reply_status, reply_status);
+    // The slot the first handle had is reused, but not by the first handle
+    auto get_client_msg = make_msg_handler();
+    REPLACE(sftp_get_client_message, [&](auto... args) {
+        auto msg = get_client_msg(args...);
+        if (msg == stale_close_msg.get())
+            msg->handle = first_handle.get();
+        return msg;
+    });
 
-    logger_scope.mock_logger->screen_logs(mpl::Level::error);
-    EXPECT_CALL(*logger_scope.mock_logger,
-                log(Eq(mpl::Level::error), mpt::MockLogger::make_cstring_matcher(StrEq("sftp server")),
-                    mpt::MockLogger::make_cstring_matcher(StrEq("Cannot allocate handle for open()"))));
+    std::vector<uint32_t> statuses;
+    REPLACE(sftp_reply_status, [&statuses](sftp_client_message, uint32_t status, const char*) {
+        statuses.push_back(status);
+        return SSH_OK;
+    });
 
     sftp.run();
 
-    EXPECT_EQ(failure_num_calls, 1);
+    EXPECT_THAT(statuses, ElementsAre(SSH_FX_OK, SSH_FX_BAD_MESSAGE));
 }
 
 TEST_F(SftpServer, handles_readdir)
@@ -1237,12 +1413,6 @@ TEST_F(SftpServer, handles_readdir)
     auto readdir_msg = make_msg(SFTP_READDIR);
     auto readdir_msg_final = make_msg(SFTP_READDIR);
 
-    void* id{nullptr};
-    auto handle_alloc = [&id](sftp_session, void* info) {
-        id = info;
-        return ssh_string_new(4);
-    };
-
     int eof_num_calls{0};
     auto reply_status = make_reply_status(readdir_msg_final.get(), SSH_FX_EOF, eof_num_calls);
 
@@ -1253,9 +1423,7 @@ TEST_F(SftpServer, handles_readdir)
         return SSH_OK;
     };
 
-    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
-    REPLACE(sftp_handle_alloc, handle_alloc);
-    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_reply_handle, make_handle_reply());
     REPLACE(sftp_get_client_message, make_msg_handler());
     REPLACE(sftp_reply_status, reply_status);
     REPLACE(sftp_reply_names_add, reply_names_add);
@@ -1266,7 +1434,42 @@ TEST_F(SftpServer, handles_readdir)
     EXPECT_THAT(eof_num_calls, Eq(1));
 
     std::vector<std::string> expected_entries = {".", "..", "test-dir-entry", "test-file"};
-    EXPECT_THAT(entries, ContainerEq(expected_entries));
+    EXPECT_THAT(entries, UnorderedElementsAreArray(expected_entries));
+}
+
+TEST_F(SftpServer, readdir_spreads_large_directories_over_several_replies)
+{
+    mpt::TempDir temp_dir;
+    const auto num_files = 2000;
+    for (auto i = 0; i < num_files; ++i)
+        mpt::make_file_with_content(temp_dir.path() + QString("/a-rather-long-file-name-%1").arg(i));
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    auto open_dir_msg = make_msg(SFTP_OPENDIR);
+    auto dir_name = name_as_char_array(temp_dir.path().toStdString());
+    open_dir_msg->filename = dir_name.data();
+
+    std::vector<std::unique_ptr<sftp_client_message_struct>> readdir_msgs;
+    for (auto i = 0; i < 10; ++i)
+        readdir_msgs.push_back(make_msg(SFTP_READDIR));
+
+    std::set<std::string> entries;
+    int num_replies{0};
+    REPLACE(sftp_reply_handle, make_handle_reply());
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(sftp_reply_names_add, [&entries](sftp_client_message, const char* file, auto...) {
+        EXPECT_TRUE(entries.insert(file).second);
+        return SSH_OK;
+    });
+    REPLACE(sftp_reply_names, [&num_replies](auto...) {
+        ++num_replies;
+        return SSH_OK;
+    });
+
+    sftp.run();
+
+    EXPECT_THAT(num_replies, Gt(1));
+    EXPECT_THAT(entries.size(), Eq(num_files + 2u));
 }
 
 TEST_F(SftpServer, handles_readdir_attributes_preserved)
@@ -1290,12 +1493,6 @@ TEST_F(SftpServer, handles_readdir_attributes_preserved)
     auto readdir_msg = make_msg(SFTP_READDIR);
     auto readdir_msg_final = make_msg(SFTP_READDIR);
 
-    void* id{nullptr};
-    auto handle_alloc = [&id](sftp_session, void* info) {
-        id = info;
-        return ssh_string_new(4);
-    };
-
     int eof_num_calls{0};
     auto reply_status = make_reply_status(readdir_msg_final.get(), SSH_FX_EOF, eof_num_calls);
 
@@ -1311,9 +1508,7 @@ TEST_F(SftpServer, handles_readdir_attributes_preserved)
         return SSH_OK;
     };
 
-    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
-    REPLACE(sftp_handle_alloc, handle_alloc);
-    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_reply_handle, make_handle_reply());
     REPLACE(sftp_get_client_message, make_msg_handler());
     REPLACE(sftp_reply_status, reply_status);
     REPLACE(sftp_reply_names_add, get_test_file_attributes);
@@ -1346,22 +1541,13 @@ TEST_F(SftpServer, handles_close)
 
     auto close_msg = make_msg(SFTP_CLOSE);
 
-    void* id{nullptr};
-    auto handle_alloc = [&id](sftp_session, void* info) {
-        id = info;
-        return ssh_string_new(4);
-    };
-
     int ok_num_calls{0};
     auto reply_status = make_reply_status(close_msg.get(), SSH_FX_OK, ok_num_calls);
 
-    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
-    REPLACE(sftp_handle_alloc, handle_alloc);
-    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_reply_handle, make_handle_reply());
     REPLACE(sftp_get_client_message, make_msg_handler());
     REPLACE(sftp_reply_status, reply_status);
     REPLACE(sftp_reply_names, [](auto...) { return SSH_OK; });
-    REPLACE(sftp_handle_remove, [](auto...) {});
 
     sftp.run();
 
@@ -1382,12 +1568,6 @@ TEST_F(SftpServer, handles_fstat)
 
     auto fstat_msg = make_msg(SFTP_FSTAT);
 
-    void* id{nullptr};
-    auto handle_alloc = [&id](sftp_session, void* info) {
-        id = info;
-        return ssh_string_new(4);
-    };
-
     int num_calls{0};
     auto reply_attr = [&num_calls, &fstat_msg, expected_size](sftp_client_message reply_msg, sftp_attributes attr) {
         EXPECT_THAT(reply_msg, Eq(fstat_msg.get()));
@@ -1397,9 +1577,7 @@ TEST_F(SftpServer, handles_fstat)
     };
 
     REPLACE(sftp_reply_attr, reply_attr);
-    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
-    REPLACE(sftp_handle_alloc, handle_alloc);
-    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_reply_handle, make_handle_reply());
     REPLACE(sftp_get_client_message, make_msg_handler());
 
     sftp.run();
@@ -1407,6 +1585,83 @@ TEST_F(SftpServer, handles_fstat)
     EXPECT_THAT(num_calls, Eq(1));
 }
 
+TEST_F(SftpServer, serves_read_only_requests_concurrently)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    mpt::make_file_with_content(file_name);
+    auto name = name_as_char_array(file_name.toStdString());
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    auto first_msg = make_msg(SFTP_STAT);
+    first_msg->filename = name.data();
+    auto second_msg = make_msg(SFTP_STAT);
+    second_msg->filename = name.data();
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    int num_served{0}, num_overlapping{0};
+    auto get_filename = [&](sftp_client_message msg) {
+        std::unique_lock<std::mutex> lock{mutex};
+        ++num_served;
+        cv.notify_all();
+        if (cv.wait_for(lock, std::chrono::seconds{5}, [&num_served] { return num_served == 2; }))
+            ++num_overlapping;
+        return msg->filename;
+    };
+
+    int num_calls{0};
+    REPLACE(sftp_client_message_get_filename, get_filename);
+    REPLACE(sftp_reply_attr, [&num_calls](auto...) {
+        ++num_calls;
+        return SSH_OK;
+    });
+    REPLACE(sftp_get_client_message, make_msg_handler());
+
+    sftp.run();
+
+    EXPECT_THAT(num_calls, Eq(2));
+    EXPECT_THAT(num_overlapping, Eq(2));
+}
+
+TEST_F(SftpServer, serves_changes_after_earlier_requests_are_answered)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    mpt::make_file_with_content(file_name);
+    auto name = name_as_char_array(file_name.toStdString());
+    auto new_dir_name = name_as_char_array(fmt::format("{}/mkdir-test", temp_dir.path().toStdString()));
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    auto stat_msg = make_msg(SFTP_STAT);
+    stat_msg->filename = name.data();
+    auto mkdir_msg = make_msg(SFTP_MKDIR);
+    mkdir_msg->filename = new_dir_name.data();
+    sftp_attributes_struct attr{};
+    attr.permissions = 0777;
+    mkdir_msg->attr = &attr;
+
+    std::vector<uint8_t> replies;
+    REPLACE(sftp_client_message_get_filename, [](sftp_client_message msg) {
+        if (msg->type == SFTP_STAT)
+            std::this_thread::sleep_for(std::chrono::milliseconds{50});
+        return msg->filename;
+    });
+    REPLACE(sftp_reply_attr, [&replies](sftp_client_message msg, auto...) {
+        replies.push_back(msg->type);
+        return SSH_OK;
+    });
+    REPLACE(sftp_reply_status, [&replies](sftp_client_message msg, auto...) {
+        replies.push_back(msg->type);
+        return SSH_OK;
+    });
+    REPLACE(sftp_get_client_message, make_msg_handler());
+
+    sftp.run();
+
+    EXPECT_THAT(replies, ElementsAre(SFTP_STAT, SFTP_MKDIR));
+}
+
 TEST_F(SftpServer, handles_fsetstat)
 {
     mpt::TempDir temp_dir;
@@ -1428,18 +1683,10 @@ TEST_F(SftpServer, handles_fsetstat)
     auto fsetstat_msg = make_msg(SFTP_FSETSTAT);
     fsetstat_msg->attr = &attr;
 
-    void* id{nullptr};
-    auto handle_alloc = [&id](sftp_session, void* info) {
-        id = info;
-        return ssh_string_new(4);
-    };
-
     int num_calls{0};
     auto reply_status = make_reply_status(fsetstat_msg.get(), SSH_FX_OK, num_calls);
 
-    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
-    REPLACE(sftp_handle_alloc, handle_alloc);
-    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_reply_handle, make_handle_reply());
     REPLACE(sftp_get_client_message, make_msg_handler());
     REPLACE(sftp_reply_status, reply_status);
 
@@ -1483,6 +1730,41 @@ TEST_F(SftpServer, handles_setstat)
     EXPECT_THAT(file.size(), Eq(expected_size));
 }
 
+TEST_F(SftpServer, stat_sees_changes_made_through_the_server)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    mpt::make_file_with_content(file_name);
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    auto name = name_as_char_array(file_name.toStdString());
+    auto first_stat_msg = make_msg(SFTP_STAT);
+    first_stat_msg->filename = name.data();
+
+    auto setstat_msg = make_msg(SFTP_SETSTAT);
+    sftp_attributes_struct attr{};
+    const uint64_t expected_size = 7777;
+    attr.size = expected_size;
+    attr.flags = SSH_FILEXFER_ATTR_SIZE;
+    setstat_msg->filename = name.data();
+    setstat_msg->attr = &attr;
+
+    auto second_stat_msg = make_msg(SFTP_STAT);
+    second_stat_msg->filename = name.data();
+
+    std::vector<uint64_t> sizes;
+    REPLACE(sftp_reply_attr, [&sizes](sftp_client_message, sftp_attributes attr) {
+        sizes.push_back(attr->size);
+        return SSH_OK;
+    });
+    REPLACE(sftp_get_client_message, make_msg_handler());
+
+    sftp.run();
+
+    ASSERT_THAT(sizes, SizeIs(2));
+    EXPECT_THAT(sizes[1], Eq(expected_size));
+}
+
 TEST_F(SftpServer, setstat_correctly_modifies_file_timestamp)
 {
     mpt::TempDir temp_dir;
@@ -1703,12 +1985,6 @@ TEST_F(SftpServer, handles_writes)
     write_msg2->data = data2.get();
     write_msg2->offset = ssh_string_len(data1.get());
 
-    void* id{nullptr};
-    auto handle_alloc = [&id](sftp_session, void* info) {
-        id = info;
-        return ssh_string_new(4);
-    };
-
     int num_calls{0};
     auto reply_status = [&num_calls](sftp_client_message, uint32_t status, const char*) {
         EXPECT_TRUE(status == SSH_FX_OK);
@@ -1716,9 +1992,7 @@ TEST_F(SftpServer, handles_writes)
         return SSH_OK;
     };
 
-    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
-    REPLACE(sftp_handle_alloc, handle_alloc);
-    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_reply_handle, make_handle_reply());
     REPLACE(sftp_get_client_message, make_msg_handler());
     REPLACE(sftp_reply_status, reply_status);
 
@@ -1728,9 +2002,8 @@ TEST_F(SftpServer, handles_writes)
     EXPECT_TRUE(content_match(file_name, "The answer is always 42"));
 }
 
-TEST_F(SftpServer, write_cannot_seek_fails)
+TEST_F(SftpServer, write_failure_fails_close)
 {
-    const int seek_pos{10};
     mpt::TempDir temp_dir;
     auto file_name = temp_dir.path() + "/test-file";
 
@@ -1747,27 +2020,24 @@ TEST_F(SftpServer, write_cannot_seek_fails)
     auto write_msg = make_msg(SFTP_WRITE);
     auto data1 = make_data("The answer is ");
     write_msg->data = data1.get();
-    write_msg->offset = seek_pos;
+    write_msg->offset = 10;
 
-    void* id{nullptr};
-    auto handle_alloc = [&id](sftp_session, void* info) {
-        id = info;
-        return ssh_string_new(4);
-    };
+    auto close_msg = make_msg(SFTP_CLOSE);
 
     auto [mock_file_ops, guard] = mpt::MockFileOps::inject();
     EXPECT_CALL(*mock_file_ops, open(_, _)).WillOnce([](QFile& file, QIODevice::OpenMode mode) {
         return file.open(mode);
     });
     EXPECT_CALL(*mock_file_ops, setPermissions(_, _)).WillOnce(Return(true));
-    EXPECT_CALL(*mock_file_ops, seek(_, _)).WillOnce(Return(false));
+    EXPECT_CALL(*mock_file_ops, write_at(_, _, Eq(14), Eq(10))).WillOnce(Return(-1));
 
-    int failure_num_calls{0};
-    auto reply_status = make_reply_status(write_msg.get(), SSH_FX_FAILURE, failure_num_calls);
+    std::vector<std::pair<sftp_client_message, uint32_t>> replies;
+    auto reply_status = [&replies](sftp_client_message msg, uint32_t status, const char*) {
+        replies.emplace_back(msg, status);
+        return SSH_OK;
+    };
 
-    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
-    REPLACE(sftp_handle_alloc, handle_alloc);
-    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_reply_handle, make_handle_reply());
     REPLACE(sftp_get_client_message, make_msg_handler());
     REPLACE(sftp_reply_status, reply_status);
 
@@ -1775,15 +2045,14 @@ TEST_F(SftpServer, write_cannot_seek_fails)
     EXPECT_CALL(*logger_scope.mock_logger,
                 log(Eq(mpl::Level::error), mpt::MockLogger::make_cstring_matcher(StrEq("sftp server")),
                     mpt::MockLogger::make_cstring_matcher(
-                        AllOf(HasSubstr(fmt::format("cannot seek to position {} in", seek_pos)),
-                              HasSubstr(file_name.toStdString())))));
+                        AllOf(HasSubstr("write failed for"), HasSubstr(file_name.toStdString())))));
 
     sftp.run();
 
-    EXPECT_EQ(failure_num_calls, 1);
+    EXPECT_THAT(replies, ElementsAre(Pair(write_msg.get(), SSH_FX_OK), Pair(close_msg.get(), SSH_FX_FAILURE)));
 }
 
-TEST_F(SftpServer, write_failure_fails)
+TEST_F(SftpServer, sends_adjacent_writes_together)
 {
     mpt::TempDir temp_dir;
     auto file_name = temp_dir.path() + "/test-file";
@@ -1798,43 +2067,29 @@ TEST_F(SftpServer, write_failure_fails)
     open_msg->attr = &attr;
     open_msg->flags |= SSH_FXF_WRITE | SSH_FXF_TRUNC;
 
-    auto write_msg = make_msg(SFTP_WRITE);
+    auto write_msg1 = make_msg(SFTP_WRITE);
     auto data1 = make_data("The answer is ");
-    write_msg->data = data1.get();
-    write_msg->offset = 10;
+    write_msg1->data = data1.get();
+    write_msg1->offset = 0;
 
-    void* id{nullptr};
-    auto handle_alloc = [&id](sftp_session, void* info) {
-        id = info;
-        return ssh_string_new(4);
-    };
+    auto write_msg2 = make_msg(SFTP_WRITE);
+    auto data2 = make_data("always 42");
+    write_msg2->data = data2.get();
+    write_msg2->offset = ssh_string_len(data1.get());
+
+    auto close_msg = make_msg(SFTP_CLOSE);
 
     auto [mock_file_ops, guard] = mpt::MockFileOps::inject();
     EXPECT_CALL(*mock_file_ops, open(_, _)).WillOnce([](QFile& file, QIODevice::OpenMode mode) {
         return file.open(mode);
     });
     EXPECT_CALL(*mock_file_ops, setPermissions(_, _)).WillOnce(Return(true));
-    EXPECT_CALL(*mock_file_ops, seek(_, _)).WillOnce(Return(true));
-    EXPECT_CALL(*mock_file_ops, write(_, _, _)).WillOnce(Return(-1));
+    EXPECT_CALL(*mock_file_ops, write_at(_, _, Eq(23), Eq(0))).WillOnce(Return(23));
 
-    int failure_num_calls{0};
-    auto reply_status = make_reply_status(write_msg.get(), SSH_FX_FAILURE, failure_num_calls);
-
-    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
-    REPLACE(sftp_handle_alloc, handle_alloc);
-    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_reply_handle, make_handle_reply());
     REPLACE(sftp_get_client_message, make_msg_handler());
-    REPLACE(sftp_reply_status, reply_status);
-
-    logger_scope.mock_logger->screen_logs(mpl::Level::error);
-    EXPECT_CALL(*logger_scope.mock_logger,
-                log(Eq(mpl::Level::error), mpt::MockLogger::make_cstring_matcher(StrEq("sftp server")),
-                    mpt::MockLogger::make_cstring_matcher(
-                        AllOf(HasSubstr("write failed for"), HasSubstr(file_name.toStdString())))));
 
     sftp.run();
-
-    EXPECT_EQ(failure_num_calls, 1);
 }
 
 TEST_F(SftpServer, handles_reads)
@@ -1854,12 +2109,6 @@ TEST_F(SftpServer, handles_reads)
     const int expected_size = size - read_msg->offset;
     read_msg->len = expected_size;
 
-    void* id{nullptr};
-    auto handle_alloc = [&id](sftp_session, void* info) {
-        id = info;
-        return ssh_string_new(4);
-    };
-
     int num_calls{0};
     auto reply_data = [&num_calls, &read_msg](sftp_client_message msg, const void* data, int len) {
         EXPECT_THAT(len, Gt(0));
@@ -1871,9 +2120,7 @@ TEST_F(SftpServer, handles_reads)
         return SSH_OK;
     };
 
-    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
-    REPLACE(sftp_handle_alloc, handle_alloc);
-    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_reply_handle, make_handle_reply());
     REPLACE(sftp_get_client_message, make_msg_handler());
     REPLACE(sftp_reply_data, reply_data);
 
@@ -1882,12 +2129,12 @@ TEST_F(SftpServer, handles_reads)
     ASSERT_THAT(num_calls, Eq(1));
 }
 
-TEST_F(SftpServer, read_cannot_seek_fails)
+TEST_F(SftpServer, handles_reads_larger_than_64k)
 {
-    const int seek_pos{10};
     mpt::TempDir temp_dir;
     auto file_name = temp_dir.path() + "/test-file";
-    auto size = mpt::make_file_with_content(file_name);
+    const std::string content(200 * 1024, 'x');
+    mpt::make_file_with_content(file_name, content);
 
     auto sftp = make_sftpserver(temp_dir.path().toStdString());
     auto open_msg = make_msg(SFTP_OPEN);
@@ -1896,39 +2143,22 @@ TEST_F(SftpServer, read_cannot_seek_fails)
     open_msg->flags |= SSH_FXF_READ;
 
     auto read_msg = make_msg(SFTP_READ);
-    read_msg->offset = seek_pos;
-    const int expected_size = size - read_msg->offset;
-    read_msg->len = expected_size;
+    read_msg->offset = 0;
+    read_msg->len = content.size();
 
-    void* id{nullptr};
-    auto handle_alloc = [&id](sftp_session, void* info) {
-        id = info;
-        return ssh_string_new(4);
+    int len_read{0};
+    auto reply_data = [&len_read](sftp_client_message, const void*, int len) {
+        len_read = len;
+        return SSH_OK;
     };
 
-    auto [mock_file_ops, guard] = mpt::MockFileOps::inject();
-    EXPECT_CALL(*mock_file_ops, open(_, _)).WillOnce(Return(true));
-    EXPECT_CALL(*mock_file_ops, seek(_, _)).WillOnce(Return(false));
-
-    int failure_num_calls{0};
-    auto reply_status = make_reply_status(read_msg.get(), SSH_FX_FAILURE, failure_num_calls);
-
-    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
-    REPLACE(sftp_handle_alloc, handle_alloc);
-    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_reply_handle, make_handle_reply());
     REPLACE(sftp_get_client_message, make_msg_handler());
-    REPLACE(sftp_reply_status, reply_status);
-
-    logger_scope.mock_logger->screen_logs(mpl::Level::error);
-    EXPECT_CALL(*logger_scope.mock_logger,
-                log(Eq(mpl::Level::error), mpt::MockLogger::make_cstring_matcher(StrEq("sftp server")),
-                    mpt::MockLogger::make_cstring_matcher(
-                        AllOf(HasSubstr(fmt::format("cannot seek to position {} in", seek_pos)),
-                              HasSubstr(file_name.toStdString())))));
+    REPLACE(sftp_reply_data, reply_data);
 
     sftp.run();
 
-    EXPECT_EQ(failure_num_calls, 1);
+    EXPECT_THAT(len_read, Eq(static_cast<int>(content.size())));
 }
 
 TEST_F(SftpServer, read_returns_failure_fails)
@@ -1948,23 +2178,14 @@ TEST_F(SftpServer, read_returns_failure_fails)
     const int expected_size = size - read_msg->offset;
     read_msg->len = expected_size;
 
-    void* id{nullptr};
-    auto handle_alloc = [&id](sftp_session, void* info) {
-        id = info;
-        return ssh_string_new(4);
-    };
-
     auto [mock_file_ops, guard] = mpt::MockFileOps::inject();
     EXPECT_CALL(*mock_file_ops, open(_, _)).WillOnce(Return(true));
-    EXPECT_CALL(*mock_file_ops, seek(_, _)).WillOnce(Return(true));
-    EXPECT_CALL(*mock_file_ops, read(_, _, _)).WillOnce(Return(-1));
+    EXPECT_CALL(*mock_file_ops, read_at(_, _, _, Eq(10))).WillOnce(Return(-1));
 
     int failure_num_calls{0};
     auto reply_status = make_reply_status(read_msg.get(), SSH_FX_FAILURE, failure_num_calls);
 
-    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
-    REPLACE(sftp_handle_alloc, handle_alloc);
-    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_reply_handle, make_handle_reply());
     REPLACE(sftp_get_client_message, make_msg_handler());
     REPLACE(sftp_reply_status, reply_status);
 
@@ -1996,23 +2217,14 @@ TEST_F(SftpServer, read_returns_zero_end_of_file)
     const int expected_size = size - read_msg->offset;
     read_msg->len = expected_size;
 
-    void* id{nullptr};
-    auto handle_alloc = [&id](sftp_session, void* info) {
-        id = info;
-        return ssh_string_new(4);
-    };
-
     auto [mock_file_ops, guard] = mpt::MockFileOps::inject();
     EXPECT_CALL(*mock_file_ops, open(_, _)).WillOnce(Return(true));
-    EXPECT_CALL(*mock_file_ops, seek(_, _)).WillOnce(Return(true));
-    EXPECT_CALL(*mock_file_ops, read(_, _, _)).WillOnce(Return(0));
+    EXPECT_CALL(*mock_file_ops, read_at(_, _, _, Eq(10))).WillOnce(Return(0));
 
     int eof_num_calls{0};
     auto reply_status = make_reply_status(read_msg.get(), SSH_FX_EOF, eof_num_calls);
 
-    REPLACE(sftp_reply_handle, [](auto...) { return SSH_OK; });
-    REPLACE(sftp_handle_alloc, handle_alloc);
-    REPLACE(sftp_handle, [&id](auto...) { return id; });
+    REPLACE(sftp_reply_handle, make_handle_reply());
     REPLACE(sftp_get_client_message, make_msg_handler());
     REPLACE(sftp_reply_status, reply_status);
 
@@ -2021,6 +2233,102 @@ TEST_F(SftpServer, read_returns_zero_end_of_file)
     EXPECT_EQ(eof_num_calls, 1);
 }
 
+TEST_F(SftpServer, read_in_order_reads_ahead)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    mpt::make_file_with_content(file_name);
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    auto open_msg = make_msg(SFTP_OPEN);
+    auto name = name_as_char_array(file_name.toStdString());
+    open_msg->filename = name.data();
+    open_msg->flags |= SSH_FXF_READ;
+
+    const auto len = 64 * 1024;
+    std::vector<std::unique_ptr<sftp_client_message_struct>> read_msgs;
+    for (auto i = 0; i < 3; ++i)
+    {
+        read_msgs.push_back(make_msg(SFTP_READ));
+        read_msgs.back()->offset = i * len;
+        read_msgs.back()->len = len;
+    }
+
+    auto [mock_file_ops, guard] = mpt::MockFileOps::inject();
+    EXPECT_CALL(*mock_file_ops, open(_, _)).WillOnce(Return(true));
+    EXPECT_CALL(*mock_file_ops, read_at(_, _, _, _)).WillRepeatedly(ReturnArg<2>());
+    EXPECT_CALL(*mock_file_ops, advise_will_need(_, Ge(len), Gt(0))).WillOnce(Return(true));
+
+    REPLACE(sftp_reply_handle, make_handle_reply());
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(sftp_reply_data, [](auto...) { return SSH_OK; });
+
+    sftp.run();
+}
+
+TEST_F(SftpServer, read_out_of_order_does_not_read_ahead)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    mpt::make_file_with_content(file_name);
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    auto open_msg = make_msg(SFTP_OPEN);
+    auto name = name_as_char_array(file_name.toStdString());
+    open_msg->filename = name.data();
+    open_msg->flags |= SSH_FXF_READ;
+
+    const auto len = 64 * 1024;
+    std::vector<std::unique_ptr<sftp_client_message_struct>> read_msgs;
+    for (auto offset : {0ll, 1ll << 30, 1ll << 20, 1ll << 32})
+    {
+        read_msgs.push_back(make_msg(SFTP_READ));
+        read_msgs.back()->offset = offset;
+        read_msgs.back()->len = len;
+    }
+
+    auto [mock_file_ops, guard] = mpt::MockFileOps::inject();
+    EXPECT_CALL(*mock_file_ops, open(_, _)).WillOnce(Return(true));
+    EXPECT_CALL(*mock_file_ops, read_at(_, _, _, _)).WillRepeatedly(ReturnArg<2>());
+    EXPECT_CALL(*mock_file_ops, advise_will_need(_, _, _)).Times(0);
+
+    REPLACE(sftp_reply_handle, make_handle_reply());
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(sftp_reply_data, [](auto...) { return SSH_OK; });
+
+    sftp.run();
+}
+
+TEST_F(SftpServer, counts_operations_and_bytes_read)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    const std::string content(1024, 'x');
+    mpt::make_file_with_content(file_name, content);
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    auto open_msg = make_msg(SFTP_OPEN);
+    auto name = name_as_char_array(file_name.toStdString());
+    open_msg->filename = name.data();
+    open_msg->flags |= SSH_FXF_READ;
+
+    auto read_msg = make_msg(SFTP_READ);
+    read_msg->offset = 0;
+    read_msg->len = content.size();
+
+    REPLACE(sftp_reply_handle, make_handle_reply());
+    REPLACE(sftp_get_client_message, make_msg_handler());
+    REPLACE(sftp_reply_data, [](auto...) { return SSH_OK; });
+
+    sftp.run();
+
+    const auto stats = sftp.stats();
+    EXPECT_EQ(stats.operations.at("open").count, 1u);
+    EXPECT_EQ(stats.operations.at("read").count, 1u);
+    EXPECT_EQ(stats.bytes_read, content.size());
+    EXPECT_EQ(stats.bytes_written, 0u);
+}
+
 TEST_F(SftpServer, handle_extended_link)
 {
     mpt::TempDir temp_dir;
@@ -2167,6 +2475,190 @@ TEST_F(SftpServer, extended_rename_in_invalid_dir_fails)
     EXPECT_THAT(perm_denied_num_calls, Eq(1));
 }
 
+TEST_F(SftpServer, extended_fsync_syncs_file)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    mpt::make_file_with_content(file_name);
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    auto open_msg = make_msg(SFTP_OPEN);
+    auto name = name_as_char_array(file_name.toStdString());
+    open_msg->filename = name.data();
+    open_msg->flags |= SSH_FXF_WRITE;
+
+    auto msg = make_msg(SFTP_EXTENDED);
+    auto submessage = name_as_char_array("fsync@openssh.com");
+    msg->submessage = submessage.data();
+    auto complete_message = make_extended_message("fsync@openssh.com", sftp_string("handle"));
+    msg->complete_message = complete_message.get();
+
+    auto [mock_file_ops, guard] = mpt::MockFileOps::inject();
+    EXPECT_CALL(*mock_file_ops, open(_, _)).WillOnce([](QFile& file, QIODevice::OpenMode mode) {
+        return file.open(mode);
+    });
+    EXPECT_CALL(*mock_file_ops, sync(_)).WillOnce(Return(true));
+
+    int num_calls{0};
+    REPLACE(sftp_reply_status, make_reply_status(msg.get(), SSH_FX_OK, num_calls));
+    REPLACE(sftp_reply_handle, make_handle_reply());
+    REPLACE(sftp_get_client_message, make_msg_handler());
+
+    sftp.run();
+
+    EXPECT_THAT(num_calls, Eq(1));
+}
+
+TEST_F(SftpServer, extended_fsync_with_bad_handle_fails)
+{
+    auto sftp = make_sftpserver();
+    auto msg = make_msg(SFTP_EXTENDED);
+    auto submessage = name_as_char_array("fsync@openssh.com");
+    msg->submessage = submessage.data();
+    auto complete_message = make_extended_message("fsync@openssh.com", sftp_string("handle"));
+    msg->complete_message = complete_message.get();
+
+    int num_calls{0};
+    REPLACE(sftp_reply_status, make_reply_status(msg.get(), SSH_FX_BAD_MESSAGE, num_calls));
+    REPLACE(sftp_get_client_message, make_msg_handler());
+
+    sftp.run();
+
+    EXPECT_THAT(num_calls, Eq(1));
+}
+
+TEST_F(SftpServer, extended_statvfs_replies_with_file_system_info)
+{
+    mpt::TempDir temp_dir;
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    auto msg = make_msg(SFTP_EXTENDED);
+    auto submessage = name_as_char_array("statvfs@openssh.com");
+    msg->submessage = submessage.data();
+    auto complete_message = make_extended_message("statvfs@openssh.com", sftp_string(temp_dir.path().toStdString()));
+    msg->complete_message = complete_message.get();
+    sftp_session_struct session{};
+    msg->sftp = &session;
+
+    std::string reply;
+    REPLACE(ssh_channel_write, [&reply](ssh_channel, const void* data, uint32_t len) {
+        reply.append(static_cast<const char*>(data), len);
+        return static_cast<int>(len);
+    });
+    REPLACE(sftp_get_client_message, make_msg_handler());
+
+    sftp.run();
+
+    ASSERT_THAT(reply.size(), Eq(4u + 1u + 4u + 11u * 8u));
+    EXPECT_THAT(reply.substr(0, 4), Eq(sftp_u32(1u + 4u + 11u * 8u)));
+    EXPECT_THAT(static_cast<uint8_t>(reply[4]), Eq(201u));
+    EXPECT_THAT(reply.substr(5, 4), Eq(sftp_u32(42)));
+}
+
+TEST_F(SftpServer, extended_statvfs_in_invalid_dir_fails)
+{
+    mpt::TempDir temp_dir;
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    auto msg = make_msg(SFTP_EXTENDED);
+    auto submessage = name_as_char_array("statvfs@openssh.com");
+    msg->submessage = submessage.data();
+    auto complete_message = make_extended_message("statvfs@openssh.com", sftp_string("/foo/bar"));
+    msg->complete_message = complete_message.get();
+
+    int perm_denied_num_calls{0};
+    REPLACE(sftp_reply_status, make_reply_status(msg.get(), SSH_FX_PERMISSION_DENIED, perm_denied_num_calls));
+    REPLACE(sftp_get_client_message, make_msg_handler());
+
+    sftp.run();
+
+    EXPECT_THAT(perm_denied_num_calls, Eq(1));
+}
+
+TEST_F(SftpServer, extended_limits_replies_with_limits)
+{
+    auto sftp = make_sftpserver();
+    auto msg = make_msg(SFTP_EXTENDED);
+    auto submessage = name_as_char_array("limits@openssh.com");
+    msg->submessage = submessage.data();
+    sftp_session_struct session{};
+    msg->sftp = &session;
+
+    std::string reply;
+    REPLACE(ssh_channel_write, [&reply](ssh_channel, const void* data, uint32_t len) {
+        reply.append(static_cast<const char*>(data), len);
+        return static_cast<int>(len);
+    });
+    REPLACE(sftp_get_client_message, make_msg_handler());
+
+    sftp.run();
+
+    ASSERT_THAT(reply.size(), Eq(4u + 1u + 4u + 4u * 8u));
+    EXPECT_THAT(static_cast<uint8_t>(reply[4]), Eq(201u));
+    EXPECT_THAT(reply.substr(9, 8), Eq(sftp_u64(256u * 1024u)));
+    EXPECT_THAT(reply.substr(33, 8), Eq(sftp_u64(0)));
+}
+
+TEST_F(SftpServer, extended_copy_data_copies_within_file)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    mpt::make_file_with_content(file_name, "0123456789");
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    auto open_msg = make_msg(SFTP_OPEN);
+    auto name = name_as_char_array(file_name.toStdString());
+    open_msg->filename = name.data();
+    open_msg->flags |= SSH_FXF_READ | SSH_FXF_WRITE;
+
+    auto msg = make_msg(SFTP_EXTENDED);
+    auto submessage = name_as_char_array("copy-data");
+    msg->submessage = submessage.data();
+    const auto args = sftp_string("handle") + sftp_u64(0) + sftp_u64(5) + sftp_string("handle") + sftp_u64(10);
+    auto complete_message = make_extended_message("copy-data", args);
+    msg->complete_message = complete_message.get();
+
+    int num_calls{0};
+    REPLACE(sftp_reply_status, make_reply_status(msg.get(), SSH_FX_OK, num_calls));
+    REPLACE(sftp_reply_handle, make_handle_reply());
+    REPLACE(sftp_get_client_message, make_msg_handler());
+
+    sftp.run();
+
+    EXPECT_THAT(num_calls, Eq(1));
+    EXPECT_TRUE(content_match(file_name, "012345678901234"));
+}
+
+TEST_F(SftpServer, extended_copy_data_over_overlapping_ranges_fails)
+{
+    mpt::TempDir temp_dir;
+    auto file_name = temp_dir.path() + "/test-file";
+    mpt::make_file_with_content(file_name, "0123456789");
+
+    auto sftp = make_sftpserver(temp_dir.path().toStdString());
+    auto open_msg = make_msg(SFTP_OPEN);
+    auto name = name_as_char_array(file_name.toStdString());
+    open_msg->filename = name.data();
+    open_msg->flags |= SSH_FXF_READ | SSH_FXF_WRITE;
+
+    auto msg = make_msg(SFTP_EXTENDED);
+    auto submessage = name_as_char_array("copy-data");
+    msg->submessage = submessage.data();
+    const auto args = sftp_string("handle") + sftp_u64(0) + sftp_u64(5) + sftp_string("handle") + sftp_u64(3);
+    auto complete_message = make_extended_message("copy-data", args);
+    msg->complete_message = complete_message.get();
+
+    int num_calls{0};
+    REPLACE(sftp_reply_status, make_reply_status(msg.get(), SSH_FX_FAILURE, num_calls));
+    REPLACE(sftp_reply_handle, make_handle_reply());
+    REPLACE(sftp_get_client_message, make_msg_handler());
+
+    sftp.run();
+
+    EXPECT_THAT(num_calls, Eq(1));
+    EXPECT_TRUE(content_match(file_name, "0123456789"));
+}
+
 TEST_F(SftpServer, invalid_extended_fails)
 {
     auto sftp = make_sftpserver();
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/sha256.h>
+
+#include <gmock/gmock.h>
+
+#include <QCryptographicHash>
+
+namespace mp = multipass;
+
+using namespace testing;
+
+TEST(Sha256, hashes_nothing)
+{
+    mp::Sha256 hash;
+
+    EXPECT_EQ(hash.result().toHex(), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+}
+
+TEST(Sha256, hashes_data_added_in_pieces)
+{
+    mp::Sha256 hash;
+    hash.add_data("a", 1);
+    hash.add_data(QByteArray{"bc"});
+
+    EXPECT_EQ(hash.result().toHex(), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+}
+
+TEST(Sha256, agrees_with_qt_on_large_data)
+{
+    const QByteArray data(3 * 1024 * 1024 + 7, 'x');
+    mp::Sha256 hash;
+    hash.add_data(data);
+
+    EXPECT_EQ(hash.result(), QCryptographicHash::hash(data, QCryptographicHash::Sha256));
+}
+
+TEST(Sha256, result_leaves_hash_to_continue)
+{
+    mp::Sha256 hash;
+    hash.add_data("a", 1);
+    hash.result();
+    hash.add_data("bc", 2);
+
+    EXPECT_EQ(hash.result().toHex(), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+}
+
+TEST(Sha256, reset_starts_over)
+{
+    mp::Sha256 hash;
+    hash.add_data("junk", 4);
+    hash.reset();
+    hash.add_data("abc", 3);
+
+    EXPECT_EQ(hash.result().toHex(), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+}
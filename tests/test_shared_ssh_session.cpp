@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mock_ssh.h"
+
+#include <multipass/ssh/shared_ssh_session.h>
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <future>
+#include <thread>
+
+#include <unistd.h>
+
+namespace mp = multipass;
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace
+{
+struct SharedSSHSession : public Test
+{
+    SharedSSHSession()
+    {
+        connect.returnValue(SSH_OK);
+        is_connected.returnValue(true);
+
+        EXPECT_EQ(::pipe(busy_socket), 0);
+        EXPECT_EQ(::pipe(idle_socket), 0);
+        const char byte{0};
+        EXPECT_EQ(::write(busy_socket[1], &byte, 1), 1);
+    }
+
+    ~SharedSSHSession()
+    {
+        for (const auto fd : {busy_socket[0], busy_socket[1], idle_socket[0], idle_socket[1]})
+            ::close(fd);
+    }
+
+    decltype(MOCK(ssh_connect)) connect{MOCK(ssh_connect)};
+    decltype(MOCK(ssh_is_connected)) is_connected{MOCK(ssh_is_connected)};
+    int busy_socket[2]; // with data waiting to be taken in
+    int idle_socket[2];
+};
+} // namespace
+
+TEST_F(SharedSSHSession, turn_taking_in_data_counts_as_arrival)
+{
+    REPLACE(ssh_get_fd, [this](auto...) { return busy_socket[0]; });
+    mp::SharedSSHSession shared{mp::SSHSession{"a", 42}};
+
+    const auto seen = shared.arrivals();
+    {
+        mp::SharedSSHSession::Turn turn{shared};
+    }
+
+    EXPECT_EQ(shared.arrivals(), seen + 1);
+}
+
+TEST_F(SharedSSHSession, turn_without_incoming_data_is_no_arrival)
+{
+    REPLACE(ssh_get_fd, [this](auto...) { return idle_socket[0]; });
+    mp::SharedSSHSession shared{mp::SSHSession{"a", 42}};
+
+    const auto seen = shared.arrivals();
+    {
+        mp::SharedSSHSession::Turn turn{shared};
+    }
+
+    EXPECT_EQ(shared.arrivals(), seen);
+}
+
+TEST_F(SharedSSHSession, wait_for_data_returns_at_once_after_unseen_arrival)
+{
+    REPLACE(ssh_get_fd, [this](auto...) { return busy_socket[0]; });
+    mp::SharedSSHSession shared{mp::SSHSession{"a", 42}};
+
+    const auto seen = shared.arrivals();
+    {
+        mp::SharedSSHSession::Turn turn{shared};
+    }
+
+    REPLACE(ssh_get_fd, [this](auto...) { return idle_socket[0]; });
+    const auto start = std::chrono::steady_clock::now();
+    shared.wait_for_data(seen, 1min);
+
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 5s);
+}
+
+TEST_F(SharedSSHSession, turn_taking_in_data_wakes_up_waiters)
+{
+    // The waiter finds nothing on the socket, the data having been taken in by another user's turn
+    const auto waiter_id = std::this_thread::get_id();
+    REPLACE(ssh_get_fd, [this, waiter_id](auto...) {
+        return std::this_thread::get_id() == waiter_id ? idle_socket[0] : busy_socket[0];
+    });
+    mp::SharedSSHSession shared{mp::SSHSession{"a", 42}};
+
+    auto turn_taken = std::async(std::launch::async, [&shared] {
+        std::this_thread::sleep_for(100ms); // for the waiter to be asleep
+        mp::SharedSSHSession::Turn turn{shared};
+    });
+
+    const auto start = std::chrono::steady_clock::now();
+    shared.wait_for_data(shared.arrivals(), 1min);
+    turn_taken.get();
+
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 5s);
+}
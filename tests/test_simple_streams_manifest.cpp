@@ -71,6 +71,56 @@ TEST(SimpleStreamsManifest, throws_on_invalid_top_level_type)
     EXPECT_THROW(mp::SimpleStreamsManifest::fromJson(json, ""), mp::GenericManifestException);
 }
 
+TEST(SimpleStreamsManifest, throws_on_truncated_json)
+{
+    auto json = mpt::load_test_file("good_manifest.json");
+    json.chop(json.size() / 2);
+    EXPECT_THROW(mp::SimpleStreamsManifest::fromJson(json, ""), mp::GenericManifestException);
+}
+
+TEST(SimpleStreamsManifest, throws_on_trailing_garbage)
+{
+    auto json = mpt::load_test_file("good_manifest.json");
+    json.append("}");
+    EXPECT_THROW(mp::SimpleStreamsManifest::fromJson(json, ""), mp::GenericManifestException);
+}
+
+TEST(SimpleStreamsManifest, reads_products_whatever_their_member_order)
+{
+    const QByteArray json{R"({
+        "products": {
+            "com.ubuntu.cloud:server:16.04:s390x": {
+                "arch": "s390x",
+                "versions": {"20170516": {"items": {"disk1.img": {"sha256": "other", "extra": [1, -2.5e3, null]}}}}
+            },
+            "com.ubuntu.cloud:server:16.04:amd64": {
+                "versions": {
+                    "20170516": {"items": {"disk1.img": {"path": "xenial.img", "sha256": "abc", "size": 512}}}
+                },
+                "release_title": "16.04 \"Xenial\" Xerus",
+                "supported": true,
+                "aliases": "16.04,x,xenial",
+                "release": "xenial",
+                "arch": "amd64"
+            }
+        },
+        "updated": "Wed, 17 May 2017 03:52:48 +0000"
+    })"};
+
+    auto manifest = mp::SimpleStreamsManifest::fromJson(json, "http://stream/url");
+
+    EXPECT_THAT(manifest->updated_at, Eq("Wed, 17 May 2017 03:52:48 +0000"));
+    ASSERT_THAT(manifest->products.size(), Eq(1u));
+
+    const auto info = manifest->image_records["x"];
+    ASSERT_THAT(info, NotNull());
+    EXPECT_THAT(info->id, Eq("abc"));
+    EXPECT_THAT(info->release_title, Eq("16.04 \"Xenial\" Xerus"));
+    EXPECT_THAT(info->image_location, Eq("xenial.img"));
+    EXPECT_THAT(info->size, Eq(512));
+    EXPECT_TRUE(info->supported);
+}
+
 TEST(SimpleStreamsManifest, throws_when_missing_products)
 {
     auto json = mpt::load_test_file("missing_products_manifest.json");
@@ -118,6 +168,36 @@ TEST(SimpleStreamsManifest, can_query_all_versions)
     }
 }
 
+TEST(SimpleStreamsManifest, finds_products_by_full_id)
+{
+    auto json = mpt::load_test_file("releases/multiple_versions_manifest.json");
+    auto manifest = mp::SimpleStreamsManifest::fromJson(json, "");
+
+    const QString id{"1507bd2b3288ef4bacd3e699fe71b827b7ccf321ec4487e168a30d7089d3c8e4"};
+    const auto info = manifest->product_with_id(id);
+    ASSERT_THAT(info, NotNull());
+    EXPECT_THAT(info->id, Eq(id));
+
+    EXPECT_THAT(manifest->product_with_id(id.left(10)), IsNull());
+    EXPECT_THAT(manifest->product_with_id("xenial"), IsNull());
+}
+
+TEST(SimpleStreamsManifest, finds_products_by_id_prefix_in_manifest_order)
+{
+    auto json = mpt::load_test_file("releases/multiple_versions_manifest.json");
+    auto manifest = mp::SimpleStreamsManifest::fromJson(json, "");
+
+    std::vector<const mp::VMImageInfo*> expected;
+    for (const auto& product : manifest->products)
+        if (product.id.startsWith("1"))
+            expected.push_back(&product);
+
+    EXPECT_THAT(expected.size(), Eq(2u));
+    EXPECT_THAT(manifest->products_with_id_prefix("1"), ContainerEq(expected));
+    EXPECT_THAT(manifest->products_with_id_prefix("f00"), IsEmpty());
+    EXPECT_THAT(manifest->products_with_id_prefix("").size(), Eq(manifest->products.size()));
+}
+
 TEST(SimpleStreamsManifest, info_has_kernel_and_initrd_paths)
 {
     auto json = mpt::load_test_file("good_manifest.json");
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mock_ssh.h"
+#include "stub_terminal.h"
+#include "temp_dir.h"
+
+#include <multipass/ssh/ssh_broker.h>
+
+#include <gmock/gmock.h>
+
+#include <QLocalSocket>
+#include <QThread>
+
+#include <atomic>
+#include <cstring>
+#include <sstream>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+
+namespace
+{
+// Serves in a thread of its own for as long as it is in scope
+class RunningBroker
+{
+public:
+    explicit RunningBroker(const QString& server_name)
+        : broker{server_name, std::chrono::milliseconds{500}},
+          thread{QThread::create([this] { broker.run(); })}
+    {
+        thread->start();
+
+        QLocalSocket probe;
+        for (auto attempts = 0; attempts < 100; ++attempts)
+        {
+            probe.connectToServer(server_name);
+            if (probe.waitForConnected(50))
+                break;
+            QThread::msleep(10);
+        }
+    }
+
+    ~RunningBroker()
+    {
+        thread->wait();
+    }
+
+private:
+    mp::SSHBroker broker;
+    std::unique_ptr<QThread> thread;
+};
+
+struct SSHBroker : public Test
+{
+    SSHBroker()
+    {
+        connect.returnValue(SSH_OK);
+        is_connected.returnValue(true);
+        userauth.returnValue(SSH_AUTH_SUCCESS);
+        open_session.returnValue(SSH_OK);
+        request_exec.returnValue(SSH_OK);
+        is_open.returnValue(1);
+        is_eof.returnValue(1);
+        read.returnValue(0);
+        poll.returnValue(0);
+        send_eof.returnValue(SSH_OK);
+        exit_status.returnValue(0);
+    }
+
+    std::optional<int> exec(const std::vector<std::string>& args)
+    {
+        return mp::SSHBroker::exec(server_name, "localhost", 22, "ubuntu", "key", args, &term);
+    }
+
+    decltype(MOCK(ssh_connect)) connect{MOCK(ssh_connect)};
+    decltype(MOCK(ssh_is_connected)) is_connected{MOCK(ssh_is_connected)};
+    decltype(MOCK(ssh_userauth_publickey)) userauth{MOCK(ssh_userauth_publickey)};
+    decltype(MOCK(ssh_channel_open_session)) open_session{MOCK(ssh_channel_open_session)};
+    decltype(MOCK(ssh_channel_request_exec)) request_exec{MOCK(ssh_channel_request_exec)};
+    decltype(MOCK(ssh_channel_is_open)) is_open{MOCK(ssh_channel_is_open)};
+    decltype(MOCK(ssh_channel_is_eof)) is_eof{MOCK(ssh_channel_is_eof)};
+    decltype(MOCK(ssh_channel_read_nonblocking)) read{MOCK(ssh_channel_read_nonblocking)};
+    decltype(MOCK(ssh_channel_poll_timeout)) poll{MOCK(ssh_channel_poll_timeout)};
+    decltype(MOCK(ssh_channel_send_eof)) send_eof{MOCK(ssh_channel_send_eof)};
+    decltype(MOCK(ssh_channel_get_exit_status)) exit_status{MOCK(ssh_channel_get_exit_status)};
+
+    mpt::TempDir temp_dir;
+    QString server_name{temp_dir.path() + "/ssh-broker"};
+    std::stringstream cout, cerr, cin;
+    mpt::StubTerminal term{cout, cerr, cin};
+};
+} // namespace
+
+TEST_F(SSHBroker, exec_returns_nothing_without_a_broker)
+{
+    EXPECT_EQ(exec({"true"}), std::nullopt);
+}
+
+TEST_F(SSHBroker, relays_output_and_exit_status)
+{
+    std::atomic_bool sent_output{false}, sent_error_output{false};
+    REPLACE(ssh_channel_read_nonblocking, [&](auto, void* dest, auto, int is_stderr) {
+        auto& sent = is_stderr ? sent_error_output : sent_output;
+        if (sent.exchange(true))
+            return 0;
+
+        const auto data = is_stderr ? "oops" : "hello";
+        std::memcpy(dest, data, std::strlen(data));
+        return static_cast<int>(std::strlen(data));
+    });
+    REPLACE(ssh_channel_is_eof, [&](auto) { return sent_output && sent_error_output; });
+    exit_status.returnValue(3);
+
+    RunningBroker broker{server_name};
+
+    EXPECT_EQ(exec({"foo"}), 3);
+    EXPECT_EQ(cout.str(), "hello");
+    EXPECT_EQ(cerr.str(), "oops");
+}
+
+TEST_F(SSHBroker, relays_input_until_it_ends)
+{
+    std::string written;
+    std::atomic_bool input_ended{false};
+    REPLACE(ssh_channel_write, [&](auto, const void* data, uint32_t len) {
+        written.append(static_cast<const char*>(data), len);
+        return static_cast<int>(len);
+    });
+    REPLACE(ssh_channel_send_eof, [&](auto) {
+        input_ended = true;
+        return SSH_OK;
+    });
+    REPLACE(ssh_channel_is_eof, [&](auto) { return input_ended.load(); });
+    cin << "some input";
+
+    RunningBroker broker{server_name};
+
+    EXPECT_EQ(exec({"cat"}), 0);
+    EXPECT_EQ(written, "some input");
+}
+
+TEST_F(SSHBroker, reuses_the_session_across_commands)
+{
+    RunningBroker broker{server_name};
+
+    EXPECT_EQ(exec({"foo"}), 0);
+    EXPECT_EQ(exec({"bar"}), 0);
+    EXPECT_NO_THROW(connect.expectCalled(1));
+}
+
+TEST_F(SSHBroker, leaves_commands_it_cannot_start_to_the_client)
+{
+    request_exec.returnValue(SSH_ERROR);
+
+    RunningBroker broker{server_name};
+
+    EXPECT_EQ(exec({"foo"}), std::nullopt);
+}
@@ -23,6 +23,9 @@
 
 #include <gmock/gmock.h>
 
+#include <QDir>
+#include <QFile>
+
 #include <thread>
 
 namespace mp = multipass;
@@ -97,3 +100,32 @@ TEST_F(SSHKeyProvider, public_key_is_stable)
 
     EXPECT_THAT(key_one, StrEq(key_two));
 }
+
+TEST_F(SSHKeyProvider, creates_ed25519_key_by_default)
+{
+    mp::OpenSSHKeyProvider key_provider{key_dir.path()};
+
+    EXPECT_EQ(ssh_key_type(key_provider.private_key()), SSH_KEYTYPE_ED25519);
+    EXPECT_TRUE(QFile::exists(QDir{key_dir.path()}.filePath("ssh-keys/id_ed25519")));
+}
+
+TEST_F(SSHKeyProvider, creates_rsa_key_when_asked)
+{
+    mp::OpenSSHKeyProvider key_provider{key_dir.path(), mp::OpenSSHKeyProvider::KeyType::rsa};
+
+    EXPECT_EQ(ssh_key_type(key_provider.private_key()), SSH_KEYTYPE_RSA);
+    EXPECT_TRUE(QFile::exists(QDir{key_dir.path()}.filePath("ssh-keys/id_rsa")));
+}
+
+TEST_F(SSHKeyProvider, keeps_existing_key_of_another_type)
+{
+    std::string private_key;
+    {
+        mp::OpenSSHKeyProvider key_provider{key_dir.path(), mp::OpenSSHKeyProvider::KeyType::rsa};
+        private_key = key_provider.private_key_as_base64();
+    }
+
+    mp::OpenSSHKeyProvider key_provider{key_dir.path()};
+    EXPECT_EQ(ssh_key_type(key_provider.private_key()), SSH_KEYTYPE_RSA);
+    EXPECT_THAT(key_provider.private_key_as_base64(), StrEq(private_key));
+}
@@ -23,6 +23,7 @@
 
 #include <algorithm>
 #include <thread>
+#include <vector>
 
 namespace mp = multipass;
 using namespace testing;
@@ -69,6 +70,71 @@ TEST_F(SSHProcess, can_retrieve_exit_status)
     EXPECT_THAT(proc.exit_code(), Eq(expected_status));
 }
 
+TEST_F(SSHProcess, exit_status_is_kept_for_later_calls)
+{
+    ssh_channel_callbacks callbacks{nullptr};
+    REPLACE(ssh_add_channel_callbacks, [&callbacks](ssh_channel, ssh_channel_callbacks cb) {
+        callbacks = cb;
+        return SSH_OK;
+    });
+
+    auto polls = 0;
+    REPLACE(ssh_event_dopoll, [&callbacks, &polls](auto...) {
+        ++polls;
+        callbacks->channel_exit_status_function(nullptr, nullptr, 7, callbacks->userdata);
+        return SSH_OK;
+    });
+
+    auto proc = session.exec("something");
+    EXPECT_THAT(proc.exit_code(), Eq(7));
+    EXPECT_THAT(proc.exit_code(), Eq(7));
+    EXPECT_THAT(polls, Eq(1));
+}
+
+TEST_F(SSHProcess, waiting_on_one_process_hears_the_exit_of_others)
+{
+    std::vector<ssh_channel_callbacks> callbacks;
+    REPLACE(ssh_add_channel_callbacks, [&callbacks](ssh_channel, ssh_channel_callbacks cb) {
+        callbacks.push_back(cb);
+        return SSH_OK;
+    });
+
+    auto polls = 0;
+    REPLACE(ssh_event_dopoll, [&callbacks, &polls](auto...) {
+        ++polls;
+        for (auto i = 0u; i < callbacks.size(); ++i)
+            callbacks[i]->channel_exit_status_function(nullptr, nullptr, i + 1, callbacks[i]->userdata);
+        return SSH_OK;
+    });
+
+    auto first = session.exec("something");
+    auto second = session.exec("something else");
+    EXPECT_THAT(first.exit_code(), Eq(1));
+    EXPECT_THAT(second.exit_code(), Eq(2));
+    EXPECT_THAT(polls, Eq(1));
+}
+
+TEST_F(SSHProcess, processes_of_different_sessions_wait_on_their_own_events)
+{
+    std::vector<ssh_event> events;
+    REPLACE(ssh_event_dopoll, [&events](ssh_event event, auto...) {
+        events.push_back(event);
+        return SSH_ERROR;
+    });
+
+    mp::SSHSession other_session{"theanswertoeverything", 42};
+    auto first = session.exec("something");
+    auto second = other_session.exec("something else");
+    auto third = session.exec("something more");
+    EXPECT_THROW(first.exit_code(), std::runtime_error);
+    EXPECT_THROW(second.exit_code(), std::runtime_error);
+    EXPECT_THROW(third.exit_code(), std::runtime_error);
+
+    ASSERT_THAT(events, SizeIs(3));
+    EXPECT_THAT(events[0], Ne(events[1]));
+    EXPECT_THAT(events[0], Eq(events[2]));
+}
+
 TEST_F(SSHProcess, exit_code_times_out)
 {
     REPLACE(ssh_event_dopoll, [](ssh_event, int timeout) {
@@ -154,3 +220,39 @@ TEST_F(SSHProcess, can_read_output)
 
     EXPECT_THAT(output, StrEq(expected_output));
 }
+
+TEST_F(SSHProcess, can_read_output_through_handler)
+{
+    std::string expected_output{"some content here"};
+    auto remaining = expected_output.size();
+    auto channel_read = [&expected_output, &remaining](ssh_channel, void* dest, uint32_t count, int is_stderr, int) {
+        const auto num_to_copy = std::min({count, static_cast<uint32_t>(remaining), 5u});
+        const auto begin = expected_output.begin() + expected_output.size() - remaining;
+        std::copy_n(begin, num_to_copy, reinterpret_cast<char*>(dest));
+        remaining -= num_to_copy;
+        return num_to_copy;
+    };
+    REPLACE(ssh_channel_read_timeout, channel_read);
+
+    auto proc = session.exec("something");
+    std::vector<std::string> chunks;
+    proc.read_std_output([&chunks](const char* data, std::size_t size) { chunks.emplace_back(data, size); });
+
+    EXPECT_THAT(chunks, ElementsAre("some ", "conte", "nt he", "re"));
+}
+
+TEST_F(SSHProcess, reads_ask_for_more_while_they_keep_filling_up)
+{
+    std::vector<uint32_t> counts;
+    auto channel_read = [&counts](ssh_channel, void*, uint32_t count, auto...) {
+        counts.push_back(count);
+        return counts.size() < 3 ? count : counts.size() == 3 ? 1u : 0u;
+    };
+    REPLACE(ssh_channel_read_timeout, channel_read);
+
+    auto proc = session.exec("something");
+    auto output = proc.read_std_output();
+
+    EXPECT_THAT(counts, ElementsAre(65536u, 131072u, 262144u, 262144u));
+    EXPECT_EQ(output.size(), 65536u + 131072u + 1u);
+}
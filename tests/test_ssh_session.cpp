@@ -22,6 +22,16 @@
 
 #include <gmock/gmock.h>
 
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 namespace mp = multipass;
 using namespace testing;
 
@@ -37,6 +47,134 @@ TEST(SSHSession, throws_when_unable_to_set_option)
     EXPECT_THROW(mp::SSHSession("theanswertoeverything", 42), std::runtime_error);
 }
 
+TEST(SSHSession, uses_the_ciphers_set)
+{
+    std::vector<std::string> ciphers;
+    REPLACE(ssh_connect, [](auto...) { return SSH_OK; });
+    REPLACE(ssh_options_set, [&ciphers](ssh_session, ssh_options_e type, const void* value) {
+        if (type == SSH_OPTIONS_CIPHERS_C_S || type == SSH_OPTIONS_CIPHERS_S_C)
+            ciphers.emplace_back(static_cast<const char*>(value));
+        return SSH_OK;
+    });
+
+    mp::SSHSession::set_ciphers("aes256-ctr");
+    mp::SSHSession session{"theanswertoeverything", 42};
+    mp::SSHSession::set_ciphers("");
+
+    EXPECT_THAT(ciphers, ElementsAre("aes256-ctr", "aes256-ctr"));
+}
+
+TEST(SSHSession, picks_ciphers_when_none_are_set)
+{
+    std::string ciphers;
+    REPLACE(ssh_connect, [](auto...) { return SSH_OK; });
+    REPLACE(ssh_options_set, [&ciphers](ssh_session, ssh_options_e type, const void* value) {
+        if (type == SSH_OPTIONS_CIPHERS_C_S)
+            ciphers = static_cast<const char*>(value);
+        return SSH_OK;
+    });
+
+    mp::SSHSession session{"theanswertoeverything", 42};
+
+    EXPECT_THAT(ciphers, AnyOf(StartsWith("aes128-gcm@openssh.com"), StartsWith("chacha20-poly1305@openssh.com")));
+}
+
+namespace
+{
+// A port on the loopback interface, listened on if asked to, and refusing connections otherwise
+struct LocalPort
+{
+    explicit LocalPort(bool listening)
+    {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+
+        EXPECT_EQ(::bind(fd, reinterpret_cast<sockaddr*>(&address), length), 0);
+        EXPECT_EQ(::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length), 0);
+        number = ntohs(address.sin_port);
+
+        if (listening)
+            EXPECT_EQ(::listen(fd, 1), 0);
+    }
+
+    ~LocalPort()
+    {
+        ::close(fd);
+    }
+
+    int fd{::socket(AF_INET, SOCK_STREAM, 0)};
+    int number{0};
+};
+} // namespace
+
+TEST(SSHSession, automatic_compression_times_the_link_rather_than_the_handshake)
+{
+    LocalPort port{true};
+    std::vector<std::string> compression;
+    std::vector<int> handed_sockets;
+    REPLACE(ssh_connect, [](auto...) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{50}); // a busy instance, slow at the key exchange
+        return SSH_OK;
+    });
+    REPLACE(ssh_options_set, [&compression, &handed_sockets](ssh_session, ssh_options_e type, const void* value) {
+        if (type == SSH_OPTIONS_COMPRESSION_C_S)
+            compression.emplace_back(static_cast<const char*>(value));
+        else if (type == SSH_OPTIONS_FD)
+            handed_sockets.push_back(*static_cast<const int*>(value));
+        return SSH_OK;
+    });
+
+    mp::SSHSession::set_compression(mp::SSHSession::Compression::automatic);
+    mp::SSHSession{"127.0.0.1", port.number};
+    mp::SSHSession{"127.0.0.1", port.number};
+    mp::SSHSession::set_compression(mp::SSHSession::Compression::never);
+
+    for (const auto fd : handed_sockets)
+        ::close(fd);
+
+    EXPECT_EQ(handed_sockets.size(), 2u);
+    EXPECT_THAT(compression, ElementsAre("none", "none"));
+}
+
+TEST(SSHSession, automatic_compression_throws_when_the_link_is_refused)
+{
+    LocalPort port{false};
+    REPLACE(ssh_connect, [](auto...) { return SSH_OK; });
+
+    mp::SSHSession::set_compression(mp::SSHSession::Compression::automatic);
+    EXPECT_THROW(mp::SSHSession("127.0.0.1", port.number), std::runtime_error);
+    mp::SSHSession::set_compression(mp::SSHSession::Compression::never);
+}
+
+TEST(SSHSession, uses_the_compression_set)
+{
+    std::vector<std::string> compression;
+    REPLACE(ssh_connect, [](auto...) { return SSH_OK; });
+    REPLACE(ssh_options_set, [&compression](ssh_session, ssh_options_e type, const void* value) {
+        if (type == SSH_OPTIONS_COMPRESSION_S_C)
+            compression.emplace_back(static_cast<const char*>(value));
+        return SSH_OK;
+    });
+
+    mp::SSHSession::set_compression(mp::SSHSession::Compression::always);
+    mp::SSHSession{"theanswertoeverything", 42};
+    mp::SSHSession::set_compression(mp::SSHSession::Compression::never);
+    mp::SSHSession{"theanswertoeverything", 42};
+
+    EXPECT_THAT(compression, ElementsAre(StartsWith("zlib@openssh.com"), "none"));
+}
+
+TEST(SSHSession, compression_for_reads_the_setting)
+{
+    mp::SSHSession::set_compression(mp::SSHSession::Compression::always);
+    EXPECT_EQ(mp::SSHSession::compression_for("auto"), mp::SSHSession::Compression::automatic);
+    EXPECT_EQ(mp::SSHSession::compression_for("off"), mp::SSHSession::Compression::never);
+    EXPECT_EQ(mp::SSHSession::compression_for(""), mp::SSHSession::Compression::always);
+    mp::SSHSession::set_compression(mp::SSHSession::Compression::never);
+}
+
 TEST(SSHSession, throws_when_unable_to_connect)
 {
     REPLACE(ssh_connect, [](auto...) { return SSH_ERROR; });
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mock_ssh.h"
+#include "stub_ssh_key_provider.h"
+
+#include <multipass/ssh/ssh_session_pool.h>
+
+#include <gmock/gmock.h>
+
+#include <stdexcept>
+
+namespace mp = multipass;
+using namespace testing;
+
+namespace
+{
+struct SSHSessionPool : public Test
+{
+    SSHSessionPool()
+    {
+        connect.returnValue(SSH_OK);
+        is_connected.returnValue(true);
+        userauth.returnValue(SSH_AUTH_SUCCESS);
+    }
+
+    decltype(MOCK(ssh_connect)) connect{MOCK(ssh_connect)};
+    decltype(MOCK(ssh_is_connected)) is_connected{MOCK(ssh_is_connected)};
+    decltype(MOCK(ssh_userauth_publickey)) userauth{MOCK(ssh_userauth_publickey)};
+    mp::test::StubSSHKeyProvider key_provider;
+    mp::SSHSessionPool pool{key_provider};
+};
+} // namespace
+
+TEST_F(SSHSessionPool, reuses_returned_sessions)
+{
+    ssh_session first_session, second_session;
+    {
+        auto lease = pool.acquire("foo", "localhost", 22, "ubuntu");
+        first_session = *lease;
+    }
+    {
+        auto lease = pool.acquire("foo", "localhost", 22, "ubuntu");
+        second_session = *lease;
+    }
+
+    EXPECT_EQ(first_session, second_session);
+    EXPECT_NO_THROW(connect.expectCalled(1));
+}
+
+TEST_F(SSHSessionPool, does_not_share_sessions_in_use)
+{
+    auto lease = pool.acquire("foo", "localhost", 22, "ubuntu");
+    auto other_lease = pool.acquire("foo", "localhost", 22, "ubuntu");
+
+    EXPECT_NE(static_cast<ssh_session>(*lease), static_cast<ssh_session>(*other_lease));
+    EXPECT_NO_THROW(connect.expectCalled(2));
+}
+
+TEST_F(SSHSessionPool, reconnects_when_session_is_dead)
+{
+    pool.acquire("foo", "localhost", 22, "ubuntu");
+    is_connected.returnValue(false);
+    pool.acquire("foo", "localhost", 22, "ubuntu");
+
+    EXPECT_NO_THROW(connect.expectCalled(2));
+}
+
+TEST_F(SSHSessionPool, reconnects_when_address_changes)
+{
+    pool.acquire("foo", "localhost", 22, "ubuntu");
+    pool.acquire("foo", "localhost", 2222, "ubuntu");
+
+    EXPECT_NO_THROW(connect.expectCalled(2));
+}
+
+TEST_F(SSHSessionPool, forgets_sessions_of_dropped_instances)
+{
+    {
+        auto lease = pool.acquire("foo", "localhost", 22, "ubuntu");
+        pool.drop("foo"); // sessions lent out at the time are not taken back either
+    }
+    pool.acquire("foo", "localhost", 22, "ubuntu");
+
+    EXPECT_NO_THROW(connect.expectCalled(2));
+}
+
+TEST_F(SSHSessionPool, discards_sessions_returned_while_throwing)
+{
+    try
+    {
+        auto lease = pool.acquire("foo", "localhost", 22, "ubuntu");
+        throw std::runtime_error{"failed"};
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+    pool.acquire("foo", "localhost", 22, "ubuntu");
+
+    EXPECT_NO_THROW(connect.expectCalled(2));
+}
@@ -40,7 +40,8 @@ struct TestSSHFSServerProcessSpec : public Test
                                  "source_path",
                                  "target_path",
                                  {{1, 2}, {3, 4}},
-                                 {{5, -1}, {6, 10}}};
+                                 {{5, -1}, {6, 10}},
+                                 {}};
 };
 
 TEST_F(TestSSHFSServerProcessSpec, program_correct)
@@ -64,6 +65,33 @@ TEST_F(TestSSHFSServerProcessSpec, arguments_correct)
     EXPECT_EQ(spec.arguments()[7], "0");
 }
 
+TEST_F(TestSSHFSServerProcessSpec, arguments_include_additional_mounts_before_log_level)
+{
+    config.additional_mounts.push_back({"other_source", "other_target", {{7, 8}}, {{9, 10}}});
+
+    mp::SSHFSServerProcessSpec spec(config);
+    ASSERT_EQ(spec.arguments().size(), 12);
+    EXPECT_EQ(spec.arguments()[3], "source_path");
+    EXPECT_EQ(spec.arguments()[4], "target_path");
+    EXPECT_EQ(spec.arguments()[7], "other_source");
+    EXPECT_EQ(spec.arguments()[8], "other_target");
+    EXPECT_EQ(spec.arguments()[9], "9:10,");
+    EXPECT_EQ(spec.arguments()[10], "7:8,");
+    EXPECT_EQ(spec.arguments()[11], "0");
+}
+
+TEST_F(TestSSHFSServerProcessSpec, apparmor_profile_allows_additional_sources)
+{
+    config.additional_mounts.push_back({"/other/source", "other_target", {}, {}});
+
+    mp::SSHFSServerProcessSpec spec(config);
+    const auto apparmor_profile = spec.apparmor_profile();
+
+    EXPECT_TRUE(apparmor_profile.contains("source_path/** rwlk,"));
+    EXPECT_TRUE(apparmor_profile.contains("/other/source/ rw,"));
+    EXPECT_TRUE(apparmor_profile.contains("/other/source/** rwlk,"));
+}
+
 TEST_F(TestSSHFSServerProcessSpec, environment_correct)
 {
     mp::SSHFSServerProcessSpec spec(config);
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "file_operations.h"
+#include "temp_dir.h"
+
+#include "src/daemon/sshfs_snap_cache.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+using namespace testing;
+
+namespace
+{
+struct SSHFSSnapCache : public Test
+{
+    // Downloads as snap download does, with the revision in the names
+    mp::SSHFSSnapCache::Download download_revision(const std::string& revision)
+    {
+        return [this, revision](const QString& directory) {
+            ++downloads;
+            mpt::make_file_with_content(QDir{directory}.filePath("multipass-sshfs_12.snap"), revision);
+            mpt::make_file_with_content(QDir{directory}.filePath("multipass-sshfs_12.assert"), "assertions");
+            return true;
+        };
+    }
+
+    void plant_copy(const std::string& contents, const QDateTime& modified)
+    {
+        for (const auto& name : {"multipass-sshfs.snap", "multipass-sshfs.assert"})
+        {
+            const auto path = QDir{cache_dir.path()}.filePath(name);
+            mpt::make_file_with_content(path, contents);
+
+            QFile file{path};
+            ASSERT_TRUE(file.open(QIODevice::ReadWrite));
+            ASSERT_TRUE(file.setFileTime(modified, QFileDevice::FileModificationTime));
+        }
+    }
+
+    mpt::TempDir cache_dir;
+    int downloads{0};
+};
+} // namespace
+
+TEST_F(SSHFSSnapCache, downloads_a_missing_copy_under_the_names_it_is_pushed_by)
+{
+    mp::SSHFSSnapCache cache{cache_dir.path(), download_revision("new")};
+
+    const auto files = cache.refresh();
+
+    ASSERT_TRUE(files);
+    EXPECT_EQ(downloads, 1);
+    EXPECT_EQ(files->snap, QDir{cache_dir.path()}.filePath("multipass-sshfs.snap"));
+    EXPECT_EQ(files->assertion, QDir{cache_dir.path()}.filePath("multipass-sshfs.assert"));
+    EXPECT_EQ(mpt::load(files->snap), "new");
+    EXPECT_THAT(QDir{cache_dir.path()}.entryList(QDir::AllEntries | QDir::NoDotAndDotDot),
+                UnorderedElementsAre("multipass-sshfs.snap", "multipass-sshfs.assert"));
+}
+
+TEST_F(SSHFSSnapCache, keeps_a_recent_copy)
+{
+    plant_copy("cached", QDateTime::currentDateTime().addDays(-1));
+    mp::SSHFSSnapCache cache{cache_dir.path(), download_revision("new")};
+
+    const auto files = cache.refresh();
+
+    ASSERT_TRUE(files);
+    EXPECT_EQ(downloads, 0);
+    EXPECT_EQ(mpt::load(files->snap), "cached");
+}
+
+TEST_F(SSHFSSnapCache, refreshes_an_old_copy)
+{
+    plant_copy("cached", QDateTime::currentDateTime().addDays(-30));
+    mp::SSHFSSnapCache cache{cache_dir.path(), download_revision("new")};
+
+    const auto files = cache.refresh();
+
+    ASSERT_TRUE(files);
+    EXPECT_EQ(downloads, 1);
+    EXPECT_EQ(mpt::load(files->snap), "new");
+}
+
+TEST_F(SSHFSSnapCache, falls_back_to_an_old_copy_when_the_download_fails)
+{
+    plant_copy("cached", QDateTime::currentDateTime().addDays(-30));
+    mp::SSHFSSnapCache cache{cache_dir.path(), [](const QString&) { return false; }};
+
+    const auto files = cache.refresh();
+
+    ASSERT_TRUE(files);
+    EXPECT_EQ(mpt::load(files->snap), "cached");
+}
+
+TEST_F(SSHFSSnapCache, has_nothing_to_give_without_a_copy_or_a_download)
+{
+    mp::SSHFSSnapCache cache{cache_dir.path(), [](const QString&) { return false; }};
+
+    EXPECT_FALSE(cache.refresh());
+}
+
+TEST_F(SSHFSSnapCache, ignores_a_download_that_did_not_bring_one_snap)
+{
+    mp::SSHFSSnapCache cache{cache_dir.path(), [](const QString& directory) {
+                                 mpt::make_file_with_content(QDir{directory}.filePath("multipass-sshfs_12.snap"));
+                                 return true;
+                             }};
+
+    EXPECT_FALSE(cache.refresh());
+}
+
+TEST_F(SSHFSSnapCache, downloads_again_once_discarded)
+{
+    mp::SSHFSSnapCache cache{cache_dir.path(), download_revision("new")};
+    ASSERT_TRUE(cache.refresh());
+
+    cache.discard();
+    ASSERT_TRUE(cache.refresh());
+
+    EXPECT_EQ(downloads, 2);
+}
@@ -16,6 +16,7 @@
  */
 
 #include <multipass/exceptions/sshfs_missing_error.h>
+#include <multipass/ssh/ssh_session.h>
 #include <multipass/sshfs_mount/sshfs_mounts.h>
 
 #include "mock_environment_helpers.h"
@@ -25,9 +26,12 @@
 #include "stub_ssh_key_provider.h"
 
 #include <QCoreApplication>
+#include <QEventLoop>
 #include <QTimer>
 #include <gmock/gmock.h>
 
+#include <chrono>
+
 namespace mp = multipass;
 namespace mpt = multipass::test;
 
@@ -96,6 +100,129 @@ TEST_F(SSHFSMountsTest, mount_creates_sshfs_process)
     EXPECT_EQ(sshfs_command.arguments[7], log_level_as_string);
 }
 
+TEST_F(SSHFSMountsTest, mount_passes_its_compression_on_to_sshfs_process)
+{
+    QProcessEnvironment environment;
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback([this, &environment](mpt::MockProcess* process) {
+        sshfs_prints_connected(process);
+        environment = process->process_environment();
+    });
+
+    mp::SSHFSMounts sshfs_mounts(key_provider);
+    NiceMock<mpt::MockVirtualMachine> vm{"my_instance"};
+
+    mp::SSHSession::set_compression(mp::SSHSession::Compression::never, 3);
+    sshfs_mounts.start_mount(&vm, source_path, target_path, gid_map, uid_map, "on");
+    mp::SSHSession::set_compression(mp::SSHSession::Compression::never);
+
+    EXPECT_EQ(environment.value("COMPRESSION"), QString::number(static_cast<int>(mp::SSHSession::Compression::always)));
+    EXPECT_EQ(environment.value("COMPRESSION_LEVEL"), "3");
+}
+
+TEST_F(SSHFSMountsTest, mount_without_compression_follows_the_daemon)
+{
+    QProcessEnvironment environment;
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback([this, &environment](mpt::MockProcess* process) {
+        sshfs_prints_connected(process);
+        environment = process->process_environment();
+    });
+
+    mp::SSHFSMounts sshfs_mounts(key_provider);
+    NiceMock<mpt::MockVirtualMachine> vm{"my_instance"};
+
+    mp::SSHSession::set_compression(mp::SSHSession::Compression::automatic);
+    sshfs_mounts.start_mount(&vm, source_path, target_path, gid_map, uid_map);
+    mp::SSHSession::set_compression(mp::SSHSession::Compression::never);
+
+    EXPECT_EQ(environment.value("COMPRESSION"),
+              QString::number(static_cast<int>(mp::SSHSession::Compression::automatic)));
+}
+
+TEST_F(SSHFSMountsTest, start_mounts_serves_all_from_one_sshfs_process)
+{
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback([](mpt::MockProcess* process) {
+        if (process->program().contains("sshfs_server"))
+        {
+            ON_CALL(*process, read_all_standard_output()).WillByDefault(Return("Connected\nConnected\n"));
+            QTimer::singleShot(100, process, [process]() { emit process->ready_read_standard_output(); });
+
+            mp::ProcessState running_state;
+            ON_CALL(*process, process_state()).WillByDefault(Return(running_state));
+        }
+    });
+
+    mp::SSHFSMounts sshfs_mounts(key_provider);
+    NiceMock<mpt::MockVirtualMachine> vm{"my_instance"};
+
+    sshfs_mounts.start_mounts(&vm, {{"/source/one", "/target/one", gid_map, uid_map},
+                                    {"/source/two", "/target/two", gid_map, uid_map}});
+
+    ASSERT_EQ(factory->process_list().size(), 1u);
+    auto sshfs_command = factory->process_list()[0];
+    ASSERT_EQ(sshfs_command.arguments.size(), 12);
+    EXPECT_EQ(sshfs_command.arguments[3], "/source/one");
+    EXPECT_EQ(sshfs_command.arguments[4], "/target/one");
+    EXPECT_EQ(sshfs_command.arguments[7], "/source/two");
+    EXPECT_EQ(sshfs_command.arguments[8], "/target/two");
+
+    EXPECT_TRUE(sshfs_mounts.has_instance_already_mounted(vm.vm_name, "/target/one"));
+    EXPECT_TRUE(sshfs_mounts.has_instance_already_mounted(vm.vm_name, "/target/two"));
+}
+
+TEST_F(SSHFSMountsTest, stop_mount_restarts_other_mounts_of_its_process_once_it_is_gone)
+{
+    mpt::MockProcess* first_process{nullptr};
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback([&first_process](mpt::MockProcess* process) {
+        if (process->program().contains("sshfs_server"))
+        {
+            const auto mounts = (process->arguments().size() - 4) / 4;
+            ON_CALL(*process, read_all_standard_output())
+                .WillByDefault(Return(QByteArray("Connected\n").repeated(mounts)));
+            QTimer::singleShot(100, process, [process]() { emit process->ready_read_standard_output(); });
+
+            mp::ProcessState running_state;
+            ON_CALL(*process, process_state()).WillByDefault(Return(running_state));
+            EXPECT_CALL(*process, wait_for_finished).Times(0); // not to hold up the caller
+
+            if (!first_process)
+                first_process = process;
+        }
+    });
+
+    mp::SSHFSMounts sshfs_mounts(key_provider);
+    NiceMock<mpt::MockVirtualMachine> vm{"my_instance"};
+
+    sshfs_mounts.start_mounts(&vm, {{"/source/one", "/target/one", gid_map, uid_map},
+                                    {"/source/two", "/target/two", gid_map, uid_map}});
+    EXPECT_TRUE(sshfs_mounts.stop_mount(vm.vm_name, "/target/one"));
+
+    EXPECT_EQ(factory->process_list().size(), 1u);
+    EXPECT_FALSE(sshfs_mounts.has_instance_already_mounted(vm.vm_name, "/target/two"));
+
+    ASSERT_NE(first_process, nullptr);
+    mp::ProcessState exit_state;
+    exit_state.exit_code = 0;
+    emit first_process->finished(exit_state);
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!sshfs_mounts.has_instance_already_mounted(vm.vm_name, "/target/two") &&
+           std::chrono::steady_clock::now() < deadline)
+        qApp->processEvents(QEventLoop::AllEvents, 10);
+
+    ASSERT_EQ(factory->process_list().size(), 2u);
+    auto sshfs_command = factory->process_list()[1];
+    ASSERT_EQ(sshfs_command.arguments.size(), 8);
+    EXPECT_EQ(sshfs_command.arguments[3], "/source/two");
+    EXPECT_EQ(sshfs_command.arguments[4], "/target/two");
+
+    EXPECT_FALSE(sshfs_mounts.has_instance_already_mounted(vm.vm_name, "/target/one"));
+    EXPECT_TRUE(sshfs_mounts.has_instance_already_mounted(vm.vm_name, "/target/two"));
+}
+
 TEST_F(SSHFSMountsTest, sshfs_process_failing_with_return_code_9_causes_exception)
 {
     auto factory = mpt::MockProcessFactory::Inject();
@@ -241,3 +368,77 @@ TEST_F(SSHFSMountsTest, has_instance_already_mounted_returns_false_when_no_such_
 
     EXPECT_FALSE(sshfs_mounts.has_instance_already_mounted("bad_vm_name", target_path));
 }
+
+TEST_F(SSHFSMountsTest, mount_stats_are_the_last_reported)
+{
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback([](mpt::MockProcess* process) {
+        if (process->program().contains("sshfs_server"))
+        {
+            EXPECT_CALL(*process, read_all_standard_output())
+                .WillOnce(Return("Connected\n"))
+                .WillOnce(Return("Stats {\"target_path\":\"/the/target/path\",\"bytes_read\":1"))
+                .WillRepeatedly(Return("0,\"operations\":{\"read\":{\"count\":2,\"seconds\":0.5}}}\n"));
+            QTimer::singleShot(100, process, [process]() { emit process->ready_read_standard_output(); });
+            QTimer::singleShot(150, process, [process]() { emit process->ready_read_standard_output(); });
+            QTimer::singleShot(200, process, [process]() { emit process->ready_read_standard_output(); });
+
+            mp::ProcessState running_state;
+            ON_CALL(*process, process_state()).WillByDefault(Return(running_state));
+        }
+    });
+
+    mp::SSHFSMounts sshfs_mounts(key_provider);
+    NiceMock<mpt::MockVirtualMachine> vm{"my_instance"};
+
+    sshfs_mounts.start_mount(&vm, source_path, target_path, gid_map, uid_map);
+    EXPECT_FALSE(sshfs_mounts.mount_stats(vm.vm_name, target_path));
+
+    QEventLoop event_loop;
+    QTimer::singleShot(300, &event_loop, &QEventLoop::quit);
+    event_loop.exec();
+
+    const auto stats = sshfs_mounts.mount_stats(vm.vm_name, target_path);
+    ASSERT_TRUE(stats);
+    EXPECT_EQ(stats->bytes_read, 10u);
+    EXPECT_EQ(stats->operations.at("read").count, 2u);
+    EXPECT_EQ(stats->operations.at("read").seconds, 0.5);
+}
+
+TEST_F(SSHFSMountsTest, activity_counts_one_session_per_process_and_the_operations_reported)
+{
+    auto factory = mpt::MockProcessFactory::Inject();
+    factory->register_callback([](mpt::MockProcess* process) {
+        if (process->program().contains("sshfs_server"))
+        {
+            EXPECT_CALL(*process, read_all_standard_output())
+                .WillOnce(Return("Connected\nConnected\n"))
+                .WillOnce(Return("Stats {\"target_path\":\"/target/one\",\"bytes_read\":0,"
+                                 "\"operations\":{\"read\":{\"count\":2,\"seconds\":0.5}}}\n"
+                                 "Stats {\"target_path\":\"/target/two\",\"bytes_read\":0,"
+                                 "\"operations\":{\"getattr\":{\"count\":3,\"seconds\":0.1}}}\n"))
+                .WillRepeatedly(Return(""));
+            QTimer::singleShot(100, process, [process]() { emit process->ready_read_standard_output(); });
+            QTimer::singleShot(150, process, [process]() { emit process->ready_read_standard_output(); });
+
+            mp::ProcessState running_state;
+            ON_CALL(*process, process_state()).WillByDefault(Return(running_state));
+        }
+    });
+
+    mp::SSHFSMounts sshfs_mounts(key_provider);
+    NiceMock<mpt::MockVirtualMachine> vm{"my_instance"};
+    EXPECT_EQ(sshfs_mounts.activity_of(vm.vm_name).sessions, 0u);
+
+    sshfs_mounts.start_mounts(&vm, {{"/source/one", "/target/one", gid_map, uid_map},
+                                    {"/source/two", "/target/two", gid_map, uid_map}});
+
+    QEventLoop event_loop;
+    QTimer::singleShot(300, &event_loop, &QEventLoop::quit);
+    event_loop.exec();
+
+    const auto activity = sshfs_mounts.activity_of(vm.vm_name);
+    EXPECT_EQ(activity.sessions, 1u);
+    EXPECT_EQ(activity.operations, 5u);
+    EXPECT_EQ(sshfs_mounts.activity_of("other_instance").operations, 0u);
+}
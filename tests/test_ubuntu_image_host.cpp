@@ -18,17 +18,20 @@
 #include "src/daemon/ubuntu_image_host.h"
 
 #include "extra_assertions.h"
+#include "file_operations.h"
 #include "image_host_remote_count.h"
 #include "mischievous_url_downloader.h"
 #include "mock_platform.h"
 #include "path.h"
 #include "stub_url_downloader.h"
+#include "temp_dir.h"
 
 #include <multipass/exceptions/unsupported_alias_exception.h>
 #include <multipass/exceptions/unsupported_image_exception.h>
 #include <multipass/exceptions/unsupported_remote_exception.h>
 #include <multipass/query.h>
 
+#include <QDir>
 #include <QUrl>
 
 #include <gmock/gmock.h>
@@ -302,22 +305,50 @@ TEST_F(UbuntuImageHost, handles_and_recovers_from_initial_network_failure)
     EXPECT_TRUE(host.info_for(query));
 }
 
-TEST_F(UbuntuImageHost, handles_and_recovers_from_later_network_failure)
+TEST_F(UbuntuImageHost, keeps_serving_manifests_through_later_network_failure)
 {
     const auto ttl = 0s; // to ensure updates are always retried
     mp::UbuntuVMImageHost host{all_remote_specs, &url_downloader, ttl};
 
     const auto query = make_query("xenial", release_remote_spec.first);
     EXPECT_TRUE(host.info_for(query));
+    host.wait_for_manifest_refresh();
 
     url_downloader.mischiefs = 1000;
-    EXPECT_THROW(host.info_for(query), std::runtime_error);
+    EXPECT_TRUE(host.info_for(query));
+    host.wait_for_manifest_refresh();
+    EXPECT_TRUE(host.info_for(query));
+    host.wait_for_manifest_refresh();
 
     url_downloader.mischiefs = 0;
     EXPECT_TRUE(host.info_for(query));
 }
 
-TEST_F(UbuntuImageHost, handles_and_recovers_from_independent_server_failures)
+TEST_F(UbuntuImageHost, serves_unchanged_manifests_after_refresh)
+{
+    const auto ttl = 0s; // to ensure updates always happen
+    mp::UbuntuVMImageHost host{all_remote_specs, &url_downloader, ttl};
+
+    const auto release_query = make_query("xenial", release_remote_spec.first);
+    const auto daily_query = make_query("xenial", daily_remote_spec.first);
+    const auto release_info = host.info_for(release_query);
+    const auto daily_info = host.info_for(daily_query);
+    ASSERT_TRUE(release_info);
+    ASSERT_TRUE(daily_info);
+
+    for (auto i = 0; i < 3; ++i)
+    {
+        auto info = host.info_for(release_query);
+        ASSERT_TRUE(info);
+        EXPECT_THAT(info->id, Eq(release_info->id));
+
+        info = host.info_for(daily_query);
+        ASSERT_TRUE(info);
+        EXPECT_THAT(info->id, Eq(daily_info->id));
+    }
+}
+
+TEST_F(UbuntuImageHost, keeps_serving_remotes_through_independent_server_failures)
 {
     const auto ttl = 0h;
     mp::UbuntuVMImageHost host{all_remote_specs, &url_downloader, ttl};
@@ -327,9 +358,47 @@ TEST_F(UbuntuImageHost, handles_and_recovers_from_independent_server_failures)
 
     for (size_t i = 0; i < num_remotes; ++i)
     {
+        host.wait_for_manifest_refresh();
         url_downloader.mischiefs = i;
-        EXPECT_EQ(mpt::count_remotes(host), num_remotes - i);
+        EXPECT_EQ(mpt::count_remotes(host), num_remotes);
+        host.wait_for_manifest_refresh();
+        EXPECT_EQ(mpt::count_remotes(host), num_remotes);
+    }
+}
+
+TEST_F(UbuntuImageHost, serves_cached_manifests_after_restart_and_offline)
+{
+    mpt::TempDir cache_dir;
+    const auto cache_path = QDir{cache_dir.path()}.filePath("ubuntu");
+    const auto query = make_query("xenial", release_remote_spec.first);
+    {
+        mp::UbuntuVMImageHost host{all_remote_specs, &url_downloader, default_ttl, cache_path};
+        EXPECT_TRUE(host.info_for(query));
     }
+
+    url_downloader.mischiefs = 1000;
+    mp::UbuntuVMImageHost host{all_remote_specs, &url_downloader, default_ttl, cache_path};
+
+    auto info = host.info_for(query);
+    ASSERT_TRUE(info);
+    EXPECT_THAT(info->image_location, Eq(expected_location));
+    EXPECT_THAT(info->id, Eq(expected_id));
+
+    host.wait_for_manifest_refresh();
+    EXPECT_TRUE(host.info_for(query));
+    EXPECT_EQ(mpt::count_remotes(host), 2u);
+}
+
+TEST_F(UbuntuImageHost, ignores_damaged_manifest_cache)
+{
+    mpt::TempDir cache_dir;
+    const auto cache_path = QDir{cache_dir.path()}.filePath("ubuntu");
+    mpt::make_file_with_content(cache_path, "not a cache");
+
+    url_downloader.mischiefs = 1000;
+    mp::UbuntuVMImageHost host{all_remote_specs, &url_downloader, default_ttl, cache_path};
+
+    EXPECT_THROW(host.info_for(make_query("xenial", release_remote_spec.first)), std::runtime_error);
 }
 
 TEST_F(UbuntuImageHost, throws_unsupported_image_when_image_not_supported)
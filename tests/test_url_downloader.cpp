@@ -20,11 +20,13 @@
 #include <multipass/format.h>
 
 #include "extra_assertions.h"
+#include "file_operations.h"
 #include "mock_file_ops.h"
 #include "mock_logger.h"
 #include "mock_network.h"
 #include "temp_dir.h"
 
+#include <QCryptographicHash>
 #include <QTimer>
 
 #include <gtest/gtest.h>
@@ -87,6 +89,90 @@ TEST_F(URLDownloader, simpleDownloadReturnsExpectedData)
     EXPECT_EQ(downloaded_data, test_data);
 }
 
+TEST_F(URLDownloader, rangeDownloadAsksForTheRangeAndReturnsIt)
+{
+    const QByteArray test_data{"answer"};
+    mpt::MockQNetworkReply* mock_reply = new mpt::MockQNetworkReply();
+
+    EXPECT_CALL(*mock_network_access_manager, createRequest(_, _, _))
+        .WillOnce([&mock_reply](auto, const QNetworkRequest& request, auto) {
+            EXPECT_EQ(request.rawHeader("Range"), "bytes=4-9");
+
+            QTimer::singleShot(0, [&mock_reply] {
+                mock_reply->set_attribute(QNetworkRequest::HttpStatusCodeAttribute, 206);
+                mock_reply->readyRead();
+                mock_reply->finished();
+            });
+            return mock_reply;
+        });
+
+    EXPECT_CALL(*mock_reply, readData(_, _))
+        .WillOnce([&test_data](char* data, auto) {
+            auto data_size{test_data.size()};
+            memcpy(data, test_data.constData(), data_size);
+
+            return data_size;
+        })
+        .WillRepeatedly(Return(0));
+
+    mp::URLDownloader downloader(cache_dir.path(), 1s);
+
+    EXPECT_EQ(downloader.download_range(fake_url, 4, 10), test_data);
+}
+
+TEST_F(URLDownloader, rangeDownloadThrowsWhenTheRangeComesShort)
+{
+    const QByteArray test_data{"ans"};
+    mpt::MockQNetworkReply* mock_reply = new mpt::MockQNetworkReply();
+
+    EXPECT_CALL(*mock_network_access_manager, createRequest(_, _, _)).WillOnce([&mock_reply](auto...) {
+        QTimer::singleShot(0, [&mock_reply] {
+            mock_reply->set_attribute(QNetworkRequest::HttpStatusCodeAttribute, 206);
+            mock_reply->readyRead();
+            mock_reply->finished();
+        });
+        return mock_reply;
+    });
+
+    EXPECT_CALL(*mock_reply, readData(_, _))
+        .WillOnce([&test_data](char* data, auto) {
+            auto data_size{test_data.size()};
+            memcpy(data, test_data.constData(), data_size);
+
+            return data_size;
+        })
+        .WillRepeatedly(Return(0));
+
+    mp::URLDownloader downloader(cache_dir.path(), 1s);
+
+    MP_EXPECT_THROW_THAT(downloader.download_range(fake_url, 4, 10), mp::DownloadException,
+                         mpt::match_what(HasSubstr("expected bytes 4-9, got 3 bytes")));
+}
+
+TEST_F(URLDownloader, downloadsFromSameThreadReuseNetworkManager)
+{
+    mpt::MockQNetworkReply* first_reply = new mpt::MockQNetworkReply();
+    mpt::MockQNetworkReply* second_reply = new mpt::MockQNetworkReply();
+
+    // The fixture only allows the factory to make one manager
+    EXPECT_CALL(*mock_network_access_manager, createRequest(_, _, _))
+        .WillOnce(Return(first_reply))
+        .WillOnce(Return(second_reply));
+
+    EXPECT_CALL(*first_reply, readData(_, _)).WillRepeatedly(Return(0));
+    EXPECT_CALL(*second_reply, readData(_, _)).WillRepeatedly(Return(0));
+
+    logger_scope.mock_logger->screen_logs(mpl::Level::trace);
+
+    mp::URLDownloader downloader(cache_dir.path(), 1s);
+
+    QTimer::singleShot(0, [&first_reply] { first_reply->finished(); });
+    downloader.download(fake_url);
+
+    QTimer::singleShot(0, [&second_reply] { second_reply->finished(); });
+    downloader.download(fake_url);
+}
+
 TEST_F(URLDownloader, simpleDownloadNetworkTimeoutTriesCache)
 {
     mpt::MockQNetworkReply* mock_reply_abort = new mpt::MockQNetworkReply();
@@ -272,6 +358,355 @@ TEST_F(URLDownloader, fileDownloadErrorTriesCache)
     EXPECT_EQ(file_data, test_data);
 }
 
+TEST_F(URLDownloader, fileDownloadAndHashReturnsDigestOfDownloadedData)
+{
+    mpt::MockQNetworkReply* mock_reply = new mpt::MockQNetworkReply();
+    const QByteArray test_data{"This is some data to put in a file when downloaded."};
+
+    EXPECT_CALL(*mock_network_access_manager, createRequest(_, _, _)).WillOnce([&mock_reply, &test_data](auto...) {
+        QTimer::singleShot(0, [&mock_reply, &test_data] {
+            mock_reply->downloadProgress(test_data.size(), test_data.size());
+            mock_reply->readyRead();
+            mock_reply->finished();
+        });
+        return mock_reply;
+    });
+
+    EXPECT_CALL(*mock_reply, readData(_, _))
+        .WillOnce([&test_data](char* data, auto) {
+            auto data_size{test_data.size()};
+            memcpy(data, test_data.constData(), data_size);
+
+            return data_size;
+        })
+        .WillRepeatedly(Return(0));
+
+    auto progress_monitor = [](auto...) { return true; };
+
+    mp::URLDownloader downloader(cache_dir.path(), 1ms);
+
+    mpt::TempDir file_dir;
+    QString download_file{file_dir.path() + "/foo.txt"};
+
+    const auto hash = downloader.download_and_hash_to(fake_url, download_file, test_data.size(), -1, progress_monitor);
+
+    EXPECT_EQ(hash, QCryptographicHash::hash(test_data, QCryptographicHash::Sha256).toHex());
+
+    QFile test_file{download_file};
+    ASSERT_TRUE(test_file.exists());
+
+    test_file.open(QIODevice::ReadOnly);
+    EXPECT_EQ(test_file.readAll(), test_data);
+}
+
+TEST_F(URLDownloader, fileDownloadWithoutRangeSupportUsesSingleConnection)
+{
+    mpt::MockQNetworkReply* mock_head_reply = new mpt::MockQNetworkReply();
+    mpt::MockQNetworkReply* mock_reply = new mpt::MockQNetworkReply();
+    const QByteArray test_data{"This is some data to put in a file when downloaded."};
+
+    EXPECT_CALL(*mock_network_access_manager, createRequest(QNetworkAccessManager::HeadOperation, _, _))
+        .WillOnce([&mock_head_reply](auto...) {
+            QTimer::singleShot(0, [&mock_head_reply] { mock_head_reply->finished(); });
+            return mock_head_reply;
+        });
+
+    EXPECT_CALL(*mock_network_access_manager, createRequest(QNetworkAccessManager::GetOperation, _, _))
+        .WillOnce([&mock_reply, &test_data](auto...) {
+            QTimer::singleShot(0, [&mock_reply, &test_data] {
+                mock_reply->downloadProgress(test_data.size(), test_data.size());
+                mock_reply->readyRead();
+                mock_reply->finished();
+            });
+            return mock_reply;
+        });
+
+    EXPECT_CALL(*mock_reply, readData(_, _))
+        .WillOnce([&test_data](char* data, auto) {
+            auto data_size{test_data.size()};
+            memcpy(data, test_data.constData(), data_size);
+
+            return data_size;
+        })
+        .WillRepeatedly(Return(0));
+
+    auto progress_monitor = [](auto...) { return true; };
+
+    logger_scope.mock_logger->screen_logs(mpl::Level::trace);
+    logger_scope.mock_logger->expect_log(mpl::Level::trace,
+                                         fmt::format("Found {} in cache: false", fake_url.toString()));
+
+    mp::URLDownloader downloader(cache_dir.path(), 1s, 4);
+
+    mpt::TempDir file_dir;
+    QString download_file{file_dir.path() + "/foo.txt"};
+
+    downloader.download_to(fake_url, download_file, -1, -1, progress_monitor);
+
+    QFile test_file{download_file};
+    ASSERT_TRUE(test_file.exists());
+
+    test_file.open(QIODevice::ReadOnly);
+    EXPECT_EQ(test_file.readAll(), test_data);
+}
+
+TEST_F(URLDownloader, fileDownloadWithRangeSupportFetchesRangesConcurrently)
+{
+    constexpr auto range_size = 16 * 1024 * 1024;
+    QByteArray test_data(2 * range_size, '\0');
+    for (auto i = 0; i < test_data.size(); i += 4096)
+        test_data[i] = static_cast<char>(i / 4096);
+
+    mpt::MockQNetworkReply* mock_head_reply = new mpt::MockQNetworkReply();
+    EXPECT_CALL(*mock_network_access_manager, createRequest(QNetworkAccessManager::HeadOperation, _, _))
+        .WillOnce([&mock_head_reply, &test_data](auto...) {
+            mock_head_reply->set_raw_header("Accept-Ranges", "bytes");
+            mock_head_reply->set_header(QNetworkRequest::ContentLengthHeader, test_data.size());
+            QTimer::singleShot(0, [&mock_head_reply] { mock_head_reply->finished(); });
+            return mock_head_reply;
+        });
+
+    // Each range is served from its own reply, in pieces no bigger than asked for
+    std::vector<QByteArray> requested_ranges;
+    std::vector<qint64> served(2, 0);
+    EXPECT_CALL(*mock_network_access_manager, createRequest(QNetworkAccessManager::GetOperation, _, _))
+        .Times(2)
+        .WillRepeatedly([&](auto, const QNetworkRequest& request, auto) {
+            const auto i = requested_ranges.size();
+            requested_ranges.push_back(request.rawHeader("Range"));
+
+            auto mock_reply = new mpt::MockQNetworkReply();
+            EXPECT_CALL(*mock_reply, readData(_, _)).WillRepeatedly([&, i](char* data, qint64 max_size) {
+                const auto size = std::min<qint64>(max_size, range_size - served[i]);
+                memcpy(data, test_data.constData() + i * range_size + served[i], size);
+                served[i] += size;
+                return size;
+            });
+
+            QTimer::singleShot(0, [mock_reply] {
+                mock_reply->set_attribute(QNetworkRequest::HttpStatusCodeAttribute, 206);
+                mock_reply->readyRead();
+                mock_reply->finished();
+            });
+            return mock_reply;
+        });
+
+    auto progress_monitor = [](auto...) { return true; };
+
+    mp::URLDownloader downloader(cache_dir.path(), 1s, 2);
+
+    mpt::TempDir file_dir;
+    QString download_file{file_dir.path() + "/foo.img"};
+
+    const auto hash = downloader.download_and_hash_to(fake_url, download_file, -1, -1, progress_monitor);
+
+    EXPECT_THAT(requested_ranges,
+                ElementsAre(QByteArray::fromStdString(fmt::format("bytes=0-{}", range_size - 1)),
+                            QByteArray::fromStdString(fmt::format("bytes={}-{}", range_size, 2 * range_size - 1))));
+    EXPECT_EQ(hash, QCryptographicHash::hash(test_data, QCryptographicHash::Sha256).toHex());
+    EXPECT_EQ(mpt::load(download_file), test_data);
+}
+
+TEST_F(URLDownloader, fileDownloadResumesPartialDownload)
+{
+    mpt::MockQNetworkReply* mock_reply = new mpt::MockQNetworkReply();
+    const QByteArray partial_data{"This is some data "};
+    const QByteArray remaining_data{"to put in a file when downloaded."};
+
+    mpt::TempDir file_dir;
+    QString download_file{file_dir.path() + "/foo.txt"};
+    mpt::make_file_with_content(download_file + ".partial", partial_data.toStdString());
+    mpt::make_file_with_content(
+        download_file + ".partial.json",
+        fmt::format(R"({{"url": "{}", "offset": {}, "etag": "\"1234\"", "last_modified": ""}})",
+                    fake_url.toString(), partial_data.size()));
+
+    EXPECT_CALL(*mock_network_access_manager, createRequest(_, _, _))
+        .WillOnce([&mock_reply, &remaining_data, &partial_data](auto, const QNetworkRequest& request, auto) {
+            EXPECT_EQ(request.rawHeader("Range"),
+                      QByteArray::fromStdString(fmt::format("bytes={}-", partial_data.size())));
+            EXPECT_EQ(request.rawHeader("If-Range"), "\"1234\"");
+
+            QTimer::singleShot(0, [&mock_reply, &remaining_data] {
+                mock_reply->set_attribute(QNetworkRequest::HttpStatusCodeAttribute, 206);
+                mock_reply->downloadProgress(remaining_data.size(), remaining_data.size());
+                mock_reply->readyRead();
+                mock_reply->finished();
+            });
+            return mock_reply;
+        });
+
+    EXPECT_CALL(*mock_reply, readData(_, _))
+        .WillOnce([&remaining_data](char* data, auto) {
+            auto data_size{remaining_data.size()};
+            memcpy(data, remaining_data.constData(), data_size);
+
+            return data_size;
+        })
+        .WillRepeatedly(Return(0));
+
+    auto progress_monitor = [](auto...) { return true; };
+
+    logger_scope.mock_logger->screen_logs(mpl::Level::info);
+    logger_scope.mock_logger->expect_log(mpl::Level::info, "Resuming download");
+
+    mp::URLDownloader downloader(cache_dir.path(), 1s, 1, true);
+
+    const auto hash = downloader.download_and_hash_to(fake_url, download_file, -1, -1, progress_monitor);
+
+    EXPECT_EQ(hash, QCryptographicHash::hash(partial_data + remaining_data, QCryptographicHash::Sha256).toHex());
+    EXPECT_FALSE(QFile::exists(download_file + ".partial"));
+    EXPECT_FALSE(QFile::exists(download_file + ".partial.json"));
+
+    QFile test_file{download_file};
+    ASSERT_TRUE(test_file.exists());
+
+    test_file.open(QIODevice::ReadOnly);
+    EXPECT_EQ(test_file.readAll(), partial_data + remaining_data);
+}
+
+TEST_F(URLDownloader, fileDownloadResumesPartialDownloadHandedOverFromAnotherMirror)
+{
+    mpt::MockQNetworkReply* mock_reply = new mpt::MockQNetworkReply();
+    const QUrl mirror_url{"http://a.fake.mirror"};
+    const QByteArray partial_data{"This is some data "};
+    const QByteArray remaining_data{"to put in a file when downloaded."};
+    const QByteArray last_modified{"Tue, 25 Jun 2019 13:15:00 GMT"};
+
+    mpt::TempDir file_dir;
+    QString download_file{file_dir.path() + "/foo.txt"};
+    mpt::make_file_with_content(download_file + ".partial", partial_data.toStdString());
+    mpt::make_file_with_content(
+        download_file + ".partial.json",
+        fmt::format(R"({{"url": "{}", "offset": {}, "etag": "\"1234\"", "last_modified": "{}"}})",
+                    fake_url.toString(), partial_data.size(), last_modified));
+
+    // The ETag is the first mirror's own, so only the modification time can vouch for the file on the next one
+    EXPECT_CALL(*mock_network_access_manager, createRequest(_, _, _))
+        .WillOnce([&](auto, const QNetworkRequest& request, auto) {
+            EXPECT_EQ(request.url(), mirror_url);
+            EXPECT_EQ(request.rawHeader("Range"),
+                      QByteArray::fromStdString(fmt::format("bytes={}-", partial_data.size())));
+            EXPECT_EQ(request.rawHeader("If-Range"), last_modified);
+
+            QTimer::singleShot(0, [&mock_reply, &remaining_data] {
+                mock_reply->set_attribute(QNetworkRequest::HttpStatusCodeAttribute, 206);
+                mock_reply->downloadProgress(remaining_data.size(), remaining_data.size());
+                mock_reply->readyRead();
+                mock_reply->finished();
+            });
+            return mock_reply;
+        });
+
+    EXPECT_CALL(*mock_reply, readData(_, _))
+        .WillOnce([&remaining_data](char* data, auto) {
+            auto data_size{remaining_data.size()};
+            memcpy(data, remaining_data.constData(), data_size);
+
+            return data_size;
+        })
+        .WillRepeatedly(Return(0));
+
+    auto progress_monitor = [](auto...) { return true; };
+
+    logger_scope.mock_logger->screen_logs(mpl::Level::info);
+    logger_scope.mock_logger->expect_log(mpl::Level::info, "Resuming download");
+
+    mp::URLDownloader downloader(cache_dir.path(), 1s, 1, true);
+
+    downloader.hand_over_partial_download(fake_url, mirror_url, download_file);
+    downloader.download_to(mirror_url, download_file, -1, -1, progress_monitor);
+
+    QFile test_file{download_file};
+    ASSERT_TRUE(test_file.open(QIODevice::ReadOnly));
+    EXPECT_EQ(test_file.readAll(), partial_data + remaining_data);
+}
+
+TEST_F(URLDownloader, fileDownloadStartsOverWhenThePartialDownloadHandedOverIsOfAnotherUrl)
+{
+    mpt::MockQNetworkReply* mock_reply = new mpt::MockQNetworkReply();
+    const QUrl mirror_url{"http://a.fake.mirror"};
+    const QByteArray test_data{"This is some data to put in a file when downloaded."};
+
+    mpt::TempDir file_dir;
+    QString download_file{file_dir.path() + "/foo.txt"};
+    mpt::make_file_with_content(download_file + ".partial", "data");
+    mpt::make_file_with_content(download_file + ".partial.json",
+                                R"({"url": "http://elsewhere", "offset": 4, "etag": "\"1234\"", "last_modified": ""})");
+
+    EXPECT_CALL(*mock_network_access_manager, createRequest(_, _, _))
+        .WillOnce([&mock_reply, &test_data](auto, const QNetworkRequest& request, auto) {
+            EXPECT_FALSE(request.hasRawHeader("Range"));
+
+            QTimer::singleShot(0, [&mock_reply, &test_data] {
+                mock_reply->downloadProgress(test_data.size(), test_data.size());
+                mock_reply->readyRead();
+                mock_reply->finished();
+            });
+            return mock_reply;
+        });
+
+    EXPECT_CALL(*mock_reply, readData(_, _))
+        .WillOnce([&test_data](char* data, auto) {
+            auto data_size{test_data.size()};
+            memcpy(data, test_data.constData(), data_size);
+
+            return data_size;
+        })
+        .WillRepeatedly(Return(0));
+
+    auto progress_monitor = [](auto...) { return true; };
+
+    mp::URLDownloader downloader(cache_dir.path(), 1s, 1, true);
+
+    downloader.hand_over_partial_download(fake_url, mirror_url, download_file);
+    downloader.download_to(mirror_url, download_file, -1, -1, progress_monitor);
+
+    QFile test_file{download_file};
+    ASSERT_TRUE(test_file.open(QIODevice::ReadOnly));
+    EXPECT_EQ(test_file.readAll(), test_data);
+}
+
+TEST_F(URLDownloader, fileDownloadKeepsPartialDownloadOnError)
+{
+    mpt::MockQNetworkReply* mock_reply = new mpt::MockQNetworkReply();
+    const QByteArray test_data{"This is some data "};
+
+    EXPECT_CALL(*mock_reply, abort()).WillOnce([&mock_reply] { mock_reply->abort_operation(); });
+
+    EXPECT_CALL(*mock_network_access_manager, createRequest(_, _, _)).WillOnce([&mock_reply](auto...) {
+        QTimer::singleShot(0, [&mock_reply] {
+            mock_reply->set_raw_header("ETag", "\"1234\"");
+            mock_reply->readyRead();
+            mock_reply->downloadProgress(1000, 1000);
+        });
+        return mock_reply;
+    });
+
+    EXPECT_CALL(*mock_reply, readData(_, _))
+        .WillOnce([&test_data](char* data, auto) {
+            auto data_size{test_data.size()};
+            memcpy(data, test_data.constData(), data_size);
+
+            return data_size;
+        })
+        .WillRepeatedly(Return(0));
+
+    auto progress_monitor = [](auto...) { return false; };
+
+    mp::URLDownloader downloader(cache_dir.path(), 1s, 1, true);
+
+    mpt::TempDir file_dir;
+    QString download_file{file_dir.path() + "/foo.txt"};
+
+    EXPECT_THROW(downloader.download_to(fake_url, download_file, -1, -1, progress_monitor),
+                 mp::AbortedDownloadException);
+
+    EXPECT_FALSE(QFile::exists(download_file));
+    EXPECT_TRUE(QFile::exists(download_file + ".partial"));
+    EXPECT_TRUE(QFile::exists(download_file + ".partial.json"));
+}
+
 TEST_F(URLDownloader, fileDownloadMonitorReturnFalseAborts)
 {
     mpt::MockQNetworkReply* mock_reply = new mpt::MockQNetworkReply();
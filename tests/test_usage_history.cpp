@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "src/daemon/usage_history.h"
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+using namespace testing;
+
+namespace
+{
+struct UsageHistory : public Test
+{
+    mp::UsageHistory::Sample sample_at(int seconds, long long cpu_time_ms, long long memory_used)
+    {
+        return {start + std::chrono::seconds{seconds}, cpu_time_ms, 0, 0, memory_used, mp::nullopt};
+    }
+
+    const mp::UsageHistory::Clock::time_point start = mp::UsageHistory::Clock::now();
+    mp::UsageHistory history{4};
+};
+} // namespace
+
+TEST_F(UsageHistory, turns_counters_into_rates)
+{
+    history.add("foo", sample_at(0, 0, 100));
+    history.add("foo", sample_at(10, 5000, 300));
+
+    const auto points = history.history("foo", 0);
+
+    ASSERT_EQ(points.size(), 1u);
+    EXPECT_EQ(points[0].time, start + std::chrono::seconds{10});
+    EXPECT_DOUBLE_EQ(*points[0].cpu_cores, 0.5);
+    EXPECT_EQ(*points[0].memory_used, 300);
+    EXPECT_FALSE(points[0].disk_used);
+}
+
+TEST_F(UsageHistory, downsamples_to_as_many_points_as_asked_for)
+{
+    history.add("foo", sample_at(0, 0, 0));
+    history.add("foo", sample_at(10, 10000, 100));
+    history.add("foo", sample_at(20, 10000, 300));
+
+    const auto points = history.history("foo", 1);
+
+    ASSERT_EQ(points.size(), 1u);
+    EXPECT_DOUBLE_EQ(*points[0].cpu_cores, 0.5);
+    EXPECT_EQ(*points[0].memory_used, 200);
+}
+
+TEST_F(UsageHistory, keeps_no_more_than_its_capacity)
+{
+    for (auto i = 0; i < 6; ++i)
+        history.add("foo", sample_at(i * 10, i * 1000, i));
+
+    const auto points = history.history("foo", 0);
+
+    ASSERT_EQ(points.size(), 3u);
+    EXPECT_EQ(points.front().time, start + std::chrono::seconds{30});
+    EXPECT_EQ(points.back().time, start + std::chrono::seconds{50});
+}
+
+TEST_F(UsageHistory, counts_counters_restarting_from_zero)
+{
+    history.add("foo", sample_at(0, 8000, 0));
+    history.add("foo", sample_at(10, 2000, 0));
+
+    EXPECT_DOUBLE_EQ(*history.history("foo", 0)[0].cpu_cores, 0.2);
+}
+
+TEST_F(UsageHistory, forgets_instances)
+{
+    history.add("foo", sample_at(0, 0, 0));
+    history.add("foo", sample_at(10, 0, 0));
+    history.forget("foo");
+
+    EXPECT_TRUE(history.history("foo", 0).empty());
+}
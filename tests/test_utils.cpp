@@ -260,6 +260,18 @@ TEST(Utils, try_action_does_not_timeout)
     EXPECT_TRUE(action_called);
 }
 
+TEST(Utils, try_action_retries_sooner_at_first)
+{
+    auto tries = 0;
+    auto retry_action = [&tries] {
+        ++tries;
+        return mp::utils::TimeoutAction::retry;
+    };
+    mp::utils::try_action_for([] {}, std::chrono::seconds(1), retry_action);
+
+    EXPECT_GE(tries, 3);
+}
+
 TEST(Utils, uuid_has_no_curly_brackets)
 {
     auto uuid = mp::utils::make_uuid();
@@ -534,6 +546,31 @@ TEST(Utils, wait_for_cloud_init_error_times_out_throws)
                          mpt::match_what(StrEq("timed out waiting for initialization to complete")));
 }
 
+TEST(Utils, wait_for_cloud_init_keeps_to_one_ssh_session)
+{
+    auto connections = 0;
+    REPLACE(ssh_connect, [&connections](auto...) {
+        ++connections;
+        return SSH_OK;
+    });
+    REPLACE(ssh_is_connected, [](auto...) { return true; });
+    REPLACE(ssh_channel_open_session, [](auto...) { return SSH_OK; });
+    REPLACE(ssh_userauth_publickey, [](auto...) { return SSH_OK; });
+    REPLACE(ssh_channel_request_exec, [](auto...) { return SSH_OK; });
+
+    mpt::ExitStatusMock exit_status_mock;
+    exit_status_mock.return_exit_code(SSH_ERROR);
+
+    mp::test::StubSSHKeyProvider key_provider;
+    NiceMock<mpt::MockVirtualMachine> vm{"my_instance"};
+
+    EXPECT_CALL(vm, ensure_vm_is_running()).WillRepeatedly(Return());
+
+    std::chrono::milliseconds timeout(500);
+    EXPECT_THROW(MP_UTILS.wait_for_cloud_init(&vm, timeout, key_provider), std::runtime_error);
+    EXPECT_EQ(connections, 1);
+}
+
 TEST(Utils, wait_for_cloud_init_cannot_connect_times_out)
 {
     REPLACE(ssh_connect, [](auto...) { return SSH_OK; });
@@ -566,6 +603,33 @@ TEST(VaultUtils, copy_creates_new_file_and_returned_path_exists)
     EXPECT_TRUE(QFile::exists(new_file_path));
 }
 
+TEST(VaultUtils, copy_preserves_contents_around_runs_of_zeros)
+{
+    mpt::TempDir temp_dir1, temp_dir2;
+    auto orig_file_path = QDir(temp_dir1.path()).filePath("test_file");
+
+    const auto contents = std::string(10000, '\0') + "some data" + std::string(3 * 1024 * 1024, '\0');
+    mpt::make_file_with_content(orig_file_path, contents);
+
+    auto new_file_path = mp::vault::copy(orig_file_path, temp_dir2.path());
+
+    EXPECT_EQ(mpt::load(new_file_path).toStdString(), contents);
+}
+
+TEST(VaultUtils, copy_preserves_contents_across_batches)
+{
+    mpt::TempDir temp_dir1, temp_dir2;
+    auto orig_file_path = QDir(temp_dir1.path()).filePath("test_file");
+
+    const auto contents = std::string(9 * 1024 * 1024, '\0') + "some data" + std::string(8 * 1024 * 1024, 'x') +
+                          std::string(5 * 1024 * 1024 + 7, '\0');
+    mpt::make_file_with_content(orig_file_path, contents);
+
+    auto new_file_path = mp::vault::copy(orig_file_path, temp_dir2.path());
+
+    EXPECT_EQ(mpt::load(new_file_path).toStdString(), contents);
+}
+
 TEST(VaultUtils, copy_returns_empty_path_when_file_name_is_empty)
 {
     mpt::TempDir temp_dir;
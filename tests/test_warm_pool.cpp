@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mock_settings.h"
+
+#include "src/daemon/warm_pool.h"
+
+#include <multipass/constants.h>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+
+namespace
+{
+struct WarmPool : public Test
+{
+    mp::WarmPoolSpec spec{2, "", "default", 1, mp::MemorySize{"1G"}, mp::MemorySize{"5G"}};
+    mp::LaunchRequest request;
+};
+} // namespace
+
+TEST_F(WarmPool, spec_comes_from_the_settings)
+{
+    auto& mock_settings = mpt::MockSettings::mock_instance();
+    EXPECT_CALL(mock_settings, get(_)).Times(AnyNumber());
+    EXPECT_CALL(mock_settings, get(Eq(mp::warm_pool_size_key))).WillRepeatedly(Return("3"));
+    EXPECT_CALL(mock_settings, get(Eq(mp::warm_pool_image_key))).WillRepeatedly(Return("daily:focal"));
+    EXPECT_CALL(mock_settings, get(Eq(mp::warm_pool_cpus_key))).WillRepeatedly(Return("2"));
+
+    const auto from_settings = mp::WarmPoolSpec::from_settings();
+
+    EXPECT_EQ(from_settings.size, 3);
+    EXPECT_EQ(from_settings.remote_name, "daily");
+    EXPECT_EQ(from_settings.image, "focal");
+    EXPECT_EQ(from_settings.num_cores, 2);
+    EXPECT_EQ(from_settings.mem_size, mp::MemorySize{mp::default_memory_size});
+    EXPECT_EQ(from_settings.disk_space, mp::MemorySize{mp::default_disk_size});
+}
+
+TEST_F(WarmPool, instance_names_are_not_hostnames)
+{
+    const auto name = mp::WarmPoolSpec::instance_name(0);
+
+    EXPECT_TRUE(mp::WarmPoolSpec::is_pool_instance(name));
+    EXPECT_FALSE(mp::WarmPoolSpec::is_pool_instance("warm-pool-0"));
+    EXPECT_NE(name.find('.'), std::string::npos);
+}
+
+TEST_F(WarmPool, plain_launch_with_defaults_matches)
+{
+    request.set_image("default");
+    request.set_mem_size("1G");
+    request.set_time_zone("Europe/London");
+
+    EXPECT_TRUE(spec.matches(request));
+}
+
+TEST_F(WarmPool, pool_launch_request_matches_its_spec)
+{
+    EXPECT_TRUE(spec.matches(spec.launch_request(mp::WarmPoolSpec::instance_name(1))));
+}
+
+TEST_F(WarmPool, launch_asking_for_more_does_not_match)
+{
+    request.set_mem_size("1G");
+    request.set_num_cores(4);
+
+    EXPECT_FALSE(spec.matches(request));
+}
+
+TEST_F(WarmPool, launch_with_user_data_or_networks_does_not_match)
+{
+    request.set_mem_size("1G");
+    request.set_cloud_init_user_data("packages: [git]");
+
+    EXPECT_FALSE(spec.matches(request));
+
+    request.clear_cloud_init_user_data();
+    request.add_network_options()->set_id("eth0");
+
+    EXPECT_FALSE(spec.matches(request));
+}
+
+TEST_F(WarmPool, empty_pool_matches_nothing)
+{
+    spec.size = 0;
+    request.set_mem_size("1G");
+
+    EXPECT_FALSE(spec.matches(request));
+}
+
+TEST_F(WarmPool, handover_sets_the_hostname_and_nothing_else_without_a_time_zone)
+{
+    EXPECT_THAT(mp::warm_pool_handover_commands("primary", ""),
+                ElementsAre("sudo hostnamectl set-hostname primary"));
+}
+
+TEST_F(WarmPool, handover_sets_the_time_zone_asked_for)
+{
+    EXPECT_THAT(mp::warm_pool_handover_commands("primary", "Europe/London"),
+                ElementsAre("sudo hostnamectl set-hostname primary", "sudo timedatectl set-timezone Europe/London"));
+}
+
+TEST_F(WarmPool, handover_keeps_the_time_zone_from_the_shell)
+{
+    const auto commands = mp::warm_pool_handover_commands("primary", "UTC'; touch /pwned; echo '");
+
+    ASSERT_EQ(commands.size(), 2u);
+    EXPECT_EQ(commands[1], R"(sudo timedatectl set-timezone UTC\'\;\ touch\ /pwned\;\ echo\ \')");
+}
@@ -75,7 +75,7 @@ TEST_F(VMWorkflowProvider, fetchWorkflowForUnknownWorkflowThrows)
 {
     mp::DefaultVMWorkflowProvider workflow_provider{workflows_zip_url, &url_downloader, cache_dir.path(), default_ttl};
 
-    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
+    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
 
     EXPECT_THROW(workflow_provider.fetch_workflow_for("phony", vm_desc), std::out_of_range);
 }
@@ -91,7 +91,7 @@ TEST_F(VMWorkflowProvider, invalidImageSchemeThrows)
 {
     mp::DefaultVMWorkflowProvider workflow_provider{workflows_zip_url, &url_downloader, cache_dir.path(), default_ttl};
 
-    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
+    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
 
     MP_EXPECT_THROW_THAT(workflow_provider.fetch_workflow_for("invalid-image-workflow", vm_desc),
                          mp::InvalidWorkflowException, mpt::match_what(StrEq("Unsupported image scheme in Workflow")));
@@ -101,7 +101,7 @@ TEST_F(VMWorkflowProvider, invalidMinCoresThrows)
 {
     mp::DefaultVMWorkflowProvider workflow_provider{workflows_zip_url, &url_downloader, cache_dir.path(), default_ttl};
 
-    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
+    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
 
     MP_EXPECT_THROW_THAT(workflow_provider.fetch_workflow_for("invalid-cpu-workflow", vm_desc),
                          mp::InvalidWorkflowException,
@@ -112,7 +112,7 @@ TEST_F(VMWorkflowProvider, invalidMinMemorySizeThrows)
 {
     mp::DefaultVMWorkflowProvider workflow_provider{workflows_zip_url, &url_downloader, cache_dir.path(), default_ttl};
 
-    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
+    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
 
     MP_EXPECT_THROW_THAT(workflow_provider.fetch_workflow_for("invalid-memory-size-workflow", vm_desc),
                          mp::InvalidWorkflowException,
@@ -123,7 +123,7 @@ TEST_F(VMWorkflowProvider, invalidMinDiskSpaceThrows)
 {
     mp::DefaultVMWorkflowProvider workflow_provider{workflows_zip_url, &url_downloader, cache_dir.path(), default_ttl};
 
-    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
+    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
 
     MP_EXPECT_THROW_THAT(workflow_provider.fetch_workflow_for("invalid-disk-space-workflow", vm_desc),
                          mp::InvalidWorkflowException,
@@ -134,7 +134,7 @@ TEST_F(VMWorkflowProvider, fetchTestWorkflow1ReturnsExpectedInfo)
 {
     mp::DefaultVMWorkflowProvider workflow_provider{workflows_zip_url, &url_downloader, cache_dir.path(), default_ttl};
 
-    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
+    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
 
     auto query = workflow_provider.fetch_workflow_for("test-workflow1", vm_desc);
 
@@ -151,7 +151,7 @@ TEST_F(VMWorkflowProvider, fetchTestWorkflow2ReturnsExpectedInfo)
 {
     mp::DefaultVMWorkflowProvider workflow_provider{workflows_zip_url, &url_downloader, cache_dir.path(), default_ttl};
 
-    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
+    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
 
     auto query = workflow_provider.fetch_workflow_for("test-workflow2", vm_desc);
 
@@ -207,7 +207,7 @@ TEST_F(VMWorkflowProvider, invalidCloudInitThrows)
 {
     mp::DefaultVMWorkflowProvider workflow_provider{workflows_zip_url, &url_downloader, cache_dir.path(), default_ttl};
 
-    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
+    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
 
     const std::string workflow{"invalid-cloud-init-workflow"};
 
@@ -220,7 +220,7 @@ TEST_F(VMWorkflowProvider, givenCoresLessThanMinimumThrows)
 {
     mp::DefaultVMWorkflowProvider workflow_provider{workflows_zip_url, &url_downloader, cache_dir.path(), default_ttl};
 
-    mp::VirtualMachineDescription vm_desc{1, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
+    mp::VirtualMachineDescription vm_desc{1, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
 
     MP_EXPECT_THROW_THAT(workflow_provider.fetch_workflow_for("test-workflow1", vm_desc), mp::WorkflowMinimumException,
                          mpt::match_what(AllOf(HasSubstr("Number of CPUs"), HasSubstr("2"))));
@@ -230,7 +230,7 @@ TEST_F(VMWorkflowProvider, givenMemLessThanMinimumThrows)
 {
     mp::DefaultVMWorkflowProvider workflow_provider{workflows_zip_url, &url_downloader, cache_dir.path(), default_ttl};
 
-    mp::VirtualMachineDescription vm_desc{0, mp::MemorySize{"1G"}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
+    mp::VirtualMachineDescription vm_desc{0, mp::MemorySize{"1G"}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
 
     MP_EXPECT_THROW_THAT(workflow_provider.fetch_workflow_for("test-workflow1", vm_desc), mp::WorkflowMinimumException,
                          mpt::match_what(AllOf(HasSubstr("Memory size"), HasSubstr("2G"))));
@@ -240,7 +240,7 @@ TEST_F(VMWorkflowProvider, givenDiskSpaceLessThanMinimumThrows)
 {
     mp::DefaultVMWorkflowProvider workflow_provider{workflows_zip_url, &url_downloader, cache_dir.path(), default_ttl};
 
-    mp::VirtualMachineDescription vm_desc{0, {}, mp::MemorySize{"20G"}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
+    mp::VirtualMachineDescription vm_desc{0, {}, mp::MemorySize{"20G"}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
 
     MP_EXPECT_THROW_THAT(workflow_provider.fetch_workflow_for("test-workflow1", vm_desc), mp::WorkflowMinimumException,
                          mpt::match_what(AllOf(HasSubstr("Disk space"), HasSubstr("25G"))));
@@ -251,7 +251,7 @@ TEST_F(VMWorkflowProvider, higherOptionsIsNotOverriden)
     mp::DefaultVMWorkflowProvider workflow_provider{workflows_zip_url, &url_downloader, cache_dir.path(), default_ttl};
 
     mp::VirtualMachineDescription vm_desc{
-        4, mp::MemorySize{"4G"}, mp::MemorySize{"50G"}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
+        4, mp::MemorySize{"4G"}, mp::MemorySize{"50G"}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
 
     workflow_provider.fetch_workflow_for("test-workflow1", vm_desc);
 
@@ -340,6 +340,23 @@ TEST_F(VMWorkflowProvider, updatesWorkflowsWhenNeeded)
     workflow_provider.all_workflows();
 }
 
+TEST_F(VMWorkflowProvider, doesNotReadUnchangedArchiveAgain)
+{
+    auto [mock_poco_zip_utils, guard] = mpt::MockPocoZipUtils::inject();
+    EXPECT_CALL(*mock_poco_zip_utils, zip_archive_for(_)).WillOnce([](std::ifstream& zip_stream) {
+        return Poco::Zip::ZipArchive{zip_stream};
+    });
+
+    mp::DefaultVMWorkflowProvider workflow_provider{workflows_zip_url, &url_downloader, cache_dir.path(),
+                                                    std::chrono::milliseconds(0)};
+
+    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
+    auto query = workflow_provider.fetch_workflow_for("test-workflow2", vm_desc);
+
+    EXPECT_EQ(query.release, "bionic");
+    EXPECT_EQ(workflow_provider.info_for("test-workflow2").release_title, "Another test workflow");
+}
+
 TEST_F(VMWorkflowProvider, downloadFailureOnStartupLogsErrorAndDoesNotThrow)
 {
     const std::string error_msg{"There is a problem, Houston."};
@@ -480,7 +497,7 @@ TEST_F(VMWorkflowProvider, noImageDefinedReturnsDefault)
 {
     mp::DefaultVMWorkflowProvider workflow_provider{workflows_zip_url, &url_downloader, cache_dir.path(), default_ttl};
 
-    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
+    mp::VirtualMachineDescription vm_desc{0, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}};
 
     auto query = workflow_provider.fetch_workflow_for("no-image-workflow", vm_desc);
 
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define XZ_USE_CRC64
+#include <xz.h>
+
+#include <gmock/gmock.h>
+
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+
+namespace
+{
+// Bit at a time, as a reference the folded CRCs have to agree with
+template <typename T>
+T bitwise_crc(const std::uint8_t* buf, std::size_t size, T crc, T poly)
+{
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        crc ^= buf[i];
+        for (auto bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (poly & (T{0} - (crc & 1)));
+    }
+
+    return ~crc;
+}
+
+std::uint32_t reference_crc32(const std::uint8_t* buf, std::size_t size, std::uint32_t crc)
+{
+    return bitwise_crc<std::uint32_t>(buf, size, crc, 0xEDB88320);
+}
+
+std::uint64_t reference_crc64(const std::uint8_t* buf, std::size_t size, std::uint64_t crc)
+{
+    return bitwise_crc<std::uint64_t>(buf, size, crc, 0xC96C5795D7870F42);
+}
+
+struct XzCrc : public Test
+{
+    XzCrc()
+    {
+        xz_crc32_init();
+        xz_crc64_init();
+    }
+
+    std::vector<std::uint8_t> random_bytes(std::size_t size)
+    {
+        std::vector<std::uint8_t> bytes(size);
+        for (auto& byte : bytes)
+            byte = static_cast<std::uint8_t>(byte_dist(gen));
+
+        return bytes;
+    }
+
+    std::mt19937 gen{42};
+    std::uniform_int_distribution<int> byte_dist{0, 255};
+};
+} // namespace
+
+TEST_F(XzCrc, matches_check_values)
+{
+    const auto check = reinterpret_cast<const std::uint8_t*>("123456789");
+
+    EXPECT_EQ(xz_crc32(check, 9, 0), 0xCBF43926u);
+    EXPECT_EQ(xz_crc64(check, 9, 0), 0x995DC9BBDF1939FAu);
+}
+
+TEST_F(XzCrc, matches_reference_on_random_sized_buffers)
+{
+    // Sizes around and well past the 64 bytes it takes to fold, at every alignment of the first byte
+    std::uniform_int_distribution<std::size_t> size_dist{0, 4096};
+    const auto bytes = random_bytes(4096 + 16);
+
+    for (auto i = 0; i < 500; ++i)
+    {
+        const auto size = i < 160 ? static_cast<std::size_t>(i) : size_dist(gen);
+        const auto buf = bytes.data() + i % 16;
+
+        ASSERT_EQ(xz_crc32(buf, size, 0), reference_crc32(buf, size, 0)) << "size " << size;
+        ASSERT_EQ(xz_crc64(buf, size, 0), reference_crc64(buf, size, 0)) << "size " << size;
+    }
+}
+
+TEST_F(XzCrc, carries_on_across_split_buffers)
+{
+    std::uniform_int_distribution<std::size_t> size_dist{0, 8192};
+
+    for (auto i = 0; i < 200; ++i)
+    {
+        const auto bytes = random_bytes(size_dist(gen));
+        const auto split = std::uniform_int_distribution<std::size_t>{0, bytes.size()}(gen);
+        const auto rest = bytes.size() - split;
+
+        EXPECT_EQ(xz_crc32(bytes.data() + split, rest, xz_crc32(bytes.data(), split, 0)),
+                  reference_crc32(bytes.data(), bytes.size(), 0));
+        EXPECT_EQ(xz_crc64(bytes.data() + split, rest, xz_crc64(bytes.data(), split, 0)),
+                  reference_crc64(bytes.data(), bytes.size(), 0));
+    }
+}
+
+TEST_F(XzCrc, agrees_across_threads)
+{
+    const auto bytes = random_bytes(1024 * 1024);
+    const auto expected32 = reference_crc32(bytes.data(), bytes.size(), 0);
+    const auto expected64 = reference_crc64(bytes.data(), bytes.size(), 0);
+
+    std::vector<std::uint32_t> crc32s(4);
+    std::vector<std::uint64_t> crc64s(4);
+    std::vector<std::thread> threads;
+    for (auto i = 0u; i < crc32s.size(); ++i)
+        threads.emplace_back([&bytes, &crc32s, &crc64s, i] {
+            crc32s[i] = xz_crc32(bytes.data(), bytes.size(), 0);
+            crc64s[i] = xz_crc64(bytes.data(), bytes.size(), 0);
+        });
+
+    for (auto& thread : threads)
+        thread.join();
+
+    EXPECT_THAT(crc32s, Each(expected32));
+    EXPECT_THAT(crc64s, Each(expected64));
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/vm_image_vault.h>
+#include <multipass/xz_image_decoder.h>
+
+#include "file_operations.h"
+#include "temp_dir.h"
+
+#include <QDir>
+#include <QFile>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+using namespace testing;
+
+namespace
+{
+struct XzImageDecoder : public Test
+{
+    // What test_data/image.img.xz holds: mostly zeros, like a disk image, with some data in between
+    static QByteArray image_data()
+    {
+        QByteArray data(4 * 1024 * 1024, '\0');
+        data.replace(1024 * 1024, 13, "some contents");
+        return data;
+    }
+
+    mpt::TempDir temp_dir;
+    const QByteArray compressed{mpt::load_test_file("image.img.xz")};
+    const QString xz_path{QDir{temp_dir.path()}.filePath("image.img.xz")};
+    const QString decoded_path{QDir{temp_dir.path()}.filePath("image.img")};
+    mp::ProgressMonitor stub_monitor{[](int, int) { return true; }};
+};
+} // namespace
+
+TEST_F(XzImageDecoder, decodes_image)
+{
+    mpt::make_file_with_content(xz_path, compressed.toStdString());
+
+    mp::XzImageDecoder{xz_path}.decode_to(decoded_path, stub_monitor);
+
+    EXPECT_EQ(mpt::load(decoded_path), image_data());
+}
+
+TEST_F(XzImageDecoder, decodes_block_split_image)
+{
+    // Made with xz -T4 --block-size=1MiB, so that each of the four blocks can be decoded on its own
+    const auto blocks_path = QDir{temp_dir.path()}.filePath("image-blocks.img.xz");
+    mpt::make_file_with_content(blocks_path, mpt::load_test_file("image-blocks.img.xz").toStdString());
+
+    auto last_progress = -1;
+    mp::XzImageDecoder{blocks_path}.decode_to(decoded_path, [&last_progress](int, int progress) {
+        EXPECT_GE(progress, last_progress);
+        last_progress = progress;
+        return true;
+    });
+
+    EXPECT_EQ(mpt::load(decoded_path), image_data());
+    EXPECT_LE(last_progress, 100);
+}
+
+TEST_F(XzImageDecoder, throws_on_corrupt_block)
+{
+    auto corrupt = mpt::load_test_file("image-blocks.img.xz");
+    corrupt[40] = static_cast<char>(corrupt[40] ^ 0xff); // in the data of the first block, past its header
+    const auto blocks_path = QDir{temp_dir.path()}.filePath("image-blocks.img.xz");
+    mpt::make_file_with_content(blocks_path, corrupt.toStdString());
+
+    EXPECT_THROW(mp::XzImageDecoder{blocks_path}.decode_to(decoded_path, stub_monitor), std::runtime_error);
+}
+
+TEST_F(XzImageDecoder, stream_decodes_chunks_as_they_come)
+{
+    mp::XzStreamDecoder decoder{decoded_path};
+    for (auto pos = 0; pos < compressed.size(); pos += 7)
+        ASSERT_TRUE(decoder.write(compressed.mid(pos, 7)));
+    decoder.finish();
+
+    EXPECT_EQ(mpt::load(decoded_path), image_data());
+}
+
+TEST_F(XzImageDecoder, stream_decodes_through_a_small_queue)
+{
+    mp::XzStreamDecoder decoder{decoded_path, 1};
+    for (auto pos = 0; pos < compressed.size(); pos += 3)
+        ASSERT_TRUE(decoder.write(compressed.mid(pos, 3)));
+    decoder.finish();
+
+    EXPECT_EQ(mpt::load(decoded_path), image_data());
+}
+
+TEST_F(XzImageDecoder, throws_on_truncated_data)
+{
+    mp::XzStreamDecoder decoder{decoded_path};
+    decoder.write(compressed.left(compressed.size() - 4));
+
+    EXPECT_THROW(decoder.finish(), std::runtime_error);
+}
+
+TEST_F(XzImageDecoder, stops_wanting_data_once_corrupt)
+{
+    mp::XzStreamDecoder decoder{decoded_path, 4};
+
+    // Decoding runs behind the writes, but a full queue has them wait until it gave up
+    auto wanted = true;
+    for (auto i = 0; i < 16 && wanted; ++i)
+        wanted = decoder.write("not xz at all");
+
+    EXPECT_FALSE(wanted);
+    EXPECT_THROW(decoder.finish(), std::runtime_error);
+}
+
+TEST_F(XzImageDecoder, extract_image_takes_xz_suffix_off)
+{
+    mpt::make_file_with_content(xz_path, compressed.toStdString());
+
+    EXPECT_TRUE(mp::vault::is_compressed_image(xz_path));
+    EXPECT_EQ(mp::vault::extract_image(xz_path, stub_monitor), decoded_path);
+    EXPECT_FALSE(QFile::exists(xz_path));
+    EXPECT_EQ(mpt::load(decoded_path), image_data());
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <multipass/vm_image_vault.h>
+#include <multipass/zstd_image_decoder.h>
+
+#include "file_operations.h"
+#include "temp_dir.h"
+
+#include <QDir>
+#include <QFile>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+
+using namespace testing;
+
+namespace
+{
+struct ZstdImageDecoder : public Test
+{
+    static QByteArray compress(const QByteArray& data)
+    {
+        QByteArray compressed(static_cast<int>(ZSTD_compressBound(data.size())), '\0');
+        const auto size = ZSTD_compress(compressed.data(), compressed.size(), data.constData(), data.size(), 3);
+        compressed.resize(static_cast<int>(size));
+        return compressed;
+    }
+
+    // Mostly zeros, like a disk image, with some data in between
+    static QByteArray image_data()
+    {
+        QByteArray data(4 * 1024 * 1024, '\0');
+        data.replace(1024 * 1024, 13, "some contents");
+        return data;
+    }
+
+    mpt::TempDir temp_dir;
+    const QString zstd_path{QDir{temp_dir.path()}.filePath("image.img.zst")};
+    const QString decoded_path{QDir{temp_dir.path()}.filePath("image.img")};
+    mp::ProgressMonitor stub_monitor{[](int, int) { return true; }};
+};
+} // namespace
+
+TEST_F(ZstdImageDecoder, decodes_image)
+{
+    mpt::make_file_with_content(zstd_path, compress(image_data()).toStdString());
+
+    mp::ZstdImageDecoder{zstd_path}.decode_to(decoded_path, stub_monitor);
+
+    EXPECT_EQ(mpt::load(decoded_path), image_data());
+}
+
+TEST_F(ZstdImageDecoder, decodes_concatenated_frames)
+{
+    const auto data = image_data();
+    mpt::make_file_with_content(zstd_path, (compress(data) + compress(data)).toStdString());
+
+    mp::ZstdImageDecoder{zstd_path}.decode_to(decoded_path, stub_monitor);
+
+    EXPECT_EQ(mpt::load(decoded_path), data + data);
+}
+
+TEST_F(ZstdImageDecoder, stream_decodes_chunks_as_they_come)
+{
+    const auto compressed = compress(image_data());
+
+    mp::ZstdStreamDecoder decoder{decoded_path};
+    for (auto pos = 0; pos < compressed.size(); pos += 7)
+        ASSERT_TRUE(decoder.write(compressed.mid(pos, 7)));
+    decoder.finish();
+
+    EXPECT_EQ(mpt::load(decoded_path), image_data());
+}
+
+TEST_F(ZstdImageDecoder, throws_on_truncated_data)
+{
+    const auto compressed = compress(image_data());
+
+    mp::ZstdStreamDecoder decoder{decoded_path};
+    decoder.write(compressed.left(compressed.size() - 4));
+
+    EXPECT_THROW(decoder.finish(), std::runtime_error);
+}
+
+TEST_F(ZstdImageDecoder, stops_wanting_data_once_corrupt)
+{
+    mp::ZstdStreamDecoder decoder{decoded_path};
+
+    EXPECT_FALSE(decoder.write("not zstd at all"));
+    EXPECT_THROW(decoder.finish(), std::runtime_error);
+}
+
+TEST_F(ZstdImageDecoder, extract_image_takes_zst_suffix_off)
+{
+    mpt::make_file_with_content(zstd_path, compress(image_data()).toStdString());
+
+    EXPECT_TRUE(mp::vault::is_compressed_image(zstd_path));
+    EXPECT_EQ(mp::vault::extract_image(zstd_path, stub_monitor), decoded_path);
+    EXPECT_FALSE(QFile::exists(zstd_path));
+    EXPECT_EQ(mpt::load(decoded_path), image_data());
+}
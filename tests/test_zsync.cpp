@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "temp_dir.h"
+#include "zsync_control_file.h"
+
+#include "src/daemon/zsync.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+
+#include <gmock/gmock.h>
+
+namespace mp = multipass;
+namespace mpt = multipass::test;
+using namespace testing;
+
+namespace
+{
+constexpr auto block_size = 16;
+
+QByteArray block_of(char c)
+{
+    return QByteArray(block_size, c);
+}
+
+QByteArray control_file_for(const QByteArray& data, int seq_matches = 2, int rsum_bytes = 3, int checksum_bytes = 5)
+{
+    return mpt::zsync_control_file_for(data, block_size, seq_matches, rsum_bytes, checksum_bytes);
+}
+
+struct ZSync : public Test
+{
+    QString seed_with(const QByteArray& data)
+    {
+        const auto path = QDir{temp_dir.path()}.filePath("seed.img");
+        QFile file{path};
+        file.open(QIODevice::WriteOnly);
+        file.write(data);
+        return path;
+    }
+
+    mpt::TempDir temp_dir;
+};
+} // namespace
+
+TEST_F(ZSync, parses_header_and_checksums)
+{
+    const auto data = block_of('a') + block_of('b') + "tail";
+    const auto control = mp::zsync::parse(control_file_for(data));
+
+    EXPECT_EQ(control.length, data.size());
+    EXPECT_EQ(control.block_size, block_size);
+    EXPECT_EQ(control.seq_matches, 2);
+    EXPECT_EQ(control.rsum_bytes, 3);
+    EXPECT_EQ(control.checksum_bytes, 5);
+    EXPECT_EQ(control.url, "image.img");
+    EXPECT_EQ(control.block_count(), 3);
+    ASSERT_EQ(control.rsums.size(), 3u);
+    EXPECT_EQ(control.rsums[0], mp::zsync::rsum(block_of('a').constData(), block_size) & 0xffffff);
+    EXPECT_EQ(control.checksums[1], QCryptographicHash::hash(block_of('b'), QCryptographicHash::Md4).left(5));
+}
+
+TEST_F(ZSync, rejects_truncated_checksums)
+{
+    const auto control = control_file_for(block_of('a') + block_of('b'));
+
+    EXPECT_THROW(mp::zsync::parse(control.left(control.size() - 1)), std::runtime_error);
+}
+
+TEST_F(ZSync, rejects_compressed_files)
+{
+    auto control = control_file_for(block_of('a'));
+    control.replace("URL: image.img\n", "Z-URL: image.img.gz\n");
+
+    EXPECT_THROW(mp::zsync::parse(control), std::runtime_error);
+}
+
+TEST_F(ZSync, rejects_files_without_header)
+{
+    EXPECT_THROW(mp::zsync::parse("Blocksize: 16\nLength: 16"), std::runtime_error);
+}
+
+TEST_F(ZSync, finds_blocks_that_moved_in_the_seed)
+{
+    const auto data = block_of('a') + block_of('b') + block_of('c') + block_of('d');
+    const auto control = mp::zsync::parse(control_file_for(data));
+
+    // Shifted by a few bytes, with the third block changed
+    const auto seed = seed_with("xyz" + block_of('a') + block_of('b') + block_of('q') + block_of('d'));
+
+    EXPECT_THAT(mp::zsync::match(control, seed), ElementsAre(3, 3 + block_size, -1, -1));
+}
+
+TEST_F(ZSync, finds_single_blocks_without_sequential_matches)
+{
+    const auto data = block_of('a') + block_of('b') + block_of('c');
+    const auto control = mp::zsync::parse(control_file_for(data, 1, 4, 16));
+    const auto seed = seed_with(block_of('c') + "xy" + block_of('a'));
+
+    EXPECT_THAT(mp::zsync::match(control, seed), ElementsAre(block_size + 2, -1, 0));
+}
+
+TEST_F(ZSync, finds_the_whole_of_an_identical_seed)
+{
+    QByteArray data;
+    for (auto c = 'a'; c <= 'h'; ++c)
+        data += block_of(c);
+
+    const auto control = mp::zsync::parse(control_file_for(data));
+    const auto sources = mp::zsync::match(control, seed_with(data));
+
+    for (auto block = 0u; block < sources.size(); ++block)
+        EXPECT_EQ(sources[block], static_cast<qint64>(block) * block_size);
+}
+
+TEST_F(ZSync, finds_nothing_in_a_missing_seed)
+{
+    const auto control = mp::zsync::parse(control_file_for(block_of('a') + block_of('b')));
+
+    EXPECT_THAT(mp::zsync::match(control, QDir{temp_dir.path()}.filePath("none.img")), ElementsAre(-1, -1));
+}
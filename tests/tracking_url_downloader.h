@@ -19,16 +19,17 @@
 #define MULTIPASS_TRACKING_URL_DOWNLOADER_H
 
 #include "file_operations.h"
+#include "stub_url_downloader.h"
 
-#include <multipass/url_downloader.h>
+#include <mutex>
 
 namespace multipass
 {
 namespace test
 {
-struct TrackingURLDownloader : public URLDownloader
+struct TrackingURLDownloader : public StubURLDownloader
 {
-    TrackingURLDownloader(const std::string& content) : URLDownloader{std::chrono::seconds(10)}, content{content}
+    TrackingURLDownloader(const std::string& content) : content{content}
     {
     }
 
@@ -40,21 +41,19 @@ struct TrackingURLDownloader : public URLDownloader
                      const ProgressMonitor&) override
     {
         make_file_with_content(file_name, content);
+
+        std::lock_guard<decltype(mutex)> lock{mutex}; // kernel and initrd download alongside the image
         downloaded_urls << url.toString();
         downloaded_files << file_name;
     }
 
-    QByteArray download(const QUrl& url) override
-    {
-        return {};
-    }
-
     QDateTime last_modified(const QUrl& url) override
     {
         return QDateTime::currentDateTime();
     }
 
     const std::string content;
+    std::mutex mutex;
     QStringList downloaded_files;
     QStringList downloaded_urls;
 };
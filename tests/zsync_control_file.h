@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2021 Canonical, Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MULTIPASS_ZSYNC_CONTROL_FILE_H
+#define MULTIPASS_ZSYNC_CONTROL_FILE_H
+
+#include "src/daemon/zsync.h"
+
+#include <QByteArray>
+#include <QCryptographicHash>
+
+namespace multipass
+{
+namespace test
+{
+// What zsyncmake writes for data, with the given number of bytes kept of each checksum
+inline QByteArray zsync_control_file_for(const QByteArray& data, int block_size, int seq_matches = 2,
+                                         int rsum_bytes = 3, int checksum_bytes = 5)
+{
+    QByteArray control = "zsync: 0.6.2\nFilename: image.img\nBlocksize: " + QByteArray::number(block_size) +
+                         "\nLength: " + QByteArray::number(data.size()) + "\nHash-Lengths: " +
+                         QByteArray::number(seq_matches) + ',' + QByteArray::number(rsum_bytes) + ',' +
+                         QByteArray::number(checksum_bytes) + "\nURL: image.img\n\n";
+
+    for (auto offset = 0; offset < data.size(); offset += block_size)
+    {
+        auto block = data.mid(offset, block_size);
+        block.append(QByteArray(block_size - block.size(), '\0'));
+
+        const auto rsum = zsync::rsum(block.constData(), block.size());
+        for (auto i = rsum_bytes - 1; i >= 0; --i)
+            control.append(static_cast<char>(rsum >> (8 * i)));
+        control.append(QCryptographicHash::hash(block, QCryptographicHash::Md4).left(checksum_bytes));
+    }
+
+    return control;
+}
+} // namespace test
+} // namespace multipass
+#endif // MULTIPASS_ZSYNC_CONTROL_FILE_H